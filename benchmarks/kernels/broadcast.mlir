@@ -0,0 +1,5 @@
+// A bias add, broadcasting a row across a matrix.
+func @broadcast_add(%matrix: tensor<?x?xf32>, %row: tensor<?xf32>) -> tensor<?x?xf32> {
+  %0 = tcf.add %matrix, %row : (tensor<?x?xf32>, tensor<?xf32>) -> tensor<?x?xf32>
+  return %0 : tensor<?x?xf32>
+}
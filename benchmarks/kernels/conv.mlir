@@ -0,0 +1,5 @@
+// A single unpadded, unit-stride convolution.
+func @conv_2d_nchw(%input: tensor<?x?x?x?xf32>, %filter: tensor<?x?x?x?xf32>) -> tensor<?x?x?x?xf32> {
+  %0 = tcf.conv_2d_nchw %input, %filter : (tensor<?x?x?x?xf32>, tensor<?x?x?x?xf32>) -> tensor<?x?x?x?xf32>
+  return %0 : tensor<?x?x?x?xf32>
+}
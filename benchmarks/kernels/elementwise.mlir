@@ -0,0 +1,9 @@
+// A chain of elementwise ops, which fusion should turn into a single pass over
+// memory.
+func @elementwise_chain(%a: tensor<?xf32>, %b: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = tcf.add %a, %b : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  %1 = tcf.mul %0, %a : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  %2 = tcf.exp %1 : tensor<?xf32>
+  %3 = tcf.tanh %2 : tensor<?xf32>
+  return %3 : tensor<?xf32>
+}
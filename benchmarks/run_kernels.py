@@ -0,0 +1,216 @@
+#!/usr/bin/env python3
+# Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+"""Runs the kernel benchmarks and reports them against the machine roofline.
+
+Each kernel in `kernels/` is compiled through the TCF RefBackend lowering
+pipeline and benchmarked by npcomp-run-mlir, which reports its GFLOP/s and
+GB/s and the fraction of the roofline that it reaches. The roofline is made of
+the peak memory bandwidth, measured by npcomp-run-mlir unless given, and the
+peak compute throughput, which must be given with --peak-gflops for the
+compute-bound kernels to be compared against it.
+
+To gate a change on the kernels, record a baseline before it:
+
+  run_kernels.py --json-output=baseline.json
+
+and compare against it after:
+
+  run_kernels.py --baseline=baseline.json --tolerance=0.1
+
+which fails if any kernel's roofline fraction dropped by more than 10% of its
+baseline value. --min-fraction fails on kernels below an absolute fraction.
+
+To compare two machines (such as an x86 and an AArch64 one), record the
+results of one with --json-output and run on the other with
+--compare=<results>, which reports the speedup of each kernel and the roofline
+fractions reached on both machines, without failing.
+"""
+
+import argparse
+import json
+import os
+import platform
+import subprocess
+import sys
+
+KERNELS_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                           "kernels")
+
+
+def _tensor(*extents):
+  return "random : tensor<{}xf32>".format("x".join(str(e) for e in extents))
+
+
+def _conv_flops(n, c, h, w, f, kh, kw):
+  return 2 * n * f * (h - kh + 1) * (w - kw + 1) * c * kh * kw
+
+
+# Each kernel is a function of a file of `kernels/`, with its inputs and the
+# floating-point operations of one call.
+KERNELS = [
+    dict(name="matmul_256", file="matmul.mlir", function="matmul",
+         args=[_tensor(256, 256), _tensor(256, 256)],
+         flops=2 * 256 * 256 * 256),
+    dict(name="matmul_1024", file="matmul.mlir", function="matmul",
+         args=[_tensor(1024, 1024), _tensor(1024, 1024)],
+         flops=2 * 1024 * 1024 * 1024),
+    dict(name="conv_3x3", file="conv.mlir", function="conv_2d_nchw",
+         args=[_tensor(1, 64, 58, 58), _tensor(64, 64, 3, 3)],
+         flops=_conv_flops(1, 64, 58, 58, 64, 3, 3)),
+    dict(name="conv_1x1", file="conv.mlir", function="conv_2d_nchw",
+         args=[_tensor(1, 256, 28, 28), _tensor(256, 256, 1, 1)],
+         flops=_conv_flops(1, 256, 28, 28, 256, 1, 1)),
+    dict(name="elementwise_chain", file="elementwise.mlir",
+         function="elementwise_chain",
+         args=[_tensor(1 << 22), _tensor(1 << 22)],
+         flops=4 * (1 << 22)),
+    dict(name="broadcast_add", file="broadcast.mlir", function="broadcast_add",
+         args=[_tensor(2048, 2048), _tensor(2048)],
+         flops=2048 * 2048),
+    dict(name="pad", file="pad.mlir", function="pad",
+         args=[_tensor(2048, 2048)],
+         flops=0),
+]
+
+
+def run_kernel(kernel, args):
+  command = [
+      args.npcomp_run_mlir,
+      os.path.join(KERNELS_DIR, kernel["file"]),
+      "-invoke", kernel["function"],
+      "-shared-libs=" + args.runtime_shlib,
+      "-benchmark-iterations={}".format(args.iterations),
+      "-warmup={}".format(args.warmup),
+      "-benchmark-format=json",
+      "-roofline",
+      "-flops-per-call={}".format(kernel["flops"]),
+  ]
+  command += ["-arg-value=" + arg for arg in kernel["args"]]
+  if args.optimize:
+    command.append("-optimize")
+  if args.prefetch_distance:
+    command.append("-prefetch-distance={}".format(args.prefetch_distance))
+  if args.tuning_database:
+    command.append("-tuning-database=" + args.tuning_database)
+  if args.autotune:
+    command.append("-autotune")
+  if args.mcpu:
+    command.append("-mcpu=" + args.mcpu)
+  if args.mattr:
+    command.append("-mattr=" + args.mattr)
+  if args.peak_gflops:
+    command.append("-peak-gflops={}".format(args.peak_gflops))
+  if args.peak_gbps:
+    command.append("-peak-gbps={}".format(args.peak_gbps))
+  output = subprocess.run(command, check=True, stdout=subprocess.PIPE,
+                          universal_newlines=True).stdout
+  return json.loads(output)
+
+
+def main():
+  parser = argparse.ArgumentParser(
+      description=__doc__, formatter_class=argparse.RawTextHelpFormatter)
+  parser.add_argument("--npcomp-run-mlir", default="npcomp-run-mlir",
+                      help="path to npcomp-run-mlir")
+  parser.add_argument("--runtime-shlib", required=True,
+                      help="path to the compiler runtime shared library")
+  parser.add_argument("--filter", default="",
+                      help="only run kernels whose name contains this")
+  parser.add_argument("--iterations", type=int, default=20)
+  parser.add_argument("--warmup", type=int, default=3)
+  parser.add_argument("--optimize", action="store_true",
+                      help="compile with the optimizing RefBackend pipeline")
+  parser.add_argument("--prefetch-distance", type=int, default=0,
+                      help="prefetch the strided and indirect loads of "
+                      "innermost loops this many iterations ahead")
+  parser.add_argument("--tuning-database",
+                      help="compile the matmuls and convolutions with the "
+                      "configurations tuned in this database")
+  parser.add_argument("--autotune", action="store_true",
+                      help="tune the kernels missing from --tuning-database "
+                      "before benchmarking them")
+  parser.add_argument("--mcpu",
+                      help="CPU to generate code for (the host CPU by "
+                      "default)")
+  parser.add_argument("--mattr",
+                      help="target features to enable (+feature) or disable "
+                      "(-feature), e.g. +sve or -fma")
+  parser.add_argument("--peak-gflops", type=float, default=0,
+                      help="peak GFLOP/s of the machine")
+  parser.add_argument("--peak-gbps", type=float, default=0,
+                      help="peak memory bandwidth of the machine in GB/s "
+                      "(measured by default)")
+  parser.add_argument("--json-output",
+                      help="write the results to this file, which can serve "
+                      "as a --baseline")
+  parser.add_argument("--baseline",
+                      help="results of an earlier run to compare against")
+  parser.add_argument("--tolerance", type=float, default=0.1,
+                      help="the relative drop of the roofline fraction "
+                      "from the baseline that fails a kernel")
+  parser.add_argument("--min-fraction", type=float, default=0,
+                      help="the roofline fraction below which a kernel fails")
+  parser.add_argument("--compare",
+                      help="results of a run on another machine to report "
+                      "the kernels against")
+  args = parser.parse_args()
+
+  baseline = {}
+  if args.baseline:
+    with open(args.baseline) as f:
+      baseline = json.load(f)
+  other = {}
+  if args.compare:
+    with open(args.compare) as f:
+      other = json.load(f)
+
+  results = {}
+  failures = []
+  print("{:<20} {:>10} {:>10} {:>10} {:>8} {:>9}".format(
+      "Kernel", "p50 (ms)", "GFLOP/s", "GB/s", "Bound", "Roofline"))
+  for kernel in KERNELS:
+    if args.filter not in kernel["name"]:
+      continue
+    report = run_kernel(kernel, args)
+    report["machine"] = platform.machine()
+    roofline = report["roofline"]
+    results[kernel["name"]] = report
+    print("{:<20} {:>10.3f} {:>10.2f} {:>10.2f} {:>8} {:>8.1f}%".format(
+        kernel["name"], report["latency_ms"]["p50"], roofline["gflops"],
+        roofline["gbps"], roofline["bound"], roofline["fraction"] * 100))
+    if roofline["fraction"] < args.min_fraction:
+      failures.append("{}: {:.1%} of the roofline, below {:.1%}".format(
+          kernel["name"], roofline["fraction"], args.min_fraction))
+    if kernel["name"] in baseline:
+      before = baseline[kernel["name"]]["roofline"]["fraction"]
+      if roofline["fraction"] < before * (1 - args.tolerance):
+        failures.append("{}: {:.1%} of the roofline, down from {:.1%}".format(
+            kernel["name"], roofline["fraction"], before))
+
+  if other:
+    print()
+    print("{:<20} {:>10} {:>12} {:>12}".format(
+        "Kernel", "Speedup", "Roofline", "Other"))
+    for name, report in results.items():
+      if name not in other:
+        continue
+      speedup = (other[name]["latency_ms"]["p50"] /
+                 report["latency_ms"]["p50"])
+      print("{:<20} {:>9.2f}x {:>11.1f}% {:>11.1f}% ({})".format(
+          name, speedup, report["roofline"]["fraction"] * 100,
+          other[name]["roofline"]["fraction"] * 100,
+          other[name].get("machine", "unknown")))
+
+  if args.json_output:
+    with open(args.json_output, "w") as f:
+      json.dump(results, f, indent=2)
+  for failure in failures:
+    print("FAILED " + failure, file=sys.stderr)
+  return 1 if failures else 0
+
+
+if __name__ == "__main__":
+  sys.exit(main())
@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+# Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+"""Sweeps the serving load of a model and reports its throughput and latency.
+
+Each point of the sweep is a run of npcomp-serve-bench, which loads the model
+once and drives one of its functions from concurrent client threads, with
+requests of the given sizes (the leading extent of the dynamic inputs). The
+sweep covers every combination of --clients and --rates, a rate of 0 meaning
+clients that send their requests back to back:
+
+  run_serving.py model.mlir --invoke=forward --clients=1,4,16 \\
+      --rates=0,100,400 --request-sizes=1,8,32
+
+For each point, it reports the achieved requests per second against the
+offered rate, the latency percentiles, the CPU utilization of the machine
+and the resident memory. Past the capacity of the model, the achieved rate
+stops following the offered one and the tail latency grows with the queue.
+
+--json-output writes the reports of all the points, to plot or compare.
+"""
+
+import argparse
+import json
+import subprocess
+import sys
+
+
+def _int_list(value):
+  return [int(v) for v in value.split(",")]
+
+
+def _float_list(value):
+  return [float(v) for v in value.split(",")]
+
+
+def run_point(args, clients, rate):
+  command = [args.npcomp_serve_bench]
+  if args.compiled_module:
+    command.append("-compiled-module=" + args.compiled_module)
+  else:
+    command.append(args.model)
+  command += [
+      "-invoke", args.invoke,
+      "-clients={}".format(clients),
+      "-rate={}".format(rate),
+      "-duration={}".format(args.duration),
+      "-warmup={}".format(args.warmup),
+      "-api=" + args.api,
+      "-seed={}".format(args.seed),
+      "-format=json",
+  ]
+  if args.request_sizes:
+    command.append("-request-sizes=" +
+                   ",".join(str(s) for s in args.request_sizes))
+  if args.specialize_batch_sizes:
+    command.append("-specialize-batch-sizes=" +
+                   ",".join(str(s) for s in args.specialize_batch_sizes))
+  if not args.optimize:
+    command.append("-optimize=false")
+  output = subprocess.run(command, check=True, stdout=subprocess.PIPE,
+                          universal_newlines=True).stdout
+  return json.loads(output)
+
+
+def main():
+  parser = argparse.ArgumentParser(
+      description=__doc__, formatter_class=argparse.RawTextHelpFormatter)
+  parser.add_argument("model", nargs="?", default="",
+                      help="the .mlir file of the model")
+  parser.add_argument("--compiled-module",
+                      help="shared object produced by npcomp-compile to "
+                      "serve instead of the model")
+  parser.add_argument("--npcomp-serve-bench", default="npcomp-serve-bench",
+                      help="path to npcomp-serve-bench")
+  parser.add_argument("--invoke", required=True,
+                      help="the function to serve")
+  parser.add_argument("--clients", type=_int_list, default=[1],
+                      help="comma-separated numbers of client threads")
+  parser.add_argument("--rates", type=_float_list, default=[0],
+                      help="comma-separated total arrival rates in "
+                      "requests/s (0 for back to back requests)")
+  parser.add_argument("--request-sizes", type=_int_list, default=[],
+                      help="comma-separated sizes of the requests")
+  parser.add_argument("--specialize-batch-sizes", type=_int_list,
+                      default=[],
+                      help="comma-separated batch sizes to compile static "
+                      "variants of the functions for")
+  parser.add_argument("--duration", type=float, default=10,
+                      help="seconds of load per point")
+  parser.add_argument("--warmup", type=int, default=2)
+  parser.add_argument("--api", default="invoke",
+                      choices=["invoke", "into", "async"],
+                      help="the runtime entry point serving the requests")
+  parser.add_argument("--seed", type=int, default=0)
+  parser.add_argument("--no-optimize", dest="optimize", action="store_false",
+                      help="compile without the RefBackend optimizations")
+  parser.add_argument("--json-output",
+                      help="write the reports of all the points to this file")
+  args = parser.parse_args()
+  if not args.model and not args.compiled_module:
+    parser.error("either a model or --compiled-module is required")
+
+  results = []
+  print("{:>7} {:>10} {:>10} {:>10} {:>10} {:>10} {:>7} {:>9}".format(
+      "Clients", "Offered", "QPS", "p50 (ms)", "p99 (ms)", "p99.9 (ms)",
+      "CPU", "RSS (MiB)"))
+  for clients in args.clients:
+    for rate in args.rates:
+      report = run_point(args, clients, rate)
+      results.append(report)
+      latency = report["latency_ms"]
+      print("{:>7} {:>10} {:>10.1f} {:>10.3f} {:>10.3f} {:>10.3f} {:>6.1f}% "
+            "{:>9.1f}".format(
+                clients, "{:.1f}".format(rate) if rate else "closed",
+                report["qps"], latency["p50"], latency["p99"],
+                latency["p999"], report["cpu"]["utilization"] * 100,
+                report["memory_mib"]["rss_after"]))
+      if report["errors"]:
+        print("  {} requests failed".format(report["errors"]),
+              file=sys.stderr)
+
+  if args.json_output:
+    with open(args.json_output, "w") as f:
+      json.dump(results, f, indent=2)
+  return 0
+
+
+if __name__ == "__main__":
+  sys.exit(main())
@@ -14,6 +14,7 @@
 #include "npcomp-c/Types.h"
 #include "npcomp/Python/PybindUtils.h"
 
+#include <ATen/ATen.h>
 #include <ATen/core/function_schema.h>
 #include <ATen/core/ivalue.h>
 #include <ATen/core/stack.h>
@@ -44,9 +45,13 @@ static c10::DispatchKey kAcapGradDispatchKey =
     c10::DispatchKey::ACAP_GRAD_DISPATCH_KEY;
 
 AcapController::TracedSchemaOpBuilder::TracedSchemaOpBuilder(
-    AcapController &parent, MlirContext context, MlirLocation loc,
+    AcapController &parent, MlirLocation loc,
     const c10::OperatorHandle &opHandle)
-    : parent(parent),  loc(loc), opHandle(opHandle) {}
+    : parent(parent), loc(loc), opHandle(opHandle),
+      kernelInfo(parent.getKernelInfo(opHandle)) {
+  operands.reserve(kernelInfo.argCount);
+  resultTypes.reserve(kernelInfo.returnCount);
+}
 
 void AcapController::TracedSchemaOpBuilder::addOperand(const IValue &value) {
   MlirValue mlirValue = parent.mapIValueToMlirValue(loc, value);
@@ -78,7 +83,7 @@ void AcapController::TracedSchemaOpBuilder::addResult(const IValue &value) {
 MlirOperation AcapController::TracedSchemaOpBuilder::create() {
   MlirOperation op =
       createOperationFromSchema(parent.funcBuilder->getEntryBlock(), loc,
-                                opHandle.schema(), resultTypes, operands);
+                                kernelInfo.opInfo, resultTypes, operands);
   // Map result tensors.
   for (auto &it : resultIndexToTensorMap) {
     MlirValue result = mlirOperationGetResult(op, it.first);
@@ -127,7 +132,7 @@ void AcapController::returns(std::vector<at::Tensor> tensors) {
     if (mlirValueIsNull(v)) {
       debugTrace(
           "Return of imported-constant tensor (intentional memorization?)");
-      v = importTensorByValue(tensor);
+      v = importCapturedTensor(tensor);
     }
 
     returnsTypes.push_back(mlirValueGetType(v));
@@ -158,23 +163,156 @@ void AcapController::verifyHasNotReturned() {
   }
 }
 
+const AcapController::KernelInfo &
+AcapController::getKernelInfo(const OperatorHandle &opHandle) {
+  const FunctionSchema &schema = opHandle.schema();
+  auto it = kernelInfos.find(&schema);
+  if (it == kernelInfos.end()) {
+    KernelInfo info{getSchemaOpInfo(funcBuilder->getContext(), schema),
+                    schema.arguments().size(), schema.returns().size()};
+    it = kernelInfos.emplace(&schema, std::move(info)).first;
+  }
+  return it->second;
+}
+
+/* static */
+void AcapController::redispatch(const OperatorHandle &opHandle, Stack *stack) {
+  // Exclude recursive dispatch to this kernel.
+  c10::impl::ExcludeDispatchKeyGuard exclusion(kAcapDispatchKey);
+  // Passthrough.
+  c10::Dispatcher::singleton().callBoxed(opHandle, stack);
+}
+
 /* static */
 void AcapController::fallbackKernel(const OperatorHandle &opHandle,
                                     Stack *stack) {
-  auto redispatchCallback = [&]() {
-    // Exclude recursive dispatch to this kernel.
-    c10::impl::ExcludeDispatchKeyGuard exclusion(kAcapDispatchKey);
-    // Passthrough.
-    auto &dispatcher = c10::Dispatcher::singleton();
-    dispatcher.callBoxed(opHandle, stack);
-  };
-
   auto current = getCurrentThreadAcapController();
   if (!current) {
-    redispatchCallback();
+    redispatch(opHandle, stack);
     return;
   }
-  current->fallbackKernelImpl(opHandle, stack, redispatchCallback);
+  current->fallbackKernelImpl(opHandle, stack);
+}
+
+// Replaces the `argCount` arguments of `opHandle` on `stack` with its results
+// as computed by its meta kernel, with uninitialized storage on the device of
+// the arguments. Results aliasing an argument are that argument. Returns false
+// and leaves `stack` unchanged if the results can't be computed that way.
+static bool redispatchToMeta(const OperatorHandle &opHandle, Stack *stack,
+                             size_t argCount) {
+  if (!opHandle.hasKernelForDispatchKey(c10::DispatchKey::Meta)) {
+    return false;
+  }
+  Stack metaStack;
+  metaStack.reserve(argCount);
+  c10::SmallVector<std::pair<c10::TensorImpl *, at::Tensor>, 4> metaToArg;
+  c10::Device device = c10::kCPU;
+  for (auto argIt = stack->end() - argCount; argIt != stack->end(); ++argIt) {
+    if (argIt->isTensorList()) {
+      return false;
+    }
+    if (!argIt->isTensor() || !argIt->toTensor().defined()) {
+      metaStack.push_back(*argIt);
+      continue;
+    }
+    const at::Tensor &arg = argIt->toTensor();
+    if (metaToArg.empty()) {
+      device = arg.device();
+    }
+    at::Tensor meta = at::empty_strided(arg.sizes(), arg.strides(),
+                                        arg.options().device(c10::kMeta));
+    metaToArg.emplace_back(meta.unsafeGetTensorImpl(), arg);
+    metaStack.push_back(std::move(meta));
+  }
+
+  try {
+    c10::Dispatcher::singleton().callBoxed(opHandle, &metaStack);
+  } catch (const c10::Error &) {
+    return false;
+  }
+  for (IValue &result : metaStack) {
+    if (result.isTensorList()) {
+      return false;
+    }
+    if (!result.isTensor() || !result.toTensor().defined()) {
+      continue;
+    }
+    at::Tensor meta = result.toTensor();
+    c10::optional<at::Tensor> aliasedArg;
+    for (auto &entry : metaToArg) {
+      if (entry.first == meta.unsafeGetTensorImpl()) {
+        aliasedArg = entry.second;
+        break;
+      }
+    }
+    result = aliasedArg ? *aliasedArg
+                        : at::empty_strided(meta.sizes(), meta.strides(),
+                                            meta.options().device(device));
+  }
+  torch::jit::drop(*stack, argCount);
+  stack->insert(stack->end(), metaStack.begin(), metaStack.end());
+  return true;
+}
+
+namespace {
+// The ops captured by unboxedCaptureKernel, which are the ones that most
+// traced programs spend their time on. Convolutions are captured by
+// convolutionKernel (and linear layers reach the backend as addmm or mm).
+struct MmOp {
+  static constexpr const char *name = "aten::mm";
+  static constexpr const char *overloadName = "";
+};
+struct AddmmOp {
+  static constexpr const char *name = "aten::addmm";
+  static constexpr const char *overloadName = "";
+};
+struct AddTensorOp {
+  static constexpr const char *name = "aten::add";
+  static constexpr const char *overloadName = "Tensor";
+};
+struct ReluOp {
+  static constexpr const char *name = "aten::relu";
+  static constexpr const char *overloadName = "";
+};
+} // namespace
+
+template <typename Op, typename... Args>
+at::Tensor AcapController::unboxedCaptureKernel(Args... args) {
+  static c10::TypedOperatorHandle<at::Tensor(Args...)> opTyped =
+      c10::Dispatcher::singleton()
+          .findSchemaOrThrow(Op::name, Op::overloadName)
+          .template typed<at::Tensor(Args...)>();
+
+  auto current = getCurrentThreadAcapController();
+  if (current && current->captureOnly) {
+    // Only the boxed kernel knows how to run just the meta kernel.
+    Stack stack;
+    torch::jit::push(stack, args...);
+    current->fallbackKernelImpl(opTyped, &stack);
+    return torch::jit::pop(stack).toTensor();
+  }
+
+  // Exclude recursive dispatch to this kernel.
+  c10::impl::ExcludeDispatchKeyGuard exclusion(kAcapDispatchKey);
+  if (!current) {
+    return opTyped.call(args...);
+  }
+
+  current->verifyHasNotReturned();
+  if (isDebugTraceEnabled()) {
+    std::stringstream s;
+    s << "Unboxed dispatch: " << opTyped.schema();
+    debugTrace(s.str());
+  }
+  TracedSchemaOpBuilder opBuilder{*current, current->getCurrentLocation(),
+                                  opTyped};
+  // Map the arguments to operands in order.
+  int unused[] = {(opBuilder.addOperand(IValue(args)), 0)...};
+  (void)unused;
+  at::Tensor result = opTyped.call(args...);
+  opBuilder.addResult(IValue(result));
+  opBuilder.create();
+  return result;
 }
 
 at::Tensor AcapController::convolutionKernel(
@@ -210,10 +348,9 @@ at::Tensor AcapController::convolutionKernel(
                                        transposed, output_padding, groups);
   }
 
-  MlirContext context = current->funcBuilder->getContext();
   MlirLocation loc = current->getCurrentLocation();
   std::string kernelName{"aten::convolution"};
-  TracedSchemaOpBuilder opBuilder{*current, context, loc, *opHandle};
+  TracedSchemaOpBuilder opBuilder{*current, loc, *opHandle};
 
   opBuilder.addOperand(IValue(input));
   opBuilder.addOperand(IValue(weight));
@@ -286,14 +423,13 @@ AcapController::mklConvolutionBackward(
   //   bool transposed, int[] output_padding, int groups,
   //   bool[3] output_mask) ->
   //     (Tensor grad_input, Tensor grad_weight, Tensor grad_bias)
-  MlirContext context = current->funcBuilder->getContext();
   MlirLocation loc = current->getCurrentLocation();
   std::string kernelName{"aten::convolution_backward"};
   static c10::OperatorName emitOpName{"aten::convolution_backward_overrideable",
                                       ""};
   auto emitOpHandle = dispatcher.findOp(emitOpName);
   assert(emitOpHandle && "could not find convolution_backward_overrideable op");
-  TracedSchemaOpBuilder opBuilder{*current, context, loc, *emitOpHandle};
+  TracedSchemaOpBuilder opBuilder{*current, loc, *emitOpHandle};
 
   opBuilder.addOperand(IValue(grad_output));
   opBuilder.addOperand(IValue(input));
@@ -344,9 +480,8 @@ at::Tensor &AcapController::copyUnderKernel(at::Tensor &self,
                                        src, non_blocking);
   }
 
-  MlirContext context = current->funcBuilder->getContext();
   MlirLocation loc = current->getCurrentLocation();
-  TracedSchemaOpBuilder opBuilder{*current, context, loc, *opHandle};
+  TracedSchemaOpBuilder opBuilder{*current, loc, *opHandle};
 
   opBuilder.addOperand(IValue(self));
   opBuilder.addOperand(IValue(src));
@@ -385,9 +520,8 @@ MlirLocation AcapController::getCurrentLocation() {
   return mlirLocationUnknownGet(funcBuilder->getContext());
 }
 
-void AcapController::fallbackKernelImpl(
-    const OperatorHandle &opHandle, Stack *stack,
-    std::function<void()> redispatchCallback) {
+void AcapController::fallbackKernelImpl(const OperatorHandle &opHandle,
+                                        Stack *stack) {
   verifyHasNotReturned();
   if (isDebugTraceEnabled()) {
     std::stringstream s;
@@ -407,25 +541,26 @@ void AcapController::fallbackKernelImpl(
         "Cannot capture ops with variable arguments or returns");
   }
 
-  MlirContext context = funcBuilder->getContext();
   MlirLocation loc = getCurrentLocation();
-  auto kernelName = schema.name();
-  TracedSchemaOpBuilder opBuilder{*this, context, loc, opHandle};
+  TracedSchemaOpBuilder opBuilder{*this, loc, opHandle};
+  const KernelInfo &kernelInfo = getKernelInfo(opHandle);
 
   // Map arguments to operands.
   // This must be accumulated into the OperationState prior to re-dispatch
   // since the stack is modified at that point.
-  size_t argCount = schema.arguments().size();
+  size_t argCount = kernelInfo.argCount;
   assert(stack->size() >= argCount && "stack too short");
   for (auto argIt = stack->end() - argCount; argIt != stack->end(); ++argIt) {
     opBuilder.addOperand(*argIt);
   }
 
-  // Invoke the original kernel.
-  redispatchCallback();
+  // Invoke the original kernel (or only its meta kernel).
+  if (!captureOnly || !redispatchToMeta(opHandle, stack, argCount)) {
+    redispatch(opHandle, stack);
+  }
 
   // Map returns to results.
-  size_t returnCount = schema.returns().size();
+  size_t returnCount = kernelInfo.returnCount;
   assert(stack->size() >= returnCount && "stack too short");
   for (auto returnIt = stack->end() - returnCount; returnIt != stack->end();
        ++returnIt) {
@@ -454,7 +589,7 @@ MlirValue AcapController::mapIValueToMlirValue(MlirLocation loc,
       return mappedValue;
     }
 
-    mappedValue = importTensorByValue(ival.toTensor());
+    mappedValue = importCapturedTensor(ival.toTensor());
     assert(mappedValue.ptr);
     return mappedValue;
   }
@@ -525,17 +660,89 @@ MlirType AcapController::mapIValueToMlirType(MlirLocation loc,
   return {nullptr};
 }
 
-MlirValue AcapController::importTensorByValue(at::Tensor tensor) {
+MlirValue AcapController::importCapturedTensor(at::Tensor tensor) {
+  // Tensors viewing the same memory the same way import the same value.
+  std::tuple<const void *, int, std::vector<int64_t>, std::vector<int64_t>>
+      key;
+  bool hasKey = tensor.has_storage() && tensor.layout() == at::kStrided;
+  if (hasKey) {
+    key = std::make_tuple(tensor.data_ptr(),
+                          static_cast<int>(tensor.scalar_type()),
+                          tensor.sizes().vec(), tensor.strides().vec());
+    auto it = capturedTensorValues.find(key);
+    if (it != capturedTensorValues.end()) {
+      funcBuilder->mapTensor(tensor, it->second);
+      return it->second;
+    }
+  }
+
+  MlirValue tensorValue;
+  switch (capturedTensorMode) {
+  case CapturedTensorMode::Constants:
+    tensorValue = importTensorByValue(funcBuilder->getEntryBlock(), tensor);
+    break;
+  case CapturedTensorMode::Arguments:
+    tensorValue =
+        funcBuilder->addArgument(typeMapper.forwardTensorToType(tensor));
+    capturedTensors.push_back(tensor);
+    break;
+  case CapturedTensorMode::GlobalSlots: {
+    // A private slot, named after the function, inserted before it.
+    MlirContext context = funcBuilder->getContext();
+    MlirLocation loc = getCurrentLocation();
+    MlirOperation funcOp = funcBuilder->getFuncOp();
+    MlirAttribute funcName =
+        mlirOperationGetAttributeByName(funcOp, toMlirStringRef("sym_name"));
+    MlirStringRef funcNameRef = mlirStringAttrGetValue(funcName);
+    std::string slotName = std::string(funcNameRef.data, funcNameRef.length) +
+                           "_captured" +
+                           std::to_string(capturedTensors.size());
+    MlirRegion initializer = mlirRegionCreate();
+    mlirRegionAppendOwnedBlock(initializer, mlirBlockCreate(0, nullptr));
+    MlirBlock initializerBlock = mlirRegionGetFirstBlock(initializer);
+    MlirValue initialValue = importTensorByValue(initializerBlock, tensor);
+    MlirType type = mlirValueGetType(initialValue);
+    mlirBlockAppendOwnedOperation(
+        initializerBlock,
+        createMlirOperation("torch.global_slot.init", loc, initialValue));
+    MlirOperation slotOp = createMlirOperation(
+        "torch.global_slot", loc, initializer,
+        toMlirNamedAttribute(
+            "sym_name",
+            mlirStringAttrGet(context, toMlirStringRef(slotName))),
+        toMlirNamedAttribute(
+            "sym_visibility",
+            mlirStringAttrGet(context, toMlirStringRef("private"))),
+        toMlirNamedAttribute("typeBound", mlirTypeAttrGet(type)));
+    mlirBlockInsertOwnedOperationBefore(mlirOperationGetBlock(funcOp), funcOp,
+                                        slotOp);
+    MlirOperation getOp = createMlirOperationAtEnd(
+        funcBuilder->getEntryBlock(), "torch.global_slot.get", loc, type,
+        toMlirNamedAttribute(
+            "slot",
+            mlirFlatSymbolRefAttrGet(context, toMlirStringRef(slotName))));
+    tensorValue = mlirOperationGetResult(getOp, 0);
+    capturedTensors.push_back(tensor);
+    break;
+  }
+  }
+
+  funcBuilder->mapTensor(tensor, tensorValue);
+  if (hasKey)
+    capturedTensorValues.emplace(std::move(key), tensorValue);
+  return tensorValue;
+}
+
+MlirValue AcapController::importTensorByValue(MlirBlock block,
+                                              const at::Tensor &tensor) {
   auto loc = getCurrentLocation();
   MlirAttribute denseElements = convertTensorToMlirElementsAttr(tensor, loc);
   MlirOperation tensorOp = createMlirOperationAtEnd(
-      funcBuilder->getEntryBlock(), "torch.tensor", loc,
+      block, "torch.tensor", loc,
       npcompNonValueTensorTypeGetFromShaped(
           mlirAttributeGetType(denseElements)),
       toMlirNamedAttribute("value", denseElements));
-  MlirValue tensorValue = mlirOperationGetResult(tensorOp, 0);
-  funcBuilder->mapTensor(tensor, tensorValue);
-  return tensorValue;
+  return mlirOperationGetResult(tensorOp, 0);
 }
 
 TORCH_LIBRARY_IMPL(aten, BackendSelect, m) {
@@ -560,6 +767,21 @@ TORCH_LIBRARY_IMPL(_, ACAP_DISPATCH_KEY, m) {
 
 TORCH_LIBRARY_IMPL(aten, ACAP_DISPATCH_KEY, m) {
   m.impl("copy_", &AcapController::copyUnderKernel);
+
+  // Capture the most frequently traced ops without the boxing round trip of
+  // the fallback. These record exactly what the fallback would.
+  m.impl("mm", &AcapController::unboxedCaptureKernel<MmOp, const at::Tensor &,
+                                                     const at::Tensor &>);
+  m.impl("addmm",
+         &AcapController::unboxedCaptureKernel<
+             AddmmOp, const at::Tensor &, const at::Tensor &,
+             const at::Tensor &, const at::Scalar &, const at::Scalar &>);
+  m.impl("add.Tensor",
+         &AcapController::unboxedCaptureKernel<AddTensorOp, const at::Tensor &,
+                                               const at::Tensor &,
+                                               const at::Scalar &>);
+  m.impl("relu",
+         &AcapController::unboxedCaptureKernel<ReluOp, const at::Tensor &>);
 }
 
 TORCH_LIBRARY_IMPL(aten, ACAP_GRAD_DISPATCH_KEY, m) {
@@ -15,26 +15,60 @@
 #define NPCOMP_FRONTENDS_PYTORCH_CSRC_BUILDER_ACAP_DISPATCH_H
 
 #include <list>
+#include <map>
 #include <memory>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
 
 #include "../pybind.h"
 
 #include "func_builder.h"
+#include "torch_to_mlir_utils.h"
 
 #include "mlir-c/IR.h"
 
 #include <ATen/core/dispatch/Dispatcher.h>
 #include <ATen/core/ivalue.h>
 #include <c10/core/impl/LocalDispatchKeySet.h>
+#include <c10/util/SmallVector.h>
 
 namespace torch_mlir {
 
+/// How the captured tensors of a function are imported: the tensors that it
+/// reads without them being arguments or computed under capture, typically
+/// the parameters of a model.
+enum class CapturedTensorMode {
+  /// As constants of the function, holding their value at capture.
+  Constants,
+  /// As arguments of the function, after the explicit ones, so that the
+  /// function is compiled once for all their values.
+  Arguments,
+  /// As private `torch.global_slot`s of the module, initialized with their
+  /// value at capture.
+  GlobalSlots,
+};
+
 /// Main entry point for managing device capture.
 class AcapController : public std::enable_shared_from_this<AcapController> {
 public:
+  /// With `captureOnly`, ops that have a meta kernel (which computes the
+  /// shapes and dtypes of their results) only run it, and their results are
+  /// uninitialized. That makes capture much faster when only the captured
+  /// function is wanted, but the values of the tensors computed under capture
+  /// are meaningless.
+  ///
+  /// Each captured tensor is imported once as specified by
+  /// `capturedTensorMode`, including when other tensors view the same memory
+  /// with the same shape, strides and dtype (such as `p.detach()` for a
+  /// parameter `p`).
   AcapController(TypeMapper &typeMapper,
-                 std::unique_ptr<FuncBuilder> funcBuilder)
-      : typeMapper(typeMapper), funcBuilder(std::move(funcBuilder)) {}
+                 std::unique_ptr<FuncBuilder> funcBuilder,
+                 bool captureOnly = false,
+                 CapturedTensorMode capturedTensorMode =
+                     CapturedTensorMode::Constants)
+      : typeMapper(typeMapper), funcBuilder(std::move(funcBuilder)),
+        captureOnly(captureOnly), capturedTensorMode(capturedTensorMode) {}
 
   // Enter and exit the context manager.
   pybind11::object contextEnter();
@@ -44,6 +78,12 @@ public:
   // Terminates capture and returns tensors from the function.
   void returns(std::vector<at::Tensor> tensors);
 
+  // Returns the captured tensors imported so far, in the order of the
+  // arguments or global slots they were imported as (none for constants).
+  const std::vector<at::Tensor> &getCapturedTensors() const {
+    return capturedTensors;
+  }
+
   // Returns the current AcapController (if it has been activated on this
   // thread. Returns nullptr if none (not active on the current thread).
   static std::shared_ptr<AcapController> getCurrentThreadAcapController();
@@ -71,6 +111,12 @@ public:
   static at::Tensor &copyUnderKernel(at::Tensor &self, const at::Tensor &src,
                                      bool non_blocking);
 
+  // Kernel implementation capturing the frequently traced op `Op` (see
+  // kUnboxedCaptureOps) without boxing its arguments onto a stack like
+  // fallbackKernel does.
+  template <typename Op, typename... Args>
+  static at::Tensor unboxedCaptureKernel(Args... args);
+
   // Backend select kernel for arange factory function.
   static at::Tensor arangeBackendSelectKernel(
       const at::Scalar &end, c10::optional<at::ScalarType> dtype,
@@ -78,12 +124,18 @@ public:
       c10::optional<bool> pin_memory);
 
 private:
+  /// What is captured of each operator, computed on its first capture.
+  struct KernelInfo {
+    SchemaOpInfo opInfo;
+    size_t argCount;
+    size_t returnCount;
+  };
+
   /// Builds an MLIR operation for a Torch operator step by step.
   class TracedSchemaOpBuilder {
   public:
-    TracedSchemaOpBuilder(AcapController &parent, MlirContext context,
-                            MlirLocation loc,
-                            const c10::OperatorHandle &opHandle);
+    TracedSchemaOpBuilder(AcapController &parent, MlirLocation loc,
+                          const c10::OperatorHandle &opHandle);
     void addOperand(const c10::IValue &value);
     void addResult(const c10::IValue &result);
     MlirOperation create();
@@ -92,21 +144,26 @@ private:
     AcapController &parent;
     MlirLocation loc;
     const c10::OperatorHandle &opHandle;
-    std::vector<MlirValue> operands;
-    std::vector<MlirType> resultTypes;
+    const KernelInfo &kernelInfo;
+    c10::SmallVector<MlirValue, 8> operands;
+    c10::SmallVector<MlirType, 4> resultTypes;
     int resultCount = 0;
-    std::vector<std::pair<size_t, at::Tensor>> resultIndexToTensorMap;
+    c10::SmallVector<std::pair<size_t, at::Tensor>, 4> resultIndexToTensorMap;
   };
 
   MlirLocation getCurrentLocation();
-  void redispatch(const c10::OperatorHandle &opHandle, c10::Stack *stack);
+  const KernelInfo &getKernelInfo(const c10::OperatorHandle &opHandle);
+  static void redispatch(const c10::OperatorHandle &opHandle,
+                         c10::Stack *stack);
   void fallbackKernelImpl(const c10::OperatorHandle &opHandle,
-                          c10::Stack *stack,
-                          std::function<void()> redispatchCallback);
+                          c10::Stack *stack);
   MlirValue mapIValueToMlirValue(MlirLocation loc, const c10::IValue &ival);
   MlirType mapIValueToMlirType(MlirLocation loc, const c10::IValue &ival);
-  /// Imports a tensor by value (as a constant), remembering the association.
-  MlirValue importTensorByValue(at::Tensor tensor);
+  /// Imports a captured tensor as specified by `capturedTensorMode`,
+  /// remembering the association.
+  MlirValue importCapturedTensor(at::Tensor tensor);
+  /// Imports a tensor by value (as a `torch.tensor`) at the end of `block`.
+  MlirValue importTensorByValue(MlirBlock block, const at::Tensor &tensor);
   void verifyHasNotReturned();
   struct Activation {
     Activation(std::shared_ptr<AcapController> controller)
@@ -123,7 +180,19 @@ private:
 
   TypeMapper &typeMapper;
   std::unique_ptr<FuncBuilder> funcBuilder;
+  bool captureOnly;
+  CapturedTensorMode capturedTensorMode;
   bool hasReturned = false;
+  // The captured tensors imported as arguments or global slots.
+  std::vector<at::Tensor> capturedTensors;
+  // The captured tensors imported so far, by the memory they view: the data
+  // pointer, dtype, sizes and strides.
+  std::map<std::tuple<const void *, int, std::vector<int64_t>,
+                      std::vector<int64_t>>,
+           MlirValue>
+      capturedTensorValues;
+  // Keyed by the schemas, which the dispatcher owns.
+  std::unordered_map<const c10::FunctionSchema *, KernelInfo> kernelInfos;
 };
 
 } // namespace torch_mlir
@@ -160,19 +160,14 @@ static c10::ScalarType convertToC10ScalarType(py::object obj) {
   throw std::invalid_argument(ss.str());
 }
 
-static void fillArgAnnotations(MethodAnnotation &methodAnnotation,
+static void fillArgAnnotations(std::vector<ArgAnnotation> &argAnnotations,
                                py::list pyArgAnnotations,
                                torch::jit::Function *function) {
   if (pyArgAnnotations.size() != function->num_inputs()) {
     throw std::invalid_argument("Arg annotations should have one entry per "
                                 "function parameter (including self).");
   }
-  if (!methodAnnotation.argAnnotations.has_value()) {
-    methodAnnotation.argAnnotations.emplace(function->num_inputs(),
-                                            ArgAnnotation{});
-  }
-  std::vector<ArgAnnotation> &argAnnotations =
-      methodAnnotation.argAnnotations.value();
+  argAnnotations.resize(function->num_inputs());
   for (int i = 0, e = argAnnotations.size(); i != e; i++) {
     if (pyArgAnnotations[i].is_none()) {
       continue;
@@ -194,6 +189,32 @@ static void fillArgAnnotations(MethodAnnotation &methodAnnotation,
 void ClassAnnotator::annotateArgs(c10::ClassType &rootClassType,
                                   std::vector<std::string> path,
                                   py::list argAnnotations) {
+  torch::jit::Function *function;
+  MethodAnnotation &methodAnnotation =
+      getMethodAnnotationAtPath(rootClassType, path, function);
+  if (!methodAnnotation.argAnnotations.has_value()) {
+    methodAnnotation.argAnnotations.emplace(function->num_inputs(),
+                                            ArgAnnotation{});
+  }
+  fillArgAnnotations(methodAnnotation.argAnnotations.value(), argAnnotations,
+                     function);
+}
+
+void ClassAnnotator::specializeArgs(c10::ClassType &rootClassType,
+                                    std::vector<std::string> path,
+                                    py::list argAnnotations) {
+  torch::jit::Function *function;
+  MethodAnnotation &methodAnnotation =
+      getMethodAnnotationAtPath(rootClassType, path, function);
+  std::vector<ArgAnnotation> specialization;
+  fillArgAnnotations(specialization, argAnnotations, function);
+  methodAnnotation.argSpecializations.push_back(std::move(specialization));
+}
+
+MethodAnnotation &
+ClassAnnotator::getMethodAnnotationAtPath(c10::ClassType &rootClassType,
+                                          std::vector<std::string> path,
+                                          torch::jit::Function *&function) {
   if (path.size() == 0) {
     throw std::invalid_argument("Empty annotated path. Can only annotate "
                                 "shapes/dtypes of a method of a class.");
@@ -204,19 +225,25 @@ void ClassAnnotator::annotateArgs(c10::ClassType &rootClassType,
                                          .vec());
 
   // Throw error if no method on the class of the specified name.
-  torch::jit::Function *function = &classType->getMethod(path.back());
+  function = &classType->getMethod(path.back());
 
   ClassAnnotation &classAnnotation = getOrCreateClassAnnotation(classType);
   std::vector<MethodAnnotation> &methodAnnotations =
       classAnnotation.getMethodAnnotations();
   const std::vector<torch::jit::Function *> &methods = classType->methods();
   for (int i = 0, e = methods.size(); i != e; i++) {
-    if (methods[i]->name() == path.back()) {
-      fillArgAnnotations(methodAnnotations[i], argAnnotations, function);
+    if (methods[i] == function) {
+      return methodAnnotations[i];
     }
   }
+  // `getMethod` only returns methods of the class.
+  assert(false && "method annotation not found");
+  return methodAnnotations.front();
+}
 
-  return;
+std::string torch_mlir::getSpecializationName(const std::string &name,
+                                              int specializationIndex) {
+  return name + "$" + std::to_string(specializationIndex);
 }
 
 c10::ClassType *ClassAnnotator::getClassAtPath(c10::ClassType *rootClassType,
@@ -300,6 +327,13 @@ std::string MethodAnnotation::toString(const std::string &name) {
   } else {
     ss << " <none>\n";
   }
+  // Only printed if present, to keep the common case short.
+  for (int i = 0, e = argSpecializations.size(); i < e; i++) {
+    ss << "  argSpecialization(" << i << ") =\n";
+    for (int j = 0, f = argSpecializations[i].size(); j < f; j++) {
+      ss << indentString("    ", argSpecializations[i][j].toString(j));
+    }
+  }
   ss << "}\n";
   return ss.str();
 }
@@ -338,5 +372,6 @@ void torch_mlir::initClassAnnotatorBindings(py::module &m) {
       .def("exportPath", &ClassAnnotator::exportPath)
       .def("exportNone", &ClassAnnotator::exportNone)
       .def("annotateArgs", &ClassAnnotator::annotateArgs)
+      .def("specializeArgs", &ClassAnnotator::specializeArgs)
       .def("__repr__", &ClassAnnotator::toString);
 }
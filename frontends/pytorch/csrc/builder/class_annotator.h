@@ -78,9 +78,27 @@ struct MethodAnnotation {
   // large printout of the default ArgAnnotation for every method.
   c10::optional<std::vector<ArgAnnotation>> argAnnotations;
 
+  // Additional signatures that the method is specialized for.
+  //
+  // Each entry has one ArgAnnotation per argument, like `argAnnotations`. The
+  // method is imported once more for each of them, as a method with the
+  // same name suffixed by `$` and the index of the specialization (for
+  // example `forward$0`). This lets the compiler generate fully static code for
+  // each of the common signatures of the method, next to the (possibly
+  // dynamic) code for `argAnnotations`. The runtime dispatches calls to the
+  // method to the specialization matching the arguments (see
+  // `refbackrt::selectFunction`).
+  std::vector<std::vector<ArgAnnotation>> argSpecializations;
+
   std::string toString(const std::string &name);
 };
 
+// Returns the name of the `specializationIndex`'th specialization of the
+// method or function called `name` (see
+// `MethodAnnotation::argSpecializations`).
+std::string getSpecializationName(const std::string &name,
+                                  int specializationIndex);
+
 // Annotations on a c10::ClassType.
 //
 // A c10::ClassType consists of attributes and methods, which are stored in
@@ -160,6 +178,12 @@ public:
   void annotateArgs(c10::ClassType &rootClassType,
                     std::vector<std::string> path, py::list argAnnotations);
 
+  // Add a specialization of the method at path `path` from `rootClassType` for
+  // the arguments described by `argAnnotations`, which has the same format as
+  // for `annotateArgs`. See `MethodAnnotation::argSpecializations`.
+  void specializeArgs(c10::ClassType &rootClassType,
+                      std::vector<std::string> path, py::list argAnnotations);
+
   // The annotations collected so far.
   const ClassAnnotationMap &getAnnotationMap();
 
@@ -182,6 +206,12 @@ private:
   // submodule.
   c10::ClassType *getClassAtPath(c10::ClassType *rootClassType,
                                  std::vector<std::string> path);
+  // Get the MethodAnnotation of the method at `path` from `rootClassType`,
+  // and the method itself in `function`. Throw an error if there is no such
+  // method.
+  MethodAnnotation &getMethodAnnotationAtPath(c10::ClassType &rootClassType,
+                                              std::vector<std::string> path,
+                                              torch::jit::Function *&function);
   ClassAnnotationMap classAnnotations;
   // Reverse mapping used to service getMethodAnnotationForFunction.
   std::unordered_map<torch::jit::Function *, MethodAnnotation *>
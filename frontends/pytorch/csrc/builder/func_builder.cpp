@@ -84,13 +84,29 @@ MlirValue FuncBuilder::insertConstantOp(MlirOperation op) {
   return mlirOperationGetResult(op, 0);
 }
 
-MlirValue FuncBuilder::lookupTensor(at::Tensor tensor) {
-  for (auto it = tensorValueMap.rbegin(), e = tensorValueMap.rend(); it != e;
-       ++it) {
-    if (it->first.is_same(tensor))
-      return it->second;
-  }
-  return {nullptr};
+MlirValue FuncBuilder::addArgument(MlirType type) {
+  MlirType funcType = mlirTypeAttrGetValue(
+      mlirOperationGetAttributeByName(funcOp, toMlirStringRef("type")));
+  std::vector<MlirType> inputTypes;
+  for (intptr_t i = 0, e = mlirFunctionTypeGetNumInputs(funcType); i < e; ++i)
+    inputTypes.push_back(mlirFunctionTypeGetInput(funcType, i));
+  inputTypes.push_back(type);
+  std::vector<MlirType> resultTypes;
+  for (intptr_t i = 0, e = mlirFunctionTypeGetNumResults(funcType); i < e; ++i)
+    resultTypes.push_back(mlirFunctionTypeGetResult(funcType, i));
+  MlirType newFuncType =
+      mlirFunctionTypeGet(context, inputTypes.size(), inputTypes.data(),
+                          resultTypes.size(), resultTypes.data());
+  mlirOperationSetAttributeByName(funcOp, toMlirStringRef("type"),
+                                  mlirTypeAttrGet(newFuncType));
+  return mlirBlockAddArgument(getEntryBlock(), type);
+}
+
+MlirValue FuncBuilder::lookupTensor(const at::Tensor &tensor) {
+  auto it = tensorValueMap.find(tensor.unsafeGetTensorImpl());
+  if (it == tensorValueMap.end())
+    return {nullptr};
+  return it->second.value;
 }
 
 MlirValue FuncBuilder::getScalarConstant(MlirLocation loc, at::Scalar s) {
@@ -16,6 +16,8 @@
 #include <ATen/Tensor.h>
 #include <ATen/core/function_schema.h>
 
+#include <unordered_map>
+
 namespace torch_mlir {
 
 /// Wraps an MlirOperationState, deallocating it on destruction unless if
@@ -94,14 +96,19 @@ public:
   /// assumed that a compatible terminator has been added.
   void rewriteFuncReturnTypes(std::vector<MlirType> &resultTypes);
 
-  /// Maps a live Tensor to an MlirValue.
+  /// Appends an argument of type `type` to the function, returning it.
+  MlirValue addArgument(MlirType type);
+
+  /// Maps a live Tensor to an MlirValue, replacing any previous mapping.
   void mapTensor(at::Tensor tensor, MlirValue value) {
-    tensorValueMap.push_back(std::make_pair(tensor, value));
+    TensorMapping &mapping = tensorValueMap[tensor.unsafeGetTensorImpl()];
+    mapping.tensor = std::move(tensor);
+    mapping.value = value;
   }
 
   /// Looks up a current mapping of tensor to an MlirValue, returning a null
   /// value if not found.
-  MlirValue lookupTensor(at::Tensor tensor);
+  MlirValue lookupTensor(const at::Tensor &tensor);
 
   /// Gets a scalar constant value.
   MlirValue getScalarConstant(MlirLocation loc, at::Scalar s);
@@ -143,13 +150,14 @@ private:
   /// Previously inserted constant op or null.
   MlirOperation prevConstantOp = {nullptr};
 
-  /// Maps tensors to MlirValue. Unfortunately, this needs to be a linear scan
-  /// because the impl pointer for the Tensor is not accessible. To make this
-  /// slightly better, we add to the back and lookup in reverse under the idea
-  /// that tensors may be mapped and accessed in proximity.
-  /// TODO: Tensors referenced via an IValue support hash code lookup and
-  /// identity checks. Switch to this instead of a linear scan.
-  std::vector<std::pair<at::Tensor, MlirValue>> tensorValueMap;
+  /// Maps tensors to MlirValue, by identity (the TensorImpl, as
+  /// at::Tensor::is_same). The mapping holds a reference to the tensor, so
+  /// that its TensorImpl can't be freed and reused by another tensor.
+  struct TensorMapping {
+    at::Tensor tensor;
+    MlirValue value;
+  };
+  std::unordered_map<const c10::TensorImpl *, TensorMapping> tensorValueMap;
 };
 
 } // namespace torch_mlir
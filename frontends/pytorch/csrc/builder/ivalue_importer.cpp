@@ -9,7 +9,10 @@
 #include "class_annotator.h"
 #include "function_importer.h"
 
+#include <algorithm>
+#include <deque>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "mlir_utils.h"
 
@@ -19,6 +22,7 @@
 #include "npcomp-c/Types.h"
 
 #include "caffe2/core/scope_guard.h"
+#include "ATen/Parallel.h"
 #include "ATen/native/quantized/cpu/packed_params.h"
 
 using namespace torch_mlir;
@@ -69,6 +73,18 @@ struct IValueEq {
 };
 } // namespace
 
+// Returns true if `lhs` and `rhs`, which share a storage, view the same
+// elements of it in the same way.
+static bool isSameView(const at::Tensor &lhs, const at::Tensor &rhs) {
+  // The elements of quantized tensors also depend on their quantization
+  // parameters.
+  if (lhs.is_quantized() || rhs.is_quantized())
+    return false;
+  return lhs.scalar_type() == rhs.scalar_type() &&
+         lhs.storage_offset() == rhs.storage_offset() &&
+         lhs.sizes() == rhs.sizes() && lhs.strides() == rhs.strides();
+}
+
 namespace {
 /// Helper class for holding state during recursive IValue import.
 ///
@@ -89,22 +105,37 @@ namespace {
 ///   - the address of the at::StorageImpl is the identity of the "storage".
 ///
 /// Multiple different tensors can share the same underlying storage. We
-/// currently import tensors by identity and emit errors in the case of tensors
-/// with different identity but sharing the same storage. This is done because
-/// correctly modeling the many ways that tensors can overlap and alias when
-/// they share storage is difficult. Example hard cases are weird
-/// strides/offsets that overlap, and even cases where the data types mismatch
-/// (PyTorch allows this!).
+/// import tensors by identity, and tensors with different identity that are
+/// the same view of the same storage (same offset, sizes, strides and dtype,
+/// such as a tensor and its `detach()`) are unified too, since they alias
+/// exactly. We emit errors in the case of other tensors sharing the same
+/// storage. This is done because correctly modeling the many ways that tensors
+/// can overlap and alias when they share storage is difficult. Example hard
+/// cases are weird strides/offsets that overlap, and even cases where the data
+/// types mismatch (PyTorch allows this!).
 class IValueImporter {
 public:
   IValueImporter(MlirBlock importBlock, MlirContext context,
-                 ClassAnnotator &annotator)
+                 ClassAnnotator &annotator,
+                 ExternalTensorStorage *externalStorage)
       : importBlock(importBlock), context(context), typeMapper(context),
-        annotator(annotator) {}
+        annotator(annotator), externalStorage(externalStorage) {}
+
+  /// Converts the tensors reachable from `ivalue` to elements attributes on
+  /// the ATen thread pool, for later calls of importIValue to use.
+  ///
+  /// The conversion (copying and hashing the data) dominates the import time
+  /// of models with many parameters. It requires `context` to have
+  /// multithreading enabled, which is the default.
+  void convertTensors(c10::IValue ivalue);
 
   MlirValue importIValue(c10::IValue ivalue);
 
 private:
+  void collectTensors(
+      c10::IValue ivalue,
+      std::unordered_set<c10::IValue, IValueHasher, IValueEq> &visited,
+      std::vector<at::Tensor> &tensors);
   MlirValue rawImportIValue(c10::IValue ivalue);
   MlirValue importTensor(c10::IValue ivalue);
   MlirValue importModule(torch::jit::Module jitModule);
@@ -112,11 +143,29 @@ private:
                     const MethodAnnotation &methodAnnotation);
   void importClassType(c10::ClassType *classType);
   void importCompilationUnit(torch::jit::CompilationUnit *cu);
+  // Import the functions of the compilation unit reachable from `roots`
+  // through calls (and function constants) that haven't been imported yet.
+  // The methods among them are added to the class types already imported.
+  void importReachableFunctions(
+      const std::vector<torch::jit::Function *> &roots);
+  // Import `function` and its specializations.
+  void importFunctionAndSpecializations(torch::jit::Function *function);
+  // Import `function` as a private func named `symName`, with its arguments
+  // annotated according to `argAnnotations` (if not null).
+  void importFunction(torch::jit::Function *function,
+                      const std::vector<ArgAnnotation> *argAnnotations,
+                      const std::string &symName);
 
   MlirBlock importBlock;
   MlirContext context;
   TypeMapper typeMapper;
   ClassAnnotator &annotator;
+  ExternalTensorStorage *externalStorage;
+
+  // The tensors converted by convertTensors, and their elements attributes,
+  // by tensor identity.
+  std::vector<at::Tensor> convertedTensors;
+  std::unordered_map<c10::TensorImpl *, MlirAttribute> convertedElements;
 
   // Map tracking already-imported values.
   std::unordered_map<c10::IValue, MlirValue, IValueHasher, IValueEq> valueMap;
@@ -129,14 +178,29 @@ private:
   // `__torch__`).
   torch::jit::CompilationUnit *compilationUnit = nullptr;
 
-  // Used to detect potentially aliasing tensors.
-  std::unordered_set<c10::StorageImpl *> seenStorageImpls;
+  // The first tensor imported with each storage, and its imported value. Used
+  // to unify tensors that are the same view of a storage, and to detect other
+  // potentially aliasing tensors. Holding the tensors keeps their storage from
+  // being reused by later tensors.
+  std::unordered_map<c10::StorageImpl *, std::pair<at::Tensor, MlirValue>>
+      importedStorages;
   // The set of ClassType's that have already been imported.
   //
   // ClassType's are referenced via their `classType->name()->qualifiedName()`
   // string (as an MLIR symbol name) so we don't need to keep a map associating
   // them with the MlirOperation that they import into.
   std::unordered_set<c10::ClassType *> classTypes;
+  // The bodies of the imported ClassType's, which the methods found to be
+  // reachable after their import are added to.
+  std::unordered_map<c10::ClassType *, MlirBlock> classTypeBodies;
+  // The first imported ClassType, which the functions are imported before.
+  MlirOperation firstClassType = {nullptr};
+  // The functions of the compilation unit imported so far. Only the functions
+  // reachable from the exported methods of the imported ClassType's are
+  // imported, since the others would be discarded by the lowering of the
+  // object graph anyway, and importing them dominates the import time of
+  // large modules.
+  std::unordered_set<torch::jit::Function *> importedFunctions;
   // The stack of attribute names we have traversed to reach the current IValue.
   // Used for diagnostics.
   std::vector<std::string> attributeNameStack;
@@ -161,11 +225,11 @@ IValueImporter::importModule(torch::jit::Module currentModule) {
   }
   std::string moduleTypeName = maybeName->qualifiedName();
 
-  // If this is the first time we are encountering a module, import the
-  // compilation unit.
+  // Check that the module shares the compilation unit of the other modules.
   importCompilationUnit(currentModule._ivalue()->compilation_unit().get());
 
-  // Ensure the class type has been imported.
+  // Ensure the class type, and the functions that its exported methods
+  // reach, have been imported.
   importClassType(currentModule.type().get());
 
   MlirOperation nnModule = createMlirOperation(
@@ -210,16 +274,77 @@ IValueImporter::importModule(torch::jit::Module currentModule) {
   return mlirOperationGetResult(nnModule, 0);
 }
 
+void IValueImporter::collectTensors(
+    c10::IValue ivalue,
+    std::unordered_set<c10::IValue, IValueHasher, IValueEq> &visited,
+    std::vector<at::Tensor> &tensors) {
+  if (!visited.insert(ivalue).second)
+    return;
+  if (ivalue.isTensor()) {
+    tensors.push_back(ivalue.toTensor());
+  } else if (ivalue.isModule()) {
+    for (const c10::IValue &slot : ivalue.toModule()._ivalue()->slots())
+      collectTensors(slot, visited, tensors);
+  } else if (ivalue.isList()) {
+    for (const c10::IValue &elem : ivalue.toList())
+      collectTensors(elem, visited, tensors);
+  } else if (ivalue.isTuple()) {
+    for (const c10::IValue &elem : ivalue.toTuple()->elements())
+      collectTensors(elem, visited, tensors);
+  }
+  // The tensors of custom classes are created when they are imported, so
+  // they are converted then.
+}
+
+void IValueImporter::convertTensors(c10::IValue ivalue) {
+  std::unordered_set<c10::IValue, IValueHasher, IValueEq> visited;
+  std::vector<at::Tensor> tensors;
+  collectTensors(ivalue, visited, tensors);
+
+  MlirLocation loc = mlirLocationUnknownGet(context);
+  std::vector<MlirAttribute> elements(tensors.size(), {nullptr});
+  std::vector<size_t> parallelIndices;
+  for (size_t i = 0, e = tensors.size(); i < e; i++) {
+    // Stores to the external storage are cheap, and are made in import order
+    // so that the file is deterministic.
+    if (externalStorage && externalStorage->accepts(tensors[i]))
+      elements[i] = convertTensorToMlirElementsAttr(tensors[i].contiguous(),
+                                                    loc, externalStorage);
+    else
+      parallelIndices.push_back(i);
+  }
+  at::parallel_for(
+      0, parallelIndices.size(), /*grain_size=*/1,
+      [&](int64_t begin, int64_t end) {
+        for (int64_t i = begin; i < end; i++) {
+          size_t index = parallelIndices[i];
+          elements[index] =
+              convertTensorToMlirElementsAttr(tensors[index].contiguous(), loc);
+        }
+      });
+
+  for (size_t i = 0, e = tensors.size(); i < e; i++)
+    convertedElements[tensors[i].unsafeGetTensorImpl()] = elements[i];
+  convertedTensors.insert(convertedTensors.end(), tensors.begin(),
+                          tensors.end());
+}
+
 MlirValue IValueImporter::importIValue(c10::IValue ivalue) {
   auto it = valueMap.find(ivalue);
   if (it != valueMap.end()) {
     return it->second;
   }
-  // Reject potentially aliased tensors.
+  // Unify tensors that are the same view of a storage, and reject other
+  // potentially aliased tensors.
   if (ivalue.isTensor()) {
-    c10::StorageImpl *storageImpl =
-        ivalue.toTensor().storage().unsafeGetStorageImpl();
-    if (!seenStorageImpls.insert(storageImpl).second) {
+    const at::Tensor &tensor = ivalue.toTensor();
+    auto imported = importedStorages.find(
+        tensor.storage().unsafeGetStorageImpl());
+    if (imported != importedStorages.end()) {
+      if (isSameView(tensor, imported->second.first)) {
+        valueMap[ivalue] = imported->second.second;
+        return imported->second.second;
+      }
       std::stringstream msg;
       msg << "Unhandled tensor that shares storage with another tensor.";
       if (rootModuleName) {
@@ -232,6 +357,11 @@ MlirValue IValueImporter::importIValue(c10::IValue ivalue) {
   }
   MlirValue value = rawImportIValue(ivalue);
   valueMap[ivalue] = value;
+  if (ivalue.isTensor()) {
+    const at::Tensor &tensor = ivalue.toTensor();
+    importedStorages.insert(
+        {tensor.storage().unsafeGetStorageImpl(), {tensor, value}});
+  }
   return value;
 }
 
@@ -341,7 +471,12 @@ MlirValue IValueImporter::importTensor(c10::IValue ivalue) {
 
   // Import the bulk tensor representation.
   at::Tensor tensor = ivalue.toTensor().contiguous();
-  MlirAttribute denseElements = convertTensorToMlirElementsAttr(tensor, loc);
+  auto converted =
+      convertedElements.find(ivalue.toTensor().unsafeGetTensorImpl());
+  MlirAttribute denseElements =
+      converted != convertedElements.end()
+          ? converted->second
+          : convertTensorToMlirElementsAttr(tensor, loc, externalStorage);
   MlirOperation tensorOp =
       createMlirOperationAtEnd(importBlock, "torch.tensor", loc,
                                npcompNonValueTensorTypeGetFromShaped(
@@ -401,6 +536,24 @@ void IValueImporter::importMethod(torch::jit::Function *function,
           "name",
           mlirStringAttrGet(context, toMlirStringRef(function->name()))),
       toMlirNamedAttribute("function", functionSymbolRef), isPrivate);
+
+  // The specializations are methods of their own, calling the specialized
+  // copies of the function imported with the compilation unit.
+  for (int i = 0, e = methodAnnotation.argSpecializations.size(); i != e;
+       i++) {
+    std::string specializationSymName = getSpecializationName(symName, i);
+    createMlirOperationAtEnd(
+        classTypeBody, "torch.method", mlirLocationUnknownGet(context),
+        toMlirNamedAttribute(
+            "name", mlirStringAttrGet(context,
+                                      toMlirStringRef(getSpecializationName(
+                                          function->name(), i)))),
+        toMlirNamedAttribute(
+            "function",
+            mlirFlatSymbolRefAttrGet(context,
+                                     toMlirStringRef(specializationSymName))),
+        isPrivate);
+  }
 }
 
 void IValueImporter::importClassType(c10::ClassType *classType) {
@@ -420,6 +573,9 @@ void IValueImporter::importClassType(c10::ClassType *classType) {
   MlirRegion region = mlirOperationGetRegion(op, 0);
   mlirRegionAppendOwnedBlock(region, mlirBlockCreate(0, nullptr));
   MlirBlock classTypeBody = mlirRegionGetFirstBlock(region);
+  if (mlirOperationIsNull(firstClassType)) {
+    firstClassType = op;
+  }
 
   ClassAnnotation &classAnnotation =
       annotator.getOrCreateClassAnnotation(classType);
@@ -443,99 +599,204 @@ void IValueImporter::importClassType(c10::ClassType *classType) {
         isPrivate);
   }
 
+  // The exported methods are imported along with the functions they reach,
+  // which include the private methods they call. Other private methods are
+  // only imported if code of other classes calls them.
   const auto &methodAnnotations = classAnnotation.getMethodAnnotations();
   const auto &methods = classType->methods();
+  std::vector<torch::jit::Function *> exportedMethods;
   for (int i = 0, e = methods.size(); i != e; i++) {
+    if (methodAnnotations[i].isExported) {
+      exportedMethods.push_back(methods[i]);
+    } else if (!importedFunctions.count(methods[i])) {
+      continue;
+    }
     importMethod(methods[i], classTypeBody, methodAnnotations[i]);
   }
 
   createMlirOperationAtEnd(classTypeBody, "torch.class_type_terminator", loc);
+  classTypeBodies[classType] = classTypeBody;
+  importReachableFunctions(exportedMethods);
 }
 
 void IValueImporter::importCompilationUnit(torch::jit::CompilationUnit *cu) {
+  // The functions of the compilation unit are imported on demand, as they are
+  // found to be reachable (see importReachableFunctions).
   if (compilationUnit == nullptr) {
     compilationUnit = cu;
-  } else {
-    // All sorts of stuff is connected to the compilation unit, such as
-    // c10::ClassType's (owned by the compilation unit), c10::FunctionType
-    // (which holds a pointer to a torch::jit::Function in the compilation
-    // unit), load-bearing symbol table names of functions, etc.
-    //
-    // It doesn't seem to be defined how multiple compilation units semantically
-    // connect with each other, and it doesn't seem to happen either (though
-    // structurally at the C++ level nothing prevents it), so make it an error.
-    if (compilationUnit != cu) {
-      throw std::invalid_argument(
-          "found two compilation units while importing");
-    }
     return;
   }
+  // All sorts of stuff is connected to the compilation unit, such as
+  // c10::ClassType's (owned by the compilation unit), c10::FunctionType
+  // (which holds a pointer to a torch::jit::Function in the compilation
+  // unit), load-bearing symbol table names of functions, etc.
+  //
+  // It doesn't seem to be defined how multiple compilation units semantically
+  // connect with each other, and it doesn't seem to happen either (though
+  // structurally at the C++ level nothing prevents it), so make it an error.
+  if (compilationUnit != cu) {
+    throw std::invalid_argument("found two compilation units while importing");
+  }
+}
+
+// Appends the functions that `block` refers to (through function constants
+// and method calls) to `callees`, along with the class type of each method.
+static void collectCallees(
+    torch::jit::Block *block,
+    std::vector<std::pair<torch::jit::Function *, c10::ClassType *>>
+        &callees) {
+  for (torch::jit::Node *node : block->nodes()) {
+    if (node->kind() == c10::prim::Constant) {
+      if (auto functionType =
+              node->output()->type()->cast<c10::FunctionType>()) {
+        callees.emplace_back(functionType->function(), nullptr);
+      }
+    } else if (node->kind() == c10::prim::CallMethod) {
+      // Calls of interface methods have no statically known callee.
+      if (auto classType = node->input(0)->type()->cast<c10::ClassType>()) {
+        if (torch::jit::Function *method =
+                classType->findMethod(node->s(c10::attr::name))) {
+          callees.emplace_back(method, classType.get());
+        }
+      }
+    }
+    for (torch::jit::Block *nestedBlock : node->blocks()) {
+      collectCallees(nestedBlock, callees);
+    }
+  }
+}
+
+void IValueImporter::importReachableFunctions(
+    const std::vector<torch::jit::Function *> &roots) {
+  std::deque<std::pair<torch::jit::Function *, c10::ClassType *>> worklist;
+  for (torch::jit::Function *root : roots) {
+    worklist.emplace_back(root, nullptr);
+  }
+  std::vector<std::pair<torch::jit::Function *, c10::ClassType *>> callees;
+  while (!worklist.empty()) {
+    torch::jit::Function *function = worklist.front().first;
+    c10::ClassType *classType = worklist.front().second;
+    worklist.pop_front();
+    if (!importedFunctions.insert(function).second) {
+      continue;
+    }
+    importFunctionAndSpecializations(function);
+
+    // A private method of an already imported class type is added to it now
+    // that it is reachable (its exported methods were imported along with
+    // the class type).
+    auto body = classTypeBodies.find(classType);
+    if (body != classTypeBodies.end()) {
+      const auto &methods = classType->methods();
+      auto method = std::find(methods.begin(), methods.end(), function);
+      if (method != methods.end()) {
+        ClassAnnotation &classAnnotation =
+            annotator.getOrCreateClassAnnotation(classType);
+        importMethod(function, body->second,
+                     classAnnotation
+                         .getMethodAnnotations()[method - methods.begin()]);
+      }
+    }
 
-  for (torch::jit::Function *function : cu->get_functions()) {
-    // Useful for debugging errors in free functions that end up being
-    // unused. These can be missing when round-tripping through the on-disk
-    // format, even though they still cause import issues when importing
-    // through the larger Python session where they originate.
-    // std::cerr << "NAME: " << function->qualname().qualifiedName() << "\n";
-    // std::cerr << *function->graph();
-    MethodAnnotation *annotation =
-        annotator.getMethodAnnotationForFunction(function);
-    MlirOperation func = importJitFunctionAsFuncOp(
-        context, function, [&](int argIndex) -> MlirAttribute {
-          if (!annotation || !annotation->argAnnotations.has_value()) {
-            return {nullptr};
-          }
-          c10::optional<std::vector<int64_t>> &maybeShape =
-              annotation->argAnnotations.value()[argIndex].shape;
-          c10::optional<c10::ScalarType> &maybeDtype =
-              annotation->argAnnotations.value()[argIndex].dtype;
-          bool hasValueSemantics =
-              annotation->argAnnotations.value()[argIndex].hasValueSemantics;
-
-          // TODO: Handle unranked tensors and tensors with unknown dtype (but
-          // possibly known ranks/sizes).
-          if (!maybeShape || !maybeDtype) {
-            return {nullptr};
-          }
-
-          std::vector<int64_t> shape = *maybeShape;
-          MlirType dtype = TypeMapper(context).mapFromTorchScalarType(
-              mlirLocationUnknownGet(context), *maybeDtype);
-          MlirType typeBound;
-          if (hasValueSemantics) {
-            typeBound = npcompValueTensorTypeGet(context, shape.size(),
-                                                 shape.data(), dtype);
-          } else {
-            typeBound = npcompNonValueTensorTypeGet(context, shape.size(),
-                                                    shape.data(), dtype);
-          }
-
-          MlirNamedAttribute typeBoundAttr = toMlirNamedAttribute(
-              "torch.type_bound", mlirTypeAttrGet(typeBound));
-          return mlirDictionaryAttrGet(context, 1, &typeBoundAttr);
-        });
-    // For IValue importing, the logical linkage structure of the module
-    // is determined by the object graph.
-    //
-    // The functions' symbol names are thus irrelevant to the module's
-    // externally visible characteristics, so mark them all as private.
-    //
-    // These functions may be referenced by the object graph, which can make
-    // them reachable from the exernally visible characteristics of the module,
-    // but they cannot be intrinsically externally visible.
+    callees.clear();
+    collectCallees(function->graph()->block(), callees);
+    worklist.insert(worklist.end(), callees.begin(), callees.end());
+  }
+}
+
+void IValueImporter::importFunctionAndSpecializations(
+    torch::jit::Function *function) {
+  // Useful for debugging errors in free functions.
+  // std::cerr << "NAME: " << function->qualname().qualifiedName() << "\n";
+  // std::cerr << *function->graph();
+  MethodAnnotation *annotation =
+      annotator.getMethodAnnotationForFunction(function);
+  const std::vector<ArgAnnotation> *argAnnotations = nullptr;
+  if (annotation && annotation->argAnnotations.has_value()) {
+    argAnnotations = &annotation->argAnnotations.value();
+  }
+  importFunction(function, argAnnotations,
+                 function->qualname().qualifiedName());
+  // Each specialization is a copy of the function with the arguments
+  // annotated with the specialized signature.
+  if (annotation) {
+    for (int i = 0, e = annotation->argSpecializations.size(); i != e; i++) {
+      importFunction(function, &annotation->argSpecializations[i],
+                     getSpecializationName(
+                         function->qualname().qualifiedName(), i));
+    }
+  }
+}
+
+void IValueImporter::importFunction(
+    torch::jit::Function *function,
+    const std::vector<ArgAnnotation> *argAnnotations,
+    const std::string &symName) {
+  MlirOperation func = importJitFunctionAsFuncOp(
+      context, function, [&](int argIndex) -> MlirAttribute {
+        if (!argAnnotations) {
+          return {nullptr};
+        }
+        const ArgAnnotation &argAnnotation = (*argAnnotations)[argIndex];
+        const c10::optional<std::vector<int64_t>> &maybeShape =
+            argAnnotation.shape;
+        const c10::optional<c10::ScalarType> &maybeDtype = argAnnotation.dtype;
+        bool hasValueSemantics = argAnnotation.hasValueSemantics;
+
+        // TODO: Handle unranked tensors and tensors with unknown dtype (but
+        // possibly known ranks/sizes).
+        if (!maybeShape || !maybeDtype) {
+          return {nullptr};
+        }
+
+        std::vector<int64_t> shape = *maybeShape;
+        MlirType dtype = TypeMapper(context).mapFromTorchScalarType(
+            mlirLocationUnknownGet(context), *maybeDtype);
+        MlirType typeBound;
+        if (hasValueSemantics) {
+          typeBound = npcompValueTensorTypeGet(context, shape.size(),
+                                               shape.data(), dtype);
+        } else {
+          typeBound = npcompNonValueTensorTypeGet(context, shape.size(),
+                                                  shape.data(), dtype);
+        }
+
+        MlirNamedAttribute typeBoundAttr = toMlirNamedAttribute(
+            "torch.type_bound", mlirTypeAttrGet(typeBound));
+        return mlirDictionaryAttrGet(context, 1, &typeBoundAttr);
+      });
+  if (symName != function->qualname().qualifiedName()) {
     mlirOperationSetAttributeByName(
-        func, toMlirStringRef("sym_visibility"),
-        mlirStringAttrGet(context, toMlirStringRef("private")));
-    mlirBlockInsertOwnedOperationBefore(
-        importBlock, mlirBlockGetTerminator(importBlock), func);
+        func, toMlirStringRef("sym_name"),
+        mlirStringAttrGet(context, toMlirStringRef(symName)));
   }
+  // For IValue importing, the logical linkage structure of the module
+  // is determined by the object graph.
+  //
+  // The functions' symbol names are thus irrelevant to the module's
+  // externally visible characteristics, so mark them all as private.
+  //
+  // These functions may be referenced by the object graph, which can make
+  // them reachable from the exernally visible characteristics of the module,
+  // but they cannot be intrinsically externally visible.
+  mlirOperationSetAttributeByName(
+      func, toMlirStringRef("sym_visibility"),
+      mlirStringAttrGet(context, toMlirStringRef("private")));
+  // The functions precede the class types referring to them.
+  mlirBlockInsertOwnedOperationBefore(
+      importBlock,
+      mlirOperationIsNull(firstClassType) ? mlirBlockGetTerminator(importBlock)
+                                          : firstClassType,
+      func);
 }
 
 void torch_mlir::importIValue(c10::IValue ivalue, MlirBlock block,
-                              MlirContext context, ClassAnnotator &annotator) {
+                              MlirContext context, ClassAnnotator &annotator,
+                              ExternalTensorStorage *externalStorage) {
   // When debugging module importing, it can be useful to dump as so:
   // if (ivalue.isModule())
   //   ivalue.toModule().dump(true, false, false);
-  IValueImporter importer(block, context, annotator);
+  IValueImporter importer(block, context, annotator, externalStorage);
+  importer.convertTensors(ivalue);
   importer.importIValue(ivalue);
 }
@@ -22,10 +22,18 @@
 
 namespace torch_mlir {
 
+class ExternalTensorStorage;
+
 /// Main entry-point for importing torch IValue's .
 /// Recursively imports `ivalue`, inserting operations at the end of `block`.
+/// The tensors reachable from `ivalue` are converted in parallel, on the ATen
+/// thread pool.
+///
+/// If `externalStorage` is non-null, the tensors large enough for it are
+/// stored there instead of in the IR.
 void importIValue(c10::IValue ivalue, MlirBlock block, MlirContext context,
-                  ClassAnnotator &annotator);
+                  ClassAnnotator &annotator,
+                  ExternalTensorStorage *externalStorage = nullptr);
 
 } // namespace torch_mlir
 
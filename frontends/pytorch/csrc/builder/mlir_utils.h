@@ -92,7 +92,7 @@ void addToMlirOperationState(MlirOperationState &state, T &&t, U &&u,
 }
 
 template <typename... Ts>
-MlirOperation createMlirOperation(std::string name, MlirLocation loc,
+MlirOperation createMlirOperation(const std::string &name, MlirLocation loc,
                                   Ts &&...ts) {
   MlirOperationState state = mlirOperationStateGet(toMlirStringRef(name), loc);
   addToMlirOperationState(state, std::forward<Ts>(ts)...);
@@ -100,7 +100,8 @@ MlirOperation createMlirOperation(std::string name, MlirLocation loc,
 }
 
 template <typename... Ts>
-MlirOperation createMlirOperationAtEnd(MlirBlock block, std::string name,
+MlirOperation createMlirOperationAtEnd(MlirBlock block,
+                                       const std::string &name,
                                        MlirLocation loc, Ts &&...ts) {
   MlirOperation operation =
       createMlirOperation(name, loc, std::forward<Ts>(ts)...);
@@ -124,7 +124,22 @@ ModuleBuilder::ModuleBuilder(pybind11::object contextObj)
 
 std::shared_ptr<AcapController>
 ModuleBuilder::startCaptureFunction(std::string &name,
-                                    std::vector<at::Tensor> args) {
+                                    std::vector<at::Tensor> args,
+                                    bool captureOnly,
+                                    const std::string &capturedTensors) {
+  CapturedTensorMode capturedTensorMode;
+  if (capturedTensors == "constants") {
+    capturedTensorMode = CapturedTensorMode::Constants;
+  } else if (capturedTensors == "arguments") {
+    capturedTensorMode = CapturedTensorMode::Arguments;
+  } else if (capturedTensors == "globals") {
+    capturedTensorMode = CapturedTensorMode::GlobalSlots;
+  } else {
+    throw std::invalid_argument(
+        "captured_tensors must be 'constants', 'arguments' or 'globals', "
+        "not '" + capturedTensors + "'");
+  }
+
   // TODO: Verify that arguments do not alias each other.
   std::vector<MlirType> inputTypes;
   for (auto &arg : args) {
@@ -143,7 +158,8 @@ ModuleBuilder::startCaptureFunction(std::string &name,
   for (size_t i = 0; i < args.size(); ++i) {
     funcBuilder->mapTensor(args[i], mlirBlockGetArgument(entryBlock, i));
   }
-  return std::make_shared<AcapController>(typeMapper, std::move(funcBuilder));
+  return std::make_shared<AcapController>(typeMapper, std::move(funcBuilder),
+                                          captureOnly, capturedTensorMode);
 }
 
 torch::jit::StrongFunctionPtr
@@ -156,14 +172,21 @@ ModuleBuilder::importFunction(torch::jit::StrongFunctionPtr function) {
 }
 
 void ModuleBuilder::importModule(torch::jit::Module jitModule,
-                                 py::object maybeClassAnnotator) {
+                                 py::object maybeClassAnnotator,
+                                 const std::string &externalWeightsPath,
+                                 int64_t externalWeightsMinBytes) {
   ClassAnnotator dummyAnnotator;
   ClassAnnotator *classAnnotator = &dummyAnnotator;
   if (!maybeClassAnnotator.is_none()) {
     classAnnotator = py::cast<ClassAnnotator *>(maybeClassAnnotator);
   }
+  std::unique_ptr<ExternalTensorStorage> externalStorage;
+  if (!externalWeightsPath.empty())
+    externalStorage = std::make_unique<ExternalTensorStorage>(
+        externalWeightsPath, externalWeightsMinBytes);
   importIValue(jitModule._ivalue(), mlirModuleGetBody(module),
-               mlirModuleGetContext(module), *classAnnotator);
+               mlirModuleGetContext(module), *classAnnotator,
+               externalStorage.get());
 }
 
 FuncBuilder::Inserter ModuleBuilder::createInserter() {
@@ -185,8 +208,11 @@ void ModuleBuilder::bind(py::module &m) {
       .def_property_readonly("context", &ModuleBuilder::getContextObj)
       .def_property_readonly("module", &ModuleBuilder::getModuleObj)
       .def("capture_function", &ModuleBuilder::startCaptureFunction,
-           py::keep_alive<0, 1>())
+           py::arg("name"), py::arg("args"), py::arg("capture_only") = false,
+           py::arg("captured_tensors") = "constants", py::keep_alive<0, 1>())
       .def("import_function", &ModuleBuilder::importFunction)
       .def("import_module", &ModuleBuilder::importModule, py::arg("module"),
-           py::arg("classAnnotator") = py::none());
+           py::arg("classAnnotator") = py::none(),
+           py::arg("external_weights_path") = "",
+           py::arg("external_weights_min_bytes") = 1 << 20);
 }
@@ -34,9 +34,12 @@ public:
   pybind11::object getContextObj() { return contextObj; }
   pybind11::object getModuleObj() { return moduleObj; }
 
-  // Starts a device-capture based function.
+  // Starts a device-capture based function. `capturedTensors` is how the
+  // tensors that it captures are imported: "constants", "arguments" or
+  // "globals" (see CapturedTensorMode).
   std::shared_ptr<AcapController>
-  startCaptureFunction(std::string &name, std::vector<at::Tensor> args);
+  startCaptureFunction(std::string &name, std::vector<at::Tensor> args,
+                       bool captureOnly, const std::string &capturedTensors);
 
   // Imports a traced function. Note that the python type
   // torch.jit.ScriptFunction is the C++ type torch::jit::StrongFunctionPtr.
@@ -48,8 +51,14 @@ public:
   // Imports a torch::jit::Module into the current module, using the
   // annotations, if not none, provided in `maybeClassAnnotator` which should be
   // a ClassAnnotator.
+  //
+  // If `externalWeightsPath` is not empty, the tensors of at least
+  // `externalWeightsMinBytes` bytes are written to a new file at that path,
+  // and only referenced from the IR (see ExternalTensorStorage).
   void importModule(torch::jit::Module jitModule,
-                    py::object maybeClassAnnotator);
+                    py::object maybeClassAnnotator,
+                    const std::string &externalWeightsPath,
+                    int64_t externalWeightsMinBytes);
 
 private:
   FuncBuilder::Inserter createInserter();
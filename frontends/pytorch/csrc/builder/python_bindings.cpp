@@ -131,7 +131,9 @@ void torch_mlir::InitBuilderBindings(py::module &m) {
                                                               "AcapController")
       .def("__enter__", &AcapController::contextEnter)
       .def("__exit__", &AcapController::contextExit)
-      .def("returns", &AcapController::returns);
+      .def("returns", &AcapController::returns)
+      .def_property_readonly("captured_tensors",
+                             &AcapController::getCapturedTensors);
   m.def("get_registered_ops", &GetRegisteredOps, kGetRegisteredOpsDocstring);
 
   ModuleBuilder::bind(m);
@@ -8,6 +8,8 @@
 #include "function_importer.h"
 #include "ivalue_importer.h"
 
+#include <cstdlib>
+#include <cstring>
 #include <unordered_map>
 
 #include "mlir_utils.h"
@@ -15,6 +17,7 @@
 #include "mlir-c/BuiltinAttributes.h"
 #include "mlir-c/BuiltinTypes.h"
 #include "mlir-c/Diagnostics.h"
+#include "npcomp-c/Attributes.h"
 #include "npcomp-c/Types.h"
 
 using namespace torch_mlir;
@@ -246,8 +249,62 @@ torch_mlir::getFunctionTypeFromSchema(MlirContext context,
                              outputTypes.size(), outputTypes.data());
 }
 
-MlirAttribute torch_mlir::convertTensorToMlirElementsAttr(at::Tensor tensor,
-                                                          MlirLocation loc) {
+// The alignment of the tensors in the file of an ExternalTensorStorage. This
+// is enough for the compiled code to use them in place with vector loads.
+static constexpr int64_t kExternalTensorAlignment = 64;
+
+ExternalTensorStorage::ExternalTensorStorage(const std::string &path,
+                                             int64_t minBytes)
+    : minBytes(minBytes),
+      file(path, std::ios::binary | std::ios::out | std::ios::trunc) {
+  // The compiled code may be loaded from another working directory.
+  char *absolutePath = file ? realpath(path.c_str(), nullptr) : nullptr;
+  if (!absolutePath)
+    throw std::runtime_error("could not create external tensor storage '" +
+                             path + "'");
+  this->path = absolutePath;
+  free(absolutePath);
+}
+
+MlirAttribute ExternalTensorStorage::store(const at::Tensor &tensor,
+                                           MlirType shapedType) {
+  if (!accepts(tensor))
+    return {nullptr};
+  int64_t numBytes = tensor.numel() * tensor.element_size();
+  auto inserted = offsets.insert({{tensor.data_ptr(), numBytes}, fileSize});
+  if (inserted.second) {
+    int64_t padding = (kExternalTensorAlignment -
+                       fileSize % kExternalTensorAlignment) %
+                      kExternalTensorAlignment;
+    for (int64_t i = 0; i < padding; i++)
+      file.put(0);
+    inserted.first->second = fileSize + padding;
+    file.write(static_cast<const char *>(tensor.data_ptr()), numBytes);
+    file.flush();
+    if (!file)
+      throw std::runtime_error("could not write external tensor storage '" +
+                               path + "'");
+    fileSize += padding + numBytes;
+    storedTensors.push_back(tensor);
+  }
+  return npcompExternalElementsAttrGet(shapedType, toMlirStringRef(path),
+                                       inserted.first->second);
+}
+
+// Returns true if all the elements of the contiguous `tensor` have the same
+// bits.
+static bool isSplatTensor(const at::Tensor &tensor) {
+  size_t elementSize = tensor.element_size();
+  size_t numBytes = tensor.numel() * elementSize;
+  if (numBytes <= elementSize)
+    return true;
+  const char *data = static_cast<const char *>(tensor.data_ptr());
+  return std::memcmp(data, data + elementSize, numBytes - elementSize) == 0;
+}
+
+MlirAttribute torch_mlir::convertTensorToMlirElementsAttr(
+    at::Tensor tensor, MlirLocation loc,
+    ExternalTensorStorage *externalStorage) {
   MlirContext context = mlirLocationGetContext(loc);
   TypeMapper typeMapper(context);
   using at::ScalarType;
@@ -258,6 +315,12 @@ MlirAttribute torch_mlir::convertTensorToMlirElementsAttr(at::Tensor tensor,
     throw std::invalid_argument(msg.str());
   };
 
+  // Sparse (COO and CSR) tensors, such as the embedding tables of
+  // recommendation models, are imported as their dense equivalent, which the
+  // compiled gathers index directly.
+  if (tensor.layout() != c10::Layout::Strided)
+    tensor = tensor.to_dense();
+
   // Get a C-contiguous form as we can bulk-load that into a DenseElementsAttr.
   if (!tensor.is_contiguous())
     tensor = tensor.contiguous();
@@ -292,42 +355,39 @@ MlirAttribute torch_mlir::convertTensorToMlirElementsAttr(at::Tensor tensor,
     throwUnsupportedTensorError();
   }
 
-  // Import DenseElementsAttr data.
-  // TODO: Support bool tensors.
-  // TODO: More import formats in C-API.
-  auto numElements = tensor.numel();
-  auto tensorData = tensor.data_ptr();
-  switch (tensor.scalar_type()) {
-  case ScalarType::Int:
-    return mlirDenseElementsAttrInt32Get(
-        shapedType, numElements, static_cast<const int32_t *>(tensorData));
-    break;
-  case ScalarType::Long:
-    return mlirDenseElementsAttrInt64Get(
-        shapedType, numElements, static_cast<const int64_t *>(tensorData));
-    break;
-  case ScalarType::Float:
-    return mlirDenseElementsAttrFloatGet(
-        shapedType, numElements, static_cast<const float *>(tensorData));
-    break;
-  case ScalarType::Double:
-    return mlirDenseElementsAttrDoubleGet(
-        shapedType, numElements, static_cast<const double *>(tensorData));
-    break;
-  case ScalarType::Bool:
-    // TODO: Add a test specifically for bool and ensure consistency between
-    // storage format and load format
-    // (https://github.com/llvm/mlir-npcomp/issues/100).
-    return mlirDenseElementsAttrBoolGet(shapedType, numElements,
-                                        static_cast<const int *>(tensorData));
-    break;
-  case ScalarType::QInt8:
-    return mlirDenseElementsAttrInt8Get(
-        shapedType, numElements, static_cast<const int8_t *>(tensorData));
-  default:
-    throwUnsupportedTensorError();
+  // Large tensors of the types imported below can be stored externally as
+  // is: their in-memory layout is that of the MLIR element type (bools are
+  // stored one per byte). Splats (such as zero-initialized biases) are kept
+  // inline, where they take the space of one element and the backend can
+  // fill them instead of loading them.
+  if (externalStorage && !isSplatTensor(tensor)) {
+    switch (tensor.scalar_type()) {
+    case ScalarType::Byte:
+    case ScalarType::Char:
+    case ScalarType::Short:
+    case ScalarType::Int:
+    case ScalarType::Long:
+    case ScalarType::Half:
+    case ScalarType::BFloat16:
+    case ScalarType::Float:
+    case ScalarType::Double:
+    case ScalarType::Bool:
+    case ScalarType::QInt8: {
+      MlirAttribute external = externalStorage->store(tensor, shapedType);
+      if (!mlirAttributeIsNull(external))
+        return external;
+      break;
+    }
+    default:
+      break;
+    }
   }
-  return {nullptr}; // Unreachable.
+
+  // Import DenseElementsAttr data. The storage of the tensor is in the
+  // in-memory layout of its element type (bools are stored one per byte,
+  // halves and bfloat16s as their bits), so it is copied as is.
+  return npcompDenseElementsAttrGetFromBuffer(
+      shapedType, tensor.numel() * tensor.element_size(), tensor.data_ptr());
 }
 
 MlirAttribute torch_mlir::importAttribute(MlirLocation loc,
@@ -405,13 +465,8 @@ torch_mlir::derefineValues(c10::ArrayRef<MlirValue> values,
   return ret;
 }
 
-MlirOperation
-torch_mlir::createOperationFromSchema(MlirBlock appendToBlock, MlirLocation loc,
-                                      const c10::FunctionSchema &schema,
-                                      c10::ArrayRef<MlirType> resultTypes,
-                                      c10::ArrayRef<MlirValue> operands) {
-  MlirContext context = mlirLocationGetContext(loc);
-
+SchemaOpInfo torch_mlir::getSchemaOpInfo(MlirContext context,
+                                         const c10::FunctionSchema &schema) {
   // Munge the name into the appropriate MLIR operation name.
   // See torch_ods_gen.py:JitOperator for the logic used to construct the MLIR
   // op name from the schema. This logic must be kept in sync with that logic.
@@ -426,8 +481,7 @@ torch_mlir::createOperationFromSchema(MlirBlock appendToBlock, MlirLocation loc,
   std::string opName = "torch." + opNameSuffix;
   // If we have a registered op, use it!
   if (mlirContextIsRegisteredOperation(context, toMlirStringRef(opName))) {
-    return createMlirOperationAtEnd(appendToBlock, opName, loc, resultTypes,
-                                    operands);
+    return {opName, {nullptr}};
   }
   // Oops, no registered op -- create an opaque wrapper so that import can
   // still succeed. This helps a common use case of filling out registered ops
@@ -438,8 +492,30 @@ torch_mlir::createOperationFromSchema(MlirBlock appendToBlock, MlirLocation loc,
   // - Makes the dialect overall less strict
   // - Makes it hard to see exactly which ops from a model are registered or
   //   not.
-  return createMlirOperationAtEnd(
-      appendToBlock, "torch.operator", loc, resultTypes, operands,
-      toMlirNamedAttribute(
-          "name", mlirStringAttrGet(context, toMlirStringRef(opNameSuffix))));
+  return {"torch.operator",
+          mlirStringAttrGet(context, toMlirStringRef(opNameSuffix))};
+}
+
+MlirOperation
+torch_mlir::createOperationFromSchema(MlirBlock appendToBlock, MlirLocation loc,
+                                      const SchemaOpInfo &opInfo,
+                                      c10::ArrayRef<MlirType> resultTypes,
+                                      c10::ArrayRef<MlirValue> operands) {
+  c10::optional<MlirNamedAttribute> operatorName;
+  if (!mlirAttributeIsNull(opInfo.operatorName)) {
+    operatorName = toMlirNamedAttribute("name", opInfo.operatorName);
+  }
+  return createMlirOperationAtEnd(appendToBlock, opInfo.opName, loc,
+                                  resultTypes, operands, operatorName);
+}
+
+MlirOperation
+torch_mlir::createOperationFromSchema(MlirBlock appendToBlock, MlirLocation loc,
+                                      const c10::FunctionSchema &schema,
+                                      c10::ArrayRef<MlirType> resultTypes,
+                                      c10::ArrayRef<MlirValue> operands) {
+  return createOperationFromSchema(
+      appendToBlock, loc,
+      getSchemaOpInfo(mlirLocationGetContext(loc), schema), resultTypes,
+      operands);
 }
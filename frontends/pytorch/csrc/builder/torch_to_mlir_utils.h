@@ -8,7 +8,10 @@
 #ifndef NPCOMP_FRONTENDS_PYTORCH_CSRC_TORCH_TO_MLIR_UTILS_H
 #define NPCOMP_FRONTENDS_PYTORCH_CSRC_TORCH_TO_MLIR_UTILS_H
 
+#include <fstream>
+#include <map>
 #include <memory>
+#include <vector>
 
 #include "../pybind.h"
 
@@ -58,9 +61,49 @@ private:
 MlirType getFunctionTypeFromSchema(MlirContext context,
                                    const c10::FunctionSchema &schema);
 
+/// Storage for the elements of large tensors outside of the IR.
+///
+/// The elements of each stored tensor are appended to a blob file, and the
+/// tensor is imported as an external elements attribute referencing them
+/// (see npcompExternalElementsAttrGet), which the RefBackend maps into the
+/// compiled code. The file must therefore outlive the compiled code.
+///
+/// Tensors with the same data (such as tied weights) are only stored once.
+class ExternalTensorStorage {
+public:
+  /// Stores the tensors of at least `minBytes` bytes to a new file at `path`.
+  /// Throws std::runtime_error if the file can't be created.
+  ExternalTensorStorage(const std::string &path, int64_t minBytes);
+
+  /// Returns true if `tensor` is large enough to be stored.
+  bool accepts(const at::Tensor &tensor) const {
+    return tensor.numel() * tensor.element_size() >= minBytes;
+  }
+
+  /// Returns an attribute of type `shapedType` referencing the elements of the
+  /// contiguous `tensor`, or a null attribute if `tensor` is too small to be
+  /// stored.
+  MlirAttribute store(const at::Tensor &tensor, MlirType shapedType);
+
+private:
+  std::string path;
+  int64_t minBytes;
+  std::ofstream file;
+  uint64_t fileSize = 0;
+  // The offset in the file of each stored data pointer and size.
+  std::map<std::pair<const void *, int64_t>, uint64_t> offsets;
+  // The stored tensors, kept alive so that their data pointers aren't reused
+  // by tensors with other data.
+  std::vector<at::Tensor> storedTensors;
+};
+
 /// Creates an appropriate MlirAttribute that holds the same values as `tensor`.
-MlirAttribute convertTensorToMlirElementsAttr(at::Tensor tensor,
-                                              MlirLocation loc);
+///
+/// If `externalStorage` is non-null, tensors large enough for it are stored
+/// there instead.
+MlirAttribute convertTensorToMlirElementsAttr(
+    at::Tensor tensor, MlirLocation loc,
+    ExternalTensorStorage *externalStorage = nullptr);
 
 MlirAttribute importAttribute(MlirLocation loc, torch::jit::Node *node,
                               c10::Symbol symbol);
@@ -77,11 +120,33 @@ std::vector<MlirValue> derefineValues(c10::ArrayRef<MlirValue> values,
                                       MlirLocation loc,
                                       MlirBlock appendToBlock);
 
-/// Create the appropriate MLIR operation for the Torch operator with schema
+/// The kind of MLIR operation that the Torch operator with a given schema is
+/// imported as.
+struct SchemaOpInfo {
+  /// The registered op of the schema, or "torch.operator".
+  std::string opName;
+  /// For "torch.operator", its `name` attribute. Null otherwise.
+  MlirAttribute operatorName;
+};
+
+/// Returns the kind of MLIR operation for the Torch operator with schema
 /// "schema".
 ///
 /// The primary difficulty here is doing the appropriate name munging and
-/// checking if the have a registered op.
+/// checking if the have a registered op. Callers creating many operations for
+/// the same schema can compute this once.
+SchemaOpInfo getSchemaOpInfo(MlirContext context,
+                             const c10::FunctionSchema &schema);
+
+/// Create the MLIR operation of kind `opInfo`.
+MlirOperation createOperationFromSchema(MlirBlock appendToBlock,
+                                        MlirLocation loc,
+                                        const SchemaOpInfo &opInfo,
+                                        c10::ArrayRef<MlirType> resultTypes,
+                                        c10::ArrayRef<MlirValue> operands);
+
+/// Create the appropriate MLIR operation for the Torch operator with schema
+/// "schema".
 MlirOperation createOperationFromSchema(MlirBlock appendToBlock,
                                         MlirLocation loc,
                                         const c10::FunctionSchema &schema,
@@ -33,6 +33,42 @@ def MmModule_chained(module, tu: TestUtils):
 
 # ==============================================================================
 
+class BmmModule(torch.nn.Module):
+    def __init__(self):
+        super().__init__()
+    @export
+    @annotate_args([
+        None,
+        ([-1, -1, -1], torch.float32, True),
+        ([-1, -1, -1], torch.float32, True),
+    ])
+    def forward(self, lhs, rhs):
+        return torch.bmm(lhs, rhs)
+
+@register_test_case(module_factory=lambda: BmmModule())
+def BmmModule_basic(module, tu: TestUtils):
+    module.forward(tu.rand(3, 4, 5), tu.rand(3, 5, 6))
+
+# ==============================================================================
+
+class MatmulBroadcastModule(torch.nn.Module):
+    def __init__(self):
+        super().__init__()
+    @export
+    @annotate_args([
+        None,
+        ([-1, -1, -1], torch.float32, True),
+        ([-1, -1], torch.float32, True),
+    ])
+    def forward(self, lhs, rhs):
+        return torch.matmul(lhs, rhs)
+
+@register_test_case(module_factory=lambda: MatmulBroadcastModule())
+def MatmulBroadcastModule_basic(module, tu: TestUtils):
+    module.forward(tu.rand(3, 4, 5), tu.rand(5, 6))
+
+# ==============================================================================
+
 class TanhModule(torch.nn.Module):
     def __init__(self):
         super().__init__()
@@ -67,3 +103,21 @@ class MmTanhModule(torch.nn.Module):
 @register_test_case(module_factory=lambda: MmTanhModule())
 def MmTanhModule_basic(module, tu: TestUtils):
     module.forward(tu.rand(4, 2), tu.rand(2, 4))
+
+# ==============================================================================
+
+class ElementwiseBroadcastModule(torch.nn.Module):
+    def __init__(self):
+        super().__init__()
+    @export
+    @annotate_args([
+        None,
+        ([-1, -1], torch.float32, True),
+        ([1, -1], torch.float32, True),
+    ])
+    def forward(self, x, y):
+        return torch.maximum(x * y - x, y / (x + y))
+
+@register_test_case(module_factory=lambda: ElementwiseBroadcastModule())
+def ElementwiseBroadcastModule_basic(module, tu: TestUtils):
+    module.forward(tu.rand(3, 4), tu.rand(1, 4))
@@ -6,13 +6,18 @@ import argparse
 import re
 import sys
 
+from torch_mlir.torchscript.e2e_test.benchmark import (
+    BenchmarkThresholds, load_benchmark_results, report_benchmarks,
+    run_benchmarks, save_benchmark_results
+)
 from torch_mlir.torchscript.e2e_test.framework import run_tests
 from torch_mlir.torchscript.e2e_test.reporting import report_results
 from torch_mlir.torchscript.e2e_test.registry import GLOBAL_TEST_REGISTRY
 
 # Available test configs.
 from torch_mlir.torchscript.e2e_test.configs import (
-    RefBackendTestConfig, NativeTorchTestConfig, TorchScriptTestConfig
+    RefBackendTestConfig, NativeTorchTestConfig, TorchScriptTestConfig,
+    IreeBackendTestConfig
 )
 
 # Import tests to register them in the global registry.
@@ -30,11 +35,12 @@ import quantized_models
 def _get_argparse():
     parser = argparse.ArgumentParser(description='Run torchscript e2e tests.')
     parser.add_argument('--config',
-        choices=['native_torch', 'torchscript', 'refbackend'],
+        choices=['native_torch', 'torchscript', 'refbackend', 'iree'],
         default='refbackend',
         help='''
 Meaning of options:
 "refbackend": run through npcomp's RefBackend.
+"iree": run through IREE, with its asynchronous, multi-threaded "dylib" HAL driver.
 "native_torch": run the torch.nn.Module as-is without compiling (useful for verifying model is deterministic; ALL tests should pass in this configuration).
 "torchscript": compile the model to a torch.jit.ScriptModule, and then run that as-is (useful for verifying TorchScript is modeling the program correctly).
 ''')
@@ -45,6 +51,38 @@ Regular expression specifying which tests to include in this run.
                         default=False,
                         action='store_true',
                         help='report test results with additional detail')
+    parser.add_argument('-j', '--jobs', type=int, default=None, help='''
+the number of tests to run in parallel (one per CPU by default)
+''')
+    parser.add_argument('--cache-dir', default=None, help='''
+directory caching the artifacts compiled by the "refbackend" config across
+runs (the NPCOMP_E2E_CACHE_DIR environment variable by default)
+''')
+    parser.add_argument('--benchmark',
+                        default=False,
+                        action='store_true',
+                        help='''
+Instead of checking the results, benchmark the tests under both the
+"refbackend" and "native_torch" configs (ignoring --config).
+''')
+    parser.add_argument('--benchmark-iterations', type=int, default=10,
+                        help='the number of timed runs of each test')
+    parser.add_argument('--benchmark-warmup', type=int, default=1,
+                        help='the number of untimed runs before the timed ones')
+    parser.add_argument('--benchmark-output',
+                        help='save the benchmark results to this JSON file')
+    parser.add_argument('--benchmark-baseline', help='''
+JSON file saved by --benchmark-output of an earlier run to report regressions
+against. Exits with an error if there are any.
+''')
+    parser.add_argument('--latency-threshold', type=float, default=0.1,
+                        help='''
+the relative warm latency increase over the baseline reported as a regression
+''')
+    parser.add_argument('--compile-time-threshold', type=float, default=0.25,
+                        help='''
+the relative compile time increase over the baseline reported as a regression
+''')
     return parser
 
 def main():
@@ -52,11 +90,13 @@ def main():
 
     # Find the selected config.
     if args.config == 'refbackend':
-        config = RefBackendTestConfig()
+        config = RefBackendTestConfig(cache_dir=args.cache_dir)
     elif args.config == 'native_torch':
         config = NativeTorchTestConfig()
     elif args.config == 'torchscript':
         config = TorchScriptTestConfig()
+    elif args.config == 'iree':
+        config = IreeBackendTestConfig()
 
     # Find the selected tests, and emit a diagnostic if none are found.
     tests = [
@@ -72,8 +112,28 @@ def main():
             print(test.unique_name)
         sys.exit(1)
 
+    if args.benchmark:
+        configs = {
+            # Cached compilations would hide the compile time.
+            'refbackend': RefBackendTestConfig(enable_cache=False),
+            'native_torch': NativeTorchTestConfig(),
+        }
+        results = run_benchmarks(tests, configs, args.benchmark_iterations,
+                                 args.benchmark_warmup)
+        if args.benchmark_output:
+            save_benchmark_results(results, args.benchmark_output)
+        baseline = None
+        if args.benchmark_baseline:
+            baseline = load_benchmark_results(args.benchmark_baseline)
+        thresholds = BenchmarkThresholds(
+            warm_latency=args.latency_threshold,
+            compile_time=args.compile_time_threshold)
+        regressions = report_benchmarks(results, 'native_torch', baseline,
+                                        thresholds)
+        sys.exit(1 if regressions else 0)
+
     # Run the tests.
-    results = run_tests(tests, config)
+    results = run_tests(tests, config, num_workers=args.jobs)
 
     # Report the test results.
     report_results(results, args.verbose)
@@ -61,6 +61,29 @@ def annotate_args(annotations: List[Optional[ArgAnnotation]]):
     return decorator
 
 
+def specialize_args(annotations: List[Optional[ArgAnnotation]]):
+    """Decorator that adds a specialization of a method for certain arguments.
+
+    The `annotations` have the same format as for `annotate_args`. The
+    compiler generates an additional version of the method for them, and calls
+    of the method with arguments that match them are dispatched to it.
+    Annotating fully static shapes allows the compiler to generate much faster
+    code. The decorator can be applied several times, for example once for each
+    batch size that is common in practice. The signature given by
+    `annotate_args` (if any) is used for the calls that match none of the
+    specializations.
+    """
+
+    def decorator(fn):
+        specializations = getattr(fn, '_npcomp_arg_specializations', [])
+        # Decorators are applied bottom-up, so prepend to keep the order in
+        # which they are written.
+        fn._npcomp_arg_specializations = [annotations] + specializations
+        return fn
+
+    return decorator
+
+
 # Utilities for extracting decorated information into torch_mlir.ClassAnnotator.
 
 
@@ -80,6 +103,10 @@ def _recursively_extract_annotations(
             class_annotator.annotateArgs(
                 scripted._c._type(), [method_name],
                 method._npcomp_arg_annotations)
+        for specialization in getattr(method, '_npcomp_arg_specializations',
+                                      []):
+            class_annotator.specializeArgs(scripted._c._type(), [method_name],
+                                           specialization)
     # Recurse.
     for name, child in module.named_children():
         scripted_child = getattr(scripted, name)
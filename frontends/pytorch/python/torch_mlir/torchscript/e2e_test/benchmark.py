@@ -0,0 +1,216 @@
+#  Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+#  See https://llvm.org/LICENSE.txt for license information.
+#  SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+"""
+Performance benchmarking of the tests of the test framework.
+
+Each `Test` is compiled with each of a set of `TestConfig`'s, and its golden
+trace is then replayed through `TestConfig.run` repeatedly. One replay of the
+whole trace is the unit that is timed (a "run").
+
+The results can be saved as JSON and used as the baseline of a later
+benchmark run, which reports the tests that got slower than the baseline by
+more than a threshold. That's how to tell whether a lowering change made
+codegen slower: benchmark before and after it on the same machine.
+"""
+
+import json
+import os
+import statistics
+import time
+from typing import Dict, List, NamedTuple, Optional
+
+from .framework import Test, TestConfig, _generate_golden_trace
+
+
+class BenchmarkResult(NamedTuple):
+    # Should match Test.unique_name for corresponding test.
+    unique_name: str
+    # The name of the TestConfig that ran the test.
+    config_name: str
+    # If compilation or running failed, a string describing the failure.
+    # If this is not None, then the measurements are None, and vice-versa.
+    error: Optional[str]
+    # The time taken by `TestConfig.compile`, in seconds.
+    compile_time: Optional[float]
+    # The time taken by the first run, which includes lazy initialization
+    # such as loading the compiled artifact, in seconds.
+    first_run_latency: Optional[float]
+    # The median time of the runs after the warmup runs, in seconds.
+    warm_latency: Optional[float]
+    # The number of warm runs per second.
+    throughput: Optional[float]
+    # The growth of the resident set size of the process from before
+    # compiling to after the last run, in bytes, or None if unknown. This
+    # includes memory held by the compiled artifact.
+    memory_growth: Optional[int]
+
+
+def _get_rss() -> Optional[int]:
+    """Returns the resident set size of the process, if known."""
+    try:
+        with open('/proc/self/statm') as f:
+            return int(f.read().split()[1]) * os.sysconf('SC_PAGE_SIZE')
+    except (OSError, ValueError, IndexError):
+        return None
+
+
+def _benchmark_test(test: Test, config_name: str, config: TestConfig,
+                    iterations: int, warmup: int) -> BenchmarkResult:
+    def failure(error: str):
+        return BenchmarkResult(unique_name=test.unique_name,
+                               config_name=config_name,
+                               error=error,
+                               compile_time=None,
+                               first_run_latency=None,
+                               warm_latency=None,
+                               throughput=None,
+                               memory_growth=None)
+
+    golden_trace = _generate_golden_trace(test)
+    rss_before = _get_rss()
+    try:
+        start = time.perf_counter()
+        compiled = config.compile(test.program_factory())
+        compile_time = time.perf_counter() - start
+    except Exception as e:
+        return failure('compilation error: ' + str(e))
+    try:
+        start = time.perf_counter()
+        config.run(compiled, golden_trace)
+        first_run_latency = time.perf_counter() - start
+        for _ in range(warmup):
+            config.run(compiled, golden_trace)
+        latencies = []
+        for _ in range(iterations):
+            start = time.perf_counter()
+            config.run(compiled, golden_trace)
+            latencies.append(time.perf_counter() - start)
+    except Exception as e:
+        return failure('run error: ' + str(e))
+    rss_after = _get_rss()
+    memory_growth = None
+    if rss_before is not None and rss_after is not None:
+        memory_growth = max(rss_after - rss_before, 0)
+    return BenchmarkResult(unique_name=test.unique_name,
+                           config_name=config_name,
+                           error=None,
+                           compile_time=compile_time,
+                           first_run_latency=first_run_latency,
+                           warm_latency=statistics.median(latencies),
+                           throughput=len(latencies) / sum(latencies),
+                           memory_growth=memory_growth)
+
+
+def run_benchmarks(tests: List[Test],
+                   configs: Dict[str, TestConfig],
+                   iterations: int = 10,
+                   warmup: int = 1) -> List[BenchmarkResult]:
+    """Benchmark the given `Test`'s with each of the named `TestConfig`'s.
+
+    Each test is run `warmup` untimed times and then `iterations` timed times
+    after its first run.
+    """
+    assert iterations > 0, 'need at least one timed run'
+    results = []
+    for test in tests:
+        for config_name, config in configs.items():
+            results.append(
+                _benchmark_test(test, config_name, config, iterations,
+                                warmup))
+    return results
+
+
+def save_benchmark_results(results: List[BenchmarkResult], filename: str):
+    """Save `results` as JSON, for use as a baseline of a later run."""
+    with open(filename, 'w') as f:
+        json.dump([r._asdict() for r in results], f, indent=2)
+
+
+def load_benchmark_results(filename: str) -> List[BenchmarkResult]:
+    """Load results saved by `save_benchmark_results`."""
+    with open(filename) as f:
+        return [BenchmarkResult(**r) for r in json.load(f)]
+
+
+def _format_time(seconds: Optional[float]) -> str:
+    return 'n/a' if seconds is None else f'{seconds * 1000:.3f}'
+
+
+def _format_memory(size: Optional[int]) -> str:
+    return 'n/a' if size is None else f'{size / (1024 * 1024):.1f}'
+
+
+class BenchmarkThresholds(NamedTuple):
+    """The relative slowdowns that are reported as regressions."""
+    # For example 0.1 means 10% slower than the baseline.
+    warm_latency: float = 0.1
+    compile_time: float = 0.25
+
+
+def report_benchmarks(results: List[BenchmarkResult],
+                      reference_config: Optional[str] = None,
+                      baseline: Optional[List[BenchmarkResult]] = None,
+                      thresholds: BenchmarkThresholds = BenchmarkThresholds()
+                      ) -> List[str]:
+    """Print a table of `results` and return the regressions found.
+
+    If `reference_config` is given, the warm latency of each test under the
+    other configs is also reported relative to the latency under it, such as
+    the speed of the RefBackend relative to native Torch.
+
+    If `baseline` is given, each result is compared with the baseline result
+    of the same test and config. A regression is reported when its warm
+    latency or compile time exceeds the baseline by more than `thresholds`,
+    or when a test that succeeded in the baseline now fails.
+    """
+    latency_by_test = {(r.unique_name, r.config_name): r.warm_latency
+                       for r in results}
+    print(f'{"Test":<40} {"Config":<14} {"Compile ms":>11} '
+          f'{"First ms":>10} {"Warm ms":>10} {"Runs/s":>10} {"Mem MiB":>8}'
+          + (f' {"vs " + reference_config:>16}' if reference_config else ''))
+    for r in results:
+        if r.error is not None:
+            print(f'{r.unique_name:<40} {r.config_name:<14} FAILURE - '
+                  + r.error.strip().splitlines()[0])
+            continue
+        line = (f'{r.unique_name:<40} {r.config_name:<14} '
+                f'{_format_time(r.compile_time):>11} '
+                f'{_format_time(r.first_run_latency):>10} '
+                f'{_format_time(r.warm_latency):>10} '
+                f'{r.throughput:>10.1f} {_format_memory(r.memory_growth):>8}')
+        reference = latency_by_test.get((r.unique_name, reference_config))
+        if reference_config and r.config_name != reference_config:
+            ratio = 'n/a' if not reference else (
+                f'{r.warm_latency / reference:.2f}x')
+            line += f' {ratio:>16}'
+        print(line)
+
+    regressions = []
+    if baseline is None:
+        return regressions
+    baseline_by_test = {(r.unique_name, r.config_name): r for r in baseline}
+    for r in results:
+        base = baseline_by_test.get((r.unique_name, r.config_name))
+        if base is None or base.error is not None:
+            continue
+        name = f'"{r.unique_name}" ({r.config_name})'
+        if r.error is not None:
+            regressions.append(f'{name}: now fails')
+            continue
+        for field, threshold in thresholds._asdict().items():
+            value, base_value = getattr(r, field), getattr(base, field)
+            if base_value and value > base_value * (1 + threshold):
+                regressions.append(
+                    f'{name}: {field} regressed by '
+                    f'{(value / base_value - 1) * 100:.1f}% '
+                    f'({_format_time(base_value)} ms -> '
+                    f'{_format_time(value)} ms, threshold '
+                    f'{threshold * 100:.0f}%)')
+    print()
+    if regressions:
+        for regression in regressions:
+            print('REGRESSION - ' + regression)
+    else:
+        print('No regressions relative to the baseline.')
+    return regressions
@@ -5,3 +5,4 @@
 from .ref_backend import RefBackendTestConfig
 from .native_torch import NativeTorchTestConfig
 from .torchscript import TorchScriptTestConfig
+from .iree_backend import IreeBackendTestConfig
@@ -0,0 +1,37 @@
+#  Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+#  See https://llvm.org/LICENSE.txt for license information.
+#  SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+from typing import Any
+
+import torch
+
+from torch_mlir.torchscript.e2e_test.framework import TestConfig, Trace
+from torch_mlir.torchscript.e2e_test.configs.utils import (
+    import_torchscript_module,
+    lower_to_backend_contract,
+    run_trace_with_numpy,
+)
+
+
+class IreeBackendTestConfig(TestConfig):
+    """TestConfig that runs the torch.nn.Module through IREE.
+
+    The module is lowered to the npcomp backend contract and compiled by IREE
+    to a VM flatbuffer, which is the compiled artifact. `driver` selects the
+    IREE HAL driver that runs it; see `iree.CompilerBackend`.
+    """
+    def __init__(self, driver: str = "dylib"):
+        super().__init__()
+        # Import lazily, so that the other configs work without IREE.
+        from npcomp.compiler.pytorch.backend import iree
+        self.backend = iree.CompilerBackend(driver=driver)
+
+    def compile(self, program: torch.nn.Module) -> Any:
+        module, scripted = import_torchscript_module(program)
+        lower_to_backend_contract(module, scripted)
+        return self.backend.compile(module)
+
+    def run(self, artifact: Any, trace: Trace) -> Trace:
+        iree_module = self.backend.load(artifact)
+        return run_trace_with_numpy(iree_module, trace)
@@ -2,96 +2,50 @@
 #  See https://llvm.org/LICENSE.txt for license information.
 #  SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
 
-import sys
-from typing import Any
-from io import StringIO
+from typing import Any, Optional
 import os
-import tempfile
 
-import numpy as np
 import torch
-from mlir.passmanager import PassManager
 
-import torch_mlir
+from npcomp.compiler.generic.backend.refjit import CompiledModuleCache
 from npcomp.compiler.pytorch.backend import refjit
-from torch_mlir.torchscript.e2e_test.framework import TestConfig, Trace, TraceItem
-from torch_mlir.torchscript.annotations import extract_annotations
+from torch_mlir.torchscript.e2e_test.framework import TestConfig, Trace
+from torch_mlir.torchscript.e2e_test.configs.utils import (
+    BACKEND_CONTRACT_PIPELINE,
+    import_torchscript_module,
+    lower_to_backend_contract,
+    run_trace_with_torch,
+)
 
 
 class RefBackendTestConfig(TestConfig):
-    """TestConfig that just runs the torch.nn.Module through RefBackend."""
-    def __init__(self):
+    """TestConfig that just runs the torch.nn.Module through RefBackend.
+
+    Compiled artifacts are cached by the content of the imported module; see
+    `CompiledModuleCache`. `cache_dir` defaults to the NPCOMP_E2E_CACHE_DIR
+    environment variable, if set. Disabling the cache makes every `compile`
+    compile from scratch, such as when measuring compile time.
+    """
+    def __init__(self, cache_dir: Optional[str] = None,
+                 enable_cache: bool = True):
         super().__init__()
-        self.backend = refjit.CompilerBackend()
+        if cache_dir is None:
+            cache_dir = os.environ.get('NPCOMP_E2E_CACHE_DIR')
+        self.cache = CompiledModuleCache(cache_dir, enable_cache)
+        self.backend = refjit.CompilerBackend(
+            object_cache_dir=self.cache.object_cache_dir)
 
     def compile(self, program: torch.nn.Module) -> Any:
-        mb = torch_mlir.ModuleBuilder()
-        scripted = torch.jit.script(program)
-        class_annotator = torch_mlir.ClassAnnotator()
+        module, scripted = import_torchscript_module(program)
 
-        extract_annotations(program, scripted, class_annotator)
+        def lower(module):
+            lower_to_backend_contract(module, scripted)
+            self.backend.lower(module)
 
-        # TODO: Find a way to make each of these calls own its own
-        # "debuggable error report" situation.
-        try:
-            sys.stderr = StringIO()
-            # Import the TorchScript module to MLIR
-            mb.import_module(scripted._c, class_annotator)
-        except Exception as e:
-            raise Exception(f"""
-PyTorch TorchScript module -> NPCOMP Object Graph IR import failed with:
-Exception:
-{e}
-Diagnostics:
-{sys.stderr.getvalue()}
-""") from None
-        finally:
-            sys.stderr = sys.__stderr__
-
-        try:
-            sys.stderr = StringIO()
-            asm_for_error_report = mb.module.operation.get_asm(
-                large_elements_limit=10, enable_debug_info=True)
-            pipeline_str = "torchscript-to-npcomp-backend-pipeline"
-            # Lower module in place to make it ready for compiler backends.
-            with mb.module.context:
-                pm = PassManager.parse(pipeline_str)
-                pm.run(mb.module)
-        except Exception as e:
-            # TODO: More robust.
-            # - don't arbitrarily clutter up /tmp. When a test suite has many
-            #   tests, this can be a big disk cost (also, /tmp/ is frequently a
-            #   RAM fs, which increases worries about capacity).
-            # - don't have colliding filenames (hard to do without cluttering
-            #   up /tmp)
-            # - if we do have have colliding filenames, writes should at least
-            #   avoid being racy.
-            filename = os.path.join(tempfile.gettempdir(),
-                                    scripted.original_name + '.mlir')
-            with open(filename, 'w') as f:
-                f.write(asm_for_error_report)
-            raise Exception(f"""
-NPCOMP TorchScript Object Graph IR -> NPCOMP Backend IR lowering failed with the following diagnostics:
-{sys.stderr.getvalue()}
-
-Error can be reproduced with:
-$ npcomp-opt -{pipeline_str} {filename}
-""") from None
-        finally:
-            sys.stderr = sys.__stderr__
-        return self.backend.compile(mb.module)
+        return self.cache.get_or_compile(module, BACKEND_CONTRACT_PIPELINE,
+                                         lower, self.backend.compile_lowered)
 
     def run(self, artifact: Any, trace: Trace) -> Trace:
-        jit_module = self.backend.load(artifact)
-        result: Trace = []
-        for item in trace:
-            numpy_inputs = [t.numpy() for t in item.inputs]
-            outputs = getattr(jit_module, item.symbol)(*numpy_inputs)
-            if isinstance(outputs, np.ndarray):
-                outputs = [outputs]
-            torch_outputs = [torch.tensor(ndarray) for ndarray in outputs]
-            result.append(
-                TraceItem(symbol=item.symbol,
-                          inputs=item.inputs,
-                          outputs=torch_outputs))
-        return result
+        # Tensors are exchanged with the module through DLPack, without copies.
+        jit_module = self.backend.load(artifact, torch_outputs=True)
+        return run_trace_with_torch(jit_module, trace)
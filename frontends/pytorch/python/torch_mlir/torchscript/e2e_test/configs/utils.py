@@ -0,0 +1,121 @@
+#  Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+#  See https://llvm.org/LICENSE.txt for license information.
+#  SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+"""Helpers shared by the TestConfigs that compile through npcomp."""
+
+import sys
+from typing import Any, Tuple
+from io import StringIO
+import os
+import tempfile
+
+import numpy as np
+import torch
+from mlir.ir import Module
+from mlir.passmanager import PassManager
+
+import torch_mlir
+from torch_mlir.torchscript.e2e_test.framework import Trace, TraceItem
+from torch_mlir.torchscript.annotations import extract_annotations
+
+BACKEND_CONTRACT_PIPELINE = "torchscript-to-npcomp-backend-pipeline"
+
+
+def import_torchscript_module(
+        program: torch.nn.Module) -> Tuple[Module, torch.jit.ScriptModule]:
+    """Scripts `program` and imports it into an MLIR module.
+
+    Returns the imported module and the scripted program.
+    """
+    mb = torch_mlir.ModuleBuilder()
+    scripted = torch.jit.script(program)
+    class_annotator = torch_mlir.ClassAnnotator()
+
+    extract_annotations(program, scripted, class_annotator)
+
+    # TODO: Find a way to make each of these calls own its own
+    # "debuggable error report" situation.
+    try:
+        sys.stderr = StringIO()
+        # Import the TorchScript module to MLIR
+        mb.import_module(scripted._c, class_annotator)
+    except Exception as e:
+        raise Exception(f"""
+PyTorch TorchScript module -> NPCOMP Object Graph IR import failed with:
+Exception:
+{e}
+Diagnostics:
+{sys.stderr.getvalue()}
+""") from None
+    finally:
+        sys.stderr = sys.__stderr__
+    return mb.module, scripted
+
+
+def lower_to_backend_contract(module: Module,
+                              scripted: torch.jit.ScriptModule):
+    """Lowers an imported module in place to the npcomp backend contract.
+
+    The result satisfies `VerifyBackendContract`, and is ready for any of the
+    compiler backends.
+    """
+    pipeline_str = BACKEND_CONTRACT_PIPELINE
+    try:
+        sys.stderr = StringIO()
+        asm_for_error_report = module.operation.get_asm(
+            large_elements_limit=10, enable_debug_info=True)
+        with module.context:
+            pm = PassManager.parse(pipeline_str)
+            pm.run(module)
+    except Exception as e:
+        # TODO: More robust.
+        # - don't arbitrarily clutter up /tmp. When a test suite has many
+        #   tests, this can be a big disk cost (also, /tmp/ is frequently a
+        #   RAM fs, which increases worries about capacity).
+        # - don't have colliding filenames (hard to do without cluttering
+        #   up /tmp)
+        # - if we do have have colliding filenames, writes should at least
+        #   avoid being racy.
+        filename = os.path.join(tempfile.gettempdir(),
+                                scripted.original_name + '.mlir')
+        with open(filename, 'w') as f:
+            f.write(asm_for_error_report)
+        raise Exception(f"""
+NPCOMP TorchScript Object Graph IR -> NPCOMP Backend IR lowering failed with the following diagnostics:
+{sys.stderr.getvalue()}
+
+Error can be reproduced with:
+$ npcomp-opt -{pipeline_str} {filename}
+""") from None
+    finally:
+        sys.stderr = sys.__stderr__
+
+
+def run_trace_with_numpy(module: Any, trace: Trace) -> Trace:
+    """Runs `trace` on a loaded module that takes and returns numpy arrays."""
+    result: Trace = []
+    for item in trace:
+        numpy_inputs = [t.numpy() for t in item.inputs]
+        outputs = getattr(module, item.symbol)(*numpy_inputs)
+        if isinstance(outputs, np.ndarray):
+            outputs = [outputs]
+        torch_outputs = [torch.tensor(ndarray) for ndarray in outputs]
+        result.append(
+            TraceItem(symbol=item.symbol,
+                      inputs=item.inputs,
+                      outputs=torch_outputs))
+    return result
+
+
+def run_trace_with_torch(module: Any, trace: Trace) -> Trace:
+    """Runs `trace` on a loaded module that takes and returns torch.Tensor's."""
+    result: Trace = []
+    for item in trace:
+        outputs = getattr(module, item.symbol)(*item.inputs)
+        if isinstance(outputs, torch.Tensor):
+            outputs = [outputs]
+        result.append(
+            TraceItem(symbol=item.symbol,
+                      inputs=item.inputs,
+                      outputs=list(outputs)))
+    return result
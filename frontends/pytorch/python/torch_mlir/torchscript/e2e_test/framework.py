@@ -20,6 +20,8 @@ compiling or TorchScript'ing).
 """
 
 import abc
+import multiprocessing
+import os
 from typing import Any, Callable, List, NamedTuple, Optional, TypeVar
 
 import torch
@@ -223,26 +225,61 @@ def _generate_golden_trace(test: Test) -> Trace:
     return tracer.get_trace()
 
 
-def run_tests(tests: List[Test], config: TestConfig) -> List[TestResult]:
-    """Invoke the given `Test`'s with the provided `TestConfig`."""
-    results = []
-    for test in tests:
-        golden_trace = _generate_golden_trace(test)
-        # TODO: Precompile everything in parallel.
-        try:
-            compiled = config.compile(test.program_factory())
-        except Exception as e:
-            results.append(
-                TestResult(unique_name=test.unique_name,
-                           compilation_error=str(e),
-                           trace=None,
-                           golden_trace=None))
-            continue
-        # TODO: Run in parallel.
-        trace = config.run(compiled, golden_trace)
-        results.append(
-            TestResult(unique_name=test.unique_name,
-                       compilation_error=None,
-                       trace=trace,
-                       golden_trace=golden_trace))
-    return results
+def _run_test(test: Test, config: TestConfig) -> TestResult:
+    golden_trace = _generate_golden_trace(test)
+    try:
+        compiled = config.compile(test.program_factory())
+    except Exception as e:
+        return TestResult(unique_name=test.unique_name,
+                          compilation_error=str(e),
+                          trace=None,
+                          golden_trace=None)
+    trace = config.run(compiled, golden_trace)
+    return TestResult(unique_name=test.unique_name,
+                      compilation_error=None,
+                      trace=trace,
+                      golden_trace=golden_trace)
+
+
+# The arguments of the `run_tests` call that worker processes are running.
+# Workers inherit them when forked instead of pickling them, as neither the
+# test factories nor the configs are generally picklable.
+_worker_tests_and_config = None
+
+
+def _init_worker():
+    # The workers already use all the CPUs, so intra-op threads would only
+    # oversubscribe them.
+    torch.set_num_threads(1)
+
+
+def _run_test_in_worker(index: int) -> TestResult:
+    tests, config = _worker_tests_and_config
+    return _run_test(tests[index], config)
+
+
+def run_tests(tests: List[Test],
+              config: TestConfig,
+              num_workers: Optional[int] = None) -> List[TestResult]:
+    """Invoke the given `Test`'s with the provided `TestConfig`.
+
+    The tests are independent, so they run in `num_workers` forked processes
+    (by default, one per CPU). Each process runs one test at a time, on a
+    single thread, which keeps the global random seed that tests rely on
+    process-local. The results are in the order of `tests` regardless.
+    """
+    if num_workers is None:
+        num_workers = os.cpu_count() or 1
+    num_workers = min(num_workers, len(tests))
+    if (num_workers <= 1
+            or 'fork' not in multiprocessing.get_all_start_methods()):
+        return [_run_test(test, config) for test in tests]
+    global _worker_tests_and_config
+    _worker_tests_and_config = (tests, config)
+    try:
+        with multiprocessing.get_context('fork').Pool(
+                num_workers, initializer=_init_worker) as pool:
+            return pool.map(_run_test_in_worker, range(len(tests)),
+                            chunksize=1)
+    finally:
+        _worker_tests_and_config = None
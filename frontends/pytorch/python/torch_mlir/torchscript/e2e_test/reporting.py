@@ -8,11 +8,57 @@ Utilities for reporting the results of the test framework.
 from typing import List, Optional
 
 import io
+import itertools
 import textwrap
 
 import torch
 
-from .framework import TestResult, TraceItem
+from .framework import TestResult, Trace, TraceItem
+
+
+def _values_match(value, golden_value) -> bool:
+    # Backends generally pass the inputs of the golden trace through.
+    if value is golden_value:
+        return True
+    if value.size() != golden_value.size() or value.dtype != golden_value.dtype:
+        return False
+    if not value.is_floating_point():
+        return torch.equal(value, golden_value)
+    return torch.allclose(value, golden_value)
+
+
+def _trace_matches(trace: Trace, golden_trace: Trace) -> bool:
+    """Returns whether `trace` matches `golden_trace`, as reported by
+    `TraceItemReport`'s.
+
+    The floating point values are compared by a single `torch.allclose` of all
+    of them, which is equivalent to comparing them one by one as the tolerance
+    is elementwise.
+    """
+    if len(trace) != len(golden_trace):
+        return False
+    values = []
+    golden_values = []
+    for item, golden_item in zip(trace, golden_trace):
+        if (item.symbol != golden_item.symbol
+                or len(item.inputs) != len(golden_item.inputs)
+                or len(item.outputs) != len(golden_item.outputs)):
+            return False
+        for value, golden_value in zip(
+                itertools.chain(item.inputs, item.outputs),
+                itertools.chain(golden_item.inputs, golden_item.outputs)):
+            if value is golden_value:
+                continue
+            if (value.dtype != torch.float32
+                    or golden_value.dtype != torch.float32
+                    or value.size() != golden_value.size()):
+                if not _values_match(value, golden_value):
+                    return False
+                continue
+            values.append(value.reshape(-1))
+            golden_values.append(golden_value.reshape(-1))
+    return not values or torch.allclose(torch.cat(values),
+                                        torch.cat(golden_values))
 
 
 class TensorSummary:
@@ -61,16 +107,17 @@ class ValueReport:
         self.value = value
         self.golden_value = golden_value
         self.context = context
-
-    @property
-    def failed(self):
-        return not torch.allclose(self.value, self.golden_value)
+        self.failed = not _values_match(value, golden_value)
 
     def error_str(self):
         assert self.failed
         if self.value.size() != self.golden_value.size():
             return self.context.format_error(
-                f'tensor shape mismatch: got {tensor.size()!r}, expected {golden_tensor.size()!r}'
+                f'tensor shape mismatch: got {self.value.size()!r}, expected {self.golden_value.size()!r}'
+            )
+        if self.value.dtype != self.golden_value.dtype:
+            return self.context.format_error(
+                f'tensor dtype mismatch: got {self.value.dtype}, expected {self.golden_value.dtype}'
             )
         f = io.StringIO()
         p = lambda *x: print(*x, file=f)
@@ -139,7 +186,9 @@ class SingleTestReport:
         self.result = result
         self.context = context
         self.item_reports = None
-        if result.compilation_error is None:
+        # The item reports are only needed to describe failures.
+        if (result.compilation_error is None
+                and not _trace_matches(result.trace, result.golden_trace)):
             self.item_reports = []
             for i, (item, golden_item) in enumerate(
                     zip(result.trace, result.golden_trace)):
@@ -153,7 +202,8 @@ class SingleTestReport:
     def failed(self):
         if self.result.compilation_error is not None:
             return True
-        return any(r.failed for r in self.item_reports)
+        return self.item_reports is not None and any(
+            r.failed for r in self.item_reports)
 
     def error_str(self):
         assert self.failed
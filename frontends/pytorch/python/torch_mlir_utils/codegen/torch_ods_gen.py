@@ -221,6 +221,8 @@ TORCH_TYPE_TO_ODS_TYPE = {
     "Scalar": "AnyTorchScalarType",
     "int": "AnyTorchIntType",
     "int[]": "AnyTorchIntListType",
+    "Tensor[]": "AnyTorchTensorListType",
+    "int?": "AnyTorchOptionalIntType",
     "bool": "AnyTorchBoolType",
     "bool[]": "AnyTorchBoolListType",
     "float": "AnyFloat",
@@ -272,7 +274,8 @@ ODS_BANNER = "\n".join([
 
 
 def raw_emit_op(operator: JitOperator, f: TextIO, *, traits: List[str],
-                has_folder: bool, has_canonicalizer: bool):
+                has_folder: bool, has_canonicalizer: bool,
+                flops: Optional[str]):
     """Emit the ODS for a JitOperator to a textual file.
 
     This is the lowest level of emission and is responsible for low-level
@@ -337,20 +340,59 @@ def raw_emit_op(operator: JitOperator, f: TextIO, *, traits: List[str],
             p("let hasFolder = 1;")
         if has_canonicalizer:
             p("let hasCanonicalizer = 1;")
+        if flops is not None:
+            p("let extraClassDeclaration = [{")
+            with emitter.indent():
+                p("Optional<int64_t> getFlops() {")
+                with emitter.indent():
+                    p(f"return {flops};")
+                p("}")
+            p("}];")
     p("}")
     p("\n")
 
 
+def flops_per_element(value: str, flops: int) -> str:
+    """Cost of an op doing `flops` FLOPs per element of the tensor `value`."""
+    return f"getFlopsPerElement({value}, {flops})"
+
+
+# Cost of matmul-like ops, from the size of the contracted dimension.
+CONTRACTION_FLOPS = "getContractionFlops(*this)"
+
+# Shape functions shared by many ops, as the traits implementing them (see
+# TorchTraits.h). RefineTypes computes the sizes and dtype of the result of
+# the ops having these traits, instead of special casing each op.
+SHAPE_FUNCTIONS = {
+    # The result has the sizes and dtype of `self`.
+    "unary": ["SameSizesAsSelf", "SameDtypeAsSelf"],
+    # The result has the broadcasted sizes of the first two operands, and
+    # their promoted dtype.
+    "broadcasting": ["BroadcastsSizes", "PromotesDtypes"],
+    # Same as "broadcasting", but producing bools.
+    "comparison": ["BroadcastsSizes", "ProducesBools"],
+}
+
+
 def emit_op(operator: JitOperator,
             f: TextIO,
             *,
             traits: Optional[List[str]] = None,
             has_folder: bool = False,
-            has_canonicalizer: bool = False):
+            has_canonicalizer: bool = False,
+            flops: Optional[str] = None,
+            shape_function: Optional[str] = None):
     """Main entry point for op emission.
 
     Besides emitting the op, it deduces / adds traits based on the operator
     information.
+
+    `flops` is a C++ expression computing the FLOPs of the op from the shapes
+    of its operands (see TorchInterfaces.h), which implements the
+    CostModelOpInterface of the op.
+
+    `shape_function` is the key in SHAPE_FUNCTIONS of the shape transfer
+    function of the op, if it has one of them.
     """
     if traits is None:
         traits = []
@@ -365,12 +407,17 @@ def emit_op(operator: JitOperator,
             "alias_info" not in x
             for x in itertools.chain(operator.arguments, operator.returns)):
         traits += ["HasValueSemantics"]
+    if shape_function is not None:
+        traits += SHAPE_FUNCTIONS[shape_function]
+    if flops is not None:
+        traits += ["Torch_CostModelOpInterface"]
 
     raw_emit_op(operator,
                 f,
                 traits=traits,
                 has_folder=has_folder,
-                has_canonicalizer=has_canonicalizer)
+                has_canonicalizer=has_canonicalizer,
+                flops=flops)
 
 
 def emit_prim_ops(torch_ir_dir: str, registry: Registry):
@@ -382,10 +429,10 @@ def emit_prim_ops(torch_ir_dir: str, registry: Registry):
             emit_op(registry[key], f, **kwargs)
 
         emit("prim::layout : (Tensor) -> (int)")
-        emit("prim::TupleIndex : (Any, int) -> (Any)")
+        emit("prim::TupleIndex : (Any, int) -> (Any)", has_canonicalizer=True)
         emit("prim::device : (Tensor) -> (Device)")
         emit("prim::dtype : (Tensor) -> (int)")
-        emit("prim::TupleUnpack : (Any) -> (...)")
+        emit("prim::TupleUnpack : (Any) -> (...)", has_canonicalizer=True)
         emit("prim::NumToTensor.Scalar : (Scalar) -> (Tensor)")
         emit("prim::min.self_int : (int[]) -> (int)")
         emit("prim::min.int : (int, int) -> (int)")
@@ -412,37 +459,113 @@ def emit_aten_ops(torch_ir_dir: str, registry: Registry):
             operator = registry[key]
             emit_op(operator, f, **kwargs)
             ns, unqual, overload = operator.triple
+            # The in-place variants return `self`.
             emit_op(registry.get_by_triple((ns, unqual + "_", overload)),
                     f,
-                    traits=["IsTrailingUnderscoreInplaceVariant"])
+                    traits=["IsTrailingUnderscoreInplaceVariant"],
+                    shape_function="unary")
 
         # Elementwise tensor compute ops
         for key in [
                 "aten::tanh : (Tensor) -> (Tensor)",
                 "aten::relu : (Tensor) -> (Tensor)",
+        ]:
+            emit_with_mutating_variants(
+                key,
+                flops=flops_per_element("getResult()", 1),
+                shape_function="unary")
+        for key in [
                 "aten::add.Tensor : (Tensor, Tensor, Scalar) -> (Tensor)",
+                "aten::sub.Tensor : (Tensor, Tensor, Scalar) -> (Tensor)",
+                "aten::mul.Tensor : (Tensor, Tensor) -> (Tensor)",
+                "aten::div.Tensor : (Tensor, Tensor) -> (Tensor)",
         ]:
-            emit_with_mutating_variants(key)
+            emit_with_mutating_variants(
+                key,
+                flops=flops_per_element("getResult()", 1),
+                shape_function="broadcasting")
+        # Elementwise ops emitted without in-place variants: maximum and
+        # minimum have none, and those of the comparisons keep the dtype of
+        # `self` instead of producing bools, so they don't reduce to the value
+        # semantic ops.
+        for key in [
+                "aten::maximum : (Tensor, Tensor) -> (Tensor)",
+                "aten::minimum : (Tensor, Tensor) -> (Tensor)",
+        ]:
+            emit(key,
+                 flops=flops_per_element("getResult()", 1),
+                 shape_function="broadcasting")
+        for key in [
+                "aten::gt.Tensor : (Tensor, Tensor) -> (Tensor)",
+                "aten::ge.Tensor : (Tensor, Tensor) -> (Tensor)",
+                "aten::lt.Tensor : (Tensor, Tensor) -> (Tensor)",
+                "aten::le.Tensor : (Tensor, Tensor) -> (Tensor)",
+                "aten::eq.Tensor : (Tensor, Tensor) -> (Tensor)",
+                "aten::ne.Tensor : (Tensor, Tensor) -> (Tensor)",
+        ]:
+            emit(key,
+                 flops=flops_per_element("getResult()", 1),
+                 shape_function="comparison")
 
         # Non-elementwise tensor compute ops
-        emit("aten::linear : (Tensor, Tensor, Tensor?) -> (Tensor)")
-        emit("aten::mm : (Tensor, Tensor) -> (Tensor)")
+        emit("aten::linear : (Tensor, Tensor, Tensor?) -> (Tensor)",
+             flops=CONTRACTION_FLOPS)
+        emit("aten::mm : (Tensor, Tensor) -> (Tensor)", flops=CONTRACTION_FLOPS)
+        emit("aten::bmm : (Tensor, Tensor) -> (Tensor)", flops=CONTRACTION_FLOPS)
+        emit("aten::matmul : (Tensor, Tensor) -> (Tensor)",
+             flops=CONTRACTION_FLOPS)
+        emit(
+            "aten::conv2d : (Tensor, Tensor, Tensor?, int[], int[], int[], int) -> (Tensor)",
+            flops="getConvolutionFlops(*this)")
+        # Normalizing with the running statistics, then scaling and shifting.
         emit(
-            "aten::conv2d : (Tensor, Tensor, Tensor?, int[], int[], int[], int) -> (Tensor)"
-        )
+            "aten::batch_norm : (Tensor, Tensor?, Tensor?, Tensor?, Tensor?, bool, float, float, bool) -> (Tensor)",
+            flops=flops_per_element("getResult()", 4),
+            shape_function="unary")
         emit(
-            "aten::batch_norm : (Tensor, Tensor?, Tensor?, Tensor?, Tensor?, bool, float, float, bool) -> (Tensor)"
-        )
+            "aten::max_pool2d : (Tensor, int[], int[], int[], int[], bool) -> (Tensor)",
+            flops="getWindowFlops(*this, kernel_size())")
+        emit("aten::adaptive_avg_pool2d : (Tensor, int[]) -> (Tensor)",
+             flops=flops_per_element("self()", 1))
+        # Computing the statistics as well.
         emit(
-            "aten::max_pool2d : (Tensor, int[], int[], int[], int[], bool) -> (Tensor)"
-        )
-        emit("aten::adaptive_avg_pool2d : (Tensor, int[]) -> (Tensor)")
+            "aten::layer_norm : (Tensor, int[], Tensor?, Tensor?, float, bool) -> (Tensor)",
+            flops=flops_per_element("getResult()", 7),
+            shape_function="unary")
+        emit(
+            "aten::group_norm : (Tensor, int, Tensor?, Tensor?, float, bool) -> (Tensor)",
+            flops=flops_per_element("getResult()", 7),
+            shape_function="unary")
+        # The maximum, the exponentials and their sum, and the normalization.
+        emit("aten::softmax.int : (Tensor, int, int?) -> (Tensor)",
+             flops=flops_per_element("getResult()", 5))
+        emit("aten::log_softmax.int : (Tensor, int, int?) -> (Tensor)",
+             flops=flops_per_element("getResult()", 5))
+        # Gathers, which only move data.
+        emit("aten::embedding : (Tensor, Tensor, int, bool, bool) -> (Tensor)",
+             flops=flops_per_element("getResult()", 0))
+        emit("aten::index_select : (Tensor, int, Tensor) -> (Tensor)",
+             flops=flops_per_element("getResult()", 0))
 
         # Misc tensor ops.
         emit("aten::flatten.using_ints : (Tensor, int, int) -> (Tensor)")
+        emit("aten::transpose.int : (Tensor, int, int) -> (Tensor)")
+        emit("aten::permute : (Tensor, int[]) -> (Tensor)")
+        emit("aten::slice.Tensor : (Tensor, int, int?, int?, int) -> (Tensor)")
+        emit("aten::select.int : (Tensor, int, int) -> (Tensor)")
+        emit("aten::cat : (Tensor[], int) -> (Tensor)",
+             flops=flops_per_element("getResult()", 0))
+        emit("aten::split.Tensor : (Tensor, int, int) -> (Tensor[])")
+        emit("aten::chunk : (Tensor, int, int) -> (Tensor[])")
         emit("aten::dim : (Tensor) -> (int)", has_folder=True)
         emit("aten::size : (Tensor) -> (int[])", has_canonicalizer=True)
 
+        # Quantization ops.
+        emit("aten::quantize_per_tensor : (Tensor, float, int, int) -> (Tensor)",
+             flops=flops_per_element("getResult()", 2))
+        emit("aten::dequantize.self : (Tensor) -> (Tensor)",
+             flops=flops_per_element("getResult()", 2))
+
         # Primitive ops
         emit("aten::gt.int : (int, int) -> (bool)")
         emit("aten::ne.int : (int, int) -> (bool)")
@@ -469,7 +592,8 @@ def emit_quantized_ops(torch_ir_dir: str, registry: Registry):
 
         emit(
             "quantized::linear : (Tensor, __torch__.torch.classes.quantized.LinearPackedParamsBase, float, int) -> (Tensor)",
-            traits=["HasValueSemantics"])
+            traits=["HasValueSemantics"],
+            flops=CONTRACTION_FLOPS)
 
 
 def dump_registered_ops(outfile: TextIO, registry: Registry):
@@ -0,0 +1,27 @@
+# -*- Python -*-
+# This file is licensed under a pytorch-style license
+# See frontends/pytorch/LICENSE for license information.
+
+import torch
+import torch_mlir
+
+# RUN: %PYTHON %s | npcomp-opt | FileCheck %s
+
+t0 = torch.randn((1,2,3,4))
+t1 = torch.randn((1,2,3,4))
+t2 = torch.randn((1,2,3,4))
+
+# Capture-only mode records the same function without computing the values of
+# the tensors.
+mb = torch_mlir.ModuleBuilder()
+with mb.capture_function("add3", [t0, t1, t2], capture_only=True) as f:
+  t3 = t0 + t1 + t2
+  f.returns([t3])
+# CHECK-LABEL:   func @add3(
+# CHECK-SAME:               %[[VAL_0:.*]]: !torch.tensor<[1,2,3,4],f32>, %[[VAL_1:.*]]: !torch.tensor<[1,2,3,4],f32>,
+# CHECK-SAME:               %[[VAL_2:.*]]: !torch.tensor<[1,2,3,4],f32>) -> !torch.tensor<[1,2,3,4],f32> {
+# CHECK:           %[[VAL_6:.*]] = torch.operator "aten.add.out"(%[[VAL_0]], %[[VAL_1]], {{.*}}) : {{.*}} -> !torch.tensor<[1,2,3,4],f32>
+# CHECK:           %[[VAL_8:.*]] = torch.operator "aten.add.out"(%[[VAL_6]], %[[VAL_2]], {{.*}}) : {{.*}} -> !torch.tensor<[1,2,3,4],f32>
+# CHECK:           return %[[VAL_8]] : !torch.tensor<[1,2,3,4],f32>
+
+print(mb.module)
@@ -0,0 +1,50 @@
+# -*- Python -*-
+# This file is licensed under a pytorch-style license
+# See frontends/pytorch/LICENSE for license information.
+
+import torch
+import torch_mlir
+
+# RUN: %PYTHON %s | npcomp-opt | FileCheck %s
+
+x = torch.randn(3, 4)
+# Captured by the functions, once: its detached view reads the same memory.
+w = torch.randn(3, 4)
+
+mb = torch_mlir.ModuleBuilder()
+
+# CHECK-LABEL:   func @constants(
+# CHECK-SAME:                    %[[X:.*]]: !torch.tensor<[3,4],f32>) -> !torch.tensor<[3,4],f32> {
+# CHECK:           %[[W:.*]] = torch.tensor(dense<
+# CHECK-NOT:       torch.tensor(
+# CHECK:           %[[T0:.*]] = torch.operator "aten.add.out"(%[[X]], %[[W]], {{.*}})
+# CHECK:           %[[T1:.*]] = torch.operator "aten.add.out"(%[[T0]], %[[W]], {{.*}})
+# CHECK:           return %[[T1]]
+with mb.capture_function("constants", [x]) as f:
+  f.returns([x + w + w.detach()])
+
+# CHECK-LABEL:   func @arguments(
+# CHECK-SAME:                    %[[X:.*]]: !torch.tensor<[3,4],f32>, %[[W:.*]]: !torch.tensor<[3,4],f32>) -> !torch.tensor<[3,4],f32> {
+# CHECK-NOT:       torch.tensor(
+# CHECK:           %[[T0:.*]] = torch.operator "aten.add.out"(%[[X]], %[[W]], {{.*}})
+# CHECK:           %[[T1:.*]] = torch.operator "aten.add.out"(%[[T0]], %[[W]], {{.*}})
+# CHECK:           return %[[T1]]
+with mb.capture_function("arguments", [x],
+                         captured_tensors="arguments") as f:
+  f.returns([x + w + w.detach()])
+# The callers pass the captured tensors after the explicit arguments.
+assert len(f.captured_tensors) == 1 and f.captured_tensors[0] is w
+
+# CHECK:         torch.global_slot "private" @globals_captured0 : !torch.tensor<[3,4],f32> {
+# CHECK:           %[[W:.*]] = torch.tensor(dense<
+# CHECK:           torch.global_slot.init %[[W]]
+# CHECK-LABEL:   func @globals(
+# CHECK-SAME:                  %[[X:.*]]: !torch.tensor<[3,4],f32>) -> !torch.tensor<[3,4],f32> {
+# CHECK:           %[[W:.*]] = torch.global_slot.get @globals_captured0
+# CHECK:           %[[T0:.*]] = torch.operator "aten.add.out"(%[[X]], %[[W]], {{.*}})
+# CHECK:           %[[T1:.*]] = torch.operator "aten.add.out"(%[[T0]], %[[W]], {{.*}})
+# CHECK:           return %[[T1]]
+with mb.capture_function("globals", [x], captured_tensors="globals") as f:
+  f.returns([x + w + w.detach()])
+
+print(mb.module)
@@ -0,0 +1,54 @@
+# -*- Python -*-
+# This file is licensed under a pytorch-style license
+# See frontends/pytorch/LICENSE for license information.
+
+import sys
+
+import torch
+import torch_mlir
+
+# RUN: %PYTHON %s 2>/dev/null | npcomp-opt | FileCheck %s
+# RUN: %PYTHON %s 2>&1 >/dev/null | FileCheck %s --check-prefix=TRACE
+# RUN: %PYTHON %s capture_only 2>/dev/null | npcomp-opt | FileCheck %s
+# RUN: %PYTHON %s capture_only 2>&1 >/dev/null \
+# RUN:   | FileCheck %s --check-prefix=TRACE-CAPTURE-ONLY
+
+# mm, addmm, add and relu are captured by unboxed kernels, which record the
+# same ops as the boxed fallback. In capture-only mode, they defer to the
+# fallback, which runs only the meta kernels.
+torch_mlir.debug_trace_to_stderr()
+capture_only = sys.argv[1:] == ["capture_only"]
+
+bias = torch.randn(3)
+x = torch.randn(2, 4)
+w = torch.randn(4, 3)
+
+mb = torch_mlir.ModuleBuilder()
+with mb.capture_function("unboxed", [bias, x, w],
+                         capture_only=capture_only) as f:
+  t0 = torch.mm(x, w)
+  t1 = torch.addmm(bias, x, w, beta=2, alpha=3)
+  t2 = torch.add(t0, t1, alpha=2)
+  t3 = torch.relu(t2)
+  f.returns([t3])
+
+# CHECK-LABEL:   func @unboxed(
+# CHECK-SAME:               %[[BIAS:.*]]: !torch.tensor<[3],f32>, %[[X:.*]]: !torch.tensor<[2,4],f32>,
+# CHECK-SAME:               %[[W:.*]]: !torch.tensor<[4,3],f32>) -> !torch.tensor<[2,3],f32> {
+# CHECK:           %[[MM:.*]] = torch.operator "aten.mm"(%[[X]], %[[W]]) : (!torch.tensor<[2,4],f32>, !torch.tensor<[4,3],f32>) -> !torch.tensor<[2,3],f32>
+# CHECK:           %[[ADDMM:.*]] = torch.operator "aten.addmm"(%[[BIAS]], %[[X]], %[[W]], %{{.*}}, %{{.*}}) : (!torch.tensor<[3],f32>, !torch.tensor<[2,4],f32>, !torch.tensor<[4,3],f32>, i64, i64) -> !torch.tensor<[2,3],f32>
+# CHECK:           %[[ADD:.*]] = torch.operator "aten.add.Tensor"(%[[MM]], %[[ADDMM]], %{{.*}}) : (!torch.tensor<[2,3],f32>, !torch.tensor<[2,3],f32>, i64) -> !torch.tensor<[2,3],f32>
+# CHECK:           %[[RELU:.*]] = torch.operator "aten.relu"(%[[ADD]]) : (!torch.tensor<[2,3],f32>) -> !torch.tensor<[2,3],f32>
+# CHECK:           return %[[RELU]] : !torch.tensor<[2,3],f32>
+
+# TRACE: TORCH_MLIR TRACE: Unboxed dispatch: aten::mm(
+# TRACE: TORCH_MLIR TRACE: Unboxed dispatch: aten::addmm(
+# TRACE: TORCH_MLIR TRACE: Unboxed dispatch: aten::add.Tensor(
+# TRACE: TORCH_MLIR TRACE: Unboxed dispatch: aten::relu(
+
+# TRACE-CAPTURE-ONLY: TORCH_MLIR TRACE: Fallback (boxed) dispatch: aten::mm(
+# TRACE-CAPTURE-ONLY: TORCH_MLIR TRACE: Fallback (boxed) dispatch: aten::addmm(
+# TRACE-CAPTURE-ONLY: TORCH_MLIR TRACE: Fallback (boxed) dispatch: aten::add.Tensor(
+# TRACE-CAPTURE-ONLY: TORCH_MLIR TRACE: Fallback (boxed) dispatch: aten::relu(
+
+print(mb.module)
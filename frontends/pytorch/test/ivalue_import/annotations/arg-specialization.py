@@ -0,0 +1,52 @@
+# -*- Python -*-
+# This file is licensed under a pytorch-style license
+# See frontends/pytorch/LICENSE for license information.
+
+import typing
+
+import torch
+import torch_mlir
+
+# RUN: %PYTHON %s | npcomp-opt | FileCheck %s
+
+mb = torch_mlir.ModuleBuilder()
+
+class TestModule(torch.nn.Module):
+    def __init__(self):
+        super().__init__()
+    def forward(self, tensor):
+        return
+
+test_module = TestModule()
+recursivescriptmodule = torch.jit.script(test_module)
+
+annotator = torch_mlir.ClassAnnotator()
+class_type = recursivescriptmodule._c._type()
+annotator.annotateArgs(class_type, ['forward'], [
+    None,
+    ((-1, 1024), torch.float32, True),
+])
+annotator.specializeArgs(class_type, ['forward'], [
+    None,
+    ((1, 1024), torch.float32, True),
+])
+annotator.specializeArgs(class_type, ['forward'], [
+    None,
+    ((8, 1024), torch.float32, True),
+])
+
+# CHECK-LABEL: func private @__torch__.TestModule.forward(
+# CHECK-SAME:    %arg1: !torch.tensor {torch.type_bound = !torch.vtensor<[?,1024],f32>}
+# CHECK-LABEL: func private @__torch__.TestModule.forward$0(
+# CHECK-SAME:    %arg1: !torch.tensor {torch.type_bound = !torch.vtensor<[1,1024],f32>}
+# CHECK-LABEL: func private @__torch__.TestModule.forward$1(
+# CHECK-SAME:    %arg1: !torch.tensor {torch.type_bound = !torch.vtensor<[8,1024],f32>}
+# CHECK-LABEL: torch.class_type @__torch__.TestModule {{.*}}{
+# CHECK:         torch.method "forward", @__torch__.TestModule.forward
+# CHECK:         torch.method "forward$0", @__torch__.TestModule.forward$0
+# CHECK:         torch.method "forward$1", @__torch__.TestModule.forward$1
+# CHECK:       }
+
+# # TODO: Automatically handle unpacking Python class RecursiveScriptModule into the underlying ScriptModule.
+mb.import_module(recursivescriptmodule._c, annotator)
+mb.module.operation.print()
@@ -0,0 +1,52 @@
+# -*- Python -*-
+# This file is licensed under a pytorch-style license
+# See frontends/pytorch/LICENSE for license information.
+
+import typing
+
+import torch
+import torch_mlir
+
+# RUN: %PYTHON %s | npcomp-opt | FileCheck %s
+
+mb = torch_mlir.ModuleBuilder()
+
+# Only the functions reachable from the exported methods are imported.
+
+def helper(x):
+    return x
+
+class TestModule(torch.nn.Module):
+    def __init__(self):
+        super().__init__()
+    def forward(self, x):
+        return self.reachable(x)
+    def reachable(self, x):
+        return x
+    @torch.jit.export
+    def unreachable(self, x):
+        return helper(x)
+
+test_module = TestModule()
+recursivescriptmodule = torch.jit.script(test_module)
+
+annotator = torch_mlir.ClassAnnotator()
+class_type = recursivescriptmodule._c._type()
+annotator.exportNone(class_type)
+annotator.exportPath(class_type, ['forward'])
+
+# CHECK-NOT:       unreachable
+# CHECK-NOT:       helper
+# CHECK-LABEL:     func private @__torch__.TestModule.forward
+# CHECK-LABEL:     func private @__torch__.TestModule.reachable
+# CHECK-LABEL:   torch.class_type @__torch__.TestModule {
+# CHECK:           torch.method "forward", @__torch__.TestModule.forward
+# CHECK:           torch.method private "reachable", @__torch__.TestModule.reachable
+# CHECK-NOT:       torch.method
+# CHECK:         }
+# CHECK-NOT:       unreachable
+# CHECK-NOT:       helper
+
+# # TODO: Automatically handle unpacking Python class RecursiveScriptModule into the underlying ScriptModule.
+mb.import_module(recursivescriptmodule._c, annotator)
+mb.module.operation.print()
@@ -0,0 +1,32 @@
+# -*- Python -*-
+# This file is licensed under a pytorch-style license
+# See frontends/pytorch/LICENSE for license information.
+
+import typing
+
+import torch
+import torch_mlir
+
+# RUN: %PYTHON %s | npcomp-opt | FileCheck %s
+
+mb = torch_mlir.ModuleBuilder()
+
+class TestModule(torch.nn.Module):
+    def __init__(self):
+        super().__init__()
+        # Tensors of different identity that are the same view of the same
+        # storage (such as tied weights) are imported as one value.
+        # CHECK: %[[T:.*]] = torch.tensor
+        # CHECK-NOT: torch.tensor
+        # CHECK: torch.nn_module {
+        # CHECK:   torch.slot "t1", %[[T]]
+        # CHECK:   torch.slot "t2", %[[T]]
+        self.t1 = torch.nn.Parameter(torch.tensor([10., 20.]))
+        self.t2 = self.t1.detach()
+
+
+test_module = TestModule()
+recursivescriptmodule = torch.jit.script(test_module)
+# TODO: Automatically handle unpacking Python class RecursiveScriptModule into the underlying ScriptModule.
+mb.import_module(recursivescriptmodule._c)
+mb.module.operation.print()
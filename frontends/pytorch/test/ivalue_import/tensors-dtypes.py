@@ -0,0 +1,32 @@
+# -*- Python -*-
+# This file is licensed under a pytorch-style license
+# See frontends/pytorch/LICENSE for license information.
+
+import torch
+import torch_mlir
+
+# RUN: %PYTHON %s | npcomp-opt | FileCheck %s
+
+mb = torch_mlir.ModuleBuilder()
+
+class TestModule(torch.nn.Module):
+    def __init__(self):
+        super().__init__()
+        self.mask = torch.tensor([True, False, True])
+        self.half = torch.tensor([1.0, 2.0], dtype=torch.half)
+        self.bfloat16 = torch.tensor([1.0, 2.0], dtype=torch.bfloat16)
+        self.zeros = torch.zeros(2, 3, dtype=torch.half)
+        self.all_true = torch.ones(4, dtype=torch.bool)
+
+# The elements of all types are imported from the storage of the tensors, and
+# tensors with equal elements as splats.
+# CHECK-DAG: torch.tensor(dense<[true, false, true]> : tensor<3xi1>) : !torch.tensor<[3],i1>
+# CHECK-DAG: torch.tensor(dense<[1.000000e+00, 2.000000e+00]> : tensor<2xf16>) : !torch.tensor<[2],f16>
+# CHECK-DAG: torch.tensor(dense<[1.000000e+00, 2.000000e+00]> : tensor<2xbf16>) : !torch.tensor<[2],bf16>
+# CHECK-DAG: torch.tensor(dense<0.000000e+00> : tensor<2x3xf16>) : !torch.tensor<[2,3],f16>
+# CHECK-DAG: torch.tensor(dense<true> : tensor<4xi1>) : !torch.tensor<[4],i1>
+
+test_module = TestModule()
+recursivescriptmodule = torch.jit.script(test_module)
+mb.import_module(recursivescriptmodule._c)
+mb.module.operation.print()
@@ -0,0 +1,35 @@
+# -*- Python -*-
+# This file is licensed under a pytorch-style license
+# See frontends/pytorch/LICENSE for license information.
+
+import sys
+
+import torch
+import torch_mlir
+
+# RUN: %PYTHON %s %t.bin | npcomp-opt | FileCheck %s
+# RUN: %PYTHON -c "import numpy as np; print(np.fromfile('%t.bin', dtype=np.float32)[:16].tolist())" | FileCheck %s --check-prefix=FILE
+
+mb = torch_mlir.ModuleBuilder()
+
+class TestModule(torch.nn.Module):
+    def __init__(self):
+        super().__init__()
+        self.ones = torch.ones(1)
+        self.bias = torch.nn.Parameter(torch.zeros(32))
+        self.weight = torch.nn.Parameter(torch.arange(16.0).reshape(4, 4))
+
+# Tensors of at least `external_weights_min_bytes` are stored in the file.
+# CHECK-DAG: %[[WEIGHT:.*]] = torch.tensor(opaque<"refback", "0x{{[0-9A-F]+}}"> : tensor<4x4xf32>) : !torch.tensor<[4,4],f32>
+# Splats are kept inline however large they are.
+# CHECK-DAG: %[[BIAS:.*]] = torch.tensor(dense<0.000000e+00> : tensor<32xf32>) : !torch.tensor<[32],f32>
+# CHECK-DAG: %[[ONES:.*]] = torch.tensor(dense<1.000000e+00> : tensor<1xf32>) : !torch.tensor<[1],f32>
+
+# FILE: [0.0, 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 8.0, 9.0, 10.0, 11.0, 12.0, 13.0, 14.0, 15.0]
+
+test_module = TestModule()
+recursivescriptmodule = torch.jit.script(test_module)
+mb.import_module(recursivescriptmodule._c,
+                 external_weights_path=sys.argv[1],
+                 external_weights_min_bytes=64)
+mb.module.operation.print()
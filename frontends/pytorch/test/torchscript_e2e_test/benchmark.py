@@ -0,0 +1,47 @@
+# -*- Python -*-
+# This file is licensed under a pytorch-style license
+# See frontends/pytorch/LICENSE for license information.
+
+# RUN: %PYTHON %s | FileCheck %s
+
+import torch
+
+from torch_mlir.torchscript.e2e_test.benchmark import (
+    BenchmarkThresholds, report_benchmarks, run_benchmarks)
+from torch_mlir.torchscript.e2e_test.framework import TestUtils
+from torch_mlir.torchscript.e2e_test.registry import register_test_case, GLOBAL_TEST_REGISTRY
+from torch_mlir.torchscript.e2e_test.configs import NativeTorchTestConfig, TorchScriptTestConfig
+
+
+class MmModule(torch.nn.Module):
+    def __init__(self):
+        super().__init__()
+
+    def forward(self, lhs, rhs):
+        return torch.mm(lhs, rhs)
+
+
+@register_test_case(module_factory=lambda: MmModule())
+def MmModule_basic(module, tu: TestUtils):
+    module.forward(tu.rand(4, 4), tu.rand(4, 4))
+
+
+# CHECK: Test {{.*}} Config {{.*}} Warm ms {{.*}} vs native_torch
+# CHECK: MmModule_basic {{.*}} native_torch
+# CHECK: MmModule_basic {{.*}} torchscript {{.*}}x
+# A baseline that is infinitely fast makes every result a regression.
+# CHECK: REGRESSION - "MmModule_basic" (native_torch): warm_latency regressed
+# CHECK: REGRESSION - "MmModule_basic" (torchscript): warm_latency regressed
+def main():
+    configs = {
+        'native_torch': NativeTorchTestConfig(),
+        'torchscript': TorchScriptTestConfig(),
+    }
+    results = run_benchmarks(GLOBAL_TEST_REGISTRY, configs, iterations=3)
+    baseline = [r._replace(warm_latency=1e-12) for r in results]
+    report_benchmarks(results, 'native_torch', baseline,
+                      BenchmarkThresholds(compile_time=float('inf')))
+
+
+if __name__ == '__main__':
+    main()
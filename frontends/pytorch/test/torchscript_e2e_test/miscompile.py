@@ -37,6 +37,14 @@ def MmModule_basic(module, tu: TestUtils):
     module.forward(tu.rand(4, 4), tu.rand(4, 4))
 
 
+# CHECK: FAILURE - "MmModule_shapeMismatch"
+# CHECK:     @ output #0
+# CHECK:     ERROR: tensor shape mismatch: got torch.Size([3, 3]), expected torch.Size([4, 4])
+@register_test_case(module_factory=lambda: MmModule())
+def MmModule_shapeMismatch(module, tu: TestUtils):
+    module.forward(tu.rand(4, 3), tu.rand(3, 4))
+
+
 def main():
     config = TorchScriptTestConfig()
     results = run_tests(GLOBAL_TEST_REGISTRY, config)
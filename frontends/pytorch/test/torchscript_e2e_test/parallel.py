@@ -0,0 +1,58 @@
+# -*- Python -*-
+# This file is licensed under a pytorch-style license
+# See frontends/pytorch/LICENSE for license information.
+
+# RUN: %PYTHON %s | FileCheck %s
+
+import torch
+
+from torch_mlir.torchscript.e2e_test.framework import run_tests, TestUtils
+from torch_mlir.torchscript.e2e_test.reporting import report_results
+from torch_mlir.torchscript.e2e_test.registry import register_test_case, GLOBAL_TEST_REGISTRY
+from torch_mlir.torchscript.e2e_test.configs import TorchScriptTestConfig
+
+
+class MmModule(torch.nn.Module):
+    def __init__(self):
+        super().__init__()
+
+    def forward(self, lhs, rhs):
+        return torch.mm(lhs, rhs)
+
+
+class TanhModule(torch.nn.Module):
+    def __init__(self):
+        super().__init__()
+
+    def forward(self, x):
+        return torch.tanh(x)
+
+
+# Results are reported in registration order, whichever worker ran the test.
+# CHECK: SUCCESS - "MmModule_basic"
+@register_test_case(module_factory=lambda: MmModule())
+def MmModule_basic(module, tu: TestUtils):
+    module.forward(tu.rand(64, 64), tu.rand(64, 64))
+
+
+# CHECK: SUCCESS - "TanhModule_basic"
+@register_test_case(module_factory=lambda: TanhModule())
+def TanhModule_basic(module, tu: TestUtils):
+    module.forward(tu.rand(3, 4))
+
+
+# CHECK: SUCCESS - "MmModule_chained"
+@register_test_case(module_factory=lambda: MmModule())
+def MmModule_chained(module, tu: TestUtils):
+    res = module.forward(tu.rand(4, 4), tu.rand(4, 4))
+    module.forward(res, res)
+
+
+def main():
+    config = TorchScriptTestConfig()
+    results = run_tests(GLOBAL_TEST_REGISTRY, config, num_workers=2)
+    report_results(results)
+
+
+if __name__ == '__main__':
+    main()
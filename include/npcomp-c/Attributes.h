@@ -0,0 +1,50 @@
+/*===-- npcomp-c/Attributes.h - NPComp custom attributes ----------*- C -*-===*\
+|*                                                                            *|
+|* Part of the LLVM Project, under the Apache License v2.0 with LLVM          *|
+|* Exceptions.                                                                *|
+|* See https://llvm.org/LICENSE.txt for license information.                  *|
+|* SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception                    *|
+|*                                                                            *|
+\*===----------------------------------------------------------------------===*/
+
+#ifndef NPCOMP_C_ATTRIBUTES_H
+#define NPCOMP_C_ATTRIBUTES_H
+
+#include "mlir-c/IR.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*============================================================================*/
+/* External elements attribute.                                               */
+/*============================================================================*/
+
+/** Gets an elements attribute of the given shaped type whose elements are
+ * stored in the file `path` from byte `offset` on, in row-major order, instead
+ * of in the attribute. See mlir::NPCOMP::refback::getExternalElementsAttr. */
+MlirAttribute npcompExternalElementsAttrGet(MlirType shapedType,
+                                            MlirStringRef path,
+                                            uint64_t offset);
+
+/** Checks whether the given attribute is an external elements attribute. */
+int npcompAttributeIsAExternalElements(MlirAttribute attr);
+
+/*============================================================================*/
+/* Dense elements attribute.                                                  */
+/*============================================================================*/
+
+/** Gets a dense elements attribute of the given shaped type from the
+ * `rawBufferSize` bytes of its elements at `rawBuffer`, in row-major order
+ * and in the in-memory layout of the element type (one byte per element for
+ * i1). The bytes are copied as is, without converting each element, or only
+ * one element is copied if they are all equal (making a splat attribute). */
+MlirAttribute npcompDenseElementsAttrGetFromBuffer(MlirType shapedType,
+                                                   size_t rawBufferSize,
+                                                   const void *rawBuffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NPCOMP_C_ATTRIBUTES_H
@@ -0,0 +1,262 @@
+/*===-- npcomp-c/Runtime.h - C API for running compiled modules ---*- C -*-===*\
+|*                                                                            *|
+|* Part of the LLVM Project, under the Apache License v2.0 with LLVM          *|
+|* Exceptions.                                                                *|
+|* See https://llvm.org/LICENSE.txt for license information.                  *|
+|* SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception                    *|
+|*                                                                            *|
+\*===----------------------------------------------------------------------===*/
+
+/* Loads modules compiled by the RefBackend, and invokes their functions with
+ * the refbackrt runtime.
+ *
+ * Functions that can fail return a null handle or a failed MlirLogicalResult,
+ * after which npcompRtGetLastErrorMessage describes the error.
+ *
+ * Unless noted otherwise, all of the functions below can be called
+ * concurrently from any number of threads, including on the same module,
+ * function and input tensors.
+ */
+
+#ifndef NPCOMP_C_RUNTIME_H
+#define NPCOMP_C_RUNTIME_H
+
+#include "mlir-c/IR.h"
+#include "mlir-c/Pass.h"
+#include "mlir-c/Support.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DEFINE_C_API_STRUCT(name, storage)                                     \
+  struct name {                                                                \
+    storage *ptr;                                                              \
+  };                                                                           \
+  typedef struct name name
+
+/* A loaded module. */
+DEFINE_C_API_STRUCT(NpcompRtModule, void);
+/* A function of a module, valid as long as the module. */
+DEFINE_C_API_STRUCT(NpcompRtFunction, void);
+/* A reference to a tensor. */
+DEFINE_C_API_STRUCT(NpcompRtTensor, void);
+/* The pending result of npcompRtFunctionInvokeAsync. */
+DEFINE_C_API_STRUCT(NpcompRtInvocation, void);
+
+#undef DEFINE_C_API_STRUCT
+
+/** Returns the description of the last error of the calling thread, valid
+ * until its next failing call. */
+const char *npcompRtGetLastErrorMessage(void);
+
+/*============================================================================*/
+/* Modules.                                                                   */
+/*============================================================================*/
+
+/** Adds the RefBackend compilation pipeline to `pm`. Its result can be passed
+ * to npcompRtModuleCreateFromCompiledModule. */
+void npcompRtBuildBackendCompilationPipeline(MlirPassManager pm,
+                                             bool optimize);
+
+/** Compiles `module`, the result of the pipeline of
+ * npcompRtBuildBackendCompilationPipeline, with a JIT. The symbols of the
+ * `numSharedLibs` shared libraries `sharedLibs` (which must include the
+ * compiler runtime) are made available to the compiled code. Returns a null
+ * module on failure. */
+NpcompRtModule npcompRtModuleCreateFromCompiledModule(
+    MlirModule module, intptr_t numSharedLibs, const MlirStringRef *sharedLibs);
+
+/** Loads the shared object at `path`, as produced by `npcomp-compile`. Returns
+ * a null module on failure. */
+NpcompRtModule npcompRtModuleCreateFromSharedObject(MlirStringRef path);
+
+/** Destroys `module`, after waiting for its pending asynchronous invocations.
+ */
+void npcompRtModuleDestroy(NpcompRtModule module);
+
+static inline bool npcompRtModuleIsNull(NpcompRtModule module) {
+  return !module.ptr;
+}
+
+/*============================================================================*/
+/* Functions.                                                                 */
+/*============================================================================*/
+
+/* The types of the arguments and results of functions. */
+typedef enum NpcompRtArgType {
+  NpcompRtArgTypeNone = 0,
+  NpcompRtArgTypeTensor,
+  NpcompRtArgTypeF32,
+  NpcompRtArgTypeF64,
+  NpcompRtArgTypeI32,
+  NpcompRtArgTypeI64,
+  NpcompRtArgTypeI1,
+} NpcompRtArgType;
+
+/* The element types of tensors. */
+typedef enum NpcompRtElementType {
+  NpcompRtElementTypeNone = 0,
+  NpcompRtElementTypeF32,
+  NpcompRtElementTypeF16,
+  NpcompRtElementTypeBF16,
+  NpcompRtElementTypeI8,
+  NpcompRtElementTypeI32,
+  NpcompRtElementTypeI64,
+  /* Booleans, stored as one byte per element. */
+  NpcompRtElementTypeI1,
+} NpcompRtElementType;
+
+/* The type of an argument or result of a function. The extents of tensors are
+ * returned separately (see npcompRtFunctionGetInputExtents), since their rank
+ * is not bounded. */
+typedef struct NpcompRtArgInfo {
+  NpcompRtArgType argType;
+  /* The element type of tensors. */
+  NpcompRtElementType elementType;
+  /* The rank of tensors, or -1 if unranked. */
+  int32_t rank;
+} NpcompRtArgInfo;
+
+/** Looks up function `name` of `module`. Returns a null function if there is
+ * none. */
+NpcompRtFunction npcompRtModuleLookupFunction(NpcompRtModule module,
+                                              MlirStringRef name);
+
+static inline bool npcompRtFunctionIsNull(NpcompRtFunction function) {
+  return !function.ptr;
+}
+
+/** Returns the name of `function`, valid as long as its module. */
+MlirStringRef npcompRtFunctionGetName(NpcompRtFunction function);
+
+/** Returns the number of inputs of `function`. */
+intptr_t npcompRtFunctionGetNumInputs(NpcompRtFunction function);
+
+/** Returns the number of outputs of `function`. */
+intptr_t npcompRtFunctionGetNumOutputs(NpcompRtFunction function);
+
+/** Returns the type of input `pos` of `function`. */
+NpcompRtArgInfo npcompRtFunctionGetInputInfo(NpcompRtFunction function,
+                                             intptr_t pos);
+
+/** Returns the type of output `pos` of `function`. */
+NpcompRtArgInfo npcompRtFunctionGetOutputInfo(NpcompRtFunction function,
+                                              intptr_t pos);
+
+/** Writes the extents of input `pos` of `function`, a tensor of rank `rank`
+ * (as returned by npcompRtFunctionGetInputInfo), to `extents`, with -1 for
+ * dynamic extents. */
+void npcompRtFunctionGetInputExtents(NpcompRtFunction function, intptr_t pos,
+                                     int64_t *extents);
+
+/** Same as npcompRtFunctionGetInputExtents, for output `pos`. */
+void npcompRtFunctionGetOutputExtents(NpcompRtFunction function, intptr_t pos,
+                                      int64_t *extents);
+
+/*============================================================================*/
+/* Tensors.                                                                   */
+/*============================================================================*/
+
+/** Creates a tensor viewing `data`, without copying it or taking ownership of
+ * it. `strides` are in elements, or null for a contiguous row-major tensor.
+ * The caller must keep `data` alive, and unmodified while it is the input of a
+ * pending invocation, for as long as the tensor exists. */
+NpcompRtTensor npcompRtTensorCreateBorrowing(NpcompRtElementType elementType,
+                                             intptr_t rank,
+                                             const int64_t *extents,
+                                             const int64_t *strides,
+                                             void *data);
+
+/** Creates a contiguous row-major tensor holding a copy of `data`. */
+NpcompRtTensor npcompRtTensorCreateCopy(NpcompRtElementType elementType,
+                                        intptr_t rank, const int64_t *extents,
+                                        const void *data);
+
+/** Releases the reference of `tensor`. Its memory is freed once the runtime
+ * doesn't use it either. */
+void npcompRtTensorDestroy(NpcompRtTensor tensor);
+
+static inline bool npcompRtTensorIsNull(NpcompRtTensor tensor) {
+  return !tensor.ptr;
+}
+
+NpcompRtElementType npcompRtTensorGetElementType(NpcompRtTensor tensor);
+intptr_t npcompRtTensorGetRank(NpcompRtTensor tensor);
+int64_t npcompRtTensorGetExtent(NpcompRtTensor tensor, intptr_t dim);
+/** Returns the stride of dimension `dim`, in elements. */
+int64_t npcompRtTensorGetStride(NpcompRtTensor tensor, intptr_t dim);
+/** Returns the first element of `tensor`. */
+void *npcompRtTensorGetData(NpcompRtTensor tensor);
+/** Returns whether `tensor` views a constant of a module, which must not be
+ * written to. */
+bool npcompRtTensorIsReadOnly(NpcompRtTensor tensor);
+
+/*============================================================================*/
+/* Invocation.                                                                */
+/*============================================================================*/
+
+/* The priorities of invocations (see refbackrt::Priority). */
+typedef enum NpcompRtPriority {
+  NpcompRtPriorityHigh = 0,
+  NpcompRtPriorityNormal,
+  NpcompRtPriorityLow,
+} NpcompRtPriority;
+
+/* How an invocation is scheduled (see refbackrt::RequestSchedule). */
+typedef struct NpcompRtSchedule {
+  NpcompRtPriority priority;
+  /* The time, in nanoseconds of the monotonic clock of
+   * std::chrono::steady_clock, by which the invocation must start, or 0 for
+   * no deadline. */
+  int64_t deadlineNanos;
+} NpcompRtSchedule;
+
+/** Invokes `function` of `module` with the tensors `inputs`, and stores new
+ * references to its results in `outputs`, which the caller destroys.
+ * `numInputs` and `numOutputs` must match the function. `schedule` may be
+ * null for the default schedule. Only functions whose arguments and results
+ * are all tensors can be invoked through this API. */
+MlirLogicalResult npcompRtFunctionInvoke(NpcompRtModule module,
+                                         NpcompRtFunction function,
+                                         intptr_t numInputs,
+                                         const NpcompRtTensor *inputs,
+                                         intptr_t numOutputs,
+                                         NpcompRtTensor *outputs,
+                                         const NpcompRtSchedule *schedule);
+
+/** Same as npcompRtFunctionInvoke, but runs the invocation on a thread pool
+ * of `module` and returns immediately. The inputs are retained until the
+ * invocation completes, so the caller may destroy them. Failures of the
+ * invocation are reported by npcompRtInvocationWait. */
+NpcompRtInvocation npcompRtFunctionInvokeAsync(NpcompRtModule module,
+                                               NpcompRtFunction function,
+                                               intptr_t numInputs,
+                                               const NpcompRtTensor *inputs,
+                                               const NpcompRtSchedule *schedule);
+
+static inline bool npcompRtInvocationIsNull(NpcompRtInvocation invocation) {
+  return !invocation.ptr;
+}
+
+/** Returns whether `invocation` completed. Doesn't block. */
+bool npcompRtInvocationIsDone(NpcompRtInvocation invocation);
+
+/** Waits for `invocation` to complete, and stores its results in `outputs` as
+ * npcompRtFunctionInvoke does. Can be called once per invocation, from one
+ * thread. */
+MlirLogicalResult npcompRtInvocationWait(NpcompRtInvocation invocation,
+                                         intptr_t numOutputs,
+                                         NpcompRtTensor *outputs);
+
+/** Destroys `invocation`, which needn't have completed. */
+void npcompRtInvocationDestroy(NpcompRtInvocation invocation);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NPCOMP_C_RUNTIME_H
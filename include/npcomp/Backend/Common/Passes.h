@@ -20,6 +20,16 @@ void registerCommonBackendPasses();
 
 std::unique_ptr<OperationPass<ModuleOp>> createVerifyBackendContractPass();
 
+std::unique_ptr<OperationPass<ModuleOp>> createExternalizeElementsPass();
+
+std::unique_ptr<OperationPass<ModuleOp>> createInternalizeElementsPass();
+
+// The attribute holding the index of the stage functions created by
+// createSplitPipelineStagesPass.
+constexpr StringLiteral kPipelineStageAttrName = "npcomp.pipeline_stage";
+
+std::unique_ptr<OperationPass<ModuleOp>> createSplitPipelineStagesPass();
+
 } // namespace CommonBackend
 } // namespace NPCOMP
 } // namespace mlir
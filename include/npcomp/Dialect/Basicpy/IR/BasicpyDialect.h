@@ -105,6 +105,12 @@ public:
   Typing::CPA::TypeNode *mapToCPAType(Typing::CPA::Context &context);
 };
 
+/// Returns the type of the result of Python arithmetic on operands of the
+/// numeric (integer or float) types `lhs` and `rhs`: integers promote to
+/// floats, and narrower types to wider ones. A true division (`/`) of
+/// integers is an f64. Returns null if either type isn't numeric.
+Type getPromotedNumericType(Type lhs, Type rhs, bool isTrueDivision = false);
+
 } // namespace Basicpy
 } // namespace NPCOMP
 } // namespace mlir
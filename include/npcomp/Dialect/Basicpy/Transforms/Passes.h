@@ -19,6 +19,8 @@ namespace Basicpy {
 
 std::unique_ptr<OperationPass<FuncOp>> createFunctionTypeInferencePass();
 
+std::unique_ptr<OperationPass<ModuleOp>> createModuleTypeInferencePass();
+
 } // namespace Basicpy
 
 /// Registers all Basicpy transformation passes.
@@ -9,6 +9,7 @@
 #ifndef NPCOMP_DIALECT_NUMPY_TRANSFORMS_PASSES_H
 #define NPCOMP_DIALECT_NUMPY_TRANSFORMS_PASSES_H
 
+#include "mlir/IR/BuiltinOps.h"
 #include "mlir/Pass/Pass.h"
 
 #include <memory>
@@ -18,6 +19,7 @@ namespace NPCOMP {
 namespace Numpy {
 
 std::unique_ptr<OperationPass<ModuleOp>> createPublicFunctionsToTensorPass();
+std::unique_ptr<OperationPass<FuncOp>> createElideArrayCopiesPass();
 
 } // namespace Numpy
 
@@ -9,8 +9,50 @@
 #ifndef NPCOMP_DIALECT_REFBACK_IR_REFBACKDIALECT_H
 #define NPCOMP_DIALECT_REFBACK_IR_REFBACKDIALECT_H
 
+#include "mlir/IR/BuiltinAttributes.h"
 #include "mlir/IR/Dialect.h"
 
 #include "npcomp/Dialect/Refback/IR/RefbackOpsDialect.h.inc"
 
+namespace mlir {
+namespace NPCOMP {
+namespace refback {
+
+// External elements attributes.
+//
+// An external elements attribute is an `opaque<"refback", ...>` elements
+// attribute which, instead of holding its elements, references a file storing
+// them. This keeps large constants (such as the weights of a model) out of the
+// IR, so that importing them neither copies them into the IR nor bloats its
+// textual form.
+//
+// The elements are stored in row-major order, in the in-memory layout of the
+// element type (one byte per i1), starting at `offset` bytes into the file.
+// The compiler never reads them: the RefBackend maps the file into the
+// compiled code when it is loaded.
+
+// Returns the external elements attribute of type `type` referencing the
+// elements stored at `offset` in the file `path`.
+ElementsAttr getExternalElementsAttr(ShapedType type, StringRef path,
+                                     uint64_t offset);
+
+struct ExternalElements {
+  StringRef path;
+  uint64_t offset;
+};
+
+// Returns the storage referenced by `attr` if it is an external elements
+// attribute.
+Optional<ExternalElements> getExternalElements(Attribute attr);
+
+// Prefixes the relative paths of the external elements attributes of `root`
+// and of the ops nested in it with `directory`. This resolves them against
+// the directory of the file that `root` was parsed from, so that a module and
+// the files storing its elements can be moved together.
+void resolveExternalElementsPaths(Operation *root, StringRef directory);
+
+} // namespace refback
+} // namespace NPCOMP
+} // namespace mlir
+
 #endif // NPCOMP_DIALECT_REFBACK_IR_REFBACKDIALECT_H
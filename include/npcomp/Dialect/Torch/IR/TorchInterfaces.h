@@ -0,0 +1,57 @@
+//===------------------------------------------------------------*- C++ -*-===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// The cost model of Torch ops, and the helpers that the cost formulas of the
+// generated ops (see torch_ods_gen.py) are written with.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef NPCOMP_DIALECT_TORCH_IR_TORCHINTERFACES_H
+#define NPCOMP_DIALECT_TORCH_IR_TORCHINTERFACES_H
+
+#include "mlir/IR/OpDefinition.h"
+
+namespace mlir {
+namespace NPCOMP {
+namespace Torch {
+
+/// Returns the number of elements of a tensor of type `type`, if its sizes
+/// are known.
+Optional<int64_t> getNumElements(Type type);
+
+/// Returns the number of bytes of a tensor of type `type`, if its sizes and
+/// dtype are known.
+Optional<int64_t> getNumBytes(Type type);
+
+/// Returns the number of bytes of the tensor operands and results of `op`.
+Optional<int64_t> getTensorBytesMoved(Operation *op);
+
+/// Returns the FLOPs of doing `flopsPerElement` FLOPs per element of the
+/// tensor `tensor`.
+Optional<int64_t> getFlopsPerElement(Value tensor, int64_t flopsPerElement);
+
+/// Returns the FLOPs of a matmul-like op, which multiplies and accumulates
+/// along the last dimension of its first operand for each element of its
+/// result.
+Optional<int64_t> getContractionFlops(Operation *op);
+
+/// Returns the FLOPs of a convolution, whose second operand is the weight.
+Optional<int64_t> getConvolutionFlops(Operation *op);
+
+/// Returns the FLOPs of a sliding window op, doing one FLOP per element of its
+/// window (the constant list of sizes `kernelSize`) for each element of its
+/// result.
+Optional<int64_t> getWindowFlops(Operation *op, Value kernelSize);
+
+} // namespace Torch
+} // namespace NPCOMP
+} // namespace mlir
+
+#include "npcomp/Dialect/Torch/IR/TorchInterfaces.h.inc"
+
+#endif // NPCOMP_DIALECT_TORCH_IR_TORCHINTERFACES_H
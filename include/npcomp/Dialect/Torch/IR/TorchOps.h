@@ -17,6 +17,7 @@
 #include "mlir/Interfaces/ControlFlowInterfaces.h"
 #include "mlir/Interfaces/InferTypeOpInterface.h"
 #include "mlir/Interfaces/SideEffectInterfaces.h"
+#include "npcomp/Dialect/Torch/IR/TorchInterfaces.h"
 #include "npcomp/Dialect/Torch/IR/TorchTraits.h"
 #include "npcomp/Dialect/Torch/IR/TorchTypes.h"
 #include "npcomp/Interfaces/Traits.h"
@@ -39,6 +39,37 @@ class IsTrailingUnderscoreInplaceVariant
     : public ::mlir::OpTrait::TraitBase<ConcreteType,
                                         IsTrailingUnderscoreInplaceVariant> {};
 
+// The following traits describe how the sizes and the dtype of the result of
+// a Torch op are computed from those of its operands, as shape transfer
+// functions shared by many ops. They are attached by torch_ods_gen.py and
+// interpreted by the RefineTypes pass.
+
+// The result has the sizes of the first operand (`self`).
+template <typename ConcreteType>
+class SameSizesAsSelf
+    : public ::mlir::OpTrait::TraitBase<ConcreteType, SameSizesAsSelf> {};
+
+// The result has the sizes of the first two operands broadcasted together,
+// with the numpy broadcasting rules.
+template <typename ConcreteType>
+class BroadcastsSizes
+    : public ::mlir::OpTrait::TraitBase<ConcreteType, BroadcastsSizes> {};
+
+// The result has the dtype of the first operand (`self`).
+template <typename ConcreteType>
+class SameDtypeAsSelf
+    : public ::mlir::OpTrait::TraitBase<ConcreteType, SameDtypeAsSelf> {};
+
+// The result has the dtype of the first two operands promoted together.
+template <typename ConcreteType>
+class PromotesDtypes
+    : public ::mlir::OpTrait::TraitBase<ConcreteType, PromotesDtypes> {};
+
+// The result is a tensor of bools.
+template <typename ConcreteType>
+class ProducesBools
+    : public ::mlir::OpTrait::TraitBase<ConcreteType, ProducesBools> {};
+
 } // namespace OpTrait
 } // namespace Torch
 } // namespace NPCOMP
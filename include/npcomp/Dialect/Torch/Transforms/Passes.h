@@ -22,12 +22,25 @@ std::unique_ptr<OperationPass<ModuleOp>> createGlobalizeObjectGraphPass();
 std::unique_ptr<OperationPass<ModuleOp>>
 createPrepareForGlobalizeObjectGraphPass();
 
+std::unique_ptr<OperationPass<ModuleOp>> createPruneToEntryPointsPass();
+std::unique_ptr<OperationPass<ModuleOp>>
+createPruneToEntryPointsPass(ArrayRef<std::string> entryPoints);
+
 struct TorchLoweringPipelineOptions
     : public PassPipelineOptions<TorchLoweringPipelineOptions> {
   // If this option is true, then perform optimizations.
   // If this option is false, only do the bare minimum for correctness.
   Option<bool> optimize{*this, "optimize", llvm::cl::desc("Do optimizations."),
                         llvm::cl::init(true)};
+
+  // The public functions that are called when serving the module. If this
+  // list is not empty, everything else (the other methods and the exported
+  // attributes) is deleted after globalization, along with the global slots
+  // that only it uses (see createPruneToEntryPointsPass).
+  ListOption<std::string> entryPoints{
+      *this, "entry-points",
+      llvm::cl::desc("Public functions to keep (all of them if empty)"),
+      llvm::cl::MiscFlags::CommaSeparated};
 };
 
 /// Creates a pipeline that lowers the object graph IR that is produced by
@@ -49,10 +62,18 @@ std::unique_ptr<OperationPass<FuncOp>> createRefineTypesPass();
 
 std::unique_ptr<OperationPass<ModuleOp>> createInlineGlobalSlotsPass();
 
+std::unique_ptr<OperationPass<ModuleOp>> createPropagateGlobalConstantsPass();
+
+std::unique_ptr<OperationPass<ModuleOp>> createLowerGlobalSlotsPass();
+
 std::unique_ptr<OperationPass<FuncOp>> createReduceOpVariantsPass();
 
 std::unique_ptr<OperationPass<FuncOp>> createMaximizeValueSemanticsPass();
 
+std::unique_ptr<OperationPass<FuncOp>> createFoldBatchNormPass();
+
+std::unique_ptr<OperationPass<FuncOp>> createReportOpCostsPass();
+
 std::unique_ptr<OperationPass<ModuleOp>> createRefinePublicReturnPass();
 
 std::unique_ptr<OperationPass<ModuleOp>> createFuncBuiltinTensorizePass();
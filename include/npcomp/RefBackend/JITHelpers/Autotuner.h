@@ -0,0 +1,53 @@
+//===------------------------------------------------------------*- C++ -*-===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef NPCOMP_JITRUNTIME_AUTOTUNER_H
+#define NPCOMP_JITRUNTIME_AUTOTUNER_H
+
+#include "mlir/IR/BuiltinOps.h"
+#include "npcomp/RefBackend/JITHelpers/JITModule.h"
+#include "npcomp/RefBackend/Tuning.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace refback {
+
+/// Options controlling how autotuneModule() measures each candidate.
+struct AutotuneOptions {
+  /// The number of timed calls of each candidate, whose median latency is
+  /// compared.
+  unsigned iterations = 10;
+  /// The number of untimed calls of each candidate before the timed ones.
+  unsigned warmup = 2;
+  /// How LLVM compiles the candidates, which should match how the tuned
+  /// modules are compiled.
+  JITCompileOptions compileOptions;
+  llvm::SmallVector<llvm::StringRef, 2> sharedLibs;
+};
+
+/// Tunes the lowering of the matmuls and convolutions of `module` (a module
+/// as passed to JITModule::buildBackendCompilationPipeline) whose signature
+/// has static shapes and isn't in `database` yet, and adds the fastest
+/// configuration of each to `database`.
+///
+/// Each op is compiled on its own, with each of the candidates of
+/// mlir::NPCOMP::getTuningCandidates, and timed on this machine. `module` is
+/// left unchanged: compiling it with the pipeline option `tuning-database`
+/// (or the NPCOMP_TUNING_DATABASE environment variable) set to the saved
+/// database applies the tuned configurations.
+///
+/// Returns the number of signatures added to `database`. The progress of the
+/// tuning is printed to `log`, if not null.
+llvm::Expected<unsigned> autotuneModule(mlir::ModuleOp module,
+                                        mlir::NPCOMP::TuningDatabase &database,
+                                        const AutotuneOptions &options = {},
+                                        llvm::raw_ostream *log = nullptr);
+
+} // namespace refback
+
+#endif // NPCOMP_JITRUNTIME_AUTOTUNER_H
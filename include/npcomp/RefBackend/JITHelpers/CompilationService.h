@@ -0,0 +1,215 @@
+//===------------------------------------------------------------*- C++ -*-===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef NPCOMP_JITRUNTIME_COMPILATIONSERVICE_H
+#define NPCOMP_JITRUNTIME_COMPILATIONSERVICE_H
+
+#include "npcomp/RefBackend/JITHelpers/JITModule.h"
+#include "mlir/IR/Dialect.h"
+#include "llvm/ADT/StringMap.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace refback {
+
+/// Options of a CompilationService.
+struct CompilationServiceOptions {
+  /// The number of compilations that run concurrently, each on its own
+  /// thread. 0 means one per hardware thread.
+  unsigned numThreads = 0;
+  /// The number of compilations after which a thread replaces its
+  /// MLIRContext with a fresh one. The attributes and types of the compiled
+  /// modules (including their constants) stay in the context until then.
+  /// 0 means never.
+  unsigned maxCompilationsPerContext = 256;
+  /// The shared libraries whose symbols are made available to the compiled
+  /// code, as in JITModule::fromCompiledModule.
+  std::vector<std::string> sharedLibs;
+  /// If not empty, the directory caching the object code of the compiled
+  /// modules, as in JITModule::fromCompiledModule.
+  std::string objectCacheDir;
+  /// If set, the object store shared with other processes that compilations
+  /// use unless their options set another one (see
+  /// JITCompileOptions::sharedObjectStore).
+  std::shared_ptr<ObjectStore> sharedObjectStore;
+};
+
+/// The compile tiers of a CompilationService, which trade the speed of the
+/// compiled code for compile time.
+enum class CompileTier {
+  /// Runs only the passes of the backend pipeline needed for correctness,
+  /// and generates code with LLVM at O0 with FastISel. For development
+  /// iteration, and for code that runs a few times.
+  Fast,
+  /// Runs all the optimizations of the backend pipeline and of LLVM (at O2).
+  Optimized,
+};
+
+/// Options of one compilation of a CompilationService.
+struct CompilationOptions {
+  /// See mlir::NPCOMP::RefBackendLoweringPipelineOptions.
+  bool optimize = false;
+  bool profileOps = false;
+  std::vector<int64_t> specializedBatchSizes;
+  std::string tuningDatabase;
+  /// If not empty, only these public functions of the module (along with the
+  /// functions they call, and their specializations) are compiled.
+  std::vector<std::string> functions;
+  /// How LLVM compiles the code of the module.
+  JITCompileOptions jitOptions;
+
+  /// Sets the options selecting the passes and the LLVM code generation to
+  /// those of `tier`, keeping the others (such as the target CPU).
+  void setTier(CompileTier tier);
+};
+
+class CompilationService;
+
+/// A module that is compiled on the fast tier first, and whose functions are
+/// each recompiled on the optimized tier in the background once they have
+/// been invoked enough times (see CompilationService::compileTiered). The
+/// calls of a function made after its optimized code is ready run that code
+/// instead of the fast code.
+///
+/// Each optimized function is compiled into a module of its own, with its
+/// own copy of the globals of the module. So modules updating mutable
+/// globals (such as the parameters of a training step) must not be tiered.
+///
+/// The outputs of a call stay valid as long as the TieredJITModule, which
+/// keeps the code of both tiers. A TieredJITModule must not outlive the
+/// service that compiled it. Its methods can be called concurrently from
+/// multiple threads.
+class TieredJITModule {
+public:
+  /// Waits for the optimized compilations in progress.
+  ~TieredJITModule();
+
+  /// Invokes a function, as in JITModule::invoke.
+  llvm::Expected<llvm::SmallVector<refbackrt::RtValue, 6>>
+  invoke(llvm::StringRef functionName,
+         llvm::ArrayRef<refbackrt::RtValue> inputs);
+
+  /// Returns whether the calls of `functionName` run optimized code.
+  bool isOptimized(llvm::StringRef functionName) const;
+
+  /// Waits until the calls of `functionName` run optimized code, starting
+  /// its compilation if the function hasn't been invoked enough times yet.
+  /// Fails if the optimized compilation failed, in which case the calls keep
+  /// running the fast code.
+  llvm::Error waitForOptimized(llvm::StringRef functionName);
+
+private:
+  friend class CompilationService;
+  struct Function;
+
+  TieredJITModule(CompilationService &service, std::string source,
+                  CompilationOptions optimizedOptions,
+                  unsigned promoteAfterCalls,
+                  std::unique_ptr<JITModule> fastModule);
+
+  // Starts the optimized compilation of `function`. Requires its mutex.
+  void startOptimizedCompilation(llvm::StringRef name, Function &function);
+
+  CompilationService &service;
+  const std::string source;
+  const CompilationOptions optimizedOptions;
+  const unsigned promoteAfterCalls;
+  std::unique_ptr<JITModule> fastModule;
+  // The public functions of the module (but not their specializations,
+  // which the calls of the functions dispatch to), created upfront so that
+  // calls look them up without locking.
+  llvm::StringMap<std::unique_ptr<Function>> functions;
+};
+
+/// A long-lived service compiling modules to JITModules, for clients
+/// compiling many (typically small) modules.
+///
+/// Compiling a module on its own spends much of its time setting up: creating
+/// an MLIRContext and loading its dialects, building the pass manager of the
+/// backend pipeline, and detecting and configuring the LLVM target. The
+/// service does this once per thread instead: each of its threads keeps an
+/// MLIRContext with the dialects of `registry` loaded, along with a pass
+/// manager for each set of CompilationOptions it has compiled with, and the
+/// configured LLVM targets are shared by the whole process.
+///
+/// The modules to compile are given as text (or files), since they are parsed
+/// into the MLIRContext of the thread that compiles them. The JITModules
+/// returned don't depend on the service, and can outlive it.
+///
+/// The methods of a CompilationService can be called concurrently from
+/// multiple threads.
+class CompilationService {
+public:
+  using Result = llvm::Expected<std::unique_ptr<JITModule>>;
+
+  CompilationService(const mlir::DialectRegistry &registry,
+                     CompilationServiceOptions options = {});
+  CompilationService(const CompilationService &) = delete;
+  CompilationService &operator=(const CompilationService &) = delete;
+  /// Waits for the pending compilations.
+  ~CompilationService();
+
+  /// Compiles the module whose source is `source`, which is in the form
+  /// expected by JITModule::buildBackendCompilationPipeline.
+  Result compile(llvm::StringRef source,
+                 const CompilationOptions &options = {});
+  /// Same as compile(), but compiles the module in the file at `path`, as
+  /// parsed by JITModule::parseModuleFile.
+  Result compileFile(llvm::StringRef path,
+                     const CompilationOptions &options = {});
+
+  /// Same as compile(), but returns immediately. Compilations start in order
+  /// of submission, on the first thread that is free.
+  std::future<Result> compileAsync(std::string source,
+                                   CompilationOptions options = {});
+  /// Same as compileFile(), but returns immediately.
+  std::future<Result> compileFileAsync(std::string path,
+                                       CompilationOptions options = {});
+
+  /// Compiles the module whose source is `source` on the fast tier, and
+  /// returns a TieredJITModule recompiling each of its functions on the
+  /// optimized tier on this service after `promoteAfterCalls` invocations of
+  /// the function. The tiers override the pass and LLVM code generation
+  /// options of `options`, whose other options apply to both. In
+  /// particular, the optimized tier applies the autotuned configurations of
+  /// `options.tuningDatabase`.
+  llvm::Expected<std::unique_ptr<TieredJITModule>>
+  compileTiered(llvm::StringRef source, const CompilationOptions &options = {},
+                unsigned promoteAfterCalls = 100);
+
+  /// Returns the number of compilations that run concurrently.
+  unsigned getNumThreads() const { return workers.size(); }
+
+private:
+  class Worker;
+  using Task = std::function<void(Worker &)>;
+
+  std::future<Result> submit(std::string sourceOrPath, bool isFile,
+                             CompilationOptions options);
+  void workerMain();
+
+  mlir::DialectRegistry registry;
+  const CompilationServiceOptions options;
+  std::mutex mutex;
+  std::condition_variable wakeUp;
+  std::deque<Task> pending;
+  bool shuttingDown = false;
+  std::vector<std::thread> workers;
+};
+
+} // namespace refback
+
+#endif // NPCOMP_JITRUNTIME_COMPILATIONSERVICE_H
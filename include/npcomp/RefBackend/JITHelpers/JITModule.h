@@ -9,45 +9,383 @@
 #ifndef NPCOMP_JITRUNTIME_JITMODULE_H
 #define NPCOMP_JITRUNTIME_JITMODULE_H
 
-#include "mlir/ExecutionEngine/ExecutionEngine.h"
 #include "mlir/IR/BuiltinOps.h"
+#include "npcomp/RefBackend/RefBackend.h"
 #include "npcomp/RefBackend/Runtime/UserAPI.h"
+#include "npcomp/RefBackend/TargetInfo.h"
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
 #include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
 
+#include <future>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 namespace mlir {
 class PassManager;
 } // namespace mlir
 
+namespace refbackrt {
+namespace interp {
+class Module;
+} // namespace interp
+} // namespace refbackrt
+
 namespace refback {
+class ExternalWeights;
+class RequestScheduler;
+
+/// A store of the object code of compiled modules, keyed by a hash of
+/// everything the object code depends on: the module as lowered by the
+/// backend pipeline (and so the options of the pipeline), the version of
+/// LLVM, the target triple, the CPU and its features, and the options of
+/// code generation.
+///
+/// Stores shared by the processes of a fleet (a directory on network storage,
+/// or an HTTP cache) let a replica load the object code compiled by another
+/// one instead of compiling the module itself. Stores must be safe to use
+/// from several threads at once.
+class ObjectStore {
+public:
+  virtual ~ObjectStore();
+
+  /// Returns the object code stored under `key`, or null if there is none,
+  /// including when the store can't be reached.
+  virtual std::unique_ptr<llvm::MemoryBuffer> fetch(llvm::StringRef key) = 0;
+
+  /// Stores `object` under `key`. Failures are ignored: they only cost
+  /// compiling the module again.
+  virtual void store(llvm::StringRef key, llvm::StringRef object) = 0;
+
+  /// Returns a store keeping the object code in files of `directory`, which
+  /// is created on the first store. The files are written atomically, so
+  /// that concurrent processes (possibly on other machines) never load a
+  /// partially written one.
+  static std::shared_ptr<ObjectStore>
+  createDirectoryStore(llvm::StringRef directory);
+};
+
+/// Options controlling how LLVM compiles the code of a JITModule.
+struct JITCompileOptions {
+  /// The optimization level (0 to 3) of both the LLVM IR optimization
+  /// pipeline and codegen.
+  unsigned optLevel = 2;
+  /// Whether codegen selects instructions with FastISel, which is much faster
+  /// than the default instruction selector but generates slower code. Meant
+  /// for unoptimized code (optLevel 0), such as that of the fast compile tier
+  /// of a CompilationService.
+  bool fastISel = false;
+  /// The CPU to generate code for. Empty or "native" means the host CPU, along
+  /// with all of its features.
+  std::string cpu;
+  /// Comma-separated target features to enable (`+feature`) or disable
+  /// (`-feature`) on top of those of the CPU, e.g. "+avx2,-fma".
+  std::string features;
+  /// Whether to compile each function on its first call, instead of
+  /// compiling the whole module upfront. This saves compile time and code size
+  /// for modules with many rarely called functions, but the functions are
+  /// optimized separately from each other. Not supported with an object cache.
+  bool lazy = false;
+  /// The number of threads that LLVM compiles a large module on, after
+  /// splitting it into as many parts. 0 means one per hardware thread. Small
+  /// modules, and modules compiled lazily, are compiled on a single thread.
+  unsigned compileThreads = 0;
+  /// Whether to translate, optimize and generate code for one function at a
+  /// time (see mlir::NPCOMP::streamFunctionModules), freeing the IR of each
+  /// function once its object code is generated, so that the peak memory of
+  /// compilation scales with the largest function rather than with the whole
+  /// module. The functions are optimized separately from each other, on a
+  /// single thread, and the bodies of the functions of the module passed to
+  /// JITModule::fromCompiledModule are erased. Not supported with lazy
+  /// compilation or an object cache.
+  bool streaming = false;
+  /// Whether to copy the files of the external globals (typically weights)
+  /// into buffers from refbackrt::allocateHugePages instead of mapping them,
+  /// so that they are backed by the huge pages selected by
+  /// refbackrt::setHugePages. Mapped files are backed by regular pages.
+  bool hugePageWeights = false;
+  /// If set, an object store shared with other processes, looked up after
+  /// the object cache directory of JITModule::fromCompiledModule (if any),
+  /// which is filled with the object code found in the shared store. The
+  /// object code compiled on a miss is put in both. Not supported with lazy
+  /// or streaming compilation.
+  std::shared_ptr<ObjectStore> sharedObjectStore;
+};
+
+/// A call to one function of a JITModule, prepared for a fixed input
+/// signature (the types and shapes of the inputs).
+///
+/// All of the bookkeeping done by JITModule::invoke (looking up the function,
+/// fetching its metadata, validating the inputs against it, and creating the
+/// outputs) is done once when the call is prepared. Each invoke() then only
+/// checks that the inputs still have the prepared signature before calling
+/// into the compiled code.
+///
+/// A PreparedCall is valid as long as the JITModule it came from.
+class PreparedCall {
+public:
+  llvm::Expected<llvm::SmallVector<refbackrt::RtValue, 6>>
+  invoke(llvm::ArrayRef<refbackrt::RtValue> inputs) const;
+
+  /// Invokes the function once for each element of `batchInputs`, returning
+  /// the outputs of each call. The ABI setup cost is amortized across the
+  /// batch, so this is cheaper than separate invoke() calls.
+  llvm::Expected<std::vector<llvm::SmallVector<refbackrt::RtValue, 6>>>
+  invokeBatch(
+      llvm::ArrayRef<llvm::ArrayRef<refbackrt::RtValue>> batchInputs) const;
+
+  /// Returns outputs to pass to invokeInto(): a Tensor of the result's shape
+  /// for each tensor result with a static shape that isn't a constant of the
+  /// module, and None (which invokeInto() replaces) for the other results.
+  llvm::SmallVector<refbackrt::RtValue, 6> createOutputs() const;
+
+  /// Same as invoke(), but writes the results into `outputs`, as created by
+  /// createOutputs(), so that calls repeated with the same outputs don't
+  /// allocate them (see JITModule::invokeInto).
+  llvm::Error
+  invokeInto(llvm::ArrayRef<refbackrt::RtValue> inputs,
+             llvm::MutableArrayRef<refbackrt::RtValue> outputs) const;
+
+  /// Captures the call with `inputs` and `outputs` (as created by
+  /// createOutputs()), for request loops that refill the same input buffers
+  /// between calls. Each replay of the returned call only calls into the
+  /// compiled code, without any of the checks of invoke() (see
+  /// refbackrt::CapturedCall).
+  llvm::Expected<refbackrt::CapturedCall>
+  capture(llvm::ArrayRef<refbackrt::RtValue> inputs,
+          llvm::ArrayRef<refbackrt::RtValue> outputs) const;
+
+  llvm::StringRef getFunctionName() const;
+
+private:
+  friend class JITModule;
+  PreparedCall() = default;
+
+  /// Checks that `inputs` match the prepared input signature.
+  llvm::Error checkInputs(llvm::ArrayRef<refbackrt::RtValue> inputs) const;
+
+  refbackrt::FunctionHandle function;
+  // The types and concrete shapes of the inputs the call was prepared with.
+  llvm::SmallVector<refbackrt::InputArgInfo, 6> inputSignature;
+  // The number of outputs, which refbackrt::invoke creates.
+  std::int32_t numOutputs = 0;
+  // The types and shapes of the outputs, as recorded by the compiler.
+  llvm::SmallVector<refbackrt::OutputArgInfo, 6> outputArgInfos;
+};
+
+/// The outputs of a call made by JITModule::invokeAsync, or its error.
+///
+/// Unlike an llvm::Expected, it may be destroyed without having been checked,
+/// which is what happens to the results of the calls whose futures are
+/// abandoned: their errors are dropped.
+class AsyncCallResult
+    : public llvm::Expected<llvm::SmallVector<refbackrt::RtValue, 6>> {
+public:
+  using Base = llvm::Expected<llvm::SmallVector<refbackrt::RtValue, 6>>;
+
+  AsyncCallResult(Base &&result) : Base(std::move(result)) {}
+  AsyncCallResult(AsyncCallResult &&other) = default;
+  ~AsyncCallResult() {
+    if (!*this)
+      llvm::consumeError(takeError());
+  }
+};
+
 // Wrapper around refbackrt data structures and a JITted module, facilitating
 // interaction.
+//
+// Once constructed, a JITModule (and any PreparedCall created from it) can be
+// invoked concurrently from multiple threads without locking.
 class JITModule {
 public:
-  /// Populates a PassManager with a pipeline that performs backend compilation.
-  /// The resulting module can be passed to fromCompiledModule().
-  static void buildBackendCompilationPipeline(mlir::PassManager &pm,
-                                              bool optimize = false);
+  ~JITModule();
+
+  /// Populates a PassManager with a pipeline that performs backend compilation
+  /// with `options`. The resulting module can be passed to
+  /// fromCompiledModule().
+  ///
+  /// Among the options, `profileOps` makes the compiled code record the
+  /// runtime's per-op profile (see refbackrt::getOpProfile), and each of
+  /// `specializeBatchSizes` adds variants of the public functions with a
+  /// dynamic leading dimension, which invoke() dispatches to when the inputs
+  /// match them. The pipeline optimizes for the host CPU unless the options
+  /// set another one (see mlir::NPCOMP::setTargetInfo and getTargetInfo).
+  static void buildBackendCompilationPipeline(
+      mlir::PassManager &pm,
+      const mlir::NPCOMP::RefBackendLoweringPipelineOptions &options);
+
+  /// Populates a PassManager with a pipeline lowering TCF to the ops of the
+  /// runtime's interpreter. The resulting module can be passed to
+  /// fromInterpretedModule().
+  static void buildInterpreterPipeline(mlir::PassManager &pm);
+
+  /// Returns the CPU that `compileOptions` generate code for: its vector
+  /// width and ISA extensions come from the LLVM target features of the CPU
+  /// (and of `compileOptions.features`), and its cache sizes and number of
+  /// cores are those of the host for the host CPU, and the defaults of
+  /// TargetInfo for other CPUs.
+  static llvm::Expected<mlir::NPCOMP::TargetInfo>
+  getTargetInfo(const JITCompileOptions &compileOptions = {});
+  /// Returns the CPU that `targetMachine` generates code for, as above, where
+  /// `isHost` tells whether it is the host CPU.
+  static mlir::NPCOMP::TargetInfo
+  getTargetInfo(const llvm::TargetMachine &targetMachine, bool isHost);
+
+  /// Parses the module in the file at `path` ("-" for stdin) to be compiled,
+  /// returning null on failure.
+  ///
+  /// Large constants are best stored in external files (see
+  /// refback::getExternalElementsAttr, and the npcomp-externalize-elements
+  /// pass), which are mapped into the compiled code instead of being parsed.
+  /// Relative paths to them are resolved against the directory of `path`.
+  /// All the JITModules of a process using the same file (for example
+  /// different shape variants of a model, or its instances for different
+  /// tenants) share a single read-only copy of it in memory.
+  static mlir::OwningModuleRef parseModuleFile(llvm::StringRef path,
+                                               mlir::MLIRContext &context);
 
   /// Constructs a JITModule from a compiled Module.
   /// The module should be the result of having run the backend compilation
-  /// pipeline successfully.
+  /// pipeline successfully. LLVM optimizes and generates code for it as
+  /// specified by `compileOptions`.
+  ///
+  /// If `objectCacheDir` is not empty, the object code generated for the
+  /// module is stored in that directory, keyed by a hash of the module, the
+  /// target and the compile options. Later calls with the same module
+  /// (including from other processes) load the object code from there instead
+  /// of running LLVM again.
+  ///
+  /// The compiler runtime functions (`__npcomp_compiler_rt_*`) are bound to
+  /// those of the runtime linked into this process, so the compiler runtime
+  /// shared library doesn't need to be loaded. `sharedLibs` are only needed
+  /// for other symbols of the compiled code; each is loaded once per process.
   static llvm::Expected<std::unique_ptr<JITModule>>
   fromCompiledModule(mlir::ModuleOp module,
-                     llvm::ArrayRef<llvm::StringRef> sharedLibs);
+                     llvm::ArrayRef<llvm::StringRef> sharedLibs,
+                     llvm::StringRef objectCacheDir = "",
+                     const JITCompileOptions &compileOptions = {});
+
+  /// Constructs a JITModule interpreting the functions of a module, without
+  /// generating any code, for callers that can't afford the latency of LLVM
+  /// (see refbackrt::interp). The module should be the result of having run
+  /// the interpreter pipeline successfully. Fails on functions with ops that
+  /// the interpreter doesn't support.
+  static llvm::Expected<std::unique_ptr<JITModule>>
+  fromInterpretedModule(mlir::ModuleOp module);
+
+  /// Constructs a JITModule from a shared object produced ahead of time by
+  /// `npcomp-compile`, loaded with refbackrt::loadModule.
+  static llvm::Expected<std::unique_ptr<JITModule>>
+  fromSharedObject(llvm::StringRef path);
 
+  /// Resolves `functionName` once, so that hot callers can invoke it many
+  /// times through the FunctionHandle overloads below without name lookups.
+  llvm::Expected<refbackrt::FunctionHandle>
+  lookup(llvm::StringRef functionName);
+
+  /// Resolves `functionName` to the function or specialization of it to call
+  /// with `inputs` (see refbackrt::selectFunction). The overloads below taking
+  /// a function name call the function selected by this.
+  llvm::Expected<refbackrt::FunctionHandle>
+  select(llvm::StringRef functionName,
+         llvm::ArrayRef<refbackrt::RtValue> inputs);
+
+  /// Prepares repeated calls of `functionName` with inputs of the same types
+  /// and shapes as `exampleInputs`, which are validated against the compiled
+  /// function.
+  llvm::Expected<PreparedCall>
+  prepare(llvm::StringRef functionName,
+          llvm::ArrayRef<refbackrt::RtValue> exampleInputs);
+
+  /// Invokes a function, whose parallel loops are scheduled with the
+  /// priority of `schedule`. Fails without calling the function if the
+  /// deadline of `schedule` has passed, and with the message of the check if
+  /// a runtime check of the compiled code (such as a shape check) fails.
   llvm::Expected<llvm::SmallVector<refbackrt::RtValue, 6>>
   invoke(llvm::StringRef functionName,
-         llvm::ArrayRef<refbackrt::RtValue> inputs);
+         llvm::ArrayRef<refbackrt::RtValue> inputs,
+         const refbackrt::RequestSchedule &schedule = {});
+  llvm::Expected<llvm::SmallVector<refbackrt::RtValue, 6>>
+  invoke(refbackrt::FunctionHandle function,
+         llvm::ArrayRef<refbackrt::RtValue> inputs,
+         const refbackrt::RequestSchedule &schedule = {});
+
+  /// Same as invoke(), but runs the call on a thread pool owned by this
+  /// JITModule and returns immediately. The inputs are retained until the
+  /// call completes. Destroying the JITModule waits for all pending calls.
+  ///
+  /// Pending calls start in order of priority, then of deadline (calls
+  /// without one last), then of submission. Calls still pending at their
+  /// deadline fail instead of running.
+  std::future<AsyncCallResult>
+  invokeAsync(llvm::StringRef functionName,
+              llvm::ArrayRef<refbackrt::RtValue> inputs,
+              const refbackrt::RequestSchedule &schedule = {});
+
+  /// Same as invoke(), but writes the results into caller-owned `outputs`.
+  /// Each tensor result must have a preallocated Tensor of the result's shape
+  /// in the corresponding slot of `outputs`, which lets steady-state callers
+  /// avoid allocating output storage on every invocation. Slots left as None
+  /// (as refbackrt::createRtValueFromOutputArgInfo does for dynamically
+  /// shaped results) get the result allocated by the compiled code instead.
+  llvm::Error invokeInto(llvm::StringRef functionName,
+                         llvm::ArrayRef<refbackrt::RtValue> inputs,
+                         llvm::MutableArrayRef<refbackrt::RtValue> outputs);
+  llvm::Error invokeInto(refbackrt::FunctionHandle function,
+                         llvm::ArrayRef<refbackrt::RtValue> inputs,
+                         llvm::MutableArrayRef<refbackrt::RtValue> outputs);
+
+  /// Gets `functionName` ready to serve its first call at steady-state
+  /// latency: touches the pages of the external weights of the module, starts
+  /// the runtime's thread pool, and calls the function once on zero-filled
+  /// inputs of `signature` (by default, the signature of the function, which
+  /// must then have static shapes). The call compiles the function if the
+  /// module is compiled lazily, resolves the symbols of the runtime that it
+  /// calls, and sizes the allocator pools and scratch arenas of the threads
+  /// it runs on for inputs of that shape. These are per-thread, so serving
+  /// threads should warm up on their own. Fails if the call fails.
+  llvm::Error warmup(llvm::StringRef functionName,
+                     llvm::ArrayRef<refbackrt::InputArgInfo> signature = {});
+
+  /// Returns the names of the functions of the module, including the
+  /// specializations of other functions, in order.
+  std::vector<std::string> getFunctionNames();
+
+  /// Returns the signature and memory footprint of `functionName`, as
+  /// recorded by the compiler.
+  llvm::Expected<refbackrt::FunctionMetadata>
+  getMetadata(llvm::StringRef functionName);
+
+  /// Returns the counters of the calls of `functionName` made while
+  /// refbackrt instrumentation was enabled (see
+  /// refbackrt::setInstrumentationEnabled).
+  llvm::Expected<refbackrt::FunctionStats>
+  getFunctionStats(llvm::StringRef functionName);
 
 private:
   JITModule();
-  std::unique_ptr<mlir::ExecutionEngine> engine;
+  // Declared before `jit`, which uses it while compiling.
+  std::unique_ptr<llvm::ObjectCache> objectCache;
+  // The files storing the external globals of the compiled code, loaded into
+  // memory and shared with the other JITModules of the process that use
+  // them. Declared before `jit` so that they outlive the compiled code.
+  std::vector<std::shared_ptr<const ExternalWeights>> externalWeights;
+  // Null for modules loaded from a shared object or interpreted.
+  std::unique_ptr<llvm::orc::LLJIT> jit;
+  // The functions of interpreted modules, which `descriptor` points into.
+  std::unique_ptr<refbackrt::interp::Module> interpretedModule;
   refbackrt::ModuleDescriptor *descriptor;
+  // Created on the first invokeAsync. Declared after `jit` so that pending
+  // calls finish before the compiled code is destroyed.
+  std::once_flag schedulerCreated;
+  std::unique_ptr<RequestScheduler> scheduler;
 };
 } // namespace refback
 
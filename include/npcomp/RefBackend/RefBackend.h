@@ -11,6 +11,7 @@
 
 #include "mlir/Pass/Pass.h"
 #include "mlir/Pass/PassManager.h"
+#include "npcomp/RefBackend/TargetInfo.h"
 
 namespace mlir {
 namespace NPCOMP {
@@ -25,11 +26,153 @@ void registerRefBackendPasses();
 
 std::unique_ptr<OperationPass<FuncOp>> createLowerStructuralToMemrefPass();
 
+std::unique_ptr<OperationPass<ModuleOp>> createInlinePrivateFunctionsPass();
+
+std::unique_ptr<OperationPass<ModuleOp>> createSpecializeFunctionsPass();
+std::unique_ptr<OperationPass<ModuleOp>>
+createSpecializeFunctionsPass(ArrayRef<int64_t> batchSizes);
+
 std::unique_ptr<OperationPass<ModuleOp>> createLowerToRefbackrtABIPass();
+std::unique_ptr<OperationPass<ModuleOp>>
+createLowerToRefbackrtABIPass(bool rankedABI, unsigned stackBufferMaxBytes);
 
 std::unique_ptr<OperationPass<FuncOp>> createLowerAllocMemRefOpsPass();
 
+std::unique_ptr<OperationPass<FuncOp>> createLowerMemRefCloneOpsPass();
+
+std::unique_ptr<OperationPass<FuncOp>> createUpdateGlobalsInPlacePass();
+
+std::unique_ptr<OperationPass<FuncOp>> createElideSliceCopiesPass();
+
+std::unique_ptr<OperationPass<FuncOp>> createElideConcatCopiesPass();
+
+std::unique_ptr<OperationPass<FuncOp>> createReuseLoopCarriedBuffersPass();
+
+std::unique_ptr<OperationPass<FuncOp>> createConvertBroadcastToToLinalgPass();
+
+std::unique_ptr<OperationPass<FuncOp>> createConvertConvolutionsToNHWCPass();
+
+std::unique_ptr<OperationPass<FuncOp>> createFoldConstantLinalgOpsPass();
+
+std::unique_ptr<OperationPass<FuncOp>> createDemoteToBF16Pass();
+
+std::unique_ptr<OperationPass<FuncOp>> createExpandSplatConstantsPass();
+
+std::unique_ptr<OperationPass<FuncOp>> createHoistShapeConstraintsPass();
+
+std::unique_ptr<OperationPass<FuncOp>> createAssumeShapeConstraintsPass();
+
+std::unique_ptr<OperationPass<FuncOp>> createHoistShapeComputationsPass();
+
+std::unique_ptr<OperationPass<ModuleOp>> createApplyTuningDatabasePass();
+std::unique_ptr<OperationPass<ModuleOp>>
+createApplyTuningDatabasePass(StringRef path);
+
+std::unique_ptr<OperationPass<FuncOp>> createLowerConvolutionsPass();
+
+std::unique_ptr<OperationPass<FuncOp>> createPackMatmulWeightsPass();
+std::unique_ptr<OperationPass<FuncOp>>
+createPackMatmulWeightsPass(int64_t panelWidth);
+
+std::unique_ptr<OperationPass<FuncOp>> createLowerPackedMatmulsPass();
+std::unique_ptr<OperationPass<FuncOp>>
+createLowerPackedMatmulsPass(int64_t rows, bool useFMA);
+
+// Tile sizes for createTileLinalgOpsPass (and, for the L2 sizes of the
+// parallel loops, createFuseLinalgEpiloguesPass), in the loop order of each op.
+struct LinalgTilingStrategy {
+  // Whether to make the parallel loops of the outermost level scf.parallel.
+  bool parallelize = false;
+  SmallVector<int64_t, 3> matmulL2TileSizes;
+  SmallVector<int64_t, 3> matmulL1TileSizes;
+  SmallVector<int64_t, 7> convL2TileSizes;
+  SmallVector<int64_t, 7> convL1TileSizes;
+};
+
+std::unique_ptr<OperationPass<FuncOp>> createTileLinalgOpsPass();
+std::unique_ptr<OperationPass<FuncOp>>
+createTileLinalgOpsPass(const LinalgTilingStrategy &strategy);
+
+std::unique_ptr<OperationPass<FuncOp>> createFuseLinalgEpiloguesPass();
+std::unique_ptr<OperationPass<FuncOp>>
+createFuseLinalgEpiloguesPass(const LinalgTilingStrategy &strategy);
+
+std::unique_ptr<OperationPass<FuncOp>> createVectorizeLinalgOpsPass();
+std::unique_ptr<OperationPass<FuncOp>>
+createVectorizeLinalgOpsPass(unsigned vectorWidth);
+
+std::unique_ptr<OperationPass<FuncOp>> createApproximateMathPass();
+std::unique_ptr<OperationPass<FuncOp>>
+createApproximateMathPass(unsigned maxUlp, bool useFMA);
+
+std::unique_ptr<OperationPass<FuncOp>> createInsertOpProfilingPass();
+
+std::unique_ptr<OperationPass<FuncOp>> createPromoteLoopInvariantAccessesPass();
+
+std::unique_ptr<OperationPass<FuncOp>> createInsertPrefetchesPass();
+std::unique_ptr<OperationPass<FuncOp>>
+createInsertPrefetchesPass(unsigned distance);
+
+std::unique_ptr<OperationPass<FuncOp>> createInterchangeAffineLoopsPass();
+
+// The attribute marking the `scf.parallel` loops over the tasks formed by
+// createFormConcurrentTasksPass.
+constexpr StringLiteral kConcurrentTasksAttrName = "refbackrt.concurrent_tasks";
+
+std::unique_ptr<OperationPass<FuncOp>> createFormConcurrentTasksPass();
+
+std::unique_ptr<OperationPass<ModuleOp>> createInsertWeightPrefetchesPass();
+
+std::unique_ptr<OperationPass<ModuleOp>> createLowerParallelLoopsPass();
+
+std::unique_ptr<OperationPass<ModuleOp>> createReuseScratchBuffersPass();
+
 std::unique_ptr<OperationPass<ModuleOp>> createLowerToLLVMPass();
+std::unique_ptr<OperationPass<ModuleOp>>
+createLowerToLLVMPass(bool fastMathReassoc, bool fastMathContract,
+                      bool fastMathNoNaNs, bool profileAllocations);
+
+// A global of a module lowered by createLowerToLLVMPass whose initial value is
+// an external elements attribute (see refback::getExternalElementsAttr). The
+// global is an external declaration, which whoever loads the compiled code
+// must define as the address of the `size` bytes at `offset` in `path`.
+struct ExternalGlobal {
+  std::string symbol;
+  std::string path;
+  uint64_t offset;
+  uint64_t size;
+};
+
+// The module attribute describing the external globals of a module lowered
+// by createLowerToLLVMPass, as an array of {symbol, path, offset, size}
+// dictionaries. The compiled code doesn't depend on it.
+constexpr StringLiteral kExternalGlobalsAttrName = "refback.external_globals";
+
+// Returns the external globals of `module`, lowered by createLowerToLLVMPass.
+SmallVector<ExternalGlobal, 4> getExternalGlobals(ModuleOp module);
+
+// Makes the external globals of `module` stored in the file at `path` be
+// stored at the same offsets in the file at `newPath` instead (such as when
+// the weights of a model are refreshed). Returns the number of globals whose
+// file was replaced.
+int64_t replaceExternalGlobalsPath(ModuleOp module, StringRef path,
+                                   StringRef newPath);
+
+// Calls `callback` on one module per function of `module`, lowered by
+// createLowerToLLVMPass, in turn, and then on a last module. Each module
+// defines its function along with the globals it uses that no previous module
+// defined, and declares the other symbols it uses. The last module defines the
+// remaining globals (such as the module descriptor). Linked together, the
+// modules are equivalent to `module`, whose functions and globals are all
+// given external linkage for that purpose.
+//
+// The body of each function of `module` is erased once `callback` returns for
+// it, so that compiling the modules one at a time (see
+// refback::JITCompileOptions::streaming) only ever holds the IR of one
+// function.
+LogicalResult
+streamFunctionModules(ModuleOp module,
+                      function_ref<LogicalResult(ModuleOp)> callback);
 
 std::unique_ptr<Pass> createRestrictedCanonicalizerPass();
 
@@ -39,8 +182,190 @@ struct RefBackendLoweringPipelineOptions
   // If this option is false, only do the bare minimum for correctness.
   Option<bool> optimize{*this, "optimize", llvm::cl::desc("Do optimizations."),
                         llvm::cl::init(false)};
+
+  // If this option is true (and optimizations are enabled), run the parallel
+  // loops of linalg ops on the runtime's thread pool.
+  Option<bool> parallelize{
+      *this, "parallelize",
+      llvm::cl::desc("Run parallel loops on multiple threads."),
+      llvm::cl::init(true)};
+
+  // If this option is true (and optimizations are enabled), lower linalg ops
+  // to affine loops and optimize them with affine loop fusion, interchange,
+  // tiling and data copy generation instead of tiling the linalg ops.
+  Option<bool> affineLoops{
+      *this, "affine-loops",
+      llvm::cl::desc("Optimize the loops of linalg ops as affine loops."),
+      llvm::cl::init(false)};
+
+  // If this option is true (and optimizations are enabled), compute the f32
+  // matmuls with bf16 operands and f32 accumulation. See
+  // createDemoteToBF16Pass.
+  Option<bool> bf16Matmuls{
+      *this, "bf16-matmuls",
+      llvm::cl::desc("Compute f32 matmuls with bf16 operands."),
+      llvm::cl::init(false)};
+
+  // If this option is nonzero, replace the math functions on f32 (exp, log,
+  // tanh) by polynomial approximations whose error is at most this many ULPs.
+  // See createApproximateMathPass.
+  Option<unsigned> mathMaxUlp{
+      *this, "math-max-ulp",
+      llvm::cl::desc("Maximum error in ULPs of the approximations of math "
+                     "functions (0 to compute them exactly)"),
+      llvm::cl::init(0)};
+
+  // These options set LLVM fast-math flags on the floating-point ops of the
+  // compiled code, for models that tolerate different rounding: `reassoc`
+  // lets LLVM vectorize reductions (and dot products), `contract` lets it
+  // fuse multiplies and adds into FMAs, and `no-nans` lets it assume that no
+  // value is NaN. See createLowerToLLVMPass.
+  Option<bool> fastMathReassoc{
+      *this, "fast-math-reassoc",
+      llvm::cl::desc("Allow reassociating floating-point ops."),
+      llvm::cl::init(false)};
+  Option<bool> fastMathContract{
+      *this, "fast-math-contract",
+      llvm::cl::desc("Allow contracting floating-point multiplies and adds."),
+      llvm::cl::init(false)};
+  Option<bool> fastMathNoNaNs{
+      *this, "fast-math-no-nans",
+      llvm::cl::desc("Assume floating-point values are never NaN."),
+      llvm::cl::init(false)};
+
+  // If this option is true, time each top-level op of the compiled code at
+  // runtime, for refbackrt's per-op profile, and name the op making each
+  // allocation and free for refbackrt's memory profile. See
+  // createInsertOpProfilingPass and createLowerToLLVMPass.
+  Option<bool> profileOps{
+      *this, "profile-ops",
+      llvm::cl::desc("Record a per-op profile at runtime."),
+      llvm::cl::init(false)};
+
+  // If this option is true, the callers guarantee that the dynamic extents of
+  // the inputs they pass are consistent (e.g. broadcastable), and the compiled
+  // code doesn't check them. The runtime still checks the inputs against the
+  // signature of the function. See createAssumeShapeConstraintsPass.
+  Option<bool> trustedInputs{
+      *this, "trusted-inputs",
+      llvm::cl::desc("Assume that the shape constraints on the inputs hold."),
+      llvm::cl::init(false)};
+
+  // If non-zero, the strided and indirect loads of innermost loops prefetch
+  // the element they load this many iterations later. See
+  // createInsertPrefetchesPass.
+  Option<unsigned> prefetchDistance{
+      *this, "prefetch-distance",
+      llvm::cl::desc("Number of loop iterations to prefetch strided and "
+                     "indirect loads ahead (0 to not prefetch)"),
+      llvm::cl::init(0)};
+
+  // If this option is true, the first call of each function asks the OS to
+  // read ahead the pages of the external globals (e.g. weights) it uses. See
+  // createInsertWeightPrefetchesPass.
+  Option<bool> prefetchWeights{
+      *this, "prefetch-weights",
+      llvm::cl::desc("Prefetch the external globals used by each function."),
+      llvm::cl::init(false)};
+
+  // The tuning database whose configurations to apply to the matmuls and
+  // convolutions when optimizing (see createApplyTuningDatabasePass). If it
+  // is empty, the NPCOMP_TUNING_DATABASE environment variable is used, if it
+  // is set.
+  Option<std::string> tuningDatabase{
+      *this, "tuning-database",
+      llvm::cl::desc("Path of the tuning database of matmuls and "
+                     "convolutions."),
+      llvm::cl::init("")};
+
+  // The CPU to optimize for (see getTargetInfo below): the host CPU by
+  // default. Non-empty `target-features` (LLVM target features, such as
+  // "avx2,fma") describe another CPU instead, with default cache sizes. The
+  // other options override the cache sizes, vector width and core count of
+  // either, when they are non-zero.
+  ListOption<std::string> targetFeatures{
+      *this, "target-features",
+      llvm::cl::desc("ISA extensions of the target CPU (the host CPU's by "
+                     "default)"),
+      llvm::cl::MiscFlags::CommaSeparated};
+  Option<unsigned> targetVectorWidth{
+      *this, "target-vector-width",
+      llvm::cl::desc("Width in bits of the target's vector registers"),
+      llvm::cl::init(0)};
+  Option<int64_t> targetL1CacheSize{
+      *this, "target-l1-cache-size",
+      llvm::cl::desc("Size in bytes of the target's L1 data cache"),
+      llvm::cl::init(0)};
+  Option<int64_t> targetL2CacheSize{
+      *this, "target-l2-cache-size",
+      llvm::cl::desc("Size in bytes of the target's per-core L2 cache"),
+      llvm::cl::init(0)};
+  Option<unsigned> targetCores{
+      *this, "target-cores",
+      llvm::cl::desc("Number of cores of the target"), llvm::cl::init(0)};
+
+  // Tile sizes used for linalg ops when optimizing. Empty lists mean the
+  // defaults, which are sized for the caches of the target CPU for f32. See
+  // createTileLinalgOpsPass.
+  ListOption<int64_t> matmulL2TileSizes{
+      *this, "matmul-l2-tile-sizes",
+      llvm::cl::desc("L2 tile sizes for matmuls (0 to not tile a loop)"),
+      llvm::cl::MiscFlags::CommaSeparated};
+  ListOption<int64_t> matmulL1TileSizes{
+      *this, "matmul-l1-tile-sizes",
+      llvm::cl::desc("L1 tile sizes for matmuls (0 to not tile a loop)"),
+      llvm::cl::MiscFlags::CommaSeparated};
+  ListOption<int64_t> convL2TileSizes{
+      *this, "conv-l2-tile-sizes",
+      llvm::cl::desc("L2 tile sizes for convolutions (0 to not tile a loop)"),
+      llvm::cl::MiscFlags::CommaSeparated};
+  ListOption<int64_t> convL1TileSizes{
+      *this, "conv-l1-tile-sizes",
+      llvm::cl::desc("L1 tile sizes for convolutions (0 to not tile a loop)"),
+      llvm::cl::MiscFlags::CommaSeparated};
+
+  // If this option is true, memref arguments cross function boundaries with
+  // their ranked types rather than as unranked memrefs (see
+  // createLowerToRefbackrtABIPass).
+  Option<bool> rankedABI{
+      *this, "ranked-abi",
+      llvm::cl::desc("Pass memref arguments with their ranked types."),
+      llvm::cl::init(false)};
+
+  // The size in bytes of the largest statically shaped buffers that don't
+  // escape their function to allocate on the stack rather than from the
+  // runtime's scratch arena (0 to not allocate any on the stack). See
+  // createLowerToRefbackrtABIPass.
+  Option<unsigned> stackBufferMaxBytes{
+      *this, "stack-buffer-max-bytes",
+      llvm::cl::desc("Size in bytes of the largest buffers to allocate on the "
+                     "stack"),
+      llvm::cl::init(256)};
+
+  // Leading (batch) sizes for which to add statically shaped variants of the
+  // public functions (see createSpecializeFunctionsPass).
+  ListOption<int64_t> specializeBatchSizes{
+      *this, "specialize-batch-sizes",
+      llvm::cl::desc("Batch sizes to add static variants of public functions "
+                     "for"),
+      llvm::cl::MiscFlags::CommaSeparated};
 };
 
+// Returns the CPU that the pipeline optimizes for with `options`: the host
+// CPU (detected when this is called) or the CPU described by the target-*
+// options.
+//
+// The pipeline sizes the default tiles for its caches, vectorizes for its
+// vector width, uses a matmul microkernel of one vector register per row
+// (with more rows when it has more registers), and doesn't parallelize for a
+// single core.
+TargetInfo getTargetInfo(const RefBackendLoweringPipelineOptions &options);
+
+// Sets the target-* options of `options` to describe `target`, such as the
+// CPU that a module is compiled ahead of time for.
+void setTargetInfo(RefBackendLoweringPipelineOptions &options,
+                   const TargetInfo &target);
+
 // The main pipeline that encapsulates the full RefBackend lowering.
 void createRefBackendLoweringPipeline(
     OpPassManager &pm, const RefBackendLoweringPipelineOptions &options);
@@ -64,6 +389,23 @@ void createRefBackendTCFToTCPPipeline(
 void createTCFRefBackendLoweringPipeline(
     OpPassManager &pm, const RefBackendLoweringPipelineOptions &options);
 
+// Pipeline lowering TCF to the ops that the runtime's interpreter executes
+// (see refbackrt::interp::Function): linalg ops on tensors, with std and math
+// scalar ops. Nothing is bufferized or lowered to LLVM.
+void createTCFRefBackendInterpreterPipeline(
+    OpPassManager &pm, const RefBackendLoweringPipelineOptions &options);
+
+// Sets the number of threads that pass managers running on `context` run
+// nested pass pipelines on in parallel: 0 for one per hardware thread, 1 to
+// disable multithreading. Other than disabling multithreading, this is
+// process-wide, and only takes effect if it is set before the first pass
+// pipeline runs in parallel.
+void setNumCompileThreads(MLIRContext &context, unsigned numThreads);
+
+// Makes `pm` print a per-pass timing report and a per-pass memory report to
+// stderr when it is destroyed, covering all of its runs.
+void enableCompileTimeReport(PassManager &pm);
+
 } // namespace NPCOMP
 } // namespace mlir
 
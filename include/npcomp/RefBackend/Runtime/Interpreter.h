@@ -0,0 +1,340 @@
+//===------------------------------------------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// An interpreter of the ops of the backend contract (linalg ops on tensors,
+// and std and math scalar ops), for deployments that can't afford the latency
+// or footprint of generating code with LLVM.
+//
+// The compiler translates each function into a Function: a straight-line
+// sequence of Instructions over numbered value slots. Each linalg op becomes
+// a LinalgInstruction, executed by a handful of precompiled kernels: a
+// matmul kernel for the matmuls, and otherwise a loop nest that evaluates
+// the payload of the op on vectors of kLanes iterations at a time (see
+// Interpreter.cpp), with one kernel per payload op. The kernels are compiled
+// for several generations of SIMD instructions and dispatched on the CPU at
+// load time where the toolchain supports it.
+//
+// A Module of interpreted functions has a ModuleDescriptor like compiled
+// modules, so that refbackrt::invoke, getMetadata and the rest of the user
+// API work the same on both.
+//
+// This is shared by the compiler and the runtime, so it has no dependencies.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef NPCOMP_RUNTIME_INTERPRETER_H
+#define NPCOMP_RUNTIME_INTERPRETER_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace refbackrt {
+struct ModuleDescriptor;
+
+namespace interp {
+
+// The number of iterations of a linalg op that the kernels of its payload
+// process at a time.
+constexpr std::int64_t kLanes = 256;
+
+// The types of scalars, and of the elements of tensors. `index` is kI64.
+enum class ScalarType : std::uint8_t {
+  kF32,
+  kF64,
+  // Booleans, stored as one byte per element in tensors.
+  kI1,
+  kI8,
+  kI32,
+  kI64,
+};
+
+// A scalar, in the representation that the kernels compute on: integers of
+// all widths are sign-extended to 64 bits, except i1, which is 0 or 1.
+union Scalar {
+  float f32;
+  double f64;
+  std::int64_t i64;
+};
+
+enum class Opcode : std::uint8_t {
+  // Float ops, on operands and results of `type`.
+  kAddF,
+  kSubF,
+  kMulF,
+  kDivF,
+  kRemF,
+  kNegF,
+  kAbsF,
+  kCeilF,
+  kFloorF,
+  kExp,
+  kLog,
+  kTanh,
+  kSqrt,
+  kRsqrt,
+  kPowF,
+  // Compares operands of `operandType` with `predicate`, a CmpFPredicate.
+  kCmpF,
+  // Integer ops, on operands and results of `type`.
+  kAddI,
+  kSubI,
+  kMulI,
+  kDivSI,
+  kDivUI,
+  kRemSI,
+  kRemUI,
+  kAndI,
+  kOrI,
+  kXOrI,
+  kShLI,
+  kShRSI,
+  kShRUI,
+  // Compares operands of `operandType` with `predicate`, a CmpIPredicate.
+  kCmpI,
+  // Selects operand 1 or 2 of `type` with the i1 operand 0.
+  kSelect,
+  // Conversions from operands of `operandType` to `type`.
+  kSIToFP,
+  kUIToFP,
+  kFPToSI,
+  kFPToUI,
+  kExtF,
+  kTruncF,
+  kExtSI,
+  kExtUI,
+  kTruncI,
+};
+
+// The predicates of kCmpF, numbered as mlir::CmpFPredicate.
+enum class CmpFPredicate : std::uint8_t {
+  kFalse,
+  kOEQ,
+  kOGT,
+  kOGE,
+  kOLT,
+  kOLE,
+  kONE,
+  kORD,
+  kUEQ,
+  kUGT,
+  kUGE,
+  kULT,
+  kULE,
+  kUNE,
+  kUNO,
+  kTrue,
+};
+
+// The predicates of kCmpI, numbered as mlir::CmpIPredicate.
+enum class CmpIPredicate : std::uint8_t {
+  kEQ,
+  kNE,
+  kSLT,
+  kSLE,
+  kSGT,
+  kSGE,
+  kULT,
+  kULE,
+  kUGT,
+  kUGE,
+};
+
+// A scalar op, computing `result` from `operands`. These are value slots of
+// the function for scalar ops of the function, and registers of the payload
+// for those of a linalg op.
+struct ScalarInstruction {
+  Opcode opcode;
+  // The type of the result (i1 for comparisons).
+  ScalarType type;
+  // The type of the operands of comparisons and conversions.
+  ScalarType operandType = ScalarType::kI64;
+  // A CmpFPredicate or CmpIPredicate, for comparisons.
+  std::uint8_t predicate = 0;
+  std::int32_t result;
+  std::int32_t operands[3] = {-1, -1, -1};
+};
+
+// How a linalg op reads or writes one of its tensor operands: the index of
+// each dimension of the operand is a linear combination of the loop indices
+// plus a constant, which covers permutations, broadcasts and the sliding
+// windows of convolutions.
+struct LinalgOperand {
+  ScalarType elementType;
+  std::int32_t rank;
+  // The coefficient of loop `l` in the index of dimension `d` is
+  // `coefficients[d * numLoops + l]`.
+  std::vector<std::int64_t> coefficients;
+  std::vector<std::int64_t> offsets;
+};
+
+enum class LinalgKernel : std::uint8_t {
+  // The payload is evaluated on vectors of iterations.
+  kGeneric,
+  // f32 `linalg.matmul` and `linalg.batch_matmul`, which fall back to
+  // kGeneric for operands whose innermost dimension isn't contiguous.
+  kMatmul,
+  kBatchMatmul,
+};
+
+// A linalg op. Its Instruction reads the input tensors, then the output
+// (init) tensors, then the values of the function that the payload uses, and
+// defines the result tensors.
+struct LinalgInstruction {
+  LinalgKernel kernel = LinalgKernel::kGeneric;
+  std::int32_t numLoops;
+  std::vector<bool> isReduction;
+  // The operand and dimension whose extent is the trip count of each loop.
+  std::vector<std::int32_t> loopExtentOperands;
+  std::vector<std::int32_t> loopExtentDims;
+  // The inputs, then the outputs.
+  std::vector<LinalgOperand> operands;
+  std::int32_t numInputs;
+
+  // The payload computes on registers of kLanes scalars of
+  // `registerTypes`. The first registers are the arguments of the payload
+  // (one per operand), the others are those of `constantRegisters`,
+  // `captureRegisters`, `loopIndexRegisters`, and the results of `body`.
+  std::vector<ScalarType> registerTypes;
+  // Registers holding a constant...
+  std::vector<std::int32_t> constantRegisters;
+  std::vector<Scalar> constants;
+  // ...a value of the function, given by its position among the values the
+  // Instruction reads after the tensors...
+  std::vector<std::int32_t> captureRegisters;
+  std::vector<std::int32_t> captures;
+  // ...or the index of a loop (`linalg.index`).
+  std::vector<std::int32_t> loopIndexRegisters;
+  std::vector<std::int32_t> loopIndices;
+  std::vector<ScalarInstruction> body;
+  // The registers yielded for each output.
+  std::vector<std::int32_t> yields;
+  // Whether the payload reads each output, so that its init tensor must be
+  // copied into the result.
+  std::vector<bool> readsOutput;
+};
+
+enum class InstructionKind : std::uint8_t {
+  // Defines result 0 as `constant`, of `type`.
+  kScalarConstant,
+  // Defines result 0 as the tensor constant `constantIndex`.
+  kTensorConstant,
+  kScalar,
+  // Defines result 0 as the extent of dimension `dim` of tensor operand 0.
+  kDim,
+  // Defines result 0 as an uninitialized tensor of elements of `type` and
+  // extents `extents`, where dynamic (-1) extents are given by the operands,
+  // in order.
+  kInitTensor,
+  // Defines result 0 as a tensor of the extents of operand 1 filled with the
+  // scalar operand 0.
+  kFill,
+  kLinalg,
+  // Defines result 0 as the element of tensor operand 0 at the indices given
+  // by the other operands.
+  kExtract,
+  // Defines result 0 as a tensor of elements of `type` and extents
+  // `extents`, holding the operands.
+  kFromElements,
+  // Defines result 0 as tensor operand 0, viewed as a different type of the
+  // same shape (`tensor.cast`).
+  kCast,
+  // Fails the call with `message` unless the i1 operand 0 is true.
+  kAssert,
+  // Returns the operands.
+  kReturn,
+};
+
+struct Instruction {
+  InstructionKind kind;
+  std::vector<std::int32_t> operands;
+  std::vector<std::int32_t> results;
+  // The slots whose last use is this instruction, released after it.
+  std::vector<std::int32_t> lastUses;
+  // Whether each output of a kLinalg may be computed in the buffer of its
+  // init tensor, whose last use this is, if nothing else references it.
+  std::vector<bool> mayReuseOutput;
+
+  ScalarType type = ScalarType::kI64;
+  Scalar constant = {};
+  std::int32_t constantIndex = -1;
+  std::int64_t dim = 0;
+  std::vector<std::int64_t> extents;
+  ScalarInstruction scalar = {};
+  std::int32_t linalgIndex = -1;
+  std::string message;
+};
+
+// A tensor constant, stored densely in row-major order.
+struct TensorConstant {
+  ScalarType elementType;
+  std::vector<std::int64_t> extents;
+  std::vector<char> data;
+};
+
+// The type of an argument or result of a Function.
+struct ArgSignature {
+  bool isTensor;
+  // The element type for tensors.
+  ScalarType type;
+  // The extents of tensors, -1 for dynamic ones.
+  std::vector<std::int64_t> extents;
+};
+
+struct Function {
+  std::string name;
+  std::vector<ArgSignature> inputs;
+  std::vector<ArgSignature> outputs;
+  // The slots of the values of the function, the inputs first.
+  std::int32_t numSlots;
+  std::vector<Instruction> instructions;
+  std::vector<LinalgInstruction> linalgOps;
+  std::vector<TensorConstant> constants;
+};
+
+// Interpreted functions, with the descriptors that let refbackrt::invoke call
+// them.
+class Module {
+public:
+  explicit Module(std::vector<Function> functions);
+  ~Module();
+  Module(const Module &) = delete;
+  Module &operator=(const Module &) = delete;
+
+  // The descriptor of the module, valid as long as the Module.
+  ModuleDescriptor *getDescriptor() const;
+
+private:
+  struct Descriptors;
+  std::vector<Function> functions;
+  std::unique_ptr<Descriptors> descriptors;
+};
+
+// An argument or result of a call of a Function.
+struct Value {
+  Scalar scalar = {};
+  // For tensors, their buffer, which is owned by the caller, as are the
+  // buffers of the results, allocated with refbackrt::allocate.
+  void *data = nullptr;
+  std::vector<std::int64_t> extents;
+  // The distance, in elements, between consecutive indices of each
+  // dimension. Results are contiguous.
+  std::vector<std::int64_t> strides;
+};
+
+// Runs `function` on `inputs`, setting `outputs`. Returns the message of the
+// runtime check that failed, if any, in which case `outputs` are left unset.
+const char *runFunction(const Function &function,
+                        const std::vector<Value> &inputs,
+                        std::vector<Value> &outputs);
+
+} // namespace interp
+} // namespace refbackrt
+
+#endif // NPCOMP_RUNTIME_INTERPRETER_H
@@ -14,10 +14,13 @@
 #ifndef NPCOMP_RUNTIME_SUPPORT_H
 #define NPCOMP_RUNTIME_SUPPORT_H
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <memory>
 
 namespace refbackrt {
 class StringRef {
@@ -31,7 +34,23 @@ public:
     return std::memcmp(ptr, other.ptr, length) == 0;
   }
 
+  // Lexicographically compares the bytes of the two strings, returning a value
+  // less than, equal to, or greater than zero, like `std::memcmp`. Matches the
+  // ordering of llvm::StringRef::compare.
+  int compare(StringRef other) const {
+    std::size_t minLength = length < other.length ? length : other.length;
+    if (minLength != 0) {
+      if (int result = std::memcmp(ptr, other.ptr, minLength))
+        return result < 0 ? -1 : 1;
+    }
+    if (length == other.length)
+      return 0;
+    return length < other.length ? -1 : 1;
+  }
+
   const char* str() { return ptr; }
+  const char *data() const { return ptr; }
+  std::size_t size() const { return length; }
 
 private:
   const char *ptr;
@@ -72,6 +91,76 @@ private:
   std::size_t length;
 };
 
+// A vector whose first `N` elements are stored inline, so that it only
+// allocates once it grows past `N` elements. Unlike llvm::SmallVector, it only
+// holds default-constructible, copyable values, which are value-initialized
+// when the vector grows.
+template <typename T, std::size_t N> class SmallVector {
+public:
+  SmallVector() = default;
+  explicit SmallVector(std::size_t size) { resize(size); }
+  SmallVector(ArrayRef<T> values) {
+    resize(values.size());
+    std::copy(values.data(), values.data() + values.size(), begin());
+  }
+  SmallVector(const SmallVector &other) { *this = other; }
+  SmallVector &operator=(const SmallVector &other) {
+    if (&other != this) {
+      resize(other.size());
+      std::copy(other.begin(), other.end(), begin());
+    }
+    return *this;
+  }
+
+  T &operator[](std::size_t i) {
+    assert(i < length);
+    return data()[i];
+  }
+  const T &operator[](std::size_t i) const {
+    assert(i < length);
+    return data()[i];
+  }
+  T *data() {
+    return heapElements ? heapElements.get() : inlineElements.data();
+  }
+  const T *data() const {
+    return heapElements ? heapElements.get() : inlineElements.data();
+  }
+  std::size_t size() const { return length; }
+  bool empty() const { return length == 0; }
+  T *begin() { return data(); }
+  T *end() { return data() + length; }
+  const T *begin() const { return data(); }
+  const T *end() const { return data() + length; }
+  operator ArrayRef<T>() const { return ArrayRef<T>(data(), length); }
+  operator MutableArrayRef<T>() { return MutableArrayRef<T>(data(), length); }
+
+  void resize(std::size_t newLength) {
+    std::size_t capacity = heapElements ? heapCapacity : N;
+    if (newLength > capacity) {
+      std::size_t newCapacity = std::max(newLength, 2 * capacity);
+      std::unique_ptr<T[]> newElements(new T[newCapacity]());
+      std::copy(begin(), end(), newElements.get());
+      heapElements = std::move(newElements);
+      heapCapacity = newCapacity;
+    } else if (newLength > length) {
+      std::fill(end(), data() + newLength, T());
+    }
+    length = newLength;
+  }
+  void push_back(const T &value) {
+    T copy = value;
+    resize(length + 1);
+    data()[length - 1] = copy;
+  }
+
+private:
+  std::array<T, N> inlineElements = {};
+  std::unique_ptr<T[]> heapElements;
+  std::size_t heapCapacity = 0;
+  std::size_t length = 0;
+};
+
 // Literally copied from MLIR.
 struct LogicalResult {
   enum ResultEnum { Success, Failure } value;
@@ -30,7 +30,296 @@ namespace refbackrt {
 
 struct RtValue;
 
+//===----------------------------------------------------------------------===//
+// Memory allocation.
+//===----------------------------------------------------------------------===//
+
+// The alignment (in bytes) of all buffers allocated by the runtime and by
+// compiled code. The compiler assumes this alignment for buffers passed across
+// the ABI boundary, so it must agree with the `buffer-alignment` option of the
+// `lower-to-refbackrt-abi` pass.
+#ifndef NPCOMP_REFBACKRT_BUFFER_ALIGNMENT
+#define NPCOMP_REFBACKRT_BUFFER_ALIGNMENT 64
+#endif
+constexpr static std::size_t kBufferAlignment =
+    NPCOMP_REFBACKRT_BUFFER_ALIGNMENT;
+
+// Statistics about the buffers handed out by an Allocator.
+struct AllocatorStats {
+  // Number of bytes currently allocated and not yet deallocated.
+  std::int64_t bytesLive = 0;
+  // High-water mark of `bytesLive`.
+  std::int64_t peakBytesLive = 0;
+  // Total number of calls to `allocate`.
+  std::int64_t numAllocations = 0;
+  // Number of calls to `allocate` that were satisfied by reusing a cached
+  // buffer rather than by the system allocator.
+  std::int64_t numPoolHits = 0;
+
+  double getHitRate() const {
+    return numAllocations == 0 ? 0.0
+                               : static_cast<double>(numPoolHits) /
+                                     static_cast<double>(numAllocations);
+  }
+};
+
+// Interface for the allocator used for tensor buffers, both by the runtime
+// and by compiled code (through the compiler runtime).
+//
+// Implementations must be thread-safe, and must return buffers aligned to at
+// least kBufferAlignment. Since `deallocate` is not told the size of the
+// buffer, implementations need to track that themselves if they need it.
+class Allocator {
+public:
+  virtual ~Allocator() = default;
+  virtual void *allocate(std::size_t size) = 0;
+  virtual void deallocate(void *ptr) = 0;
+  virtual AllocatorStats getStats() const;
+};
+
+// Returns the default allocator, a thread-caching size-class pool.
+Allocator *getDefaultAllocator();
+
+// Returns the allocator currently in use.
+Allocator *getAllocator();
+
+// Sets the allocator used for all subsequent allocations. Passing nullptr
+// restores the default allocator.
+//
+// This must not be changed while any buffers allocated by the previous
+// allocator are still live, since they will be deallocated with the new one.
+void setAllocator(Allocator *allocator);
+
+// Allocates/deallocates a buffer with the current allocator. Deallocating
+// nullptr does nothing.
+void *allocate(std::size_t size);
+void deallocate(void *ptr);
+
+// Same as allocate/deallocate, attributing the allocation or free to `site`
+// in the memory profile (see setMemoryProfilingEnabled). `site` must outlive
+// the profile.
+void *allocateAt(std::size_t size, const char *site);
+void deallocateAt(void *ptr, const char *site);
+
+// Returns the statistics of the current allocator.
+AllocatorStats getAllocatorStats();
+
+// The size of the huge pages that large buffers can be backed by.
+constexpr static std::size_t kHugePageSize = std::size_t(2) << 20;
+
+// Which pages back buffers of at least kHugePageSize bytes, which are mostly
+// weights and large activations, whose accesses miss the TLB a lot with
+// regular pages.
+enum class HugePages {
+  // Regular pages.
+  None,
+  // Transparent huge pages, which the kernel backs the buffers with when it
+  // can, and otherwise regular pages.
+  Transparent,
+  // Huge pages reserved by the system administrator (e.g. through
+  // /proc/sys/vm/nr_hugepages). Buffers fall back to transparent huge pages
+  // when none are left.
+  Explicit,
+};
+
+// Sets which pages back the large buffers allocated from now on, by the
+// default allocator and by allocateHugePages. The default is the
+// REFBACKRT_HUGE_PAGES environment variable ("none", "transparent" or
+// "explicit") if it is set, and HugePages::None otherwise.
+//
+// Huge pages are only supported on Linux, and are ignored elsewhere.
+void setHugePages(HugePages hugePages);
+
+// Returns which pages back large buffers.
+HugePages getHugePages();
+
+// Allocates a buffer of `size` bytes aligned to kHugePageSize, backed by the
+// pages selected by setHugePages. The buffer must be freed with
+// deallocateHugePages, given the same size. Returns nullptr on failure.
+void *allocateHugePages(std::size_t size);
+void deallocateHugePages(void *ptr, std::size_t size);
+
+// Asks the OS to read ahead the pages of the `size` bytes at `ptr`, which are
+// typically mapped from a file (such as external weights), without waiting
+// for them. Compiled code calls this at the entry of functions compiled with
+// the `prefetch-weights` option, so that their first call doesn't fault the
+// weights in a page at a time. Does nothing where unsupported (Windows).
+void prefetchPages(const void *ptr, std::size_t size);
+
+// Allocates `size` bytes of scratch memory, aligned to kBufferAlignment.
+//
+// Compiled code uses this for intermediate buffers that provably don't
+// outlive the call. While the compiled code runs under `invoke` (or one of its
+// variants), scratch memory is bump-allocated from a per-thread arena that is
+// reset as soon as the compiled code returns, so it must never be passed to
+// `deallocate`. Outside of an invocation, it comes from another per-thread
+// arena, which is reset when the next invocation on the thread returns (and
+// when the thread exits).
+void *allocateScratch(std::size_t size);
+
+//===----------------------------------------------------------------------===//
+// Parallel execution.
+//===----------------------------------------------------------------------===//
+
+// Sets the number of threads (including the invoking thread) that parallel
+// loops in compiled code are spread over. Passing 0 restores the default:
+// the REFBACKRT_NUM_THREADS environment variable if it is set, and the number
+// of hardware threads otherwise. With an Executor set, this sizes the
+// runtime's own thread pool for when the Executor is unset.
+//
+// This must not be called while compiled code is running.
+void setNumThreads(int numThreads);
+
+// Returns the number of threads that parallel loops are spread over: those of
+// the Executor if one is set, and of the runtime's thread pool otherwise.
+int getNumThreads();
+
+// The body of a parallel loop, which runs the iterations [begin, end).
+using ParallelForBody = void (*)(std::int64_t begin, std::int64_t end,
+                                 void *context);
+
+// Runs the iterations [begin, end) of a parallel loop on the runtime's thread
+// pool, in ranges of at least `grainSize` iterations, and returns once all of
+// them are done. Compiled code uses this for its outermost parallel loops.
+//
+// Scratch memory allocated by `body` is only valid until it returns.
+void parallelFor(std::int64_t begin, std::int64_t end, std::int64_t grainSize,
+                 ParallelForBody body, void *context);
+
+// Interface for a thread pool of the embedding application (such as the
+// intra-op pool of a framework sharing the process) that runs the parallel
+// loops of the runtime instead of its own thread pool, so that the process
+// doesn't run a thread per core for each of them.
+//
+// Implementations must be thread-safe, as parallel loops can be started by
+// concurrent requests.
+class Executor {
+public:
+  virtual ~Executor() = default;
+  // The number of threads (including the invoking thread) that parallelFor
+  // spreads loops over.
+  virtual int getNumThreads() const = 0;
+  // Runs the iterations [begin, end) of `body` in ranges of at least
+  // `grainSize` iterations (unless there are fewer), and returns once all of
+  // them are done. Ranges may run on any thread, including the invoking one.
+  virtual void parallelFor(std::int64_t begin, std::int64_t end,
+                           std::int64_t grainSize, ParallelForBody body,
+                           void *context) = 0;
+};
+
+// Sets the executor that runs all subsequent parallel loops, and shuts the
+// runtime's thread pool down. Passing nullptr restores the runtime's thread
+// pool, as configured by setNumThreads and setThreadPinning. The executor
+// must outlive its use, and priorities (see RequestSchedule) are up to it.
+//
+// This must not be called while compiled code is running.
+void setExecutor(Executor *executor);
+
+// Returns the executor set by setExecutor, or nullptr.
+Executor *getExecutor();
+
+// The priority class of a request.
+//
+// When requests run concurrently, the thread pool runs the ranges of
+// iterations of the parallel loops of higher-priority requests first. Workers
+// only pick the next range once they finish the current one, so a
+// higher-priority loop waits for at most one range of each lower-priority
+// loop. Lower-priority loops are split into smaller ranges to keep that wait
+// short.
+enum class Priority : std::int32_t {
+  // Latency-critical requests.
+  High = 0,
+  Normal = 1,
+  // Throughput-oriented requests, such as batch scoring.
+  Low = 2,
+};
+constexpr static int kNumPriorities = 3;
+
+// How the requests invoked by a thread are scheduled.
+struct RequestSchedule {
+  Priority priority = Priority::Normal;
+  // The time (in nanoseconds of std::chrono::steady_clock) by which the
+  // request must start, or 0 if it has no deadline. Executors that queue
+  // requests (such as JITModule::invokeAsync) start the requests of the same
+  // priority in order of their deadlines, and fail the requests that can't
+  // start by their deadline instead of running them.
+  std::int64_t deadlineNanos = 0;
+};
+
+// Returns how the requests invoked by the calling thread are scheduled.
+RequestSchedule getRequestSchedule();
+
+// Sets how the requests invoked by the calling thread are scheduled, for as
+// long as it is in scope.
+class ScopedRequestSchedule {
+public:
+  explicit ScopedRequestSchedule(const RequestSchedule &schedule);
+  ScopedRequestSchedule(const ScopedRequestSchedule &) = delete;
+  ScopedRequestSchedule &operator=(const ScopedRequestSchedule &) = delete;
+  ~ScopedRequestSchedule();
+
+private:
+  RequestSchedule previous;
+};
+
+//===----------------------------------------------------------------------===//
+// NUMA placement.
+//===----------------------------------------------------------------------===//
+
+// How the workers of the thread pool are pinned to CPUs.
+enum class ThreadPinning {
+  // Workers are left to the OS scheduler.
+  None,
+  // Workers fill the CPUs of one NUMA node before moving to the next, which
+  // keeps a small pool on the memory of a single socket.
+  Compact,
+  // Workers are dealt out round-robin across NUMA nodes, which spreads a
+  // large pool over the memory bandwidth of all sockets.
+  Scatter,
+};
+
+// Sets how the workers of the thread pool are pinned, restarting the pool
+// with the same number of threads. The default is the REFBACKRT_PIN_THREADS
+// environment variable ("none", "compact" or "scatter") if it is set, and
+// ThreadPinning::None otherwise.
+//
+// This must not be called while compiled code is running.
+void setThreadPinning(ThreadPinning pinning);
+
+// Returns how the workers of the thread pool are pinned.
+ThreadPinning getThreadPinning();
+
+// Returns the number of NUMA nodes of the machine, which is 1 if it has no
+// NUMA topology or it can't be determined.
+int getNumNumaNodes();
+
+// Where the pages of a buffer are placed.
+enum class NumaMemoryPolicy {
+  // On the NUMA node of the calling thread. Use this for buffers only used by
+  // threads running on that node.
+  Local,
+  // Interleaved across all NUMA nodes. Use this for buffers read by the
+  // threads of all nodes, such as weights, so that reading them is spread
+  // over the memory controllers of all sockets.
+  Interleave,
+};
+
+// Places the pages of the buffer [ptr, ptr + size) according to `policy`,
+// migrating the pages that were already touched. Only the pages entirely
+// within the buffer are affected.
+//
+// Buffers allocated by the default allocator are already local to the thread
+// that first allocated them, so this is mostly useful for weights.
+//
+// Returns failure (and does nothing) on machines without NUMA support.
+LogicalResult setNumaMemoryPolicy(void *ptr, std::size_t size,
+                                  NumaMemoryPolicy policy);
+
 // Base class for any RefCounted object type
+//
+// The reference count is atomic, so Ref's to the same object can be copied and
+// destroyed concurrently from multiple threads (e.g. sharing an input Tensor
+// between concurrent invocations). The object itself is not synchronized.
 class RefTarget {
 protected:
   template <typename T> friend class Ref;
@@ -89,14 +378,18 @@ private:
   static void incref(T *ptr) {
     if (!ptr)
       return;
-    ptr->refCount += 1;
+    // Taking a new reference requires an existing one, so no synchronization
+    // with other threads is needed here.
+    ptr->refCount.fetch_add(1, std::memory_order_relaxed);
   }
 
   friend struct RtValue;
   static void decref(T *ptr) {
     if (!ptr)
       return;
-    if (ptr->refCount.fetch_sub(1) == 1) {
+    // The release/acquire pair makes all uses of the object on other threads
+    // happen before it is destroyed.
+    if (ptr->refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
       ptr->~T();
       std::free(static_cast<void *>(ptr));
     }
@@ -108,6 +401,13 @@ private:
 enum class ElementType : std::int32_t {
   NONE,
   F32,
+  F16,
+  BF16,
+  I8,
+  I32,
+  I64,
+  // Booleans, stored as one byte per element.
+  I1,
 };
 std::int32_t getElementTypeByteSize(ElementType type);
 StringRef getElementTypeAsStringRef(ElementType type);
@@ -121,53 +421,128 @@ public:
 
   // Create a Tensor with the given extents and element type, with a buffer
   // holding a copy of `data`.
-  static Ref<Tensor> create(ArrayRef<std::int32_t> extents,
+  //
+  // Buffers of at most kMaxInlineDataBytes bytes are allocated together with
+  // the Tensor itself, so that small tensors cost a single allocation.
+  // Larger buffers are allocated separately with refbackrt::allocate.
+  static Ref<Tensor> create(ArrayRef<std::int64_t> extents,
                             ElementType elementType, void *data);
   // Same as `create`, but returns a raw pointer.
-  static Tensor *createRaw(ArrayRef<std::int32_t> extents,
+  static Tensor *createRaw(ArrayRef<std::int64_t> extents,
                            ElementType elementType, void *data);
 
-  static Ref<Tensor> create(ArrayRef<std::int64_t> extents,
+  // Convenience overloads of the above for 32-bit extents.
+  static Ref<Tensor> create(ArrayRef<std::int32_t> extents,
                             ElementType elementType, void *data);
-  // Same as `create`, but returns a raw pointer.
-  static Tensor *createRaw(ArrayRef<std::int64_t> extents,
+  static Tensor *createRaw(ArrayRef<std::int32_t> extents,
                            ElementType elementType, void *data);
 
+  // Same as `createRaw`, but leaves the contents of the buffer unspecified.
+  static Tensor *createRawUninitialized(ArrayRef<std::int64_t> extents,
+                                        ElementType elementType);
+
+  // The largest buffer that is allocated together with its Tensor.
+  constexpr static std::int64_t kMaxInlineDataBytes = 16384;
+
+  // Create a Tensor with the given extents and element type that takes
+  // ownership of an existing buffer instead of copying it.
+  // `allocatedPtr` must have been allocated with refbackrt::allocate and will
+  // be deallocated when the Tensor is destroyed. The tensor's data is located
+  // `byteOffset` bytes past `dataPtr`.
+  static Tensor *createRawAdoptingBuffer(ArrayRef<std::int64_t> extents,
+                                         ElementType elementType,
+                                         void *allocatedPtr, void *dataPtr,
+                                         std::int64_t byteOffset);
+  // Same as above, but for a buffer with the given (element) strides.
+  static Tensor *createRawAdoptingBuffer(ArrayRef<std::int64_t> extents,
+                                         ArrayRef<std::int64_t> strides,
+                                         ElementType elementType,
+                                         void *allocatedPtr, void *dataPtr,
+                                         std::int64_t byteOffset);
+
+  // Create a Tensor with the given extents and element type that views the
+  // existing buffer `data` without copying it or taking ownership of it. The
+  // caller must keep `data` alive for as long as the Tensor exists.
+  static Ref<Tensor> createBorrowingBuffer(ArrayRef<std::int64_t> extents,
+                                           ElementType elementType,
+                                           void *data);
+  // Same as above, but for a buffer with the given (element) strides.
+  static Ref<Tensor> createBorrowingBuffer(ArrayRef<std::int64_t> extents,
+                                           ArrayRef<std::int64_t> strides,
+                                           ElementType elementType,
+                                           void *data);
+
+  // Same as `createBorrowingBuffer`, but for a buffer that must never be
+  // written to, such as a constant of a loaded module (see isReadOnly).
+  // Returns a raw pointer.
+  static Tensor *createRawReadOnlyView(ArrayRef<std::int64_t> extents,
+                                       ArrayRef<std::int64_t> strides,
+                                       ElementType elementType, void *dataPtr,
+                                       std::int64_t byteOffset);
+
   ElementType getElementType() const { return elementType; }
   std::int32_t getRank() const { return rank; }
   void *getData() const { return data; }
   template <typename T> T *getData() const { return static_cast<T *>(data); }
-  std::int32_t getExtent(int dimension) const {
+  std::int64_t getExtent(int dimension) const {
     return getExtents()[dimension];
   }
-  ArrayRef<std::int32_t> getExtents() const {
+  ArrayRef<std::int64_t> getExtents() const {
     auto extents = const_cast<Tensor *>(this)->getMutableExtents();
-    return ArrayRef<std::int32_t>(extents.data(), extents.size());
+    return ArrayRef<std::int64_t>(extents.data(), extents.size());
+  }
+  // The distance, in elements, between consecutive indices of each dimension.
+  // Tensors that own a buffer allocated by the runtime are always contiguous,
+  // but those adopting or borrowing a buffer can have arbitrary strides.
+  ArrayRef<std::int64_t> getStrides() const {
+    auto strides = const_cast<Tensor *>(this)->getMutableStrides();
+    return ArrayRef<std::int64_t>(strides.data(), strides.size());
   }
+  // Returns true if the tensor has the dense row-major layout.
+  bool isContiguous() const;
+  // Returns true if the buffer of the tensor must not be written to. Such
+  // tensors view memory of a loaded module, and are only valid as long as
+  // the module is loaded.
+  bool isReadOnly() const { return readOnly; }
   // Returns the number of bytes occupied by the data representing this tensor.
   // The total allocated amount might be higher to allow e.g. for alignment
   // nudging.
-  std::int32_t getDataByteSize() const;
-  ~Tensor() { std::free(allocatedPtr); }
+  std::int64_t getDataByteSize() const;
+  ~Tensor() { deallocate(allocatedPtr); }
 
 private:
-  MutableArrayRef<std::int32_t> getMutableExtents() {
-    auto *tail = reinterpret_cast<std::int32_t *>(this + 1);
-    return MutableArrayRef<std::int32_t>(tail, rank);
+  MutableArrayRef<std::int64_t> getMutableExtents() {
+    auto *tail = reinterpret_cast<std::int64_t *>(this + 1);
+    return MutableArrayRef<std::int64_t>(tail, rank);
+  }
+  MutableArrayRef<std::int64_t> getMutableStrides() {
+    auto *tail = reinterpret_cast<std::int64_t *>(this + 1);
+    return MutableArrayRef<std::int64_t>(tail + rank, rank);
   }
 
+  // Allocates a Tensor (but not its buffer) with the given extents and dense
+  // row-major strides, followed by `inlineDataBytes` bytes of buffer aligned
+  // to kBufferAlignment.
+  static Tensor *allocateTensor(ArrayRef<std::int64_t> extents,
+                                ElementType elementType,
+                                std::int64_t inlineDataBytes = 0);
+
   ElementType elementType;
   // The number of dimensions of this Tensor.
-  // There are `rank` tail-allocated std::int32_t values representing the
-  // tensor extents.
+  // There are `rank` tail-allocated std::int64_t values representing the
+  // tensor extents, followed by `rank` values representing the strides.
   std::int32_t rank;
   // The buffer base.
   void *data;
-  // The raw pointer returned by the allocator (currently assumed to be
-  // malloc), suitable for freeing the buffer.
+  // The raw pointer returned by refbackrt::allocate, suitable for freeing the
+  // buffer. Null if the buffer isn't owned, or is allocated inline after the
+  // sizes and strides.
   void *allocatedPtr;
+  // Whether the buffer must not be written to.
+  bool readOnly;
 
-  // Sizes are tail-allocated.
+  // Sizes and strides are tail-allocated, followed by the inline buffer if
+  // there is one.
 };
 
 // RtValue is a generic tagged union used to hold all value types
@@ -190,6 +565,7 @@ private:
 struct RtValue final {
 
   RtValue() : payload{0}, tag(Tag::None) {}
+  bool isNone() const { return Tag::None == tag; }
 
   // Bool
   RtValue(bool b) : tag(Tag::Bool) { payload.asBool = b; }
@@ -233,6 +609,22 @@ struct RtValue final {
     assert(isTensor());
     return Ref<Tensor>(reinterpret_cast<Tensor *>(payload.asVoidPtr));
   }
+  // Returns the tensor without taking a reference to it (which costs an
+  // atomic increment and decrement): it is only valid as long as the RtValue
+  // holds it.
+  Tensor *getTensor() const {
+    assert(isTensor());
+    return reinterpret_cast<Tensor *>(payload.asVoidPtr);
+  }
+  // Moves the reference to the tensor out of the RtValue, which becomes None.
+  Ref<Tensor> takeTensor() {
+    assert(isTensor());
+    Ref<Tensor> tensor;
+    tensor.ptr = reinterpret_cast<Tensor *>(payload.asVoidPtr);
+    payload.asVoidPtr = nullptr;
+    tag = Tag::None;
+    return tensor;
+  }
 
   // Ref
   bool isRef() const {
@@ -342,19 +734,27 @@ enum class ArgType : std::uint32_t {
   kTensor,
   kF32,
   kF64,
+  kI32,
+  kI64,
+  kI1,
 };
 StringRef getArgTypeAsStringRef(ArgType type);
 
-// Maximum rank supported across the ABI boundary
-constexpr static int kMaxRank = 6;
+// The ranks and arities up to which the metadata of a function and the
+// arguments of an invocation are stored inline, without allocating. Larger
+// ones are supported, but allocate.
+constexpr static int kInlineRank = 6;
+constexpr static int kInlineArity = 8;
 
 struct InputArgInfo {
   // What type of argument this is
   ArgType argType;
   // Certain arg types also have an element type
   ElementType elementType;
+  // The rank of tensors, or -1 if unranked.
   std::int32_t rank;
-  std::array<std::int32_t, kMaxRank> extents;
+  // The extents of ranked tensors, with -1 for dynamic extents.
+  SmallVector<std::int64_t, kInlineRank> extents;
 };
 
 struct OutputArgInfo {
@@ -362,28 +762,98 @@ struct OutputArgInfo {
   ArgType argType;
   // Certain arg types also have an element type
   ElementType elementType;
+  // The rank of tensors, or -1 if unranked.
   std::int32_t rank;
-  std::array<std::int32_t, kMaxRank> extents;
+  // The extents of ranked tensors, with -1 for dynamic extents.
+  SmallVector<std::int64_t, kInlineRank> extents;
+  // True if the output is always a constant of the module, which the runtime
+  // returns as a read-only Tensor viewing the module's memory instead of
+  // copying it (see Tensor::isReadOnly).
+  bool isReadOnly;
   // TODO(brycearden): Add checks for whether output buffers alias to input
   // buffers and populate field(s) here indicating that case
 };
 
-// Maximum input or output arity.
-constexpr static int kMaxArity = 20;
-
 // Metadata for a particular function.
 struct FunctionMetadata {
   std::int32_t numInputs;
   std::int32_t numOutputs;
+  // Upper bound on the scratch memory (see allocateScratch) that one
+  // invocation needs, or -1 if the compiler couldn't determine it. This is
+  // the estimated peak memory of the intermediate results of the function.
+  std::int64_t peakScratchBytes;
+  // Bytes of the constants (and external weights) of the module that the
+  // function uses. Functions of a module can share constants.
+  std::int64_t constantBytes;
+  // Total bytes of the inputs and outputs, or -1 if some of them don't have a
+  // static size.
+  std::int64_t inputBytes;
+  std::int64_t outputBytes;
 
-  std::array<InputArgInfo, kMaxArity> inputArgInfos;
-  std::array<OutputArgInfo, kMaxArity> outputArgInfos;
+  // `numInputs` and `numOutputs` elements.
+  SmallVector<InputArgInfo, kInlineArity> inputArgInfos;
+  SmallVector<OutputArgInfo, kInlineArity> outputArgInfos;
 };
 
 // Opaque forward declaration of module descriptor type. This is the type
 // created by the compiler in the module binary.
 struct ModuleDescriptor;
 
+// Opaque forward declaration of the per-function descriptor type, which lives
+// inside a ModuleDescriptor.
+struct FuncDescriptor;
+
+// A function of a module that has already been looked up by name.
+//
+// Callers that invoke the same function many times should look it up once with
+// `lookupFunction` and use the FunctionHandle overloads below, which skip the
+// name lookup. A FunctionHandle is valid as long as its module is loaded.
+class FunctionHandle {
+public:
+  FunctionHandle() = default;
+  explicit FunctionHandle(FuncDescriptor *descriptor)
+      : descriptor(descriptor) {}
+  // Returns true if this refers to a function (i.e. the lookup succeeded).
+  explicit operator bool() const { return descriptor != nullptr; }
+  FuncDescriptor *getDescriptor() const { return descriptor; }
+
+private:
+  FuncDescriptor *descriptor = nullptr;
+};
+
+// Looks up function `functionName` in the module.
+//
+// Returns a null FunctionHandle if functionName wasn't found.
+FunctionHandle lookupFunction(ModuleDescriptor *moduleDescriptor,
+                              StringRef functionName);
+
+// Returns the name of the function referred to by a (non-null) `function`.
+StringRef getFunctionName(FunctionHandle function);
+
+// Returns the number of functions of the module, including the
+// specializations of other functions (see `selectFunction`).
+std::int32_t getNumFunctions(ModuleDescriptor *moduleDescriptor);
+
+// Returns the function at `index` (less than `getNumFunctions`) of the
+// module. The functions are in order of name.
+FunctionHandle getFunction(ModuleDescriptor *moduleDescriptor,
+                           std::int32_t index);
+
+// Looks up the function to call for function `functionName` with `inputs`.
+//
+// A module can contain specializations of a function for particular input
+// types and shapes, such as fully static shapes for common batch sizes, which
+// are named `functionName$<suffix>` (e.g. `forward$0`). Of the specializations
+// and the function itself, this returns the one with the most static input
+// extents that `inputs` are valid inputs of. If none of them is, returns the
+// function itself (which is null if the module has no function named
+// `functionName`).
+//
+// The entry points taking a function name call the function selected by this.
+FunctionHandle selectFunction(ModuleDescriptor *moduleDescriptor,
+                              StringRef functionName,
+                              ArrayRef<RtValue> inputs);
+
 // Verifies that the input RtValue arg types match what the user provides
 // matches the types we expect from the descriptors emitted by the
 // compiler.
@@ -400,14 +870,130 @@ LogicalResult checkRtValueArgTypes(const RtValue &value,
 LogicalResult checkRtValueShapes(const RtValue &value,
                                  const InputArgInfo &info);
 
+// Same as the InputArgInfo overloads above, but for checking caller-provided
+// output buffers passed to `invokeInto`.
+LogicalResult checkRtValueArgTypes(const RtValue &value,
+                                   const OutputArgInfo &info);
+LogicalResult checkRtValueShapes(const RtValue &value,
+                                 const OutputArgInfo &info);
+
 // Creates an RtValue of the right type from the output metadata
-// provided by the compiled module
+// provided by the compiled module, suitable as an output of `invokeInto`.
+// Tensors with dynamic extents, whose shape is only known once the compiled
+// code computed them, are left as None (see `invokeInto`).
 RtValue createRtValueFromOutputArgInfo(const OutputArgInfo &info);
 
+// Creates a zero-filled input of the type and shape of `info` (zero for
+// scalars), such as for calling a function just to warm it up. Returns None
+// for unranked tensors and tensors with dynamic extents.
+RtValue createRtValueFromInputArgInfo(const InputArgInfo &info);
+
 // Low-level invocation API. The number of inputs and outputs should be correct
 // and match the results of getMetadata.
-void invoke(ModuleDescriptor *moduleDescriptor, StringRef functionName,
-            ArrayRef<RtValue> inputs, MutableArrayRef<RtValue> outputs);
+//
+// All of the invocation entry points are reentrant: a module's functions can
+// be invoked concurrently from any number of threads without external
+// locking, including with the same input Tensor's, since inputs are never
+// written to. Each call must have its own `outputs`.
+//
+// `outputs` are replaced with the results, whatever they held before (they
+// can be default-constructed). Scalars are passed by value in the
+// representation of the compiled code, without going through RtValue's.
+// Outputs that are constants of the module (see OutputArgInfo::isReadOnly)
+// are returned as read-only Tensor's viewing the module's memory.
+//
+// Returns failure if a runtime check of the compiled code fails (such as a
+// check that the extents of the inputs are compatible), in which case the
+// outputs are left unchanged. `*errorMessage` (if non-null) is then set to the
+// message of the check, which lives as long as the module.
+LogicalResult invoke(ModuleDescriptor *moduleDescriptor,
+                     StringRef functionName, ArrayRef<RtValue> inputs,
+                     MutableArrayRef<RtValue> outputs,
+                     const char **errorMessage = nullptr);
+LogicalResult invoke(FunctionHandle function, ArrayRef<RtValue> inputs,
+                     MutableArrayRef<RtValue> outputs,
+                     const char **errorMessage = nullptr);
+
+// Invokes `function` `batchSize` times. `inputs` holds `batchSize` consecutive
+// groups of the function's inputs, and `outputs` the corresponding groups of
+// its outputs, each of which is treated as with `invoke`.
+//
+// This amortizes the per-call setup of the ABI boundary across the batch.
+//
+// Stops at the first call that fails, which is reported as with `invoke`.
+LogicalResult invokeBatch(FunctionHandle function, std::int32_t batchSize,
+                          ArrayRef<RtValue> inputs,
+                          MutableArrayRef<RtValue> outputs,
+                          const char **errorMessage = nullptr);
+
+// Same as `invoke`, but tensor results are written into the buffers of the
+// caller-owned Tensor's already present in `outputs`, instead of `outputs`
+// being replaced with newly created Tensor's. Scalar outputs are overwritten as
+// with `invoke`, and so are tensor outputs left as None, which get the buffer
+// allocated by the compiled code, of exactly the size of the result.
+//
+// Returns failure if a runtime check fails as with `invoke`, or if the
+// extents of a result don't match the extents of the corresponding
+// caller-provided Tensor, or that Tensor is read-only (the contents of that
+// Tensor are left unchanged in that case). The failure is described in
+// `*errorMessage` as with `invoke`.
+LogicalResult invokeInto(ModuleDescriptor *moduleDescriptor,
+                         StringRef functionName, ArrayRef<RtValue> inputs,
+                         MutableArrayRef<RtValue> outputs,
+                         const char **errorMessage = nullptr);
+LogicalResult invokeInto(FunctionHandle function, ArrayRef<RtValue> inputs,
+                         MutableArrayRef<RtValue> outputs,
+                         const char **errorMessage = nullptr);
+
+// A call of a function with bound inputs and outputs, captured once so that
+// request loops of a fixed signature can replay it at close to the cost of
+// calling the compiled code directly.
+//
+// Capturing does the per-call setup of `invokeInto` up front: the inputs are
+// packed into memref descriptors that live as long as the CapturedCall, and
+// the outputs are bound. Each replay is then a single call into the ABI
+// wrapper of the function with the already packed arguments, followed by
+// setting the outputs from its results. Input buffers that the compiled code
+// may write to (or that don't have the dense layout and alignment it assumes)
+// are still copied by each replay, as with `invoke`.
+//
+// The input Tensor's are bound by reference: each replay reads their contents
+// at the time of the replay, so a request loop refills them in place between
+// replays. Scalar inputs are bound by value when the call is captured.
+//
+// Tensor results are written into the Tensor's bound as outputs, as with
+// `invokeInto`. Outputs bound as None (as the constants of the module must
+// be, see OutputArgInfo::isReadOnly) are replaced with new Tensor's by each
+// replay, and scalar outputs are overwritten.
+//
+// A CapturedCall is valid as long as the module of its function, and must
+// only be replayed by one thread at a time.
+class CapturedCall {
+public:
+  CapturedCall();
+  CapturedCall(CapturedCall &&other);
+  CapturedCall &operator=(CapturedCall &&other);
+  ~CapturedCall();
+
+  // Captures a call of `function`. The number of inputs and outputs should be
+  // correct and match the results of getMetadata, and the inputs should be
+  // accepted by the function (see checkRtValueArgTypes and
+  // checkRtValueShapes).
+  static CapturedCall capture(FunctionHandle function,
+                              ArrayRef<RtValue> inputs,
+                              ArrayRef<RtValue> outputs);
+
+  // Calls the function on the current contents of the inputs. Failures are
+  // reported as with `invokeInto`.
+  LogicalResult replay(const char **errorMessage = nullptr);
+
+  // The outputs, as set by the last replay.
+  ArrayRef<RtValue> getOutputs() const;
+
+private:
+  struct State;
+  std::unique_ptr<State> state;
+};
 
 // Metadata for function `functionName`.
 //
@@ -415,6 +1001,280 @@ void invoke(ModuleDescriptor *moduleDescriptor, StringRef functionName,
 LogicalResult getMetadata(ModuleDescriptor *moduleDescriptor,
                           StringRef functionName,
                           FunctionMetadata &outMetadata);
+void getMetadata(FunctionHandle function, FunctionMetadata &outMetadata);
+
+// Returns the entry point of `function` with the direct-call ABI, or null if
+// the compiler didn't emit one.
+//
+// The compiler emits it for functions whose inputs and outputs all have static
+// shapes (or are scalars), whose tensor inputs are never written to, and whose
+// tensor outputs are computed into fresh buffers. It is a C function returning
+// void that takes, in order:
+// - for each input, a pointer to the contiguous (row-major) elements of the
+//   tensor, or the scalar by value;
+// - for each output, a pointer to a caller-allocated buffer for the contiguous
+//   elements of the tensor, or to the scalar.
+// For example, a function from a 2x3 f32 tensor and an f32 scalar to a 4 f32
+// tensor has the entry point `void(float *input, float scalar, float *output)`.
+//
+// Calls through the entry point bypass the runtime entirely: nothing is
+// copied, checked or instrumented, and the caller is responsible for passing
+// buffers of the extents given by getMetadata. The buffers need not be
+// aligned.
+void *getDirectEntryPoint(FunctionHandle function);
+
+//===----------------------------------------------------------------------===//
+// Streaming execution.
+//===----------------------------------------------------------------------===//
+
+// Streaming execution runs a function over tensors stored in files, which may
+// be larger than memory, one chunk of their leading dimension at a time.
+// Chunks are read into (and results written from) two sets of buffers used in
+// turn: while the function runs on a chunk, the next chunk of the inputs is
+// read and the results of the previous chunk are written on other threads.
+// So at most two chunks of each tensor are in memory at a time.
+
+// A tensor stored in a file as its contiguous (row-major) elements, starting
+// `byteOffset` bytes into the file.
+struct FileTensor {
+  const char *path = nullptr;
+  std::int64_t byteOffset = 0;
+  ElementType elementType = ElementType::F32;
+  SmallVector<std::int64_t, kInlineRank> extents;
+};
+
+// The size of the chunks of the streamed inputs when StreamOptions::chunkRows
+// is 0.
+constexpr static std::int64_t kDefaultStreamChunkBytes = 64 << 20;
+
+struct StreamOptions {
+  // The number of indices of the leading dimension in each chunk, or 0 to
+  // use chunks of about kDefaultStreamChunkBytes of streamed inputs.
+  std::int64_t chunkRows = 0;
+};
+
+// Runs `function` on each chunk of `streamedInputs`, which all have the same
+// leading extent, followed by `extraInputs`, which are passed whole with each
+// chunk (e.g. weights). Its results on each chunk are written at the same
+// rows of the files `outputs`, whose leading extent must also be that of
+// `streamedInputs`. So each row of the results must only depend on the same
+// row of the streamed inputs, as with elementwise ops or reductions of the
+// other dimensions. Output files are created if they don't exist, and are
+// truncated after the output (but keep the bytes before `byteOffset`). An
+// output may be one of the streamed inputs, at the same offset, to update it
+// in place.
+//
+// Returns failure if a file can't be read or written, or `function` doesn't
+// accept the inputs or returns results of other types or extents than
+// `outputs`. `*errorMessage` (if non-null) is then set to a description of the
+// error, valid until the next streaming call on this thread.
+LogicalResult streamMap(FunctionHandle function,
+                        ArrayRef<FileTensor> streamedInputs,
+                        ArrayRef<RtValue> extraInputs,
+                        ArrayRef<FileTensor> outputs,
+                        const StreamOptions &options = StreamOptions(),
+                        const char **errorMessage = nullptr);
+
+// Folds `function` over the chunks of `streamedInputs`: `function` takes the
+// current `accumulators`, the inputs of a chunk and `extraInputs`, and returns
+// the new accumulators (e.g. a running sum plus the sum of the chunk along
+// the leading dimension). `accumulators` must hold the initial values, and are
+// replaced with the final ones.
+//
+// Errors are reported as with `streamMap`.
+LogicalResult streamReduce(FunctionHandle function,
+                           ArrayRef<FileTensor> streamedInputs,
+                           ArrayRef<RtValue> extraInputs,
+                           MutableArrayRef<RtValue> accumulators,
+                           const StreamOptions &options = StreamOptions(),
+                           const char **errorMessage = nullptr);
+
+//===----------------------------------------------------------------------===//
+// Instrumentation.
+//===----------------------------------------------------------------------===//
+
+// Building with NPCOMP_REFBACKRT_ENABLE_INSTRUMENTATION=0 compiles the
+// instrumentation of the invocation entry points (and the per-op profile) out
+// entirely. The functions below still exist then, but never record anything.
+#ifndef NPCOMP_REFBACKRT_ENABLE_INSTRUMENTATION
+#define NPCOMP_REFBACKRT_ENABLE_INSTRUMENTATION 1
+#endif
+
+// The number of buckets of FunctionStats::latencyHistogram. Bucket 0 counts
+// calls that took less than 1 microsecond, bucket i > 0 calls that took
+// [2^(i-1), 2^i) microseconds, and the last bucket also counts all slower
+// calls.
+constexpr static int kNumLatencyBuckets = 32;
+
+// Counters of the invocations of one function, as seen at the ABI boundary.
+// Every invocation entry point counts each call it makes, including each call
+// of a batch.
+struct FunctionStats {
+  std::int64_t numCalls = 0;
+  // Total latency of the calls, including the copies across the ABI.
+  std::int64_t totalNanoseconds = 0;
+  std::array<std::int64_t, kNumLatencyBuckets> latencyHistogram = {};
+  // Bytes of input tensors copied into buffers for the compiled code (inputs
+  // that can't be passed zero-copy).
+  std::int64_t bytesCopiedIn = 0;
+  // Bytes of results copied out of the compiled code's buffers (results that
+  // aren't adopted by the output Tensor's, such as with `invokeInto`).
+  std::int64_t bytesCopiedOut = 0;
+};
+
+// Callbacks run by the invocation entry points around each call, e.g. to
+// feed a tracing system. Null callbacks are skipped.
+struct InvokeCallbacks {
+  // Called before the inputs of a call of `function` are prepared.
+  void (*onEnter)(FunctionHandle function, void *userData) = nullptr;
+  // Called once a call of `function` is complete, with its latency.
+  void (*onExit)(FunctionHandle function, std::int64_t nanoseconds,
+                 void *userData) = nullptr;
+  void *userData = nullptr;
+};
+
+// Enables or disables instrumentation, which is disabled by default. While
+// disabled, each call pays only for checking this flag.
+void setInstrumentationEnabled(bool enabled);
+bool isInstrumentationEnabled();
+
+// Sets the callbacks run around each call while instrumentation is enabled.
+//
+// This must not be called while compiled code is running.
+void setInvokeCallbacks(const InvokeCallbacks &callbacks);
+
+// Returns the counters of the calls of `function` made while instrumentation
+// was enabled since the last `resetFunctionStats`. Up to
+// kMaxInstrumentedFunctions distinct functions are counted per process;
+// calls of any further functions aren't.
+constexpr static int kMaxInstrumentedFunctions = 1024;
+FunctionStats getFunctionStats(FunctionHandle function);
+
+// Resets the counters of all functions to zero.
+void resetFunctionStats();
+
+// Per-op profiling.
+//
+// Code compiled with the `profile-ops` option of the RefBackend lowering
+// pipeline times each of its top-level ops (see refback-insert-op-profiling),
+// whether or not instrumentation is enabled. Each execution of a profiled op
+// is counted in the per-op profile, and also recorded as an event (up to
+// kMaxOpProfileEvents of them) for writeOpProfileAsChromeTrace.
+
+// The executions of one profiled op.
+struct OpProfileEntry {
+  // The name given by the compiler, such as "linalg.matmul at model.py:3:8",
+  // followed by " in <scope>" (e.g. the nn.Module method the op comes from)
+  // when known.
+  // It is owned by the compiled module, so is only valid while it is loaded.
+  const char *name = nullptr;
+  std::int64_t numCalls = 0;
+  std::int64_t totalNanoseconds = 0;
+};
+
+constexpr static int kMaxProfiledOps = 4096;
+constexpr static int kMaxOpProfileEvents = 1 << 18;
+
+// Stores the entries of up to `maxEntries` profiled ops into `entries`, and
+// returns the number of ops profiled since the last `resetOpProfile`, which
+// may be larger.
+int getOpProfile(OpProfileEntry *entries, int maxEntries);
+
+// Writes the events recorded since the last `resetOpProfile` to `path` as a
+// Chrome trace (viewable in chrome://tracing or Perfetto), with one track per
+// thread. Returns false if the file couldn't be written.
+//
+// Neither this nor `resetOpProfile` may be called while compiled code is
+// running.
+bool writeOpProfileAsChromeTrace(const char *path);
+
+void resetOpProfile();
+
+// The timers that profiled compiled code calls around each profiled op.
+// `beginProfiledOp` returns the start time to pass to `endProfiledOp`.
+std::int64_t beginProfiledOp();
+void endProfiledOp(const char *name, std::int64_t start);
+
+// Memory profiling.
+//
+// While memory profiling is enabled, every allocation and free made through
+// refbackrt::allocate/deallocate, by the runtime or by compiled code through
+// the compiler runtime, is recorded as an event (up to kMaxMemoryEvents of
+// them), along with the begin and end of each call of the invocation entry
+// points. Code compiled with the `profile-ops` option attributes each of its
+// allocations and frees to the location of the op making it; the others are
+// attributed to "compiled code" or "runtime".
+//
+// Recording an event takes a lock, so memory profiling is meant for
+// diagnosing which layer drives the peak memory use, not for production.
+
+enum class MemoryEventKind : std::uint8_t {
+  Allocate,
+  Free,
+  CallBegin,
+  CallEnd
+};
+
+struct MemoryEvent {
+  MemoryEventKind kind = MemoryEventKind::Allocate;
+  // Where the allocation or free was made, such as "model.py:3:8 in forward"
+  // for profiled compiled code. Null for the begin and end of calls.
+  // Sites named by compiled code are owned by the compiled module, so are
+  // only valid while it is loaded.
+  const char *site = nullptr;
+  // The call of an invocation entry point that the event happened in, on the
+  // same thread, if any.
+  FunctionHandle function;
+  // The bytes allocated or freed.
+  std::int64_t bytes = 0;
+  // The bytes allocated since memory profiling was enabled (or reset) and not
+  // freed yet, after the event.
+  std::int64_t liveBytes = 0;
+  // The time of the event, in nanoseconds of a monotonic clock.
+  std::int64_t nanoseconds = 0;
+  std::uint32_t thread = 0;
+};
+
+constexpr static int kMaxMemoryEvents = 1 << 20;
+
+// Enables or disables memory profiling, which is disabled by default. While
+// disabled, each allocation, free and call pays only for checking this flag.
+void setMemoryProfilingEnabled(bool enabled);
+bool isMemoryProfilingEnabled();
+
+// Stores up to `maxEvents` of the events recorded since the last
+// `resetMemoryProfile` into `events`, in order, and returns the number of
+// events recorded, which may be larger.
+std::int64_t getMemoryProfile(MemoryEvent *events, std::int64_t maxEvents);
+
+// Writes the events recorded since the last `resetMemoryProfile` to `path`
+// as a Chrome trace, with the live bytes as a counter, the calls as spans and
+// the allocations and frees as instant events on the track of their thread.
+// Returns false if the file couldn't be written.
+//
+// Neither this nor `resetMemoryProfile` may be called while compiled code is
+// running.
+bool writeMemoryProfileAsChromeTrace(const char *path);
+
+// Discards the recorded events, and stops tracking the buffers that are live.
+void resetMemoryProfile();
+
+//===----------------------------------------------------------------------===//
+// Loading ahead-of-time compiled modules.
+//===----------------------------------------------------------------------===//
+
+// Loads the shared object at `path`, as produced by `npcomp-compile`, and
+// returns its module descriptor, ready for `invoke`. The compiled code is
+// bound to this runtime, so it uses its allocator and thread pool.
+//
+// The shared object stays loaded for the lifetime of the process, as do the
+// read-only mappings of the files of its external weights if it was compiled
+// with `-external-weights`, and the decompressed copies of its weights if it
+// was compiled with `-compress-weights`. Returns null if it couldn't be
+// loaded, in which case `*errorMessage` (if non-null) is set to a description
+// of the error, valid until the next call.
+ModuleDescriptor *loadModule(const char *path,
+                             const char **errorMessage = nullptr);
 
 } // namespace refbackrt
 
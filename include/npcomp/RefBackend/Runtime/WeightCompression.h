@@ -0,0 +1,66 @@
+//===------------------------------------------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// The codec of the weights that `npcomp-compile -compress-weights` embeds
+// compressed into shared objects, and that refbackrt::loadModule decompresses.
+//
+// Weights are split into blocks of kWeightBlockSize bytes, compressed
+// independently so that they can be decompressed in parallel. Within a block,
+// the bytes of the elements are regrouped by position into byte planes (the
+// first byte of every element, then the second, ...): the planes holding the
+// sign, exponent and high mantissa bits of floats, or the high bytes of
+// integers, are much more repetitive than the interleaved elements. Each
+// plane is then run-length encoded, or stored as is when that doesn't make it
+// smaller, so that pruned (zero) and quantized weights shrink the most.
+//
+// This is shared by the compiler and the runtime, so it has no dependencies.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef NPCOMP_RUNTIME_WEIGHTCOMPRESSION_H
+#define NPCOMP_RUNTIME_WEIGHTCOMPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace refbackrt {
+
+// The number of bytes of weights compressed into each block (rounded down to
+// a multiple of the element size).
+constexpr std::size_t kWeightBlockSize = 1 << 20;
+
+// Appends to `compressed` the compressed form of the `size` bytes of weights
+// at `data`, whose elements are `elementBytes` bytes each.
+void compressWeights(const void *data, std::size_t size,
+                     std::size_t elementBytes, std::vector<char> &compressed);
+
+// A block of compressed weights, which decompresses to the `size` bytes at
+// `output`.
+struct CompressedWeightsBlock {
+  const char *data;
+  std::size_t compressedSize;
+  char *output;
+  std::size_t size;
+};
+
+// Appends to `blocks` the blocks of the `compressedSize` bytes at
+// `compressed`, produced by compressWeights, which decompress into the `size`
+// bytes at `output`. Returns false if `compressed` is malformed or doesn't
+// decompress to `size` bytes.
+bool getCompressedWeightsBlocks(const void *compressed,
+                                std::size_t compressedSize, void *output,
+                                std::size_t size,
+                                std::vector<CompressedWeightsBlock> &blocks);
+
+// Decompresses `block`. Returns false if it is malformed.
+bool decompressWeightsBlock(const CompressedWeightsBlock &block);
+
+} // namespace refbackrt
+
+#endif // NPCOMP_RUNTIME_WEIGHTCOMPRESSION_H
@@ -0,0 +1,67 @@
+//===------------------------------------------------------------*- C++ -*-===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef NPCOMP_REFBACKEND_SHAPEEQUIVALENCE_H
+#define NPCOMP_REFBACKEND_SHAPEEQUIVALENCE_H
+
+#include "mlir/IR/Operation.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/EquivalenceClasses.h"
+
+namespace mlir {
+namespace NPCOMP {
+
+/// Proves that dynamic sizes are equal, by giving the sizes that are
+/// derived from each other (e.g. from the same function argument) the same
+/// symbol.
+///
+/// The sizes tracked are the dimensions of tensors and memrefs, the elements
+/// of extent tensors and index values. Two sizes have the same symbol if
+/// - they are the same static size,
+/// - one is computed from the other (`memref.dim`, `shape.shape_of`,
+///   `tensor.extract`, ...) or is the size an op is created with
+///   (`memref.alloc`, `linalg.init_tensor`, `tcp.broadcast_to`, ...),
+/// - an op requires them to be equal (the operand dimensions mapped to the
+///   same loop of a `linalg` op, the operands of elementwise ops, ...), which
+///   is assumed to hold for the ops to be well-defined,
+/// - or they are both the `shape.broadcast` of sizes with the same symbols
+///   (ignoring sizes of 1).
+///
+/// The analysis is a snapshot of the IR it was built on: it must be rebuilt
+/// after the IR changes.
+class ShapeEquivalence {
+public:
+  explicit ShapeEquivalence(Operation *root);
+
+  /// Returns true if dimension `lhsDim` of the shaped value `lhs` is known to
+  /// have the same size as dimension `rhsDim` of `rhs`.
+  bool areDimsEqual(Value lhs, int64_t lhsDim, Value rhs, int64_t rhsDim);
+
+  /// Returns true if the ranked shaped values `lhs` and `rhs` are known to
+  /// have the same shape.
+  bool haveSameShape(Value lhs, Value rhs);
+
+private:
+  // A size, as a value and a position (see getDimKey and friends).
+  using Key = std::pair<Value, int64_t>;
+
+  void visit(Operation *op);
+  bool visitBroadcast(Operation *op);
+
+  bool unify(Key lhs, Key rhs);
+  bool isEqual(Key lhs, Key rhs);
+  Optional<int64_t> getExtentTensorLength(Value shape);
+
+  DenseMap<Key, unsigned> ids;
+  llvm::EquivalenceClasses<unsigned> classes;
+};
+
+} // namespace NPCOMP
+} // namespace mlir
+
+#endif // NPCOMP_REFBACKEND_SHAPEEQUIVALENCE_H
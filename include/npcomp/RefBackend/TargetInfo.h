@@ -0,0 +1,60 @@
+//===------------------------------------------------------------*- C++ -*-===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef NPCOMP_REFBACKEND_TARGETINFO_H
+#define NPCOMP_REFBACKEND_TARGETINFO_H
+
+#include "mlir/Support/LLVM.h"
+#include "llvm/ADT/StringMap.h"
+
+#include <string>
+#include <vector>
+
+namespace mlir {
+namespace NPCOMP {
+
+/// The properties of the CPU that the compiled code runs on that the
+/// RefBackend lowering pipeline sizes its tiles, vectors, microkernels and
+/// parallel loops for.
+struct TargetInfo {
+  /// The width in bits of the widest vector registers, and their number.
+  unsigned vectorWidth = 128;
+  unsigned numVectorRegisters = 16;
+  /// The sizes in bytes of the L1 data cache and of the L2 cache of a core.
+  int64_t l1CacheSize = 32 * 1024;
+  int64_t l2CacheSize = 1024 * 1024;
+  /// The number of cores that parallel loops can be distributed across, or
+  /// 0 if it isn't known.
+  unsigned numCores = 0;
+  /// The ISA extensions of the CPU, as the names of LLVM target features
+  /// (e.g. "avx2", "avx512f" or "neon"), sorted.
+  std::vector<std::string> features;
+
+  bool hasFeature(StringRef feature) const;
+
+  /// Whether the CPU has fused multiply-add instructions, which all AArch64
+  /// CPUs do, but only x86 CPUs with the FMA (or AVX-512) extension.
+  bool hasFMA() const;
+
+  /// The number of f32 elements in a vector register.
+  unsigned getNumF32Lanes() const { return vectorWidth / 32; }
+};
+
+/// Returns the TargetInfo of a CPU with the LLVM target `features` that are
+/// mapped to true, with the default cache sizes and an unknown number of
+/// cores.
+TargetInfo getTargetInfo(const llvm::StringMap<bool> &features);
+
+/// Returns the TargetInfo of the host CPU, with the cache sizes and number of
+/// cores of the host where they can be detected.
+TargetInfo getHostTargetInfo();
+
+} // namespace NPCOMP
+} // namespace mlir
+
+#endif // NPCOMP_REFBACKEND_TARGETINFO_H
@@ -0,0 +1,98 @@
+//===------------------------------------------------------------*- C++ -*-===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef NPCOMP_REFBACKEND_TUNING_H
+#define NPCOMP_REFBACKEND_TUNING_H
+
+#include "mlir/IR/Operation.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Error.h"
+
+#include <string>
+
+namespace mlir {
+namespace NPCOMP {
+
+/// How the RefBackend pipeline lowers one matmul or convolution, overriding
+/// its heuristics for that op. Empty fields keep the heuristics.
+struct TuningConfig {
+  /// For convolutions, the algorithm of createLowerConvolutionsPass:
+  /// "direct", "im2col" or "winograd".
+  std::string convStrategy;
+  /// The tile sizes of createTileLinalgOpsPass, for the loops of the op or,
+  /// for convolutions computed as matmuls, for the loops of the matmul.
+  SmallVector<int64_t, 4> l2TileSizes;
+  SmallVector<int64_t, 4> l1TileSizes;
+
+  bool operator==(const TuningConfig &other) const {
+    return convStrategy == other.convStrategy &&
+           l2TileSizes == other.l2TileSizes &&
+           l1TileSizes == other.l1TileSizes;
+  }
+};
+
+/// The attribute holding the TuningConfig of an op, as a dictionary with
+/// optional `conv_strategy`, `l2_tile_sizes` and `l1_tile_sizes` entries.
+constexpr StringLiteral kTuningAttrName = "refback.tuning";
+
+/// Returns true if `op` is a matmul, batch matmul or convolution on f32
+/// tensors, whose lowering can be tuned.
+bool isTunableOp(Operation *op);
+
+/// Returns the key of the tuned configurations of `op` in a TuningDatabase:
+/// the op name followed by the types of its inputs, e.g.
+/// "linalg.matmul(tensor<64x32xf32>, tensor<32x16xf32>)".
+std::string getTuningSignature(Operation *op);
+
+/// Returns true if the signature of `op` only has static shapes, so that `op`
+/// can be benchmarked on its own.
+bool hasStaticTuningSignature(Operation *op);
+
+/// Returns the configurations to benchmark for the tunable `op`, starting
+/// with the heuristics of the pipeline (an empty TuningConfig).
+SmallVector<TuningConfig, 16> getTuningCandidates(Operation *op);
+
+/// Sets (or, for an empty `config`, removes) the kTuningAttrName of `op`.
+void setTuningConfig(Operation *op, const TuningConfig &config);
+
+/// Returns the TuningConfig of `op`, which is empty if it has none.
+TuningConfig getTuningConfig(Operation *op);
+
+/// Tuned configurations by op signature (see getTuningSignature), stored as
+/// a JSON file mapping each signature to its configuration and the latency
+/// it was measured with. The configurations are only meaningful on the
+/// machine that they were tuned on.
+class TuningDatabase {
+public:
+  struct Entry {
+    TuningConfig config;
+    /// The latency of the op with `config`, in milliseconds.
+    double latencyMs = 0;
+  };
+
+  /// Reads the database at `path`. A file that doesn't exist is an empty
+  /// database.
+  static llvm::Expected<TuningDatabase> load(StringRef path);
+  /// Writes the database to `path`, replacing it atomically.
+  llvm::Error save(StringRef path) const;
+
+  /// Returns the entry of `signature`, or null if it wasn't tuned.
+  const Entry *lookup(StringRef signature) const;
+  /// Sets the entry of `signature`.
+  void insert(StringRef signature, Entry entry);
+
+  size_t size() const { return entries.size(); }
+
+private:
+  llvm::StringMap<Entry> entries;
+};
+
+} // namespace NPCOMP
+} // namespace mlir
+
+#endif // NPCOMP_REFBACKEND_TUNING_H
@@ -17,7 +17,11 @@
 #define NPCOMP_TYPING_ANALYSIS_CPA_ALGORITHM_H
 
 #include "npcomp/Typing/Analysis/CPA/Types.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallVector.h"
+
+#include <vector>
 
 namespace mlir {
 namespace NPCOMP {
@@ -25,6 +29,10 @@ namespace Typing {
 namespace CPA {
 
 /// Propagates constraints in an environment.
+///
+/// Propagation is incremental: each round only joins the constraints added
+/// since the previous round against indexes of all constraints so far, so
+/// every pair of constraints is joined once over the whole propagation.
 class PropagationWorklist {
 public:
   PropagationWorklist(Environment &env);
@@ -41,8 +49,20 @@ public:
   bool commit();
 
 private:
+  /// Adds a constraint, returning true if it is new.
+  bool addConstraint(Constraint *c);
+
   Environment &env;
   llvm::DenseSet<Constraint *> currentConstraints;
+  /// All constraints in the order they were added. Those from
+  /// `firstUnjoined` on have not been joined yet.
+  std::vector<Constraint *> constraintList;
+  size_t firstUnjoined = 0;
+  /// Indexes of the joined constraints, for the two sides of the join.
+  /// For `τv <: t`, varToValueTypes[t] contains τv, and for `t <: τ`,
+  /// varToAny[t] contains τ.
+  llvm::DenseMap<TypeVar *, llvm::SmallVector<ValueType *, 8>> varToValueTypes;
+  llvm::DenseMap<TypeVar *, llvm::SmallVector<TypeNode *, 8>> varToAny;
   int newConstraintCount = 0;
 };
 
@@ -18,12 +18,16 @@
 #include "mlir/Support/LogicalResult.h"
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/BitVector.h"
 #include "llvm/ADT/MapVector.h"
 #include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SparseBitVector.h"
 #include "llvm/Support/Allocator.h"
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <deque>
+
 #ifndef NPCOMP_TYPING_ANALYSIS_CPA_SUPPORT_H
 #define NPCOMP_TYPING_ANALYSIS_CPA_SUPPORT_H
 
@@ -116,6 +120,9 @@ public:
                                      MLIRContext *mlirContext,
                                      llvm::Optional<Location> loc = llvm::None);
 
+  /// The dense index of this TypeNode in its Context.
+  unsigned getId() const { return id; }
+
   bool operator==(const TypeNode &that) const;
   void print(Context &context, raw_ostream &os, bool brief = false) override;
 
@@ -143,8 +150,10 @@ public:
 
 private:
   unsigned hashValue;
+  unsigned id = ~0u;
 
   friend struct PtrInfo;
+  friend class Context;
 };
 
 /// A unique type variable.
@@ -326,6 +335,9 @@ public:
   TypeNode *getFrom() { return from; }
   TypeNode *getTo() { return to; }
 
+  /// The dense index of this Constraint in its Context.
+  unsigned getId() const { return id; }
+
   void print(Context &context, raw_ostream &os, bool brief = false) override;
 
   bool operator==(const Constraint &that) const {
@@ -356,6 +368,7 @@ private:
       : ObjectBase(Kind::Constraint), from(from), to(to) {}
   TypeNode *from;
   TypeNode *to;
+  unsigned id = ~0u;
   friend class Context;
 };
 
@@ -444,6 +457,7 @@ public:
   TypeVar *newTypeVar() {
     TypeVar *tv = allocator.Allocate<TypeVar>(1);
     new (tv) TypeVar(++typeVarCounter);
+    addNode(tv);
     currentEnvironment->getTypeVars().insert(tv);
     return tv;
   }
@@ -484,6 +498,7 @@ public:
     auto *ovt = allocator.Allocate<ObjectValueType>(1);
     new (ovt) ObjectValueType(irCtor, typeIdentifier, n, allocFieldIdentifiers,
                               allocFieldTypes);
+    addNode(ovt);
     return ovt;
   }
 
@@ -513,6 +528,7 @@ public:
     auto *av = allocator.Allocate<Constraint>(1);
     new (av) Constraint(v); // Copy ctor
     *it.first = av;         // Replace key pointer with durable allocation.
+    av->id = constraintCounter++;
     addConstraintToGraph(av);
     currentEnvironment->getConstraints().insert(av);
     return av;
@@ -532,12 +548,8 @@ public:
     return tvs;
   }
 
-  /// Gets a reference to the current members.
-  /// This is the actual backing set. Any modification to the graph can
-  /// invalidate iterators.
-  const ValueTypeSet &getMembers(TypeNode *node) {
-    return typeNodeMembers[node];
-  }
+  /// Gets the ValueTypes that currently flow into `node`, in creation order.
+  llvm::SmallVector<ValueType *, 4> getMembers(TypeNode *node);
 
 private:
   /// Generically creates a uniquable TypeNode subclass.
@@ -553,15 +565,38 @@ private:
     auto *av = allocator.Allocate<ConcreteTy>(1);
     new (av) ConcreteTy(v); // Copy ctor
     *it.first = av;         // Replace key pointer with durable allocation.
+    addNode(av);
     return av;
   }
 
+  /// Assigns the next id to a newly allocated TypeNode and adds its state to
+  /// the graph.
+  void addNode(TypeNode *node) {
+    node->id = nodes.size();
+    nodes.emplace_back();
+    nodes.back().node = node;
+    nodes.back().rep = node->id;
+  }
+
   /// Adds a constraint to the graph structure.
   void addConstraintToGraph(Constraint *c);
 
-  /// Propagates any pending constraints.
+  /// Propagates the members of pending nodes until convergence.
   void propagateConstraints();
 
+  /// Gets the id of the node representing the cycle that a node was
+  /// collapsed into (or the node itself).
+  unsigned getRep(unsigned id);
+
+  /// Adds a node to the propagation worklist.
+  void enqueueNode(unsigned id);
+
+  /// Collapses the cycles of constraints reachable from a node.
+  void collapseCyclesFrom(unsigned id);
+
+  /// Merges nodes (forming a cycle of constraints) into the first one.
+  void collapseNodes(ArrayRef<unsigned> ids);
+
   // Configuration.
   IrTypeMapHook irTypeMapHook;
 
@@ -573,17 +608,38 @@ private:
   int typeVarCounter = 0;
 
   // Graph management.
-  llvm::DenseMap<TypeNode *, ConstraintSet> fwdNodeToConstraintMap;
-  llvm::DenseMap<Constraint *, TypeNodeSet> fwdConstraintToNodeMap;
-  llvm::DenseMap<TypeNode *, ConstraintSet> bakNodeToConstraintMap;
-  // Note that we track contents for all TypeNodes, not just vars, as this
-  // can be used to determine illegal dataflows.
-  llvm::DenseMap<TypeNode *, ValueTypeSet> typeNodeMembers;
+  /// The graph state of a TypeNode.
+  ///
+  /// The nodes of a cycle of constraints always have the same members, so
+  /// they are collapsed into one representative node, which holds the
+  /// members and the constraints from all of them. Only the state of
+  /// representative nodes is meaningful.
+  struct NodeState {
+    TypeNode *node = nullptr;
+    unsigned rep;
+    /// Constraints from the node (or from the nodes it represents).
+    llvm::SmallVector<Constraint *, 4> fwdConstraints;
+    /// The ids of the ValueTypes flowing into the node. Note that we track
+    /// contents for all TypeNodes, not just vars, as this can be used to
+    /// determine illegal dataflows.
+    llvm::SparseBitVector<> members;
+    /// The members already propagated along fwdConstraints, so that only the
+    /// difference is propagated when the members change.
+    llvm::SparseBitVector<> propagated;
+  };
+  /// Indexed by TypeNode id. A deque keeps references to the states stable
+  /// as nodes are added.
+  std::deque<NodeState> nodes;
+  unsigned constraintCounter = 0;
 
   // Propagation worklist.
-  /// Constraints that are pending propagation.
-  ConstraintSet pendingConstraints;
-  ConstraintSet pendingConstraintWorklist;
+  /// Nodes with members pending propagation, and the ids of those nodes (so
+  /// that each is pending at most once).
+  llvm::SmallVector<unsigned, 16> pendingNodes;
+  llvm::BitVector pendingNodeIds;
+  /// Ids of the constraints that were already checked for being part of a
+  /// cycle (see collapseCyclesFrom).
+  llvm::BitVector cycleCheckedConstraintIds;
 
   // Environment management.
   std::vector<std::unique_ptr<Environment>> environmentStack;
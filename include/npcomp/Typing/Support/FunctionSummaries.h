@@ -0,0 +1,44 @@
+//===- FunctionSummaries.h - Bottom-up function type inference --*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef NPCOMP_TYPING_SUPPORT_FUNCTION_SUMMARIES_H
+#define NPCOMP_TYPING_SUPPORT_FUNCTION_SUMMARIES_H
+
+#include "mlir/IR/BuiltinOps.h"
+#include "llvm/ADT/StringMap.h"
+
+namespace mlir {
+namespace NPCOMP {
+namespace Typing {
+
+/// The type summaries of the functions of a module, by name: the types of
+/// their arguments and results once inferred. A function that isn't
+/// summarized (yet) maps to a null type.
+using FunctionSummaries = llvm::StringMap<FunctionType>;
+
+/// Infers the types of the functions of `module` with `inferFunction`,
+/// bottom-up over the call graph (of `std.call`s): each function is inferred
+/// after the functions it calls, and gets their summaries, which are computed
+/// once and reused by all the callers. The functions of a cycle of calls are
+/// inferred one at a time, without the summaries of the functions of the
+/// cycle not inferred yet. External functions are summarized by their
+/// declared types.
+///
+/// The functions that don't call each other (directly or not) are inferred in
+/// parallel when multithreading is enabled, so `inferFunction` must only
+/// modify the function it is given.
+LogicalResult inferFunctionsBottomUp(
+    ModuleOp module,
+    llvm::function_ref<LogicalResult(FuncOp, const FunctionSummaries &)>
+        inferFunction);
+
+} // namespace Typing
+} // namespace NPCOMP
+} // namespace mlir
+
+#endif // NPCOMP_TYPING_SUPPORT_FUNCTION_SUMMARIES_H
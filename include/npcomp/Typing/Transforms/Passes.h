@@ -19,6 +19,8 @@ namespace Typing {
 
 std::unique_ptr<OperationPass<FuncOp>> createCPAFunctionTypeInferencePass();
 
+std::unique_ptr<OperationPass<ModuleOp>> createCPAModuleTypeInferencePass();
+
 } // namespace Typing
 
 /// Registers all typing passes.
@@ -0,0 +1,164 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Passes moving the elements of tensor constants between the IR and external
+// files (see refback::getExternalElementsAttr).
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "mlir/Dialect/StandardOps/IR/Ops.h"
+#include "mlir/IR/BuiltinOps.h"
+#include "npcomp/Backend/Common/Passes.h"
+#include "npcomp/Dialect/Refback/IR/RefbackDialect.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+using namespace mlir::NPCOMP::CommonBackend;
+
+// The alignment of the elements in the files written by
+// ExternalizeElements. This matches the files of the TorchScript importer, so
+// that the compiled code can use them in place with vector loads.
+static constexpr uint64_t kExternalElementsAlignment = 64;
+
+// Returns the size in bytes of the external storage of the elements of
+// `type`, or None if they can't be stored externally. The elements are stored
+// in the in-memory layout of the element type, one byte per i1.
+static Optional<uint64_t> getExternalStorageSize(ShapedType type) {
+  if (!type.hasStaticShape() || !type.getElementType().isIntOrFloat())
+    return None;
+  unsigned bitWidth = type.getElementType().getIntOrFloatBitWidth();
+  if (bitWidth != 1 && bitWidth % 8 != 0)
+    return None;
+  return type.getNumElements() * llvm::divideCeil(bitWidth, 8);
+}
+
+namespace {
+class ExternalizeElementsPass
+    : public ExternalizeElementsBase<ExternalizeElementsPass> {
+  void getDependentDialects(DialectRegistry &registry) const override {
+    registry.insert<refback::RefbackDialect>();
+  }
+
+  void runOnOperation() override {
+    ModuleOp module = getOperation();
+    if (path.empty()) {
+      emitError(module.getLoc()) << "the path of the file is required";
+      return signalPassFailure();
+    }
+
+    SmallVector<std::pair<ConstantOp, DenseElementsAttr>> constants;
+    module.walk([&](ConstantOp op) {
+      auto elements = op.getValue().dyn_cast<DenseElementsAttr>();
+      // Splats are small in the IR anyway.
+      if (!elements || elements.isSplat())
+        return;
+      Optional<uint64_t> size = getExternalStorageSize(elements.getType());
+      if (size && *size >= static_cast<uint64_t>(minBytes))
+        constants.emplace_back(op, elements);
+    });
+
+    std::error_code error;
+    llvm::raw_fd_ostream file(path, error);
+    if (error) {
+      emitError(module.getLoc())
+          << "could not create " << path << ": " << error.message();
+      return signalPassFailure();
+    }
+    // Constants with the same elements (such as tied weights) are stored
+    // once.
+    DenseMap<Attribute, uint64_t> offsets;
+    uint64_t fileSize = 0;
+    for (auto &constant : constants) {
+      DenseElementsAttr elements = constant.second;
+      auto inserted = offsets.insert({elements, 0});
+      if (inserted.second) {
+        uint64_t offset = llvm::alignTo(fileSize, kExternalElementsAlignment);
+        file.write_zeros(offset - fileSize);
+        inserted.first->second = offset;
+        // i1 elements are bit-packed in the attribute.
+        if (elements.getType().getElementType().isInteger(1)) {
+          for (bool value : elements.getValues<bool>())
+            file << static_cast<char>(value);
+        } else {
+          ArrayRef<char> data = elements.getRawData();
+          file.write(data.data(), data.size());
+        }
+        fileSize = offset + *getExternalStorageSize(elements.getType());
+      }
+      constant.first->setAttr(
+          "value", refback::getExternalElementsAttr(
+                       elements.getType(), path, inserted.first->second));
+    }
+    file.close();
+    if (file.has_error()) {
+      emitError(module.getLoc())
+          << "could not write " << path << ": " << file.error().message();
+      file.clear_error();
+      return signalPassFailure();
+    }
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<ModuleOp>>
+mlir::NPCOMP::CommonBackend::createExternalizeElementsPass() {
+  return std::make_unique<ExternalizeElementsPass>();
+}
+
+namespace {
+class InternalizeElementsPass
+    : public InternalizeElementsBase<InternalizeElementsPass> {
+  void runOnOperation() override {
+    ModuleOp module = getOperation();
+    llvm::StringMap<std::unique_ptr<llvm::MemoryBuffer>> files;
+    auto result = module.walk([&](ConstantOp op) -> WalkResult {
+      auto external = refback::getExternalElements(op.getValue());
+      if (!external)
+        return WalkResult::advance();
+      auto type = op.getType().cast<ShapedType>();
+      Optional<uint64_t> size = getExternalStorageSize(type);
+      if (!size)
+        return op.emitError() << "unsupported type of external elements: "
+                              << type;
+      std::unique_ptr<llvm::MemoryBuffer> &file = files[external->path];
+      if (!file) {
+        auto buffer = llvm::MemoryBuffer::getFile(
+            external->path, /*FileSize=*/-1, /*RequiresNullTerminator=*/false);
+        if (!buffer)
+          return op.emitError() << "could not open " << external->path << ": "
+                                << buffer.getError().message();
+        file = std::move(*buffer);
+      }
+      if (external->offset + *size > file->getBufferSize())
+        return op.emitError() << external->path << " is too small";
+      const char *data = file->getBufferStart() + external->offset;
+      DenseElementsAttr elements;
+      if (type.getElementType().isInteger(1)) {
+        SmallVector<bool> values(data, data + *size);
+        elements = DenseElementsAttr::get(type, values);
+      } else {
+        elements = DenseElementsAttr::getFromRawBuffer(
+            type, ArrayRef<char>(data, *size), /*isSplatBuffer=*/false);
+      }
+      op->setAttr("value", elements);
+      return WalkResult::advance();
+    });
+    if (result.wasInterrupted())
+      return signalPassFailure();
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<ModuleOp>>
+mlir::NPCOMP::CommonBackend::createInternalizeElementsPass() {
+  return std::make_unique<InternalizeElementsPass>();
+}
@@ -0,0 +1,264 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Splits a function satisfying the backend contract into a pipeline of stage
+// functions, balanced by compute and weight memory, which can each be
+// compiled into a module of its own and run by a process of its own.
+//
+// Stage `k` takes the values live into it (the function arguments for the
+// first stage) and returns the values live out of it, including those it only
+// passes through to later stages, so that each stage only ever talks to the
+// next one. Ops without side effects that don't produce tensors (such as
+// `memref.dim` and index arithmetic), constants (including weights) and
+// `linalg.init_tensor`s are not assigned to stages: they are cloned into each
+// stage using them.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "mlir/Dialect/Linalg/IR/LinalgOps.h"
+#include "mlir/Dialect/StandardOps/IR/Ops.h"
+#include "mlir/IR/BlockAndValueMapping.h"
+#include "mlir/IR/Builders.h"
+#include "mlir/IR/BuiltinOps.h"
+#include "mlir/Interfaces/SideEffectInterfaces.h"
+#include "npcomp/Backend/Common/Passes.h"
+#include "llvm/ADT/DenseSet.h"
+
+#include <functional>
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+using namespace mlir::NPCOMP::CommonBackend;
+
+// Returns true if `op` is cloned into each stage using it rather than being
+// assigned to one stage.
+static bool isRematerializable(Operation *op) {
+  if (isa<ConstantOp, linalg::InitTensorOp>(op))
+    return true;
+  return op->getNumRegions() == 0 && MemoryEffectOpInterface::hasNoEffect(op) &&
+         llvm::none_of(op->getResultTypes(),
+                       [](Type type) { return type.isa<TensorType>(); });
+}
+
+// Returns the number of iterations of the loops of `op` times the number of
+// ops of its payload. Dynamic sizes (typically the batch size) scale all the
+// ops of a model alike, so they count as 1.
+static double getComputeCost(linalg::LinalgOp op) {
+  double iterations = 1;
+  if (Optional<SmallVector<int64_t, 4>> ranges = op.getStaticLoopRanges())
+    for (int64_t range : *ranges)
+      if (range > 0)
+        iterations *= range;
+  Block &payload = op->getRegion(0).front();
+  return iterations * std::max<size_t>(1, payload.getOperations().size() - 1);
+}
+
+// Returns the size in bytes of the tensor constants that `op` uses.
+static double getWeightBytes(Operation *op) {
+  double bytes = 0;
+  for (Value operand : op->getOperands()) {
+    auto constant = operand.getDefiningOp<ConstantOp>();
+    auto type = operand.getType().dyn_cast<RankedTensorType>();
+    if (!constant || !type || !type.hasStaticShape() ||
+        !type.getElementType().isIntOrFloat())
+      continue;
+    bytes += type.getNumElements() *
+             llvm::divideCeil(type.getElementType().getIntOrFloatBitWidth(), 8);
+  }
+  return bytes;
+}
+
+namespace {
+class SplitPipelineStagesPass
+    : public SplitPipelineStagesBase<SplitPipelineStagesPass> {
+  void runOnOperation() override {
+    ModuleOp module = getOperation();
+    auto func = module.lookupSymbol<FuncOp>(functionName);
+    if (!func) {
+      emitError(module.getLoc()) << "no function named " << functionName;
+      return signalPassFailure();
+    }
+    if (numStages < 1 || stage >= numStages) {
+      emitError(module.getLoc()) << "invalid stage " << stage << " of "
+                                 << numStages;
+      return signalPassFailure();
+    }
+    if (!llvm::hasSingleElement(func.getBody())) {
+      func.emitError() << "can only split functions with a single block";
+      return signalPassFailure();
+    }
+    Block &body = func.getBody().front();
+    Operation *terminator = body.getTerminator();
+
+    // Assign the ops to stages, cutting whenever the share of the compute and
+    // weights of the function in the stages so far exceeds their share of the
+    // stages.
+    SmallVector<Operation *, 32> ops;
+    SmallVector<double, 32> computeCosts, weightCosts;
+    double totalCompute = 0, totalWeights = 0;
+    for (Operation &op : body.without_terminator()) {
+      if (isRematerializable(&op))
+        continue;
+      auto linalgOp = dyn_cast<linalg::LinalgOp>(&op);
+      ops.push_back(&op);
+      computeCosts.push_back(linalgOp ? getComputeCost(linalgOp) : 0);
+      weightCosts.push_back(getWeightBytes(&op));
+      totalCompute += computeCosts.back();
+      totalWeights += weightCosts.back();
+    }
+    int64_t stages = std::max<int64_t>(
+        1, std::min<int64_t>(numStages, ops.size()));
+    DenseMap<Operation *, int64_t> stageOf;
+    double cost = 0;
+    int64_t current = 0;
+    for (size_t i = 0, e = ops.size(); i < e; ++i) {
+      // Leave at least one op for each of the remaining stages.
+      int64_t remainingOps = e - i;
+      if (current + 1 < stages &&
+          (cost >= static_cast<double>(current + 1) / stages ||
+           remainingOps <= stages - current - 1))
+        ++current;
+      stageOf[ops[i]] = current;
+      double share = 0;
+      if (totalCompute > 0)
+        share += computeCosts[i] / totalCompute;
+      if (totalWeights > 0)
+        share += weightCosts[i] / totalWeights;
+      if (totalCompute > 0 && totalWeights > 0)
+        share /= 2;
+      cost += share;
+    }
+
+    // The values live into each stage (and into the return for the last
+    // one), in the order they are defined.
+    auto stageOfUser = [&](Operation *user) -> int64_t {
+      if (user == terminator)
+        return stages;
+      auto it = stageOf.find(user);
+      return it == stageOf.end() ? -1 : it->second;
+    };
+    // The stages using each value, directly or through rematerialized ops.
+    DenseMap<Value, int64_t> lastUse;
+    std::function<void(Value, int64_t)> noteUse = [&](Value value,
+                                                      int64_t user) {
+      int64_t &last = lastUse[value];
+      last = std::max(last, user);
+      Operation *def = value.getDefiningOp();
+      if (def && isRematerializable(def))
+        for (Value operand : def->getOperands())
+          noteUse(operand, user);
+    };
+    for (Operation &op : body) {
+      int64_t user = stageOfUser(&op);
+      if (user < 0)
+        continue;
+      for (Value operand : op.getOperands())
+        noteUse(operand, user);
+      op.walk([&](Operation *nested) {
+        for (Value operand : nested->getOperands())
+          if (operand.getParentBlock() == &body)
+            noteUse(operand, user);
+      });
+    }
+    auto definingStage = [&](Value value) -> int64_t {
+      Operation *def = value.getDefiningOp();
+      if (!def)
+        return -1;
+      auto it = stageOf.find(def);
+      return it == stageOf.end() ? -2 : it->second;
+    };
+    SmallVector<SmallVector<Value, 8>, 4> liveIn(stages + 1);
+    auto collectLiveIn = [&](Value value) {
+      int64_t def = definingStage(value);
+      if (def == -2)
+        return;
+      auto it = lastUse.find(value);
+      for (int64_t k = def + 1; k <= stages; ++k)
+        if (k == 0 || (it != lastUse.end() && it->second >= k))
+          liveIn[k].push_back(value);
+    };
+    for (BlockArgument arg : body.getArguments())
+      collectLiveIn(arg);
+    for (Operation &op : body.without_terminator())
+      for (Value result : op.getResults())
+        collectLiveIn(result);
+    liveIn[stages].assign(terminator->operand_begin(),
+                          terminator->operand_end());
+
+    // Create the stage functions.
+    OpBuilder builder(func);
+    SmallVector<FuncOp, 4> stageFuncs;
+    for (int64_t k = 0; k < stages; ++k) {
+      auto type = builder.getFunctionType(ValueRange(liveIn[k]).getTypes(),
+                                          ValueRange(liveIn[k + 1]).getTypes());
+      auto stageFunc = builder.create<FuncOp>(
+          func.getLoc(), (functionName + "_stage" + Twine(k)).str(), type);
+      stageFunc->setAttr(kPipelineStageAttrName, builder.getI64IntegerAttr(k));
+      Block *entry = stageFunc.addEntryBlock();
+      BlockAndValueMapping mapping;
+      mapping.map(liveIn[k], entry->getArguments());
+      OpBuilder stageBuilder = OpBuilder::atBlockEnd(entry);
+      // Clone the ops of the stage, and the rematerialized ops they use.
+      std::function<void(Value)> materialize = [&](Value value) {
+        if (mapping.contains(value))
+          return;
+        Operation *def = value.getDefiningOp();
+        assert(def && isRematerializable(def) && "value not live into stage");
+        for (Value operand : def->getOperands())
+          materialize(operand);
+        stageBuilder.clone(*def, mapping);
+      };
+      for (Operation *op : ops) {
+        if (stageOf[op] != k)
+          continue;
+        for (Value operand : op->getOperands())
+          materialize(operand);
+        op->walk([&](Operation *nested) {
+          for (Value operand : nested->getOperands())
+            if (operand.getParentBlock() == &body)
+              materialize(operand);
+        });
+        stageBuilder.clone(*op, mapping);
+      }
+      SmallVector<Value, 8> results;
+      for (Value value : liveIn[k + 1]) {
+        materialize(value);
+        results.push_back(mapping.lookup(value));
+      }
+      stageBuilder.create<ReturnOp>(func.getLoc(), results);
+      stageFuncs.push_back(stageFunc);
+    }
+
+    if (stage >= 0) {
+      // Only keep the requested stage, for the module of its own process.
+      for (int64_t k = 0; k < stages; ++k)
+        if (k != stage)
+          stageFuncs[k].erase();
+      func.erase();
+      return;
+    }
+    // The function calls the stages in turn.
+    body.dropAllReferences();
+    body.clear();
+    builder.setInsertionPointToEnd(&body);
+    ValueRange values = body.getArguments();
+    SmallVector<Value, 8> results(values.begin(), values.end());
+    for (FuncOp stageFunc : stageFuncs) {
+      auto call = builder.create<CallOp>(func.getLoc(), stageFunc, results);
+      results.assign(call.getResults().begin(), call.getResults().end());
+    }
+    builder.create<ReturnOp>(func.getLoc(), results);
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<ModuleOp>>
+mlir::NPCOMP::CommonBackend::createSplitPipelineStagesPass() {
+  return std::make_unique<SplitPipelineStagesPass>();
+}
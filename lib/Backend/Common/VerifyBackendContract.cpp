@@ -10,6 +10,7 @@
 #include "mlir/Dialect/Linalg/IR/LinalgOps.h"
 #include "mlir/Dialect/Math/IR/Math.h"
 #include "mlir/Dialect/MemRef/IR/MemRef.h"
+#include "mlir/Dialect/Tensor/IR/Tensor.h"
 #include "mlir/IR/OpDefinition.h"
 #include "mlir/Transforms/DialectConversion.h"
 #include "npcomp/Backend/Common/Passes.h"
@@ -33,6 +34,17 @@ class VerifyBackendContractPass
       return nullptr;
     });
     TypeConverter scalarConverter;
+    TypeConverter memrefConverter;
+    memrefConverter.addConversion([](RankedTensorType type) -> Type {
+      if (BaseMemRefType::isValidElementType(type.getElementType()))
+        return type;
+      return nullptr;
+    });
+    memrefConverter.addConversion([](MemRefType type) -> Type {
+      if (type.hasStaticShape() && type.getAffineMaps().empty())
+        return type;
+      return nullptr;
+    });
     for (TypeConverter *c : {&converter, &scalarConverter}) {
       c->addConversion([](FloatType type) { return type; });
       c->addConversion([](IntegerType type) { return type; });
@@ -59,8 +71,49 @@ class VerifyBackendContractPass
     // Tensor operations should go through linalg and the tensor dialect.
     target.addDynamicallyLegalDialect<linalg::LinalgDialect>(opHasLegalTypes);
     target.addDynamicallyLegalDialect<tensor::TensorDialect>(opHasLegalTypes);
+    // Casts that change nothing, and chains of casts whose intermediate type
+    // knows no extent that the others don't, would keep elementwise ops from
+    // fusing and become copies after bufferization. They are folded by
+    // torch-finalizing-builtin-tensorize.
+    target.addDynamicallyLegalOp<tensor::CastOp>([&](tensor::CastOp op) {
+      if (!opHasLegalTypes(op) || op.source().getType() == op.getType())
+        return false;
+      auto producer = op.source().getDefiningOp<tensor::CastOp>();
+      if (!producer)
+        return true;
+      auto sourceType =
+          producer.source().getType().dyn_cast<RankedTensorType>();
+      if (!sourceType)
+        return true;
+      auto intermediateType = producer.getType().cast<RankedTensorType>();
+      auto resultType = op.getType().cast<RankedTensorType>();
+      for (unsigned i = 0, e = intermediateType.getRank(); i < e; i++) {
+        if (!intermediateType.isDynamicDim(i) && sourceType.isDynamicDim(i) &&
+            resultType.isDynamicDim(i))
+          return true;
+      }
+      return false;
+    });
     // DimOp is used to query tensor sizes.
     target.addDynamicallyLegalOp<memref::DimOp>(opHasLegalTypes);
+    // Mutable global tensors (see torch-lower-global-slots) are stored in
+    // memref globals, which are read and written by copying through memrefs.
+    target.addLegalOp<memref::GlobalOp>();
+    target.addDynamicallyLegalOp<memref::GetGlobalOp, memref::AllocOp,
+                                 memref::TensorLoadOp, memref::BufferCastOp,
+                                 linalg::CopyOp>(
+        [&](Operation *op) { return memrefConverter.isLegal(op); });
+
+    // Casts between integers of different signedness (such as the elements
+    // of the `si64` index tensors of gathers) are no-ops.
+    target.addDynamicallyLegalOp<UnrealizedConversionCastOp>(
+        [](UnrealizedConversionCastOp op) {
+          if (op.getNumOperands() != 1 || op.getNumResults() != 1)
+            return false;
+          auto from = op.getOperand(0).getType().dyn_cast<IntegerType>();
+          auto to = op.getResult(0).getType().dyn_cast<IntegerType>();
+          return from && to && from.getWidth() == to.getWidth();
+        });
 
     // AssertOp is used to terminate the program for error guards.
     target.addLegalOp<AssertOp>();
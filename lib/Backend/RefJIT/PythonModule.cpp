@@ -9,120 +9,1111 @@
 #include "npcomp/Backend/RefJIT/PythonModule.h"
 
 #include "pybind11/numpy.h"
+#include "pybind11/stl.h"
 
 #include "mlir/CAPI/IR.h"
 #include "mlir/CAPI/Pass.h"
+#include "mlir/InitAllDialects.h"
+#include "npcomp/InitAll.h"
+#include "npcomp/RefBackend/JITHelpers/CompilationService.h"
 #include "npcomp/RefBackend/JITHelpers/JITModule.h"
+#include "npcomp/RefBackend/RefBackend.h"
+
+#include <algorithm>
+#include <chrono>
+#include <future>
 
 using llvm::SmallVector;
 using llvm::StringRef;
 using llvm::Twine;
 
 // Make namespaces consistent.
+using refback::AsyncCallResult;
+using refback::CompilationOptions;
+using refback::CompilationService;
+using refback::CompilationServiceOptions;
+using refback::JITCompileOptions;
 using refback::JITModule;
+using refback::ObjectStore;
+using refback::PreparedCall;
 using refbackrt::Ref;
 using refbackrt::Tensor;
 using refbackrt::RtValue;
 
-template <typename T>
-static T checkError(llvm::Expected<T> &&expected, Twine banner = {}) {
-  if (LLVM_LIKELY(expected))
-    return std::move(*expected);
+static void checkError(llvm::Error error, Twine banner = {}) {
+  if (LLVM_LIKELY(!error))
+    return;
 
   std::string errorMessage;
   llvm::raw_string_ostream os(errorMessage);
-  llvm::logAllUnhandledErrors(expected.takeError(), os, banner);
+  llvm::logAllUnhandledErrors(std::move(error), os, banner);
   os.flush();
   throw py::raisePyError(PyExc_RuntimeError, errorMessage.c_str());
 }
 
+template <typename T>
+static T checkError(llvm::Expected<T> &&expected, Twine banner = {}) {
+  if (LLVM_LIKELY(expected))
+    return std::move(*expected);
+  checkError(expected.takeError(), banner);
+  llvm_unreachable("checkError throws on errors");
+}
+
 static refbackrt::ElementType
-mapBufferFormatToElementType(const std::string &format, py::ssize_t itemSize) {
+mapBufferFormatToElementType(StringRef format, py::ssize_t itemSize) {
   if (format == "f")
     return refbackrt::ElementType::F32;
+  if (format == "e")
+    return refbackrt::ElementType::F16;
+  if (format == "?")
+    return refbackrt::ElementType::I1;
+  // The signed integer formats are platform-dependent in size, so dispatch on
+  // the item size.
+  if (format == "b" || format == "h" || format == "i" || format == "l" ||
+      format == "q") {
+    switch (itemSize) {
+    case 1:
+      return refbackrt::ElementType::I8;
+    case 4:
+      return refbackrt::ElementType::I32;
+    case 8:
+      return refbackrt::ElementType::I64;
+    default:
+      break;
+    }
+  }
 
   std::string message("unsupported buffer format: ");
-  message.append(format);
+  message.append(format.str());
   throw py::raiseValueError(message);
 }
 
-static Ref<Tensor> copyBufferToTensor(py::buffer buffer) {
-  // Request a C contiguous view as that is what Tensor accepts now (no strides
-  // or non row-major layout).
-  int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT;
+static py::buffer_info requestBuffer(py::buffer buffer, int flags) {
   std::unique_ptr<Py_buffer> view(new Py_buffer());
   if (PyObject_GetBuffer(buffer.ptr(), view.get(), flags) != 0) {
     throw py::error_already_set();
   }
-  py::buffer_info info(view.release());
+  return py::buffer_info(view.release());
+}
+
+static py::buffer_info requestContiguousBuffer(py::buffer buffer) {
+  // Request a C contiguous view, as needed for copying into a Tensor.
+  return requestBuffer(buffer, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT);
+}
+
+// Creates a Tensor viewing the memory of a strided buffer, which must outlive
+// it.
+static Ref<Tensor> borrowBufferAsTensor(StringRef format, py::ssize_t itemSize,
+                                        llvm::ArrayRef<py::ssize_t> shape,
+                                        llvm::ArrayRef<py::ssize_t> byteStrides,
+                                        void *data) {
+  auto elementType = mapBufferFormatToElementType(format, itemSize);
+
+  SmallVector<std::int64_t, 4> extents(shape.begin(), shape.end());
+  SmallVector<std::int64_t, 4> strides;
+  for (py::ssize_t byteStride : byteStrides) {
+    if (byteStride % itemSize != 0)
+      throw py::raiseValueError("buffer strides must be a multiple of the "
+                                "element size");
+    strides.push_back(byteStride / itemSize);
+  }
+  return Tensor::createBorrowingBuffer(
+      refbackrt::ArrayRef<std::int64_t>(extents.data(), extents.size()),
+      refbackrt::ArrayRef<std::int64_t>(strides.data(), strides.size()),
+      elementType, data);
+}
+
+static Ref<Tensor> borrowBufferAsTensor(const Py_buffer &view) {
+  return borrowBufferAsTensor(view.format, view.itemsize,
+                              llvm::makeArrayRef(view.shape, view.ndim),
+                              llvm::makeArrayRef(view.strides, view.ndim),
+                              view.buf);
+}
+
+static Ref<Tensor> copyBufferToTensor(py::buffer buffer) {
+  py::buffer_info info = requestContiguousBuffer(buffer);
   auto elementType = mapBufferFormatToElementType(info.format, info.itemsize);
 
-  // TODO: Switch Tensor extents to ssize_t for efficiency.
-  SmallVector<std::int32_t, 4> extents(info.shape.begin(), info.shape.end());
+  SmallVector<std::int64_t, 4> extents(info.shape.begin(), info.shape.end());
   return Tensor::create(
-      refbackrt::ArrayRef<std::int32_t>(extents.data(), extents.size()),
+      refbackrt::ArrayRef<std::int64_t>(extents.data(), extents.size()),
       elementType, info.ptr);
 }
 
 py::array wrapTensorAsArray(Ref<Tensor> tensor) {
   auto pyTensor = py::cast(tensor);
   auto extents = tensor->getExtents();
-  // TODO: Switch Tensor extents to ssize_t for efficiency.
   std::vector<ssize_t> shape(extents.data(), extents.data() + extents.size());
+  auto elementByteSize =
+      refbackrt::getElementTypeByteSize(tensor->getElementType());
+  std::vector<ssize_t> strides;
+  for (int i = 0, e = tensor->getRank(); i < e; i++)
+    strides.push_back(tensor->getStrides()[i] * elementByteSize);
 
   const char *format;
   switch (tensor->getElementType()) {
   case refbackrt::ElementType::F32:
     format = "f";
     break;
+  case refbackrt::ElementType::F16:
+    format = "e";
+    break;
+  case refbackrt::ElementType::I8:
+    format = "b";
+    break;
+  case refbackrt::ElementType::I32:
+    format = "i";
+    break;
+  case refbackrt::ElementType::I64:
+    format = "q";
+    break;
+  case refbackrt::ElementType::I1:
+    format = "?";
+    break;
   default:
     throw py::raiseValueError("unsupported tensor element type");
   }
 
-  return py::array(py::dtype(format), shape, tensor->getData(),
-                   /*base=*/std::move(pyTensor));
+  py::array array(py::dtype(format), shape, strides, tensor->getData(),
+                  /*base=*/std::move(pyTensor));
+  // Read-only tensors view the constants of the module.
+  if (tensor->isReadOnly())
+    array.attr("setflags")(py::arg("write") = false);
+  return array;
+}
+
+// The parts of the DLPack ABI (see dlpack.h) used to exchange CPU tensors with
+// other frameworks, such as PyTorch, without copying them. DLPack tensors are
+// passed in PyCapsule's named "dltensor", which the consumer renames to
+// "used_dltensor" when it takes ownership of the DLManagedTensor.
+namespace dlpack {
+enum : std::int32_t { kDLCPU = 1 };
+enum : std::uint8_t { kDLInt = 0, kDLFloat = 2, kDLBool = 6 };
+struct DLDevice {
+  std::int32_t deviceType;
+  std::int32_t deviceId;
+};
+struct DLDataType {
+  std::uint8_t code;
+  std::uint8_t bits;
+  std::uint16_t lanes;
+};
+struct DLTensor {
+  void *data;
+  DLDevice device;
+  std::int32_t ndim;
+  DLDataType dtype;
+  std::int64_t *shape;
+  // In elements, or null for the dense row-major layout.
+  std::int64_t *strides;
+  std::uint64_t byteOffset;
+};
+struct DLManagedTensor {
+  DLTensor dlTensor;
+  void *managerCtx;
+  void (*deleter)(DLManagedTensor *self);
+};
+} // namespace dlpack
+
+static const char *const kDLPackCapsuleName = "dltensor";
+static const char *const kUsedDLPackCapsuleName = "used_dltensor";
+
+static refbackrt::ElementType
+mapDLDataTypeToElementType(const dlpack::DLDataType &type) {
+  if (type.lanes == 1) {
+    if (type.code == dlpack::kDLFloat && type.bits == 32)
+      return refbackrt::ElementType::F32;
+    if (type.code == dlpack::kDLFloat && type.bits == 16)
+      return refbackrt::ElementType::F16;
+    if (type.code == dlpack::kDLBool && type.bits == 8)
+      return refbackrt::ElementType::I1;
+    if (type.code == dlpack::kDLInt) {
+      switch (type.bits) {
+      case 8:
+        return refbackrt::ElementType::I8;
+      case 32:
+        return refbackrt::ElementType::I32;
+      case 64:
+        return refbackrt::ElementType::I64;
+      default:
+        break;
+      }
+    }
+  }
+  throw py::raiseValueError("unsupported DLPack data type");
+}
+
+static dlpack::DLDataType
+mapElementTypeToDLDataType(refbackrt::ElementType type) {
+  switch (type) {
+  case refbackrt::ElementType::F32:
+    return {dlpack::kDLFloat, 32, 1};
+  case refbackrt::ElementType::F16:
+    return {dlpack::kDLFloat, 16, 1};
+  case refbackrt::ElementType::I8:
+    return {dlpack::kDLInt, 8, 1};
+  case refbackrt::ElementType::I32:
+    return {dlpack::kDLInt, 32, 1};
+  case refbackrt::ElementType::I64:
+    return {dlpack::kDLInt, 64, 1};
+  case refbackrt::ElementType::I1:
+    return {dlpack::kDLBool, 8, 1};
+  default:
+    throw py::raiseValueError("unsupported tensor element type");
+  }
+}
+
+// Takes ownership of the DLManagedTensor of `capsule`, which the caller must
+// delete.
+static dlpack::DLManagedTensor *consumeDLPackCapsule(py::handle capsule) {
+  if (!PyCapsule_IsValid(capsule.ptr(), kDLPackCapsuleName))
+    throw py::raiseValueError("expected a DLPack capsule that wasn't consumed");
+  auto *managed = static_cast<dlpack::DLManagedTensor *>(
+      PyCapsule_GetPointer(capsule.ptr(), kDLPackCapsuleName));
+  PyCapsule_SetName(capsule.ptr(), kUsedDLPackCapsuleName);
+  return managed;
+}
+
+// Creates a Tensor viewing the memory of `tensor`, which must outlive it.
+static Ref<Tensor> borrowDLTensorAsTensor(const dlpack::DLTensor &tensor) {
+  if (tensor.device.deviceType != dlpack::kDLCPU)
+    throw py::raiseValueError("only CPU tensors can be passed with DLPack");
+  auto elementType = mapDLDataTypeToElementType(tensor.dtype);
+  refbackrt::ArrayRef<std::int64_t> extents(tensor.shape, tensor.ndim);
+  void *data = static_cast<char *>(tensor.data) + tensor.byteOffset;
+  if (!tensor.strides)
+    return Tensor::createBorrowingBuffer(extents, elementType, data);
+  return Tensor::createBorrowingBuffer(
+      extents, refbackrt::ArrayRef<std::int64_t>(tensor.strides, tensor.ndim),
+      elementType, data);
+}
+
+namespace {
+// The DLManagedTensor exported for a Tensor, which it keeps alive.
+struct DLPackExport {
+  Ref<Tensor> tensor;
+  SmallVector<std::int64_t, 4> shape;
+  SmallVector<std::int64_t, 4> strides;
+  dlpack::DLManagedTensor managed;
+};
+} // namespace
+
+static void destroyDLPackCapsule(PyObject *capsule) {
+  // The consumer of the capsule, if any, owns the DLManagedTensor.
+  if (!PyCapsule_IsValid(capsule, kDLPackCapsuleName))
+    return;
+  auto *managed = static_cast<dlpack::DLManagedTensor *>(
+      PyCapsule_GetPointer(capsule, kDLPackCapsuleName));
+  managed->deleter(managed);
+}
+
+// Returns a DLPack capsule viewing `tensor`. DLPack has no notion of read-only
+// tensors, so those (the constants of a module) are exported as copies.
+static py::capsule exportTensorAsDLPack(Ref<Tensor> tensor) {
+  if (tensor->isReadOnly()) {
+    if (!tensor->isContiguous())
+      throw py::raiseValueError("cannot export a strided read-only tensor");
+    tensor = Tensor::create(tensor->getExtents(), tensor->getElementType(),
+                            tensor->getData());
+  }
+  auto exported = std::make_unique<DLPackExport>();
+  auto extents = tensor->getExtents();
+  auto strides = tensor->getStrides();
+  exported->shape.append(extents.begin(), extents.end());
+  exported->strides.append(strides.begin(), strides.end());
+  dlpack::DLTensor &dlTensor = exported->managed.dlTensor;
+  dlTensor.data = tensor->getData();
+  dlTensor.device = {dlpack::kDLCPU, 0};
+  dlTensor.ndim = tensor->getRank();
+  dlTensor.dtype = mapElementTypeToDLDataType(tensor->getElementType());
+  dlTensor.shape = exported->shape.data();
+  dlTensor.strides = exported->strides.data();
+  dlTensor.byteOffset = 0;
+  exported->managed.managerCtx = exported.get();
+  exported->managed.deleter = [](dlpack::DLManagedTensor *self) {
+    delete static_cast<DLPackExport *>(self->managerCtx);
+  };
+  exported->tensor = std::move(tensor);
+
+  PyObject *capsule = PyCapsule_New(&exported->managed, kDLPackCapsuleName,
+                                    destroyDLPackCapsule);
+  if (!capsule)
+    throw py::error_already_set();
+  exported.release();
+  return py::reinterpret_steal<py::capsule>(capsule);
+}
+
+// Returns the Tensor viewed by `array`, which must be (exactly) an output
+// returned by a JITModule.
+static Ref<Tensor> getArrayTensor(py::array array) {
+  py::object base = array.base();
+  if (py::isinstance<Ref<Tensor>>(base)) {
+    Ref<Tensor> tensor = base.cast<Ref<Tensor>>();
+    auto elementByteSize =
+        refbackrt::getElementTypeByteSize(tensor->getElementType());
+    bool isWholeTensor = array.data() == tensor->getData() &&
+                         array.ndim() == tensor->getRank();
+    for (int i = 0, e = tensor->getRank(); isWholeTensor && i < e; i++)
+      isWholeTensor = array.shape(i) == tensor->getExtent(i) &&
+                      array.strides(i) ==
+                          tensor->getStrides()[i] * elementByteSize;
+    if (isWholeTensor)
+      return tensor;
+  }
+  throw py::raiseValueError(
+      "only arrays returned by a JITModule can be exported with DLPack");
+}
+
+namespace {
+// Borrows the inputs of a call as Tensor's, which must be destroyed before
+// this. Inputs are either buffers, whose strided views are released on
+// destruction, or DLPack tensors (capsules, or objects with a `__dlpack__`
+// method such as torch.Tensor's), which are deleted on destruction.
+// Unlike py::buffer_info, this doesn't allocate for each input.
+class BorrowedInputs {
+public:
+  explicit BorrowedInputs(size_t numInputs) { views.reserve(numInputs); }
+  BorrowedInputs(const BorrowedInputs &) = delete;
+  BorrowedInputs &operator=(const BorrowedInputs &) = delete;
+  ~BorrowedInputs() {
+    for (Py_buffer &view : views)
+      PyBuffer_Release(&view);
+    for (dlpack::DLManagedTensor *managed : dlTensors)
+      if (managed->deleter)
+        managed->deleter(managed);
+  }
+
+  Ref<Tensor> borrow(py::handle input) {
+    if (PyObject_CheckBuffer(input.ptr())) {
+      assert(views.size() < views.capacity() && "more views than reserved");
+      Py_buffer view;
+      // Strided views (e.g. transposed or sliced arrays) can be borrowed
+      // directly.
+      if (PyObject_GetBuffer(input.ptr(), &view, PyBUF_RECORDS_RO) != 0)
+        throw py::error_already_set();
+      // Doesn't reallocate, so the views acquired before stay in place.
+      views.push_back(view);
+      return borrowBufferAsTensor(views.back());
+    }
+
+    py::object capsule = py::reinterpret_borrow<py::object>(input);
+    if (!PyCapsule_CheckExact(input.ptr())) {
+      if (!py::hasattr(input, "__dlpack__")) {
+        std::string message("inputs must be buffers or DLPack tensors, not ");
+        message.append(Py_TYPE(input.ptr())->tp_name);
+        throw py::raisePyError(PyExc_TypeError, message.c_str());
+      }
+      capsule = input.attr("__dlpack__")();
+    }
+    dlTensors.push_back(consumeDLPackCapsule(capsule));
+    return borrowDLTensorAsTensor(dlTensors.back()->dlTensor);
+  }
+
+private:
+  SmallVector<Py_buffer, 6> views;
+  SmallVector<dlpack::DLManagedTensor *, 2> dlTensors;
+};
+} // namespace
+
+// Copies `input` (see BorrowedInputs) into a new Tensor.
+static Ref<Tensor> copyInputToTensor(py::handle input) {
+  if (PyObject_CheckBuffer(input.ptr()))
+    return copyBufferToTensor(py::reinterpret_borrow<py::buffer>(input));
+  BorrowedInputs borrowed(1);
+  Ref<Tensor> tensor = borrowed.borrow(input);
+  if (!tensor->isContiguous())
+    throw py::raiseValueError("DLPack tensors must be contiguous to be copied");
+  return Tensor::create(tensor->getExtents(), tensor->getElementType(),
+                        tensor->getData());
+}
+
+// Moves the tensors of `outputs` into arrays.
+static std::vector<py::array>
+wrapOutputsAsArrays(llvm::MutableArrayRef<RtValue> outputs) {
+  std::vector<py::array> outputArrays;
+  outputArrays.reserve(outputs.size());
+  for (RtValue &outputTensor : outputs) {
+    outputArrays.push_back(wrapTensorAsArray(outputTensor.takeTensor()));
+  }
+  return outputArrays;
+}
+
+// Returns the schedule of a request of priority `priority` ("high", "normal"
+// or "low"), which must start within `timeout` seconds unless it is None.
+static refbackrt::RequestSchedule getRequestSchedule(const std::string &priority,
+                                                     py::object timeout) {
+  refbackrt::RequestSchedule schedule;
+  if (priority == "high")
+    schedule.priority = refbackrt::Priority::High;
+  else if (priority == "low")
+    schedule.priority = refbackrt::Priority::Low;
+  else if (priority != "normal")
+    throw py::raisePyError(PyExc_ValueError,
+                           ("unknown priority: " + priority).c_str());
+  if (!timeout.is_none()) {
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::duration<double>(timeout.cast<double>()));
+    schedule.deadlineNanos = deadline.time_since_epoch().count();
+  }
+  return schedule;
+}
+
+namespace {
+// The pending result of JITModule.invoke_async.
+class AsyncInvocation {
+public:
+  AsyncInvocation(std::future<AsyncCallResult> future)
+      : future(std::move(future)) {}
+
+  bool done() const {
+    return future.wait_for(std::chrono::seconds(0)) ==
+           std::future_status::ready;
+  }
+
+  std::vector<py::array> result() {
+    if (!future.valid())
+      throw py::raisePyError(PyExc_RuntimeError,
+                             "result of invocation was already retrieved");
+    {
+      py::gil_scoped_release release;
+      future.wait();
+    }
+    auto outputs = checkError(future.get(), "error invoking JIT function: ");
+    return wrapOutputsAsArrays(outputs);
+  }
+
+private:
+  std::future<AsyncCallResult> future;
+};
+
+// A call returned by JITModule.prepare. The outputs are written into the
+// same arrays on every call, so that calling it only creates the Tensor's
+// borrowing the inputs (and the arrays of the outputs with dynamic shapes).
+class PreparedInvocation {
+public:
+  PreparedInvocation(PreparedCall preparedCall)
+      : call(std::move(preparedCall)), outputs(call.createOutputs()) {
+    py::tuple arrays(outputs.size());
+    for (size_t i = 0, e = outputs.size(); i < e; i++) {
+      if (outputs[i].isTensor()) {
+        arrays[i] = wrapTensorAsArray(outputs[i].toTensor());
+      } else if (outputs[i].isNone()) {
+        arrays[i] = py::none();
+        newOutputs.push_back(i);
+      } else {
+        throw py::raiseValueError("prepared calls only support tensor results");
+      }
+    }
+    outputArrays = std::move(arrays);
+  }
+
+  StringRef getFunctionName() const { return call.getFunctionName(); }
+
+  // Returns the tuple of output arrays, which the next call overwrites.
+  py::tuple operator()(py::args inputs) {
+    // The outputs are shared by all calls.
+    if (running)
+      throw py::raisePyError(PyExc_RuntimeError,
+                             "prepared call is already running");
+    BorrowedInputs borrowed(inputs.size());
+    SmallVector<RtValue, 6> inputValues;
+    inputValues.reserve(inputs.size());
+    for (py::handle input : inputs)
+      inputValues.push_back(borrowed.borrow(input));
+    running = true;
+    auto invokeWithoutGIL = [&]() {
+      py::gil_scoped_release release;
+      return call.invokeInto(inputValues, outputs);
+    };
+    llvm::Error error = invokeWithoutGIL();
+    running = false;
+    checkError(std::move(error), "error invoking JIT function: ");
+
+    if (newOutputs.empty())
+      return outputArrays;
+    // Results without an output buffer get new arrays, and their slots are
+    // reset for the next call.
+    py::tuple arrays(outputs.size());
+    for (size_t i = 0, e = outputs.size(); i < e; i++)
+      arrays[i] = outputArrays[i];
+    for (size_t i : newOutputs)
+      arrays[i] = wrapTensorAsArray(outputs[i].takeTensor());
+    return arrays;
+  }
+
+private:
+  PreparedCall call;
+  SmallVector<RtValue, 6> outputs;
+  // The arrays viewing `outputs`, with None for `newOutputs`.
+  py::tuple outputArrays;
+  // The outputs that invokeInto creates, as they have no output buffer.
+  SmallVector<size_t, 2> newOutputs;
+  bool running = false;
+};
+
+// An object store calling Python functions, such as ones fetching and storing
+// the object code over HTTP.
+class PyObjectStore : public ObjectStore {
+public:
+  PyObjectStore(py::function fetchFn, py::function storeFn)
+      : fetchFn(std::move(fetchFn)), storeFn(std::move(storeFn)) {}
+  ~PyObjectStore() override {
+    if (!Py_IsInitialized()) {
+      fetchFn.release();
+      storeFn.release();
+      return;
+    }
+    // The store may be released by a compiling thread.
+    py::gil_scoped_acquire acquire;
+    fetchFn = py::function();
+    storeFn = py::function();
+  }
+
+  std::unique_ptr<llvm::MemoryBuffer> fetch(llvm::StringRef key) override {
+    py::gil_scoped_acquire acquire;
+    try {
+      py::object object = fetchFn(key.str());
+      if (object.is_none())
+        return nullptr;
+      return llvm::MemoryBuffer::getMemBufferCopy(
+          std::string(object.cast<py::bytes>()), key);
+    } catch (py::error_already_set &e) {
+      // A store that can't be reached is a miss.
+      e.discard_as_unraisable("fetching from an object store");
+      return nullptr;
+    }
+  }
+
+  void store(llvm::StringRef key, llvm::StringRef object) override {
+    py::gil_scoped_acquire acquire;
+    try {
+      storeFn(key.str(), py::bytes(object.data(), object.size()));
+    } catch (py::error_already_set &e) {
+      e.discard_as_unraisable("storing to an object store");
+    }
+  }
+
+private:
+  py::function fetchFn;
+  py::function storeFn;
+};
+
+// The pending result of CompilationService.compile_async.
+class AsyncCompilation {
+public:
+  AsyncCompilation(std::future<CompilationService::Result> future)
+      : future(std::move(future)) {}
+
+  bool done() const {
+    return future.wait_for(std::chrono::seconds(0)) ==
+           std::future_status::ready;
+  }
+
+  std::unique_ptr<JITModule> result() {
+    if (!future.valid())
+      throw py::raisePyError(PyExc_RuntimeError,
+                             "result of compilation was already retrieved");
+    {
+      py::gil_scoped_release release;
+      future.wait();
+    }
+    return checkError(future.get(), "error compiling module: ");
+  }
+
+private:
+  std::future<CompilationService::Result> future;
+};
+} // namespace
+
+static CompilationOptions
+getCompilationOptions(bool optimize, bool profileOps,
+                      std::vector<int64_t> specializedBatchSizes,
+                      unsigned optLevel, std::string cpu, std::string features,
+                      bool lazy, bool hugePageWeights) {
+  CompilationOptions options;
+  options.optimize = optimize;
+  options.profileOps = profileOps;
+  options.specializedBatchSizes = std::move(specializedBatchSizes);
+  options.jitOptions.optLevel = optLevel;
+  options.jitOptions.cpu = std::move(cpu);
+  options.jitOptions.features = std::move(features);
+  options.jitOptions.lazy = lazy;
+  options.jitOptions.hugePageWeights = hugePageWeights;
+  return options;
 }
 
 void npcomp::python::defineBackendRefJitModule(py::module &m) {
-  m.def("build_backend_compilation_pipeline", [](MlirPassManager capiPm) {
-    mlir::PassManager *pm = unwrap(capiPm);
-    JITModule::buildBackendCompilationPipeline(*pm);
+  m.def(
+      "build_backend_compilation_pipeline",
+      [](MlirPassManager capiPm, bool profileOps,
+         std::vector<int64_t> specializedBatchSizes, bool optimize) {
+        mlir::PassManager *pm = unwrap(capiPm);
+        mlir::NPCOMP::RefBackendLoweringPipelineOptions options;
+        options.optimize = optimize;
+        options.profileOps = profileOps;
+        options.specializeBatchSizes = specializedBatchSizes;
+        JITModule::buildBackendCompilationPipeline(*pm, options);
+      },
+      py::arg("pm"), py::arg("profile_ops") = false,
+      py::arg("specialized_batch_sizes") = std::vector<int64_t>(),
+      py::arg("optimize") = false);
+  m.def(
+      "enable_compile_time_report",
+      [](MlirPassManager capiPm) {
+        mlir::NPCOMP::enableCompileTimeReport(*unwrap(capiPm));
+      },
+      py::arg("pm"));
+  m.def(
+      "set_compile_threads",
+      [](MlirContext capiContext, unsigned numThreads) {
+        mlir::NPCOMP::setNumCompileThreads(*unwrap(capiContext), numThreads);
+      },
+      py::arg("context"), py::arg("num_threads"));
+  // The threads of the runtime's parallel loops (see refbackrt::setNumThreads).
+  m.def("set_num_threads", &refbackrt::setNumThreads, py::arg("num_threads"));
+  m.def("get_num_threads", &refbackrt::getNumThreads);
+  m.def("set_instrumentation_enabled", &refbackrt::setInstrumentationEnabled,
+        py::arg("enabled"));
+  m.def("is_instrumentation_enabled", &refbackrt::isInstrumentationEnabled);
+  m.def("reset_function_stats", &refbackrt::resetFunctionStats);
+  // The per-op profile of code compiled with `profile_ops`, as a list of
+  // dicts, one per profiled op.
+  m.def("get_op_profile", []() {
+    std::vector<refbackrt::OpProfileEntry> entries(refbackrt::kMaxProfiledOps);
+    int numOps = refbackrt::getOpProfile(entries.data(), entries.size());
+    py::list result;
+    for (int i = 0; i < numOps; i++) {
+      py::dict entry;
+      entry["name"] = entries[i].name;
+      entry["num_calls"] = entries[i].numCalls;
+      entry["total_ns"] = entries[i].totalNanoseconds;
+      result.append(entry);
+    }
+    return result;
+  });
+  m.def(
+      "write_op_profile_as_chrome_trace",
+      [](std::string path) {
+        if (!refbackrt::writeOpProfileAsChromeTrace(path.c_str()))
+          throw py::raisePyError(PyExc_OSError,
+                                 ("could not write " + path).c_str());
+      },
+      py::arg("path"));
+  m.def("reset_op_profile", &refbackrt::resetOpProfile);
+  m.def("set_memory_profiling_enabled", &refbackrt::setMemoryProfilingEnabled,
+        py::arg("enabled"));
+  m.def("is_memory_profiling_enabled", &refbackrt::isMemoryProfilingEnabled);
+  // The events of the memory profile, as a list of dicts in order. The
+  // "function" of an event is the name of the call it happened in, or None.
+  m.def("get_memory_profile", []() {
+    std::int64_t numEvents = std::min<std::int64_t>(
+        refbackrt::getMemoryProfile(nullptr, 0), refbackrt::kMaxMemoryEvents);
+    std::vector<refbackrt::MemoryEvent> events(numEvents);
+    numEvents = std::min<std::int64_t>(
+        refbackrt::getMemoryProfile(events.data(), numEvents), numEvents);
+    py::list result;
+    for (std::int64_t i = 0; i < numEvents; i++) {
+      const refbackrt::MemoryEvent &event = events[i];
+      py::dict entry;
+      switch (event.kind) {
+      case refbackrt::MemoryEventKind::Allocate:
+        entry["kind"] = "allocate";
+        break;
+      case refbackrt::MemoryEventKind::Free:
+        entry["kind"] = "free";
+        break;
+      case refbackrt::MemoryEventKind::CallBegin:
+        entry["kind"] = "call_begin";
+        break;
+      case refbackrt::MemoryEventKind::CallEnd:
+        entry["kind"] = "call_end";
+        break;
+      }
+      entry["site"] = event.site ? py::object(py::str(event.site)) : py::none();
+      if (event.function) {
+        refbackrt::StringRef name = refbackrt::getFunctionName(event.function);
+        entry["function"] = std::string(name.data(), name.size());
+      } else {
+        entry["function"] = py::none();
+      }
+      entry["bytes"] = event.bytes;
+      entry["live_bytes"] = event.liveBytes;
+      entry["ns"] = event.nanoseconds;
+      entry["thread"] = event.thread;
+      result.append(entry);
+    }
+    return result;
   });
+  m.def(
+      "write_memory_profile_as_chrome_trace",
+      [](std::string path) {
+        if (!refbackrt::writeMemoryProfileAsChromeTrace(path.c_str()))
+          throw py::raisePyError(PyExc_OSError,
+                                 ("could not write " + path).c_str());
+      },
+      py::arg("path"));
+  m.def("reset_memory_profile", &refbackrt::resetMemoryProfile);
+  // Returns a DLPack capsule viewing an array returned by a JITModule, which
+  // keeps the output alive. Read-only arrays (constants of the module) are
+  // copied.
+  m.def(
+      "to_dlpack",
+      [](py::array array) {
+        return exportTensorAsDLPack(getArrayTensor(array));
+      },
+      py::arg("array"));
+  // Makes the external globals (weights) of a module lowered by the backend
+  // compilation pipeline that are stored in `path` be read from `new_path`,
+  // a file with the same layout. Returns the number of globals moved. The
+  // object code of the module is still found in the object cache afterwards.
+  m.def(
+      "replace_external_weights_path",
+      [](MlirModule capiModule, std::string path, std::string newPath) {
+        return mlir::NPCOMP::replaceExternalGlobalsPath(unwrap(capiModule),
+                                                        path, newPath);
+      },
+      py::arg("module"), py::arg("path"), py::arg("new_path"));
+  // Stores of object code shared by the processes of a fleet.
+  py::class_<ObjectStore, std::shared_ptr<ObjectStore>>(m, "ObjectStore")
+      .def_static(
+          "directory",
+          [](std::string directory) {
+            return ObjectStore::createDirectoryStore(directory);
+          },
+          py::arg("directory"))
+      .def_static(
+          "from_functions",
+          [](py::function fetch, py::function store)
+              -> std::shared_ptr<ObjectStore> {
+            return std::make_shared<PyObjectStore>(std::move(fetch),
+                                                   std::move(store));
+          },
+          py::arg("fetch"), py::arg("store"));
   py::class_<JITModule>(m, "JITModule")
       .def_static(
           "from_compiled_module",
-          [](MlirModule capiModule, std::vector<std::string> pySharedLibs)
+          [](MlirModule capiModule, std::vector<std::string> pySharedLibs,
+             std::string objectCacheDir, unsigned optLevel, std::string cpu,
+             std::string features, bool lazy, bool hugePageWeights,
+             unsigned compileThreads, bool streaming,
+             std::shared_ptr<ObjectStore> sharedObjectStore)
               -> std::unique_ptr<JITModule> {
             SmallVector<StringRef, 4> sharedLibs(pySharedLibs.begin(),
                                                  pySharedLibs.end());
             auto module = unwrap(capiModule);
-            auto jitModule =
-                checkError(JITModule::fromCompiledModule(module, sharedLibs),
-                           "error creating JITModule: ");
-            return jitModule;
+            JITCompileOptions compileOptions;
+            compileOptions.optLevel = optLevel;
+            compileOptions.cpu = cpu;
+            compileOptions.features = features;
+            compileOptions.lazy = lazy;
+            compileOptions.hugePageWeights = hugePageWeights;
+            compileOptions.compileThreads = compileThreads;
+            compileOptions.streaming = streaming;
+            compileOptions.sharedObjectStore = std::move(sharedObjectStore);
+            auto compileWithoutGIL = [&]() {
+              // The compile threads of the JIT may call into a Python
+              // object store.
+              py::gil_scoped_release release;
+              return JITModule::fromCompiledModule(module, sharedLibs,
+                                                   objectCacheDir,
+                                                   compileOptions);
+            };
+            return checkError(compileWithoutGIL(),
+                              "error creating JITModule: ");
           },
-          py::arg("module"), py::arg("shared_libs"))
+          py::arg("module"), py::arg("shared_libs"),
+          py::arg("object_cache_dir") = "", py::arg("opt_level") = 2,
+          py::arg("cpu") = "", py::arg("features") = "",
+          py::arg("lazy") = false, py::arg("huge_page_weights") = false,
+          py::arg("compile_threads") = 0, py::arg("streaming") = false,
+          py::arg("shared_object_store") = nullptr)
       .def(
           "invoke",
           [](JITModule &self, std::string functionName,
-             std::vector<py::buffer> inputs) {
-            // Prepare inputs.
+             std::vector<py::object> inputs, std::string priority,
+             py::object timeout) {
+            refbackrt::RequestSchedule schedule =
+                getRequestSchedule(priority, timeout);
+            // Prepare inputs. The input Tensor's borrow the memory of the
+            // buffers or DLPack tensors, which stay alive until after the
+            // Tensor's are destroyed. The runtime copies any input that the
+            // compiled code might write to, so the inputs are never modified.
+            BorrowedInputs borrowed(inputs.size());
             llvm::SmallVector<RtValue, 4> inputValues;
             inputValues.reserve(inputs.size());
-            for (py::buffer &inputBuffer : inputs) {
-              inputValues.push_back(copyBufferToTensor(inputBuffer));
+            for (py::object &input : inputs) {
+              inputValues.push_back(borrowed.borrow(input));
             }
-
-            auto outputs = checkError(self.invoke(functionName, inputValues),
+            auto invokeWithoutGIL = [&]() {
+              // Let other Python threads run while we execute native code.
+              py::gil_scoped_release release;
+              return self.invoke(functionName, inputValues, schedule);
+            };
+            auto outputs = checkError(invokeWithoutGIL(),
                                       "error invoking JIT function: ");
-            std::vector<py::array> outputArrays;
-            outputArrays.reserve(outputs.size());
-            for (RtValue &outputTensor : outputs) {
-              outputArrays.push_back(wrapTensorAsArray(outputTensor.toTensor()));
+            return wrapOutputsAsArrays(outputs);
+          },
+          py::arg("function_name"), py::arg("inputs"),
+          py::arg("priority") = "normal", py::arg("timeout") = py::none())
+      .def(
+          "prepare",
+          [](JITModule &self, std::string functionName,
+             std::vector<py::object> exampleInputs) {
+            BorrowedInputs borrowed(exampleInputs.size());
+            SmallVector<RtValue, 6> inputValues;
+            for (py::object &input : exampleInputs)
+              inputValues.push_back(borrowed.borrow(input));
+            return PreparedInvocation(
+                checkError(self.prepare(functionName, inputValues),
+                           "error preparing JIT function: "));
+          },
+          py::arg("function_name"), py::arg("example_inputs"),
+          // The prepared call runs the code of the JITModule.
+          py::keep_alive<0, 1>())
+      .def(
+          "warmup",
+          [](JITModule &self, std::string functionName, py::object shapes) {
+            auto metadata = checkError(self.getMetadata(functionName),
+                                       "error warming up JIT function: ");
+            // Shapes given as None keep the static shape of the signature.
+            llvm::SmallVector<refbackrt::InputArgInfo, 6> signature(
+                metadata.inputArgInfos.begin(), metadata.inputArgInfos.end());
+            if (!shapes.is_none()) {
+              auto shapeList = shapes.cast<std::vector<py::object>>();
+              if (shapeList.size() != signature.size())
+                throw py::value_error("expected " +
+                                      std::to_string(signature.size()) +
+                                      " shapes");
+              for (size_t i = 0; i < shapeList.size(); i++) {
+                if (shapeList[i].is_none())
+                  continue;
+                auto extents = shapeList[i].cast<std::vector<int64_t>>();
+                signature[i].rank = extents.size();
+                signature[i].extents.resize(extents.size());
+                std::copy(extents.begin(), extents.end(),
+                          signature[i].extents.begin());
+              }
+            }
+            auto warmupWithoutGIL = [&]() {
+              py::gil_scoped_release release;
+              return self.warmup(functionName, signature);
+            };
+            checkError(warmupWithoutGIL(), "error warming up JIT function: ");
+          },
+          py::arg("function_name"), py::arg("shapes") = py::none())
+      .def(
+          "invoke_async",
+          [](JITModule &self, std::string functionName,
+             std::vector<py::object> inputs, std::string priority,
+             py::object timeout) {
+            refbackrt::RequestSchedule schedule =
+                getRequestSchedule(priority, timeout);
+            // Inputs are copied here, while we hold the GIL.
+            llvm::SmallVector<RtValue, 4> inputValues;
+            inputValues.reserve(inputs.size());
+            for (py::object &input : inputs) {
+              inputValues.push_back(copyInputToTensor(input));
             }
-            return outputArrays;
+            return AsyncInvocation(
+                self.invokeAsync(functionName, inputValues, schedule));
+          },
+          py::arg("function_name"), py::arg("inputs"),
+          py::arg("priority") = "normal", py::arg("timeout") = py::none(),
+          // The invocation runs on the JITModule's thread pool.
+          py::keep_alive<0, 1>())
+      .def(
+          "get_function_stats",
+          [](JITModule &self, std::string functionName) {
+            refbackrt::FunctionStats stats =
+                checkError(self.getFunctionStats(functionName),
+                           "error getting function stats: ");
+            py::dict result;
+            result["num_calls"] = stats.numCalls;
+            result["total_ns"] = stats.totalNanoseconds;
+            // See refbackrt::kNumLatencyBuckets for the bucket bounds.
+            result["latency_histogram_us"] = std::vector<std::int64_t>(
+                stats.latencyHistogram.begin(), stats.latencyHistogram.end());
+            result["bytes_copied_in"] = stats.bytesCopiedIn;
+            result["bytes_copied_out"] = stats.bytesCopiedOut;
+            return result;
+          },
+          py::arg("function_name"))
+      .def(
+          "get_memory_footprint",
+          [](JITModule &self, std::string functionName) {
+            refbackrt::FunctionMetadata metadata =
+                checkError(self.getMetadata(functionName),
+                           "error getting function metadata: ");
+            // Sizes in bytes, or -1 if unknown.
+            py::dict result;
+            result["constant_bytes"] = metadata.constantBytes;
+            result["peak_intermediate_bytes"] = metadata.peakScratchBytes;
+            result["input_bytes"] = metadata.inputBytes;
+            result["output_bytes"] = metadata.outputBytes;
+            return result;
           },
-          py::arg("function_name"), py::arg("inputs"));
+          py::arg("function_name"));
+
+  // The pending result of `JITModule.invoke_async`. `result()` blocks (with the
+  // GIL released) until the invocation completes.
+  py::class_<AsyncInvocation>(m, "AsyncInvocation")
+      .def("done", &AsyncInvocation::done)
+      .def("result", &AsyncInvocation::result);
+
+  // A call returned by `JITModule.prepare`, which takes the inputs as
+  // positional arguments of the same types and shapes as the example inputs.
+  // It returns a tuple of the outputs, whose arrays (except for outputs with
+  // dynamic shapes) are reused: each call overwrites the results of the
+  // previous one, and calls can't overlap.
+  py::class_<PreparedInvocation>(m, "PreparedCall")
+      .def("__call__", &PreparedInvocation::operator())
+      .def_property_readonly("function_name",
+                             [](PreparedInvocation &self) {
+                               return self.getFunctionName().str();
+                             });
+
+  // Compiles the text of modules, in the form expected by
+  // `build_backend_compilation_pipeline`, to JITModules. The contexts, pass
+  // managers and LLVM targets used for compiling are kept across
+  // compilations, which run concurrently on the threads of the service.
+  py::class_<CompilationService>(m, "CompilationService")
+      .def(py::init([](std::vector<std::string> sharedLibs,
+                       std::string objectCacheDir, unsigned numThreads,
+                       unsigned maxCompilationsPerContext,
+                       std::shared_ptr<ObjectStore> sharedObjectStore) {
+             mlir::DialectRegistry registry;
+             mlir::registerAllDialects(registry);
+             mlir::NPCOMP::registerAllDialects(registry);
+             CompilationServiceOptions options;
+             options.numThreads = numThreads;
+             options.maxCompilationsPerContext = maxCompilationsPerContext;
+             options.sharedLibs = std::move(sharedLibs);
+             options.objectCacheDir = std::move(objectCacheDir);
+             options.sharedObjectStore = std::move(sharedObjectStore);
+             return std::make_unique<CompilationService>(registry,
+                                                         std::move(options));
+           }),
+           py::arg("shared_libs"), py::arg("object_cache_dir") = "",
+           py::arg("num_threads") = 0,
+           py::arg("max_compilations_per_context") = 256,
+           py::arg("shared_object_store") = nullptr)
+      .def(
+          "compile",
+          [](CompilationService &self, std::string source, bool optimize,
+             bool profileOps, std::vector<int64_t> specializedBatchSizes,
+             unsigned optLevel, std::string cpu, std::string features,
+             bool lazy, bool hugePageWeights) {
+            CompilationOptions options = getCompilationOptions(
+                optimize, profileOps, std::move(specializedBatchSizes),
+                optLevel, std::move(cpu), std::move(features), lazy,
+                hugePageWeights);
+            auto compileWithoutGIL = [&]() {
+              py::gil_scoped_release release;
+              return self.compile(source, options);
+            };
+            return checkError(compileWithoutGIL(), "error compiling module: ");
+          },
+          py::arg("source"), py::arg("optimize") = false,
+          py::arg("profile_ops") = false,
+          py::arg("specialized_batch_sizes") = std::vector<int64_t>(),
+          py::arg("opt_level") = 2, py::arg("cpu") = "",
+          py::arg("features") = "", py::arg("lazy") = false,
+          py::arg("huge_page_weights") = false)
+      .def(
+          "compile_async",
+          [](CompilationService &self, std::string source, bool optimize,
+             bool profileOps, std::vector<int64_t> specializedBatchSizes,
+             unsigned optLevel, std::string cpu, std::string features,
+             bool lazy, bool hugePageWeights) {
+            return AsyncCompilation(self.compileAsync(
+                std::move(source),
+                getCompilationOptions(optimize, profileOps,
+                                      std::move(specializedBatchSizes),
+                                      optLevel, std::move(cpu),
+                                      std::move(features), lazy,
+                                      hugePageWeights)));
+          },
+          py::arg("source"), py::arg("optimize") = false,
+          py::arg("profile_ops") = false,
+          py::arg("specialized_batch_sizes") = std::vector<int64_t>(),
+          py::arg("opt_level") = 2, py::arg("cpu") = "",
+          py::arg("features") = "", py::arg("lazy") = false,
+          py::arg("huge_page_weights") = false)
+      .def(
+          "compile_tiered",
+          [](CompilationService &self, std::string source,
+             unsigned promoteAfterCalls, bool profileOps,
+             std::vector<int64_t> specializedBatchSizes, std::string cpu,
+             std::string features, std::string tuningDatabase) {
+            // The tiers select the passes and the LLVM options.
+            CompilationOptions options = getCompilationOptions(
+                /*optimize=*/false, profileOps,
+                std::move(specializedBatchSizes), /*optLevel=*/0,
+                std::move(cpu), std::move(features), /*lazy=*/false,
+                /*hugePageWeights=*/false);
+            options.tuningDatabase = std::move(tuningDatabase);
+            auto compileWithoutGIL = [&]() {
+              py::gil_scoped_release release;
+              return self.compileTiered(source, options, promoteAfterCalls);
+            };
+            return checkError(compileWithoutGIL(), "error compiling module: ");
+          },
+          py::arg("source"), py::arg("promote_after_calls") = 100,
+          py::arg("profile_ops") = false,
+          py::arg("specialized_batch_sizes") = std::vector<int64_t>(),
+          py::arg("cpu") = "", py::arg("features") = "",
+          py::arg("tuning_database") = "",
+          // The optimized tier is compiled on the service.
+          py::keep_alive<0, 1>())
+      .def_property_readonly("num_threads", &CompilationService::getNumThreads);
+
+  // A module returned by `CompilationService.compile_tiered`. The calls of
+  // each function run the code of the fast tier until the function has been
+  // invoked `promote_after_calls` times, and its optimized code once its
+  // compilation in the background completes.
+  py::class_<TieredJITModule>(m, "TieredJITModule")
+      .def(
+          "invoke",
+          [](TieredJITModule &self, std::string functionName,
+             std::vector<py::object> inputs) {
+            BorrowedInputs borrowed(inputs.size());
+            llvm::SmallVector<RtValue, 4> inputValues;
+            inputValues.reserve(inputs.size());
+            for (py::object &input : inputs)
+              inputValues.push_back(borrowed.borrow(input));
+            auto invokeWithoutGIL = [&]() {
+              py::gil_scoped_release release;
+              return self.invoke(functionName, inputValues);
+            };
+            auto outputs = checkError(invokeWithoutGIL(),
+                                      "error invoking JIT function: ");
+            return wrapOutputsAsArrays(outputs);
+          },
+          py::arg("function_name"), py::arg("inputs"))
+      .def(
+          "wait_for_optimized",
+          [](TieredJITModule &self, std::string functionName) {
+            auto waitWithoutGIL = [&]() {
+              py::gil_scoped_release release;
+              return self.waitForOptimized(functionName);
+            };
+            checkError(waitWithoutGIL(), "error compiling module: ");
+          },
+          py::arg("function_name"))
+      .def(
+          "is_optimized",
+          [](TieredJITModule &self, std::string functionName) {
+            return self.isOptimized(functionName);
+          },
+          py::arg("function_name"));
+
+  // The pending result of `CompilationService.compile_async`. `result()`
+  // blocks (with the GIL released) until the compilation completes, and
+  // returns the JITModule.
+  py::class_<AsyncCompilation>(m, "AsyncCompilation")
+      .def("done", &AsyncCompilation::done)
+      .def("result", &AsyncCompilation::result);
 
   // A Ref<Tensor> needs to be bound because we use it as a base for the
   // ndarray (the array retains a reference to it). Users should not encounter
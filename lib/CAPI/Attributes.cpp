@@ -0,0 +1,61 @@
+//===- Attributes.cpp - C Interface for NPComp attributes -----------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "npcomp-c/Attributes.h"
+
+#include "mlir/CAPI/IR.h"
+#include "mlir/CAPI/Support.h"
+#include "mlir/IR/BuiltinAttributes.h"
+#include "mlir/IR/BuiltinTypes.h"
+#include "npcomp/Dialect/Refback/IR/RefbackDialect.h"
+
+#include <cstring>
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+/*============================================================================*/
+/* External elements attribute.                                               */
+/*============================================================================*/
+
+MlirAttribute npcompExternalElementsAttrGet(MlirType shapedType,
+                                            MlirStringRef path,
+                                            uint64_t offset) {
+  return wrap(refback::getExternalElementsAttr(
+      unwrap(shapedType).cast<ShapedType>(), unwrap(path), offset));
+}
+
+int npcompAttributeIsAExternalElements(MlirAttribute attr) {
+  return refback::getExternalElements(unwrap(attr)).hasValue();
+}
+
+/*============================================================================*/
+/* Dense elements attribute.                                                  */
+/*============================================================================*/
+
+MlirAttribute npcompDenseElementsAttrGetFromBuffer(MlirType shapedType,
+                                                   size_t rawBufferSize,
+                                                   const void *rawBuffer) {
+  auto type = unwrap(shapedType).cast<ShapedType>();
+  const char *data = static_cast<const char *>(rawBuffer);
+  int64_t numElements = type.getNumElements();
+  size_t elementSize = numElements > 0 ? rawBufferSize / numElements : 0;
+  // The elements are all equal if the buffer is equal to itself shifted by
+  // one element.
+  bool isSplat = numElements > 0 &&
+                 std::memcmp(data, data + elementSize,
+                             rawBufferSize - elementSize) == 0;
+  size_t size = isSplat ? elementSize : rawBufferSize;
+  // Attributes of i1 store their elements as bits, which DenseElementsAttr
+  // packs from bools.
+  if (type.getElementType().isInteger(1))
+    return wrap(DenseElementsAttr::get(
+        type, llvm::makeArrayRef(reinterpret_cast<const bool *>(data), size)));
+  return wrap(DenseElementsAttr::getFromRawBuffer(
+      type, llvm::makeArrayRef(data, size), isSplat));
+}
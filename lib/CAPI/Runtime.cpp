@@ -0,0 +1,331 @@
+//===- Runtime.cpp - C Interface for running compiled modules -------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "npcomp-c/Runtime.h"
+
+#include "mlir/CAPI/IR.h"
+#include "mlir/CAPI/Pass.h"
+#include "mlir/CAPI/Support.h"
+#include "npcomp/RefBackend/JITHelpers/JITModule.h"
+
+#include <algorithm>
+#include <future>
+#include <string>
+
+using namespace mlir;
+using refback::JITModule;
+using refbackrt::Ref;
+using refbackrt::RtValue;
+using refbackrt::Tensor;
+
+using Outputs = llvm::SmallVector<RtValue, 6>;
+using PendingOutputs = std::future<refback::AsyncCallResult>;
+
+// The C enums mirror the runtime's.
+static_assert(static_cast<int>(refbackrt::ArgType::kTensor) ==
+                      NpcompRtArgTypeTensor &&
+                  static_cast<int>(refbackrt::ArgType::kI1) ==
+                      NpcompRtArgTypeI1,
+              "NpcompRtArgType doesn't match refbackrt::ArgType");
+static_assert(static_cast<int>(refbackrt::ElementType::F32) ==
+                      NpcompRtElementTypeF32 &&
+                  static_cast<int>(refbackrt::ElementType::I1) ==
+                      NpcompRtElementTypeI1,
+              "NpcompRtElementType doesn't match refbackrt::ElementType");
+static_assert(static_cast<int>(refbackrt::Priority::Low) ==
+                  NpcompRtPriorityLow,
+              "NpcompRtPriority doesn't match refbackrt::Priority");
+
+static thread_local std::string lastErrorMessage;
+
+static void setLastError(llvm::Error error) {
+  lastErrorMessage = llvm::toString(std::move(error));
+}
+
+static void setLastError(const llvm::Twine &message) {
+  lastErrorMessage = message.str();
+}
+
+const char *npcompRtGetLastErrorMessage(void) {
+  return lastErrorMessage.c_str();
+}
+
+static JITModule *unwrap(NpcompRtModule module) {
+  return static_cast<JITModule *>(module.ptr);
+}
+
+static refbackrt::FunctionHandle unwrap(NpcompRtFunction function) {
+  return refbackrt::FunctionHandle(
+      static_cast<refbackrt::FuncDescriptor *>(function.ptr));
+}
+
+// Tensor handles own a Ref to the tensor.
+static Ref<Tensor> &unwrap(NpcompRtTensor tensor) {
+  return *static_cast<Ref<Tensor> *>(tensor.ptr);
+}
+
+static NpcompRtTensor wrap(Ref<Tensor> tensor) {
+  return NpcompRtTensor{new Ref<Tensor>(std::move(tensor))};
+}
+
+static PendingOutputs *unwrap(NpcompRtInvocation invocation) {
+  return static_cast<PendingOutputs *>(invocation.ptr);
+}
+
+/*============================================================================*/
+/* Modules.                                                                   */
+/*============================================================================*/
+
+void npcompRtBuildBackendCompilationPipeline(MlirPassManager pm,
+                                             bool optimize) {
+  mlir::NPCOMP::RefBackendLoweringPipelineOptions options;
+  options.optimize = optimize;
+  JITModule::buildBackendCompilationPipeline(*unwrap(pm), options);
+}
+
+NpcompRtModule npcompRtModuleCreateFromCompiledModule(
+    MlirModule module, intptr_t numSharedLibs,
+    const MlirStringRef *sharedLibs) {
+  llvm::SmallVector<llvm::StringRef, 4> libs;
+  for (intptr_t i = 0; i < numSharedLibs; i++)
+    libs.push_back(unwrap(sharedLibs[i]));
+  auto jitModule = JITModule::fromCompiledModule(unwrap(module), libs);
+  if (!jitModule) {
+    setLastError(jitModule.takeError());
+    return {nullptr};
+  }
+  return {jitModule->release()};
+}
+
+NpcompRtModule npcompRtModuleCreateFromSharedObject(MlirStringRef path) {
+  auto jitModule = JITModule::fromSharedObject(unwrap(path));
+  if (!jitModule) {
+    setLastError(jitModule.takeError());
+    return {nullptr};
+  }
+  return {jitModule->release()};
+}
+
+void npcompRtModuleDestroy(NpcompRtModule module) { delete unwrap(module); }
+
+/*============================================================================*/
+/* Functions.                                                                 */
+/*============================================================================*/
+
+NpcompRtFunction npcompRtModuleLookupFunction(NpcompRtModule module,
+                                              MlirStringRef name) {
+  auto function = unwrap(module)->lookup(unwrap(name));
+  if (!function) {
+    setLastError(function.takeError());
+    return {nullptr};
+  }
+  return {function->getDescriptor()};
+}
+
+MlirStringRef npcompRtFunctionGetName(NpcompRtFunction function) {
+  refbackrt::StringRef name = refbackrt::getFunctionName(unwrap(function));
+  return mlirStringRefCreate(name.data(), name.size());
+}
+
+static refbackrt::FunctionMetadata getMetadata(NpcompRtFunction function) {
+  refbackrt::FunctionMetadata metadata;
+  refbackrt::getMetadata(unwrap(function), metadata);
+  return metadata;
+}
+
+template <typename ArgInfo>
+static NpcompRtArgInfo wrapArgInfo(const ArgInfo &info) {
+  NpcompRtArgInfo result;
+  result.argType = static_cast<NpcompRtArgType>(info.argType);
+  result.elementType = static_cast<NpcompRtElementType>(info.elementType);
+  result.rank = info.rank;
+  return result;
+}
+
+template <typename ArgInfo>
+static void copyExtents(const ArgInfo &info, int64_t *extents) {
+  std::copy(info.extents.begin(), info.extents.end(), extents);
+}
+
+intptr_t npcompRtFunctionGetNumInputs(NpcompRtFunction function) {
+  return getMetadata(function).numInputs;
+}
+
+intptr_t npcompRtFunctionGetNumOutputs(NpcompRtFunction function) {
+  return getMetadata(function).numOutputs;
+}
+
+NpcompRtArgInfo npcompRtFunctionGetInputInfo(NpcompRtFunction function,
+                                             intptr_t pos) {
+  return wrapArgInfo(getMetadata(function).inputArgInfos[pos]);
+}
+
+NpcompRtArgInfo npcompRtFunctionGetOutputInfo(NpcompRtFunction function,
+                                              intptr_t pos) {
+  return wrapArgInfo(getMetadata(function).outputArgInfos[pos]);
+}
+
+void npcompRtFunctionGetInputExtents(NpcompRtFunction function, intptr_t pos,
+                                     int64_t *extents) {
+  copyExtents(getMetadata(function).inputArgInfos[pos], extents);
+}
+
+void npcompRtFunctionGetOutputExtents(NpcompRtFunction function, intptr_t pos,
+                                      int64_t *extents) {
+  copyExtents(getMetadata(function).outputArgInfos[pos], extents);
+}
+
+/*============================================================================*/
+/* Tensors.                                                                   */
+/*============================================================================*/
+
+NpcompRtTensor npcompRtTensorCreateBorrowing(NpcompRtElementType elementType,
+                                             intptr_t rank,
+                                             const int64_t *extents,
+                                             const int64_t *strides,
+                                             void *data) {
+  refbackrt::ArrayRef<std::int64_t> extentsRef(extents, rank);
+  auto type = static_cast<refbackrt::ElementType>(elementType);
+  if (!strides)
+    return wrap(Tensor::createBorrowingBuffer(extentsRef, type, data));
+  return wrap(Tensor::createBorrowingBuffer(
+      extentsRef, refbackrt::ArrayRef<std::int64_t>(strides, rank), type,
+      data));
+}
+
+NpcompRtTensor npcompRtTensorCreateCopy(NpcompRtElementType elementType,
+                                        intptr_t rank, const int64_t *extents,
+                                        const void *data) {
+  return wrap(Tensor::create(refbackrt::ArrayRef<std::int64_t>(extents, rank),
+                             static_cast<refbackrt::ElementType>(elementType),
+                             const_cast<void *>(data)));
+}
+
+void npcompRtTensorDestroy(NpcompRtTensor tensor) { delete &unwrap(tensor); }
+
+NpcompRtElementType npcompRtTensorGetElementType(NpcompRtTensor tensor) {
+  return static_cast<NpcompRtElementType>(unwrap(tensor)->getElementType());
+}
+
+intptr_t npcompRtTensorGetRank(NpcompRtTensor tensor) {
+  return unwrap(tensor)->getRank();
+}
+
+int64_t npcompRtTensorGetExtent(NpcompRtTensor tensor, intptr_t dim) {
+  return unwrap(tensor)->getExtent(dim);
+}
+
+int64_t npcompRtTensorGetStride(NpcompRtTensor tensor, intptr_t dim) {
+  return unwrap(tensor)->getStrides()[dim];
+}
+
+void *npcompRtTensorGetData(NpcompRtTensor tensor) {
+  return unwrap(tensor)->getData();
+}
+
+bool npcompRtTensorIsReadOnly(NpcompRtTensor tensor) {
+  return unwrap(tensor)->isReadOnly();
+}
+
+/*============================================================================*/
+/* Invocation.                                                                */
+/*============================================================================*/
+
+static void getInputs(intptr_t numInputs, const NpcompRtTensor *inputs,
+                      llvm::SmallVectorImpl<RtValue> &values) {
+  values.reserve(numInputs);
+  for (intptr_t i = 0; i < numInputs; i++)
+    values.push_back(unwrap(inputs[i]));
+}
+
+static refbackrt::RequestSchedule
+getRequestSchedule(const NpcompRtSchedule *schedule) {
+  refbackrt::RequestSchedule result;
+  if (schedule) {
+    result.priority = static_cast<refbackrt::Priority>(schedule->priority);
+    result.deadlineNanos = schedule->deadlineNanos;
+  }
+  return result;
+}
+
+// Moves the references to the tensors `values` into `outputs`.
+static MlirLogicalResult wrapOutputs(llvm::MutableArrayRef<RtValue> values,
+                                     intptr_t numOutputs,
+                                     NpcompRtTensor *outputs) {
+  if (static_cast<intptr_t>(values.size()) != numOutputs) {
+    setLastError("expected " + llvm::Twine(values.size()) +
+                 " outputs, but got room for " + llvm::Twine(numOutputs));
+    return mlirLogicalResultFailure();
+  }
+  for (auto value : llvm::enumerate(values)) {
+    if (!value.value().isTensor()) {
+      setLastError("output #" + llvm::Twine(value.index()) +
+                   " is not a tensor");
+      return mlirLogicalResultFailure();
+    }
+  }
+  for (auto value : llvm::enumerate(values))
+    outputs[value.index()] = wrap(value.value().takeTensor());
+  return mlirLogicalResultSuccess();
+}
+
+MlirLogicalResult npcompRtFunctionInvoke(NpcompRtModule module,
+                                         NpcompRtFunction function,
+                                         intptr_t numInputs,
+                                         const NpcompRtTensor *inputs,
+                                         intptr_t numOutputs,
+                                         NpcompRtTensor *outputs,
+                                         const NpcompRtSchedule *schedule) {
+  llvm::SmallVector<RtValue, 6> inputValues;
+  getInputs(numInputs, inputs, inputValues);
+  auto results = unwrap(module)->invoke(unwrap(function), inputValues,
+                                        getRequestSchedule(schedule));
+  if (!results) {
+    setLastError(results.takeError());
+    return mlirLogicalResultFailure();
+  }
+  return wrapOutputs(*results, numOutputs, outputs);
+}
+
+NpcompRtInvocation npcompRtFunctionInvokeAsync(NpcompRtModule module,
+                                               NpcompRtFunction function,
+                                               intptr_t numInputs,
+                                               const NpcompRtTensor *inputs,
+                                               const NpcompRtSchedule *schedule) {
+  llvm::SmallVector<RtValue, 6> inputValues;
+  getInputs(numInputs, inputs, inputValues);
+  refbackrt::StringRef name = refbackrt::getFunctionName(unwrap(function));
+  return {new PendingOutputs(unwrap(module)->invokeAsync(
+      llvm::StringRef(name.data(), name.size()), inputValues,
+      getRequestSchedule(schedule)))};
+}
+
+bool npcompRtInvocationIsDone(NpcompRtInvocation invocation) {
+  return unwrap(invocation)->wait_for(std::chrono::seconds(0)) ==
+         std::future_status::ready;
+}
+
+MlirLogicalResult npcompRtInvocationWait(NpcompRtInvocation invocation,
+                                         intptr_t numOutputs,
+                                         NpcompRtTensor *outputs) {
+  PendingOutputs &pending = *unwrap(invocation);
+  if (!pending.valid()) {
+    setLastError("the results of the invocation were already retrieved");
+    return mlirLogicalResultFailure();
+  }
+  auto results = pending.get();
+  if (!results) {
+    setLastError(results.takeError());
+    return mlirLogicalResultFailure();
+  }
+  return wrapOutputs(*results, numOutputs, outputs);
+}
+
+void npcompRtInvocationDestroy(NpcompRtInvocation invocation) {
+  delete unwrap(invocation);
+}
@@ -25,28 +25,48 @@ bool isLegalBinaryOpType(Type type) {
   return false;
 }
 
-// Convert to std ops when all types match. It is assumed that additional
-// patterns and type inference are used to get into this form.
+// Converts `value` of a legal binary op type to the (promoted) type `type`.
+Value promoteNumeric(PatternRewriter &rewriter, Location loc, Value value,
+                     Type type) {
+  Type valueType = value.getType();
+  if (valueType == type)
+    return value;
+  if (type.isa<FloatType>()) {
+    if (valueType.isa<IntegerType>())
+      return rewriter.create<SIToFPOp>(loc, value, type);
+    return rewriter.create<FPExtOp>(loc, value, type);
+  }
+  return rewriter.create<SignExtendIOp>(loc, value, type);
+}
+
+// Convert to std ops when the result type is the promotion of the operand
+// types (see Basicpy::getPromotedNumericType), promoting the operands to it
+// first. It is assumed that additional patterns and type inference are used
+// to get into this form.
 class NumericBinaryExpr : public OpRewritePattern<Basicpy::BinaryExprOp> {
 public:
   using OpRewritePattern::OpRewritePattern;
   LogicalResult matchAndRewrite(Basicpy::BinaryExprOp op,
                                 PatternRewriter &rewriter) const override {
     // Match failure unless if both:
-    //   a) operands/results are the same type
+    //   a) the result type is the promoted type of the operands
     //   b) matches a set of supported primitive types
     //   c) the operation maps to a simple std op without further massaging
-    auto valueType = op.left().getType();
-    if (valueType != op.right().getType() || valueType != op.result().getType())
-      return failure();
-    if (!isLegalBinaryOpType(valueType))
-      return failure();
-
     auto operation = Basicpy::symbolizeBinaryOperation(op.operation());
     if (!operation)
       return failure();
-    auto left = op.left();
-    auto right = op.right();
+    auto valueType = op.result().getType();
+    if (!isLegalBinaryOpType(valueType) ||
+        !isLegalBinaryOpType(op.left().getType()) ||
+        !isLegalBinaryOpType(op.right().getType()))
+      return failure();
+    if (valueType != Basicpy::getPromotedNumericType(
+                         op.left().getType(), op.right().getType(),
+                         *operation == Basicpy::BinaryOperation::Div))
+      return failure();
+
+    auto left = promoteNumeric(rewriter, op.getLoc(), op.left(), valueType);
+    auto right = promoteNumeric(rewriter, op.getLoc(), op.right(), valueType);
 
     // Generally, int and float ops in std are different.
     using Basicpy::BinaryOperation;
@@ -180,19 +200,21 @@ public:
   LogicalResult matchAndRewrite(Basicpy::BinaryCompareOp op,
                                 PatternRewriter &rewriter) const override {
     auto loc = op.getLoc();
-    auto valueType = op.left().getType();
-    if (valueType != op.right().getType())
-      return failure();
-    if (!isLegalBinaryOpType(valueType))
+    if (!isLegalBinaryOpType(op.left().getType()) ||
+        !isLegalBinaryOpType(op.right().getType()))
       return failure();
+    auto valueType = Basicpy::getPromotedNumericType(op.left().getType(),
+                                                     op.right().getType());
     auto bpyPredicate = Basicpy::symbolizeCompareOperation(op.operation());
     if (!bpyPredicate)
       return failure();
+    // The comparison of an int with a float is that of their promotions.
+    auto left = promoteNumeric(rewriter, loc, op.left(), valueType);
+    auto right = promoteNumeric(rewriter, loc, op.right(), valueType);
 
     if (valueType.isa<IntegerType>()) {
       if (auto stdPredicate = mapBasicpyPredicateToCmpI(*bpyPredicate)) {
-        auto cmp =
-            rewriter.create<CmpIOp>(loc, *stdPredicate, op.left(), op.right());
+        auto cmp = rewriter.create<CmpIOp>(loc, *stdPredicate, left, right);
         rewriter.replaceOpWithNewOp<Basicpy::BoolCastOp>(
             op, Basicpy::BoolType::get(rewriter.getContext()), cmp);
         return success();
@@ -201,8 +223,7 @@ public:
       }
     } else if (valueType.isa<FloatType>()) {
       if (auto stdPredicate = mapBasicpyPredicateToCmpF(*bpyPredicate)) {
-        auto cmp =
-            rewriter.create<CmpFOp>(loc, *stdPredicate, op.left(), op.right());
+        auto cmp = rewriter.create<CmpFOp>(loc, *stdPredicate, left, right);
         rewriter.replaceOpWithNewOp<Basicpy::BoolCastOp>(
             op, Basicpy::BoolType::get(rewriter.getContext()), cmp);
         return success();
@@ -239,6 +260,28 @@ public:
   }
 };
 
+// Converts the as_i1 op for bools (such as the results of comparisons, which
+// drive loops and conditionals).
+class BoolToI1 : public OpRewritePattern<Basicpy::AsI1Op> {
+public:
+  using OpRewritePattern::OpRewritePattern;
+  LogicalResult matchAndRewrite(Basicpy::AsI1Op op,
+                                PatternRewriter &rewriter) const override {
+    if (!op.operand().getType().isa<Basicpy::BoolType>())
+      return failure();
+    // Bools cast from predicates are used as the predicates.
+    if (auto cast = op.operand().getDefiningOp<Basicpy::BoolCastOp>()) {
+      if (cast.operand().getType().isInteger(1)) {
+        rewriter.replaceOp(op, cast.operand());
+        return success();
+      }
+    }
+    rewriter.replaceOpWithNewOp<Basicpy::BoolCastOp>(op, rewriter.getI1Type(),
+                                                     op.operand());
+    return success();
+  }
+};
+
 } // namespace
 
 void mlir::NPCOMP::populateBasicpyToStdPrimitiveOpPatterns(
@@ -247,4 +290,5 @@ void mlir::NPCOMP::populateBasicpyToStdPrimitiveOpPatterns(
   patterns.add<NumericBinaryExpr>(context);
   patterns.add<NumericCompare>(context);
   patterns.add<NumericToI1>(context);
+  patterns.add<BoolToI1>(context);
 }
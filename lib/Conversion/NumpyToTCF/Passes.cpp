@@ -9,6 +9,7 @@
 #include "npcomp/Conversion/NumpyToTCF/Passes.h"
 
 #include "../PassDetail.h"
+#include "mlir/Dialect/Tensor/IR/Tensor.h"
 #include "mlir/Transforms/GreedyPatternRewriteDriver.h"
 #include "npcomp/Dialect/Numpy/IR/NumpyOps.h"
 #include "npcomp/Dialect/TCF/IR/TCFDialect.h"
@@ -42,10 +43,114 @@ private:
 };
 } // namespace
 
+namespace {
+template <typename TargetTcfOp>
+class ConvertUnaryBuiltinUfuncCallOp
+    : public OpRewritePattern<Numpy::BuiltinUfuncCallOp> {
+public:
+  ConvertUnaryBuiltinUfuncCallOp(MLIRContext *context, StringRef qualifiedName,
+                                 PatternBenefit benefit = 1)
+      : OpRewritePattern(context, benefit), qualifiedName(qualifiedName) {}
+  LogicalResult matchAndRewrite(Numpy::BuiltinUfuncCallOp op,
+                                PatternRewriter &rewriter) const override {
+    if (op.qualified_name() != qualifiedName)
+      return failure();
+    if (op.inputs().size() != 1)
+      return failure();
+
+    // TCF unary ops have the type of their operand.
+    Value input = op.inputs()[0];
+    Value result =
+        rewriter.create<TargetTcfOp>(op.getLoc(), input.getType(), input);
+    if (result.getType() != op.getResult().getType())
+      result = rewriter.create<tensor::CastOp>(
+          op.getLoc(), op.getResult().getType(), result);
+    rewriter.replaceOp(op, result);
+    return success();
+  }
+
+private:
+  StringRef qualifiedName;
+};
+} // namespace
+
+namespace {
+// Converts `numpy.transpose`, which reverses the dimensions of its operand, to
+// `tcf.transpose`, once the rank of the operand is known.
+class ConvertTransposeOp : public OpRewritePattern<Numpy::TransposeOp> {
+public:
+  using OpRewritePattern::OpRewritePattern;
+  LogicalResult matchAndRewrite(Numpy::TransposeOp op,
+                                PatternRewriter &rewriter) const override {
+    auto operandType = op.a().getType().dyn_cast<RankedTensorType>();
+    auto resultType = op.getType().dyn_cast<TensorType>();
+    if (!operandType || !operandType.getElementType().isF32() ||
+        !resultType ||
+        resultType.getElementType() != operandType.getElementType())
+      return failure();
+
+    int64_t rank = operandType.getRank();
+    SmallVector<int64_t, 4> permutation, shape;
+    for (int64_t i = rank - 1; i >= 0; i--) {
+      permutation.push_back(i);
+      shape.push_back(operandType.getDimSize(i));
+    }
+    auto transposedType =
+        RankedTensorType::get(shape, operandType.getElementType());
+    Value result = rewriter.create<tcf::TransposeOp>(
+        op.getLoc(), transposedType, op.a(),
+        rewriter.getI64ArrayAttr(permutation));
+    if (result.getType() != resultType)
+      result = rewriter.create<tensor::CastOp>(op.getLoc(), resultType, result);
+    rewriter.replaceOp(op, result);
+    return success();
+  }
+};
+} // namespace
+
+namespace {
+// Converts `numpy.dot` of ranked vectors and matrices to `tcf.matmul` when
+// both operands are matrices, so that it reaches the matmul kernels, and to
+// `tcf.dot` (matrix-vector and vector products) otherwise.
+class ConvertDotOp : public OpRewritePattern<Numpy::DotOp> {
+public:
+  using OpRewritePattern::OpRewritePattern;
+  LogicalResult matchAndRewrite(Numpy::DotOp op,
+                                PatternRewriter &rewriter) const override {
+    auto lhsType = op.a().getType().dyn_cast<RankedTensorType>();
+    auto rhsType = op.b().getType().dyn_cast<RankedTensorType>();
+    auto resultType = op.getType().dyn_cast<TensorType>();
+    if (!lhsType || !rhsType || !resultType ||
+        !lhsType.getElementType().isF32() ||
+        !rhsType.getElementType().isF32() ||
+        !resultType.getElementType().isF32())
+      return failure();
+    int64_t lhsRank = lhsType.getRank(), rhsRank = rhsType.getRank();
+    if (lhsRank < 1 || lhsRank > 2 || rhsRank < 1 || rhsRank > 2)
+      return failure();
+
+    SmallVector<int64_t, 2> shape(lhsType.getShape().drop_back());
+    shape.append(rhsType.getShape().begin() + 1, rhsType.getShape().end());
+    auto productType = RankedTensorType::get(shape, rewriter.getF32Type());
+    Value result;
+    if (lhsRank == 2 && rhsRank == 2)
+      result = rewriter.create<tcf::MatmulOp>(op.getLoc(), productType, op.a(),
+                                              op.b());
+    else
+      result = rewriter.create<tcf::DotOp>(op.getLoc(), productType, op.a(),
+                                           op.b());
+    if (result.getType() != resultType)
+      result = rewriter.create<tensor::CastOp>(op.getLoc(), resultType, result);
+    rewriter.replaceOp(op, result);
+    return success();
+  }
+};
+} // namespace
+
 namespace {
 class ConvertNumpyToTCF : public ConvertNumpyToTCFBase<ConvertNumpyToTCF> {
   void getDependentDialects(DialectRegistry &registry) const override {
-    registry.insert<NPCOMP::tcf::TCFDialect>();
+    registry.insert<NPCOMP::tcf::TCFDialect, tensor::TensorDialect>();
   }
 
   void runOnOperation() override {
@@ -55,6 +160,16 @@ class ConvertNumpyToTCF : public ConvertNumpyToTCFBase<ConvertNumpyToTCF> {
     RewritePatternSet patterns(context);
     patterns.add<ConvertBinaryBuiltinUfuncCallOp<tcf::AddOp>>(context,
                                                               "numpy.add");
+    patterns.add<ConvertBinaryBuiltinUfuncCallOp<tcf::MulOp>>(
+        context, "numpy.multiply");
+    patterns.add<ConvertBinaryBuiltinUfuncCallOp<tcf::MaxOp>>(
+        context, "numpy.maximum");
+    patterns.add<ConvertUnaryBuiltinUfuncCallOp<tcf::ExpOp>>(context,
+                                                             "numpy.exp");
+    patterns.add<ConvertUnaryBuiltinUfuncCallOp<tcf::TanhOp>>(context,
+                                                              "numpy.tanh");
+    patterns.add<ConvertTransposeOp>(context);
+    patterns.add<ConvertDotOp>(context);
     (void)applyPatternsAndFoldGreedily(func, std::move(patterns));
   }
 };
@@ -10,6 +10,8 @@
 
 #include "../PassDetail.h"
 #include "mlir/Dialect/Linalg/IR/LinalgOps.h"
+#include "mlir/Dialect/Math/IR/Math.h"
+#include "mlir/Dialect/SCF/SCF.h"
 #include "mlir/Dialect/Shape/IR/Shape.h"
 #include "mlir/Dialect/StandardOps/IR/Ops.h"
 #include "mlir/Dialect/Tensor/IR/Tensor.h"
@@ -22,6 +24,8 @@
 #include "npcomp/Dialect/TCP/IR/TCPDialect.h"
 #include "npcomp/Dialect/TCP/IR/TCPOps.h"
 
+#include <limits>
+
 using namespace mlir;
 using namespace mlir::NPCOMP;
 
@@ -35,6 +39,25 @@ static SmallVector<Value, 6> bypassResultShapes(Operation *op,
         op->getLoc(), ValueRange({lhsRows, rhsCols}));
     return {shape};
   }
+  if (auto matmul = dyn_cast<tcf::BatchMatmulOp>(op)) {
+    auto batch = builder.create<memref::DimOp>(op->getLoc(), matmul.lhs(), 0);
+    auto lhsRows = builder.create<memref::DimOp>(op->getLoc(), matmul.lhs(), 1);
+    auto rhsCols = builder.create<memref::DimOp>(op->getLoc(), matmul.rhs(), 2);
+    auto shape = builder.create<tensor::FromElementsOp>(
+        op->getLoc(), ValueRange({batch, lhsRows, rhsCols}));
+    return {shape};
+  }
+  if (auto attention = dyn_cast<tcf::AttentionOp>(op)) {
+    auto batch =
+        builder.create<memref::DimOp>(op->getLoc(), attention.query(), 0);
+    auto queries =
+        builder.create<memref::DimOp>(op->getLoc(), attention.query(), 1);
+    auto valueSize =
+        builder.create<memref::DimOp>(op->getLoc(), attention.value(), 2);
+    auto shape = builder.create<tensor::FromElementsOp>(
+        op->getLoc(), ValueRange({batch, queries, valueSize}));
+    return {shape};
+  }
   // TODO: This only supports the NCHW data format. Consider other formats and lower ranks.
   if (auto conv2dNCHW = dyn_cast<tcf::ConvNCHWOp>(op)) {
     // TODO: Replace hard-coded stride/dilation/padding constant-ops.
@@ -131,6 +154,50 @@ public:
 };
 } // namespace
 
+namespace {
+class ConvertBatchMatmul : public OpRewritePattern<tcf::BatchMatmulOp> {
+public:
+  using OpRewritePattern::OpRewritePattern;
+  LogicalResult matchAndRewrite(tcf::BatchMatmulOp op,
+                                PatternRewriter &rewriter) const override {
+    // Create the constraints, and the assuming region.
+    Value lhsB = rewriter.create<memref::DimOp>(op.getLoc(), op.lhs(), 0);
+    Value rhsB = rewriter.create<memref::DimOp>(op.getLoc(), op.rhs(), 0);
+    Value lhsK = rewriter.create<memref::DimOp>(op.getLoc(), op.lhs(), 2);
+    Value rhsK = rewriter.create<memref::DimOp>(op.getLoc(), op.rhs(), 1);
+    Value matchingB =
+        rewriter.create<CmpIOp>(op.getLoc(), CmpIPredicate::eq, lhsB, rhsB);
+    Value matchingK =
+        rewriter.create<CmpIOp>(op.getLoc(), CmpIPredicate::eq, lhsK, rhsK);
+    Value witnessB = rewriter.create<shape::CstrRequireOp>(
+        op.getLoc(), matchingB, "mismatching batch dimension for batch_matmul");
+    Value witnessK = rewriter.create<shape::CstrRequireOp>(
+        op.getLoc(), matchingK,
+        "mismatching contracting dimension for batch_matmul");
+    Value assumingAll = rewriter.create<shape::AssumingAllOp>(
+        op.getLoc(), witnessB.getType(), ValueRange({witnessB, witnessK}));
+    auto assuming = rewriter.create<shape::AssumingOp>(
+        op.getLoc(), ArrayRef<Type>{op.getType()}, assumingAll);
+
+    // Build the region body.
+    rewriter.createBlock(&assuming.doRegion());
+    Value c0 =
+        rewriter.create<ConstantOp>(op.getLoc(), rewriter.getF32FloatAttr(0.0));
+    Value shape = bypassResultShapes(op, rewriter)[0];
+    Value initTensor =
+        rewriter.create<tcp::SplattedOp>(op.getLoc(), op.getType(), c0, shape);
+
+    auto matmul = rewriter.create<linalg::BatchMatmulOp>(
+        op.getLoc(), TypeRange(op.getType()), op.getOperands(),
+        ValueRange(initTensor));
+    rewriter.create<shape::AssumingYieldOp>(op.getLoc(), matmul.getResult(0));
+
+    rewriter.replaceOp(op, assuming.getResults());
+    return success();
+  }
+};
+} // namespace
+
 namespace {
 class ConvertConvNCHW : public OpRewritePattern<tcf::ConvNCHWOp> {
 public:
@@ -187,12 +254,712 @@ public:
 };
 } // namespace
 
+// Reductions along the innermost dimension of at least this many elements are
+// split into parallel partial reductions.
+constexpr int64_t kMinSplitReductionSize = 4096;
+// The number of partial results of each split reduction that are accumulated
+// independently in adjacent elements, so that they can be accumulated in the
+// lanes of a vector.
+constexpr int64_t kReductionLanes = 16;
+// The maximum number of chunks of a split reduction, which are reduced in
+// parallel.
+constexpr int64_t kMaxReductionChunks = 16;
+
+using ReductionCombiner =
+    function_ref<Value(OpBuilder &, Location, Value, Value)>;
+// Returns the value to reduce for the elements of the operands of a reduction
+// at the same index.
+using ReductionElementFn =
+    function_ref<Value(OpBuilder &, Location, ValueRange)>;
+
+// Creates an empty tensor of type `type`, with the dynamic sizes of
+// `operand`.
+static Value createInitTensor(OpBuilder &b, Location loc,
+                              RankedTensorType type, Value operand) {
+  SmallVector<Value, 4> dynamicSizes;
+  for (int64_t i = 0, e = type.getRank(); i < e; i++)
+    if (type.isDynamicDim(i))
+      dynamicSizes.push_back(b.create<memref::DimOp>(loc, operand, i));
+  return b.create<linalg::InitTensorOp>(loc, dynamicSizes, type.getShape(),
+                                        type.getElementType());
+}
+
+// Creates a tensor of type `type` filled with `value`, with the dynamic sizes
+// of `operand`.
+static Value createFilledTensor(OpBuilder &b, Location loc,
+                                RankedTensorType type, Value operand,
+                                Value value) {
+  Value init = createInitTensor(b, loc, type, operand);
+  return b.create<linalg::FillOp>(loc, init, value).getResult(0);
+}
+
+// Returns the number of chunks to split a reduction along the innermost
+// dimension of `type` into, or 1 if it shouldn't be split.
+static int64_t getNumReductionChunks(RankedTensorType type) {
+  int64_t size = type.getShape().back();
+  if (ShapedType::isDynamic(size) || size < kMinSplitReductionSize ||
+      size % kReductionLanes != 0)
+    return 1;
+  int64_t numChunks = kMaxReductionChunks;
+  while ((size / kReductionLanes) % numChunks != 0)
+    numChunks /= 2;
+  return numChunks;
+}
+
+// Returns the reduction of `operands` (of the same shape) along dimension
+// `dim` with `combine`, accumulated into `init` (which has size 1 along
+// `dim`). The value reduced at each index is `getElement` of the elements of
+// the operands there, or the element of the only operand if it is null.
+//
+// Large reductions along the innermost dimension are computed in two phases.
+// The first one splits the reduction into chunks, which are reduced in
+// parallel into kReductionLanes adjacent partial results each, and the second
+// one reduces the partial results.
+static Value createReduction(OpBuilder &b, Location loc, ValueRange operands,
+                             int64_t dim, Value init, Value identity,
+                             ReductionCombiner combine,
+                             ReductionElementFn getElement = nullptr) {
+  MLIRContext *context = b.getContext();
+  Value operand = operands.front();
+  auto operandType = operand.getType().cast<RankedTensorType>();
+  int64_t rank = operandType.getRank();
+  size_t numOperands = operands.size();
+  StringRef parallel = getParallelIteratorTypeName();
+  StringRef reduction = getReductionIteratorTypeName();
+  auto reduceElements = [&](OpBuilder &b, Location loc, Value acc,
+                            ValueRange elements) {
+    Value element =
+        getElement ? getElement(b, loc, elements) : elements.front();
+    return combine(b, loc, acc, element);
+  };
+  auto bodyBuilder = [&](OpBuilder &b, Location loc, ValueRange args) {
+    b.create<linalg::YieldOp>(
+        loc, reduceElements(b, loc, args.back(), args.drop_back()));
+  };
+
+  int64_t numChunks = getNumReductionChunks(operandType);
+  if (dim != rank - 1 || numChunks == 1) {
+    SmallVector<AffineExpr, 4> outputExprs;
+    SmallVector<StringRef, 4> iteratorTypes;
+    for (int64_t i = 0; i < rank; i++) {
+      outputExprs.push_back(i == dim ? getAffineConstantExpr(0, context)
+                                     : getAffineDimExpr(i, context));
+      iteratorTypes.push_back(i == dim ? reduction : parallel);
+    }
+    SmallVector<AffineMap, 3> indexingMaps(
+        numOperands, AffineMap::getMultiDimIdentityMap(rank, context));
+    indexingMaps.push_back(AffineMap::get(rank, 0, outputExprs, context));
+    return b
+        .create<linalg::GenericOp>(loc, TypeRange(init.getType()), operands,
+                                   init, indexingMaps, iteratorTypes,
+                                   bodyBuilder)
+        ->getResult(0);
+  }
+
+  // The partial results have the shape of the outer dimensions of the
+  // operand, followed by [numChunks, kReductionLanes].
+  SmallVector<int64_t, 4> partialShape(operandType.getShape().drop_back());
+  partialShape.push_back(numChunks);
+  partialShape.push_back(kReductionLanes);
+  auto partialType =
+      RankedTensorType::get(partialShape, operandType.getElementType());
+  SmallVector<Value, 4> dynamicSizes;
+  for (int64_t i = 0; i < rank - 1; i++)
+    if (operandType.isDynamicDim(i))
+      dynamicSizes.push_back(b.create<memref::DimOp>(loc, operand, i));
+  Value partialInit = b.create<linalg::InitTensorOp>(
+      loc, dynamicSizes, partialShape, operandType.getElementType());
+  partialInit =
+      b.create<linalg::FillOp>(loc, partialInit, identity).getResult(0);
+
+  // Loops (outer dimensions..., chunk, row, lane), where element `lane` of
+  // row `row` of chunk `chunk` is element
+  // `(chunk * rowsPerChunk + row) * kReductionLanes + lane`. The loop range of
+  // `row` is only given by an (otherwise unused) input of that size, since
+  // the operand is only indexed by a combination of the loops.
+  int64_t rowsPerChunk =
+      operandType.getShape().back() / (numChunks * kReductionLanes);
+  Value rows = b.create<linalg::InitTensorOp>(
+      loc, ValueRange(), ArrayRef<int64_t>{rowsPerChunk},
+      operandType.getElementType());
+  SmallVector<AffineExpr, 4> inputExprs, partialExprs;
+  SmallVector<StringRef, 6> iteratorTypes;
+  for (int64_t i = 0; i < rank - 1; i++) {
+    inputExprs.push_back(getAffineDimExpr(i, context));
+    iteratorTypes.push_back(parallel);
+  }
+  partialExprs = inputExprs;
+  AffineExpr chunk = getAffineDimExpr(rank - 1, context);
+  AffineExpr row = getAffineDimExpr(rank, context);
+  AffineExpr lane = getAffineDimExpr(rank + 1, context);
+  inputExprs.push_back((chunk * rowsPerChunk + row) * kReductionLanes + lane);
+  partialExprs.push_back(chunk);
+  partialExprs.push_back(lane);
+  iteratorTypes.append({parallel, reduction, parallel});
+  SmallVector<AffineMap, 4> partialMaps(
+      numOperands, AffineMap::get(rank + 2, 0, inputExprs, context));
+  partialMaps.push_back(AffineMap::get(rank + 2, 0, {row}, context));
+  partialMaps.push_back(AffineMap::get(rank + 2, 0, partialExprs, context));
+  SmallVector<Value, 3> partialInputs(operands.begin(), operands.end());
+  partialInputs.push_back(rows);
+  Value partial =
+      b.create<linalg::GenericOp>(
+           loc, TypeRange(partialType), partialInputs, partialInit,
+           partialMaps, iteratorTypes,
+           [&](OpBuilder &b, Location loc, ValueRange args) {
+             b.create<linalg::YieldOp>(
+                 loc, reduceElements(b, loc, args.back(),
+                                     args.take_front(numOperands)));
+           })
+          ->getResult(0);
+
+  // Loops (outer dimensions..., chunk, lane).
+  SmallVector<AffineExpr, 4> outputExprs(inputExprs.begin(),
+                                         inputExprs.end() - 1);
+  outputExprs.push_back(getAffineConstantExpr(0, context));
+  iteratorTypes.resize(rank - 1);
+  iteratorTypes.append({reduction, reduction});
+  SmallVector<AffineMap, 2> resultMaps = {
+      AffineMap::getMultiDimIdentityMap(rank + 1, context),
+      AffineMap::get(rank + 1, 0, outputExprs, context)};
+  return b
+      .create<linalg::GenericOp>(
+          loc, TypeRange(init.getType()), partial, init, resultMaps,
+          iteratorTypes,
+          [&](OpBuilder &b, Location loc, ValueRange args) {
+            b.create<linalg::YieldOp>(loc, combine(b, loc, args[1], args[0]));
+          })
+      ->getResult(0);
+}
+
+static Value createSum(OpBuilder &b, Location loc, Value operand, int64_t dim,
+                       RankedTensorType resultType) {
+  Value zero = b.create<ConstantOp>(loc, b.getF32FloatAttr(0.0));
+  Value init = createFilledTensor(b, loc, resultType, operand, zero);
+  return createReduction(b, loc, operand, dim, init, zero,
+                         [](OpBuilder &b, Location loc, Value acc,
+                            Value element) -> Value {
+                           return b.create<AddFOp>(loc, acc, element);
+                         });
+}
+
+static Value createMax(OpBuilder &b, Location loc, Value operand, int64_t dim,
+                       RankedTensorType resultType) {
+  Value lowest = b.create<ConstantOp>(
+      loc, b.getF32FloatAttr(-std::numeric_limits<float>::infinity()));
+  Value init = createFilledTensor(b, loc, resultType, operand, lowest);
+  return createReduction(b, loc, operand, dim, init, lowest,
+                         [](OpBuilder &b, Location loc, Value acc,
+                            Value element) -> Value {
+                           Value greater = b.create<CmpFOp>(
+                               loc, CmpFPredicate::OGT, element, acc);
+                           return b.create<SelectOp>(loc, greater, element,
+                                                     acc);
+                         });
+}
+
+// Returns the type of the reduction of `operand` along `dim`.
+static RankedTensorType getReducedType(Value operand, int64_t dim) {
+  auto type = operand.getType().cast<RankedTensorType>();
+  SmallVector<int64_t, 4> shape(type.getShape().begin(),
+                                type.getShape().end());
+  shape[dim] = 1;
+  return RankedTensorType::get(shape, type.getElementType());
+}
+
+// Returns the indexing map reading a reduction along `dim` for each element
+// of the reduced operand of rank `rank`.
+static AffineMap getReducedMap(int64_t rank, int64_t dim,
+                               MLIRContext *context) {
+  SmallVector<AffineExpr, 4> exprs;
+  for (int64_t i = 0; i < rank; i++)
+    exprs.push_back(i == dim ? getAffineConstantExpr(0, context)
+                             : getAffineDimExpr(i, context));
+  return AffineMap::get(rank, 0, exprs, context);
+}
+
+// Returns `lhs` combined elementwise with `rhs`, the reduction of `lhs` along
+// `dim`, as a tensor of type `resultType`.
+static Value
+createBroadcastingElementwise(OpBuilder &b, Location loc, Value lhs, Value rhs,
+                              int64_t dim, RankedTensorType resultType,
+                              ReductionCombiner combine) {
+  MLIRContext *context = b.getContext();
+  int64_t rank = resultType.getRank();
+  AffineMap identity = AffineMap::getMultiDimIdentityMap(rank, context);
+  SmallVector<AffineMap, 3> indexingMaps = {
+      identity, getReducedMap(rank, dim, context), identity};
+  SmallVector<StringRef, 4> iteratorTypes(rank, getParallelIteratorTypeName());
+  return b
+      .create<linalg::GenericOp>(
+          loc, TypeRange(resultType), ValueRange({lhs, rhs}),
+          createInitTensor(b, loc, resultType, lhs), indexingMaps,
+          iteratorTypes,
+          [&](OpBuilder &b, Location loc, ValueRange args) {
+            b.create<linalg::YieldOp>(loc, combine(b, loc, args[0], args[1]));
+          })
+      ->getResult(0);
+}
+
+// Returns `operands`, which all have type `resultType`, combined elementwise
+// with `combine`.
+static Value createElementwise(
+    OpBuilder &b, Location loc, ValueRange operands,
+    RankedTensorType resultType,
+    function_ref<Value(OpBuilder &, Location, ValueRange)> combine) {
+  int64_t rank = resultType.getRank();
+  SmallVector<AffineMap, 4> indexingMaps(
+      operands.size() + 1,
+      AffineMap::getMultiDimIdentityMap(rank, b.getContext()));
+  SmallVector<StringRef, 4> iteratorTypes(rank, getParallelIteratorTypeName());
+  return b
+      .create<linalg::GenericOp>(
+          loc, TypeRange(resultType), operands,
+          createInitTensor(b, loc, resultType, operands[0]), indexingMaps,
+          iteratorTypes,
+          [&](OpBuilder &b, Location loc, ValueRange args) {
+            b.create<linalg::YieldOp>(loc,
+                                      combine(b, loc, args.drop_back()));
+          })
+      ->getResult(0);
+}
+
+namespace {
+class ConvertReduceSum : public OpRewritePattern<tcf::ReduceSumOp> {
+public:
+  using OpRewritePattern::OpRewritePattern;
+  LogicalResult matchAndRewrite(tcf::ReduceSumOp op,
+                                PatternRewriter &rewriter) const override {
+    auto resultType = op.getType().cast<RankedTensorType>();
+    rewriter.replaceOp(op, createSum(rewriter, op.getLoc(), op.operand(),
+                                     op.dim(), resultType));
+    return success();
+  }
+};
+} // namespace
+
+namespace {
+class ConvertReduceMean : public OpRewritePattern<tcf::ReduceMeanOp> {
+public:
+  using OpRewritePattern::OpRewritePattern;
+  LogicalResult matchAndRewrite(tcf::ReduceMeanOp op,
+                                PatternRewriter &rewriter) const override {
+    Location loc = op.getLoc();
+    auto resultType = op.getType().cast<RankedTensorType>();
+    Value sum =
+        createSum(rewriter, loc, op.operand(), op.dim(), resultType);
+    Value extent = rewriter.create<memref::DimOp>(loc, op.operand(), op.dim());
+    Value count = rewriter.create<SIToFPOp>(
+        loc, rewriter.create<IndexCastOp>(loc, extent, rewriter.getI64Type()),
+        rewriter.getF32Type());
+    int64_t rank = resultType.getRank();
+    AffineMap identity =
+        AffineMap::getMultiDimIdentityMap(rank, rewriter.getContext());
+    SmallVector<StringRef, 4> iteratorTypes(rank,
+                                            getParallelIteratorTypeName());
+    Value mean =
+        rewriter
+            .create<linalg::GenericOp>(
+                loc, TypeRange(resultType), sum,
+                createInitTensor(rewriter, loc, resultType, sum),
+                ArrayRef<AffineMap>{identity, identity}, iteratorTypes,
+                [&](OpBuilder &b, Location loc, ValueRange args) {
+                  b.create<linalg::YieldOp>(
+                      loc, b.create<DivFOp>(loc, args[0], count));
+                })
+            ->getResult(0);
+    rewriter.replaceOp(op, mean);
+    return success();
+  }
+};
+} // namespace
+
+namespace {
+class ConvertReduceMax : public OpRewritePattern<tcf::ReduceMaxOp> {
+public:
+  using OpRewritePattern::OpRewritePattern;
+  LogicalResult matchAndRewrite(tcf::ReduceMaxOp op,
+                                PatternRewriter &rewriter) const override {
+    auto resultType = op.getType().cast<RankedTensorType>();
+    rewriter.replaceOp(op, createMax(rewriter, op.getLoc(), op.operand(),
+                                     op.dim(), resultType));
+    return success();
+  }
+};
+} // namespace
+
+namespace {
+// Lowers softmax to the numerically stable
+// `exp(x - max(x)) / sum(exp(x - max(x)))`, where subtracting the maximum
+// keeps `exp` from overflowing.
+class ConvertSoftmax : public OpRewritePattern<tcf::SoftmaxOp> {
+public:
+  using OpRewritePattern::OpRewritePattern;
+  LogicalResult matchAndRewrite(tcf::SoftmaxOp op,
+                                PatternRewriter &rewriter) const override {
+    Location loc = op.getLoc();
+    int64_t dim = op.dim();
+    auto resultType = op.getType().cast<RankedTensorType>();
+    RankedTensorType reducedType = getReducedType(op.operand(), dim);
+    Value max = createMax(rewriter, loc, op.operand(), dim, reducedType);
+    Value exp = createBroadcastingElementwise(
+        rewriter, loc, op.operand(), max, dim, resultType,
+        [](OpBuilder &b, Location loc, Value element, Value max) -> Value {
+          return b.create<math::ExpOp>(loc,
+                                       b.create<SubFOp>(loc, element, max));
+        });
+    Value sum = createSum(rewriter, loc, exp, dim, reducedType);
+    Value softmax = createBroadcastingElementwise(
+        rewriter, loc, exp, sum, dim, resultType,
+        [](OpBuilder &b, Location loc, Value element, Value sum) -> Value {
+          return b.create<DivFOp>(loc, element, sum);
+        });
+    rewriter.replaceOp(op, softmax);
+    return success();
+  }
+};
+} // namespace
+
+namespace {
+// Lowers transpose to a copy through a permuted indexing map. It is left to
+// the fusion of the RefBackend pipeline to fold the permuted map into the ops
+// reading the result, so that the transpose isn't materialized, and to the
+// affine loop tiling to block the remaining copies for the cache.
+class ConvertTranspose : public OpRewritePattern<tcf::TransposeOp> {
+public:
+  using OpRewritePattern::OpRewritePattern;
+  LogicalResult matchAndRewrite(tcf::TransposeOp op,
+                                PatternRewriter &rewriter) const override {
+    Location loc = op.getLoc();
+    auto resultType = op.getType().cast<RankedTensorType>();
+    int64_t rank = resultType.getRank();
+    auto permutation = llvm::to_vector<4>(llvm::map_range(
+        op.permutation().getAsValueRange<IntegerAttr>(),
+        [](const APInt &dim) { return dim.getSExtValue(); }));
+    // Dimension i of the result is dimension permutation[i] of the operand.
+    SmallVector<AffineExpr, 4> operandExprs(rank);
+    SmallVector<Value, 4> dynamicSizes;
+    for (int64_t i = 0; i < rank; i++) {
+      operandExprs[permutation[i]] = rewriter.getAffineDimExpr(i);
+      if (resultType.isDynamicDim(i))
+        dynamicSizes.push_back(
+            rewriter.create<memref::DimOp>(loc, op.operand(), permutation[i]));
+    }
+    Value init = rewriter.create<linalg::InitTensorOp>(
+        loc, dynamicSizes, resultType.getShape(),
+        resultType.getElementType());
+    SmallVector<AffineMap, 2> indexingMaps = {
+        AffineMap::get(rank, 0, operandExprs, rewriter.getContext()),
+        rewriter.getMultiDimIdentityMap(rank)};
+    SmallVector<StringRef, 4> iteratorTypes(rank,
+                                            getParallelIteratorTypeName());
+    rewriter.replaceOpWithNewOp<linalg::GenericOp>(
+        op, TypeRange(resultType), op.operand(), init, indexingMaps,
+        iteratorTypes, [](OpBuilder &b, Location loc, ValueRange args) {
+          b.create<linalg::YieldOp>(loc, args[0]);
+        });
+    return success();
+  }
+};
+} // namespace
+
+namespace {
+// Lowers the products of a matrix and a vector to `linalg.matvec` and
+// `linalg.vecmat` (which RefBackend tiles and vectorizes like matmuls), and
+// dot products of vectors to a sum of products, which is split into
+// vectorizable partial sums like `tcf.reduce_sum`.
+class ConvertDot : public OpRewritePattern<tcf::DotOp> {
+public:
+  using OpRewritePattern::OpRewritePattern;
+  LogicalResult matchAndRewrite(tcf::DotOp op,
+                                PatternRewriter &rewriter) const override {
+    Location loc = op.getLoc();
+    Value lhs = op.lhs(), rhs = op.rhs();
+    int64_t lhsRank = lhs.getType().cast<RankedTensorType>().getRank();
+    int64_t rhsRank = rhs.getType().cast<RankedTensorType>().getRank();
+    auto resultType = op.getType().cast<RankedTensorType>();
+
+    // Create the constraints, and the assuming region.
+    Value lhsK = rewriter.create<memref::DimOp>(loc, lhs, lhsRank - 1);
+    Value rhsK = rewriter.create<memref::DimOp>(loc, rhs, 0);
+    Value matchingK =
+        rewriter.create<CmpIOp>(loc, CmpIPredicate::eq, lhsK, rhsK);
+    Value witness = rewriter.create<shape::CstrRequireOp>(
+        loc, matchingK, "mismatching contracting dimension for dot");
+    auto assuming = rewriter.create<shape::AssumingOp>(
+        loc, ArrayRef<Type>{resultType}, witness);
+    rewriter.createBlock(&assuming.doRegion());
+
+    Value zero =
+        rewriter.create<ConstantOp>(loc, rewriter.getF32FloatAttr(0.0));
+    Value result;
+    if (lhsRank == 2) {
+      Value init = createFilledTensor(rewriter, loc, resultType, lhs, zero);
+      result = rewriter
+                   .create<linalg::MatvecOp>(loc, TypeRange(resultType),
+                                             ValueRange({lhs, rhs}),
+                                             ValueRange(init))
+                   .getResult(0);
+    } else if (rhsRank == 2) {
+      SmallVector<Value, 1> dynamicSizes;
+      if (resultType.isDynamicDim(0))
+        dynamicSizes.push_back(rewriter.create<memref::DimOp>(loc, rhs, 1));
+      Value init = rewriter.create<linalg::InitTensorOp>(
+          loc, dynamicSizes, resultType.getShape(),
+          resultType.getElementType());
+      init = rewriter.create<linalg::FillOp>(loc, init, zero).getResult(0);
+      result = rewriter
+                   .create<linalg::VecmatOp>(loc, TypeRange(resultType),
+                                             ValueRange({lhs, rhs}),
+                                             ValueRange(init))
+                   .getResult(0);
+    } else {
+      auto sumType = RankedTensorType::get({1}, resultType.getElementType());
+      Value init = createFilledTensor(rewriter, loc, sumType, lhs, zero);
+      Value sum = createReduction(
+          rewriter, loc, ValueRange({lhs, rhs}), /*dim=*/0, init, zero,
+          [](OpBuilder &b, Location loc, Value acc, Value element) -> Value {
+            return b.create<AddFOp>(loc, acc, element);
+          },
+          [](OpBuilder &b, Location loc, ValueRange elements) -> Value {
+            return b.create<MulFOp>(loc, elements[0], elements[1]);
+          });
+      // Read the only element of the sum into the 0-D result.
+      Value resultInit = rewriter.create<linalg::InitTensorOp>(
+          loc, ValueRange(), ArrayRef<int64_t>{},
+          resultType.getElementType());
+      SmallVector<AffineMap, 2> indexingMaps = {
+          AffineMap::get(0, 0, rewriter.getAffineConstantExpr(0)),
+          AffineMap::get(rewriter.getContext())};
+      result = rewriter
+                   .create<linalg::GenericOp>(
+                       loc, TypeRange(resultType), sum, resultInit,
+                       indexingMaps, ArrayRef<StringRef>{},
+                       [](OpBuilder &b, Location loc, ValueRange args) {
+                         b.create<linalg::YieldOp>(loc, args[0]);
+                       })
+                   ->getResult(0);
+    }
+    rewriter.create<shape::AssumingYieldOp>(loc, result);
+
+    rewriter.replaceOp(op, assuming.getResults());
+    return success();
+  }
+};
+} // namespace
+
+// The number of keys that attention processes at a time, which bounds the
+// attention scores that are materialized to [B, S, kAttentionBlockSize].
+constexpr int64_t kAttentionBlockSize = 64;
+
+namespace {
+// Lowers attention to a loop over blocks of kAttentionBlockSize keys, which
+// keeps running softmax statistics for each query: the maximum `m` of its
+// scores so far, the sum `l` of their exponentials relative to `m`, and the
+// sum `acc` of the values weighted by these exponentials. When a block raises
+// the maximum, `l` and `acc` are rescaled by `exp(m - newM)`. The result is
+// `acc / l`.
+//
+// Only the scores of one block are materialized, so that the memory used is
+// O(S * kAttentionBlockSize) instead of O(S * T). The keys and values of a
+// block are read directly from the operands, and the positions of the last
+// block past the last key get a score of -inf (and read key 0 instead).
+class ConvertAttention : public OpRewritePattern<tcf::AttentionOp> {
+public:
+  using OpRewritePattern::OpRewritePattern;
+  LogicalResult matchAndRewrite(tcf::AttentionOp op,
+                                PatternRewriter &rewriter) const override {
+    Location loc = op.getLoc();
+    Value query = op.query();
+    Value key = op.key();
+    Value value = op.value();
+
+    // Create the constraints, and the assuming region.
+    auto require = [&](Value lhs, int64_t lhsDim, Value rhs, int64_t rhsDim,
+                       StringRef message) -> Value {
+      Value matching = rewriter.create<CmpIOp>(
+          loc, CmpIPredicate::eq,
+          rewriter.create<memref::DimOp>(loc, lhs, lhsDim),
+          rewriter.create<memref::DimOp>(loc, rhs, rhsDim));
+      return rewriter.create<shape::CstrRequireOp>(loc, matching, message);
+    };
+    SmallVector<Value, 4> witnesses = {
+        require(query, 0, key, 0, "mismatching batch dimension for attention"),
+        require(query, 0, value, 0,
+                "mismatching batch dimension for attention"),
+        require(query, 2, key, 2, "mismatching query and key sizes"),
+        require(key, 1, value, 1, "mismatching number of keys and values")};
+    Value assumingAll = rewriter.create<shape::AssumingAllOp>(
+        loc, witnesses[0].getType(), witnesses);
+    auto assuming = rewriter.create<shape::AssumingOp>(
+        loc, ArrayRef<Type>{op.getType()}, assumingAll);
+
+    // Build the region body.
+    rewriter.createBlock(&assuming.doRegion());
+    MLIRContext *context = rewriter.getContext();
+    auto resultType = op.getType().cast<RankedTensorType>();
+    ArrayRef<int64_t> queryShape =
+        query.getType().cast<RankedTensorType>().getShape();
+    auto scoresType = RankedTensorType::get(
+        {queryShape[0], queryShape[1], kAttentionBlockSize},
+        rewriter.getF32Type());
+    auto statsType = RankedTensorType::get({queryShape[0], queryShape[1], 1},
+                                           rewriter.getF32Type());
+    Value zero =
+        rewriter.create<ConstantOp>(loc, rewriter.getF32FloatAttr(0.0));
+    Value lowest = rewriter.create<ConstantOp>(
+        loc, rewriter.getF32FloatAttr(-std::numeric_limits<float>::infinity()));
+    Value scale = rewriter.create<ConstantOp>(loc, op.scaleAttr());
+    Value c0 = rewriter.create<ConstantIndexOp>(loc, 0);
+    Value blockSize =
+        rewriter.create<ConstantIndexOp>(loc, kAttentionBlockSize);
+    Value numKeys = rewriter.create<memref::DimOp>(loc, key, 1);
+
+    Value m = createFilledTensor(rewriter, loc, statsType, query, lowest);
+    Value l = createFilledTensor(rewriter, loc, statsType, query, zero);
+    Value acc = rewriter.create<tcp::SplattedOp>(
+        loc, resultType, zero, bypassResultShapes(op, rewriter)[0]);
+
+    AffineExpr batch, row, col, reduction;
+    bindDims(context, batch, row, col, reduction);
+    SmallVector<StringRef, 4> iteratorTypes(3, getParallelIteratorTypeName());
+    iteratorTypes.push_back(getReductionIteratorTypeName());
+    auto loop = rewriter.create<scf::ForOp>(
+        loc, c0, numKeys, blockSize, ValueRange({m, l, acc}),
+        [&](OpBuilder &b, Location loc, Value blockStart, ValueRange iterArgs) {
+          Value m = iterArgs[0], l = iterArgs[1], acc = iterArgs[2];
+          // Returns the key at position `dim` of the iteration space of a
+          // linalg op within the block, or 0 if it is past the last key.
+          auto getKeyIndex = [&](OpBuilder &b, Location loc, int64_t dim,
+                                 Value &inBounds) -> Value {
+            Value index = b.create<AddIOp>(
+                loc, blockStart,
+                b.create<linalg::IndexOp>(loc, b.getIndexType(),
+                                          b.getI64IntegerAttr(dim)));
+            inBounds =
+                b.create<CmpIOp>(loc, CmpIPredicate::ult, index, numKeys);
+            return b.create<SelectOp>(loc, inBounds, index, c0);
+          };
+          auto getBatchIndex = [](OpBuilder &b, Location loc) -> Value {
+            return b.create<linalg::IndexOp>(loc, b.getIndexType(),
+                                             b.getI64IntegerAttr(0));
+          };
+
+          // The scores of the block, scale * query . key.
+          SmallVector<AffineMap, 2> scoresMaps = {
+              AffineMap::get(4, 0, {batch, row, reduction}, context),
+              AffineMap::get(4, 0, {batch, row, col}, context)};
+          Value scores =
+              b.create<linalg::GenericOp>(
+                   loc, TypeRange(scoresType), query,
+                   createFilledTensor(b, loc, scoresType, query, zero),
+                   scoresMaps, iteratorTypes,
+                   [&](OpBuilder &b, Location loc, ValueRange args) {
+                     Value inBounds;
+                     Value k = b.create<tensor::ExtractOp>(
+                         loc, key,
+                         ValueRange({getBatchIndex(b, loc),
+                                     getKeyIndex(b, loc, 2, inBounds),
+                                     b.create<linalg::IndexOp>(
+                                         loc, b.getIndexType(),
+                                         b.getI64IntegerAttr(3))}));
+                     b.create<linalg::YieldOp>(
+                         loc, b.create<AddFOp>(
+                                  loc, args[1],
+                                  b.create<MulFOp>(loc, args[0], k)));
+                   })
+                  ->getResult(0);
+          scores = createElementwise(
+              b, loc, scores, scoresType,
+              [&](OpBuilder &b, Location loc, ValueRange args) -> Value {
+                Value inBounds;
+                getKeyIndex(b, loc, 2, inBounds);
+                return b.create<SelectOp>(
+                    loc, inBounds, b.create<MulFOp>(loc, args[0], scale),
+                    lowest);
+              });
+
+          // Update the statistics.
+          Value blockMax = createMax(b, loc, scores, 2, statsType);
+          Value newM = createElementwise(
+              b, loc, ValueRange({m, blockMax}), statsType,
+              [](OpBuilder &b, Location loc, ValueRange args) -> Value {
+                Value greater = b.create<CmpFOp>(loc, CmpFPredicate::OGT,
+                                                 args[1], args[0]);
+                return b.create<SelectOp>(loc, greater, args[1], args[0]);
+              });
+          Value exp = createBroadcastingElementwise(
+              b, loc, scores, newM, 2, scoresType,
+              [](OpBuilder &b, Location loc, Value score, Value m) -> Value {
+                return b.create<math::ExpOp>(loc,
+                                             b.create<SubFOp>(loc, score, m));
+              });
+          Value correction = createElementwise(
+              b, loc, ValueRange({m, newM}), statsType,
+              [](OpBuilder &b, Location loc, ValueRange args) -> Value {
+                return b.create<math::ExpOp>(
+                    loc, b.create<SubFOp>(loc, args[0], args[1]));
+              });
+          Value newL = createElementwise(
+              b, loc,
+              ValueRange({l, correction, createSum(b, loc, exp, 2, statsType)}),
+              statsType,
+              [](OpBuilder &b, Location loc, ValueRange args) -> Value {
+                return b.create<AddFOp>(
+                    loc, b.create<MulFOp>(loc, args[0], args[1]), args[2]);
+              });
+
+          // Rescale the accumulated values and add those of the block.
+          Value rescaled = createBroadcastingElementwise(
+              b, loc, acc, correction, 2, resultType,
+              [](OpBuilder &b, Location loc, Value acc, Value c) -> Value {
+                return b.create<MulFOp>(loc, acc, c);
+              });
+          SmallVector<AffineMap, 2> accMaps = {
+              AffineMap::get(4, 0, {batch, row, reduction}, context),
+              AffineMap::get(4, 0, {batch, row, col}, context)};
+          Value newAcc =
+              b.create<linalg::GenericOp>(
+                   loc, TypeRange(resultType), exp, rescaled, accMaps,
+                   iteratorTypes,
+                   [&](OpBuilder &b, Location loc, ValueRange args) {
+                     Value inBounds;
+                     Value v = b.create<tensor::ExtractOp>(
+                         loc, value,
+                         ValueRange({getBatchIndex(b, loc),
+                                     getKeyIndex(b, loc, 3, inBounds),
+                                     b.create<linalg::IndexOp>(
+                                         loc, b.getIndexType(),
+                                         b.getI64IntegerAttr(2))}));
+                     b.create<linalg::YieldOp>(
+                         loc, b.create<AddFOp>(
+                                  loc, args[1],
+                                  b.create<MulFOp>(loc, args[0], v)));
+                   })
+                  ->getResult(0);
+          b.create<scf::YieldOp>(loc, ValueRange({newM, newL, newAcc}));
+        });
+
+    Value result = createBroadcastingElementwise(
+        rewriter, loc, loop.getResult(2), loop.getResult(1), 2, resultType,
+        [](OpBuilder &b, Location loc, Value acc, Value l) -> Value {
+          return b.create<DivFOp>(loc, acc, l);
+        });
+    rewriter.create<shape::AssumingYieldOp>(loc, result);
+
+    rewriter.replaceOp(op, assuming.getResults());
+    return success();
+  }
+};
+} // namespace
+
 namespace {
 class ConvertTCFToLinalg : public ConvertTCFToLinalgBase<ConvertTCFToLinalg> {
 public:
   void getDependentDialects(DialectRegistry &registry) const override {
     registry.insert<shape::ShapeDialect, tcp::TCPDialect, tensor::TensorDialect,
-                    memref::MemRefDialect, linalg::LinalgDialect>();
+                    memref::MemRefDialect, linalg::LinalgDialect,
+                    math::MathDialect, scf::SCFDialect>();
   }
 
   void runOnOperation() override {
@@ -202,8 +969,12 @@ public:
   FrozenRewritePatternSet getPatterns() {
     MLIRContext *context = &getContext();
     RewritePatternSet patterns(context);
-    patterns.add<ConvertMatmul>(context);
+    patterns.add<ConvertMatmul, ConvertBatchMatmul, ConvertDot>(context);
     patterns.add<ConvertConvNCHW>(context);
+    patterns.add<ConvertReduceSum, ConvertReduceMean, ConvertReduceMax,
+                 ConvertSoftmax>(context);
+    patterns.add<ConvertTranspose>(context);
+    patterns.add<ConvertAttention>(context);
     return std::move(patterns);
   }
 };
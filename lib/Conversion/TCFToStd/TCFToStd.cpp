@@ -12,12 +12,15 @@
 #include "mlir/Dialect/Math/IR/Math.h"
 #include "mlir/Dialect/Shape/IR/Shape.h"
 #include "mlir/Dialect/StandardOps/IR/Ops.h"
+#include "mlir/Dialect/Tensor/IR/Tensor.h"
 #include "mlir/Dialect/Traits.h"
+#include "mlir/IR/BlockAndValueMapping.h"
 #include "mlir/Transforms/DialectConversion.h"
 #include "mlir/Transforms/GreedyPatternRewriteDriver.h"
 #include "npcomp/Dialect/TCF/IR/TCFOps.h"
 #include "npcomp/Dialect/TCP/IR/TCPDialect.h"
 #include "npcomp/Dialect/TCP/IR/TCPOps.h"
+#include "llvm/ADT/SetVector.h"
 
 using namespace mlir;
 using namespace mlir::NPCOMP;
@@ -27,6 +30,38 @@ static RankedTensorType getExtentTensorType(Builder &builder) {
                                builder.getIndexType());
 }
 
+// Creates the std op computing the binary elementwise TCF `op` on `lhs` and
+// `rhs`, which have the same shape.
+static Value createBinaryElementwise(OpBuilder &builder, Operation *op,
+                                     Value lhs, Value rhs, Type resultType) {
+  Location loc = op->getLoc();
+  if (isa<tcf::AddOp>(op))
+    return builder.create<AddFOp>(loc, resultType, lhs, rhs);
+  if (isa<tcf::MaxOp>(op)) {
+    // XXX: remove TCP dep
+    // XXX: remove TCP ops from TCP
+    auto pred = builder.create<CmpFOp>(loc, CmpFPredicate::OGT, lhs, rhs);
+    return builder.create<SelectOp>(loc, pred, lhs, rhs);
+  }
+  if (isa<tcf::MulOp>(op))
+    return builder.create<MulFOp>(loc, resultType, lhs, rhs);
+  op->dump();
+  llvm::report_fatal_error(
+      "unhandled op (see dump above): TCF->Std binary elementwise");
+}
+
+// Creates the math op computing the unary elementwise TCF `op` on `operand`.
+static Value createUnaryElementwise(OpBuilder &builder, Operation *op,
+                                    Value operand) {
+  if (isa<tcf::ExpOp>(op))
+    return builder.create<math::ExpOp>(op->getLoc(), operand);
+  if (isa<tcf::TanhOp>(op))
+    return builder.create<math::TanhOp>(op->getLoc(), operand);
+  op->dump();
+  llvm::report_fatal_error(
+      "unhandled op (see dump above): TCF->TCP unary elementwise");
+}
+
 // Non-templated version of the body of ConvertBinaryElementwise to keep things
 // simple.
 static LogicalResult
@@ -68,25 +103,8 @@ matchAndRewriteBinaryElementwise(Operation *op, PatternRewriter &rewriter) {
       loc, resultType, lhs, broadcastedShape);
   Value rhsBroadcasted = rewriter.create<tcp::BroadcastToOp>(
       loc, resultType, rhs, broadcastedShape);
-  Value binaryOpResult;
-  if (isa<tcf::AddOp>(op)) {
-    binaryOpResult = rewriter.create<AddFOp>(loc, result.getType(),
-                                             lhsBroadcasted, rhsBroadcasted);
-  } else if (isa<tcf::MaxOp>(op)) {
-    // XXX: remove TCP dep
-    // XXX: remove TCP ops from TCP
-    auto pred = rewriter.create<CmpFOp>(loc, CmpFPredicate::OGT, lhsBroadcasted,
-                                        rhsBroadcasted);
-    binaryOpResult =
-        rewriter.create<SelectOp>(loc, pred, lhsBroadcasted, rhsBroadcasted);
-  } else if (isa<tcf::MulOp>(op)) {
-    binaryOpResult = rewriter.create<MulFOp>(loc, result.getType(),
-                                             lhsBroadcasted, rhsBroadcasted);
-  } else {
-    op->dump();
-    llvm::report_fatal_error(
-        "unhandled op (see dump above): TCF->Std binary elementwise");
-  }
+  Value binaryOpResult = createBinaryElementwise(
+      rewriter, op, lhsBroadcasted, rhsBroadcasted, result.getType());
   rewriter.create<shape::AssumingYieldOp>(loc, binaryOpResult);
 
   // Finally, replace with the results of the shape.assuming
@@ -108,15 +126,8 @@ public:
 
 static LogicalResult
 matchAndRewriteUnaryElementwise(Operation *op, PatternRewriter &rewriter) {
-  if (isa<tcf::ExpOp>(op)) {
-    rewriter.replaceOpWithNewOp<math::ExpOp>(op, op->getOperand(0));
-  } else if (isa<tcf::TanhOp>(op)) {
-    rewriter.replaceOpWithNewOp<math::TanhOp>(op, op->getOperand(0));
-  } else {
-    op->dump();
-    llvm::report_fatal_error(
-        "unhandled op (see dump above): TCF->TCP unary elementwise");
-  }
+  rewriter.replaceOp(op,
+                     createUnaryElementwise(rewriter, op, op->getOperand(0)));
   return success();
 }
 
@@ -132,14 +143,161 @@ public:
 };
 } // namespace
 
+//===----------------------------------------------------------------------===//
+// Fusion of elementwise chains
+//===----------------------------------------------------------------------===//
+
+// Chains of elementwise ops, such as the ufunc calls of `np.tanh(a * b + c)`,
+// are lowered into a single `shape.assuming` region instead of one region per
+// binary op: broadcasting is associative, so the whole chain computes on the
+// broadcast of all its operands. The regions would otherwise keep the
+// elementwise ops apart from each other, and linalg fusion (which runs before
+// the regions are removed) could not fuse them into a single loop nest over
+// the operands, leaving one full-size temporary per op.
+
+static bool isElementwise(Operation *op) {
+  return isa<tcf::AddOp, tcf::MaxOp, tcf::MulOp, tcf::ExpOp, tcf::TanhOp>(op);
+}
+
+// Returns the elementwise op defining `value` if the chain of its only user,
+// in `block`, can compute it.
+static Operation *getChainProducer(Value value, Block *block) {
+  Operation *producer = value.getDefiningOp();
+  if (!producer || producer->getBlock() != block || !isElementwise(producer) ||
+      !value.hasOneUse())
+    return nullptr;
+  return producer;
+}
+
+// Returns true if the elementwise `op` computes the result of a chain, rather
+// than an operand of the next op of a chain.
+static bool isChainRoot(Operation *op) {
+  Value result = op->getResult(0);
+  if (!result.hasOneUse())
+    return true;
+  Operation *user = *result.getUsers().begin();
+  return !isElementwise(user) || user->getBlock() != op->getBlock();
+}
+
+namespace {
+// A tree of elementwise ops computing the result of `ops.back()`.
+struct ElementwiseChain {
+  // The ops of the chain, operands first.
+  SmallVector<Operation *, 4> ops;
+  // The values used by the chain and defined outside of it.
+  llvm::SetVector<Value> leaves;
+  bool hasBinaryOp = false;
+};
+} // namespace
+
+static void collectChain(Operation *op, ElementwiseChain &chain) {
+  for (Value operand : op->getOperands()) {
+    if (Operation *producer = getChainProducer(operand, op->getBlock()))
+      collectChain(producer, chain);
+    else
+      chain.leaves.insert(operand);
+  }
+  chain.hasBinaryOp |= op->getNumOperands() == 2;
+  chain.ops.push_back(op);
+}
+
+// Lowers the ops of `chain` to std ops on operands broadcast to
+// `staticShape` once, in a single `shape.assuming` region when the chain has
+// several operands.
+static void lowerChain(ElementwiseChain &chain, ArrayRef<int64_t> staticShape) {
+  Operation *root = chain.ops.back();
+  Location loc = root->getLoc();
+  OpBuilder builder(root);
+  BlockAndValueMapping mapping;
+  shape::AssumingOp assuming;
+  if (chain.leaves.size() == 1) {
+    // Nothing to broadcast.
+    mapping.map(chain.leaves[0], chain.leaves[0]);
+  } else {
+    SmallVector<Value, 4> shapes;
+    for (Value leaf : chain.leaves)
+      shapes.push_back(builder.create<shape::ShapeOfOp>(loc, leaf));
+    Value witness = builder.create<shape::CstrBroadcastableOp>(loc, shapes);
+    assuming = builder.create<shape::AssumingOp>(
+        loc, root->getResultTypes(), witness);
+    builder.createBlock(&assuming.doRegion());
+    Value broadcastedShape = builder.create<shape::BroadcastOp>(
+        loc, getExtentTensorType(builder), shapes, /*error=*/nullptr);
+    for (Value leaf : chain.leaves) {
+      auto type = RankedTensorType::get(
+          staticShape, leaf.getType().cast<ShapedType>().getElementType());
+      mapping.map(leaf, builder.create<tcp::BroadcastToOp>(loc, type, leaf,
+                                                           broadcastedShape));
+    }
+  }
+
+  Value result;
+  for (Operation *op : chain.ops) {
+    Value operand = mapping.lookup(op->getOperand(0));
+    if (op->getNumOperands() == 1) {
+      result = createUnaryElementwise(builder, op, operand);
+    } else {
+      result = createBinaryElementwise(builder, op, operand,
+                                       mapping.lookup(op->getOperand(1)),
+                                       operand.getType());
+    }
+    mapping.map(op->getResult(0), result);
+  }
+  if (result.getType() != root->getResult(0).getType()) {
+    result = builder.create<tensor::CastOp>(loc, root->getResult(0).getType(),
+                                            result);
+  }
+  if (assuming) {
+    builder.create<shape::AssumingYieldOp>(loc, result);
+    result = assuming.getResult(0);
+  }
+  root->getResult(0).replaceAllUsesWith(result);
+  for (Operation *op : llvm::reverse(chain.ops))
+    op->erase();
+}
+
+// Lowers the chains of elementwise ops of `func` with at least two ops, one
+// of which broadcasts. The others are left to the patterns converting each
+// op.
+static void lowerElementwiseChains(FuncOp func) {
+  SmallVector<Operation *, 8> roots;
+  func.walk([&](Operation *op) {
+    if (isElementwise(op) && isChainRoot(op))
+      roots.push_back(op);
+  });
+  for (Operation *root : roots) {
+    ElementwiseChain chain;
+    collectChain(root, chain);
+    if (chain.ops.size() < 2 || !chain.hasBinaryOp)
+      continue;
+    // Same requirements as for a single op.
+    SmallVector<int64_t, 6> staticShape;
+    bool lowerable = llvm::all_of(chain.leaves, [&](Value leaf) {
+      auto type = leaf.getType().dyn_cast<RankedTensorType>();
+      if (!type)
+        return false;
+      SmallVector<int64_t, 6> broadcastedShape;
+      if (!OpTrait::util::getBroadcastedShape(staticShape, type.getShape(),
+                                              broadcastedShape))
+        return false;
+      staticShape = std::move(broadcastedShape);
+      return true;
+    });
+    if (lowerable)
+      lowerChain(chain, staticShape);
+  }
+}
+
 namespace {
 class ConvertTCFToStd : public ConvertTCFToStdBase<ConvertTCFToStd> {
 public:
   void getDependentDialects(DialectRegistry &registry) const override {
-    registry.insert<math::MathDialect, shape::ShapeDialect, tcp::TCPDialect>();
+    registry.insert<math::MathDialect, shape::ShapeDialect,
+                    tensor::TensorDialect, tcp::TCPDialect>();
   }
 
   void runOnOperation() override {
+    lowerElementwiseChains(getOperation());
     (void)applyPatternsAndFoldGreedily(getOperation(), getPatterns());
   }
 
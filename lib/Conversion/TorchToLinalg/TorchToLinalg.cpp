@@ -13,7 +13,9 @@
 #include "mlir/Dialect/Math/IR/Math.h"
 #include "mlir/Dialect/MemRef/IR/MemRef.h" // TODO: For `memref.dim`.
 #include "mlir/Dialect/Traits.h"
+#include "mlir/IR/Matchers.h"
 #include "mlir/Transforms/DialectConversion.h"
+#include "npcomp/Dialect/Basicpy/IR/BasicpyDialect.h"
 #include "npcomp/Dialect/Torch/IR/TorchOps.h"
 #include "npcomp/Dialect/Torch/IR/TorchUtils.h"
 
@@ -40,25 +42,26 @@ using namespace mlir::NPCOMP::Torch;
 // that these patterns become mostly mechanical associations of
 // "aten.foo -> linalg.foo".
 
+// For now, use a small allowlist of types we don't reject.
+// The main culprit in practice is an unknown dtype
+// when RefineTypes isn't smart enough to propagate it everywhere.
+// For tensors, we consider the post-conversion tensor type (this pass is
+// doing a type conversion).
+static bool isValidLinalgType(Type type) {
+  if (auto tensor = type.dyn_cast<ValueTensorType>()) {
+    if (auto rankedTensor =
+            tensor.toBuiltinTensor().dyn_cast_or_null<RankedTensorType>()) {
+      if (BaseMemRefType::isValidElementType(rankedTensor.getElementType()))
+        return true;
+    }
+  }
+  if (type.isa<FloatType, IntegerType, IndexType>())
+    return true;
+  return false;
+}
+
 static LogicalResult verifyLinalgCompatibleTypes(Operation *op,
                                                  PatternRewriter &rewriter) {
-  // For now, use a small allowlist of types we don't reject.
-  // The main culprit in practice is an unknown dtype
-  // when RefineTypes isn't smart enough to propagate it everywhere.
-  // For tensors, we consider the post-conversion tensor type (this pass is
-  // doing a type conversion).
-  auto isValidLinalgType = [](Type type) {
-    if (auto tensor = type.dyn_cast<ValueTensorType>()) {
-      if (auto rankedTensor =
-              tensor.toBuiltinTensor().dyn_cast_or_null<RankedTensorType>()) {
-        if (BaseMemRefType::isValidElementType(rankedTensor.getElementType()))
-          return true;
-      }
-    }
-    if (type.isa<FloatType, IntegerType, IndexType>())
-      return true;
-    return false;
-  };
   bool valid = llvm::all_of(op->getOperandTypes(), isValidLinalgType) &&
                llvm::all_of(op->getResultTypes(), isValidLinalgType);
   if (!valid)
@@ -66,6 +69,104 @@ static LogicalResult verifyLinalgCompatibleTypes(Operation *op,
   return success();
 }
 
+// Like the above, for ops that also have non-tensor operands (such as lists of
+// ints) that don't need to be lowered: only checks `tensors`, which are
+// original (non-converted) values of `op`, and requires a float dtype.
+static LogicalResult verifyLinalgCompatibleTypes(Operation *op,
+                                                 ValueRange tensors,
+                                                 PatternRewriter &rewriter) {
+  for (Value tensor : tensors) {
+    auto type = tensor.getType().dyn_cast<ValueTensorType>();
+    if (!type || !isValidLinalgType(type))
+      return rewriter.notifyMatchFailure(op,
+                                         "type cannot be lowered to linalg");
+    if (!type.getDtype().isa<FloatType>())
+      return rewriter.notifyMatchFailure(op, "unimplemented: non-float dtype");
+  }
+  return success();
+}
+
+// Match a `torch.prim.ListConstruct` of integer constants.
+static bool matchConstantIntList(Value list,
+                                 SmallVectorImpl<int64_t> &elements) {
+  auto listConstruct = list.getDefiningOp<PrimListConstructOp>();
+  if (!listConstruct)
+    return false;
+  for (Value element : listConstruct.elements()) {
+    APInt value;
+    if (!matchPattern(element, m_ConstantInt(&value)))
+      return false;
+    elements.push_back(value.getSExtValue());
+  }
+  return true;
+}
+
+// Match the constant dimensions of `aten.transpose.int` or `aten.permute` on
+// an operand of rank `rank`, as the permutation `dims` of the operand
+// dimensions (dimension i of the result is dimension dims[i] of the operand).
+static bool matchPermutation(Operation *op, int64_t rank,
+                             SmallVectorImpl<int64_t> &dims) {
+  if (auto transpose = dyn_cast<AtenTransposeIntOp>(op)) {
+    APInt dim0, dim1;
+    if (!matchPattern(transpose.dim0(), m_ConstantInt(&dim0)) ||
+        !matchPattern(transpose.dim1(), m_ConstantInt(&dim1)))
+      return false;
+    for (int64_t i = 0; i < rank; i++)
+      dims.push_back(i);
+    int64_t first = dim0.getSExtValue(), second = dim1.getSExtValue();
+    if (first < 0)
+      first += rank;
+    if (second < 0)
+      second += rank;
+    if (first < 0 || first >= rank || second < 0 || second >= rank)
+      return false;
+    std::swap(dims[first], dims[second]);
+    return true;
+  }
+  if (!matchConstantIntList(cast<AtenPermuteOp>(op).dims(), dims) ||
+      static_cast<int64_t>(dims.size()) != rank)
+    return false;
+  SmallVector<bool, 4> seen(rank, false);
+  for (int64_t &dim : dims) {
+    if (dim < 0)
+      dim += rank;
+    if (dim < 0 || dim >= rank || seen[dim])
+      return false;
+    seen[dim] = true;
+  }
+  return true;
+}
+
+// Match a constant bool, which is either an `i1` or a `!basicpy.BoolType`.
+static bool matchConstantBool(Value value, bool &result) {
+  Attribute attr;
+  if (!matchPattern(value, m_Constant(&attr)))
+    return false;
+  if (auto boolAttr = attr.dyn_cast<BoolAttr>()) {
+    result = boolAttr.getValue();
+    return true;
+  }
+  if (auto intAttr = attr.dyn_cast<IntegerAttr>()) {
+    result = intAttr.getValue().getBoolValue();
+    return true;
+  }
+  return false;
+}
+
+// Returns the size of dimension `dim` of `tensor` as an index attribute if it
+// is static, and `dynamicSize` otherwise.
+//
+// Init tensors built from these sizes keep all the statically known sizes in
+// their types, so that the static shapes reach the linalg ops (and everything
+// lowered from them) instead of being recovered by later canonicalizations.
+static OpFoldResult getStaticOrDynamicSize(OpBuilder &b, Value tensor,
+                                           int64_t dim, Value dynamicSize) {
+  auto type = tensor.getType().cast<RankedTensorType>();
+  if (!type.isDynamicDim(dim))
+    return b.getIndexAttr(type.getDimSize(dim));
+  return dynamicSize;
+}
+
 namespace {
 class ConvertAtenMmOp : public OpConversionPattern<AtenMmOp> {
 public:
@@ -109,7 +210,11 @@ public:
     Type newResultType = getTypeConverter()->convertType(op.getType());
     Type elementType = newResultType.cast<TensorType>().getElementType();
     Value initTensor = rewriter.create<linalg::InitTensorOp>(
-        loc, ValueRange{lhsDim0, rhsDim1}, elementType);
+        loc,
+        ArrayRef<OpFoldResult>{
+            getStaticOrDynamicSize(rewriter, lhs, 0, lhsDim0),
+            getStaticOrDynamicSize(rewriter, rhs, 1, rhsDim1)},
+        elementType);
     Value c0 =
         rewriter.create<ConstantOp>(loc, FloatAttr::get(elementType, 0.0));
     Value zeroFill =
@@ -118,11 +223,11 @@ public:
                        .create<linalg::MatmulOp>(loc, zeroFill.getType(),
                                                  ValueRange{lhs, rhs}, zeroFill)
                        .getResult(0);
-    // When constructed with just dynamic sizes, InitTensorOp will have a result
-    // type which has all `?`'s for dimensions, which might not be the result
-    // type of `op`. The constraints on later linalg ops means that the result
-    // of the MatmulOp will have this type too. So cast it to the desired type
-    // so that in the end we have the original result type.
+    // The InitTensorOp only has the static sizes of the operands, which might
+    // be less static than the result type of `op`. The constraints on later
+    // linalg ops means that the result of the MatmulOp will have this type
+    // too. So cast it to the desired type so that in the end we have the
+    // original result type.
     rewriter.replaceOpWithNewOp<tensor::CastOp>(op, newResultType, matmul);
 
     return success();
@@ -130,6 +235,138 @@ public:
 };
 } // namespace
 
+// Creates the product of `lhs` and `rhs`, which are either matrices
+// [M, K] x [K, N], batches of matrices [B, M, K] x [B, K, N], or a batch of
+// matrices and a matrix shared by the whole batch [B, M, K] x [K, N]. The
+// sizes are checked at runtime, with messages naming `opName`.
+static Value createMatmul(OpBuilder &b, Location loc, Value lhs, Value rhs,
+                          Type elementType, StringRef opName) {
+  MLIRContext *context = b.getContext();
+  int64_t lhsRank = lhs.getType().cast<RankedTensorType>().getRank();
+  int64_t rhsRank = rhs.getType().cast<RankedTensorType>().getRank();
+  SmallVector<Value, 3> lhsSizes, rhsSizes;
+  for (int64_t i = 0; i < lhsRank; i++)
+    lhsSizes.push_back(b.create<memref::DimOp>(loc, lhs, i));
+  for (int64_t i = 0; i < rhsRank; i++)
+    rhsSizes.push_back(b.create<memref::DimOp>(loc, rhs, i));
+  Value contractingDimEqual = b.create<CmpIOp>(
+      loc, CmpIPredicate::eq, lhsSizes.back(), rhsSizes[rhsRank - 2]);
+  b.create<AssertOp>(
+      loc, contractingDimEqual,
+      b.getStringAttr("mismatching contracting dimension for " + opName));
+  if (rhsRank == 3) {
+    Value batchDimEqual = b.create<CmpIOp>(loc, CmpIPredicate::eq,
+                                           lhsSizes[0], rhsSizes[0]);
+    b.create<AssertOp>(
+        loc, batchDimEqual,
+        b.getStringAttr("mismatching batch dimension for " + opName));
+  }
+
+  SmallVector<OpFoldResult, 3> resultSizes;
+  for (int64_t i = 0; i < lhsRank - 1; i++)
+    resultSizes.push_back(getStaticOrDynamicSize(b, lhs, i, lhsSizes[i]));
+  resultSizes.push_back(
+      getStaticOrDynamicSize(b, rhs, rhsRank - 1, rhsSizes.back()));
+  Value initTensor =
+      b.create<linalg::InitTensorOp>(loc, resultSizes, elementType);
+  Value c0 = b.create<ConstantOp>(loc, FloatAttr::get(elementType, 0.0));
+  Value zeroFill = b.create<linalg::FillOp>(loc, initTensor, c0).getResult(0);
+  if (lhsRank == 2) {
+    return b
+        .create<linalg::MatmulOp>(loc, zeroFill.getType(),
+                                  ValueRange{lhs, rhs}, zeroFill)
+        .getResult(0);
+  }
+  if (rhsRank == 3) {
+    return b
+        .create<linalg::BatchMatmulOp>(loc, zeroFill.getType(),
+                                       ValueRange{lhs, rhs}, zeroFill)
+        .getResult(0);
+  }
+
+  // The matrix is broadcast along the batch dimension, which would otherwise
+  // have to be materialized for linalg.batch_matmul.
+  AffineExpr batch, row, col, reduction;
+  bindDims(context, batch, row, col, reduction);
+  SmallVector<AffineMap, 3> indexingMaps = {
+      AffineMap::get(4, 0, {batch, row, reduction}, context),
+      AffineMap::get(4, 0, {reduction, col}, context),
+      AffineMap::get(4, 0, {batch, row, col}, context)};
+  SmallVector<StringRef, 4> iteratorTypes(3, getParallelIteratorTypeName());
+  iteratorTypes.push_back(getReductionIteratorTypeName());
+  return b
+      .create<linalg::GenericOp>(
+          loc, zeroFill.getType(), ValueRange{lhs, rhs}, zeroFill,
+          indexingMaps, iteratorTypes,
+          [](OpBuilder &b, Location loc, ValueRange args) {
+            Value product = b.create<MulFOp>(loc, args[0], args[1]);
+            b.create<linalg::YieldOp>(
+                loc, b.create<AddFOp>(loc, args[2], product).getResult());
+          })
+      .getResult(0);
+}
+
+namespace {
+class ConvertAtenBmmOp : public OpConversionPattern<AtenBmmOp> {
+public:
+  using OpConversionPattern::OpConversionPattern;
+  LogicalResult
+  matchAndRewrite(AtenBmmOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    Value lhs = operands[0];
+    Value rhs = operands[1];
+    // See the comments in ConvertAtenMmOp.
+    if (failed(verifyLinalgCompatibleTypes(op, rewriter)))
+      return failure();
+    if (lhs.getType().cast<RankedTensorType>().getRank() != 3 ||
+        rhs.getType().cast<RankedTensorType>().getRank() != 3) {
+      return rewriter.notifyMatchFailure(
+          op, "expected both operands to aten.bmm to be rank 3");
+    }
+
+    Type newResultType = getTypeConverter()->convertType(op.getType());
+    Type elementType = newResultType.cast<TensorType>().getElementType();
+    Value bmm = createMatmul(rewriter, op->getLoc(), lhs, rhs, elementType,
+                             "torch.aten.bmm");
+    rewriter.replaceOpWithNewOp<tensor::CastOp>(op, newResultType, bmm);
+    return success();
+  }
+};
+} // namespace
+
+namespace {
+// `aten.matmul` has NumPy-style semantics: depending on the operand ranks, it
+// computes a dot product, a matrix-vector product, or a (broadcasting) batch
+// matmul. Only the ranks that transformer-style models use are supported:
+// [M, K] x [K, N], [B, M, K] x [B, K, N] and [B, M, K] x [K, N].
+class ConvertAtenMatmulOp : public OpConversionPattern<AtenMatmulOp> {
+public:
+  using OpConversionPattern::OpConversionPattern;
+  LogicalResult
+  matchAndRewrite(AtenMatmulOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    Value lhs = operands[0];
+    Value rhs = operands[1];
+    if (failed(verifyLinalgCompatibleTypes(op, rewriter)))
+      return failure();
+    int64_t lhsRank = lhs.getType().cast<RankedTensorType>().getRank();
+    int64_t rhsRank = rhs.getType().cast<RankedTensorType>().getRank();
+    if (!(lhsRank == 2 && rhsRank == 2) && !(lhsRank == 3 && rhsRank == 3) &&
+        !(lhsRank == 3 && rhsRank == 2)) {
+      return rewriter.notifyMatchFailure(
+          op, "unimplemented: operand ranks of aten.matmul");
+    }
+
+    Type newResultType = getTypeConverter()->convertType(op.getType());
+    Type elementType = newResultType.cast<TensorType>().getElementType();
+    Value matmul = createMatmul(rewriter, op->getLoc(), lhs, rhs, elementType,
+                                "torch.aten.matmul");
+    rewriter.replaceOpWithNewOp<tensor::CastOp>(op, newResultType, matmul);
+    return success();
+  }
+};
+} // namespace
+
 namespace {
 // See comments at in convertMmOp and the heading for this section for general
 // considerations. This function needs to be auto-generated.
@@ -198,7 +435,11 @@ public:
         rewriter.getStringAttr("mismatching bias size for aten.linear"));
 
     Value initTensor = rewriter.create<linalg::InitTensorOp>(
-        loc, ValueRange{inputDim0, weightDim0}, inputType.getElementType());
+        loc,
+        ArrayRef<OpFoldResult>{
+            getStaticOrDynamicSize(rewriter, input, 0, inputDim0),
+            getStaticOrDynamicSize(rewriter, weight, 0, weightDim0)},
+        inputType.getElementType());
     SmallVector<AffineMap> broadcastIndexingMaps = {
         AffineMap::get(
             /*dimCount=*/2, /*symbolCount=*/0, rewriter.getAffineDimExpr(1)),
@@ -225,7 +466,11 @@ public:
             context),
         rewriter.getMultiDimIdentityMap(2)};
     Value transposedWeightInitTensor = rewriter.create<linalg::InitTensorOp>(
-        loc, ValueRange{weightDim1, weightDim0}, weightType.getElementType());
+        loc,
+        ArrayRef<OpFoldResult>{
+            getStaticOrDynamicSize(rewriter, weight, 1, weightDim1),
+            getStaticOrDynamicSize(rewriter, weight, 0, weightDim0)},
+        weightType.getElementType());
     Value transposedWeights =
         rewriter
             .create<linalg::GenericOp>(
@@ -249,89 +494,2318 @@ public:
 };
 } // namespace
 
+// Converts `scalar`, an integer or float, to the float type `dtype`.
+static Value convertScalarToFloat(OpBuilder &b, Location loc, Value scalar,
+                                  FloatType dtype) {
+  Type type = scalar.getType();
+  if (type.isa<IntegerType>())
+    return b.create<SIToFPOp>(loc, scalar, dtype);
+  unsigned width = type.cast<FloatType>().getWidth();
+  if (width > dtype.getWidth())
+    return b.create<FPTruncOp>(loc, scalar, dtype);
+  if (width < dtype.getWidth())
+    return b.create<FPExtOp>(loc, scalar, dtype);
+  return scalar;
+}
+
+static bool isElementwiseComparisonOp(Operation *op) {
+  return isa<AtenGtTensorOp, AtenGeTensorOp, AtenLtTensorOp, AtenLeTensorOp,
+             AtenEqTensorOp, AtenNeTensorOp>(op);
+}
+
+// Creates the computation of the elementwise op `op` on `args`, the elements
+// of its tensor operands. `alpha` is the multiplier of `other` in
+// `aten.add.Tensor` and `aten.sub.Tensor`, or null if it is 1.
+static Value createElementwisePayload(OpBuilder &b, Location loc,
+                                      Operation *op, ValueRange args,
+                                      Value alpha) {
+  if (isa<AtenTanhOp>(op))
+    return b.create<math::TanhOp>(loc, args[0]);
+  if (isa<AtenReluOp>(op)) {
+    // The comparison is unordered, so that NaNs are propagated.
+    Value zero =
+        b.create<ConstantOp>(loc, b.getFloatAttr(args[0].getType(), 0.0));
+    Value positive =
+        b.create<CmpFOp>(loc, CmpFPredicate::UGT, args[0], zero);
+    return b.create<SelectOp>(loc, positive, args[0], zero);
+  }
+  if (isa<AtenAddTensorOp, AtenSubTensorOp>(op)) {
+    Value other = args[1];
+    if (alpha)
+      other = b.create<MulFOp>(loc, other, alpha);
+    if (isa<AtenAddTensorOp>(op))
+      return b.create<AddFOp>(loc, args[0], other);
+    return b.create<SubFOp>(loc, args[0], other);
+  }
+  if (isa<AtenMulTensorOp>(op))
+    return b.create<MulFOp>(loc, args[0], args[1]);
+  if (isa<AtenDivTensorOp>(op))
+    return b.create<DivFOp>(loc, args[0], args[1]);
+  if (isa<AtenMaximumOp, AtenMinimumOp>(op)) {
+    // Propagate NaNs, as PyTorch does: a NaN `self` is selected (the
+    // comparison is unordered), and a NaN `other` is selected explicitly.
+    CmpFPredicate predicate =
+        isa<AtenMaximumOp>(op) ? CmpFPredicate::UGT : CmpFPredicate::ULT;
+    Value selectSelf = b.create<CmpFOp>(loc, predicate, args[0], args[1]);
+    Value result = b.create<SelectOp>(loc, selectSelf, args[0], args[1]);
+    Value otherIsNaN =
+        b.create<CmpFOp>(loc, CmpFPredicate::UNO, args[1], args[1]);
+    return b.create<SelectOp>(loc, otherIsNaN, args[1], result);
+  }
+  // Comparisons with NaN are false, except for `ne`.
+  CmpFPredicate predicate;
+  if (isa<AtenGtTensorOp>(op))
+    predicate = CmpFPredicate::OGT;
+  else if (isa<AtenGeTensorOp>(op))
+    predicate = CmpFPredicate::OGE;
+  else if (isa<AtenLtTensorOp>(op))
+    predicate = CmpFPredicate::OLT;
+  else if (isa<AtenLeTensorOp>(op))
+    predicate = CmpFPredicate::OLE;
+  else if (isa<AtenEqTensorOp>(op))
+    predicate = CmpFPredicate::OEQ;
+  else
+    predicate = CmpFPredicate::UNE;
+  return b.create<CmpFOp>(loc, predicate, args[0], args[1]);
+}
+
 namespace {
-// Converts a unary op. There is no implicit broadcasting behavior, so these can
-// be trivially lowered to linalg.
-// TODO: For binary ops, we will need a "linalg.generic-like" op that models
-// N-ary broadcasting and allows us to do multiversioning techniques for
-// lowering to linalg. We can trivially handle this as through that
-// abstraction instead.
-struct ConvertUnaryOp : ConversionPattern {
-  ConvertUnaryOp(TypeConverter &typeConverter, MLIRContext *context)
+// Converts an elementwise op, with the broadcasting semantics of PyTorch, to a
+// single linalg.generic. Broadcasting is expressed in the indexing maps of the
+// operands instead of being materialized: leading dimensions missing from an
+// operand are not indexed, and its dimensions of static size 1 are indexed
+// with the constant 0. The result is thus computed in one pass, and the
+// linalg.generic fuses with its elementwise producers and consumers.
+//
+// Dynamic dimensions are assumed not to be broadcast, and are checked to be
+// equal to the corresponding dimension of the result at runtime.
+// TODO: Handle dynamic sizes of 1 by multiversioning the linalg.generic.
+struct ConvertElementwiseOp : ConversionPattern {
+  ConvertElementwiseOp(TypeConverter &typeConverter, MLIRContext *context)
       : ConversionPattern(typeConverter, MatchAnyOpTypeTag(), /*benefit=*/1,
                           context) {}
 
   LogicalResult
   matchAndRewrite(Operation *op, ArrayRef<Value> operands,
                   ConversionPatternRewriter &rewriter) const override {
-    if (!isa<AtenTanhOp>(op))
-      return rewriter.notifyMatchFailure(op, "not a unary op");
+    if (!isa<AtenTanhOp, AtenReluOp, AtenAddTensorOp, AtenSubTensorOp,
+             AtenMulTensorOp, AtenDivTensorOp, AtenMaximumOp, AtenMinimumOp>(
+            op) &&
+        !isElementwiseComparisonOp(op))
+      return rewriter.notifyMatchFailure(op, "not an elementwise op");
 
-    if (failed(verifyLinalgCompatibleTypes(op, rewriter)))
+    Location loc = op->getLoc();
+    SmallVector<Value> tensorOperands, tensors;
+    for (auto it : llvm::zip(op->getOperands(), operands)) {
+      if (std::get<0>(it).getType().isa<ValueTensorType>()) {
+        tensors.push_back(std::get<0>(it));
+        tensorOperands.push_back(std::get<1>(it));
+      }
+    }
+    if (failed(verifyLinalgCompatibleTypes(op, tensors, rewriter)))
       return failure();
+    Value result = op->getResult(0);
+    if (!isValidLinalgType(result.getType()))
+      return rewriter.notifyMatchFailure(op,
+                                         "type cannot be lowered to linalg");
+    auto resultType = getTypeConverter()
+                          ->convertType(result.getType())
+                          .cast<RankedTensorType>();
+    auto dtype = tensorOperands[0]
+                     .getType()
+                     .cast<RankedTensorType>()
+                     .getElementType()
+                     .cast<FloatType>();
+    Type expectedResultDtype = isElementwiseComparisonOp(op)
+                                   ? rewriter.getI1Type()
+                                   : static_cast<Type>(dtype);
+    if (resultType.getElementType() != expectedResultDtype ||
+        llvm::any_of(tensorOperands, [&](Value tensor) {
+          return tensor.getType().cast<RankedTensorType>().getElementType() !=
+                 dtype;
+        })) {
+      return rewriter.notifyMatchFailure(op, "unimplemented: type promotion");
+    }
 
-    Value operand = operands[0];
-    auto type = getTypeConverter()
-                    ->convertType(op->getResult(0).getType())
-                    .cast<RankedTensorType>();
-    auto rank = type.getRank();
+    Value alpha;
+    if (isa<AtenAddTensorOp, AtenSubTensorOp>(op)) {
+      APInt alphaInt;
+      FloatAttr alphaFloat;
+      Value alphaOperand = op->getOperand(2);
+      if (!alphaOperand.getType().isa<IntegerType, FloatType>())
+        return rewriter.notifyMatchFailure(op, "unimplemented: alpha type");
+      bool isOne = (matchPattern(alphaOperand, m_ConstantInt(&alphaInt)) &&
+                    alphaInt == 1) ||
+                   (matchPattern(alphaOperand, m_Constant(&alphaFloat)) &&
+                    alphaFloat.getValue().isExactlyValue(1.0));
+      if (!isOne)
+        alpha = convertScalarToFloat(rewriter, loc, operands[2], dtype);
+    }
 
-    SmallVector<StringRef> iteratorTypes(rank, "parallel");
-    SmallVector<AffineMap> indexingMaps = {
-        rewriter.getMultiDimIdentityMap(rank),
-        rewriter.getMultiDimIdentityMap(rank)};
+    // Each dimension of the result takes its size from a source dimension of
+    // an operand that is not broadcast along it, preferably from an operand
+    // of the type of the result, which is then reused as the `outs` operand
+    // (its elements are never read) instead of creating an init tensor.
+    int64_t resultRank = resultType.getRank();
+    Value outs;
+    for (Value tensor : tensorOperands) {
+      if (tensor.getType() == resultType) {
+        outs = tensor;
+        break;
+      }
+    }
+    SmallVector<std::pair<Value, int64_t>> sizeSources(resultRank);
+    if (outs) {
+      for (int64_t j = 0; j < resultRank; j++)
+        sizeSources[j] = {outs, j};
+    }
+    SmallVector<AffineMap> indexingMaps;
+    for (Value tensor : tensorOperands) {
+      auto type = tensor.getType().cast<RankedTensorType>();
+      int64_t rank = type.getRank();
+      if (rank > resultRank)
+        return rewriter.notifyMatchFailure(
+            op, "operand of higher rank than the result");
+      SmallVector<AffineExpr> exprs;
+      for (int64_t i = 0; i < rank; i++) {
+        int64_t j = i + resultRank - rank;
+        int64_t size = type.getDimSize(i);
+        if (size == 1) {
+          exprs.push_back(rewriter.getAffineConstantExpr(0));
+          continue;
+        }
+        if (size != ShapedType::kDynamicSize &&
+            !resultType.isDynamicDim(j) && resultType.getDimSize(j) != size)
+          return rewriter.notifyMatchFailure(op, "incompatible static sizes");
+        exprs.push_back(rewriter.getAffineDimExpr(j));
+        if (!sizeSources[j].first)
+          sizeSources[j] = {tensor, i};
+      }
+      indexingMaps.push_back(AffineMap::get(/*dimCount=*/resultRank,
+                                            /*symbolCount=*/0, exprs,
+                                            op->getContext()));
+    }
+    indexingMaps.push_back(rewriter.getMultiDimIdentityMap(resultRank));
+
+    auto getSize = [&](Value tensor, int64_t dim) -> Value {
+      auto type = tensor.getType().cast<RankedTensorType>();
+      if (!type.isDynamicDim(dim))
+        return rewriter.create<ConstantIndexOp>(loc, type.getDimSize(dim));
+      return rewriter.create<memref::DimOp>(loc, tensor, dim);
+    };
+    SmallVector<Value> resultSizes(resultRank);
+    auto getResultSize = [&](int64_t j) -> Value {
+      if (!resultSizes[j]) {
+        if (!resultType.isDynamicDim(j))
+          resultSizes[j] =
+              rewriter.create<ConstantIndexOp>(loc, resultType.getDimSize(j));
+        else if (sizeSources[j].first)
+          resultSizes[j] =
+              getSize(sizeSources[j].first, sizeSources[j].second);
+        else
+          resultSizes[j] = rewriter.create<ConstantIndexOp>(loc, 1);
+      }
+      return resultSizes[j];
+    };
+    for (Value tensor : tensorOperands) {
+      auto type = tensor.getType().cast<RankedTensorType>();
+      int64_t rank = type.getRank();
+      for (int64_t i = 0; i < rank; i++) {
+        int64_t j = i + resultRank - rank;
+        if (type.getDimSize(i) == 1 ||
+            sizeSources[j] == std::make_pair(tensor, i) ||
+            (!type.isDynamicDim(i) && !resultType.isDynamicDim(j)))
+          continue;
+        Value sizeCorrect = rewriter.create<CmpIOp>(
+            loc, CmpIPredicate::eq, getSize(tensor, i), getResultSize(j));
+        rewriter.create<AssertOp>(
+            loc, sizeCorrect,
+            rewriter.getStringAttr(
+                "mismatching sizes in elementwise op (only static sizes of 1 "
+                "are broadcast)"));
+      }
+    }
+    if (!outs) {
+      SmallVector<OpFoldResult> initSizes;
+      for (int64_t j = 0; j < resultRank; j++) {
+        if (resultType.isDynamicDim(j))
+          initSizes.push_back(getResultSize(j));
+        else
+          initSizes.push_back(rewriter.getIndexAttr(resultType.getDimSize(j)));
+      }
+      outs = rewriter.create<linalg::InitTensorOp>(
+          loc, initSizes, resultType.getElementType());
+    }
 
+    SmallVector<StringRef> iteratorTypes(resultRank, "parallel");
     rewriter.replaceOpWithNewOp<linalg::GenericOp>(
-        op, type, operand, operand,
+        op, resultType, tensorOperands, outs,
         /*indexingMaps=*/indexingMaps,
         /*iteratorTypes=*/iteratorTypes,
         [&](OpBuilder &b, Location loc, ValueRange args) {
-          Value result;
-          if (isa<AtenTanhOp>(op)) {
-            result = b.create<math::TanhOp>(loc, args[0]);
-          }
-          b.create<linalg::YieldOp>(loc, result);
+          b.create<linalg::YieldOp>(
+              loc, createElementwisePayload(b, loc, op, args.drop_back(),
+                                            alpha));
         });
-
     return success();
   }
 };
 } // namespace
 
-// -----------------------------------------------------------------------------
-// The pass
-// -----------------------------------------------------------------------------
+// Returns the size of the output of a sliding window of size `kernelSize`
+// over a dimension of size `inputSize`, as computed by PyTorch (with
+// `ceil_mode` false).
+static OpFoldResult getSlidingWindowOutputSize(OpBuilder &b, Location loc,
+                                               OpFoldResult inputSize,
+                                               OpFoldResult kernelSize,
+                                               int64_t padding, int64_t stride,
+                                               int64_t dilation) {
+  auto inputAttr = inputSize.dyn_cast<Attribute>();
+  auto kernelAttr = kernelSize.dyn_cast<Attribute>();
+  if (inputAttr && kernelAttr) {
+    int64_t windowExtent =
+        dilation * (kernelAttr.cast<IntegerAttr>().getInt() - 1) + 1;
+    int64_t paddedSize = inputAttr.cast<IntegerAttr>().getInt() + 2 * padding;
+    // Invalid sizes are left to be diagnosed at runtime.
+    if (paddedSize >= windowExtent)
+      return b.getIndexAttr((paddedSize - windowExtent) / stride + 1);
+  }
+  auto getValue = [&](OpFoldResult size) -> Value {
+    if (auto attr = size.dyn_cast<Attribute>())
+      return b.create<ConstantIndexOp>(loc, attr.cast<IntegerAttr>().getInt());
+    return size.get<Value>();
+  };
+  // (inputSize + 2 * padding - (dilation * (kernelSize - 1) + 1)) / stride + 1
+  Value windowExtent = b.create<MulIOp>(
+      loc, getValue(kernelSize), b.create<ConstantIndexOp>(loc, dilation));
+  Value difference = b.create<SubIOp>(
+      loc,
+      b.create<AddIOp>(loc, getValue(inputSize),
+                       b.create<ConstantIndexOp>(loc, 2 * padding - 1 +
+                                                          dilation)),
+      windowExtent);
+  Value quotient = b.create<SignedDivIOp>(
+      loc, difference, b.create<ConstantIndexOp>(loc, stride));
+  return b.create<AddIOp>(loc, quotient, b.create<ConstantIndexOp>(loc, 1))
+      .getResult();
+}
+
+// Returns `input` padded with `padding[i]` elements of value `padValue` on
+// both sides of dimension `i + 2` (the spatial dimensions of an NCHW tensor).
+static Value padSpatialDims(OpBuilder &b, Location loc, Value input,
+                            ArrayRef<int64_t> padding, Value padValue) {
+  if (llvm::all_of(padding, [](int64_t pad) { return pad == 0; }))
+    return input;
+  auto inputType = input.getType().cast<RankedTensorType>();
+  SmallVector<int64_t, 4> paddedShape(inputType.getShape().begin(),
+                                      inputType.getShape().end());
+  SmallVector<OpFoldResult, 4> pads(inputType.getRank(), b.getIndexAttr(0));
+  for (size_t i = 0; i < padding.size(); i++) {
+    pads[i + 2] = b.getIndexAttr(padding[i]);
+    if (!inputType.isDynamicDim(i + 2))
+      paddedShape[i + 2] += 2 * padding[i];
+  }
+  auto paddedType =
+      RankedTensorType::get(paddedShape, inputType.getElementType());
+  return linalg::PadTensorOp::createPadScalarOp(paddedType, input, padValue,
+                                                pads, pads, loc, b);
+}
+
+// Returns a constant -inf of type `elementType`, the identity of max.
+static Value createNegativeInfinity(OpBuilder &b, Location loc,
+                                    Type elementType) {
+  return b.create<ConstantOp>(
+      loc, FloatAttr::get(elementType,
+                          -std::numeric_limits<double>::infinity()));
+}
 
 namespace {
-class ConvertTorchToLinalg
-    : public ConvertTorchToLinalgBase<ConvertTorchToLinalg> {
+// Lowers `aten.conv2d` to a linalg.generic over the loops
+// (n, f, oh, ow, c, kh, kw), reading the input through the strided and dilated
+// window of each output element. The result is accumulated into the
+// broadcasted bias, so that adding the bias doesn't take another pass over the
+// result.
+//
+// With `groups` > 1, filter f only reads the C = Cin / groups input channels
+// of its group, so the input channel of the loop c is
+// (f floordiv (F / groups)) * C + c, which needs F and C to be static. For
+// depthwise convolutions (C == 1, as in MobileNet-style networks), the loop c
+// is dropped: the kernel is then a parallel loop over the channels around the
+// KH x KW window, instead of a dense kernel with a reduction of size 1.
+class ConvertAtenConv2dOp : public OpConversionPattern<AtenConv2dOp> {
 public:
-  void getDependentDialects(DialectRegistry &registry) const override {
-    registry.insert<linalg::LinalgDialect>();
-    registry.insert<memref::MemRefDialect>();
-    registry.insert<math::MathDialect>();
-    registry.insert<StandardOpsDialect>();
-    registry.insert<tensor::TensorDialect>();
+  using OpConversionPattern::OpConversionPattern;
+  LogicalResult
+  matchAndRewrite(AtenConv2dOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    AtenConv2dOp::Adaptor adaptor(operands);
+    MLIRContext *context = op->getContext();
+    Location loc = op->getLoc();
+    Value input = adaptor.input();
+    Value weight = adaptor.weight();
+    Value bias = adaptor.bias();
+    bool hasBias = !op.bias().getType().isa<Basicpy::NoneType>();
+    SmallVector<Value, 4> tensors = {op.input(), op.weight(), op.getResult()};
+    if (hasBias)
+      tensors.push_back(op.bias());
+    if (failed(verifyLinalgCompatibleTypes(op, tensors, rewriter)))
+      return failure();
+    auto inputType = input.getType().cast<RankedTensorType>();
+    auto weightType = weight.getType().cast<RankedTensorType>();
+    if (inputType.getRank() != 4 || weightType.getRank() != 4 ||
+        (hasBias && bias.getType().cast<RankedTensorType>().getRank() != 1)) {
+      return rewriter.notifyMatchFailure(
+          op, "expected input and weight to be rank 4 and bias to be rank 1");
+    }
+    Type elementType = inputType.getElementType();
+    if (weightType.getElementType() != elementType ||
+        (hasBias &&
+         bias.getType().cast<RankedTensorType>().getElementType() !=
+             elementType)) {
+      return rewriter.notifyMatchFailure(op, "unimplemented: type promotion");
+    }
+    SmallVector<int64_t, 2> stride, padding, dilation;
+    if (!matchConstantIntList(op.stride(), stride) ||
+        !matchConstantIntList(op.padding(), padding) ||
+        !matchConstantIntList(op.dilation(), dilation) || stride.size() != 2 ||
+        padding.size() != 2 || dilation.size() != 2) {
+      return rewriter.notifyMatchFailure(
+          op, "unimplemented: non-constant stride, padding or dilation");
+    }
+    APInt groupsAP;
+    if (!matchPattern(op.groups(), m_ConstantInt(&groupsAP)))
+      return rewriter.notifyMatchFailure(op,
+                                         "unimplemented: non-constant groups");
+    int64_t groups = groupsAP.getSExtValue();
+    int64_t numFilters = weightType.getDimSize(0);
+    int64_t groupChannels = weightType.getDimSize(1);
+    if (groups != 1) {
+      if (groups <= 0 || weightType.isDynamicDim(0) ||
+          weightType.isDynamicDim(1))
+        return rewriter.notifyMatchFailure(
+            op, "unimplemented: dynamic weight channels with groups != 1");
+      if (numFilters % groups != 0)
+        return rewriter.notifyMatchFailure(
+            op, "expected the number of filters to be divisible by groups");
+    }
+
+    auto getDimOp = [&](Value v, int dimension) -> Value {
+      return rewriter.create<memref::DimOp>(loc, v, dimension);
+    };
+    Value inputDim1 = getDimOp(input, 1);
+    Value weightDim0 = getDimOp(weight, 0);
+    Value weightDim1 = getDimOp(weight, 1);
+    Value weightChannels = weightDim1;
+    if (groups != 1)
+      weightChannels = rewriter.create<ConstantIndexOp>(
+          loc, groups * groupChannels);
+    Value channelsEqual = rewriter.create<CmpIOp>(loc, CmpIPredicate::eq,
+                                                  inputDim1, weightChannels);
+    rewriter.create<AssertOp>(
+        loc, channelsEqual,
+        rewriter.getStringAttr("mismatching input channels for aten.conv2d"));
+    if (hasBias) {
+      Value biasSizeCorrect = rewriter.create<CmpIOp>(
+          loc, CmpIPredicate::eq, weightDim0, getDimOp(bias, 0));
+      rewriter.create<AssertOp>(
+          loc, biasSizeCorrect,
+          rewriter.getStringAttr("mismatching bias size for aten.conv2d"));
+    }
+
+    Value zero =
+        rewriter.create<ConstantOp>(loc, FloatAttr::get(elementType, 0.0));
+    Value paddedInput = padSpatialDims(rewriter, loc, input, padding, zero);
+    SmallVector<OpFoldResult, 4> resultSizes = {
+        getStaticOrDynamicSize(rewriter, input, 0, getDimOp(input, 0)),
+        getStaticOrDynamicSize(rewriter, weight, 0, weightDim0)};
+    for (int i = 0; i < 2; i++) {
+      resultSizes.push_back(getSlidingWindowOutputSize(
+          rewriter, loc,
+          getStaticOrDynamicSize(rewriter, input, 2 + i,
+                                 getDimOp(input, 2 + i)),
+          getStaticOrDynamicSize(rewriter, weight, 2 + i,
+                                 getDimOp(weight, 2 + i)),
+          padding[i], stride[i], dilation[i]));
+    }
+    Value initTensor =
+        rewriter.create<linalg::InitTensorOp>(loc, resultSizes, elementType);
+    Value accumulator;
+    if (hasBias) {
+      SmallVector<AffineMap> broadcastIndexingMaps = {
+          AffineMap::get(
+              /*dimCount=*/4, /*symbolCount=*/0, rewriter.getAffineDimExpr(1)),
+          rewriter.getMultiDimIdentityMap(4)};
+      SmallVector<StringRef> iteratorTypes(4, "parallel");
+      accumulator = rewriter
+                        .create<linalg::GenericOp>(
+                            loc, initTensor.getType(), bias, initTensor,
+                            /*indexingMaps=*/broadcastIndexingMaps,
+                            /*iteratorTypes=*/iteratorTypes,
+                            [](OpBuilder &b, Location loc, ValueRange args) {
+                              b.create<linalg::YieldOp>(loc, args[0]);
+                            })
+                        .getResult(0);
+    } else {
+      accumulator =
+          rewriter.create<linalg::FillOp>(loc, initTensor, zero).getResult(0);
+    }
+
+    AffineExpr n, f, oh, ow, c, kh, kw;
+    bool isDepthwise = groups != 1 && groupChannels == 1;
+    unsigned numLoops;
+    AffineExpr inputChannel, weightChannel;
+    if (isDepthwise) {
+      numLoops = 6;
+      bindDims(context, n, f, oh, ow, kh, kw);
+      inputChannel = f.floorDiv(numFilters / groups);
+      weightChannel = rewriter.getAffineConstantExpr(0);
+    } else {
+      numLoops = 7;
+      bindDims(context, n, f, oh, ow, c, kh, kw);
+      inputChannel = c;
+      if (groups != 1)
+        inputChannel = f.floorDiv(numFilters / groups) * groupChannels + c;
+      weightChannel = c;
+    }
+    SmallVector<AffineMap> indexingMaps = {
+        AffineMap::get(/*dimCount=*/numLoops, /*symbolCount=*/0,
+                       {n, inputChannel, oh * stride[0] + kh * dilation[0],
+                        ow * stride[1] + kw * dilation[1]},
+                       context),
+        AffineMap::get(/*dimCount=*/numLoops, /*symbolCount=*/0,
+                       {f, weightChannel, kh, kw}, context),
+        AffineMap::get(/*dimCount=*/numLoops, /*symbolCount=*/0,
+                       {n, f, oh, ow}, context)};
+    SmallVector<StringRef> iteratorTypes(4, "parallel");
+    iteratorTypes.append(numLoops - 4, "reduction");
+    Value conv = rewriter
+                     .create<linalg::GenericOp>(
+                         loc, accumulator.getType(),
+                         ValueRange{paddedInput, weight}, accumulator,
+                         /*indexingMaps=*/indexingMaps,
+                         /*iteratorTypes=*/iteratorTypes,
+                         [](OpBuilder &b, Location loc, ValueRange args) {
+                           Value product =
+                               b.create<MulFOp>(loc, args[0], args[1]);
+                           b.create<linalg::YieldOp>(
+                               loc, b.create<AddFOp>(loc, args[2], product)
+                                        .getResult());
+                         })
+                     .getResult(0);
+    Type newResultType = getTypeConverter()->convertType(op.getType());
+    rewriter.replaceOpWithNewOp<tensor::CastOp>(op, newResultType, conv);
+    return success();
   }
+};
+} // namespace
 
-  void runOnOperation() override {
-    MLIRContext *context = &getContext();
-    ConversionTarget target(*context);
-    target.addLegalDialect<linalg::LinalgDialect, StandardOpsDialect,
-                           memref::MemRefDialect, math::MathDialect,
-                           tensor::TensorDialect>();
+namespace {
+// Lowers `aten.max_pool2d` to a linalg.generic over the loops
+// (n, c, oh, ow, kh, kw). The loop range of (kh, kw) is given by an otherwise
+// unused input of the size of the window, since the input is only indexed by
+// combinations of the loops. The input is padded with -inf first.
+class ConvertAtenMaxPool2dOp : public OpConversionPattern<AtenMaxPool2dOp> {
+public:
+  using OpConversionPattern::OpConversionPattern;
+  LogicalResult
+  matchAndRewrite(AtenMaxPool2dOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    AtenMaxPool2dOp::Adaptor adaptor(operands);
+    MLIRContext *context = op->getContext();
+    Location loc = op->getLoc();
+    Value self = adaptor.self();
+    if (failed(verifyLinalgCompatibleTypes(op, {op.self(), op.getResult()},
+                                           rewriter)))
+      return failure();
+    auto selfType = self.getType().cast<RankedTensorType>();
+    if (selfType.getRank() != 4)
+      return rewriter.notifyMatchFailure(op, "expected self to be rank 4");
+    SmallVector<int64_t, 2> kernelSize, stride, padding, dilation;
+    if (!matchConstantIntList(op.kernel_size(), kernelSize) ||
+        !matchConstantIntList(op.stride(), stride) ||
+        !matchConstantIntList(op.padding(), padding) ||
+        !matchConstantIntList(op.dilation(), dilation)) {
+      return rewriter.notifyMatchFailure(
+          op, "unimplemented: non-constant kernel size, stride, padding or "
+              "dilation");
+    }
+    // An empty stride defaults to the kernel size.
+    if (stride.empty())
+      stride = kernelSize;
+    if (kernelSize.size() != 2 || stride.size() != 2 || padding.size() != 2 ||
+        dilation.size() != 2) {
+      return rewriter.notifyMatchFailure(
+          op, "unimplemented: kernel size, stride, padding or dilation of "
+              "size other than 2");
+    }
+    bool ceilMode;
+    if (!matchConstantBool(op.ceil_mode(), ceilMode) || ceilMode)
+      return rewriter.notifyMatchFailure(op, "unimplemented: ceil_mode");
 
-    TypeConverter typeConverter;
-    typeConverter.addConversion([](Type type) { return type; });
-    setupValueTensorToBuiltinTensorConversion(target, typeConverter);
+    auto getDimOp = [&](Value v, int dimension) -> Value {
+      return rewriter.create<memref::DimOp>(loc, v, dimension);
+    };
+    Type elementType = selfType.getElementType();
+    Value lowest = createNegativeInfinity(rewriter, loc, elementType);
+    Value paddedSelf = padSpatialDims(rewriter, loc, self, padding, lowest);
+    SmallVector<OpFoldResult, 4> resultSizes = {
+        getStaticOrDynamicSize(rewriter, self, 0, getDimOp(self, 0)),
+        getStaticOrDynamicSize(rewriter, self, 1, getDimOp(self, 1))};
+    for (int i = 0; i < 2; i++) {
+      resultSizes.push_back(getSlidingWindowOutputSize(
+          rewriter, loc,
+          getStaticOrDynamicSize(rewriter, self, 2 + i, getDimOp(self, 2 + i)),
+          rewriter.getIndexAttr(kernelSize[i]), padding[i], stride[i],
+          dilation[i]));
+    }
+    Value initTensor =
+        rewriter.create<linalg::InitTensorOp>(loc, resultSizes, elementType);
+    Value lowestFill =
+        rewriter.create<linalg::FillOp>(loc, initTensor, lowest).getResult(0);
+    Value window = rewriter.create<linalg::InitTensorOp>(
+        loc, ValueRange(), kernelSize, elementType);
 
-    RewritePatternSet patterns(context);
-    target.addIllegalOp<AtenMmOp>();
-    patterns.add<ConvertAtenMmOp>(typeConverter, context);
-    target.addIllegalOp<AtenLinearOp>();
-    patterns.add<ConvertAtenLinearOp>(typeConverter, context);
-    target.addIllegalOp<AtenTanhOp>();
-    patterns.add<ConvertUnaryOp>(typeConverter, context);
+    AffineExpr n, c, oh, ow, kh, kw;
+    bindDims(context, n, c, oh, ow, kh, kw);
+    SmallVector<AffineMap> indexingMaps = {
+        AffineMap::get(/*dimCount=*/6, /*symbolCount=*/0,
+                       {n, c, oh * stride[0] + kh * dilation[0],
+                        ow * stride[1] + kw * dilation[1]},
+                       context),
+        AffineMap::get(/*dimCount=*/6, /*symbolCount=*/0, {kh, kw}, context),
+        AffineMap::get(/*dimCount=*/6, /*symbolCount=*/0, {n, c, oh, ow},
+                       context)};
+    SmallVector<StringRef> iteratorTypes(4, "parallel");
+    iteratorTypes.append(2, "reduction");
+    Value maxPool =
+        rewriter
+            .create<linalg::GenericOp>(
+                loc, lowestFill.getType(), ValueRange{paddedSelf, window},
+                lowestFill,
+                /*indexingMaps=*/indexingMaps,
+                /*iteratorTypes=*/iteratorTypes,
+                [](OpBuilder &b, Location loc, ValueRange args) {
+                  Value element = args[0];
+                  Value acc = args[2];
+                  // Propagate NaNs, as PyTorch does: a NaN element is
+                  // selected (the comparison is unordered), and a NaN
+                  // accumulator is kept.
+                  Value greater = b.create<CmpFOp>(loc, CmpFPredicate::UGT,
+                                                   element, acc);
+                  Value max = b.create<SelectOp>(loc, greater, element, acc);
+                  Value accIsNaN =
+                      b.create<CmpFOp>(loc, CmpFPredicate::UNO, acc, acc);
+                  b.create<linalg::YieldOp>(
+                      loc, b.create<SelectOp>(loc, accIsNaN, acc, max)
+                               .getResult());
+                })
+            .getResult(0);
+    Type newResultType = getTypeConverter()->convertType(op.getType());
+    rewriter.replaceOpWithNewOp<tensor::CastOp>(op, newResultType, maxPool);
+    return success();
+  }
+};
+} // namespace
+
+namespace {
+// Lowers `aten.adaptive_avg_pool2d` when each output element averages a
+// window of the same size, which is the case when the input size is a
+// multiple of the output size. The windows then tile the input, as in a
+// pooling with a stride equal to the window size. Dynamic input sizes are
+// supported when the output size is 1 (global average pooling).
+//
+// Each element is scaled by the reciprocal of the window size as it is
+// accumulated, so that the average takes a single pass over the input.
+class ConvertAtenAdaptiveAvgPool2dOp
+    : public OpConversionPattern<AtenAdaptiveAvgPool2dOp> {
+public:
+  using OpConversionPattern::OpConversionPattern;
+  LogicalResult
+  matchAndRewrite(AtenAdaptiveAvgPool2dOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    AtenAdaptiveAvgPool2dOp::Adaptor adaptor(operands);
+    MLIRContext *context = op->getContext();
+    Location loc = op->getLoc();
+    Value self = adaptor.self();
+    if (failed(verifyLinalgCompatibleTypes(op, {op.self(), op.getResult()},
+                                           rewriter)))
+      return failure();
+    auto selfType = self.getType().cast<RankedTensorType>();
+    if (selfType.getRank() != 4)
+      return rewriter.notifyMatchFailure(op, "expected self to be rank 4");
+    SmallVector<int64_t, 2> outputSize;
+    if (!matchConstantIntList(op.output_size(), outputSize) ||
+        outputSize.size() != 2 ||
+        llvm::any_of(outputSize, [](int64_t size) { return size <= 0; })) {
+      return rewriter.notifyMatchFailure(
+          op, "unimplemented: output size other than 2 constant positive "
+              "sizes");
+    }
+
+    auto getDimOp = [&](Value v, int dimension) -> Value {
+      return rewriter.create<memref::DimOp>(loc, v, dimension);
+    };
+    AffineExpr n, c, oh, ow, kh, kw;
+    bindDims(context, n, c, oh, ow, kh, kw);
+    AffineExpr outputExprs[2] = {oh, ow};
+    AffineExpr windowExprs[2] = {kh, kw};
+    SmallVector<AffineExpr, 4> inputExprs = {n, c};
+    SmallVector<OpFoldResult, 2> windowSizes;
+    for (int i = 0; i < 2; i++) {
+      OpFoldResult inputSize =
+          getStaticOrDynamicSize(rewriter, self, 2 + i, getDimOp(self, 2 + i));
+      if (outputSize[i] == 1) {
+        windowSizes.push_back(inputSize);
+        inputExprs.push_back(windowExprs[i]);
+        continue;
+      }
+      int64_t staticInputSize = selfType.getDimSize(2 + i);
+      if (ShapedType::isDynamic(staticInputSize) ||
+          staticInputSize % outputSize[i] != 0) {
+        return rewriter.notifyMatchFailure(
+            op, "unimplemented: input size that is not a static multiple of "
+                "the output size");
+      }
+      int64_t windowSize = staticInputSize / outputSize[i];
+      windowSizes.push_back(rewriter.getIndexAttr(windowSize));
+      inputExprs.push_back(outputExprs[i] * windowSize + windowExprs[i]);
+    }
+
+    Type elementType = selfType.getElementType();
+    Value scale;
+    auto windowHeight = windowSizes[0].dyn_cast<Attribute>();
+    auto windowWidth = windowSizes[1].dyn_cast<Attribute>();
+    if (windowHeight && windowWidth) {
+      int64_t windowElements = windowHeight.cast<IntegerAttr>().getInt() *
+                               windowWidth.cast<IntegerAttr>().getInt();
+      scale = rewriter.create<ConstantOp>(
+          loc, FloatAttr::get(elementType, 1.0 / windowElements));
+    } else {
+      auto getValue = [&](OpFoldResult size) -> Value {
+        if (auto attr = size.dyn_cast<Attribute>())
+          return rewriter.create<ConstantIndexOp>(
+              loc, attr.cast<IntegerAttr>().getInt());
+        return size.get<Value>();
+      };
+      Value windowElements = rewriter.create<MulIOp>(
+          loc, getValue(windowSizes[0]), getValue(windowSizes[1]));
+      Value count = rewriter.create<SIToFPOp>(
+          loc,
+          rewriter.create<IndexCastOp>(loc, windowElements,
+                                       rewriter.getI64Type()),
+          elementType);
+      Value one =
+          rewriter.create<ConstantOp>(loc, FloatAttr::get(elementType, 1.0));
+      scale = rewriter.create<DivFOp>(loc, one, count);
+    }
+
+    SmallVector<OpFoldResult, 4> resultSizes = {
+        getStaticOrDynamicSize(rewriter, self, 0, getDimOp(self, 0)),
+        getStaticOrDynamicSize(rewriter, self, 1, getDimOp(self, 1)),
+        rewriter.getIndexAttr(outputSize[0]),
+        rewriter.getIndexAttr(outputSize[1])};
+    Value initTensor =
+        rewriter.create<linalg::InitTensorOp>(loc, resultSizes, elementType);
+    Value zero =
+        rewriter.create<ConstantOp>(loc, FloatAttr::get(elementType, 0.0));
+    Value zeroFill =
+        rewriter.create<linalg::FillOp>(loc, initTensor, zero).getResult(0);
+    Value window =
+        rewriter.create<linalg::InitTensorOp>(loc, windowSizes, elementType);
+
+    SmallVector<AffineMap> indexingMaps = {
+        AffineMap::get(/*dimCount=*/6, /*symbolCount=*/0, inputExprs, context),
+        AffineMap::get(/*dimCount=*/6, /*symbolCount=*/0, {kh, kw}, context),
+        AffineMap::get(/*dimCount=*/6, /*symbolCount=*/0, {n, c, oh, ow},
+                       context)};
+    SmallVector<StringRef> iteratorTypes(4, "parallel");
+    iteratorTypes.append(2, "reduction");
+    Value avgPool =
+        rewriter
+            .create<linalg::GenericOp>(
+                loc, zeroFill.getType(), ValueRange{self, window}, zeroFill,
+                /*indexingMaps=*/indexingMaps,
+                /*iteratorTypes=*/iteratorTypes,
+                [&](OpBuilder &b, Location loc, ValueRange args) {
+                  Value scaled = b.create<MulFOp>(loc, args[0], scale);
+                  b.create<linalg::YieldOp>(
+                      loc, b.create<AddFOp>(loc, args[2], scaled).getResult());
+                })
+            .getResult(0);
+    Type newResultType = getTypeConverter()->convertType(op.getType());
+    rewriter.replaceOpWithNewOp<tensor::CastOp>(op, newResultType, avgPool);
+    return success();
+  }
+};
+} // namespace
+
+namespace {
+// Lowers `aten.batch_norm` in inference mode to a single elementwise
+// linalg.generic that normalizes each element with the running statistics of
+// its channel.
+class ConvertAtenBatchNormOp : public OpConversionPattern<AtenBatchNormOp> {
+public:
+  using OpConversionPattern::OpConversionPattern;
+  LogicalResult
+  matchAndRewrite(AtenBatchNormOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    AtenBatchNormOp::Adaptor adaptor(operands);
+    MLIRContext *context = op->getContext();
+    Location loc = op->getLoc();
+    Value input = adaptor.input();
+    SmallVector<Value, 4> channelParams = {adaptor.weight(), adaptor.bias(),
+                                           adaptor.running_mean(),
+                                           adaptor.running_var()};
+    SmallVector<Value, 6> tensors = {op.input(),       op.weight(),
+                                     op.bias(),        op.running_mean(),
+                                     op.running_var(), op.getResult()};
+    if (llvm::any_of(channelParams, [](Value param) {
+          return param.getType().isa<Basicpy::NoneType>();
+        })) {
+      return rewriter.notifyMatchFailure(
+          op, "unimplemented: None weight, bias, running_mean or "
+              "running_var");
+    }
+    if (failed(verifyLinalgCompatibleTypes(op, tensors, rewriter)))
+      return failure();
+    bool training;
+    if (!matchConstantBool(op.training(), training) || training)
+      return rewriter.notifyMatchFailure(op, "unimplemented: training mode");
+    auto inputType = input.getType().cast<RankedTensorType>();
+    Type elementType = inputType.getElementType();
+    if (inputType.getRank() < 2 ||
+        llvm::any_of(channelParams, [&](Value param) {
+          return param.getType().cast<RankedTensorType>().getRank() != 1;
+        })) {
+      return rewriter.notifyMatchFailure(
+          op, "expected input to be at least rank 2 and weight, bias, "
+              "running_mean and running_var to be rank 1");
+    }
+    if (llvm::any_of(channelParams, [&](Value param) {
+          return param.getType().cast<RankedTensorType>().getElementType() !=
+                 elementType;
+        })) {
+      return rewriter.notifyMatchFailure(op, "unimplemented: type promotion");
+    }
+
+    Value numChannels = rewriter.create<memref::DimOp>(loc, input, 1);
+    for (Value param : channelParams) {
+      Value sizeCorrect = rewriter.create<CmpIOp>(
+          loc, CmpIPredicate::eq, numChannels,
+          rewriter.create<memref::DimOp>(loc, param, 0));
+      rewriter.create<AssertOp>(
+          loc, sizeCorrect,
+          rewriter.getStringAttr(
+              "mismatching number of channels for aten.batch_norm"));
+    }
+    Value eps = convertScalarToFloat(rewriter, loc, adaptor.eps(),
+                                     elementType.cast<FloatType>());
+
+    int64_t rank = inputType.getRank();
+    AffineMap channelMap = AffineMap::get(
+        /*dimCount=*/rank, /*symbolCount=*/0, rewriter.getAffineDimExpr(1),
+        context);
+    SmallVector<AffineMap> indexingMaps = {
+        rewriter.getMultiDimIdentityMap(rank), channelMap, channelMap,
+        channelMap, channelMap, rewriter.getMultiDimIdentityMap(rank)};
+    SmallVector<StringRef> iteratorTypes(rank, "parallel");
+    SmallVector<Value, 5> inputs = {input};
+    inputs.append(channelParams.begin(), channelParams.end());
+    Value batchNorm =
+        rewriter
+            .create<linalg::GenericOp>(
+                loc, input.getType(), inputs, input,
+                /*indexingMaps=*/indexingMaps,
+                /*iteratorTypes=*/iteratorTypes,
+                [&](OpBuilder &b, Location loc, ValueRange args) {
+                  Value element = args[0], weight = args[1], bias = args[2],
+                        mean = args[3], var = args[4];
+                  // (element - mean) / sqrt(var + eps) * weight + bias
+                  Value stdDev = b.create<math::SqrtOp>(
+                      loc, b.create<AddFOp>(loc, var, eps));
+                  Value normalized = b.create<DivFOp>(
+                      loc, b.create<SubFOp>(loc, element, mean), stdDev);
+                  Value scaled = b.create<MulFOp>(loc, normalized, weight);
+                  b.create<linalg::YieldOp>(
+                      loc, b.create<AddFOp>(loc, scaled, bias).getResult());
+                })
+            .getResult(0);
+    Type newResultType = getTypeConverter()->convertType(op.getType());
+    rewriter.replaceOpWithNewOp<tensor::CastOp>(op, newResultType, batchNorm);
+    return success();
+  }
+};
+} // namespace
+
+// Normalizes `input` with the mean and variance of its elements over the
+// reduction loops of `iteratorTypes`, then applies the optional per-element
+// `weight` and `bias` (null if absent), as in layer and group normalization.
+//
+// The loops are those of `input`, and the statistics have the shape
+// `statsSizes`, indexed by `statsMap`. `weight` and `bias` are indexed by
+// `paramMap`.
+//
+// The mean and variance are computed together, in a single pass over the
+// input, with Welford's algorithm (which, unlike accumulating the sum and the
+// sum of squares, doesn't lose the variance to cancellation when it is small
+// compared to the mean). After a small computation over the statistics only,
+// a second pass normalizes the input and applies the affine transform.
+static Value createNormalization(OpBuilder &b, Location loc, Value input,
+                                 ArrayRef<StringRef> iteratorTypes,
+                                 AffineMap statsMap,
+                                 ArrayRef<OpFoldResult> statsSizes,
+                                 Value weight, Value bias, AffineMap paramMap,
+                                 Value eps) {
+  auto inputType = input.getType().cast<RankedTensorType>();
+  Type elementType = inputType.getElementType();
+  int64_t rank = inputType.getRank();
+  Value zero = b.create<ConstantOp>(loc, FloatAttr::get(elementType, 0.0));
+  Value one = b.create<ConstantOp>(loc, FloatAttr::get(elementType, 1.0));
+  Value statsInit =
+      b.create<linalg::InitTensorOp>(loc, statsSizes, elementType);
+  Value zeroStats =
+      b.create<linalg::FillOp>(loc, statsInit, zero).getResult(0);
+
+  // The running count, mean and sum of squared differences from the mean.
+  AffineMap identity = b.getMultiDimIdentityMap(rank);
+  auto welford = b.create<linalg::GenericOp>(
+      loc, TypeRange{zeroStats.getType(), zeroStats.getType(),
+                     zeroStats.getType()},
+      input, ValueRange{zeroStats, zeroStats, zeroStats},
+      /*indexingMaps=*/
+      ArrayRef<AffineMap>{identity, statsMap, statsMap, statsMap},
+      /*iteratorTypes=*/iteratorTypes,
+      [&](OpBuilder &b, Location loc, ValueRange args) {
+        Value element = args[0], count = args[1], mean = args[2],
+              m2 = args[3];
+        Value newCount = b.create<AddFOp>(loc, count, one);
+        Value delta = b.create<SubFOp>(loc, element, mean);
+        Value newMean = b.create<AddFOp>(
+            loc, mean, b.create<DivFOp>(loc, delta, newCount));
+        Value newM2 = b.create<AddFOp>(
+            loc, m2,
+            b.create<MulFOp>(loc, delta,
+                             b.create<SubFOp>(loc, element, newMean)));
+        b.create<linalg::YieldOp>(loc, ValueRange{newCount, newMean, newM2});
+      });
+  Value count = welford.getResult(0), mean = welford.getResult(1),
+        m2 = welford.getResult(2);
+
+  // 1 / sqrt(variance + eps), once per set of statistics rather than once per
+  // element.
+  int64_t statsRank = statsSizes.size();
+  AffineMap statsIdentity = b.getMultiDimIdentityMap(statsRank);
+  SmallVector<StringRef, 4> statsIteratorTypes(statsRank, "parallel");
+  Value invStdDev =
+      b.create<linalg::GenericOp>(
+           loc, statsInit.getType(), ValueRange{count, m2}, statsInit,
+           /*indexingMaps=*/
+           ArrayRef<AffineMap>{statsIdentity, statsIdentity, statsIdentity},
+           /*iteratorTypes=*/statsIteratorTypes,
+           [&](OpBuilder &b, Location loc, ValueRange args) {
+             Value variance = b.create<DivFOp>(loc, args[1], args[0]);
+             Value stdDev = b.create<math::SqrtOp>(
+                 loc, b.create<AddFOp>(loc, variance, eps));
+             b.create<linalg::YieldOp>(
+                 loc, b.create<DivFOp>(loc, one, stdDev).getResult());
+           })
+          .getResult(0);
+
+  SmallVector<Value, 5> inputs = {input, mean, invStdDev};
+  SmallVector<AffineMap, 6> indexingMaps = {identity, statsMap, statsMap};
+  if (weight) {
+    inputs.push_back(weight);
+    indexingMaps.push_back(paramMap);
+  }
+  if (bias) {
+    inputs.push_back(bias);
+    indexingMaps.push_back(paramMap);
+  }
+  indexingMaps.push_back(identity);
+  SmallVector<StringRef, 4> parallelIteratorTypes(rank, "parallel");
+  return b
+      .create<linalg::GenericOp>(
+          loc, input.getType(), inputs, input,
+          /*indexingMaps=*/indexingMaps,
+          /*iteratorTypes=*/parallelIteratorTypes,
+          [&](OpBuilder &b, Location loc, ValueRange args) {
+            // (element - mean) * invStdDev * weight + bias
+            Value result = b.create<MulFOp>(
+                loc, b.create<SubFOp>(loc, args[0], args[1]), args[2]);
+            unsigned nextArg = 3;
+            if (weight)
+              result = b.create<MulFOp>(loc, result, args[nextArg++]);
+            if (bias)
+              result = b.create<AddFOp>(loc, result, args[nextArg++]);
+            b.create<linalg::YieldOp>(loc, result);
+          })
+      .getResult(0);
+}
+
+// Returns the converted optional tensor `value`, or null if it is None.
+static Value getOptionalTensor(Value value) {
+  return value.getType().isa<Basicpy::NoneType>() ? Value() : value;
+}
+
+namespace {
+// Lowers `aten.layer_norm`, which normalizes each slice of the trailing
+// `normalized_shape` dimensions of its input, with createNormalization.
+class ConvertAtenLayerNormOp : public OpConversionPattern<AtenLayerNormOp> {
+public:
+  using OpConversionPattern::OpConversionPattern;
+  LogicalResult
+  matchAndRewrite(AtenLayerNormOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    AtenLayerNormOp::Adaptor adaptor(operands);
+    MLIRContext *context = op->getContext();
+    Location loc = op->getLoc();
+    Value input = adaptor.input();
+    Value weight = getOptionalTensor(adaptor.weight());
+    Value bias = getOptionalTensor(adaptor.bias());
+    SmallVector<Value, 4> tensors = {op.input(), op.getResult()};
+    if (weight)
+      tensors.push_back(op.weight());
+    if (bias)
+      tensors.push_back(op.bias());
+    if (failed(verifyLinalgCompatibleTypes(op, tensors, rewriter)))
+      return failure();
+    SmallVector<int64_t, 4> normalizedShape;
+    if (!matchConstantIntList(op.normalized_shape(), normalizedShape))
+      return rewriter.notifyMatchFailure(
+          op, "unimplemented: non-constant normalized_shape");
+    auto inputType = input.getType().cast<RankedTensorType>();
+    Type elementType = inputType.getElementType();
+    int64_t rank = inputType.getRank();
+    int64_t numNormalizedDims = normalizedShape.size();
+    if (numNormalizedDims == 0 || numNormalizedDims > rank)
+      return rewriter.notifyMatchFailure(
+          op, "expected normalized_shape to have between 1 and rank "
+              "dimensions");
+    for (Value param : {weight, bias}) {
+      if (!param)
+        continue;
+      auto paramType = param.getType().cast<RankedTensorType>();
+      if (paramType.getRank() != numNormalizedDims)
+        return rewriter.notifyMatchFailure(
+            op, "expected weight and bias to have the normalized shape");
+      if (paramType.getElementType() != elementType)
+        return rewriter.notifyMatchFailure(op,
+                                           "unimplemented: type promotion");
+    }
+
+    int64_t numStatsDims = rank - numNormalizedDims;
+    for (int64_t i = 0; i < numNormalizedDims; i++) {
+      Value size = rewriter.create<ConstantIndexOp>(loc, normalizedShape[i]);
+      SmallVector<Value, 3> sizes = {
+          rewriter.create<memref::DimOp>(loc, input, numStatsDims + i)};
+      for (Value param : {weight, bias})
+        if (param)
+          sizes.push_back(rewriter.create<memref::DimOp>(loc, param, i));
+      for (Value otherSize : sizes) {
+        Value sizeCorrect = rewriter.create<CmpIOp>(loc, CmpIPredicate::eq,
+                                                    size, otherSize);
+        rewriter.create<AssertOp>(
+            loc, sizeCorrect,
+            rewriter.getStringAttr(
+                "mismatching normalized_shape for aten.layer_norm"));
+      }
+    }
+    Value eps = convertScalarToFloat(rewriter, loc, adaptor.eps(),
+                                     elementType.cast<FloatType>());
+
+    SmallVector<StringRef, 4> iteratorTypes;
+    SmallVector<AffineExpr, 4> statsExprs, paramExprs;
+    SmallVector<OpFoldResult, 4> statsSizes;
+    for (int64_t i = 0; i < rank; i++) {
+      if (i >= numStatsDims) {
+        iteratorTypes.push_back("reduction");
+        paramExprs.push_back(rewriter.getAffineDimExpr(i));
+        continue;
+      }
+      iteratorTypes.push_back("parallel");
+      statsExprs.push_back(rewriter.getAffineDimExpr(i));
+      statsSizes.push_back(getStaticOrDynamicSize(
+          rewriter, input, i, rewriter.create<memref::DimOp>(loc, input, i)));
+    }
+    AffineMap statsMap = AffineMap::get(/*dimCount=*/rank, /*symbolCount=*/0,
+                                        statsExprs, context);
+    AffineMap paramMap = AffineMap::get(/*dimCount=*/rank, /*symbolCount=*/0,
+                                        paramExprs, context);
+    Value layerNorm =
+        createNormalization(rewriter, loc, input, iteratorTypes, statsMap,
+                            statsSizes, weight, bias, paramMap, eps);
+    Type newResultType = getTypeConverter()->convertType(op.getType());
+    rewriter.replaceOpWithNewOp<tensor::CastOp>(op, newResultType, layerNorm);
+    return success();
+  }
+};
+} // namespace
+
+namespace {
+// Lowers `aten.group_norm`, which normalizes each group of `num_groups`
+// consecutive channels of each batch element, with createNormalization. The
+// statistics of a group are indexed with the channel divided by the number of
+// channels per group, which has to be static.
+class ConvertAtenGroupNormOp : public OpConversionPattern<AtenGroupNormOp> {
+public:
+  using OpConversionPattern::OpConversionPattern;
+  LogicalResult
+  matchAndRewrite(AtenGroupNormOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    AtenGroupNormOp::Adaptor adaptor(operands);
+    MLIRContext *context = op->getContext();
+    Location loc = op->getLoc();
+    Value input = adaptor.input();
+    Value weight = getOptionalTensor(adaptor.weight());
+    Value bias = getOptionalTensor(adaptor.bias());
+    SmallVector<Value, 4> tensors = {op.input(), op.getResult()};
+    if (weight)
+      tensors.push_back(op.weight());
+    if (bias)
+      tensors.push_back(op.bias());
+    if (failed(verifyLinalgCompatibleTypes(op, tensors, rewriter)))
+      return failure();
+    APInt numGroupsAP;
+    if (!matchPattern(op.num_groups(), m_ConstantInt(&numGroupsAP)))
+      return rewriter.notifyMatchFailure(
+          op, "unimplemented: non-constant num_groups");
+    int64_t numGroups = numGroupsAP.getSExtValue();
+    auto inputType = input.getType().cast<RankedTensorType>();
+    Type elementType = inputType.getElementType();
+    int64_t rank = inputType.getRank();
+    if (rank < 2)
+      return rewriter.notifyMatchFailure(op,
+                                         "expected input to be at least rank 2");
+    if (inputType.isDynamicDim(1))
+      return rewriter.notifyMatchFailure(
+          op, "unimplemented: dynamic number of channels");
+    int64_t numChannels = inputType.getDimSize(1);
+    if (numGroups <= 0 || numChannels % numGroups != 0)
+      return rewriter.notifyMatchFailure(
+          op, "expected the number of channels to be divisible by num_groups");
+    for (Value param : {weight, bias}) {
+      if (!param)
+        continue;
+      auto paramType = param.getType().cast<RankedTensorType>();
+      if (paramType.getRank() != 1)
+        return rewriter.notifyMatchFailure(
+            op, "expected weight and bias to be rank 1");
+      if (paramType.getElementType() != elementType)
+        return rewriter.notifyMatchFailure(op,
+                                           "unimplemented: type promotion");
+      Value sizeCorrect = rewriter.create<CmpIOp>(
+          loc, CmpIPredicate::eq,
+          rewriter.create<ConstantIndexOp>(loc, numChannels),
+          rewriter.create<memref::DimOp>(loc, param, 0));
+      rewriter.create<AssertOp>(
+          loc, sizeCorrect,
+          rewriter.getStringAttr(
+              "mismatching number of channels for aten.group_norm"));
+    }
+    Value eps = convertScalarToFloat(rewriter, loc, adaptor.eps(),
+                                     elementType.cast<FloatType>());
+
+    SmallVector<StringRef, 4> iteratorTypes(rank, "reduction");
+    iteratorTypes[0] = "parallel";
+    AffineExpr channel = rewriter.getAffineDimExpr(1);
+    AffineMap statsMap = AffineMap::get(
+        /*dimCount=*/rank, /*symbolCount=*/0,
+        {rewriter.getAffineDimExpr(0),
+         channel.floorDiv(numChannels / numGroups)},
+        context);
+    SmallVector<OpFoldResult, 2> statsSizes = {
+        getStaticOrDynamicSize(rewriter, input, 0,
+                               rewriter.create<memref::DimOp>(loc, input, 0)),
+        rewriter.getIndexAttr(numGroups)};
+    AffineMap paramMap =
+        AffineMap::get(/*dimCount=*/rank, /*symbolCount=*/0, channel);
+    Value groupNorm =
+        createNormalization(rewriter, loc, input, iteratorTypes, statsMap,
+                            statsSizes, weight, bias, paramMap, eps);
+    Type newResultType = getTypeConverter()->convertType(op.getType());
+    rewriter.replaceOpWithNewOp<tensor::CastOp>(op, newResultType, groupNorm);
+    return success();
+  }
+};
+} // namespace
+
+namespace {
+// Lowers `aten.transpose.int` and `aten.permute` (on value tensors) to a copy
+// through a permuted indexing map. The RefBackend pipeline folds the permuted
+// map into the elementwise ops reading the result, so that the transpose is
+// usually not materialized, and blocks the remaining copies for the cache
+// with its affine loop tiling.
+template <typename OpTy>
+class ConvertAtenPermuteLikeOp : public OpConversionPattern<OpTy> {
+public:
+  using OpConversionPattern<OpTy>::OpConversionPattern;
+  LogicalResult
+  matchAndRewrite(OpTy op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    typename OpTy::Adaptor adaptor(operands);
+    Location loc = op->getLoc();
+    Value self = adaptor.self();
+    if (failed(verifyLinalgCompatibleTypes(op, {op.self(), op.getResult()},
+                                           rewriter)))
+      return failure();
+    auto selfType = self.getType().cast<RankedTensorType>();
+    int64_t rank = selfType.getRank();
+    SmallVector<int64_t, 4> dims;
+    if (!matchPermutation(op, rank, dims))
+      return rewriter.notifyMatchFailure(
+          op, "unimplemented: non-constant or invalid dimensions");
+
+    SmallVector<AffineExpr, 4> selfExprs(rank);
+    SmallVector<OpFoldResult, 4> resultSizes;
+    for (int64_t i = 0; i < rank; i++) {
+      selfExprs[dims[i]] = rewriter.getAffineDimExpr(i);
+      resultSizes.push_back(getStaticOrDynamicSize(
+          rewriter, self, dims[i],
+          rewriter.create<memref::DimOp>(loc, self, dims[i])));
+    }
+    Value initTensor = rewriter.create<linalg::InitTensorOp>(
+        loc, resultSizes, selfType.getElementType());
+    SmallVector<AffineMap, 2> indexingMaps = {
+        AffineMap::get(/*dimCount=*/rank, /*symbolCount=*/0, selfExprs,
+                       op->getContext()),
+        rewriter.getMultiDimIdentityMap(rank)};
+    SmallVector<StringRef, 4> iteratorTypes(rank, "parallel");
+    Value transposed =
+        rewriter
+            .create<linalg::GenericOp>(
+                loc, initTensor.getType(), self, initTensor,
+                /*indexingMaps=*/indexingMaps,
+                /*iteratorTypes=*/iteratorTypes,
+                [](OpBuilder &b, Location loc, ValueRange args) {
+                  b.create<linalg::YieldOp>(loc, args[0]);
+                })
+            .getResult(0);
+    Type newResultType = this->getTypeConverter()->convertType(op.getType());
+    rewriter.replaceOpWithNewOp<tensor::CastOp>(op, newResultType, transposed);
+    return success();
+  }
+};
+} // namespace
+
+// Returns the bound `bound` of a slice of a dimension of size `dimSize`, as
+// an index normalized like the bounds of Python slices: negative bounds count
+// from the end, and bounds are clamped to [0, dimSize]. `bound` is an optional
+// int, whose None stands for `defaultBound`.
+static Value getSliceBound(OpBuilder &b, Location loc, Value bound,
+                           Value defaultBound, Value dimSize) {
+  if (bound.getType().isa<Basicpy::NoneType>())
+    return defaultBound;
+  Value zero = b.create<ConstantIndexOp>(loc, 0);
+  Value index = b.create<IndexCastOp>(loc, bound, b.getIndexType());
+  Value isNegative = b.create<CmpIOp>(loc, CmpIPredicate::slt, index, zero);
+  index = b.create<SelectOp>(loc, isNegative,
+                             b.create<AddIOp>(loc, index, dimSize), index);
+  Value isBelow = b.create<CmpIOp>(loc, CmpIPredicate::slt, index, zero);
+  index = b.create<SelectOp>(loc, isBelow, zero, index);
+  Value isAbove = b.create<CmpIOp>(loc, CmpIPredicate::sgt, index, dimSize);
+  return b.create<SelectOp>(loc, isAbove, dimSize, index);
+}
+
+// Like getSliceBound, for a constant (or None) bound of a static dimension.
+static int64_t getStaticSliceBound(Optional<int64_t> bound,
+                                   int64_t defaultBound, int64_t dimSize) {
+  if (!bound)
+    return defaultBound;
+  int64_t index = *bound < 0 ? *bound + dimSize : *bound;
+  return std::min(std::max(index, int64_t(0)), dimSize);
+}
+
+// Returns the value of `value`, an optional int, in `result` (None if it is
+// None). Returns false if it is not a constant.
+static bool matchConstantOptionalInt(Value value,
+                                     Optional<int64_t> &result) {
+  if (value.getType().isa<Basicpy::NoneType>()) {
+    result = None;
+    return true;
+  }
+  APInt valueAP;
+  if (!matchPattern(value, m_ConstantInt(&valueAP)))
+    return false;
+  result = valueAP.getSExtValue();
+  return true;
+}
+
+// Returns the offsets, sizes and strides of `subtensor`s taking all of each
+// dimension of `tensor`.
+static void getFullSlice(OpBuilder &b, Location loc, Value tensor,
+                         SmallVectorImpl<OpFoldResult> &offsets,
+                         SmallVectorImpl<OpFoldResult> &sizes,
+                         SmallVectorImpl<OpFoldResult> &strides) {
+  auto type = tensor.getType().cast<RankedTensorType>();
+  for (int64_t i = 0, e = type.getRank(); i < e; i++) {
+    offsets.push_back(b.getIndexAttr(0));
+    if (type.isDynamicDim(i))
+      sizes.push_back(b.create<memref::DimOp>(loc, tensor, i).getResult());
+    else
+      sizes.push_back(b.getIndexAttr(type.getDimSize(i)));
+    strides.push_back(b.getIndexAttr(1));
+  }
+}
+
+namespace {
+// Lowers `aten.slice.Tensor` (on value tensors) to a `subtensor`, which
+// bufferizes to a `memref.subview` of the sliced buffer, and to a copy only
+// where a consumer can't read the strided view directly (see
+// refback-elide-slice-copies).
+class ConvertAtenSliceTensorOp : public OpConversionPattern<AtenSliceTensorOp> {
+public:
+  using OpConversionPattern::OpConversionPattern;
+  LogicalResult
+  matchAndRewrite(AtenSliceTensorOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    AtenSliceTensorOp::Adaptor adaptor(operands);
+    Location loc = op->getLoc();
+    Value self = adaptor.self();
+    if (failed(verifyLinalgCompatibleTypes(op, {op.self(), op.getResult()},
+                                           rewriter)))
+      return failure();
+    auto selfType = self.getType().cast<RankedTensorType>();
+    int64_t rank = selfType.getRank();
+    APInt dimAP, stepAP;
+    if (!matchPattern(op.dim(), m_ConstantInt(&dimAP)) ||
+        !matchPattern(op.step(), m_ConstantInt(&stepAP)))
+      return rewriter.notifyMatchFailure(
+          op, "unimplemented: non-constant dim or step");
+    int64_t dim = dimAP.getSExtValue();
+    if (dim < 0)
+      dim += rank;
+    if (dim < 0 || dim >= rank)
+      return rewriter.notifyMatchFailure(op, "dim out of range");
+    int64_t step = stepAP.getSExtValue();
+    if (step <= 0)
+      return rewriter.notifyMatchFailure(op, "expected a positive step");
+
+    SmallVector<OpFoldResult, 4> offsets, sizes, strides;
+    getFullSlice(rewriter, loc, self, offsets, sizes, strides);
+    strides[dim] = rewriter.getIndexAttr(step);
+    Optional<int64_t> start, end;
+    if (!selfType.isDynamicDim(dim) &&
+        matchConstantOptionalInt(op.start(), start) &&
+        matchConstantOptionalInt(op.end(), end)) {
+      int64_t dimSize = selfType.getDimSize(dim);
+      int64_t offset = getStaticSliceBound(start, 0, dimSize);
+      int64_t limit =
+          std::max(getStaticSliceBound(end, dimSize, dimSize), offset);
+      offsets[dim] = rewriter.getIndexAttr(offset);
+      sizes[dim] = rewriter.getIndexAttr((limit - offset + step - 1) / step);
+    } else {
+      Value dimSize = rewriter.create<memref::DimOp>(loc, self, dim);
+      Value offset =
+          getSliceBound(rewriter, loc, adaptor.start(),
+                        rewriter.create<ConstantIndexOp>(loc, 0), dimSize);
+      Value limit = getSliceBound(rewriter, loc, adaptor.end(), dimSize,
+                                  dimSize);
+      Value isEmpty =
+          rewriter.create<CmpIOp>(loc, CmpIPredicate::slt, limit, offset);
+      limit = rewriter.create<SelectOp>(loc, isEmpty, offset, limit);
+      // ceildiv(limit - offset, step)
+      Value size = rewriter.create<SignedDivIOp>(
+          loc,
+          rewriter.create<AddIOp>(
+              loc, rewriter.create<SubIOp>(loc, limit, offset),
+              rewriter.create<ConstantIndexOp>(loc, step - 1)),
+          rewriter.create<ConstantIndexOp>(loc, step));
+      offsets[dim] = offset;
+      sizes[dim] = size;
+    }
+    Value slice =
+        rewriter.create<SubTensorOp>(loc, self, offsets, sizes, strides);
+    Type newResultType = getTypeConverter()->convertType(op.getType());
+    rewriter.replaceOpWithNewOp<tensor::CastOp>(op, newResultType, slice);
+    return success();
+  }
+};
+} // namespace
+
+namespace {
+// Lowers `aten.select.int` (on value tensors) to a rank-reducing `subtensor`
+// of size 1 along `dim`, like ConvertAtenSliceTensorOp.
+class ConvertAtenSelectIntOp : public OpConversionPattern<AtenSelectIntOp> {
+public:
+  using OpConversionPattern::OpConversionPattern;
+  LogicalResult
+  matchAndRewrite(AtenSelectIntOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    AtenSelectIntOp::Adaptor adaptor(operands);
+    Location loc = op->getLoc();
+    Value self = adaptor.self();
+    if (failed(verifyLinalgCompatibleTypes(op, {op.self(), op.getResult()},
+                                           rewriter)))
+      return failure();
+    auto selfType = self.getType().cast<RankedTensorType>();
+    int64_t rank = selfType.getRank();
+    APInt dimAP;
+    if (!matchPattern(op.dim(), m_ConstantInt(&dimAP)))
+      return rewriter.notifyMatchFailure(op, "unimplemented: non-constant dim");
+    int64_t dim = dimAP.getSExtValue();
+    if (dim < 0)
+      dim += rank;
+    if (dim < 0 || dim >= rank)
+      return rewriter.notifyMatchFailure(op, "dim out of range");
+
+    // Negative indices count from the end.
+    Value dimSize = rewriter.create<memref::DimOp>(loc, self, dim);
+    Value index =
+        rewriter.create<IndexCastOp>(loc, adaptor.index(),
+                                     rewriter.getIndexType());
+    Value isNegative = rewriter.create<CmpIOp>(
+        loc, CmpIPredicate::slt, index,
+        rewriter.create<ConstantIndexOp>(loc, 0));
+    index = rewriter.create<SelectOp>(
+        loc, isNegative, rewriter.create<AddIOp>(loc, index, dimSize), index);
+    Value inBounds =
+        rewriter.create<CmpIOp>(loc, CmpIPredicate::ult, index, dimSize);
+    rewriter.create<AssertOp>(
+        loc, inBounds,
+        rewriter.getStringAttr("index out of range in torch.aten.select.int"));
+
+    SmallVector<OpFoldResult, 4> offsets, sizes, strides;
+    getFullSlice(rewriter, loc, self, offsets, sizes, strides);
+    offsets[dim] = index;
+    sizes[dim] = rewriter.getIndexAttr(1);
+    SmallVector<int64_t, 4> resultShape(selfType.getShape().begin(),
+                                        selfType.getShape().end());
+    resultShape.erase(resultShape.begin() + dim);
+    auto sliceType =
+        RankedTensorType::get(resultShape, selfType.getElementType());
+    Value slice = rewriter.create<SubTensorOp>(loc, sliceType, self, offsets,
+                                               sizes, strides);
+    Type newResultType = getTypeConverter()->convertType(op.getType());
+    rewriter.replaceOpWithNewOp<tensor::CastOp>(op, newResultType, slice);
+    return success();
+  }
+};
+} // namespace
+
+namespace {
+// Lowers `aten.cat` of a `torch.prim.ListConstruct` by inserting each input
+// into the result with a `subtensor_insert`, at the offset along `dim` where
+// the previous inputs end. The list itself is never materialized, and after
+// bufferization the inputs are computed directly into their views of the
+// result (see refback-elide-concat-copies).
+class ConvertAtenCatOp : public OpConversionPattern<AtenCatOp> {
+public:
+  using OpConversionPattern::OpConversionPattern;
+  LogicalResult
+  matchAndRewrite(AtenCatOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    Location loc = op->getLoc();
+    auto listConstruct = op.tensors().getDefiningOp<PrimListConstructOp>();
+    if (!listConstruct || listConstruct.elements().empty())
+      return rewriter.notifyMatchFailure(
+          op, "unimplemented: tensors not from a non-empty list construct");
+    SmallVector<Value> tensorValues(listConstruct.elements());
+    tensorValues.push_back(op.getResult());
+    if (failed(verifyLinalgCompatibleTypes(op, tensorValues, rewriter)))
+      return failure();
+    auto resultType = getTypeConverter()
+                          ->convertType(op.getType())
+                          .cast<RankedTensorType>();
+    int64_t rank = resultType.getRank();
+    APInt dimAP;
+    if (!matchPattern(op.dim(), m_ConstantInt(&dimAP)))
+      return rewriter.notifyMatchFailure(op, "unimplemented: non-constant dim");
+    int64_t dim = dimAP.getSExtValue();
+    if (dim < 0)
+      dim += rank;
+    if (dim < 0 || dim >= rank)
+      return rewriter.notifyMatchFailure(op, "dim out of range");
+
+    SmallVector<Value> tensors;
+    for (Value element : listConstruct.elements()) {
+      Value tensor = rewriter.create<ToBuiltinTensorOp>(loc, element);
+      auto type = tensor.getType().cast<RankedTensorType>();
+      if (type.getRank() != rank ||
+          type.getElementType() != resultType.getElementType())
+        return rewriter.notifyMatchFailure(
+            op, "unimplemented: inputs of different ranks or dtypes");
+      tensors.push_back(tensor);
+    }
+
+    // The sizes of the result are those of the first input, except along
+    // `dim`, where they add up.
+    SmallVector<Value, 4> resultSizes;
+    for (int64_t i = 0; i < rank; i++)
+      resultSizes.push_back(rewriter.create<memref::DimOp>(loc, tensors[0], i));
+    for (Value tensor : llvm::drop_begin(tensors)) {
+      for (int64_t i = 0; i < rank; i++) {
+        Value size = rewriter.create<memref::DimOp>(loc, tensor, i);
+        if (i == dim) {
+          resultSizes[i] = rewriter.create<AddIOp>(loc, resultSizes[i], size);
+          continue;
+        }
+        Value sizesEqual = rewriter.create<CmpIOp>(loc, CmpIPredicate::eq,
+                                                   resultSizes[i], size);
+        rewriter.create<AssertOp>(
+            loc, sizesEqual,
+            rewriter.getStringAttr("mismatching sizes in torch.aten.cat"));
+      }
+    }
+    Value result = rewriter.create<linalg::InitTensorOp>(
+        loc, resultSizes, resultType.getElementType());
+
+    Value offset = rewriter.create<ConstantIndexOp>(loc, 0);
+    for (Value tensor : tensors) {
+      SmallVector<OpFoldResult, 4> offsets, sizes, strides;
+      getFullSlice(rewriter, loc, tensor, offsets, sizes, strides);
+      offsets[dim] = offset;
+      result = rewriter.create<SubTensorInsertOp>(loc, tensor, result, offsets,
+                                                  sizes, strides);
+      offset = rewriter.create<AddIOp>(
+          loc, offset, rewriter.create<memref::DimOp>(loc, tensor, dim));
+    }
+    rewriter.replaceOpWithNewOp<tensor::CastOp>(op, resultType, result);
+    return success();
+  }
+};
+} // namespace
+
+namespace {
+// Lowers the `torch.prim.ListUnpack` of an `aten.split.Tensor` or
+// `aten.chunk` to a `subtensor` for each piece, like ConvertAtenSliceTensorOp.
+// After bufferization, the pieces only read by linalg ops are read through
+// views of the split buffer (see refback-elide-slice-copies), so splitting
+// doesn't move any data.
+class ConvertSplitListUnpackOp : public OpConversionPattern<PrimListUnpackOp> {
+public:
+  using OpConversionPattern::OpConversionPattern;
+  LogicalResult
+  matchAndRewrite(PrimListUnpackOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    Location loc = op->getLoc();
+    Operation *split = op.operand().getDefiningOp();
+    if (!isa_and_nonnull<AtenSplitTensorOp, AtenChunkOp>(split))
+      return rewriter.notifyMatchFailure(
+          op, "unimplemented: list not from aten.split.Tensor or aten.chunk");
+    Value selfTensor = split->getOperand(0);
+    SmallVector<Value> tensorValues(op.getResults());
+    tensorValues.push_back(selfTensor);
+    if (failed(verifyLinalgCompatibleTypes(op, tensorValues, rewriter)))
+      return failure();
+    Value self = rewriter.create<ToBuiltinTensorOp>(loc, selfTensor);
+    int64_t rank = self.getType().cast<RankedTensorType>().getRank();
+    APInt dimAP;
+    if (!matchPattern(split->getOperand(2), m_ConstantInt(&dimAP)))
+      return rewriter.notifyMatchFailure(op, "unimplemented: non-constant dim");
+    int64_t dim = dimAP.getSExtValue();
+    if (dim < 0)
+      dim += rank;
+    if (dim < 0 || dim >= rank)
+      return rewriter.notifyMatchFailure(op, "dim out of range");
+
+    // Every piece but the last has `pieceSize` elements along `dim`.
+    Value dimSize = rewriter.create<memref::DimOp>(loc, self, dim);
+    Value one = rewriter.create<ConstantIndexOp>(loc, 1);
+    auto ceilDiv = [&](Value lhs, Value rhs) -> Value {
+      return rewriter.create<SignedDivIOp>(
+          loc,
+          rewriter.create<SubIOp>(loc, rewriter.create<AddIOp>(loc, lhs, rhs),
+                                  one),
+          rhs);
+    };
+    Value operand = rewriter.create<IndexCastOp>(loc, split->getOperand(1),
+                                                 rewriter.getIndexType());
+    Value isPositive = rewriter.create<CmpIOp>(
+        loc, CmpIPredicate::sgt, operand,
+        rewriter.create<ConstantIndexOp>(loc, 0));
+    rewriter.create<AssertOp>(
+        loc, isPositive,
+        rewriter.getStringAttr("expected a positive split size or number of "
+                               "chunks"));
+    Value pieceSize =
+        isa<AtenChunkOp>(split) ? ceilDiv(dimSize, operand) : operand;
+    Value numPieces = ceilDiv(dimSize, pieceSize);
+    Value numResults =
+        rewriter.create<ConstantIndexOp>(loc, op.getNumResults());
+    Value numPiecesEqual =
+        rewriter.create<CmpIOp>(loc, CmpIPredicate::eq, numPieces, numResults);
+    rewriter.create<AssertOp>(
+        loc, numPiecesEqual,
+        rewriter.getStringAttr(
+            "mismatching number of results for torch.prim.ListUnpack"));
+
+    auto min = [&](Value lhs, Value rhs) -> Value {
+      Value isLess =
+          rewriter.create<CmpIOp>(loc, CmpIPredicate::slt, lhs, rhs);
+      return rewriter.create<SelectOp>(loc, isLess, lhs, rhs);
+    };
+    SmallVector<Value> pieces;
+    for (auto result : llvm::enumerate(op.getResults())) {
+      Value index = rewriter.create<ConstantIndexOp>(loc, result.index());
+      Value offset =
+          min(rewriter.create<MulIOp>(loc, index, pieceSize), dimSize);
+      Value size =
+          min(pieceSize, rewriter.create<SubIOp>(loc, dimSize, offset));
+      SmallVector<OpFoldResult, 4> offsets, sizes, strides;
+      getFullSlice(rewriter, loc, self, offsets, sizes, strides);
+      offsets[dim] = offset;
+      sizes[dim] = size;
+      Value piece =
+          rewriter.create<SubTensorOp>(loc, self, offsets, sizes, strides);
+      Type newResultType =
+          getTypeConverter()->convertType(result.value().getType());
+      pieces.push_back(
+          rewriter.create<tensor::CastOp>(loc, newResultType, piece));
+    }
+    rewriter.replaceOp(op, pieces);
+    if (split->getResult(0).hasOneUse())
+      rewriter.eraseOp(split);
+    return success();
+  }
+};
+} // namespace
+
+namespace {
+// Lowers `aten.softmax.int` and `aten.log_softmax.int`.
+//
+// The maximum and the sum of the exponentials of each slice along `dim` are
+// computed together, in a single pass: the sum is kept relative to the
+// running maximum, and rescaled when the maximum increases. This keeps `exp`
+// from overflowing (as in the usual `exp(x - max(x))` formulation) without a
+// separate pass to compute the maximum. A second pass computes the results.
+template <typename OpTy>
+class ConvertAtenSoftmaxLikeOp : public OpConversionPattern<OpTy> {
+public:
+  using OpConversionPattern<OpTy>::OpConversionPattern;
+  LogicalResult
+  matchAndRewrite(OpTy op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    typename OpTy::Adaptor adaptor(operands);
+    MLIRContext *context = op->getContext();
+    Location loc = op->getLoc();
+    Value self = adaptor.self();
+    if (failed(verifyLinalgCompatibleTypes(op, {op.self(), op.getResult()},
+                                           rewriter)))
+      return failure();
+    if (!op.dtype().getType().template isa<Basicpy::NoneType>())
+      return rewriter.notifyMatchFailure(op, "unimplemented: dtype argument");
+    auto selfType = self.getType().cast<RankedTensorType>();
+    int64_t rank = selfType.getRank();
+    APInt dimAP;
+    if (!matchPattern(op.dim(), m_ConstantInt(&dimAP)))
+      return rewriter.notifyMatchFailure(op, "unimplemented: non-constant dim");
+    int64_t dim = dimAP.getSExtValue();
+    if (dim < 0)
+      dim += rank;
+    if (dim < 0 || dim >= rank)
+      return rewriter.notifyMatchFailure(op, "dim out of range");
+
+    Type elementType = selfType.getElementType();
+    SmallVector<OpFoldResult, 4> reducedSizes;
+    SmallVector<AffineExpr, 4> reducedExprs;
+    SmallVector<StringRef, 4> iteratorTypes;
+    for (int64_t i = 0; i < rank; i++) {
+      if (i == dim) {
+        iteratorTypes.push_back("reduction");
+        continue;
+      }
+      iteratorTypes.push_back("parallel");
+      reducedExprs.push_back(rewriter.getAffineDimExpr(i));
+      reducedSizes.push_back(getStaticOrDynamicSize(
+          rewriter, self, i, rewriter.create<memref::DimOp>(loc, self, i)));
+    }
+    Value reducedInit =
+        rewriter.create<linalg::InitTensorOp>(loc, reducedSizes, elementType);
+    Value lowest = createNegativeInfinity(rewriter, loc, elementType);
+    Value zero =
+        rewriter.create<ConstantOp>(loc, FloatAttr::get(elementType, 0.0));
+    Value one =
+        rewriter.create<ConstantOp>(loc, FloatAttr::get(elementType, 1.0));
+    Value maxInit =
+        rewriter.create<linalg::FillOp>(loc, reducedInit, lowest).getResult(0);
+    Value sumInit =
+        rewriter.create<linalg::FillOp>(loc, reducedInit, zero).getResult(0);
+
+    AffineMap identity = rewriter.getMultiDimIdentityMap(rank);
+    AffineMap reducedMap = AffineMap::get(
+        /*dimCount=*/rank, /*symbolCount=*/0, reducedExprs, context);
+    auto maxAndSum = rewriter.create<linalg::GenericOp>(
+        loc, TypeRange{maxInit.getType(), sumInit.getType()}, self,
+        ValueRange{maxInit, sumInit},
+        /*indexingMaps=*/ArrayRef<AffineMap>{identity, reducedMap, reducedMap},
+        /*iteratorTypes=*/iteratorTypes,
+        [&](OpBuilder &b, Location loc, ValueRange args) {
+          Value element = args[0], max = args[1], sum = args[2];
+          Value greater =
+              b.create<CmpFOp>(loc, CmpFPredicate::OGT, element, max);
+          Value newMax = b.create<SelectOp>(loc, greater, element, max);
+          // Rescale the sum when the maximum increases.
+          Value rescaledSum = b.create<MulFOp>(
+              loc, sum,
+              b.create<math::ExpOp>(loc, b.create<SubFOp>(loc, max, newMax)));
+          rescaledSum = b.create<SelectOp>(loc, greater, rescaledSum, sum);
+          // exp(element - newMax), which is 1 when `element` is the maximum.
+          // Selecting the constant also avoids computing `exp(-inf - -inf)`
+          // for the leading -inf elements of a slice.
+          Value isMax =
+              b.create<CmpFOp>(loc, CmpFPredicate::OEQ, element, newMax);
+          Value exp = b.create<math::ExpOp>(
+              loc, b.create<SubFOp>(loc, element, newMax));
+          exp = b.create<SelectOp>(loc, isMax, one, exp);
+          Value newSum = b.create<AddFOp>(loc, rescaledSum, exp);
+          b.create<linalg::YieldOp>(loc, ValueRange{newMax, newSum});
+        });
+
+    bool isLogSoftmax = std::is_same<OpTy, AtenLogSoftmaxIntOp>::value;
+    SmallVector<StringRef, 4> parallelIteratorTypes(rank, "parallel");
+    Value result =
+        rewriter
+            .create<linalg::GenericOp>(
+                loc, self.getType(),
+                ValueRange{self, maxAndSum.getResult(0),
+                           maxAndSum.getResult(1)},
+                self,
+                /*indexingMaps=*/
+                ArrayRef<AffineMap>{identity, reducedMap, reducedMap,
+                                    identity},
+                /*iteratorTypes=*/parallelIteratorTypes,
+                [&](OpBuilder &b, Location loc, ValueRange args) {
+                  Value shifted = b.create<SubFOp>(loc, args[0], args[1]);
+                  Value result;
+                  if (isLogSoftmax) {
+                    result = b.create<SubFOp>(
+                        loc, shifted, b.create<math::LogOp>(loc, args[2]));
+                  } else {
+                    result = b.create<DivFOp>(
+                        loc, b.create<math::ExpOp>(loc, shifted), args[2]);
+                  }
+                  b.create<linalg::YieldOp>(loc, result);
+                })
+            .getResult(0);
+    Type newResultType =
+        this->getTypeConverter()->convertType(op.getType());
+    rewriter.replaceOpWithNewOp<tensor::CastOp>(op, newResultType, result);
+    return success();
+  }
+};
+} // namespace
+
+// Casts `value`, an integer of any signedness (such as the elements of an
+// `si64` index tensor), to the signless integer of the same width that std
+// ops operate on.
+static Value castToSignless(OpBuilder &b, Location loc, Value value) {
+  auto type = value.getType().cast<IntegerType>();
+  if (type.isSignless())
+    return value;
+  return b
+      .create<UnrealizedConversionCastOp>(
+          loc, b.getIntegerType(type.getWidth()), value)
+      .getResult(0);
+}
+
+// Returns true if `tensor`, a converted value, is a tensor of integers.
+static bool isIntegerTensor(Value tensor) {
+  auto type = tensor.getType().dyn_cast<RankedTensorType>();
+  return type && type.getElementType().isa<IntegerType>();
+}
+
+// Creates a guard that the elements of the integer tensor `indices` are in
+// [0, `size`), as indices of a gather must be. The indices are reduced to
+// their minimum and maximum in a single pass, which is cheap compared to the
+// gather itself (that moves a whole row or slice per index).
+static void createIndicesInBoundsGuard(OpBuilder &b, Location loc,
+                                       Value indices, Value size,
+                                       StringRef message) {
+  MLIRContext *context = b.getContext();
+  auto indicesType = indices.getType().cast<RankedTensorType>();
+  int64_t rank = indicesType.getRank();
+  unsigned width = indicesType.getElementType().getIntOrFloatBitWidth();
+  Type intType = b.getIntegerType(width);
+  auto createInt = [&](const APInt &value) -> Value {
+    return b.create<ConstantOp>(loc, b.getIntegerAttr(intType, value));
+  };
+  Value init =
+      b.create<linalg::InitTensorOp>(loc, ValueRange(), ArrayRef<int64_t>(),
+                                     intType);
+  Value minInit =
+      b.create<linalg::FillOp>(loc, init,
+                               createInt(APInt::getSignedMaxValue(width)))
+          .getResult(0);
+  Value maxInit =
+      b.create<linalg::FillOp>(loc, init,
+                               createInt(APInt::getSignedMinValue(width)))
+          .getResult(0);
+  SmallVector<AffineMap> indexingMaps = {
+      b.getMultiDimIdentityMap(rank),
+      AffineMap::get(/*dimCount=*/rank, /*symbolCount=*/0, context),
+      AffineMap::get(/*dimCount=*/rank, /*symbolCount=*/0, context)};
+  SmallVector<StringRef> iteratorTypes(rank, "reduction");
+  auto minMax = b.create<linalg::GenericOp>(
+      loc, TypeRange{minInit.getType(), maxInit.getType()}, indices,
+      ValueRange{minInit, maxInit}, indexingMaps, iteratorTypes,
+      [](OpBuilder &b, Location loc, ValueRange args) {
+        Value index = castToSignless(b, loc, args[0]);
+        Value isLess =
+            b.create<CmpIOp>(loc, CmpIPredicate::slt, index, args[1]);
+        Value isGreater =
+            b.create<CmpIOp>(loc, CmpIPredicate::sgt, index, args[2]);
+        b.create<linalg::YieldOp>(
+            loc, ValueRange{b.create<SelectOp>(loc, isLess, index, args[1]),
+                            b.create<SelectOp>(loc, isGreater, index,
+                                               args[2])});
+      });
+  Value min =
+      b.create<tensor::ExtractOp>(loc, minMax.getResult(0), ValueRange());
+  Value max =
+      b.create<tensor::ExtractOp>(loc, minMax.getResult(1), ValueRange());
+  Value isMinInBounds = b.create<CmpIOp>(loc, CmpIPredicate::sge, min,
+                                         createInt(APInt(width, 0)));
+  Value isMaxInBounds = b.create<CmpIOp>(
+      loc, CmpIPredicate::slt, max, b.create<IndexCastOp>(loc, size, intType));
+  b.create<AssertOp>(loc, b.create<AndOp>(loc, isMinInBounds, isMaxInBounds),
+                     b.getStringAttr(message));
+}
+
+namespace {
+// Lowers `aten.embedding` to a gather of rows of the weight: a linalg.generic
+// over the indices and the embedding dimension that reads the weight with
+// `tensor.extract`. The innermost loop copies a contiguous row.
+//
+// The other arguments only affect the gradient.
+class ConvertAtenEmbeddingOp : public OpConversionPattern<AtenEmbeddingOp> {
+public:
+  using OpConversionPattern::OpConversionPattern;
+  LogicalResult
+  matchAndRewrite(AtenEmbeddingOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    AtenEmbeddingOp::Adaptor adaptor(operands);
+    MLIRContext *context = op->getContext();
+    Location loc = op->getLoc();
+    Value weight = adaptor.weight();
+    Value indices = adaptor.indices();
+    if (failed(verifyLinalgCompatibleTypes(op, {op.weight(), op.getResult()},
+                                           rewriter)))
+      return failure();
+    if (!isValidLinalgType(op.indices().getType()) || !isIntegerTensor(indices))
+      return rewriter.notifyMatchFailure(op, "expected integer indices");
+    if (weight.getType().cast<RankedTensorType>().getRank() != 2)
+      return rewriter.notifyMatchFailure(op, "expected weight to be rank 2");
+
+    Value numEmbeddings = rewriter.create<memref::DimOp>(loc, weight, 0);
+    createIndicesInBoundsGuard(rewriter, loc, indices, numEmbeddings,
+                               "index out of range in torch.aten.embedding");
+
+    int64_t indicesRank = indices.getType().cast<RankedTensorType>().getRank();
+    SmallVector<OpFoldResult, 4> resultSizes;
+    for (int64_t i = 0; i < indicesRank; i++) {
+      Value size = rewriter.create<memref::DimOp>(loc, indices, i);
+      resultSizes.push_back(getStaticOrDynamicSize(rewriter, indices, i, size));
+    }
+    resultSizes.push_back(getStaticOrDynamicSize(
+        rewriter, weight, 1, rewriter.create<memref::DimOp>(loc, weight, 1)));
+    Type elementType =
+        weight.getType().cast<RankedTensorType>().getElementType();
+    Value initTensor =
+        rewriter.create<linalg::InitTensorOp>(loc, resultSizes, elementType);
+
+    int64_t resultRank = indicesRank + 1;
+    SmallVector<AffineExpr, 4> indicesExprs;
+    for (int64_t i = 0; i < indicesRank; i++)
+      indicesExprs.push_back(rewriter.getAffineDimExpr(i));
+    SmallVector<AffineMap> indexingMaps = {
+        AffineMap::get(/*dimCount=*/resultRank, /*symbolCount=*/0,
+                       indicesExprs, context),
+        rewriter.getMultiDimIdentityMap(resultRank)};
+    SmallVector<StringRef> iteratorTypes(resultRank, "parallel");
+    Value embedding =
+        rewriter
+            .create<linalg::GenericOp>(
+                loc, initTensor.getType(), indices, initTensor,
+                /*indexingMaps=*/indexingMaps,
+                /*iteratorTypes=*/iteratorTypes,
+                [&](OpBuilder &b, Location loc, ValueRange args) {
+                  Value row = b.create<IndexCastOp>(
+                      loc, castToSignless(b, loc, args[0]), b.getIndexType());
+                  Value column = b.create<linalg::IndexOp>(
+                      loc, b.getIndexType(),
+                      b.getI64IntegerAttr(resultRank - 1));
+                  b.create<linalg::YieldOp>(
+                      loc, b.create<tensor::ExtractOp>(
+                                loc, weight, ValueRange{row, column})
+                               .getResult());
+                })
+            .getResult(0);
+    Type newResultType = getTypeConverter()->convertType(op.getType());
+    rewriter.replaceOpWithNewOp<tensor::CastOp>(op, newResultType, embedding);
+    return success();
+  }
+};
+} // namespace
+
+namespace {
+// Lowers `aten.index_select` to a gather along `dim`: a linalg.generic over
+// the result that reads `self` with `tensor.extract` at the selected index
+// along `dim`, and at the same position along the other dimensions.
+class ConvertAtenIndexSelectOp
+    : public OpConversionPattern<AtenIndexSelectOp> {
+public:
+  using OpConversionPattern::OpConversionPattern;
+  LogicalResult
+  matchAndRewrite(AtenIndexSelectOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    AtenIndexSelectOp::Adaptor adaptor(operands);
+    MLIRContext *context = op->getContext();
+    Location loc = op->getLoc();
+    Value self = adaptor.self();
+    Value index = adaptor.index();
+    if (failed(verifyLinalgCompatibleTypes(op, {op.self(), op.getResult()},
+                                           rewriter)))
+      return failure();
+    if (!isValidLinalgType(op.index().getType()) || !isIntegerTensor(index))
+      return rewriter.notifyMatchFailure(op, "expected integer index");
+    int64_t indexRank = index.getType().cast<RankedTensorType>().getRank();
+    if (indexRank > 1)
+      return rewriter.notifyMatchFailure(op,
+                                         "expected index to be rank 0 or 1");
+    int64_t rank = self.getType().cast<RankedTensorType>().getRank();
+    APInt dimAP;
+    if (!matchPattern(op.dim(), m_ConstantInt(&dimAP)))
+      return rewriter.notifyMatchFailure(op, "unimplemented: non-constant dim");
+    int64_t dim = dimAP.getSExtValue();
+    if (dim < 0)
+      dim += rank;
+    if (dim < 0 || dim >= rank)
+      return rewriter.notifyMatchFailure(op, "dim out of range");
+
+    Value selfDim = rewriter.create<memref::DimOp>(loc, self, dim);
+    createIndicesInBoundsGuard(rewriter, loc, index, selfDim,
+                               "index out of range in torch.aten.index_select");
+
+    SmallVector<OpFoldResult, 4> resultSizes;
+    for (int64_t i = 0; i < rank; i++) {
+      if (i != dim) {
+        resultSizes.push_back(getStaticOrDynamicSize(
+            rewriter, self, i, rewriter.create<memref::DimOp>(loc, self, i)));
+      } else if (indexRank == 0) {
+        resultSizes.push_back(rewriter.getIndexAttr(1));
+      } else {
+        resultSizes.push_back(getStaticOrDynamicSize(
+            rewriter, index, 0, rewriter.create<memref::DimOp>(loc, index, 0)));
+      }
+    }
+    Type elementType = self.getType().cast<RankedTensorType>().getElementType();
+    Value initTensor =
+        rewriter.create<linalg::InitTensorOp>(loc, resultSizes, elementType);
+
+    SmallVector<AffineExpr, 1> indexExprs;
+    if (indexRank == 1)
+      indexExprs.push_back(rewriter.getAffineDimExpr(dim));
+    SmallVector<AffineMap> indexingMaps = {
+        AffineMap::get(/*dimCount=*/rank, /*symbolCount=*/0, indexExprs,
+                       context),
+        rewriter.getMultiDimIdentityMap(rank)};
+    SmallVector<StringRef> iteratorTypes(rank, "parallel");
+    Value result =
+        rewriter
+            .create<linalg::GenericOp>(
+                loc, initTensor.getType(), index, initTensor,
+                /*indexingMaps=*/indexingMaps,
+                /*iteratorTypes=*/iteratorTypes,
+                [&](OpBuilder &b, Location loc, ValueRange args) {
+                  SmallVector<Value, 4> position;
+                  for (int64_t i = 0; i < rank; i++) {
+                    if (i == dim) {
+                      position.push_back(b.create<IndexCastOp>(
+                          loc, castToSignless(b, loc, args[0]),
+                          b.getIndexType()));
+                    } else {
+                      position.push_back(b.create<linalg::IndexOp>(
+                          loc, b.getIndexType(), b.getI64IntegerAttr(i)));
+                    }
+                  }
+                  b.create<linalg::YieldOp>(
+                      loc, b.create<tensor::ExtractOp>(loc, self, position)
+                               .getResult());
+                })
+            .getResult(0);
+    Type newResultType = getTypeConverter()->convertType(op.getType());
+    rewriter.replaceOpWithNewOp<tensor::CastOp>(op, newResultType, result);
+    return success();
+  }
+};
+} // namespace
+
+// PyTorch's `ScalarType` numbering of the quantized dtypes.
+static constexpr int64_t kQInt8 = 12;
+static constexpr int64_t kQUInt8 = 13;
+
+// Returns the contents of the tensor literal `value` if it is only used to
+// create quantized linear params (which never modify it).
+static DenseElementsAttr getLinearParamsLiteral(Value value) {
+  auto literal = value.getDefiningOp<TensorOp>();
+  if (!literal || !llvm::all_of(literal->getUsers(), [](Operation *user) {
+        return isa<PerTensorAffineCreateOp, LinearParamsCreateOp>(user);
+      }))
+    return nullptr;
+  return literal.value().dyn_cast<DenseElementsAttr>();
+}
+
+static Value createClamp(OpBuilder &b, Location loc, Value value, Value min,
+                         Value max) {
+  Value belowMin = b.create<CmpFOp>(loc, CmpFPredicate::OLT, value, min);
+  value = b.create<SelectOp>(loc, belowMin, min, value);
+  Value aboveMax = b.create<CmpFOp>(loc, CmpFPredicate::OGT, value, max);
+  return b.create<SelectOp>(loc, aboveMax, max, value);
+}
+
+// Rounds `value` half away from zero to an integer of type `type`.
+static Value createRoundToInt(OpBuilder &b, Location loc, Value value,
+                              Type type) {
+  Value half = b.create<ConstantOp>(loc, b.getFloatAttr(value.getType(), 0.5));
+  Value zero = b.create<ConstantOp>(loc, b.getFloatAttr(value.getType(), 0.0));
+  Value isNegative = b.create<CmpFOp>(loc, CmpFPredicate::OLT, value, zero);
+  Value rounded = b.create<SelectOp>(loc, isNegative,
+                                     b.create<SubFOp>(loc, value, half),
+                                     b.create<AddFOp>(loc, value, half));
+  return b.create<FPToSIOp>(loc, rounded, type);
+}
+
+namespace {
+// Lowers a quantized linear layer with float boundaries: an
+// `aten.quantize_per_tensor` only used by a `quantized.linear` (with literal
+// weights and bias, as imported from a quantized model), itself only used by
+// an `aten.dequantize.self`. Quantized tensors have no builtin tensor type, so
+// the whole island is lowered at once.
+//
+// The input is quantized to i8 in a first pass. The matrix product then
+// accumulates the products of the i8 elements in i32, which the backend can
+// map to dot-product instructions (such as VNNI). The weights must be
+// quantized symmetrically (with a zero point of 0, as in PyTorch's default
+// qconfigs), so that the zero point of the input is folded into compile-time
+// sums of the weights instead of being subtracted in the inner loop. A single
+// elementwise epilogue applies that correction, the scales and the bias, and
+// requantizes (with the rounding and saturation of the output's zero point
+// and scale) and dequantizes the result.
+//
+// quint8 elements and zero points are stored shifted by -128 into i8, which
+// leaves their differences, and thus the products, unchanged.
+class ConvertQuantizedLinearIsland
+    : public OpConversionPattern<AtenQuantizePerTensorOp> {
+public:
+  using OpConversionPattern::OpConversionPattern;
+  LogicalResult
+  matchAndRewrite(AtenQuantizePerTensorOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    AtenQuantizePerTensorOp::Adaptor adaptor(operands);
+    MLIRContext *context = op->getContext();
+    Location loc = op->getLoc();
+    if (!op->hasOneUse())
+      return rewriter.notifyMatchFailure(op, "unimplemented: multiple uses");
+    auto linear = dyn_cast<QuantizedLinearOp>(*op->user_begin());
+    if (!linear || !linear->hasOneUse())
+      return rewriter.notifyMatchFailure(
+          op, "unimplemented: not only used by a quantized.linear");
+    auto dequantize = dyn_cast<AtenDequantizeSelfOp>(*linear->user_begin());
+    if (!dequantize)
+      return rewriter.notifyMatchFailure(
+          op, "unimplemented: quantized.linear not only used by "
+              "aten.dequantize.self");
+    auto params = linear.W_prepack().getDefiningOp<LinearParamsCreateOp>();
+    PerTensorAffineCreateOp weight;
+    DenseElementsAttr weightAttr;
+    if (params)
+      weight = params.weight().getDefiningOp<PerTensorAffineCreateOp>();
+    if (weight)
+      weightAttr = getLinearParamsLiteral(weight.int_repr());
+    FloatAttr weightScale;
+    APInt weightZeroPoint;
+    if (!weightAttr || weightAttr.getType().getRank() != 2 ||
+        !weightAttr.getType().getElementType().isInteger(8) ||
+        !matchPattern(weight.scale(), m_Constant(&weightScale)) ||
+        !matchPattern(weight.offset(), m_ConstantInt(&weightZeroPoint)) ||
+        weightZeroPoint != 0) {
+      return rewriter.notifyMatchFailure(
+          op, "unimplemented: weight that is not a symmetrically quantized "
+              "literal");
+    }
+    DenseElementsAttr biasAttr;
+    if (params.bias()) {
+      biasAttr = getLinearParamsLiteral(params.bias());
+      if (!biasAttr || biasAttr.getType().getRank() != 1 ||
+          !biasAttr.getType().getElementType().isF32())
+        return rewriter.notifyMatchFailure(
+            op, "unimplemented: bias that is not an f32 literal");
+    }
+    APInt dtype;
+    if (!matchPattern(op.dtype(), m_ConstantInt(&dtype)) ||
+        (dtype != kQInt8 && dtype != kQUInt8))
+      return rewriter.notifyMatchFailure(op,
+                                         "unimplemented: non-constant dtype");
+    if (failed(verifyLinalgCompatibleTypes(
+            op, {op.self(), dequantize.getResult()}, rewriter)))
+      return failure();
+    Value input = adaptor.self();
+    auto inputType = input.getType().cast<RankedTensorType>();
+    if (inputType.getRank() != 2 || !inputType.getElementType().isF32())
+      return rewriter.notifyMatchFailure(
+          op, "unimplemented: input that is not rank 2 of f32");
+
+    Type f32 = rewriter.getF32Type();
+    Type i8 = rewriter.getIntegerType(8);
+    Type i32 = rewriter.getI32Type();
+    auto createF32 = [&](double value) -> Value {
+      return rewriter.create<ConstantOp>(loc, FloatAttr::get(f32, value));
+    };
+    auto createI32 = [&](int64_t value) -> Value {
+      return rewriter.create<ConstantOp>(loc, IntegerAttr::get(i32, value));
+    };
+    bool isUnsigned = dtype == kQUInt8;
+    Value qMin = createF32(isUnsigned ? 0 : -128);
+    Value qMax = createF32(isUnsigned ? 255 : 127);
+    Value storageShift = createI32(isUnsigned ? -128 : 0);
+
+    int64_t numOutputs = weightAttr.getType().getDimSize(0);
+    int64_t numInputs = weightAttr.getType().getDimSize(1);
+    Value numRows = rewriter.create<memref::DimOp>(loc, input, 0);
+    Value inputsCorrect = rewriter.create<CmpIOp>(
+        loc, CmpIPredicate::eq, rewriter.create<memref::DimOp>(loc, input, 1),
+        rewriter.create<ConstantIndexOp>(loc, numInputs));
+    rewriter.create<AssertOp>(
+        loc, inputsCorrect,
+        rewriter.getStringAttr(
+            "mismatching input features for quantized.linear"));
+
+    // Quantize the input.
+    auto f32Type = f32.cast<FloatType>();
+    Value inputScale = convertScalarToFloat(rewriter, loc, adaptor.scale(),
+                                            f32Type);
+    Value inputZeroPoint = rewriter.create<TruncateIOp>(
+        loc, adaptor.zero_point(), i32);
+    Value inputZeroPointFloat =
+        convertScalarToFloat(rewriter, loc, adaptor.zero_point(), f32Type);
+    Value inputMin = rewriter.create<SubFOp>(loc, qMin, inputZeroPointFloat);
+    Value inputMax = rewriter.create<SubFOp>(loc, qMax, inputZeroPointFloat);
+    OpFoldResult rows = getStaticOrDynamicSize(rewriter, input, 0, numRows);
+    Value quantizedInit = rewriter.create<linalg::InitTensorOp>(
+        loc, ArrayRef<OpFoldResult>{rows, rewriter.getIndexAttr(numInputs)},
+        i8);
+    SmallVector<AffineMap> identityMaps(2,
+                                        rewriter.getMultiDimIdentityMap(2));
+    SmallVector<StringRef> parallel2d(2, "parallel");
+    Value quantized =
+        rewriter
+            .create<linalg::GenericOp>(
+                loc, quantizedInit.getType(), input, quantizedInit,
+                /*indexingMaps=*/identityMaps,
+                /*iteratorTypes=*/parallel2d,
+                [&](OpBuilder &b, Location loc, ValueRange args) {
+                  Value scaled = b.create<DivFOp>(loc, args[0], inputScale);
+                  scaled = createClamp(b, loc, scaled, inputMin, inputMax);
+                  Value element = b.create<AddIOp>(
+                      loc, createRoundToInt(b, loc, scaled, i32),
+                      inputZeroPoint);
+                  element = b.create<AddIOp>(loc, element, storageShift);
+                  b.create<linalg::YieldOp>(
+                      loc, b.create<TruncateIOp>(loc, element, i8)
+                               .getResult());
+                })
+            .getResult(0);
+
+    // Accumulate the products of the i8 elements in i32.
+    auto weightType = RankedTensorType::get({numOutputs, numInputs}, i8);
+    SmallVector<APInt> weightValues(weightAttr.getIntValues());
+    SmallVector<APInt> weightSums(numOutputs, APInt(32, 0));
+    for (int64_t n = 0; n < numOutputs; n++) {
+      for (int64_t k = 0; k < numInputs; k++)
+        weightSums[n] += weightValues[n * numInputs + k].sext(32);
+    }
+    Value weights = rewriter.create<ConstantOp>(
+        loc, DenseElementsAttr::get(weightType, weightValues));
+    Value accInit = rewriter.create<linalg::InitTensorOp>(
+        loc, ArrayRef<OpFoldResult>{rows, rewriter.getIndexAttr(numOutputs)},
+        i32);
+    Value zeroAcc =
+        rewriter.create<linalg::FillOp>(loc, accInit, createI32(0))
+            .getResult(0);
+    AffineExpr m, n, k;
+    bindDims(context, m, n, k);
+    SmallVector<AffineMap> matmulMaps = {
+        AffineMap::get(/*dimCount=*/3, /*symbolCount=*/0, {m, k}, context),
+        AffineMap::get(/*dimCount=*/3, /*symbolCount=*/0, {n, k}, context),
+        AffineMap::get(/*dimCount=*/3, /*symbolCount=*/0, {m, n}, context)};
+    SmallVector<StringRef> matmulIteratorTypes = {"parallel", "parallel",
+                                                  "reduction"};
+    Value acc =
+        rewriter
+            .create<linalg::GenericOp>(
+                loc, zeroAcc.getType(), ValueRange{quantized, weights},
+                zeroAcc,
+                /*indexingMaps=*/matmulMaps,
+                /*iteratorTypes=*/matmulIteratorTypes,
+                [&](OpBuilder &b, Location loc, ValueRange args) {
+                  Value product = b.create<MulIOp>(
+                      loc, b.create<SignExtendIOp>(loc, args[0], i32),
+                      b.create<SignExtendIOp>(loc, args[1], i32));
+                  b.create<linalg::YieldOp>(
+                      loc, b.create<AddIOp>(loc, args[2], product).getResult());
+                })
+            .getResult(0);
+
+    // Correct for the zero point of the input, scale, add the bias, and
+    // requantize then dequantize the result.
+    Value storedZeroPoint =
+        rewriter.create<AddIOp>(loc, inputZeroPoint, storageShift);
+    Value accScale = rewriter.create<MulFOp>(
+        loc, inputScale, createF32(weightScale.getValueAsDouble()));
+    Value outputScale =
+        convertScalarToFloat(rewriter, loc, linear.Y_scale_i(), f32Type);
+    Value outputZeroPoint =
+        convertScalarToFloat(rewriter, loc, linear.Y_zero_point_i(), f32Type);
+    Value outputMin = rewriter.create<SubFOp>(loc, qMin, outputZeroPoint);
+    Value outputMax = rewriter.create<SubFOp>(loc, qMax, outputZeroPoint);
+    SmallVector<Value, 3> epilogueInputs = {
+        acc, rewriter.create<ConstantOp>(
+                 loc, DenseElementsAttr::get(
+                          RankedTensorType::get({numOutputs}, i32),
+                          weightSums))};
+    if (biasAttr)
+      epilogueInputs.push_back(rewriter.create<ConstantOp>(loc, biasAttr));
+    AffineMap outputMap = AffineMap::get(/*dimCount=*/2, /*symbolCount=*/0,
+                                         rewriter.getAffineDimExpr(1), context);
+    SmallVector<AffineMap> epilogueMaps = {rewriter.getMultiDimIdentityMap(2),
+                                           outputMap};
+    if (biasAttr)
+      epilogueMaps.push_back(outputMap);
+    epilogueMaps.push_back(rewriter.getMultiDimIdentityMap(2));
+    Value resultInit = rewriter.create<linalg::InitTensorOp>(
+        loc, ArrayRef<OpFoldResult>{rows, rewriter.getIndexAttr(numOutputs)},
+        f32);
+    Value result =
+        rewriter
+            .create<linalg::GenericOp>(
+                loc, resultInit.getType(), epilogueInputs, resultInit,
+                /*indexingMaps=*/epilogueMaps,
+                /*iteratorTypes=*/parallel2d,
+                [&](OpBuilder &b, Location loc, ValueRange args) {
+                  Value corrected = b.create<SubIOp>(
+                      loc, args[0],
+                      b.create<MulIOp>(loc, storedZeroPoint, args[1]));
+                  Value value = b.create<MulFOp>(
+                      loc, b.create<SIToFPOp>(loc, corrected, f32), accScale);
+                  if (biasAttr)
+                    value = b.create<AddFOp>(loc, value, args[2]);
+                  // The quantized result, relative to its zero point.
+                  value = b.create<DivFOp>(loc, value, outputScale);
+                  value = createClamp(b, loc, value, outputMin, outputMax);
+                  value = b.create<SIToFPOp>(
+                      loc, createRoundToInt(b, loc, value, i32), f32);
+                  b.create<linalg::YieldOp>(
+                      loc, b.create<MulFOp>(loc, value, outputScale)
+                               .getResult());
+                })
+            .getResult(0);
+
+    Type newResultType =
+        getTypeConverter()->convertType(dequantize.getType());
+    rewriter.replaceOpWithNewOp<tensor::CastOp>(dequantize, newResultType,
+                                                result);
+    rewriter.eraseOp(linear);
+    rewriter.eraseOp(op);
+    // The quantized parameters have no builtin types either.
+    if (params->hasOneUse()) {
+      rewriter.eraseOp(params);
+      if (params.bias() && params.bias().hasOneUse())
+        rewriter.eraseOp(params.bias().getDefiningOp());
+      if (weight->hasOneUse()) {
+        rewriter.eraseOp(weight);
+        if (weight.int_repr().hasOneUse())
+          rewriter.eraseOp(weight.int_repr().getDefiningOp());
+      }
+    }
+    return success();
+  }
+};
+} // namespace
+
+// -----------------------------------------------------------------------------
+// The pass
+// -----------------------------------------------------------------------------
+
+namespace {
+class ConvertTorchToLinalg
+    : public ConvertTorchToLinalgBase<ConvertTorchToLinalg> {
+public:
+  void getDependentDialects(DialectRegistry &registry) const override {
+    registry.insert<linalg::LinalgDialect>();
+    registry.insert<memref::MemRefDialect>();
+    registry.insert<math::MathDialect>();
+    registry.insert<StandardOpsDialect>();
+    registry.insert<tensor::TensorDialect>();
+  }
+
+  void runOnOperation() override {
+    MLIRContext *context = &getContext();
+    ConversionTarget target(*context);
+    target.addLegalDialect<linalg::LinalgDialect, StandardOpsDialect,
+                           memref::MemRefDialect, math::MathDialect,
+                           tensor::TensorDialect>();
+
+    TypeConverter typeConverter;
+    typeConverter.addConversion([](Type type) { return type; });
+    setupValueTensorToBuiltinTensorConversion(target, typeConverter);
+
+    RewritePatternSet patterns(context);
+    target.addIllegalOp<AtenMmOp>();
+    patterns.add<ConvertAtenMmOp>(typeConverter, context);
+    target.addIllegalOp<AtenBmmOp, AtenMatmulOp>();
+    patterns.add<ConvertAtenBmmOp, ConvertAtenMatmulOp>(typeConverter,
+                                                        context);
+    target.addIllegalOp<AtenLinearOp>();
+    patterns.add<ConvertAtenLinearOp>(typeConverter, context);
+    target.addIllegalOp<AtenTanhOp, AtenReluOp, AtenAddTensorOp,
+                        AtenSubTensorOp, AtenMulTensorOp, AtenDivTensorOp,
+                        AtenMaximumOp, AtenMinimumOp, AtenGtTensorOp,
+                        AtenGeTensorOp, AtenLtTensorOp, AtenLeTensorOp,
+                        AtenEqTensorOp, AtenNeTensorOp>();
+    patterns.add<ConvertElementwiseOp>(typeConverter, context);
+    target.addIllegalOp<AtenConv2dOp>();
+    patterns.add<ConvertAtenConv2dOp>(typeConverter, context);
+    target.addIllegalOp<AtenMaxPool2dOp>();
+    patterns.add<ConvertAtenMaxPool2dOp>(typeConverter, context);
+    target.addIllegalOp<AtenAdaptiveAvgPool2dOp>();
+    patterns.add<ConvertAtenAdaptiveAvgPool2dOp>(typeConverter, context);
+    target.addIllegalOp<AtenBatchNormOp>();
+    patterns.add<ConvertAtenBatchNormOp>(typeConverter, context);
+    target.addIllegalOp<AtenLayerNormOp, AtenGroupNormOp>();
+    patterns.add<ConvertAtenLayerNormOp, ConvertAtenGroupNormOp>(typeConverter,
+                                                                 context);
+    // These are views, which can only be lowered once they are on value
+    // tensors.
+    target.addDynamicallyLegalOp<AtenTransposeIntOp, AtenPermuteOp,
+                                AtenSliceTensorOp, AtenSelectIntOp>(
+        [](Operation *op) {
+          return !op->getResult(0).getType().isa<ValueTensorType>();
+        });
+    patterns.add<ConvertAtenPermuteLikeOp<AtenTransposeIntOp>,
+                 ConvertAtenPermuteLikeOp<AtenPermuteOp>>(typeConverter,
+                                                          context);
+    patterns.add<ConvertAtenSliceTensorOp, ConvertAtenSelectIntOp>(
+        typeConverter, context);
+    target.addIllegalOp<AtenCatOp>();
+    patterns.add<ConvertAtenCatOp>(typeConverter, context);
+    target.addDynamicallyLegalOp<PrimListUnpackOp>([](PrimListUnpackOp op) {
+      return !isa_and_nonnull<AtenSplitTensorOp, AtenChunkOp>(
+                 op.operand().getDefiningOp()) ||
+             !llvm::all_of(op.getResultTypes(), [](Type type) {
+               return type.isa<ValueTensorType>();
+             });
+    });
+    patterns.add<ConvertSplitListUnpackOp>(typeConverter, context);
+    target.addIllegalOp<AtenSoftmaxIntOp, AtenLogSoftmaxIntOp>();
+    patterns.add<ConvertAtenSoftmaxLikeOp<AtenSoftmaxIntOp>,
+                 ConvertAtenSoftmaxLikeOp<AtenLogSoftmaxIntOp>>(typeConverter,
+                                                                context);
+    target.addIllegalOp<AtenEmbeddingOp>();
+    patterns.add<ConvertAtenEmbeddingOp>(typeConverter, context);
+    target.addIllegalOp<AtenIndexSelectOp>();
+    patterns.add<ConvertAtenIndexSelectOp>(typeConverter, context);
+    target.addIllegalOp<AtenQuantizePerTensorOp>();
+    patterns.add<ConvertQuantizedLinearIsland>(typeConverter, context);
     if (failed(applyPartialConversion(getOperation(), target,
                                       std::move(patterns))))
       return signalPassFailure();
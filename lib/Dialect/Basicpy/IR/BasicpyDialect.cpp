@@ -205,6 +205,29 @@ SlotObjectType SlotObjectType::get(StringAttr className,
   return Base::get(className.getContext(), className, slotTypes);
 }
 
+//----------------------------------------------------------------------------//
+// Numeric promotion
+//----------------------------------------------------------------------------//
+
+static bool isNumericType(Type type) {
+  // i1 is the predicate type, not a Python number.
+  if (auto intType = type.dyn_cast<IntegerType>())
+    return intType.getWidth() > 1;
+  return type.isa<FloatType>();
+}
+
+Type Basicpy::getPromotedNumericType(Type lhs, Type rhs, bool isTrueDivision) {
+  if (!isNumericType(lhs) || !isNumericType(rhs))
+    return nullptr;
+  if (lhs.isa<FloatType>() != rhs.isa<FloatType>())
+    return lhs.isa<FloatType>() ? lhs : rhs;
+  Type wider =
+      lhs.getIntOrFloatBitWidth() >= rhs.getIntOrFloatBitWidth() ? lhs : rhs;
+  if (isTrueDivision && wider.isa<IntegerType>())
+    return FloatType::getF64(lhs.getContext());
+  return wider;
+}
+
 //----------------------------------------------------------------------------//
 // CPA Interface Implementations
 //----------------------------------------------------------------------------//
@@ -14,6 +14,7 @@
 #include "npcomp/Dialect/Basicpy/IR/BasicpyDialect.h"
 #include "npcomp/Dialect/Basicpy/IR/BasicpyOps.h"
 #include "npcomp/Dialect/Basicpy/Transforms/Passes.h"
+#include "npcomp/Typing/Support/FunctionSummaries.h"
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/ilist.h"
 #include "llvm/Support/Allocator.h"
@@ -24,6 +25,7 @@
 using namespace llvm;
 using namespace mlir;
 using namespace mlir::NPCOMP::Basicpy;
+using mlir::NPCOMP::Typing::FunctionSummaries;
 
 namespace {
 
@@ -94,6 +96,17 @@ private:
   Operation *context;
 };
 
+/// A promotion constraint of a binary op on numbers, whose operands may have
+/// different types that Python promotes to the type of the result (see
+/// getPromotedNumericType). Comparisons have no result.
+struct Promotion {
+  TypeNode *left;
+  TypeNode *right;
+  TypeNode *result;
+  bool isTrueDivision;
+  Operation *context;
+};
+
 raw_ostream &operator<<(raw_ostream &os, const TypeNode &tn) {
   switch (tn.getDiscrim()) {
   case TypeNode::Discrim::CONST_TYPE:
@@ -149,6 +162,21 @@ public:
     addEquation(getTypeNode(def1), getTypeNode(def2), context);
   }
 
+  /// Adds an equation binding a def to a constant type, creating its type node
+  /// if necessary.
+  void addConstTypeEquation(Value def, Type type, Operation *context) {
+    addEquation(getTypeNode(def), createConstType(def, type), context);
+  }
+
+  /// Adds a promotion constraint of `result` (if any) from `left` and
+  /// `right`, creating type nodes if necessary.
+  void addPromotion(Value left, Value right, Value result,
+                    bool isTrueDivision, Operation *context) {
+    promotions.push_back({getTypeNode(left), getTypeNode(right),
+                          result ? getTypeNode(result) : nullptr,
+                          isTrueDivision, context});
+  }
+
   /// Print a report of the equations for debugging.
   void report(raw_ostream &os) {
     os << "Type variable map:\n";
@@ -164,6 +192,10 @@ public:
 
   simple_ilist<TypeEquation> &getEquations() { return equations; }
 
+  ArrayRef<Promotion> getPromotions() { return promotions; }
+
+  unsigned getNumVars() { return nextOrdinal; }
+
   TypeNode *lookupVarOrdinal(unsigned ordinal) {
     assert(ordinal < ordinalToVarNode.size());
     return ordinalToVarNode[ordinal];
@@ -189,6 +221,7 @@ private:
   BumpPtrAllocator allocator;
   simple_ilist<TypeNode> nodes;
   simple_ilist<TypeEquation> equations;
+  llvm::SmallVector<Promotion, 16> promotions;
   llvm::DenseMap<Value, TypeNode *> defToNodeMap;
   llvm::SmallVector<TypeNode *, 16> ordinalToVarNode;
   unsigned nextOrdinal = 0;
@@ -196,114 +229,174 @@ private:
 
 /// (Very) simple type unification. This really isn't advanced enough for
 /// anything beyond simple, unambiguous programs.
-/// It is also terribly inefficient.
+///
+/// Type variables are kept in a union-find (with path compression and union
+/// by rank), where each class of variables is bound to at most one constant
+/// type. Solving takes a single pass over the equations, in near-linear time.
+///
+/// The promotions are then solved once the types of their operands are
+/// known, which binds their results. A promotion whose operands can't be
+/// resolved that way (such as one on loop-carried values only, or on
+/// non-numeric types) has all of its types unified instead.
 class TypeUnifier {
 public:
-  using SubstMap = llvm::DenseMap<unsigned, TypeNode *>;
-
-  Optional<SubstMap> unifyEquations(TypeEquations &equations) {
-    Optional<SubstMap> subst;
-    subst.emplace();
+  TypeUnifier(TypeEquations &equations)
+      : equations(equations), parents(equations.getNumVars()),
+        ranks(equations.getNumVars(), 0),
+        boundTypes(equations.getNumVars()),
+        unified(equations.getNumVars(), false) {
+    for (unsigned i = 0, e = parents.size(); i < e; ++i)
+      parents[i] = i;
+  }
 
+  /// Unifies all equations, emitting an error on the first one that
+  /// conflicts with the others.
+  LogicalResult unifyEquations() {
     for (auto &eq : equations.getEquations()) {
-      subst = unify(eq.getLeft(), eq.getRight(), std::move(subst));
-      if (!subst) {
-        break;
-      }
+      if (failed(unify(eq.getLeft(), eq.getRight())))
+        return reportConflict(eq.getLeft(), eq.getRight());
     }
-
-    return subst;
+    return solvePromotions();
   }
 
-  Type resolveSubst(TypeNode *typeNode, const Optional<SubstMap> &subst) {
-    if (!subst)
-      return nullptr;
-    if (typeNode->getDiscrim() == TypeNode::Discrim::CONST_TYPE) {
-      return typeNode->getConstType();
-    }
-    if (typeNode->getDiscrim() == TypeNode::Discrim::VAR_ORDINAL) {
-      auto foundIt = subst->find(typeNode->getVarOrdinal());
-      if (foundIt != subst->end()) {
-        return resolveSubst(foundIt->second, subst);
-      } else {
-        return nullptr;
-      }
-    }
-    return nullptr;
+  /// Returns true if the variable was unified with anything.
+  bool isUnified(unsigned ordinal) { return unified[ordinal]; }
+
+  /// Returns the type that the class of a variable is bound to, or null.
+  Type resolveVar(unsigned ordinal) { return boundTypes[find(ordinal)]; }
+
+private:
+  LogicalResult reportConflict(TypeNode *typeX, TypeNode *typeY) {
+    emitError(typeX->getDef().getLoc()) << "cannot unify type";
+    emitRemark(typeY->getDef().getLoc()) << "conflicting expression here";
+    return failure();
   }
 
-  Optional<SubstMap> unify(TypeNode *typeX, TypeNode *typeY,
-                           Optional<SubstMap> subst) {
-    LLVM_DEBUG(llvm::dbgs() << "+ UNIFY: " << *typeX << ", " << *typeY << "\n");
-    if (!subst) {
-      emitError(typeX->getDef().getLoc()) << "cannot unify type";
-      emitRemark(typeY->getDef().getLoc()) << "conflicting expression here";
-      return None;
-    } else if (*typeX == *typeY) {
-      return subst;
-    } else if (typeX->getDiscrim() == TypeNode::Discrim::VAR_ORDINAL) {
-      return unifyVariable(typeX, typeY, std::move(*subst));
-    } else if (typeY->getDiscrim() == TypeNode::Discrim::VAR_ORDINAL) {
-      return unifyVariable(typeY, typeX, std::move(*subst));
-    } else {
-      LLVM_DEBUG(llvm::dbgs() << "  Unify fallthrough\n");
-      return None;
-    }
+  /// Returns the type that a node is known to have, or null.
+  Type resolve(TypeNode *node) {
+    if (node->getDiscrim() == TypeNode::Discrim::CONST_TYPE)
+      return node->getConstType();
+    return resolveVar(node->getVarOrdinal());
   }
 
-  Optional<SubstMap> unifyVariable(TypeNode *varNode, TypeNode *typeNode,
-                                   SubstMap subst) {
-    assert(varNode->getDiscrim() == TypeNode::Discrim::VAR_ORDINAL);
-    LLVM_DEBUG(llvm::dbgs() << "  - UNIFY VARIABLE: " << *varNode << " <- "
-                            << *typeNode << "\n");
-    // Var node in subst?
-    auto it = subst.find(varNode->getVarOrdinal());
-    if (it != subst.end()) {
-      TypeNode *found = it->second;
-      LLVM_DEBUG(llvm::dbgs() << "    --> FOUND VAR: " << *found << "\n");
-      return unify(found, typeNode, std::move(subst));
-    }
+  /// Unifies the types of the operands and result of `promotion`.
+  LogicalResult unifyPromotion(const Promotion &promotion) {
+    if (failed(unify(promotion.left, promotion.right)))
+      return reportConflict(promotion.left, promotion.right);
+    if (promotion.result && failed(unify(promotion.left, promotion.result)))
+      return reportConflict(promotion.result, promotion.left);
+    return success();
+  }
 
-    // Type node in subst?
-    if (typeNode->getDiscrim() == TypeNode::Discrim::VAR_ORDINAL) {
-      it = subst.find(typeNode->getVarOrdinal());
-      if (it != subst.end()) {
-        TypeNode *found = it->second;
-        LLVM_DEBUG(llvm::dbgs() << "    --> FOUND TYPE: " << *found << "\n");
-        return unify(varNode, found, std::move(subst));
+  LogicalResult solvePromotions() {
+    SmallVector<const Promotion *, 16> pending;
+    for (const Promotion &promotion : equations.getPromotions())
+      pending.push_back(&promotion);
+    while (!pending.empty()) {
+      bool progress = false;
+      for (auto it = pending.begin(); it != pending.end();) {
+        const Promotion &promotion = **it;
+        Type left = resolve(promotion.left), right = resolve(promotion.right);
+        if (!left || !right) {
+          ++it;
+          continue;
+        }
+        Type promoted = getPromotedNumericType(left, right,
+                                               promotion.isTrueDivision);
+        LLVM_DEBUG(llvm::dbgs() << "+ PROMOTE: " << left << ", " << right
+                                << " -> " << promoted << "\n");
+        if (!promoted) {
+          if (failed(unifyPromotion(promotion)))
+            return failure();
+        } else if (promotion.result) {
+          TypeNode constNode(promotion.result->getDef(), promoted);
+          if (failed(unify(promotion.result, &constNode)))
+            return reportConflict(promotion.result, promotion.left);
+        }
+        it = pending.erase(it);
+        progress = true;
       }
+      if (progress)
+        continue;
+      // Nothing else is known: take the types of the first remaining
+      // promotion to be the same, which may resolve the others.
+      if (failed(unifyPromotion(*pending.front())))
+        return failure();
+      pending.erase(pending.begin());
     }
+    return success();
+  }
 
-    // Does the variable appear in the type?
-    if (occursCheck(varNode, typeNode, subst)) {
-      LLVM_DEBUG(llvm::dbgs() << "FAILED OCCURS_CHECK\n");
-      return None;
+  unsigned find(unsigned ordinal) {
+    unsigned root = ordinal;
+    while (parents[root] != root)
+      root = parents[root];
+    while (parents[ordinal] != root) {
+      unsigned next = parents[ordinal];
+      parents[ordinal] = root;
+      ordinal = next;
     }
-
-    // varNode is not yet in subst and cannot simplify typeNode. Extend.
-    subst[varNode->getVarOrdinal()] = typeNode;
-    return std::move(subst);
+    return root;
   }
 
-  bool occursCheck(TypeNode *varNode, TypeNode *typeNode, SubstMap &subst) {
-    if (*varNode == *typeNode)
-      return true;
+  LogicalResult unify(TypeNode *typeX, TypeNode *typeY) {
+    LLVM_DEBUG(llvm::dbgs() << "+ UNIFY: " << *typeX << ", " << *typeY << "\n");
+    if (*typeX == *typeY)
+      return success();
+    if (typeX->getDiscrim() == TypeNode::Discrim::VAR_ORDINAL &&
+        typeY->getDiscrim() == TypeNode::Discrim::VAR_ORDINAL)
+      return unifyVariables(typeX->getVarOrdinal(), typeY->getVarOrdinal());
+    if (typeX->getDiscrim() == TypeNode::Discrim::VAR_ORDINAL)
+      return bindVariable(typeX->getVarOrdinal(), typeY->getConstType());
+    if (typeY->getDiscrim() == TypeNode::Discrim::VAR_ORDINAL)
+      return bindVariable(typeY->getVarOrdinal(), typeX->getConstType());
+    LLVM_DEBUG(llvm::dbgs() << "  Unify fallthrough\n");
+    return failure();
+  }
 
-    if (typeNode->getDiscrim() == TypeNode::Discrim::VAR_ORDINAL) {
-      unsigned typeOrdinal = typeNode->getVarOrdinal();
-      auto foundIt = subst.find(typeOrdinal);
-      if (foundIt != subst.end()) {
-        return occursCheck(varNode, foundIt->second, subst);
-      }
-    }
+  LogicalResult bindVariable(unsigned ordinal, Type type) {
+    unified[ordinal] = true;
+    unsigned root = find(ordinal);
+    LLVM_DEBUG(llvm::dbgs() << "  - BIND VARIABLE: " << ordinal << " (root "
+                            << root << ") <- " << type << "\n");
+    Type &boundType = boundTypes[root];
+    if (!boundType)
+      boundType = type;
+    return success(boundType == type);
+  }
 
-    return false;
+  LogicalResult unifyVariables(unsigned ordinalX, unsigned ordinalY) {
+    unified[ordinalX] = unified[ordinalY] = true;
+    unsigned rootX = find(ordinalX), rootY = find(ordinalY);
+    LLVM_DEBUG(llvm::dbgs() << "  - UNIFY VARIABLES: " << ordinalX << " (root "
+                            << rootX << "), " << ordinalY << " (root " << rootY
+                            << ")\n");
+    if (rootX == rootY)
+      return success();
+    Type typeX = boundTypes[rootX], typeY = boundTypes[rootY];
+    if (typeX && typeY && typeX != typeY)
+      return failure();
+    if (ranks[rootX] < ranks[rootY])
+      std::swap(rootX, rootY);
+    parents[rootY] = rootX;
+    if (ranks[rootX] == ranks[rootY])
+      ranks[rootX] += 1;
+    boundTypes[rootX] = typeX ? typeX : typeY;
+    return success();
   }
+
+  TypeEquations &equations;
+  llvm::SmallVector<unsigned, 16> parents;
+  llvm::SmallVector<unsigned, 16> ranks;
+  llvm::SmallVector<Type, 16> boundTypes;
+  llvm::SmallVector<bool, 16> unified;
 };
 
 class TypeEquationPopulator {
 public:
-  TypeEquationPopulator(TypeEquations &equations) : equations(equations) {}
+  TypeEquationPopulator(TypeEquations &equations,
+                        const FunctionSummaries &summaries)
+      : equations(equations), summaries(summaries) {}
 
   /// If a return op was visited, this will be one of them.
   Operation *getLastReturnOp() { return funcReturnOp; }
@@ -356,8 +449,36 @@ public:
         }
         return WalkResult::advance();
       }
+      if (auto op = dyn_cast<scf::WhileOp>(childOp)) {
+        // The results and the arguments of the `after` region are those of
+        // the scf.condition.
+        for (auto it : llvm::zip(op.inits(), op.getBefore().getArguments()))
+          equations.addTypeEqualityEquation(std::get<0>(it), std::get<1>(it),
+                                            op);
+        return WalkResult::advance();
+      }
+      if (auto conditionOp = dyn_cast<scf::ConditionOp>(childOp)) {
+        auto whileOp = cast<scf::WhileOp>(conditionOp->getParentOp());
+        for (auto it : llvm::zip(conditionOp.args(), whileOp.getResults(),
+                                 whileOp.getAfter().getArguments())) {
+          equations.addTypeEqualityEquation(std::get<0>(it), std::get<1>(it),
+                                            conditionOp);
+          equations.addTypeEqualityEquation(std::get<0>(it), std::get<2>(it),
+                                            conditionOp);
+        }
+        return WalkResult::advance();
+      }
       if (auto yieldOp = dyn_cast<scf::YieldOp>(childOp)) {
         auto scfParentOp = yieldOp->getParentOp();
+        // The `after` region of a loop yields the next values of the
+        // arguments of its `before` region.
+        if (auto whileOp = dyn_cast<scf::WhileOp>(scfParentOp)) {
+          for (auto it : llvm::zip(yieldOp.getOperands(),
+                                   whileOp.getBefore().getArguments()))
+            equations.addTypeEqualityEquation(std::get<0>(it),
+                                              std::get<1>(it), yieldOp);
+          return WalkResult::advance();
+        }
         if (scfParentOp->getNumResults() != yieldOp.getNumOperands()) {
           yieldOp.emitWarning()
               << "cannot run type inference on yield due to arity mismatch";
@@ -374,17 +495,25 @@ public:
         equations.addTypeEqualityEquation(op.operand(), op.result(), op);
         return WalkResult::advance();
       }
+      if (auto op = dyn_cast<CallOp>(childOp)) {
+        // Calls of the functions already inferred take the types of their
+        // summaries.
+        FunctionType summary = summaries.lookup(op.getCallee());
+        if (summary && summary.getNumInputs() == op.getNumOperands() &&
+            summary.getNumResults() == op.getNumResults()) {
+          addSummaryEquations(op.getOperands(), summary.getInputs(), op);
+          addSummaryEquations(op.getResults(), summary.getResults(), op);
+          return WalkResult::advance();
+        }
+      }
       if (auto op = dyn_cast<BinaryExprOp>(childOp)) {
-        // TODO: This should really be applying arithmetic promotion, not
-        // strict equality.
-        equations.addTypeEqualityEquation(op.left(), op.right(), op);
-        equations.addTypeEqualityEquation(op.left(), op.result(), op);
+        equations.addPromotion(op.left(), op.right(), op.result(),
+                               op.operation() == "Div", op);
         return WalkResult::advance();
       }
       if (auto op = dyn_cast<BinaryCompareOp>(childOp)) {
-        // TODO: This should really be applying arithmetic promotion, not
-        // strict equality.
-        equations.addTypeEqualityEquation(op.left(), op.right(), op);
+        equations.addPromotion(op.left(), op.right(), /*result=*/nullptr,
+                               /*isTrueDivision=*/false, op);
         return WalkResult::advance();
       }
 
@@ -425,60 +554,86 @@ public:
   }
 
 private:
+  void addSummaryEquations(ValueRange values, TypeRange types, Operation *op) {
+    for (auto it : llvm::zip(values, types)) {
+      if (!std::get<1>(it).isa<UnknownType>())
+        equations.addConstTypeEquation(std::get<0>(it), std::get<1>(it), op);
+    }
+  }
+
   // The last encountered ReturnLike op.
   Operation *funcReturnOp = nullptr;
   llvm::SmallVector<Operation *, 4> innerReturnLikeOps;
   TypeEquations &equations;
+  const FunctionSummaries &summaries;
 };
 
+/// Infers the types of `func`, given the summaries of its callees.
+LogicalResult inferFunctionTypes(FuncOp func,
+                                 const FunctionSummaries &summaries) {
+  if (func.getBody().empty())
+    return success();
+
+  TypeEquations equations;
+  TypeEquationPopulator p(equations, summaries);
+  (void)p.runOnFunction(func);
+  LLVM_DEBUG(equations.report(llvm::dbgs()));
+
+  TypeUnifier unifier(equations);
+  if (failed(unifier.unifyEquations())) {
+    func.emitError() << "type inference failed";
+    return failure();
+  }
+
+  // Apply substitutions.
+  LLVM_DEBUG(llvm::dbgs() << "Unification subst:\n");
+  for (unsigned ordinal = 0, e = equations.getNumVars(); ordinal < e;
+       ++ordinal) {
+    if (!unifier.isUnified(ordinal))
+      continue;
+    TypeNode *varNode = equations.lookupVarOrdinal(ordinal);
+    Type resolvedType = unifier.resolveVar(ordinal);
+    LLVM_DEBUG(llvm::dbgs() << "  " << ordinal << " -> " << resolvedType
+                            << "\n");
+    if (!resolvedType) {
+      emitError(varNode->getDef().getLoc()) << "unable to infer type";
+      continue;
+    }
+    varNode->getDef().setType(resolvedType);
+  }
+
+  // Now rewrite the function type based on actual types of entry block
+  // args and the final return op operands.
+  auto entryBlockTypes = func.getBody().front().getArgumentTypes();
+  SmallVector<Type, 4> inputTypes(entryBlockTypes.begin(),
+                                  entryBlockTypes.end());
+  SmallVector<Type, 4> resultTypes;
+  if (p.getLastReturnOp()) {
+    auto resultRange = p.getLastReturnOp()->getOperandTypes();
+    resultTypes.append(resultRange.begin(), resultRange.end());
+  }
+  func.setType(FunctionType::get(func.getContext(), inputTypes, resultTypes));
+  return success();
+}
+
 class FunctionTypeInferencePass
     : public FunctionTypeInferenceBase<FunctionTypeInferencePass> {
 public:
   void runOnOperation() override {
-    FuncOp func = getOperation();
-    if (func.getBody().empty())
-      return;
-
-    TypeEquations equations;
-    TypeEquationPopulator p(equations);
-    (void)p.runOnFunction(func);
-    LLVM_DEBUG(equations.report(llvm::dbgs()));
-
-    TypeUnifier unifier;
-    auto substMap = unifier.unifyEquations(equations);
-    if (!substMap) {
-      func.emitError() << "type inference failed";
+    // A function pass can't see its callees, so the types of calls are only
+    // inferred by basicpy-module-type-inference.
+    if (failed(inferFunctionTypes(getOperation(), /*summaries=*/{})))
       return signalPassFailure();
-    }
-
-    // Apply substitutions.
-    LLVM_DEBUG(llvm::dbgs() << "Unification subst:\n");
-    LLVM_DEBUG(for (auto it
-                    : *substMap) {
-      llvm::dbgs() << "  " << it.first << " -> " << *it.second << "\n";
-    });
-    for (auto it : *substMap) {
-      TypeNode *varNode = equations.lookupVarOrdinal(it.first);
-      Type resolvedType = unifier.resolveSubst(it.second, substMap);
-      if (!resolvedType) {
-        emitError(varNode->getDef().getLoc()) << "unable to infer type";
-        continue;
-      }
-      varNode->getDef().setType(resolvedType);
-    }
+  }
+};
 
-    // Now rewrite the function type based on actual types of entry block
-    // args and the final return op operands.
-    auto entryBlockTypes = func.getBody().front().getArgumentTypes();
-    SmallVector<Type, 4> inputTypes(entryBlockTypes.begin(),
-                                    entryBlockTypes.end());
-    SmallVector<Type, 4> resultTypes;
-    if (p.getLastReturnOp()) {
-      auto resultRange = p.getLastReturnOp()->getOperandTypes();
-      resultTypes.append(resultRange.begin(), resultRange.end());
-    }
-    auto funcType = FunctionType::get(&getContext(), inputTypes, resultTypes);
-    func.setType(funcType);
+class ModuleTypeInferencePass
+    : public ModuleTypeInferenceBase<ModuleTypeInferencePass> {
+public:
+  void runOnOperation() override {
+    if (failed(NPCOMP::Typing::inferFunctionsBottomUp(getOperation(),
+                                                      inferFunctionTypes)))
+      return signalPassFailure();
   }
 };
 
@@ -488,3 +643,8 @@ std::unique_ptr<OperationPass<FuncOp>>
 mlir::NPCOMP::Basicpy::createFunctionTypeInferencePass() {
   return std::make_unique<FunctionTypeInferencePass>();
 }
+
+std::unique_ptr<OperationPass<ModuleOp>>
+mlir::NPCOMP::Basicpy::createModuleTypeInferencePass() {
+  return std::make_unique<ModuleTypeInferencePass>();
+}
@@ -0,0 +1,85 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Removes the copies between tensors and the ndarrays created from them when
+// the arrays are never mutated.
+//
+// The importer and NumpyPublicFunctionsToTensor wrap tensors into arrays with
+// `numpy.create_array_from_tensor` and copy them back with
+// `numpy.copy_to_tensor`, for example at function boundaries. When all the
+// uses of such an array (through `numpy.static_info_cast`s) are copies to
+// tensors, the array doesn't escape and can't be overwritten, so each copy is
+// the original tensor.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+
+#include "mlir/IR/BuiltinOps.h"
+#include "npcomp/Dialect/Numpy/IR/NumpyDialect.h"
+#include "npcomp/Dialect/Numpy/IR/NumpyOps.h"
+#include "npcomp/Dialect/Numpy/Transforms/Passes.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+using namespace mlir::NPCOMP::Numpy;
+
+// Collects the copies to tensors of `array` and the casts of it they go
+// through. Returns failure if `array` has other uses, which may mutate it or
+// let it escape.
+static LogicalResult
+collectCopies(Value array, SmallVectorImpl<CopyToTensorOp> &copies,
+              SmallVectorImpl<StaticInfoCastOp> &casts) {
+  for (Operation *user : array.getUsers()) {
+    if (auto copy = dyn_cast<CopyToTensorOp>(user)) {
+      copies.push_back(copy);
+    } else if (auto cast = dyn_cast<StaticInfoCastOp>(user)) {
+      casts.push_back(cast);
+      if (failed(collectCopies(cast.getResult(), copies, casts)))
+        return failure();
+    } else {
+      return failure();
+    }
+  }
+  return success();
+}
+
+namespace {
+class ElideArrayCopiesPass
+    : public NumpyElideArrayCopiesBase<ElideArrayCopiesPass> {
+  void runOnOperation() override {
+    SmallVector<CreateArrayFromTensorOp, 8> creates;
+    getOperation().walk(
+        [&](CreateArrayFromTensorOp create) { creates.push_back(create); });
+    for (CreateArrayFromTensorOp create : creates) {
+      SmallVector<CopyToTensorOp, 4> copies;
+      SmallVector<StaticInfoCastOp, 4> casts;
+      if (failed(collectCopies(create.dest(), copies, casts)))
+        continue;
+      Value tensor = create.source();
+      for (CopyToTensorOp copy : copies) {
+        Value replacement = tensor;
+        if (replacement.getType() != copy.getType()) {
+          replacement = OpBuilder(copy).create<TensorStaticInfoCastOp>(
+              copy.getLoc(), copy.getType(), tensor);
+        }
+        copy.replaceAllUsesWith(replacement);
+        copy.erase();
+      }
+      for (StaticInfoCastOp cast : llvm::reverse(casts))
+        cast.erase();
+      create.erase();
+    }
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::Numpy::createElideArrayCopiesPass() {
+  return std::make_unique<ElideArrayCopiesPass>();
+}
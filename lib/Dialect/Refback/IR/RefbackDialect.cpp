@@ -9,6 +9,7 @@
 #include "npcomp/Dialect/Refback/IR/RefbackDialect.h"
 #include "mlir/Transforms/InliningUtils.h"
 #include "npcomp/Dialect/Refback/IR/RefbackOps.h"
+#include "llvm/Support/Path.h"
 
 using namespace mlir;
 using namespace mlir::NPCOMP::refback;
@@ -38,3 +39,62 @@ void RefbackDialect::initialize() {
       >();
   addInterfaces<RefbackInlinerInterface>();
 }
+
+//===----------------------------------------------------------------------===//
+// External elements attributes
+//===----------------------------------------------------------------------===//
+
+// The opaque data of an external elements attribute is this prefix, followed
+// by "<offset>:<path>".
+static constexpr StringLiteral kExternalElementsPrefix = "external:";
+
+ElementsAttr
+mlir::NPCOMP::refback::getExternalElementsAttr(ShapedType type, StringRef path,
+                                               uint64_t offset) {
+  MLIRContext *context = type.getContext();
+  std::string data =
+      (kExternalElementsPrefix + Twine(offset) + ":" + path).str();
+  return OpaqueElementsAttr::get(context->getOrLoadDialect<RefbackDialect>(),
+                                 type, data);
+}
+
+Optional<ExternalElements>
+mlir::NPCOMP::refback::getExternalElements(Attribute attr) {
+  auto opaqueAttr = attr.dyn_cast<OpaqueElementsAttr>();
+  if (!opaqueAttr ||
+      opaqueAttr.getDialect() != RefbackDialect::getDialectNamespace())
+    return None;
+  StringRef data = opaqueAttr.getValue();
+  if (!data.consume_front(kExternalElementsPrefix))
+    return None;
+  StringRef offset, path;
+  std::tie(offset, path) = data.split(':');
+  ExternalElements elements;
+  if (offset.getAsInteger(10, elements.offset) || path.empty())
+    return None;
+  elements.path = path;
+  return elements;
+}
+
+void mlir::NPCOMP::refback::resolveExternalElementsPaths(Operation *root,
+                                                         StringRef directory) {
+  if (directory.empty())
+    return;
+  root->walk([&](Operation *op) {
+    SmallVector<std::pair<Identifier, ElementsAttr>, 1> resolved;
+    for (NamedAttribute namedAttr : op->getAttrs()) {
+      auto elements = getExternalElements(namedAttr.second);
+      if (!elements || llvm::sys::path::is_absolute(elements->path))
+        continue;
+      SmallString<128> path(directory);
+      llvm::sys::path::append(path, elements->path);
+      resolved.emplace_back(
+          namedAttr.first,
+          getExternalElementsAttr(
+              namedAttr.second.cast<ElementsAttr>().getType(), path,
+              elements->offset));
+    }
+    for (auto &attr : resolved)
+      op->setAttr(attr.first, attr.second);
+  });
+}
@@ -16,6 +16,23 @@
 using namespace mlir;
 using namespace mlir::NPCOMP::refbackrt;
 
+//===----------------------------------------------------------------------===//
+// ParallelForOp
+//===----------------------------------------------------------------------===//
+
+static LogicalResult verify(ParallelForOp op) {
+  auto body = dyn_cast_or_null<FuncOp>(
+      SymbolTable::lookupNearestSymbolFrom(op, op.bodyAttr()));
+  if (!body)
+    return op.emitError() << "must reference a valid func";
+  FunctionType type = body.getType();
+  if (type.getNumInputs() != 3 || type.getNumResults() != 0 ||
+      !type.getInput(0).isIndex() || !type.getInput(1).isIndex())
+    return op.emitError()
+           << "body must have type (index, index, !llvm.ptr<i8>) -> ()";
+  return success();
+}
+
 //===----------------------------------------------------------------------===//
 // ModuleMetadataOp
 //===----------------------------------------------------------------------===//
@@ -64,6 +81,19 @@ static LogicalResult verify(FuncMetadataOp op) {
     if (op.numOutputs() != op.outputArgTypes()->size())
       return op.emitError() << "number of outputTypes must match number of outputs";
   }
+  if (op.outputOwnership().hasValue() != op.outputAliasIndices().hasValue())
+    return op.emitError()
+           << "outputOwnership and outputAliasIndices must be given together";
+  if (op.outputOwnership() &&
+      (op.outputOwnership()->size() != op.numOutputs() ||
+       op.outputAliasIndices()->size() != op.numOutputs()))
+    return op.emitError()
+           << "outputOwnership and outputAliasIndices must have one element "
+              "per output";
+  if (op.directFuncName() &&
+      !isa_and_nonnull<FuncOp>(
+          SymbolTable::lookupSymbolIn(module, *op.directFuncName())))
+    return op.emitError() << "directFuncName must reference a valid func";
   return success();
 }
 
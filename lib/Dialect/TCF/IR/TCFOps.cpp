@@ -11,5 +11,72 @@
 using namespace mlir;
 using namespace mlir::NPCOMP::tcf;
 
+//===----------------------------------------------------------------------===//
+// Reduction ops
+//===----------------------------------------------------------------------===//
+
+template <typename OpTy> static LogicalResult verifyReductionOp(OpTy op) {
+  auto operandType = op.operand().getType().template cast<RankedTensorType>();
+  auto resultType = op.getType().template cast<RankedTensorType>();
+  int64_t dim = op.dim();
+  if (dim < 0 || dim >= operandType.getRank())
+    return op.emitError() << "reduction dimension " << dim
+                          << " is out of range for an operand of rank "
+                          << operandType.getRank();
+  if (resultType.getRank() != operandType.getRank())
+    return op.emitError("result must have the rank of the operand");
+  if (!isa<SoftmaxOp>(op.getOperation()) && resultType.getDimSize(dim) != 1)
+    return op.emitError("result must have size 1 along the reduced dimension");
+  return success();
+}
+
+//===----------------------------------------------------------------------===//
+// TransposeOp
+//===----------------------------------------------------------------------===//
+
+static LogicalResult verifyTransposeOp(TransposeOp op) {
+  auto operandType = op.operand().getType().cast<RankedTensorType>();
+  auto resultType = op.getType().cast<RankedTensorType>();
+  int64_t rank = operandType.getRank();
+  ArrayAttr permutation = op.permutation();
+  if (static_cast<int64_t>(permutation.size()) != rank ||
+      resultType.getRank() != rank)
+    return op.emitError("permutation and result must have the rank of the "
+                        "operand");
+  SmallVector<bool, 4> seen(rank, false);
+  for (auto it : llvm::enumerate(permutation.getAsValueRange<IntegerAttr>())) {
+    int64_t dim = it.value().getSExtValue();
+    if (dim < 0 || dim >= rank || seen[dim])
+      return op.emitError("permutation must be a permutation of the operand "
+                          "dimensions");
+    seen[dim] = true;
+    int64_t operandSize = operandType.getDimSize(dim);
+    int64_t resultSize = resultType.getDimSize(it.index());
+    if (!ShapedType::isDynamic(operandSize) &&
+        !ShapedType::isDynamic(resultSize) && operandSize != resultSize)
+      return op.emitError() << "result dimension " << it.index()
+                            << " doesn't match operand dimension " << dim;
+  }
+  return success();
+}
+
+//===----------------------------------------------------------------------===//
+// DotOp
+//===----------------------------------------------------------------------===//
+
+static LogicalResult verifyDotOp(DotOp op) {
+  int64_t lhsRank = op.lhs().getType().cast<RankedTensorType>().getRank();
+  int64_t rhsRank = op.rhs().getType().cast<RankedTensorType>().getRank();
+  int64_t resultRank = op.getType().cast<RankedTensorType>().getRank();
+  if (lhsRank < 1 || lhsRank > 2 || rhsRank < 1 || rhsRank > 2)
+    return op.emitError("operands must be vectors or matrices");
+  if (lhsRank == 2 && rhsRank == 2)
+    return op.emitError("at least one operand must be a vector");
+  if (resultRank != lhsRank + rhsRank - 2)
+    return op.emitError() << "result must have rank "
+                          << lhsRank + rhsRank - 2;
+  return success();
+}
+
 #define GET_OP_CLASSES
 #include "npcomp/Dialect/TCF/IR/TCFOps.cpp.inc"
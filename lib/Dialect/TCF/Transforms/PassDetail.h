@@ -9,6 +9,7 @@
 #ifndef NPCOMP_DIALECT_TCF_TRANSFORMS_PASSDETAIL_H
 #define NPCOMP_DIALECT_TCF_TRANSFORMS_PASSDETAIL_H
 
+#include "mlir/Dialect/Tensor/IR/Tensor.h"
 #include "mlir/Pass/Pass.h"
 
 namespace mlir {
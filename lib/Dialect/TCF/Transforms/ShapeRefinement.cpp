@@ -5,10 +5,28 @@
 // SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
 //
 //===----------------------------------------------------------------------===//
+//
+// Propagates the shapes of the function arguments forward through the TCF
+// ops, refining the result types of the ops to the most precise shapes that
+// follow from the shapes of their operands:
+// - elementwise ops get the broadcast of their operand shapes,
+// - reductions get the operand shape with size 1 along the reduced dimension,
+// - matmuls get [M, N] from lhs [M, K] and rhs [K, N],
+// - convolutions get [N, Cout, H - KH + 1, W - KW + 1].
+//
+// Operands that don't satisfy the static requirements of the ops (which will
+// abort at runtime) don't refine anything. Users outside TCF that can't be
+// assumed to accept a refined type see the original type through a
+// `tensor.cast`, and the function results are refined along with the
+// returned values.
+//
+//===----------------------------------------------------------------------===//
 
 #include "PassDetail.h"
 
 #include "mlir/Dialect/StandardOps/IR/Ops.h"
+#include "mlir/Dialect/Tensor/IR/Tensor.h"
+#include "mlir/Dialect/Traits.h"
 #include "mlir/IR/Builders.h"
 #include "mlir/IR/BuiltinOps.h"
 #include "npcomp/Dialect/TCF/IR/TCFDialect.h"
@@ -19,18 +37,156 @@ using namespace mlir;
 using namespace mlir::NPCOMP;
 using namespace mlir::NPCOMP::tcf;
 
+// Returns the shape of `value`, or None if it is unranked.
+static Optional<ArrayRef<int64_t>> getShape(Value value) {
+  if (auto type = value.getType().dyn_cast<RankedTensorType>())
+    return type.getShape();
+  return None;
+}
+
+// Returns the shape of the result of `op` implied by its operands, or None if
+// nothing is known about it.
+static Optional<SmallVector<int64_t, 4>> inferResultShape(Operation *op) {
+  if (isa<tcf::AddOp, tcf::MaxOp, tcf::MulOp>(op)) {
+    auto lhs = getShape(op->getOperand(0));
+    auto rhs = getShape(op->getOperand(1));
+    SmallVector<int64_t, 4> shape;
+    if (!lhs || !rhs || !OpTrait::util::getBroadcastedShape(*lhs, *rhs, shape))
+      return None;
+    return shape;
+  }
+  if (isa<tcf::ExpOp, tcf::TanhOp, tcf::SoftmaxOp>(op)) {
+    if (auto operand = getShape(op->getOperand(0)))
+      return llvm::to_vector<4>(*operand);
+    return None;
+  }
+  if (isa<tcf::ReduceSumOp, tcf::ReduceMeanOp, tcf::ReduceMaxOp>(op)) {
+    auto operand = getShape(op->getOperand(0));
+    if (!operand)
+      return None;
+    auto shape = llvm::to_vector<4>(*operand);
+    shape[op->getAttrOfType<IntegerAttr>("dim").getInt()] = 1;
+    return shape;
+  }
+  if (auto transpose = dyn_cast<tcf::TransposeOp>(op)) {
+    auto operand = getShape(transpose.operand());
+    if (!operand)
+      return None;
+    SmallVector<int64_t, 4> shape;
+    for (APInt dim : transpose.permutation().getAsValueRange<IntegerAttr>())
+      shape.push_back((*operand)[dim.getZExtValue()]);
+    return shape;
+  }
+  if (auto matmul = dyn_cast<tcf::MatmulOp>(op)) {
+    auto lhs = getShape(matmul.lhs());
+    auto rhs = getShape(matmul.rhs());
+    if (!lhs || !rhs)
+      return None;
+    return SmallVector<int64_t, 4>{(*lhs)[0], (*rhs)[1]};
+  }
+  if (auto dot = dyn_cast<tcf::DotOp>(op)) {
+    auto lhs = getShape(dot.lhs());
+    auto rhs = getShape(dot.rhs());
+    if (!lhs || !rhs)
+      return None;
+    SmallVector<int64_t, 4> shape(lhs->drop_back());
+    shape.append(rhs->begin() + 1, rhs->end());
+    return shape;
+  }
+  if (auto matmul = dyn_cast<tcf::BatchMatmulOp>(op)) {
+    auto lhs = getShape(matmul.lhs());
+    auto rhs = getShape(matmul.rhs());
+    if (!lhs || !rhs)
+      return None;
+    return SmallVector<int64_t, 4>{(*lhs)[0], (*lhs)[1], (*rhs)[2]};
+  }
+  if (auto attention = dyn_cast<tcf::AttentionOp>(op)) {
+    auto query = getShape(attention.query());
+    auto value = getShape(attention.value());
+    if (!query || !value)
+      return None;
+    return SmallVector<int64_t, 4>{(*query)[0], (*query)[1], (*value)[2]};
+  }
+  if (auto conv = dyn_cast<tcf::ConvNCHWOp>(op)) {
+    auto in = getShape(conv.in());
+    auto filter = getShape(conv.filter());
+    if (!in || !filter)
+      return None;
+    auto getOutputSize = [](int64_t inputSize, int64_t kernelSize) {
+      if (ShapedType::isDynamic(inputSize) ||
+          ShapedType::isDynamic(kernelSize) || inputSize < kernelSize)
+        return ShapedType::kDynamicSize;
+      return inputSize - kernelSize + 1;
+    };
+    return SmallVector<int64_t, 4>{(*in)[0], (*filter)[0],
+                                   getOutputSize((*in)[2], (*filter)[2]),
+                                   getOutputSize((*in)[3], (*filter)[3])};
+  }
+  return None;
+}
+
+// Returns `type` with its shape refined by `shape`, or null if they conflict.
+static Type refineType(Type type, ArrayRef<int64_t> shape) {
+  auto tensorType = type.dyn_cast<TensorType>();
+  if (!tensorType)
+    return nullptr;
+  if (!tensorType.hasRank())
+    return RankedTensorType::get(shape, tensorType.getElementType());
+  if (tensorType.getRank() != static_cast<int64_t>(shape.size()))
+    return nullptr;
+  SmallVector<int64_t, 4> refined;
+  for (auto it : llvm::zip(tensorType.getShape(), shape)) {
+    int64_t current = std::get<0>(it), inferred = std::get<1>(it);
+    if (ShapedType::isDynamic(current))
+      refined.push_back(inferred);
+    else if (ShapedType::isDynamic(inferred) || inferred == current)
+      refined.push_back(current);
+    else
+      return nullptr;
+  }
+  return RankedTensorType::get(refined, tensorType.getElementType());
+}
+
+// Returns true if `user` is known to accept any refinement of the types of
+// its operands.
+static bool acceptsRefinedTypes(Operation *user) {
+  return isa_and_nonnull<TCFDialect>(user->getDialect()) ||
+         isa<ReturnOp>(user);
+}
+
 namespace {
 
 class ShapeRefinementPass : public TCFShapeRefinementBase<ShapeRefinementPass> {
   void runOnOperation() override {
     auto func = getOperation();
-    // TODO: Implement for real.
-    func.walk([](tcf::AddOp addOp) {
-      auto lhsType = addOp.lhs().getType();
-      auto rhsType = addOp.rhs().getType();
-      if (lhsType == rhsType) {
-        addOp.result().setType(lhsType);
-      }
+    // Ops are visited before their users, so refinements propagate through
+    // chains of ops in one go.
+    func.walk([](Operation *op) {
+      if (op->getNumResults() != 1)
+        return;
+      Optional<SmallVector<int64_t, 4>> shape = inferResultShape(op);
+      if (!shape)
+        return;
+      Value result = op->getResult(0);
+      Type originalType = result.getType();
+      Type refinedType = refineType(originalType, *shape);
+      if (!refinedType || refinedType == originalType)
+        return;
+      result.setType(refinedType);
+
+      // Keep the original type for the other users.
+      SmallVector<OpOperand *, 4> otherUses;
+      for (OpOperand &use : result.getUses())
+        if (!acceptsRefinedTypes(use.getOwner()))
+          otherUses.push_back(&use);
+      if (otherUses.empty())
+        return;
+      OpBuilder builder(op->getContext());
+      builder.setInsertionPointAfter(op);
+      Value cast =
+          builder.create<tensor::CastOp>(op->getLoc(), originalType, result);
+      for (OpOperand *use : otherUses)
+        use->set(cast);
     });
 
     // If the change cascaded to any returns, need to update the function
@@ -184,6 +184,8 @@ public:
 } // namespace
 
 namespace {
+// Writes the fill value only to the padding, and copies the operand into the
+// rest of the result, so that each element of the result is written once.
 class BufferizePadOp : public OpConversionPattern<tcp::PadOp> {
 public:
   using OpConversionPattern::OpConversionPattern;
@@ -194,28 +196,58 @@ public:
     if (failed(resultsOrFailure))
       return failure();
     auto results = *resultsOrFailure;
-    auto c1 =
-      rewriter.create<ConstantOp>(op.getLoc(), rewriter.getIntegerAttr(
-            rewriter.getIndexType(), 1));
-    SmallVector<Value, 6> offsets, sizes, strides;
+    Value resultMemref = results[0];
+    Location loc = op.getLoc();
+    auto c0 = rewriter.create<ConstantIndexOp>(loc, 0);
+    auto c1 = rewriter.create<ConstantIndexOp>(loc, 1);
+    SmallVector<Value, 6> lowerExpansions, upperExpansions, sizes;
     auto resultType = op.getType().cast<RankedTensorType>();
-    for (int i = 0, e = resultType.getRank(); i < e; i++) {
-      auto dimIndex = rewriter.create<ConstantIndexOp>(op.getLoc(), i);
-      auto offset =
-        rewriter.create<tensor::ExtractOp>(op.getLoc(), op.lowerExpansion(),
-            ValueRange({dimIndex}));
-      auto size = rewriter.create<memref::DimOp>(op.getLoc(), op.operand(), i);
-      auto stride   = c1;
-      offsets.push_back(offset);
-      sizes.push_back(size);
-      strides.push_back(stride);
+    int64_t rank = resultType.getRank();
+    for (int64_t i = 0; i < rank; i++) {
+      auto dimIndex = rewriter.create<ConstantIndexOp>(loc, i);
+      lowerExpansions.push_back(rewriter.create<tensor::ExtractOp>(
+          loc, op.lowerExpansion(), ValueRange({dimIndex})));
+      upperExpansions.push_back(rewriter.create<tensor::ExtractOp>(
+          loc, op.upperExpansion(), ValueRange({dimIndex})));
+      sizes.push_back(rewriter.create<memref::DimOp>(loc, op.operand(), i));
+    }
+    SmallVector<Value, 6> strides(rank, c1);
+
+    // Fill the padding before and after the operand along each dimension i.
+    // These slabs only span the operand along the dimensions before i, so
+    // that they don't overlap.
+    for (int64_t i = 0; i < rank; i++) {
+      SmallVector<Value, 6> offsets, extents;
+      for (int64_t j = 0; j < rank; j++) {
+        if (j < i) {
+          offsets.push_back(lowerExpansions[j]);
+          extents.push_back(sizes[j]);
+        } else if (j == i) {
+          offsets.push_back(c0);
+          extents.push_back(lowerExpansions[j]);
+        } else {
+          offsets.push_back(c0);
+          extents.push_back(
+              rewriter.create<memref::DimOp>(loc, resultMemref, j));
+        }
+      }
+      auto lower = rewriter.create<memref::SubViewOp>(
+          loc, resultMemref, ValueRange(offsets), ValueRange(extents),
+          ValueRange(strides));
+      rewriter.create<linalg::FillOp>(loc, lower, op.fillVal());
+      offsets[i] = rewriter.create<AddIOp>(loc, lowerExpansions[i], sizes[i]);
+      extents[i] = upperExpansions[i];
+      auto upper = rewriter.create<memref::SubViewOp>(
+          loc, resultMemref, ValueRange(offsets), ValueRange(extents),
+          ValueRange(strides));
+      rewriter.create<linalg::FillOp>(loc, upper, op.fillVal());
     }
-    rewriter.create<linalg::FillOp>(op.getLoc(), results[0], op.fillVal());
+
     auto unpadded = rewriter.create<memref::SubViewOp>(
-        op.getLoc(), results[0], ValueRange(offsets), ValueRange(sizes),
+        loc, resultMemref, ValueRange(lowerExpansions), ValueRange(sizes),
         ValueRange(strides));
     auto inputMemref = operands[0];
-    rewriter.create<linalg::CopyOp>(op.getLoc(), inputMemref, unpadded);
+    rewriter.create<linalg::CopyOp>(loc, inputMemref, unpadded);
     rewriter.replaceOp(op, results);
     return success();
   }
@@ -0,0 +1,113 @@
+//===----------------------------------------------------------------------===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "npcomp/Dialect/Torch/IR/TorchInterfaces.h"
+
+#include "mlir/IR/Matchers.h"
+#include "npcomp/Dialect/Torch/IR/TorchOps.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+using namespace mlir::NPCOMP::Torch;
+
+Optional<int64_t> Torch::getNumElements(Type type) {
+  auto tensorType = type.dyn_cast<BaseTensorType>();
+  if (!tensorType || !tensorType.areAllSizesKnown())
+    return None;
+  int64_t numElements = 1;
+  for (int64_t size : tensorType.getSizes())
+    numElements *= size;
+  return numElements;
+}
+
+Optional<int64_t> Torch::getNumBytes(Type type) {
+  Optional<int64_t> numElements = getNumElements(type);
+  auto tensorType = type.dyn_cast<BaseTensorType>();
+  if (!numElements || !tensorType.hasDtype() ||
+      !tensorType.getDtype().isIntOrFloat())
+    return None;
+  int64_t bitWidth = tensorType.getDtype().getIntOrFloatBitWidth();
+  return *numElements * ((bitWidth + 7) / 8);
+}
+
+Optional<int64_t> Torch::getTensorBytesMoved(Operation *op) {
+  int64_t bytes = 0;
+  SmallVector<Type> types(op->getOperandTypes());
+  llvm::append_range(types, op->getResultTypes());
+  for (Type type : types) {
+    if (!type.isa<BaseTensorType>())
+      continue;
+    Optional<int64_t> tensorBytes = getNumBytes(type);
+    if (!tensorBytes)
+      return None;
+    bytes += *tensorBytes;
+  }
+  return bytes;
+}
+
+Optional<int64_t> Torch::getFlopsPerElement(Value tensor,
+                                            int64_t flopsPerElement) {
+  Optional<int64_t> numElements = getNumElements(tensor.getType());
+  if (!numElements)
+    return None;
+  return *numElements * flopsPerElement;
+}
+
+// Returns the size of dimension `dim` of a tensor of type `type` (counting
+// from the end if negative), if it is known.
+static Optional<int64_t> getSize(Type type, int64_t dim) {
+  auto tensorType = type.dyn_cast<BaseTensorType>();
+  if (!tensorType || !tensorType.hasSizes())
+    return None;
+  ArrayRef<int64_t> sizes = tensorType.getSizes();
+  int64_t rank = sizes.size();
+  if (dim < 0)
+    dim += rank;
+  if (dim < 0 || dim >= rank || sizes[dim] == kUnknownSize)
+    return None;
+  return sizes[dim];
+}
+
+Optional<int64_t> Torch::getContractionFlops(Operation *op) {
+  Optional<int64_t> numElements = getNumElements(op->getResult(0).getType());
+  Optional<int64_t> contractedSize = getSize(op->getOperand(0).getType(), -1);
+  if (!numElements || !contractedSize)
+    return None;
+  // A multiplication and an addition each.
+  return 2 * *numElements * *contractedSize;
+}
+
+Optional<int64_t> Torch::getConvolutionFlops(Operation *op) {
+  Optional<int64_t> numElements = getNumElements(op->getResult(0).getType());
+  Type weightType = op->getOperand(1).getType();
+  Optional<int64_t> weightElements = getNumElements(weightType);
+  Optional<int64_t> outputChannels = getSize(weightType, 0);
+  if (!numElements || !weightElements || !outputChannels ||
+      *outputChannels == 0)
+    return None;
+  // Each output element accumulates the products of the weights of its
+  // output channel.
+  return 2 * *numElements * (*weightElements / *outputChannels);
+}
+
+Optional<int64_t> Torch::getWindowFlops(Operation *op, Value kernelSize) {
+  Optional<int64_t> numElements = getNumElements(op->getResult(0).getType());
+  auto listConstruct = kernelSize.getDefiningOp<PrimListConstructOp>();
+  if (!numElements || !listConstruct)
+    return None;
+  int64_t windowSize = 1;
+  for (Value size : listConstruct.elements()) {
+    APInt sizeAP;
+    if (!matchPattern(size, m_ConstantInt(&sizeAP)))
+      return None;
+    windowSize *= sizeAP.getSExtValue();
+  }
+  return *numElements * windowSize;
+}
+
+#include "npcomp/Dialect/Torch/IR/TorchInterfaces.cpp.inc"
@@ -441,6 +441,83 @@ LogicalResult FromBuiltinTensorOp::inferReturnTypes(
   return success();
 }
 
+//===----------------------------------------------------------------------===//
+// Statically sized lists and tuples
+//===----------------------------------------------------------------------===//
+//
+// The elements of lists built by `torch.prim.ListConstruct` (that aren't
+// mutated) and tuples built by `basicpy.build_tuple` are forwarded to their
+// readers, so that the containers become dead instead of being built at
+// runtime.
+
+// Returns the elements of the list `list` if it is built by a
+// `torch.prim.ListConstruct` and only read: by ops reading its elements or
+// length, or by ops with value semantics (such as the tensor ops taking lists
+// of sizes). Otherwise, it may be mutated or escape, and returns None.
+static Optional<OperandRange> getStaticListElements(Value list) {
+  auto listConstruct = list.getDefiningOp<PrimListConstructOp>();
+  if (!listConstruct)
+    return None;
+  for (Operation *user : list.getUsers()) {
+    if (!isa<Aten__Getitem__TOp, AtenLenTOp, PrimListUnpackOp>(user) &&
+        !user->hasTrait<Torch::OpTrait::HasValueSemantics>())
+      return None;
+  }
+  return listConstruct.elements();
+}
+
+// Returns `element` as a value of `type`, casting it if needed, or null if
+// that isn't possible.
+static Value castStaticElement(PatternRewriter &rewriter, Location loc,
+                               Value element, Type type) {
+  Type elementType = element.getType();
+  if (elementType == type)
+    return element;
+  auto elementTensorType = elementType.dyn_cast<BaseTensorType>();
+  auto tensorType = type.dyn_cast<BaseTensorType>();
+  if (elementTensorType && tensorType &&
+      elementTensorType.isa<ValueTensorType>() ==
+          tensorType.isa<ValueTensorType>() &&
+      areSizesAndDtypesCompatible(elementTensorType, tensorType))
+    return rewriter.create<TensorStaticInfoCastOp>(loc, type, element);
+  if (isValidSubtype(elementType, type))
+    return rewriter.create<DerefineOp>(loc, type, element);
+  return nullptr;
+}
+
+// Replaces the results of `op` with the (cast) `elements`.
+static LogicalResult replaceWithStaticElements(Operation *op,
+                                               ValueRange elements,
+                                               PatternRewriter &rewriter) {
+  if (elements.size() != op->getNumResults())
+    return rewriter.notifyMatchFailure(op, "mismatching number of elements");
+  SmallVector<Value> replacements;
+  for (auto it : llvm::zip(elements, op->getResultTypes())) {
+    Value element = castStaticElement(rewriter, op->getLoc(), std::get<0>(it),
+                                      std::get<1>(it));
+    if (!element)
+      return rewriter.notifyMatchFailure(op, "incompatible element type");
+    replacements.push_back(element);
+  }
+  rewriter.replaceOp(op, replacements);
+  return success();
+}
+
+// Returns the element at the constant index `indexValue` of `elements`, or
+// null.
+static Value getStaticElement(ValueRange elements, Value indexValue) {
+  APInt indexAP;
+  if (!matchPattern(indexValue, m_ConstantInt(&indexAP)))
+    return nullptr;
+  int64_t index = indexAP.getSExtValue();
+  int64_t size = elements.size();
+  if (index < 0)
+    index += size;
+  if (index < 0 || index >= size)
+    return nullptr;
+  return elements[index];
+}
+
 //===----------------------------------------------------------------------===//
 // Aten__Getitem__TOp
 //===----------------------------------------------------------------------===//
@@ -448,21 +525,59 @@ LogicalResult FromBuiltinTensorOp::inferReturnTypes(
 void Aten__Getitem__TOp::getCanonicalizationPatterns(RewritePatternSet &patterns,
                                                      MLIRContext *context) {
   patterns.add(+[](Aten__Getitem__TOp op, PatternRewriter &rewriter) {
-    auto torchList = op.getOperand(0);
-    if(!torchList.hasOneUse())
+    Optional<OperandRange> elements = getStaticListElements(op.list());
+    if (!elements)
       return failure();
+    Value element = getStaticElement(*elements, op.idx());
+    if (!element)
+      return failure();
+    return replaceWithStaticElements(op, element, rewriter);
+  });
+}
 
-    auto listConstruct = torchList.getDefiningOp<Torch::PrimListConstructOp>();
-    if (!listConstruct)
+//===----------------------------------------------------------------------===//
+// PrimListUnpackOp
+//===----------------------------------------------------------------------===//
+
+void PrimListUnpackOp::getCanonicalizationPatterns(RewritePatternSet &patterns,
+                                                   MLIRContext *context) {
+  patterns.add(+[](PrimListUnpackOp op, PatternRewriter &rewriter) {
+    Optional<OperandRange> elements = getStaticListElements(op.operand());
+    if (!elements)
       return failure();
+    return replaceWithStaticElements(op, *elements, rewriter);
+  });
+}
+
+//===----------------------------------------------------------------------===//
+// PrimTupleIndexOp
+//===----------------------------------------------------------------------===//
 
-    APInt indexAP;
-    if (!matchPattern(op.getOperand(1), m_ConstantInt(&indexAP)))
+void PrimTupleIndexOp::getCanonicalizationPatterns(RewritePatternSet &patterns,
+                                                   MLIRContext *context) {
+  patterns.add(+[](PrimTupleIndexOp op, PatternRewriter &rewriter) {
+    // Tuples are immutable.
+    auto buildTuple = op.tup().getDefiningOp<Basicpy::BuildTupleOp>();
+    if (!buildTuple)
       return failure();
+    Value element = getStaticElement(buildTuple.elements(), op.i());
+    if (!element)
+      return failure();
+    return replaceWithStaticElements(op, element, rewriter);
+  });
+}
 
-    auto index = indexAP.getSExtValue();
-    rewriter.replaceOp(op, {listConstruct.getOperand(index)});
-    return success();
+//===----------------------------------------------------------------------===//
+// PrimTupleUnpackOp
+//===----------------------------------------------------------------------===//
+
+void PrimTupleUnpackOp::getCanonicalizationPatterns(RewritePatternSet &patterns,
+                                                    MLIRContext *context) {
+  patterns.add(+[](PrimTupleUnpackOp op, PatternRewriter &rewriter) {
+    auto buildTuple = op.tup().getDefiningOp<Basicpy::BuildTupleOp>();
+    if (!buildTuple)
+      return failure();
+    return replaceWithStaticElements(op, buildTuple.elements(), rewriter);
   });
 }
 
@@ -31,10 +31,20 @@ using namespace mlir::NPCOMP::Torch;
 // issues between rewriting of func ops vs call ops.
 using TypeBoundMap = DenseMap<std::pair<StringRef, int>, Type> ;
 
+// Map from func name and result index to the element types of the tuple
+// returned there, for the tuple results that are expanded into their elements.
+// A tuple result is expanded when every return of the func builds it with
+// `basicpy.build_tuple` from elements of the same types, so that callers
+// receive the elements as SSA values instead of a tuple object.
+using TupleResultMap = DenseMap<std::pair<StringRef, int>, SmallVector<Type>>;
+
 namespace {
 class AdjustCallingConventionForFunc : public OpConversionPattern<FuncOp> {
 public:
-  using OpConversionPattern::OpConversionPattern;
+  AdjustCallingConventionForFunc(TypeConverter &converter, MLIRContext *context,
+                                 TupleResultMap &tupleResultMap)
+      : OpConversionPattern<FuncOp>(converter, context),
+        tupleResultMap(tupleResultMap) {}
   LogicalResult
   matchAndRewrite(FuncOp func, ArrayRef<Value> operands,
                   ConversionPatternRewriter &rewriter) const override {
@@ -68,11 +78,16 @@ public:
       conversion.addInputs(type.index(), type.value());
     }
     SmallVector<Type> newResultTypes;
-    for (auto type : func.getType().getResults()) {
-      if (auto none = type.dyn_cast<Basicpy::NoneType>()) {
+    for (auto type : llvm::enumerate(func.getType().getResults())) {
+      if (auto none = type.value().dyn_cast<Basicpy::NoneType>()) {
+        continue;
+      }
+      auto it = tupleResultMap.find({func.getName(), type.index()});
+      if (it != tupleResultMap.end()) {
+        newResultTypes.append(it->second.begin(), it->second.end());
         continue;
       }
-      newResultTypes.push_back(type);
+      newResultTypes.push_back(type.value());
     }
     rewriter.applySignatureConversion(&func.getBody(), conversion,
                                       typeConverter);
@@ -85,6 +100,9 @@ public:
     });
     return success();
   }
+
+private:
+  TupleResultMap &tupleResultMap;
 };
 } // namespace
 
@@ -92,16 +110,23 @@ namespace {
 class AdjustCallingConventionForCall : public OpConversionPattern<CallOp> {
 public:
   AdjustCallingConventionForCall(TypeConverter &converter, MLIRContext *context,
-                                 TypeBoundMap &typeBoundMap)
+                                 TypeBoundMap &typeBoundMap,
+                                 TupleResultMap &tupleResultMap)
       : OpConversionPattern<CallOp>(converter, context),
-        typeBoundMap(typeBoundMap) {}
+        typeBoundMap(typeBoundMap), tupleResultMap(tupleResultMap) {}
   LogicalResult
   matchAndRewrite(CallOp call, ArrayRef<Value> operands,
                   ConversionPatternRewriter &rewriter) const override {
     SmallVector<Type> convertedResults;
-    if (failed(typeConverter->convertTypes(call.getResultTypes(),
-                                           convertedResults)))
-      return failure();
+    for (auto type : llvm::enumerate(call.getResultTypes())) {
+      auto it = tupleResultMap.find({call.callee(), type.index()});
+      if (it != tupleResultMap.end()) {
+        convertedResults.append(it->second.begin(), it->second.end());
+        continue;
+      }
+      if (failed(typeConverter->convertType(type.value(), convertedResults)))
+        return failure();
+    }
 
     SmallVector<Value> newOperands;
     for (auto operand : llvm::enumerate(operands)) {
@@ -126,10 +151,22 @@ public:
                                              convertedResults, newOperands);
     int newOpResultIdx = 0;
     SmallVector<Value> newResults;
-    for (auto type : call.getResultTypes()) {
-      if (type.isa<Basicpy::NoneType>()) {
+    for (auto type : llvm::enumerate(call.getResultTypes())) {
+      if (type.value().isa<Basicpy::NoneType>()) {
         newResults.push_back(
-            rewriter.create<Basicpy::SingletonOp>(call.getLoc(), type));
+            rewriter.create<Basicpy::SingletonOp>(call.getLoc(), type.value()));
+        continue;
+      }
+      auto it = tupleResultMap.find({call.callee(), type.index()});
+      if (it != tupleResultMap.end()) {
+        // Rebuild the tuple for the remaining users; its elements are read
+        // directly once `torch.prim.TupleIndex` and `torch.prim.TupleUnpack`
+        // are canonicalized.
+        int numElements = it->second.size();
+        newResults.push_back(rewriter.create<Basicpy::BuildTupleOp>(
+            call.getLoc(), type.value(),
+            newCall.getResults().slice(newOpResultIdx, numElements)));
+        newOpResultIdx += numElements;
         continue;
       }
       newResults.push_back(newCall.getResult(newOpResultIdx++));
@@ -140,36 +177,77 @@ public:
 
   private:
     TypeBoundMap &typeBoundMap;
+    TupleResultMap &tupleResultMap;
 };
 } // namespace
 
 namespace {
 class AdjustCallingConventionForReturn : public OpConversionPattern<ReturnOp> {
 public:
-  using OpConversionPattern::OpConversionPattern;
+  AdjustCallingConventionForReturn(TypeConverter &converter,
+                                   MLIRContext *context,
+                                   TupleResultMap &tupleResultMap)
+      : OpConversionPattern<ReturnOp>(converter, context),
+        tupleResultMap(tupleResultMap) {}
   LogicalResult
   matchAndRewrite(ReturnOp op, ArrayRef<Value> operands,
                   ConversionPatternRewriter &rewriter) const override {
-
+    StringRef funcName = op->getParentOfType<FuncOp>().getName();
     SmallVector<Value> newOperands;
     for (auto operand : llvm::enumerate(operands)) {
       if (!operand.value())
         continue;
       if (operand.value().getType().isa<Basicpy::NoneType>())
         continue;
+      if (tupleResultMap.count({funcName, operand.index()})) {
+        auto buildTuple = op.getOperand(operand.index())
+                              .getDefiningOp<Basicpy::BuildTupleOp>();
+        for (Value element : buildTuple.elements())
+          newOperands.push_back(rewriter.getRemappedValue(element));
+        continue;
+      }
       newOperands.push_back(operand.value());
     }
     rewriter.replaceOpWithNewOp<ReturnOp>(op, newOperands);
     return success();
   }
+
+private:
+  TupleResultMap &tupleResultMap;
 };
 } // namespace
 
+// Returns the element types of the tuple returned by `func` at `resultIndex`
+// if all its returns build it from elements of the same types, or None.
+static Optional<SmallVector<Type>> getExpandedTupleResult(FuncOp func,
+                                                          int resultIndex) {
+  Optional<SmallVector<Type>> elementTypes;
+  WalkResult walkResult = func.walk([&](ReturnOp op) {
+    auto buildTuple =
+        op.getOperand(resultIndex).getDefiningOp<Basicpy::BuildTupleOp>();
+    if (!buildTuple)
+      return WalkResult::interrupt();
+    SmallVector<Type> types(buildTuple.elements().getTypes());
+    // Nested tuples and None elements would need to be adjusted themselves.
+    if (llvm::any_of(types, [](Type type) {
+          return type.isa<Basicpy::TupleType, Basicpy::NoneType>();
+        }))
+      return WalkResult::interrupt();
+    if (elementTypes && *elementTypes != types)
+      return WalkResult::interrupt();
+    elementTypes = std::move(types);
+    return WalkResult::advance();
+  });
+  if (walkResult.wasInterrupted())
+    return None;
+  return elementTypes;
+}
+
 static LogicalResult adjustCallingConventions(FuncOp func,
-                                              TypeBoundMap &typeBoundMap) {
+                                              TypeBoundMap &typeBoundMap,
+                                              TupleResultMap &tupleResultMap) {
   MLIRContext *context = func.getContext();
   RewritePatternSet patterns(context);
-  // TODO: TupleTypes
   TypeConverter typeConverter;
   typeConverter.addConversion([](Type type) { return type; });
   typeConverter.addConversion(
@@ -185,13 +263,15 @@ static LogicalResult adjustCallingConventions(FuncOp func,
         assert(inputs[0].getType().isa<BaseTensorType>());
         return copyTensorToType(builder, loc, type, inputs[0]);
       });
-  patterns.add<AdjustCallingConventionForFunc>(typeConverter, context);
+  patterns.add<AdjustCallingConventionForFunc>(typeConverter, context,
+                                               tupleResultMap);
   patterns.add<AdjustCallingConventionForCall>(typeConverter, context,
-                                               typeBoundMap);
-  patterns.add<AdjustCallingConventionForReturn>(typeConverter, context);
+                                               typeBoundMap, tupleResultMap);
+  patterns.add<AdjustCallingConventionForReturn>(typeConverter, context,
+                                                 tupleResultMap);
 
   ConversionTarget target(*context);
-  target.addDynamicallyLegalOp<FuncOp>([](FuncOp func) {
+  target.addDynamicallyLegalOp<FuncOp>([&](FuncOp func) {
     for (int i = 0, e = func.getNumArguments(); i != e; i++) {
       if (func.getArgAttr(i, "torch.type_bound"))
         return false;
@@ -199,7 +279,11 @@ static LogicalResult adjustCallingConventions(FuncOp func,
         return false;
     }
     for (int i = 0, e = func.getNumResults(); i != e; i++) {
-      if (func.getType().getResults()[i].isa<Basicpy::NoneType>())
+      Type type = func.getType().getResults()[i];
+      if (type.isa<Basicpy::NoneType>())
+        return false;
+      if (type.isa<Basicpy::TupleType>() &&
+          tupleResultMap.count({func.getName(), i}))
         return false;
     }
     return true;
@@ -221,6 +305,7 @@ static LogicalResult adjustCallingConventions(FuncOp func,
   target.addLegalOp<CopyTensorOp>();
   target.addLegalOp<TensorStaticInfoCastOp>();
   target.addLegalOp<Basicpy::SingletonOp>();
+  target.addLegalOp<Basicpy::BuildTupleOp>();
   // We don't know how to rewrite it, so mark it as illegal.
   target.addIllegalOp<CallIndirectOp>();
   if (failed(applyPartialConversion(func.getOperation(), target,
@@ -235,6 +320,7 @@ class AdjustCallingConventionsPass
   void runOnOperation() override {
     auto module = getOperation();
     TypeBoundMap typeBoundMap;
+    TupleResultMap tupleResultMap;
     for (auto func : module.getOps<FuncOp>()) {
       for (int i = 0, e = func.getNumArguments(); i != e; i++) {
         auto typeBoundAttr =
@@ -243,9 +329,17 @@ class AdjustCallingConventionsPass
           continue;
         typeBoundMap[{func.getName(), i}] = typeBoundAttr.getValue();
       }
+      if (func.isExternal())
+        continue;
+      for (int i = 0, e = func.getNumResults(); i != e; i++) {
+        if (!func.getType().getResult(i).isa<Basicpy::TupleType>())
+          continue;
+        if (auto elementTypes = getExpandedTupleResult(func, i))
+          tupleResultMap[{func.getName(), i}] = std::move(*elementTypes);
+      }
     }
     for (auto func : module.getOps<FuncOp>()) {
-      if (failed(adjustCallingConventions(func, typeBoundMap)))
+      if (failed(adjustCallingConventions(func, typeBoundMap, tupleResultMap)))
         return signalPassFailure();
     }
   }
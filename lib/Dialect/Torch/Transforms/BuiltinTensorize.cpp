@@ -8,12 +8,15 @@
 
 #include "PassDetail.h"
 
+#include "mlir/Dialect/Linalg/IR/LinalgOps.h"
 #include "mlir/Dialect/StandardOps/IR/Ops.h"
 #include "mlir/Dialect/StandardOps/Transforms/FuncConversions.h"
+#include "mlir/Dialect/Tensor/IR/Tensor.h"
 #include "mlir/IR/BlockAndValueMapping.h"
 #include "mlir/IR/Builders.h"
 #include "mlir/IR/BuiltinOps.h"
 #include "mlir/Transforms/DialectConversion.h"
+#include "mlir/Transforms/GreedyPatternRewriteDriver.h"
 #include "npcomp/Dialect/Torch/IR/TorchOps.h"
 #include "npcomp/Dialect/Torch/IR/TorchUtils.h"
 #include "npcomp/Dialect/Torch/Transforms/Passes.h"
@@ -100,6 +103,70 @@ public:
 };
 } // namespace
 
+// Returns true if the `tensor.cast` of `source` to the type of `op`, the
+// second of a chain of two casts, checks nothing that casting `source`
+// directly doesn't: the intermediate type has no static extent that neither
+// `source` nor the result has.
+static bool isFoldableCastChain(tensor::CastOp op, Value source) {
+  auto sourceType = source.getType().dyn_cast<RankedTensorType>();
+  auto intermediateType = op.source().getType().dyn_cast<RankedTensorType>();
+  auto resultType = op.getType().dyn_cast<RankedTensorType>();
+  if (!sourceType || !intermediateType || !resultType)
+    return false;
+  for (unsigned i = 0, e = intermediateType.getRank(); i < e; i++) {
+    if (!intermediateType.isDynamicDim(i) && sourceType.isDynamicDim(i) &&
+        resultType.isDynamicDim(i))
+      return false;
+  }
+  return tensor::CastOp::areCastCompatible(sourceType, resultType);
+}
+
+namespace {
+// Folds `tensor.cast(tensor.cast(x))` into one cast of `x`, or into `x` when
+// it has the type of the result.
+class FoldTensorCastChain : public OpRewritePattern<tensor::CastOp> {
+public:
+  using OpRewritePattern::OpRewritePattern;
+  LogicalResult matchAndRewrite(tensor::CastOp op,
+                                PatternRewriter &rewriter) const override {
+    auto producer = op.source().getDefiningOp<tensor::CastOp>();
+    if (!producer || !isFoldableCastChain(op, producer.source()))
+      return failure();
+    if (producer.source().getType() == op.getType())
+      rewriter.replaceOp(op, producer.source());
+    else
+      rewriter.replaceOpWithNewOp<tensor::CastOp>(op, op.getType(),
+                                                  producer.source());
+    return success();
+  }
+};
+} // namespace
+
+namespace {
+// Makes linalg ops read the operands of the `tensor.cast`s of their inputs
+// that only erase static extents, so that the ops see the static shapes.
+class FoldTensorCastIntoLinalgInput
+    : public OpInterfaceRewritePattern<linalg::LinalgOp> {
+public:
+  using OpInterfaceRewritePattern::OpInterfaceRewritePattern;
+  LogicalResult matchAndRewrite(linalg::LinalgOp op,
+                                PatternRewriter &rewriter) const override {
+    if (!op.hasTensorSemantics())
+      return failure();
+    bool changed = false;
+    for (unsigned i = 0, e = op.getNumInputs(); i < e; i++) {
+      OpOperand &operand = op->getOpOperand(i);
+      auto cast = operand.get().getDefiningOp<tensor::CastOp>();
+      if (!cast || !tensor::canFoldIntoConsumerOp(cast))
+        continue;
+      rewriter.updateRootInPlace(op, [&] { operand.set(cast.source()); });
+      changed = true;
+    }
+    return success(changed);
+  }
+};
+} // namespace
+
 namespace {
 struct FinalizingBuiltinTensorizePass
     : public FinalizingBuiltinTensorizeBase<FinalizingBuiltinTensorizePass> {
@@ -132,7 +199,19 @@ struct FinalizingBuiltinTensorizePass
         [&](Operation *op) { return typeConverter.isLegal(op); });
 
     if (failed(applyFullConversion(func, target, std::move(patterns))))
-      signalPassFailure();
+      return signalPassFailure();
+
+    // Removing the materializations leaves the `tensor.cast`s on either side
+    // of them adjacent. Fold the chains, the casts to the type of their
+    // operand, and the casts erasing static extents of linalg inputs, which
+    // would otherwise separate the linalg ops (keeping elementwise ops from
+    // fusing) and become copies after bufferization. The backend contract
+    // rejects the casts left that this could fold.
+    RewritePatternSet cleanupPatterns(context);
+    cleanupPatterns.add<FoldTensorCastChain, FoldTensorCastIntoLinalgInput>(
+        context);
+    if (failed(applyPatternsAndFoldGreedily(func, std::move(cleanupPatterns))))
+      return signalPassFailure();
   }
 };
 } // namespace
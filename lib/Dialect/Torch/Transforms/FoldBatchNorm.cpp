@@ -0,0 +1,229 @@
+//===- FoldBatchNorm.cpp -----------------------------------------*- C++-*-===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+
+#include "mlir/IR/Builders.h"
+#include "mlir/IR/BuiltinOps.h"
+#include "mlir/IR/Matchers.h"
+#include "npcomp/Dialect/Basicpy/IR/BasicpyDialect.h"
+#include "npcomp/Dialect/Torch/IR/TorchOps.h"
+#include "npcomp/Dialect/Torch/Transforms/Passes.h"
+
+#include <cmath>
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+using namespace mlir::NPCOMP::Torch;
+
+// Match a constant bool, which is either an `i1` or a `!basicpy.BoolType`.
+static bool matchConstantBool(Value value, bool &result) {
+  Attribute attr;
+  if (!matchPattern(value, m_Constant(&attr)))
+    return false;
+  if (auto boolAttr = attr.dyn_cast<BoolAttr>()) {
+    result = boolAttr.getValue();
+    return true;
+  }
+  if (auto intAttr = attr.dyn_cast<IntegerAttr>()) {
+    result = intAttr.getValue().getBoolValue();
+    return true;
+  }
+  return false;
+}
+
+static Value stripStaticInfoCasts(Value value) {
+  while (auto cast = value.getDefiningOp<TensorStaticInfoCastOp>())
+    value = cast.getOperand();
+  return value;
+}
+
+// Returns true if the non-value tensor `tensor` is never modified: it is only
+// copied, or cast to tensors that are never modified.
+static bool isNeverModified(Value tensor) {
+  for (Operation *user : tensor.getUsers()) {
+    if (isa<CopyTensorOp>(user))
+      continue;
+    auto cast = dyn_cast<TensorStaticInfoCastOp>(user);
+    if (!cast || !isNeverModified(cast.getResult()))
+      return false;
+  }
+  return true;
+}
+
+// Returns the floating point contents of the tensor literal that `value`
+// holds, or null.
+//
+// After InlineGlobalSlots and ReduceOpVariants, the parameters of a model are
+// copies of non-value tensor literals, which hold the literal as long as the
+// literal is never modified.
+static DenseElementsAttr getConstantTensor(Value value) {
+  value = stripStaticInfoCasts(value);
+  if (auto copy = value.getDefiningOp<CopyTensorOp>())
+    value = stripStaticInfoCasts(copy.getOperand());
+  auto literal = value.getDefiningOp<TensorOp>();
+  if (!literal)
+    return nullptr;
+  if (literal.getType().isa<NonValueTensorType>() &&
+      !isNeverModified(literal.getResult()))
+    return nullptr;
+  auto attr = literal.value().dyn_cast<DenseElementsAttr>();
+  if (!attr || !attr.getType().getElementType().isa<FloatType>())
+    return nullptr;
+  return attr;
+}
+
+static SmallVector<double> getDoubleValues(DenseElementsAttr attr) {
+  SmallVector<double> values;
+  values.reserve(attr.getNumElements());
+  for (APFloat value : attr.getFloatValues()) {
+    bool losesInfo;
+    value.convert(APFloat::IEEEdouble(), APFloat::rmNearestTiesToEven,
+                  &losesInfo);
+    values.push_back(value.convertToDouble());
+  }
+  return values;
+}
+
+// Creates a value tensor literal of type `type` holding `values`.
+static Value createLiteral(OpBuilder &b, Location loc, RankedTensorType type,
+                           ArrayRef<double> values) {
+  const llvm::fltSemantics &semantics =
+      type.getElementType().cast<FloatType>().getFloatSemantics();
+  SmallVector<APFloat> elements;
+  elements.reserve(values.size());
+  for (double value : values) {
+    APFloat element(value);
+    bool losesInfo;
+    element.convert(semantics, APFloat::rmNearestTiesToEven, &losesInfo);
+    elements.push_back(element);
+  }
+  return b.create<TensorOp>(loc, ValueTensorType::getFromShaped(type),
+                            DenseElementsAttr::get(type, elements));
+}
+
+// Erases the ops that only computed `value`, if it became unused.
+static void eraseIfUnused(Value value) {
+  Operation *op = value.getDefiningOp();
+  if (!op || !value.use_empty() ||
+      !isa<CopyTensorOp, TensorStaticInfoCastOp, TensorOp>(op))
+    return;
+  SmallVector<Value> operands(op->getOperands());
+  op->erase();
+  for (Value operand : operands)
+    eraseIfUnused(operand);
+}
+
+// Folds `batchNorm`, in inference mode, into the weight and bias of the
+// `aten.conv2d` or `aten.linear` op producing its input, when all of them are
+// literals.
+//
+// Normalizing channel `c` is an affine map `x * scale[c] + shift[c]`, which
+// composes with the convolution by scaling its filters for output channel `c`
+// and adjusting their bias.
+static bool foldIntoProducer(AtenBatchNormOp batchNorm) {
+  bool training;
+  FloatAttr epsAttr;
+  if (!matchConstantBool(batchNorm.training(), training) || training ||
+      !matchPattern(batchNorm.eps(), m_Constant(&epsAttr)))
+    return false;
+  Operation *producer = batchNorm.input().getDefiningOp();
+  if (!producer || !producer->hasOneUse())
+    return false;
+  Value weight, bias;
+  if (auto conv = dyn_cast<AtenConv2dOp>(producer)) {
+    weight = conv.weight();
+    bias = conv.bias();
+  } else if (auto linear = dyn_cast<AtenLinearOp>(producer)) {
+    // The channels of batch_norm are the output features of aten.linear only
+    // when the input is rank 2.
+    auto inputType = linear.input().getType().dyn_cast<BaseTensorType>();
+    if (!inputType || !inputType.hasSizes() ||
+        inputType.getSizes().size() != 2)
+      return false;
+    weight = linear.weight();
+    bias = linear.bias();
+  } else {
+    return false;
+  }
+
+  DenseElementsAttr weightAttr = getConstantTensor(weight);
+  if (!weightAttr || weightAttr.getType().getRank() < 1)
+    return false;
+  int64_t numChannels = weightAttr.getType().getDimSize(0);
+  Type elementType = weightAttr.getType().getElementType();
+  bool hasBias = !bias.getType().isa<Basicpy::NoneType>();
+  SmallVector<Value, 5> channelParams = {
+      batchNorm.weight(), batchNorm.bias(), batchNorm.running_mean(),
+      batchNorm.running_var()};
+  if (hasBias)
+    channelParams.push_back(bias);
+  SmallVector<SmallVector<double>, 5> channelValues;
+  for (Value param : channelParams) {
+    DenseElementsAttr attr = getConstantTensor(param);
+    if (!attr || attr.getType().getRank() != 1 ||
+        attr.getType().getDimSize(0) != numChannels ||
+        attr.getType().getElementType() != elementType)
+      return false;
+    channelValues.push_back(getDoubleValues(attr));
+  }
+  ArrayRef<double> gamma = channelValues[0], beta = channelValues[1],
+                   mean = channelValues[2], var = channelValues[3];
+  double eps = epsAttr.getValueAsDouble();
+
+  SmallVector<double> newWeight = getDoubleValues(weightAttr);
+  SmallVector<double> newBias(numChannels);
+  int64_t channelSize = newWeight.size() / numChannels;
+  for (int64_t c = 0; c < numChannels; c++) {
+    double scale = gamma[c] / std::sqrt(var[c] + eps);
+    for (int64_t i = c * channelSize, e = i + channelSize; i < e; i++)
+      newWeight[i] *= scale;
+    double oldBias = hasBias ? channelValues[4][c] : 0.0;
+    newBias[c] = (oldBias - mean[c]) * scale + beta[c];
+  }
+
+  Location loc = producer->getLoc();
+  OpBuilder builder(producer);
+  producer->setOperand(
+      1, createLiteral(builder, loc, weightAttr.getType(), newWeight));
+  producer->setOperand(
+      2, createLiteral(builder, loc,
+                       RankedTensorType::get({numChannels}, elementType),
+                       newBias));
+  Value result = producer->getResult(0);
+  if (result.getType() != batchNorm.getType()) {
+    result = OpBuilder(batchNorm).create<TensorStaticInfoCastOp>(
+        batchNorm.getLoc(), batchNorm.getType(), result);
+  }
+  batchNorm.replaceAllUsesWith(result);
+  batchNorm.erase();
+  eraseIfUnused(weight);
+  for (Value param : channelParams)
+    eraseIfUnused(param);
+  return true;
+}
+
+namespace {
+class FoldBatchNormPass : public FoldBatchNormBase<FoldBatchNormPass> {
+  void runOnOperation() override {
+    SmallVector<AtenBatchNormOp> batchNorms;
+    getOperation().walk(
+        [&](AtenBatchNormOp batchNorm) { batchNorms.push_back(batchNorm); });
+    bool changed = false;
+    for (AtenBatchNormOp batchNorm : batchNorms)
+      changed |= foldIntoProducer(batchNorm);
+    if (!changed)
+      markAllAnalysesPreserved();
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::Torch::createFoldBatchNormPass() {
+  return std::make_unique<FoldBatchNormPass>();
+}
@@ -96,14 +96,23 @@ public:
     return it->second;
   }
 
+  unsigned getNumGlobalSlots() { return slotToGlobalSlot.size(); }
+
 private:
+  // Appends `name` to the path from the root.
+  void pushName(StringRef name) {
+    pathLengths.push_back(path.size());
+    if (!path.empty())
+      path += '.';
+    path += name;
+  }
+  void popName() { path.resize(pathLengths.pop_back_val()); }
+
   LogicalResult recursivelyTraverse(NnModuleOp nnModule) {
-    std::string pathToClassFromRoot = llvm::join(nameStack, ".");
-    if (!seenNnModules.insert({nnModule, pathToClassFromRoot}).second) {
+    if (!seenNnModules.insert({nnModule, path}).second) {
       return nnModule.emitError()
              << "reachable by multiple paths from root object: '<root>."
-             << seenNnModules[nnModule] << "' and '<root>."
-             << pathToClassFromRoot << "'";
+             << seenNnModules[nnModule] << "' and '<root>." << path << "'";
     }
 
     auto classType = symbolTable.lookup<ClassTypeOp>(
@@ -112,13 +121,13 @@ private:
          llvm::zip(nnModule.getOps<SlotOp>(), classType.getOps<AttrOp>())) {
       auto slot = std::get<0>(t);
       auto attr = std::get<1>(t);
-      nameStack.push_back(attr.name().str());
+      pushName(attr.name());
       if (attr.type().isa<NnModuleType>()) {
         if (failed(
                 recursivelyTraverse(slot.value().getDefiningOp<NnModuleOp>())))
           return failure();
       } else {
-        std::string linkageName = llvm::join(nameStack, ".");
+        const std::string &linkageName = path;
         auto globalSlot = globalSlotBuilder.create<GlobalSlotOp>(
             slot.getLoc(), linkageName,
             /*sym_visibility=*/nullptr, attr.type());
@@ -130,14 +139,14 @@ private:
         if (failed(populateGlobalSlotInitializer(globalSlot, slot.value())))
           return failure();
       }
-      nameStack.pop_back();
+      popName();
     }
     for (auto method : classType.getOps<MethodOp>()) {
-      nameStack.push_back(method.name().str());
+      pushName(method.name());
       funcLinkageInfo[{nnModule,
                        symbolTable.lookup<FuncOp>(method.function())}] =
-          LinkageInfo{llvm::join(nameStack, "."), method.isPrivate()};
-      nameStack.pop_back();
+          LinkageInfo{path, method.isPrivate()};
+      popName();
     }
     return success();
   }
@@ -187,12 +196,14 @@ private:
   // The map value is the original path from the root that we found it at.
   DenseMap<NnModuleOp, std::string> seenNnModules;
 
-  // The stack of attribute names we have traversed during our recursive
-  // traversal of the class/object hierarchy.
+  // The attribute names we have traversed during our recursive traversal of
+  // the class/object hierarchy, joined with ".", and the length of the path
+  // before each name was appended.
   //
   // Linkage names are calculated based on the set of attribute names traversed
   // from the root class/module in the program.
-  std::vector<std::string> nameStack;
+  std::string path;
+  SmallVector<size_t> pathLengths;
   // Linkage info for each SlotOp in the program.
   DenseMap<SlotOp, LinkageInfo> slotLinkageInfo;
   // Linkage info for each method in the program. Since we are going to be
@@ -208,6 +219,32 @@ private:
 };
 } // namespace
 
+//===----------------------------------------------------------------------===//
+// Slot lookup.
+//===----------------------------------------------------------------------===//
+
+namespace {
+/// Finds the slot of an instance by name in constant time, instead of
+/// scanning the slots of the instance for each attribute access.
+class SlotLookup {
+public:
+  SlotLookup(ModuleOp module) {
+    for (auto nnModule : module.getOps<NnModuleOp>())
+      for (auto slot : nnModule.getOps<SlotOp>())
+        slots.insert({{nnModule, slot.name()}, slot});
+  }
+
+  /// Returns the slot named `name` of `instance` (the result of an
+  /// NnModuleOp), or null.
+  SlotOp lookup(Value instance, StringRef name) const {
+    return slots.lookup({instance.getDefiningOp(), name});
+  }
+
+private:
+  DenseMap<std::pair<Operation *, StringRef>, SlotOp> slots;
+};
+} // namespace
+
 //===----------------------------------------------------------------------===//
 // Monomorphization.
 //===----------------------------------------------------------------------===//
@@ -273,6 +310,7 @@ template <> struct llvm::DenseMapInfo<Monomorphization> {
 // currently only analyzes a subset of ops.
 static LogicalResult analyzeInstances(FuncOp func,
                                       ArrayRef<ArgInstance> argInstances,
+                                      const SlotLookup &slotLookup,
                                       BlockAndValueMapping &mapping) {
   for (auto &argInstance : argInstances)
     mapping.map(func.getArgument(argInstance.argIndex), argInstance.instance);
@@ -281,12 +319,8 @@ static LogicalResult analyzeInstances(FuncOp func,
       return WalkResult::advance();
     auto instance = mapping.lookupOrNull(op.receiver());
     assert(instance && "verifyFuncConformsToSubset should ensure this");
-    for (auto slot : instance.getDefiningOp<NnModuleOp>().getOps<SlotOp>()) {
-      if (slot.name() == op.name()) {
-        mapping.map(op, slot.value());
-        break;
-      }
-    }
+    if (SlotOp slot = slotLookup.lookup(instance, op.name()))
+      mapping.map(op, slot.value());
     return WalkResult::advance();
   });
   return success(!walkResult.wasInterrupted());
@@ -312,8 +346,8 @@ createMonomorphizationForCall(CallOp op, BlockAndValueMapping &mapping,
 namespace {
 class MonomorphizationTracker {
 public:
-  MonomorphizationTracker(ModuleOp module)
-      : module(module), symbolTable(module) {}
+  MonomorphizationTracker(ModuleOp module, const SlotLookup &slotLookup)
+      : module(module), symbolTable(module), slotLookup(slotLookup) {}
   LogicalResult
   initialize(DenseMap<ClassTypeOp, std::vector<NnModuleOp>> &instances) {
     for (auto func : module.getOps<FuncOp>()) {
@@ -355,7 +389,7 @@ private:
   LogicalResult generateNewMonomorphizations(const Monomorphization &m) {
     auto func = m.func;
     BlockAndValueMapping mapping;
-    if (failed(analyzeInstances(func, m.argInstances, mapping)))
+    if (failed(analyzeInstances(func, m.argInstances, slotLookup, mapping)))
       return failure();
     auto walkResult = func.walk([&](CallOp op) {
       FailureOr<Monomorphization> maybeMonomorphization =
@@ -371,6 +405,7 @@ private:
 
   ModuleOp module;
   SymbolTable symbolTable;
+  const SlotLookup &slotLookup;
   SmallVector<Monomorphization> dirtyMonomorphizations;
   llvm::SetVector<Monomorphization> monomorphizations;
 };
@@ -451,16 +486,13 @@ static LogicalResult
 rewriteMonomorphizedFuncClone(FuncOp func, BlockAndValueMapping mapping,
                               SymbolTable &symbolTable,
                               DenseMap<Monomorphization, FuncOp> &newFuncs,
-                              ObjectGraphInfo &objectGraphInfo) {
+                              ObjectGraphInfo &objectGraphInfo,
+                              const SlotLookup &slotLookup) {
 
   SmallVector<Operation *> toErase;
   auto handlePrimSetAttr = [&](PrimSetAttrOp op) {
-    auto instance = mapping.lookup(op.receiver()).getDefiningOp<NnModuleOp>();
-    SlotOp affectedSlot;
-    for (auto slot : instance.getOps<SlotOp>()) {
-      if (slot.name() == op.name())
-        affectedSlot = slot;
-    }
+    SlotOp affectedSlot = slotLookup.lookup(mapping.lookup(op.receiver()),
+                                            op.name());
     OpBuilder(op).create<GlobalSlotSetOp>(
         op.getLoc(), objectGraphInfo.getGlobalSlotFor(affectedSlot).sym_name(),
         op.value());
@@ -469,12 +501,8 @@ rewriteMonomorphizedFuncClone(FuncOp func, BlockAndValueMapping mapping,
   };
   auto handlePrimGetAttr = [&](PrimGetAttrOp op) {
     if (!op.getType().isa<NnModuleType>()) {
-      auto instance = mapping.lookup(op.receiver()).getDefiningOp<NnModuleOp>();
-      SlotOp affectedSlot;
-      for (auto slot : instance.getOps<SlotOp>()) {
-        if (slot.name() == op.name())
-          affectedSlot = slot;
-      }
+      SlotOp affectedSlot = slotLookup.lookup(mapping.lookup(op.receiver()),
+                                              op.name());
       auto newOp = OpBuilder(op).create<GlobalSlotGetOp>(
           op.getLoc(), op.getType(),
           objectGraphInfo.getGlobalSlotFor(affectedSlot).sym_name());
@@ -523,7 +551,18 @@ rewriteMonomorphizedFuncClone(FuncOp func, BlockAndValueMapping mapping,
   return success(!walkResult.wasInterrupted());
 }
 
-static LogicalResult globalizeObjectGraph(ModuleOp module) {
+namespace {
+// Counts reported as the statistics of the pass.
+struct GlobalizeStatistics {
+  unsigned numGlobalSlots = 0;
+  unsigned numMonomorphizations = 0;
+  // Monomorphizations beyond the first of each function.
+  unsigned numExtraMonomorphizations = 0;
+};
+} // namespace
+
+static LogicalResult globalizeObjectGraph(ModuleOp module,
+                                          GlobalizeStatistics &statistics) {
 
   // Step 1: Traverse object graph and collect information.
 
@@ -571,7 +610,8 @@ static LogicalResult globalizeObjectGraph(ModuleOp module) {
   // calculating these monomorphizations is a fixed-point iteration that
   // discovers all needed monomorphizations. In practice this yields a
   // controllable number.
-  MonomorphizationTracker tracker(module);
+  SlotLookup slotLookup(module);
+  MonomorphizationTracker tracker(module, slotLookup);
   if (failed(tracker.initialize(instances)))
     return failure();
 
@@ -579,6 +619,14 @@ static LogicalResult globalizeObjectGraph(ModuleOp module) {
     return failure();
   }
 
+  statistics.numGlobalSlots = objectGraphInfo.getNumGlobalSlots();
+  DenseSet<FuncOp> monomorphizedFuncs;
+  for (auto &monomorphization : tracker.getMonomorphizations()) {
+    statistics.numMonomorphizations += 1;
+    if (!monomorphizedFuncs.insert(monomorphization.func).second)
+      statistics.numExtraMonomorphizations += 1;
+  }
+
   // Step 4: Clone/rewrite functions to implement the necessary
   // monomorphizations.
   DenseMap<Monomorphization, FuncOp> newFuncs;
@@ -600,6 +648,14 @@ static LogicalResult globalizeObjectGraph(ModuleOp module) {
                                 ? SymbolTable::Visibility::Private
                                 : SymbolTable::Visibility::Public);
       newFunc.setName(linkageInfo->linkageName);
+      // Record in the location of each op the method it comes from, which
+      // is named after the path of its module from the root. This survives
+      // inlining (as the callee of a callsite location) and lowering, so that
+      // e.g. profiles can attribute time to modules.
+      auto methodName = Identifier::get(newFunc.getName(), module.getContext());
+      newFunc.walk([&](Operation *op) {
+        op->setLoc(NameLoc::get(methodName, op->getLoc()));
+      });
     } else {
       // It's a free function.
       // TODO: Make the name nicer (no suffix in typical case).
@@ -613,10 +669,12 @@ static LogicalResult globalizeObjectGraph(ModuleOp module) {
 
   for (auto &kv : newFuncs) {
     BlockAndValueMapping mapping;
-    if (failed(analyzeInstances(kv.second, kv.first.argInstances, mapping)))
+    if (failed(analyzeInstances(kv.second, kv.first.argInstances, slotLookup,
+                                mapping)))
       return failure();
     if (failed(rewriteMonomorphizedFuncClone(kv.second, mapping, symbolTable,
-                                             newFuncs, objectGraphInfo)))
+                                             newFuncs, objectGraphInfo,
+                                             slotLookup)))
       return failure();
   }
 
@@ -644,8 +702,12 @@ namespace {
 class GlobalizeObjectGraphPass
     : public GlobalizeObjectGraphBase<GlobalizeObjectGraphPass> {
   void runOnOperation() override {
-    if (failed(globalizeObjectGraph(getOperation())))
+    GlobalizeStatistics statistics;
+    if (failed(globalizeObjectGraph(getOperation(), statistics)))
       return signalPassFailure();
+    numGlobalSlots = statistics.numGlobalSlots;
+    numMonomorphizations = statistics.numMonomorphizations;
+    numExtraMonomorphizations = statistics.numExtraMonomorphizations;
   }
 };
 } // namespace
@@ -56,6 +56,12 @@ class InlineGlobalSlotsPass
     }
 
     DenseSet<Operation *> toErase;
+    // The value of each inlined global slot, materialized once per function
+    // (at the start of its entry block, in order of first use) and shared by
+    // all the reads in that function. Literals in the initializers are uniqued
+    // attributes, so the copies in different functions share their contents.
+    DenseMap<std::pair<Operation *, Operation *>, Value> materialized;
+    DenseMap<Operation *, Operation *> lastMaterializedOp;
     // Inline all the global slots that are not potentially written.
     for (const SymbolTable::SymbolUse &use : *uses) {
       auto flatSymbolRef = use.getSymbolRef().cast<FlatSymbolRefAttr>();
@@ -70,14 +76,28 @@ class InlineGlobalSlotsPass
       if (potentiallyWrittenGlobalSlots.contains(globalSlot))
         continue;
       auto globalSlotGet = cast<Torch::GlobalSlotGetOp>(use.getUser());
-      OpBuilder builder(globalSlotGet);
-      BlockAndValueMapping mapper;
-      for (Operation &op : globalSlot.getBody()->without_terminator())
-        builder.clone(op, mapper);
-      Value cloned = mapper.lookup(
-          cast<GlobalSlotInitOp>(globalSlot.getBody()->getTerminator())
-              .getOperand());
-      globalSlotGet.replaceAllUsesWith(cloned);
+      auto func = globalSlotGet->getParentOfType<FuncOp>();
+      Value &value = materialized[{func, globalSlot}];
+      if (!value || !func) {
+        OpBuilder builder(globalSlotGet);
+        Operation *lastOp = nullptr;
+        if (func) {
+          lastOp = lastMaterializedOp.lookup(func);
+          if (lastOp)
+            builder.setInsertionPointAfter(lastOp);
+          else
+            builder.setInsertionPointToStart(&func.getBody().front());
+        }
+        BlockAndValueMapping mapper;
+        for (Operation &op : globalSlot.getBody()->without_terminator())
+          lastOp = builder.clone(op, mapper);
+        value = mapper.lookup(
+            cast<GlobalSlotInitOp>(globalSlot.getBody()->getTerminator())
+                .getOperand());
+        if (func && lastOp)
+          lastMaterializedOp[func] = lastOp;
+      }
+      globalSlotGet.replaceAllUsesWith(value);
       toErase.insert(globalSlotGet);
       toErase.insert(globalSlot);
     }
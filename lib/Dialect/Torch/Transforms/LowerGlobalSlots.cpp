@@ -0,0 +1,125 @@
+//===- LowerGlobalSlots.cpp --------------------------------------*- C++-*-===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+
+#include "mlir/Dialect/Linalg/IR/LinalgOps.h"
+#include "mlir/Dialect/MemRef/IR/MemRef.h"
+#include "mlir/IR/Builders.h"
+#include "mlir/IR/BuiltinOps.h"
+#include "npcomp/Dialect/Torch/IR/TorchDialect.h"
+#include "npcomp/Dialect/Torch/IR/TorchOps.h"
+#include "npcomp/Dialect/Torch/Transforms/Passes.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+using namespace mlir::NPCOMP::Torch;
+
+// Returns the initial value of `slot` if it is a tensor literal that can be
+// the initial value of a `memref.global`, or null.
+static DenseElementsAttr getInitialTensor(GlobalSlotOp slot) {
+  if (!slot.typeBound().isa<BaseTensorType>())
+    return nullptr;
+  auto init = cast<GlobalSlotInitOp>(slot.getBody()->getTerminator());
+  auto literal = init.initialValue().getDefiningOp<TensorOp>();
+  if (!literal)
+    return nullptr;
+  auto value = literal.value().dyn_cast<DenseElementsAttr>();
+  if (!value || !value.getType().hasStaticShape() ||
+      !BaseMemRefType::isValidElementType(value.getType().getElementType()))
+    return nullptr;
+  return value;
+}
+
+// Replaces `get` by a read of `global`. Unless the slot is never set, the
+// value is copied out of the global, so that later sets don't change it.
+static void lowerGet(GlobalSlotGetOp get, memref::GlobalOp global,
+                     bool isEverSet) {
+  OpBuilder b(get);
+  Location loc = get.getLoc();
+  MemRefType type = global.type().cast<MemRefType>();
+  Value buffer = b.create<memref::GetGlobalOp>(loc, type, global.sym_name());
+  if (isEverSet) {
+    Value copy = b.create<memref::AllocOp>(loc, type);
+    b.create<linalg::CopyOp>(loc, buffer, copy);
+    buffer = copy;
+  }
+  Value tensor = b.create<memref::TensorLoadOp>(loc, buffer);
+  auto tensorType = tensor.getType().cast<ShapedType>();
+  Value result = b.create<FromBuiltinTensorOp>(
+      loc, ValueTensorType::getFromShaped(tensorType), tensor);
+  result = b.create<CopyTensorOp>(
+      loc, NonValueTensorType::getFromShaped(tensorType), result);
+  if (result.getType() != get.getType())
+    result = b.create<TensorStaticInfoCastOp>(loc, get.getType(), result);
+  get.replaceAllUsesWith(result);
+  get.erase();
+}
+
+// Replaces `set` by a copy into the storage of `global`.
+static void lowerSet(GlobalSlotSetOp set, memref::GlobalOp global) {
+  OpBuilder b(set);
+  Location loc = set.getLoc();
+  MemRefType type = global.type().cast<MemRefType>();
+  auto tensorType = RankedTensorType::get(type.getShape(),
+                                          type.getElementType());
+  Value value = set.value();
+  auto nonValueType = NonValueTensorType::getFromShaped(tensorType);
+  if (value.getType() != nonValueType)
+    value = b.create<TensorStaticInfoCastOp>(loc, nonValueType, value);
+  value = b.create<CopyTensorOp>(
+      loc, ValueTensorType::getFromShaped(tensorType), value);
+  value = b.create<ToBuiltinTensorOp>(loc, tensorType, value);
+  Value source = b.create<memref::BufferCastOp>(loc, type, value);
+  Value buffer = b.create<memref::GetGlobalOp>(loc, type, global.sym_name());
+  b.create<linalg::CopyOp>(loc, source, buffer);
+  set.erase();
+}
+
+namespace {
+class LowerGlobalSlotsPass : public LowerGlobalSlotsBase<LowerGlobalSlotsPass> {
+  void runOnOperation() override {
+    ModuleOp module = getOperation();
+    SymbolTable symbolTable(module);
+
+    DenseMap<GlobalSlotOp, SmallVector<GlobalSlotGetOp, 4>> gets;
+    DenseMap<GlobalSlotOp, SmallVector<GlobalSlotSetOp, 4>> sets;
+    module.walk([&](Operation *op) {
+      if (auto get = dyn_cast<GlobalSlotGetOp>(op))
+        gets[symbolTable.lookup<GlobalSlotOp>(get.slot())].push_back(get);
+      else if (auto set = dyn_cast<GlobalSlotSetOp>(op))
+        sets[symbolTable.lookup<GlobalSlotOp>(set.slot())].push_back(set);
+    });
+
+    for (auto slot :
+         llvm::make_early_inc_range(module.getOps<GlobalSlotOp>())) {
+      DenseElementsAttr initialValue = getInitialTensor(slot);
+      if (!initialValue)
+        continue;
+      OpBuilder b(slot);
+      auto type = MemRefType::get(initialValue.getType().getShape(),
+                                  initialValue.getType().getElementType());
+      // The slot keeps its name and visibility.
+      auto global = b.create<memref::GlobalOp>(
+          slot.getLoc(), slot.sym_name(), slot.sym_visibilityAttr(), type,
+          initialValue, /*constant=*/false);
+      bool isEverSet = !sets[slot].empty() || !slot.isPrivate();
+      for (GlobalSlotGetOp get : gets[slot])
+        lowerGet(get, global, isEverSet);
+      for (GlobalSlotSetOp set : sets[slot])
+        lowerSet(set, global);
+      slot.erase();
+    }
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<ModuleOp>>
+mlir::NPCOMP::Torch::createLowerGlobalSlotsPass() {
+  return std::make_unique<LowerGlobalSlotsPass>();
+}
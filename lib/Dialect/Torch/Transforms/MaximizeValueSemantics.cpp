@@ -8,6 +8,7 @@
 
 #include "PassDetail.h"
 
+#include "mlir/Dialect/SCF/SCF.h"
 #include "mlir/Dialect/StandardOps/IR/Ops.h"
 #include "mlir/IR/Builders.h"
 #include "mlir/IR/BuiltinOps.h"
@@ -20,6 +21,215 @@ using namespace mlir;
 using namespace mlir::NPCOMP;
 using namespace mlir::NPCOMP::Torch;
 
+// Returns true if `copy` creates a fresh non-value tensor from a value tensor.
+static bool isFreshTensor(CopyTensorOp copy) {
+  return copy.getOperand().getType().isa<ValueTensorType>() &&
+         copy.getType().isa<NonValueTensorType>();
+}
+
+// Returns the copy creating the fresh tensor that `value` is an alias of
+// (through `torch.tensor_static_info_cast` ops), or null.
+static CopyTensorOp getFreshTensor(Value value) {
+  while (auto cast = value.getDefiningOp<TensorStaticInfoCastOp>())
+    value = cast.getOperand();
+  auto copy = value.getDefiningOp<CopyTensorOp>();
+  if (!copy || !isFreshTensor(copy))
+    return nullptr;
+  return copy;
+}
+
+// Returns true if `user`, a user of an alias of a fresh tensor, copies it to a
+// value tensor.
+static bool isRead(Operation *user) {
+  auto copy = dyn_cast<CopyTensorOp>(user);
+  return copy && copy.getType().isa<ValueTensorType>();
+}
+
+// Returns true if the use `use` of an alias of a fresh tensor overwrites it
+// with a value tensor.
+static bool isWrite(OpOperand &use) {
+  auto overwrite = dyn_cast<OverwriteTensorOp>(use.getOwner());
+  return overwrite && use.getOperandNumber() == 1 &&
+         overwrite.value().getType().isa<ValueTensorType>();
+}
+
+// Collects the users of the aliases of the fresh tensor created by `copy`
+// (the tensor itself and any `torch.tensor_static_info_cast` of them), in
+// discovery order, so that each cast comes before its own users.
+//
+// Returns false if the tensor is used by anything else than reads, writes and
+// casts, except for the uses by `allowedUser`, which are not collected.
+// Writes must be in the block of `copy`, while reads and casts can also be
+// nested in the regions of the ops of that block, if `allowNestedReads`.
+static bool collectAliasUsers(CopyTensorOp copy,
+                              SmallVectorImpl<Operation *> &users,
+                              Operation *allowedUser = nullptr,
+                              bool allowNestedReads = true) {
+  Block *block = copy->getBlock();
+  SmallVector<Value> worklist = {copy.getResult()};
+  while (!worklist.empty()) {
+    Value alias = worklist.pop_back_val();
+    for (OpOperand &use : alias.getUses()) {
+      Operation *user = use.getOwner();
+      if (user == allowedUser)
+        continue;
+      bool isNested = user->getBlock() != block;
+      if (isNested &&
+          (!allowNestedReads || !block->findAncestorOpInBlock(*user)))
+        return false;
+      if (auto cast = dyn_cast<TensorStaticInfoCastOp>(user))
+        worklist.push_back(cast.getResult());
+      else if (!isRead(user) && (isNested || !isWrite(use)))
+        return false;
+      users.push_back(user);
+    }
+  }
+  return true;
+}
+
+// Rewrites the fresh tensor created by `copy` to value semantics, if all its
+// aliases are only read or overwritten.
+//
+// Since the tensor doesn't escape, the contents read by each read are exactly
+// the last value written to the tensor, in program order. The reads nested in
+// regions (such as loop bodies) read the value current at the op holding the
+// region, since the tensor can't be written in the region.
+static bool rewriteToValueSemantics(CopyTensorOp copy) {
+  SmallVector<Operation *> users;
+  if (!collectAliasUsers(copy, users))
+    return false;
+
+  // Order the users by their ancestor in the block of `copy`. Nested users
+  // with the same ancestor are all reads or casts, which commute.
+  Block *block = copy->getBlock();
+  SmallVector<std::pair<Operation *, Operation *>> orderedUsers;
+  for (Operation *user : users)
+    orderedUsers.emplace_back(block->findAncestorOpInBlock(*user), user);
+  llvm::stable_sort(orderedUsers, [](auto lhs, auto rhs) {
+    return lhs.first != rhs.first && lhs.first->isBeforeInBlock(rhs.first);
+  });
+
+  Value currentValue = copy.getOperand();
+  for (auto &ancestorAndUser : orderedUsers) {
+    Operation *user = ancestorAndUser.second;
+    if (auto overwrite = dyn_cast<OverwriteTensorOp>(user)) {
+      currentValue = overwrite.value();
+    } else if (auto read = dyn_cast<CopyTensorOp>(user)) {
+      Value value = currentValue;
+      // The value written may have different static information than the
+      // tensor read.
+      if (value.getType() != read.getType()) {
+        value = OpBuilder(read).create<TensorStaticInfoCastOp>(
+            read.getLoc(), read.getType(), value);
+      }
+      read.replaceAllUsesWith(value);
+    }
+  }
+  // Each cast comes before its users in `users`.
+  for (Operation *user : llvm::reverse(users))
+    user->erase();
+  copy.erase();
+  return true;
+}
+
+// Returns true if the value `yielded` by `terminator` is a fresh tensor
+// created in the block of `terminator` that is only read, written and yielded.
+// Such a tensor can be yielded as a value tensor read just before
+// `terminator`.
+static bool isYieldedFreshTensor(Value yielded, Operation *terminator) {
+  CopyTensorOp copy = getFreshTensor(yielded);
+  SmallVector<Operation *> users;
+  return copy && copy->getBlock() == terminator->getBlock() &&
+         collectAliasUsers(copy, users, terminator,
+                           /*allowNestedReads=*/false);
+}
+
+// Returns a value tensor read of `tensor` inserted before `op`.
+static Value createRead(Operation *op, Value tensor) {
+  auto type = tensor.getType().cast<BaseTensorType>();
+  return OpBuilder(op).create<CopyTensorOp>(op->getLoc(),
+                                            type.getWithValueSemantics(),
+                                            tensor);
+}
+
+// Changes `result`, which holds a tensor of the same contents as a fresh
+// tensor, to a value tensor, and replaces its uses by a fresh copy of it.
+static void convertResultToValueSemantics(OpResult result) {
+  auto type = result.getType().cast<NonValueTensorType>();
+  result.setType(type.getWithValueSemantics());
+  OpBuilder builder(result.getOwner());
+  builder.setInsertionPointAfter(result.getOwner());
+  auto copy =
+      builder.create<CopyTensorOp>(result.getOwner()->getLoc(), type, result);
+  result.replaceAllUsesExcept(copy, copy);
+}
+
+// Changes the non-value tensor results of `ifOp` that are fresh tensors in
+// both branches to value tensors.
+static bool convertIfToValueSemantics(scf::IfOp ifOp) {
+  if (ifOp.getNumResults() == 0)
+    return false;
+  auto thenYield =
+      cast<scf::YieldOp>(ifOp.thenRegion().front().getTerminator());
+  auto elseYield =
+      cast<scf::YieldOp>(ifOp.elseRegion().front().getTerminator());
+  bool changed = false;
+  for (OpResult result : ifOp->getResults()) {
+    unsigned i = result.getResultNumber();
+    if (!result.getType().isa<NonValueTensorType>() ||
+        !isYieldedFreshTensor(thenYield.getOperand(i), thenYield) ||
+        !isYieldedFreshTensor(elseYield.getOperand(i), elseYield))
+      continue;
+    for (scf::YieldOp yield : {thenYield, elseYield})
+      yield->setOperand(i, createRead(yield, yield.getOperand(i)));
+    convertResultToValueSemantics(result);
+    changed = true;
+  }
+  return changed;
+}
+
+// Changes the non-value loop-carried tensors of `loop` to value tensors.
+//
+// This requires that the tensor be a fresh tensor at the start of each
+// iteration that is only read in the loop body, so that each iteration reads
+// the contents that the tensor had when it was carried. Then, the tensor
+// carried initially must not be used after the loop, since the result of the
+// loop aliases it if the loop doesn't run.
+static bool convertLoopToValueSemantics(PrimLoopOp loop) {
+  Block *body = &loop.region().front();
+  auto condition = cast<PrimLoopConditionOp>(body->getTerminator());
+  bool changed = false;
+  for (OpResult result : loop->getResults()) {
+    unsigned i = result.getResultNumber();
+    BlockArgument iterArg = body->getArgument(i + 1);
+    Value init = loop.iterArgsInit()[i];
+    if (!result.getType().isa<NonValueTensorType>() ||
+        !llvm::all_of(iterArg.getUsers(), isRead) ||
+        !isYieldedFreshTensor(condition.iterArgs()[i], condition))
+      continue;
+    CopyTensorOp initCopy = getFreshTensor(init);
+    SmallVector<Operation *> initUsers;
+    if (!initCopy || initCopy->getBlock() != loop->getBlock() ||
+        !collectAliasUsers(initCopy, initUsers, loop,
+                           /*allowNestedReads=*/false) ||
+        llvm::any_of(initUsers, [&](Operation *user) {
+          return loop->isBeforeInBlock(user);
+        }))
+      continue;
+
+    loop->setOperand(loop.iterArgsInit().getBeginOperandIndex() + i,
+                     createRead(loop, init));
+    iterArg.setType(iterArg.getType()
+                        .cast<NonValueTensorType>()
+                        .getWithValueSemantics());
+    condition->setOperand(condition.iterArgs().getBeginOperandIndex() + i,
+                          createRead(condition, condition.iterArgs()[i]));
+    convertResultToValueSemantics(result);
+    changed = true;
+  }
+  return changed;
+}
+
 namespace {
 
 class MaximizeValueSemanticsPass
@@ -31,7 +241,35 @@ class MaximizeValueSemanticsPass
     RewritePatternSet patterns(context);
     CopyTensorOp::getCanonicalizationPatterns(patterns, context);
     TensorStaticInfoCastOp::getCanonicalizationPatterns(patterns, context);
-    (void)applyPatternsAndFoldGreedily(func, std::move(patterns));
+    FrozenRewritePatternSet frozenPatterns(std::move(patterns));
+    (void)applyPatternsAndFoldGreedily(func, frozenPatterns);
+
+    // Carry the tensors across regions as value tensors where possible. This
+    // only adds copies, which are removed below. The walk is post-order, so
+    // that the results of inner ops are fresh tensors when visiting the outer
+    // ops.
+    bool changed = false;
+    func.walk([&](Operation *op) {
+      if (auto ifOp = dyn_cast<scf::IfOp>(op))
+        changed |= convertIfToValueSemantics(ifOp);
+      else if (auto loop = dyn_cast<PrimLoopOp>(op))
+        changed |= convertLoopToValueSemantics(loop);
+    });
+
+    // Rewrite the fresh tensors that are only read and overwritten (such as
+    // those updated by in-place ops after ReduceOpVariants) to value
+    // semantics, which removes all their copies. This only erases reads,
+    // casts and writes, so the fresh tensors collected are never erased by
+    // the rewrite of another one.
+    SmallVector<CopyTensorOp> freshTensors;
+    func.walk([&](CopyTensorOp copy) {
+      if (isFreshTensor(copy))
+        freshTensors.push_back(copy);
+    });
+    for (CopyTensorOp copy : freshTensors)
+      changed |= rewriteToValueSemantics(copy);
+    if (changed)
+      (void)applyPatternsAndFoldGreedily(func, frozenPatterns);
   }
 };
 
@@ -9,6 +9,9 @@
 #ifndef NPCOMP_DIALECT_TORCH_TRANSFORMS_PASSDETAIL_H
 #define NPCOMP_DIALECT_TORCH_TRANSFORMS_PASSDETAIL_H
 
+#include "mlir/Dialect/Linalg/IR/LinalgTypes.h"
+#include "mlir/Dialect/MemRef/IR/MemRef.h"
+#include "mlir/Dialect/StandardOps/IR/Ops.h"
 #include "mlir/Pass/Pass.h"
 
 namespace mlir {
@@ -49,12 +49,15 @@ void mlir::NPCOMP::Torch::createLowerObjectGraphPipeline(
   // to write.
   pm.addPass(createPrepareForGlobalizeObjectGraphPass());
   pm.addPass(createGlobalizeObjectGraphPass());
-  // "lower" `torch.global_slot` ops by deleting them if unused, which we
-  // currently require because we don't have a lowering path for backends to
-  // handle them.
+  // When serving only some of the methods, make the rest of the globalized
+  // interface private, so that the symbol DCE below deletes it along with the
+  // weights only it uses.
+  if (!options.entryPoints.empty())
+    pm.addPass(createPruneToEntryPointsPass(options.entryPoints));
+  // Delete the unused `torch.global_slot` ops, which backends would otherwise
+  // have to allocate (see LowerGlobalSlots).
   // Torch usually inserts a few unused global slots so this ends up hitting
   // every single module even if it doesn't have any explicit slots.
-  // TODO: Support global slots in backends.
   pm.addPass(createSymbolDCEPass());
   // Currently, our shape inference is not powerful enough to deal with
   // calls, so inline everything.
@@ -85,7 +88,7 @@ void mlir::NPCOMP::Torch::createLowerToNpcompBackendPipeline(
   // In particular the following features are needed in some form from backends:
   // - Error handling (RaiseException + error string formatting)
   // - First-class list type
-  // - torch.global_slot lowering
+  // - torch.global_slot lowering for non-tensor slots
   // - ...
   // Please try to keep this list somewhat up to date when adding
   // "optimize hard enough that it works" transformations.
@@ -93,11 +96,13 @@ void mlir::NPCOMP::Torch::createLowerToNpcompBackendPipeline(
   if (options.optimize) {
     // Inline global slots, which for most inference scenarios deletes them.
     // This also exposes more information to intraprocedural transformations
-    // below like MaximizeValueSemantics and RefineTypes.
+    // below like MaximizeValueSemantics and RefineTypes. The branches on
+    // constants (such as `self.training`) are folded along the way, which
+    // lets the slots only written or read in training be inlined or deleted.
     // OPT-ONLY: Don't rely on this pass to "lower" global slots by deleting.
     // Also don't rely on this pass to expose constants into the program to
     // simplify handling of "optional".
-    pm.addPass(createInlineGlobalSlotsPass());
+    pm.addPass(createPropagateGlobalConstantsPass());
   }
 
   // Reduce variants of ops to a smaller set of primitives.
@@ -115,6 +120,10 @@ void mlir::NPCOMP::Torch::createLowerToNpcompBackendPipeline(
     pm.addPass(createSymbolDCEPass());
   }
 
+  // Lower the remaining tensor global slots (such as the parameters updated by
+  // a training step) to mutable globals that backends can handle.
+  pm.addPass(createLowerGlobalSlotsPass());
+
   //===--------------------------------------------------------------------===//
   // Lowering to ranked !torch.vtensors of known dtype.
   //===--------------------------------------------------------------------===//
@@ -129,6 +138,12 @@ void mlir::NPCOMP::Torch::createLowerToNpcompBackendPipeline(
   // Clean up a few stray conversion remnants.
   pm.addNestedPass<FuncOp>(Torch::createMaximizeValueSemanticsPass());
 
+  if (options.optimize) {
+    // Fold inference batch normalizations into the weights of the preceding
+    // convolutions, now that the parameters are inlined as literals.
+    pm.addNestedPass<FuncOp>(Torch::createFoldBatchNormPass());
+  }
+
   //===--------------------------------------------------------------------===//
   // Lowering ops and the !torch.vtensor type.
   //===--------------------------------------------------------------------===//
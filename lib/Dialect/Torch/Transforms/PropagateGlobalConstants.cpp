@@ -0,0 +1,71 @@
+//===- PropagateGlobalConstants.cpp ------------------------------*- C++-*-===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+
+#include "mlir/IR/BuiltinOps.h"
+#include "mlir/Pass/PassManager.h"
+#include "mlir/Transforms/Passes.h"
+#include "npcomp/Dialect/Torch/IR/TorchOps.h"
+#include "npcomp/Dialect/Torch/Transforms/Passes.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+using namespace mlir::NPCOMP::Torch;
+
+// Erases the reads of global slots and the tensor literals (such as inlined
+// weights) whose results are unused, returning true if there were any. Both
+// have no side effects, but aren't marked as such: each tensor literal creates
+// a distinct mutable tensor, and reads see the writes that precede them.
+static bool eraseUnusedReads(ModuleOp module) {
+  bool erased = false;
+  module.walk([&](Operation *op) {
+    if (isa<GlobalSlotGetOp, TensorOp>(op) && op->use_empty()) {
+      op->erase();
+      erased = true;
+    }
+  });
+  return erased;
+}
+
+static size_t getNumGlobalSlots(ModuleOp module) {
+  auto globalSlots = module.getOps<GlobalSlotOp>();
+  return std::distance(globalSlots.begin(), globalSlots.end());
+}
+
+namespace {
+class PropagateGlobalConstantsPass
+    : public PropagateGlobalConstantsBase<PropagateGlobalConstantsPass> {
+  void runOnOperation() override {
+    ModuleOp module = getOperation();
+    OpPassManager pipeline(ModuleOp::getOperationName());
+    pipeline.addPass(createInlineGlobalSlotsPass());
+    pipeline.addPass(createSCCPPass());
+    pipeline.addNestedPass<FuncOp>(createCanonicalizerPass());
+    pipeline.addPass(createSymbolDCEPass());
+
+    // Each round can fold away the branches writing more slots, which the
+    // next round then inlines.
+    size_t numGlobalSlots = getNumGlobalSlots(module);
+    for (;;) {
+      if (failed(runPipeline(pipeline, module)))
+        return signalPassFailure();
+      bool erasedReads = eraseUnusedReads(module);
+      size_t newNumGlobalSlots = getNumGlobalSlots(module);
+      if (!erasedReads && newNumGlobalSlots == numGlobalSlots)
+        break;
+      numGlobalSlots = newNumGlobalSlots;
+    }
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<ModuleOp>>
+mlir::NPCOMP::Torch::createPropagateGlobalConstantsPass() {
+  return std::make_unique<PropagateGlobalConstantsPass>();
+}
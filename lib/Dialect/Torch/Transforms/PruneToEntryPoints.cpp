@@ -0,0 +1,70 @@
+//===- PruneToEntryPoints.cpp ------------------------------------*- C++-*-===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+
+#include "mlir/IR/BuiltinOps.h"
+#include "npcomp/Dialect/Torch/IR/TorchOps.h"
+#include "npcomp/Dialect/Torch/Transforms/Passes.h"
+#include "llvm/ADT/StringSet.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+using namespace mlir::NPCOMP::Torch;
+
+namespace {
+class PruneToEntryPointsPass
+    : public PruneToEntryPointsBase<PruneToEntryPointsPass> {
+public:
+  PruneToEntryPointsPass() = default;
+  PruneToEntryPointsPass(ArrayRef<std::string> names) { entryPoints = names; }
+
+  void runOnOperation() override {
+    ModuleOp module = getOperation();
+    // Without entry points, the whole public interface is kept.
+    if (entryPoints.empty())
+      return;
+
+    llvm::StringSet<> names;
+    for (const std::string &name : entryPoints) {
+      auto func = module.lookupSymbol<FuncOp>(name);
+      if (!func || !func.isPublic()) {
+        module.emitError() << "entry point '" << name
+                           << "' is not a public function of the module";
+        return signalPassFailure();
+      }
+      names.insert(name);
+    }
+
+    // Make everything else private, so that symbol DCE deletes what the entry
+    // points don't reach.
+    for (Operation &op : *module.getBody()) {
+      if (!isa<FuncOp, GlobalSlotOp>(op))
+        continue;
+      if (SymbolTable::getSymbolVisibility(&op) !=
+          SymbolTable::Visibility::Public)
+        continue;
+      if (isa<FuncOp>(op) &&
+          names.contains(SymbolTable::getSymbolName(&op).getValue()))
+        continue;
+      SymbolTable::setSymbolVisibility(&op, SymbolTable::Visibility::Private);
+    }
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<ModuleOp>>
+mlir::NPCOMP::Torch::createPruneToEntryPointsPass() {
+  return std::make_unique<PruneToEntryPointsPass>();
+}
+
+std::unique_ptr<OperationPass<ModuleOp>>
+mlir::NPCOMP::Torch::createPruneToEntryPointsPass(
+    ArrayRef<std::string> entryPoints) {
+  return std::make_unique<PruneToEntryPointsPass>(entryPoints);
+}
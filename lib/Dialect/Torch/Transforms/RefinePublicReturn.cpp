@@ -54,18 +54,17 @@ class RefinePublicReturnPass
       return signalPassFailure();
     }
 
-    // Get the new operands. Either the original operand, or if there is a
-    // TensorStaticInfoCastOp then the pre-casted operand, which is presumed to
-    // have a more precise type.
+    // Get the new operands. Either the original operand, or if there are
+    // TensorStaticInfoCastOp's then the operand before all of them, which is
+    // presumed to have the most precise type. With shape annotations on the
+    // arguments, this makes fully static result types part of the public
+    // signature.
     SmallVector<Value> newOperands;
     OpBuilder builder(returnOp);
     for (auto operand : returnOp.getOperands()) {
-      Value newOperand;
-      if (auto cast = operand.getDefiningOp<TensorStaticInfoCastOp>()) {
+      Value newOperand = operand;
+      while (auto cast = newOperand.getDefiningOp<TensorStaticInfoCastOp>())
         newOperand = cast.getOperand();
-      } else {
-        newOperand = operand;
-      }
       if (auto tensorType = newOperand.getType().dyn_cast<BaseTensorType>()) {
         newOperands.push_back(
             copyTensorToType(builder, returnOp->getLoc(),
@@ -40,6 +40,91 @@ static Type joinElementTypes(Type lhs, Type rhs) {
   return Type();
 }
 
+// Match a `torch.prim.ListConstruct` of integer constants.
+static bool matchConstantIntList(Value list,
+                                 SmallVectorImpl<int64_t> &elements) {
+  auto listConstruct = list.getDefiningOp<PrimListConstructOp>();
+  if (!listConstruct)
+    return false;
+  for (Value element : listConstruct.elements()) {
+    APInt value;
+    if (!matchPattern(element, m_ConstantInt(&value)))
+      return false;
+    elements.push_back(value.getSExtValue());
+  }
+  return true;
+}
+
+// Match the constant dimensions of `aten.transpose.int` or `aten.permute` on
+// an operand of rank `rank`, as the permutation `dims` of the operand
+// dimensions (dimension i of the result is dimension dims[i] of the operand).
+static bool matchPermutation(Operation *op, int64_t rank,
+                             SmallVectorImpl<int64_t> &dims) {
+  if (auto transpose = dyn_cast<AtenTransposeIntOp>(op)) {
+    APInt dim0, dim1;
+    if (!matchPattern(transpose.dim0(), m_ConstantInt(&dim0)) ||
+        !matchPattern(transpose.dim1(), m_ConstantInt(&dim1)))
+      return false;
+    for (int64_t i = 0; i < rank; i++)
+      dims.push_back(i);
+    int64_t first = dim0.getSExtValue(), second = dim1.getSExtValue();
+    if (first < 0)
+      first += rank;
+    if (second < 0)
+      second += rank;
+    if (first < 0 || first >= rank || second < 0 || second >= rank)
+      return false;
+    std::swap(dims[first], dims[second]);
+    return true;
+  }
+  if (!matchConstantIntList(cast<AtenPermuteOp>(op).dims(), dims) ||
+      static_cast<int64_t>(dims.size()) != rank)
+    return false;
+  SmallVector<bool, 4> seen(rank, false);
+  for (int64_t &dim : dims) {
+    if (dim < 0)
+      dim += rank;
+    if (dim < 0 || dim >= rank || seen[dim])
+      return false;
+    seen[dim] = true;
+  }
+  return true;
+}
+
+// The size of the result of broadcasting two dimensions of sizes `lhs` and
+// `rhs`, assuming that the program doesn't abort.
+static int64_t getBroadcastedSize(int64_t lhs, int64_t rhs) {
+  if (lhs == 1)
+    return rhs;
+  if (rhs == 1)
+    return lhs;
+  // If either size is known, the other one is either equal to it, or 1 (in
+  // which case it broadcasts to it).
+  if (lhs != kUnknownSize)
+    return lhs;
+  return rhs;
+}
+
+// The size of spatial dimension `dim` of the result of a convolution (or
+// other sliding window op without rounding modes) with the given parameters.
+static int64_t getSlidingWindowOutputSize(int64_t inputSize,
+                                          int64_t kernelSize,
+                                          ArrayRef<int64_t> stride,
+                                          ArrayRef<int64_t> padding,
+                                          ArrayRef<int64_t> dilation,
+                                          int dim) {
+  if (inputSize == kUnknownSize || kernelSize == kUnknownSize ||
+      (int)stride.size() <= dim || (int)padding.size() <= dim ||
+      (int)dilation.size() <= dim || stride[dim] <= 0)
+    return kUnknownSize;
+  int64_t numerator =
+      inputSize + 2 * padding[dim] - dilation[dim] * (kernelSize - 1) - 1;
+  // A negative numerator corresponds to an erroneous program.
+  if (numerator < 0)
+    return kUnknownSize;
+  return numerator / stride[dim] + 1;
+}
+
 namespace {
 // Statically known information for a particular Value.
 //
@@ -144,100 +229,222 @@ public:
   ChangeResult
   visitOperation(Operation *op,
                  ArrayRef<LatticeElement<ValueKnowledge> *> operands) final {
-    if (isa<TensorStaticInfoCastOp, CopyTensorOp, AtenTanhOp, AtenBatchNormOp,
-            AtenReluOp>(op)) {
+    if (isa<TensorStaticInfoCastOp, CopyTensorOp>(op)) {
       return getLatticeElement(op->getResult(0)).join(*operands[0]);
     }
+    if (Optional<ValueKnowledge> knowledge =
+            visitShapeFunctionTraits(op, operands)) {
+      return getLatticeElement(op->getResult(0)).join(*knowledge);
+    }
     if (isa<AtenMmOp>(op)) {
       auto &lhs = operands[0]->getValue();
       auto &rhs = operands[1]->getValue();
       auto knowledge =
           ValueKnowledge::getPessimisticValueState(op->getContext());
       knowledge.hasSizes = true;
-      // WARNING: We could be more precise here by calculating the output
-      // shape as "(lhs.shape[0], rhs.shape[1])". However, that is really tricky
-      // at this stage in the compiler because we don't really have many static
-      // guarantees about the input ranks because `aten` ops do dynamic error
-      // checking and safely abort the program. There is nothing preventing us
-      // from (correctly!) statically inferring the shapes of the operands to
-      // shapes that are guaranteed to cause an error at runtime.
-      //
-      // Example: Suppose a user program calls `aten.mm` with two rank-0
-      // operands. The program emits an error when invoked, but when running
-      // this pass, we will (correctly!) infer `lhs.hasSizes && lhs.sizes.size()
-      // == 0 && rhs.hasSizes && rhs.sizes.size() == 0` -- it's not safe to
-      // access `lhs.sizes[0]` / `rhs.sizes[1]`! So when writing this transfer
-      // function, it's not as simple as taking `lhs.sizes[0]` and
-      // `rhs.sizes[1]`, as both of those might read out of bounds of the array.
-      // It would require more complicated logic.
-      //
-      // Just knowing dtypes and ranks is sufficient at this stage
-      // in the compiler. The precise per-dimension size propagation is best
-      // done lower in the stack, such as at the linalg level, where we have
-      // more static guarantees and more structure.
       knowledge.sizes.resize(2, kUnknownSize);
+      // Careful: `aten.mm` does dynamic error checking and safely aborts the
+      // program if the operands are not rank 2, so we can (correctly!) infer
+      // operand ranks that are statically known to cause an error at runtime.
+      // Only read the operand sizes when the ranks are the ones we expect.
+      if (lhs.hasSizes && lhs.sizes.size() == 2 && rhs.hasSizes &&
+          rhs.sizes.size() == 2) {
+        knowledge.sizes[0] = lhs.sizes[0];
+        knowledge.sizes[1] = rhs.sizes[1];
+      }
       // TODO: Investigate promotion rules if element types mismatch.
       // This is conservatively correct, assuming that if both element types are
       // the same, then the result is of that same element type.
       knowledge.dtype = joinElementTypes(lhs.dtype, rhs.dtype);
       return getLatticeElement(op->getResult(0)).join(knowledge);
+    } else if (isa<AtenBmmOp>(op)) {
+      auto &lhs = operands[0]->getValue();
+      auto &rhs = operands[1]->getValue();
+      auto knowledge =
+          ValueKnowledge::getPessimisticValueState(op->getContext());
+      knowledge.hasSizes = true;
+      knowledge.sizes.resize(3, kUnknownSize);
+      // As for `aten.mm`, only read the operand sizes when the ranks are the
+      // ones we expect.
+      if (lhs.hasSizes && lhs.sizes.size() == 3 && rhs.hasSizes &&
+          rhs.sizes.size() == 3) {
+        knowledge.sizes[0] = lhs.sizes[0];
+        knowledge.sizes[1] = lhs.sizes[1];
+        knowledge.sizes[2] = rhs.sizes[2];
+      }
+      knowledge.dtype = joinElementTypes(lhs.dtype, rhs.dtype);
+      return getLatticeElement(op->getResult(0)).join(knowledge);
+    } else if (isa<AtenMatmulOp>(op)) {
+      // The result rank of `aten.matmul` depends on the operand ranks, so the
+      // sizes are only known for the ranks that we lower: [M, K] x [K, N],
+      // [B, M, K] x [B, K, N] and [B, M, K] x [K, N].
+      auto &lhs = operands[0]->getValue();
+      auto &rhs = operands[1]->getValue();
+      auto knowledge =
+          ValueKnowledge::getPessimisticValueState(op->getContext());
+      if (lhs.hasSizes && rhs.hasSizes && rhs.sizes.size() >= 2 &&
+          rhs.sizes.size() <= lhs.sizes.size() && lhs.sizes.size() <= 3 &&
+          (lhs.sizes.size() == 3 || rhs.sizes.size() == 2)) {
+        knowledge.hasSizes = true;
+        knowledge.sizes.assign(lhs.sizes.begin(), lhs.sizes.end() - 1);
+        knowledge.sizes.push_back(rhs.sizes.back());
+      }
+      knowledge.dtype = joinElementTypes(lhs.dtype, rhs.dtype);
+      return getLatticeElement(op->getResult(0)).join(knowledge);
     } else if (isa<AtenLinearOp>(op)) {
       // The output shape is the input shape with the last dimension changed
       // to the weight's output dimension.
       auto knowledge = operands[0]->getValue();
-      if (knowledge.hasSizes && knowledge.sizes.size() > 0)
-        knowledge.sizes[knowledge.sizes.size() - 1] = kUnknownSize;
+      auto &weight = operands[1]->getValue();
+      if (knowledge.hasSizes && knowledge.sizes.size() > 0) {
+        knowledge.sizes[knowledge.sizes.size() - 1] =
+            weight.hasSizes && weight.sizes.size() == 2 ? weight.sizes[0]
+                                                        : kUnknownSize;
+      }
       // TODO: Handle case of bias being None gracefully. Requires a lattice
       // that tracks "None" (torch.optional). See also
       // DerefineOp::getCanonicalizationPatterns for more refinement that needs
       // to be done in this pass.
       knowledge.dtype = joinElementTypes(
-          knowledge.dtype, joinElementTypes(operands[1]->getValue().dtype,
-                                            operands[2]->getValue().dtype));
+          knowledge.dtype,
+          joinElementTypes(weight.dtype, operands[2]->getValue().dtype));
       return getLatticeElement(op->getResult(0)).join(knowledge);
-    } else if (isa<AtenConv2dOp>(op)) {
+    } else if (auto conv = dyn_cast<AtenConv2dOp>(op)) {
+      auto &input = operands[0]->getValue();
+      auto &weight = operands[1]->getValue();
       auto knowledge =
           ValueKnowledge::getPessimisticValueState(op->getContext());
       knowledge.hasSizes = true;
       knowledge.sizes.resize(4, kUnknownSize);
+      // As with `aten.mm`, only read the operand sizes if the ranks are valid.
+      if (input.hasSizes && input.sizes.size() == 4 && weight.hasSizes &&
+          weight.sizes.size() == 4) {
+        knowledge.sizes[0] = input.sizes[0];
+        knowledge.sizes[1] = weight.sizes[0];
+        SmallVector<int64_t, 2> stride, padding, dilation;
+        if (matchConstantIntList(conv.stride(), stride) &&
+            matchConstantIntList(conv.padding(), padding) &&
+            matchConstantIntList(conv.dilation(), dilation)) {
+          for (int i = 0; i < 2; i++) {
+            knowledge.sizes[2 + i] = getSlidingWindowOutputSize(
+                input.sizes[2 + i], weight.sizes[2 + i], stride, padding,
+                dilation, i);
+          }
+        }
+      }
       // Running some experiments in PyTorch, the bias doesn't seem to
       // contribute to the final element type.
-      knowledge.dtype = joinElementTypes(operands[0]->getValue().dtype,
-                                         operands[1]->getValue().dtype);
+      knowledge.dtype = joinElementTypes(input.dtype, weight.dtype);
       return getLatticeElement(op->getResult(0)).join(knowledge);
     } else if (isa<AtenMaxPool2dOp>(op)) {
+      auto &input = operands[0]->getValue();
       auto knowledge =
           ValueKnowledge::getPessimisticValueState(op->getContext());
       knowledge.hasSizes = true;
       knowledge.sizes.resize(4, kUnknownSize);
-      knowledge.dtype = operands[0]->getValue().dtype;
+      // The spatial sizes also depend on `ceil_mode`, so we only propagate the
+      // batch and channel sizes.
+      if (input.hasSizes && input.sizes.size() == 4) {
+        knowledge.sizes[0] = input.sizes[0];
+        knowledge.sizes[1] = input.sizes[1];
+      }
+      knowledge.dtype = input.dtype;
       return getLatticeElement(op->getResult(0)).join(knowledge);
-    } else if (isa<AtenAdaptiveAvgPool2dOp>(op)) {
+    } else if (auto pool = dyn_cast<AtenAdaptiveAvgPool2dOp>(op)) {
       auto input = operands[0]->getValue();
       auto knowledge =
           ValueKnowledge::getPessimisticValueState(op->getContext());
       if (input.hasSizes) {
         knowledge.hasSizes = true;
-        knowledge.sizes.resize(input.sizes.size(), kUnknownSize);
+        knowledge.sizes = input.sizes;
+        // The trailing two dimensions are replaced by `output_size`, and the
+        // leading dimensions are preserved.
+        SmallVector<int64_t, 2> outputSize;
+        if (input.sizes.size() >= 2 &&
+            matchConstantIntList(pool.output_size(), outputSize) &&
+            outputSize.size() == 2) {
+          std::copy(outputSize.begin(), outputSize.end(),
+                    knowledge.sizes.end() - 2);
+        } else {
+          std::fill(knowledge.sizes.end() - std::min<size_t>(
+                                                2, knowledge.sizes.size()),
+                    knowledge.sizes.end(), kUnknownSize);
+        }
       }
       knowledge.dtype = input.dtype;
       return getLatticeElement(op->getResult(0)).join(knowledge);
-    } else if (isa<AtenAddTensorOp>(op)) {
-      // This is a general binary broadcasting shape transfer function.
-      // We currently don't track "size 1" in our lattice, but we might want to.
-      // We could make this more precise as well. But again, as with the other
-      // shape transfer functions, handling the statically-invalid case is
-      // tricky, so we defer that until we need it.
-      auto lhs = operands[0]->getValue();
-      auto rhs = operands[1]->getValue();
+    } else if (isa<AtenSoftmaxIntOp, AtenLogSoftmaxIntOp>(op)) {
+      // The shape is preserved, and so is the dtype unless a `dtype` is
+      // given.
+      auto input = operands[0]->getValue();
       auto knowledge =
           ValueKnowledge::getPessimisticValueState(op->getContext());
-      if (lhs.hasSizes && rhs.hasSizes) {
+      knowledge.hasSizes = input.hasSizes;
+      knowledge.sizes = input.sizes;
+      if (op->getOperand(2).getType().isa<Basicpy::NoneType>())
+        knowledge.dtype = input.dtype;
+      return getLatticeElement(op->getResult(0)).join(knowledge);
+    } else if (isa<AtenEmbeddingOp>(op)) {
+      // Each index is replaced by a row of the weight.
+      auto &weight = operands[0]->getValue();
+      auto &indices = operands[1]->getValue();
+      auto knowledge =
+          ValueKnowledge::getPessimisticValueState(op->getContext());
+      if (indices.hasSizes) {
         knowledge.hasSizes = true;
-        knowledge.sizes.resize(std::max(lhs.sizes.size(), rhs.sizes.size()),
-                               kUnknownSize);
+        knowledge.sizes = indices.sizes;
+        knowledge.sizes.push_back(weight.hasSizes && weight.sizes.size() == 2
+                                      ? weight.sizes[1]
+                                      : kUnknownSize);
+      }
+      knowledge.dtype = weight.dtype;
+      return getLatticeElement(op->getResult(0)).join(knowledge);
+    } else if (auto indexSelect = dyn_cast<AtenIndexSelectOp>(op)) {
+      // The size of dimension `dim` becomes the number of indices.
+      auto &self = operands[0]->getValue();
+      auto &index = operands[2]->getValue();
+      auto knowledge =
+          ValueKnowledge::getPessimisticValueState(op->getContext());
+      APInt dim;
+      if (self.hasSizes &&
+          matchPattern(indexSelect.dim(), m_ConstantInt(&dim))) {
+        int64_t rank = self.sizes.size();
+        int64_t dimValue = dim.getSExtValue();
+        if (dimValue < 0)
+          dimValue += rank;
+        // Careful: the dimension might be out of bounds.
+        if (0 <= dimValue && dimValue < rank) {
+          knowledge.hasSizes = true;
+          knowledge.sizes = self.sizes;
+          knowledge.sizes[dimValue] = kUnknownSize;
+          if (index.hasSizes && index.sizes.size() <= 1)
+            knowledge.sizes[dimValue] =
+                index.sizes.empty() ? 1 : index.sizes[0];
+        }
+      }
+      knowledge.dtype = self.dtype;
+      return getLatticeElement(op->getResult(0)).join(knowledge);
+    } else if (isa<AtenQuantizePerTensorOp, AtenDequantizeSelfOp,
+                   QuantizedLinearOp>(op)) {
+      // The shape is preserved, except for the output features of
+      // `quantized.linear`, which depend on its opaque packed weights.
+      auto input = operands[0]->getValue();
+      auto knowledge =
+          ValueKnowledge::getPessimisticValueState(op->getContext());
+      knowledge.hasSizes = input.hasSizes;
+      knowledge.sizes = input.sizes;
+      APInt dtype;
+      if (isa<QuantizedLinearOp>(op)) {
+        if (!knowledge.sizes.empty())
+          knowledge.sizes.back() = kUnknownSize;
+        knowledge.dtype = input.dtype;
+      } else if (isa<AtenDequantizeSelfOp>(op)) {
+        knowledge.dtype = Float32Type::get(op->getContext());
+      } else if (matchPattern(op->getOperand(3), m_ConstantInt(&dtype)) &&
+                 dtype == 12) {
+        // `ScalarType::QInt8`.
+        knowledge.dtype = QInt8Type::get(op->getContext());
       }
-      knowledge.dtype = joinElementTypes(lhs.dtype, rhs.dtype);
       return getLatticeElement(op->getResult(0)).join(knowledge);
     } else if (auto flatten = dyn_cast<AtenFlattenUsingIntsOp>(op)) {
       APInt startDimAP, endDimAP;
@@ -272,11 +479,155 @@ public:
         }
       }
       return getLatticeElement(op->getResult(0)).join(knowledge);
+    } else if (isa<AtenTransposeIntOp, AtenPermuteOp>(op)) {
+      auto operand = operands[0]->getValue();
+      auto knowledge =
+          ValueKnowledge::getPessimisticValueState(op->getContext());
+      knowledge.dtype = operand.dtype;
+      SmallVector<int64_t, 4> dims;
+      if (operand.hasSizes &&
+          matchPermutation(op, operand.sizes.size(), dims)) {
+        knowledge.hasSizes = true;
+        for (int64_t dim : dims)
+          knowledge.sizes.push_back(operand.sizes[dim]);
+      }
+      return getLatticeElement(op->getResult(0)).join(knowledge);
+    } else if (isa<AtenSliceTensorOp, AtenSelectIntOp>(op)) {
+      // Slicing makes the size along `dim` unknown, and selecting removes
+      // `dim`.
+      auto operand = operands[0]->getValue();
+      auto knowledge =
+          ValueKnowledge::getPessimisticValueState(op->getContext());
+      knowledge.dtype = operand.dtype;
+      APInt dimAP;
+      if (operand.hasSizes &&
+          matchPattern(op->getOperand(1), m_ConstantInt(&dimAP))) {
+        int64_t rank = operand.sizes.size();
+        int64_t dim = dimAP.getSExtValue();
+        if (dim < 0)
+          dim += rank;
+        if (0 <= dim && dim < rank) {
+          knowledge.hasSizes = true;
+          knowledge.sizes = operand.sizes;
+          if (isa<AtenSliceTensorOp>(op))
+            knowledge.sizes[dim] = kUnknownSize;
+          else
+            knowledge.sizes.erase(knowledge.sizes.begin() + dim);
+        }
+      }
+      return getLatticeElement(op->getResult(0)).join(knowledge);
+    } else if (auto cat = dyn_cast<AtenCatOp>(op)) {
+      // The inputs have equal sizes except along `dim`, where the result has
+      // the sum of their sizes. Their knowledge comes from their types, since
+      // the lattice elements of the list elements don't flow into `cat`.
+      auto knowledge =
+          ValueKnowledge::getPessimisticValueState(op->getContext());
+      auto listConstruct = cat.tensors().getDefiningOp<PrimListConstructOp>();
+      APInt dimAP;
+      if (!listConstruct || listConstruct.elements().empty() ||
+          !matchPattern(cat.dim(), m_ConstantInt(&dimAP)))
+        return getLatticeElement(op->getResult(0)).join(knowledge);
+      ValueKnowledge joined =
+          ValueKnowledge::getPessimisticValueState(op->getContext());
+      bool allRanked = true, sameDtypes = true, first = true;
+      int64_t rank = -1;
+      for (Value element : listConstruct.elements()) {
+        auto elementKnowledge =
+            ValueKnowledge::getKnowledgeFromType(element.getType());
+        if (!elementKnowledge.dtype ||
+            (!first && elementKnowledge.dtype != joined.dtype))
+          sameDtypes = false;
+        if (!elementKnowledge.hasSizes ||
+            (rank != -1 && rank != (int64_t)elementKnowledge.sizes.size())) {
+          allRanked = false;
+        } else {
+          rank = elementKnowledge.sizes.size();
+        }
+        if (first)
+          joined = elementKnowledge;
+        else
+          joined = ValueKnowledge::join(joined, elementKnowledge);
+        first = false;
+      }
+      // Inputs of different dtypes are promoted, which isn't modeled here.
+      if (sameDtypes)
+        knowledge.dtype = joined.dtype;
+      int64_t dim = dimAP.getSExtValue();
+      if (allRanked && dim < 0)
+        dim += rank;
+      if (allRanked && 0 <= dim && dim < rank) {
+        knowledge.hasSizes = true;
+        knowledge.sizes = joined.sizes;
+        int64_t dimSize = 0;
+        for (Value element : listConstruct.elements()) {
+          int64_t size =
+              element.getType().cast<BaseTensorType>().getSizes()[dim];
+          if (size == kUnknownSize) {
+            dimSize = kUnknownSize;
+            break;
+          }
+          dimSize += size;
+        }
+        knowledge.sizes[dim] = dimSize;
+      }
+      return getLatticeElement(op->getResult(0)).join(knowledge);
     }
     // Otherwise, this is an unknown operation. Just mark all results as having
     // reached a pessimistic fixpoint.
     return markAllPessimisticFixpoint(op->getResults());
   }
+
+private:
+  // Compute the knowledge for the result of an op from its shape transfer
+  // function traits (see TorchTraits.h), or return None if it has none of
+  // them.
+  Optional<ValueKnowledge> visitShapeFunctionTraits(
+      Operation *op, ArrayRef<LatticeElement<ValueKnowledge> *> operands) {
+    bool sameSizes = op->hasTrait<Torch::OpTrait::SameSizesAsSelf>();
+    bool broadcasts = op->hasTrait<Torch::OpTrait::BroadcastsSizes>();
+    bool sameDtype = op->hasTrait<Torch::OpTrait::SameDtypeAsSelf>();
+    bool promotes = op->hasTrait<Torch::OpTrait::PromotesDtypes>();
+    bool producesBools = op->hasTrait<Torch::OpTrait::ProducesBools>();
+    if (!sameSizes && !broadcasts && !sameDtype && !promotes && !producesBools)
+      return None;
+    auto knowledge =
+        ValueKnowledge::getPessimisticValueState(op->getContext());
+    auto &self = operands[0]->getValue();
+    if (sameSizes) {
+      knowledge.hasSizes = self.hasSizes;
+      knowledge.sizes = self.sizes;
+    } else if (broadcasts) {
+      // Dimensions are aligned from the back. A dimension missing from one
+      // operand, or known to be of size 1, takes the size of the other. As
+      // with the other shape transfer functions, sizes that are statically
+      // known to be incompatible are never read, since the program aborts
+      // dynamically in that case.
+      auto &other = operands[1]->getValue();
+      if (self.hasSizes && other.hasSizes) {
+        knowledge.hasSizes = true;
+        knowledge.sizes.resize(
+            std::max(self.sizes.size(), other.sizes.size()), kUnknownSize);
+        for (int i = 0, e = knowledge.sizes.size(); i != e; i++) {
+          int selfIndex = i - (e - self.sizes.size());
+          int otherIndex = i - (e - other.sizes.size());
+          int64_t selfSize = selfIndex >= 0 ? self.sizes[selfIndex] : 1;
+          int64_t otherSize = otherIndex >= 0 ? other.sizes[otherIndex] : 1;
+          knowledge.sizes[i] = getBroadcastedSize(selfSize, otherSize);
+        }
+      }
+    }
+    if (sameDtype) {
+      knowledge.dtype = self.dtype;
+    } else if (promotes) {
+      // TODO: Model the promotion of different dtypes. This is conservatively
+      // correct, assuming that the promotion of equal dtypes is that dtype.
+      knowledge.dtype =
+          joinElementTypes(self.dtype, operands[1]->getValue().dtype);
+    } else if (producesBools) {
+      knowledge.dtype = IntegerType::get(op->getContext(), 1);
+    }
+    return knowledge;
+  }
 };
 } // namespace
 
@@ -315,7 +666,29 @@ static bool allowsTypeRefinementOrWillBeOtherwiseSafelyRefined(Operation *op) {
   return allowsTypeRefinement(op) || isa<CopyTensorOp>(op);
 }
 
-void optimize(FuncOp func, TypeAnalyzer &analyzer) {
+// Return true if the type of some value in `func` could be refined, that is,
+// if some tensor is not yet known to have static sizes and a dtype.
+static bool hasRefinableTypes(FuncOp func) {
+  auto isRefinable = [](Value v) {
+    auto tensorType = v.getType().dyn_cast<BaseTensorType>();
+    return tensorType &&
+           !(tensorType.areAllSizesKnown() && tensorType.hasDtype());
+  };
+  auto walkResult = func.walk([&](Block *block) {
+    if (llvm::any_of(block->getArguments(), isRefinable))
+      return WalkResult::interrupt();
+    for (Operation &op : *block)
+      if (llvm::any_of(op.getResults(), isRefinable))
+        return WalkResult::interrupt();
+    return WalkResult::advance();
+  });
+  return walkResult.wasInterrupted();
+}
+
+// Rewrite `func` to embed the static information found by `analyzer`.
+// Return true if anything changed.
+static bool optimize(FuncOp func, TypeAnalyzer &analyzer) {
+  bool changed = false;
   func.walk([&](Operation *op) {
     for (Value v : op->getResults()) {
       Type refinedType = getMostRefinedStaticType(v, analyzer);
@@ -343,6 +716,7 @@ void optimize(FuncOp func, TypeAnalyzer &analyzer) {
         };
       }
       if (createStaticInfoCast) {
+        changed = true;
         // Save off the original uses to avoid iterator invalidation issues
         // or other unexpected behavior since we are creating new ops here that
         // use the value.
@@ -379,15 +753,21 @@ void optimize(FuncOp func, TypeAnalyzer &analyzer) {
       }
     }
   });
+  return changed;
 }
 
 namespace {
 class RefineTypesPass : public RefineTypesBase<RefineTypesPass> {
   void runOnOperation() override {
     auto func = getOperation();
+    // Functions whose types are all fully static (such as after a previous
+    // run of this pass on them) don't need to be analyzed again.
+    if (!hasRefinableTypes(func))
+      return markAllAnalysesPreserved();
     TypeAnalyzer analyzer(&getContext());
     analyzer.run(func);
-    optimize(func, analyzer);
+    if (!optimize(func, analyzer))
+      markAllAnalysesPreserved();
   }
 };
 } // namespace
@@ -0,0 +1,56 @@
+//===- ReportOpCosts.cpp -----------------------------------------*- C++-*-===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+
+#include "mlir/IR/BuiltinOps.h"
+#include "npcomp/Dialect/Torch/IR/TorchOps.h"
+#include "npcomp/Dialect/Torch/Transforms/Passes.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+using namespace mlir::NPCOMP::Torch;
+
+// Prints `cost` to `diag`, or "?" if it is unknown.
+static void printCost(InFlightDiagnostic &diag, Optional<int64_t> cost) {
+  if (cost)
+    diag << *cost;
+  else
+    diag << "?";
+}
+
+namespace {
+class ReportOpCostsPass : public ReportOpCostsBase<ReportOpCostsPass> {
+  void runOnOperation() override {
+    FuncOp func = getOperation();
+    Optional<int64_t> totalFlops = 0, totalBytes = 0;
+    func.walk([&](CostModelOpInterface op) {
+      Optional<int64_t> flops = op.getFlops();
+      Optional<int64_t> bytes = op.getBytesMoved();
+      InFlightDiagnostic diag = op->emitRemark("flops: ");
+      printCost(diag, flops);
+      diag << ", bytes: ";
+      printCost(diag, bytes);
+      totalFlops = totalFlops && flops ? *totalFlops + *flops
+                                       : Optional<int64_t>();
+      totalBytes = totalBytes && bytes ? *totalBytes + *bytes
+                                       : Optional<int64_t>();
+    });
+    InFlightDiagnostic diag = func.emitRemark("total flops: ");
+    printCost(diag, totalFlops);
+    diag << ", total bytes: ";
+    printCost(diag, totalBytes);
+    markAllAnalysesPreserved();
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::Torch::createReportOpCostsPass() {
+  return std::make_unique<ReportOpCostsPass>();
+}
@@ -0,0 +1,65 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Applies the configurations tuned by the autotuner (see Autotuner.h) to the
+// matmuls and convolutions of a module, so that compiling a model reuses the
+// lowering measured to be fastest for each of its op shapes instead of the
+// heuristics of the pipeline.
+//
+// Each tunable op whose signature is in the database gets the tuned
+// configuration as its `refback.tuning` attribute (see Tuning.h), which
+// LowerConvolutions, FuseLinalgEpilogues and TileLinalgOps honor. Ops that
+// already have one (e.g. set by hand) keep it.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+#include "npcomp/RefBackend/Tuning.h"
+
+#include "mlir/Dialect/Linalg/IR/LinalgOps.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+namespace {
+class ApplyTuningDatabase
+    : public ApplyTuningDatabaseBase<ApplyTuningDatabase> {
+public:
+  ApplyTuningDatabase() = default;
+  ApplyTuningDatabase(StringRef path) { database = path.str(); }
+
+  void runOnOperation() override {
+    ModuleOp module = getOperation();
+    if (database.empty())
+      return;
+    llvm::Expected<TuningDatabase> tuned = TuningDatabase::load(database);
+    if (!tuned) {
+      module.emitError() << llvm::toString(tuned.takeError());
+      return signalPassFailure();
+    }
+    module.walk([&](Operation *op) {
+      if (!isTunableOp(op) || op->hasAttr(kTuningAttrName))
+        return;
+      if (const TuningDatabase::Entry *entry =
+              tuned->lookup(getTuningSignature(op)))
+        setTuningConfig(op, entry->config);
+    });
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<ModuleOp>>
+mlir::NPCOMP::createApplyTuningDatabasePass() {
+  return std::make_unique<ApplyTuningDatabase>();
+}
+
+std::unique_ptr<OperationPass<ModuleOp>>
+mlir::NPCOMP::createApplyTuningDatabasePass(StringRef path) {
+  return std::make_unique<ApplyTuningDatabase>(path);
+}
@@ -0,0 +1,318 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Replaces the `math` ops on f32 scalars and vectors by polynomial
+// approximations built from arithmetic std ops.
+//
+// The LLVM lowering turns `math.exp` and `math.log` into libm calls, one per
+// element (vectors are scalarized), and `math.tanh` into a computation with
+// a division and a libm call per element (see populateExpandTanhPattern).
+// Activations and softmax are then bound by libm. The approximations are
+// branch-free, so they vectorize along with the ops around them.
+//
+// Each function has approximations of increasing cost and accuracy, whose
+// maximum errors in ULPs (measured on f32 inputs over the whole range of the
+// function, with some margin) are given below. The cheapest approximation
+// within the `max-ulp` budget is used; the ops without one are left as they
+// are. The approximations handle infinities, NaNs and subnormals, but not the
+// sign of NaNs.
+//
+// With `use-fma`, the polynomials are evaluated with fused multiply-adds,
+// which halves their cost on targets with FMA units (such as every AArch64
+// CPU, and x86 CPUs with the FMA extension) and only makes them more
+// accurate. Without FMA units, each `fmaf` would become a libm call.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+
+#include "mlir/Dialect/Math/IR/Math.h"
+#include "mlir/Dialect/StandardOps/IR/Ops.h"
+#include "mlir/Transforms/GreedyPatternRewriteDriver.h"
+
+#include <limits>
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+// Maximum errors of the approximations, in ULPs.
+static constexpr unsigned kExpPreciseUlp = 2;
+static constexpr unsigned kExpFastUlp = 1024;
+static constexpr unsigned kTanhPreciseUlp = 2;
+static constexpr unsigned kTanhFastUlp = 8;
+static constexpr unsigned kLogUlp = 1;
+
+static constexpr float kInfinity = std::numeric_limits<float>::infinity();
+static constexpr float kNaN = std::numeric_limits<float>::quiet_NaN();
+static constexpr float kMinNormal = std::numeric_limits<float>::min();
+
+// Cody-Waite split of ln(2): kLn2Hi has few enough significant bits that
+// n * kLn2Hi is exact for the exponents n of f32.
+static constexpr float kLog2E = 1.44269504088896341f;
+static constexpr float kLn2Hi = 0.693359375f;
+static constexpr float kLn2Lo = -2.12194440e-4f;
+
+// Polynomials, with the highest degree coefficient first.
+// exp(r) = 1 + r + r^2 * P(r) on [-ln(2)/2, ln(2)/2] (Cephes).
+static constexpr float kExpPrecise[] = {
+    1.9875691500e-4f, 1.3981999507e-3f, 8.3334519073e-3f,
+    4.1665795894e-2f, 1.6666665459e-1f, 5.0000001201e-1f};
+// The Taylor polynomial of degree 4.
+static constexpr float kExpFast[] = {1.0f / 24, 1.0f / 6, 0.5f};
+// tanh(x) = x + x^3 * P(x^2) on [-0.625, 0.625] (Cephes).
+static constexpr float kTanhSmall[] = {-5.70498872745e-3f, 2.06390887954e-2f,
+                                       -5.37397155531e-2f, 1.33314422036e-1f,
+                                       -3.33332819422e-1f};
+// tanh(x) = x * P(x^2) / Q(x^2) on [-7.9, 7.9] (Eigen).
+static constexpr float kTanhNumerator[] = {
+    -2.76076847742355e-16f, 2.00018790482477e-13f, -8.60467152213735e-11f,
+    5.12229709037114e-08f,  1.48572235717979e-05f, 6.37261928875436e-04f,
+    4.89352455891786e-03f};
+static constexpr float kTanhDenominator[] = {
+    1.19825839466702e-06f, 1.18534705686654e-04f, 2.26843463243900e-03f,
+    4.89352518554385e-03f};
+// log(1 + x) = x - x^2 / 2 + x^3 * P(x) on [sqrt(1/2) - 1, sqrt(2) - 1]
+// (Cephes).
+static constexpr float kLog[] = {
+    7.0376836292e-2f,  -1.1514610310e-1f, 1.1676998740e-1f,
+    -1.2420140846e-1f, 1.4249322787e-1f,  -1.6668057665e-1f,
+    2.0000714765e-1f,  -2.4999993993e-1f, 3.3333331174e-1f};
+
+// Returns true if `type` is f32 or a vector of f32.
+static bool isF32Like(Type type) {
+  if (auto vectorType = type.dyn_cast<VectorType>())
+    type = vectorType.getElementType();
+  return type.isF32();
+}
+
+namespace {
+// Builds the approximations on values of an f32 type, splatting the
+// constants to vectors for vector types.
+class ApproximationBuilder {
+public:
+  ApproximationBuilder(OpBuilder &b, Location loc, Type floatType,
+                       bool useFMA)
+      : b(b), loc(loc), floatType(floatType), useFMA(useFMA) {
+    intType = b.getI32Type();
+    if (auto vectorType = floatType.dyn_cast<VectorType>())
+      intType = VectorType::get(vectorType.getShape(), intType);
+  }
+
+  Value f32(float value) {
+    return constant(b.getF32FloatAttr(value), floatType);
+  }
+  Value i32(int32_t value) {
+    return constant(b.getI32IntegerAttr(value), intType);
+  }
+
+  Value add(Value lhs, Value rhs) { return b.create<AddFOp>(loc, lhs, rhs); }
+  Value sub(Value lhs, Value rhs) { return b.create<SubFOp>(loc, lhs, rhs); }
+  Value mul(Value lhs, Value rhs) { return b.create<MulFOp>(loc, lhs, rhs); }
+  Value div(Value lhs, Value rhs) { return b.create<DivFOp>(loc, lhs, rhs); }
+  Value cmp(CmpFPredicate predicate, Value lhs, Value rhs) {
+    return b.create<CmpFOp>(loc, predicate, lhs, rhs);
+  }
+  Value select(Value condition, Value lhs, Value rhs) {
+    return b.create<SelectOp>(loc, condition, lhs, rhs);
+  }
+  Value clamp(Value x, float lower, float upper) {
+    x = select(cmp(CmpFPredicate::OLT, x, f32(lower)), f32(lower), x);
+    return select(cmp(CmpFPredicate::OGT, x, f32(upper)), f32(upper), x);
+  }
+
+  // Evaluates the polynomial with the given coefficients at `x`.
+  Value polynomial(Value x, ArrayRef<float> coefficients) {
+    Value result = f32(coefficients.front());
+    for (float coefficient : coefficients.drop_front()) {
+      if (useFMA)
+        result = b.create<FmaFOp>(loc, result, x, f32(coefficient));
+      else
+        result = add(mul(result, x), f32(coefficient));
+    }
+    return result;
+  }
+
+  // Returns 2^n for the i32 `n` in [-126, 127].
+  Value exp2(Value n) {
+    Value bits = b.create<ShiftLeftOp>(loc, b.create<AddIOp>(loc, n, i32(127)),
+                                       i32(23));
+    return b.create<BitcastOp>(loc, bits, floatType);
+  }
+
+  Value exp(Value x, ArrayRef<float> coefficients) {
+    // exp(x) = 2^n * exp(r) with n = round(x / ln(2)) and r = x - n * ln(2)
+    // in [-ln(2)/2, ln(2)/2]. Below the clamp, the result is 0 anyway.
+    Value clamped = clamp(x, -104.0f, 88.7228394f);
+    Value n =
+        b.create<FloorFOp>(loc, add(mul(clamped, f32(kLog2E)), f32(0.5f)));
+    Value r = sub(sub(clamped, mul(n, f32(kLn2Hi))), mul(n, f32(kLn2Lo)));
+    Value result = add(add(mul(polynomial(r, coefficients), mul(r, r)), r),
+                       f32(1.0f));
+    // n is in [-150, 128]: scale in two steps, which reach the subnormals and
+    // the largest finite values.
+    Value exponent = b.create<FPToSIOp>(loc, n, intType);
+    Value half = b.create<SignedShiftRightOp>(loc, exponent, i32(1));
+    Value otherHalf = b.create<SubIOp>(loc, exponent, half);
+    result = mul(mul(result, exp2(half)), exp2(otherHalf));
+    Value overflows = cmp(CmpFPredicate::OGT, x, f32(88.7228394f));
+    result = select(overflows, f32(kInfinity), result);
+    return select(cmp(CmpFPredicate::UNO, x, x), x, result);
+  }
+
+  Value tanhPrecise(Value x) {
+    Value abs = b.create<AbsFOp>(loc, x);
+    Value square = mul(x, x);
+    Value small = add(x, mul(mul(x, square), polynomial(square, kTanhSmall)));
+    // tanh(|x|) = 1 - 2 / (exp(2|x|) + 1), which is 1 when the exp overflows.
+    Value expTwice = exp(add(abs, abs), kExpPrecise);
+    Value large = sub(f32(1.0f), div(f32(2.0f), add(expTwice, f32(1.0f))));
+    large = b.create<CopySignOp>(loc, large, x);
+    // This also forwards NaNs, which the small case propagates.
+    return select(cmp(CmpFPredicate::OGE, abs, f32(0.625f)), large, small);
+  }
+
+  Value tanhFast(Value x) {
+    // tanh(x) rounds to +-1 outside of the clamp, and to x close to 0.
+    Value clamped = clamp(x, -7.90531111f, 7.90531111f);
+    Value square = mul(clamped, clamped);
+    Value result = div(mul(clamped, polynomial(square, kTanhNumerator)),
+                       polynomial(square, kTanhDenominator));
+    Value isTiny = cmp(CmpFPredicate::OLT, b.create<AbsFOp>(loc, x),
+                       f32(0.0004f));
+    result = select(isTiny, x, result);
+    return select(cmp(CmpFPredicate::UNO, x, x), x, result);
+  }
+
+  Value log(Value x) {
+    // Scale subnormals to normal numbers, which have an exponent field.
+    Value isSubnormal = cmp(CmpFPredicate::OLT, x, f32(kMinNormal));
+    Value normal = select(isSubnormal, mul(x, f32(8388608.0f)), x);
+    // log(x) = e * ln(2) + log(m) with x = m * 2^e and m in
+    // [sqrt(1/2), sqrt(2)).
+    Value bits = b.create<BitcastOp>(loc, normal, intType);
+    Value biasedExponent = b.create<SignedShiftRightOp>(loc, bits, i32(23));
+    Value exponent = b.create<SubIOp>(
+        loc, biasedExponent, select(isSubnormal, i32(126 + 23), i32(126)));
+    // m in [0.5, 1), with the exponent field of 0.5. The sign of negative
+    // inputs is dropped, they are NaNs anyway.
+    Value m = b.create<BitcastOp>(
+        loc,
+        b.create<OrOp>(loc, b.create<AndOp>(loc, bits, i32(0x007fffff)),
+                       i32(0x3f000000)),
+        floatType);
+    Value isBelowSqrtHalf =
+        cmp(CmpFPredicate::OLT, m, f32(0.707106781186547524f));
+    Value e = b.create<SIToFPOp>(loc, exponent, floatType);
+    e = select(isBelowSqrtHalf, sub(e, f32(1.0f)), e);
+    Value y = sub(select(isBelowSqrtHalf, add(m, m), m), f32(1.0f));
+    Value square = mul(y, y);
+    Value result = mul(mul(y, square), polynomial(y, kLog));
+    result = add(result, mul(e, f32(kLn2Lo)));
+    result = sub(result, mul(f32(0.5f), square));
+    result = add(add(y, result), mul(e, f32(kLn2Hi)));
+    // log(+inf) = +inf, log(0) = -inf, log(x < 0) = NaN and log(NaN) = NaN.
+    result = select(cmp(CmpFPredicate::OEQ, x, f32(kInfinity)), x, result);
+    result = select(cmp(CmpFPredicate::OEQ, x, f32(0.0f)), f32(-kInfinity),
+                    result);
+    return select(cmp(CmpFPredicate::ULT, x, f32(0.0f)), f32(kNaN), result);
+  }
+
+private:
+  Value constant(Attribute scalar, Type type) {
+    if (auto vectorType = type.dyn_cast<VectorType>())
+      return b.create<ConstantOp>(loc,
+                                  SplatElementsAttr::get(vectorType, scalar));
+    return b.create<ConstantOp>(loc, scalar);
+  }
+
+  OpBuilder &b;
+  Location loc;
+  Type floatType;
+  Type intType;
+  bool useFMA;
+};
+} // namespace
+
+// Returns the cheapest approximation of the math `op` within `maxUlp`, or null
+// if there is none.
+static Value approximate(ApproximationBuilder &b, Operation *op,
+                         unsigned maxUlp) {
+  Value x = op->getOperand(0);
+  if (isa<math::ExpOp>(op)) {
+    if (maxUlp >= kExpFastUlp)
+      return b.exp(x, kExpFast);
+    if (maxUlp >= kExpPreciseUlp)
+      return b.exp(x, kExpPrecise);
+  } else if (isa<math::TanhOp>(op)) {
+    if (maxUlp >= kTanhFastUlp)
+      return b.tanhFast(x);
+    if (maxUlp >= kTanhPreciseUlp)
+      return b.tanhPrecise(x);
+  } else if (isa<math::LogOp>(op)) {
+    if (maxUlp >= kLogUlp)
+      return b.log(x);
+  }
+  return nullptr;
+}
+
+namespace {
+template <typename OpTy>
+class ApproximateUnaryOp : public OpRewritePattern<OpTy> {
+public:
+  ApproximateUnaryOp(MLIRContext *context, unsigned maxUlp, bool useFMA)
+      : OpRewritePattern<OpTy>(context), maxUlp(maxUlp), useFMA(useFMA) {}
+
+  LogicalResult matchAndRewrite(OpTy op,
+                                PatternRewriter &rewriter) const override {
+    Type type = op.getType();
+    if (!isF32Like(type))
+      return failure();
+    ApproximationBuilder b(rewriter, op.getLoc(), type, useFMA);
+    Value approximation = approximate(b, op, maxUlp);
+    if (!approximation)
+      return failure();
+    rewriter.replaceOp(op, approximation);
+    return success();
+  }
+
+private:
+  unsigned maxUlp;
+  bool useFMA;
+};
+
+class ApproximateMath : public ApproximateMathBase<ApproximateMath> {
+public:
+  ApproximateMath() = default;
+  ApproximateMath(unsigned ulp, bool fma) {
+    maxUlp = ulp;
+    useFMA = fma;
+  }
+
+  void runOnOperation() override {
+    if (maxUlp == 0)
+      return;
+    auto *context = &getContext();
+    RewritePatternSet patterns(context);
+    patterns.add<ApproximateUnaryOp<math::ExpOp>,
+                 ApproximateUnaryOp<math::LogOp>,
+                 ApproximateUnaryOp<math::TanhOp>>(context, maxUlp, useFMA);
+    (void)applyPatternsAndFoldGreedily(getOperation(), std::move(patterns));
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createApproximateMathPass() {
+  return std::make_unique<ApproximateMath>();
+}
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createApproximateMathPass(unsigned maxUlp, bool useFMA) {
+  return std::make_unique<ApproximateMath>(maxUlp, useFMA);
+}
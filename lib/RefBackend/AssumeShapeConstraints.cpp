@@ -0,0 +1,63 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Removes the runtime shape checks of functions whose callers are trusted to
+// pass inputs of consistent shapes (see the `trusted-inputs` option of the
+// RefBackend pipeline).
+//
+// The lowering of each TCF op emits `shape.cstr_*` constraints on the shapes
+// of its operands, which ConvertShapeConstraints expands to `assert`s (and
+// then `refbackrt.abort_if`s), and computes its result in a `shape.assuming`
+// region of their witnesses. Here every constraint is assumed to hold:
+//   %w = shape.cstr_broadcastable %a, %b : tensor<?xindex>, tensor<?xindex>
+// becomes
+//   %w = shape.const_witness true
+// so that canonicalization inlines the `shape.assuming` regions, and the
+// extents only compared by the constraints become dead.
+//
+// The runtime still checks the element types, ranks and static extents of
+// the inputs against the signature of the function; only the relations
+// between dynamic extents are trusted.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+
+#include "mlir/Dialect/Shape/IR/Shape.h"
+#include "mlir/Dialect/StandardOps/IR/Ops.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+namespace {
+class AssumeShapeConstraints
+    : public AssumeShapeConstraintsBase<AssumeShapeConstraints> {
+  void runOnOperation() override {
+    SmallVector<Operation *, 16> checks;
+    getOperation().walk([&](Operation *op) {
+      if (isa<shape::CstrBroadcastableOp, shape::CstrEqOp,
+              shape::CstrRequireOp, AssertOp>(op))
+        checks.push_back(op);
+    });
+    for (Operation *op : checks) {
+      if (op->getNumResults() != 0) {
+        OpBuilder builder(op);
+        op->replaceAllUsesWith(builder.create<shape::ConstWitnessOp>(
+            op->getLoc(), /*passing=*/true));
+      }
+      op->erase();
+    }
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createAssumeShapeConstraintsPass() {
+  return std::make_unique<AssumeShapeConstraints>();
+}
@@ -0,0 +1,110 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Controls over, and reports on, the compile-time cost of npcomp pass
+// pipelines.
+//
+// The memory report attributes to each pass the growth of the heap (as
+// reported by malloc) while it runs, which mostly measures the IR it creates.
+// Passes running concurrently on different functions see each other's
+// allocations, so the per-pass numbers are only exact for single-threaded
+// compilation. The peak is the largest heap usage at the end of any pass.
+//
+//===----------------------------------------------------------------------===//
+
+#include "npcomp/RefBackend/RefBackend.h"
+
+#include "mlir/Pass/PassInstrumentation.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Parallel.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/Threading.h"
+
+#include <mutex>
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+void mlir::NPCOMP::setNumCompileThreads(MLIRContext &context,
+                                        unsigned numThreads) {
+  if (numThreads == 1) {
+    context.disableMultithreading();
+    return;
+  }
+  context.enableMultithreading();
+  // 0 requests one thread per hardware thread.
+  llvm::parallel::strategy = llvm::hardware_concurrency(numThreads);
+}
+
+namespace {
+class PassMemoryInstrumentation : public PassInstrumentation {
+public:
+  ~PassMemoryInstrumentation() override { print(llvm::errs()); }
+
+  void runBeforePass(Pass *pass, Operation *op) override {
+    size_t usage = llvm::sys::Process::GetMallocUsage();
+    std::lock_guard<std::mutex> lock(mutex);
+    startUsage[{llvm::get_threadid(), pass}] = usage;
+  }
+  void runAfterPass(Pass *pass, Operation *op) override { recordRun(pass); }
+  void runAfterPassFailed(Pass *pass, Operation *op) override {
+    recordRun(pass);
+  }
+
+private:
+  struct PassRecord {
+    int64_t growth = 0;
+    unsigned numRuns = 0;
+  };
+
+  void recordRun(Pass *pass) {
+    size_t usage = llvm::sys::Process::GetMallocUsage();
+    std::lock_guard<std::mutex> lock(mutex);
+    auto start = startUsage.find({llvm::get_threadid(), pass});
+    if (start == startUsage.end())
+      return;
+    // Pass adaptors, which run nested pipelines, have no argument. Their
+    // growth includes that of the passes they run.
+    StringRef name = pass->getArgument();
+    PassRecord &record = records[name.empty() ? pass->getName() : name];
+    record.growth += static_cast<int64_t>(usage) -
+                     static_cast<int64_t>(start->second);
+    record.numRuns++;
+    peakUsage = std::max(peakUsage, usage);
+    startUsage.erase(start);
+  }
+
+  void print(llvm::raw_ostream &os) {
+    if (records.empty())
+      return;
+    os << "===" << std::string(73, '-') << "===\n"
+       << "                          ... Pass memory report ...\n"
+       << "===" << std::string(73, '-') << "===\n";
+    os << llvm::format("  Peak heap usage after a pass: %.1f MiB\n\n",
+                       peakUsage / (1024.0 * 1024.0));
+    os << "  Heap growth (KiB)   Runs  Name\n";
+    for (auto &entry : records)
+      os << llvm::format("  %17.1f %6u  ", entry.second.growth / 1024.0,
+                         entry.second.numRuns)
+         << entry.first << "\n";
+    os.flush();
+  }
+
+  std::mutex mutex;
+  DenseMap<std::pair<uint64_t, Pass *>, size_t> startUsage;
+  // In the order the passes first finished running.
+  llvm::MapVector<StringRef, PassRecord> records;
+  size_t peakUsage = 0;
+};
+} // namespace
+
+void mlir::NPCOMP::enableCompileTimeReport(PassManager &pm) {
+  pm.enableTiming();
+  pm.addInstrumentation(std::make_unique<PassMemoryInstrumentation>());
+}
@@ -0,0 +1,128 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Rewrites `tcp.broadcast_to` ops whose broadcast dimensions are known
+// statically into a `linalg.generic` copy that reads its operand through a
+// broadcasting indexing map:
+// - dimensions added by the broadcast (the leading ones) are dropped from the
+//   map,
+// - operand dimensions of static size 1 are read at index 0,
+// - the other static operand dimensions, and the dynamic ones that
+//   ShapeEquivalence proves equal to the result dimension they match, are
+//   read along that dimension.
+// Broadcasts that turn out to not broadcast anything are removed.
+//
+// The elementwise fusion that follows merges these copies into their
+// elementwise consumers, which then read the operand (say, the bias vector of
+// a bias add) through the broadcasting map, instead of reading a buffer that
+// the bufferization of `tcp.broadcast_to` would fill with the broadcast
+// result.
+//
+// Other operand dimensions of dynamic size might or might not be broadcast
+// at runtime, which an indexing map can't express, so ops with such
+// dimensions are left to the bufferization of `tcp.broadcast_to`.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+
+#include "mlir/Dialect/Linalg/IR/LinalgOps.h"
+#include "mlir/Dialect/StandardOps/IR/Ops.h"
+#include "npcomp/Dialect/TCP/IR/TCPOps.h"
+#include "npcomp/RefBackend/ShapeEquivalence.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+// Returns the indexing map reading the operand of `op` for each element of
+// its result, or a null map if it depends on dynamic sizes.
+static AffineMap getBroadcastingMap(tcp::BroadcastToOp op,
+                                    ShapeEquivalence &shapes) {
+  auto inputType = op.operand().getType().dyn_cast<RankedTensorType>();
+  auto resultType = op.getType().cast<RankedTensorType>();
+  if (!inputType)
+    return AffineMap();
+  int64_t rankDiff = resultType.getRank() - inputType.getRank();
+  if (rankDiff < 0)
+    return AffineMap();
+  MLIRContext *context = op.getContext();
+  SmallVector<AffineExpr, 4> exprs;
+  for (int64_t i = 0, e = inputType.getRank(); i < e; i++) {
+    if (inputType.getDimSize(i) == 1)
+      exprs.push_back(getAffineConstantExpr(0, context));
+    else if (!inputType.isDynamicDim(i) ||
+             shapes.areDimsEqual(op.operand(), i, op.getResult(),
+                                 rankDiff + i))
+      exprs.push_back(getAffineDimExpr(rankDiff + i, context));
+    else
+      return AffineMap();
+  }
+  return AffineMap::get(resultType.getRank(), 0, exprs, context);
+}
+
+static void convertToLinalg(tcp::BroadcastToOp op, AffineMap inputMap) {
+  OpBuilder b(op);
+  Location loc = op.getLoc();
+  auto resultType = op.getType().cast<RankedTensorType>();
+  if (inputMap.isIdentity()) {
+    Value result = op.operand();
+    if (result.getType() != resultType)
+      result = b.create<tensor::CastOp>(loc, resultType, result);
+    op.replaceAllUsesWith(result);
+    op.erase();
+    return;
+  }
+  SmallVector<Value, 4> dynamicSizes;
+  for (int64_t i = 0, e = resultType.getRank(); i < e; i++) {
+    if (!resultType.isDynamicDim(i))
+      continue;
+    Value index = b.create<ConstantIndexOp>(loc, i);
+    dynamicSizes.push_back(
+        b.create<tensor::ExtractOp>(loc, op.shape(), ValueRange({index})));
+  }
+  Value init = b.create<linalg::InitTensorOp>(
+      loc, dynamicSizes, resultType.getShape(), resultType.getElementType());
+  SmallVector<AffineMap, 2> indexingMaps = {
+      inputMap,
+      AffineMap::getMultiDimIdentityMap(resultType.getRank(),
+                                        op.getContext())};
+  SmallVector<StringRef, 4> iteratorTypes(resultType.getRank(),
+                                          getParallelIteratorTypeName());
+  Value result =
+      b.create<linalg::GenericOp>(
+           loc, TypeRange(resultType), op.operand(), init, indexingMaps,
+           iteratorTypes,
+           [](OpBuilder &b, Location loc, ValueRange args) {
+             b.create<linalg::YieldOp>(loc, args[0]);
+           })
+          ->getResult(0);
+  op.replaceAllUsesWith(result);
+  op.erase();
+}
+
+namespace {
+class ConvertBroadcastToToLinalg
+    : public ConvertBroadcastToToLinalgBase<ConvertBroadcastToToLinalg> {
+  void runOnOperation() override {
+    ShapeEquivalence shapes(getOperation());
+    SmallVector<std::pair<tcp::BroadcastToOp, AffineMap>, 4> broadcasts;
+    getOperation().walk([&](tcp::BroadcastToOp op) {
+      if (AffineMap map = getBroadcastingMap(op, shapes))
+        broadcasts.emplace_back(op, map);
+    });
+    for (auto &broadcast : broadcasts)
+      convertToLinalg(broadcast.first, broadcast.second);
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createConvertBroadcastToToLinalgPass() {
+  return std::make_unique<ConvertBroadcastToToLinalg>();
+}
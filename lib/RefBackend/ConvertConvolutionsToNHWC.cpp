@@ -0,0 +1,156 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Computes `linalg.conv_2d_nchw` ops on tensors in the NHWC layout (with an
+// HWCF filter), where the output channels are the innermost loop and the
+// innermost dimension of both the filter and the output, so that the inner
+// loop is contiguous and vectorizes.
+//
+// Each convolution is rewritten to a transpose of its input and filter to
+// NHWC/HWCF, the convolution in NHWC as a `linalg.generic`, and a transpose of
+// the result back to NCHW (accumulated into the original output). All the
+// transposes are plain elementwise `linalg.generic`s, so:
+// - transposes of constant filters are folded by FoldConstantLinalgOps,
+// - elementwise fusion merges the transpose back to NCHW, any elementwise
+//   ops following the convolution (bias adds, activations) and the transpose
+//   to NHWC of the next convolution, so that the activations between
+//   convolutions stay in NHWC,
+// which leaves transposes only where the data enters or leaves the function.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+
+#include "mlir/Dialect/Linalg/IR/LinalgOps.h"
+#include "mlir/Dialect/MemRef/IR/MemRef.h"
+#include "mlir/Dialect/StandardOps/IR/Ops.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+// Creates an init tensor with dimension i of size dimension `permutation[i]`
+// of `value`.
+static Value createPermutedInitTensor(OpBuilder &b, Location loc, Value value,
+                                      ArrayRef<unsigned> permutation) {
+  auto type = value.getType().cast<RankedTensorType>();
+  SmallVector<int64_t, 4> shape;
+  SmallVector<Value, 4> dynamicSizes;
+  for (unsigned dim : permutation) {
+    shape.push_back(type.getDimSize(dim));
+    if (type.isDynamicDim(dim))
+      dynamicSizes.push_back(b.create<memref::DimOp>(loc, value, dim));
+  }
+  return b.create<linalg::InitTensorOp>(loc, dynamicSizes, shape,
+                                        type.getElementType());
+}
+
+// Returns `value` transposed so that dimension i of the result is dimension
+// `permutation[i]` of `value`.
+static Value createTranspose(OpBuilder &b, Location loc, Value value,
+                             ArrayRef<unsigned> permutation) {
+  MLIRContext *context = b.getContext();
+  Value init = createPermutedInitTensor(b, loc, value, permutation);
+  SmallVector<AffineMap, 2> indexingMaps = {
+      inversePermutation(AffineMap::getPermutationMap(permutation, context)),
+      AffineMap::getMultiDimIdentityMap(permutation.size(), context)};
+  SmallVector<StringRef, 4> iteratorTypes(permutation.size(),
+                                          getParallelIteratorTypeName());
+  return b
+      .create<linalg::GenericOp>(
+          loc, TypeRange(init.getType()), value, init, indexingMaps,
+          iteratorTypes,
+          [](OpBuilder &b, Location loc, ValueRange args) {
+            b.create<linalg::YieldOp>(loc, args[0]);
+          })
+      ->getResult(0);
+}
+
+static void convertToNHWC(linalg::ConvNCHWOp op) {
+  OpBuilder b(op);
+  Location loc = op.getLoc();
+  MLIRContext *context = op.getContext();
+  Value init = op.getOperand(2);
+  Type elementType = init.getType().cast<ShapedType>().getElementType();
+  const unsigned nchwToNHWC[] = {0, 2, 3, 1};
+  const unsigned fchwToHWCF[] = {2, 3, 1, 0};
+  Value input = createTranspose(b, loc, op.getOperand(0), nchwToNHWC);
+  Value filter = createTranspose(b, loc, op.getOperand(1), fchwToHWCF);
+  Value zero = b.create<ConstantOp>(loc, b.getZeroAttr(elementType));
+  Value output = b.create<linalg::FillOp>(
+                      loc, createPermutedInitTensor(b, loc, init, nchwToNHWC),
+                      zero)
+                     .getResult(0);
+
+  // Loops (n, oh, ow, kh, kw, c, f), with the output channels innermost.
+  AffineExpr n, oh, ow, kh, kw, c, f;
+  bindDims(context, n, oh, ow, kh, kw, c, f);
+  SmallVector<AffineMap, 3> convMaps = {
+      AffineMap::get(7, 0, {n, oh + kh, ow + kw, c}, context),
+      AffineMap::get(7, 0, {kh, kw, c, f}, context),
+      AffineMap::get(7, 0, {n, oh, ow, f}, context)};
+  StringRef parallel = getParallelIteratorTypeName();
+  StringRef reduction = getReductionIteratorTypeName();
+  SmallVector<StringRef, 7> convIteratorTypes = {
+      parallel, parallel, parallel, reduction, reduction, reduction, parallel};
+  Value conv =
+      b.create<linalg::GenericOp>(
+           loc, TypeRange(output.getType()), ValueRange({input, filter}),
+           output, convMaps, convIteratorTypes,
+           [](OpBuilder &b, Location loc, ValueRange args) {
+             Value product = b.create<MulFOp>(loc, args[0], args[1]);
+             b.create<linalg::YieldOp>(
+                 loc, b.create<AddFOp>(loc, args[2], product));
+           })
+          ->getResult(0);
+
+  // Accumulate the result into the original output, transposing it back.
+  bindDims(context, n, f, oh, ow);
+  SmallVector<AffineMap, 2> resultMaps = {
+      AffineMap::get(4, 0, {n, oh, ow, f}, context),
+      AffineMap::getMultiDimIdentityMap(4, context)};
+  SmallVector<StringRef, 4> resultIteratorTypes(4, parallel);
+  Value result =
+      b.create<linalg::GenericOp>(
+           loc, op->getResultTypes(), conv, init, resultMaps,
+           resultIteratorTypes,
+           [](OpBuilder &b, Location loc, ValueRange args) {
+             b.create<linalg::YieldOp>(
+                 loc, b.create<AddFOp>(loc, args[1], args[0]));
+           })
+          ->getResult(0);
+  op->getResult(0).replaceAllUsesWith(result);
+  op.erase();
+}
+
+namespace {
+class ConvertConvolutionsToNHWC
+    : public ConvertConvolutionsToNHWCBase<ConvertConvolutionsToNHWC> {
+  void runOnOperation() override {
+    SmallVector<linalg::ConvNCHWOp, 4> convs;
+    getOperation().walk([&](linalg::ConvNCHWOp op) {
+      bool isRankedTensorOp =
+          llvm::all_of(op->getOperandTypes(), [](Type type) {
+            return type.isa<RankedTensorType>();
+          });
+      if (!isRankedTensorOp)
+        return;
+      auto resultType = op->getResult(0).getType().cast<ShapedType>();
+      if (resultType.getElementType().isa<FloatType>())
+        convs.push_back(op);
+    });
+    for (linalg::ConvNCHWOp op : convs)
+      convertToNHWC(op);
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createConvertConvolutionsToNHWCPass() {
+  return std::make_unique<ConvertConvolutionsToNHWC>();
+}
@@ -0,0 +1,125 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Computes the f32 matmuls with bf16 operands and f32 accumulation, which
+// halves the memory traffic of their operands (most of which is usually
+// weights).
+//
+// The operands of each `linalg.matmul` and `linalg.batch_matmul` on f32
+// tensors are rounded to bf16:
+// - constants are converted at compile time, so the weights are stored in
+//   bf16 in the compiled module (and packed as such, see PackMatmulWeights),
+// - other operands are converted by an elementwise `linalg.generic`, which
+//   tensor fusion merges into the op producing them, so that the producer
+//   stores bf16 directly.
+// The matmul itself extends the elements to f32 before multiplying them, and
+// its result stays f32.
+//
+// The convolutions that LowerConvolutions rewrites into matmuls are demoted
+// with them; the remaining direct convolutions stay in f32.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+
+#include "mlir/Dialect/Linalg/IR/LinalgOps.h"
+#include "mlir/Dialect/MemRef/IR/MemRef.h"
+#include "mlir/Dialect/StandardOps/IR/Ops.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+// Returns true if `value` is a ranked tensor of f32.
+static bool isF32Tensor(Value value) {
+  auto type = value.getType().dyn_cast<RankedTensorType>();
+  return type && type.getElementType().isF32();
+}
+
+// Returns the f32 tensor `value` rounded to bf16.
+static Value demote(OpBuilder &b, Location loc, Value value) {
+  auto roundElement = [](const APFloat &element) {
+    APFloat rounded = element;
+    bool losesInfo;
+    rounded.convert(APFloat::BFloat(), APFloat::rmNearestTiesToEven,
+                    &losesInfo);
+    return rounded.bitcastToAPInt();
+  };
+  if (auto constant = value.getDefiningOp<ConstantOp>()) {
+    if (auto elements = constant.getValue().dyn_cast<DenseFPElementsAttr>())
+      return b.create<ConstantOp>(
+          loc, elements.mapValues(b.getBF16Type(), roundElement));
+  }
+
+  auto type = value.getType().cast<RankedTensorType>();
+  auto demotedType = RankedTensorType::get(type.getShape(), b.getBF16Type());
+  SmallVector<Value, 4> dynamicSizes;
+  for (int64_t i = 0, e = type.getRank(); i < e; i++)
+    if (type.isDynamicDim(i))
+      dynamicSizes.push_back(b.create<memref::DimOp>(loc, value, i));
+  Value init = b.create<linalg::InitTensorOp>(loc, dynamicSizes,
+                                              type.getShape(),
+                                              b.getBF16Type());
+  auto identity = b.getMultiDimIdentityMap(type.getRank());
+  SmallVector<StringRef, 4> iteratorTypes(type.getRank(),
+                                          getParallelIteratorTypeName());
+  return b
+      .create<linalg::GenericOp>(
+          loc, TypeRange(demotedType), value, init,
+          ArrayRef<AffineMap>({identity, identity}), iteratorTypes,
+          [](OpBuilder &b, Location loc, ValueRange args) {
+            Value rounded =
+                b.create<FPTruncOp>(loc, args[0], b.getBF16Type());
+            b.create<linalg::YieldOp>(loc, rounded);
+          })
+      ->getResult(0);
+}
+
+// Replaces the f32 matmul `op` by one with bf16 operands.
+template <typename OpTy>
+static void demoteMatmul(OpTy op) {
+  OpBuilder b(op);
+  Location loc = op.getLoc();
+  Value lhs = demote(b, loc, op.getOperand(0));
+  Value rhs = demote(b, loc, op.getOperand(1));
+  Value demoted = b.create<OpTy>(loc, op->getResultTypes(),
+                                 ValueRange({lhs, rhs}), op.getOperand(2))
+                      ->getResult(0);
+  op->replaceAllUsesWith(ValueRange(demoted));
+  op.erase();
+}
+
+namespace {
+class DemoteToBF16 : public DemoteToBF16Base<DemoteToBF16> {
+  void runOnOperation() override {
+    FuncOp func = getOperation();
+    SmallVector<Operation *, 4> matmuls;
+    func.walk([&](Operation *op) {
+      if (isa<linalg::MatmulOp, linalg::BatchMatmulOp>(op) &&
+          llvm::all_of(op->getOperands(), isF32Tensor))
+        matmuls.push_back(op);
+    });
+    for (Operation *op : matmuls) {
+      if (auto matmul = dyn_cast<linalg::MatmulOp>(op))
+        demoteMatmul(matmul);
+      else
+        demoteMatmul(cast<linalg::BatchMatmulOp>(op));
+    }
+    // Erase the constants that were only used by the matmuls.
+    func.walk([](ConstantOp op) {
+      if (op->use_empty() && op.getType().isa<RankedTensorType>())
+        op.erase();
+    });
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createDemoteToBF16Pass() {
+  return std::make_unique<DemoteToBF16>();
+}
@@ -0,0 +1,298 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Computes the inputs of concatenations directly into the concatenated buffer
+// (destination-passing style), instead of into buffers of their own which are
+// then copied.
+//
+// A concatenation (such as `torch.cat([x, y], 1)` from the Torch frontend) is
+// a chain of `subtensor_insert`s into a `linalg.init_tensor`, and each of them
+// bufferizes to a copy of the whole destination followed by a copy of the
+// input into a view of it:
+//   %x = memref.alloc() : memref<4x3xf32>
+//   linalg.generic ... outs(%x : memref<4x3xf32>)
+//   %init = memref.alloc() : memref<4x7xf32>
+//   %0 = memref.alloc() : memref<4x7xf32>
+//   linalg.copy(%init, %0)
+//   %1 = memref.subview %0[0, 0] [4, 3] [1, 1]
+//   linalg.copy(%x, %1)
+//   %2 = memref.alloc() : memref<4x7xf32>
+//   linalg.copy(%0, %2)
+//   ...
+// This pass
+// - forwards each copy of a whole buffer that is dead afterwards (here the
+//   destinations of the previous inserts) by reusing that buffer,
+// - and then computes each input copied into a view directly into the view,
+//   when the viewed buffer isn't accessed between the op computing the input
+//   and the copy,
+// which leaves
+//   %init = memref.alloc() : memref<4x7xf32>
+//   %1 = memref.subview %init[0, 0] [4, 3] [1, 1]
+//   linalg.generic ... outs(%1 : memref<4x3xf32, #strided>)
+//   ...
+// so that the concatenation doesn't move any data.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+
+#include "mlir/Dialect/Linalg/IR/LinalgOps.h"
+#include "mlir/Dialect/MemRef/IR/MemRef.h"
+#include "mlir/IR/Dominance.h"
+#include "mlir/Interfaces/CallInterfaces.h"
+#include "mlir/Interfaces/SideEffectInterfaces.h"
+#include "mlir/Interfaces/ViewLikeInterface.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+// Returns the buffer that `memref` is (a view of).
+static Value getRootBuffer(Value memref) {
+  while (Operation *op = memref.getDefiningOp()) {
+    if (auto view = dyn_cast<ViewLikeOpInterface>(op))
+      memref = view.getViewSource();
+    else if (auto cast = dyn_cast<memref::CastOp>(op))
+      memref = cast.source();
+    else
+      break;
+  }
+  return memref;
+}
+
+// Returns true if the buffers `a` and `b` may alias. Allocations are distinct
+// from every other buffer, while the others (arguments and globals) may alias
+// each other.
+static bool mayAlias(Value a, Value b) {
+  if (a == b)
+    return true;
+  auto isAllocation = [](Value buffer) {
+    return buffer.getDefiningOp<memref::AllocOp>() ||
+           buffer.getDefiningOp<memref::AllocaOp>();
+  };
+  return !isAllocation(a) && !isAllocation(b);
+}
+
+// Returns true if `op` (or an op nested in it) may read or write the buffer
+// `root`.
+static bool mayAccessBuffer(Operation *op, Value root) {
+  auto result = op->walk([&](Operation *nested) {
+    if (isa<CallOpInterface>(nested))
+      return WalkResult::interrupt();
+    if (isa<memref::DimOp, ViewLikeOpInterface, memref::CastOp>(nested))
+      return WalkResult::advance();
+    for (Value operand : nested->getOperands())
+      if (operand.getType().isa<MemRefType>() &&
+          mayAlias(getRootBuffer(operand), root))
+        return WalkResult::interrupt();
+    return WalkResult::advance();
+  });
+  return result.wasInterrupted();
+}
+
+// Returns true if `op` (or an op nested in it) may write the buffer `root`.
+static bool mayWriteBuffer(Operation *op, Value root) {
+  auto result = op->walk([&](Operation *nested) {
+    if (isa<CallOpInterface>(nested))
+      return WalkResult::interrupt();
+    if (auto linalgOp = dyn_cast<linalg::LinalgOp>(nested)) {
+      for (Value output : linalgOp.getOutputBuffers())
+        if (mayAlias(getRootBuffer(output), root))
+          return WalkResult::interrupt();
+      return WalkResult::advance();
+    }
+    if (isa<memref::DimOp, ViewLikeOpInterface, memref::CastOp>(nested))
+      return WalkResult::advance();
+    for (Value operand : nested->getOperands()) {
+      if (!operand.getType().isa<MemRefType>() ||
+          !mayAlias(getRootBuffer(operand), root))
+        continue;
+      auto effects = dyn_cast<MemoryEffectOpInterface>(nested);
+      if (!effects || effects.getEffectOnValue<MemoryEffects::Write>(operand) ||
+          effects.getEffectOnValue<MemoryEffects::Free>(operand))
+        return WalkResult::interrupt();
+    }
+    return WalkResult::advance();
+  });
+  return result.wasInterrupted();
+}
+
+// Returns true if every use of `buffer`, and of the views of it, is before
+// `point`, except for the deallocations of `buffer`, which are collected in
+// `deallocs`.
+static bool areAllUsesBefore(Value buffer, Operation *point,
+                             SmallVectorImpl<Operation *> *deallocs) {
+  Block *block = point->getBlock();
+  for (Operation *user : buffer.getUsers()) {
+    if (user == point)
+      continue;
+    if (deallocs && isa<memref::DeallocOp>(user)) {
+      deallocs->push_back(user);
+      continue;
+    }
+    Operation *ancestor = block->findAncestorOpInBlock(*user);
+    if (!ancestor || !ancestor->isBeforeInBlock(point))
+      return false;
+    if (isa<ViewLikeOpInterface, memref::CastOp>(user) &&
+        !areAllUsesBefore(user->getResult(0), point, /*deallocs=*/nullptr))
+      return false;
+  }
+  return true;
+}
+
+// Replaces `copy`, from a buffer which is dead afterwards into a fresh
+// allocation of the same type, with the source buffer.
+static LogicalResult forwardClone(linalg::CopyOp copy) {
+  auto source = copy.input().getDefiningOp<memref::AllocOp>();
+  auto clone = copy.output().getDefiningOp<memref::AllocOp>();
+  Block *block = copy->getBlock();
+  if (!source || !clone || source.getType() != clone.getType() ||
+      source->getBlock() != block || clone->getBlock() != block)
+    return failure();
+  SmallVector<Operation *, 2> sourceDeallocs;
+  if (!areAllUsesBefore(source, copy, &sourceDeallocs))
+    return failure();
+  // The clone must not be used before it holds the copied values.
+  for (Operation *user : clone->getUsers()) {
+    if (user == copy)
+      continue;
+    Operation *ancestor = block->findAncestorOpInBlock(*user);
+    if (!ancestor || !copy->isBeforeInBlock(ancestor))
+      return failure();
+  }
+
+  for (Operation *dealloc : sourceDeallocs)
+    dealloc->erase();
+  copy.erase();
+  clone.replaceAllUsesWith(source.getResult());
+  clone.erase();
+  return success();
+}
+
+// Returns true if `op` writes `buffer` as its only output and doesn't read it.
+static bool writesOnly(linalg::LinalgOp op, Value buffer) {
+  return op.getNumOutputs() == 1 && op.getOutputBuffer(0) == buffer &&
+         !llvm::is_contained(op.getInputs(), buffer) &&
+         !op.payloadUsesValueFromOutputOperandIndex(0);
+}
+
+// Returns true if `op` only reads `buffer`, in a way that accepts any layout.
+static bool readsOnly(Operation *op, Value buffer) {
+  if (auto linalgOp = dyn_cast<linalg::LinalgOp>(op))
+    return !llvm::is_contained(linalgOp.getOutputBuffers(), buffer);
+  return isa<memref::DimOp, memref::LoadOp>(op);
+}
+
+// Moves the op defining `value`, and recursively the ops defining its
+// operands, before `point` when `value` doesn't dominate it yet. Only ops of
+// the same block without side effects (other than allocating) are moved.
+static bool hoistBefore(Value value, Operation *point,
+                        DominanceInfo &domInfo) {
+  if (domInfo.properlyDominates(value, point))
+    return true;
+  Operation *op = value.getDefiningOp();
+  if (!op || op->getBlock() != point->getBlock() || op->getNumRegions() != 0 ||
+      (!isa<memref::AllocOp>(op) && !MemoryEffectOpInterface::hasNoEffect(op)))
+    return false;
+  for (Value operand : op->getOperands())
+    if (!hoistBefore(operand, point, domInfo))
+      return false;
+  op->moveBefore(point);
+  return true;
+}
+
+// Computes the source of `copy`, a fresh allocation only written by one op,
+// directly into the view that it is copied to.
+static LogicalResult forwardWriteIntoView(linalg::CopyOp copy,
+                                          DominanceInfo &domInfo) {
+  auto subview = copy.output().getDefiningOp<memref::SubViewOp>();
+  auto alloc = copy.input().getDefiningOp<memref::AllocOp>();
+  Block *block = copy->getBlock();
+  if (!subview || !alloc || alloc->getBlock() != block)
+    return failure();
+  MemRefType allocType = alloc.getType();
+  MemRefType viewType = subview.getType();
+  if (allocType.getShape() != viewType.getShape() ||
+      allocType.getElementType() != viewType.getElementType())
+    return failure();
+  linalg::LinalgOp writer;
+  SmallVector<Operation *, 2> deallocs;
+  for (Operation *user : alloc->getUsers()) {
+    if (isa<memref::DeallocOp>(user)) {
+      deallocs.push_back(user);
+      continue;
+    }
+    auto linalgOp = dyn_cast<linalg::LinalgOp>(user);
+    if (!linalgOp || user == copy ||
+        !llvm::is_contained(linalgOp.getOutputBuffers(), alloc))
+      continue;
+    if (writer || linalgOp->getBlock() != block ||
+        !writesOnly(linalgOp, alloc))
+      return failure();
+    writer = linalgOp;
+  }
+  if (!writer || !writer->isBeforeInBlock(copy))
+    return failure();
+  // The other uses of the buffer read the value computed by the writer, which
+  // the view must hold from the writer to the last of them.
+  Operation *lastUse = copy;
+  for (Operation *user : alloc->getUsers()) {
+    if (user == copy || user == writer || isa<memref::DeallocOp>(user))
+      continue;
+    Operation *ancestor = block->findAncestorOpInBlock(*user);
+    if (!ancestor || !writer->isBeforeInBlock(ancestor) ||
+        !readsOnly(user, alloc))
+      return failure();
+    if (lastUse->isBeforeInBlock(ancestor))
+      lastUse = ancestor;
+  }
+  Value root = getRootBuffer(subview.source());
+  if (mayAccessBuffer(writer, root) ||
+      llvm::any_of(
+          llvm::make_range(std::next(writer->getIterator()),
+                           copy->getIterator()),
+          [&](Operation &op) { return mayAccessBuffer(&op, root); }) ||
+      llvm::any_of(
+          llvm::make_range(std::next(copy->getIterator()),
+                           std::next(lastUse->getIterator())),
+          [&](Operation &op) { return mayWriteBuffer(&op, root); }))
+    return failure();
+  // The view (and the buffer it views) must exist before the writer.
+  if (!hoistBefore(subview.getResult(), writer, domInfo))
+    return failure();
+
+  for (Operation *dealloc : deallocs)
+    dealloc->erase();
+  copy.erase();
+  alloc.replaceAllUsesWith(subview.getResult());
+  alloc.erase();
+  return success();
+}
+
+namespace {
+class ElideConcatCopies : public ElideConcatCopiesBase<ElideConcatCopies> {
+  void runOnOperation() override {
+    DominanceInfo &domInfo = getAnalysis<DominanceInfo>();
+    SmallVector<linalg::CopyOp, 8> copies;
+    getOperation().walk([&](linalg::CopyOp copy) { copies.push_back(copy); });
+    // Forwarding the clones first makes all the inputs of a concatenation
+    // copied into views of the same buffer.
+    SmallVector<linalg::CopyOp, 8> remainingCopies;
+    for (linalg::CopyOp copy : copies)
+      if (failed(forwardClone(copy)))
+        remainingCopies.push_back(copy);
+    for (linalg::CopyOp copy : remainingCopies)
+      (void)forwardWriteIntoView(copy, domInfo);
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createElideConcatCopiesPass() {
+  return std::make_unique<ElideConcatCopies>();
+}
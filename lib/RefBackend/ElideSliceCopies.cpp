@@ -0,0 +1,164 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Reads slices directly through their strided views instead of through
+// contiguous copies of them.
+//
+// A slice (such as `x[:, 2:5]` from the Torch frontend) is a `subtensor`,
+// which bufferizes to a copy of a view of the sliced buffer:
+//   %0 = memref.subview %x[0, 2] [4, 3] [1, 1]
+//       : memref<4x8xf32> to memref<4x3xf32, #strided>
+//   %1 = memref.alloc() : memref<4x3xf32>
+//   linalg.copy(%0, %1)
+//   linalg.generic ins(%1 : memref<4x3xf32>) ...
+// The linalg ops (and loads) reading the copy can read the strided view just
+// as well, so this pass replaces the copy with the view when the sliced
+// buffer isn't written while the copy is used:
+//   linalg.generic ins(%0 : memref<4x3xf32, #strided>) ...
+// The copies that escape (such as the results returned to the runtime, whose
+// ABI takes contiguous buffers) are kept.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+
+#include "mlir/Dialect/Linalg/IR/LinalgOps.h"
+#include "mlir/Dialect/MemRef/IR/MemRef.h"
+#include "mlir/Interfaces/CallInterfaces.h"
+#include "mlir/Interfaces/SideEffectInterfaces.h"
+#include "mlir/Interfaces/ViewLikeInterface.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+// Returns the buffer that `memref` is (a view of).
+static Value getRootBuffer(Value memref) {
+  while (Operation *op = memref.getDefiningOp()) {
+    if (auto view = dyn_cast<ViewLikeOpInterface>(op))
+      memref = view.getViewSource();
+    else if (auto cast = dyn_cast<memref::CastOp>(op))
+      memref = cast.source();
+    else
+      break;
+  }
+  return memref;
+}
+
+// Returns true if the buffers `a` and `b` may alias. Allocations are distinct
+// from every other buffer, while the others (arguments and globals) may alias
+// each other.
+static bool mayAlias(Value a, Value b) {
+  if (a == b)
+    return true;
+  auto isAllocation = [](Value buffer) {
+    return buffer.getDefiningOp<memref::AllocOp>() ||
+           buffer.getDefiningOp<memref::AllocaOp>();
+  };
+  return !isAllocation(a) && !isAllocation(b);
+}
+
+// Returns true if `op` (or an op nested in it) may write the buffer `root`.
+static bool mayWriteBuffer(Operation *op, Value root) {
+  auto result = op->walk([&](Operation *nested) {
+    if (isa<CallOpInterface>(nested))
+      return WalkResult::interrupt();
+    if (auto linalgOp = dyn_cast<linalg::LinalgOp>(nested)) {
+      for (Value output : linalgOp.getOutputBuffers())
+        if (mayAlias(getRootBuffer(output), root))
+          return WalkResult::interrupt();
+      return WalkResult::advance();
+    }
+    if (isa<memref::DimOp, ViewLikeOpInterface, memref::CastOp>(nested))
+      return WalkResult::advance();
+    for (Value operand : nested->getOperands()) {
+      if (!operand.getType().isa<MemRefType>() ||
+          !mayAlias(getRootBuffer(operand), root))
+        continue;
+      auto effects = dyn_cast<MemoryEffectOpInterface>(nested);
+      if (!effects || effects.getEffectOnValue<MemoryEffects::Write>(operand) ||
+          effects.getEffectOnValue<MemoryEffects::Free>(operand))
+        return WalkResult::interrupt();
+    }
+    return WalkResult::advance();
+  });
+  return result.wasInterrupted();
+}
+
+// Returns true if `op` only reads `buffer`, in a way that accepts any layout.
+// Terminators, calls and casts need the identity layout of `buffer`.
+static bool readsOnly(Operation *op, Value buffer) {
+  if (auto linalgOp = dyn_cast<linalg::LinalgOp>(op))
+    return !llvm::is_contained(linalgOp.getOutputBuffers(), buffer);
+  return isa<memref::DimOp, memref::LoadOp>(op);
+}
+
+// Replaces `copy`, from a subview into a fresh allocation which is then only
+// read, with the subview.
+static LogicalResult elideSliceCopy(linalg::CopyOp copy) {
+  auto subview = copy.input().getDefiningOp<memref::SubViewOp>();
+  auto alloc = copy.output().getDefiningOp<memref::AllocOp>();
+  if (!subview || !alloc || alloc->getBlock() != copy->getBlock() ||
+      !alloc->isBeforeInBlock(copy))
+    return failure();
+  MemRefType allocType = alloc.getType();
+  MemRefType viewType = subview.getType();
+  if (allocType.getShape() != viewType.getShape() ||
+      allocType.getElementType() != viewType.getElementType())
+    return failure();
+  Block *block = copy->getBlock();
+  Operation *lastUse = copy;
+  SmallVector<Operation *, 2> deallocs;
+  for (Operation *user : alloc->getUsers()) {
+    if (user == copy)
+      continue;
+    if (isa<memref::DeallocOp>(user)) {
+      deallocs.push_back(user);
+      continue;
+    }
+    Operation *ancestor = block->findAncestorOpInBlock(*user);
+    if (!ancestor || !copy->isBeforeInBlock(ancestor) ||
+        !readsOnly(user, alloc))
+      return failure();
+    if (lastUse->isBeforeInBlock(ancestor))
+      lastUse = ancestor;
+  }
+  if (lastUse == copy)
+    return failure();
+  // The sliced buffer must hold the copied values until the last read.
+  Value root = getRootBuffer(subview.source());
+  for (Operation *op = copy->getNextNode();; op = op->getNextNode()) {
+    if (mayWriteBuffer(op, root))
+      return failure();
+    if (op == lastUse)
+      break;
+  }
+
+  for (Operation *dealloc : deallocs)
+    dealloc->erase();
+  copy.erase();
+  alloc.replaceAllUsesWith(subview.getResult());
+  alloc.erase();
+  return success();
+}
+
+namespace {
+class ElideSliceCopies : public ElideSliceCopiesBase<ElideSliceCopies> {
+  void runOnOperation() override {
+    SmallVector<linalg::CopyOp, 8> copies;
+    getOperation().walk([&](linalg::CopyOp copy) { copies.push_back(copy); });
+    for (linalg::CopyOp copy : copies)
+      (void)elideSliceCopy(copy);
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createElideSliceCopiesPass() {
+  return std::make_unique<ElideSliceCopies>();
+}
@@ -0,0 +1,64 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Computes the large splat tensor constants (such as zero biases and
+// initial states) with a `linalg.fill`, instead of letting constant
+// bufferization store each of their elements in a global:
+//   %0 = constant dense<0.0> : tensor<4096xf32>
+// becomes
+//   %init = linalg.init_tensor [4096] : tensor<4096xf32>
+//   %zero = constant 0.0 : f32
+//   %0 = linalg.fill(%init, %zero) : tensor<4096xf32>, f32 -> tensor<4096xf32>
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+
+#include "mlir/Dialect/Linalg/IR/LinalgOps.h"
+#include "mlir/Dialect/StandardOps/IR/Ops.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+namespace {
+class ExpandSplatConstants
+    : public ExpandSplatConstantsBase<ExpandSplatConstants> {
+  void runOnOperation() override {
+    SmallVector<ConstantOp, 4> splats;
+    getOperation().walk([&](ConstantOp op) {
+      auto elements = op.getValue().dyn_cast<DenseElementsAttr>();
+      if (!elements || !elements.isSplat() ||
+          elements.getNumElements() < minElements)
+        return;
+      // Only the element types of std scalar constants can be filled.
+      Type elementType = elements.getType().getElementType();
+      if (elementType.isa<FloatType>() || elementType.isSignlessInteger())
+        splats.push_back(op);
+    });
+    for (ConstantOp op : splats) {
+      OpBuilder b(op);
+      Location loc = op.getLoc();
+      auto elements = op.getValue().cast<DenseElementsAttr>();
+      auto type = elements.getType();
+      Value init = b.create<linalg::InitTensorOp>(
+          loc, ValueRange(), type.getShape(), type.getElementType());
+      Value scalar =
+          b.create<ConstantOp>(loc, elements.getSplatValue<Attribute>());
+      Value filled = b.create<linalg::FillOp>(loc, init, scalar).getResult(0);
+      op.replaceAllUsesWith(filled);
+      op.erase();
+    }
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createExpandSplatConstantsPass() {
+  return std::make_unique<ExpandSplatConstants>();
+}
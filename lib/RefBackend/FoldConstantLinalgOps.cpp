@@ -0,0 +1,296 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Evaluates elementwise `linalg.generic` ops on constant tensors at compile
+// time, so that the transposes and broadcasts of weights (such as the ones
+// emitted by the lowering of `aten.linear`) don't run on every invocation.
+// Reshapes of constants are already folded by the reshape ops themselves, but
+// generics that reshape by indexing with `floordiv`/`mod` maps (such as the
+// filter layout changes of LowerConvolutions) are folded here.
+//
+// Ops whose payload just forwards an input element (transposes, broadcasts,
+// and other data movement) are evaluated by copying raw element data, and are
+// folded as long as the result has at most `max-elements` elements. Other
+// payloads are evaluated by folding the payload ops element by element, which
+// is much slower and creates an attribute per element, so they have the much
+// smaller budget `max-computed-elements`.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+
+#include "mlir/Dialect/Linalg/IR/LinalgOps.h"
+#include "mlir/Dialect/StandardOps/IR/Ops.h"
+#include "mlir/IR/BuiltinAttributes.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+namespace {
+// An input of a generic op, with the strides (in elements) by which each loop
+// of the op advances through it. If the input isn't accessed with a projected
+// permutation, `loopStrides` is empty and the offsets are computed from `map`
+// at each iteration instead.
+struct ConstantInput {
+  DenseElementsAttr value;
+  AffineMap map;
+  SmallVector<int64_t, 4> loopStrides;
+};
+} // namespace
+
+// Returns the strides of the loops of `op` through an operand of type `type`
+// accessed with `map`, which must be a projected permutation.
+static SmallVector<int64_t, 4> getLoopStrides(ShapedType type, AffineMap map) {
+  SmallVector<int64_t, 4> loopStrides(map.getNumDims(), 0);
+  int64_t stride = 1;
+  for (int64_t i = type.getRank() - 1; i >= 0; i--) {
+    unsigned loop = map.getResult(i).cast<AffineDimExpr>().getPosition();
+    loopStrides[loop] += stride;
+    stride *= type.getDimSize(i);
+  }
+  return loopStrides;
+}
+
+// Returns the offset of iteration `ivs` into `input`, whose map isn't a
+// projected permutation, or -1 if the access is out of bounds.
+static int64_t getOffset(const ConstantInput &input, ArrayRef<int64_t> ivs) {
+  ShapedType type = input.value.getType();
+  SmallVector<int64_t, 4> indices = input.map.compose(ivs);
+  int64_t offset = 0;
+  for (auto it : llvm::enumerate(indices)) {
+    int64_t size = type.getDimSize(it.index());
+    if (it.value() < 0 || it.value() >= size)
+      return -1;
+    offset = offset * size + it.value();
+  }
+  return offset;
+}
+
+// Calls `fn` with the offset of each iteration (in loop order) into each of
+// `inputs` and into the result (whose loop strides are `resultStrides`).
+// Returns false if some input is accessed out of bounds.
+static bool
+forEachIteration(ArrayRef<int64_t> loopRanges, ArrayRef<ConstantInput> inputs,
+                 ArrayRef<int64_t> resultStrides,
+                 function_ref<void(ArrayRef<int64_t>, int64_t)> fn) {
+  int64_t numLoops = loopRanges.size();
+  SmallVector<int64_t, 4> ivs(numLoops, 0);
+  SmallVector<int64_t, 4> offsets(inputs.size(), 0);
+  int64_t resultOffset = 0;
+  while (true) {
+    for (auto input : llvm::enumerate(inputs)) {
+      if (!input.value().loopStrides.empty())
+        continue;
+      offsets[input.index()] = getOffset(input.value(), ivs);
+      if (offsets[input.index()] < 0)
+        return false;
+    }
+    fn(offsets, resultOffset);
+    // Advance the innermost loop, carrying into the outer ones.
+    int64_t loop = numLoops - 1;
+    for (; loop >= 0; loop--) {
+      for (auto input : llvm::enumerate(inputs))
+        if (!input.value().loopStrides.empty())
+          offsets[input.index()] += input.value().loopStrides[loop];
+      resultOffset += resultStrides[loop];
+      if (++ivs[loop] < loopRanges[loop])
+        break;
+      for (auto input : llvm::enumerate(inputs))
+        if (!input.value().loopStrides.empty())
+          offsets[input.index()] -=
+              input.value().loopStrides[loop] * ivs[loop];
+      resultOffset -= resultStrides[loop] * ivs[loop];
+      ivs[loop] = 0;
+    }
+    if (loop < 0)
+      return true;
+  }
+}
+
+// Evaluates a payload that yields input number `inputIndex` unchanged.
+static DenseElementsAttr foldCopy(ArrayRef<ConstantInput> inputs,
+                                  unsigned inputIndex,
+                                  ArrayRef<int64_t> loopRanges,
+                                  ArrayRef<int64_t> resultStrides,
+                                  RankedTensorType resultType) {
+  DenseElementsAttr source = inputs[inputIndex].value;
+  if (source.isSplat())
+    return DenseElementsAttr::get(resultType, source.getSplatValue());
+  int64_t elementBytes = resultType.getElementTypeBitWidth() / 8;
+  ArrayRef<char> data = source.getRawData();
+  std::vector<char> result(resultType.getNumElements() * elementBytes);
+  bool inBounds = forEachIteration(
+      loopRanges, inputs, resultStrides,
+      [&](ArrayRef<int64_t> offsets, int64_t resultOffset) {
+        const char *element = data.data() + offsets[inputIndex] * elementBytes;
+        std::copy(element, element + elementBytes,
+                  result.data() + resultOffset * elementBytes);
+      });
+  if (!inBounds)
+    return nullptr;
+  return DenseElementsAttr::getFromRawBuffer(resultType, result,
+                                             /*isSplatBuffer=*/false);
+}
+
+// Evaluates the payload of `op` by folding its ops for each element, or
+// returns null if some payload op doesn't fold to a constant.
+static DenseElementsAttr foldComputation(linalg::GenericOp op,
+                                         ArrayRef<ConstantInput> inputs,
+                                         ArrayRef<int64_t> loopRanges,
+                                         ArrayRef<int64_t> resultStrides,
+                                         RankedTensorType resultType) {
+  Block *body = op.getBody();
+  SmallVector<SmallVector<Attribute, 0>, 4> inputElements;
+  for (const ConstantInput &input : inputs)
+    inputElements.push_back(
+        llvm::to_vector<0>(input.value.getValues<Attribute>()));
+
+  SmallVector<Attribute, 0> result(resultType.getNumElements());
+  bool failedToFold = false;
+  bool inBounds = forEachIteration(
+      loopRanges, inputs, resultStrides,
+      [&](ArrayRef<int64_t> offsets, int64_t resultOffset) {
+        if (failedToFold)
+          return;
+        DenseMap<Value, Attribute> values;
+        for (auto input : llvm::enumerate(inputElements))
+          values[body->getArgument(input.index())] =
+              input.value()[offsets[input.index()]];
+        for (Operation &payloadOp : body->without_terminator()) {
+          SmallVector<Attribute, 4> operands;
+          for (Value operand : payloadOp.getOperands()) {
+            Attribute attr = values.lookup(operand);
+            // Constants defined above the op.
+            if (!attr)
+              if (auto constant = operand.getDefiningOp<ConstantOp>())
+                attr = constant.getValue();
+            operands.push_back(attr);
+          }
+          SmallVector<OpFoldResult, 1> folded;
+          if (failed(payloadOp.fold(operands, folded)) ||
+              folded.size() != payloadOp.getNumResults()) {
+            failedToFold = true;
+            return;
+          }
+          for (auto it : llvm::zip(payloadOp.getResults(), folded)) {
+            OpFoldResult foldResult = std::get<1>(it);
+            Attribute attr = foldResult.dyn_cast<Attribute>();
+            if (!attr)
+              attr = values.lookup(foldResult.get<Value>());
+            if (!attr) {
+              failedToFold = true;
+              return;
+            }
+            values[std::get<0>(it)] = attr;
+          }
+        }
+        Attribute element =
+            values.lookup(body->getTerminator()->getOperand(0));
+        if (!element) {
+          failedToFold = true;
+          return;
+        }
+        result[resultOffset] = element;
+      });
+  if (failedToFold || !inBounds)
+    return nullptr;
+  return DenseElementsAttr::get(resultType, result);
+}
+
+// Returns the value of `op` as a constant, or null if it can't be folded
+// within the budgets.
+static DenseElementsAttr foldGenericOp(linalg::GenericOp op,
+                                       int64_t maxElements,
+                                       int64_t maxComputedElements) {
+  if (!op.hasTensorSemantics() || op.getNumOutputs() != 1 ||
+      op.getNumInputs() == 0 || op.getNumParallelLoops() != op.getNumLoops())
+    return nullptr;
+  auto resultType =
+      op->getResult(0).getType().dyn_cast<RankedTensorType>();
+  if (!resultType || !resultType.hasStaticShape() ||
+      resultType.getNumElements() > maxElements ||
+      !resultType.getElementType().isIntOrFloat() ||
+      resultType.getElementTypeBitWidth() % 8 != 0)
+    return nullptr;
+
+  // The output must only provide the shape, not initial values.
+  Block *body = op.getBody();
+  if (!body->getArgument(op.getNumInputs()).use_empty())
+    return nullptr;
+
+  auto indexingMaps = op.getIndexingMaps();
+  AffineMap resultMap = indexingMaps.back();
+  if (!resultMap.isPermutation())
+    return nullptr;
+  SmallVector<ConstantInput, 4> inputs;
+  for (unsigned i = 0, e = op.getNumInputs(); i < e; i++) {
+    auto constant = op.getOperand(i).getDefiningOp<ConstantOp>();
+    if (!constant)
+      return nullptr;
+    auto value = constant.getValue().dyn_cast<DenseElementsAttr>();
+    AffineMap map = indexingMaps[i];
+    if (!value || map.getNumSymbols() != 0)
+      return nullptr;
+    SmallVector<int64_t, 4> loopStrides;
+    if (map.isProjectedPermutation())
+      loopStrides = getLoopStrides(value.getType(), map);
+    inputs.push_back({value, map, loopStrides});
+  }
+  SmallVector<int64_t, 4> loopRanges(op.getNumLoops(), 0);
+  for (unsigned i = 0, e = resultType.getRank(); i < e; i++)
+    loopRanges[resultMap.getDimPosition(i)] = resultType.getDimSize(i);
+  SmallVector<int64_t, 4> resultStrides = getLoopStrides(resultType, resultMap);
+  if (resultType.getNumElements() == 0)
+    return DenseElementsAttr::get(resultType, ArrayRef<Attribute>());
+
+  Value yielded = body->getTerminator()->getOperand(0);
+  for (unsigned i = 0, e = op.getNumInputs(); i < e; i++) {
+    if (yielded == body->getArgument(i) &&
+        inputs[i].value.getType().getElementType() ==
+            resultType.getElementType())
+      return foldCopy(inputs, i, loopRanges, resultStrides, resultType);
+  }
+  if (resultType.getNumElements() > maxComputedElements)
+    return nullptr;
+  return foldComputation(op, inputs, loopRanges, resultStrides, resultType);
+}
+
+namespace {
+class FoldConstantLinalgOps
+    : public FoldConstantLinalgOpsBase<FoldConstantLinalgOps> {
+  void runOnOperation() override {
+    FuncOp func = getOperation();
+    // Ops are visited before their users, so chains of foldable ops are
+    // folded in one go.
+    func.walk([&](linalg::GenericOp op) {
+      DenseElementsAttr value =
+          foldGenericOp(op, maxElements, maxComputedElements);
+      if (!value)
+        return;
+      OpBuilder builder(op);
+      Value constant = builder.create<ConstantOp>(op.getLoc(), value);
+      op->getResult(0).replaceAllUsesWith(constant);
+      op.erase();
+    });
+
+    // Drop the constants (and init tensors) that are no longer used, so that
+    // they don't end up in the compiled module.
+    func.walk([](Operation *op) {
+      if (op->use_empty() && isa<ConstantOp, linalg::InitTensorOp>(op) &&
+          op->getResult(0).getType().isa<RankedTensorType>())
+        op->erase();
+    });
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createFoldConstantLinalgOpsPass() {
+  return std::make_unique<FoldConstantLinalgOps>();
+}
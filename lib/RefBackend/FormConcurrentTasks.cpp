@@ -0,0 +1,247 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Groups the independent compute ops of straight-line code into tasks that
+// run concurrently.
+//
+// After bufferization, a function is a sequence of ops on buffers, which runs
+// in order even where the ops don't depend on each other, such as the towers
+// of an Inception block. This pass levels the compute ops of each block (the
+// linalg ops and the loop nests they were tiled into) by their dependences,
+// through SSA values and through the buffers they read and write. The compute
+// ops of a level are independent of each other, so when a level has several,
+// they become the cases of an `scf.parallel` over task indices:
+//
+//   scf.parallel (%task) = (%c0) to (%c2) step (%c1) {
+//     %is0 = cmpi eq, %task, %c0 : index
+//     scf.if %is0 { <op 0> }
+//     %is1 = cmpi eq, %task, %c1 : index
+//     scf.if %is1 { <op 1> }
+//   } {refbackrt.concurrent_tasks}
+//
+// which LowerParallelLoops runs on the runtime's thread pool, still running
+// the parallel loops of each task on the thread pool as well.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+
+#include "mlir/Dialect/Linalg/IR/LinalgOps.h"
+#include "mlir/Dialect/SCF/SCF.h"
+#include "mlir/Dialect/StandardOps/IR/Ops.h"
+#include "mlir/Interfaces/SideEffectInterfaces.h"
+#include "mlir/Interfaces/ViewLikeInterface.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+// Returns the buffer that `memref` is a view of.
+static Value getUnderlyingBuffer(Value memref) {
+  while (Operation *op = memref.getDefiningOp()) {
+    if (auto view = dyn_cast<ViewLikeOpInterface>(op))
+      memref = view.getViewSource();
+    else if (auto cast = dyn_cast<memref::CastOp>(op))
+      memref = cast.source();
+    else
+      break;
+  }
+  return memref;
+}
+
+static bool isAllocation(Value buffer) {
+  return buffer.getDefiningOp<memref::AllocOp>() ||
+         buffer.getDefiningOp<memref::AllocaOp>();
+}
+
+// Returns true if views of the underlying buffers `lhs` and `rhs` may
+// overlap. An allocation doesn't overlap any other buffer.
+static bool mayAlias(Value lhs, Value rhs) {
+  return lhs == rhs || (!isAllocation(lhs) && !isAllocation(rhs));
+}
+
+namespace {
+// An access of an op to the memory of `buffer`.
+struct MemoryAccess {
+  Value buffer;
+  bool isWrite;
+};
+
+// An op of the block being scheduled.
+struct ScheduledOp {
+  Operation *op;
+  // The accesses of the op (and its nested ops) to buffers defined outside of
+  // it.
+  SmallVector<MemoryAccess, 4> accesses;
+  // Whether the op is compute op that can run as a task.
+  bool isTask;
+  // The ops of the same level run after the tasks of the previous levels.
+  unsigned level = 0;
+};
+} // namespace
+
+// Collects the accesses of `op` to the memory of buffers defined outside of
+// it. Returns failure if it has other effects, or effects we can't attribute
+// to a buffer.
+static LogicalResult getMemoryAccesses(Operation *op,
+                                       SmallVectorImpl<MemoryAccess> &accesses) {
+  auto result = op->walk([&](Operation *nested) {
+    // The nested ops of such ops are visited on their own.
+    if (nested->hasTrait<OpTrait::HasRecursiveSideEffects>())
+      return WalkResult::advance();
+    auto effectInterface = dyn_cast<MemoryEffectOpInterface>(nested);
+    if (!effectInterface)
+      return WalkResult::interrupt();
+    SmallVector<MemoryEffects::EffectInstance, 2> effects;
+    effectInterface.getEffects(effects);
+    for (const MemoryEffects::EffectInstance &effect : effects) {
+      // Allocating memory doesn't affect the existing buffers.
+      if (isa<MemoryEffects::Allocate>(effect.getEffect()))
+        continue;
+      Value value = effect.getValue();
+      if (!value || !value.getType().isa<BaseMemRefType>())
+        return WalkResult::interrupt();
+      Value buffer = getUnderlyingBuffer(value);
+      // Buffers local to the op are private to it.
+      if (op->isProperAncestor(buffer.getParentBlock()->getParentOp()) ||
+          (buffer.getDefiningOp() &&
+           op->isProperAncestor(buffer.getDefiningOp())))
+        continue;
+      accesses.push_back(
+          {buffer, !isa<MemoryEffects::Read>(effect.getEffect())});
+    }
+    return WalkResult::advance();
+  });
+  return failure(result.wasInterrupted());
+}
+
+// Returns true if `later` must run after `earlier`.
+static bool dependsOn(const ScheduledOp &later, const ScheduledOp &earlier) {
+  bool usesResult = false;
+  later.op->walk([&](Operation *nested) {
+    for (Value operand : nested->getOperands()) {
+      if (operand.getDefiningOp() == earlier.op)
+        usesResult = true;
+    }
+  });
+  if (usesResult)
+    return true;
+  for (const MemoryAccess &lhs : later.accesses) {
+    for (const MemoryAccess &rhs : earlier.accesses) {
+      if ((lhs.isWrite || rhs.isWrite) && mayAlias(lhs.buffer, rhs.buffer))
+        return true;
+    }
+  }
+  return false;
+}
+
+// Moves `tasks` into the cases of an `scf.parallel` over task indices, built
+// before `insertionPoint`.
+static void formConcurrentTasks(ArrayRef<Operation *> tasks,
+                                Operation *insertionPoint) {
+  Location loc = tasks.front()->getLoc();
+  OpBuilder builder(insertionPoint);
+  Value zero = builder.create<ConstantIndexOp>(loc, 0);
+  Value one = builder.create<ConstantIndexOp>(loc, 1);
+  Value numTasks = builder.create<ConstantIndexOp>(loc, tasks.size());
+  auto parallelOp = builder.create<scf::ParallelOp>(
+      loc, ValueRange(zero), ValueRange(numTasks), ValueRange(one));
+  parallelOp->setAttr(kConcurrentTasksAttrName, builder.getUnitAttr());
+  builder.setInsertionPoint(parallelOp.getBody()->getTerminator());
+  Value taskIndex = parallelOp.getInductionVars()[0];
+  for (auto task : llvm::enumerate(tasks)) {
+    Value isTask = builder.create<CmpIOp>(
+        loc, CmpIPredicate::eq, taskIndex,
+        builder.create<ConstantIndexOp>(loc, task.index()));
+    auto ifOp = builder.create<scf::IfOp>(loc, TypeRange(), isTask,
+                                          /*withElseRegion=*/false);
+    task.value()->moveBefore(ifOp.thenBlock()->getTerminator());
+  }
+}
+
+// Schedules the ops [begin, end) of a block, which have no unknown effects.
+// `end` is left in place.
+static void scheduleOps(Block::iterator begin, Block::iterator end) {
+  SmallVector<ScheduledOp, 16> ops;
+  for (Operation &op : llvm::make_range(begin, end)) {
+    ScheduledOp scheduled;
+    scheduled.op = &op;
+    (void)getMemoryAccesses(&op, scheduled.accesses);
+    scheduled.isTask = op.getNumResults() == 0 &&
+                       (op.getNumRegions() != 0 || isa<linalg::LinalgOp>(op));
+    ops.push_back(std::move(scheduled));
+  }
+
+  // Tasks start a new level; other ops join the level of their dependences,
+  // since they run before the tasks of their level.
+  unsigned numLevels = 0;
+  for (unsigned i = 0, e = ops.size(); i < e; i++) {
+    for (unsigned j = 0; j < i; j++) {
+      if (dependsOn(ops[i], ops[j]))
+        ops[i].level = std::max(ops[i].level, ops[j].level + ops[j].isTask);
+    }
+    numLevels = std::max(numLevels, ops[i].level + 1);
+  }
+  SmallVector<SmallVector<Operation *, 4>, 4> levelTasks(numLevels);
+  for (ScheduledOp &op : ops) {
+    if (op.isTask)
+      levelTasks[op.level].push_back(op.op);
+  }
+  if (llvm::none_of(levelTasks, [](auto &tasks) { return tasks.size() > 1; }))
+    return;
+
+  // Rebuild the ops level by level before `end`.
+  Operation *insertionPoint = &*end;
+  for (unsigned level = 0; level < numLevels; level++) {
+    for (ScheduledOp &op : ops) {
+      if (op.level == level && !op.isTask)
+        op.op->moveBefore(insertionPoint);
+    }
+    ArrayRef<Operation *> tasks = levelTasks[level];
+    if (tasks.size() == 1)
+      tasks.front()->moveBefore(insertionPoint);
+    else if (!tasks.empty())
+      formConcurrentTasks(tasks, insertionPoint);
+  }
+}
+
+// Returns true if `op` must stay in place, with all the ops before it running
+// before it and all the ops after it running after it.
+static bool isBarrier(Operation *op) {
+  if (op->hasTrait<OpTrait::IsTerminator>())
+    return true;
+  SmallVector<MemoryAccess, 4> accesses;
+  return failed(getMemoryAccesses(op, accesses));
+}
+
+namespace {
+class FormConcurrentTasks
+    : public FormConcurrentTasksBase<FormConcurrentTasks> {
+  void runOnOperation() override {
+    for (Block &block : getOperation().getBody()) {
+      // Ops with unknown effects (and the terminator) split the block into
+      // segments that are scheduled separately.
+      SmallVector<Operation *, 4> barriers;
+      for (Operation &op : block) {
+        if (isBarrier(&op))
+          barriers.push_back(&op);
+      }
+      Block::iterator begin = block.begin();
+      for (Operation *barrier : barriers) {
+        scheduleOps(begin, Block::iterator(barrier));
+        begin = std::next(Block::iterator(barrier));
+      }
+    }
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createFormConcurrentTasksPass() {
+  return std::make_unique<FormConcurrentTasks>();
+}
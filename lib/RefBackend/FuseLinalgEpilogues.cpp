@@ -0,0 +1,167 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Fuses elementwise ops that consume the result of a matmul or convolution
+// (bias adds, activations) into the output tile loops of that op, so that each
+// output tile is finished while it is still in cache, instead of making
+// another full pass over the output in memory.
+//
+// This works on buffers, where the epilogue is a parallel `linalg.generic`
+// reading the output buffer of the matmul/convolution. The epilogue is tiled
+// along its loops with the L2 tile sizes of the producer's parallel loops, and
+// the producer (and the op initializing its output, such as a bias broadcast
+// or a fill) is fused into each tile. The fused producers are then tiled
+// further by TileLinalgOps like any other. Producers with tuned tile sizes
+// (see Tuning.h) use their tuned L2 sizes instead of those of the pass.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+#include "npcomp/RefBackend/Tuning.h"
+
+#include "mlir/Dialect/Linalg/Analysis/DependenceAnalysis.h"
+#include "mlir/Dialect/Linalg/IR/LinalgOps.h"
+#include "mlir/Dialect/Linalg/Transforms/Transforms.h"
+#include "mlir/Interfaces/SideEffectInterfaces.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+// Returns true if `op` is an elementwise op that can be tiled along the
+// output dimensions of a producer of its input `operandIndex`.
+static bool isEpilogue(linalg::GenericOp op, unsigned operandIndex) {
+  if (op.getNumOutputs() != 1 ||
+      op.getNumParallelLoops() != op.getNumLoops())
+    return false;
+  auto maps = op.getIndexingMaps();
+  return maps[operandIndex].isIdentity() && maps.back().isIdentity();
+}
+
+// Returns the op before `op` in its block that last writes `buffer` as its
+// output, provided that nothing in between has side effects.
+static linalg::LinalgOp getLastWriter(Operation *op, Value buffer) {
+  for (Operation *prev = op->getPrevNode(); prev; prev = prev->getPrevNode()) {
+    if (auto linalgOp = dyn_cast<linalg::LinalgOp>(prev)) {
+      if (linalgOp.getNumOutputs() == 1 &&
+          linalgOp.getOutputBuffer(0) == buffer)
+        return linalgOp;
+      return nullptr;
+    }
+    if (!MemoryEffectOpInterface::hasNoEffect(prev))
+      return nullptr;
+  }
+  return nullptr;
+}
+
+// Returns the producers to fuse into `epilogue`, in program order, followed
+// by `epilogue` itself, and the tile sizes for the loops of `epilogue`.
+static SmallVector<linalg::LinalgOp, 3>
+getFusionChain(linalg::GenericOp epilogue, ArrayRef<int64_t> matmulTileSizes,
+               ArrayRef<int64_t> convTileSizes,
+               SmallVectorImpl<int64_t> &tileSizes) {
+  for (unsigned i = 0, e = epilogue.getNumInputs(); i < e; i++) {
+    if (!isEpilogue(epilogue, i))
+      continue;
+    linalg::LinalgOp producer =
+        getLastWriter(epilogue, epilogue.getInputBuffer(i));
+    if (!producer)
+      continue;
+    // Only the parallel loops of the producer, which come first, are tiled.
+    unsigned numParallelLoops;
+    ArrayRef<int64_t> producerTileSizes;
+    if (isa<linalg::MatmulOp>(producer)) {
+      numParallelLoops = 2;
+      producerTileSizes = matmulTileSizes;
+    } else if (isa<linalg::ConvNCHWOp>(producer)) {
+      numParallelLoops = 4;
+      producerTileSizes = convTileSizes;
+    } else {
+      continue;
+    }
+    TuningConfig tuning = getTuningConfig(producer);
+    if (!tuning.l2TileSizes.empty())
+      producerTileSizes = tuning.l2TileSizes;
+    producerTileSizes = producerTileSizes.take_front(numParallelLoops);
+    if (producerTileSizes.size() != epilogue.getNumLoops() ||
+        llvm::all_of(producerTileSizes, [](int64_t size) { return size == 0; }))
+      continue;
+
+    SmallVector<linalg::LinalgOp, 3> chain;
+    // The op initializing the output of the producer (for matmuls and
+    // convolutions, which accumulate into their output).
+    if (linalg::LinalgOp init =
+            getLastWriter(producer, producer.getOutputBuffer(0)))
+      if (init.getNumLoops() == init.getNumParallelLoops())
+        chain.push_back(init);
+    chain.push_back(producer);
+    chain.push_back(epilogue);
+    tileSizes.assign(producerTileSizes.begin(), producerTileSizes.end());
+    return chain;
+  }
+  return {};
+}
+
+namespace {
+class FuseLinalgEpilogues
+    : public FuseLinalgEpiloguesBase<FuseLinalgEpilogues> {
+public:
+  FuseLinalgEpilogues() = default;
+  FuseLinalgEpilogues(const LinalgTilingStrategy &strategy) {
+    parallelize = strategy.parallelize;
+    matmulTileSizes = ArrayRef<int64_t>(strategy.matmulL2TileSizes);
+    convTileSizes = ArrayRef<int64_t>(strategy.convL2TileSizes);
+  }
+
+  void runOnOperation() override {
+    FuncOp func = getOperation();
+    SmallVector<linalg::GenericOp, 4> epilogues;
+    func.walk([&](linalg::GenericOp op) {
+      if (op.hasBufferSemantics())
+        epilogues.push_back(op);
+    });
+
+    auto loopType = parallelize ? linalg::LinalgTilingLoopType::ParallelLoops
+                                : linalg::LinalgTilingLoopType::Loops;
+    for (linalg::GenericOp epilogue : epilogues) {
+      SmallVector<int64_t, 4> tileSizes;
+      SmallVector<linalg::LinalgOp, 3> chain = getFusionChain(
+          epilogue, *matmulTileSizes, *convTileSizes, tileSizes);
+      if (chain.empty())
+        continue;
+
+      // The dependence graph has to be rebuilt after each fusion, since
+      // fusion creates and erases ops.
+      linalg::Aliases aliases;
+      auto graph = linalg::LinalgDependenceGraph::buildDependenceGraph(
+          aliases, func);
+      OpBuilder builder(epilogue);
+      auto options = linalg::LinalgTilingOptions()
+                         .setTileSizes(tileSizes)
+                         .setLoopType(loopType);
+      auto fused =
+          linalg::tileAndFuseLinalgOps(builder, chain, graph, options);
+      if (!fused)
+        continue;
+      for (linalg::LinalgOp op : llvm::reverse(chain))
+        op->erase();
+    }
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createFuseLinalgEpiloguesPass() {
+  return std::make_unique<FuseLinalgEpilogues>();
+}
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createFuseLinalgEpiloguesPass(
+    const LinalgTilingStrategy &strategy) {
+  return std::make_unique<FuseLinalgEpilogues>(strategy);
+}
@@ -0,0 +1,152 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Computes the shapes of a function once, at its entry, instead of once per
+// op.
+//
+// The lowering of each op on tensors with dynamic dimensions computes its
+// result shape where the op is: it queries the extents of its operands
+// (`memref.dim`), combines them, packs them into an extent tensor
+// (`tensor.from_elements`), and the allocation of its result
+// (`refback.alloc_memref`, see LowerAllocMemRefOps) then extracts them again
+// one by one. For a chain of ops on tensors of the same shape, the same
+// extents are queried over and over. This pass
+// - forwards extracted extents to the values they were packed from, and the
+//   extents of buffers to the sizes they were allocated with, which leaves
+//   most extent tensors unused,
+// - and then moves the shape computations (ops without side effects on
+//   extents) that only depend on the function arguments into a single block
+//   of ops at the function entry, merging the duplicates.
+//
+// The ops that compute the shapes of intermediate results from their own
+// (runtime-dependent) operands stay in place, but also reuse the hoisted
+// extents.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+
+#include "mlir/Dialect/MemRef/IR/MemRef.h"
+#include "mlir/Dialect/StandardOps/IR/Ops.h"
+#include "mlir/Dialect/Tensor/IR/Tensor.h"
+#include "mlir/IR/Matchers.h"
+#include "mlir/Interfaces/SideEffectInterfaces.h"
+#include "mlir/Transforms/GreedyPatternRewriteDriver.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+// Returns true if `type` is a type of extents, or of values computed along
+// with them.
+static bool isShapeLikeType(Type type) {
+  if (auto tensorType = type.dyn_cast<RankedTensorType>())
+    return tensorType.getElementType().isIndex();
+  return type.isIndex() || type.isSignlessInteger();
+}
+
+// Returns true if `index` is a constant in [0, size).
+static bool isConstantInBounds(Value index, int64_t size) {
+  APInt value;
+  return matchPattern(index, m_ConstantInt(&value)) &&
+         value.getSExtValue() >= 0 && value.getSExtValue() < size;
+}
+
+// Returns true if `op` computes shapes, and can be executed unconditionally
+// at the function entry.
+static bool isHoistable(Operation *op) {
+  if (op->getNumRegions() != 0 || op->getNumResults() == 0 ||
+      !llvm::all_of(op->getResultTypes(), isShapeLikeType) ||
+      !MemoryEffectOpInterface::hasNoEffect(op))
+    return false;
+  // Integer division traps on a zero divisor, which an earlier assertion may
+  // have ruled out.
+  if (isa<SignedDivIOp, UnsignedDivIOp, SignedRemIOp, UnsignedRemIOp,
+          SignedCeilDivIOp, SignedFloorDivIOp>(op))
+    return false;
+  // Accesses out of bounds are undefined.
+  if (auto dim = dyn_cast<memref::DimOp>(op))
+    return dim.getConstantIndex().hasValue();
+  if (auto extract = dyn_cast<tensor::ExtractOp>(op)) {
+    auto type = extract.tensor().getType().dyn_cast<RankedTensorType>();
+    if (!type || !type.hasStaticShape())
+      return false;
+    for (auto index : llvm::enumerate(extract.indices()))
+      if (!isConstantInBounds(index.value(), type.getDimSize(index.index())))
+        return false;
+  }
+  return true;
+}
+
+// Returns true if `lhs` and `rhs` compute the same values from the same
+// operands.
+static bool areEquivalent(Operation *lhs, Operation *rhs) {
+  return lhs->getName() == rhs->getName() &&
+         lhs->getOperands() == rhs->getOperands() &&
+         lhs->getAttrDictionary() == rhs->getAttrDictionary() &&
+         lhs->getResultTypes() == rhs->getResultTypes();
+}
+
+namespace {
+class HoistShapeComputations
+    : public HoistShapeComputationsBase<HoistShapeComputations> {
+  void runOnOperation() override {
+    FuncOp func = getOperation();
+    auto *context = &getContext();
+
+    // Forward the extents. This folds the extents of buffers to the sizes
+    // they were allocated with, and the extracted elements of extent tensors
+    // to the values they were built from, and erases the unused ops.
+    RewritePatternSet patterns(context);
+    memref::DimOp::getCanonicalizationPatterns(patterns, context);
+    tensor::ExtractOp::getCanonicalizationPatterns(patterns, context);
+    tensor::GenerateOp::getCanonicalizationPatterns(patterns, context);
+    (void)applyPatternsAndFoldGreedily(func, std::move(patterns));
+
+    // Move the shape computations that only depend on the arguments to the
+    // entry, in program order, so that their operands are hoisted before
+    // them.
+    Block &entry = func.getBody().front();
+    SmallVector<Operation *, 32> ops;
+    func.walk([&](Operation *op) {
+      if (isHoistable(op))
+        ops.push_back(op);
+    });
+    SmallVector<Operation *, 32> hoistedOps;
+    llvm::SmallPtrSet<Operation *, 32> isHoisted;
+    auto isAvailable = [&](Value value) {
+      if (auto arg = value.dyn_cast<BlockArgument>())
+        return arg.getOwner() == &entry;
+      return isHoisted.contains(value.getDefiningOp());
+    };
+    for (Operation *op : ops) {
+      if (!llvm::all_of(op->getOperands(), isAvailable))
+        continue;
+      auto earlier = llvm::find_if(hoistedOps, [&](Operation *other) {
+        return areEquivalent(other, op);
+      });
+      if (earlier != hoistedOps.end()) {
+        op->replaceAllUsesWith(*earlier);
+        op->erase();
+        continue;
+      }
+      if (hoistedOps.empty())
+        op->moveBefore(&entry, entry.begin());
+      else if (op->getPrevNode() != hoistedOps.back())
+        op->moveAfter(hoistedOps.back());
+      hoistedOps.push_back(op);
+      isHoisted.insert(op);
+    }
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createHoistShapeComputationsPass() {
+  return std::make_unique<HoistShapeComputations>();
+}
@@ -0,0 +1,236 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Hoists shape constraints (`shape.cstr_*`) and the shape computations they
+// depend on out of `shape.assuming` regions, and removes the constraints that
+// are implied by earlier ones, so that each distinct constraint is checked
+// once per call instead of once per op.
+//
+// The lowering of each broadcasting TCF op checks that its operand shapes are
+// broadcastable, and computes its result shape as their `shape.broadcast`
+// inside a `shape.assuming` region. The shape of the result of such a region
+// is then queried again by the next op. This pass
+// - hoists the computations of shapes (ops with only index-like results,
+//   which can't fail) and the constraints out of `shape.assuming` regions,
+//   which execute unconditionally,
+// - forwards the shape of the results of `shape.assuming` regions to the
+//   shape computed inside of them (through elementwise ops and
+//   `tcp.broadcast_to`),
+// - and, since broadcasting is associative, commutative and idempotent,
+//   treats each shape as the broadcast of a set of "base" shapes: a
+//   `shape.cstr_broadcastable` is implied by an earlier one over a superset
+//   of its base shapes, and `shape.broadcast`s of the same base shapes are
+//   equal. Other duplicated constraints and shape computations are merged.
+//
+// Hoisting keeps the constraints in program order, so a shape computed from
+// shapes that are not broadcastable is only used after the constraint on them
+// has aborted the program.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+
+#include "mlir/Dialect/Shape/IR/Shape.h"
+#include "mlir/IR/Dominance.h"
+#include "mlir/Interfaces/SideEffectInterfaces.h"
+#include "npcomp/Dialect/TCP/IR/TCPOps.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+static bool isConstraint(Operation *op) {
+  return isa<shape::CstrBroadcastableOp, shape::CstrEqOp,
+             shape::CstrRequireOp>(op);
+}
+
+// Returns true if `type` is a type of shapes, witnesses, or the values they
+// are computed from.
+static bool isShapeLikeType(Type type) {
+  if (auto tensorType = type.dyn_cast<RankedTensorType>())
+    return tensorType.getElementType().isIndex();
+  return type.isIndex() || type.isSignlessInteger() ||
+         type.isa<shape::ShapeType, shape::SizeType, shape::WitnessType>();
+}
+
+// Returns true if `op` can be executed earlier without changing the behavior
+// of the program, besides reporting a failed constraint earlier.
+static bool isHoistable(Operation *op) {
+  if (op->getNumRegions() != 0 || op->getNumResults() == 0 ||
+      !llvm::all_of(op->getResultTypes(), isShapeLikeType))
+    return false;
+  return isConstraint(op) || isa<shape::AssumingAllOp>(op) ||
+         MemoryEffectOpInterface::hasNoEffect(op);
+}
+
+// Returns true if `value` is defined inside of `op`.
+static bool isDefinedInside(Value value, Operation *op) {
+  return op->isAncestor(value.getParentBlock()->getParentOp());
+}
+
+// Moves `op` out of the `shape.assuming` regions it is in, as far as its
+// operands allow.
+static void hoistOutOfAssumingRegions(Operation *op) {
+  while (auto assuming = dyn_cast<shape::AssumingOp>(op->getParentOp())) {
+    if (llvm::any_of(op->getOperands(), [&](Value operand) {
+          return isDefinedInside(operand, assuming);
+        }))
+      return;
+    op->moveBefore(assuming);
+  }
+}
+
+// Returns the shape value computed for `tensor`, if there is one.
+static Value getComputedShape(Value tensor) {
+  while (auto result = tensor.dyn_cast<OpResult>()) {
+    Operation *op = result.getOwner();
+    if (auto assuming = dyn_cast<shape::AssumingOp>(op)) {
+      Operation *yield = assuming.doRegion().front().getTerminator();
+      tensor = yield->getOperand(result.getResultNumber());
+    } else if (auto broadcastTo = dyn_cast<tcp::BroadcastToOp>(op)) {
+      return broadcastTo.shape();
+    } else if (op->hasTrait<OpTrait::Elementwise>() &&
+               op->getNumOperands() != 0 &&
+               op->getOperand(0).getType().isa<RankedTensorType>()) {
+      // All operands of elementwise ops on tensors have the result shape.
+      tensor = op->getOperand(0);
+    } else {
+      return nullptr;
+    }
+  }
+  return nullptr;
+}
+
+namespace {
+// Maps shapes to the base shapes they are the broadcast of.
+class BaseShapes {
+public:
+  ArrayRef<Value> get(Value shape) {
+    auto it = baseShapes.find(shape);
+    if (it != baseShapes.end())
+      return it->second;
+    SmallVector<Value, 4> bases;
+    if (auto broadcast = shape.getDefiningOp<shape::BroadcastOp>())
+      bases = getUnion(broadcast->getOperands());
+    else
+      bases.push_back(shape);
+    return baseShapes[shape] = bases;
+  }
+
+  // Returns the sorted union of the base shapes of `shapes`.
+  SmallVector<Value, 4> getUnion(ValueRange shapes) {
+    SmallVector<Value, 4> bases;
+    for (Value shape : shapes) {
+      ArrayRef<Value> shapeBases = get(shape);
+      bases.append(shapeBases.begin(), shapeBases.end());
+    }
+    llvm::sort(bases, [](Value lhs, Value rhs) {
+      return lhs.getAsOpaquePointer() < rhs.getAsOpaquePointer();
+    });
+    bases.erase(std::unique(bases.begin(), bases.end()), bases.end());
+    return bases;
+  }
+
+private:
+  DenseMap<Value, SmallVector<Value, 4>> baseShapes;
+};
+} // namespace
+
+// Returns true if `lhs` and `rhs` compute the same values from the same
+// operands.
+static bool areEquivalent(Operation *lhs, Operation *rhs) {
+  return lhs->getName() == rhs->getName() &&
+         lhs->getOperands() == rhs->getOperands() &&
+         lhs->getAttrDictionary() == rhs->getAttrDictionary() &&
+         lhs->getResultTypes() == rhs->getResultTypes();
+}
+
+namespace {
+class HoistShapeConstraints
+    : public HoistShapeConstraintsBase<HoistShapeConstraints> {
+  void runOnOperation() override {
+    FuncOp func = getOperation();
+    DominanceInfo &domInfo = getAnalysis<DominanceInfo>();
+
+    // Ops are visited in program order, after the ops in their regions.
+    SmallVector<Operation *, 32> ops;
+    func.walk([&](Operation *op) { ops.push_back(op); });
+    for (Operation *op : ops) {
+      if (isHoistable(op))
+        hoistOutOfAssumingRegions(op);
+      auto shapeOf = dyn_cast<shape::ShapeOfOp>(op);
+      if (!shapeOf || !shapeOf.arg().getDefiningOp<shape::AssumingOp>())
+        continue;
+      Value shape = getComputedShape(shapeOf.arg());
+      if (shape && shape.getType() == shapeOf.getType() &&
+          domInfo.properlyDominates(shape, shapeOf)) {
+        shapeOf.replaceAllUsesWith(shape);
+        shapeOf.erase();
+      }
+    }
+
+    // Remove the ops that are equivalent to, or implied by, an earlier one.
+    BaseShapes baseShapes;
+    SmallVector<std::pair<Operation *, SmallVector<Value, 4>>, 8> broadcasts;
+    SmallVector<Operation *, 32> keptOps;
+    ops.clear();
+    func.walk([&](Operation *op) {
+      if (isHoistable(op))
+        ops.push_back(op);
+    });
+    for (Operation *op : ops) {
+      if (isa<shape::CstrBroadcastableOp, shape::BroadcastOp>(op)) {
+        SmallVector<Value, 4> bases = baseShapes.getUnion(op->getOperands());
+        bool isBroadcastable = isa<shape::CstrBroadcastableOp>(op);
+        auto earlier = llvm::find_if(broadcasts, [&](const auto &broadcast) {
+          Operation *other = broadcast.first;
+          if (other->getName() != op->getName() ||
+              other->getResultTypes() != op->getResultTypes() ||
+              !domInfo.properlyDominates(other, op))
+            return false;
+          // A constraint implies the constraints on subsets of its shapes.
+          if (isBroadcastable)
+            return llvm::all_of(bases, [&](Value base) {
+              return llvm::is_contained(broadcast.second, base);
+            });
+          return broadcast.second == bases;
+        });
+        if (earlier == broadcasts.end()) {
+          broadcasts.emplace_back(op, std::move(bases));
+          continue;
+        }
+        if (isBroadcastable) {
+          OpBuilder builder(op);
+          op->replaceAllUsesWith(builder.create<shape::ConstWitnessOp>(
+              op->getLoc(), /*passing=*/true));
+        } else {
+          op->replaceAllUsesWith(earlier->first);
+        }
+        op->erase();
+        continue;
+      }
+
+      auto earlier = llvm::find_if(keptOps, [&](Operation *other) {
+        return areEquivalent(other, op) &&
+               domInfo.properlyDominates(other, op);
+      });
+      if (earlier == keptOps.end()) {
+        keptOps.push_back(op);
+        continue;
+      }
+      op->replaceAllUsesWith(*earlier);
+      op->erase();
+    }
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createHoistShapeConstraintsPass() {
+  return std::make_unique<HoistShapeConstraints>();
+}
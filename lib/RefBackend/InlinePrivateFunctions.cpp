@@ -0,0 +1,249 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Removes the calls of private functions (such as the helpers that frontends
+// outline) from the functions that the RefBackend compiles: the small or
+// singly called ones are inlined, and the others are specialized for the
+// static shapes of their operands, so that fusion, memory planning and shape
+// refinement see the dataflow of the whole program.
+//
+// The upstream inliner is not used, as the TCF dialect has no inliner
+// interface, and the calls with static operands need their TCF users to see
+// the static types: the bodies of single block callees are simply cloned in
+// place of their calls.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+
+#include "mlir/Dialect/StandardOps/IR/Ops.h"
+#include "mlir/Dialect/Tensor/IR/Tensor.h"
+#include "mlir/IR/BlockAndValueMapping.h"
+#include "mlir/IR/BuiltinOps.h"
+#include "mlir/IR/SymbolTable.h"
+#include "npcomp/Dialect/TCF/IR/TCFDialect.h"
+#include "llvm/ADT/SetVector.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+// Makes the TCF users of `cast`, which casts a static value to the type that
+// they were declared to read, read the static value instead, and erases
+// `cast` if that leaves it unused. TCF ops accept any refinement of their
+// operand types, and propagate it during shape refinement.
+static void forwardToTCFUsers(tensor::CastOp cast) {
+  for (OpOperand &use : llvm::make_early_inc_range(cast.getResult().getUses()))
+    if (isa_and_nonnull<tcf::TCFDialect>(use.getOwner()->getDialect()))
+      use.set(cast.source());
+  if (cast.use_empty())
+    cast.erase();
+}
+
+// Returns true if `type` is a tensor type strictly more static than
+// `declared`, which it is compatible with.
+static bool isRefinementOf(Type type, Type declared) {
+  auto tensorType = type.dyn_cast<RankedTensorType>();
+  auto declaredType = declared.dyn_cast<TensorType>();
+  if (!tensorType || !declaredType || type == declared ||
+      !tensor::CastOp::areCastCompatible(type, declared))
+    return false;
+  if (!declaredType.hasRank())
+    return true;
+  for (int64_t i = 0, e = tensorType.getRank(); i < e; i++)
+    if (declaredType.isDynamicDim(i) && !tensorType.isDynamicDim(i))
+      return true;
+  return false;
+}
+
+// Returns the most static value that `value` is a `tensor.cast` of, or
+// `value`. The calls of a function have operands of the declared types of
+// its arguments, so static operands are cast to them.
+static Value getStaticSource(Value value) {
+  while (auto cast = value.getDefiningOp<tensor::CastOp>()) {
+    if (!isRefinementOf(cast.source().getType(), value.getType()))
+      break;
+    value = cast.source();
+  }
+  return value;
+}
+
+// Erases the `tensor.cast` defining `value` if nothing uses it anymore.
+static void eraseIfUnusedCast(Value value) {
+  if (auto cast = value.getDefiningOp<tensor::CastOp>())
+    if (cast.use_empty())
+      cast.erase();
+}
+
+// Returns the number of ops of the body of `func`, including nested ones.
+static int64_t getNumOps(FuncOp func) {
+  int64_t numOps = 0;
+  func.getBody().walk([&](Operation *) { numOps++; });
+  return numOps;
+}
+
+// Replaces `call` with a copy of the body of `callee`, which has a single
+// block.
+static void inlineCall(CallOp call, FuncOp callee) {
+  OpBuilder builder(call);
+  Block &body = callee.getBody().front();
+  BlockAndValueMapping mapping;
+  SmallVector<tensor::CastOp, 4> casts;
+  for (auto it : llvm::zip(body.getArguments(), call.getOperands())) {
+    BlockArgument arg = std::get<0>(it);
+    Value operand = std::get<1>(it);
+    Value source = getStaticSource(operand);
+    if (source == operand) {
+      mapping.map(arg, operand);
+      continue;
+    }
+    auto cast =
+        builder.create<tensor::CastOp>(call.getLoc(), arg.getType(), source);
+    casts.push_back(cast);
+    mapping.map(arg, cast.getResult());
+  }
+  for (Operation &op : body.without_terminator())
+    builder.clone(op, mapping);
+  SmallVector<Value, 4> results;
+  for (Value result : body.getTerminator()->getOperands())
+    results.push_back(mapping.lookupOrDefault(result));
+  llvm::SetVector<Value> operands(call.getOperands().begin(),
+                                  call.getOperands().end());
+  call->replaceAllUsesWith(results);
+  call.erase();
+  for (tensor::CastOp cast : casts)
+    forwardToTCFUsers(cast);
+  for (Value operand : operands)
+    eraseIfUnusedCast(operand);
+}
+
+// Returns a private copy of `callee` taking arguments of `argTypes`, which
+// refine those of `callee`, inserted after `callee`.
+static FuncOp cloneWithArgTypes(FuncOp callee, TypeRange argTypes,
+                                SymbolTable &symbolTable, unsigned &counter) {
+  FuncOp clone = callee.clone();
+  clone.setName((callee.getName() + ".static" + Twine(counter++)).str());
+  clone.setPrivate();
+  // This renames the copy if the name is taken.
+  symbolTable.insert(clone, std::next(Block::iterator(callee)));
+
+  Block &entry = clone.getBody().front();
+  OpBuilder builder = OpBuilder::atBlockBegin(&entry);
+  for (auto it : llvm::zip(entry.getArguments(), argTypes)) {
+    BlockArgument arg = std::get<0>(it);
+    Type declaredType = arg.getType();
+    if (std::get<1>(it) == declaredType)
+      continue;
+    arg.setType(std::get<1>(it));
+    auto cast = builder.create<tensor::CastOp>(clone.getLoc(), declaredType,
+                                               arg);
+    arg.replaceAllUsesExcept(cast.getResult(), cast);
+    forwardToTCFUsers(cast);
+  }
+  clone.setType(FunctionType::get(clone.getContext(), argTypes,
+                                  callee.getType().getResults()));
+  return clone;
+}
+
+namespace {
+class InlinePrivateFunctions
+    : public InlinePrivateFunctionsBase<InlinePrivateFunctions> {
+  void runOnOperation() override {
+    ModuleOp module = getOperation();
+    SymbolTable symbolTable(module);
+
+    // Returns the private callee of `call` with a body, if any.
+    auto getPrivateCallee = [&](CallOp call) -> FuncOp {
+      auto callee = symbolTable.lookup<FuncOp>(call.getCallee());
+      if (!callee || !callee.isPrivate() || callee.isExternal())
+        return nullptr;
+      return callee;
+    };
+
+    for (unsigned iteration = 0; iteration < maxIterations; iteration++) {
+      SmallVector<CallOp, 8> calls;
+      llvm::DenseMap<Operation *, int64_t> numCalls;
+      module.walk([&](CallOp call) {
+        if (FuncOp callee = getPrivateCallee(call)) {
+          calls.push_back(call);
+          numCalls[callee]++;
+        }
+      });
+
+      bool changed = false;
+      for (CallOp call : calls) {
+        FuncOp callee = getPrivateCallee(call);
+        // Recursive calls are only specialized.
+        if (callee == call->getParentOfType<FuncOp>())
+          continue;
+        if (callee.getBody().hasOneBlock() &&
+            (numCalls[callee] == 1 ||
+             getNumOps(callee) <= static_cast<int64_t>(inlineThreshold))) {
+          inlineCall(call, callee);
+          changed = true;
+        }
+      }
+      if (!changed)
+        break;
+    }
+
+    // Specialize the calls left for the static types of their operands,
+    // sharing the copies between calls of the same types.
+    llvm::DenseMap<std::pair<Operation *, Type>, FuncOp> clones;
+    llvm::DenseMap<Operation *, unsigned> counters;
+    SmallVector<CallOp, 8> calls;
+    module.walk([&](CallOp call) { calls.push_back(call); });
+    for (CallOp call : calls) {
+      FuncOp callee = getPrivateCallee(call);
+      if (!callee)
+        continue;
+      TypeRange declaredTypes = callee.getType().getInputs();
+      bool refines = false;
+      SmallVector<Type, 4> argTypes;
+      for (auto it : llvm::zip(call.getOperands(), declaredTypes)) {
+        Type type = getStaticSource(std::get<0>(it)).getType();
+        Type declaredType = std::get<1>(it);
+        if (type != declaredType) {
+          argTypes.push_back(type);
+          refines = true;
+        } else {
+          argTypes.push_back(declaredType);
+        }
+      }
+      if (!refines)
+        continue;
+      FuncOp &clone = clones[std::make_pair(
+          callee.getOperation(),
+          Type(FunctionType::get(&getContext(), argTypes, {})))];
+      if (!clone)
+        clone = cloneWithArgTypes(callee, argTypes, symbolTable,
+                                  counters[callee]);
+      OpBuilder builder(call);
+      call->setAttr("callee", builder.getSymbolRefAttr(clone.getName()));
+      for (auto it : llvm::enumerate(argTypes)) {
+        Value operand = call.getOperand(it.index());
+        if (operand.getType() == it.value())
+          continue;
+        call->setOperand(it.index(), getStaticSource(operand));
+        eraseIfUnusedCast(operand);
+      }
+    }
+
+    // Delete the private functions that no call is left to.
+    for (FuncOp func : llvm::make_early_inc_range(module.getOps<FuncOp>())) {
+      if (func.isPrivate() && SymbolTable::symbolKnownUseEmpty(func, module))
+        func.erase();
+    }
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<ModuleOp>>
+mlir::NPCOMP::createInlinePrivateFunctionsPass() {
+  return std::make_unique<InlinePrivateFunctions>();
+}
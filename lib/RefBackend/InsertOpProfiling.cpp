@@ -0,0 +1,112 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Instrumentation of the top-level ops of a function for the runtime's per-op
+// profile.
+//
+// This runs late enough that the tile loops of an op (along with any epilogue
+// fused into them) are timed as a whole, but before vectorization and the
+// lowering of linalg ops to loops erase the linalg ops that give the profiled
+// ops their names.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+
+#include "mlir/Dialect/Linalg/IR/LinalgOps.h"
+#include "mlir/Interfaces/LoopLikeInterface.h"
+#include "npcomp/Dialect/Refbackrt/IR/RefbackrtOps.h"
+#include "llvm/Support/Path.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+// Returns the file location that `loc` is derived from, if any.
+static Optional<FileLineColLoc> getFileLocation(Location loc) {
+  if (auto fileLoc = loc.dyn_cast<FileLineColLoc>())
+    return fileLoc;
+  if (auto nameLoc = loc.dyn_cast<NameLoc>())
+    return getFileLocation(nameLoc.getChildLoc());
+  if (auto callSiteLoc = loc.dyn_cast<CallSiteLoc>())
+    return getFileLocation(callSiteLoc.getCallee());
+  if (auto fusedLoc = loc.dyn_cast<FusedLoc>())
+    for (Location child : fusedLoc.getLocations())
+      if (auto fileLoc = getFileLocation(child))
+        return fileLoc;
+  return None;
+}
+
+// Returns the name of the innermost scope that `loc` is in, such as the
+// method of the module that TorchScript ops come from (see
+// GlobalizeObjectGraph), if any.
+static Optional<StringRef> getScopeName(Location loc) {
+  if (auto nameLoc = loc.dyn_cast<NameLoc>())
+    return nameLoc.getName().strref();
+  if (auto callSiteLoc = loc.dyn_cast<CallSiteLoc>())
+    return getScopeName(callSiteLoc.getCallee());
+  if (auto fusedLoc = loc.dyn_cast<FusedLoc>())
+    for (Location child : fusedLoc.getLocations())
+      if (auto name = getScopeName(child))
+        return name;
+  return None;
+}
+
+// Returns the name of the profiled op `op`, such as
+// "linalg.matmul+linalg.generic at model.py:12:8 in layer1.0.forward".
+static std::string getProfiledOpName(Operation *op) {
+  SmallVector<StringRef, 4> linalgOpNames;
+  op->walk([&](linalg::LinalgOp linalgOp) {
+    StringRef name = linalgOp->getName().getStringRef();
+    if (!llvm::is_contained(linalgOpNames, name))
+      linalgOpNames.push_back(name);
+  });
+  std::string name;
+  llvm::raw_string_ostream os(name);
+  if (linalgOpNames.empty())
+    os << op->getName().getStringRef();
+  else
+    llvm::interleave(linalgOpNames, os, "+");
+  if (auto fileLoc = getFileLocation(op->getLoc()))
+    os << " at " << llvm::sys::path::filename(fileLoc->getFilename().strref())
+       << ":" << fileLoc->getLine() << ":" << fileLoc->getColumn();
+  if (auto scopeName = getScopeName(op->getLoc()))
+    os << " in " << *scopeName;
+  return os.str();
+}
+
+static void insertProfiling(Block &block) {
+  for (Operation &op : llvm::make_early_inc_range(block)) {
+    if (!isa<linalg::LinalgOp, LoopLikeOpInterface>(op)) {
+      for (Region &region : op.getRegions())
+        for (Block &nestedBlock : region)
+          insertProfiling(nestedBlock);
+      continue;
+    }
+    OpBuilder builder(&op);
+    Value start = builder.create<refbackrt::ProfileBeginOp>(
+        op.getLoc(), builder.getIntegerType(64));
+    builder.setInsertionPointAfter(&op);
+    builder.create<refbackrt::ProfileEndOp>(
+        op.getLoc(), builder.getStringAttr(getProfiledOpName(&op)), start);
+  }
+}
+
+namespace {
+class InsertOpProfiling : public InsertOpProfilingBase<InsertOpProfiling> {
+  void runOnOperation() override {
+    for (Block &block : getOperation().getBody())
+      insertProfiling(block);
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createInsertOpProfilingPass() {
+  return std::make_unique<InsertOpProfiling>();
+}
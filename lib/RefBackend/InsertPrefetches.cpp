@@ -0,0 +1,167 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Inserts software prefetches for the strided and indirect loads of innermost
+// `scf.for` loops, which hardware prefetchers don't follow.
+//
+// The loops that linalg ops lower to read some operands across rows (such as
+// the transposed operand of a matmul, or the filter of a convolution whose
+// innermost loop is over its input channels) and some through indices loaded
+// from other memrefs (gathers). Such a load in
+//   scf.for %k = %c0 to %K step %c1 {
+//     %b = memref.load %B[%k, %j]
+//     ...
+//   }
+// gets a prefetch of the element it loads `distance` iterations later:
+//   %ahead = addi %k, %distance
+//   %in_range = cmpi slt, %ahead, %K
+//   %next = select %in_range, %ahead, %k
+//   memref.prefetch %B[%next, %j], read, locality<3>, data
+// The computation of the indices (including the loads of gathered indices) is
+// repeated for %next, which stays in the iteration space so that the repeated
+// loads are in bounds. Loads whose only varying index is the innermost one are
+// sequential, and are left to the hardware prefetchers.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+
+#include "mlir/Dialect/StandardOps/IR/Ops.h"
+#include "mlir/IR/BlockAndValueMapping.h"
+#include "mlir/Interfaces/SideEffectInterfaces.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+// Returns true if `value` is computed from the induction variable of `loop`
+// by ops of its body, and sets `throughLoad` if this involves a load.
+static bool dependsOnInductionVar(Value value, scf::ForOp loop,
+                                  bool &throughLoad) {
+  if (value == loop.getInductionVar())
+    return true;
+  Operation *op = value.getDefiningOp();
+  if (!op || op->getBlock() != loop.getBody())
+    return false;
+  bool depends = false;
+  for (Value operand : op->getOperands())
+    depends |= dependsOnInductionVar(operand, loop, throughLoad);
+  if (depends && isa<memref::LoadOp>(op))
+    throughLoad = true;
+  return depends;
+}
+
+// Adds the ops of the body of `loop` that `value` is computed from to `slice`.
+// Returns false if one of them can't be repeated for a later iteration.
+static bool collectSlice(Value value, scf::ForOp loop,
+                         llvm::SmallPtrSetImpl<Operation *> &slice) {
+  Operation *op = value.getDefiningOp();
+  if (!op || op->getBlock() != loop.getBody() || !slice.insert(op).second)
+    return true;
+  if (op->getNumRegions() != 0 ||
+      !(isa<memref::LoadOp>(op) || MemoryEffectOpInterface::hasNoEffect(op)))
+    return false;
+  return llvm::all_of(op->getOperands(), [&](Value operand) {
+    return collectSlice(operand, loop, slice);
+  });
+}
+
+// Returns true if `load` accesses its memref in an order that hardware
+// prefetchers don't follow: across rows, or through loaded indices.
+static bool needsPrefetch(memref::LoadOp load, scf::ForOp loop) {
+  bool throughLoad = false;
+  bool acrossRows = false;
+  auto indices = load.indices();
+  for (auto index : llvm::enumerate(indices)) {
+    if (dependsOnInductionVar(index.value(), loop, throughLoad) &&
+        index.index() + 1 != indices.size())
+      acrossRows = true;
+  }
+  return acrossRows || throughLoad;
+}
+
+static bool isInnermostLoop(scf::ForOp loop) {
+  auto result = loop.getBody()->walk([](Operation *op) {
+    return isa<scf::ForOp, scf::ParallelOp>(op) ? WalkResult::interrupt()
+                                                : WalkResult::advance();
+  });
+  return !result.wasInterrupted();
+}
+
+static void insertPrefetches(scf::ForOp loop, unsigned distance) {
+  SmallVector<memref::LoadOp, 4> loads;
+  for (auto load : loop.getBody()->getOps<memref::LoadOp>())
+    if (needsPrefetch(load, loop))
+      loads.push_back(load);
+  if (loads.empty())
+    return;
+
+  Location loc = loop.getLoc();
+  OpBuilder builder(loop);
+  Value offset = builder.create<MulIOp>(
+      loc, loop.step(), builder.create<ConstantIndexOp>(loc, distance));
+  builder.setInsertionPointToStart(loop.getBody());
+  Value iv = loop.getInductionVar();
+  Value ahead = builder.create<AddIOp>(loc, iv, offset);
+  Value inRange =
+      builder.create<CmpIOp>(loc, CmpIPredicate::slt, ahead, loop.upperBound());
+  Value next = builder.create<SelectOp>(loc, inRange, ahead, iv);
+
+  for (memref::LoadOp load : loads) {
+    llvm::SmallPtrSet<Operation *, 8> slice;
+    if (!llvm::all_of(load.indices(), [&](Value index) {
+          return collectSlice(index, loop, slice);
+        }))
+      continue;
+    builder.setInsertionPoint(load);
+    BlockAndValueMapping mapping;
+    mapping.map(iv, next);
+    for (Operation &op : loop.getBody()->without_terminator()) {
+      if (&op == load.getOperation())
+        break;
+      if (slice.count(&op))
+        builder.clone(op, mapping);
+    }
+    SmallVector<Value, 4> indices;
+    for (Value index : load.indices())
+      indices.push_back(mapping.lookupOrDefault(index));
+    builder.create<memref::PrefetchOp>(load.getLoc(), load.memref(), indices,
+                                       /*isWrite=*/false, /*localityHint=*/3,
+                                       /*isDataCache=*/true);
+  }
+}
+
+namespace {
+class InsertPrefetches : public InsertPrefetchesBase<InsertPrefetches> {
+public:
+  InsertPrefetches() = default;
+  InsertPrefetches(unsigned iterations) { distance = iterations; }
+
+  void runOnOperation() override {
+    if (distance == 0)
+      return;
+    SmallVector<scf::ForOp, 8> loops;
+    getOperation().walk([&](scf::ForOp loop) {
+      if (isInnermostLoop(loop))
+        loops.push_back(loop);
+    });
+    for (scf::ForOp loop : loops)
+      insertPrefetches(loop, distance);
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createInsertPrefetchesPass() {
+  return std::make_unique<InsertPrefetches>();
+}
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createInsertPrefetchesPass(unsigned distance) {
+  return std::make_unique<InsertPrefetches>(distance);
+}
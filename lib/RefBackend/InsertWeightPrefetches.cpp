@@ -0,0 +1,89 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Prefetches the external globals (typically the weights of a model) that
+// each public function reads, at its entry (see the `prefetch-weights` option
+// of the RefBackend pipeline).
+//
+// External globals are mapped from their files rather than read when the
+// compiled code is loaded, so their pages are only read once touched. Without
+// a hint, the first call of a function faults them in a page at a time, as
+// its loops reach them. A `refbackrt.prefetch_global` at the entry lets the OS
+// read all of them ahead with large reads instead, while the globals of
+// functions that are never called (such as the cold experts of a
+// mixture-of-experts model) are never read at all.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+
+#include "mlir/Dialect/MemRef/IR/MemRef.h"
+#include "mlir/Dialect/StandardOps/IR/Ops.h"
+#include "npcomp/Dialect/Refback/IR/RefbackDialect.h"
+#include "npcomp/Dialect/Refbackrt/IR/RefbackrtOps.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/StringSet.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+namespace {
+class InsertWeightPrefetches
+    : public InsertWeightPrefetchesBase<InsertWeightPrefetches> {
+  void runOnOperation() override {
+    ModuleOp module = getOperation();
+    for (auto global : module.getOps<memref::GlobalOp>()) {
+      Optional<Attribute> initialValue = global.initial_value();
+      if (initialValue && refback::getExternalElements(*initialValue))
+        externalGlobals.insert(global.sym_name());
+    }
+    if (externalGlobals.empty())
+      return;
+
+    SymbolTable symbolTable(module);
+    for (FuncOp func : module.getOps<FuncOp>()) {
+      if (func.isPrivate() || func.isExternal())
+        continue;
+      llvm::SetVector<StringRef> globals;
+      llvm::SmallPtrSet<Operation *, 8> visited;
+      collectExternalGlobals(func, symbolTable, globals, visited);
+      OpBuilder builder(&func.getBody().front(),
+                        func.getBody().front().begin());
+      for (StringRef global : globals)
+        builder.create<refbackrt::PrefetchGlobalOp>(
+            func.getLoc(), builder.getSymbolRefAttr(global));
+    }
+  }
+
+  // Adds the external globals read by `func` and the functions it calls to
+  // `globals`, in the order of their first use.
+  void collectExternalGlobals(FuncOp func, SymbolTable &symbolTable,
+                              llvm::SetVector<StringRef> &globals,
+                              llvm::SmallPtrSetImpl<Operation *> &visited) {
+    if (!visited.insert(func).second)
+      return;
+    func.walk([&](Operation *op) {
+      if (auto getGlobal = dyn_cast<memref::GetGlobalOp>(op)) {
+        if (externalGlobals.count(getGlobal.name()))
+          globals.insert(getGlobal.name());
+      } else if (auto call = dyn_cast<CallOp>(op)) {
+        if (auto callee = symbolTable.lookup<FuncOp>(call.getCallee()))
+          collectExternalGlobals(callee, symbolTable, globals, visited);
+      }
+    });
+  }
+
+  llvm::StringSet<> externalGlobals;
+};
+} // namespace
+
+std::unique_ptr<OperationPass<ModuleOp>>
+mlir::NPCOMP::createInsertWeightPrefetchesPass() {
+  return std::make_unique<InsertWeightPrefetches>();
+}
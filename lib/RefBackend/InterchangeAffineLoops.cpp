@@ -0,0 +1,121 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Interchanges perfectly nested affine loops so that the innermost loop is the
+// one walking the most memref accesses with unit stride.
+//
+// Linalg ops lower to loops in the order of their iteration dimensions, which
+// is not always the best order for the layout of their operands. For example,
+// the reduction loop of a matmul is innermost, so that each iteration reads a
+// new row of the right-hand side. Moving the loop over its columns innermost
+// instead makes all but the left-hand side accesses contiguous.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+
+#include "mlir/Analysis/AffineAnalysis.h"
+#include "mlir/Analysis/Utils.h"
+#include "mlir/Dialect/Affine/IR/AffineValueMap.h"
+#include "mlir/Transforms/LoopUtils.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+// Returns how much better memref accesses get when each loop of `band` is
+// the innermost one: the number of accesses whose last (contiguous) index
+// depends on the loop, minus the number of accesses that it walks with a
+// larger stride.
+static SmallVector<int64_t, 4> getInnermostScores(ArrayRef<AffineForOp> band) {
+  SmallVector<int64_t, 4> scores(band.size(), 0);
+  band.back().getBody()->walk([&](Operation *op) {
+    if (!isa<AffineReadOpInterface, AffineWriteOpInterface>(op))
+      return;
+    MemRefAccess access(op);
+    AffineValueMap accessMap;
+    access.getAccessMap(&accessMap);
+    unsigned rank = accessMap.getNumResults();
+    if (rank == 0)
+      return;
+    for (unsigned i = 0, e = band.size(); i < e; i++) {
+      Value iv = band[i].getInductionVar();
+      if (accessMap.isFunctionOf(rank - 1, iv)) {
+        scores[i]++;
+        continue;
+      }
+      for (unsigned dim = 0; dim + 1 < rank; dim++) {
+        if (accessMap.isFunctionOf(dim, iv)) {
+          scores[i]--;
+          break;
+        }
+      }
+    }
+  });
+  return scores;
+}
+
+// Returns true if the bounds of the loops of `band` don't depend on the
+// induction variables of the other loops of `band`, which permuteLoops
+// requires.
+static bool isRectangular(ArrayRef<AffineForOp> band) {
+  return llvm::all_of(band, [&](AffineForOp loop) {
+    return llvm::all_of(loop->getOperands(), [&](Value operand) {
+      return band.front().isDefinedOutsideOfLoop(operand);
+    });
+  });
+}
+
+// Moves the loop of `band` with the best innermost score innermost, if that
+// is legal.
+static void interchangeBand(MutableArrayRef<AffineForOp> band) {
+  if (band.size() < 2 || !isRectangular(band))
+    return;
+  SmallVector<int64_t, 4> scores = getInnermostScores(band);
+  unsigned best = band.size() - 1;
+  for (unsigned i = 0, e = band.size() - 1; i < e; i++) {
+    if (scores[i] > scores[best])
+      best = i;
+  }
+  if (best == band.size() - 1)
+    return;
+  // Keep the other loops in order.
+  SmallVector<unsigned, 4> permutation;
+  for (unsigned i = 0, e = band.size(); i < e; i++) {
+    if (i == best)
+      permutation.push_back(e - 1);
+    else
+      permutation.push_back(i < best ? i : i - 1);
+  }
+  if (!isValidLoopInterchangePermutation(band, permutation))
+    return;
+  permuteLoops(band, permutation);
+}
+
+namespace {
+class InterchangeAffineLoops
+    : public InterchangeAffineLoopsBase<InterchangeAffineLoops> {
+  void runOnOperation() override {
+    SmallVector<AffineForOp, 4> roots;
+    getOperation().walk([&](AffineForOp loop) {
+      if (!loop->getParentOfType<AffineForOp>())
+        roots.push_back(loop);
+    });
+    for (AffineForOp root : roots) {
+      SmallVector<AffineForOp, 4> band;
+      getPerfectlyNestedLoops(band, root);
+      interchangeBand(band);
+    }
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createInterchangeAffineLoopsPass() {
+  return std::make_unique<InterchangeAffineLoops>();
+}
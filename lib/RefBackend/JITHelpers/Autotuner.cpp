@@ -0,0 +1,184 @@
+//===------------------------------------------------------------*- C++ -*-===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "npcomp/RefBackend/JITHelpers/Autotuner.h"
+#include "mlir/Dialect/StandardOps/IR/Ops.h"
+#include "mlir/IR/BlockAndValueMapping.h"
+#include "mlir/IR/Builders.h"
+#include "mlir/Pass/PassManager.h"
+#include "npcomp/RefBackend/RefBackend.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/Support/Format.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+using namespace refback;
+using namespace mlir;
+using namespace mlir::NPCOMP;
+using llvm::Error;
+using llvm::Expected;
+using llvm::Twine;
+
+static Error make_string_error(const Twine &message) {
+  return llvm::make_error<llvm::StringError>(message.str(),
+                                             llvm::inconvertibleErrorCode());
+}
+
+// Returns a module with a public function @kernel computing `op` alone with
+// `config`, from its operands as arguments.
+static OwningModuleRef createKernelModule(Operation *op,
+                                          const TuningConfig &config) {
+  Location loc = op->getLoc();
+  OwningModuleRef module = ModuleOp::create(loc);
+  OpBuilder builder(module->getBodyRegion());
+  auto func = builder.create<FuncOp>(
+      loc, "kernel",
+      builder.getFunctionType(op->getOperandTypes(), op->getResultTypes()));
+  builder.setInsertionPointToStart(func.addEntryBlock());
+  BlockAndValueMapping mapping;
+  mapping.map(op->getOperands(), func.getArguments());
+  Operation *kernel = builder.clone(*op, mapping);
+  setTuningConfig(kernel, config);
+  builder.create<ReturnOp>(loc, kernel->getResults());
+  return module;
+}
+
+// Creates inputs for the operands of `op`, which have static shapes and f32
+// elements. The values only need to be finite.
+static SmallVector<refbackrt::RtValue, 3> createKernelInputs(Operation *op) {
+  SmallVector<refbackrt::RtValue, 3> inputs;
+  for (Type type : op->getOperandTypes()) {
+    ArrayRef<int64_t> shape = type.cast<ShapedType>().getShape();
+    std::vector<float> elements(type.cast<ShapedType>().getNumElements());
+    for (size_t i = 0, e = elements.size(); i < e; i++)
+      elements[i] = (i % 17) / 16.0f - 0.5f;
+    inputs.push_back(refbackrt::Tensor::create(
+        refbackrt::ArrayRef<std::int64_t>(shape.data(), shape.size()),
+        refbackrt::ElementType::F32, elements.data()));
+  }
+  return inputs;
+}
+
+// Compiles `op` with `config`, and returns its median latency in
+// milliseconds.
+static Expected<double> measureCandidate(Operation *op,
+                                         const TuningConfig &config,
+                                         const AutotuneOptions &options) {
+  auto target = JITModule::getTargetInfo(options.compileOptions);
+  if (!target)
+    return target.takeError();
+  OwningModuleRef module = createKernelModule(op, config);
+  PassManager pm(op->getContext(), OpPassManager::Nesting::Implicit);
+  RefBackendLoweringPipelineOptions pipelineOptions;
+  pipelineOptions.optimize = true;
+  setTargetInfo(pipelineOptions, *target);
+  createRefBackendLoweringPipeline(pm, pipelineOptions);
+  if (failed(pm.run(*module)))
+    return make_string_error("error compiling the candidate");
+  auto jitModule = JITModule::fromCompiledModule(
+      *module, options.sharedLibs, /*objectCacheDir=*/"",
+      options.compileOptions);
+  if (!jitModule)
+    return jitModule.takeError();
+
+  SmallVector<refbackrt::RtValue, 3> inputs = createKernelInputs(op);
+  auto call = (*jitModule)->prepare("kernel", inputs);
+  if (!call)
+    return call.takeError();
+  SmallVector<refbackrt::RtValue, 6> outputs = call->createOutputs();
+  for (unsigned i = 0; i < options.warmup; i++)
+    if (Error error = call->invokeInto(inputs, outputs))
+      return std::move(error);
+  std::vector<double> latencies;
+  for (unsigned i = 0; i < std::max(options.iterations, 1u); i++) {
+    auto start = std::chrono::steady_clock::now();
+    if (Error error = call->invokeInto(inputs, outputs))
+      return std::move(error);
+    latencies.push_back(std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count());
+  }
+  std::nth_element(latencies.begin(),
+                   latencies.begin() + latencies.size() / 2, latencies.end());
+  return latencies[latencies.size() / 2];
+}
+
+static void printConfig(const TuningConfig &config, llvm::raw_ostream &os) {
+  if (config == TuningConfig()) {
+    os << "heuristics";
+    return;
+  }
+  StringRef separator = "";
+  if (!config.convStrategy.empty()) {
+    os << config.convStrategy;
+    separator = " ";
+  }
+  auto printSizes = [&](StringRef level, ArrayRef<int64_t> sizes) {
+    if (sizes.empty())
+      return;
+    os << separator << level << "=";
+    llvm::interleave(sizes, os, "x");
+    separator = " ";
+  };
+  printSizes("l2", config.l2TileSizes);
+  printSizes("l1", config.l1TileSizes);
+}
+
+Expected<unsigned> refback::autotuneModule(ModuleOp module,
+                                           TuningDatabase &database,
+                                           const AutotuneOptions &options,
+                                           llvm::raw_ostream *log) {
+  // The ops are tuned as the lowering pipeline sees them, after TCF has been
+  // lowered to linalg.
+  OwningModuleRef lowered = module.clone();
+  PassManager pm(module.getContext(), OpPassManager::Nesting::Implicit);
+  createRefBackendTCFToTCPPipeline(pm, RefBackendLoweringPipelineOptions());
+  if (failed(pm.run(*lowered)))
+    return make_string_error("error lowering the module to tune");
+
+  llvm::MapVector<std::string, Operation *> ops;
+  lowered->walk([&](Operation *op) {
+    if (isTunableOp(op) && hasStaticTuningSignature(op)) {
+      std::string signature = getTuningSignature(op);
+      if (!database.lookup(signature))
+        ops.insert({signature, op});
+    }
+  });
+
+  for (auto &signatureAndOp : ops) {
+    StringRef signature = signatureAndOp.first;
+    Operation *op = signatureAndOp.second;
+    if (log)
+      *log << "tuning " << signature << "\n";
+    Optional<TuningDatabase::Entry> best;
+    for (const TuningConfig &config : getTuningCandidates(op)) {
+      Expected<double> latency = measureCandidate(op, config, options);
+      if (log) {
+        *log << "  ";
+        printConfig(config, *log);
+        if (latency)
+          *log << llvm::format(": %.3f ms\n", *latency);
+        else
+          *log << ": failed: " << llvm::toString(latency.takeError()) << "\n";
+      } else if (!latency) {
+        llvm::consumeError(latency.takeError());
+      }
+      if (latency && (!best || *latency < best->latencyMs)) {
+        best.emplace();
+        best->config = config;
+        best->latencyMs = *latency;
+      }
+    }
+    if (!best)
+      return make_string_error("no candidate of " + signature + " could run");
+    database.insert(signature, *best);
+  }
+  return ops.size();
+}
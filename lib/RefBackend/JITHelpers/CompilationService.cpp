@@ -0,0 +1,378 @@
+//===------------------------------------------------------------*- C++ -*-===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "npcomp/RefBackend/JITHelpers/CompilationService.h"
+#include "mlir/ExecutionEngine/OptUtils.h"
+#include "mlir/IR/Diagnostics.h"
+#include "mlir/Parser.h"
+#include "mlir/Pass/PassManager.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/TargetSelect.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+using namespace refback;
+using namespace mlir;
+using llvm::Error;
+using llvm::StringError;
+using llvm::Twine;
+
+/// Wrap a string into an llvm::StringError.
+static Error make_string_error(const Twine &message) {
+  return llvm::make_error<StringError>(message.str(),
+                                       llvm::inconvertibleErrorCode());
+}
+
+void CompilationOptions::setTier(CompileTier tier) {
+  const bool fast = tier == CompileTier::Fast;
+  optimize = !fast;
+  jitOptions.optLevel = fast ? 0 : 2;
+  jitOptions.fastISel = fast;
+}
+
+// Returns the key of the backend pipeline built for `options`.
+static std::string getPipelineKey(const CompilationOptions &options) {
+  std::string key;
+  llvm::raw_string_ostream os(key);
+  os << options.optimize << options.profileOps;
+  for (int64_t batchSize : options.specializedBatchSizes)
+    os << ',' << batchSize;
+  os << '\0' << options.tuningDatabase;
+  return os.str();
+}
+
+// Removes the public functions of `module` that aren't in `functions`, along
+// with the private functions that only they called.
+static void removeOtherFunctions(ModuleOp module,
+                                 llvm::ArrayRef<std::string> functions) {
+  for (FuncOp func : llvm::make_early_inc_range(module.getOps<FuncOp>()))
+    if (func.isPublic() && !llvm::is_contained(functions, func.getName()))
+      func.erase();
+  // Erasing a function can leave the functions it called unused.
+  bool erased = true;
+  while (erased) {
+    erased = false;
+    for (FuncOp func : llvm::make_early_inc_range(module.getOps<FuncOp>())) {
+      if (func.isPrivate() && SymbolTable::symbolKnownUseEmpty(func, module)) {
+        func.erase();
+        erased = true;
+      }
+    }
+  }
+}
+
+namespace refback {
+// The state of a thread of a CompilationService, which is reused across the
+// compilations that the thread runs.
+class CompilationService::Worker {
+public:
+  Worker(const DialectRegistry &registry,
+         const CompilationServiceOptions &serviceOptions)
+      : registry(registry), serviceOptions(serviceOptions) {
+    resetContext();
+  }
+
+  Result compile(llvm::StringRef sourceOrPath, bool isFile,
+                 const CompilationOptions &options) {
+    if (numCompilations == serviceOptions.maxCompilationsPerContext &&
+        numCompilations != 0)
+      resetContext();
+    numCompilations++;
+
+    // Report the diagnostics in the returned error, rather than on stderr.
+    std::string diagnostics;
+    llvm::raw_string_ostream os(diagnostics);
+    ScopedDiagnosticHandler handler(context.get(), [&](Diagnostic &diag) {
+      if (diag.getSeverity() == DiagnosticSeverity::Error)
+        os << "\n" << diag.getLocation() << ": " << diag;
+      return success();
+    });
+
+    OwningModuleRef module =
+        isFile ? JITModule::parseModuleFile(sourceOrPath, *context)
+               : parseSourceString(sourceOrPath, context.get());
+    if (!module && isFile)
+      return make_string_error("could not parse " + Twine(sourceOrPath) +
+                               os.str());
+    if (!module)
+      return make_string_error("could not parse the module" + os.str());
+    if (!options.functions.empty())
+      removeOtherFunctions(*module, options.functions);
+    if (failed(getPipeline(options).run(*module)))
+      return make_string_error("error compiling to jit backend" + os.str());
+
+    llvm::SmallVector<llvm::StringRef, 4> sharedLibs(
+        serviceOptions.sharedLibs.begin(), serviceOptions.sharedLibs.end());
+    JITCompileOptions jitOptions = options.jitOptions;
+    if (!jitOptions.sharedObjectStore)
+      jitOptions.sharedObjectStore = serviceOptions.sharedObjectStore;
+    return JITModule::fromCompiledModule(*module, sharedLibs,
+                                         serviceOptions.objectCacheDir,
+                                         jitOptions);
+  }
+
+private:
+  // Replaces the context with a fresh one, dropping the attributes and types
+  // of the modules compiled so far.
+  void resetContext() {
+    // The pass managers refer to the context.
+    pipelines.clear();
+    context = std::make_unique<MLIRContext>();
+    context->appendDialectRegistry(registry);
+    context->loadAllAvailableDialects();
+    // The service runs compilations concurrently instead.
+    context->disableMultithreading();
+    numCompilations = 0;
+  }
+
+  // Returns the backend pipeline for `options`, built on its first use.
+  PassManager &getPipeline(const CompilationOptions &options) {
+    std::unique_ptr<PassManager> &pm = pipelines[getPipelineKey(options)];
+    if (!pm) {
+      pm = std::make_unique<PassManager>(context.get(),
+                                         OpPassManager::Nesting::Implicit);
+      NPCOMP::RefBackendLoweringPipelineOptions pipelineOptions;
+      pipelineOptions.optimize = options.optimize;
+      pipelineOptions.profileOps = options.profileOps;
+      pipelineOptions.specializeBatchSizes = options.specializedBatchSizes;
+      pipelineOptions.tuningDatabase = options.tuningDatabase;
+      JITModule::buildBackendCompilationPipeline(*pm, pipelineOptions);
+    }
+    return *pm;
+  }
+
+  const DialectRegistry &registry;
+  const CompilationServiceOptions &serviceOptions;
+  std::unique_ptr<MLIRContext> context;
+  // The backend pipelines, by getPipelineKey.
+  llvm::StringMap<std::unique_ptr<PassManager>> pipelines;
+  unsigned numCompilations = 0;
+};
+} // namespace refback
+
+CompilationService::CompilationService(const DialectRegistry &registry,
+                                       CompilationServiceOptions options)
+    : options(std::move(options)) {
+  static std::once_flag llvmInitialized;
+  std::call_once(llvmInitialized, [] {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    mlir::initializeLLVMPasses();
+  });
+  registry.appendTo(this->registry);
+  unsigned numThreads = this->options.numThreads;
+  if (numThreads == 0)
+    numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+  for (unsigned i = 0; i < numThreads; i++)
+    workers.emplace_back([this] { workerMain(); });
+}
+
+CompilationService::~CompilationService() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    shuttingDown = true;
+  }
+  wakeUp.notify_all();
+  for (std::thread &worker : workers)
+    worker.join();
+}
+
+void CompilationService::workerMain() {
+  Worker worker(registry, options);
+  for (;;) {
+    Task task;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wakeUp.wait(lock, [&] { return shuttingDown || !pending.empty(); });
+      if (pending.empty())
+        return;
+      task = std::move(pending.front());
+      pending.pop_front();
+    }
+    task(worker);
+  }
+}
+
+std::future<CompilationService::Result>
+CompilationService::submit(std::string sourceOrPath, bool isFile,
+                           CompilationOptions options) {
+  // std::function requires copyable tasks, so share the promise.
+  auto promise = std::make_shared<std::promise<Result>>();
+  auto future = promise->get_future();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending.push_back([promise, sourceOrPath = std::move(sourceOrPath), isFile,
+                       options = std::move(options)](Worker &worker) {
+      promise->set_value(worker.compile(sourceOrPath, isFile, options));
+    });
+  }
+  wakeUp.notify_one();
+  return future;
+}
+
+CompilationService::Result
+CompilationService::compile(llvm::StringRef source,
+                            const CompilationOptions &options) {
+  return compileAsync(source.str(), options).get();
+}
+
+CompilationService::Result
+CompilationService::compileFile(llvm::StringRef path,
+                                const CompilationOptions &options) {
+  return compileFileAsync(path.str(), options).get();
+}
+
+std::future<CompilationService::Result>
+CompilationService::compileAsync(std::string source,
+                                 CompilationOptions options) {
+  return submit(std::move(source), /*isFile=*/false, std::move(options));
+}
+
+std::future<CompilationService::Result>
+CompilationService::compileFileAsync(std::string path,
+                                     CompilationOptions options) {
+  return submit(std::move(path), /*isFile=*/true, std::move(options));
+}
+
+llvm::Expected<std::unique_ptr<TieredJITModule>>
+CompilationService::compileTiered(llvm::StringRef source,
+                                  const CompilationOptions &options,
+                                  unsigned promoteAfterCalls) {
+  CompilationOptions fastOptions = options;
+  fastOptions.setTier(CompileTier::Fast);
+  Result fastModule = compile(source, fastOptions);
+  if (!fastModule)
+    return fastModule.takeError();
+  CompilationOptions optimizedOptions = options;
+  optimizedOptions.setTier(CompileTier::Optimized);
+  return std::unique_ptr<TieredJITModule>(new TieredJITModule(
+      *this, source.str(), std::move(optimizedOptions), promoteAfterCalls,
+      std::move(*fastModule)));
+}
+
+// The tiers of one public function of a TieredJITModule.
+struct TieredJITModule::Function {
+  // The module that the calls of the function run, which is switched from the
+  // fast module to `optimizedModule` once.
+  std::atomic<JITModule *> current;
+  std::atomic<unsigned> numCalls{0};
+  // Guards the members below.
+  std::mutex mutex;
+  std::future<CompilationService::Result> optimizedCompilation;
+  bool optimizedCompilationStarted = false;
+  std::unique_ptr<JITModule> optimizedModule;
+  // The error of the optimized compilation, if it failed.
+  std::string optimizedCompilationError;
+
+  // Waits for an optimized compilation that no call switched to, whose
+  // result must be checked before it is destroyed.
+  ~Function() {
+    if (optimizedCompilation.valid())
+      llvm::consumeError(optimizedCompilation.get().takeError());
+  }
+
+  // Takes the result of the optimized compilation, and switches the calls to
+  // the optimized code if it succeeded. Requires `mutex`.
+  void finishOptimizedCompilation(llvm::StringRef name) {
+    CompilationService::Result result = optimizedCompilation.get();
+    if (result) {
+      auto expectedFunction = (*result)->lookup(name);
+      if (!expectedFunction)
+        result = expectedFunction.takeError();
+    }
+    if (!result) {
+      optimizedCompilationError = "error compiling the optimized tier: " +
+                                  llvm::toString(result.takeError());
+      return;
+    }
+    // The fast code stays alive, since it may still be running, and the
+    // outputs of its calls may point into its constants.
+    optimizedModule = std::move(*result);
+    current.store(optimizedModule.get(), std::memory_order_release);
+  }
+};
+
+TieredJITModule::TieredJITModule(CompilationService &service,
+                                 std::string source,
+                                 CompilationOptions optimizedOptions,
+                                 unsigned promoteAfterCalls,
+                                 std::unique_ptr<JITModule> fastModule)
+    : service(service), source(std::move(source)),
+      optimizedOptions(std::move(optimizedOptions)),
+      promoteAfterCalls(promoteAfterCalls), fastModule(std::move(fastModule)) {
+  for (const std::string &name : this->fastModule->getFunctionNames()) {
+    // Calls of a specialization go through the function it specializes.
+    if (StringRef(name).contains('$'))
+      continue;
+    auto function = std::make_unique<Function>();
+    function->current = this->fastModule.get();
+    functions[name] = std::move(function);
+  }
+}
+
+TieredJITModule::~TieredJITModule() = default;
+
+llvm::Expected<llvm::SmallVector<refbackrt::RtValue, 6>>
+TieredJITModule::invoke(llvm::StringRef functionName,
+                        llvm::ArrayRef<refbackrt::RtValue> inputs) {
+  auto it = functions.find(functionName);
+  if (it == functions.end())
+    return fastModule->invoke(functionName, inputs);
+  Function &function = *it->second;
+  JITModule *module = function.current.load(std::memory_order_acquire);
+  if (module == fastModule.get() &&
+      ++function.numCalls >= promoteAfterCalls) {
+    // Calls don't wait for each other here: the call holding the lock starts
+    // the optimized compilation, or switches to its result once it is ready,
+    // and the others run the fast code meanwhile.
+    std::unique_lock<std::mutex> lock(function.mutex, std::try_to_lock);
+    if (lock.owns_lock()) {
+      if (!function.optimizedCompilationStarted)
+        startOptimizedCompilation(functionName, function);
+      else if (function.optimizedCompilation.valid() &&
+               function.optimizedCompilation.wait_for(
+                   std::chrono::seconds(0)) == std::future_status::ready)
+        function.finishOptimizedCompilation(functionName);
+      module = function.current.load(std::memory_order_acquire);
+    }
+  }
+  return module->invoke(functionName, inputs);
+}
+
+bool TieredJITModule::isOptimized(llvm::StringRef functionName) const {
+  auto it = functions.find(functionName);
+  return it != functions.end() &&
+         it->second->current.load(std::memory_order_acquire) !=
+             fastModule.get();
+}
+
+Error TieredJITModule::waitForOptimized(llvm::StringRef functionName) {
+  auto it = functions.find(functionName);
+  if (it == functions.end())
+    return make_string_error("unknown function: " + Twine(functionName));
+  Function &function = *it->second;
+  std::lock_guard<std::mutex> lock(function.mutex);
+  if (!function.optimizedCompilationStarted)
+    startOptimizedCompilation(functionName, function);
+  if (function.optimizedCompilation.valid())
+    function.finishOptimizedCompilation(functionName);
+  if (!function.optimizedCompilationError.empty())
+    return make_string_error(function.optimizedCompilationError);
+  return Error::success();
+}
+
+void TieredJITModule::startOptimizedCompilation(llvm::StringRef name,
+                                                Function &function) {
+  CompilationOptions options = optimizedOptions;
+  options.functions = {name.str()};
+  function.optimizedCompilation =
+      service.compileAsync(source, std::move(options));
+  function.optimizedCompilationStarted = true;
+}
@@ -0,0 +1,611 @@
+//===------------------------------------------------------------*- C++ -*-===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Translation of the functions of a module lowered by the interpreter
+// pipeline into the functions of the runtime's interpreter (see
+// npcomp/RefBackend/Runtime/Interpreter.h).
+//
+//===----------------------------------------------------------------------===//
+
+#include "npcomp/RefBackend/JITHelpers/JITModule.h"
+#include "mlir/Dialect/Linalg/IR/LinalgOps.h"
+#include "mlir/Dialect/Math/IR/Math.h"
+#include "mlir/Dialect/MemRef/IR/MemRef.h"
+#include "mlir/Dialect/StandardOps/IR/Ops.h"
+#include "mlir/Dialect/Tensor/IR/Tensor.h"
+#include "mlir/Dialect/Utils/StructuredOpsUtils.h"
+#include "mlir/IR/AffineExpr.h"
+#include "mlir/IR/BuiltinTypes.h"
+#include "npcomp/RefBackend/Runtime/Interpreter.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/TypeSwitch.h"
+
+using namespace refback;
+using namespace mlir;
+using llvm::Error;
+using llvm::Expected;
+using llvm::Twine;
+
+namespace interp = refbackrt::interp;
+
+static Error make_string_error(const Twine &message) {
+  return llvm::make_error<llvm::StringError>(message.str(),
+                                             llvm::inconvertibleErrorCode());
+}
+
+static Optional<interp::ScalarType> getScalarType(Type type) {
+  if (type.isF32())
+    return interp::ScalarType::kF32;
+  if (type.isF64())
+    return interp::ScalarType::kF64;
+  if (type.isIndex())
+    return interp::ScalarType::kI64;
+  if (auto integerType = type.dyn_cast<IntegerType>()) {
+    switch (integerType.getWidth()) {
+    case 1:
+      return interp::ScalarType::kI1;
+    case 8:
+      return interp::ScalarType::kI8;
+    case 32:
+      return interp::ScalarType::kI32;
+    case 64:
+      return interp::ScalarType::kI64;
+    }
+  }
+  return None;
+}
+
+static unsigned getBitWidth(Type type) {
+  return type.isIndex() ? 64 : type.getIntOrFloatBitWidth();
+}
+
+// Returns the opcode of the scalar op `op`, if the interpreter supports it.
+static Optional<interp::Opcode> getOpcode(Operation *op) {
+  using interp::Opcode;
+  return llvm::TypeSwitch<Operation *, Optional<Opcode>>(op)
+      .Case([](AddFOp) { return Opcode::kAddF; })
+      .Case([](SubFOp) { return Opcode::kSubF; })
+      .Case([](MulFOp) { return Opcode::kMulF; })
+      .Case([](DivFOp) { return Opcode::kDivF; })
+      .Case([](RemFOp) { return Opcode::kRemF; })
+      .Case([](NegFOp) { return Opcode::kNegF; })
+      .Case([](AbsFOp) { return Opcode::kAbsF; })
+      .Case([](CeilFOp) { return Opcode::kCeilF; })
+      .Case([](FloorFOp) { return Opcode::kFloorF; })
+      .Case([](math::ExpOp) { return Opcode::kExp; })
+      .Case([](math::LogOp) { return Opcode::kLog; })
+      .Case([](math::TanhOp) { return Opcode::kTanh; })
+      .Case([](math::SqrtOp) { return Opcode::kSqrt; })
+      .Case([](math::RsqrtOp) { return Opcode::kRsqrt; })
+      .Case([](math::PowFOp) { return Opcode::kPowF; })
+      .Case([](CmpFOp) { return Opcode::kCmpF; })
+      .Case([](AddIOp) { return Opcode::kAddI; })
+      .Case([](SubIOp) { return Opcode::kSubI; })
+      .Case([](MulIOp) { return Opcode::kMulI; })
+      .Case([](SignedDivIOp) { return Opcode::kDivSI; })
+      .Case([](UnsignedDivIOp) { return Opcode::kDivUI; })
+      .Case([](SignedRemIOp) { return Opcode::kRemSI; })
+      .Case([](UnsignedRemIOp) { return Opcode::kRemUI; })
+      .Case([](AndOp) { return Opcode::kAndI; })
+      .Case([](OrOp) { return Opcode::kOrI; })
+      .Case([](XOrOp) { return Opcode::kXOrI; })
+      .Case([](ShiftLeftOp) { return Opcode::kShLI; })
+      .Case([](SignedShiftRightOp) { return Opcode::kShRSI; })
+      .Case([](UnsignedShiftRightOp) { return Opcode::kShRUI; })
+      .Case([](CmpIOp) { return Opcode::kCmpI; })
+      .Case([](SelectOp) { return Opcode::kSelect; })
+      .Case([](SIToFPOp) { return Opcode::kSIToFP; })
+      .Case([](UIToFPOp) { return Opcode::kUIToFP; })
+      .Case([](FPToSIOp) { return Opcode::kFPToSI; })
+      .Case([](FPToUIOp) { return Opcode::kFPToUI; })
+      .Case([](FPExtOp) { return Opcode::kExtF; })
+      .Case([](FPTruncOp) { return Opcode::kTruncF; })
+      .Case([](SignExtendIOp) { return Opcode::kExtSI; })
+      .Case([](ZeroExtendIOp) { return Opcode::kExtUI; })
+      .Case([](TruncateIOp) { return Opcode::kTruncI; })
+      // Integers are sign-extended by the interpreter, so casts between
+      // index and the other integer types are extensions or truncations.
+      .Case([](IndexCastOp op) {
+        return getBitWidth(op.getType()) <
+                       getBitWidth(op.getOperand().getType())
+                   ? Opcode::kTruncI
+                   : Opcode::kExtSI;
+      })
+      .Default([](Operation *) { return None; });
+}
+
+// Returns the scalar instruction of `op`, without its result and operands,
+// if the interpreter supports it.
+static Optional<interp::ScalarInstruction>
+getScalarInstruction(Operation *op) {
+  if (op->getNumResults() != 1 || op->getNumOperands() == 0 ||
+      op->getNumOperands() > 3)
+    return None;
+  Optional<interp::Opcode> opcode = getOpcode(op);
+  Optional<interp::ScalarType> type = getScalarType(op->getResult(0).getType());
+  Optional<interp::ScalarType> operandType =
+      getScalarType(op->getOperand(0).getType());
+  if (!opcode || !type || !operandType)
+    return None;
+  interp::ScalarInstruction instruction;
+  instruction.opcode = *opcode;
+  instruction.type = *type;
+  instruction.operandType = *operandType;
+  if (auto cmpf = dyn_cast<CmpFOp>(op))
+    instruction.predicate = static_cast<std::uint8_t>(cmpf.getPredicate());
+  else if (auto cmpi = dyn_cast<CmpIOp>(op))
+    instruction.predicate = static_cast<std::uint8_t>(cmpi.getPredicate());
+  // The select is typed by its true and false values.
+  if (isa<SelectOp>(op))
+    instruction.operandType = *type;
+  return instruction;
+}
+
+// Returns the scalar constant `attr` of `type`, in the representation of the
+// interpreter.
+static interp::Scalar getScalar(Attribute attr, interp::ScalarType type) {
+  interp::Scalar scalar;
+  scalar.i64 = 0;
+  if (type == interp::ScalarType::kF32)
+    scalar.f32 = attr.cast<FloatAttr>().getValue().convertToFloat();
+  else if (type == interp::ScalarType::kF64)
+    scalar.f64 = attr.cast<FloatAttr>().getValue().convertToDouble();
+  else if (type == interp::ScalarType::kI1)
+    scalar.i64 = attr.cast<IntegerAttr>().getValue().getBoolValue();
+  else
+    scalar.i64 = attr.cast<IntegerAttr>().getValue().getSExtValue();
+  return scalar;
+}
+
+// Returns the scalar element `value` of `type`, in the representation of the
+// interpreter.
+static interp::Scalar getScalar(const APFloat &value,
+                                interp::ScalarType type) {
+  interp::Scalar scalar;
+  if (type == interp::ScalarType::kF32)
+    scalar.f32 = value.convertToFloat();
+  else
+    scalar.f64 = value.convertToDouble();
+  return scalar;
+}
+
+static void appendElement(interp::ScalarType type, interp::Scalar value,
+                          std::vector<char> &data) {
+  auto append = [&](const void *element, size_t size) {
+    const char *bytes = static_cast<const char *>(element);
+    data.insert(data.end(), bytes, bytes + size);
+  };
+  switch (type) {
+  case interp::ScalarType::kF32:
+    return append(&value.f32, sizeof(float));
+  case interp::ScalarType::kF64:
+    return append(&value.f64, sizeof(double));
+  case interp::ScalarType::kI1:
+  case interp::ScalarType::kI8: {
+    auto element = static_cast<std::int8_t>(value.i64);
+    return append(&element, sizeof(element));
+  }
+  case interp::ScalarType::kI32: {
+    auto element = static_cast<std::int32_t>(value.i64);
+    return append(&element, sizeof(element));
+  }
+  case interp::ScalarType::kI64:
+    return append(&value.i64, sizeof(value.i64));
+  }
+}
+
+// Returns the coefficient of each loop in the linear affine expression
+// `expr`, and its constant term, or fails if `expr` is not linear.
+static LogicalResult decomposeLinearExpr(AffineExpr expr, int64_t scale,
+                                         MutableArrayRef<int64_t> coefficients,
+                                         int64_t &offset) {
+  if (auto dim = expr.dyn_cast<AffineDimExpr>()) {
+    coefficients[dim.getPosition()] += scale;
+    return success();
+  }
+  if (auto constant = expr.dyn_cast<AffineConstantExpr>()) {
+    offset += scale * constant.getValue();
+    return success();
+  }
+  auto binary = expr.dyn_cast<AffineBinaryOpExpr>();
+  if (!binary)
+    return failure();
+  if (expr.getKind() == AffineExprKind::Add)
+    return success(
+        succeeded(decomposeLinearExpr(binary.getLHS(), scale, coefficients,
+                                      offset)) &&
+        succeeded(decomposeLinearExpr(binary.getRHS(), scale, coefficients,
+                                      offset)));
+  if (expr.getKind() == AffineExprKind::Mul) {
+    // Products of loop indices are not linear, so one side is a constant
+    // (which the affine map builders put on the right).
+    if (auto constant = binary.getRHS().dyn_cast<AffineConstantExpr>())
+      return decomposeLinearExpr(binary.getLHS(), scale * constant.getValue(),
+                                 coefficients, offset);
+  }
+  return failure();
+}
+
+namespace {
+// Translates one function into an interp::Function.
+class FunctionTranslator {
+public:
+  FunctionTranslator(FuncOp func, interp::Function &function)
+      : func(func), function(function) {}
+
+  Error translate();
+
+private:
+  Error unsupported(Operation *op, const Twine &reason) {
+    return make_string_error("cannot interpret " + Twine(func.getName()) +
+                             ": " + reason + ": " +
+                             op->getName().getStringRef());
+  }
+  std::int32_t addSlot(Value value) {
+    std::int32_t slot = function.numSlots++;
+    slots[value] = slot;
+    return slot;
+  }
+  Expected<interp::ArgSignature> getArgSignature(Type type);
+  Error translateOp(Operation *op);
+  Error translateLinalgOp(linalg::LinalgOp op);
+  void computeLastUses();
+
+  FuncOp func;
+  interp::Function &function;
+  DenseMap<Value, std::int32_t> slots;
+};
+} // namespace
+
+Expected<interp::ArgSignature> FunctionTranslator::getArgSignature(Type type) {
+  interp::ArgSignature signature;
+  signature.isTensor = type.isa<TensorType>();
+  Type elementType = type;
+  if (signature.isTensor) {
+    auto tensorType = type.dyn_cast<RankedTensorType>();
+    if (!tensorType)
+      return make_string_error("cannot interpret " + Twine(func.getName()) +
+                               ": unranked tensor arguments are not supported");
+    signature.extents.assign(tensorType.getShape().begin(),
+                             tensorType.getShape().end());
+    elementType = tensorType.getElementType();
+  }
+  Optional<interp::ScalarType> scalarType = getScalarType(elementType);
+  // The runtime ABI has neither f64 tensors nor i8 scalars.
+  if (!scalarType ||
+      (signature.isTensor && *scalarType == interp::ScalarType::kF64) ||
+      (!signature.isTensor && *scalarType == interp::ScalarType::kI8))
+    return make_string_error("cannot interpret " + Twine(func.getName()) +
+                             ": unsupported argument type");
+  signature.type = *scalarType;
+  return signature;
+}
+
+Error FunctionTranslator::translate() {
+  function.name = func.getName().str();
+  function.numSlots = 0;
+  if (!llvm::hasSingleElement(func.getBody()))
+    return make_string_error("cannot interpret " + Twine(func.getName()) +
+                             ": functions must have a single block");
+  FunctionType type = func.getType();
+  for (Type inputType : type.getInputs()) {
+    Expected<interp::ArgSignature> signature = getArgSignature(inputType);
+    if (!signature)
+      return signature.takeError();
+    function.inputs.push_back(std::move(*signature));
+  }
+  for (Type resultType : type.getResults()) {
+    Expected<interp::ArgSignature> signature = getArgSignature(resultType);
+    if (!signature)
+      return signature.takeError();
+    function.outputs.push_back(std::move(*signature));
+  }
+  Block &body = func.getBody().front();
+  for (BlockArgument arg : body.getArguments())
+    addSlot(arg);
+  for (Operation &op : body)
+    if (Error error = translateOp(&op))
+      return error;
+  computeLastUses();
+  return Error::success();
+}
+
+Error FunctionTranslator::translateOp(Operation *op) {
+  interp::Instruction instruction;
+  auto addOperands = [&](ValueRange values) {
+    for (Value value : values)
+      instruction.operands.push_back(slots.lookup(value));
+  };
+  auto getElementType = [](Value tensor) {
+    return getScalarType(tensor.getType().cast<ShapedType>().getElementType());
+  };
+  auto getExtents = [](Value tensor) {
+    ArrayRef<int64_t> shape = tensor.getType().cast<ShapedType>().getShape();
+    return std::vector<std::int64_t>(shape.begin(), shape.end());
+  };
+
+  if (auto constant = dyn_cast<ConstantOp>(op)) {
+    Attribute value = constant.getValue();
+    if (auto elements = value.dyn_cast<DenseElementsAttr>()) {
+      Optional<interp::ScalarType> elementType =
+          getScalarType(elements.getType().getElementType());
+      if (!elementType)
+        return unsupported(op, "unsupported element type");
+      interp::TensorConstant tensor;
+      tensor.elementType = *elementType;
+      tensor.extents = getExtents(constant);
+      if (elements.getType().getElementType().isa<FloatType>()) {
+        for (const APFloat &element : elements.getFloatValues())
+          appendElement(*elementType, getScalar(element, *elementType),
+                        tensor.data);
+      } else {
+        bool isBool = *elementType == interp::ScalarType::kI1;
+        for (const APInt &element : elements.getIntValues()) {
+          interp::Scalar scalar;
+          scalar.i64 = isBool ? element.getBoolValue() : element.getSExtValue();
+          appendElement(*elementType, scalar, tensor.data);
+        }
+      }
+      instruction.kind = interp::InstructionKind::kTensorConstant;
+      instruction.constantIndex = function.constants.size();
+      function.constants.push_back(std::move(tensor));
+    } else {
+      Optional<interp::ScalarType> type = getScalarType(constant.getType());
+      if (!type || !value.isa<FloatAttr, IntegerAttr>())
+        return unsupported(op, "unsupported constant");
+      instruction.kind = interp::InstructionKind::kScalarConstant;
+      instruction.type = *type;
+      instruction.constant = getScalar(value, *type);
+    }
+  } else if (auto dim = dyn_cast<memref::DimOp>(op)) {
+    Optional<int64_t> index = dim.getConstantIndex();
+    if (!index || !dim.memrefOrTensor().getType().isa<RankedTensorType>())
+      return unsupported(op, "only constant dimensions of tensors");
+    instruction.kind = interp::InstructionKind::kDim;
+    instruction.dim = *index;
+    addOperands(dim.memrefOrTensor());
+  } else if (auto initTensor = dyn_cast<linalg::InitTensorOp>(op)) {
+    Optional<interp::ScalarType> type = getElementType(initTensor);
+    if (!type)
+      return unsupported(op, "unsupported element type");
+    instruction.kind = interp::InstructionKind::kInitTensor;
+    instruction.type = *type;
+    instruction.extents = getExtents(initTensor);
+    addOperands(initTensor.sizes());
+  } else if (auto fill = dyn_cast<linalg::FillOp>(op)) {
+    if (!fill.hasTensorSemantics())
+      return unsupported(op, "only ops on tensors");
+    instruction.kind = interp::InstructionKind::kFill;
+    addOperands(fill.value());
+    addOperands(fill.output());
+  } else if (auto linalgOp = dyn_cast<linalg::LinalgOp>(op)) {
+    return translateLinalgOp(linalgOp);
+  } else if (auto extract = dyn_cast<tensor::ExtractOp>(op)) {
+    instruction.kind = interp::InstructionKind::kExtract;
+    addOperands(extract.tensor());
+    addOperands(extract.indices());
+  } else if (auto fromElements = dyn_cast<tensor::FromElementsOp>(op)) {
+    Optional<interp::ScalarType> type = getElementType(fromElements);
+    if (!type)
+      return unsupported(op, "unsupported element type");
+    instruction.kind = interp::InstructionKind::kFromElements;
+    instruction.type = *type;
+    instruction.extents = getExtents(fromElements);
+    addOperands(fromElements.elements());
+  } else if (auto cast = dyn_cast<tensor::CastOp>(op)) {
+    if (!cast.getType().isa<RankedTensorType>())
+      return unsupported(op, "only casts to ranked tensors");
+    instruction.kind = interp::InstructionKind::kCast;
+    addOperands(cast.source());
+  } else if (auto assertOp = dyn_cast<AssertOp>(op)) {
+    instruction.kind = interp::InstructionKind::kAssert;
+    instruction.message = assertOp.msg().str();
+    addOperands(assertOp.arg());
+  } else if (auto returnOp = dyn_cast<ReturnOp>(op)) {
+    instruction.kind = interp::InstructionKind::kReturn;
+    addOperands(returnOp.getOperands());
+  } else if (Optional<interp::ScalarInstruction> scalar =
+                 getScalarInstruction(op)) {
+    instruction.kind = interp::InstructionKind::kScalar;
+    instruction.scalar = *scalar;
+    addOperands(op->getOperands());
+    for (int i = 0, e = op->getNumOperands(); i < e; ++i)
+      instruction.scalar.operands[i] = instruction.operands[i];
+  } else {
+    return unsupported(op, "unsupported op");
+  }
+  for (Value result : op->getResults())
+    instruction.results.push_back(addSlot(result));
+  if (instruction.kind == interp::InstructionKind::kScalar)
+    instruction.scalar.result = instruction.results[0];
+  if (instruction.kind == interp::InstructionKind::kFill)
+    instruction.mayReuseOutput.push_back(true);
+  function.instructions.push_back(std::move(instruction));
+  return Error::success();
+}
+
+Error FunctionTranslator::translateLinalgOp(linalg::LinalgOp op) {
+  if (!op.hasTensorSemantics() ||
+      op.getNumShapedOperands() != op->getNumOperands())
+    return unsupported(op, "only ops on tensors");
+  interp::LinalgInstruction linalg;
+  int numLoops = op.getNumLoops();
+  int numOperands = op.getNumShapedOperands();
+  linalg.numLoops = numLoops;
+  linalg.numInputs = op.getNumInputs();
+  for (Attribute iteratorType : op.iterator_types())
+    linalg.isReduction.push_back(isReductionIterator(iteratorType));
+  linalg.loopExtentOperands.assign(numLoops, -1);
+  linalg.loopExtentDims.assign(numLoops, -1);
+
+  interp::Instruction instruction;
+  instruction.kind = interp::InstructionKind::kLinalg;
+  SmallVector<AffineMap, 4> maps = op.getIndexingMaps();
+  for (int k = 0; k < numOperands; ++k) {
+    Value tensor = op.getShapedOperand(k);
+    AffineMap map = maps[k];
+    Optional<interp::ScalarType> elementType = getScalarType(
+        tensor.getType().cast<ShapedType>().getElementType());
+    if (!elementType)
+      return unsupported(op, "unsupported element type");
+    interp::LinalgOperand operand;
+    operand.elementType = *elementType;
+    operand.rank = map.getNumResults();
+    operand.coefficients.assign(operand.rank * numLoops, 0);
+    operand.offsets.assign(operand.rank, 0);
+    for (int d = 0; d < operand.rank; ++d) {
+      AffineExpr expr = map.getResult(d);
+      if (failed(decomposeLinearExpr(
+              expr, 1,
+              MutableArrayRef<int64_t>(operand.coefficients)
+                  .slice(d * numLoops, numLoops),
+              operand.offsets[d])))
+        return unsupported(op, "only linear indexing maps");
+      // The trip count of each loop is the extent of the first dimension
+      // indexed by the loop alone.
+      if (auto loop = expr.dyn_cast<AffineDimExpr>()) {
+        int l = loop.getPosition();
+        if (linalg.loopExtentOperands[l] < 0) {
+          linalg.loopExtentOperands[l] = k;
+          linalg.loopExtentDims[l] = d;
+        }
+      }
+    }
+    linalg.operands.push_back(std::move(operand));
+    instruction.operands.push_back(slots.lookup(tensor));
+  }
+  if (llvm::is_contained(linalg.loopExtentOperands, -1))
+    return unsupported(op, "loops without an operand dimension");
+
+  // Translate the payload into registers, the block arguments first.
+  Block &payload = op->getRegion(0).front();
+  DenseMap<Value, std::int32_t> registers;
+  auto addRegister = [&](Value value, interp::ScalarType type) {
+    std::int32_t reg = linalg.registerTypes.size();
+    linalg.registerTypes.push_back(type);
+    registers[value] = reg;
+    return reg;
+  };
+  for (BlockArgument arg : payload.getArguments())
+    addRegister(arg, linalg.operands[arg.getArgNumber()].elementType);
+  // Values of the function used by the payload are captured as operands of
+  // the instruction, after the tensors.
+  auto getRegister = [&](Value value) -> Optional<std::int32_t> {
+    auto it = registers.find(value);
+    if (it != registers.end())
+      return it->second;
+    Optional<interp::ScalarType> type = getScalarType(value.getType());
+    if (!type || !slots.count(value))
+      return None;
+    std::int32_t reg = addRegister(value, *type);
+    linalg.captureRegisters.push_back(reg);
+    linalg.captures.push_back(instruction.operands.size() - numOperands);
+    instruction.operands.push_back(slots.lookup(value));
+    return reg;
+  };
+  for (Operation &payloadOp : payload.without_terminator()) {
+    if (auto constant = dyn_cast<ConstantOp>(payloadOp)) {
+      Optional<interp::ScalarType> type = getScalarType(constant.getType());
+      if (!type || !constant.getValue().isa<FloatAttr, IntegerAttr>())
+        return unsupported(&payloadOp, "unsupported constant");
+      linalg.constantRegisters.push_back(addRegister(constant, *type));
+      linalg.constants.push_back(getScalar(constant.getValue(), *type));
+      continue;
+    }
+    if (auto index = dyn_cast<linalg::IndexOp>(payloadOp)) {
+      linalg.loopIndexRegisters.push_back(
+          addRegister(index, interp::ScalarType::kI64));
+      linalg.loopIndices.push_back(index.dim());
+      continue;
+    }
+    Optional<interp::ScalarInstruction> scalar =
+        getScalarInstruction(&payloadOp);
+    if (!scalar)
+      return unsupported(&payloadOp, "unsupported payload op");
+    for (int i = 0, e = payloadOp.getNumOperands(); i < e; ++i) {
+      Optional<std::int32_t> reg = getRegister(payloadOp.getOperand(i));
+      if (!reg)
+        return unsupported(&payloadOp, "unsupported payload operand");
+      scalar->operands[i] = *reg;
+    }
+    scalar->result = addRegister(payloadOp.getResult(0), scalar->type);
+    linalg.body.push_back(*scalar);
+  }
+  for (Value yielded : payload.getTerminator()->getOperands()) {
+    Optional<std::int32_t> reg = getRegister(yielded);
+    if (!reg)
+      return unsupported(op, "unsupported yielded value");
+    linalg.yields.push_back(*reg);
+  }
+  for (int k = linalg.numInputs; k < numOperands; ++k)
+    linalg.readsOutput.push_back(!payload.getArgument(k).use_empty());
+
+  if (isa<linalg::MatmulOp>(op) &&
+      linalg.operands[0].elementType == interp::ScalarType::kF32)
+    linalg.kernel = interp::LinalgKernel::kMatmul;
+  if (isa<linalg::BatchMatmulOp>(op) &&
+      linalg.operands[0].elementType == interp::ScalarType::kF32)
+    linalg.kernel = interp::LinalgKernel::kBatchMatmul;
+
+  for (Value result : op->getResults())
+    instruction.results.push_back(addSlot(result));
+  instruction.mayReuseOutput.assign(op.getNumOutputs(), true);
+  instruction.linalgIndex = function.linalgOps.size();
+  function.linalgOps.push_back(std::move(linalg));
+  function.instructions.push_back(std::move(instruction));
+  return Error::success();
+}
+
+// Releases each value after its last use, and lets linalg ops compute their
+// results in the buffers of init tensors that nothing else uses.
+void FunctionTranslator::computeLastUses() {
+  std::vector<std::int32_t> lastUse(function.numSlots, -1);
+  for (int i = 0, e = function.instructions.size(); i < e; ++i) {
+    interp::Instruction &instruction = function.instructions[i];
+    for (std::int32_t slot : instruction.results)
+      lastUse[slot] = i;
+    for (std::int32_t slot : instruction.operands)
+      lastUse[slot] = i;
+  }
+  for (int i = 0, e = function.instructions.size(); i < e; ++i) {
+    interp::Instruction &instruction = function.instructions[i];
+    // The init tensors are the operands after the inputs (and, for fills,
+    // the scalar).
+    int firstInit = 1;
+    if (instruction.kind == interp::InstructionKind::kLinalg)
+      firstInit = function.linalgOps[instruction.linalgIndex].numInputs;
+    for (int j = 0, je = instruction.mayReuseOutput.size(); j < je; ++j) {
+      std::int32_t init = instruction.operands[firstInit + j];
+      // Function arguments are never reused, as the caller owns them.
+      bool reusable = init >= static_cast<int>(function.inputs.size()) &&
+                      lastUse[init] == i &&
+                      llvm::count(instruction.operands, init) == 1;
+      instruction.mayReuseOutput[j] = reusable;
+    }
+  }
+  for (std::int32_t slot = 0; slot < function.numSlots; ++slot)
+    if (lastUse[slot] >= 0)
+      function.instructions[lastUse[slot]].lastUses.push_back(slot);
+}
+
+Expected<std::unique_ptr<JITModule>>
+JITModule::fromInterpretedModule(ModuleOp module) {
+  std::vector<interp::Function> functions;
+  for (FuncOp func : module.getOps<FuncOp>()) {
+    if (func.isPrivate() || func.isExternal())
+      continue;
+    functions.emplace_back();
+    if (Error error = FunctionTranslator(func, functions.back()).translate())
+      return std::move(error);
+  }
+  std::unique_ptr<JITModule> ret(new JITModule);
+  ret->interpretedModule =
+      std::make_unique<interp::Module>(std::move(functions));
+  ret->descriptor = ret->interpretedModule->getDescriptor();
+  return std::move(ret);
+}
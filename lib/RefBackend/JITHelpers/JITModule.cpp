@@ -10,9 +10,41 @@
 #include "mlir/ExecutionEngine/CRunnerUtils.h"
 #include "mlir/ExecutionEngine/OptUtils.h"
 #include "mlir/Target/LLVMIR/Dialect/LLVMIR/LLVMToLLVMIRTranslation.h"
+#include "mlir/Parser.h"
+#include "mlir/Target/LLVMIR/Export.h"
+#include "npcomp/Dialect/Refback/IR/RefbackDialect.h"
 #include "npcomp/RefBackend/RefBackend.h"
+#include "npcomp/RefBackend/Runtime/Interpreter.h"
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/Mangling.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
 #include <sstream>
+#include <thread>
 
 using namespace refback;
 using namespace mlir;
@@ -27,36 +59,854 @@ static Error make_string_error(const Twine &message) {
                                        llvm::inconvertibleErrorCode());
 }
 
+namespace refback {
+// Runs the calls of JITModule::invokeAsync on a pool of threads, starting the
+// pending calls in order of RequestSchedule.
+class RequestScheduler {
+public:
+  explicit RequestScheduler(unsigned numThreads) {
+    for (unsigned i = 0; i < numThreads; i++)
+      workers.emplace_back([this] { workerMain(); });
+  }
+  RequestScheduler(const RequestScheduler &) = delete;
+  RequestScheduler &operator=(const RequestScheduler &) = delete;
+  // Waits for the pending calls.
+  ~RequestScheduler() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      shuttingDown = true;
+    }
+    wakeUp.notify_all();
+    for (std::thread &worker : workers)
+      worker.join();
+  }
+
+  void schedule(const refbackrt::RequestSchedule &schedule,
+                std::function<void()> run) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      pending.push_back({schedule, nextSequence++, std::move(run)});
+      std::push_heap(pending.begin(), pending.end(), RunsLater());
+    }
+    wakeUp.notify_one();
+  }
+
+private:
+  struct Request {
+    refbackrt::RequestSchedule schedule;
+    uint64_t sequence;
+    std::function<void()> run;
+  };
+  // Orders requests so that the heap's front is the one to run first.
+  struct RunsLater {
+    bool operator()(const Request &lhs, const Request &rhs) const {
+      if (lhs.schedule.priority != rhs.schedule.priority)
+        return lhs.schedule.priority > rhs.schedule.priority;
+      // Requests without a deadline run after those with one.
+      uint64_t lhsDeadline = lhs.schedule.deadlineNanos;
+      uint64_t rhsDeadline = rhs.schedule.deadlineNanos;
+      if (lhsDeadline != rhsDeadline)
+        return lhsDeadline - 1 > rhsDeadline - 1;
+      return lhs.sequence > rhs.sequence;
+    }
+  };
+
+  void workerMain() {
+    for (;;) {
+      std::function<void()> run;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wakeUp.wait(lock, [&] { return shuttingDown || !pending.empty(); });
+        if (pending.empty())
+          return;
+        std::pop_heap(pending.begin(), pending.end(), RunsLater());
+        run = std::move(pending.back().run);
+        pending.pop_back();
+      }
+      run();
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable wakeUp;
+  // A heap ordered by RunsLater.
+  std::vector<Request> pending;
+  uint64_t nextSequence = 0;
+  bool shuttingDown = false;
+  std::vector<std::thread> workers;
+};
+} // namespace refback
+
 JITModule::JITModule() {}
 
-void JITModule::buildBackendCompilationPipeline(PassManager &pm,
-                                                bool optimize) {
-  NPCOMP::RefBackendLoweringPipelineOptions options;
-  options.optimize = optimize;
+JITModule::~JITModule() {}
+
+// Compiler runtime functions bound into the JIT'ed code, in place of the ones
+// in the compiler runtime shared library, which then doesn't need to be loaded.
+// This makes compiled code share the allocator of the runtime linked into this
+// process, so buffers can be freely handed across the ABI boundary.
+static void compilerRtAbortIf(bool b, const char *msg) {
+  if (b) {
+    std::fprintf(stderr, "NPCOMP: aborting: %s\n", msg);
+    std::exit(1);
+  }
+}
+static void *compilerRtAlloc(std::int64_t size) {
+  return refbackrt::allocateAt(size, "compiled code");
+}
+static void compilerRtFree(void *ptr) {
+  refbackrt::deallocateAt(ptr, "compiled code");
+}
+static void *compilerRtAllocAt(std::int64_t size, const char *site) {
+  return refbackrt::allocateAt(size, site);
+}
+static void compilerRtFreeAt(void *ptr, const char *site) {
+  refbackrt::deallocateAt(ptr, site);
+}
+static void *compilerRtScratchAlloc(std::int64_t size) {
+  return refbackrt::allocateScratch(size);
+}
+static void compilerRtParallelFor(std::int64_t begin, std::int64_t end,
+                                  std::int64_t grainSize,
+                                  refbackrt::ParallelForBody body,
+                                  void *context) {
+  refbackrt::parallelFor(begin, end, grainSize, body, context);
+}
+static std::int64_t compilerRtProfileBegin() {
+  return refbackrt::beginProfiledOp();
+}
+static void compilerRtProfileEnd(const char *name, std::int64_t start) {
+  refbackrt::endProfiledOp(name, start);
+}
+static void compilerRtPrefetch(std::uint8_t *prefetched, const void *ptr,
+                               std::int64_t size) {
+  auto *flag = reinterpret_cast<std::atomic<std::uint8_t> *>(prefetched);
+  if (!flag->load(std::memory_order_relaxed) &&
+      !flag->exchange(1, std::memory_order_relaxed))
+    refbackrt::prefetchPages(ptr, size);
+}
+
+void JITModule::buildBackendCompilationPipeline(
+    PassManager &pm, const NPCOMP::RefBackendLoweringPipelineOptions &options) {
   NPCOMP::createTCFRefBackendLoweringPipeline(pm, options);
 }
 
+void JITModule::buildInterpreterPipeline(PassManager &pm) {
+  NPCOMP::createTCFRefBackendInterpreterPipeline(
+      pm, NPCOMP::RefBackendLoweringPipelineOptions());
+}
+
+ObjectStore::~ObjectStore() = default;
+
+namespace {
+// An object store keeping the object code stored under each key in a file of
+// a directory.
+class DirectoryObjectStore : public ObjectStore {
+public:
+  DirectoryObjectStore(llvm::StringRef directory)
+      : directory(directory.str()) {}
+
+  std::unique_ptr<llvm::MemoryBuffer> fetch(llvm::StringRef key) override {
+    auto buffer = llvm::MemoryBuffer::getFile(getPath(key));
+    if (!buffer)
+      return nullptr;
+    return std::move(*buffer);
+  }
+
+  void store(llvm::StringRef key, llvm::StringRef object) override {
+    if (llvm::sys::fs::create_directories(directory))
+      return;
+    // Write to a unique temporary file first, so that concurrent processes
+    // never load a partially written object.
+    llvm::SmallString<128> tempPath;
+    int fd;
+    if (llvm::sys::fs::createUniqueFile(getPath(key) + ".tmp-%%%%%%%%", fd,
+                                        tempPath))
+      return;
+    {
+      llvm::raw_fd_ostream os(fd, /*shouldClose=*/true);
+      os << object;
+      if (os.has_error()) {
+        os.clear_error();
+        llvm::sys::fs::remove(tempPath);
+        return;
+      }
+    }
+    if (llvm::sys::fs::rename(tempPath, getPath(key)))
+      llvm::sys::fs::remove(tempPath);
+  }
+
+private:
+  std::string getPath(llvm::StringRef key) const {
+    llvm::SmallString<128> path(directory);
+    llvm::sys::path::append(path, key + ".o");
+    return std::string(path);
+  }
+
+  std::string directory;
+};
+} // namespace
+
+std::shared_ptr<ObjectStore>
+ObjectStore::createDirectoryStore(llvm::StringRef directory) {
+  return std::make_shared<DirectoryObjectStore>(directory);
+}
+
+namespace {
+// An object cache looking up the object code of each module in a list of
+// object stores, under the module identifier, which fromCompiledModule sets
+// to a hash of everything the object code depends on. The object code found
+// in a store is put in the stores before it, and the object code compiled on
+// a miss in all of them.
+class TieredObjectCache : public llvm::ObjectCache {
+public:
+  TieredObjectCache(std::vector<std::shared_ptr<ObjectStore>> stores)
+      : stores(std::move(stores)) {}
+
+  void notifyObjectCompiled(const llvm::Module *module,
+                            llvm::MemoryBufferRef object) override {
+    for (const auto &store : stores)
+      store->store(module->getModuleIdentifier(), object.getBuffer());
+  }
+
+  std::unique_ptr<llvm::MemoryBuffer>
+  getObject(const llvm::Module *module) override {
+    llvm::StringRef key = module->getModuleIdentifier();
+    for (size_t i = 0, e = stores.size(); i < e; ++i) {
+      std::unique_ptr<llvm::MemoryBuffer> object = stores[i]->fetch(key);
+      if (!object)
+        continue;
+      for (size_t j = 0; j < i; ++j)
+        stores[j]->store(key, object->getBuffer());
+      return object;
+    }
+    return nullptr;
+  }
+
+private:
+  std::vector<std::shared_ptr<ObjectStore>> stores;
+};
+} // namespace
+
+namespace {
+// Compiles modules with a TargetMachine, after running the LLVM IR
+// optimization pipeline on them. Modules whose object code is found in the
+// object cache are neither optimized nor compiled again.
+//
+// A TargetMachine can only compile one module at a time, so a compiler called
+// concurrently (without a `targetMachine`) creates one for each module.
+class OptimizingCompiler : public llvm::orc::IRCompileLayer::IRCompiler {
+public:
+  OptimizingCompiler(llvm::orc::JITTargetMachineBuilder tmBuilder,
+                     std::unique_ptr<llvm::TargetMachine> targetMachine,
+                     unsigned optLevel, llvm::ObjectCache *objectCache)
+      : IRCompiler(llvm::orc::irManglingOptionsFromTargetOptions(
+            tmBuilder.getOptions())),
+        tmBuilder(std::move(tmBuilder)),
+        targetMachine(std::move(targetMachine)), optLevel(optLevel),
+        objectCache(objectCache) {}
+
+  Expected<std::unique_ptr<llvm::MemoryBuffer>>
+  operator()(llvm::Module &module) override {
+    if (objectCache)
+      if (std::unique_ptr<llvm::MemoryBuffer> object =
+              objectCache->getObject(&module))
+        return std::move(object);
+    std::unique_ptr<llvm::TargetMachine> moduleTargetMachine;
+    llvm::TargetMachine *tm = targetMachine.get();
+    if (!tm) {
+      auto expectedTargetMachine = tmBuilder.createTargetMachine();
+      if (!expectedTargetMachine)
+        return expectedTargetMachine.takeError();
+      moduleTargetMachine = std::move(*expectedTargetMachine);
+      tm = moduleTargetMachine.get();
+    }
+    auto transformer =
+        mlir::makeOptimizingTransformer(optLevel, /*sizeLevel=*/0, tm);
+    if (Error error = transformer(&module))
+      return std::move(error);
+    // Stores the object code in the cache.
+    return llvm::orc::SimpleCompiler(*tm, objectCache)(module);
+  }
+
+private:
+  llvm::orc::JITTargetMachineBuilder tmBuilder;
+  std::unique_ptr<llvm::TargetMachine> targetMachine;
+  unsigned optLevel;
+  llvm::ObjectCache *objectCache;
+};
+} // namespace
+
+// Configures `tmBuilder`, initialized for the host, as specified by `options`.
+static Error configureTarget(llvm::orc::JITTargetMachineBuilder &tmBuilder,
+                             const JITCompileOptions &options) {
+  if (options.optLevel > 3)
+    return make_string_error("invalid LLVM optimization level " +
+                             Twine(options.optLevel));
+  tmBuilder.setCodeGenOptLevel(
+      static_cast<llvm::CodeGenOpt::Level>(options.optLevel));
+  tmBuilder.getOptions().EnableFastISel = options.fastISel;
+  if (!options.cpu.empty() && options.cpu != "native") {
+    // The features of the host CPU don't apply to another CPU.
+    tmBuilder.setCPU(options.cpu);
+    tmBuilder.getFeatures() = llvm::SubtargetFeatures();
+  }
+  SmallVector<StringRef, 8> features;
+  StringRef(options.features)
+      .split(features, ',', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+  for (StringRef feature : features)
+    tmBuilder.getFeatures().AddFeature(feature.trim());
+  return Error::success();
+}
+
+namespace {
+// A host target configured as specified by a JITCompileOptions.
+struct JITTarget {
+  llvm::orc::JITTargetMachineBuilder tmBuilder;
+  llvm::DataLayout dataLayout;
+};
+} // namespace
+
+// Returns the host target configured as specified by `options`.
+//
+// Detecting the host CPU, and creating the TargetMachine that the data layout
+// comes from, each take about as long as compiling a small module, so they are
+// done once per process for each configuration.
+static Expected<JITTarget> getJITTarget(const JITCompileOptions &options) {
+  std::string key = options.cpu + '\0' + options.features + '\0' +
+                    std::to_string(options.optLevel) + '\0' +
+                    std::to_string(options.fastISel);
+  static std::mutex mutex;
+  static llvm::StringMap<JITTarget> targets;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = targets.find(key);
+    if (it != targets.end())
+      return it->second;
+  }
+
+  auto expectedTMBuilder = llvm::orc::JITTargetMachineBuilder::detectHost();
+  if (!expectedTMBuilder)
+    return expectedTMBuilder.takeError();
+  llvm::orc::JITTargetMachineBuilder tmBuilder = std::move(*expectedTMBuilder);
+  if (Error error = configureTarget(tmBuilder, options))
+    return std::move(error);
+  auto expectedDataLayout = tmBuilder.getDefaultDataLayoutForTarget();
+  if (!expectedDataLayout)
+    return expectedDataLayout.takeError();
+
+  std::lock_guard<std::mutex> lock(mutex);
+  return targets.try_emplace(key, JITTarget{tmBuilder, *expectedDataLayout})
+      .first->second;
+}
+
+Expected<NPCOMP::TargetInfo>
+JITModule::getTargetInfo(const JITCompileOptions &compileOptions) {
+  auto expectedTarget = getJITTarget(compileOptions);
+  if (!expectedTarget)
+    return expectedTarget.takeError();
+  auto expectedTM = expectedTarget->tmBuilder.createTargetMachine();
+  if (!expectedTM)
+    return expectedTM.takeError();
+  return getTargetInfo(**expectedTM, /*isHost=*/compileOptions.cpu.empty() ||
+                                         compileOptions.cpu == "native");
+}
+
+NPCOMP::TargetInfo
+JITModule::getTargetInfo(const llvm::TargetMachine &targetMachine,
+                         bool isHost) {
+  const llvm::MCSubtargetInfo *subtargetInfo =
+      targetMachine.getMCSubtargetInfo();
+  llvm::StringMap<bool> features;
+  for (const llvm::SubtargetFeatureKV &feature :
+       subtargetInfo->getAllProcessorFeatures()) {
+    if (subtargetInfo->checkFeatures(std::string("+") + feature.Key))
+      features[feature.Key] = true;
+  }
+  NPCOMP::TargetInfo target = NPCOMP::getTargetInfo(features);
+  if (isHost) {
+    NPCOMP::TargetInfo host = NPCOMP::getHostTargetInfo();
+    target.l1CacheSize = host.l1CacheSize;
+    target.l2CacheSize = host.l2CacheSize;
+    target.numCores = host.numCores;
+  }
+  return target;
+}
+
+// Returns the key of the object code of `module` compiled for `tmBuilder` at
+// `optLevel`.
+static std::string
+getObjectCacheKey(mlir::ModuleOp module,
+                  llvm::orc::JITTargetMachineBuilder &tmBuilder,
+                  unsigned optLevel) {
+  llvm::SHA1 hasher;
+  auto update = [&](llvm::StringRef data) {
+    hasher.update(data);
+    // Terminate each field, so that different fields never hash the same.
+    static const uint8_t terminator = 0;
+    hasher.update(llvm::makeArrayRef(terminator));
+  };
+  // The object code doesn't depend on where the external globals are stored,
+  // since their addresses are only defined when it is linked. Leaving that
+  // out lets modules whose weights were moved or refreshed share it.
+  std::string moduleText;
+  llvm::raw_string_ostream os(moduleText);
+  Attribute externalGlobals =
+      module->removeAttr(mlir::NPCOMP::kExternalGlobalsAttrName);
+  module.print(os);
+  if (externalGlobals)
+    module->setAttr(mlir::NPCOMP::kExternalGlobalsAttrName, externalGlobals);
+  update(os.str());
+  update(LLVM_VERSION_STRING);
+  update(tmBuilder.getTargetTriple().str());
+  update(tmBuilder.getCPU());
+  update(tmBuilder.getFeatures().getString());
+  update(std::to_string(optLevel));
+  update(std::to_string(tmBuilder.getOptions().EnableFastISel));
+  return llvm::toHex(hasher.result(), /*LowerCase=*/true);
+}
+
+// Modules are split for concurrent compilation into parts of at least this
+// many instructions, below which splitting costs more than it saves.
+static constexpr unsigned kMinInstructionsPerPartition = 20000;
+
+// Returns the number of parts to split `module` into, to compile them on up to
+// `compileThreads` threads.
+static unsigned getNumPartitions(llvm::Module &module,
+                                 unsigned compileThreads) {
+  if (compileThreads == 0)
+    compileThreads = std::max(std::thread::hardware_concurrency(), 1u);
+  unsigned numInstructions = 0;
+  for (llvm::Function &function : module)
+    numInstructions += function.getInstructionCount();
+  return std::max(
+      1u, std::min(compileThreads,
+                   numInstructions / kMinInstructionsPerPartition));
+}
+
+// Splits `module` into `numPartitions` modules, which are appended to
+// `partitions`, along with the name of a function defined by each to
+// `partitionSymbols`. Each partition has a context of its own, so that the
+// partitions can be compiled concurrently, and is identified by the
+// identifier of `module` and its index.
+static Error
+splitModule(llvm::Module &module, unsigned numPartitions,
+            std::vector<llvm::orc::ThreadSafeModule> &partitions,
+            SmallVectorImpl<std::string> &partitionSymbols) {
+  std::string errorMessage;
+  // The internal symbols referenced across partitions are made external.
+  llvm::SplitModule(
+      module, numPartitions,
+      [&](std::unique_ptr<llvm::Module> partition) {
+        if (!errorMessage.empty())
+          return;
+        // The partitions share the context of `module`, so move each one to a
+        // context of its own through bitcode.
+        llvm::SmallString<0> bitcode;
+        llvm::raw_svector_ostream os(bitcode);
+        llvm::WriteBitcodeToFile(*partition, os);
+        auto context = std::make_unique<llvm::LLVMContext>();
+        auto expectedPartition = llvm::parseBitcodeFile(
+            llvm::MemoryBufferRef(bitcode, module.getModuleIdentifier()),
+            *context);
+        if (!expectedPartition) {
+          errorMessage = llvm::toString(expectedPartition.takeError());
+          return;
+        }
+        std::unique_ptr<llvm::Module> &newPartition = *expectedPartition;
+        newPartition->setModuleIdentifier(
+            (module.getModuleIdentifier() + "." + Twine(partitions.size()) +
+             "-of-" + Twine(numPartitions))
+                .str());
+        for (llvm::Function &function : *newPartition) {
+          if (!function.isDeclaration()) {
+            partitionSymbols.push_back(function.getName().str());
+            break;
+          }
+        }
+        partitions.emplace_back(std::move(newPartition), std::move(context));
+      },
+      /*PreserveLocals=*/false);
+  if (!errorMessage.empty())
+    return make_string_error("could not split the module: " + errorMessage);
+  return Error::success();
+}
+
+// Translates, optimizes and generates code for `module` one function at a time
+// (see mlir::NPCOMP::streamFunctionModules), appending the object code of each
+// part to `objects`. Each part is translated into a context of its own, which
+// is freed along with its LLVM IR once its object code is generated.
+static Error compileFunctionAtATime(
+    mlir::ModuleOp module, llvm::orc::JITTargetMachineBuilder tmBuilder,
+    const llvm::DataLayout &dataLayout, unsigned optLevel,
+    std::vector<std::unique_ptr<llvm::MemoryBuffer>> &objects) {
+  auto expectedTargetMachine = tmBuilder.createTargetMachine();
+  if (!expectedTargetMachine)
+    return expectedTargetMachine.takeError();
+  std::string triple = tmBuilder.getTargetTriple().str();
+  OptimizingCompiler compiler(std::move(tmBuilder),
+                              std::move(*expectedTargetMachine), optLevel,
+                              /*objectCache=*/nullptr);
+  std::string errorMessage;
+  LogicalResult result = mlir::NPCOMP::streamFunctionModules(
+      module, [&](mlir::ModuleOp part) -> LogicalResult {
+        llvm::LLVMContext context;
+        std::unique_ptr<llvm::Module> llvmPart = mlir::translateModuleToLLVMIR(
+            part, context, "part" + std::to_string(objects.size()));
+        if (!llvmPart) {
+          errorMessage = "could not translate the module to LLVM IR";
+          return failure();
+        }
+        llvmPart->setTargetTriple(triple);
+        llvmPart->setDataLayout(dataLayout);
+        auto expectedObject = compiler(*llvmPart);
+        if (!expectedObject) {
+          errorMessage = llvm::toString(expectedObject.takeError());
+          return failure();
+        }
+        objects.push_back(std::move(*expectedObject));
+        return success();
+      });
+  if (failed(result))
+    return make_string_error(errorMessage);
+  return Error::success();
+}
+
+namespace refback {
+// The contents of a file storing external globals, either mapped read-only or
+// copied into huge pages.
+//
+// The contents of each file are loaded once per process: JITModules get them
+// through `get`, which hands out the copy already loaded by any live
+// JITModule.
+class ExternalWeights {
+public:
+  ExternalWeights(const ExternalWeights &) = delete;
+  ExternalWeights &operator=(const ExternalWeights &) = delete;
+  ~ExternalWeights() {
+    if (hugePagesData)
+      refbackrt::deallocateHugePages(hugePagesData, size);
+  }
+
+  static Expected<std::shared_ptr<const ExternalWeights>>
+  get(llvm::StringRef path, bool hugePages);
+
+  const char *getData() const {
+    return hugePagesData ? static_cast<const char *>(hugePagesData)
+                         : mappedFile->const_data();
+  }
+  std::size_t getSize() const { return size; }
+
+private:
+  ExternalWeights() = default;
+
+  std::unique_ptr<llvm::sys::fs::mapped_file_region> mappedFile;
+  void *hugePagesData = nullptr;
+  std::size_t size = 0;
+};
+} // namespace refback
+
+Expected<std::shared_ptr<const ExternalWeights>>
+ExternalWeights::get(llvm::StringRef path, bool hugePages) {
+  auto file = llvm::sys::fs::openNativeFileForRead(path);
+  if (!file)
+    return make_string_error("could not open " + Twine(path) + ": " +
+                             toString(file.takeError()));
+  auto closeFile =
+      llvm::make_scope_exit([&] { llvm::sys::fs::closeFile(*file); });
+  llvm::sys::fs::file_status status;
+  if (std::error_code error = llvm::sys::fs::status(*file, status))
+    return make_string_error("could not stat " + Twine(path) + ": " +
+                             error.message());
+
+  // Files are identified by their inode rather than their path, and a file
+  // rewritten in place is loaded again.
+  llvm::sys::fs::UniqueID id = status.getUniqueID();
+  std::string key = std::to_string(id.getDevice()) + ":" +
+                    std::to_string(id.getFile()) + ":" +
+                    std::to_string(status.getLastModificationTime()
+                                       .time_since_epoch()
+                                       .count()) +
+                    ":" + std::to_string(status.getSize()) +
+                    (hugePages ? ":huge" : "");
+  static std::mutex mutex;
+  static llvm::StringMap<std::weak_ptr<const ExternalWeights>> loaded;
+  std::lock_guard<std::mutex> lock(mutex);
+  if (std::shared_ptr<const ExternalWeights> weights = loaded[key].lock())
+    return weights;
+
+  std::shared_ptr<ExternalWeights> weights(new ExternalWeights);
+  weights->size = status.getSize();
+  std::error_code error;
+  weights->mappedFile = std::make_unique<llvm::sys::fs::mapped_file_region>(
+      *file, llvm::sys::fs::mapped_file_region::readonly, weights->size,
+      /*offset=*/0, error);
+  if (error)
+    return make_string_error("could not map " + Twine(path) + ": " +
+                             error.message());
+  if (hugePages) {
+    weights->hugePagesData = refbackrt::allocateHugePages(weights->size);
+    if (!weights->hugePagesData)
+      return make_string_error("could not allocate huge pages for " +
+                               Twine(path));
+    std::memcpy(weights->hugePagesData, weights->mappedFile->const_data(),
+                weights->size);
+    weights->mappedFile.reset();
+  }
+  loaded[key] = weights;
+  return std::shared_ptr<const ExternalWeights>(std::move(weights));
+}
+
+// Loads the files storing the external globals of `module` (see
+// mlir::NPCOMP::getExternalGlobals), adding them to `externalWeights`, and
+// defines the address of each global in `symbolMap`.
+static Error mapExternalGlobals(
+    mlir::ModuleOp module, llvm::orc::MangleAndInterner &interner,
+    llvm::orc::SymbolMap &symbolMap, bool hugePages,
+    std::vector<std::shared_ptr<const ExternalWeights>> &externalWeights) {
+  llvm::StringMap<const ExternalWeights *> weightsByPath;
+  for (const mlir::NPCOMP::ExternalGlobal &global :
+       mlir::NPCOMP::getExternalGlobals(module)) {
+    const ExternalWeights *&weights = weightsByPath[global.path];
+    if (!weights) {
+      auto expectedWeights = ExternalWeights::get(global.path, hugePages);
+      if (!expectedWeights)
+        return expectedWeights.takeError();
+      weights = expectedWeights->get();
+      externalWeights.push_back(std::move(*expectedWeights));
+    }
+    if (global.offset + global.size > weights->getSize())
+      return make_string_error(Twine(global.path) + " is too small for " +
+                               global.symbol);
+    symbolMap[interner(global.symbol)] = llvm::JITEvaluatedSymbol::fromPointer(
+        weights->getData() + global.offset);
+  }
+  return Error::success();
+}
+
+mlir::OwningModuleRef JITModule::parseModuleFile(llvm::StringRef path,
+                                                 mlir::MLIRContext &context) {
+  // The file is mapped rather than read when it is large.
+  mlir::OwningModuleRef module = mlir::parseSourceFile(path, &context);
+  if (module && path != "-")
+    mlir::NPCOMP::refback::resolveExternalElementsPaths(
+        *module, llvm::sys::path::parent_path(path));
+  return module;
+}
+
+// Loads `sharedLibs` into the process, making their symbols available to the
+// compiled code, unless an earlier JITModule did.
+static Error loadSharedLibraries(llvm::ArrayRef<llvm::StringRef> sharedLibs) {
+  static std::mutex mutex;
+  static llvm::StringSet<> loaded;
+  std::lock_guard<std::mutex> lock(mutex);
+  for (llvm::StringRef sharedLib : sharedLibs) {
+    if (loaded.count(sharedLib))
+      continue;
+    std::string errorMessage;
+    if (llvm::sys::DynamicLibrary::LoadLibraryPermanently(
+            sharedLib.str().c_str(), &errorMessage))
+      return make_string_error("could not load " + Twine(sharedLib) + ": " +
+                               errorMessage);
+    loaded.insert(sharedLib);
+  }
+  return Error::success();
+}
+
 llvm::Expected<std::unique_ptr<JITModule>>
 JITModule::fromCompiledModule(mlir::ModuleOp module,
-                              llvm::ArrayRef<llvm::StringRef> sharedLibs) {
+                              llvm::ArrayRef<llvm::StringRef> sharedLibs,
+                              llvm::StringRef objectCacheDir,
+                              const JITCompileOptions &compileOptions) {
   // Ensure LLVM Dialect -> LLVM IR translations are available.
   mlir::registerLLVMDialectTranslation(*module->getContext());
-  // Build the JITModule.
-  auto expectedEngine = ExecutionEngine::create(
-      module, /*llvmModuleBuilder=*/nullptr,
-      /*transformer=*/[](llvm::Module *) { return Error::success(); },
-      /*jitCodeGenOptLevel=*/llvm::None, llvm::to_vector<6>(sharedLibs));
-  if (!expectedEngine)
-    return expectedEngine.takeError();
+  auto expectedTarget = getJITTarget(compileOptions);
+  if (!expectedTarget)
+    return expectedTarget.takeError();
+  llvm::orc::JITTargetMachineBuilder &tmBuilder = expectedTarget->tmBuilder;
+  const llvm::DataLayout &dataLayout = expectedTarget->dataLayout;
+  const unsigned optLevel = compileOptions.optLevel;
+
+  // When streaming, the module is compiled to object code right away, one
+  // function at a time, instead of being translated to LLVM IR as a whole.
+  std::vector<std::unique_ptr<llvm::MemoryBuffer>> objects;
+  auto context = std::make_unique<llvm::LLVMContext>();
+  std::unique_ptr<llvm::Module> llvmModule;
+  if (compileOptions.streaming) {
+    if (compileOptions.lazy || !objectCacheDir.empty() ||
+        compileOptions.sharedObjectStore)
+      return make_string_error("streaming compilation supports neither lazy "
+                               "compilation nor an object cache");
+    if (Error error = compileFunctionAtATime(module, tmBuilder, dataLayout,
+                                             optLevel, objects))
+      return std::move(error);
+  } else {
+    llvmModule = mlir::translateModuleToLLVMIR(module, *context);
+    if (!llvmModule)
+      return make_string_error("could not translate the module to LLVM IR");
+    llvmModule->setTargetTriple(tmBuilder.getTargetTriple().str());
+    llvmModule->setDataLayout(dataLayout);
+  }
+
+  std::unique_ptr<JITModule> ret(new JITModule);
+  std::vector<std::shared_ptr<ObjectStore>> objectStores;
+  if (!objectCacheDir.empty())
+    objectStores.push_back(ObjectStore::createDirectoryStore(objectCacheDir));
+  if (compileOptions.sharedObjectStore)
+    objectStores.push_back(compileOptions.sharedObjectStore);
+  if (!objectStores.empty()) {
+    // Lazy compilation splits the module into per-function modules, which
+    // would all map to the same cache entry.
+    if (compileOptions.lazy)
+      return make_string_error(
+          "lazy compilation doesn't support an object cache");
+    // The cache looks up the object code by module identifier.
+    llvmModule->setModuleIdentifier(
+        getObjectCacheKey(module, tmBuilder, optLevel));
+    ret->objectCache =
+        std::make_unique<TieredObjectCache>(std::move(objectStores));
+  }
+
+  // Make the symbols of the shared libraries available to the compiled code.
+  if (Error error = loadSharedLibraries(sharedLibs))
+    return std::move(error);
+
+  llvm::ObjectCache *objectCache = ret->objectCache.get();
+  // Large modules are split into parts that are compiled concurrently, on the
+  // threads of the JIT.
+  const unsigned numPartitions =
+      !llvmModule || compileOptions.lazy
+          ? 1
+          : getNumPartitions(*llvmModule, compileOptions.compileThreads);
+  std::vector<llvm::orc::ThreadSafeModule> modules;
+  SmallVector<std::string, 8> partitionSymbols;
+  if (numPartitions > 1) {
+    if (Error error = splitModule(*llvmModule, numPartitions, modules,
+                                  partitionSymbols))
+      return std::move(error);
+    llvmModule.reset();
+    context.reset();
+  } else if (llvmModule) {
+    modules.emplace_back(std::move(llvmModule), std::move(context));
+  }
+  const bool concurrent = numPartitions > 1;
+
+  auto createCompiler =
+      [objectCache, optLevel,
+       concurrent](llvm::orc::JITTargetMachineBuilder tmBuilder)
+      -> Expected<std::unique_ptr<llvm::orc::IRCompileLayer::IRCompiler>> {
+    std::unique_ptr<llvm::TargetMachine> targetMachine;
+    if (!concurrent) {
+      auto expectedTargetMachine = tmBuilder.createTargetMachine();
+      if (!expectedTargetMachine)
+        return expectedTargetMachine.takeError();
+      targetMachine = std::move(*expectedTargetMachine);
+    }
+    return std::make_unique<OptimizingCompiler>(
+        std::move(tmBuilder), std::move(targetMachine), optLevel, objectCache);
+  };
+  llvm::orc::LLLazyJIT *lazyJit = nullptr;
+  if (compileOptions.lazy) {
+    auto expectedJit = llvm::orc::LLLazyJITBuilder()
+                           .setJITTargetMachineBuilder(tmBuilder)
+                           .setCompileFunctionCreator(createCompiler)
+                           .create();
+    if (!expectedJit)
+      return expectedJit.takeError();
+    lazyJit = expectedJit->get();
+    ret->jit = std::move(*expectedJit);
+  } else {
+    auto expectedJit = llvm::orc::LLJITBuilder()
+                           .setJITTargetMachineBuilder(tmBuilder)
+                           .setCompileFunctionCreator(createCompiler)
+                           .setNumCompileThreads(concurrent ? numPartitions
+                                                            : 0)
+                           .create();
+    if (!expectedJit)
+      return expectedJit.takeError();
+    ret->jit = std::move(*expectedJit);
+  }
+
+  // Resolve the symbols of this process (including the shared libraries
+  // loaded above), and bind the compiler runtime functions into the compiled
+  // code.
+  llvm::orc::JITDylib &mainJD = ret->jit->getMainJITDylib();
+  auto expectedGenerator =
+      llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+          dataLayout.getGlobalPrefix());
+  if (!expectedGenerator)
+    return expectedGenerator.takeError();
+  mainJD.addGenerator(std::move(*expectedGenerator));
+  llvm::orc::MangleAndInterner interner(ret->jit->getExecutionSession(),
+                                        dataLayout);
+  llvm::orc::SymbolMap symbolMap;
+  symbolMap[interner("__npcomp_compiler_rt_abort_if")] =
+      llvm::JITEvaluatedSymbol::fromPointer(compilerRtAbortIf);
+  symbolMap[interner("__npcomp_compiler_rt_alloc")] =
+      llvm::JITEvaluatedSymbol::fromPointer(compilerRtAlloc);
+  symbolMap[interner("__npcomp_compiler_rt_free")] =
+      llvm::JITEvaluatedSymbol::fromPointer(compilerRtFree);
+  symbolMap[interner("__npcomp_compiler_rt_alloc_at")] =
+      llvm::JITEvaluatedSymbol::fromPointer(compilerRtAllocAt);
+  symbolMap[interner("__npcomp_compiler_rt_free_at")] =
+      llvm::JITEvaluatedSymbol::fromPointer(compilerRtFreeAt);
+  symbolMap[interner("__npcomp_compiler_rt_scratch_alloc")] =
+      llvm::JITEvaluatedSymbol::fromPointer(compilerRtScratchAlloc);
+  symbolMap[interner("__npcomp_compiler_rt_parallel_for")] =
+      llvm::JITEvaluatedSymbol::fromPointer(compilerRtParallelFor);
+  symbolMap[interner("__npcomp_compiler_rt_profile_begin")] =
+      llvm::JITEvaluatedSymbol::fromPointer(compilerRtProfileBegin);
+  symbolMap[interner("__npcomp_compiler_rt_profile_end")] =
+      llvm::JITEvaluatedSymbol::fromPointer(compilerRtProfileEnd);
+  symbolMap[interner("__npcomp_compiler_rt_prefetch")] =
+      llvm::JITEvaluatedSymbol::fromPointer(compilerRtPrefetch);
+  if (Error error = mapExternalGlobals(module, interner, symbolMap,
+                                      compileOptions.hugePageWeights,
+                                      ret->externalWeights))
+    return std::move(error);
+  if (Error error = mainJD.define(llvm::orc::absoluteSymbols(symbolMap)))
+    return std::move(error);
+
+  for (llvm::orc::ThreadSafeModule &threadSafeModule : modules) {
+    if (Error error =
+            lazyJit ? lazyJit->addLazyIRModule(std::move(threadSafeModule))
+                    : ret->jit->addIRModule(std::move(threadSafeModule)))
+      return std::move(error);
+  }
+  for (std::unique_ptr<llvm::MemoryBuffer> &object : objects)
+    if (Error error = ret->jit->addObjectFile(std::move(object)))
+      return std::move(error);
+  // Looking up a symbol of each partition at once compiles them concurrently.
+  if (!partitionSymbols.empty()) {
+    llvm::orc::SymbolLookupSet symbols;
+    for (const std::string &symbol : partitionSymbols)
+      symbols.add(interner(symbol));
+    auto expectedSymbols = ret->jit->getExecutionSession().lookup(
+        llvm::orc::makeJITDylibSearchOrder(&mainJD), std::move(symbols));
+    if (!expectedSymbols)
+      return expectedSymbols.takeError();
+  }
+  // Looking up the module descriptor compiles the module (or loads it from the
+  // object cache). In lazy mode, it only compiles the descriptor, which points
+  // at stubs compiling each function on its first call.
+  auto expectedSymbol = ret->jit->lookup("_mlir___npcomp_module_descriptor");
+  if (!expectedSymbol)
+    return expectedSymbol.takeError();
+  ret->descriptor = reinterpret_cast<refbackrt::ModuleDescriptor *>(
+      expectedSymbol->getAddress());
+  return std::move(ret);
+}
+
+llvm::Expected<std::unique_ptr<JITModule>>
+JITModule::fromSharedObject(llvm::StringRef path) {
+  const char *errorMessage = nullptr;
+  refbackrt::ModuleDescriptor *descriptor =
+      refbackrt::loadModule(path.str().c_str(), &errorMessage);
+  if (!descriptor)
+    return make_string_error("could not load " + Twine(path) + ": " +
+                             errorMessage);
   std::unique_ptr<JITModule> ret(new JITModule);
-  ret->engine = std::move(*expectedEngine);
-  // Here we abuse mlir::ExecutionEngine a bit. It technically returns a
-  // function pointer, but here we look up a module descriptor.
-  auto expectedAddress = ret->engine->lookup("__npcomp_module_descriptor");
-  if (!expectedAddress)
-    return expectedAddress.takeError();
-  ret->descriptor =
-      reinterpret_cast<refbackrt::ModuleDescriptor *>(*expectedAddress);
+  ret->descriptor = descriptor;
   return std::move(ret);
 }
 
@@ -65,6 +915,10 @@ static refbackrt::StringRef toRefbackrt(llvm::StringRef s) {
   return refbackrt::StringRef(s.data(), s.size());
 }
 
+static llvm::StringRef fromRefbackrt(refbackrt::StringRef s) {
+  return llvm::StringRef(s.data(), s.size());
+}
+
 template <typename T>
 static refbackrt::ArrayRef<T> toRefbackrt(llvm::ArrayRef<T> a) {
   return refbackrt::ArrayRef<T>(a.data(), a.size());
@@ -75,7 +929,7 @@ static refbackrt::MutableArrayRef<T> toRefbackrt(llvm::MutableArrayRef<T> a) {
   return refbackrt::MutableArrayRef<T>(a.data(), a.size());
 }
 
-static std::string stringifyShape(refbackrt::ArrayRef<std::int32_t> extents) {
+static std::string stringifyShape(refbackrt::ArrayRef<std::int64_t> extents) {
   static constexpr char kDynamicDimAsString[] = "?";
   std::stringstream ss;
   ss << "(";
@@ -91,14 +945,15 @@ static std::string stringifyShape(refbackrt::ArrayRef<std::int32_t> extents) {
   return ss.str();
 }
 
-llvm::Expected<llvm::SmallVector<refbackrt::RtValue, 6>>
-JITModule::invoke(llvm::StringRef functionName,
-                  llvm::ArrayRef<refbackrt::RtValue> inputs) {
+// Gets the metadata for `function` and verifies that the user-provided
+// `inputs` match the types and shapes that the compiler expects.
+static Expected<refbackrt::FunctionMetadata>
+getMetadataAndCheckInputs(refbackrt::FunctionHandle function,
+                          llvm::ArrayRef<refbackrt::RtValue> inputs) {
   refbackrt::FunctionMetadata metadata;
-  if (refbackrt::failed(refbackrt::getMetadata(
-          descriptor, toRefbackrt(functionName), metadata)))
-    return make_string_error("unknown function: " + Twine(functionName));
-  SmallVector<refbackrt::RtValue, 6> outputs(metadata.numOutputs);
+  refbackrt::getMetadata(function, metadata);
+  llvm::StringRef functionName =
+      fromRefbackrt(refbackrt::getFunctionName(function));
   if (metadata.numInputs != static_cast<std::int32_t>(inputs.size()))
     return make_string_error("invoking '" + Twine(functionName) +
                              "': expected " + Twine(metadata.numInputs) +
@@ -118,29 +973,388 @@ JITModule::invoke(llvm::StringRef functionName,
       return make_string_error(
           "invoking '" + Twine(functionName) + "': input shape mismatch (%arg" +
           Twine(i) + "). " + "actual (provided by user): " +
-          stringifyShape(input.toTensor()->getExtents()) +
+          stringifyShape(input.getTensor()->getExtents()) +
           ", expected (from compiler): " +
-          stringifyShape(refbackrt::ArrayRef<int32_t>(
-              inputArgInfo.extents.data(), inputArgInfo.rank)));
-  }
-
-  // Create the correct output RtValue based on FuncMetadata,
-  // which contains the arg types (scalar, Tensor, etc.), element types (only
-  // applicable if not scalar) and shapes (also only applicable if not scalar)
-  //
-  // Currently we have to give each RtValue an output type so that we know
-  // how to pack / unpack the outputs properly across the ABI boundary in
-  // refbackrt::invoke. As a result, we can't just rely on the default
-  // construction of each output argument type (otherwise RtValue will have
-  // Tag::kNone) currently without passing the ArgInfo structs down to the
-  // Runtime level, so we deal with the output type creation here.
-  for (int i = 0; i < metadata.numOutputs; i++) {
-    outputs[i] =
-        refbackrt::createRtValueFromOutputArgInfo(metadata.outputArgInfos[i]);
-  }
-
-  refbackrt::invoke(
-      descriptor, toRefbackrt(functionName), toRefbackrt(inputs),
-      toRefbackrt(llvm::makeMutableArrayRef(outputs.data(), outputs.size())));
+          stringifyShape(inputArgInfo.extents));
+  }
+  return metadata;
+}
+
+llvm::Expected<refbackrt::FunctionHandle>
+JITModule::lookup(llvm::StringRef functionName) {
+  auto function =
+      refbackrt::lookupFunction(descriptor, toRefbackrt(functionName));
+  if (!function)
+    return make_string_error("unknown function: " + Twine(functionName));
+  return function;
+}
+
+llvm::Expected<refbackrt::FunctionHandle>
+JITModule::select(llvm::StringRef functionName,
+                  llvm::ArrayRef<refbackrt::RtValue> inputs) {
+  auto function = refbackrt::selectFunction(
+      descriptor, toRefbackrt(functionName), toRefbackrt(inputs));
+  if (!function)
+    return make_string_error("unknown function: " + Twine(functionName));
+  return function;
+}
+
+// Verifies the caller-provided outputs of a call of `functionName` (see
+// JITModule::invokeInto) against `outputArgInfos`.
+static llvm::Error
+checkOutputs(llvm::StringRef functionName,
+             llvm::ArrayRef<refbackrt::OutputArgInfo> outputArgInfos,
+             llvm::ArrayRef<refbackrt::RtValue> outputs) {
+  std::int32_t numOutputs = outputArgInfos.size();
+  if (numOutputs != static_cast<std::int32_t>(outputs.size()))
+    return make_string_error("invoking '" + Twine(functionName) +
+                             "': expected " + Twine(numOutputs) +
+                             " outputs");
+
+  // Verify the caller-provided outputs have the type and (static) shape that
+  // the compiler expects. Dynamic dimensions can only be checked after the
+  // call. Tensor outputs left as None get the buffers of the compiled code.
+  for (int i = 0; i < numOutputs; i++) {
+    auto &output = outputs[i];
+    auto &outputArgInfo = outputArgInfos[i];
+    if (output.isNone() && outputArgInfo.argType == refbackrt::ArgType::kTensor)
+      continue;
+    if (refbackrt::failed(checkRtValueArgTypes(output, outputArgInfo)))
+      return make_string_error(
+          "invoking '" + Twine(functionName) +
+          "': output argument type mismatch. actual (provided by user): " +
+          Twine(output.tagKind().str()) + ", expected (from compiler): " +
+          Twine(getArgTypeAsStringRef(outputArgInfo.argType).str()));
+    if (refbackrt::failed(checkRtValueShapes(output, outputArgInfo)))
+      return make_string_error(
+          "invoking '" + Twine(functionName) +
+          "': output shape mismatch (#" + Twine(i) + "). " +
+          "actual (provided by user): " +
+          stringifyShape(output.getTensor()->getExtents()) +
+          ", expected (from compiler): " +
+          stringifyShape(outputArgInfo.extents));
+    if (output.isTensor() && output.getTensor()->isReadOnly())
+      return make_string_error("invoking '" + Twine(functionName) +
+                               "': output #" + Twine(i) + " is read-only");
+  }
+  return Error::success();
+}
+
+llvm::Expected<PreparedCall>
+JITModule::prepare(llvm::StringRef functionName,
+                   llvm::ArrayRef<refbackrt::RtValue> exampleInputs) {
+  auto expectedFunction = select(functionName, exampleInputs);
+  if (!expectedFunction)
+    return expectedFunction.takeError();
+  auto expectedMetadata =
+      getMetadataAndCheckInputs(*expectedFunction, exampleInputs);
+  if (!expectedMetadata)
+    return expectedMetadata.takeError();
+  auto &metadata = *expectedMetadata;
+
+  PreparedCall call;
+  call.function = *expectedFunction;
+  for (int i = 0; i < metadata.numInputs; i++) {
+    // Pin any dynamic dimensions to the extents of the example input.
+    refbackrt::InputArgInfo info = metadata.inputArgInfos[i];
+    if (exampleInputs[i].isTensor()) {
+      auto extents = exampleInputs[i].getTensor()->getExtents();
+      info.rank = extents.size();
+      info.extents = extents;
+    }
+    call.inputSignature.push_back(info);
+  }
+  call.numOutputs = metadata.numOutputs;
+  call.outputArgInfos.append(metadata.outputArgInfos.begin(),
+                             metadata.outputArgInfos.begin() +
+                                 metadata.numOutputs);
+  return std::move(call);
+}
+
+llvm::StringRef PreparedCall::getFunctionName() const {
+  return fromRefbackrt(refbackrt::getFunctionName(function));
+}
+
+llvm::Error
+PreparedCall::checkInputs(llvm::ArrayRef<refbackrt::RtValue> inputs) const {
+  if (inputs.size() != inputSignature.size())
+    return make_string_error("invoking '" + Twine(getFunctionName()) +
+                             "': expected " + Twine(inputSignature.size()) +
+                             " inputs");
+  for (int i = 0, e = inputs.size(); i < e; i++) {
+    if (refbackrt::failed(checkRtValueArgTypes(inputs[i], inputSignature[i])) ||
+        refbackrt::failed(checkRtValueShapes(inputs[i], inputSignature[i])))
+      return make_string_error("invoking '" + Twine(getFunctionName()) +
+                               "': input does not match the signature the "
+                               "call was prepared with (%arg" +
+                               Twine(i) + ")");
+  }
+  return Error::success();
+}
+
+llvm::Expected<llvm::SmallVector<refbackrt::RtValue, 6>>
+PreparedCall::invoke(llvm::ArrayRef<refbackrt::RtValue> inputs) const {
+  if (Error error = checkInputs(inputs))
+    return std::move(error);
+
+  SmallVector<refbackrt::RtValue, 6> outputs(numOutputs);
+  const char *errorMessage = nullptr;
+  if (refbackrt::failed(refbackrt::invoke(
+          function, toRefbackrt(inputs),
+          toRefbackrt(llvm::makeMutableArrayRef(outputs.data(),
+                                                outputs.size())),
+          &errorMessage)))
+    return make_string_error("invoking '" + Twine(getFunctionName()) +
+                             "': " + errorMessage);
   return outputs;
 }
+
+llvm::SmallVector<refbackrt::RtValue, 6> PreparedCall::createOutputs() const {
+  SmallVector<refbackrt::RtValue, 6> outputs;
+  for (const refbackrt::OutputArgInfo &info : outputArgInfos) {
+    // Constant results are returned as read-only views, which can't be
+    // written into.
+    if (info.argType == refbackrt::ArgType::kTensor && info.isReadOnly)
+      outputs.emplace_back();
+    else
+      outputs.push_back(refbackrt::createRtValueFromOutputArgInfo(info));
+  }
+  return outputs;
+}
+
+llvm::Error PreparedCall::invokeInto(
+    llvm::ArrayRef<refbackrt::RtValue> inputs,
+    llvm::MutableArrayRef<refbackrt::RtValue> outputs) const {
+  if (Error error = checkInputs(inputs))
+    return std::move(error);
+  if (outputs.size() != outputArgInfos.size())
+    return make_string_error("invoking '" + Twine(getFunctionName()) +
+                             "': expected " + Twine(outputArgInfos.size()) +
+                             " outputs");
+
+  const char *errorMessage = nullptr;
+  if (refbackrt::failed(refbackrt::invokeInto(function, toRefbackrt(inputs),
+                                              toRefbackrt(outputs),
+                                              &errorMessage)))
+    return make_string_error("invoking '" + Twine(getFunctionName()) +
+                             "': " + errorMessage);
+  return Error::success();
+}
+
+llvm::Expected<refbackrt::CapturedCall>
+PreparedCall::capture(llvm::ArrayRef<refbackrt::RtValue> inputs,
+                      llvm::ArrayRef<refbackrt::RtValue> outputs) const {
+  if (Error error = checkInputs(inputs))
+    return std::move(error);
+  if (Error error = checkOutputs(getFunctionName(), outputArgInfos, outputs))
+    return std::move(error);
+  return refbackrt::CapturedCall::capture(function, toRefbackrt(inputs),
+                                          toRefbackrt(outputs));
+}
+
+llvm::Expected<std::vector<llvm::SmallVector<refbackrt::RtValue, 6>>>
+PreparedCall::invokeBatch(
+    llvm::ArrayRef<llvm::ArrayRef<refbackrt::RtValue>> batchInputs) const {
+  // refbackrt::invokeBatch takes the inputs (and outputs) of all calls
+  // concatenated together.
+  SmallVector<refbackrt::RtValue, 6> inputs;
+  SmallVector<refbackrt::RtValue, 6> outputs;
+  inputs.reserve(batchInputs.size() * inputSignature.size());
+  outputs.reserve(batchInputs.size() * numOutputs);
+  for (auto callInputs : batchInputs) {
+    if (Error error = checkInputs(callInputs))
+      return std::move(error);
+    inputs.append(callInputs.begin(), callInputs.end());
+    outputs.append(numOutputs, refbackrt::RtValue());
+  }
+
+  const char *errorMessage = nullptr;
+  if (refbackrt::failed(refbackrt::invokeBatch(
+          function, batchInputs.size(),
+          toRefbackrt(llvm::makeArrayRef(inputs)),
+          toRefbackrt(llvm::makeMutableArrayRef(outputs.data(),
+                                                outputs.size())),
+          &errorMessage)))
+    return make_string_error("invoking '" + Twine(getFunctionName()) +
+                             "': " + errorMessage);
+
+  std::vector<SmallVector<refbackrt::RtValue, 6>> results(batchInputs.size());
+  auto outputsIt = std::make_move_iterator(outputs.begin());
+  for (auto &callOutputs : results) {
+    callOutputs.append(outputsIt, outputsIt + numOutputs);
+    outputsIt += numOutputs;
+  }
+  return results;
+}
+
+llvm::Expected<llvm::SmallVector<refbackrt::RtValue, 6>>
+JITModule::invoke(llvm::StringRef functionName,
+                  llvm::ArrayRef<refbackrt::RtValue> inputs,
+                  const refbackrt::RequestSchedule &schedule) {
+  auto expectedFunction = select(functionName, inputs);
+  if (!expectedFunction)
+    return expectedFunction.takeError();
+  return invoke(*expectedFunction, inputs, schedule);
+}
+
+llvm::Expected<llvm::SmallVector<refbackrt::RtValue, 6>>
+JITModule::invoke(refbackrt::FunctionHandle function,
+                  llvm::ArrayRef<refbackrt::RtValue> inputs,
+                  const refbackrt::RequestSchedule &schedule) {
+  if (schedule.deadlineNanos &&
+      std::chrono::steady_clock::now().time_since_epoch() >
+          std::chrono::nanoseconds(schedule.deadlineNanos))
+    return make_string_error(
+        "invoking '" +
+        Twine(fromRefbackrt(refbackrt::getFunctionName(function))) +
+        "': deadline exceeded");
+  refbackrt::ScopedRequestSchedule scopedSchedule(schedule);
+  auto expectedMetadata = getMetadataAndCheckInputs(function, inputs);
+  if (!expectedMetadata)
+    return expectedMetadata.takeError();
+  // refbackrt::invoke creates the outputs from the output descriptors of the
+  // function, so they start out as None.
+  SmallVector<refbackrt::RtValue, 6> outputs(expectedMetadata->numOutputs);
+
+  // Failed runtime checks of the compiled code (such as shape checks) fail
+  // the call, rather than aborting the process.
+  const char *errorMessage = nullptr;
+  if (refbackrt::failed(refbackrt::invoke(
+          function, toRefbackrt(inputs),
+          toRefbackrt(llvm::makeMutableArrayRef(outputs.data(),
+                                                outputs.size())),
+          &errorMessage)))
+    return make_string_error(
+        "invoking '" +
+        Twine(fromRefbackrt(refbackrt::getFunctionName(function))) + "': " +
+        errorMessage);
+  return outputs;
+}
+
+std::future<AsyncCallResult>
+JITModule::invokeAsync(llvm::StringRef functionName,
+                       llvm::ArrayRef<refbackrt::RtValue> inputs,
+                       const refbackrt::RequestSchedule &schedule) {
+  std::call_once(schedulerCreated, [this] {
+    scheduler = std::make_unique<RequestScheduler>(
+        std::max(std::thread::hardware_concurrency(), 1u));
+  });
+  // std::function requires copyable tasks, so share the promise.
+  auto promise = std::make_shared<std::promise<AsyncCallResult>>();
+  auto future = promise->get_future();
+  scheduler->schedule(
+      schedule,
+      [this, promise, schedule, functionName = functionName.str(),
+       inputs = SmallVector<refbackrt::RtValue, 6>(inputs.begin(),
+                                                    inputs.end())] {
+        promise->set_value(invoke(functionName, inputs, schedule));
+      });
+  return future;
+}
+
+llvm::Error
+JITModule::invokeInto(llvm::StringRef functionName,
+                      llvm::ArrayRef<refbackrt::RtValue> inputs,
+                      llvm::MutableArrayRef<refbackrt::RtValue> outputs) {
+  auto expectedFunction = select(functionName, inputs);
+  if (!expectedFunction)
+    return expectedFunction.takeError();
+  return invokeInto(*expectedFunction, inputs, outputs);
+}
+
+llvm::Error
+JITModule::invokeInto(refbackrt::FunctionHandle function,
+                      llvm::ArrayRef<refbackrt::RtValue> inputs,
+                      llvm::MutableArrayRef<refbackrt::RtValue> outputs) {
+  auto expectedMetadata = getMetadataAndCheckInputs(function, inputs);
+  if (!expectedMetadata)
+    return expectedMetadata.takeError();
+  llvm::StringRef functionName =
+      fromRefbackrt(refbackrt::getFunctionName(function));
+  auto &metadata = *expectedMetadata;
+  if (Error error = checkOutputs(
+          functionName,
+          llvm::makeArrayRef(metadata.outputArgInfos.begin(),
+                             metadata.outputArgInfos.end()),
+          outputs))
+    return error;
+
+  const char *errorMessage = nullptr;
+  if (refbackrt::failed(refbackrt::invokeInto(function, toRefbackrt(inputs),
+                                              toRefbackrt(outputs),
+                                              &errorMessage)))
+    return make_string_error("invoking '" + Twine(functionName) + "': " +
+                             errorMessage);
+  return Error::success();
+}
+
+llvm::Error
+JITModule::warmup(llvm::StringRef functionName,
+                  llvm::ArrayRef<refbackrt::InputArgInfo> signature) {
+  SmallVector<refbackrt::InputArgInfo, 6> inputArgInfos(signature.begin(),
+                                                        signature.end());
+  if (signature.empty()) {
+    auto expectedMetadata = getMetadata(functionName);
+    if (!expectedMetadata)
+      return expectedMetadata.takeError();
+    inputArgInfos.assign(expectedMetadata->inputArgInfos.begin(),
+                         expectedMetadata->inputArgInfos.end());
+  }
+  SmallVector<refbackrt::RtValue, 6> inputs;
+  for (int i = 0, e = inputArgInfos.size(); i < e; i++) {
+    inputs.push_back(
+        refbackrt::createRtValueFromInputArgInfo(inputArgInfos[i]));
+    if (inputs.back().isNone())
+      return make_string_error("warming up '" + Twine(functionName) +
+                               "': %arg" + Twine(i) +
+                               " needs a static shape");
+  }
+
+  // Fault in the weights now rather than a page at a time during the call.
+  // Reading one byte of each page also maps pages that the OS didn't read
+  // ahead.
+  std::size_t pageSize = llvm::sys::Process::getPageSizeEstimate();
+  for (const auto &weights : externalWeights) {
+    refbackrt::prefetchPages(weights->getData(), weights->getSize());
+    const volatile char *data = weights->getData();
+    for (std::size_t offset = 0; offset < weights->getSize();
+         offset += pageSize)
+      (void)data[offset];
+  }
+  // Start the thread pool, if parallel loops run on it.
+  (void)refbackrt::getNumThreads();
+
+  auto expectedOutputs = invoke(functionName, inputs);
+  if (!expectedOutputs)
+    return make_string_error("warming up '" + Twine(functionName) +
+                             "': " + toString(expectedOutputs.takeError()));
+  return Error::success();
+}
+
+std::vector<std::string> JITModule::getFunctionNames() {
+  std::vector<std::string> names;
+  for (std::int32_t i = 0, e = refbackrt::getNumFunctions(descriptor); i < e;
+       i++)
+    names.push_back(fromRefbackrt(refbackrt::getFunctionName(
+                                      refbackrt::getFunction(descriptor, i)))
+                        .str());
+  return names;
+}
+
+llvm::Expected<refbackrt::FunctionMetadata>
+JITModule::getMetadata(llvm::StringRef functionName) {
+  auto expectedFunction = lookup(functionName);
+  if (!expectedFunction)
+    return expectedFunction.takeError();
+  refbackrt::FunctionMetadata metadata;
+  refbackrt::getMetadata(*expectedFunction, metadata);
+  return metadata;
+}
+
+llvm::Expected<refbackrt::FunctionStats>
+JITModule::getFunctionStats(llvm::StringRef functionName) {
+  auto expectedFunction = lookup(functionName);
+  if (!expectedFunction)
+    return expectedFunction.takeError();
+  return refbackrt::getFunctionStats(*expectedFunction);
+}
@@ -0,0 +1,445 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Rewrites `linalg.conv_2d_nchw` ops on tensors into matrix multiplications
+// where that is expected to be faster than computing the convolution
+// directly, choosing the algorithm from the shape of each convolution:
+//
+// - Winograd F(2x2, 3x3) for 3x3 convolutions with an even output size and
+//   enough channels for the 2.25x reduction in multiplications to pay for the
+//   input and output transforms. The transformed input and filter are
+//   multiplied with a `linalg.batch_matmul` (one matmul per point of the 4x4
+//   transformed tiles).
+// - im2col for other convolutions whose im2col matrix fits in the budget
+//   `max-im2col-elements`: each receptive field of the input is copied to a
+//   row of a matrix, which is multiplied with the filter as a `linalg.matmul`.
+//   The filter is the right-hand side, so that when it is a constant, its
+//   relayout is folded by FoldConstantLinalgOps and the product goes through
+//   the packed matmul microkernel (see PackMatmulWeights).
+// - Otherwise, the convolution is left as is, and is computed directly in
+//   register-blocked tiles by TileLinalgOps and VectorizeLinalgOps.
+//
+// The matrices flatten several dimensions of the convolution, which is done
+// with `floordiv`/`mod` indexing maps, so both rewrites need the spatial sizes
+// of the convolution to be static (the batch and channel sizes can be
+// dynamic).
+//
+// The `strategy` option forces the algorithm of all convolutions, and the
+// `conv_strategy` of the tuning attribute of a convolution (see Tuning.h)
+// forces the algorithm of that convolution. The tile sizes of the tuning
+// attribute are those of the matmul it is rewritten to, so they are moved to
+// that matmul.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+#include "npcomp/RefBackend/Tuning.h"
+
+#include "mlir/Dialect/Linalg/IR/LinalgOps.h"
+#include "mlir/Dialect/MemRef/IR/MemRef.h"
+#include "mlir/Dialect/StandardOps/IR/Ops.h"
+#include "mlir/IR/BuiltinAttributes.h"
+#include "llvm/ADT/StringSwitch.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+// Winograd only pays off when the transforms, whose cost is proportional to
+// the number of input (resp. output) channels, are amortized over enough
+// output (resp. input) channels.
+static constexpr int64_t kWinogradMinInputChannels = 16;
+static constexpr int64_t kWinogradMinOutputChannels = 32;
+
+namespace {
+enum class ConvStrategy { Direct, Im2col, Winograd };
+
+// The sizes of a convolution that the strategies depend on. The batch size
+// and channel counts are ShapedType::kDynamicSize when they are dynamic.
+struct ConvShape {
+  int64_t batch, inputChannels, outputChannels;
+  int64_t outputHeight, outputWidth, kernelHeight, kernelWidth;
+};
+} // namespace
+
+static Optional<ConvShape> getConvShape(linalg::ConvNCHWOp op) {
+  auto filterType = op.getOperand(1).getType().dyn_cast<RankedTensorType>();
+  auto resultType = op->getResult(0).getType().dyn_cast<RankedTensorType>();
+  if (!filterType || !resultType ||
+      !resultType.getElementType().isa<FloatType>())
+    return None;
+  ConvShape shape = {resultType.getDimSize(0),  filterType.getDimSize(1),
+                     resultType.getDimSize(1),  resultType.getDimSize(2),
+                     resultType.getDimSize(3),  filterType.getDimSize(2),
+                     filterType.getDimSize(3)};
+  if (ShapedType::isDynamic(shape.outputHeight) ||
+      ShapedType::isDynamic(shape.outputWidth) ||
+      ShapedType::isDynamic(shape.kernelHeight) ||
+      ShapedType::isDynamic(shape.kernelWidth))
+    return None;
+  return shape;
+}
+
+static bool canUseWinograd(const ConvShape &shape) {
+  return shape.kernelHeight == 3 && shape.kernelWidth == 3 &&
+         shape.outputHeight % 2 == 0 && shape.outputWidth % 2 == 0;
+}
+
+static Optional<ConvStrategy> parseStrategy(StringRef name) {
+  return llvm::StringSwitch<Optional<ConvStrategy>>(name)
+      .Case("winograd", ConvStrategy::Winograd)
+      .Case("im2col", ConvStrategy::Im2col)
+      .Case("direct", ConvStrategy::Direct)
+      .Default(None);
+}
+
+static ConvStrategy chooseStrategy(const ConvShape &shape,
+                                   int64_t maxIm2colElements) {
+  if (canUseWinograd(shape) &&
+      !ShapedType::isDynamic(shape.inputChannels) &&
+      !ShapedType::isDynamic(shape.outputChannels) &&
+      shape.inputChannels >= kWinogradMinInputChannels &&
+      shape.outputChannels >= kWinogradMinOutputChannels)
+    return ConvStrategy::Winograd;
+  if (ShapedType::isDynamic(shape.inputChannels))
+    return ConvStrategy::Direct;
+  // A dynamic batch size is typically small, so the budget is then checked
+  // for a single image.
+  int64_t batch = ShapedType::isDynamic(shape.batch) ? 1 : shape.batch;
+  int64_t im2colElements = batch * shape.outputHeight *
+                           shape.outputWidth * shape.inputChannels *
+                           shape.kernelHeight * shape.kernelWidth;
+  if (im2colElements <= maxIm2colElements)
+    return ConvStrategy::Im2col;
+  return ConvStrategy::Direct;
+}
+
+// Returns the size of dimension `dim` of `value`, as a constant if it is
+// static.
+static Value getDimSize(OpBuilder &b, Location loc, Value value, int64_t dim) {
+  auto type = value.getType().cast<ShapedType>();
+  if (!type.isDynamicDim(dim))
+    return b.create<ConstantIndexOp>(loc, type.getDimSize(dim));
+  return b.create<memref::DimOp>(loc, value, dim);
+}
+
+// Returns the size of dimension `dim` of `value` times `factor` if it is
+// static. Otherwise, appends the product to `dynamicSizes` and returns
+// ShapedType::kDynamicSize.
+static int64_t getScaledSize(OpBuilder &b, Location loc, Value value,
+                             int64_t dim, int64_t factor,
+                             SmallVectorImpl<Value> &dynamicSizes) {
+  auto type = value.getType().cast<ShapedType>();
+  if (!type.isDynamicDim(dim))
+    return type.getDimSize(dim) * factor;
+  dynamicSizes.push_back(b.create<MulIOp>(
+      loc, getDimSize(b, loc, value, dim),
+      b.create<ConstantIndexOp>(loc, factor)));
+  return ShapedType::kDynamicSize;
+}
+
+static Value createInitTensor(OpBuilder &b, Location loc,
+                              ArrayRef<int64_t> shape, ValueRange dynamicSizes,
+                              Type elementType) {
+  return b.create<linalg::InitTensorOp>(loc, dynamicSizes, shape,
+                                        elementType);
+}
+
+static Value createZeroTensor(OpBuilder &b, Location loc,
+                              ArrayRef<int64_t> shape, ValueRange dynamicSizes,
+                              Type elementType) {
+  Value init = createInitTensor(b, loc, shape, dynamicSizes, elementType);
+  Value zero = b.create<ConstantOp>(loc, b.getZeroAttr(elementType));
+  return b.create<linalg::FillOp>(loc, init, zero).getResult(0);
+}
+
+// Creates a linalg.generic with the given loops, operands and payload, whose
+// result type is the type of `output`.
+static Value
+createGenericOp(OpBuilder &b, Location loc, ValueRange inputs, Value output,
+                ArrayRef<AffineMap> indexingMaps,
+                ArrayRef<StringRef> iteratorTypes,
+                function_ref<void(OpBuilder &, Location, ValueRange)> payload) {
+  auto generic = b.create<linalg::GenericOp>(
+      loc, TypeRange(output.getType()), inputs, output, indexingMaps,
+      iteratorTypes, payload);
+  return generic->getResult(0);
+}
+
+// Yields the first argument of the payload.
+static void yieldCopy(OpBuilder &b, Location loc, ValueRange args) {
+  b.create<linalg::YieldOp>(loc, args[0]);
+}
+
+// Yields the last argument plus the product of the others.
+static void yieldMultiplyAdd(OpBuilder &b, Location loc, ValueRange args) {
+  Value product = args[0];
+  for (Value arg : args.drop_front().drop_back())
+    product = b.create<MulFOp>(loc, product, arg);
+  b.create<linalg::YieldOp>(loc, b.create<AddFOp>(loc, args.back(), product));
+}
+
+// Yields the sum of the arguments.
+static void yieldAdd(OpBuilder &b, Location loc, ValueRange args) {
+  b.create<linalg::YieldOp>(loc, b.create<AddFOp>(loc, args[1], args[0]));
+}
+
+static SmallVector<StringRef, 6> getIteratorTypes(unsigned numParallel,
+                                                  unsigned numReduction) {
+  SmallVector<StringRef, 6> iteratorTypes(numParallel,
+                                          getParallelIteratorTypeName());
+  iteratorTypes.append(numReduction, getReductionIteratorTypeName());
+  return iteratorTypes;
+}
+
+// Rewrites `op` as the product of its im2col matrix, of type
+// `tensor<(N*OH*OW) x (C*KH*KW)>`, with its filter transposed to
+// `tensor<(C*KH*KW) x F>`.
+static Value lowerWithIm2col(OpBuilder &b, linalg::ConvNCHWOp op,
+                             const ConvShape &shape) {
+  Location loc = op.getLoc();
+  MLIRContext *context = op.getContext();
+  Value input = op.getOperand(0);
+  Value filter = op.getOperand(1);
+  Value init = op.getOperand(2);
+  Type elementType = init.getType().cast<ShapedType>().getElementType();
+  int64_t spatialSize = shape.outputHeight * shape.outputWidth;
+  int64_t kernelSize = shape.kernelHeight * shape.kernelWidth;
+
+  auto filterType = filter.getType().cast<ShapedType>();
+  int64_t numFilters = filterType.getDimSize(0);
+  SmallVector<Value, 1> rowSizes, colSizes, filterSizes;
+  int64_t numRows = getScaledSize(b, loc, init, 0, spatialSize, rowSizes);
+  int64_t numCols = getScaledSize(b, loc, filter, 1, kernelSize, colSizes);
+  if (ShapedType::isDynamic(numFilters))
+    filterSizes.push_back(getDimSize(b, loc, filter, 0));
+
+  AffineExpr d0, d1;
+  bindDims(context, d0, d1);
+  AffineMap identity = AffineMap::getMultiDimIdentityMap(2, context);
+  // col[q, r] = input[n, c, oh + kh, ow + kw] for q = (n*OH + oh)*OW + ow and
+  // r = (c*KH + kh)*KW + kw.
+  Value col = createGenericOp(
+      b, loc, input,
+      createInitTensor(b, loc, {numRows, numCols},
+                       llvm::to_vector<2>(llvm::concat<Value>(rowSizes,
+                                                               colSizes)),
+                       elementType),
+      {AffineMap::get(2, 0,
+                      {d0.floorDiv(spatialSize), d1.floorDiv(kernelSize),
+                       (d0 % spatialSize).floorDiv(shape.outputWidth) +
+                           (d1 % kernelSize).floorDiv(shape.kernelWidth),
+                       d0 % shape.outputWidth + d1 % shape.kernelWidth},
+                      context),
+       identity},
+      getIteratorTypes(2, 0), yieldCopy);
+  // transposedFilter[r, f] = filter[f, c, kh, kw].
+  Value transposedFilter = createGenericOp(
+      b, loc, filter,
+      createInitTensor(b, loc, {numCols, numFilters},
+                       llvm::to_vector<2>(llvm::concat<Value>(colSizes,
+                                                               filterSizes)),
+                       elementType),
+      {AffineMap::get(2, 0,
+                      {d1, d0.floorDiv(kernelSize),
+                       (d0 % kernelSize).floorDiv(shape.kernelWidth),
+                       d0 % shape.kernelWidth},
+                      context),
+       identity},
+      getIteratorTypes(2, 0), yieldCopy);
+
+  SmallVector<int64_t, 2> productShape = {numRows, numFilters};
+  Value product =
+      b.create<linalg::MatmulOp>(
+           loc, TypeRange(RankedTensorType::get(productShape, elementType)),
+           ValueRange({col, transposedFilter}),
+           createZeroTensor(b, loc, productShape,
+                            llvm::to_vector<2>(llvm::concat<Value>(
+                                rowSizes, filterSizes)),
+                            elementType))
+          ->getResult(0);
+
+  // Accumulate the product, laid out as (N, OH, OW) x F, into the output.
+  AffineExpr n, f, oh, ow;
+  bindDims(context, n, f, oh, ow);
+  return createGenericOp(
+      b, loc, product, init,
+      {AffineMap::get(4, 0,
+                      {n * spatialSize + oh * shape.outputWidth + ow, f},
+                      context),
+       AffineMap::getMultiDimIdentityMap(4, context)},
+      getIteratorTypes(4, 0), yieldAdd);
+}
+
+// Returns a constant matrix of type `elementType` with `rows` rows.
+static Value createMatrix(OpBuilder &b, Location loc, Type elementType,
+                          ArrayRef<ArrayRef<double>> rows) {
+  SmallVector<Attribute, 16> elements;
+  for (ArrayRef<double> row : rows)
+    for (double element : row)
+      elements.push_back(b.getFloatAttr(elementType, element));
+  auto type = RankedTensorType::get(
+      {static_cast<int64_t>(rows.size()),
+       static_cast<int64_t>(rows.front().size())},
+      elementType);
+  return b.create<ConstantOp>(loc, DenseElementsAttr::get(type, elements));
+}
+
+// Rewrites `op` with the Winograd F(2x2, 3x3) algorithm:
+//   out = A^T [(G g G^T) . (B^T d B)] A
+// for each 4x4 tile d of the input (with a stride of 2), where `.` is the
+// elementwise product summed over the input channels.
+static Value lowerWithWinograd(OpBuilder &b, linalg::ConvNCHWOp op,
+                               const ConvShape &shape) {
+  Location loc = op.getLoc();
+  MLIRContext *context = op.getContext();
+  Value input = op.getOperand(0);
+  Value filter = op.getOperand(1);
+  Value init = op.getOperand(2);
+  Type elementType = init.getType().cast<ShapedType>().getElementType();
+  int64_t tilesWidth = shape.outputWidth / 2;
+  int64_t numTiles = shape.outputHeight / 2 * tilesWidth;
+  int64_t inputChannels = shape.inputChannels;
+  int64_t outputChannels = shape.outputChannels;
+
+  Value g = createMatrix(b, loc, elementType,
+                         {{1.0, 0.0, 0.0},
+                          {0.5, 0.5, 0.5},
+                          {0.5, -0.5, 0.5},
+                          {0.0, 0.0, 1.0}});
+  Value bt = createMatrix(b, loc, elementType,
+                          {{1.0, 0.0, -1.0, 0.0},
+                           {0.0, 1.0, 1.0, 0.0},
+                           {0.0, -1.0, 1.0, 0.0},
+                           {0.0, 1.0, 0.0, -1.0}});
+  Value at = createMatrix(b, loc, elementType,
+                          {{1.0, 1.0, 1.0, 0.0}, {0.0, 1.0, -1.0, -1.0}});
+
+  // The transformed filter U, with the 16 points of each tile flattened to
+  // the batch dimension: U[a*4+b, c, f] = (G g[f, c] G^T)[a, b].
+  AffineExpr ab, x, y, i, j;
+  bindDims(context, ab, x, y, i, j);
+  Value u = createGenericOp(
+      b, loc, ValueRange({g, g, filter}),
+      createZeroTensor(b, loc, {16, inputChannels, outputChannels},
+                       ValueRange(), elementType),
+      {AffineMap::get(5, 0, {ab.floorDiv(4), i}, context),
+       AffineMap::get(5, 0, {ab % 4, j}, context),
+       AffineMap::get(5, 0, {y, x, i, j}, context),
+       AffineMap::get(5, 0, {ab, x, y}, context)},
+      getIteratorTypes(3, 2), yieldMultiplyAdd);
+
+  // The transformed input V, with the tiles of all images flattened to the
+  // rows: V[a*4+b, (n*TH + th)*TW + tw, c] = (B^T d[n, c, th, tw] B)[a, b].
+  SmallVector<Value, 1> tileSizes;
+  int64_t numRows = getScaledSize(b, loc, init, 0, numTiles, tileSizes);
+  Value v = createGenericOp(
+      b, loc, ValueRange({bt, bt, input}),
+      createZeroTensor(b, loc, {16, numRows, inputChannels}, tileSizes,
+                       elementType),
+      {AffineMap::get(5, 0, {ab.floorDiv(4), i}, context),
+       AffineMap::get(5, 0, {ab % 4, j}, context),
+       AffineMap::get(5, 0,
+                      {x.floorDiv(numTiles), y,
+                       (x % numTiles).floorDiv(tilesWidth) * 2 + i,
+                       x % tilesWidth * 2 + j},
+                      context),
+       AffineMap::get(5, 0, {ab, x, y}, context)},
+      getIteratorTypes(3, 2), yieldMultiplyAdd);
+
+  // M[a*4+b] = V[a*4+b] U[a*4+b], summing over the input channels.
+  auto productType =
+      RankedTensorType::get({16, numRows, outputChannels}, elementType);
+  Value m = b.create<linalg::BatchMatmulOp>(
+                 loc, TypeRange(productType), ValueRange({v, u}),
+                 createZeroTensor(b, loc, productType.getShape(), tileSizes,
+                                  elementType))
+                ->getResult(0);
+
+  // out[n, f, oh, ow] += (A^T M[n, f, th, tw] A)[oh mod 2, ow mod 2], where
+  // M[n, f, th, tw] is the 4x4 tile of M for output tile (th, tw).
+  AffineExpr n, f, oh, ow, s, t;
+  bindDims(context, n, f, oh, ow, s, t);
+  return createGenericOp(
+      b, loc, ValueRange({at, at, m}), init,
+      {AffineMap::get(6, 0, {oh % 2, s}, context),
+       AffineMap::get(6, 0, {ow % 2, t}, context),
+       AffineMap::get(6, 0,
+                      {s * 4 + t,
+                       n * numTiles + oh.floorDiv(2) * tilesWidth +
+                           ow.floorDiv(2),
+                       f},
+                      context),
+       AffineMap::get(6, 0, {n, f, oh, ow}, context)},
+      getIteratorTypes(4, 2), yieldMultiplyAdd);
+}
+
+namespace {
+class LowerConvolutions : public LowerConvolutionsBase<LowerConvolutions> {
+  void runOnOperation() override {
+    FuncOp func = getOperation();
+    Optional<ConvStrategy> forcedStrategy;
+    if (strategy != "auto" && !(forcedStrategy = parseStrategy(strategy))) {
+      func.emitError() << "unknown convolution strategy '" << strategy << "'";
+      return signalPassFailure();
+    }
+
+    SmallVector<linalg::ConvNCHWOp, 4> convs;
+    func.walk([&](linalg::ConvNCHWOp op) {
+      if (op.hasTensorSemantics())
+        convs.push_back(op);
+    });
+    for (linalg::ConvNCHWOp op : convs) {
+      Optional<ConvShape> shape = getConvShape(op);
+      if (!shape)
+        continue;
+      TuningConfig tuning = getTuningConfig(op);
+      Optional<ConvStrategy> tunedStrategy = forcedStrategy;
+      if (!tuning.convStrategy.empty() &&
+          !(tunedStrategy = parseStrategy(tuning.convStrategy))) {
+        op.emitError() << "unknown convolution strategy '"
+                       << tuning.convStrategy << "'";
+        return signalPassFailure();
+      }
+      ConvStrategy convStrategy =
+          tunedStrategy ? *tunedStrategy
+                        : chooseStrategy(*shape, maxIm2colElements);
+      // Winograd needs the channel counts to size its transformed operands.
+      if (convStrategy == ConvStrategy::Winograd &&
+          (!canUseWinograd(*shape) ||
+           ShapedType::isDynamic(shape->inputChannels) ||
+           ShapedType::isDynamic(shape->outputChannels)))
+        convStrategy = ConvStrategy::Direct;
+
+      OpBuilder builder(op);
+      Operation *previous = op->getPrevNode();
+      Value result;
+      if (convStrategy == ConvStrategy::Winograd)
+        result = lowerWithWinograd(builder, op, *shape);
+      else if (convStrategy == ConvStrategy::Im2col)
+        result = lowerWithIm2col(builder, op, *shape);
+      else
+        continue;
+      tuning.convStrategy.clear();
+      auto created = previous ? ++Block::iterator(previous)
+                              : op->getBlock()->begin();
+      for (Operation &createdOp :
+           llvm::make_range(created, Block::iterator(op)))
+        if (isa<linalg::MatmulOp, linalg::BatchMatmulOp>(createdOp))
+          setTuningConfig(&createdOp, tuning);
+      op->getResult(0).replaceAllUsesWith(result);
+      op.erase();
+    }
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createLowerConvolutionsPass() {
+  return std::make_unique<LowerConvolutions>();
+}
@@ -0,0 +1,169 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Lowers the matmuls whose right-hand side was packed by PackMatmulWeights to
+// a register-blocked microkernel.
+//
+// For each panel of the packed matrix (in parallel), the output is computed
+// `rows` rows at a time: the `rows` x `panelWidth` block of the output is held
+// in `rows` vector accumulators throughout the whole reduction, and each step
+// of the reduction loads one row of the panel as a vector and multiplies it
+// with a broadcast element of each of the `rows` rows of the left-hand side,
+// accumulating with FMAs (or, without `use-fma`, with separate multiplies and
+// adds, for targets without FMA units). Leftover rows are computed one at a
+// time, and the columns of the last panel beyond the output are masked off
+// when the accumulators are loaded and stored.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+
+#include "mlir/Dialect/Linalg/IR/LinalgOps.h"
+#include "mlir/Dialect/StandardOps/IR/Ops.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+// Emits the microkernel computing the `numRows` rows of the output block
+// starting at (`row`, `col`), from panel `panel` of `packed`.
+static void emitMicrokernel(OpBuilder &builder, Location loc, Value lhs,
+                            Value packed, Value out, Value panel, Value row,
+                            Value col, int64_t numRows, bool useFMA) {
+  // The operands may be narrower than the output (see DemoteToBF16), in
+  // which case they are extended to the type of the accumulators.
+  auto packedType = packed.getType().cast<MemRefType>();
+  Type accumulatorType = out.getType().cast<MemRefType>().getElementType();
+  auto vectorType =
+      VectorType::get({packedType.getDimSize(2)}, accumulatorType);
+  auto packedVectorType = VectorType::get({packedType.getDimSize(2)},
+                                          packedType.getElementType());
+  Value c0 = builder.create<ConstantIndexOp>(loc, 0);
+  Value c1 = builder.create<ConstantIndexOp>(loc, 1);
+  SmallVector<Value, 4> rows;
+  for (int64_t r = 0; r < numRows; r++)
+    rows.push_back(builder.create<AddIOp>(
+        loc, row, builder.create<ConstantIndexOp>(loc, r)));
+
+  SmallVector<Value, 4> accumulators;
+  for (Value r : rows)
+    accumulators.push_back(builder.create<vector::TransferReadOp>(
+        loc, vectorType, out, ValueRange({r, col})));
+
+  Value reductionSize = builder.create<memref::DimOp>(loc, lhs, 1);
+  auto reduction = builder.create<scf::ForOp>(
+      loc, c0, reductionSize, c1, accumulators,
+      [&](OpBuilder &b, Location loc, Value k, ValueRange iterArgs) {
+        Value panelRow = b.create<vector::TransferReadOp>(
+            loc, packedVectorType, packed, ValueRange({panel, k, c0}),
+            /*inBounds=*/ArrayRef<bool>(true));
+        if (packedVectorType != vectorType)
+          panelRow = b.create<FPExtOp>(loc, panelRow, vectorType);
+        SmallVector<Value, 4> results;
+        for (auto r : llvm::enumerate(rows)) {
+          Value element =
+              b.create<memref::LoadOp>(loc, lhs, ValueRange({r.value(), k}));
+          if (element.getType() != accumulatorType)
+            element = b.create<FPExtOp>(loc, element, accumulatorType);
+          Value broadcast =
+              b.create<vector::BroadcastOp>(loc, vectorType, element);
+          if (useFMA) {
+            results.push_back(b.create<vector::FMAOp>(
+                loc, broadcast, panelRow, iterArgs[r.index()]));
+          } else {
+            results.push_back(b.create<AddFOp>(
+                loc, b.create<MulFOp>(loc, broadcast, panelRow),
+                iterArgs[r.index()]));
+          }
+        }
+        b.create<scf::YieldOp>(loc, results);
+      });
+
+  for (auto r : llvm::enumerate(rows))
+    builder.create<vector::TransferWriteOp>(
+        loc, reduction.getResult(r.index()), out, ValueRange({r.value(), col}));
+}
+
+static void lowerPackedMatmul(linalg::GenericOp op, int64_t rowsPerBlock,
+                              bool useFMA) {
+  OpBuilder builder(op);
+  Location loc = op.getLoc();
+  Value lhs = op.getOperand(0);
+  Value packed = op.getOperand(1);
+  Value out = op.getOperand(2);
+  auto packedType = packed.getType().cast<MemRefType>();
+  int64_t panelWidth = packedType.getDimSize(2);
+
+  Value c0 = builder.create<ConstantIndexOp>(loc, 0);
+  Value c1 = builder.create<ConstantIndexOp>(loc, 1);
+  Value numPanels =
+      builder.create<ConstantIndexOp>(loc, packedType.getDimSize(0));
+  builder.create<scf::ParallelOp>(
+      loc, ValueRange(c0), ValueRange(numPanels), ValueRange(c1),
+      [&](OpBuilder &b, Location loc, ValueRange ivs) {
+        Value panel = ivs[0];
+        Value col = b.create<MulIOp>(
+            loc, panel, b.create<ConstantIndexOp>(loc, panelWidth));
+        Value numRows = b.create<memref::DimOp>(loc, lhs, 0);
+        Value blockSize = b.create<ConstantIndexOp>(loc, rowsPerBlock);
+        Value numBlockedRows = b.create<SubIOp>(
+            loc, numRows, b.create<UnsignedRemIOp>(loc, numRows, blockSize));
+        b.create<scf::ForOp>(
+            loc, c0, numBlockedRows, blockSize, llvm::None,
+            [&](OpBuilder &b, Location loc, Value row, ValueRange) {
+              emitMicrokernel(b, loc, lhs, packed, out, panel, row, col,
+                              rowsPerBlock, useFMA);
+              b.create<scf::YieldOp>(loc);
+            });
+        b.create<scf::ForOp>(
+            loc, numBlockedRows, numRows, c1, llvm::None,
+            [&](OpBuilder &b, Location loc, Value row, ValueRange) {
+              emitMicrokernel(b, loc, lhs, packed, out, panel, row, col,
+                              /*numRows=*/1, useFMA);
+              b.create<scf::YieldOp>(loc);
+            });
+        b.create<scf::YieldOp>(loc);
+      });
+  op.erase();
+}
+
+namespace {
+class LowerPackedMatmuls : public LowerPackedMatmulsBase<LowerPackedMatmuls> {
+public:
+  LowerPackedMatmuls() = default;
+  LowerPackedMatmuls(int64_t numRows, bool fma) {
+    rows = numRows;
+    useFMA = fma;
+  }
+
+  void runOnOperation() override {
+    FuncOp func = getOperation();
+    if (rows <= 0) {
+      func.emitError() << "number of rows must be positive";
+      return signalPassFailure();
+    }
+    SmallVector<linalg::GenericOp, 4> matmuls;
+    func.walk([&](linalg::GenericOp op) {
+      if (op->hasAttr("refback.packed_matmul") && op.hasBufferSemantics())
+        matmuls.push_back(op);
+    });
+    for (linalg::GenericOp op : matmuls)
+      lowerPackedMatmul(op, rows, useFMA);
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createLowerPackedMatmulsPass() {
+  return std::make_unique<LowerPackedMatmuls>();
+}
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createLowerPackedMatmulsPass(int64_t rows, bool useFMA) {
+  return std::make_unique<LowerPackedMatmuls>(rows, useFMA);
+}
@@ -0,0 +1,238 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Distributes the iterations of outermost `scf.parallel` loops across the
+// runtime's thread pool.
+//
+// The first dimension of each such loop is outlined into a body function
+// that runs a range of its iterations (the remaining dimensions stay an
+// `scf.parallel` inside it, which is later lowered to sequential loops), and
+// the loop is replaced by a `refbackrt.parallel_for` calling that function.
+// The values the loop uses from above are passed through the context pointer
+// of the body function, except constants, which are simply cloned into it.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+
+#include "mlir/Dialect/StandardOps/IR/Ops.h"
+#include "mlir/IR/BlockAndValueMapping.h"
+#include "mlir/Transforms/RegionUtils.h"
+#include "npcomp/Dialect/Refbackrt/IR/RefbackrtOps.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/Support/MathExtras.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+// The attribute marking the outlined body functions.
+constexpr StringLiteral kParallelBodyAttrName = "refbackrt.parallel_body";
+
+// The number of innermost loop iterations that a task should at least run to
+// amortize the cost of scheduling it.
+constexpr int64_t kMinIterationsPerTask = 1 << 14;
+
+// The number of iterations assumed for loops without a static trip count.
+constexpr int64_t kUnknownTripCount = 16;
+
+static int64_t getTripCountEstimate(Value lowerBound, Value upperBound,
+                                    Value step) {
+  auto lb = lowerBound.getDefiningOp<ConstantIndexOp>();
+  auto ub = upperBound.getDefiningOp<ConstantIndexOp>();
+  auto st = step.getDefiningOp<ConstantIndexOp>();
+  if (!lb || !ub || !st || st.getValue() <= 0)
+    return kUnknownTripCount;
+  return std::max<int64_t>(
+      llvm::divideCeil(std::max<int64_t>(ub.getValue() - lb.getValue(), 0),
+                       st.getValue()),
+      1);
+}
+
+// Multiplies the trip counts of the loops of `op`, starting at `firstLoop`,
+// into `count`, saturating at kMinIterationsPerTask.
+static void accumulateTripCounts(scf::ParallelOp op, unsigned firstLoop,
+                                 int64_t &count) {
+  for (unsigned i = firstLoop, e = op.getNumLoops(); i < e; i++)
+    count = std::min(count * getTripCountEstimate(op.lowerBound()[i],
+                                                  op.upperBound()[i],
+                                                  op.step()[i]),
+                     kMinIterationsPerTask);
+}
+
+// Returns an estimate of the number of innermost loop iterations that one
+// iteration of the first loop of `op` executes.
+static int64_t estimateIterationsPerStep(scf::ParallelOp op) {
+  int64_t ownCount = 1;
+  accumulateTripCounts(op, /*firstLoop=*/1, ownCount);
+  int64_t deepestCount = ownCount;
+  op.getBody()->walk([&](Operation *nested) {
+    if (!isa<scf::ForOp, scf::ParallelOp>(nested))
+      return;
+    int64_t count = ownCount;
+    for (Operation *loop = nested; loop != op; loop = loop->getParentOp()) {
+      if (auto forOp = dyn_cast<scf::ForOp>(loop))
+        count = std::min(count * getTripCountEstimate(forOp.lowerBound(),
+                                                      forOp.upperBound(),
+                                                      forOp.step()),
+                         kMinIterationsPerTask);
+      else if (auto parallelOp = dyn_cast<scf::ParallelOp>(loop))
+        accumulateTripCounts(parallelOp, /*firstLoop=*/0, count);
+    }
+    deepestCount = std::max(deepestCount, count);
+  });
+  return deepestCount;
+}
+
+static bool isCapturableType(Type type) {
+  return type.isa<MemRefType, IndexType, IntegerType, FloatType, VectorType>();
+}
+
+// Replaces `op` by a `refbackrt.parallel_for` over its first loop, whose body
+// is outlined into a function named `bodyName`.
+static LogicalResult outlineParallelLoop(scf::ParallelOp op,
+                                         StringRef bodyName) {
+  MLIRContext *context = op.getContext();
+  Location loc = op.getLoc();
+
+  // The values that the outlined body needs from above. The bounds of the
+  // first loop are replaced by the range of the subrange being executed, but
+  // its lower bound and step are still needed to compute the induction
+  // variable.
+  llvm::SetVector<Value> usedValues;
+  usedValues.insert(op.lowerBound()[0]);
+  usedValues.insert(op.step()[0]);
+  for (unsigned i = 1, e = op.getNumLoops(); i < e; i++) {
+    usedValues.insert(op.lowerBound()[i]);
+    usedValues.insert(op.upperBound()[i]);
+    usedValues.insert(op.step()[i]);
+  }
+  getUsedValuesDefinedAbove(op.region(), op.region(), usedValues);
+
+  SmallVector<Operation *, 6> constants;
+  SmallVector<Value, 6> captures;
+  for (Value value : usedValues) {
+    if (auto constant = value.getDefiningOp<ConstantOp>()) {
+      constants.push_back(constant);
+      continue;
+    }
+    if (!isCapturableType(value.getType()))
+      return failure();
+    captures.push_back(value);
+  }
+
+  // Create the body function.
+  auto indexType = IndexType::get(context);
+  auto contextType = LLVM::LLVMPointerType::get(IntegerType::get(context, 8));
+  auto bodyType =
+      FunctionType::get(context, {indexType, indexType, contextType}, {});
+  auto parentFunc = op->getParentOfType<FuncOp>();
+  auto bodyFunc = OpBuilder(parentFunc).create<FuncOp>(loc, bodyName, bodyType);
+  bodyFunc.setPrivate();
+  bodyFunc->setAttr(kParallelBodyAttrName, UnitAttr::get(context));
+
+  Block *entry = bodyFunc.addEntryBlock();
+  auto builder = OpBuilder::atBlockEnd(entry);
+  BlockAndValueMapping mapping;
+  for (Operation *constant : constants)
+    builder.clone(*constant, mapping);
+  auto unpack = builder.create<refbackrt::UnpackParallelContextOp>(
+      loc, ValueRange(captures).getTypes(), entry->getArgument(2));
+  mapping.map(captures, unpack.getResults());
+
+  Value one = builder.create<ConstantIndexOp>(loc, 1);
+  auto forOp = builder.create<scf::ForOp>(loc, entry->getArgument(0),
+                                          entry->getArgument(1), one);
+  builder.setInsertionPoint(forOp.getBody()->getTerminator());
+  Value scaled = builder.create<MulIOp>(loc, forOp.getInductionVar(),
+                                        mapping.lookup(op.step()[0]));
+  mapping.map(op.getInductionVars()[0],
+              builder.create<AddIOp>(loc, mapping.lookup(op.lowerBound()[0]),
+                                     scaled));
+  if (op.getNumLoops() > 1) {
+    auto lookupAll = [&](ValueRange values) {
+      return llvm::to_vector<4>(llvm::map_range(
+          values.drop_front(), [&](Value v) { return mapping.lookup(v); }));
+    };
+    auto innerOp = builder.create<scf::ParallelOp>(
+        loc, lookupAll(op.lowerBound()), lookupAll(op.upperBound()),
+        lookupAll(op.step()));
+    mapping.map(op.getInductionVars().drop_front(),
+                innerOp.getInductionVars());
+    builder.setInsertionPoint(innerOp.getBody()->getTerminator());
+  }
+  for (Operation &nested : op.getBody()->without_terminator())
+    builder.clone(nested, mapping);
+  builder.setInsertionPointToEnd(entry);
+  builder.create<ReturnOp>(loc);
+
+  // Replace the loop by a parallel_for over the normalized iteration space
+  // of its first loop: ceildiv(ub - lb, step) iterations.
+  builder.setInsertionPoint(op);
+  Value lb = op.lowerBound()[0];
+  Value ub = op.upperBound()[0];
+  Value step = op.step()[0];
+  Value stepMinusOne = builder.create<SubIOp>(
+      loc, step, builder.create<ConstantIndexOp>(loc, 1));
+  Value tripCount = builder.create<SignedDivIOp>(
+      loc,
+      builder.create<AddIOp>(loc, builder.create<SubIOp>(loc, ub, lb),
+                             stepMinusOne),
+      step);
+  int64_t grainSize = llvm::divideCeil(kMinIterationsPerTask,
+                                       estimateIterationsPerStep(op));
+  builder.create<refbackrt::ParallelForOp>(
+      loc, builder.getSymbolRefAttr(bodyFunc.getName()),
+      builder.create<ConstantIndexOp>(loc, 0), tripCount,
+      builder.create<ConstantIndexOp>(loc, grainSize), captures);
+  op.erase();
+  return success();
+}
+
+namespace {
+class LowerParallelLoops : public LowerParallelLoopsBase<LowerParallelLoops> {
+  void runOnOperation() override {
+    ModuleOp module = getOperation();
+    // Collect the functions first, since we add new ones as we go. The body
+    // functions of concurrent tasks are added too, so that the loops in each
+    // task are distributed as well.
+    SmallVector<FuncOp, 6> funcs;
+    for (FuncOp func : module.getOps<FuncOp>()) {
+      if (!func->hasAttr(kParallelBodyAttrName))
+        funcs.push_back(func);
+    }
+    for (unsigned i = 0; i < funcs.size(); i++) {
+      FuncOp func = funcs[i];
+      // Only outermost loops are distributed; nested ones already have
+      // plenty of parallelism around them. Loops with reductions aren't
+      // supported.
+      SmallVector<scf::ParallelOp, 4> loops;
+      func.walk([&](scf::ParallelOp op) {
+        if (!op->getParentOfType<scf::ParallelOp>() && op.initVals().empty())
+          loops.push_back(op);
+      });
+      for (auto loop : llvm::enumerate(loops)) {
+        std::string bodyName =
+            (func.getName() + ".parallel_body." + Twine(loop.index())).str();
+        // Loops that use values we can't pass through the context just stay
+        // sequential.
+        bool isConcurrentTasks =
+            loop.value()->hasAttr(kConcurrentTasksAttrName);
+        if (succeeded(outlineParallelLoop(loop.value(), bodyName)) &&
+            isConcurrentTasks)
+          funcs.push_back(module.lookupSymbol<FuncOp>(bodyName));
+      }
+    }
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<ModuleOp>>
+mlir::NPCOMP::createLowerParallelLoopsPass() {
+  return std::make_unique<LowerParallelLoops>();
+}
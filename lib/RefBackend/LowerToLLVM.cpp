@@ -11,13 +11,17 @@
 
 #include "mlir/Conversion/StandardToLLVM/ConvertStandardToLLVM.h"
 #include "mlir/Conversion/StandardToLLVM/ConvertStandardToLLVMPass.h"
+#include "mlir/Conversion/VectorToLLVM/ConvertVectorToLLVM.h"
 #include "mlir/Dialect/LLVMIR/LLVMDialect.h"
 #include "mlir/Dialect/Math/Transforms/Passes.h"
+#include "mlir/Dialect/MemRef/IR/MemRef.h"
 #include "mlir/Dialect/StandardOps/Transforms/Passes.h"
 #include "mlir/Transforms/DialectConversion.h"
 
+#include "npcomp/Dialect/Refback/IR/RefbackDialect.h"
 #include "npcomp/Dialect/Refbackrt/IR/RefbackrtDialect.h"
 #include "npcomp/Dialect/Refbackrt/IR/RefbackrtOps.h"
+#include "llvm/Support/Path.h"
 
 using namespace mlir;
 using namespace mlir::NPCOMP;
@@ -34,17 +38,12 @@ using mlir::LLVM::LLVMVoidType;
 // These correspond to the types in CompilerDataStructures.h
 //===----------------------------------------------------------------------===//
 
-// MaxRank that the refbackrt ABI lowering is capable of handling
-// NOTE: This parameter must stay consistent with
-// `lib/RefBackend/LowerToRefbackrtABI.cpp`
-static constexpr int kMaxRank = 6;
-
 static LLVMPointerType getInt8PointerType(MLIRContext *context) {
   return LLVMPointerType::get(IntegerType::get(context, 8));
 }
 
-static LLVMPointerType getInt32PointerType(MLIRContext *context) {
-  return LLVMPointerType::get(IntegerType::get(context, 32));
+static LLVMPointerType getInt64PointerType(MLIRContext *context) {
+  return LLVMPointerType::get(IntegerType::get(context, 64));
 }
 
 static LLVMStructType getInputDescriptorTy(MLIRContext *context) {
@@ -57,7 +56,9 @@ static LLVMStructType getInputDescriptorTy(MLIRContext *context) {
                    // Rank
                    IntegerType::get(context, 32),
                    // Extents
-                   LLVMPointerType::get(IntegerType::get(context, 32)),
+                   LLVMPointerType::get(IntegerType::get(context, 64)),
+                   // IsReadOnly
+                   IntegerType::get(context, 32),
                    // IsStatic
                    // IntegerType::get(context, 32),
                });
@@ -73,7 +74,11 @@ static LLVMStructType getOutputDescriptorTy(MLIRContext *context) {
                    // Rank
                    IntegerType::get(context, 32),
                    // Extents
-                   LLVMPointerType::get(IntegerType::get(context, 32)),
+                   LLVMPointerType::get(IntegerType::get(context, 64)),
+                   // Ownership
+                   IntegerType::get(context, 32),
+                   // AliasIndex
+                   IntegerType::get(context, 32),
                    // IsStatic
                    // IntegerType::get(context, 32),
                });
@@ -97,6 +102,18 @@ static LLVMStructType getFuncDescriptorTy(MLIRContext *context) {
                    LLVMPointerType::get(getInputDescriptorTy(context)),
                    // Result Descriptors
                    LLVMPointerType::get(getOutputDescriptorTy(context)),
+                   // Peak scratch bytes.
+                   IntegerType::get(context, 64),
+                   // Direct-call function pointer, or null.
+                   getInt8PointerType(context),
+                   // Constant bytes.
+                   IntegerType::get(context, 64),
+                   // Input bytes.
+                   IntegerType::get(context, 64),
+                   // Output bytes.
+                   IntegerType::get(context, 64),
+                   // Interpreted function, always null for compiled code.
+                   getInt8PointerType(context),
                });
 }
 
@@ -157,6 +174,21 @@ static LLVM::GlobalOp createGlobalString(ModuleOp module, StringAttr msg,
   return globalOp;
 }
 
+// Creates a global string holding `str`, and returns an `i8*` to it.
+static Value createGlobalStringPtr(Operation *op, StringAttr str,
+                                   OpBuilder &builder) {
+  auto *context = op->getContext();
+  // Create the global string, take its address, and gep to get an `i8*`.
+  auto globalOp = createGlobalString(op->getParentOfType<ModuleOp>(), str,
+                                     builder, op->getLoc());
+  auto array = builder.create<LLVM::AddressOfOp>(op->getLoc(), globalOp);
+  auto c0 = builder.create<LLVM::ConstantOp>(op->getLoc(),
+                                             IntegerType::get(context, 32),
+                                             builder.getI32IntegerAttr(0));
+  return builder.create<LLVM::GEPOp>(op->getLoc(), getInt8PointerType(context),
+                                     array, ValueRange({c0, c0}));
+}
+
 namespace {
 class AbortIfOpCompilerRuntimeLowering
     : public OpConversionPattern<refbackrt::AbortIfOp> {
@@ -168,26 +200,287 @@ public:
   matchAndRewrite(refbackrt::AbortIfOp op, ArrayRef<Value> operands,
                   ConversionPatternRewriter &rewriter) const override {
     refbackrt::AbortIfOp::Adaptor adaptor(operands);
+    Value msg = createGlobalStringPtr(op, op.msgAttr(), rewriter);
+    rewriter.replaceOpWithNewOp<LLVM::CallOp>(
+        op, backingFunc, ValueRange({adaptor.pred(), msg}));
+    return success();
+  }
+  LLVM::LLVMFuncOp backingFunc;
+};
+} // namespace
+
+namespace {
+class ProfileEndOpCompilerRuntimeLowering
+    : public OpConversionPattern<refbackrt::ProfileEndOp> {
+public:
+  ProfileEndOpCompilerRuntimeLowering(LLVM::LLVMFuncOp backingFunc)
+      : OpConversionPattern<refbackrt::ProfileEndOp>(backingFunc.getContext()),
+        backingFunc(backingFunc) {}
+  LogicalResult
+  matchAndRewrite(refbackrt::ProfileEndOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    refbackrt::ProfileEndOp::Adaptor adaptor(operands);
+    // The runtime keys the profile by the address of the name, so each
+    // profiled op gets its own string.
+    Value name = createGlobalStringPtr(op, op.nameAttr(), rewriter);
+    rewriter.replaceOpWithNewOp<LLVM::CallOp>(
+        op, backingFunc, ValueRange({name, adaptor.start()}));
+    return success();
+  }
+  LLVM::LLVMFuncOp backingFunc;
+};
+} // namespace
+
+namespace {
+// Lowers casts between integers of different signedness (which the frontend
+// emits to compute on the elements of `si64` index tensors, see the backend
+// contract) by forwarding their operand: both are the same LLVM integer.
+class LowerSignCastOp
+    : public ConvertOpToLLVMPattern<UnrealizedConversionCastOp> {
+public:
+  using ConvertOpToLLVMPattern<
+      UnrealizedConversionCastOp>::ConvertOpToLLVMPattern;
+  LogicalResult
+  matchAndRewrite(UnrealizedConversionCastOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    if (operands.size() != 1 || op.getNumResults() != 1 ||
+        typeConverter->convertType(op.getResult(0).getType()) !=
+            operands[0].getType())
+      return failure();
+    rewriter.replaceOp(op, operands);
+    return success();
+  }
+};
+} // namespace
+
+// Returns the integer type with the shape of `type` (a scalar or vector type)
+// and `bitWidth` bits.
+static Type getIntegerTypeLike(Type type, unsigned bitWidth) {
+  Type intType = IntegerType::get(type.getContext(), bitWidth);
+  if (auto vectorType = type.dyn_cast<VectorType>())
+    return VectorType::get(vectorType.getShape(), intType);
+  return intType;
+}
+
+// Returns the integer constant `value` of the scalar or vector `type`.
+static Value createIntegerConstant(OpBuilder &b, Location loc, Type type,
+                                   int64_t value) {
+  auto scalar = b.getIntegerAttr(getElementTypeOrSelf(type), value);
+  if (auto vectorType = type.dyn_cast<VectorType>())
+    return b.create<ConstantOp>(loc,
+                                SplatElementsAttr::get(vectorType, scalar));
+  return b.create<ConstantOp>(loc, scalar);
+}
+
+namespace {
+// Expands the conversions between f32 and bf16 (see DemoteToBF16) to integer
+// ops on their bits, so that they don't depend on the target's support for
+// bf16: a bf16 is the upper half of an f32.
+class ExpandBF16ExtOp : public OpRewritePattern<FPExtOp> {
+public:
+  ExpandBF16ExtOp(MLIRContext *context)
+      : OpRewritePattern<FPExtOp>(context, /*benefit=*/2) {}
+  LogicalResult matchAndRewrite(FPExtOp op,
+                                PatternRewriter &rewriter) const override {
+    Type type = op.getType();
+    if (!getElementTypeOrSelf(op.getOperand().getType()).isBF16() ||
+        !getElementTypeOrSelf(type).isF32())
+      return failure();
+    Location loc = op.getLoc();
+    Type i16Type = getIntegerTypeLike(type, 16);
+    Type i32Type = getIntegerTypeLike(type, 32);
+    Value bits = rewriter.create<BitcastOp>(loc, op.getOperand(), i16Type);
+    bits = rewriter.create<ZeroExtendIOp>(loc, bits, i32Type);
+    bits = rewriter.create<ShiftLeftOp>(
+        loc, bits, createIntegerConstant(rewriter, loc, i32Type, 16));
+    rewriter.replaceOpWithNewOp<BitcastOp>(op, bits, type);
+    return success();
+  }
+};
+
+// Rounds to the nearest bf16, ties to even, and keeps NaNs quiet.
+class ExpandBF16TruncOp : public OpRewritePattern<FPTruncOp> {
+public:
+  ExpandBF16TruncOp(MLIRContext *context)
+      : OpRewritePattern<FPTruncOp>(context, /*benefit=*/2) {}
+  LogicalResult matchAndRewrite(FPTruncOp op,
+                                PatternRewriter &rewriter) const override {
+    Value operand = op.getOperand();
+    Type type = op.getType();
+    if (!getElementTypeOrSelf(operand.getType()).isF32() ||
+        !getElementTypeOrSelf(type).isBF16())
+      return failure();
+    Location loc = op.getLoc();
+    Type i32Type = getIntegerTypeLike(type, 32);
+    auto constant = [&](int64_t value) {
+      return createIntegerConstant(rewriter, loc, i32Type, value);
+    };
+    Value bits = rewriter.create<BitcastOp>(loc, operand, i32Type);
+    // Adding 0x7fff plus the lowest bit kept rounds the upper half to nearest
+    // even (carrying into the exponent as needed).
+    Value lowestKeptBit = rewriter.create<AndOp>(
+        loc, rewriter.create<UnsignedShiftRightOp>(loc, bits, constant(16)),
+        constant(1));
+    Value rounded = rewriter.create<AddIOp>(
+        loc, bits,
+        rewriter.create<AddIOp>(loc, lowestKeptBit, constant(0x7fff)));
+    // Rounding could turn a NaN into an infinity.
+    Value quietNaN = rewriter.create<OrOp>(loc, bits, constant(0x400000));
+    Value isNaN =
+        rewriter.create<CmpFOp>(loc, CmpFPredicate::UNO, operand, operand);
+    rounded = rewriter.create<SelectOp>(loc, isNaN, quietNaN, rounded);
+    Value upperHalf = rewriter.create<TruncateIOp>(
+        loc, rewriter.create<UnsignedShiftRightOp>(loc, rounded, constant(16)),
+        getIntegerTypeLike(type, 16));
+    rewriter.replaceOpWithNewOp<BitcastOp>(op, upperHalf, type);
+    return success();
+  }
+};
+} // namespace
+
+namespace {
+// Lowers allocations marked `refbackrt.scratch` by LowerToRefbackrtABI to the
+// compiler runtime's scratch allocator. The runtime releases all scratch
+// buffers at once when the invocation returns, so these allocations are never
+// freed individually.
+class LowerScratchAllocOp : public ConvertOpToLLVMPattern<memref::AllocOp> {
+public:
+  LowerScratchAllocOp(LLVMTypeConverter &typeConverter,
+                      LLVM::LLVMFuncOp backingFunc)
+      : ConvertOpToLLVMPattern<memref::AllocOp>(typeConverter,
+                                                /*benefit=*/2),
+        backingFunc(backingFunc) {}
+  LogicalResult
+  matchAndRewrite(memref::AllocOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    MemRefType memRefType = op.getType();
+    if (!op->hasAttr("refbackrt.scratch") ||
+        !isConvertibleAndHasIdentityMaps(memRefType))
+      return failure();
+    memref::AllocOp::Adaptor adaptor(operands, op->getAttrDictionary());
+    auto loc = op.getLoc();
+
+    SmallVector<Value, 4> sizes;
+    SmallVector<Value, 4> strides;
+    Value sizeBytes;
+    getMemRefDescriptorSizes(loc, memRefType, adaptor.dynamicSizes(), rewriter,
+                             sizes, strides, sizeBytes);
+    // The scratch allocator guarantees the same alignment as the regular one,
+    // so the allocated and aligned pointers coincide.
+    auto call = rewriter.create<LLVM::CallOp>(loc, backingFunc, sizeBytes);
+    Value ptr = rewriter.create<LLVM::BitcastOp>(
+        loc, getElementPtrType(memRefType), call.getResult(0));
+    auto descriptor = createMemRefDescriptor(loc, memRefType, ptr, ptr, sizes,
+                                             strides, rewriter);
+    rewriter.replaceOp(op, {descriptor});
+    return success();
+  }
+  LLVM::LLVMFuncOp backingFunc;
+};
+} // namespace
+
+namespace {
+// Lowers refbackrt.parallel_for to a call to the compiler runtime, which runs
+// the body on the runtime's thread pool. The captured values are packed into
+// a struct on the stack of the calling function, which stays alive until the
+// call returns, since the runtime waits for all iterations to finish.
+class LowerParallelForOp
+    : public ConvertOpToLLVMPattern<refbackrt::ParallelForOp> {
+public:
+  LowerParallelForOp(LLVMTypeConverter &typeConverter,
+                     LLVM::LLVMFuncOp backingFunc)
+      : ConvertOpToLLVMPattern<refbackrt::ParallelForOp>(typeConverter),
+        backingFunc(backingFunc) {}
+  LogicalResult
+  matchAndRewrite(refbackrt::ParallelForOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    refbackrt::ParallelForOp::Adaptor adaptor(operands,
+                                              op->getAttrDictionary());
     auto *context = op.getContext();
+    auto loc = op.getLoc();
+
+    Value contextPtr;
+    if (adaptor.captures().empty()) {
+      contextPtr =
+          rewriter.create<LLVM::NullOp>(loc, getInt8PointerType(context));
+    } else {
+      SmallVector<Type, 6> fieldTypes(
+          ValueRange(adaptor.captures()).getTypes());
+      auto structTy = LLVMStructType::getLiteral(context, fieldTypes);
+      Value packed = rewriter.create<LLVM::UndefOp>(loc, structTy);
+      for (auto capture : llvm::enumerate(adaptor.captures()))
+        packed = rewriter.create<LLVM::InsertValueOp>(
+            loc, packed, capture.value(),
+            rewriter.getI32ArrayAttr(capture.index()));
+
+      // Allocate the struct in the entry block, so that parallel loops nested
+      // in sequential ones don't grow the stack.
+      Value storage;
+      {
+        OpBuilder::InsertionGuard guard(rewriter);
+        Operation *func = op->getParentWithTrait<OpTrait::FunctionLike>();
+        rewriter.setInsertionPointToStart(&func->getRegion(0).front());
+        Value one = rewriter.create<LLVM::ConstantOp>(
+            loc, IntegerType::get(context, 64), rewriter.getI64IntegerAttr(1));
+        storage = rewriter.create<LLVM::AllocaOp>(
+            loc, LLVMPointerType::get(structTy), one, /*alignment=*/0);
+      }
+      rewriter.create<LLVM::StoreOp>(loc, packed, storage);
+      contextPtr = rewriter.create<LLVM::BitcastOp>(
+          loc, getInt8PointerType(context), storage);
+    }
 
-    // Create the global string, take its address, and gep to get an `i8*`.
-    auto globalOp = createGlobalString(op->getParentOfType<ModuleOp>(),
-                                       op.msgAttr(), rewriter, op.getLoc());
-    auto msgArray = rewriter.create<LLVM::AddressOfOp>(op.getLoc(), globalOp);
-    auto c0 = rewriter.create<LLVM::ConstantOp>(op.getLoc(),
-                                                IntegerType::get(context, 32),
-                                                rewriter.getI32IntegerAttr(0));
-    auto msg =
-        rewriter.create<LLVM::GEPOp>(op.getLoc(), getInt8PointerType(context),
-                                     msgArray, ValueRange({c0, c0}));
+    auto bodyTy = LLVMFunctionType::get(
+        LLVMVoidType::get(context),
+        {getIndexType(), getIndexType(), getInt8PointerType(context)},
+        /*isVarArg=*/false);
+    Value body = rewriter.create<LLVM::AddressOfOp>(
+        loc, LLVMPointerType::get(bodyTy), op.body());
     rewriter.replaceOpWithNewOp<LLVM::CallOp>(
-        op, backingFunc, ValueRange({adaptor.pred(), msg}));
+        op, backingFunc,
+        ValueRange({adaptor.begin(), adaptor.end(), adaptor.grainSize(), body,
+                    contextPtr}));
     return success();
   }
   LLVM::LLVMFuncOp backingFunc;
 };
 } // namespace
 
+namespace {
+// Lowers refbackrt.unpack_parallel_context to loads of the fields of the
+// struct that LowerParallelForOp packed the captured values into.
+class LowerUnpackParallelContextOp
+    : public ConvertOpToLLVMPattern<refbackrt::UnpackParallelContextOp> {
+public:
+  using ConvertOpToLLVMPattern::ConvertOpToLLVMPattern;
+  LogicalResult
+  matchAndRewrite(refbackrt::UnpackParallelContextOp op,
+                  ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    refbackrt::UnpackParallelContextOp::Adaptor adaptor(operands);
+    auto loc = op.getLoc();
+    SmallVector<Type, 6> fieldTypes;
+    if (failed(typeConverter->convertTypes(op.getResultTypes(), fieldTypes)))
+      return failure();
+    if (fieldTypes.empty()) {
+      rewriter.eraseOp(op);
+      return success();
+    }
+    auto structTy = LLVMStructType::getLiteral(op.getContext(), fieldTypes);
+    Value storage = rewriter.create<LLVM::BitcastOp>(
+        loc, LLVMPointerType::get(structTy), adaptor.context());
+    Value packed = rewriter.create<LLVM::LoadOp>(loc, storage);
+    SmallVector<Value, 6> fields;
+    for (auto fieldType : llvm::enumerate(fieldTypes))
+      fields.push_back(rewriter.create<LLVM::ExtractValueOp>(
+          loc, fieldType.value(), packed,
+          rewriter.getI32ArrayAttr(fieldType.index())));
+    rewriter.replaceOp(op, fields);
+    return success();
+  }
+};
+} // namespace
+
 // Create the LLVM runtime function backing the refbackrt op with name `name`
 // and requiring `type`.
 static LLVMFuncOp createCompilerRuntimeFuncDecl(StringRef name, Type type,
@@ -214,6 +507,157 @@ static void populateCompilerRuntimePatterns(ModuleOp module,
         "abort_if", abortIfFuncTy, builder, module.getLoc());
     patterns.add<AbortIfOpCompilerRuntimeLowering>(abortIfFunc);
   }
+
+  {
+    auto scratchAllocFuncTy =
+        LLVMFunctionType::get(getInt8PointerType(context),
+                              {typeConverter.getIndexType()},
+                              /*isVarArg=*/false);
+    LLVMFuncOp scratchAllocFunc = createCompilerRuntimeFuncDecl(
+        "scratch_alloc", scratchAllocFuncTy, builder, module.getLoc());
+    patterns.add<LowerScratchAllocOp>(typeConverter, scratchAllocFunc);
+  }
+
+  {
+    auto profileBeginFuncTy =
+        LLVMFunctionType::get(IntegerType::get(context, 64), {},
+                              /*isVarArg=*/false);
+    LLVMFuncOp profileBeginFunc = createCompilerRuntimeFuncDecl(
+        "profile_begin", profileBeginFuncTy, builder, module.getLoc());
+    patterns.add<TrivialCompilerRuntimeLowering<refbackrt::ProfileBeginOp>>(
+        profileBeginFunc);
+    auto profileEndFuncTy = LLVMFunctionType::get(
+        LLVMVoidType::get(context),
+        {getInt8PointerType(context), IntegerType::get(context, 64)},
+        /*isVarArg=*/false);
+    LLVMFuncOp profileEndFunc = createCompilerRuntimeFuncDecl(
+        "profile_end", profileEndFuncTy, builder, module.getLoc());
+    patterns.add<ProfileEndOpCompilerRuntimeLowering>(profileEndFunc);
+  }
+
+  {
+    Type indexTy = typeConverter.getIndexType();
+    auto bodyTy = LLVMFunctionType::get(
+        LLVMVoidType::get(context),
+        {indexTy, indexTy, getInt8PointerType(context)},
+        /*isVarArg=*/false);
+    auto parallelForFuncTy = LLVMFunctionType::get(
+        LLVMVoidType::get(context),
+        {indexTy, indexTy, indexTy, LLVMPointerType::get(bodyTy),
+         getInt8PointerType(context)},
+        /*isVarArg=*/false);
+    LLVMFuncOp parallelForFunc = createCompilerRuntimeFuncDecl(
+        "parallel_for", parallelForFuncTy, builder, module.getLoc());
+    patterns.add<LowerParallelForOp>(typeConverter, parallelForFunc);
+    patterns.add<LowerUnpackParallelContextOp>(typeConverter);
+  }
+}
+
+// Returns the name of the site of an allocation or free at `loc` for the
+// runtime's memory profile, such as "model.py:12:8 in layer1.0.forward".
+static std::string getAllocationSiteName(Location loc) {
+  Optional<FileLineColLoc> fileLoc;
+  Optional<StringRef> scopeName;
+  std::function<void(Location)> visit = [&](Location loc) {
+    if (auto fileLineColLoc = loc.dyn_cast<FileLineColLoc>()) {
+      if (!fileLoc)
+        fileLoc = fileLineColLoc;
+    } else if (auto nameLoc = loc.dyn_cast<NameLoc>()) {
+      if (!scopeName)
+        scopeName = nameLoc.getName().strref();
+      visit(nameLoc.getChildLoc());
+    } else if (auto callSiteLoc = loc.dyn_cast<CallSiteLoc>()) {
+      visit(callSiteLoc.getCallee());
+    } else if (auto fusedLoc = loc.dyn_cast<FusedLoc>()) {
+      for (Location child : fusedLoc.getLocations())
+        visit(child);
+    }
+  };
+  visit(loc);
+  if (!fileLoc && !scopeName)
+    return "compiled code";
+  std::string name;
+  llvm::raw_string_ostream os(name);
+  if (fileLoc)
+    os << llvm::sys::path::filename(fileLoc->getFilename().strref()) << ":"
+       << fileLoc->getLine() << ":" << fileLoc->getColumn();
+  if (scopeName)
+    os << (fileLoc ? " in " : "in ") << *scopeName;
+  return os.str();
+}
+
+// Redirect the calls to `malloc` and `free` emitted by the upstream lowerings
+// (e.g. for memref.alloc/memref.dealloc and for copying returned memref
+// descriptors) to the compiler runtime's allocation functions, so that buffers
+// crossing the ABI boundary all come from the refbackrt allocator.
+//
+// With `profileAllocations`, the calls instead go to the variants of the
+// allocation functions taking the name of their site (see
+// getAllocationSiteName), for the runtime's memory profile.
+static void redirectAllocationsToCompilerRuntime(ModuleOp module,
+                                                 bool profileAllocations) {
+  OpBuilder builder(module.getBodyRegion());
+  llvm::StringMap<LLVM::GlobalOp> siteNames;
+  auto redirect = [&](StringRef libcName, StringRef runtimeName) {
+    auto libcFunc = module.lookupSymbol<LLVMFuncOp>(libcName);
+    if (!libcFunc)
+      return;
+    if (!profileAllocations) {
+      LLVMFuncOp runtimeFunc = createCompilerRuntimeFuncDecl(
+          runtimeName, libcFunc.getType(), builder, module.getLoc());
+      auto runtimeFuncAttr = builder.getSymbolRefAttr(runtimeFunc.getName());
+      module.walk([&](LLVM::CallOp op) {
+        auto callee = op.callee();
+        if (callee && *callee == libcName)
+          op->setAttr("callee", runtimeFuncAttr);
+      });
+    } else {
+      auto libcFuncTy = libcFunc.getType();
+      SmallVector<Type, 2> paramTypes(libcFuncTy.getParams().begin(),
+                                      libcFuncTy.getParams().end());
+      paramTypes.push_back(getInt8PointerType(module.getContext()));
+      auto runtimeFuncTy = LLVMFunctionType::get(libcFuncTy.getReturnType(),
+                                                 paramTypes,
+                                                 /*isVarArg=*/false);
+      LLVMFuncOp runtimeFunc = createCompilerRuntimeFuncDecl(
+          (runtimeName + "_at").str(), runtimeFuncTy, builder,
+          module.getLoc());
+      SmallVector<LLVM::CallOp, 16> calls;
+      module.walk([&](LLVM::CallOp op) {
+        auto callee = op.callee();
+        if (callee && *callee == libcName)
+          calls.push_back(op);
+      });
+      for (LLVM::CallOp op : calls) {
+        OpBuilder callBuilder(op);
+        // Each site name is stored once.
+        std::string siteName = getAllocationSiteName(op.getLoc());
+        LLVM::GlobalOp &global = siteNames[siteName];
+        if (!global)
+          global = createGlobalString(
+              module, callBuilder.getStringAttr(siteName), callBuilder,
+              op.getLoc());
+        Value array =
+            callBuilder.create<LLVM::AddressOfOp>(op.getLoc(), global);
+        Value c0 = callBuilder.create<LLVM::ConstantOp>(
+            op.getLoc(), callBuilder.getI32Type(),
+            callBuilder.getI32IntegerAttr(0));
+        Value site = callBuilder.create<LLVM::GEPOp>(
+            op.getLoc(), getInt8PointerType(module.getContext()), array,
+            ValueRange({c0, c0}));
+        SmallVector<Value, 2> operands(op.getOperands());
+        operands.push_back(site);
+        auto call = callBuilder.create<LLVM::CallOp>(op.getLoc(), runtimeFunc,
+                                                     operands);
+        op->replaceAllUsesWith(call);
+        op.erase();
+      }
+    }
+    if (SymbolTable::symbolKnownUseEmpty(libcFunc, module))
+      libcFunc.erase();
+  };
+  redirect("malloc", "alloc");
+  redirect("free", "free");
 }
 
 //===----------------------------------------------------------------------===//
@@ -242,32 +686,32 @@ createFuncDescriptorArray(ArrayRef<refbackrt::FuncMetadataOp> funcMetadatas,
 
     // Create constants for the input / output shapes
     if (funcMetadata.inputShapes().hasValue()) {
-      auto i32ArrayInputSymbolName =
+      auto inputShapesSymbolName =
           (Twine("__npcomp_internal_constant_input_shapes_") +
            funcMetadata.funcName())
               .str();
       auto inputNumElements = funcMetadata.inputShapes()->getNumElements();
-      auto inputI32ArrayTy =
-          LLVMArrayType::get(builder.getIntegerType(32), inputNumElements);
+      auto inputShapesArrayTy =
+          LLVMArrayType::get(builder.getIntegerType(64), inputNumElements);
       auto inputShapesGlobal = builder.create<LLVM::GlobalOp>(
-          loc, inputI32ArrayTy, /*isConstant=*/true, LLVM::Linkage::Internal,
-          i32ArrayInputSymbolName,
+          loc, inputShapesArrayTy, /*isConstant=*/true, LLVM::Linkage::Internal,
+          inputShapesSymbolName,
           /*value=*/funcMetadata.inputShapes().getValue());
 
       inputShapesByName[funcMetadata.funcName()] = inputShapesGlobal;
     }
 
     if (funcMetadata.outputShapes().hasValue()) {
-      auto i32ArrayOutputSymbolName =
+      auto outputShapesSymbolName =
           (Twine("__npcomp_internal_constant_output_shapes_") +
            funcMetadata.funcName())
               .str();
       auto outputNumElements = funcMetadata.outputShapes()->getNumElements();
-      auto outputI32ArrayTy =
-          LLVMArrayType::get(builder.getIntegerType(32), outputNumElements);
+      auto outputShapesArrayTy =
+          LLVMArrayType::get(builder.getIntegerType(64), outputNumElements);
       auto outputShapesGlobal = builder.create<LLVM::GlobalOp>(
-          loc, outputI32ArrayTy, /*isConstant=*/true, LLVM::Linkage::Internal,
-          i32ArrayOutputSymbolName,
+          loc, outputShapesArrayTy, /*isConstant=*/true,
+          LLVM::Linkage::Internal, outputShapesSymbolName,
           /*value=*/funcMetadata.outputShapes().getValue());
 
       outputShapesByName[funcMetadata.funcName()] = outputShapesGlobal;
@@ -280,6 +724,24 @@ createFuncDescriptorArray(ArrayRef<refbackrt::FuncMetadataOp> funcMetadatas,
         loc, descriptor, value,
         /*position=*/builder.getI32ArrayAttr(position));
   };
+  // Returns a pointer to the extents of an argument of rank `rank` in the
+  // `shapes` global, which holds the extents of all the inputs or outputs of a
+  // function one after the other, starting at `offset`, which is advanced
+  // past them. Arguments without extents get a null pointer.
+  auto createExtentsPtr = [&](LLVM::GlobalOp shapes, int64_t rank,
+                              int64_t &offset) -> Value {
+    auto int64PtrTy = getInt64PointerType(builder.getContext());
+    if (!shapes || rank <= 0)
+      return builder.create<LLVM::NullOp>(loc, int64PtrTy);
+    auto extentsArray = builder.create<LLVM::AddressOfOp>(loc, shapes);
+    auto c0 = builder.create<LLVM::ConstantOp>(loc, llvmI32Ty,
+                                               builder.getI32IntegerAttr(0));
+    auto cShapeOffset = builder.create<LLVM::ConstantOp>(
+        loc, llvmI32Ty, builder.getI32IntegerAttr(offset));
+    offset += rank;
+    return builder.create<LLVM::GEPOp>(loc, int64PtrTy, extentsArray,
+                                       ValueRange({c0, cShapeOffset}));
+  };
   auto updateDescriptorWithI32Attr =
       [&](Value &descriptor, Attribute attr,
           std::initializer_list<int32_t> position) {
@@ -301,11 +763,9 @@ createFuncDescriptorArray(ArrayRef<refbackrt::FuncMetadataOp> funcMetadatas,
     OpBuilder::InsertionGuard guard(builder);
     builder.createBlock(&inputDescriptorArrayGlobal.initializer());
 
-    auto c0 = builder.create<LLVM::ConstantOp>(loc, llvmI32Ty,
-                                               builder.getI32IntegerAttr(0));
-
     Value inputDescriptorArray =
         builder.create<LLVM::UndefOp>(loc, inputDescriptorArrayTy);
+    int64_t shapesOffset = 0;
 
     for (int i = 0, e = funcMetadata.numInputs(); i < e; i++) {
       // Arg Type
@@ -327,16 +787,16 @@ createFuncDescriptorArray(ArrayRef<refbackrt::FuncMetadataOp> funcMetadatas,
       updateDescriptorWithI32Attr(inputDescriptorArray, rank, {i, 2});
 
       // Shape
-      // Each shape array is derived by offseting of kMaxRank * arg index
-      auto extentsArray = builder.create<LLVM::AddressOfOp>(
-          loc, inputShapesByName[funcMetadata.funcName()]);
-      auto cShapeOffset = builder.create<LLVM::ConstantOp>(
-          loc, IntegerType::get(builder.getContext(), 32),
-          builder.getI32IntegerAttr(i * kMaxRank));
-      auto extentsArrayPtr = builder.create<LLVM::GEPOp>(
-          loc, getInt32PointerType(builder.getContext()), extentsArray,
-          ValueRange({c0, cShapeOffset}));
-      updateDescriptor(inputDescriptorArray, extentsArrayPtr, {i, 3});
+      Value extentsPtr = createExtentsPtr(
+          inputShapesByName.lookup(funcMetadata.funcName()),
+          rank.cast<IntegerAttr>().getInt(), shapesOffset);
+      updateDescriptor(inputDescriptorArray, extentsPtr, {i, 3});
+
+      // IsReadOnly
+      Attribute isReadOnly = builder.getI32IntegerAttr(0);
+      if (funcMetadata.inputReadOnly().hasValue())
+        isReadOnly = funcMetadata.inputReadOnly()->getValue(i);
+      updateDescriptorWithI32Attr(inputDescriptorArray, isReadOnly, {i, 4});
     }
 
     builder.create<LLVM::ReturnOp>(loc, inputDescriptorArray);
@@ -359,11 +819,9 @@ createFuncDescriptorArray(ArrayRef<refbackrt::FuncMetadataOp> funcMetadatas,
     OpBuilder::InsertionGuard guard(builder);
     builder.createBlock(&outputDescriptorArrayGlobal.initializer());
 
-    auto c0 = builder.create<LLVM::ConstantOp>(loc, llvmI32Ty,
-                                               builder.getI32IntegerAttr(0));
-
     Value outputDescriptorArray =
         builder.create<LLVM::UndefOp>(loc, outputDescriptorArrayTy);
+    int64_t shapesOffset = 0;
 
     for (int i = 0, e = funcMetadata.numOutputs(); i < e; i++) {
       if (!funcMetadata.outputArgTypes().hasValue())
@@ -385,16 +843,20 @@ createFuncDescriptorArray(ArrayRef<refbackrt::FuncMetadataOp> funcMetadatas,
       updateDescriptorWithI32Attr(outputDescriptorArray, rank, {i, 2});
 
       // Shapes
-      // Offset by kMaxRank * arg index
-      auto extentsArray = builder.create<LLVM::AddressOfOp>(
-          loc, outputShapesByName[funcMetadata.funcName()]);
-      auto cShapeOffset = builder.create<LLVM::ConstantOp>(
-          loc, IntegerType::get(builder.getContext(), 32),
-          builder.getI32IntegerAttr(i * kMaxRank));
-      auto extentsArrayPtr = builder.create<LLVM::GEPOp>(
-          loc, getInt32PointerType(builder.getContext()), extentsArray,
-          ValueRange({c0, cShapeOffset}));
-      updateDescriptor(outputDescriptorArray, extentsArrayPtr, {i, 3});
+      Value extentsPtr = createExtentsPtr(
+          outputShapesByName.lookup(funcMetadata.funcName()),
+          rank.cast<IntegerAttr>().getInt(), shapesOffset);
+      updateDescriptor(outputDescriptorArray, extentsPtr, {i, 3});
+
+      // Ownership and AliasIndex
+      Attribute ownership = builder.getI32IntegerAttr(0);
+      Attribute aliasIndex = builder.getI32IntegerAttr(-1);
+      if (funcMetadata.outputOwnership().hasValue()) {
+        ownership = funcMetadata.outputOwnership()->getValue(i);
+        aliasIndex = funcMetadata.outputAliasIndices()->getValue(i);
+      }
+      updateDescriptorWithI32Attr(outputDescriptorArray, ownership, {i, 4});
+      updateDescriptorWithI32Attr(outputDescriptorArray, aliasIndex, {i, 5});
     }
 
     builder.create<LLVM::ReturnOp>(loc, outputDescriptorArray);
@@ -474,6 +936,47 @@ createFuncDescriptorArray(ArrayRef<refbackrt::FuncMetadataOp> funcMetadatas,
         loc, LLVMPointerType::get(getOutputDescriptorTy(builder.getContext())),
         outputDescriptorsArrayAddress);
     updateDescriptor(funcDescriptorArray, rawOutputDescriptorsPtr, {index, 6});
+
+    // Peak scratch bytes.
+    auto peakScratchBytes = builder.create<LLVM::ConstantOp>(
+        loc, IntegerType::get(builder.getContext(), 64),
+        builder.getI64IntegerAttr(
+            funcMetadata.peakScratchBytes().getValueOr(-1)));
+    updateDescriptor(funcDescriptorArray, peakScratchBytes, {index, 7});
+
+    // Direct-call function pointer.
+    //
+    // As with the function pointer above, this refers to the func that
+    // LowerToRefbackrtABI created, and is fixed up after conversion to point at
+    // the function with the direct-call ABI.
+    Value directFuncAddress;
+    if (Optional<StringRef> directFuncName = funcMetadata.directFuncName()) {
+      auto address = builder.create<LLVM::AddressOfOp>(
+          loc, getInt8PointerType(builder.getContext()), *directFuncName);
+      directFuncAddress = builder.create<LLVM::BitcastOp>(
+          loc, getInt8PointerType(builder.getContext()), address);
+    } else {
+      directFuncAddress = builder.create<LLVM::NullOp>(
+          loc, getInt8PointerType(builder.getContext()));
+    }
+    updateDescriptor(funcDescriptorArray, directFuncAddress, {index, 8});
+
+    // Memory footprint, with -1 for unknown sizes.
+    auto i64Ty = IntegerType::get(builder.getContext(), 64);
+    auto updateDescriptorWithBytes = [&](Optional<uint64_t> bytes,
+                                         int32_t position) {
+      auto value = builder.create<LLVM::ConstantOp>(
+          loc, i64Ty, builder.getI64IntegerAttr(bytes.getValueOr(-1)));
+      updateDescriptor(funcDescriptorArray, value, {index, position});
+    };
+    updateDescriptorWithBytes(funcMetadata.constantBytes(), 9);
+    updateDescriptorWithBytes(funcMetadata.inputBytes(), 10);
+    updateDescriptorWithBytes(funcMetadata.outputBytes(), 11);
+
+    // Compiled functions aren't interpreted.
+    auto interpretedFunction = builder.create<LLVM::NullOp>(
+        loc, getInt8PointerType(builder.getContext()));
+    updateDescriptor(funcDescriptorArray, interpretedFunction, {index, 12});
   }
 
   builder.create<LLVM::ReturnOp>(loc, funcDescriptorArray);
@@ -534,6 +1037,12 @@ public:
                   ConversionPatternRewriter &rewriter) const override {
     auto funcMetadatas =
         llvm::to_vector<6>(op.metadatas().getOps<refbackrt::FuncMetadataOp>());
+    // The runtime binary searches the function descriptors by name, so they
+    // must be sorted byte-wise (as with StringRef::compare).
+    llvm::sort(funcMetadatas, [](refbackrt::FuncMetadataOp lhs,
+                                 refbackrt::FuncMetadataOp rhs) {
+      return lhs.funcName() < rhs.funcName();
+    });
     auto funcDescriptorArray =
         createFuncDescriptorArray(funcMetadatas, rewriter, op.getLoc());
     auto moduleDescriptor =
@@ -585,6 +1094,84 @@ static SmallVector<Value, 6> loadCallArgs(Value inputsPtrPtr,
   return callArgs;
 }
 
+// Booleans cross the ABI boundary as one byte each, since the contents of the
+// padding bits of a stored i1 are unspecified in LLVM.
+static bool isABIBool(Type type) {
+  auto intType = type.dyn_cast<IntegerType>();
+  return intType && intType.getWidth() == 1;
+}
+
+// Loads a scalar of type `ty` through the ABI slot `voidStarStar[index]`.
+static Value loadABIScalar(Value voidStarStar, int32_t index, Type ty,
+                           OpBuilder &builder, Location loc) {
+  if (!isABIBool(ty)) {
+    Value addr =
+        getTypedAddressFromVoidStarStar(voidStarStar, index, ty, builder, loc);
+    return builder.create<LLVM::LoadOp>(loc, addr);
+  }
+  Type i8Type = IntegerType::get(builder.getContext(), 8);
+  Value addr = getTypedAddressFromVoidStarStar(voidStarStar, index, i8Type,
+                                               builder, loc);
+  Value byte = builder.create<LLVM::LoadOp>(loc, addr);
+  return builder.create<LLVM::TruncOp>(loc, ty, byte);
+}
+
+// Stores `value` through the ABI slot `voidStarStar[index]`.
+static void storeABIValue(Value value, Value voidStarStar, int32_t index,
+                          OpBuilder &builder, Location loc) {
+  Type ty = value.getType();
+  if (isABIBool(ty)) {
+    ty = IntegerType::get(builder.getContext(), 8);
+    value = builder.create<LLVM::ZExtOp>(loc, ty, value);
+  }
+  Value addr =
+      getTypedAddressFromVoidStarStar(voidStarStar, index, ty, builder, loc);
+  builder.create<LLVM::StoreOp>(loc, value, addr);
+}
+
+// Same as loadCallArgs, for a function whose type before the conversion to
+// LLVM was `type`.
+//
+// The runtime passes two void*'s per input: the addresses of the rank and of
+// the pointer to the descriptor of a memref, or the address of a scalar (in
+// the first of the two). It passes the same descriptors for ranked and
+// unranked memrefs, so for ranked memrefs (see the ranked ABI of
+// LowerToRefbackrtABI) we load the descriptor with the static rank, and
+// explode it into the arguments of the call.
+static SmallVector<Value, 6> loadTypedCallArgs(Value inputsPtrPtr,
+                                               LLVMFunctionType funcTy,
+                                               FunctionType type,
+                                               LLVMTypeConverter &converter,
+                                               OpBuilder &builder,
+                                               Location loc) {
+  SmallVector<Value, 6> callArgs;
+  for (auto indexAndType : llvm::enumerate(type.getInputs())) {
+    int32_t index = 2 * indexAndType.index();
+    auto load = [&](int32_t i, Type ty) -> Value {
+      Value addr =
+          getTypedAddressFromVoidStarStar(inputsPtrPtr, i, ty, builder, loc);
+      return builder.create<LLVM::LoadOp>(loc, addr);
+    };
+    if (auto memrefType = indexAndType.value().dyn_cast<MemRefType>()) {
+      Type descriptorTy = converter.convertType(memrefType);
+      Value descriptorPtr =
+          load(index + 1, LLVMPointerType::get(descriptorTy));
+      Value descriptor = builder.create<LLVM::LoadOp>(loc, descriptorPtr);
+      MemRefDescriptor::unpack(builder, loc, descriptor, memrefType, callArgs);
+    } else if (indexAndType.value().isa<UnrankedMemRefType>()) {
+      // The rank and the pointer to the descriptor.
+      callArgs.push_back(load(index, funcTy.getParamType(callArgs.size())));
+      callArgs.push_back(
+          load(index + 1, funcTy.getParamType(callArgs.size())));
+    } else {
+      callArgs.push_back(loadABIScalar(inputsPtrPtr, index,
+                                       funcTy.getParamType(callArgs.size()),
+                                       builder, loc));
+    }
+  }
+  return callArgs;
+}
+
 static Type getUnrankedMemrefDescriptorType(MLIRContext *context) {
   LLVMTypeConverter converter(context);
   // LLVMTypeConverter doesn't directly expose the struct type used to represent
@@ -599,11 +1186,6 @@ static Type getUnrankedMemrefDescriptorType(MLIRContext *context) {
                               /*memorySpace=*/0));
 }
 
-static Type getFloatType(MLIRContext *context) {
-  LLVMTypeConverter converter(context);
-  return converter.convertType(FloatType::getF32(context));
-}
-
 // Writes out the logical results of the wrapper function through the void**
 // passed on the ABI boundary. Because LLVM (and hence llvm.func)
 // only supports a single return type (or void/no results), the logic here needs
@@ -619,16 +1201,10 @@ static void storeWrapperResults(LLVM::CallOp callToWrapped, Value resultsPtrPtr,
   Value result = callToWrapped.getResult(0);
   auto ty = result.getType();
 
-  // 1 logical result.
-  if (ty == getUnrankedMemrefDescriptorType(ty.getContext())) {
-    Value addr =
-        getTypedAddressFromVoidStarStar(resultsPtrPtr, 0, ty, builder, loc);
-    builder.create<LLVM::StoreOp>(loc, result, addr);
-    return;
-  } else if (ty == getFloatType(ty.getContext())) {
-    Value addr =
-        getTypedAddressFromVoidStarStar(resultsPtrPtr, 0, ty, builder, loc);
-    builder.create<LLVM::StoreOp>(loc, result, addr);
+  // 1 logical result: an unranked memref descriptor or a scalar.
+  if (ty == getUnrankedMemrefDescriptorType(ty.getContext()) ||
+      !ty.isa<LLVMStructType>()) {
+    storeABIValue(result, resultsPtrPtr, 0, builder, loc);
     return;
   }
   assert(ty.isa<LLVMStructType>() && "must be a multi-result packed struct!");
@@ -637,19 +1213,200 @@ static void storeWrapperResults(LLVM::CallOp callToWrapped, Value resultsPtrPtr,
   // wrapping.
   for (int i = 0, e = structType.getBody().size(); i < e; i++) {
     auto elementTy = structType.getBody()[i];
-    Value addr = getTypedAddressFromVoidStarStar(resultsPtrPtr, i, elementTy,
-                                                 builder, loc);
     int32_t i32I = i;
     Value value = builder.create<LLVM::ExtractValueOp>(
         loc, elementTy, result, builder.getI32ArrayAttr({i32I}));
-    builder.create<LLVM::StoreOp>(loc, value, addr);
+    storeABIValue(value, resultsPtrPtr, i, builder, loc);
+  }
+}
+
+// Makes the failed runtime checks (such as shape checks) of the functions
+// called through the ABI wrappers return an error to the runtime, instead of
+// aborting the process, and returns the functions that now take a status
+// argument for this.
+//
+// A function can fail if it has checks or calls a function that can fail, and
+// it takes a new trailing `i8**` status argument unless its signature is fixed
+// (the direct-call entries, and the functions whose address is passed around,
+// such as the bodies of parallel loops). Each call to the compiler runtime's
+// `abort_if` in it becomes a branch, weighted as unlikely, to a block that
+// stores the message of the check through the status and returns undefined
+// results, which the caller doesn't read:
+//   llvm.cond_br %failed weights([1, 2000]), ^failure, ^continue
+// ^failure:
+//   llvm.store %msg, %status : !llvm.ptr<ptr<i8>>
+//   llvm.return %undef
+// Its calls of functions that can fail pass the status on, and return as well
+// when the callee stored a message in it:
+//   %0 = llvm.call @callee(%arg, %status)
+//   %msg = llvm.load %status : !llvm.ptr<ptr<i8>>
+//   %failed = llvm.icmp "ne" %msg, %null : !llvm.ptr<i8>
+//   llvm.cond_br %failed weights([1, 2000]), ^failure, ^continue
+// So the checks that pass cost the same compare-and-branch as before. The
+// buffers allocated before the failed check are freed by the runtime, which
+// tracks the allocations of the call.
+//
+// The checks of the functions with a fixed signature stay fatal: they pass a
+// status of their own to the functions that can fail, and abort with its
+// message when it is set.
+static llvm::SmallPtrSet<Operation *, 8>
+returnCheckFailures(ModuleOp module,
+                    const llvm::StringMap<std::string> &directEntries) {
+  auto *context = module.getContext();
+  StringRef abortIfName = "__npcomp_compiler_rt_abort_if";
+  SymbolTable symbolTable(module);
+  llvm::SmallPtrSet<Operation *, 8> hasFixedSignature;
+  for (auto &directEntry : directEntries)
+    if (auto func = symbolTable.lookup<LLVMFuncOp>(directEntry.getKey()))
+      hasFixedSignature.insert(func);
+  module.walk([&](LLVM::AddressOfOp op) {
+    if (op->getParentOfType<LLVM::GlobalOp>())
+      return;
+    if (auto func = symbolTable.lookup<LLVMFuncOp>(op.global_name()))
+      hasFixedSignature.insert(func);
+  });
+
+  // The checks of each function, and its calls of the other functions of the
+  // module that have a body.
+  struct FuncCalls {
+    LLVMFuncOp func;
+    SmallVector<LLVM::CallOp, 4> checks;
+    SmallVector<std::pair<LLVM::CallOp, LLVMFuncOp>, 4> calls;
+  };
+  SmallVector<FuncCalls, 8> funcCalls;
+  for (LLVMFuncOp func : module.getOps<LLVMFuncOp>()) {
+    if (func.isExternal())
+      continue;
+    funcCalls.push_back({func, {}, {}});
+    func.walk([&](LLVM::CallOp op) {
+      auto callee = op.callee();
+      if (!callee)
+        return;
+      if (*callee == abortIfName) {
+        funcCalls.back().checks.push_back(op);
+        return;
+      }
+      auto calleeFunc = symbolTable.lookup<LLVMFuncOp>(*callee);
+      if (calleeFunc && !calleeFunc.isExternal())
+        funcCalls.back().calls.emplace_back(op, calleeFunc);
+    });
+  }
+
+  llvm::SmallPtrSet<Operation *, 8> canFail;
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (FuncCalls &f : funcCalls) {
+      if (hasFixedSignature.count(f.func) || canFail.count(f.func))
+        continue;
+      if (!f.checks.empty() ||
+          llvm::any_of(f.calls, [&](std::pair<LLVM::CallOp, LLVMFuncOp> call) {
+            return canFail.count(call.second);
+          })) {
+        canFail.insert(f.func);
+        changed = true;
+      }
+    }
+  }
+  if (canFail.empty())
+    return canFail;
+
+  auto statusTy = LLVMPointerType::get(getInt8PointerType(context));
+  auto abortIfFunc = symbolTable.lookup<LLVMFuncOp>(abortIfName);
+  for (FuncCalls &f : funcCalls) {
+    LLVMFuncOp func = f.func;
+    Type resultTy = func.getType().getReturnType();
+    bool failsToCaller = canFail.count(func);
+    Value status;
+    if (failsToCaller) {
+      LLVMFunctionType funcTy = func.getType();
+      SmallVector<Type, 8> paramTypes(funcTy.getParams().begin(),
+                                      funcTy.getParams().end());
+      paramTypes.push_back(statusTy);
+      func->setAttr("type", TypeAttr::get(LLVMFunctionType::get(
+                                funcTy.getReturnType(), paramTypes,
+                                funcTy.isVarArg())));
+      status = func.getBody().front().addArgument(statusTy);
+    }
+
+    // Splits the block of `op` after it, and branches to a new block built by
+    // `buildFailure` if `failed` holds.
+    auto branchOnFailure = [&](Operation *op, Value failed,
+                               function_ref<void(OpBuilder &)> buildFailure) {
+      Location loc = op->getLoc();
+      Block *block = op->getBlock();
+      Block *continueBlock = block->splitBlock(std::next(Block::iterator(op)));
+      auto *failureBlock = new Block();
+      func.getBody().push_back(failureBlock);
+      auto builder = OpBuilder::atBlockBegin(failureBlock);
+      buildFailure(builder);
+      if (resultTy.isa<LLVMVoidType>()) {
+        builder.create<LLVM::ReturnOp>(loc, ValueRange());
+      } else {
+        Value undef = builder.create<LLVM::UndefOp>(loc, resultTy);
+        builder.create<LLVM::ReturnOp>(loc, undef);
+      }
+      builder.setInsertionPointToEnd(block);
+      builder.create<LLVM::CondBrOp>(
+          loc, failed, failureBlock, ValueRange(), continueBlock, ValueRange(),
+          std::make_pair<uint32_t, uint32_t>(1, 2000));
+    };
+
+    for (auto &call : f.calls) {
+      LLVM::CallOp op = call.first;
+      if (!canFail.count(call.second))
+        continue;
+      Location loc = op.getLoc();
+      if (!status) {
+        // Functions with a fixed signature pass a status of their own,
+        // allocated in the entry block so that loops don't grow the stack.
+        // Its message is only ever set right before aborting.
+        auto builder = OpBuilder::atBlockBegin(&func.getBody().front());
+        Value one = builder.create<LLVM::ConstantOp>(
+            loc, IntegerType::get(context, 64), builder.getI64IntegerAttr(1));
+        status = builder.create<LLVM::AllocaOp>(loc, statusTy, one,
+                                                /*alignment=*/0);
+        Value null =
+            builder.create<LLVM::NullOp>(loc, getInt8PointerType(context));
+        builder.create<LLVM::StoreOp>(loc, null, status);
+      }
+      OpBuilder builder(op);
+      SmallVector<Value, 8> operands(op.getOperands());
+      operands.push_back(status);
+      auto newCall = builder.create<LLVM::CallOp>(loc, call.second, operands);
+      op->replaceAllUsesWith(newCall);
+      op.erase();
+      builder.setInsertionPointAfter(newCall);
+      Value message = builder.create<LLVM::LoadOp>(loc, status);
+      Value null =
+          builder.create<LLVM::NullOp>(loc, getInt8PointerType(context));
+      auto failed = builder.create<LLVM::ICmpOp>(
+          loc, LLVM::ICmpPredicate::ne, message, null);
+      if (failsToCaller) {
+        branchOnFailure(failed, failed, [](OpBuilder &) {});
+      } else {
+        builder.create<LLVM::CallOp>(loc, abortIfFunc,
+                                     ValueRange({failed, message}));
+      }
+    }
+
+    if (!failsToCaller)
+      continue;
+    for (LLVM::CallOp check : f.checks) {
+      branchOnFailure(check, check.getOperand(0), [&](OpBuilder &builder) {
+        builder.create<LLVM::StoreOp>(check.getLoc(), check.getOperand(1),
+                                      status);
+      });
+      check.erase();
+    }
   }
+  return canFail;
 }
 
 // Construct a wrapper function.
 // For an externally visible function f(T1, T2) -> T3, T4, we create a
 // wrapper
-// __refbackrt_wrapper_f(void **inputs, void ** outputs) {
+// __refbackrt_wrapper_f(void **inputs, void ** outputs,
+//                       const char **status) {
 //  T3 t3;
 //  T4 t4;
 //  (t3, t4) = f(*cast<T1*>(inputs[0]), *cast<T2*>(inputs[1]));
@@ -659,14 +1416,25 @@ static void storeWrapperResults(LLVM::CallOp callToWrapped, Value resultsPtrPtr,
 // This is very similar to MLIR's "packed" convention, but supporting
 // outputs.
 // TODO: Extend MLIR's void** wrappers to have outputs in this way.
-static LLVMFuncOp createWrapperFunc(LLVMFuncOp func) {
+//
+// If `f` reports failed checks (see returnCheckFailures), `status` is passed
+// through to it, and is otherwise left untouched.
+//
+// `type` is the type of `func` before the conversion to LLVM, if known.
+static LLVMFuncOp createWrapperFunc(LLVMFuncOp func, FunctionType type,
+                                    bool reportsCheckFailures,
+                                    LLVMTypeConverter &converter) {
   auto *context = func.getContext();
   LLVMFunctionType funcTy = func.getType();
+  if (reportsCheckFailures)
+    funcTy = LLVMFunctionType::get(funcTy.getReturnType(),
+                                   funcTy.getParams().drop_back(),
+                                   funcTy.isVarArg());
   auto voidStarTy = getInt8PointerType(context);
   auto voidStarStarTy = LLVMPointerType::get(voidStarTy);
-  auto wrapperTy = LLVMFunctionType::get(LLVMVoidType::get(context),
-                                         {voidStarStarTy, voidStarStarTy},
-                                         /*isVarArg=*/false);
+  auto wrapperTy = LLVMFunctionType::get(
+      LLVMVoidType::get(context),
+      {voidStarStarTy, voidStarStarTy, voidStarStarTy}, /*isVarArg=*/false);
   constexpr char kRefbackrtWrapperPrefix[] = "__refbackrt_wrapper_";
   auto wrapperName = (Twine(kRefbackrtWrapperPrefix) + func.getName()).str();
   OpBuilder moduleBuilder(func->getParentRegion());
@@ -676,16 +1444,245 @@ static LLVMFuncOp createWrapperFunc(LLVMFuncOp func) {
   // Create the function body.
   Block &body = *wrapper.addEntryBlock();
   auto builder = OpBuilder::atBlockBegin(&body);
-  auto callArgs =
-      loadCallArgs(body.getArgument(0), funcTy, builder, func.getLoc());
+  SmallVector<Value, 6> callArgs;
+  if (type) {
+    callArgs = loadTypedCallArgs(body.getArgument(0), funcTy, type, converter,
+                                 builder, func.getLoc());
+  } else {
+    callArgs =
+        loadCallArgs(body.getArgument(0), funcTy, builder, func.getLoc());
+  }
+  if (reportsCheckFailures)
+    callArgs.push_back(body.getArgument(2));
   auto call = builder.create<LLVM::CallOp>(func.getLoc(), func, callArgs);
   storeWrapperResults(call, body.getArgument(1), builder, func.getLoc());
   builder.create<LLVM::ReturnOp>(func.getLoc(), ValueRange());
   return wrapper;
 }
 
+// Marks the funcs created by LowerToRefbackrtABI for the direct-call ABI,
+// holding the name of the public func they implement it for.
+static constexpr StringLiteral kDirectEntryAttrName = "refbackrt.direct_entry";
+
+// Construct the function with the direct-call ABI for `directEntry`, whose
+// type before the conversion to LLVM was `type`.
+// For a direct entry taking memref<2x3xf32>, f32 and (for its output)
+// memref<4xf32>, we create
+// __refbackrt_direct_f(float *input0, float input1, float *output0) {
+//   __refbackrt_direct_entry_f(<descriptor of input0 with shape 2x3>, input1,
+//                              <descriptor of output0 with shape 4>);
+// }
+// Since the shapes are static, the caller only needs to pass a pointer to the
+// contiguous elements of each memref, from which we expand the (exploded)
+// memref descriptors that `directEntry` takes.
+static LLVMFuncOp createDirectCallFunc(LLVMFuncOp directEntry,
+                                       FunctionType type, StringRef funcName,
+                                       LLVMTypeConverter &converter) {
+  auto *context = directEntry.getContext();
+  Location loc = directEntry.getLoc();
+  SmallVector<Type, 6> paramTypes;
+  for (Type paramType : type.getInputs()) {
+    if (auto memrefType = paramType.dyn_cast<MemRefType>()) {
+      paramTypes.push_back(LLVMPointerType::get(
+          converter.convertType(memrefType.getElementType())));
+    } else {
+      paramTypes.push_back(converter.convertType(paramType));
+    }
+  }
+  auto directTy = LLVMFunctionType::get(LLVMVoidType::get(context), paramTypes,
+                                        /*isVarArg=*/false);
+  constexpr char kRefbackrtDirectPrefix[] = "__refbackrt_direct_";
+  auto directName = (Twine(kRefbackrtDirectPrefix) + funcName).str();
+  OpBuilder moduleBuilder(directEntry->getParentRegion());
+  LLVMFuncOp directFunc = moduleBuilder.create<LLVMFuncOp>(
+      loc, directName, directTy, LLVM::Linkage::External);
+
+  // Create the function body.
+  Block &body = *directFunc.addEntryBlock();
+  auto builder = OpBuilder::atBlockBegin(&body);
+  Type indexTy = converter.getIndexType();
+  auto createIndexConstant = [&](int64_t value) -> Value {
+    return builder.create<LLVM::ConstantOp>(
+        loc, indexTy, builder.getIntegerAttr(indexTy, value));
+  };
+  SmallVector<Value, 16> callArgs;
+  for (auto paramTypeAndArg : llvm::zip(type.getInputs(), body.getArguments())) {
+    Value arg = std::get<1>(paramTypeAndArg);
+    auto memrefType = std::get<0>(paramTypeAndArg).dyn_cast<MemRefType>();
+    if (!memrefType) {
+      callArgs.push_back(arg);
+      continue;
+    }
+    // Allocated pointer, aligned pointer, offset, sizes, strides.
+    callArgs.push_back(arg);
+    callArgs.push_back(arg);
+    callArgs.push_back(createIndexConstant(0));
+    ArrayRef<int64_t> shape = memrefType.getShape();
+    for (int64_t size : shape)
+      callArgs.push_back(createIndexConstant(size));
+    SmallVector<int64_t, 6> strides(shape.size());
+    int64_t numElements = 1;
+    for (int i = shape.size() - 1; i >= 0; i--) {
+      strides[i] = numElements;
+      numElements *= shape[i];
+    }
+    for (int64_t stride : strides)
+      callArgs.push_back(createIndexConstant(stride));
+  }
+  builder.create<LLVM::CallOp>(loc, directEntry, callArgs);
+  builder.create<LLVM::ReturnOp>(loc, ValueRange());
+  return directFunc;
+}
+
+//===----------------------------------------------------------------------===//
+// External globals.
+//===----------------------------------------------------------------------===//
+
+// Turns the memref.global ops initialized with external elements attributes
+// into public declarations, which the standard lowering turns into external
+// LLVM globals, and records their storage for getExternalGlobals.
+static LogicalResult declareExternalGlobals(ModuleOp module) {
+  Builder builder(module.getContext());
+  SmallVector<Attribute, 4> externalGlobals;
+  for (auto global : module.getOps<memref::GlobalOp>()) {
+    Optional<Attribute> initialValue = global.initial_value();
+    if (!initialValue)
+      continue;
+    auto elements = refback::getExternalElements(*initialValue);
+    if (!elements)
+      continue;
+    auto type = global.type().cast<MemRefType>();
+    Type elementType = type.getElementType();
+    if (!elementType.isIntOrFloat() || !type.hasStaticShape())
+      return global.emitError()
+             << "unsupported type of external global: " << type;
+    uint64_t size = type.getNumElements() *
+                    llvm::divideCeil(elementType.getIntOrFloatBitWidth(), 8);
+    externalGlobals.push_back(builder.getDictionaryAttr({
+        builder.getNamedAttr("symbol",
+                             builder.getStringAttr(global.sym_name())),
+        builder.getNamedAttr("path", builder.getStringAttr(elements->path)),
+        builder.getNamedAttr("offset",
+                             builder.getI64IntegerAttr(elements->offset)),
+        builder.getNamedAttr("size", builder.getI64IntegerAttr(size)),
+    }));
+    global->removeAttr("initial_value");
+    SymbolTable::setSymbolVisibility(global, SymbolTable::Visibility::Public);
+  }
+  if (!externalGlobals.empty())
+    module->setAttr(kExternalGlobalsAttrName,
+                    builder.getArrayAttr(externalGlobals));
+  return success();
+}
+
+SmallVector<ExternalGlobal, 4>
+mlir::NPCOMP::getExternalGlobals(ModuleOp module) {
+  SmallVector<ExternalGlobal, 4> externalGlobals;
+  auto attr = module->getAttrOfType<ArrayAttr>(kExternalGlobalsAttrName);
+  if (!attr)
+    return externalGlobals;
+  for (auto dict : attr.getAsRange<DictionaryAttr>()) {
+    ExternalGlobal global;
+    global.symbol = dict.getAs<StringAttr>("symbol").getValue().str();
+    global.path = dict.getAs<StringAttr>("path").getValue().str();
+    global.offset = dict.getAs<IntegerAttr>("offset").getInt();
+    global.size = dict.getAs<IntegerAttr>("size").getInt();
+    externalGlobals.push_back(std::move(global));
+  }
+  return externalGlobals;
+}
+
+int64_t mlir::NPCOMP::replaceExternalGlobalsPath(ModuleOp module,
+                                                 StringRef path,
+                                                 StringRef newPath) {
+  auto attr = module->getAttrOfType<ArrayAttr>(kExternalGlobalsAttrName);
+  if (!attr)
+    return 0;
+  Builder builder(module.getContext());
+  SmallVector<Attribute, 4> externalGlobals;
+  int64_t numReplaced = 0;
+  for (auto dict : attr.getAsRange<DictionaryAttr>()) {
+    if (dict.getAs<StringAttr>("path").getValue() != path) {
+      externalGlobals.push_back(dict);
+      continue;
+    }
+    NamedAttrList attrs(dict);
+    attrs.set("path", builder.getStringAttr(newPath));
+    externalGlobals.push_back(attrs.getDictionary(module.getContext()));
+    numReplaced++;
+  }
+  module->setAttr(kExternalGlobalsAttrName,
+                  builder.getArrayAttr(externalGlobals));
+  return numReplaced;
+}
+
+// Lowers the refbackrt.prefetch_global ops, which stay legal during the
+// conversion, once the external globals they refer to are LLVM globals. Each
+// global gets a flag, so that only the first execution of any of its prefetches
+// calls into the runtime.
+static void lowerPrefetchGlobalOps(ModuleOp module) {
+  SmallVector<refbackrt::PrefetchGlobalOp, 4> ops;
+  module.walk([&](refbackrt::PrefetchGlobalOp op) { ops.push_back(op); });
+  if (ops.empty())
+    return;
+
+  auto *context = module.getContext();
+  auto llvmI8Ty = IntegerType::get(context, 8);
+  auto llvmI64Ty = IntegerType::get(context, 64);
+  OpBuilder builder(module.getBodyRegion());
+  auto prefetchFuncTy = LLVMFunctionType::get(
+      LLVMVoidType::get(context),
+      {getInt8PointerType(context), getInt8PointerType(context), llvmI64Ty},
+      /*isVarArg=*/false);
+  LLVMFuncOp prefetchFunc = createCompilerRuntimeFuncDecl(
+      "prefetch", prefetchFuncTy, builder, module.getLoc());
+
+  llvm::StringMap<uint64_t> sizes;
+  for (const ExternalGlobal &global : getExternalGlobals(module))
+    sizes[global.symbol] = global.size;
+  llvm::StringMap<LLVM::GlobalOp> flags;
+  for (refbackrt::PrefetchGlobalOp op : ops) {
+    StringRef name = op.global();
+    auto global = module.lookupSymbol<LLVM::GlobalOp>(name);
+    auto size = sizes.find(name);
+    if (!global || size == sizes.end()) {
+      op.erase();
+      continue;
+    }
+    LLVM::GlobalOp &flag = flags[name];
+    if (!flag) {
+      builder.setInsertionPointToStart(module.getBody());
+      flag = builder.create<LLVM::GlobalOp>(
+          op.getLoc(), llvmI8Ty, /*isConstant=*/false, LLVM::Linkage::Internal,
+          (Twine("__npcomp_prefetched_") + name).str(),
+          builder.getI8IntegerAttr(0));
+    }
+    builder.setInsertionPoint(op);
+    Location loc = op.getLoc();
+    Value flagPtr = builder.create<LLVM::AddressOfOp>(loc, flag);
+    Value globalPtr = builder.create<LLVM::BitcastOp>(
+        loc, getInt8PointerType(context),
+        builder.create<LLVM::AddressOfOp>(loc, global));
+    Value sizeValue = builder.create<LLVM::ConstantOp>(
+        loc, llvmI64Ty, builder.getI64IntegerAttr(size->second));
+    builder.create<LLVM::CallOp>(loc, prefetchFunc,
+                                 ValueRange{flagPtr, globalPtr, sizeValue});
+    op.erase();
+  }
+}
+
 namespace {
 class LowerToLLVM : public LowerToLLVMBase<LowerToLLVM> {
+public:
+  LowerToLLVM() = default;
+  LowerToLLVM(bool reassoc, bool contract, bool noNaNs, bool profileAllocs) {
+    fastMathReassoc = reassoc;
+    fastMathContract = contract;
+    fastMathNoNaNs = noNaNs;
+    profileAllocations = profileAllocs;
+  }
+
+private:
   void getDependentDialects(DialectRegistry &registry) const override {
     registry.insert<LLVM::LLVMDialect>();
   }
@@ -694,40 +1691,105 @@ class LowerToLLVM : public LowerToLLVMBase<LowerToLLVM> {
     auto module = getOperation();
     auto *context = &getContext();
 
+    if (failed(declareExternalGlobals(module)))
+      return signalPassFailure();
+
     LLVMTypeConverter converter(context);
 
+    // The conversion expands the memref arguments of the functions into
+    // their descriptors, so record their original types first.
+    llvm::StringMap<FunctionType> funcTypes;
+    llvm::StringMap<std::string> directEntries;
+    for (FuncOp func : module.getOps<FuncOp>()) {
+      funcTypes[func.getName()] = func.getType();
+      if (auto funcName = func->getAttrOfType<StringAttr>(kDirectEntryAttrName))
+        directEntries[func.getName()] = funcName.getValue().str();
+    }
+
     RewritePatternSet patterns(context);
     LLVMConversionTarget target(*context);
     populateCompilerRuntimePatterns(module, patterns, converter);
     target.addLegalOp<ModuleOp>();
+    target.addLegalOp<refbackrt::PrefetchGlobalOp>();
     populateStdToLLVMConversionPatterns(converter, patterns);
+    populateVectorToLLVMConversionPatterns(
+        converter, patterns, /*reassociateFPReductions=*/fastMathReassoc);
+    populateVectorToLLVMMatrixConversionPatterns(converter, patterns);
     patterns.add<LowerModuleMetadata>(context);
+    patterns.add<LowerSignCastOp>(converter);
 
     // TODO: Move these "std to std" legalizations to their own pass if we grow
     // lots of these patterns.
     populateExpandTanhPattern(patterns);
+    patterns.add<ExpandBF16ExtOp, ExpandBF16TruncOp>(context);
 
     if (failed(applyFullConversion(module, target, std::move(patterns)))) {
       return signalPassFailure();
     }
+    redirectAllocationsToCompilerRuntime(module, profileAllocations);
+    lowerPrefetchGlobalOps(module);
+    setFastMathFlags(module);
     // Rewrite llvm.mlir.addressof ops that reference the original exported
     // functions from the module to instead refer to wrapper functions.
     // These wrapper functions have a fixed ABI
-    // (`void f(void **inputs, void **results)`) which we can interface to from
-    // external code without dealing with platform-dependent
-    // register-level calling conventions. We embed enough information in the
+    // (`void f(void **inputs, void **results, const char **status)`) which we
+    // can interface to from external code without dealing with
+    // platform-dependent register-level calling conventions. We embed enough information in the
     // module metadata to make sure that calling code can e.g. preallocate
     // enough outputs and with the right types to safely funnel through this
     // convention.
+    // Only the function descriptors in the module metadata refer to exported
+    // functions; other addresses of functions (such as the bodies passed to
+    // the runtime's parallel_for) are called with their own signature.
+    // The direct entries instead get a function with the direct-call ABI, which
+    // external code calls with the signature described by the metadata.
+    // The failed checks of the functions called through the wrappers are
+    // reported to the runtime, which fails the invocation; the direct-call
+    // ABI has no status, so their checks stay fatal.
+    llvm::SmallPtrSet<Operation *, 8> canFail =
+        returnCheckFailures(module, directEntries);
+    SmallVector<LLVM::AddressOfOp, 8> addressOfOps;
     module.walk([&](LLVM::AddressOfOp op) {
+      if (op->getParentOfType<LLVM::GlobalOp>())
+        addressOfOps.push_back(op);
+    });
+    for (LLVM::AddressOfOp op : addressOfOps) {
       auto originalFunc =
           module.lookupSymbol<LLVM::LLVMFuncOp>(op.global_name());
       if (!originalFunc)
-        return;
-      auto wrapper = createWrapperFunc(originalFunc);
+        continue;
+      LLVMFuncOp wrapper;
+      FunctionType type = funcTypes.lookup(originalFunc.getName());
+      auto directEntry = directEntries.find(originalFunc.getName());
+      if (directEntry != directEntries.end()) {
+        wrapper = createDirectCallFunc(originalFunc, type, directEntry->second,
+                                       converter);
+      } else {
+        bool reportsCheckFailures = canFail.count(originalFunc);
+        wrapper = createWrapperFunc(originalFunc, type, reportsCheckFailures,
+                                    converter);
+      }
       op.getResult().setType(LLVMPointerType::get(wrapper.getType()));
       Builder builder(op.getContext());
       op->setAttr("global_name", builder.getSymbolRefAttr(wrapper.getName()));
+    }
+  }
+
+  // Sets the fast-math flags selected by the options on the floating-point
+  // ops of `module`.
+  void setFastMathFlags(ModuleOp module) {
+    LLVM::FastmathFlags flags = {};
+    if (fastMathReassoc)
+      flags = flags | LLVM::FastmathFlags::reassoc;
+    if (fastMathContract)
+      flags = flags | LLVM::FastmathFlags::contract;
+    if (fastMathNoNaNs)
+      flags = flags | LLVM::FastmathFlags::nnan;
+    if (flags == LLVM::FastmathFlags{})
+      return;
+    auto attr = LLVM::FMFAttr::get(module.getContext(), flags);
+    module.walk([&](LLVM::FastmathFlagsInterface op) {
+      op->setAttr(op.getFastmathAttrName(), attr);
     });
   }
 };
@@ -736,3 +1798,11 @@ class LowerToLLVM : public LowerToLLVMBase<LowerToLLVM> {
 std::unique_ptr<OperationPass<ModuleOp>> mlir::NPCOMP::createLowerToLLVMPass() {
   return std::make_unique<LowerToLLVM>();
 }
+
+std::unique_ptr<OperationPass<ModuleOp>>
+mlir::NPCOMP::createLowerToLLVMPass(bool fastMathReassoc,
+                                    bool fastMathContract, bool fastMathNoNaNs,
+                                    bool profileAllocations) {
+  return std::make_unique<LowerToLLVM>(fastMathReassoc, fastMathContract,
+                                       fastMathNoNaNs, profileAllocations);
+}
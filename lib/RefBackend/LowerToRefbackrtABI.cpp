@@ -11,27 +11,25 @@
 
 #include "mlir/Dialect/MemRef/IR/MemRef.h"
 #include "mlir/Dialect/StandardOps/IR/Ops.h"
+#include "mlir/IR/BlockAndValueMapping.h"
 #include "mlir/IR/BuiltinTypes.h"
 #include "mlir/IR/Verifier.h"
+#include "mlir/Interfaces/ControlFlowInterfaces.h"
+#include "mlir/Interfaces/LoopLikeInterface.h"
+#include "mlir/Interfaces/SideEffectInterfaces.h"
+#include "mlir/Interfaces/ViewLikeInterface.h"
 #include "mlir/Transforms/DialectConversion.h"
 
 #include "npcomp/Dialect/Refback/IR/RefbackOps.h"
 #include "npcomp/Dialect/Refbackrt/IR/RefbackrtDialect.h"
 #include "npcomp/Dialect/Refbackrt/IR/RefbackrtOps.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Support/MathExtras.h"
 
 using namespace mlir;
 using namespace mlir::NPCOMP;
 
-// Since input/output shapes are not hyper-rectangular we specify
-// a maximum rank for each input shape such that shapes are padded
-// out to kMaxRank at the ABI boundary. That way we can represent
-// shapes using a traditional DenseElementsAttr.
-// 
-// NOTE: When changing this parameter, also change the same `kMaxRank`
-// parameter in `lib/RefBackend/LowerToLLVM.cpp` so that the LLVM lowering
-// stays consistent.
-static constexpr int kMaxRank = 6;
-
 // Get the type used to represent MemRefType `type` on ABI boundaries.
 // For convenience we do a cast to MemRefType internally.
 static Type getABIMemrefType(Type type) {
@@ -46,10 +44,14 @@ static Type getABIMemrefType(Type type) {
 // Returns true if the function signature can be expressed with the refbackrt
 // ABI.
 static bool expressibleWithRefbackrtABI(FunctionType type) {
-  // Currently, only memref types can be exposed at refbackrt ABI boundaries.
+  // Memrefs, floats, and i1/i32/i64 scalars can cross refbackrt ABI boundaries.
   return llvm::all_of(
       llvm::concat<const Type>(type.getInputs(), type.getResults()),
       [](Type t) {
+        if (auto intTy = t.dyn_cast<IntegerType>())
+          return intTy.isSignless() &&
+                 llvm::is_contained(ArrayRef<unsigned>{1, 32, 64},
+                                    intTy.getWidth());
         return t.isa<UnrankedMemRefType, MemRefType, FloatType>();
       });
 }
@@ -69,6 +71,16 @@ static uint32_t getIntReprForABIType(Type type) {
       assert(false && "Unsupported float bit width");
     }
   } else if (auto intTy = type.dyn_cast<IntegerType>()) {
+    switch (intTy.getWidth()) {
+    case 32:
+      return 4;
+    case 64:
+      return 5;
+    case 1:
+      return 6;
+    default:
+      assert(false && "Unsupported integer bit width");
+    }
   }
   // assert(false && "couldn't get IntReprForABIType");
   return -1;
@@ -78,54 +90,40 @@ static uint32_t getIntReprForABIType(Type type) {
 static uint32_t getIntReprForABIElementType(Type type) {
   if (auto shapedTy = type.dyn_cast<ShapedType>()) {
     auto elemTy = shapedTy.getElementType();
-    if (auto floatTy = elemTy.dyn_cast<FloatType>()) {
-      switch (floatTy.getWidth()) {
+    if (elemTy.isF32())
+      return 1;
+    if (elemTy.isF16())
+      return 2;
+    if (elemTy.isBF16())
+      return 3;
+    if (auto intTy = elemTy.dyn_cast<IntegerType>()) {
+      switch (intTy.getWidth()) {
+      case 8:
+        return 4;
       case 32:
-        return 1;
+        return 5;
+      case 64:
+        return 6;
+      case 1:
+        return 7;
       default:
-        assert(false && "Unsupported tensor element type");
+        break;
       }
     }
+    assert(false && "Unsupported tensor element type");
   }
   return 0;
 }
 
-static SmallVector<int32_t, kMaxRank>
-getExtentsForType(Type type, const int32_t maxRank = kMaxRank) {
-  // Extend all shapes out to 4D to make our lives easier at the ABI boundary
-  if (auto shapedType = type.dyn_cast<ShapedType>()) {
-    if (!shapedType.hasRank()) {
-      return {kMaxRank, kMaxRank, kMaxRank, kMaxRank, kMaxRank, kMaxRank};
-    }
-
-    auto shape = shapedType.getShape();
-    auto shapeRank = shapedType.getRank();
-    if (shapeRank <= maxRank) {
-      SmallVector<int32_t, kMaxRank> extendedShape;
-      // Push back all the values of the shape
-      for (auto extentAndIndex : llvm::enumerate(shape)) {
-        auto extent = extentAndIndex.value();
-        auto index = extentAndIndex.index();
-        if (shapedType.isDynamic(index)) {
-          extendedShape.push_back(-1);
-        } else {
-          extendedShape.push_back(extent);
-        }
-      }
-
-      // Pad whatever is left so we have even vectors
-      auto padRank = maxRank - shapeRank;
-      for (int i = 0; i < padRank; i++)
-        extendedShape.push_back(0xDEAD'BEEF);
-
-      return extendedShape;
-    } else {
-      assert(false && "unsupported rank");
-    }
-  }
-
-  // Represent Scalar's as all 1's.
-  return {kMaxRank, kMaxRank, kMaxRank, kMaxRank, kMaxRank, kMaxRank};
+// Appends the extents of `type` to `extents`, with -1 for dynamic extents.
+// Unranked tensors and scalars have no extents.
+static void appendExtentsForType(Type type, SmallVectorImpl<int64_t> &extents) {
+  auto shapedType = type.dyn_cast<ShapedType>();
+  if (!shapedType || !shapedType.hasRank())
+    return;
+  for (int64_t i = 0, e = shapedType.getRank(); i < e; i++)
+    extents.push_back(shapedType.isDynamicDim(i) ? -1
+                                                 : shapedType.getDimSize(i));
 }
 
 int32_t getRankForType(Type type) {
@@ -144,6 +142,274 @@ uint32_t hasStaticShape(Type type) {
   return 1;
 }
 
+// Returns the number of bytes of a value of `type` (the buffer of memrefs),
+// or None if its size is not static.
+static Optional<int64_t> getStaticByteSize(Type type) {
+  int64_t numElements = 1;
+  if (auto memrefType = type.dyn_cast<MemRefType>()) {
+    if (!memrefType.hasStaticShape())
+      return None;
+    numElements = memrefType.getNumElements();
+    type = memrefType.getElementType();
+  }
+  if (!type.isIntOrFloat())
+    return None;
+  // Elements narrower than a byte (i1) are stored as a byte.
+  return numElements * llvm::divideCeil(type.getIntOrFloatBitWidth(), 8);
+}
+
+// Returns the total number of bytes of values of `types`, or None if some
+// size is not static.
+static Optional<int64_t> getStaticByteSize(TypeRange types) {
+  int64_t total = 0;
+  for (Type type : types) {
+    Optional<int64_t> size = getStaticByteSize(type);
+    if (!size)
+      return None;
+    total += *size;
+  }
+  return total;
+}
+
+// Returns the number of bytes of the globals that `func` uses.
+static int64_t getConstantBytes(FuncOp func, SymbolTable &symbolTable) {
+  llvm::SmallDenseSet<Operation *, 8> globals;
+  int64_t total = 0;
+  func.walk([&](memref::GetGlobalOp op) {
+    auto global = symbolTable.lookup<memref::GlobalOp>(op.name());
+    if (!global || !globals.insert(global).second)
+      return;
+    total += getStaticByteSize(global.type()).getValueOr(0);
+  });
+  return total;
+}
+
+// Returns true if `isAllowedUse` holds for every use of the buffer `buffer`
+// or of any view / cast of it.
+//
+// Uses by terminators are always rejected: they either let the buffer escape
+// the function (`return`) or alias it to a block argument that we don't track.
+static bool
+allUsesOfBufferSatisfy(Value buffer,
+                       function_ref<bool(Operation *, Value)> isAllowedUse) {
+  SmallVector<Value, 6> worklist;
+  worklist.push_back(buffer);
+  while (!worklist.empty()) {
+    Value value = worklist.pop_back_val();
+    for (Operation *user : value.getUsers()) {
+      // Views and casts alias the buffer, so we need to check their uses as
+      // well.
+      if (isa<memref::CastOp>(user)) {
+        worklist.push_back(user->getResult(0));
+        continue;
+      }
+      if (auto viewLike = dyn_cast<ViewLikeOpInterface>(user)) {
+        if (viewLike.getViewSource() != value)
+          return false;
+        worklist.push_back(user->getResult(0));
+        continue;
+      }
+      if (user->hasTrait<OpTrait::IsTerminator>() || !isAllowedUse(user, value))
+        return false;
+    }
+  }
+  return true;
+}
+
+// Returns true if `user` declares its memory effects on `value`, and they are
+// all of the given kinds. This conservatively rejects calls and any op we
+// don't know about.
+template <typename... AllowedEffects>
+static bool hasOnlyEffectsOnValue(Operation *user, Value value) {
+  auto effectInterface = dyn_cast<MemoryEffectOpInterface>(user);
+  if (!effectInterface)
+    return false;
+  SmallVector<MemoryEffects::EffectInstance, 4> effects;
+  effectInterface.getEffectsOnValue(value, effects);
+  return llvm::all_of(effects, [](MemoryEffects::EffectInstance &effect) {
+    return isa<AllowedEffects...>(effect.getEffect());
+  });
+}
+
+// Returns true if the buffer backing `arg` is provably never written, freed,
+// or allowed to escape the function (e.g. by being returned, possibly through
+// a view).
+//
+// The runtime is allowed to pass such arguments zero-copy, directly pointing
+// at the user's buffer, since the compiled code cannot observably mutate it or
+// hand it back to the runtime as an output that needs freeing.
+static bool isReadOnlyArgument(BlockArgument arg) {
+  return allUsesOfBufferSatisfy(arg,
+                                hasOnlyEffectsOnValue<MemoryEffects::Read>);
+}
+
+// Returns the buffer that `value` is a view or cast of.
+static Value getUnderlyingBuffer(Value value) {
+  while (Operation *op = value.getDefiningOp()) {
+    if (auto cast = dyn_cast<memref::CastOp>(op))
+      value = cast.source();
+    else if (auto viewLike = dyn_cast<ViewLikeOpInterface>(op))
+      value = viewLike.getViewSource();
+    else
+      break;
+  }
+  return value;
+}
+
+// Computes where the buffer of each output of `func` comes from, as the
+// integer representation of the CompilerDataStructures::ABIOutputOwnership
+// enum, along with the index of the input or output it aliases (or -1).
+//
+// Outputs that aren't memrefs, or whose buffer we can't trace to a single
+// source, get kUnknown. Must stay aligned with the enum.
+static void getOutputOwnership(FuncOp func, SmallVectorImpl<uint32_t> &kinds,
+                               SmallVectorImpl<int32_t> &aliasIndices) {
+  constexpr uint32_t kUnknown = 0, kOwned = 1, kAliasesInput = 2,
+                     kAliasesOutput = 3, kStaticGlobal = 4,
+                     kConstantGlobal = 5;
+  unsigned numResults = func.getNumResults();
+  kinds.assign(numResults, kUnknown);
+  aliasIndices.assign(numResults, -1);
+  Block &entry = func.getBody().front();
+  bool isFirstReturn = true;
+  func.walk([&](ReturnOp op) {
+    SmallVector<uint32_t, 6> returnKinds(numResults, kUnknown);
+    SmallVector<int32_t, 6> returnAliasIndices(numResults, -1);
+    SmallVector<Value, 6> buffers;
+    for (auto operandAndIndex : llvm::enumerate(op.getOperands())) {
+      unsigned i = operandAndIndex.index();
+      Value operand = operandAndIndex.value();
+      if (!operand.getType().isa<MemRefType, UnrankedMemRefType>()) {
+        buffers.push_back(nullptr);
+        continue;
+      }
+      Value buffer = getUnderlyingBuffer(operand);
+      int32_t earlier = llvm::find(buffers, buffer) - buffers.begin();
+      buffers.push_back(buffer);
+      auto arg = buffer.dyn_cast<BlockArgument>();
+      // Globals are never freed, so outputs can share them.
+      if (auto getGlobal = buffer.getDefiningOp<memref::GetGlobalOp>()) {
+        auto global = SymbolTable::lookupNearestSymbolFrom<memref::GlobalOp>(
+            getGlobal, getGlobal.name());
+        returnKinds[i] =
+            global && global.constant() ? kConstantGlobal : kStaticGlobal;
+      } else if (earlier != static_cast<int32_t>(i)) {
+        returnKinds[i] = kAliasesOutput;
+        returnAliasIndices[i] = earlier;
+      } else if (arg && arg.getOwner() == &entry) {
+        returnKinds[i] = kAliasesInput;
+        returnAliasIndices[i] = arg.getArgNumber();
+      } else if (buffer.getDefiningOp<memref::AllocOp>()) {
+        returnKinds[i] = kOwned;
+      }
+    }
+    // Outputs that come from different places depending on the return are
+    // unknown.
+    for (unsigned i = 0; i < numResults; i++) {
+      if (isFirstReturn) {
+        kinds[i] = returnKinds[i];
+        aliasIndices[i] = returnAliasIndices[i];
+      } else if (kinds[i] != returnKinds[i] ||
+                 aliasIndices[i] != returnAliasIndices[i]) {
+        kinds[i] = kUnknown;
+        aliasIndices[i] = -1;
+      }
+    }
+    isFirstReturn = false;
+  });
+}
+
+// Marks the funcs created by `createDirectEntry`, holding the name of the
+// public func they implement the direct-call ABI of.
+static constexpr StringLiteral kDirectEntryAttrName = "refbackrt.direct_entry";
+
+// Returns true if `type` can cross the direct-call ABI boundary: memrefs are
+// passed as bare pointers to their elements, so they must have a static shape
+// and the identity layout.
+static bool isDirectABIType(Type type) {
+  if (auto memrefType = type.dyn_cast<MemRefType>())
+    return memrefType.hasStaticShape() && memrefType.getAffineMaps().empty();
+  return type.isa<FloatType>();
+}
+
+// Creates the variant of the public func `func` with the direct-call ABI, if
+// its signature allows it, and returns null otherwise.
+//
+// The variant takes the inputs of `func` followed by one caller-provided
+// buffer per output (a rank-0 memref for scalar outputs), into which it
+// computes the outputs. LowerToLLVM exposes it to the runtime with bare
+// pointers in place of the memref descriptors, so callers with statically
+// shaped data can skip the generic packed wrapper, the unranked memref
+// descriptors and the copies of the results.
+//
+// This is only possible when the caller's buffers can be used as is: the
+// memref inputs must be read-only, and each memref output must be a distinct
+// buffer that `func` allocates once (in its entry block), which we replace
+// with the caller's buffer.
+static FuncOp createDirectEntry(FuncOp func) {
+  FunctionType type = func.getType();
+  if (!llvm::all_of(
+          llvm::concat<const Type>(type.getInputs(), type.getResults()),
+          isDirectABIType))
+    return nullptr;
+  Block &entry = func.getBody().front();
+  for (BlockArgument arg : entry.getArguments())
+    if (arg.getType().isa<MemRefType>() && !isReadOnlyArgument(arg))
+      return nullptr;
+  SmallVector<ReturnOp, 1> returnOps;
+  func.walk([&](ReturnOp op) { returnOps.push_back(op); });
+  if (returnOps.size() != 1)
+    return nullptr;
+  SmallVector<memref::AllocOp, 6> resultAllocs;
+  for (Value result : returnOps[0].getOperands()) {
+    if (!result.getType().isa<MemRefType>()) {
+      resultAllocs.push_back(nullptr);
+      continue;
+    }
+    auto alloc = result.getDefiningOp<memref::AllocOp>();
+    if (!alloc || alloc->getBlock() != &entry ||
+        llvm::is_contained(resultAllocs, alloc))
+      return nullptr;
+    resultAllocs.push_back(alloc);
+  }
+
+  BlockAndValueMapping mapping;
+  FuncOp directEntry = func.clone(mapping);
+  directEntry.setName(
+      (Twine("__refbackrt_direct_entry_") + func.getName()).str());
+  directEntry.setPrivate();
+  directEntry->setAttr(kDirectEntryAttrName,
+                       StringAttr::get(func.getContext(), func.getName()));
+  OpBuilder moduleBuilder(func);
+  moduleBuilder.setInsertionPointAfter(func);
+  moduleBuilder.insert(directEntry);
+
+  Block &newEntry = directEntry.getBody().front();
+  auto returnOp = cast<ReturnOp>(
+      mapping.lookup(returnOps[0]->getBlock())->getTerminator());
+  OpBuilder builder(returnOp);
+  for (auto resultAndAlloc :
+       llvm::zip(returnOp.getOperands(), resultAllocs)) {
+    Value result = std::get<0>(resultAndAlloc);
+    memref::AllocOp alloc = std::get<1>(resultAndAlloc);
+    if (!alloc) {
+      BlockArgument output =
+          newEntry.addArgument(MemRefType::get({}, result.getType()));
+      builder.create<memref::StoreOp>(returnOp.getLoc(), result, output);
+      continue;
+    }
+    BlockArgument output = newEntry.addArgument(result.getType());
+    Value clonedBuffer = mapping.lookup(alloc.getResult());
+    clonedBuffer.replaceAllUsesWith(output);
+    clonedBuffer.getDefiningOp()->erase();
+  }
+  builder.create<ReturnOp>(returnOp.getLoc());
+  returnOp.erase();
+  directEntry.setType(FunctionType::get(
+      func.getContext(), newEntry.getArgumentTypes(), TypeRange()));
+  return directEntry;
+}
+
 static LogicalResult createModuleMetadata(ModuleOp module) {
   auto moduleMetadata =
       OpBuilder::atBlockBegin(module.getBody())
@@ -155,7 +421,8 @@ static LogicalResult createModuleMetadata(ModuleOp module) {
 
   SymbolTable symbolTable(module);
   auto builder = OpBuilder::atBlockBegin(&metadatas);
-  for (auto func : module.getOps<FuncOp>()) {
+  // We add the direct entries to the module as we go.
+  for (auto func : llvm::to_vector<6>(module.getOps<FuncOp>())) {
     if (symbolTable.getSymbolVisibility(func) !=
         SymbolTable::Visibility::Public) {
       continue;
@@ -164,69 +431,67 @@ static LogicalResult createModuleMetadata(ModuleOp module) {
     // types.
     SmallVector<uint32_t, 6> inputABIArgTypes;
     SmallVector<uint32_t, 6> inputABIElementTypes;
-    SmallVector<SmallVector<int32_t, kMaxRank>, 6> inputABIShapes;
+    // The extents of all the inputs, one after the other.
+    SmallVector<int64_t, 24> inputABIShapes;
     SmallVector<uint32_t, 6> inputABIRanks;
+    SmallVector<uint32_t, 6> inputABIReadOnly;
     // SmallVector<uint32_t, 6> inputIsStatic;
-    for (const auto &inputArgType : func.getBody().front().getArgumentTypes()) {
+    for (BlockArgument inputArg : func.getBody().front().getArguments()) {
+      Type inputArgType = inputArg.getType();
       inputABIArgTypes.push_back(getIntReprForABIType(inputArgType));
       inputABIElementTypes.push_back(getIntReprForABIElementType(inputArgType));
-      inputABIShapes.push_back(
-          getExtentsForType(inputArgType, /*maxRank=*/kMaxRank));
+      appendExtentsForType(inputArgType, inputABIShapes);
       inputABIRanks.push_back(getRankForType(inputArgType));
+      inputABIReadOnly.push_back(
+          inputArgType.isa<MemRefType>() && isReadOnlyArgument(inputArg) ? 1
+                                                                         : 0);
       // inputIsStatic.push_back(hasStaticShape(inputArgType));
     }
 
     SmallVector<uint32_t, 6> outputABIArgTypes;
     SmallVector<uint32_t, 6> outputABIElementTypes;
-    SmallVector<SmallVector<int32_t, kMaxRank>, 6> outputABIShapes;
+    SmallVector<int64_t, 24> outputABIShapes;
     SmallVector<uint32_t, 6> outputABIRanks;
     SmallVector<uint32_t, 6> outputIsStatic;
+    SmallVector<uint32_t, 6> outputOwnership;
+    SmallVector<int32_t, 6> outputAliasIndices;
+    getOutputOwnership(func, outputOwnership, outputAliasIndices);
     for (const auto &outputArgType : func.getCallableResults()) {
       outputABIArgTypes.push_back(getIntReprForABIType(outputArgType));
       outputABIElementTypes.push_back(
           getIntReprForABIElementType(outputArgType));
-      outputABIShapes.push_back(
-          getExtentsForType(outputArgType, /*maxRank=*/kMaxRank));
+      appendExtentsForType(outputArgType, outputABIShapes);
       outputABIRanks.push_back(getRankForType(outputArgType));
       // outputIsStatic.push_back(hasStaticShape(outputArgType));
     }
 
     auto i32Type = builder.getIntegerType(32);
+    auto i64Type = builder.getIntegerType(64);
     auto inputABIDataType =
         RankedTensorType::get(inputABIArgTypes.size(), i32Type);
     auto inputABIElementType =
         RankedTensorType::get(inputABIElementTypes.size(), i32Type);
-    auto inputABIShapesType = RankedTensorType::get(
-        llvm::ArrayRef<int64_t>{static_cast<long>(inputABIShapes.size()) *
-                                kMaxRank},
-        i32Type);
+    auto inputABIShapesType =
+        RankedTensorType::get(inputABIShapes.size(), i64Type);
     auto inputABIRanksType =
         RankedTensorType::get(inputABIRanks.size(), i32Type);
+    auto inputABIReadOnlyType =
+        RankedTensorType::get(inputABIReadOnly.size(), i32Type);
     // auto inputIsStaticType = RankedTensorType::get(inputIsStatic.size(),
     // i32Type);
     auto outputABIDataType =
         RankedTensorType::get(outputABIArgTypes.size(), i32Type);
     auto outputABIElementType =
         RankedTensorType::get(outputABIElementTypes.size(), i32Type);
-    auto outputABIShapesType = RankedTensorType::get(
-        llvm::ArrayRef<int64_t>{static_cast<long>(outputABIShapes.size()) *
-                                kMaxRank},
-        i32Type);
+    auto outputABIShapesType =
+        RankedTensorType::get(outputABIShapes.size(), i64Type);
     auto outputABIRanksType =
         RankedTensorType::get(outputABIRanks.size(), i32Type);
+    auto outputOwnershipType =
+        RankedTensorType::get(outputOwnership.size(), i32Type);
     // auto outputIsStaticType = RankedTensorType::get(outputIsStatic.size(),
     // i32Type);
 
-    // TODO(brycearden): I'm sure there's a cleaner way to do this
-    auto flattenABIShapes =
-        [](SmallVector<SmallVector<int32_t, kMaxRank>, 6> shapes) {
-          SmallVector<int32_t, 32> ret;
-          for (auto &shape : shapes)
-            for (auto &dim : shape)
-              ret.push_back(dim);
-          return ret;
-        };
-
     SmallVector<NamedAttribute, 16> namedAttrs;
 
     // Add attributes that are valid for every func (funcName, numInputs,
@@ -255,12 +520,15 @@ static LogicalResult createModuleMetadata(ModuleOp module) {
           Identifier::get("inputRanks", func.getContext()),
           DenseIntElementsAttr::get(inputABIRanksType,
                                     llvm::makeArrayRef(inputABIRanks))));
-      auto inputShapesFlattened = flattenABIShapes(inputABIShapes);
+      if (!inputABIShapes.empty())
+        namedAttrs.push_back(std::make_pair(
+            Identifier::get("inputShapes", func.getContext()),
+            DenseIntElementsAttr::get(inputABIShapesType,
+                                      llvm::makeArrayRef(inputABIShapes))));
       namedAttrs.push_back(std::make_pair(
-          Identifier::get("inputShapes", func.getContext()),
-          DenseIntElementsAttr::get(
-              inputABIShapesType,
-              llvm::makeArrayRef(flattenABIShapes(inputABIShapes)))));
+          Identifier::get("inputReadOnly", func.getContext()),
+          DenseIntElementsAttr::get(inputABIReadOnlyType,
+                                    llvm::makeArrayRef(inputABIReadOnly))));
     }
 
     if (outputABIArgTypes.size()) {
@@ -278,11 +546,39 @@ static LogicalResult createModuleMetadata(ModuleOp module) {
           Identifier::get("outputRanks", func.getContext()),
           DenseIntElementsAttr::get(outputABIRanksType,
                                     llvm::makeArrayRef(outputABIRanks))));
+      if (!outputABIShapes.empty())
+        namedAttrs.push_back(std::make_pair(
+            Identifier::get("outputShapes", func.getContext()),
+            DenseIntElementsAttr::get(outputABIShapesType,
+                                      llvm::makeArrayRef(outputABIShapes))));
       namedAttrs.push_back(std::make_pair(
-          Identifier::get("outputShapes", func.getContext()),
-          DenseIntElementsAttr::get(
-              outputABIShapesType,
-              llvm::makeArrayRef(flattenABIShapes(outputABIShapes)))));
+          Identifier::get("outputOwnership", func.getContext()),
+          DenseIntElementsAttr::get(outputOwnershipType,
+                                    llvm::makeArrayRef(outputOwnership))));
+      namedAttrs.push_back(std::make_pair(
+          Identifier::get("outputAliasIndices", func.getContext()),
+          DenseIntElementsAttr::get(outputOwnershipType,
+                                    llvm::makeArrayRef(outputAliasIndices))));
+    }
+
+    // The memory footprint of the func, which lets clients plan memory
+    // without running it.
+    namedAttrs.push_back(std::make_pair(
+        Identifier::get("constantBytes", func.getContext()),
+        builder.getI64IntegerAttr(getConstantBytes(func, symbolTable))));
+    if (auto inputBytes = getStaticByteSize(func.getType().getInputs()))
+      namedAttrs.push_back(
+          std::make_pair(Identifier::get("inputBytes", func.getContext()),
+                         builder.getI64IntegerAttr(*inputBytes)));
+    if (auto outputBytes = getStaticByteSize(func.getType().getResults()))
+      namedAttrs.push_back(
+          std::make_pair(Identifier::get("outputBytes", func.getContext()),
+                         builder.getI64IntegerAttr(*outputBytes)));
+
+    if (FuncOp directEntry = createDirectEntry(func)) {
+      namedAttrs.push_back(std::make_pair(
+          Identifier::get("directFuncName", func.getContext()),
+          builder.getSymbolRefAttr(directEntry.getName())));
     }
 
     builder.create<refbackrt::FuncMetadataOp>(func.getLoc(), ArrayRef<Type>{},
@@ -323,18 +619,29 @@ public:
 namespace {
 // At ABI boundaries, convert all memrefs to unranked memrefs so that they have
 // a fixed ABI.
+//
+// With the ranked ABI, memref arguments keep their ranked type instead, and
+// LowerToLLVM loads their descriptors with the static rank.
 class FuncOpSignatureConversion : public OpConversionPattern<FuncOp> {
 public:
-  using OpConversionPattern::OpConversionPattern;
+  FuncOpSignatureConversion(TypeConverter &typeConverter, MLIRContext *context,
+                            unsigned bufferAlignment, bool rankedABI)
+      : OpConversionPattern<FuncOp>(typeConverter, context),
+        bufferAlignment(bufferAlignment), rankedABI(rankedABI) {}
   LogicalResult
   matchAndRewrite(FuncOp op, ArrayRef<Value> operands,
                   ConversionPatternRewriter &rewriter) const override {
     FunctionType type = op.getType();
 
     TypeConverter::SignatureConversion entryConversion(type.getNumInputs());
-    if (failed(typeConverter->convertSignatureArgs(type.getInputs(),
-                                                   entryConversion)))
-      return rewriter.notifyMatchFailure(op, "could not convert inputs");
+    for (auto indexAndType : llvm::enumerate(type.getInputs())) {
+      Type abiType = indexAndType.value();
+      if (!rankedABI || !abiType.isa<MemRefType>())
+        abiType = typeConverter->convertType(abiType);
+      if (!abiType)
+        return rewriter.notifyMatchFailure(op, "could not convert inputs");
+      entryConversion.addInputs(indexAndType.index(), abiType);
+    }
     SmallVector<Type, 1> newResultTypes;
     if (failed(typeConverter->convertTypes(type.getResults(), newResultTypes)))
       return rewriter.notifyMatchFailure(op, "could not convert outputs");
@@ -354,16 +661,256 @@ public:
       for (auto newAndOldArg :
            llvm::zip(newEntry.getArguments(), oldEntry.getArguments())) {
         std::tie(newArg, oldArg) = newAndOldArg;
+        // Arguments passed with their own type are used as is (see
+        // `assumeAlignmentOfArguments` for their alignment).
+        if (newArg.getType() == oldArg.getType()) {
+          rewriter.replaceUsesOfBlockArgument(oldArg, newArg);
+          continue;
+        }
         auto memref = rewriter.create<memref::CastOp>(op.getLoc(), newArg,
                                                       oldArg.getType());
+        // The runtime guarantees the alignment of all buffers it passes in.
+        if (bufferAlignment != 0 && oldArg.getType().isa<MemRefType>())
+          rewriter.create<memref::AssumeAlignmentOp>(op.getLoc(), memref,
+                                                     bufferAlignment);
         rewriter.replaceUsesOfBlockArgument(oldArg, memref);
       }
     });
     return success();
   }
+
+private:
+  unsigned bufferAlignment;
+  bool rankedABI;
 };
 } // namespace
 
+// Returns true if the buffer of `op` provably never escapes the function, and
+// adds its deallocations to `deallocs`.
+static bool isNonEscapingAllocation(memref::AllocOp op,
+                                    SmallVectorImpl<Operation *> &deallocs) {
+  return allUsesOfBufferSatisfy(
+      op.getResult(), [&](Operation *user, Value value) {
+        if (isa<memref::DeallocOp>(user)) {
+          deallocs.push_back(user);
+          return true;
+        }
+        return hasOnlyEffectsOnValue<MemoryEffects::Read,
+                                     MemoryEffects::Write>(user, value);
+      });
+}
+
+// The total number of bytes of the buffers that promoteSmallAllocationsToStack
+// puts on the stack frame of a function, which must also fit the smaller
+// stacks of the runtime's worker threads.
+constexpr int64_t kMaxStackBufferBytesPerFunction = 4096;
+
+// Replaces the statically shaped allocations of at most `maxBytes` bytes whose
+// buffer provably never escapes the function (such as small intermediates and
+// extent tensors) with `memref.alloca`s, and drops their deallocations.
+//
+// The allocas are hoisted to the entry block, so that allocations in loops
+// reuse one stack slot rather than growing the stack with each iteration.
+// This is sound since a non-escaping buffer isn't carried across iterations
+// (it would be through a block argument), and its contents are undefined when
+// allocated. There, LLVM's scalar replacement of aggregates also promotes the
+// elements of the buffers accessed at constant indices to SSA values, which
+// fully scalarizes tiny tensors.
+//
+// The bodies of parallel loops were outlined to functions of their own by
+// now, so that each thread gets its own copy of their buffers.
+static void promoteSmallAllocationsToStack(ModuleOp module, int64_t maxBytes,
+                                           unsigned bufferAlignment) {
+  for (FuncOp func : module.getOps<FuncOp>()) {
+    if (func.isExternal())
+      continue;
+    int64_t budget = kMaxStackBufferBytesPerFunction;
+    SmallVector<memref::AllocOp, 6> allocs;
+    func.walk([&](memref::AllocOp op) { allocs.push_back(op); });
+    OpBuilder builder = OpBuilder::atBlockBegin(&func.getBody().front());
+    for (memref::AllocOp op : allocs) {
+      MemRefType type = op.getType();
+      Optional<int64_t> bytes = getStaticByteSize(type);
+      if (!bytes || *bytes > maxBytes || *bytes > budget ||
+          op->getNumOperands() != 0)
+        continue;
+      SmallVector<Operation *, 1> deallocs;
+      if (!isNonEscapingAllocation(op, deallocs))
+        continue;
+      budget -= *bytes;
+      IntegerAttr alignment = op.alignmentAttr();
+      if (bufferAlignment != 0)
+        alignment = builder.getI64IntegerAttr(bufferAlignment);
+      auto alloca =
+          builder.create<memref::AllocaOp>(op.getLoc(), type, alignment);
+      for (Operation *dealloc : deallocs)
+        dealloc->erase();
+      op.replaceAllUsesWith(alloca.getResult());
+      op.erase();
+    }
+  }
+}
+
+// Returns true if `block` is part of a cycle of the CFG of its region.
+static bool isInBlockCycle(Block *block) {
+  SmallVector<Block *, 8> worklist(block->getSuccessors());
+  llvm::SmallPtrSet<Block *, 8> visited;
+  while (!worklist.empty()) {
+    Block *current = worklist.pop_back_val();
+    if (current == block)
+      return true;
+    if (visited.insert(current).second)
+      worklist.append(current->succ_begin(), current->succ_end());
+  }
+  return false;
+}
+
+// Returns true if control can reach `region` again after leaving it, without
+// leaving its parent op. Ops with regions that don't describe their control
+// flow are assumed to loop.
+static bool isRepetitiveRegion(Region *region) {
+  Operation *op = region->getParentOp();
+  if (isa<LoopLikeOpInterface>(op))
+    return true;
+  auto branchOp = dyn_cast<RegionBranchOpInterface>(op);
+  if (!branchOp)
+    return true;
+  SmallVector<Attribute, 4> operands(op->getNumOperands(), Attribute());
+  SmallVector<unsigned, 4> worklist = {region->getRegionNumber()};
+  llvm::SmallDenseSet<unsigned, 4> visited;
+  while (!worklist.empty()) {
+    SmallVector<RegionSuccessor, 2> successors;
+    branchOp.getSuccessorRegions(worklist.pop_back_val(), operands,
+                                 successors);
+    for (RegionSuccessor &successor : successors) {
+      Region *successorRegion = successor.getSuccessor();
+      if (successorRegion == region)
+        return true;
+      if (successorRegion &&
+          visited.insert(successorRegion->getRegionNumber()).second)
+        worklist.push_back(successorRegion->getRegionNumber());
+    }
+  }
+  return false;
+}
+
+// Returns true if `op` may run more than once per call of its function, that
+// is, if it is in a loop, either of the CFG or of a region-holding op.
+static bool mayRunRepeatedly(Operation *op) {
+  for (Block *block = op->getBlock();;
+       block = block->getParentOp()->getBlock()) {
+    if (isInBlockCycle(block))
+      return true;
+    if (isa<FuncOp>(block->getParentOp()))
+      return false;
+    if (isRepetitiveRegion(block->getParent()))
+      return true;
+  }
+}
+
+// Returns true if refback-reuse-scratch-buffers gives `op` a slot of its
+// function's scratch workspace when it is a scratch buffer, that is, if it has
+// a static size, is in a block of the function's body, and all uses of it (and
+// of its views) are in that block.
+static bool getsWorkspaceSlot(memref::AllocOp op) {
+  if (!getStaticByteSize(op.getType()) ||
+      !op.getType().getAffineMaps().empty() ||
+      !isa<FuncOp>(op->getParentOp()))
+    return false;
+  Block *block = op->getBlock();
+  SmallVector<Value, 6> worklist;
+  worklist.push_back(op.getResult());
+  while (!worklist.empty()) {
+    Value value = worklist.pop_back_val();
+    for (Operation *user : value.getUsers()) {
+      if (!block->findAncestorOpInBlock(*user))
+        return false;
+      if (isa<memref::CastOp>(user) || isa<ViewLikeOpInterface>(user))
+        worklist.push_back(user->getResult(0));
+    }
+  }
+  return true;
+}
+
+// Marks allocations whose buffer provably never escapes the function with the
+// `refbackrt.scratch` unit attribute, and drops their deallocations.
+//
+// LowerToLLVM carves such buffers out of the runtime's per-invocation scratch
+// arena instead of allocating them individually, and the runtime releases the
+// whole arena at once after the call returns. Everything else (e.g. returned
+// buffers, which the runtime adopts) keeps coming from the regular allocator.
+//
+// Allocations that may run repeatedly (in loops) are left alone too, since
+// the arena would grow with the trip count, while freeing them in each
+// iteration bounds the memory they take. The exception is those that
+// refback-reuse-scratch-buffers gives a fixed slot of the function's scratch
+// workspace.
+//
+// The direct entries (and the funcs they call) run without the runtime
+// setting up a scratch arena, so their allocations are left alone.
+static void markScratchAllocations(ModuleOp module) {
+  SymbolTable symbolTable(module);
+  SmallVector<FuncOp, 4> worklist;
+  for (FuncOp func : module.getOps<FuncOp>())
+    if (func->hasAttr(kDirectEntryAttrName))
+      worklist.push_back(func);
+  llvm::SmallPtrSet<Operation *, 4> calledWithoutArena;
+  while (!worklist.empty()) {
+    FuncOp func = worklist.pop_back_val();
+    if (!calledWithoutArena.insert(func).second)
+      continue;
+    func.walk([&](CallOp call) {
+      if (auto callee = symbolTable.lookup<FuncOp>(call.getCallee()))
+        worklist.push_back(callee);
+    });
+  }
+
+  SmallVector<Operation *, 6> deallocsToErase;
+  module.walk([&](memref::AllocOp op) {
+    if (calledWithoutArena.count(op->getParentOfType<FuncOp>()))
+      return;
+    if (mayRunRepeatedly(op) && !getsWorkspaceSlot(op))
+      return;
+    SmallVector<Operation *, 1> deallocs;
+    if (!isNonEscapingAllocation(op, deallocs))
+      return;
+    op->setAttr("refbackrt.scratch", UnitAttr::get(op.getContext()));
+    deallocsToErase.append(deallocs.begin(), deallocs.end());
+  });
+  for (Operation *dealloc : deallocsToErase)
+    dealloc->erase();
+}
+
+// Buffers allocated by compiled code come from the runtime's allocator (see
+// LowerToLLVM.cpp), which guarantees their alignment. Let later optimizations
+// know about this.
+static void assumeAlignmentOfAllocations(ModuleOp module,
+                                         unsigned bufferAlignment) {
+  module.walk([&](memref::AllocOp op) {
+    OpBuilder builder(op.getContext());
+    builder.setInsertionPointAfter(op);
+    builder.create<memref::AssumeAlignmentOp>(op.getLoc(), op.getResult(),
+                                              bufferAlignment);
+  });
+}
+
+// With the ranked ABI, the memref arguments are not converted, so we let
+// later optimizations know about their alignment up front.
+static void assumeAlignmentOfArguments(ModuleOp module,
+                                       unsigned bufferAlignment) {
+  for (FuncOp func : module.getOps<FuncOp>()) {
+    if (func.isExternal() || func->hasAttr(kDirectEntryAttrName))
+      continue;
+    Block &entry = func.getBody().front();
+    OpBuilder builder = OpBuilder::atBlockBegin(&entry);
+    for (BlockArgument arg : entry.getArguments()) {
+      if (arg.getType().isa<MemRefType>())
+        builder.create<memref::AssumeAlignmentOp>(func.getLoc(), arg,
+                                                  bufferAlignment);
+    }
+  }
+}
+
 namespace {
 // At the return ABI boundaries, convert to the ABI type.
 // This pattern is needed to trigger the type conversion mechanics to do a
@@ -380,7 +927,9 @@ public:
 };
 } // namespace
 
-static LogicalResult doDialectConversion(ModuleOp module) {
+static LogicalResult doDialectConversion(ModuleOp module,
+                                         unsigned bufferAlignment,
+                                         bool rankedABI) {
   auto *context = module.getContext();
 
   TypeConverter typeConverter;
@@ -401,9 +950,17 @@ static LogicalResult doDialectConversion(ModuleOp module) {
   target.addLegalDialect<StandardOpsDialect>();
   target.addLegalDialect<memref::MemRefDialect>();
 
-  patterns.add<FuncOpSignatureConversion>(typeConverter, context);
-  target.addDynamicallyLegalOp<FuncOp>(
-      [&](FuncOp op) { return typeConverter.isSignatureLegal(op.getType()); });
+  patterns.add<FuncOpSignatureConversion>(typeConverter, context,
+                                          bufferAlignment, rankedABI);
+  // The direct entries keep their ranked memrefs, which LowerToLLVM replaces
+  // with bare pointers.
+  target.addDynamicallyLegalOp<FuncOp>([&](FuncOp op) {
+    if (op->hasAttr(kDirectEntryAttrName))
+      return true;
+    FunctionType type = op.getType();
+    return typeConverter.isLegal(type.getResults()) &&
+           (rankedABI || typeConverter.isLegal(type.getInputs()));
+  });
   patterns.add<RewriteReturnOp>(typeConverter, context);
   target.addDynamicallyLegalOp<ReturnOp>(
       [&](ReturnOp op) { return typeConverter.isLegal(op); });
@@ -419,6 +976,14 @@ namespace {
 // the refbackrt dialect.
 class LowerToRefbackrtABI
     : public LowerToRefbackrtABIBase<LowerToRefbackrtABI> {
+public:
+  LowerToRefbackrtABI() = default;
+  LowerToRefbackrtABI(bool ranked, unsigned maxStackBytes) {
+    rankedABI = ranked;
+    stackBufferMaxBytes = maxStackBytes;
+  }
+
+private:
   void getDependentDialects(DialectRegistry &registry) const override {
     registry.insert<refbackrt::RefbackrtDialect, memref::MemRefDialect>();
   }
@@ -433,8 +998,21 @@ class LowerToRefbackrtABI
     if (failed(createModuleMetadata(module)))
       return signalPassFailure();
 
+    // These must run before `assumeAlignmentOfAllocations`, since
+    // memref.assume_alignment doesn't declare its memory effects.
+    if (stackBufferMaxBytes != 0)
+      promoteSmallAllocationsToStack(module, stackBufferMaxBytes,
+                                     bufferAlignment);
+    markScratchAllocations(module);
+
+    if (bufferAlignment != 0) {
+      assumeAlignmentOfAllocations(module, bufferAlignment);
+      if (rankedABI)
+        assumeAlignmentOfArguments(module, bufferAlignment);
+    }
+
     // Now do the actual conversion / lowering.
-    if (failed(doDialectConversion(module)))
+    if (failed(doDialectConversion(module, bufferAlignment, rankedABI)))
       return signalPassFailure();
   }
 };
@@ -444,3 +1022,10 @@ std::unique_ptr<OperationPass<ModuleOp>>
 mlir::NPCOMP::createLowerToRefbackrtABIPass() {
   return std::make_unique<LowerToRefbackrtABI>();
 }
+
+std::unique_ptr<OperationPass<ModuleOp>>
+mlir::NPCOMP::createLowerToRefbackrtABIPass(bool rankedABI,
+                                            unsigned stackBufferMaxBytes) {
+  return std::make_unique<LowerToRefbackrtABI>(rankedABI,
+                                               stackBufferMaxBytes);
+}
@@ -0,0 +1,223 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Repacks the constant right-hand sides of matmuls (typically weights) at
+// compile time into the panel layout used by the matmul microkernel (see
+// LowerPackedMatmuls).
+//
+// A KxN matrix is split into panels of `panelWidth` columns, the last one
+// padded with zeros, and each panel is stored contiguously, row after row. So
+// the packed matrix has type `tensor<ceildiv(N, panelWidth) x K x panelWidth>`
+// and the microkernel can load one row of a panel as a single vector. The
+// matmul is replaced by an equivalent `linalg.generic` reading the packed
+// matrix, which is marked for LowerPackedMatmuls.
+//
+// Constants that are only transposed before being multiplied (as in the
+// lowering of `aten.linear`) are packed directly from their original layout,
+// which also removes the transpose from the compiled code.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+
+#include "mlir/Dialect/Linalg/IR/LinalgOps.h"
+#include "mlir/Dialect/StandardOps/IR/Ops.h"
+#include "mlir/IR/BuiltinAttributes.h"
+#include "llvm/Support/MathExtras.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+// Returns true if `op` is a linalg.generic that only transposes a matrix.
+static bool isTranspose(linalg::GenericOp op) {
+  if (op.getNumInputs() != 1 || op.getNumOutputs() != 1 ||
+      op.getNumLoops() != 2)
+    return false;
+  MLIRContext *context = op.getContext();
+  AffineExpr d0, d1;
+  bindDims(context, d0, d1);
+  auto maps = op.getIndexingMaps();
+  if (maps[0] != AffineMap::get(2, 0, {d1, d0}, context) ||
+      !maps[1].isIdentity())
+    return false;
+  auto yield = cast<linalg::YieldOp>(op.getBody()->getTerminator());
+  return yield.getNumOperands() == 1 &&
+         yield.getOperand(0) == op.getBody()->getArgument(0);
+}
+
+namespace {
+// A constant KxN matrix, possibly stored transposed.
+struct ConstantMatrix {
+  DenseElementsAttr value;
+  bool isTransposed;
+};
+} // namespace
+
+static Optional<ConstantMatrix> getConstantMatrix(Value matrix) {
+  bool isTransposed = false;
+  if (auto transpose = matrix.getDefiningOp<linalg::GenericOp>()) {
+    if (!isTranspose(transpose))
+      return None;
+    matrix = transpose.getOperand(0);
+    isTransposed = true;
+  }
+  auto constant = matrix.getDefiningOp<ConstantOp>();
+  if (!constant)
+    return None;
+  auto value = constant.getValue().dyn_cast<DenseElementsAttr>();
+  if (!value)
+    return None;
+  return ConstantMatrix{value, isTransposed};
+}
+
+// Returns true if `type` is a float type that extends to the float type
+// `accumulatorType`.
+static bool isFloatNoWiderThan(Type type, Type accumulatorType) {
+  return type.isa<FloatType>() && accumulatorType.isa<FloatType>() &&
+         type.getIntOrFloatBitWidth() <=
+             accumulatorType.getIntOrFloatBitWidth();
+}
+
+// Returns the panel layout of `matrix`, as described at the top of the file.
+static DenseElementsAttr packMatrix(ConstantMatrix matrix,
+                                    int64_t panelWidth) {
+  auto type = matrix.value.getType();
+  int64_t rows = type.getDimSize(matrix.isTransposed ? 1 : 0);
+  int64_t cols = type.getDimSize(matrix.isTransposed ? 0 : 1);
+  int64_t numPanels = llvm::divideCeil(cols, panelWidth);
+  auto packedType = RankedTensorType::get({numPanels, rows, panelWidth},
+                                          type.getElementType());
+
+  // Copy the raw element data, so that this works the same for all element
+  // types and doesn't materialize an attribute per element. Zero bits are a
+  // zero of every floating point type.
+  int64_t elementBytes = type.getElementTypeBitWidth() / 8;
+  ArrayRef<char> data = matrix.value.getRawData();
+  bool isSplat = matrix.value.isSplat();
+  std::vector<char> packed(packedType.getNumElements() * elementBytes, 0);
+  for (int64_t panel = 0; panel < numPanels; panel++) {
+    for (int64_t row = 0; row < rows; row++) {
+      for (int64_t lane = 0; lane < panelWidth; lane++) {
+        int64_t col = panel * panelWidth + lane;
+        if (col >= cols)
+          break;
+        int64_t index = matrix.isTransposed ? col * rows + row
+                                            : row * cols + col;
+        const char *element =
+            data.data() + (isSplat ? 0 : index) * elementBytes;
+        int64_t packedIndex = (panel * rows + row) * panelWidth + lane;
+        std::copy(element, element + elementBytes,
+                  packed.data() + packedIndex * elementBytes);
+      }
+    }
+  }
+  return DenseElementsAttr::getFromRawBuffer(packedType, packed,
+                                             /*isSplatBuffer=*/false);
+}
+
+// Replaces `op` by a linalg.generic that reads its right-hand side from the
+// packed form of `rhs`.
+static void packMatmul(linalg::MatmulOp op, ConstantMatrix rhs,
+                       int64_t panelWidth) {
+  OpBuilder builder(op);
+  Location loc = op.getLoc();
+  MLIRContext *context = op.getContext();
+  Value packed =
+      builder.create<ConstantOp>(loc, packMatrix(rhs, panelWidth));
+
+  // Loops (i, j, k), with rhs[k, j] at packed[j floordiv w, k, j mod w].
+  AffineExpr i, j, k;
+  bindDims(context, i, j, k);
+  SmallVector<AffineMap, 3> indexingMaps = {
+      AffineMap::get(3, 0, {i, k}, context),
+      AffineMap::get(3, 0, {j.floorDiv(panelWidth), k, j % panelWidth},
+                     context),
+      AffineMap::get(3, 0, {i, j}, context)};
+  SmallVector<StringRef, 3> iteratorTypes = {getParallelIteratorTypeName(),
+                                              getParallelIteratorTypeName(),
+                                              getReductionIteratorTypeName()};
+  Value lhs = op.getOperand(0);
+  Value init = op.getOperand(2);
+  auto generic = builder.create<linalg::GenericOp>(
+      loc, op->getResultTypes(), ValueRange({lhs, packed}), init,
+      indexingMaps, iteratorTypes,
+      [](OpBuilder &b, Location loc, ValueRange args) {
+        // Narrower operands (see DemoteToBF16) are extended to the
+        // accumulator type.
+        Type accumulatorType = args[2].getType();
+        auto extend = [&](Value value) -> Value {
+          if (value.getType() == accumulatorType)
+            return value;
+          return b.create<FPExtOp>(loc, value, accumulatorType);
+        };
+        Value product =
+            b.create<MulFOp>(loc, extend(args[0]), extend(args[1]));
+        Value sum = b.create<AddFOp>(loc, args[2], product);
+        b.create<linalg::YieldOp>(loc, sum);
+      });
+  generic->setAttr("refback.packed_matmul", builder.getUnitAttr());
+  op->replaceAllUsesWith(generic);
+  op.erase();
+}
+
+namespace {
+class PackMatmulWeights : public PackMatmulWeightsBase<PackMatmulWeights> {
+public:
+  PackMatmulWeights() = default;
+  PackMatmulWeights(int64_t width) { panelWidth = width; }
+
+  void runOnOperation() override {
+    FuncOp func = getOperation();
+    if (panelWidth <= 0) {
+      func.emitError() << "panel width must be positive";
+      return signalPassFailure();
+    }
+    SmallVector<linalg::MatmulOp, 4> matmuls;
+    func.walk([&](linalg::MatmulOp op) {
+      if (op.hasTensorSemantics())
+        matmuls.push_back(op);
+    });
+    for (linalg::MatmulOp op : matmuls) {
+      auto elementType =
+          op->getResult(0).getType().cast<ShapedType>().getElementType();
+      if (!isFloatNoWiderThan(
+              op.getOperand(0).getType().cast<ShapedType>().getElementType(),
+              elementType))
+        continue;
+      auto rhs = getConstantMatrix(op.getOperand(1));
+      if (!rhs ||
+          !isFloatNoWiderThan(rhs->value.getType().getElementType(),
+                              elementType))
+        continue;
+      packMatmul(op, *rhs, panelWidth);
+    }
+
+    // Clean up the transposes and the original constants that were packed,
+    // so that they don't end up in the compiled module.
+    func.walk([](linalg::GenericOp op) {
+      if (op->use_empty() && op.hasTensorSemantics() && isTranspose(op))
+        op.erase();
+    });
+    func.walk([](ConstantOp op) {
+      if (op->use_empty() && op.getType().isa<RankedTensorType>())
+        op.erase();
+    });
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createPackMatmulWeightsPass() {
+  return std::make_unique<PackMatmulWeights>();
+}
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createPackMatmulWeightsPass(int64_t panelWidth) {
+  return std::make_unique<PackMatmulWeights>(panelWidth);
+}
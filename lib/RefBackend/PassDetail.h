@@ -9,9 +9,15 @@
 #ifndef REFBACKEND_PASSDETAIL_H
 #define REFBACKEND_PASSDETAIL_H
 
+#include "mlir/Dialect/Affine/IR/AffineOps.h"
+#include "mlir/Dialect/LLVMIR/LLVMDialect.h"
+#include "mlir/Dialect/Linalg/IR/LinalgTypes.h"
 #include "mlir/Dialect/MemRef/IR/MemRef.h"
+#include "mlir/Dialect/SCF/SCF.h"
 #include "mlir/Dialect/Tensor/IR/Tensor.h"
+#include "mlir/Dialect/Vector/VectorOps.h"
 #include "mlir/Pass/Pass.h"
+#include "npcomp/Dialect/Refbackrt/IR/RefbackrtDialect.h"
 
 namespace mlir {
 namespace NPCOMP {
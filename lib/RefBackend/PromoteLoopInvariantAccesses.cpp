@@ -0,0 +1,225 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Moves the accesses of loop-invariant memref elements out of `scf.for` loops
+// (a form of scalar replacement for the loops that linalg ops lower to).
+//
+// For example, the reduction loop of a matmul
+//   scf.for %k = %c0 to %K step %c1 {
+//     %a = memref.load %A[%i, %k]
+//     %b = memref.load %B[%k, %j]
+//     %c = memref.load %C[%i, %j]
+//     ...
+//     memref.store %sum, %C[%i, %j]
+//   }
+// becomes, when %C doesn't alias %A or %B,
+//   %init = memref.load %C[%i, %j]
+//   %result = scf.for %k = %c0 to %K step %c1 iter_args(%c = %init) {
+//     %a = memref.load %A[%i, %k]
+//     %b = memref.load %B[%k, %j]
+//     ...
+//     scf.yield %sum
+//   }
+//   memref.store %result, %C[%i, %j]
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+
+#include "mlir/Interfaces/SideEffectInterfaces.h"
+#include "mlir/Interfaces/ViewLikeInterface.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+// Returns the buffer that `memref` is a view of.
+static Value getUnderlyingBuffer(Value memref) {
+  while (Operation *op = memref.getDefiningOp()) {
+    if (auto view = dyn_cast<ViewLikeOpInterface>(op))
+      memref = view.getViewSource();
+    else if (auto cast = dyn_cast<memref::CastOp>(op))
+      memref = cast.source();
+    else
+      break;
+  }
+  return memref;
+}
+
+static bool isAllocation(Value buffer) {
+  return buffer.getDefiningOp<memref::AllocOp>() ||
+         buffer.getDefiningOp<memref::AllocaOp>();
+}
+
+// Returns true if views of the underlying buffers `lhs` and `rhs` may
+// overlap. An allocation doesn't overlap any other buffer.
+static bool mayAlias(Value lhs, Value rhs) {
+  return lhs == rhs || (!isAllocation(lhs) && !isAllocation(rhs));
+}
+
+namespace {
+// An op of a loop reading or writing the memory of `buffer`.
+struct MemoryAccess {
+  Operation *op;
+  Value buffer;
+  bool isWrite;
+};
+} // namespace
+
+// Collects the accesses of the ops in `loop` to the memory of memrefs.
+// Returns failure if they have other effects, or effects we can't attribute
+// to a memref.
+static LogicalResult getMemoryAccesses(scf::ForOp loop,
+                                       SmallVectorImpl<MemoryAccess> &accesses) {
+  auto result = loop.getBody()->walk([&](Operation *op) {
+    // The nested ops of such ops are visited on their own.
+    if (op->hasTrait<OpTrait::HasRecursiveSideEffects>())
+      return WalkResult::advance();
+    auto effectInterface = dyn_cast<MemoryEffectOpInterface>(op);
+    if (!effectInterface)
+      return WalkResult::interrupt();
+    SmallVector<MemoryEffects::EffectInstance, 2> effects;
+    effectInterface.getEffects(effects);
+    for (const MemoryEffects::EffectInstance &effect : effects) {
+      // Allocating memory doesn't affect the existing buffers.
+      if (isa<MemoryEffects::Allocate>(effect.getEffect()))
+        continue;
+      Value value = effect.getValue();
+      if (!value || !value.getType().isa<BaseMemRefType>())
+        return WalkResult::interrupt();
+      accesses.push_back({op, getUnderlyingBuffer(value),
+                          !isa<MemoryEffects::Read>(effect.getEffect())});
+    }
+    return WalkResult::advance();
+  });
+  return failure(result.wasInterrupted());
+}
+
+// Returns true if the memref and indices of `op` are defined outside of
+// `loop`.
+static bool isLoopInvariantAccess(Operation *op, scf::ForOp loop) {
+  return llvm::all_of(op->getOperands().drop_front(
+                          isa<memref::StoreOp>(op) ? 1 : 0),
+                      [&](Value operand) {
+                        return loop.isDefinedOutsideOfLoop(operand);
+                      });
+}
+
+// Moves the loads of `loop` out of it when their element is the same in all
+// iterations and is not written by the loop.
+static void hoistInvariantLoads(scf::ForOp loop,
+                                ArrayRef<MemoryAccess> accesses) {
+  for (const MemoryAccess &access : accesses) {
+    auto load = dyn_cast<memref::LoadOp>(access.op);
+    if (!load || load->getBlock() != loop.getBody() ||
+        !isLoopInvariantAccess(load, loop))
+      continue;
+    if (llvm::any_of(accesses, [&](const MemoryAccess &other) {
+          return other.isWrite && mayAlias(other.buffer, access.buffer);
+        }))
+      continue;
+    load->moveBefore(loop);
+  }
+}
+
+// Finds a load and a store of the same loop-invariant element in the body of
+// `loop`, in this order, which are the only accesses of the loop to memory
+// that may alias it.
+static Optional<std::pair<memref::LoadOp, memref::StoreOp>>
+findPromotableElement(scf::ForOp loop, ArrayRef<MemoryAccess> accesses) {
+  for (const MemoryAccess &access : accesses) {
+    auto store = dyn_cast<memref::StoreOp>(access.op);
+    if (!store || store->getBlock() != loop.getBody() ||
+        !isLoopInvariantAccess(store, loop))
+      continue;
+    memref::LoadOp load;
+    bool promotable = true;
+    for (const MemoryAccess &other : accesses) {
+      if (other.op == store || !mayAlias(other.buffer, access.buffer))
+        continue;
+      auto otherLoad = dyn_cast<memref::LoadOp>(other.op);
+      if (load || !otherLoad || otherLoad.memref() != store.memref() ||
+          !llvm::equal(otherLoad.indices(), store.indices()) ||
+          otherLoad->getBlock() != loop.getBody() ||
+          !otherLoad->isBeforeInBlock(store)) {
+        promotable = false;
+        break;
+      }
+      load = otherLoad;
+    }
+    if (promotable && load)
+      return std::make_pair(load, store);
+  }
+  return None;
+}
+
+// Keeps the element accessed by `load` and `store` in an iteration argument
+// of `loop`. Returns the new loop, which replaces `loop`.
+static scf::ForOp promoteElement(scf::ForOp loop, memref::LoadOp load,
+                                 memref::StoreOp store) {
+  load->moveBefore(loop);
+  SmallVector<Value, 4> iterOperands(loop.getIterOperands());
+  iterOperands.push_back(load.getResult());
+  OpBuilder builder(loop);
+  auto newLoop = builder.create<scf::ForOp>(loop.getLoc(), loop.lowerBound(),
+                                            loop.upperBound(), loop.step(),
+                                            iterOperands);
+  Block *newBody = newLoop.getBody();
+  newBody->getOperations().splice(newBody->end(),
+                                  loop.getBody()->getOperations());
+  for (auto args : llvm::zip(loop.getBody()->getArguments(),
+                             newBody->getArguments().drop_back()))
+    std::get<0>(args).replaceAllUsesWith(std::get<1>(args));
+  load.getResult().replaceUsesWithIf(
+      newBody->getArguments().back(), [&](OpOperand &use) {
+        return newLoop->isProperAncestor(use.getOwner());
+      });
+
+  auto yield = cast<scf::YieldOp>(newBody->getTerminator());
+  SmallVector<Value, 4> yieldedValues(yield.getOperands());
+  yieldedValues.push_back(store.value());
+  OpBuilder(yield).create<scf::YieldOp>(yield.getLoc(), yieldedValues);
+  yield.erase();
+
+  loop.replaceAllUsesWith(newLoop.getResults().drop_back());
+  loop.erase();
+  store->moveAfter(newLoop);
+  store.valueMutable().assign(newLoop.getResults().back());
+  return newLoop;
+}
+
+namespace {
+class PromoteLoopInvariantAccesses
+    : public PromoteLoopInvariantAccessesBase<PromoteLoopInvariantAccesses> {
+  void runOnOperation() override {
+    // Inner loops first, so that the accesses moved out of them can be moved
+    // further out of the loops around them.
+    SmallVector<scf::ForOp, 8> loops;
+    getOperation().walk([&](scf::ForOp loop) { loops.push_back(loop); });
+    for (scf::ForOp loop : loops) {
+      SmallVector<MemoryAccess, 8> accesses;
+      if (failed(getMemoryAccesses(loop, accesses)))
+        continue;
+      hoistInvariantLoads(loop, accesses);
+      while (true) {
+        accesses.clear();
+        (void)getMemoryAccesses(loop, accesses);
+        auto element = findPromotableElement(loop, accesses);
+        if (!element)
+          break;
+        loop = promoteElement(loop, element->first, element->second);
+      }
+    }
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createPromoteLoopInvariantAccessesPass() {
+  return std::make_unique<PromoteLoopInvariantAccesses>();
+}
@@ -27,8 +27,10 @@
 #include "PassDetail.h"
 
 #include "mlir/Conversion/AffineToStandard/AffineToStandard.h"
+#include "mlir/Dialect/Affine/Passes.h"
 #include "mlir/Conversion/SCFToStandard/SCFToStandard.h"
 #include "mlir/Conversion/ShapeToStandard/ShapeToStandard.h"
+#include "mlir/Conversion/VectorToSCF/VectorToSCF.h"
 #include "mlir/Dialect/Linalg/IR/LinalgOps.h"
 #include "mlir/Dialect/Linalg/IR/LinalgTypes.h"
 #include "mlir/Dialect/Linalg/Passes.h"
@@ -47,9 +49,11 @@
 #include "npcomp/Conversion/TCFToStd/TCFToStd.h"
 #include "npcomp/Conversion/TCFToTCP/TCFToTCP.h"
 #include "npcomp/Dialect/Refback/IR/RefbackOps.h"
+#include "npcomp/Dialect/TCF/Transforms/Passes.h"
 #include "npcomp/Dialect/TCP/IR/TCPDialect.h"
 #include "npcomp/Dialect/TCP/IR/TCPOps.h"
 #include "npcomp/Dialect/TCP/Transforms/Passes.h"
+#include "llvm/Support/Process.h"
 
 using namespace mlir;
 using namespace mlir::NPCOMP;
@@ -81,6 +85,11 @@ void mlir::NPCOMP::registerRefBackendPasses() {
       "RefBackend lowering pipeline, starting from TCF. (equivalent to "
       "refback-tcf-to-tcp-pipeline + refback-lowering-pipeline)",
       mlir::NPCOMP::createTCFRefBackendLoweringPipeline);
+  mlir::PassPipelineRegistration<RefBackendLoweringPipelineOptions>(
+      "tcf-refback-interpreter-pipeline",
+      "RefBackend pipeline lowering TCF to the ops of the runtime's "
+      "interpreter.",
+      mlir::NPCOMP::createTCFRefBackendInterpreterPipeline);
 }
 
 //===----------------------------------------------------------------------===//
@@ -139,6 +148,60 @@ mlir::NPCOMP::createLowerAllocMemRefOpsPass() {
   return std::make_unique<LowerAllocMemRefOps>();
 }
 
+//===----------------------------------------------------------------------===//
+// LowerMemRefCloneOps
+//===----------------------------------------------------------------------===//
+
+namespace {
+class LowerMemRefCloneOp : public OpRewritePattern<memref::CloneOp> {
+public:
+  using OpRewritePattern::OpRewritePattern;
+  LogicalResult matchAndRewrite(memref::CloneOp op,
+                                PatternRewriter &rewriter) const override {
+    auto memrefType = op.getType().dyn_cast<MemRefType>();
+    if (!memrefType || !memrefType.getAffineMaps().empty())
+      return rewriter.notifyMatchFailure(op, "unsupported memref type");
+    SmallVector<Value, 6> dynamicExtents;
+    for (int i = 0, e = memrefType.getRank(); i < e; i++) {
+      if (memrefType.isDynamicDim(i))
+        dynamicExtents.push_back(
+            rewriter.create<memref::DimOp>(op.getLoc(), op.input(), i));
+    }
+    auto alloc = rewriter.create<memref::AllocOp>(op.getLoc(), memrefType,
+                                                  dynamicExtents);
+    rewriter.create<linalg::CopyOp>(op.getLoc(), op.input(), alloc);
+    rewriter.replaceOp(op, alloc.getResult());
+    return success();
+  }
+};
+} // namespace
+
+namespace {
+class LowerMemRefCloneOps
+    : public LowerMemRefCloneOpsBase<LowerMemRefCloneOps> {
+
+  void runOnOperation() override {
+    auto func = getOperation();
+    auto *context = &getContext();
+    RewritePatternSet patterns(context);
+    patterns.add<LowerMemRefCloneOp>(context);
+    ConversionTarget target(*context);
+    target.addIllegalOp<memref::CloneOp>();
+    target.addLegalOp<memref::AllocOp>();
+    target.addLegalOp<memref::DimOp>();
+    target.addLegalOp<linalg::CopyOp>();
+    if (failed(applyPartialConversion(func, target, std::move(patterns)))) {
+      return signalPassFailure();
+    }
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createLowerMemRefCloneOpsPass() {
+  return std::make_unique<LowerMemRefCloneOps>();
+}
+
 //===----------------------------------------------------------------------===//
 // RestrictedCanonicalizer
 //===----------------------------------------------------------------------===//
@@ -146,8 +209,14 @@ mlir::NPCOMP::createLowerAllocMemRefOpsPass() {
 namespace {
 struct RestrictedCanonicalizer
     : public RestrictedCanonicalizerBase<RestrictedCanonicalizer> {
-  void runOnOperation() override {
-    auto *context = &getContext();
+  // The patterns are collected once, rather than on every run of the pass,
+  // which runs on each function of large modules. They are kept across runs
+  // of the pass manager, such as when a batch job compiles many modules with
+  // the same pipeline, as long as no dialects were loaded in between.
+  LogicalResult initialize(MLIRContext *context) override {
+    if (context == patternsContext &&
+        context->getLoadedDialects().size() == numLoadedDialects)
+      return success();
 
     // Find the dialects from their names.
     DenseSet<StringRef> neededDialects;
@@ -175,14 +244,26 @@ struct RestrictedCanonicalizer
     }
 
     // Collect all canonicalization patterns from ops in the included dialects.
-    RewritePatternSet patterns(context);
+    RewritePatternSet owningPatterns(context);
     for (AbstractOperation *op : context->getRegisteredOperations())
       if (dialectsToCanonicalize.count(&op->dialect))
-        op->getCanonicalizationPatterns(patterns, context);
+        op->getCanonicalizationPatterns(owningPatterns, context);
+    patterns = FrozenRewritePatternSet(std::move(owningPatterns));
+    patternsContext = context;
+    numLoadedDialects = context->getLoadedDialects().size();
+    return success();
+  }
 
+  void runOnOperation() override {
     Operation *op = getOperation();
-    (void)applyPatternsAndFoldGreedily(op->getRegions(), std::move(patterns));
+    (void)applyPatternsAndFoldGreedily(op->getRegions(), patterns);
   }
+
+  FrozenRewritePatternSet patterns;
+  // The context that `patterns` were collected in, and the number of dialects
+  // that were loaded in it.
+  MLIRContext *patternsContext = nullptr;
+  size_t numLoadedDialects = 0;
 };
 } // end anonymous namespace
 
@@ -190,12 +271,143 @@ std::unique_ptr<Pass> mlir::NPCOMP::createRestrictedCanonicalizerPass() {
   return std::make_unique<RestrictedCanonicalizer>();
 }
 
+// Returns a canonicalizer that only applies the patterns of the ops of
+// `includedDialects` (a comma separated list), for the cleanups that are
+// needed after a specific lowering, without sweeping the whole pattern set of
+// every registered op over the IR.
+// TODO: This is kind of ugly. Either we use pass options or a constructor
+// that takes C++ data structures. The former makes the pass usable on the
+// command line (including reproducers), the latter makes the pass more
+// convenient.
+static std::unique_ptr<Pass>
+createRestrictedCanonicalizerPass(StringRef includedDialects) {
+  std::unique_ptr<Pass> canonicalizer = createRestrictedCanonicalizerPass();
+  if (failed(canonicalizer->initializeOptions(
+          ("included-dialects=" + includedDialects).str())))
+    llvm::report_fatal_error("couldn't initialize restricted-canonicalize");
+  return canonicalizer;
+}
+
 //===----------------------------------------------------------------------===//
 // createRefBackendLoweringPipeline
 //===----------------------------------------------------------------------===//
 
+TargetInfo mlir::NPCOMP::getTargetInfo(
+    const RefBackendLoweringPipelineOptions &options) {
+  TargetInfo target;
+  if (options.targetFeatures.empty()) {
+    target = getHostTargetInfo();
+  } else {
+    llvm::StringMap<bool> features;
+    for (const std::string &feature : options.targetFeatures)
+      features[feature] = true;
+    target = getTargetInfo(features);
+  }
+  if (options.targetVectorWidth != 0)
+    target.vectorWidth = options.targetVectorWidth;
+  if (options.targetL1CacheSize != 0)
+    target.l1CacheSize = options.targetL1CacheSize;
+  if (options.targetL2CacheSize != 0)
+    target.l2CacheSize = options.targetL2CacheSize;
+  if (options.targetCores != 0)
+    target.numCores = options.targetCores;
+  return target;
+}
+
+void mlir::NPCOMP::setTargetInfo(RefBackendLoweringPipelineOptions &options,
+                                 const TargetInfo &target) {
+  options.targetFeatures = target.features;
+  options.targetVectorWidth = target.vectorWidth;
+  options.targetL1CacheSize = target.l1CacheSize;
+  options.targetL2CacheSize = target.l2CacheSize;
+  options.targetCores = target.numCores;
+}
+
+// Returns the largest power of two T such that three TxT f32 tiles (one of
+// each matmul operand) fill at most half of `cacheSize`, leaving the rest to
+// the other data that the loops touch.
+static int64_t getMatmulTileSize(int64_t cacheSize) {
+  int64_t size = 8;
+  while (3 * (2 * size) * (2 * size) * 4 <= cacheSize / 2)
+    size *= 2;
+  return size;
+}
+
+// Returns `size` scaled by `cacheSize / referenceCacheSize`, rounded down to
+// a power of two and clamped to [`size` / 4, `size` * 4].
+static int64_t scaleTileSize(int64_t size, int64_t cacheSize,
+                             int64_t referenceCacheSize) {
+  int64_t scaled = llvm::PowerOf2Floor(
+      std::max<int64_t>(size * cacheSize / referenceCacheSize, 1));
+  return std::min(std::max(scaled, size / 4), size * 4);
+}
+
+// Returns the tile sizes from `options`, falling back to defaults sized for
+// the caches of `target` for f32. For matmuls, three tiles (one of each
+// operand) fill half of L1 (resp. L2): 32x32 tiles for 32KiB of L1 and 128x128
+// tiles for 1MiB of L2. For convolutions, the tiles of output channels are
+// scaled from 16 for 32KiB of L1 and 64 for 1MiB of L2.
+static LinalgTilingStrategy
+getTilingStrategy(const RefBackendLoweringPipelineOptions &options,
+                  const TargetInfo &target, bool parallelize) {
+  auto get = [](const auto &option, ArrayRef<int64_t> defaultTileSizes,
+                SmallVectorImpl<int64_t> &tileSizes) {
+    if (option.empty())
+      tileSizes.assign(defaultTileSizes.begin(), defaultTileSizes.end());
+    else
+      tileSizes.assign(option.begin(), option.end());
+  };
+  LinalgTilingStrategy strategy;
+  strategy.parallelize = parallelize;
+  // Loops of linalg.matmul: i, j, k.
+  int64_t l2 = getMatmulTileSize(target.l2CacheSize);
+  int64_t l1 = getMatmulTileSize(target.l1CacheSize);
+  get(options.matmulL2TileSizes, {l2, l2, l2}, strategy.matmulL2TileSizes);
+  get(options.matmulL1TileSizes, {l1, l1, l1}, strategy.matmulL1TileSizes);
+  // Loops of linalg.conv_2d_nchw: n, f, oh, ow, c, kh, kw.
+  get(options.convL2TileSizes,
+      {1, scaleTileSize(64, target.l2CacheSize, 1024 * 1024), 32, 32},
+      strategy.convL2TileSizes);
+  get(options.convL1TileSizes,
+      {1, scaleTileSize(16, target.l1CacheSize, 32 * 1024), 8, 8},
+      strategy.convL1TileSizes);
+  return strategy;
+}
+
+// Lowers linalg ops to affine loops and optimizes them with the polyhedral
+// transformations of the affine dialect. When parallelizing, the parallel
+// loops become scf.parallel loops, as with createConvertLinalgToParallelLoops.
+static void addAffineLoopPasses(OpPassManager &pm, const TargetInfo &target,
+                                bool parallelize) {
+  pm.addNestedPass<FuncOp>(createConvertLinalgToAffineLoopsPass());
+  // Fuse the loop nests of producers into their consumers, so that the
+  // intermediate buffers between them shrink to a tile (or a scalar).
+  pm.addNestedPass<FuncOp>(createLoopFusionPass());
+  pm.addNestedPass<FuncOp>(createInterchangeAffineLoopsPass());
+  // Tile the loop nests for the L1 of the target, and copy the data accessed
+  // by each tile into contiguous buffers.
+  pm.addNestedPass<FuncOp>(createLoopTilingPass(target.l1CacheSize));
+  std::unique_ptr<Pass> dataCopyGeneration =
+      createAffineDataCopyGenerationPass();
+  if (failed(dataCopyGeneration->initializeOptions(
+          ("generate-dma=false fast-mem-space=0 fast-mem-capacity=" +
+           Twine(target.l1CacheSize / 1024) + " skip-non-unit-stride-loops")
+              .str())))
+    llvm::report_fatal_error("couldn't initialize affine-data-copy-generate");
+  pm.addNestedPass<FuncOp>(std::move(dataCopyGeneration));
+  pm.addNestedPass<FuncOp>(createAffineScalarReplacementPass());
+  pm.addNestedPass<FuncOp>(createCanonicalizerPass());
+  if (parallelize)
+    pm.addNestedPass<FuncOp>(createAffineParallelizePass());
+  pm.addNestedPass<FuncOp>(createLowerAffinePass());
+}
+
 void mlir::NPCOMP::createRefBackendLoweringPipeline(
     OpPassManager &pm, const RefBackendLoweringPipelineOptions &options) {
+  TargetInfo target = getTargetInfo(options);
+  // Parallel loops only pay off with several cores to run them on.
+  bool parallelize =
+      options.optimize && options.parallelize && target.numCores != 1;
 
   // Convert all elementwise ops to linalg.
   //
@@ -206,10 +418,45 @@ void mlir::NPCOMP::createRefBackendLoweringPipeline(
   // opportunities.
   pm.addNestedPass<FuncOp>(createConvertElementwiseToLinalgPass());
 
+  // Drop the runtime shape checks of trusted callers, which also merges the
+  // `shape.assuming` regions (which fusion doesn't cross) into the function.
+  if (options.trustedInputs) {
+    pm.addNestedPass<FuncOp>(createAssumeShapeConstraintsPass());
+    pm.addNestedPass<FuncOp>(createRestrictedCanonicalizerPass("shape"));
+  }
+
   if (options.optimize) {
+    // Use the autotuned lowering of the matmuls and convolutions whose shapes
+    // were tuned.
+    std::string tuningDatabase = options.tuningDatabase;
+    if (tuningDatabase.empty())
+      tuningDatabase =
+          llvm::sys::Process::GetEnv("NPCOMP_TUNING_DATABASE").getValueOr("");
+    if (!tuningDatabase.empty())
+      pm.addPass(createApplyTuningDatabasePass(tuningDatabase));
+    // Read broadcast operands through broadcasting indexing maps, so that
+    // the fusion below doesn't materialize the broadcasts.
+    pm.addNestedPass<FuncOp>(createConvertBroadcastToToLinalgPass());
+    // Rewrite convolutions into matmuls where their shape makes it faster,
+    // before the constant filters are relaid out for them below.
+    pm.addNestedPass<FuncOp>(createLowerConvolutionsPass());
+    // Compute the remaining convolutions in NHWC. The layout changes between
+    // convolutions are removed by the folding and fusion below.
+    pm.addNestedPass<FuncOp>(createConvertConvolutionsToNHWCPass());
+    // Evaluate layout changes of constants (such as weight transposes) at
+    // compile time, before fusion merges them into other ops.
+    pm.addNestedPass<FuncOp>(createFoldConstantLinalgOpsPass());
+    // Round the matmul operands to bf16, before fusion merges the rounding
+    // into the ops producing them.
+    if (options.bf16Matmuls)
+      pm.addNestedPass<FuncOp>(createDemoteToBF16Pass());
     pm.addNestedPass<FuncOp>(createLinalgFusionOfTensorOpsPass());
     pm.addNestedPass<FuncOp>(createCanonicalizerPass());
     pm.addNestedPass<FuncOp>(createCSEPass());
+    // Repack constant weights at compile time for the matmul microkernel.
+    // The panels are one vector register wide.
+    pm.addNestedPass<FuncOp>(
+        createPackMatmulWeightsPass(target.getNumF32Lanes()));
   }
 
   // Lower shape constraints before we enter tensor->memref conversion.
@@ -217,15 +464,7 @@ void mlir::NPCOMP::createRefBackendLoweringPipeline(
   pm.addNestedPass<FuncOp>(createConvertShapeConstraintsPass());
   // Run shape canonicalizations. In particular, this erases shape.assuming,
   // now that we have converted shape constraints.
-  // TODO: This is kind of ugly. Either we use pass options or a constructor
-  // that takes C++ data structures. The former makes the pass usable on the
-  // command line (including reproducers), the latter makes the pass more
-  // convenient.
-  std::unique_ptr<Pass> shapeCanonicalizer =
-      createRestrictedCanonicalizerPass();
-  if (failed(shapeCanonicalizer->initializeOptions("included-dialects=shape")))
-    llvm::report_fatal_error("couldn't initialize restricted-canonicalize");
-  pm.addPass(std::move(shapeCanonicalizer));
+  pm.addPass(createRestrictedCanonicalizerPass("shape"));
 
   // Lower shape ops to std.
   pm.addPass(createConvertShapeToStandardPass());
@@ -239,6 +478,10 @@ void mlir::NPCOMP::createRefBackendLoweringPipeline(
   // This means that intermediate steps have source/target materializations
   // (memref.tensor_load / memref.buffer_cast) in the IR.
 
+  // Fill the large splat constants (such as zero biases) rather than storing
+  // them in globals.
+  if (options.optimize)
+    pm.addNestedPass<FuncOp>(createExpandSplatConstantsPass());
   // Run tensor constant bufferization.
   // This pass has to run on a module op, and so does the final
   // FuncBufferizePass. But everything else can run in parallel on functions,
@@ -249,6 +492,10 @@ void mlir::NPCOMP::createRefBackendLoweringPipeline(
   // refback::AllocMemRefOp takes a shape (i.e. extent tensor) as an argument.
   // We need to resolve this to std.alloc which takes individual extents.
   pm.addNestedPass<FuncOp>(createLowerAllocMemRefOpsPass());
+  // Compute the extents once at the function entry rather than once per op,
+  // now that the allocations take them individually.
+  if (options.optimize)
+    pm.addNestedPass<FuncOp>(createHoistShapeComputationsPass());
   pm.addNestedPass<FuncOp>(createSCFBufferizePass());
   pm.addNestedPass<FuncOp>(createLinalgBufferizePass());
   pm.addNestedPass<FuncOp>(createStdBufferizePass());
@@ -256,15 +503,25 @@ void mlir::NPCOMP::createRefBackendLoweringPipeline(
   pm.addPass(createFuncBufferizePass());
   pm.addNestedPass<FuncOp>(createFinalizingBufferizePass());
 
-  // TODO: Do buffer deallocation. We should be able to just drop in the
-  // upstream pass?
-
-  // At this point, we have lots of loose stuff floating around from lowering,
-  // so it's a good time to do some general cleanups.
-  if (options.optimize) {
-    pm.addNestedPass<FuncOp>(createCanonicalizerPass());
-    pm.addNestedPass<FuncOp>(createCSEPass());
-  }
+  // Free every buffer that isn't returned once it is no longer used.
+  //
+  // Note that most of these deallocations are later dropped again, since
+  // intermediate buffers that provably don't escape the function are instead
+  // allocated from the runtime's per-invocation scratch arena (see
+  // LowerToRefbackrtABI), which frees them all at once when the call returns.
+  pm.addNestedPass<FuncOp>(createBufferDeallocationPass());
+
+  // At this point, we have lots of loose stuff floating around from lowering:
+  // memref.tensor_load / memref.buffer_cast pairs, and the clones of buffer
+  // deallocation. Fold those away, leaving the general cleanups to the
+  // canonicalization after lowering to loops below.
+  if (options.optimize)
+    pm.addNestedPass<FuncOp>(createRestrictedCanonicalizerPass("memref"));
+
+  // Double buffer the buffers carried by loops, so that the iterations don't
+  // allocate.
+  if (options.optimize)
+    pm.addNestedPass<FuncOp>(createReuseLoopCarriedBuffersPass());
 
   // --------------------------------------------------------------------------
   // Preparation for converting to an LLVM module.
@@ -272,45 +529,155 @@ void mlir::NPCOMP::createRefBackendLoweringPipeline(
   // Now, we begin the process of lowering to LLVM's level of abstraction
   // (after which LLVM will take over lowering to machine code).
 
-  // Lower linalg ops to loops.
-  // TODO: Do some linalg optimizations like tiling here.
-  pm.addNestedPass<FuncOp>(createConvertLinalgToLoopsPass());
+  // Buffer deallocation inserts clones where it can't prove that a buffer is
+  // uniquely owned. Lower the ones that didn't canonicalize away.
+  pm.addNestedPass<FuncOp>(createLowerMemRefCloneOpsPass());
 
-  // Run a some cleanups.
+  // Update mutable globals (e.g. parameters in a training step) in place,
+  // rather than through copies of them.
+  if (options.optimize)
+    pm.addNestedPass<FuncOp>(createUpdateGlobalsInPlacePass());
+
+  // Compute the inputs of concatenations directly into the concatenated
+  // buffers, and read slices through views of the sliced buffers, rather than
+  // through copies of them.
+  if (options.optimize) {
+    pm.addNestedPass<FuncOp>(createElideConcatCopiesPass());
+    pm.addNestedPass<FuncOp>(createElideSliceCopiesPass());
+  }
+
+  // Lower the matmuls with packed weights to the microkernel, tile the other
+  // compute-heavy linalg ops so that the loops they lower to have good cache
+  // locality, and vectorize the innermost tiles.
+  if (options.optimize) {
+    // Each row of the microkernel takes a vector register for its
+    // accumulator and another for its broadcast left-hand side element.
+    pm.addNestedPass<FuncOp>(createLowerPackedMatmulsPass(
+        target.numVectorRegisters >= 32 ? 8 : 4, target.hasFMA()));
+  }
+  if (options.optimize && !options.affineLoops) {
+    LinalgTilingStrategy tilingStrategy =
+        getTilingStrategy(options, target, parallelize);
+    // Compute bias adds and activations tile by tile along with the matmul or
+    // convolution producing their input, while the tile is in cache.
+    pm.addNestedPass<FuncOp>(createFuseLinalgEpiloguesPass(tilingStrategy));
+    pm.addNestedPass<FuncOp>(createTileLinalgOpsPass(tilingStrategy));
+  }
+
+  // Time each op (including all of its tiles) for the runtime's per-op
+  // profile. This has to see the linalg ops, which name the profiled ops,
+  // before they are vectorized or lowered to loops.
+  if (options.profileOps)
+    pm.addNestedPass<FuncOp>(createInsertOpProfilingPass());
+
+  if (options.optimize) {
+    // Vectorize the ops that are now small enough, for the vector width of
+    // the target.
+    pm.addNestedPass<FuncOp>(createVectorizeLinalgOpsPass(target.vectorWidth));
+  }
+
+  // Lower linalg ops to loops. When parallelizing, their parallel dimensions
+  // become scf.parallel loops, which LowerParallelLoops distributes across
+  // threads below.
+  // Run the independent ops of each function (such as the towers of an
+  // Inception block) concurrently, as tasks of a parallel loop.
+  if (parallelize && !options.affineLoops)
+    pm.addNestedPass<FuncOp>(createFormConcurrentTasksPass());
+  if (options.optimize && options.affineLoops)
+    addAffineLoopPasses(pm, target, parallelize);
+  else if (parallelize)
+    pm.addNestedPass<FuncOp>(createConvertLinalgToParallelLoopsPass());
+  else
+    pm.addNestedPass<FuncOp>(createConvertLinalgToLoopsPass());
+
+  // Run a some cleanups, then move the loop-invariant index computations,
+  // loads and stores out of the loops.
   if (options.optimize) {
     pm.addNestedPass<FuncOp>(createCanonicalizerPass());
     pm.addNestedPass<FuncOp>(createCSEPass());
+    pm.addNestedPass<FuncOp>(createLoopInvariantCodeMotionPass());
+    pm.addNestedPass<FuncOp>(createPromoteLoopInvariantAccessesPass());
   }
 
   // --------------------------------------------------------------------------
   // Final conversion to an LLVM module.
   // --------------------------------------------------------------------------
 
+  // Lower n-D vector transfers to loops of 1-D transfers, which LowerToLLVM
+  // turns into (possibly masked) vector loads and stores.
+  if (options.optimize)
+    pm.addNestedPass<FuncOp>(createConvertVectorToSCFPass());
+
+  // Approximate the math functions, in their vectorized form where the ops
+  // around them have been vectorized.
+  if (options.mathMaxUlp != 0)
+    pm.addNestedPass<FuncOp>(
+        createApproximateMathPass(options.mathMaxUlp, target.hasFMA()));
+
+  // Have the first call of each function read the external globals it uses
+  // ahead, while their loops are still inline in it.
+  if (options.prefetchWeights)
+    pm.addPass(createInsertWeightPrefetchesPass());
+
+  // Run the outermost parallel loops on the runtime's thread pool. Any other
+  // scf.parallel loops are lowered to sequential loops by LowerToCFG.
+  if (parallelize)
+    pm.addPass(createLowerParallelLoopsPass());
+
   // Convert affine to std control flow in preparation for going to LLVM.
   pm.addNestedPass<FuncOp>(createLowerAffinePass());
 
+  // Prefetch the strided and indirect loads of the innermost loops, which
+  // are all scf.for loops of memref.loads by now.
+  if (options.prefetchDistance != 0) {
+    pm.addNestedPass<FuncOp>(
+        createInsertPrefetchesPass(options.prefetchDistance));
+    pm.addNestedPass<FuncOp>(createCSEPass());
+  }
+
   // Convert scf to std control flow in preparation for going to LLVM.
   pm.addNestedPass<FuncOp>(createLowerToCFGPass());
 
   // Convert functions signatures and other constructs that interface with the
-  // runtime to the `refbackrt` dialect.
-  pm.addPass(createLowerToRefbackrtABIPass());
+  // runtime to the `refbackrt` dialect. This also moves the small buffers
+  // that don't escape their function to the stack.
+  pm.addPass(createLowerToRefbackrtABIPass(options.rankedABI,
+                                          options.stackBufferMaxBytes));
+
+  // Share storage between scratch buffers that are never live at the same
+  // time. This also records the peak scratch working set of each function in
+  // the module metadata.
+  pm.addPass(createReuseScratchBuffersPass());
 
   // Finally, convert to LLVM dialect using our custom LowerToLLVM pass
   // which reuses the upstream patterns and gives us a place to add our own
   // patterns for our own custom ops like the refbackrt ops.
-  pm.addPass(createLowerToLLVMPass());
+  pm.addPass(createLowerToLLVMPass(
+      options.fastMathReassoc, options.fastMathContract, options.fastMathNoNaNs,
+      /*profileAllocations=*/options.profileOps));
 
-  // Although LLVM will clean everything up eventually, for the sake of IR
-  // clarity while still in MLIR, run some cleanups.
-  if (options.optimize) {
-    pm.addNestedPass<FuncOp>(createCanonicalizerPass());
-    pm.addNestedPass<FuncOp>(createCSEPass());
-  }
+  // LLVM cleans up the LLVM dialect IR, so we don't run any cleanups on it
+  // here: on large modules, they would take about as long as the conversion.
 }
 
 void mlir::NPCOMP::createRefBackendTCFToTCPPipeline(
     OpPassManager &pm, const RefBackendLoweringPipelineOptions &options) {
+  if (options.optimize) {
+    // Inline the calls of private functions, or call copies specialized for
+    // the static shapes of their operands, so that fusion and memory planning
+    // see the dataflow of the whole program instead of calls through the
+    // memref ABI.
+    pm.addPass(createInlinePrivateFunctionsPass());
+    pm.addNestedPass<FuncOp>(tcf::createShapeRefinementPass());
+  }
+
+  // Add the statically shaped variants of the public functions while the
+  // static shapes can still be propagated through the TCF ops.
+  if (!options.specializeBatchSizes.empty()) {
+    pm.addPass(createSpecializeFunctionsPass(options.specializeBatchSizes));
+    pm.addNestedPass<FuncOp>(tcf::createShapeRefinementPass());
+  }
+
   // Convert from TCF dialect to TCP-level ops.
   //
   // TCF has implicit broadcasting, and issues errors "inside the ops" in the
@@ -325,9 +692,16 @@ void mlir::NPCOMP::createRefBackendTCFToTCPPipeline(
   pm.addNestedPass<FuncOp>(createConvertTCFToLinalgPass());
   pm.addNestedPass<FuncOp>(createConvertTCFToTCPPass());
 
-  if (options.optimize) {
-    pm.addNestedPass<FuncOp>(createCanonicalizerPass());
-    pm.addNestedPass<FuncOp>(createCSEPass());
+  // The constraints of trusted callers are dropped instead, see
+  // createRefBackendLoweringPipeline.
+  if (options.optimize && !options.trustedInputs) {
+    // Check each distinct shape constraint once, at the point where its
+    // shapes are known, instead of once per op.
+    pm.addNestedPass<FuncOp>(createHoistShapeConstraintsPass());
+    // Remove the `shape.assuming` regions of the constraints that were
+    // removed. HoistShapeConstraints already deduplicated the shape
+    // computations, and the rest is cleaned up after fusion.
+    pm.addNestedPass<FuncOp>(createRestrictedCanonicalizerPass("shape"));
   }
 }
 
@@ -336,3 +710,17 @@ void mlir::NPCOMP::createTCFRefBackendLoweringPipeline(
   createRefBackendTCFToTCPPipeline(pm, options);
   createRefBackendLoweringPipeline(pm, options);
 }
+
+void mlir::NPCOMP::createTCFRefBackendInterpreterPipeline(
+    OpPassManager &pm, const RefBackendLoweringPipelineOptions &options) {
+  createRefBackendTCFToTCPPipeline(pm, options);
+  pm.addNestedPass<FuncOp>(createConvertElementwiseToLinalgPass());
+  // The interpreter reads broadcast operands through broadcasting indexing
+  // maps, which don't need a buffer of their own.
+  pm.addNestedPass<FuncOp>(createConvertBroadcastToToLinalgPass());
+  pm.addNestedPass<FuncOp>(createConvertShapeConstraintsPass());
+  pm.addPass(createRestrictedCanonicalizerPass("shape"));
+  pm.addPass(createConvertShapeToStandardPass());
+  // Fold the shape computations of static shapes away.
+  pm.addNestedPass<FuncOp>(createCanonicalizerPass());
+}
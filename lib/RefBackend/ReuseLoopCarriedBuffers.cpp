@@ -0,0 +1,159 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Double buffers the tensors carried by `scf.for` loops (such as the state of
+// a recurrent network), so that the iterations update them without
+// allocating.
+//
+// After bufferization and buffer deallocation, each iteration allocates a
+// buffer for the new value of a loop-carried tensor, and frees the buffer of
+// the previous value:
+//   %r = scf.for %i = ... iter_args(%state = %init) -> (memref<?xf32>) {
+//     %next = memref.alloc(%n) : memref<?xf32>
+//     linalg.generic ins(%state, ...) outs(%next)
+//     memref.dealloc %state
+//     scf.yield %next
+//   }
+// (and the scratch arena, which ignores the deallocations, grows with each
+// iteration). This pass makes the loop also carry a spare buffer, allocated
+// once before the loop. Each iteration computes the new value into the spare
+// buffer while reading the previous value, whose buffer becomes the spare
+// buffer of the next iteration:
+//   %spare = memref.alloc(%n) : memref<?xf32>
+//   %r:2 = scf.for %i = ... iter_args(%state = %init, %next = %spare) {
+//     linalg.generic ins(%state, ...) outs(%next)
+//     scf.yield %next, %state
+//   }
+//   memref.dealloc %r#1
+//
+// This requires that neither buffer escapes the iteration: they may only be
+// accessed in place (not through views, calls or other terminators), and the
+// new one must be allocated with loop-invariant sizes.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+
+#include "mlir/Dialect/Linalg/IR/LinalgOps.h"
+#include "mlir/Dialect/MemRef/IR/MemRef.h"
+#include "mlir/Dialect/SCF/SCF.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+// Returns true if `user` accesses `buffer` in place, without aliasing it.
+static bool accessesInPlace(Operation *user, Value buffer) {
+  if (isa<linalg::LinalgOp, memref::DimOp, memref::LoadOp>(user))
+    return true;
+  if (auto store = dyn_cast<memref::StoreOp>(user))
+    return store.value() != buffer;
+  return false;
+}
+
+// Returns true if the buffer carried in iteration argument `index` of `loop`
+// can be double buffered.
+static bool canDoubleBuffer(scf::ForOp loop, unsigned index) {
+  Block *body = loop.getBody();
+  auto yield = cast<scf::YieldOp>(body->getTerminator());
+  Value state = loop.getRegionIterArgs()[index];
+  Value next = yield.getOperand(index);
+  auto alloc = next.getDefiningOp<memref::AllocOp>();
+  if (!alloc || alloc->getBlock() != body ||
+      !llvm::all_of(alloc->getOperands(), [&](Value operand) {
+        return loop.isDefinedOutsideOfLoop(operand);
+      }))
+    return false;
+  if (llvm::count(yield.getOperands(), next) != 1 ||
+      llvm::is_contained(yield.getOperands(), state))
+    return false;
+
+  // The iteration frees the previous value, which is otherwise only accessed
+  // in place, like the new value.
+  int64_t numDeallocs = 0;
+  for (Operation *user : state.getUsers()) {
+    if (isa<memref::DeallocOp>(user) && user->getBlock() == body)
+      numDeallocs++;
+    else if (!accessesInPlace(user, state))
+      return false;
+  }
+  return numDeallocs == 1 &&
+         llvm::all_of(next.getUsers(), [&](Operation *user) {
+           return user == yield || accessesInPlace(user, next);
+         });
+}
+
+// Double buffers the iteration arguments `indices` of `loop`, which is
+// replaced by a loop with a spare buffer for each of them.
+static void doubleBuffer(scf::ForOp loop, ArrayRef<unsigned> indices) {
+  OpBuilder builder(loop);
+  Block *body = loop.getBody();
+  auto yield = cast<scf::YieldOp>(body->getTerminator());
+  SmallVector<Value, 4> iterOperands(loop.getIterOperands());
+  SmallVector<memref::AllocOp, 4> allocs;
+  for (unsigned index : indices) {
+    auto alloc = yield.getOperand(index).getDefiningOp<memref::AllocOp>();
+    iterOperands.push_back(builder.clone(*alloc)->getResult(0));
+    allocs.push_back(alloc);
+  }
+  auto newLoop = builder.create<scf::ForOp>(loop.getLoc(), loop.lowerBound(),
+                                            loop.upperBound(), loop.step(),
+                                            iterOperands);
+  Block *newBody = newLoop.getBody();
+  newBody->getOperations().splice(newBody->end(), body->getOperations());
+  for (auto args : llvm::zip(body->getArguments(), newBody->getArguments()))
+    std::get<0>(args).replaceAllUsesWith(std::get<1>(args));
+
+  // Compute the new values into the spare buffers, and yield the previous
+  // values as the next spare buffers.
+  unsigned numResults = loop.getNumResults();
+  SmallVector<Value, 4> previousValues;
+  for (auto it : llvm::enumerate(indices)) {
+    Value state = newLoop.getRegionIterArgs()[it.value()];
+    for (Operation *user : llvm::make_early_inc_range(state.getUsers()))
+      if (isa<memref::DeallocOp>(user))
+        user->erase();
+    allocs[it.index()].replaceAllUsesWith(
+        newLoop.getRegionIterArgs()[numResults + it.index()]);
+    allocs[it.index()].erase();
+    previousValues.push_back(state);
+  }
+  SmallVector<Value, 4> yieldedValues(yield.getOperands());
+  yieldedValues.append(previousValues.begin(), previousValues.end());
+  OpBuilder(yield).create<scf::YieldOp>(yield.getLoc(), yieldedValues);
+  yield.erase();
+
+  loop.replaceAllUsesWith(newLoop.getResults().take_front(numResults));
+  loop.erase();
+  builder.setInsertionPointAfter(newLoop);
+  for (Value spare : newLoop.getResults().drop_front(numResults))
+    builder.create<memref::DeallocOp>(newLoop.getLoc(), spare);
+}
+
+namespace {
+class ReuseLoopCarriedBuffers
+    : public ReuseLoopCarriedBuffersBase<ReuseLoopCarriedBuffers> {
+  void runOnOperation() override {
+    SmallVector<scf::ForOp, 8> loops;
+    getOperation().walk([&](scf::ForOp loop) { loops.push_back(loop); });
+    for (scf::ForOp loop : loops) {
+      SmallVector<unsigned, 4> indices;
+      for (unsigned i = 0, e = loop.getNumIterOperands(); i < e; i++)
+        if (canDoubleBuffer(loop, i))
+          indices.push_back(i);
+      if (!indices.empty())
+        doubleBuffer(loop, indices);
+    }
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createReuseLoopCarriedBuffersPass() {
+  return std::make_unique<ReuseLoopCarriedBuffers>();
+}
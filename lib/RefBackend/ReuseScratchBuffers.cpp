@@ -0,0 +1,331 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Packs statically shaped scratch buffers (allocations marked
+// `refbackrt.scratch` by LowerToRefbackrtABI) whose lifetimes don't overlap
+// into shared storage, and records the resulting peak scratch working set of
+// each function in the module metadata.
+//
+// Lifetimes are only tracked within a single block: a buffer is planned if its
+// allocation and all uses of it (and of its views) are in the same block, in
+// which case its live range is the span of ops from the allocation to the last
+// use. The planned buffers of each block are assigned offsets (greedily,
+// largest first), and are then all replaced by `memref.view`s into a single
+// `i8` workspace allocated at function entry. For functions whose scratch
+// buffers are all planned, that workspace is their only scratch allocation,
+// and its size is known at compile time.
+//
+// Dynamically shaped scratch buffers can't be given offsets, but the same
+// lifetime tracking lets a buffer reuse an earlier one of the same type whose
+// live range ended, when ShapeEquivalence proves that they have the same
+// shape.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+
+#include "mlir/Dialect/MemRef/IR/MemRef.h"
+#include "mlir/Dialect/StandardOps/IR/Ops.h"
+#include "mlir/Interfaces/CallInterfaces.h"
+#include "mlir/Interfaces/ViewLikeInterface.h"
+#include "npcomp/Dialect/Refbackrt/IR/RefbackrtOps.h"
+#include "npcomp/RefBackend/ShapeEquivalence.h"
+#include "llvm/Support/MathExtras.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+namespace {
+// A statically sized scratch buffer that can share storage with others.
+struct ScratchBuffer {
+  memref::AllocOp op;
+  // The size in bytes, rounded up to the alignment.
+  int64_t byteSize;
+  // The positions in the block of the allocation and of the last use.
+  int64_t begin;
+  int64_t end;
+  // The offset in the function's workspace.
+  int64_t offset = 0;
+};
+} // namespace
+
+// Returns the number of bytes of scratch memory that an allocation of `type`
+// takes, or None if `type` doesn't have a static size that memref.view can
+// carve out of an `i8` workspace.
+static Optional<int64_t> getStaticScratchSize(MemRefType type,
+                                              int64_t alignment) {
+  if (!type.hasStaticShape() || !type.getAffineMaps().empty())
+    return None;
+  Type elementType = type.getElementType();
+  if (!elementType.isIntOrFloat())
+    return None;
+  int64_t elementBytes =
+      llvm::divideCeil(elementType.getIntOrFloatBitWidth(), 8);
+  // Even empty buffers take up space in the scratch arena, so that they are
+  // distinct.
+  return llvm::alignTo(std::max<int64_t>(type.getNumElements() * elementBytes,
+                                         1),
+                       alignment);
+}
+
+// Returns the position in its block of the last op using `buffer` or a view
+// of it, or None if some use is outside that block.
+static Optional<int64_t>
+getLastUsePosition(Value buffer, Block *block,
+                   const DenseMap<Operation *, int64_t> &positions) {
+  int64_t lastUse = positions.lookup(buffer.getDefiningOp());
+  SmallVector<Value, 6> worklist;
+  worklist.push_back(buffer);
+  while (!worklist.empty()) {
+    Value value = worklist.pop_back_val();
+    for (Operation *user : value.getUsers()) {
+      Operation *ancestor = block->findAncestorOpInBlock(*user);
+      if (!ancestor)
+        return None;
+      lastUse = std::max(lastUse, positions.lookup(ancestor));
+      if (isa<memref::CastOp>(user) || isa<ViewLikeOpInterface>(user))
+        worklist.push_back(user->getResult(0));
+    }
+  }
+  return lastUse;
+}
+
+// Assigns offsets to `buffers` such that buffers with overlapping live ranges
+// don't overlap in memory, and returns the total size needed.
+//
+// This is the usual greedy heuristic: buffers are placed in order of
+// decreasing size, each at the lowest offset where it fits next to the
+// already placed buffers that are live at the same time.
+static int64_t assignOffsets(MutableArrayRef<ScratchBuffer> buffers) {
+  SmallVector<ScratchBuffer *, 8> order;
+  for (ScratchBuffer &buffer : buffers)
+    order.push_back(&buffer);
+  llvm::stable_sort(order, [](ScratchBuffer *lhs, ScratchBuffer *rhs) {
+    return lhs->byteSize > rhs->byteSize;
+  });
+
+  int64_t totalSize = 0;
+  SmallVector<ScratchBuffer *, 8> placed;
+  for (ScratchBuffer *buffer : order) {
+    SmallVector<ScratchBuffer *, 8> conflicts;
+    for (ScratchBuffer *other : placed)
+      if (other->begin <= buffer->end && buffer->begin <= other->end)
+        conflicts.push_back(other);
+    llvm::sort(conflicts, [](ScratchBuffer *lhs, ScratchBuffer *rhs) {
+      return lhs->offset < rhs->offset;
+    });
+    int64_t offset = 0;
+    for (ScratchBuffer *other : conflicts) {
+      if (offset + buffer->byteSize <= other->offset)
+        break;
+      offset = std::max(offset, other->offset + other->byteSize);
+    }
+    buffer->offset = offset;
+    totalSize = std::max(totalSize, offset + buffer->byteSize);
+    placed.push_back(buffer);
+  }
+  return totalSize;
+}
+
+// Returns true if `block` can be executed more than once per invocation.
+static bool isInCycle(Block *block) {
+  SmallVector<Block *, 8> worklist(block->getSuccessors().begin(),
+                                   block->getSuccessors().end());
+  SmallPtrSet<Block *, 8> visited;
+  while (!worklist.empty()) {
+    Block *current = worklist.pop_back_val();
+    if (current == block)
+      return true;
+    if (!visited.insert(current).second)
+      continue;
+    worklist.append(current->getSuccessors().begin(),
+                    current->getSuccessors().end());
+  }
+  return false;
+}
+
+static bool isScratchAllocation(memref::AllocOp op) {
+  return op->hasAttr("refbackrt.scratch");
+}
+
+namespace {
+// The scratch allocations of a block.
+struct BlockScratchBuffers {
+  // Buffers that are only used within the block, with assigned offsets.
+  SmallVector<ScratchBuffer, 8> planned;
+  // The number of bytes the planned buffers need.
+  int64_t plannedSize = 0;
+  // The number of bytes of statically sized buffers that escape the block,
+  // and so are left to the scratch arena.
+  int64_t unplannedSize = 0;
+  // Whether some buffer isn't statically sized.
+  bool hasDynamicSize = false;
+};
+} // namespace
+
+// Replaces the dynamically shaped scratch buffers `buffers` of a block, in
+// program order, by earlier ones of the same shape that are dead by then.
+// Scratch buffers are only freed at the end of the invocation, so each
+// replaced buffer is memory saved.
+static void reuseDynamicBuffers(MutableArrayRef<ScratchBuffer> buffers,
+                                ShapeEquivalence &shapes) {
+  SmallVector<ScratchBuffer *, 8> kept;
+  for (ScratchBuffer &buffer : buffers) {
+    auto reused = llvm::find_if(kept, [&](ScratchBuffer *other) {
+      return other->end < buffer.begin &&
+             other->op.getType() == buffer.op.getType() &&
+             shapes.haveSameShape(other->op, buffer.op);
+    });
+    if (reused == kept.end()) {
+      kept.push_back(&buffer);
+      continue;
+    }
+    buffer.op.replaceAllUsesWith((*reused)->op.getResult());
+    buffer.op.erase();
+    (*reused)->end = buffer.end;
+  }
+}
+
+// Collects the scratch buffers of `block`, and plans the layout of those whose
+// live range is confined to it.
+static BlockScratchBuffers planBlock(Block &block, int64_t alignment,
+                                     ShapeEquivalence &shapes) {
+  DenseMap<Operation *, int64_t> positions;
+  for (auto opAndIndex : llvm::enumerate(block))
+    positions[&opAndIndex.value()] = opAndIndex.index();
+
+  BlockScratchBuffers result;
+  SmallVector<ScratchBuffer, 4> dynamicBuffers;
+  for (auto op : block.getOps<memref::AllocOp>()) {
+    if (!isScratchAllocation(op))
+      continue;
+    auto byteSize = getStaticScratchSize(op.getType(), alignment);
+    if (!byteSize) {
+      result.hasDynamicSize = true;
+      if (auto lastUse = getLastUsePosition(op.getResult(), &block, positions))
+        dynamicBuffers.push_back({op, 0, positions[op], *lastUse});
+      continue;
+    }
+    auto lastUse = getLastUsePosition(op.getResult(), &block, positions);
+    if (!lastUse) {
+      result.unplannedSize += *byteSize;
+      continue;
+    }
+    result.planned.push_back({op, *byteSize, positions[op], *lastUse});
+  }
+  result.plannedSize = assignOffsets(result.planned);
+  reuseDynamicBuffers(dynamicBuffers, shapes);
+  return result;
+}
+
+// Places the planned scratch buffers of `func` in a single workspace allocated
+// on entry, and returns the function's peak scratch working set in bytes, or
+// None if that isn't statically known.
+//
+// Since every planned buffer is dead by the time control leaves its block,
+// the buffers of different blocks (and of different executions of the same
+// block) can all use the same storage, so the workspace only needs to be as
+// large as the largest block's layout. When every scratch buffer is planned,
+// the whole working set is this one allocation.
+static Optional<int64_t> reuseScratchBuffers(FuncOp func, int64_t alignment) {
+  bool isBounded = true;
+  // Scratch buffers of callees (including the bodies of parallel loops), and
+  // of nested regions, aren't accounted for.
+  func.walk([&](Operation *op) {
+    if (isa<CallOpInterface, refbackrt::ParallelForOp>(op))
+      isBounded = false;
+    if (auto alloc = dyn_cast<memref::AllocOp>(op))
+      if (isScratchAllocation(alloc) &&
+          op->getParentOp() != func.getOperation())
+        isBounded = false;
+  });
+
+  ShapeEquivalence shapes(func);
+  SmallVector<BlockScratchBuffers, 4> blocks;
+  int64_t workspaceSize = 0;
+  int64_t numPlanned = 0;
+  bool hasPlannedInCycle = false;
+  int64_t unplannedSize = 0;
+  for (Block &block : func.getBody()) {
+    blocks.push_back(planBlock(block, alignment, shapes));
+    BlockScratchBuffers &buffers = blocks.back();
+    workspaceSize = std::max(workspaceSize, buffers.plannedSize);
+    numPlanned += buffers.planned.size();
+    bool inCycle = isInCycle(&block);
+    if (!buffers.planned.empty() && inCycle)
+      hasPlannedInCycle = true;
+    if (buffers.hasDynamicSize || (buffers.unplannedSize != 0 && inCycle))
+      isBounded = false;
+    unplannedSize += buffers.unplannedSize;
+  }
+
+  // A lone buffer gains nothing from being turned into a view, unless it is
+  // allocated in a loop, where each iteration would otherwise take a new one
+  // from the scratch arena.
+  if (numPlanned > 1 || hasPlannedInCycle) {
+    Block &entryBlock = func.getBody().front();
+    auto builder = OpBuilder::atBlockBegin(&entryBlock);
+    auto workspaceType =
+        MemRefType::get({workspaceSize}, builder.getIntegerType(8));
+    auto workspace =
+        builder.create<memref::AllocOp>(func.getLoc(), workspaceType);
+    workspace->setAttr("refbackrt.scratch", builder.getUnitAttr());
+    for (BlockScratchBuffers &buffers : blocks) {
+      for (ScratchBuffer &buffer : buffers.planned) {
+        builder.setInsertionPoint(buffer.op);
+        Value offset =
+            builder.create<ConstantIndexOp>(buffer.op.getLoc(), buffer.offset);
+        auto view = builder.create<memref::ViewOp>(
+            buffer.op.getLoc(), buffer.op.getType(), workspace, offset,
+            /*sizes=*/ValueRange());
+        buffer.op.replaceAllUsesWith(view.getResult());
+        buffer.op.erase();
+      }
+    }
+  }
+
+  if (!isBounded)
+    return None;
+  return workspaceSize + unplannedSize;
+}
+
+namespace {
+class ReuseScratchBuffers
+    : public ReuseScratchBuffersBase<ReuseScratchBuffers> {
+  void runOnOperation() override {
+    ModuleOp module = getOperation();
+    if (alignment == 0 || !llvm::isPowerOf2_32(alignment)) {
+      module.emitError() << "alignment must be a power of two";
+      return signalPassFailure();
+    }
+
+    llvm::StringMap<int64_t> peakScratchBytes;
+    for (auto func : module.getOps<FuncOp>()) {
+      if (func.isExternal())
+        continue;
+      if (auto size = reuseScratchBuffers(func, alignment))
+        peakScratchBytes[func.getName()] = *size;
+    }
+
+    module.walk([&](refbackrt::FuncMetadataOp funcMetadata) {
+      auto it = peakScratchBytes.find(funcMetadata.funcName());
+      if (it == peakScratchBytes.end())
+        return;
+      Builder builder(funcMetadata.getContext());
+      funcMetadata->setAttr("peakScratchBytes",
+                            builder.getI64IntegerAttr(it->second));
+    });
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<ModuleOp>>
+mlir::NPCOMP::createReuseScratchBuffersPass() {
+  return std::make_unique<ReuseScratchBuffers>();
+}
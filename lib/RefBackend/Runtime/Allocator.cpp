@@ -0,0 +1,453 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// The default refbackrt allocator: a thread-caching, size-class pool.
+//
+// Requests are rounded up to a power-of-two size class. Freed blocks are kept
+// on a small per-thread free list for their size class, which satisfies the
+// common steady-state pattern of "allocate the same shapes every invocation"
+// without touching any shared state. Blocks that don't fit in the thread
+// cache spill into a mutex-protected central free list, and only then go back
+// to std::malloc/std::free.
+//
+// On NUMA machines, each node has its own central free lists. A block belongs
+// to the node of the thread that malloc'ed (and so first touched) it, and
+// only goes back to the free lists of that node, so that threads keep getting
+// memory local to their node.
+//
+// Blocks of at least kHugePageSize bytes come from allocateHugePages instead
+// of std::malloc when huge pages are enabled (see setHugePages).
+//
+// All returned buffers are aligned to kBufferAlignment.
+//
+//===----------------------------------------------------------------------===//
+
+#include "npcomp/RefBackend/Runtime/UserAPI.h"
+
+#include "Instrumentation.h"
+#include "Numa.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace refbackrt;
+
+namespace {
+// The smallest and largest pooled size classes, as powers of two.
+// Requests larger than the largest class are passed straight to std::malloc.
+constexpr int kMinSizeClassLog2 = 6;
+constexpr int kMaxSizeClassLog2 = 28;
+constexpr int kNumSizeClasses = kMaxSizeClassLog2 - kMinSizeClassLog2 + 1;
+constexpr std::uint32_t kLargeSizeClass = kNumSizeClasses;
+
+// Upper bounds on the number of bytes held on free lists, to keep memory from
+// being retained indefinitely by a burst of allocations.
+constexpr std::size_t kMaxThreadCacheBytes = std::size_t(64) << 20;
+constexpr std::size_t kMaxCentralCacheBytes = std::size_t(256) << 20;
+
+// Each block is immediately preceded by a header recording its size class, so
+// that deallocation doesn't need to be told the size. The user-visible pointer
+// is aligned to kBufferAlignment, so the header sits somewhere in the padding
+// between the start of the malloc'ed allocation and that pointer.
+struct BlockHeader {
+  // The pointer returned by std::malloc or allocateHugePages.
+  void *rawPtr;
+  std::uint32_t sizeClass;
+  // The NUMA node (see detail::getCurrentNumaNode) the block was allocated on.
+  std::uint32_t numaNode;
+  // The number of bytes requested by the user, for the live-bytes stats.
+  std::uint64_t requestedSize;
+  // The size passed to allocateHugePages, or 0 if `rawPtr` came from
+  // std::malloc.
+  std::uint64_t hugePagesSize;
+};
+static_assert((kBufferAlignment & (kBufferAlignment - 1)) == 0,
+              "buffer alignment must be a power of two");
+static_assert(kBufferAlignment >= alignof(BlockHeader),
+              "buffer alignment must be at least the header alignment");
+// The amount of extra space we malloc to fit the header and alignment padding.
+constexpr std::size_t kOverheadSize = sizeof(BlockHeader) + kBufferAlignment;
+
+// While on a free list, the user-visible part of a block holds the next
+// pointer.
+struct FreeBlock {
+  FreeBlock *next;
+};
+
+std::size_t getSizeClassByteSize(std::uint32_t sizeClass) {
+  return std::size_t(1) << (sizeClass + kMinSizeClassLog2);
+}
+
+std::uint32_t getSizeClass(std::size_t size) {
+  int log2 = kMinSizeClassLog2;
+  while ((std::size_t(1) << log2) < size) {
+    if (++log2 > kMaxSizeClassLog2)
+      return kLargeSizeClass;
+  }
+  return log2 - kMinSizeClassLog2;
+}
+
+BlockHeader *getHeader(void *ptr) {
+  return reinterpret_cast<BlockHeader *>(static_cast<char *>(ptr) -
+                                         sizeof(BlockHeader));
+}
+
+// Carves an aligned user pointer (with a header in front of it) out of the
+// allocation `rawPtr`, which must be at least kOverheadSize bytes larger than
+// the block size.
+void *initializeBlock(void *rawPtr, std::uint32_t sizeClass) {
+  auto firstUsable =
+      reinterpret_cast<std::uintptr_t>(rawPtr) + sizeof(BlockHeader);
+  auto aligned = (firstUsable + kBufferAlignment - 1) & ~(kBufferAlignment - 1);
+  void *ptr = reinterpret_cast<void *>(aligned);
+  BlockHeader *header = getHeader(ptr);
+  header->rawPtr = rawPtr;
+  header->sizeClass = sizeClass;
+  return ptr;
+}
+
+struct FreeList {
+  FreeBlock *head = nullptr;
+  std::size_t numBlocks = 0;
+
+  void push(void *ptr) {
+    auto *block = static_cast<FreeBlock *>(ptr);
+    block->next = head;
+    head = block;
+    numBlocks++;
+  }
+  void *pop() {
+    if (!head)
+      return nullptr;
+    FreeBlock *block = head;
+    head = block->next;
+    numBlocks--;
+    return block;
+  }
+};
+
+// Free lists shared by all threads.
+class CentralCache {
+public:
+  void *pop(std::uint32_t sizeClass) {
+    std::lock_guard<std::mutex> lock(mutex);
+    void *ptr = freeLists[sizeClass].pop();
+    if (ptr)
+      cachedBytes -= getSizeClassByteSize(sizeClass);
+    return ptr;
+  }
+  // Returns false if the cache is full, in which case the caller retains
+  // ownership of `ptr`.
+  bool push(std::uint32_t sizeClass, void *ptr) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto byteSize = getSizeClassByteSize(sizeClass);
+    if (cachedBytes + byteSize > kMaxCentralCacheBytes)
+      return false;
+    freeLists[sizeClass].push(ptr);
+    cachedBytes += byteSize;
+    return true;
+  }
+
+private:
+  std::mutex mutex;
+  FreeList freeLists[kNumSizeClasses];
+  std::size_t cachedBytes = 0;
+};
+
+CentralCache &getCentralCache(std::uint32_t numaNode) {
+  // Intentionally leaked so that they outlive the thread caches of threads
+  // that exit during static destruction.
+  static CentralCache *caches = new CentralCache[detail::kMaxNumaNodes];
+  return caches[numaNode];
+}
+
+void releaseBlock(void *ptr) {
+  BlockHeader *header = getHeader(ptr);
+  if (header->hugePagesSize)
+    deallocateHugePages(header->rawPtr, header->hugePagesSize);
+  else
+    std::free(header->rawPtr);
+}
+
+// Set once the thread cache of the thread is destroyed. Frees made later
+// during thread exit (such as by the destructors of other thread_locals) go
+// to the central caches. This is trivially destructible, so it is valid until
+// the thread is gone.
+thread_local bool threadCacheDestroyed = false;
+
+// Free lists private to a single thread.
+class ThreadCache {
+public:
+  ~ThreadCache() {
+    threadCacheDestroyed = true;
+    // Hand our blocks to the central caches so other threads can reuse them.
+    for (std::uint32_t sizeClass = 0; sizeClass < kNumSizeClasses;
+         sizeClass++) {
+      while (void *ptr = freeLists[sizeClass].pop()) {
+        if (!getCentralCache(getHeader(ptr)->numaNode).push(sizeClass, ptr))
+          releaseBlock(ptr);
+      }
+    }
+  }
+  void *pop(std::uint32_t sizeClass) {
+    void *ptr = freeLists[sizeClass].pop();
+    if (ptr)
+      cachedBytes -= getSizeClassByteSize(sizeClass);
+    return ptr;
+  }
+  bool push(std::uint32_t sizeClass, void *ptr) {
+    auto byteSize = getSizeClassByteSize(sizeClass);
+    if (cachedBytes + byteSize > kMaxThreadCacheBytes)
+      return false;
+    freeLists[sizeClass].push(ptr);
+    cachedBytes += byteSize;
+    return true;
+  }
+
+private:
+  FreeList freeLists[kNumSizeClasses];
+  std::size_t cachedBytes = 0;
+};
+
+// Returns the thread cache of the thread, or null if it was destroyed.
+ThreadCache *getThreadCache() {
+  if (threadCacheDestroyed)
+    return nullptr;
+  thread_local ThreadCache cache;
+  return &cache;
+}
+
+class PoolAllocator : public Allocator {
+public:
+  void *allocate(std::size_t size) override {
+    std::uint32_t sizeClass = getSizeClass(size);
+    std::uint32_t numaNode = detail::getCurrentNumaNode();
+    void *ptr = nullptr;
+    if (sizeClass != kLargeSizeClass) {
+      if (ThreadCache *threadCache = getThreadCache())
+        ptr = threadCache->pop(sizeClass);
+      if (!ptr)
+        ptr = getCentralCache(numaNode).pop(sizeClass);
+    }
+    numAllocations++;
+    if (ptr) {
+      numPoolHits++;
+    } else {
+      auto blockSize = sizeClass == kLargeSizeClass
+                           ? size
+                           : getSizeClassByteSize(sizeClass);
+      std::size_t rawSize = kOverheadSize + blockSize;
+      std::size_t hugePagesSize = 0;
+      void *rawPtr = nullptr;
+      if (blockSize >= kHugePageSize && getHugePages() != HugePages::None) {
+        rawPtr = allocateHugePages(rawSize);
+        if (rawPtr)
+          hugePagesSize = rawSize;
+      }
+      if (!rawPtr)
+        rawPtr = std::malloc(rawSize);
+      if (!rawPtr)
+        return nullptr;
+      ptr = initializeBlock(rawPtr, sizeClass);
+      getHeader(ptr)->numaNode = numaNode;
+      getHeader(ptr)->hugePagesSize = hugePagesSize;
+    }
+    getHeader(ptr)->requestedSize = size;
+    recordAllocation(size);
+    return ptr;
+  }
+
+  void deallocate(void *ptr) override {
+    if (!ptr)
+      return;
+    BlockHeader *header = getHeader(ptr);
+    bytesLive -= header->requestedSize;
+    std::uint32_t sizeClass = header->sizeClass;
+    if (sizeClass != kLargeSizeClass) {
+      // Blocks of other nodes skip the thread cache, so that they go back to
+      // threads of their node.
+      ThreadCache *threadCache = getThreadCache();
+      if (threadCache &&
+          header->numaNode ==
+              static_cast<std::uint32_t>(detail::getCurrentNumaNode()) &&
+          threadCache->push(sizeClass, ptr))
+        return;
+      if (getCentralCache(header->numaNode).push(sizeClass, ptr))
+        return;
+    }
+    releaseBlock(ptr);
+  }
+
+  AllocatorStats getStats() const override {
+    AllocatorStats stats;
+    stats.bytesLive = bytesLive;
+    stats.peakBytesLive = peakBytesLive;
+    stats.numAllocations = numAllocations;
+    stats.numPoolHits = numPoolHits;
+    return stats;
+  }
+
+private:
+  void recordAllocation(std::size_t size) {
+    std::int64_t live = bytesLive.fetch_add(size) + size;
+    std::int64_t peak = peakBytesLive.load();
+    while (live > peak && !peakBytesLive.compare_exchange_weak(peak, live)) {
+    }
+  }
+
+  std::atomic<std::int64_t> bytesLive{0};
+  std::atomic<std::int64_t> peakBytesLive{0};
+  std::atomic<std::int64_t> numAllocations{0};
+  std::atomic<std::int64_t> numPoolHits{0};
+};
+} // namespace
+
+AllocatorStats Allocator::getStats() const { return AllocatorStats(); }
+
+Allocator *refbackrt::getDefaultAllocator() {
+  // Intentionally leaked, since buffers can be freed during static
+  // destruction.
+  static PoolAllocator *allocator = new PoolAllocator;
+  return allocator;
+}
+
+static std::atomic<Allocator *> currentAllocator{nullptr};
+
+Allocator *refbackrt::getAllocator() {
+  Allocator *allocator = currentAllocator.load(std::memory_order_acquire);
+  return allocator ? allocator : getDefaultAllocator();
+}
+
+void refbackrt::setAllocator(Allocator *allocator) {
+  currentAllocator.store(allocator, std::memory_order_release);
+}
+
+void *refbackrt::allocate(std::size_t size) {
+  void *ptr = getAllocator()->allocate(size);
+  if (ptr && detail::memoryProfilingEnabled.load(std::memory_order_relaxed))
+    detail::recordAllocation(ptr, size);
+  return ptr;
+}
+
+void refbackrt::deallocate(void *ptr) {
+  if (!ptr)
+    return;
+  if (detail::memoryProfilingEnabled.load(std::memory_order_relaxed))
+    detail::recordDeallocation(ptr);
+  getAllocator()->deallocate(ptr);
+}
+
+AllocatorStats refbackrt::getAllocatorStats() {
+  return getAllocator()->getStats();
+}
+
+//===----------------------------------------------------------------------===//
+// Huge pages.
+//===----------------------------------------------------------------------===//
+
+static HugePages getDefaultHugePages() {
+  if (const char *env = std::getenv("REFBACKRT_HUGE_PAGES")) {
+    if (std::strcmp(env, "transparent") == 0)
+      return HugePages::Transparent;
+    if (std::strcmp(env, "explicit") == 0)
+      return HugePages::Explicit;
+  }
+  return HugePages::None;
+}
+
+static std::atomic<HugePages> currentHugePages{getDefaultHugePages()};
+
+void refbackrt::setHugePages(HugePages hugePages) {
+  currentHugePages.store(hugePages, std::memory_order_relaxed);
+}
+
+HugePages refbackrt::getHugePages() {
+  return currentHugePages.load(std::memory_order_relaxed);
+}
+
+static std::size_t roundUpToHugePages(std::size_t size) {
+  return (size + kHugePageSize - 1) & ~(kHugePageSize - 1);
+}
+
+#ifndef _WIN32
+// Maps `size` bytes (a multiple of kHugePageSize) of regular pages aligned to
+// kHugePageSize, which the kernel can back with transparent huge pages.
+static void *mapAlignedPages(std::size_t size) {
+  std::size_t mappedSize = size + kHugePageSize;
+  void *mapped = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapped == MAP_FAILED)
+    return nullptr;
+  // Trim the unaligned head and the tail.
+  auto begin = reinterpret_cast<std::uintptr_t>(mapped);
+  auto aligned = (begin + kHugePageSize - 1) & ~(kHugePageSize - 1);
+  if (aligned != begin)
+    munmap(mapped, aligned - begin);
+  std::size_t tailSize = begin + mappedSize - (aligned + size);
+  if (tailSize)
+    munmap(reinterpret_cast<void *>(aligned + size), tailSize);
+  return reinterpret_cast<void *>(aligned);
+}
+#endif
+
+void *refbackrt::allocateHugePages(std::size_t size) {
+  std::size_t mappedSize = roundUpToHugePages(std::max<std::size_t>(size, 1));
+#ifdef _WIN32
+  return _aligned_malloc(mappedSize, kHugePageSize);
+#else
+  HugePages hugePages = getHugePages();
+#ifdef MAP_HUGETLB
+  if (hugePages == HugePages::Explicit) {
+    void *ptr = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (ptr != MAP_FAILED)
+      return ptr;
+  }
+#endif
+  void *ptr = mapAlignedPages(mappedSize);
+#ifdef MADV_HUGEPAGE
+  if (ptr && hugePages != HugePages::None)
+    madvise(ptr, mappedSize, MADV_HUGEPAGE);
+#endif
+  return ptr;
+#endif
+}
+
+void refbackrt::deallocateHugePages(void *ptr, std::size_t size) {
+  if (!ptr)
+    return;
+#ifdef _WIN32
+  _aligned_free(ptr);
+#else
+  munmap(ptr, roundUpToHugePages(std::max<std::size_t>(size, 1)));
+#endif
+}
+
+void refbackrt::prefetchPages(const void *ptr, std::size_t size) {
+#ifndef _WIN32
+  if (!ptr || !size)
+    return;
+  // madvise requires a page-aligned address.
+  static const std::uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+  auto begin = reinterpret_cast<std::uintptr_t>(ptr) & ~(pageSize - 1);
+  auto end = reinterpret_cast<std::uintptr_t>(ptr) + size;
+  madvise(reinterpret_cast<void *>(begin), end - begin, MADV_WILLNEED);
+#endif
+}
@@ -0,0 +1,518 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Microbenchmarks of the refbackrt primitives that every call goes through:
+// creating Tensor's, copying and moving Ref's, constructing RtValue's, looking
+// up functions, and invoking trivial kernels across arities and ranks.
+//
+// The kernels are written by hand against the ABI of the compiled code (see
+// CompilerDataStructures.h) and do no work, so that the invoke benchmarks
+// measure the overhead of the ABI boundary alone.
+//
+// Like the runtime, this has no dependencies on compiler code, so the harness
+// is a minimal one in the style of Google Benchmark: each benchmark runs its
+// body for an increasing number of iterations until it runs for at least
+// --min-time seconds, and reports the time per iteration.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CompilerDataStructures.h"
+#include "npcomp/RefBackend/Runtime/UserAPI.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace refbackrt;
+
+//===----------------------------------------------------------------------===//
+// Harness.
+//===----------------------------------------------------------------------===//
+
+// Keeps the compiler from optimizing away the computation of `value`.
+template <typename T> static void doNotOptimize(T &value) {
+#if defined(__GNUC__) || defined(__clang__)
+  asm volatile("" : : "r"(&value) : "memory");
+#else
+  static volatile void *sink;
+  sink = &value;
+#endif
+}
+
+namespace {
+// A benchmark runs its body `iterations` times.
+struct Benchmark {
+  std::string name;
+  std::function<void(std::int64_t iterations)> body;
+};
+
+struct BenchmarkResult {
+  std::int64_t iterations;
+  double nanosPerIteration;
+};
+} // namespace
+
+static std::vector<Benchmark> &getBenchmarks() {
+  static std::vector<Benchmark> benchmarks;
+  return benchmarks;
+}
+
+static void addBenchmark(std::string name,
+                         std::function<void(std::int64_t)> body) {
+  getBenchmarks().push_back({std::move(name), std::move(body)});
+}
+
+static BenchmarkResult runBenchmark(const Benchmark &benchmark,
+                                    double minSeconds) {
+  using Clock = std::chrono::steady_clock;
+  // One untimed iteration warms up the caches and the allocator.
+  benchmark.body(1);
+  std::int64_t iterations = 1;
+  for (;;) {
+    Clock::time_point start = Clock::now();
+    benchmark.body(iterations);
+    double seconds =
+        std::chrono::duration<double>(Clock::now() - start).count();
+    constexpr std::int64_t kMaxIterations = 1000000000;
+    if (seconds >= minSeconds || iterations >= kMaxIterations)
+      return {iterations, seconds * 1e9 / iterations};
+    // Aim past the minimum time, growing by at most 10x per step when the
+    // last run was too short to extrapolate from.
+    double scale = seconds * 10 < minSeconds ? 10 : minSeconds * 1.4 / seconds;
+    iterations = std::min<std::int64_t>(
+        kMaxIterations,
+        std::max<std::int64_t>(iterations + 1, iterations * scale));
+  }
+}
+
+//===----------------------------------------------------------------------===//
+// Kernels.
+//===----------------------------------------------------------------------===//
+
+namespace {
+// The memref descriptors of the compiled code (see Runtime.cpp), with the
+// sizes and then the strides following the fixed fields.
+struct MemrefDescriptor {
+  void *allocatedPtr;
+  void *dataPtr;
+  std::int64_t offset;
+};
+struct UnrankedMemref {
+  std::int64_t rank;
+  MemrefDescriptor *descriptor;
+};
+} // namespace
+
+// Takes any number of tensors, and returns an i64.
+static void sinkKernel(void **inputs, void **outputs, const char **) {
+  *static_cast<std::int64_t *>(outputs[0]) =
+      *static_cast<std::int64_t *>(inputs[0]);
+}
+
+// Takes two i64's, and returns their sum. Each input takes two slots of
+// `inputs`, of which scalars only use the first.
+static void addI64Kernel(void **inputs, void **outputs, const char **) {
+  *static_cast<std::int64_t *>(outputs[0]) =
+      *static_cast<std::int64_t *>(inputs[0]) +
+      *static_cast<std::int64_t *>(inputs[2]);
+}
+
+// Takes a f32 tensor, and returns a new, uninitialized f32 tensor of the same
+// shape.
+static void freshKernel(void **inputs, void **outputs, const char **) {
+  auto rank = *static_cast<std::int64_t *>(inputs[0]);
+  auto *input = *static_cast<MemrefDescriptor **>(inputs[1]);
+  auto *inputSizes = reinterpret_cast<std::int64_t *>(input + 1);
+  auto *output = static_cast<MemrefDescriptor *>(
+      allocate(sizeof(MemrefDescriptor) + sizeof(std::int64_t) * 2 * rank));
+  auto *outputSizes = reinterpret_cast<std::int64_t *>(output + 1);
+  std::int64_t numElements = 1;
+  for (std::int64_t i = rank - 1; i >= 0; i--) {
+    outputSizes[i] = inputSizes[i];
+    outputSizes[rank + i] = numElements;
+    numElements *= inputSizes[i];
+  }
+  output->allocatedPtr = allocate(numElements * sizeof(float));
+  output->dataPtr = output->allocatedPtr;
+  output->offset = 0;
+  *static_cast<UnrankedMemref *>(outputs[0]) = {rank, output};
+}
+
+//===----------------------------------------------------------------------===//
+// Modules.
+//===----------------------------------------------------------------------===//
+
+namespace {
+// A module of hand-written kernels, with the descriptors that the compiler
+// would emit for them.
+class KernelModule {
+public:
+  // Adds a function taking `numTensorInputs` f32 tensors of rank `rank`
+  // (read-only, so passed without copying) and `numScalarInputs` i64's.
+  // Memref outputs are new buffers of rank `rank`.
+  void addFunction(std::string name, ABIFunc *kernel,
+                   std::int32_t numTensorInputs, std::int32_t numScalarInputs,
+                   std::int32_t rank, bool returnsTensor) {
+    Function function;
+    function.name = std::move(name);
+    function.kernel = kernel;
+    function.extents.assign(rank, -1);
+    for (std::int32_t i = 0; i < numTensorInputs; i++)
+      function.inputs.push_back({ABIArgType::kMemref, ABIElementType::kF32,
+                                 rank, nullptr, /*isReadOnly=*/1});
+    for (std::int32_t i = 0; i < numScalarInputs; i++)
+      function.inputs.push_back(
+          {ABIArgType::kI64, ABIElementType::kNone, 0, nullptr, 0});
+    if (returnsTensor)
+      function.outputs.push_back({ABIArgType::kMemref, ABIElementType::kF32,
+                                  rank, nullptr, ABIOutputOwnership::kOwned,
+                                  0});
+    else
+      function.outputs.push_back({ABIArgType::kI64, ABIElementType::kNone, 0,
+                                  nullptr, ABIOutputOwnership::kUnknown, 0});
+    functions.push_back(std::move(function));
+  }
+
+  // Builds the module descriptor, after which no function can be added.
+  ModuleDescriptor *getDescriptor() {
+    std::sort(functions.begin(), functions.end(),
+              [](const Function &lhs, const Function &rhs) {
+                return StringRef(lhs.name.data(), lhs.name.size())
+                           .compare(
+                               StringRef(rhs.name.data(), rhs.name.size())) <
+                       0;
+              });
+    funcDescriptors.clear();
+    for (Function &function : functions) {
+      for (InputDescriptor &input : function.inputs)
+        input.extents = function.extents.data();
+      for (OutputDescriptor &output : function.outputs)
+        output.extents = function.extents.data();
+      funcDescriptors.push_back(
+          {static_cast<std::int32_t>(function.name.size()),
+           function.name.data(), function.kernel,
+           static_cast<std::int32_t>(function.inputs.size()),
+           static_cast<std::int32_t>(function.outputs.size()),
+           function.inputs.data(), function.outputs.data(),
+           /*peakScratchBytes=*/0, /*directFunctionPtr=*/nullptr,
+           /*constantBytes=*/0, /*inputBytes=*/-1, /*outputBytes=*/-1,
+           /*interpretedFunction=*/nullptr});
+    }
+    descriptor.numFuncDescriptors = funcDescriptors.size();
+    descriptor.functionDescriptors = funcDescriptors.data();
+    return &descriptor;
+  }
+
+private:
+  struct Function {
+    std::string name;
+    ABIFunc *kernel;
+    std::vector<std::int64_t> extents;
+    std::vector<InputDescriptor> inputs;
+    std::vector<OutputDescriptor> outputs;
+  };
+  std::vector<Function> functions;
+  std::vector<FuncDescriptor> funcDescriptors;
+  ModuleDescriptor descriptor;
+};
+} // namespace
+
+// Returns a new module, which lives as long as the benchmarks.
+static KernelModule *createModule() {
+  static std::vector<std::unique_ptr<KernelModule>> modules;
+  modules.push_back(std::make_unique<KernelModule>());
+  return modules.back().get();
+}
+
+//===----------------------------------------------------------------------===//
+// Benchmarks.
+//===----------------------------------------------------------------------===//
+
+static const std::int32_t kRanks[] = {0, 1, 4};
+static const std::int32_t kArities[] = {1, 4, 16};
+
+// Returns a tensor of rank `rank` with all extents 2.
+static Ref<Tensor> createTensor(std::int32_t rank) {
+  std::array<std::int64_t, 4> extents = {2, 2, 2, 2};
+  std::array<float, 16> data = {};
+  return Tensor::create(ArrayRef<std::int64_t>(extents.data(), rank),
+                        ElementType::F32, data.data());
+}
+
+static std::string getName(const char *base, const char *key,
+                           std::int32_t value) {
+  return std::string(base) + "/" + key + ":" + std::to_string(value);
+}
+
+static void addDataStructureBenchmarks() {
+  for (std::int32_t rank : kRanks) {
+    addBenchmark(getName("Tensor::create", "rank", rank),
+                 [rank](std::int64_t iterations) {
+                   for (std::int64_t i = 0; i < iterations; i++) {
+                     Ref<Tensor> tensor = createTensor(rank);
+                     doNotOptimize(tensor);
+                   }
+                 });
+  }
+  // Below and above Tensor::kMaxInlineDataBytes.
+  for (std::int32_t numBytes : {4096, 65536}) {
+    addBenchmark(getName("Tensor::create", "bytes", numBytes),
+                 [numBytes](std::int64_t iterations) {
+                   std::int64_t extent = numBytes / sizeof(float);
+                   std::vector<float> data(extent);
+                   for (std::int64_t i = 0; i < iterations; i++) {
+                     Ref<Tensor> tensor = Tensor::create(
+                         ArrayRef<std::int64_t>(&extent, 1), ElementType::F32,
+                         data.data());
+                     doNotOptimize(tensor);
+                   }
+                 });
+  }
+  addBenchmark("Ref<Tensor>/copy", [](std::int64_t iterations) {
+    Ref<Tensor> tensor = createTensor(1);
+    for (std::int64_t i = 0; i < iterations; i++) {
+      Ref<Tensor> copy = tensor;
+      doNotOptimize(copy);
+    }
+  });
+  addBenchmark("Ref<Tensor>/move", [](std::int64_t iterations) {
+    Ref<Tensor> tensor = createTensor(1);
+    for (std::int64_t i = 0; i < iterations; i++) {
+      Ref<Tensor> moved = std::move(tensor);
+      doNotOptimize(moved);
+      tensor = std::move(moved);
+    }
+  });
+  addBenchmark("RtValue/tensor", [](std::int64_t iterations) {
+    Ref<Tensor> tensor = createTensor(1);
+    for (std::int64_t i = 0; i < iterations; i++) {
+      RtValue value(tensor);
+      doNotOptimize(value);
+    }
+  });
+  addBenchmark("RtValue/toTensor", [](std::int64_t iterations) {
+    RtValue value(createTensor(1));
+    for (std::int64_t i = 0; i < iterations; i++) {
+      Ref<Tensor> tensor = value.toTensor();
+      doNotOptimize(tensor);
+    }
+  });
+  addBenchmark("RtValue/getTensor", [](std::int64_t iterations) {
+    RtValue value(createTensor(1));
+    for (std::int64_t i = 0; i < iterations; i++) {
+      Tensor *tensor = value.getTensor();
+      doNotOptimize(tensor);
+    }
+  });
+  addBenchmark("RtValue/int", [](std::int64_t iterations) {
+    for (std::int64_t i = 0; i < iterations; i++) {
+      RtValue value(i);
+      doNotOptimize(value);
+    }
+  });
+  addBenchmark("RtValue/double", [](std::int64_t iterations) {
+    for (std::int64_t i = 0; i < iterations; i++) {
+      RtValue value(static_cast<double>(i));
+      doNotOptimize(value);
+    }
+  });
+}
+
+static void addLookupBenchmarks() {
+  // The function descriptor lookup is a binary search over the functions of
+  // the module (getFuncDescriptor in Runtime.cpp), which lookupFunction and
+  // selectFunction wrap.
+  for (std::int32_t numFunctions : {1, 64, 4096}) {
+    KernelModule *module = createModule();
+    for (std::int32_t i = 0; i < numFunctions; i++) {
+      char name[32];
+      std::snprintf(name, sizeof(name), "function%05d", i);
+      module->addFunction(name, addI64Kernel, /*numTensorInputs=*/0,
+                          /*numScalarInputs=*/2, /*rank=*/0,
+                          /*returnsTensor=*/false);
+    }
+    ModuleDescriptor *descriptor = module->getDescriptor();
+    char name[32];
+    std::snprintf(name, sizeof(name), "function%05d", numFunctions / 2);
+    std::string functionName = name;
+    addBenchmark(getName("lookupFunction", "functions", numFunctions),
+                 [descriptor, functionName](std::int64_t iterations) {
+                   for (std::int64_t i = 0; i < iterations; i++) {
+                     FunctionHandle function =
+                         lookupFunction(descriptor, functionName.c_str());
+                     doNotOptimize(function);
+                   }
+                 });
+    addBenchmark(getName("selectFunction", "functions", numFunctions),
+                 [descriptor, functionName](std::int64_t iterations) {
+                   std::array<RtValue, 2> inputs = {
+                       RtValue(std::int64_t(1)), RtValue(std::int64_t(2))};
+                   ArrayRef<RtValue> inputsRef(inputs.data(), inputs.size());
+                   for (std::int64_t i = 0; i < iterations; i++) {
+                     FunctionHandle function = selectFunction(
+                         descriptor, functionName.c_str(), inputsRef);
+                     doNotOptimize(function);
+                   }
+                 });
+  }
+}
+
+// Adds a benchmark invoking `functionName` of `module` with `inputs`.
+static void addInvokeBenchmark(std::string name,
+                               ModuleDescriptor *descriptor,
+                               std::string functionName,
+                               std::vector<RtValue> inputs, bool byName) {
+  addBenchmark(std::move(name), [=](std::int64_t iterations) {
+    FunctionHandle function = lookupFunction(descriptor, functionName.c_str());
+    std::array<RtValue, 1> outputs;
+    ArrayRef<RtValue> inputsRef(inputs.data(), inputs.size());
+    MutableArrayRef<RtValue> outputsRef(outputs.data(), outputs.size());
+    for (std::int64_t i = 0; i < iterations; i++) {
+      if (byName)
+        invoke(descriptor, functionName.c_str(), inputsRef, outputsRef);
+      else
+        invoke(function, inputsRef, outputsRef);
+      doNotOptimize(outputs);
+    }
+  });
+}
+
+// Adds a benchmark replaying a call of `functionName` of `module` with
+// `inputs`, captured once.
+static void addReplayBenchmark(std::string name, ModuleDescriptor *descriptor,
+                               std::string functionName,
+                               std::vector<RtValue> inputs) {
+  addBenchmark(std::move(name), [=](std::int64_t iterations) {
+    FunctionHandle function = lookupFunction(descriptor, functionName.c_str());
+    std::array<RtValue, 1> outputs;
+    CapturedCall call = CapturedCall::capture(
+        function, ArrayRef<RtValue>(inputs.data(), inputs.size()),
+        ArrayRef<RtValue>(outputs.data(), outputs.size()));
+    for (std::int64_t i = 0; i < iterations; i++) {
+      call.replay();
+      doNotOptimize(call);
+    }
+  });
+}
+
+static void addInvokeBenchmarks() {
+  KernelModule *module = createModule();
+  module->addFunction("add_i64", addI64Kernel, /*numTensorInputs=*/0,
+                      /*numScalarInputs=*/2, /*rank=*/0,
+                      /*returnsTensor=*/false);
+  for (std::int32_t rank : kRanks) {
+    for (std::int32_t arity : kArities)
+      module->addFunction(getName("sink", "arity", arity) + "/rank:" +
+                              std::to_string(rank),
+                          sinkKernel, arity, /*numScalarInputs=*/0, rank,
+                          /*returnsTensor=*/false);
+    module->addFunction(getName("fresh", "rank", rank), freshKernel,
+                        /*numTensorInputs=*/1, /*numScalarInputs=*/0, rank,
+                        /*returnsTensor=*/true);
+  }
+  ModuleDescriptor *descriptor = module->getDescriptor();
+
+  std::vector<RtValue> scalars = {RtValue(std::int64_t(1)),
+                                  RtValue(std::int64_t(2))};
+  addInvokeBenchmark("invoke/add_i64", descriptor, "add_i64", scalars,
+                     /*byName=*/false);
+  addInvokeBenchmark("invoke_by_name/add_i64", descriptor, "add_i64",
+                     scalars, /*byName=*/true);
+  addReplayBenchmark("replay/add_i64", descriptor, "add_i64", scalars);
+  for (std::int32_t rank : kRanks) {
+    for (std::int32_t arity : kArities) {
+      std::string function =
+          getName("sink", "arity", arity) + "/rank:" + std::to_string(rank);
+      std::vector<RtValue> inputs;
+      for (std::int32_t i = 0; i < arity; i++)
+        inputs.push_back(RtValue(createTensor(rank)));
+      addInvokeBenchmark("invoke/" + function, descriptor, function,
+                         inputs, /*byName=*/false);
+      addReplayBenchmark("replay/" + function, descriptor, function, inputs);
+    }
+    std::string function = getName("fresh", "rank", rank);
+    addInvokeBenchmark("invoke/" + function, descriptor, function,
+                       {RtValue(createTensor(rank))}, /*byName=*/false);
+    addReplayBenchmark("replay/" + function, descriptor, function,
+                       {RtValue(createTensor(rank))});
+  }
+}
+
+//===----------------------------------------------------------------------===//
+// Main.
+//===----------------------------------------------------------------------===//
+
+static void printUsage(const char *program) {
+  std::fprintf(stderr,
+               "usage: %s [--filter=<substring>] [--min-time=<seconds>] "
+               "[--format=table|json]\n",
+               program);
+}
+
+int main(int argc, char **argv) {
+  std::string filter;
+  double minSeconds = 0.5;
+  bool json = false;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    auto startsWith = [&](const char *prefix) {
+      return arg.compare(0, std::strlen(prefix), prefix) == 0;
+    };
+    if (startsWith("--filter=")) {
+      filter = arg.substr(std::strlen("--filter="));
+    } else if (startsWith("--min-time=")) {
+      minSeconds = std::atof(arg.c_str() + std::strlen("--min-time="));
+    } else if (arg == "--format=json") {
+      json = true;
+    } else if (arg == "--format=table") {
+      json = false;
+    } else {
+      printUsage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  addDataStructureBenchmarks();
+  addLookupBenchmarks();
+  addInvokeBenchmarks();
+
+  if (json)
+    std::printf("[\n");
+  else
+    std::printf("%-40s %14s %12s\n", "Benchmark", "Iterations", "Time (ns)");
+  bool first = true;
+  for (const Benchmark &benchmark : getBenchmarks()) {
+    if (benchmark.name.find(filter) == std::string::npos)
+      continue;
+    BenchmarkResult result = runBenchmark(benchmark, minSeconds);
+    if (json) {
+      std::printf("%s  {\"name\": \"%s\", \"iterations\": %lld, "
+                  "\"time_ns\": %.3f}",
+                  first ? "" : ",\n", benchmark.name.c_str(),
+                  static_cast<long long>(result.iterations),
+                  result.nanosPerIteration);
+    } else {
+      std::printf("%-40s %14lld %12.2f\n", benchmark.name.c_str(),
+                  static_cast<long long>(result.iterations),
+                  result.nanosPerIteration);
+    }
+    std::fflush(stdout);
+    first = false;
+  }
+  if (json)
+    std::printf("\n]\n");
+  return EXIT_SUCCESS;
+}
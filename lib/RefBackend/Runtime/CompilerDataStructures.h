@@ -18,21 +18,57 @@
 #include <cstdint>
 
 namespace refbackrt {
+namespace interp {
+struct Function;
+} // namespace interp
 
 // All arguments are packed into this type-erased form for being invoked. See
 // LowerToLLVM.cpp for more details.
-typedef void ABIFunc(void **, void **);
+//
+// The last argument is the status of the call: if a runtime check of the
+// compiled code fails, its message is stored there and the outputs are left
+// unset. It is left untouched otherwise.
+typedef void ABIFunc(void **, void **, const char **);
 
 enum class ABIArgType : std::uint32_t {
   kNone = 0,
   kMemref,
   kF32,
   kF64,
+  kI32,
+  kI64,
+  // Booleans, passed as one byte.
+  kI1,
 };
 
 enum class ABIElementType : std::uint32_t {
   kNone = 0,
   kF32,
+  kF16,
+  kBF16,
+  kI8,
+  kI32,
+  kI64,
+  // Booleans, stored as one byte per element.
+  kI1,
+};
+
+// Where the buffer of a memref output comes from, which tells the runtime
+// whether it owns the buffer.
+enum class ABIOutputOwnership : std::uint32_t {
+  // The compiler couldn't tell. The runtime compares the buffers of the
+  // outputs and inputs to find out.
+  kUnknown = 0,
+  // A buffer that the compiled code allocated for this output alone.
+  kOwned,
+  // The buffer of input `aliasIndex`.
+  kAliasesInput,
+  // The buffer of the earlier output `aliasIndex`.
+  kAliasesOutput,
+  // A mutable global, which must not be freed.
+  kStaticGlobal,
+  // A constant global, which outputs can view without copying.
+  kConstantGlobal,
 };
 
 struct InputDescriptor {
@@ -40,7 +76,11 @@ struct InputDescriptor {
   ABIElementType elementType;
 
   std::int32_t rank;
-  std::int32_t* extents;
+  std::int64_t* extents;
+
+  // Non-zero if the compiled code never writes to, frees, or returns this
+  // argument, so that the runtime can pass the caller's buffer directly.
+  std::int32_t isReadOnly;
 
   // TODO(brycearden): Change to bool at ABI boundary
   // std::int32_t isStatic;
@@ -51,7 +91,12 @@ struct OutputDescriptor {
   ABIElementType elementType;
 
   std::int32_t rank;
-  std::int32_t* extents;
+  std::int64_t* extents;
+
+  // For memrefs, where the buffer of the output comes from, and the index of
+  // the input or output it aliases, if any.
+  ABIOutputOwnership ownership;
+  std::int32_t aliasIndex;
 
   // TODO(brycearden): Change to bool at ABI boundary
   //std::int32_t isStatic;
@@ -72,6 +117,19 @@ struct FuncDescriptor {
   // TODO: Add shape checking to arg / result descriptor(s)
   InputDescriptor *inputDescriptors;
   OutputDescriptor *outputDescriptors;
+  // Upper bound on the scratch memory an invocation needs, or -1 if unknown.
+  std::int64_t peakScratchBytes;
+  // The entry point with the direct-call ABI (see `getDirectEntryPoint` in
+  // UserAPI.h), or null if the function doesn't have one.
+  void *directFunctionPtr;
+  // The memory footprint of the function (see FunctionMetadata in
+  // UserAPI.h), with -1 for sizes that are unknown.
+  std::int64_t constantBytes;
+  std::int64_t inputBytes;
+  std::int64_t outputBytes;
+  // The function that the runtime interprets instead of calling
+  // `functionPtr`, or null for compiled functions (see Interpreter.h).
+  const interp::Function *interpretedFunction;
 };
 
 // The top-level entry point of the module metadata emitted by the
@@ -79,6 +137,8 @@ struct FuncDescriptor {
 // this type (albeit through an opaque pointer).
 struct ModuleDescriptor {
   std::int32_t numFuncDescriptors;
+  // Sorted by name (byte-wise lexicographic order), so that the runtime can
+  // binary search for a function.
   FuncDescriptor *functionDescriptors;
 };
 
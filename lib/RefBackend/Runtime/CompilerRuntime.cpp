@@ -12,6 +12,7 @@
 //===----------------------------------------------------------------------===//
 
 #include <array>
+#include <atomic>
 #include <cstdlib>
 #include <iostream>
 
@@ -20,9 +21,72 @@
 
 using namespace refbackrt;
 
+// The failed checks of exported functions are returned to the runtime (see
+// the status of ABIFunc), so this is only called by the checks of functions
+// that can't report them, such as direct entry points.
 extern "C" void __npcomp_compiler_rt_abort_if(bool b, const char *msg) {
   if (b) {
     std::fprintf(stderr, "NPCOMP: aborting: %s\n", msg);
     std::exit(1);
   }
 }
+
+// Allocation functions that compiled code calls instead of malloc/free, so
+// that all tensor buffers come from the refbackrt allocator.
+//
+// Note that this shared library has its own copy of the refbackrt allocator.
+// Hosts that link the runtime directly (such as JITModule) bind these symbols
+// to their own allocator instead, so that buffers can freely cross the ABI
+// boundary. The same goes for scratch memory: only the copy of the runtime
+// that performs the invocation has an active scratch arena.
+extern "C" void *__npcomp_compiler_rt_alloc(std::int64_t size) {
+  return refbackrt::allocateAt(size, "compiled code");
+}
+
+extern "C" void __npcomp_compiler_rt_free(void *ptr) {
+  refbackrt::deallocateAt(ptr, "compiled code");
+}
+
+// The allocation functions of code compiled with the `profile-ops` option,
+// which names the op making each allocation or free for the memory profile.
+extern "C" void *__npcomp_compiler_rt_alloc_at(std::int64_t size,
+                                               const char *site) {
+  return refbackrt::allocateAt(size, site);
+}
+
+extern "C" void __npcomp_compiler_rt_free_at(void *ptr, const char *site) {
+  refbackrt::deallocateAt(ptr, site);
+}
+
+extern "C" void *__npcomp_compiler_rt_scratch_alloc(std::int64_t size) {
+  return refbackrt::allocateScratch(size);
+}
+
+extern "C" void __npcomp_compiler_rt_parallel_for(std::int64_t begin,
+                                                  std::int64_t end,
+                                                  std::int64_t grainSize,
+                                                  ParallelForBody body,
+                                                  void *context) {
+  refbackrt::parallelFor(begin, end, grainSize, body, context);
+}
+
+extern "C" std::int64_t __npcomp_compiler_rt_profile_begin() {
+  return refbackrt::beginProfiledOp();
+}
+
+extern "C" void __npcomp_compiler_rt_profile_end(const char *name,
+                                                 std::int64_t start) {
+  refbackrt::endProfiledOp(name, start);
+}
+
+// Called at the entry of functions compiled with the `prefetch-weights`
+// option, with a flag per global so that only its first prefetch reaches the
+// OS.
+extern "C" void __npcomp_compiler_rt_prefetch(std::uint8_t *prefetched,
+                                              const void *ptr,
+                                              std::int64_t size) {
+  auto *flag = reinterpret_cast<std::atomic<std::uint8_t> *>(prefetched);
+  if (!flag->load(std::memory_order_relaxed) &&
+      !flag->exchange(1, std::memory_order_relaxed))
+    refbackrt::prefetchPages(ptr, size);
+}
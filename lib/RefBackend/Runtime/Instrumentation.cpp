@@ -0,0 +1,509 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Per-function counters of the calls made through the invocation entry
+// points, the per-op profile of profiled compiled code, and the memory
+// profile.
+//
+// The counters live in fixed-size, open-addressed tables keyed by function
+// descriptor (or by the address of the name of the profiled op), which
+// threads claim slots of with a compare-and-swap. Recording a call thus never
+// locks: it is a handful of relaxed atomic adds. The events of the per-op
+// profile go to a buffer allocated on first use, at an index claimed with an
+// atomic increment. The memory profile instead records its events under a
+// lock, since it also tracks the size of each live buffer.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Instrumentation.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+using namespace refbackrt;
+
+std::atomic<bool> refbackrt::detail::instrumentationEnabled{false};
+std::atomic<bool> refbackrt::detail::memoryProfilingEnabled{false};
+
+namespace {
+struct FunctionCounters {
+  std::atomic<FuncDescriptor *> function;
+  std::atomic<std::int64_t> numCalls;
+  std::atomic<std::int64_t> totalNanoseconds;
+  std::atomic<std::int64_t> latencyHistogram[kNumLatencyBuckets];
+  std::atomic<std::int64_t> bytesCopiedIn;
+  std::atomic<std::int64_t> bytesCopiedOut;
+};
+} // namespace
+
+// Zero-initialized, as it has static storage duration.
+static FunctionCounters counterTable[kMaxInstrumentedFunctions];
+static InvokeCallbacks invokeCallbacks;
+
+// Returns the slot of `table` whose field `keyField` is `key`, claiming a
+// free slot for it if `create` is true. Returns null if it has none (or the
+// table is full).
+template <typename Slot, int size, typename Key>
+static Slot *findSlot(Slot (&table)[size], std::atomic<Key *> Slot::*keyField,
+                      Key *key, bool create) {
+  std::uintptr_t hash = reinterpret_cast<std::uintptr_t>(key);
+  hash ^= hash >> 17;
+  for (int probe = 0; probe < size; probe++) {
+    Slot &slot = table[(hash + probe) % size];
+    Key *current = (slot.*keyField).load(std::memory_order_acquire);
+    if (current == key)
+      return &slot;
+    if (current != nullptr)
+      continue;
+    if (!create)
+      return nullptr;
+    if ((slot.*keyField)
+            .compare_exchange_strong(current, key, std::memory_order_acq_rel))
+      return &slot;
+    // Another thread claimed the slot first, possibly for `key`.
+    if (current == key)
+      return &slot;
+  }
+  return nullptr;
+}
+
+static FunctionCounters *getCounters(FuncDescriptor *function, bool create) {
+  return findSlot(counterTable, &FunctionCounters::function, function, create);
+}
+
+#if NPCOMP_REFBACKRT_ENABLE_INSTRUMENTATION
+static int getLatencyBucket(std::int64_t nanoseconds) {
+  std::int64_t microseconds = nanoseconds / 1000;
+  int bucket = 0;
+  while (microseconds != 0 && bucket < kNumLatencyBuckets - 1) {
+    microseconds >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+// The call in progress on this thread, and the site of the allocations and
+// frees being made, for the memory profile.
+static thread_local FunctionHandle currentFunction;
+static thread_local const char *currentSite = nullptr;
+
+// Records the begin or end of the call in progress on this thread.
+static void recordCall(MemoryEventKind kind);
+
+void detail::CallRecorder::begin(FunctionHandle function, bool counted,
+                                 bool profiled) {
+  this->function = function;
+  this->counted = counted;
+  this->profiled = profiled;
+  if (profiled) {
+    enclosingFunction = currentFunction;
+    currentFunction = function;
+    recordCall(MemoryEventKind::CallBegin);
+  }
+  if (counted && invokeCallbacks.onEnter)
+    invokeCallbacks.onEnter(function, invokeCallbacks.userData);
+  start = std::chrono::steady_clock::now();
+}
+
+void detail::CallRecorder::end() {
+  std::int64_t nanoseconds =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count();
+  if (counted) {
+    if (FunctionCounters *counters =
+            getCounters(function.getDescriptor(), /*create=*/true)) {
+      auto add = [](std::atomic<std::int64_t> &counter, std::int64_t value) {
+        counter.fetch_add(value, std::memory_order_relaxed);
+      };
+      add(counters->numCalls, 1);
+      add(counters->totalNanoseconds, nanoseconds);
+      add(counters->latencyHistogram[getLatencyBucket(nanoseconds)], 1);
+      add(counters->bytesCopiedIn, bytesCopiedIn);
+      add(counters->bytesCopiedOut, bytesCopiedOut);
+    }
+    if (invokeCallbacks.onExit)
+      invokeCallbacks.onExit(function, nanoseconds, invokeCallbacks.userData);
+  }
+  if (profiled) {
+    recordCall(MemoryEventKind::CallEnd);
+    currentFunction = enclosingFunction;
+  }
+}
+#endif
+
+void refbackrt::setInstrumentationEnabled(bool enabled) {
+  detail::instrumentationEnabled.store(
+      enabled && NPCOMP_REFBACKRT_ENABLE_INSTRUMENTATION,
+      std::memory_order_relaxed);
+}
+
+bool refbackrt::isInstrumentationEnabled() {
+  return detail::instrumentationEnabled.load(std::memory_order_relaxed);
+}
+
+void refbackrt::setInvokeCallbacks(const InvokeCallbacks &callbacks) {
+  invokeCallbacks = callbacks;
+}
+
+FunctionStats refbackrt::getFunctionStats(FunctionHandle function) {
+  assert(function && "null function handle");
+  FunctionStats stats;
+  FunctionCounters *counters =
+      getCounters(function.getDescriptor(), /*create=*/false);
+  if (!counters)
+    return stats;
+  auto get = [](const std::atomic<std::int64_t> &counter) {
+    return counter.load(std::memory_order_relaxed);
+  };
+  stats.numCalls = get(counters->numCalls);
+  stats.totalNanoseconds = get(counters->totalNanoseconds);
+  for (int i = 0; i < kNumLatencyBuckets; i++)
+    stats.latencyHistogram[i] = get(counters->latencyHistogram[i]);
+  stats.bytesCopiedIn = get(counters->bytesCopiedIn);
+  stats.bytesCopiedOut = get(counters->bytesCopiedOut);
+  return stats;
+}
+
+void refbackrt::resetFunctionStats() {
+  // Functions keep their slots, as other threads may be about to use them.
+  for (FunctionCounters &counters : counterTable) {
+    counters.numCalls.store(0, std::memory_order_relaxed);
+    counters.totalNanoseconds.store(0, std::memory_order_relaxed);
+    for (auto &bucket : counters.latencyHistogram)
+      bucket.store(0, std::memory_order_relaxed);
+    counters.bytesCopiedIn.store(0, std::memory_order_relaxed);
+    counters.bytesCopiedOut.store(0, std::memory_order_relaxed);
+  }
+}
+
+//===----------------------------------------------------------------------===//
+// Per-op profile.
+//===----------------------------------------------------------------------===//
+
+namespace {
+struct OpCounters {
+  std::atomic<const char *> name;
+  std::atomic<std::int64_t> numCalls;
+  std::atomic<std::int64_t> totalNanoseconds;
+};
+
+struct OpEvent {
+  const char *name;
+  std::int64_t start;
+  std::int64_t end;
+  std::uint32_t thread;
+};
+} // namespace
+
+static OpCounters opCounterTable[kMaxProfiledOps];
+
+static std::once_flag opEventsAllocated;
+static std::unique_ptr<OpEvent[]> opEvents;
+static std::atomic<std::int64_t> numOpEvents{0};
+
+static std::int64_t now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+std::int64_t refbackrt::beginProfiledOp() { return now(); }
+
+#if NPCOMP_REFBACKRT_ENABLE_INSTRUMENTATION
+// Small consecutive ids of the threads running profiled code, for the tracks
+// of the trace.
+static std::atomic<std::uint32_t> nextThreadId{0};
+static std::uint32_t getThreadId() {
+  thread_local std::uint32_t threadId = nextThreadId.fetch_add(1);
+  return threadId;
+}
+#endif
+
+void refbackrt::endProfiledOp(const char *name, std::int64_t start) {
+#if NPCOMP_REFBACKRT_ENABLE_INSTRUMENTATION
+  std::int64_t end = now();
+  if (OpCounters *counters = findSlot(opCounterTable, &OpCounters::name, name,
+                                      /*create=*/true)) {
+    counters->numCalls.fetch_add(1, std::memory_order_relaxed);
+    counters->totalNanoseconds.fetch_add(end - start,
+                                         std::memory_order_relaxed);
+  }
+  std::call_once(opEventsAllocated, [] {
+    opEvents = std::unique_ptr<OpEvent[]>(new OpEvent[kMaxOpProfileEvents]);
+  });
+  std::int64_t index = numOpEvents.fetch_add(1, std::memory_order_relaxed);
+  if (index < kMaxOpProfileEvents)
+    opEvents[index] = {name, start, end, getThreadId()};
+#else
+  (void)name;
+  (void)start;
+#endif
+}
+
+int refbackrt::getOpProfile(OpProfileEntry *entries, int maxEntries) {
+  int numOps = 0;
+  for (OpCounters &counters : opCounterTable) {
+    const char *name = counters.name.load(std::memory_order_acquire);
+    std::int64_t numCalls = counters.numCalls.load(std::memory_order_relaxed);
+    // Ops keep their slots across resets.
+    if (!name || numCalls == 0)
+      continue;
+    if (numOps < maxEntries) {
+      OpProfileEntry &entry = entries[numOps];
+      entry.name = name;
+      entry.numCalls = numCalls;
+      entry.totalNanoseconds =
+          counters.totalNanoseconds.load(std::memory_order_relaxed);
+    }
+    numOps++;
+  }
+  return numOps;
+}
+
+// Writes `str` as a JSON string literal.
+static void writeJsonString(std::FILE *file, StringRef str) {
+  std::fputc('"', file);
+  for (std::size_t i = 0; i < str.size(); i++) {
+    unsigned char c = str.data()[i];
+    if (c == '"' || c == '\\')
+      std::fprintf(file, "\\%c", c);
+    else if (c < 0x20)
+      std::fprintf(file, "\\u%04x", c);
+    else
+      std::fputc(c, file);
+  }
+  std::fputc('"', file);
+}
+
+bool refbackrt::writeOpProfileAsChromeTrace(const char *path) {
+  std::FILE *file = std::fopen(path, "w");
+  if (!file)
+    return false;
+  std::int64_t numEvents = std::min<std::int64_t>(
+      numOpEvents.load(std::memory_order_relaxed), kMaxOpProfileEvents);
+  // Trace timestamps are in microseconds, from the first event.
+  std::int64_t origin = 0;
+  for (std::int64_t i = 0; i < numEvents; i++)
+    if (i == 0 || opEvents[i].start < origin)
+      origin = opEvents[i].start;
+  std::fputs("{\"traceEvents\": [", file);
+  for (std::int64_t i = 0; i < numEvents; i++) {
+    const OpEvent &event = opEvents[i];
+    std::fputs(i == 0 ? "\n  {\"name\": " : ",\n  {\"name\": ", file);
+    writeJsonString(file, event.name);
+    std::fprintf(file,
+                 ", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+                 "\"pid\": 0, \"tid\": %u}",
+                 (event.start - origin) / 1000.0,
+                 (event.end - event.start) / 1000.0,
+                 static_cast<unsigned>(event.thread));
+  }
+  std::fputs("\n], \"displayTimeUnit\": \"ns\"}\n", file);
+  bool succeeded = !std::ferror(file);
+  return std::fclose(file) == 0 && succeeded;
+}
+
+void refbackrt::resetOpProfile() {
+  for (OpCounters &counters : opCounterTable) {
+    counters.numCalls.store(0, std::memory_order_relaxed);
+    counters.totalNanoseconds.store(0, std::memory_order_relaxed);
+  }
+  numOpEvents.store(0, std::memory_order_relaxed);
+}
+
+//===----------------------------------------------------------------------===//
+// Memory profile.
+//===----------------------------------------------------------------------===//
+
+namespace {
+struct MemoryProfileState {
+  std::mutex mutex;
+  // The size of each buffer allocated while profiling and not freed yet.
+  std::unordered_map<void *, std::int64_t> liveBuffers;
+  std::int64_t liveBytes = 0;
+  std::unique_ptr<MemoryEvent[]> events;
+  std::int64_t numEvents = 0;
+};
+} // namespace
+
+static MemoryProfileState &getMemoryProfileState() {
+  // Intentionally leaked, since buffers can be freed during static
+  // destruction.
+  static MemoryProfileState *state = new MemoryProfileState;
+  return *state;
+}
+
+#if NPCOMP_REFBACKRT_ENABLE_INSTRUMENTATION
+// Appends an event to the profile, whose mutex must be held.
+static void appendMemoryEvent(MemoryProfileState &state, MemoryEventKind kind,
+                              const char *site, std::int64_t bytes) {
+  if (!state.events)
+    state.events = std::unique_ptr<MemoryEvent[]>(
+        new MemoryEvent[kMaxMemoryEvents]);
+  std::int64_t index = state.numEvents++;
+  if (index >= kMaxMemoryEvents)
+    return;
+  MemoryEvent &event = state.events[index];
+  event.kind = kind;
+  event.site = site;
+  event.function = currentFunction;
+  event.bytes = bytes;
+  event.liveBytes = state.liveBytes;
+  event.nanoseconds = now();
+  event.thread = getThreadId();
+}
+
+static void recordCall(MemoryEventKind kind) {
+  MemoryProfileState &state = getMemoryProfileState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  appendMemoryEvent(state, kind, /*site=*/nullptr, /*bytes=*/0);
+}
+
+void detail::recordAllocation(void *ptr, std::size_t size) {
+  MemoryProfileState &state = getMemoryProfileState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  std::int64_t &bufferSize = state.liveBuffers[ptr];
+  state.liveBytes += static_cast<std::int64_t>(size) - bufferSize;
+  bufferSize = size;
+  appendMemoryEvent(state, MemoryEventKind::Allocate,
+                    currentSite ? currentSite : "runtime", size);
+}
+
+void detail::recordDeallocation(void *ptr) {
+  MemoryProfileState &state = getMemoryProfileState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  auto it = state.liveBuffers.find(ptr);
+  // Buffers allocated before profiling started aren't tracked.
+  if (it == state.liveBuffers.end())
+    return;
+  std::int64_t size = it->second;
+  state.liveBuffers.erase(it);
+  state.liveBytes -= size;
+  appendMemoryEvent(state, MemoryEventKind::Free,
+                    currentSite ? currentSite : "runtime", size);
+}
+
+namespace {
+// Sets the site of the allocations and frees made on this thread during its
+// lifetime.
+class SiteScope {
+public:
+  explicit SiteScope(const char *site) : enclosingSite(currentSite) {
+    currentSite = site;
+  }
+  ~SiteScope() { currentSite = enclosingSite; }
+
+private:
+  const char *enclosingSite;
+};
+} // namespace
+#else
+void detail::recordAllocation(void *, std::size_t) {}
+void detail::recordDeallocation(void *) {}
+#endif
+
+void *refbackrt::allocateAt(std::size_t size, const char *site) {
+#if NPCOMP_REFBACKRT_ENABLE_INSTRUMENTATION
+  SiteScope scope(site);
+#else
+  (void)site;
+#endif
+  void *ptr = allocate(size);
+  detail::trackCallAllocation(ptr);
+  return ptr;
+}
+
+void refbackrt::deallocateAt(void *ptr, const char *site) {
+#if NPCOMP_REFBACKRT_ENABLE_INSTRUMENTATION
+  SiteScope scope(site);
+#else
+  (void)site;
+#endif
+  detail::untrackCallAllocation(ptr);
+  deallocate(ptr);
+}
+
+void refbackrt::setMemoryProfilingEnabled(bool enabled) {
+  detail::memoryProfilingEnabled.store(
+      enabled && NPCOMP_REFBACKRT_ENABLE_INSTRUMENTATION,
+      std::memory_order_relaxed);
+}
+
+bool refbackrt::isMemoryProfilingEnabled() {
+  return detail::memoryProfilingEnabled.load(std::memory_order_relaxed);
+}
+
+std::int64_t refbackrt::getMemoryProfile(MemoryEvent *events,
+                                         std::int64_t maxEvents) {
+  MemoryProfileState &state = getMemoryProfileState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  std::int64_t numStored = std::min<std::int64_t>(
+      std::min<std::int64_t>(state.numEvents, kMaxMemoryEvents), maxEvents);
+  std::copy(state.events.get(), state.events.get() + numStored, events);
+  return state.numEvents;
+}
+
+bool refbackrt::writeMemoryProfileAsChromeTrace(const char *path) {
+  std::FILE *file = std::fopen(path, "w");
+  if (!file)
+    return false;
+  MemoryProfileState &state = getMemoryProfileState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  std::int64_t numEvents =
+      std::min<std::int64_t>(state.numEvents, kMaxMemoryEvents);
+  // Trace timestamps are in microseconds, from the first event.
+  std::int64_t origin = numEvents ? state.events[0].nanoseconds : 0;
+  std::fputs("{\"traceEvents\": [", file);
+  for (std::int64_t i = 0; i < numEvents; i++) {
+    const MemoryEvent &event = state.events[i];
+    double timestamp = (event.nanoseconds - origin) / 1000.0;
+    std::fputs(i == 0 ? "\n  {\"name\": " : ",\n  {\"name\": ", file);
+    switch (event.kind) {
+    case MemoryEventKind::CallBegin:
+    case MemoryEventKind::CallEnd:
+      writeJsonString(file, getFunctionName(event.function));
+      std::fprintf(file,
+                   ", \"ph\": \"%s\", \"ts\": %.3f, \"pid\": 0, \"tid\": %u}",
+                   event.kind == MemoryEventKind::CallBegin ? "B" : "E",
+                   timestamp, static_cast<unsigned>(event.thread));
+      break;
+    case MemoryEventKind::Allocate:
+    case MemoryEventKind::Free:
+      writeJsonString(file, event.site);
+      std::fprintf(file,
+                   ", \"ph\": \"i\", \"s\": \"t\", \"ts\": %.3f, "
+                   "\"pid\": 0, \"tid\": %u, \"args\": {\"bytes\": %lld}},"
+                   "\n  {\"name\": \"live bytes\", \"ph\": \"C\", "
+                   "\"ts\": %.3f, \"pid\": 0, "
+                   "\"args\": {\"bytes\": %lld}}",
+                   timestamp, static_cast<unsigned>(event.thread),
+                   static_cast<long long>(event.kind == MemoryEventKind::Free
+                                              ? -event.bytes
+                                              : event.bytes),
+                   timestamp, static_cast<long long>(event.liveBytes));
+      break;
+    }
+  }
+  std::fputs("\n], \"displayTimeUnit\": \"ns\"}\n", file);
+  bool succeeded = !std::ferror(file);
+  return std::fclose(file) == 0 && succeeded;
+}
+
+void refbackrt::resetMemoryProfile() {
+  MemoryProfileState &state = getMemoryProfileState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.liveBuffers.clear();
+  state.liveBytes = 0;
+  state.numEvents = 0;
+}
@@ -0,0 +1,86 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// The hooks through which the invocation entry points feed the
+// instrumentation declared in UserAPI.h, and through which allocateAt tells
+// the invocation in progress about the buffers of the compiled code.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef NPCOMP_LIB_RUNTIME_INSTRUMENTATION_H
+#define NPCOMP_LIB_RUNTIME_INSTRUMENTATION_H
+
+#include "npcomp/RefBackend/Runtime/UserAPI.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace refbackrt {
+namespace detail {
+
+extern std::atomic<bool> instrumentationEnabled;
+extern std::atomic<bool> memoryProfilingEnabled;
+
+// Records an allocation of `size` bytes at `ptr`, or a free of `ptr`, in the
+// memory profile. Only called while memory profiling is enabled.
+void recordAllocation(void *ptr, std::size_t size);
+void recordDeallocation(void *ptr);
+
+// Records that the compiled code called on this thread allocated `ptr`, or
+// freed it, so that the buffers it still holds when a runtime check fails can
+// be freed (see callCompiledCode). Does nothing outside of invocations.
+void trackCallAllocation(void *ptr);
+void untrackCallAllocation(void *ptr);
+
+// Records one call of a function, from its construction to its destruction.
+// It does nothing unless instrumentation or memory profiling is enabled when
+// it is constructed, and compiles to nothing if instrumentation is compiled
+// out.
+class CallRecorder {
+public:
+#if NPCOMP_REFBACKRT_ENABLE_INSTRUMENTATION
+  explicit CallRecorder(FunctionHandle function) {
+    bool counted = instrumentationEnabled.load(std::memory_order_relaxed);
+    bool profiled = memoryProfilingEnabled.load(std::memory_order_relaxed);
+    if (counted || profiled)
+      begin(function, counted, profiled);
+  }
+  ~CallRecorder() {
+    if (function)
+      end();
+  }
+  void recordCopyIn(std::int64_t bytes) { bytesCopiedIn += bytes; }
+  void recordCopyOut(std::int64_t bytes) { bytesCopiedOut += bytes; }
+
+private:
+  void begin(FunctionHandle function, bool counted, bool profiled);
+  void end();
+
+  FunctionHandle function;
+  // Whether the call is counted in the function stats, and whether it is
+  // recorded in the memory profile.
+  bool counted = false;
+  bool profiled = false;
+  // The call that this one is nested in on the same thread, if any.
+  FunctionHandle enclosingFunction;
+  std::chrono::steady_clock::time_point start;
+  std::int64_t bytesCopiedIn = 0;
+  std::int64_t bytesCopiedOut = 0;
+#else
+  explicit CallRecorder(FunctionHandle) {}
+  void recordCopyIn(std::int64_t) {}
+  void recordCopyOut(std::int64_t) {}
+#endif
+};
+
+} // namespace detail
+} // namespace refbackrt
+
+#endif // NPCOMP_LIB_RUNTIME_INSTRUMENTATION_H
@@ -0,0 +1,1292 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// The interpreter executes a linalg op as a loop nest whose loops run in the
+// order of their kinds: reduction loops outermost, then parallel loops. The
+// innermost loop is then parallel (unless all of them are reductions), so its
+// iterations write distinct elements of the outputs, and the payload is
+// evaluated for kLanes of them at a time: the operands are loaded into
+// registers of kLanes scalars each, each op of the payload is one call of a
+// kernel looping over the lanes, and the registers yielded are stored into
+// the outputs. The dispatch cost of the payload ops is amortized over the
+// lanes, and the kernels are simple loops over contiguous registers, which
+// the C++ compiler vectorizes. The outermost parallel loop is split among the
+// threads of the runtime.
+//
+// The kernels are compiled for AVX-512, AVX2 and baseline x86-64, and the
+// loader picks one for the CPU (with GCC's and Clang's `target_clones`), so
+// that a single build runs at full vector width everywhere.
+//
+//===----------------------------------------------------------------------===//
+
+#include "npcomp/RefBackend/Runtime/Interpreter.h"
+
+#include "npcomp/RefBackend/Runtime/UserAPI.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+
+#include "CompilerDataStructures.h"
+
+using namespace refbackrt;
+using namespace refbackrt::interp;
+
+#if defined(__x86_64__) && defined(__linux__) &&                               \
+    ((defined(__clang__) && __clang_major__ >= 14) ||                          \
+     (!defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 8))
+#define NPCOMP_INTERP_KERNEL                                                   \
+  __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define NPCOMP_INTERP_KERNEL
+#endif
+
+//===----------------------------------------------------------------------===//
+// Kernels of the scalar ops, on `n` lanes.
+//===----------------------------------------------------------------------===//
+
+#define UNARY_KERNEL(NAME, T, R, EXPR)                                         \
+  NPCOMP_INTERP_KERNEL static void NAME(R *__restrict out,                     \
+                                        const T *__restrict a,                 \
+                                        std::int64_t n) {                      \
+    for (std::int64_t i = 0; i < n; ++i) {                                     \
+      T x = a[i];                                                              \
+      out[i] = (EXPR);                                                         \
+    }                                                                          \
+  }
+
+#define BINARY_KERNEL(NAME, T, R, EXPR)                                        \
+  NPCOMP_INTERP_KERNEL static void NAME(                                       \
+      R *__restrict out, const T *__restrict a, const T *__restrict b,         \
+      std::int64_t n) {                                                        \
+    for (std::int64_t i = 0; i < n; ++i) {                                     \
+      T x = a[i];                                                              \
+      T y = b[i];                                                              \
+      out[i] = (EXPR);                                                         \
+    }                                                                          \
+  }
+
+#define SELECT_KERNEL(NAME, T)                                                 \
+  NPCOMP_INTERP_KERNEL static void NAME(                                       \
+      T *__restrict out, const std::int64_t *__restrict c,                     \
+      const T *__restrict a, const T *__restrict b, std::int64_t n) {          \
+    for (std::int64_t i = 0; i < n; ++i)                                       \
+      out[i] = c[i] ? a[i] : b[i];                                             \
+  }
+
+// The kernels of the float ops and comparisons of type T, suffixed with S.
+#define FLOAT_KERNELS(T, S)                                                    \
+  BINARY_KERNEL(addF##S, T, T, x + y)                                          \
+  BINARY_KERNEL(subF##S, T, T, x - y)                                          \
+  BINARY_KERNEL(mulF##S, T, T, x * y)                                          \
+  BINARY_KERNEL(divF##S, T, T, x / y)                                          \
+  BINARY_KERNEL(remF##S, T, T, std::fmod(x, y))                                \
+  BINARY_KERNEL(powF##S, T, T, std::pow(x, y))                                 \
+  UNARY_KERNEL(negF##S, T, T, -x)                                              \
+  UNARY_KERNEL(absF##S, T, T, std::fabs(x))                                    \
+  UNARY_KERNEL(ceilF##S, T, T, std::ceil(x))                                   \
+  UNARY_KERNEL(floorF##S, T, T, std::floor(x))                                 \
+  UNARY_KERNEL(exp##S, T, T, std::exp(x))                                      \
+  UNARY_KERNEL(log##S, T, T, std::log(x))                                      \
+  UNARY_KERNEL(tanh##S, T, T, std::tanh(x))                                    \
+  UNARY_KERNEL(sqrt##S, T, T, std::sqrt(x))                                    \
+  UNARY_KERNEL(rsqrt##S, T, T, T(1) / std::sqrt(x))                            \
+  BINARY_KERNEL(cmpOEQ##S, T, std::int64_t, x == y)                            \
+  BINARY_KERNEL(cmpOGT##S, T, std::int64_t, x > y)                             \
+  BINARY_KERNEL(cmpOGE##S, T, std::int64_t, x >= y)                            \
+  BINARY_KERNEL(cmpOLT##S, T, std::int64_t, x < y)                             \
+  BINARY_KERNEL(cmpOLE##S, T, std::int64_t, x <= y)                            \
+  BINARY_KERNEL(cmpONE##S, T, std::int64_t, x < y || x > y)                    \
+  BINARY_KERNEL(cmpORD##S, T, std::int64_t, x == x && y == y)                  \
+  BINARY_KERNEL(cmpUEQ##S, T, std::int64_t, !(x < y || x > y))                 \
+  BINARY_KERNEL(cmpUGT##S, T, std::int64_t, !(x <= y))                         \
+  BINARY_KERNEL(cmpUGE##S, T, std::int64_t, !(x < y))                          \
+  BINARY_KERNEL(cmpULT##S, T, std::int64_t, !(x >= y))                         \
+  BINARY_KERNEL(cmpULE##S, T, std::int64_t, !(x > y))                          \
+  BINARY_KERNEL(cmpUNE##S, T, std::int64_t, x != y)                            \
+  BINARY_KERNEL(cmpUNO##S, T, std::int64_t, x != x || y != y)                  \
+  SELECT_KERNEL(select##S, T)                                                  \
+  UNARY_KERNEL(sIToFP##S, std::int64_t, T, static_cast<T>(x))                  \
+  UNARY_KERNEL(uIToFP##S, std::uint64_t, T, static_cast<T>(x))                 \
+  UNARY_KERNEL(fPToSI##S, T, std::int64_t, static_cast<std::int64_t>(x))       \
+  UNARY_KERNEL(fPToUI##S, T, std::uint64_t, static_cast<std::uint64_t>(x))
+
+FLOAT_KERNELS(float, 32)
+FLOAT_KERNELS(double, 64)
+UNARY_KERNEL(extF, float, double, static_cast<double>(x))
+UNARY_KERNEL(truncF, double, float, static_cast<float>(x))
+
+// Integers wrap around, as unsigned integers do.
+BINARY_KERNEL(addI, std::uint64_t, std::uint64_t, x + y)
+BINARY_KERNEL(subI, std::uint64_t, std::uint64_t, x - y)
+BINARY_KERNEL(mulI, std::uint64_t, std::uint64_t, x * y)
+BINARY_KERNEL(andI, std::uint64_t, std::uint64_t, x & y)
+BINARY_KERNEL(orI, std::uint64_t, std::uint64_t, x | y)
+BINARY_KERNEL(xOrI, std::uint64_t, std::uint64_t, x ^ y)
+BINARY_KERNEL(shLI, std::uint64_t, std::uint64_t, y < 64 ? x << y : 0)
+BINARY_KERNEL(shRSI, std::int64_t, std::int64_t,
+              x >> (static_cast<std::uint64_t>(y) < 64 ? y : 63))
+BINARY_KERNEL(shRUI, std::uint64_t, std::uint64_t, y < 64 ? x >> y : 0)
+// Division by zero, which is undefined, gives 0 rather than trapping.
+BINARY_KERNEL(divSI, std::int64_t, std::int64_t,
+              y == 0 ? 0 : (y == -1 ? static_cast<std::int64_t>(
+                                          0 - static_cast<std::uint64_t>(x))
+                                    : x / y))
+BINARY_KERNEL(divUI, std::uint64_t, std::uint64_t, y == 0 ? 0 : x / y)
+BINARY_KERNEL(remSI, std::int64_t, std::int64_t,
+              y == 0 || y == -1 ? 0 : x % y)
+BINARY_KERNEL(remUI, std::uint64_t, std::uint64_t, y == 0 ? 0 : x % y)
+BINARY_KERNEL(cmpEQ, std::int64_t, std::int64_t, x == y)
+BINARY_KERNEL(cmpNE, std::int64_t, std::int64_t, x != y)
+BINARY_KERNEL(cmpSLT, std::int64_t, std::int64_t, x < y)
+BINARY_KERNEL(cmpSLE, std::int64_t, std::int64_t, x <= y)
+BINARY_KERNEL(cmpSGT, std::int64_t, std::int64_t, x > y)
+BINARY_KERNEL(cmpSGE, std::int64_t, std::int64_t, x >= y)
+BINARY_KERNEL(cmpULT, std::uint64_t, std::int64_t, x < y)
+BINARY_KERNEL(cmpULE, std::uint64_t, std::int64_t, x <= y)
+BINARY_KERNEL(cmpUGT, std::uint64_t, std::int64_t, x > y)
+BINARY_KERNEL(cmpUGE, std::uint64_t, std::int64_t, x >= y)
+SELECT_KERNEL(selectI, std::int64_t)
+
+static std::int32_t getBitWidth(ScalarType type) {
+  switch (type) {
+  case ScalarType::kI1:
+    return 1;
+  case ScalarType::kI8:
+    return 8;
+  case ScalarType::kI32:
+  case ScalarType::kF32:
+    return 32;
+  case ScalarType::kI64:
+  case ScalarType::kF64:
+    return 64;
+  }
+  return 64;
+}
+
+// Brings the `n` integers at `values` back into the representation of
+// `type`: sign-extended from its width, or 0 or 1 for i1.
+static void normalizeInts(std::int64_t *values, ScalarType type,
+                          std::int64_t n) {
+  switch (type) {
+  case ScalarType::kI1:
+    for (std::int64_t i = 0; i < n; ++i)
+      values[i] &= 1;
+    break;
+  case ScalarType::kI8:
+    for (std::int64_t i = 0; i < n; ++i)
+      values[i] = static_cast<std::int8_t>(values[i]);
+    break;
+  case ScalarType::kI32:
+    for (std::int64_t i = 0; i < n; ++i)
+      values[i] = static_cast<std::int32_t>(values[i]);
+    break;
+  default:
+    break;
+  }
+}
+
+// Copies the `n` integers of `type` at `values` into `out` as unsigned
+// integers of the same width.
+static void zeroExtendInts(const std::int64_t *values, ScalarType type,
+                           std::uint64_t *out, std::int64_t n) {
+  std::int32_t width = getBitWidth(type);
+  std::uint64_t mask =
+      width == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << width) - 1;
+  for (std::int64_t i = 0; i < n; ++i)
+    out[i] = static_cast<std::uint64_t>(values[i]) & mask;
+}
+
+// The operands of unsigned integer ops, zero-extended.
+static thread_local std::uint64_t unsignedOperands[2][kLanes];
+
+// Applies `instruction` to `n` lanes of its operands, whose registers (or
+// scalars, for one lane) are at `operands`, writing those of the result to
+// `result`.
+static void applyScalarInstruction(const ScalarInstruction &instruction,
+                                   void *result, void *const *operands,
+                                   std::int64_t n) {
+  ScalarType type = instruction.type;
+  bool f32 = type == ScalarType::kF32;
+  auto *out32 = static_cast<float *>(result);
+  auto *out64 = static_cast<double *>(result);
+  auto *outI = static_cast<std::int64_t *>(result);
+  auto *outU = static_cast<std::uint64_t *>(result);
+  auto a32 = static_cast<const float *>(operands[0]);
+  auto b32 = static_cast<const float *>(operands[1]);
+  auto a64 = static_cast<const double *>(operands[0]);
+  auto b64 = static_cast<const double *>(operands[1]);
+  auto aI = static_cast<const std::int64_t *>(operands[0]);
+  auto bI = static_cast<const std::int64_t *>(operands[1]);
+  auto aU = static_cast<const std::uint64_t *>(operands[0]);
+  auto bU = static_cast<const std::uint64_t *>(operands[1]);
+
+#define FLOAT_CASE(OPCODE, KERNEL)                                             \
+  case Opcode::OPCODE:                                                         \
+    return f32 ? KERNEL##32(out32, a32, n) : KERNEL##64(out64, a64, n);
+  switch (instruction.opcode) {
+  case Opcode::kAddF:
+    return f32 ? addF32(out32, a32, b32, n) : addF64(out64, a64, b64, n);
+  case Opcode::kSubF:
+    return f32 ? subF32(out32, a32, b32, n) : subF64(out64, a64, b64, n);
+  case Opcode::kMulF:
+    return f32 ? mulF32(out32, a32, b32, n) : mulF64(out64, a64, b64, n);
+  case Opcode::kDivF:
+    return f32 ? divF32(out32, a32, b32, n) : divF64(out64, a64, b64, n);
+  case Opcode::kRemF:
+    return f32 ? remF32(out32, a32, b32, n) : remF64(out64, a64, b64, n);
+  case Opcode::kPowF:
+    return f32 ? powF32(out32, a32, b32, n) : powF64(out64, a64, b64, n);
+    FLOAT_CASE(kNegF, negF)
+    FLOAT_CASE(kAbsF, absF)
+    FLOAT_CASE(kCeilF, ceilF)
+    FLOAT_CASE(kFloorF, floorF)
+    FLOAT_CASE(kExp, exp)
+    FLOAT_CASE(kLog, log)
+    FLOAT_CASE(kTanh, tanh)
+    FLOAT_CASE(kSqrt, sqrt)
+    FLOAT_CASE(kRsqrt, rsqrt)
+  case Opcode::kCmpF: {
+    bool operandF32 = instruction.operandType == ScalarType::kF32;
+#define CMPF_CASE(PREDICATE)                                                   \
+  case CmpFPredicate::k##PREDICATE:                                            \
+    return operandF32 ? cmp##PREDICATE##32(outI, a32, b32, n)                  \
+                      : cmp##PREDICATE##64(outI, a64, b64, n);
+    switch (static_cast<CmpFPredicate>(instruction.predicate)) {
+    case CmpFPredicate::kFalse:
+      std::fill(outI, outI + n, 0);
+      return;
+    case CmpFPredicate::kTrue:
+      std::fill(outI, outI + n, 1);
+      return;
+      CMPF_CASE(OEQ)
+      CMPF_CASE(OGT)
+      CMPF_CASE(OGE)
+      CMPF_CASE(OLT)
+      CMPF_CASE(OLE)
+      CMPF_CASE(ONE)
+      CMPF_CASE(ORD)
+      CMPF_CASE(UEQ)
+      CMPF_CASE(UGT)
+      CMPF_CASE(UGE)
+      CMPF_CASE(ULT)
+      CMPF_CASE(ULE)
+      CMPF_CASE(UNE)
+      CMPF_CASE(UNO)
+    }
+#undef CMPF_CASE
+    return;
+  }
+  case Opcode::kSelect: {
+    auto c = static_cast<const std::int64_t *>(operands[0]);
+    if (type == ScalarType::kF32)
+      return select32(out32, c, static_cast<const float *>(operands[1]),
+                      static_cast<const float *>(operands[2]), n);
+    if (type == ScalarType::kF64)
+      return select64(out64, c, static_cast<const double *>(operands[1]),
+                      static_cast<const double *>(operands[2]), n);
+    return selectI(outI, c, static_cast<const std::int64_t *>(operands[1]),
+                   static_cast<const std::int64_t *>(operands[2]), n);
+  }
+  case Opcode::kExtF:
+    return extF(out64, a32, n);
+  case Opcode::kTruncF:
+    return truncF(out32, a64, n);
+  case Opcode::kSIToFP:
+    return f32 ? sIToFP32(out32, aI, n) : sIToFP64(out64, aI, n);
+  case Opcode::kFPToSI:
+    if (instruction.operandType == ScalarType::kF32)
+      fPToSI32(outI, a32, n);
+    else
+      fPToSI64(outI, a64, n);
+    return normalizeInts(outI, type, n);
+  case Opcode::kFPToUI:
+    if (instruction.operandType == ScalarType::kF32)
+      fPToUI32(outU, a32, n);
+    else
+      fPToUI64(outU, a64, n);
+    return normalizeInts(outI, type, n);
+  default:
+    break;
+  }
+#undef FLOAT_CASE
+
+  // Integer ops, which wrap around at the width of their type. Unsigned ops
+  // see their operands zero-extended from it.
+  auto zeroExtendOperands = [&](int count) {
+    for (int i = 0; i < count; ++i)
+      zeroExtendInts(static_cast<const std::int64_t *>(operands[i]),
+                     instruction.operandType, unsignedOperands[i], n);
+    aU = unsignedOperands[0];
+    bU = unsignedOperands[1];
+  };
+  switch (instruction.opcode) {
+  case Opcode::kAddI:
+    addI(outU, aU, bU, n);
+    break;
+  case Opcode::kSubI:
+    subI(outU, aU, bU, n);
+    break;
+  case Opcode::kMulI:
+    mulI(outU, aU, bU, n);
+    break;
+  case Opcode::kAndI:
+    andI(outU, aU, bU, n);
+    break;
+  case Opcode::kOrI:
+    orI(outU, aU, bU, n);
+    break;
+  case Opcode::kXOrI:
+    xOrI(outU, aU, bU, n);
+    break;
+  case Opcode::kShLI:
+    zeroExtendOperands(2);
+    shLI(outU, static_cast<const std::uint64_t *>(operands[0]), bU, n);
+    break;
+  case Opcode::kShRSI:
+    zeroExtendOperands(2);
+    shRSI(outI, aI, reinterpret_cast<const std::int64_t *>(bU), n);
+    break;
+  case Opcode::kShRUI:
+    zeroExtendOperands(2);
+    shRUI(outU, aU, bU, n);
+    break;
+  case Opcode::kDivSI:
+    divSI(outI, aI, bI, n);
+    break;
+  case Opcode::kRemSI:
+    remSI(outI, aI, bI, n);
+    break;
+  case Opcode::kDivUI:
+    zeroExtendOperands(2);
+    divUI(outU, aU, bU, n);
+    break;
+  case Opcode::kRemUI:
+    zeroExtendOperands(2);
+    remUI(outU, aU, bU, n);
+    break;
+  case Opcode::kCmpI:
+    switch (static_cast<CmpIPredicate>(instruction.predicate)) {
+    case CmpIPredicate::kEQ:
+      return cmpEQ(outI, aI, bI, n);
+    case CmpIPredicate::kNE:
+      return cmpNE(outI, aI, bI, n);
+    case CmpIPredicate::kSLT:
+      return cmpSLT(outI, aI, bI, n);
+    case CmpIPredicate::kSLE:
+      return cmpSLE(outI, aI, bI, n);
+    case CmpIPredicate::kSGT:
+      return cmpSGT(outI, aI, bI, n);
+    case CmpIPredicate::kSGE:
+      return cmpSGE(outI, aI, bI, n);
+    case CmpIPredicate::kULT:
+      zeroExtendOperands(2);
+      return cmpULT(outI, aU, bU, n);
+    case CmpIPredicate::kULE:
+      zeroExtendOperands(2);
+      return cmpULE(outI, aU, bU, n);
+    case CmpIPredicate::kUGT:
+      zeroExtendOperands(2);
+      return cmpUGT(outI, aU, bU, n);
+    case CmpIPredicate::kUGE:
+      zeroExtendOperands(2);
+      return cmpUGE(outI, aU, bU, n);
+    }
+    return;
+  case Opcode::kUIToFP:
+    zeroExtendOperands(1);
+    return f32 ? uIToFP32(out32, aU, n) : uIToFP64(out64, aU, n);
+  case Opcode::kExtSI:
+    // i1 is stored as 0 or 1, which sign-extends to 0 or -1.
+    if (instruction.operandType == ScalarType::kI1) {
+      for (std::int64_t i = 0; i < n; ++i)
+        outI[i] = -aI[i];
+      return;
+    }
+    std::copy(aI, aI + n, outI);
+    return;
+  case Opcode::kExtUI:
+    zeroExtendOperands(1);
+    std::copy(aU, aU + n, outU);
+    return;
+  case Opcode::kTruncI:
+    std::copy(aI, aI + n, outI);
+    break;
+  default:
+    break;
+  }
+  normalizeInts(outI, type, n);
+}
+
+//===----------------------------------------------------------------------===//
+// Tensors.
+//===----------------------------------------------------------------------===//
+
+static std::int64_t getByteSize(ScalarType type) {
+  switch (type) {
+  case ScalarType::kI1:
+  case ScalarType::kI8:
+    return 1;
+  case ScalarType::kF32:
+  case ScalarType::kI32:
+    return 4;
+  case ScalarType::kF64:
+  case ScalarType::kI64:
+    return 8;
+  }
+  return 8;
+}
+
+namespace {
+// The buffer of one or more tensors.
+struct Storage {
+  explicit Storage(void *allocated) : allocated(allocated) {}
+  Storage(const Storage &) = delete;
+  Storage &operator=(const Storage &) = delete;
+  ~Storage() { deallocate(allocated); }
+  // Allocated with refbackrt::allocate, and owned by the storage. Null once
+  // handed over to the caller.
+  void *allocated;
+};
+
+// A tensor value of the function being run.
+struct TensorValue {
+  // Null for buffers that the interpreter doesn't own, such as those of the
+  // inputs and constants, which it never writes to.
+  std::shared_ptr<Storage> storage;
+  char *data = nullptr;
+  ScalarType elementType = ScalarType::kF32;
+  std::vector<std::int64_t> extents;
+  std::vector<std::int64_t> strides;
+
+  std::int64_t getNumElements() const {
+    std::int64_t numElements = 1;
+    for (std::int64_t extent : extents)
+      numElements *= extent;
+    return numElements;
+  }
+
+  // Returns true if the tensor can be overwritten: no other value uses its
+  // buffer.
+  bool isUniquelyOwned() const {
+    return storage && storage->allocated && storage.use_count() == 1;
+  }
+};
+
+struct SlotValue {
+  Scalar scalar = {};
+  TensorValue tensor;
+};
+} // namespace
+
+static std::vector<std::int64_t>
+getContiguousStrides(const std::vector<std::int64_t> &extents) {
+  std::vector<std::int64_t> strides(extents.size());
+  std::int64_t stride = 1;
+  for (int i = extents.size() - 1; i >= 0; --i) {
+    strides[i] = stride;
+    stride *= extents[i];
+  }
+  return strides;
+}
+
+static TensorValue allocateTensor(ScalarType elementType,
+                                  std::vector<std::int64_t> extents) {
+  TensorValue tensor;
+  tensor.elementType = elementType;
+  tensor.strides = getContiguousStrides(extents);
+  tensor.extents = std::move(extents);
+  std::size_t bytes = tensor.getNumElements() * getByteSize(elementType);
+  void *buffer = allocate(std::max<std::size_t>(bytes, 1));
+  tensor.storage = std::make_shared<Storage>(buffer);
+  tensor.data = static_cast<char *>(buffer);
+  return tensor;
+}
+
+// Copies the elements of `src` into the contiguous buffer `dest`.
+static void copyToContiguous(const TensorValue &src, char *dest) {
+  std::int64_t elementBytes = getByteSize(src.elementType);
+  std::int64_t numElements = src.getNumElements();
+  if (numElements == 0)
+    return;
+  int rank = src.extents.size();
+  if (src.strides == getContiguousStrides(src.extents)) {
+    std::memcpy(dest, src.data, numElements * elementBytes);
+    return;
+  }
+  std::vector<std::int64_t> index(rank);
+  for (std::int64_t i = 0; i < numElements; ++i) {
+    std::int64_t offset = 0;
+    for (int d = 0; d < rank; ++d)
+      offset += index[d] * src.strides[d];
+    std::memcpy(dest + i * elementBytes, src.data + offset * elementBytes,
+                elementBytes);
+    for (int d = rank - 1; d >= 0 && ++index[d] == src.extents[d]; --d)
+      index[d] = 0;
+  }
+}
+
+// Returns a new tensor with the contents of `src`.
+static TensorValue copyTensor(const TensorValue &src) {
+  TensorValue copy = allocateTensor(src.elementType, src.extents);
+  copyToContiguous(src, copy.data);
+  return copy;
+}
+
+static Scalar loadScalar(ScalarType type, const char *element) {
+  Scalar scalar;
+  switch (type) {
+  case ScalarType::kF32:
+    std::memcpy(&scalar.f32, element, sizeof(float));
+    break;
+  case ScalarType::kF64:
+    std::memcpy(&scalar.f64, element, sizeof(double));
+    break;
+  case ScalarType::kI1:
+  case ScalarType::kI8:
+    scalar.i64 = *reinterpret_cast<const std::int8_t *>(element);
+    break;
+  case ScalarType::kI32: {
+    std::int32_t value;
+    std::memcpy(&value, element, sizeof(value));
+    scalar.i64 = value;
+    break;
+  }
+  case ScalarType::kI64:
+    std::memcpy(&scalar.i64, element, sizeof(std::int64_t));
+    break;
+  }
+  return scalar;
+}
+
+static void storeScalar(ScalarType type, Scalar scalar, char *element) {
+  switch (type) {
+  case ScalarType::kF32:
+    std::memcpy(element, &scalar.f32, sizeof(float));
+    break;
+  case ScalarType::kF64:
+    std::memcpy(element, &scalar.f64, sizeof(double));
+    break;
+  case ScalarType::kI1:
+  case ScalarType::kI8:
+    *reinterpret_cast<std::int8_t *>(element) =
+        static_cast<std::int8_t>(scalar.i64);
+    break;
+  case ScalarType::kI32: {
+    auto value = static_cast<std::int32_t>(scalar.i64);
+    std::memcpy(element, &value, sizeof(value));
+    break;
+  }
+  case ScalarType::kI64:
+    std::memcpy(element, &scalar.i64, sizeof(std::int64_t));
+    break;
+  }
+}
+
+// Fills the contiguous `tensor` with `scalar`.
+static void fillTensor(TensorValue &tensor, Scalar scalar) {
+  std::int64_t numElements = tensor.getNumElements();
+  switch (tensor.elementType) {
+  case ScalarType::kF32: {
+    auto *data = reinterpret_cast<float *>(tensor.data);
+    std::fill(data, data + numElements, scalar.f32);
+    return;
+  }
+  case ScalarType::kF64: {
+    auto *data = reinterpret_cast<double *>(tensor.data);
+    std::fill(data, data + numElements, scalar.f64);
+    return;
+  }
+  case ScalarType::kI1:
+  case ScalarType::kI8:
+    std::memset(tensor.data, static_cast<std::int8_t>(scalar.i64),
+                numElements);
+    return;
+  case ScalarType::kI32: {
+    auto *data = reinterpret_cast<std::int32_t *>(tensor.data);
+    std::fill(data, data + numElements,
+              static_cast<std::int32_t>(scalar.i64));
+    return;
+  }
+  case ScalarType::kI64: {
+    auto *data = reinterpret_cast<std::int64_t *>(tensor.data);
+    std::fill(data, data + numElements, scalar.i64);
+    return;
+  }
+  }
+}
+
+//===----------------------------------------------------------------------===//
+// Registers.
+//===----------------------------------------------------------------------===//
+
+// Loads `n` elements of `type`, `stride` elements apart from `element`, into
+// the lanes of `reg`.
+static void loadLanes(ScalarType type, const char *element,
+                      std::int64_t stride, std::int64_t n, void *reg) {
+  auto load = [&](auto *lanes, const auto *elements) {
+    if (stride == 1) {
+      for (std::int64_t i = 0; i < n; ++i)
+        lanes[i] = elements[i];
+    } else if (stride == 0) {
+      std::fill(lanes, lanes + n, elements[0]);
+    } else {
+      for (std::int64_t i = 0; i < n; ++i)
+        lanes[i] = elements[i * stride];
+    }
+  };
+  switch (type) {
+  case ScalarType::kF32:
+    return load(static_cast<float *>(reg),
+                reinterpret_cast<const float *>(element));
+  case ScalarType::kF64:
+    return load(static_cast<double *>(reg),
+                reinterpret_cast<const double *>(element));
+  case ScalarType::kI1:
+  case ScalarType::kI8:
+    return load(static_cast<std::int64_t *>(reg),
+                reinterpret_cast<const std::int8_t *>(element));
+  case ScalarType::kI32:
+    return load(static_cast<std::int64_t *>(reg),
+                reinterpret_cast<const std::int32_t *>(element));
+  case ScalarType::kI64:
+    return load(static_cast<std::int64_t *>(reg),
+                reinterpret_cast<const std::int64_t *>(element));
+  }
+}
+
+// Stores the `n` lanes of `reg` into elements of `type`, `stride` elements
+// apart from `element`. A zero stride stores the last lane.
+static void storeLanes(ScalarType type, const void *reg, char *element,
+                       std::int64_t stride, std::int64_t n) {
+  auto store = [&](const auto *lanes, auto *elements) {
+    using T = std::remove_reference_t<decltype(*elements)>;
+    if (stride == 0) {
+      elements[0] = static_cast<T>(lanes[n - 1]);
+      return;
+    }
+    for (std::int64_t i = 0; i < n; ++i)
+      elements[i * stride] = static_cast<T>(lanes[i]);
+  };
+  switch (type) {
+  case ScalarType::kF32:
+    return store(static_cast<const float *>(reg),
+                 reinterpret_cast<float *>(element));
+  case ScalarType::kF64:
+    return store(static_cast<const double *>(reg),
+                 reinterpret_cast<double *>(element));
+  case ScalarType::kI1:
+  case ScalarType::kI8:
+    return store(static_cast<const std::int64_t *>(reg),
+                 reinterpret_cast<std::int8_t *>(element));
+  case ScalarType::kI32:
+    return store(static_cast<const std::int64_t *>(reg),
+                 reinterpret_cast<std::int32_t *>(element));
+  case ScalarType::kI64:
+    return store(static_cast<const std::int64_t *>(reg),
+                 reinterpret_cast<std::int64_t *>(element));
+  }
+}
+
+// Sets all the lanes of `reg` to `scalar`, of `type`.
+static void broadcastToLanes(ScalarType type, Scalar scalar, void *reg) {
+  if (type == ScalarType::kF32)
+    std::fill(static_cast<float *>(reg), static_cast<float *>(reg) + kLanes,
+              scalar.f32);
+  else if (type == ScalarType::kF64)
+    std::fill(static_cast<double *>(reg), static_cast<double *>(reg) + kLanes,
+              scalar.f64);
+  else
+    std::fill(static_cast<std::int64_t *>(reg),
+              static_cast<std::int64_t *>(reg) + kLanes, scalar.i64);
+}
+
+//===----------------------------------------------------------------------===//
+// Linalg ops.
+//===----------------------------------------------------------------------===//
+
+// The smallest number of payload evaluations worth a task of the thread
+// pool.
+constexpr std::int64_t kMinTaskWork = 1 << 15;
+
+namespace {
+// A linalg op being executed, on tensors of known shapes.
+struct LinalgExecution {
+  const LinalgInstruction *op;
+  // The tensors of the operands: the inputs, then the results, which the
+  // outputs are computed into.
+  std::vector<const TensorValue *> tensors;
+  // The values that the payload captures.
+  std::vector<Scalar> captures;
+  std::vector<std::int64_t> loopExtents;
+  // The address of element 0 of each operand, and the distance, in
+  // elements, between the elements of each operand read by consecutive
+  // iterations of each loop.
+  std::vector<char *> bases;
+  std::vector<std::int64_t> loopStrides;
+  // The loops, outermost first.
+  std::vector<int> order;
+  // The position in `order` of the loop split among threads, or -1.
+  int splitLoop = -1;
+};
+} // namespace
+
+static void prepareLinalgExecution(LinalgExecution &execution) {
+  const LinalgInstruction &op = *execution.op;
+  int numLoops = op.numLoops;
+  int numOperands = op.operands.size();
+  execution.loopExtents.resize(numLoops);
+  for (int l = 0; l < numLoops; ++l)
+    execution.loopExtents[l] =
+        execution.tensors[op.loopExtentOperands[l]]
+            ->extents[op.loopExtentDims[l]];
+  execution.bases.resize(numOperands);
+  execution.loopStrides.assign(numOperands * numLoops, 0);
+  for (int k = 0; k < numOperands; ++k) {
+    const LinalgOperand &operand = op.operands[k];
+    const TensorValue &tensor = *execution.tensors[k];
+    std::int64_t offset = 0;
+    for (int d = 0; d < operand.rank; ++d) {
+      offset += operand.offsets[d] * tensor.strides[d];
+      for (int l = 0; l < numLoops; ++l)
+        execution.loopStrides[k * numLoops + l] +=
+            operand.coefficients[d * numLoops + l] * tensor.strides[d];
+    }
+    execution.bases[k] =
+        tensor.data + offset * getByteSize(operand.elementType);
+  }
+
+  for (int l = 0; l < numLoops; ++l)
+    if (op.isReduction[l])
+      execution.order.push_back(l);
+  int numReductions = execution.order.size();
+  for (int l = 0; l < numLoops; ++l)
+    if (!op.isReduction[l])
+      execution.order.push_back(l);
+
+  // Split the outermost parallel loop among threads, if each of its
+  // iterations writes different elements of the outputs.
+  if (numReductions == numLoops)
+    return;
+  int split = execution.order[numReductions];
+  for (int k = op.numInputs; k < numOperands; ++k)
+    if (execution.loopStrides[k * numLoops + split] == 0)
+      return;
+  execution.splitLoop = numReductions;
+}
+
+// Runs the iterations of `execution` whose index along the split loop is in
+// [begin, end).
+static void runLinalgRange(const LinalgExecution &execution,
+                           std::int64_t begin, std::int64_t end) {
+  const LinalgInstruction &op = *execution.op;
+  int numLoops = op.numLoops;
+  int numOperands = op.operands.size();
+  int numRegisters = op.registerTypes.size();
+  std::vector<std::int64_t> registers(numRegisters * kLanes);
+  auto getRegister = [&](int r) -> void * {
+    return registers.data() + r * kLanes;
+  };
+  for (int i = 0, e = op.constantRegisters.size(); i < e; ++i)
+    broadcastToLanes(op.registerTypes[op.constantRegisters[i]],
+                     op.constants[i], getRegister(op.constantRegisters[i]));
+  for (int i = 0, e = op.captureRegisters.size(); i < e; ++i)
+    broadcastToLanes(op.registerTypes[op.captureRegisters[i]],
+                     execution.captures[op.captures[i]],
+                     getRegister(op.captureRegisters[i]));
+
+  // The range of each loop, by position in `order`.
+  std::vector<std::int64_t> lower(numLoops, 0), upper(numLoops);
+  for (int i = 0; i < numLoops; ++i)
+    upper[i] = execution.loopExtents[execution.order[i]];
+  if (execution.splitLoop >= 0) {
+    lower[execution.splitLoop] = begin;
+    upper[execution.splitLoop] = end;
+  }
+  for (int i = 0; i < numLoops; ++i)
+    if (lower[i] >= upper[i])
+      return;
+
+  // The iterations of the innermost loop are evaluated `lanes` at a time,
+  // unless it is a reduction.
+  int inner = numLoops - 1;
+  int innerLoop = numLoops ? execution.order[inner] : -1;
+  std::int64_t lanes = numLoops && !op.isReduction[innerLoop] ? kLanes : 1;
+  std::vector<std::int64_t> index(numLoops);
+  for (int i = 0; i < numLoops; ++i)
+    index[execution.order[i]] = lower[i];
+  std::vector<char *> elements(numOperands);
+  while (true) {
+    std::int64_t n =
+        numLoops ? std::min(lanes, upper[inner] - index[innerLoop]) : 1;
+    for (int k = 0; k < numOperands; ++k) {
+      std::int64_t offset = 0;
+      for (int l = 0; l < numLoops; ++l)
+        offset += index[l] * execution.loopStrides[k * numLoops + l];
+      elements[k] =
+          execution.bases[k] + offset * getByteSize(op.operands[k].elementType);
+    }
+    auto getLaneStride = [&](int k) -> std::int64_t {
+      return numLoops ? execution.loopStrides[k * numLoops + innerLoop] : 0;
+    };
+    for (int k = 0; k < numOperands; ++k) {
+      if (k >= op.numInputs && !op.readsOutput[k - op.numInputs])
+        continue;
+      loadLanes(op.operands[k].elementType, elements[k], getLaneStride(k), n,
+                getRegister(k));
+    }
+    for (int i = 0, e = op.loopIndexRegisters.size(); i < e; ++i) {
+      auto *reg = static_cast<std::int64_t *>(
+          getRegister(op.loopIndexRegisters[i]));
+      int l = op.loopIndices[i];
+      for (std::int64_t j = 0; j < n; ++j)
+        reg[j] = index[l] + (l == innerLoop ? j : 0);
+    }
+    for (const ScalarInstruction &instruction : op.body) {
+      void *operands[3] = {};
+      for (int i = 0; i < 3; ++i)
+        if (instruction.operands[i] >= 0)
+          operands[i] = getRegister(instruction.operands[i]);
+      applyScalarInstruction(instruction, getRegister(instruction.result),
+                             operands, n);
+    }
+    for (int j = 0, e = op.yields.size(); j < e; ++j) {
+      int k = op.numInputs + j;
+      storeLanes(op.operands[k].elementType, getRegister(op.yields[j]),
+                 elements[k], getLaneStride(k), n);
+    }
+
+    if (numLoops == 0)
+      return;
+    index[innerLoop] += n;
+    int i = inner;
+    while (i >= 0 && index[execution.order[i]] >= upper[i]) {
+      index[execution.order[i]] = lower[i];
+      --i;
+      if (i >= 0)
+        index[execution.order[i]] += 1;
+    }
+    if (i < 0)
+      return;
+  }
+}
+
+// Computes `rows` rows of the f32 matmul C += A * B, with `k` columns of A
+// and `n` columns of B and C, whose columns are contiguous.
+NPCOMP_INTERP_KERNEL static void
+matmulRowsF32(float *c, std::int64_t cStride, const float *a,
+              std::int64_t aRowStride, std::int64_t aColumnStride,
+              const float *b, std::int64_t bStride, std::int64_t rows,
+              std::int64_t k, std::int64_t n) {
+  // Blocks of columns of C, whose rows stay in the L1 cache while the rows
+  // of B stream through.
+  constexpr std::int64_t kBlockColumns = 512;
+  for (std::int64_t jb = 0; jb < n; jb += kBlockColumns) {
+    std::int64_t columns = std::min(kBlockColumns, n - jb);
+    std::int64_t i = 0;
+    for (; i + 4 <= rows; i += 4) {
+      float *__restrict c0 = c + i * cStride + jb;
+      float *__restrict c1 = c0 + cStride;
+      float *__restrict c2 = c1 + cStride;
+      float *__restrict c3 = c2 + cStride;
+      const float *a0 = a + i * aRowStride;
+      for (std::int64_t p = 0; p < k; ++p) {
+        const float *__restrict bRow = b + p * bStride + jb;
+        float x0 = a0[p * aColumnStride];
+        float x1 = a0[aRowStride + p * aColumnStride];
+        float x2 = a0[2 * aRowStride + p * aColumnStride];
+        float x3 = a0[3 * aRowStride + p * aColumnStride];
+        for (std::int64_t j = 0; j < columns; ++j) {
+          float y = bRow[j];
+          c0[j] += x0 * y;
+          c1[j] += x1 * y;
+          c2[j] += x2 * y;
+          c3[j] += x3 * y;
+        }
+      }
+    }
+    for (; i < rows; ++i) {
+      float *__restrict cRow = c + i * cStride + jb;
+      for (std::int64_t p = 0; p < k; ++p) {
+        const float *__restrict bRow = b + p * bStride + jb;
+        float x = a[i * aRowStride + p * aColumnStride];
+        for (std::int64_t j = 0; j < columns; ++j)
+          cRow[j] += x * bRow[j];
+      }
+    }
+  }
+}
+
+// Runs a matmul or batch matmul with the matmul kernel. Returns false if the
+// operands aren't laid out for it.
+static bool runMatmul(const LinalgExecution &execution) {
+  const LinalgInstruction &op = *execution.op;
+  bool batched = op.kernel == LinalgKernel::kBatchMatmul;
+  const TensorValue &a = *execution.tensors[0];
+  const TensorValue &b = *execution.tensors[1];
+  const TensorValue &c = *execution.tensors[2];
+  int rank = batched ? 3 : 2;
+  if (b.strides[rank - 1] != 1 || c.strides[rank - 1] != 1)
+    return false;
+  struct Matmul {
+    const TensorValue *a, *b, *c;
+    int rank;
+    std::int64_t rows;
+  } matmul = {&a, &b, &c, rank, c.extents[rank - 2]};
+  std::int64_t batches = batched ? c.extents[0] : 1;
+  std::int64_t k = a.extents[rank - 1];
+  std::int64_t n = c.extents[rank - 1];
+  // Tasks of 4 rows of C, which the kernel computes together.
+  std::int64_t rowBlocks = (matmul.rows + 3) / 4;
+  std::int64_t grain =
+      std::max<std::int64_t>(1, kMinTaskWork / std::max<std::int64_t>(
+                                                   1, 4 * k * n));
+  auto body = [](std::int64_t begin, std::int64_t end, void *context) {
+    auto &matmul = *static_cast<Matmul *>(context);
+    const TensorValue &a = *matmul.a, &b = *matmul.b, &c = *matmul.c;
+    int rank = matmul.rank;
+    std::int64_t rowBlocks = (matmul.rows + 3) / 4;
+    for (std::int64_t task = begin; task < end; ++task) {
+      std::int64_t batch = task / rowBlocks;
+      std::int64_t row = task % rowBlocks * 4;
+      std::int64_t rows = std::min<std::int64_t>(4, matmul.rows - row);
+      auto *aData = reinterpret_cast<const float *>(a.data);
+      auto *bData = reinterpret_cast<const float *>(b.data);
+      auto *cData = reinterpret_cast<float *>(c.data);
+      if (rank == 3) {
+        aData += batch * a.strides[0];
+        bData += batch * b.strides[0];
+        cData += batch * c.strides[0];
+      }
+      matmulRowsF32(cData + row * c.strides[rank - 2], c.strides[rank - 2],
+                    aData + row * a.strides[rank - 2], a.strides[rank - 2],
+                    a.strides[rank - 1], bData, b.strides[rank - 2], rows,
+                    a.extents[rank - 1], c.extents[rank - 1]);
+    }
+  };
+  parallelFor(0, batches * rowBlocks, grain, body, &matmul);
+  return true;
+}
+
+static void runLinalg(LinalgExecution &execution) {
+  const LinalgInstruction &op = *execution.op;
+  if (op.kernel != LinalgKernel::kGeneric && runMatmul(execution))
+    return;
+  prepareLinalgExecution(execution);
+  for (std::int64_t extent : execution.loopExtents)
+    if (extent == 0)
+      return;
+  if (execution.splitLoop < 0) {
+    runLinalgRange(execution, 0, 0);
+    return;
+  }
+  std::int64_t work = std::max<std::int64_t>(1, op.body.size());
+  int split = execution.order[execution.splitLoop];
+  for (int l = 0; l < op.numLoops; ++l)
+    if (l != split)
+      work *= execution.loopExtents[l];
+  parallelFor(
+      0, execution.loopExtents[split],
+      std::max<std::int64_t>(1, kMinTaskWork / work),
+      [](std::int64_t begin, std::int64_t end, void *context) {
+        runLinalgRange(*static_cast<const LinalgExecution *>(context), begin,
+                       end);
+      },
+      &execution);
+}
+
+//===----------------------------------------------------------------------===//
+// Functions.
+//===----------------------------------------------------------------------===//
+
+// Executes the linalg op of `instruction` on `slots`.
+static void executeLinalg(const Function &function,
+                          const Instruction &instruction,
+                          std::vector<SlotValue> &slots) {
+  const LinalgInstruction &op = function.linalgOps[instruction.linalgIndex];
+  int numOperands = op.operands.size();
+  // The results are computed in the buffers of their init tensors when
+  // nothing else uses them, and otherwise in new buffers, initialized with
+  // the init tensors if the payload reads them.
+  std::vector<TensorValue> results;
+  for (int k = op.numInputs; k < numOperands; ++k) {
+    int j = k - op.numInputs;
+    const TensorValue &init = slots[instruction.operands[k]].tensor;
+    if (instruction.mayReuseOutput[j] && init.isUniquelyOwned())
+      results.push_back(init);
+    else if (op.readsOutput[j])
+      results.push_back(copyTensor(init));
+    else
+      results.push_back(allocateTensor(init.elementType, init.extents));
+  }
+  LinalgExecution execution;
+  execution.op = &op;
+  for (int k = 0; k < op.numInputs; ++k)
+    execution.tensors.push_back(&slots[instruction.operands[k]].tensor);
+  for (TensorValue &result : results)
+    execution.tensors.push_back(&result);
+  for (int i = numOperands, e = instruction.operands.size(); i < e; ++i)
+    execution.captures.push_back(slots[instruction.operands[i]].scalar);
+  runLinalg(execution);
+  for (int j = 0, e = results.size(); j < e; ++j)
+    slots[instruction.results[j]].tensor = std::move(results[j]);
+}
+
+// Returns `tensor` as a result of the call: its buffer is handed over if
+// nothing else uses it, and copied otherwise.
+static Value takeResult(TensorValue &tensor) {
+  Value result;
+  result.extents = tensor.extents;
+  result.strides = getContiguousStrides(tensor.extents);
+  if (tensor.isUniquelyOwned() && tensor.data == tensor.storage->allocated) {
+    result.data = tensor.storage->allocated;
+    tensor.storage->allocated = nullptr;
+    return result;
+  }
+  std::size_t bytes = tensor.getNumElements() * getByteSize(tensor.elementType);
+  result.data = allocate(std::max<std::size_t>(bytes, 1));
+  copyToContiguous(tensor, static_cast<char *>(result.data));
+  return result;
+}
+
+const char *interp::runFunction(const Function &function,
+                                const std::vector<Value> &inputs,
+                                std::vector<Value> &outputs) {
+  std::vector<SlotValue> slots(function.numSlots);
+  for (int i = 0, e = inputs.size(); i < e; ++i) {
+    const ArgSignature &type = function.inputs[i];
+    if (!type.isTensor) {
+      slots[i].scalar = inputs[i].scalar;
+      continue;
+    }
+    TensorValue &tensor = slots[i].tensor;
+    tensor.data = static_cast<char *>(inputs[i].data);
+    tensor.elementType = type.type;
+    tensor.extents = inputs[i].extents;
+    tensor.strides = inputs[i].strides;
+  }
+
+  for (const Instruction &instruction : function.instructions) {
+    auto operandTensor = [&](int i) -> TensorValue & {
+      return slots[instruction.operands[i]].tensor;
+    };
+    auto operandScalar = [&](int i) -> Scalar & {
+      return slots[instruction.operands[i]].scalar;
+    };
+    SlotValue *result =
+        instruction.results.empty() ? nullptr : &slots[instruction.results[0]];
+    switch (instruction.kind) {
+    case InstructionKind::kScalarConstant:
+      result->scalar = instruction.constant;
+      break;
+    case InstructionKind::kTensorConstant: {
+      const TensorConstant &constant =
+          function.constants[instruction.constantIndex];
+      TensorValue &tensor = result->tensor;
+      tensor.storage = nullptr;
+      tensor.data = const_cast<char *>(constant.data.data());
+      tensor.elementType = constant.elementType;
+      tensor.extents = constant.extents;
+      tensor.strides = getContiguousStrides(constant.extents);
+      break;
+    }
+    case InstructionKind::kScalar: {
+      void *operands[3] = {};
+      for (int i = 0; i < 3; ++i)
+        if (instruction.scalar.operands[i] >= 0)
+          operands[i] = &slots[instruction.scalar.operands[i]].scalar;
+      applyScalarInstruction(
+          instruction.scalar, &slots[instruction.scalar.result].scalar,
+          operands, 1);
+      break;
+    }
+    case InstructionKind::kDim:
+      result->scalar.i64 = operandTensor(0).extents[instruction.dim];
+      break;
+    case InstructionKind::kInitTensor: {
+      std::vector<std::int64_t> extents = instruction.extents;
+      int dynamic = 0;
+      for (std::int64_t &extent : extents)
+        if (extent < 0)
+          extent = operandScalar(dynamic++).i64;
+      result->tensor = allocateTensor(instruction.type, std::move(extents));
+      break;
+    }
+    case InstructionKind::kFill: {
+      TensorValue &init = operandTensor(1);
+      TensorValue filled = instruction.mayReuseOutput[0] &&
+                                   init.isUniquelyOwned()
+                               ? init
+                               : allocateTensor(init.elementType, init.extents);
+      fillTensor(filled, operandScalar(0));
+      result->tensor = std::move(filled);
+      break;
+    }
+    case InstructionKind::kLinalg:
+      executeLinalg(function, instruction, slots);
+      break;
+    case InstructionKind::kExtract: {
+      const TensorValue &tensor = operandTensor(0);
+      std::int64_t offset = 0;
+      for (int d = 0, e = tensor.extents.size(); d < e; ++d)
+        offset += operandScalar(d + 1).i64 * tensor.strides[d];
+      result->scalar =
+          loadScalar(tensor.elementType,
+                     tensor.data + offset * getByteSize(tensor.elementType));
+      break;
+    }
+    case InstructionKind::kFromElements: {
+      TensorValue tensor =
+          allocateTensor(instruction.type, instruction.extents);
+      std::int64_t elementBytes = getByteSize(instruction.type);
+      for (int i = 0, e = instruction.operands.size(); i < e; ++i)
+        storeScalar(instruction.type, operandScalar(i),
+                    tensor.data + i * elementBytes);
+      result->tensor = std::move(tensor);
+      break;
+    }
+    case InstructionKind::kCast:
+      result->tensor = operandTensor(0);
+      break;
+    case InstructionKind::kAssert:
+      if (!operandScalar(0).i64)
+        return instruction.message.c_str();
+      break;
+    case InstructionKind::kReturn:
+      outputs.clear();
+      for (int i = 0, e = instruction.operands.size(); i < e; ++i) {
+        if (function.outputs[i].isTensor) {
+          outputs.push_back(takeResult(operandTensor(i)));
+        } else {
+          Value output;
+          output.scalar = operandScalar(i);
+          outputs.push_back(std::move(output));
+        }
+      }
+      return nullptr;
+    }
+    for (std::int32_t slot : instruction.lastUses)
+      slots[slot] = SlotValue();
+  }
+  return nullptr;
+}
+
+//===----------------------------------------------------------------------===//
+// Module descriptors.
+//===----------------------------------------------------------------------===//
+
+static ABIElementType getABIElementType(ScalarType type) {
+  switch (type) {
+  case ScalarType::kF32:
+    return ABIElementType::kF32;
+  case ScalarType::kI1:
+    return ABIElementType::kI1;
+  case ScalarType::kI8:
+    return ABIElementType::kI8;
+  case ScalarType::kI32:
+    return ABIElementType::kI32;
+  case ScalarType::kI64:
+    return ABIElementType::kI64;
+  case ScalarType::kF64:
+    break;
+  }
+  return ABIElementType::kNone;
+}
+
+static ABIArgType getABIArgType(const ArgSignature &type) {
+  if (type.isTensor)
+    return ABIArgType::kMemref;
+  switch (type.type) {
+  case ScalarType::kF32:
+    return ABIArgType::kF32;
+  case ScalarType::kF64:
+    return ABIArgType::kF64;
+  case ScalarType::kI1:
+    return ABIArgType::kI1;
+  case ScalarType::kI32:
+    return ABIArgType::kI32;
+  case ScalarType::kI64:
+    return ABIArgType::kI64;
+  case ScalarType::kI8:
+    break;
+  }
+  return ABIArgType::kNone;
+}
+
+// Returns the size in bytes of the tensors of `types`, or -1 if one of them
+// has a dynamic shape.
+static std::int64_t getTotalBytes(const std::vector<ArgSignature> &types) {
+  std::int64_t total = 0;
+  for (const ArgSignature &type : types) {
+    if (!type.isTensor)
+      continue;
+    std::int64_t bytes = getByteSize(type.type);
+    for (std::int64_t extent : type.extents) {
+      if (extent < 0)
+        return -1;
+      bytes *= extent;
+    }
+    total += bytes;
+  }
+  return total;
+}
+
+struct Module::Descriptors {
+  std::vector<FuncDescriptor> functions;
+  std::vector<std::vector<InputDescriptor>> inputs;
+  std::vector<std::vector<OutputDescriptor>> outputs;
+  ModuleDescriptor module;
+};
+
+Module::Module(std::vector<Function> functionsToOwn)
+    : functions(std::move(functionsToOwn)),
+      descriptors(std::make_unique<Descriptors>()) {
+  // The runtime binary searches the functions by name.
+  std::sort(functions.begin(), functions.end(),
+            [](const Function &lhs, const Function &rhs) {
+              return lhs.name < rhs.name;
+            });
+  for (Function &function : functions) {
+    std::vector<InputDescriptor> inputs;
+    for (ArgSignature &type : function.inputs)
+      inputs.push_back({getABIArgType(type), getABIElementType(type.type),
+                        static_cast<std::int32_t>(type.extents.size()),
+                        type.extents.data(), /*isReadOnly=*/1});
+    std::vector<OutputDescriptor> outputs;
+    for (ArgSignature &type : function.outputs)
+      outputs.push_back({getABIArgType(type), getABIElementType(type.type),
+                         static_cast<std::int32_t>(type.extents.size()),
+                         type.extents.data(), ABIOutputOwnership::kOwned,
+                         /*aliasIndex=*/-1});
+    descriptors->inputs.push_back(std::move(inputs));
+    descriptors->outputs.push_back(std::move(outputs));
+
+    std::int64_t constantBytes = 0;
+    for (const TensorConstant &constant : function.constants)
+      constantBytes += constant.data.size();
+    descriptors->functions.push_back(
+        {static_cast<std::int32_t>(function.name.size()),
+         function.name.data(), /*functionPtr=*/nullptr,
+         static_cast<std::int32_t>(function.inputs.size()),
+         static_cast<std::int32_t>(function.outputs.size()),
+         descriptors->inputs.back().data(),
+         descriptors->outputs.back().data(), /*peakScratchBytes=*/-1,
+         /*directFunctionPtr=*/nullptr, constantBytes,
+         getTotalBytes(function.inputs), getTotalBytes(function.outputs),
+         &function});
+  }
+  descriptors->module.numFuncDescriptors = descriptors->functions.size();
+  descriptors->module.functionDescriptors = descriptors->functions.data();
+}
+
+Module::~Module() = default;
+
+ModuleDescriptor *Module::getDescriptor() const {
+  return &descriptors->module;
+}
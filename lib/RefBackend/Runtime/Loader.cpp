@@ -0,0 +1,286 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Loader for the shared objects produced by `npcomp-compile`.
+//
+// Compiled code calls each compiler runtime function `__npcomp_compiler_rt_*`
+// through a function pointer `__npcomp_compiler_rt_*_ptr` exported by the
+// shared object, which the loader points at the functions below before
+// handing out the module descriptor.
+//
+// Shared objects compiled with `-external-weights` list the files storing
+// their external weights in `__npcomp_external_weights`, and read each weight
+// through a pointer that the loader sets into a read-only mapping of its file.
+//
+// Shared objects compiled with `-compress-weights` instead embed their weights
+// compressed (see WeightCompression.h), listed in
+// `__npcomp_compressed_weights`. The loader decompresses all of them at once,
+// in parallel on the runtime's thread pool, and points the compiled code at
+// the decompressed copies.
+//
+//===----------------------------------------------------------------------===//
+
+#include "npcomp/RefBackend/Runtime/UserAPI.h"
+#include "npcomp/RefBackend/Runtime/WeightCompression.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace refbackrt;
+
+static void compilerRtAbortIf(bool b, const char *msg) {
+  if (b) {
+    std::fprintf(stderr, "NPCOMP: aborting: %s\n", msg);
+    std::exit(1);
+  }
+}
+static void *compilerRtAlloc(std::int64_t size) {
+  return allocateAt(size, "compiled code");
+}
+static void compilerRtFree(void *ptr) { deallocateAt(ptr, "compiled code"); }
+static void *compilerRtAllocAt(std::int64_t size, const char *site) {
+  return allocateAt(size, site);
+}
+static void compilerRtFreeAt(void *ptr, const char *site) {
+  deallocateAt(ptr, site);
+}
+static void *compilerRtScratchAlloc(std::int64_t size) {
+  return allocateScratch(size);
+}
+static void compilerRtParallelFor(std::int64_t begin, std::int64_t end,
+                                  std::int64_t grainSize,
+                                  ParallelForBody body, void *context) {
+  parallelFor(begin, end, grainSize, body, context);
+}
+static std::int64_t compilerRtProfileBegin() { return beginProfiledOp(); }
+static void compilerRtProfileEnd(const char *name, std::int64_t start) {
+  endProfiledOp(name, start);
+}
+static void compilerRtPrefetch(std::uint8_t *prefetched, const void *ptr,
+                               std::int64_t size) {
+  auto *flag = reinterpret_cast<std::atomic<std::uint8_t> *>(prefetched);
+  if (!flag->load(std::memory_order_relaxed) &&
+      !flag->exchange(1, std::memory_order_relaxed))
+    prefetchPages(ptr, size);
+}
+
+#ifndef _WIN32
+// Points the function pointer `name` of the shared object `handle` at
+// `function`, if the compiled code references it.
+template <typename T>
+static void bindCompilerRtFunction(void *handle, const char *name,
+                                   T *function) {
+  if (void *pointer = dlsym(handle, name))
+    *static_cast<T **>(pointer) = function;
+}
+
+namespace {
+// An entry of the `__npcomp_external_weights` table emitted by npcomp-compile.
+struct ExternalWeightsEntry {
+  // The file storing the weights, relative to the directory of the shared
+  // object unless absolute. Null in the entry terminating the table.
+  const char *path;
+  std::int64_t offset;
+  std::int64_t size;
+  // The pointer through which the compiled code reads the weights.
+  const void **pointer;
+};
+
+// An entry of the `__npcomp_compressed_weights` table emitted by
+// npcomp-compile.
+struct CompressedWeightsEntry {
+  // The compressed weights. Null in the entry terminating the table.
+  const char *data;
+  std::int64_t compressedSize;
+  // The size of the decompressed weights.
+  std::int64_t size;
+  // The pointer through which the compiled code reads the weights.
+  const void **pointer;
+};
+
+struct MappedFile {
+  std::string path;
+  void *data;
+  std::size_t size;
+};
+} // namespace
+
+// Maps the files listed by the `__npcomp_external_weights` table of the shared
+// object `handle`, if any, and points the compiled code at the weights. Files
+// are mapped read-only and whole, once each, so that their pages are only
+// read as the compiled code touches them. Returns false on failure, with
+// `errorMessage` set and nothing left mapped.
+static bool mapExternalWeights(void *handle, std::string &errorMessage) {
+  auto *table = static_cast<ExternalWeightsEntry *>(
+      dlsym(handle, "__npcomp_external_weights"));
+  if (!table)
+    return true;
+  std::string directory;
+  Dl_info info;
+  if (dladdr(table, &info) && info.dli_fname) {
+    directory = info.dli_fname;
+    directory.erase(directory.find_last_of('/') + 1);
+  }
+
+  std::vector<MappedFile> files;
+  auto fail = [&](const std::string &message) {
+    for (MappedFile &file : files)
+      munmap(file.data, file.size);
+    errorMessage = message;
+    return false;
+  };
+  for (ExternalWeightsEntry *entry = table; entry->path; ++entry) {
+    std::string path = entry->path;
+    if (path.empty() || path[0] != '/')
+      path = directory + path;
+    MappedFile *file = nullptr;
+    for (MappedFile &mapped : files)
+      if (mapped.path == path)
+        file = &mapped;
+    if (!file) {
+      int fd = open(path.c_str(), O_RDONLY);
+      if (fd < 0)
+        return fail("could not open external weights " + path);
+      struct stat status;
+      void *data = MAP_FAILED;
+      if (fstat(fd, &status) == 0 && status.st_size > 0)
+        data = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      close(fd);
+      if (data == MAP_FAILED)
+        return fail("could not map external weights " + path);
+      files.push_back({path, data, static_cast<std::size_t>(status.st_size)});
+      file = &files.back();
+    }
+    if (entry->offset < 0 || entry->size < 0 ||
+        static_cast<std::size_t>(entry->offset + entry->size) > file->size)
+      return fail("external weights " + path + " are too small");
+    *entry->pointer = static_cast<char *>(file->data) + entry->offset;
+  }
+  return true;
+}
+
+// Decompresses the weights listed by the `__npcomp_compressed_weights` table
+// of the shared object `handle`, if any, into buffers from allocateHugePages,
+// and points the compiled code at them. The blocks of all the weights are
+// decompressed by one parallel loop. Returns false on failure, with
+// `errorMessage` set and nothing left allocated.
+static bool decompressWeights(void *handle, std::string &errorMessage) {
+  auto *table = static_cast<CompressedWeightsEntry *>(
+      dlsym(handle, "__npcomp_compressed_weights"));
+  if (!table)
+    return true;
+
+  std::vector<std::pair<void *, std::size_t>> buffers;
+  auto fail = [&](const std::string &message) {
+    for (auto &buffer : buffers)
+      deallocateHugePages(buffer.first, buffer.second);
+    errorMessage = message;
+    return false;
+  };
+  std::vector<CompressedWeightsBlock> blocks;
+  for (CompressedWeightsEntry *entry = table; entry->data; ++entry) {
+    if (entry->compressedSize < 0 || entry->size < 0)
+      return fail("malformed compressed weights");
+    std::size_t size = std::max<std::size_t>(entry->size, 1);
+    void *buffer = allocateHugePages(size);
+    if (!buffer)
+      return fail("could not allocate " + std::to_string(entry->size) +
+                  " bytes of decompressed weights");
+    buffers.emplace_back(buffer, size);
+    if (!getCompressedWeightsBlocks(entry->data, entry->compressedSize,
+                                    buffer, entry->size, blocks))
+      return fail("malformed compressed weights");
+  }
+
+  struct Context {
+    const std::vector<CompressedWeightsBlock> *blocks;
+    std::atomic<bool> failed;
+  } context{&blocks, {false}};
+  parallelFor(
+      0, blocks.size(), /*grainSize=*/1,
+      [](std::int64_t begin, std::int64_t end, void *opaque) {
+        auto *context = static_cast<Context *>(opaque);
+        for (std::int64_t i = begin; i < end; ++i)
+          if (!decompressWeightsBlock((*context->blocks)[i]))
+            context->failed.store(true, std::memory_order_relaxed);
+      },
+      &context);
+  if (context.failed.load())
+    return fail("malformed compressed weights");
+
+  std::size_t i = 0;
+  for (CompressedWeightsEntry *entry = table; entry->data; ++entry)
+    *entry->pointer = buffers[i++].first;
+  return true;
+}
+#endif
+
+ModuleDescriptor *refbackrt::loadModule(const char *path,
+                                        const char **errorMessage) {
+  const char *ignoredErrorMessage;
+  if (!errorMessage)
+    errorMessage = &ignoredErrorMessage;
+#ifdef _WIN32
+  (void)path;
+  *errorMessage = "loading compiled modules is not supported on Windows";
+  return nullptr;
+#else
+  void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (!handle) {
+    *errorMessage = dlerror();
+    return nullptr;
+  }
+  bindCompilerRtFunction(handle, "__npcomp_compiler_rt_abort_if_ptr",
+                         compilerRtAbortIf);
+  bindCompilerRtFunction(handle, "__npcomp_compiler_rt_alloc_ptr",
+                         compilerRtAlloc);
+  bindCompilerRtFunction(handle, "__npcomp_compiler_rt_free_ptr",
+                         compilerRtFree);
+  bindCompilerRtFunction(handle, "__npcomp_compiler_rt_alloc_at_ptr",
+                         compilerRtAllocAt);
+  bindCompilerRtFunction(handle, "__npcomp_compiler_rt_free_at_ptr",
+                         compilerRtFreeAt);
+  bindCompilerRtFunction(handle, "__npcomp_compiler_rt_scratch_alloc_ptr",
+                         compilerRtScratchAlloc);
+  bindCompilerRtFunction(handle, "__npcomp_compiler_rt_parallel_for_ptr",
+                         compilerRtParallelFor);
+  bindCompilerRtFunction(handle, "__npcomp_compiler_rt_profile_begin_ptr",
+                         compilerRtProfileBegin);
+  bindCompilerRtFunction(handle, "__npcomp_compiler_rt_profile_end_ptr",
+                         compilerRtProfileEnd);
+  bindCompilerRtFunction(handle, "__npcomp_compiler_rt_prefetch_ptr",
+                         compilerRtPrefetch);
+  void *descriptor = dlsym(handle, "_mlir___npcomp_module_descriptor");
+  if (!descriptor) {
+    *errorMessage = "not a compiled npcomp module: missing "
+                    "_mlir___npcomp_module_descriptor";
+    dlclose(handle);
+    return nullptr;
+  }
+  static thread_local std::string mappingErrorMessage;
+  if (!mapExternalWeights(handle, mappingErrorMessage) ||
+      !decompressWeights(handle, mappingErrorMessage)) {
+    *errorMessage = mappingErrorMessage.c_str();
+    dlclose(handle);
+    return nullptr;
+  }
+  return static_cast<ModuleDescriptor *>(descriptor);
+#endif
+}
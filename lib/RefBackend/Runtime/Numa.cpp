@@ -0,0 +1,244 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// NUMA topology, thread pinning and page placement.
+//
+// This only supports Linux, where the topology is read from sysfs and pages
+// are placed with the mbind system call, so that the runtime doesn't depend
+// on libnuma. Elsewhere, the machine is treated as a single node.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Numa.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace refbackrt;
+
+#ifdef __linux__
+// The memory policies of mbind, from <numaif.h>.
+constexpr int kMpolPreferred = 1;
+constexpr int kMpolInterleave = 3;
+constexpr unsigned kMpolMfMove = 1 << 1;
+
+namespace {
+struct NumaTopology {
+  // The CPUs that the process may run on, for each node.
+  std::vector<std::vector<int>> nodeCpus;
+  // The node of each CPU, or -1 for CPUs of no known node.
+  std::vector<int> cpuNodes;
+  // The node numbers of the nodes of `nodeCpus`.
+  std::vector<int> nodeIds;
+};
+} // namespace
+
+// Parses a sysfs CPU list such as "0-3,8-11".
+static std::vector<int> parseCpuList(const char *path) {
+  std::vector<int> cpus;
+  std::FILE *file = std::fopen(path, "r");
+  if (!file)
+    return cpus;
+  int first, last;
+  while (std::fscanf(file, "%d", &first) == 1) {
+    last = first;
+    int separator = std::fgetc(file);
+    if (separator == '-') {
+      if (std::fscanf(file, "%d", &last) != 1)
+        break;
+      separator = std::fgetc(file);
+    }
+    for (int cpu = first; cpu <= last; cpu++)
+      cpus.push_back(cpu);
+    if (separator != ',')
+      break;
+  }
+  std::fclose(file);
+  return cpus;
+}
+
+static NumaTopology computeNumaTopology() {
+  NumaTopology topology;
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  bool haveAffinity = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+  auto isAllowed = [&](int cpu) {
+    return !haveAffinity ||
+           (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed));
+  };
+
+  std::vector<int> nodeIds;
+  if (DIR *dir = opendir("/sys/devices/system/node")) {
+    while (dirent *entry = readdir(dir)) {
+      int node;
+      char trailing;
+      if (std::sscanf(entry->d_name, "node%d%c", &node, &trailing) == 1)
+        nodeIds.push_back(node);
+    }
+    closedir(dir);
+  }
+  std::sort(nodeIds.begin(), nodeIds.end());
+  for (int node : nodeIds) {
+    char path[64];
+    std::snprintf(path, sizeof(path),
+                  "/sys/devices/system/node/node%d/cpulist", node);
+    std::vector<int> cpus;
+    for (int cpu : parseCpuList(path)) {
+      if (isAllowed(cpu))
+        cpus.push_back(cpu);
+    }
+    // Nodes with only memory don't run workers.
+    if (cpus.empty())
+      continue;
+    for (int cpu : cpus) {
+      if (cpu >= static_cast<int>(topology.cpuNodes.size()))
+        topology.cpuNodes.resize(cpu + 1, -1);
+      topology.cpuNodes[cpu] = topology.nodeCpus.size();
+    }
+    topology.nodeCpus.push_back(std::move(cpus));
+    topology.nodeIds.push_back(node);
+  }
+
+  if (topology.nodeCpus.empty()) {
+    // No NUMA information: all the allowed CPUs form one node.
+    std::vector<int> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (haveAffinity && CPU_ISSET(cpu, &allowed))
+        cpus.push_back(cpu);
+    }
+    topology.cpuNodes.assign(cpus.empty() ? 0 : cpus.back() + 1, 0);
+    topology.nodeCpus.push_back(std::move(cpus));
+    topology.nodeIds.push_back(0);
+  }
+  return topology;
+}
+
+static const NumaTopology &getNumaTopology() {
+  // Intentionally leaked, since worker threads may still use it during static
+  // destruction.
+  static const NumaTopology *topology = new NumaTopology(computeNumaTopology());
+  return *topology;
+}
+
+// Returns the CPUs that consecutive workers are pinned to.
+static std::vector<int> getPinningOrder(ThreadPinning pinning) {
+  const NumaTopology &topology = getNumaTopology();
+  std::vector<int> order;
+  if (pinning == ThreadPinning::Compact) {
+    for (const std::vector<int> &cpus : topology.nodeCpus)
+      order.insert(order.end(), cpus.begin(), cpus.end());
+    return order;
+  }
+  for (std::size_t i = 0;; i++) {
+    bool any = false;
+    for (const std::vector<int> &cpus : topology.nodeCpus) {
+      if (i < cpus.size()) {
+        order.push_back(cpus[i]);
+        any = true;
+      }
+    }
+    if (!any)
+      return order;
+  }
+}
+#endif // __linux__
+
+int refbackrt::getNumNumaNodes() {
+#ifdef __linux__
+  return getNumaTopology().nodeCpus.size();
+#else
+  return 1;
+#endif
+}
+
+int refbackrt::detail::getCurrentNumaNode() {
+#ifdef __linux__
+  const NumaTopology &topology = getNumaTopology();
+  if (topology.nodeCpus.size() == 1)
+    return 0;
+  int cpu = sched_getcpu();
+  if (cpu < 0 || cpu >= static_cast<int>(topology.cpuNodes.size()) ||
+      topology.cpuNodes[cpu] < 0)
+    return 0;
+  return std::min(topology.cpuNodes[cpu], kMaxNumaNodes - 1);
+#else
+  return 0;
+#endif
+}
+
+void refbackrt::detail::pinWorkerThread(int workerIndex,
+                                        ThreadPinning pinning) {
+#ifdef __linux__
+  if (pinning == ThreadPinning::None)
+    return;
+  std::vector<int> order = getPinningOrder(pinning);
+  if (order.empty())
+    return;
+  // The invoking thread, which isn't a worker, takes the first CPU.
+  int cpu = order[(workerIndex + 1) % order.size()];
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#endif
+}
+
+LogicalResult refbackrt::setNumaMemoryPolicy(void *ptr, std::size_t size,
+                                             NumaMemoryPolicy policy) {
+#ifdef __linux__
+  const NumaTopology &topology = getNumaTopology();
+  if (topology.nodeIds.size() < 2)
+    return failure();
+  auto pageSize = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+  auto begin = reinterpret_cast<std::uintptr_t>(ptr);
+  std::uintptr_t end = begin + size;
+  begin = (begin + pageSize - 1) & ~(pageSize - 1);
+  end &= ~(pageSize - 1);
+  if (end <= begin)
+    return success();
+
+  constexpr int kBitsPerWord = 8 * sizeof(unsigned long);
+  int maxNode = topology.nodeIds.back() + 1;
+  std::vector<unsigned long> nodeMask((maxNode + kBitsPerWord - 1) /
+                                      kBitsPerWord);
+  auto addNode = [&](int node) {
+    nodeMask[node / kBitsPerWord] |= 1ul << (node % kBitsPerWord);
+  };
+  int mode;
+  if (policy == NumaMemoryPolicy::Interleave) {
+    mode = kMpolInterleave;
+    for (int node : topology.nodeIds)
+      addNode(node);
+  } else {
+    mode = kMpolPreferred;
+    int cpu = sched_getcpu();
+    if (cpu < 0 || cpu >= static_cast<int>(topology.cpuNodes.size()) ||
+        topology.cpuNodes[cpu] < 0)
+      return failure();
+    addNode(topology.nodeIds[topology.cpuNodes[cpu]]);
+  }
+  // The kernel reads `maxnode - 1` bits of the mask.
+  long result = syscall(SYS_mbind, reinterpret_cast<void *>(begin),
+                        end - begin, mode, nodeMask.data(),
+                        nodeMask.size() * kBitsPerWord + 1, kMpolMfMove);
+  return result == 0 ? success() : failure();
+#else
+  return failure();
+#endif
+}
@@ -0,0 +1,37 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// The NUMA topology queries that the thread pool and the allocator use on top
+// of the NUMA placement API declared in UserAPI.h.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef NPCOMP_LIB_RUNTIME_NUMA_H
+#define NPCOMP_LIB_RUNTIME_NUMA_H
+
+#include "npcomp/RefBackend/Runtime/UserAPI.h"
+
+namespace refbackrt {
+namespace detail {
+
+// The most NUMA nodes that the allocator keeps separate free lists for.
+// Nodes beyond this share the free lists of the last one.
+constexpr int kMaxNumaNodes = 8;
+
+// Returns the NUMA node of the CPU that the calling thread runs on, clamped
+// to kMaxNumaNodes - 1. Returns 0 on machines with a single node.
+int getCurrentNumaNode();
+
+// Pins the calling thread, which is worker `workerIndex` of the thread pool,
+// to a CPU according to `pinning`. Does nothing if the CPU can't be chosen.
+void pinWorkerThread(int workerIndex, ThreadPinning pinning);
+
+} // namespace detail
+} // namespace refbackrt
+
+#endif // NPCOMP_LIB_RUNTIME_NUMA_H
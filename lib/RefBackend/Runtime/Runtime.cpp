@@ -8,14 +8,26 @@
 
 #include "npcomp/RefBackend/Runtime/UserAPI.h"
 
+#include "npcomp/RefBackend/Runtime/Interpreter.h"
 #include "llvm/Support/ErrorHandling.h"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
+#include <condition_variable>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include "CompilerDataStructures.h"
+#include "Instrumentation.h"
+#include "Numa.h"
 
 using namespace refbackrt;
 
@@ -43,13 +55,22 @@ struct MemrefDescriptor {
     return MutableArrayRef<std::int64_t>(tail + assumedRank, assumedRank);
   }
 
-  // Returns a malloc-allocated MemrefDescriptor with the specified extents and
-  // default striding.
-  static MemrefDescriptor *create(ArrayRef<std::int32_t> extents, void *data);
+  // Returns the number of bytes needed for a MemrefDescriptor of rank `rank`.
+  static std::size_t getAllocSize(int rank) {
+    return sizeof(MemrefDescriptor) + sizeof(std::int64_t) * 2 * rank;
+  }
+
+  // Returns a MemrefDescriptor allocated with refbackrt::allocate with the
+  // specified extents and default striding.
+  static MemrefDescriptor *create(ArrayRef<std::int64_t> extents, void *data);
+  // Same as above, but constructs the descriptor in `storage`, which must be
+  // at least getAllocSize(extents.size()) bytes.
+  static MemrefDescriptor *create(ArrayRef<std::int64_t> extents, void *data,
+                                  void *storage);
 
   // Returns the number of elements in this MemrefDescriptor, assuming this
   // descriptor has rank `assumedRank`.
-  std::int32_t getNumElements(int assumedRank) {
+  std::int64_t getNumElements(int assumedRank) {
     if (assumedRank == 0)
       return 1;
     return getSizes(assumedRank)[0] * getStrides(assumedRank)[0];
@@ -64,11 +85,15 @@ struct UnrankedMemref {
 };
 } // namespace
 
-MemrefDescriptor *MemrefDescriptor::create(ArrayRef<std::int32_t> extents,
+MemrefDescriptor *MemrefDescriptor::create(ArrayRef<std::int64_t> extents,
                                            void *data) {
+  return create(extents, data, allocate(getAllocSize(extents.size())));
+}
+
+MemrefDescriptor *MemrefDescriptor::create(ArrayRef<std::int64_t> extents,
+                                           void *data, void *storage) {
   auto rank = extents.size();
-  auto allocSize = sizeof(MemrefDescriptor) + sizeof(std::int64_t) * 2 * rank;
-  auto *descriptor = static_cast<MemrefDescriptor *>(std::malloc(allocSize));
+  auto *descriptor = static_cast<MemrefDescriptor *>(storage);
   descriptor->allocatedPtr = data;
   descriptor->dataPtr = data;
   descriptor->offset = 0;
@@ -84,44 +109,797 @@ MemrefDescriptor *MemrefDescriptor::create(ArrayRef<std::int32_t> extents,
   return descriptor;
 }
 
-static UnrankedMemref convertRefbackrtTensorToUnrankedMemref(Tensor *tensor) {
-  auto byteSize = tensor->getDataByteSize();
-  void *data = std::malloc(byteSize);
-  std::memcpy(data, tensor->getData(), byteSize);
-  auto *descriptor = MemrefDescriptor::create(tensor->getExtents(), data);
-  return UnrankedMemref{tensor->getRank(), descriptor};
+namespace {
+// Bump allocator for the input memref descriptors of an invocation, which are
+// only live for the duration of the call.
+//
+// The storage is inline, so a whole call (or batch of calls) can set up its
+// input descriptors without touching the heap. Descriptors that don't fit
+// fall back to refbackrt::allocate.
+class DescriptorArena {
+public:
+  DescriptorArena() = default;
+  DescriptorArena(const DescriptorArena &) = delete;
+  DescriptorArena &operator=(const DescriptorArena &) = delete;
+  ~DescriptorArena() { reset(); }
+
+  void *allocate(std::size_t size) {
+    // Keep every descriptor 8-byte aligned.
+    size = (size + 7) & ~std::size_t(7);
+    if (size <= kCapacity - used) {
+      void *ptr = storage + used;
+      used += size;
+      return ptr;
+    }
+    void *ptr = refbackrt::allocate(size);
+    overflow.push_back(ptr);
+    return ptr;
+  }
+
+  // Releases all descriptors, so the arena can be reused for the next call.
+  void reset() {
+    for (void *ptr : overflow)
+      deallocate(ptr);
+    overflow.resize(0);
+    used = 0;
+  }
+
+private:
+  // Enough for kInlineArity inputs of rank kInlineRank.
+  static constexpr std::size_t kCapacity =
+      kInlineArity *
+      (sizeof(MemrefDescriptor) + sizeof(std::int64_t) * 2 * kInlineRank);
+  alignas(std::int64_t) char storage[kCapacity];
+  std::size_t used = 0;
+  SmallVector<void *, kInlineArity> overflow;
+};
+
+// The smallest chunk a ScratchArena allocates.
+constexpr std::size_t kMinScratchChunkSize = std::size_t(64) << 10;
+
+// Bump allocator backing refbackrt::allocateScratch.
+//
+// Scratch buffers are carved out of large chunks, and are all released at
+// once by `reset`. If an invocation needed more than one chunk, `reset`
+// replaces them with a single chunk big enough for all of them, so that
+// steady-state invocations never call into the system allocator.
+//
+// Chunks come straight from std::malloc rather than from refbackrt::allocate:
+// they are few and long-lived, so pooling them buys nothing, and the
+// per-thread arena can then be destroyed at thread exit independently of the
+// allocator's own thread caches.
+class ScratchArena {
+public:
+  ScratchArena() = default;
+  ScratchArena(const ScratchArena &) = delete;
+  ScratchArena &operator=(const ScratchArena &) = delete;
+  ~ScratchArena() { releaseChunks(); }
+
+  void *allocate(std::size_t size) {
+    // Keep every buffer aligned (and distinct, even for empty buffers). This
+    // must agree with the accounting in the refback-reuse-scratch-buffers
+    // pass.
+    size = std::max((size + kBufferAlignment - 1) & ~(kBufferAlignment - 1),
+                    kBufferAlignment);
+    if ((!head || size > head->capacity - used) && !addChunk(size))
+      return nullptr;
+    void *ptr = head->data + used;
+    used += size;
+    return ptr;
+  }
+
+  // Makes sure that the next `size` bytes can be allocated from a single
+  // chunk.
+  void reserve(std::size_t size) {
+    if (size > 0 && (!head || size > head->capacity - used))
+      addChunk(size);
+  }
+
+  void reset() {
+    if (head && head->next) {
+      std::size_t totalCapacity = 0;
+      for (Chunk *chunk = head; chunk; chunk = chunk->next)
+        totalCapacity += chunk->capacity;
+      releaseChunks();
+      // If this fails, we'll just try again on the next allocation.
+      addChunk(totalCapacity);
+    }
+    used = 0;
+  }
+
+private:
+  struct Chunk {
+    Chunk *next;
+    std::size_t capacity;
+    char *data;
+  };
+
+  bool addChunk(std::size_t minCapacity) {
+    std::size_t capacity = std::max(minCapacity, kMinScratchChunkSize);
+    if (head)
+      capacity = std::max(capacity, 2 * head->capacity);
+    void *rawPtr = std::malloc(sizeof(Chunk) + kBufferAlignment + capacity);
+    if (!rawPtr)
+      return false;
+    auto *chunk = static_cast<Chunk *>(rawPtr);
+    auto firstUsable = reinterpret_cast<std::uintptr_t>(chunk + 1);
+    chunk->data = reinterpret_cast<char *>(
+        (firstUsable + kBufferAlignment - 1) & ~(kBufferAlignment - 1));
+    chunk->capacity = capacity;
+    chunk->next = head;
+    head = chunk;
+    used = 0;
+    return true;
+  }
+
+  void releaseChunks() {
+    while (head) {
+      Chunk *next = head->next;
+      std::free(head);
+      head = next;
+    }
+  }
+
+  // The chunk currently being allocated from, followed by the exhausted ones.
+  Chunk *head = nullptr;
+  // The number of bytes of `head` in use.
+  std::size_t used = 0;
+};
+
+// The scratch arena that refbackrt::allocateScratch allocates from on this
+// thread, if compiled code is being invoked.
+thread_local ScratchArena *activeScratchArena = nullptr;
+
+// The arena that refbackrt::allocateScratch falls back to on this thread
+// outside of invocations. It is released when the next invocation on the
+// thread returns, and when the thread exits.
+static ScratchArena &getUnscopedScratchArena() {
+  thread_local ScratchArena arena;
+  return arena;
 }
 
-static Tensor *convertUnrankedMemrefToRefbackrtTensor(
-    std::int64_t rank, MemrefDescriptor *descriptor, ElementType elementType) {
-  // Launder from std::int64_t to std::int32_t.
-  auto extents64 = descriptor->getSizes(rank);
-  constexpr int kMaxRank = 20;
-  std::array<std::int32_t, kMaxRank> extents32Buf;
-  for (int i = 0, e = extents64.size(); i < e; i++)
-    extents32Buf[i] = extents64[i];
-  return Tensor::createRaw(ArrayRef<std::int32_t>(extents32Buf.data(), rank),
-                           elementType, descriptor->dataPtr);
+// Makes a scratch arena active on this thread for the lifetime of the scope,
+// and releases everything allocated from it on exit.
+//
+// Each thread reuses one arena across invocations. A nested invocation (e.g.
+// from a custom Allocator) gets a fresh arena rather than resetting the
+// outer invocation's.
+class ScratchScope {
+public:
+  // `expectedBytes` is how much scratch memory the invocation is expected to
+  // need, or -1 if unknown.
+  explicit ScratchScope(std::int64_t expectedBytes)
+      : previous(activeScratchArena) {
+    thread_local ScratchArena threadArena;
+    arena = previous ? &nestedArena : &threadArena;
+    if (expectedBytes > 0)
+      arena->reserve(expectedBytes);
+    activeScratchArena = arena;
+  }
+  ScratchScope(const ScratchScope &) = delete;
+  ScratchScope &operator=(const ScratchScope &) = delete;
+  ~ScratchScope() {
+    arena->reset();
+    activeScratchArena = previous;
+    if (!previous)
+      getUnscopedScratchArena().reset();
+  }
+
+private:
+  ScratchArena *previous;
+  ScratchArena *arena;
+  ScratchArena nestedArena;
+};
+} // namespace
+
+namespace {
+// The buffers that the compiled code called on this thread allocated through
+// allocateAt and hasn't freed yet, if compiled code is being invoked.
+thread_local std::vector<void *> *activeCallAllocations = nullptr;
+
+// Tracks the buffers that the compiled code allocates on this thread for the
+// lifetime of the scope, like ScratchScope does for scratch memory. When a
+// runtime check fails, the compiled code returns early without freeing the
+// buffers it allocated before the check, which freeLive() then frees.
+//
+// The bodies of parallel loops that run on other threads free what they
+// allocate, so their buffers don't need to be tracked.
+class CallAllocationScope {
+public:
+  CallAllocationScope() : previous(activeCallAllocations) {
+    thread_local std::vector<void *> threadLive;
+    live = previous ? &nestedLive : &threadLive;
+    live->clear();
+    activeCallAllocations = live;
+  }
+  CallAllocationScope(const CallAllocationScope &) = delete;
+  CallAllocationScope &operator=(const CallAllocationScope &) = delete;
+  ~CallAllocationScope() { activeCallAllocations = previous; }
+
+  // Frees the buffers that the compiled code still holds.
+  void freeLive() {
+    for (void *ptr : *live)
+      deallocate(ptr);
+    live->clear();
+  }
+
+private:
+  std::vector<void *> *previous;
+  std::vector<void *> *live;
+  std::vector<void *> nestedLive;
+};
+} // namespace
+
+void detail::trackCallAllocation(void *ptr) {
+  std::vector<void *> *live = activeCallAllocations;
+  if (live && ptr)
+    live->push_back(ptr);
+}
+
+void detail::untrackCallAllocation(void *ptr) {
+  std::vector<void *> *live = activeCallAllocations;
+  if (!live || !ptr)
+    return;
+  // Buffers are mostly freed soon after they are allocated.
+  auto it = std::find(live->rbegin(), live->rend(), ptr);
+  if (it == live->rend())
+    return;
+  *it = live->back();
+  live->pop_back();
+}
+
+void *refbackrt::allocateScratch(std::size_t size) {
+  if (ScratchArena *arena = activeScratchArena)
+    return arena->allocate(size);
+  return getUnscopedScratchArena().allocate(size);
 }
 
 //===----------------------------------------------------------------------===//
-// Tensor
+// Parallel loops.
 //===----------------------------------------------------------------------===//
 
-static std::int32_t totalElements(ArrayRef<std::int32_t> extents) {
-  std::int32_t ret = 1;
+// The schedule of the requests invoked by the current thread.
+static thread_local RequestSchedule currentRequestSchedule;
+
+RequestSchedule refbackrt::getRequestSchedule() {
+  return currentRequestSchedule;
+}
+
+ScopedRequestSchedule::ScopedRequestSchedule(const RequestSchedule &schedule)
+    : previous(currentRequestSchedule) {
+  currentRequestSchedule = schedule;
+}
+
+ScopedRequestSchedule::~ScopedRequestSchedule() {
+  currentRequestSchedule = previous;
+}
+
+namespace {
+// A work-stealing thread pool for running the iterations of parallel loops.
+//
+// Each worker owns a queue of tasks (contiguous ranges of loop iterations).
+// A parallel loop is split into a few tasks per thread, which are dealt out
+// round-robin across the queues. Workers take tasks from the back of their
+// own queue, and steal from the front of the others' when it runs dry. The
+// thread that started the loop doesn't idle either: it steals tasks until
+// none are left, and only then waits for the ones still running.
+//
+// Each queue holds the tasks of each priority (that of the request starting
+// the loop, see RequestSchedule) apart. Threads look for tasks of the highest
+// priority in all the queues before looking at lower priorities, so that
+// between two tasks they yield to the loops of higher-priority requests.
+class ThreadPool {
+public:
+  ThreadPool(int numThreads, ThreadPinning pinning) {
+    // The invoking thread does its share of the work, so it needs no worker.
+    int numWorkers = std::max(numThreads - 1, 0);
+    for (int i = 0; i < numWorkers; i++)
+      queues.push_back(std::make_unique<WorkQueue>());
+    for (int i = 0; i < numWorkers; i++) {
+      workers.emplace_back([this, i, pinning] {
+        detail::pinWorkerThread(i, pinning);
+        workerMain(i);
+      });
+    }
+  }
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(sleepMutex);
+      shuttingDown = true;
+    }
+    wakeUp.notify_all();
+    for (std::thread &worker : workers)
+      worker.join();
+  }
+
+  int getNumThreads() const { return workers.size() + 1; }
+
+  static void runBody(ParallelForBody body, std::int64_t begin,
+                      std::int64_t end, void *context) {
+    // Scratch memory allocated by the body only lives as long as this call.
+    // Threads that are already in a scratch scope (e.g. the invoking thread)
+    // keep allocating from it, since it outlives the call anyway.
+    if (activeScratchArena)
+      return body(begin, end, context);
+    ScratchScope scratchScope(/*expectedBytes=*/-1);
+    body(begin, end, context);
+  }
+
+  void parallelFor(std::int64_t begin, std::int64_t end,
+                   std::int64_t grainSize, ParallelForBody body,
+                   void *context) {
+    std::int64_t numIterations = end - begin;
+    if (numIterations <= 0)
+      return;
+    // A few tasks per thread, so that threads that finish early can steal
+    // from the others. Low-priority loops get more, shorter tasks, so that
+    // higher-priority loops don't wait long for their threads.
+    int priority = static_cast<int>(currentRequestSchedule.priority);
+    std::int64_t tasksPerThread =
+        priority == static_cast<int>(Priority::Low) ? 16 : 4;
+    std::int64_t maxTasks =
+        tasksPerThread * static_cast<std::int64_t>(getNumThreads());
+    std::int64_t taskSize = std::max<std::int64_t>(
+        std::max<std::int64_t>(grainSize, 1),
+        (numIterations + maxTasks - 1) / maxTasks);
+    std::int64_t numTasks = (numIterations + taskSize - 1) / taskSize;
+    if (numTasks <= 1 || queues.empty())
+      return runBody(body, begin, end, context);
+
+    Loop loop;
+    loop.numRemaining = numTasks;
+    std::size_t queueIndex = nextQueue.fetch_add(1) % queues.size();
+    for (std::int64_t taskBegin = begin; taskBegin < end;
+         taskBegin += taskSize) {
+      Task task{body, context, taskBegin, std::min(taskBegin + taskSize, end),
+                &loop};
+      WorkQueue &queue = *queues[queueIndex];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.tasks[priority].push_back(task);
+      queueIndex = (queueIndex + 1) % queues.size();
+    }
+    {
+      std::lock_guard<std::mutex> lock(sleepMutex);
+      numQueued += numTasks;
+    }
+    wakeUp.notify_all();
+
+    Task task;
+    while (popTask(workerIndex, task))
+      runTask(task);
+    std::unique_lock<std::mutex> lock(loop.mutex);
+    loop.done.wait(lock, [&] { return loop.numRemaining == 0; });
+  }
+
+private:
+  // The state of a parallel loop, owned by the thread that started it.
+  struct Loop {
+    std::mutex mutex;
+    std::condition_variable done;
+    // The number of tasks that haven't finished yet. Guarded by `mutex`.
+    std::int64_t numRemaining;
+  };
+  struct Task {
+    ParallelForBody body;
+    void *context;
+    std::int64_t begin;
+    std::int64_t end;
+    Loop *loop;
+  };
+  struct WorkQueue {
+    std::mutex mutex;
+    // Indexed by priority.
+    std::deque<Task> tasks[kNumPriorities];
+  };
+
+  // Takes the task of the highest priority from the queue of worker
+  // `ownIndex` (-1 for threads that aren't workers), or failing that, steals
+  // one from another worker.
+  bool popTask(int ownIndex, Task &task) {
+    std::size_t numQueues = queues.size();
+    std::size_t start = ownIndex >= 0 ? ownIndex : nextQueue.load();
+    for (int priority = 0; priority < kNumPriorities; priority++) {
+      for (std::size_t i = 0; i < numQueues; i++) {
+        std::size_t index = (start + i) % numQueues;
+        WorkQueue &queue = *queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        std::deque<Task> &tasks = queue.tasks[priority];
+        if (tasks.empty())
+          continue;
+        if (static_cast<int>(index) == ownIndex) {
+          task = tasks.back();
+          tasks.pop_back();
+        } else {
+          task = tasks.front();
+          tasks.pop_front();
+        }
+        numQueued--;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static void runTask(const Task &task) {
+    runBody(task.body, task.begin, task.end, task.context);
+    std::lock_guard<std::mutex> lock(task.loop->mutex);
+    if (--task.loop->numRemaining == 0)
+      task.loop->done.notify_all();
+  }
+
+  void workerMain(int index) {
+    workerIndex = index;
+    for (;;) {
+      Task task;
+      if (popTask(index, task)) {
+        runTask(task);
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(sleepMutex);
+      wakeUp.wait(lock, [&] { return shuttingDown || numQueued > 0; });
+      if (shuttingDown)
+        return;
+    }
+  }
+
+  // The index of the current thread's queue, or -1 if it isn't a worker.
+  static thread_local int workerIndex;
+
+  std::vector<std::unique_ptr<WorkQueue>> queues;
+  std::vector<std::thread> workers;
+  // Where the next parallel loop starts dealing out its tasks.
+  std::atomic<std::size_t> nextQueue{0};
+
+  // Idle workers sleep on `wakeUp` until tasks are queued. `numQueued` is
+  // only incremented with `sleepMutex` held, so that wakeups aren't lost.
+  std::mutex sleepMutex;
+  std::condition_variable wakeUp;
+  std::atomic<std::int64_t> numQueued{0};
+  bool shuttingDown = false;
+};
+
+thread_local int ThreadPool::workerIndex = -1;
+} // namespace
+
+static int getDefaultNumThreads() {
+  if (const char *env = std::getenv("REFBACKRT_NUM_THREADS")) {
+    int numThreads = std::atoi(env);
+    if (numThreads > 0)
+      return numThreads;
+  }
+  return std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+}
+
+static ThreadPinning getDefaultThreadPinning() {
+  if (const char *env = std::getenv("REFBACKRT_PIN_THREADS")) {
+    if (std::strcmp(env, "compact") == 0)
+      return ThreadPinning::Compact;
+    if (std::strcmp(env, "scatter") == 0)
+      return ThreadPinning::Scatter;
+  }
+  return ThreadPinning::None;
+}
+
+static std::mutex threadPoolMutex;
+static ThreadPool *threadPool = nullptr;
+// Guarded by `threadPoolMutex`. The number of threads set by setNumThreads,
+// or 0 for the default.
+static int numThreadsSetting = 0;
+static ThreadPinning threadPinning = getDefaultThreadPinning();
+// The executor set by setExecutor, which runs the parallel loops instead of
+// `threadPool` if it is non-null.
+static std::atomic<Executor *> executor{nullptr};
+
+static ThreadPool &getThreadPool() {
+  std::lock_guard<std::mutex> lock(threadPoolMutex);
+  // Intentionally leaked, since compiled code may still run parallel loops
+  // during static destruction.
+  if (!threadPool)
+    threadPool = new ThreadPool(numThreadsSetting > 0 ? numThreadsSetting
+                                                     : getDefaultNumThreads(),
+                                threadPinning);
+  return *threadPool;
+}
+
+// Shuts the thread pool down, so that the next parallel loop restarts it with
+// the current settings. Called with `threadPoolMutex` held.
+static void resetThreadPool() {
+  delete threadPool;
+  threadPool = nullptr;
+}
+
+void refbackrt::setNumThreads(int numThreads) {
+  {
+    std::lock_guard<std::mutex> lock(threadPoolMutex);
+    numThreadsSetting = std::max(numThreads, 0);
+    resetThreadPool();
+  }
+  // Start the workers now rather than in the middle of the first call.
+  if (!executor.load())
+    getThreadPool();
+}
+
+void refbackrt::setThreadPinning(ThreadPinning pinning) {
+  {
+    std::lock_guard<std::mutex> lock(threadPoolMutex);
+    threadPinning = pinning;
+    resetThreadPool();
+  }
+  if (!executor.load())
+    getThreadPool();
+}
+
+ThreadPinning refbackrt::getThreadPinning() {
+  std::lock_guard<std::mutex> lock(threadPoolMutex);
+  return threadPinning;
+}
+
+void refbackrt::setExecutor(Executor *newExecutor) {
+  std::lock_guard<std::mutex> lock(threadPoolMutex);
+  executor.store(newExecutor);
+  // Idle workers would only compete with the executor's threads for the
+  // cores.
+  if (newExecutor)
+    resetThreadPool();
+}
+
+Executor *refbackrt::getExecutor() { return executor.load(); }
+
+int refbackrt::getNumThreads() {
+  if (Executor *current = executor.load())
+    return current->getNumThreads();
+  return getThreadPool().getNumThreads();
+}
+
+namespace {
+// A parallel loop run by an Executor.
+struct ExecutorLoop {
+  ParallelForBody body;
+  void *context;
+};
+} // namespace
+
+// Runs a range of an ExecutorLoop, with scratch memory as on the workers of
+// the runtime's thread pool.
+static void runExecutorRange(std::int64_t begin, std::int64_t end,
+                             void *context) {
+  auto *loop = static_cast<ExecutorLoop *>(context);
+  ThreadPool::runBody(loop->body, begin, end, loop->context);
+}
+
+void refbackrt::parallelFor(std::int64_t begin, std::int64_t end,
+                            std::int64_t grainSize, ParallelForBody body,
+                            void *context) {
+  if (Executor *current = executor.load()) {
+    if (end <= begin)
+      return;
+    ExecutorLoop loop{body, context};
+    return current->parallelFor(begin, end, grainSize, runExecutorRange,
+                                &loop);
+  }
+  getThreadPool().parallelFor(begin, end, grainSize, body, context);
+}
+
+static bool isBufferAligned(void *ptr) {
+  return reinterpret_cast<std::uintptr_t>(ptr) % kBufferAlignment == 0;
+}
+
+static std::int64_t totalElements(ArrayRef<std::int64_t> extents) {
+  std::int64_t ret = 1;
   for (int i = 0, e = extents.size(); i < e; i++) {
     ret *= extents[i];
   }
   return ret;
 }
 
+// A strided view of an array of elements, in the form needed by copyStrided.
+namespace {
+struct StridedView {
+  int rank;
+  SmallVector<std::int64_t, kInlineRank> sizes;
+  // Element strides.
+  SmallVector<std::int64_t, kInlineRank> strides;
+  char *data;
+
+  static StridedView get(const Tensor *tensor) {
+    StridedView view;
+    view.rank = tensor->getRank();
+    view.sizes.resize(view.rank);
+    view.strides.resize(view.rank);
+    for (int i = 0; i < view.rank; i++) {
+      view.sizes[i] = tensor->getExtents()[i];
+      view.strides[i] = tensor->getStrides()[i];
+    }
+    view.data = tensor->getData<char>();
+    return view;
+  }
+  static StridedView get(std::int64_t rank, MemrefDescriptor *descriptor,
+                         std::int32_t elementByteSize) {
+    StridedView view;
+    view.rank = rank;
+    view.sizes.resize(rank);
+    view.strides.resize(rank);
+    for (int i = 0; i < view.rank; i++) {
+      view.sizes[i] = descriptor->getSizes(rank)[i];
+      view.strides[i] = descriptor->getStrides(rank)[i];
+    }
+    view.data = static_cast<char *>(descriptor->dataPtr) +
+                descriptor->offset * elementByteSize;
+    return view;
+  }
+  // Returns a dense row-major view of `data` with the same sizes as `other`.
+  static StridedView getContiguous(const StridedView &other, void *data) {
+    StridedView view = other;
+    std::int64_t stride = 1;
+    for (int i = view.rank - 1; i >= 0; i--) {
+      view.strides[i] = stride;
+      stride *= view.sizes[i];
+    }
+    view.data = static_cast<char *>(data);
+    return view;
+  }
+};
+} // namespace
+
+// Copies the elements of `src` into `dest`, which must have the same sizes.
+// Either of them may be non-contiguous.
+static void copyStrided(const StridedView &src, const StridedView &dest,
+                        std::int32_t elementByteSize) {
+  int rank = src.rank;
+  for (int i = 0; i < rank; i++)
+    if (src.sizes[i] == 0)
+      return;
+  // Copy whole rows at a time when the innermost dimension is contiguous in
+  // both views.
+  std::int64_t rowElements = 1;
+  int numOuterDims = rank;
+  if (rank > 0 && src.strides[rank - 1] == 1 && dest.strides[rank - 1] == 1) {
+    rowElements = src.sizes[rank - 1];
+    numOuterDims--;
+  }
+  SmallVector<std::int64_t, kInlineRank> indices(numOuterDims);
+  while (true) {
+    std::int64_t srcOffset = 0, destOffset = 0;
+    for (int i = 0; i < numOuterDims; i++) {
+      srcOffset += indices[i] * src.strides[i];
+      destOffset += indices[i] * dest.strides[i];
+    }
+    std::memcpy(dest.data + destOffset * elementByteSize,
+                src.data + srcOffset * elementByteSize,
+                rowElements * elementByteSize);
+    // Increment the multi-dimensional index, innermost dimension first.
+    int dim = numOuterDims - 1;
+    for (; dim >= 0; dim--) {
+      if (++indices[dim] < src.sizes[dim])
+        break;
+      indices[dim] = 0;
+    }
+    if (dim < 0)
+      return;
+  }
+}
+
+// Whether the compiled code must be passed a copy of input `tensor` rather
+// than its buffer (see convertRefbackrtTensorToUnrankedMemref).
+static bool needsInputCopy(Tensor *tensor, bool isReadOnly) {
+  return !isReadOnly || !isBufferAligned(tensor->getData()) ||
+         !tensor->isContiguous();
+}
+
+// Returns a freshly allocated dense copy of the elements of `tensor`.
+static void *copyTensorData(Tensor *tensor) {
+  void *data = allocate(tensor->getDataByteSize());
+  auto src = StridedView::get(tensor);
+  copyStrided(src, StridedView::getContiguous(src, data),
+              getElementTypeByteSize(tensor->getElementType()));
+  return data;
+}
+
+// Creates an UnrankedMemref viewing the data of `tensor`.
+//
+// If `isReadOnly` is true, the compiled code promises to never write, free, or
+// return the buffer, so the descriptor points directly at the tensor's data
+// (provided it has the dense layout and alignment that the compiled code
+// assumes). Otherwise, the descriptor points at a freshly allocated dense copy
+// of it.
+//
+// The descriptor itself is allocated from `arena`. Sets `isCopy` to indicate
+// whether the buffer was copied.
+static UnrankedMemref
+convertRefbackrtTensorToUnrankedMemref(Tensor *tensor, bool isReadOnly,
+                                       DescriptorArena &arena, bool &isCopy) {
+  isCopy = needsInputCopy(tensor, isReadOnly);
+  void *data = isCopy ? copyTensorData(tensor) : tensor->getData();
+  auto *descriptor = MemrefDescriptor::create(
+      tensor->getExtents(), data,
+      arena.allocate(MemrefDescriptor::getAllocSize(tensor->getRank())));
+  return UnrankedMemref{tensor->getRank(), descriptor};
+}
+
+// How a Tensor created from a memref returned by the compiled code gets its
+// buffer.
+enum class OutputBufferTransfer {
+  // The contents are copied into a new, contiguous buffer.
+  kCopy,
+  // The Tensor takes ownership of the buffer (with the descriptor's strides),
+  // and the caller must no longer free it.
+  kAdopt,
+  // The Tensor is a read-only view of the buffer, which is a constant of the
+  // module and is never freed.
+  kView,
+};
+
+// Creates a refbackrt::Tensor holding the contents of `descriptor`.
+static Tensor *convertUnrankedMemrefToRefbackrtTensor(
+    std::int64_t rank, MemrefDescriptor *descriptor, ElementType elementType,
+    OutputBufferTransfer transfer) {
+  auto sizes = descriptor->getSizes(rank);
+  auto strides = descriptor->getStrides(rank);
+  ArrayRef<std::int64_t> extents(sizes.data(), rank);
+  auto elementByteSize = getElementTypeByteSize(elementType);
+
+  switch (transfer) {
+  case OutputBufferTransfer::kAdopt:
+    return Tensor::createRawAdoptingBuffer(
+        extents, ArrayRef<std::int64_t>(strides.data(), rank), elementType,
+        descriptor->allocatedPtr,
+        descriptor->dataPtr, descriptor->offset * elementByteSize);
+  case OutputBufferTransfer::kView:
+    return Tensor::createRawReadOnlyView(
+        extents, ArrayRef<std::int64_t>(strides.data(), rank), elementType,
+        descriptor->dataPtr, descriptor->offset * elementByteSize);
+  case OutputBufferTransfer::kCopy:
+    break;
+  }
+  auto src = StridedView::get(rank, descriptor, elementByteSize);
+  auto *tensor = Tensor::createRawUninitialized(extents, elementType);
+  copyStrided(src, StridedView::getContiguous(src, tensor->getData()),
+              elementByteSize);
+  return tensor;
+}
+
+// Copies the contents of `descriptor` into the existing buffer of `tensor`.
+//
+// Returns failure if `tensor` doesn't have the same extents as `descriptor`,
+// doesn't have element type `elementType`, or is read-only.
+static LogicalResult copyUnrankedMemrefIntoTensor(std::int64_t rank,
+                                                  MemrefDescriptor *descriptor,
+                                                  ElementType elementType,
+                                                  Tensor *tensor) {
+  if (tensor->getRank() != rank || tensor->getElementType() != elementType ||
+      tensor->isReadOnly())
+    return failure();
+  auto sizes = descriptor->getSizes(rank);
+  for (int i = 0; i < rank; i++)
+    if (tensor->getExtent(i) != sizes[i])
+      return failure();
+  auto elementByteSize = getElementTypeByteSize(tensor->getElementType());
+  copyStrided(StridedView::get(rank, descriptor, elementByteSize),
+              StridedView::get(tensor), elementByteSize);
+  return success();
+}
+
+//===----------------------------------------------------------------------===//
+// Tensor
+//===----------------------------------------------------------------------===//
+
 std::int32_t refbackrt::getElementTypeByteSize(ElementType type) {
   switch (type) {
   case ElementType::NONE:
     return 0;
   case ElementType::F32:
+  case ElementType::I32:
     return 4;
+  case ElementType::F16:
+  case ElementType::BF16:
+    return 2;
+  case ElementType::I8:
+  case ElementType::I1:
+    return 1;
+  case ElementType::I64:
+    return 8;
   }
   llvm_unreachable("unsupported dtype");
 }
@@ -132,6 +910,18 @@ StringRef refbackrt::getElementTypeAsStringRef(ElementType type) {
     return "NONE";
   case ElementType::F32:
     return "F32";
+  case ElementType::F16:
+    return "F16";
+  case ElementType::BF16:
+    return "BF16";
+  case ElementType::I8:
+    return "I8";
+  case ElementType::I32:
+    return "I32";
+  case ElementType::I64:
+    return "I64";
+  case ElementType::I1:
+    return "I1";
   }
   llvm_unreachable("unsupported element type string");
 }
@@ -146,10 +936,44 @@ StringRef refbackrt::getArgTypeAsStringRef(ArgType type) {
     return "kF32";
   case ArgType::kF64:
     return "kF64";
+  case ArgType::kI32:
+    return "kI32";
+  case ArgType::kI64:
+    return "kI64";
+  case ArgType::kI1:
+    return "kI1";
   }
   llvm_unreachable("unsupported arg type string");
 }
 
+// Must stay aligned with getIntReprForABIElementType in LowerToRefbackrtABI.
+static ElementType getElementTypeFromABI(ABIElementType type) {
+  switch (type) {
+  case ABIElementType::kNone:
+    return ElementType::NONE;
+  case ABIElementType::kF32:
+    return ElementType::F32;
+  case ABIElementType::kF16:
+    return ElementType::F16;
+  case ABIElementType::kBF16:
+    return ElementType::BF16;
+  case ABIElementType::kI8:
+    return ElementType::I8;
+  case ABIElementType::kI32:
+    return ElementType::I32;
+  case ABIElementType::kI64:
+    return ElementType::I64;
+  case ABIElementType::kI1:
+    return ElementType::I1;
+  }
+  llvm_unreachable("unsupported ABI element type");
+}
+
+Ref<Tensor> Tensor::create(ArrayRef<std::int64_t> extents, ElementType type,
+                           void *data) {
+  return Ref<Tensor>(createRaw(extents, type, data));
+}
+
 Ref<Tensor> Tensor::create(ArrayRef<std::int32_t> extents, ElementType type,
                            void *data) {
   return Ref<Tensor>(createRaw(extents, type, data));
@@ -157,23 +981,123 @@ Ref<Tensor> Tensor::create(ArrayRef<std::int32_t> extents, ElementType type,
 
 Tensor *Tensor::createRaw(ArrayRef<std::int32_t> extents, ElementType type,
                           void *data) {
-  auto *tensor = static_cast<Tensor *>(
-      std::malloc(sizeof(Tensor) + extents.size() * sizeof(std::int32_t)));
+  SmallVector<std::int64_t, kInlineRank> extents64(extents.size());
+  for (int i = 0, e = extents.size(); i < e; i++)
+    extents64[i] = extents[i];
+  return createRaw(extents64, type, data);
+}
+
+Tensor *Tensor::allocateTensor(ArrayRef<std::int64_t> extents,
+                               ElementType type,
+                               std::int64_t inlineDataBytes) {
+  auto rank = extents.size();
+  std::size_t headerSize = sizeof(Tensor) + 2 * rank * sizeof(std::int64_t);
+  std::size_t allocSize = headerSize;
+  if (inlineDataBytes != 0)
+    allocSize += kBufferAlignment - 1 + inlineDataBytes;
+  auto *tensor = static_cast<Tensor *>(std::malloc(allocSize));
 
   tensor->refCount = 0;
   tensor->elementType = type;
-  tensor->rank = extents.size();
+  tensor->rank = rank;
+  tensor->readOnly = false;
+  std::int64_t stride = 1;
+  for (int i = rank - 1; i >= 0; i--) {
+    tensor->getMutableExtents()[i] = extents[i];
+    tensor->getMutableStrides()[i] = stride;
+    stride *= extents[i];
+  }
+  if (inlineDataBytes != 0) {
+    // The inline buffer is freed with the Tensor.
+    auto firstUsable = reinterpret_cast<std::uintptr_t>(tensor) + headerSize;
+    tensor->allocatedPtr = nullptr;
+    tensor->data = reinterpret_cast<void *>(
+        (firstUsable + kBufferAlignment - 1) & ~(kBufferAlignment - 1));
+  }
+  return tensor;
+}
+
+Tensor *Tensor::createRaw(ArrayRef<std::int64_t> extents, ElementType type,
+                          void *data) {
+  auto *tensor = createRawUninitialized(extents, type);
+  std::memcpy(tensor->data, data, tensor->getDataByteSize());
+  return tensor;
+}
+
+Tensor *Tensor::createRawUninitialized(ArrayRef<std::int64_t> extents,
+                                       ElementType type) {
   auto byteSize = getElementTypeByteSize(type) * totalElements(extents);
-  // TODO: Align the buffer.
-  tensor->allocatedPtr = std::malloc(byteSize);
+  if (byteSize != 0 && byteSize <= kMaxInlineDataBytes)
+    return allocateTensor(extents, type, byteSize);
+  auto *tensor = allocateTensor(extents, type);
+  // Note: refbackrt::allocate guarantees kBufferAlignment.
+  tensor->allocatedPtr = allocate(byteSize);
   tensor->data = tensor->allocatedPtr;
-  std::memcpy(tensor->data, data, byteSize);
-  for (int i = 0, e = extents.size(); i < e; i++)
-    tensor->getMutableExtents()[i] = extents[i];
   return tensor;
 }
 
-std::int32_t Tensor::getDataByteSize() const {
+Tensor *Tensor::createRawAdoptingBuffer(ArrayRef<std::int64_t> extents,
+                                        ElementType type, void *allocatedPtr,
+                                        void *dataPtr,
+                                        std::int64_t byteOffset) {
+  auto *tensor = allocateTensor(extents, type);
+  tensor->allocatedPtr = allocatedPtr;
+  tensor->data = static_cast<char *>(dataPtr) + byteOffset;
+  return tensor;
+}
+
+Tensor *Tensor::createRawAdoptingBuffer(ArrayRef<std::int64_t> extents,
+                                        ArrayRef<std::int64_t> strides,
+                                        ElementType type, void *allocatedPtr,
+                                        void *dataPtr,
+                                        std::int64_t byteOffset) {
+  assert(extents.size() == strides.size() && "rank mismatch");
+  auto *tensor =
+      createRawAdoptingBuffer(extents, type, allocatedPtr, dataPtr, byteOffset);
+  for (int i = 0, e = strides.size(); i < e; i++)
+    tensor->getMutableStrides()[i] = strides[i];
+  return tensor;
+}
+
+Ref<Tensor> Tensor::createBorrowingBuffer(ArrayRef<std::int64_t> extents,
+                                          ElementType type, void *data) {
+  // A null allocatedPtr is never deallocated.
+  return Ref<Tensor>(createRawAdoptingBuffer(extents, type,
+                                             /*allocatedPtr=*/nullptr, data,
+                                             /*byteOffset=*/0));
+}
+
+Ref<Tensor> Tensor::createBorrowingBuffer(ArrayRef<std::int64_t> extents,
+                                          ArrayRef<std::int64_t> strides,
+                                          ElementType type, void *data) {
+  return Ref<Tensor>(createRawAdoptingBuffer(extents, strides, type,
+                                             /*allocatedPtr=*/nullptr, data,
+                                             /*byteOffset=*/0));
+}
+
+Tensor *Tensor::createRawReadOnlyView(ArrayRef<std::int64_t> extents,
+                                      ArrayRef<std::int64_t> strides,
+                                      ElementType type, void *dataPtr,
+                                      std::int64_t byteOffset) {
+  auto *tensor = createRawAdoptingBuffer(extents, strides, type,
+                                         /*allocatedPtr=*/nullptr, dataPtr,
+                                         byteOffset);
+  tensor->readOnly = true;
+  return tensor;
+}
+
+bool Tensor::isContiguous() const {
+  std::int64_t expectedStride = 1;
+  for (int i = getRank() - 1; i >= 0; i--) {
+    // The stride of a dimension of size 1 doesn't matter.
+    if (getExtent(i) != 1 && getStrides()[i] != expectedStride)
+      return false;
+    expectedStride *= getExtent(i);
+  }
+  return true;
+}
+
+std::int64_t Tensor::getDataByteSize() const {
   return getElementTypeByteSize(getElementType()) * totalElements(getExtents());
 }
 
@@ -188,36 +1112,503 @@ std::int32_t Tensor::getDataByteSize() const {
 template <typename T> static void *ToVoidPtr(T *ptr) {
   return const_cast<void *>(static_cast<const void *>(ptr));
 }
+static StringRef getName(const FuncDescriptor &functionDescriptor) {
+  return StringRef(functionDescriptor.name, functionDescriptor.nameLen);
+}
+
+// The compiler emits the function descriptors sorted by name (see
+// LowerToLLVM.cpp), so we can binary search for them.
+//
+// Returns the index of the first function descriptor whose name is not less
+// than `name`.
+static std::int32_t
+getFuncDescriptorLowerBound(ModuleDescriptor *moduleDescriptor,
+                            StringRef name) {
+  std::int32_t lo = 0, hi = moduleDescriptor->numFuncDescriptors;
+  while (lo < hi) {
+    std::int32_t mid = lo + (hi - lo) / 2;
+    auto &functionDescriptor = moduleDescriptor->functionDescriptors[mid];
+    if (getName(functionDescriptor).compare(name) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
 static FuncDescriptor *getFuncDescriptor(ModuleDescriptor *moduleDescriptor,
                                          StringRef name) {
-  for (int i = 0, e = moduleDescriptor->numFuncDescriptors; i < e; i++) {
-    auto &functionDescriptor = moduleDescriptor->functionDescriptors[i];
-    if (StringRef(functionDescriptor.name, functionDescriptor.nameLen) ==
-        name) {
-      return &functionDescriptor;
+  std::int32_t index = getFuncDescriptorLowerBound(moduleDescriptor, name);
+  if (index == moduleDescriptor->numFuncDescriptors)
+    return nullptr;
+  auto &functionDescriptor = moduleDescriptor->functionDescriptors[index];
+  if (getName(functionDescriptor) != name)
+    return nullptr;
+  return &functionDescriptor;
+}
+
+FunctionHandle refbackrt::lookupFunction(ModuleDescriptor *moduleDescriptor,
+                                         StringRef functionName) {
+  return FunctionHandle(getFuncDescriptor(moduleDescriptor, functionName));
+}
+
+StringRef refbackrt::getFunctionName(FunctionHandle function) {
+  assert(function && "null function handle");
+  return getName(*function.getDescriptor());
+}
+
+std::int32_t refbackrt::getNumFunctions(ModuleDescriptor *moduleDescriptor) {
+  return moduleDescriptor->numFuncDescriptors;
+}
+
+FunctionHandle refbackrt::getFunction(ModuleDescriptor *moduleDescriptor,
+                                      std::int32_t index) {
+  assert(index >= 0 && index < moduleDescriptor->numFuncDescriptors &&
+         "function index out of range");
+  return FunctionHandle(&moduleDescriptor->functionDescriptors[index]);
+}
+
+// Storage for a scalar crossing the ABI boundary, in the representation of
+// the compiled code.
+union ABIScalar {
+  float f32;
+  double f64;
+  std::int32_t i32;
+  std::int64_t i64;
+  std::uint8_t i1;
+};
+
+static ABIScalar toABIScalar(const RtValue &value, ABIArgType type) {
+  ABIScalar scalar;
+  switch (type) {
+  case ABIArgType::kF32:
+    scalar.f32 = value.toFloat();
+    break;
+  case ABIArgType::kF64:
+    scalar.f64 = value.toDouble();
+    break;
+  case ABIArgType::kI32:
+    scalar.i32 = static_cast<std::int32_t>(value.toInt());
+    break;
+  case ABIArgType::kI64:
+    scalar.i64 = value.toInt();
+    break;
+  case ABIArgType::kI1:
+    scalar.i1 = value.toBool();
+    break;
+  default:
+    assert(false && "not a scalar ABI type");
+  }
+  return scalar;
+}
+
+static RtValue fromABIScalar(const ABIScalar &scalar, ABIArgType type) {
+  switch (type) {
+  case ABIArgType::kF32:
+    return RtValue(scalar.f32);
+  case ABIArgType::kF64:
+    return RtValue(scalar.f64);
+  case ABIArgType::kI32:
+    return RtValue(scalar.i32);
+  case ABIArgType::kI64:
+    return RtValue(scalar.i64);
+  case ABIArgType::kI1:
+    return RtValue(scalar.i1 != 0);
+  default:
+    assert(false && "not a scalar ABI type");
+    return RtValue();
+  }
+}
+
+namespace {
+// The arguments of one call into the ABI wrapper of a function, packed as
+// it takes them.
+//
+// The packing only allocates for calls with more than kInlineArity inputs or
+// outputs.
+struct CallFrame {
+  CallFrame(std::size_t numInputs, std::size_t numOutputs)
+      : inputUnrankedMemrefs(numInputs), outputUnrankedMemrefs(numOutputs),
+        packedInputs(2 * numInputs), packedOutputs(numOutputs),
+        inputScalars(numInputs), outputScalars(numOutputs),
+        inputIsCopy(numInputs) {}
+  CallFrame(const CallFrame &) = delete;
+  CallFrame &operator=(const CallFrame &) = delete;
+
+  SmallVector<UnrankedMemref, kInlineArity> inputUnrankedMemrefs;
+  SmallVector<UnrankedMemref, kInlineArity> outputUnrankedMemrefs;
+  // Pointers to the slots above, which must not move once packed.
+  SmallVector<void *, 2 * kInlineArity> packedInputs;
+  SmallVector<void *, kInlineArity> packedOutputs;
+  // Scalars are passed through these slots in their ABI representation,
+  // rather than through the RtValue's.
+  SmallVector<ABIScalar, kInlineArity> inputScalars;
+  SmallVector<ABIScalar, kInlineArity> outputScalars;
+  // Whether we made a copy of each input buffer, which we then own.
+  SmallVector<bool, kInlineArity> inputIsCopy;
+};
+} // namespace
+
+// Packs tensor input `i` of `frame`, whose descriptor is `memref`.
+static void packTensorInput(CallFrame &frame, int i, UnrankedMemref memref) {
+  frame.inputUnrankedMemrefs[i] = memref;
+  frame.packedInputs[2 * i] = ToVoidPtr(&frame.inputUnrankedMemrefs[i].rank);
+  frame.packedInputs[2 * i + 1] =
+      ToVoidPtr(&frame.inputUnrankedMemrefs[i].descriptor);
+}
+
+// Packs scalar input `i` of `frame`.
+static void packScalarInput(const FuncDescriptor &descriptor, CallFrame &frame,
+                            int i, const RtValue &input) {
+  frame.inputScalars[i] =
+      toABIScalar(input, descriptor.inputDescriptors[i].abiType);
+  frame.packedInputs[2 * i] = ToVoidPtr(&frame.inputScalars[i]);
+}
+
+static bool isMemrefOutput(const FuncDescriptor &descriptor, int i) {
+  return descriptor.outputDescriptors[i].abiType == ABIArgType::kMemref;
+}
+
+// Create a type-erased list of "packed output" to pass to the
+// LLVM/C ABI wrapper function.
+//
+// Due to how StandardToLLVM lowering works, each packedOutput pointer
+// corresponds to a single UnrankedMemref (not "exploded"), or to a scalar.
+static void packOutputs(const FuncDescriptor &descriptor, CallFrame &frame) {
+  for (int i = 0, e = frame.packedOutputs.size(); i < e; i++) {
+    if (isMemrefOutput(descriptor, i))
+      frame.packedOutputs[i] = ToVoidPtr(&frame.outputUnrankedMemrefs[i]);
+    else
+      frame.packedOutputs[i] = ToVoidPtr(&frame.outputScalars[i]);
+  }
+}
+
+static interp::Scalar toInterpreterScalar(const ABIScalar &scalar,
+                                          ABIArgType type) {
+  interp::Scalar result;
+  switch (type) {
+  case ABIArgType::kF32:
+    result.f32 = scalar.f32;
+    break;
+  case ABIArgType::kF64:
+    result.f64 = scalar.f64;
+    break;
+  case ABIArgType::kI32:
+    result.i64 = scalar.i32;
+    break;
+  case ABIArgType::kI64:
+    result.i64 = scalar.i64;
+    break;
+  case ABIArgType::kI1:
+    result.i64 = scalar.i1 != 0;
+    break;
+  default:
+    assert(false && "not a scalar ABI type");
+    result.i64 = 0;
+  }
+  return result;
+}
+
+static ABIScalar fromInterpreterScalar(const interp::Scalar &scalar,
+                                       ABIArgType type) {
+  ABIScalar result;
+  switch (type) {
+  case ABIArgType::kF32:
+    result.f32 = scalar.f32;
+    break;
+  case ABIArgType::kF64:
+    result.f64 = scalar.f64;
+    break;
+  case ABIArgType::kI32:
+    result.i32 = static_cast<std::int32_t>(scalar.i64);
+    break;
+  case ABIArgType::kI64:
+    result.i64 = scalar.i64;
+    break;
+  case ABIArgType::kI1:
+    result.i1 = scalar.i64 != 0;
+    break;
+  default:
+    assert(false && "not a scalar ABI type");
+  }
+  return result;
+}
+
+// Runs the interpreted function of `descriptor` on the arguments packed in
+// `frame`, and packs its results as the compiled code would. The results get
+// buffers of their own, as OutputDescriptor::ownership promises.
+static const char *callInterpretedFunction(const FuncDescriptor &descriptor,
+                                           CallFrame &frame) {
+  std::vector<interp::Value> inputs(descriptor.numInputs), outputs;
+  for (int i = 0; i < descriptor.numInputs; i++) {
+    const InputDescriptor &input = descriptor.inputDescriptors[i];
+    if (input.abiType != ABIArgType::kMemref) {
+      inputs[i].scalar = toInterpreterScalar(frame.inputScalars[i],
+                                             input.abiType);
+      continue;
+    }
+    UnrankedMemref &memref = frame.inputUnrankedMemrefs[i];
+    MemrefDescriptor &memrefDescriptor = *memref.descriptor;
+    int rank = memref.rank;
+    inputs[i].data =
+        static_cast<char *>(memrefDescriptor.dataPtr) +
+        memrefDescriptor.offset *
+            getElementTypeByteSize(getElementTypeFromABI(input.elementType));
+    auto sizes = memrefDescriptor.getSizes(rank);
+    auto strides = memrefDescriptor.getStrides(rank);
+    inputs[i].extents.assign(sizes.data(), sizes.data() + rank);
+    inputs[i].strides.assign(strides.data(), strides.data() + rank);
+  }
+  if (const char *checkFailure = interp::runFunction(
+          *descriptor.interpretedFunction, inputs, outputs))
+    return checkFailure;
+  for (int i = 0; i < descriptor.numOutputs; i++) {
+    if (!isMemrefOutput(descriptor, i)) {
+      frame.outputScalars[i] = fromInterpreterScalar(
+          outputs[i].scalar, descriptor.outputDescriptors[i].abiType);
+      continue;
     }
+    const std::vector<std::int64_t> &extents = outputs[i].extents;
+    frame.outputUnrankedMemrefs[i] = UnrankedMemref{
+        static_cast<std::int64_t>(extents.size()),
+        MemrefDescriptor::create(
+            ArrayRef<std::int64_t>(extents.data(), extents.size()),
+            outputs[i].data)};
   }
   return nullptr;
 }
 
-void refbackrt::invoke(ModuleDescriptor *moduleDescriptor,
-                       StringRef functionName, ArrayRef<RtValue> inputs,
-                       MutableArrayRef<RtValue> outputs) {
-  auto *descriptor = getFuncDescriptor(moduleDescriptor, functionName);
-  assert(descriptor && "unknown function name");
-  assert(inputs.size() < kMaxArity && "number of inputs exceeds kMaxArity");
-  assert(outputs.size() < kMaxArity && "number of outputs exceeds kMaxArity");
-
-  // We haven't committed to using "vector" in this runtime code, so use
-  // a fixed-sized array.
-  std::array<UnrankedMemref, kMaxArity> inputUnrankedMemrefs;
-  std::array<UnrankedMemref, kMaxArity> outputUnrankedMemrefs;
-  std::array<void *, kMaxArity * 2> packedInputs;
-  std::array<void *, kMaxArity> packedOutputs;
-
-  // Deepcopy the refbackrt::Tensor's into UnrankedMemref's.
-  // TODO: Avoid the deep copy. It makes the later lifetime management code
-  // more complex though (and maybe impossible given the current abstractions).
+// Actually invoke the function! Scratch buffers allocated by the compiled
+// code are released as soon as it returns, since none of them can be
+// referenced by the outputs.
+//
+// Returns the message of the runtime check of the compiled code that failed,
+// if any, in which case the other buffers that the compiled code allocated
+// before the check are freed too.
+static const char *callCompiledCode(const FuncDescriptor &descriptor,
+                                    CallFrame &frame) {
+  if (descriptor.interpretedFunction)
+    return callInterpretedFunction(descriptor, frame);
+  const char *checkFailure = nullptr;
+  ScratchScope scratchScope(descriptor.peakScratchBytes);
+  CallAllocationScope allocationScope;
+  descriptor.functionPtr(frame.packedInputs.data(), frame.packedOutputs.data(),
+                         &checkFailure);
+  if (checkFailure)
+    allocationScope.freeLive();
+  return checkFailure;
+}
+
+// Frees the copies of the input buffers of `frame`, after a failed runtime
+// check. The compiled code returned early without setting the outputs (so
+// there are no output descriptors to free).
+static void freeInputCopies(ArrayRef<RtValue> inputs, CallFrame &frame) {
+  for (int i = 0, e = inputs.size(); i < e; i++) {
+    if (inputs[i].isRef() && frame.inputIsCopy[i])
+      deallocate(frame.inputUnrankedMemrefs[i].descriptor->allocatedPtr);
+  }
+}
+
+// Sets `outputs` from the results of the call packed in `frame`, and frees
+// the buffers and output descriptors of the call that no output took over.
+// The input descriptors are left alone.
+//
+// If `writeIntoOutputs` is true, tensor results are copied into the
+// caller-provided Tensor's in `outputs`. Otherwise (and for outputs that are
+// None), `outputs` are replaced with new Tensor's holding the results. Scalar
+// outputs are always replaced, and the kind of each output is taken from the
+// descriptor, so the incoming contents of `outputs` only matter for tensors
+// with `writeIntoOutputs`.
+static LogicalResult unpackOutputs(const FuncDescriptor &descriptor,
+                                   ArrayRef<RtValue> inputs,
+                                   MutableArrayRef<RtValue> outputs,
+                                   bool writeIntoOutputs, CallFrame &frame,
+                                   detail::CallRecorder &recorder,
+                                   const char **errorMessage) {
+  std::size_t numInputs = inputs.size();
+  std::size_t numOutputs = outputs.size();
+
+  // Wraps the result data of memref output `i` into a refbackrt::Tensor,
+  // which gets the buffer that the compiled code returned as per `transfer`.
+  // Adopted and viewed buffers keep the strides chosen by the compiled code.
+  //
+  // When writing into caller-provided outputs, no buffer is adopted. We copy
+  // each result into the corresponding output Tensor and free everything
+  // below. Outputs the caller left as None are set as with `invoke`.
+  //
+  // Returns true if the buffer was adopted.
+  LogicalResult result = success();
+  auto setOutput = [&](int i, OutputBufferTransfer transfer) {
+    auto elementType =
+        getElementTypeFromABI(descriptor.outputDescriptors[i].elementType);
+    UnrankedMemref &memref = frame.outputUnrankedMemrefs[i];
+    if (writeIntoOutputs && outputs[i].isTensor()) {
+      if (failed(copyUnrankedMemrefIntoTensor(memref.rank, memref.descriptor,
+                                              elementType,
+                                              outputs[i].getTensor()))) {
+        result = failure();
+        if (errorMessage)
+          *errorMessage = "result shape does not match the shape of the "
+                          "provided output buffer";
+      } else {
+        recorder.recordCopyOut(outputs[i].getTensor()->getDataByteSize());
+      }
+      return false;
+    }
+    Tensor *tensor = convertUnrankedMemrefToRefbackrtTensor(
+        memref.rank, memref.descriptor, elementType, transfer);
+    if (transfer == OutputBufferTransfer::kCopy)
+      recorder.recordCopyOut(tensor->getDataByteSize());
+    outputs[i] = RtValue(Ref<Tensor>(tensor));
+    return transfer == OutputBufferTransfer::kAdopt;
+  };
+
+  // The compiler records where the buffer of each output comes from, when it
+  // can tell, in which case we know which buffers we own.
+  bool hasOwnership = true;
+  for (int i = 0, e = outputs.size(); i < e; i++) {
+    if (isMemrefOutput(descriptor, i) &&
+        descriptor.outputDescriptors[i].ownership ==
+            ABIOutputOwnership::kUnknown)
+      hasOwnership = false;
+  }
+
+  // Whether each output buffer is ours to free, and whether its Tensor
+  // adopted it.
+  SmallVector<bool, kInlineArity> outputOwnsBuffer(numOutputs);
+  SmallVector<bool, kInlineArity> outputAdoptedBuffer(numOutputs);
+  // Whether the buffer of each copied input was handed over to an output.
+  SmallVector<bool, kInlineArity> inputHandedOver(numInputs);
+  if (hasOwnership) {
+    for (int i = 0, e = outputs.size(); i < e; i++) {
+      if (!isMemrefOutput(descriptor, i)) {
+        outputs[i] = fromABIScalar(frame.outputScalars[i],
+                                   descriptor.outputDescriptors[i].abiType);
+        continue;
+      }
+      auto &outputDescriptor = descriptor.outputDescriptors[i];
+      auto transfer = OutputBufferTransfer::kCopy;
+      switch (outputDescriptor.ownership) {
+      case ABIOutputOwnership::kOwned:
+        outputOwnsBuffer[i] = true;
+        break;
+      case ABIOutputOwnership::kConstantGlobal:
+        transfer = OutputBufferTransfer::kView;
+        break;
+      case ABIOutputOwnership::kAliasesInput: {
+        // The buffer is our copy of the input (inputs that the compiled code
+        // returns are never read-only), which the output takes over.
+        int input = outputDescriptor.aliasIndex;
+        outputOwnsBuffer[i] = frame.inputIsCopy[input];
+        inputHandedOver[input] = frame.inputIsCopy[input];
+        break;
+      }
+      default:
+        // Another output's buffer, or a mutable global: copy it.
+        break;
+      }
+      if (outputOwnsBuffer[i])
+        transfer = OutputBufferTransfer::kAdopt;
+      outputAdoptedBuffer[i] = setOutput(i, transfer);
+    }
+  } else {
+    // Without ownership information, we have to compare the buffers.
+    //
+    // This is complicated by the fact that multiple output UnrankedMemref's
+    // can end up with the same backing buffer (`allocatedPtr`), which can only
+    // be owned by one Tensor. Outputs that alias a previous output are copied.
+    //
+    // The returned memref can also point into statically allocated memory
+    // that we can't pass to `free`, such as the result of lowering a
+    // tensor-valued `std.constant` to `std.global_memref`. The LLVM lowering
+    // of std.global_memref sets the allocated pointer to the magic value
+    // 0xDEADBEEF, which we sniff for here.
+    auto isStaticallyAllocated = [](void *allocatedPtr) {
+      return reinterpret_cast<std::intptr_t>(allocatedPtr) == 0xDEADBEEF;
+    };
+    auto getAllocatedPtr = [&](int i) {
+      return frame.outputUnrankedMemrefs[i].descriptor->allocatedPtr;
+    };
+    for (int i = 0, e = outputs.size(); i < e; i++) {
+      if (!isMemrefOutput(descriptor, i)) {
+        outputs[i] = fromABIScalar(frame.outputScalars[i],
+                                   descriptor.outputDescriptors[i].abiType);
+        continue;
+      }
+      // Constants are viewed as in the case above.
+      if (descriptor.outputDescriptors[i].ownership ==
+          ABIOutputOwnership::kConstantGlobal) {
+        setOutput(i, OutputBufferTransfer::kView);
+        continue;
+      }
+      // The first output with a buffer owns it, whether it comes from the
+      // compiled code or from our copy of an input.
+      void *allocatedPtr = getAllocatedPtr(i);
+      bool ownsBuffer = !isStaticallyAllocated(allocatedPtr);
+      for (int j = 0; j < i; j++) {
+        if (isMemrefOutput(descriptor, j) &&
+            allocatedPtr == getAllocatedPtr(j))
+          ownsBuffer = false;
+      }
+      for (int j = 0, je = inputs.size(); j < je; j++) {
+        if (inputs[j].isRef() && frame.inputIsCopy[j] &&
+            allocatedPtr ==
+                frame.inputUnrankedMemrefs[j].descriptor->allocatedPtr)
+          inputHandedOver[j] = true;
+      }
+      outputOwnsBuffer[i] = ownsBuffer;
+      outputAdoptedBuffer[i] =
+          setOutput(i, ownsBuffer ? OutputBufferTransfer::kAdopt
+                                  : OutputBufferTransfer::kCopy);
+    }
+  }
+
+  // Free the output buffers that we own and weren't adopted, and the copies
+  // of inputs that weren't handed over to an output. No buffer is freed
+  // before all the outputs are set, since the later ones can copy from it.
+  for (int i = 0, e = outputs.size(); i < e; i++) {
+    if (outputOwnsBuffer[i] && !outputAdoptedBuffer[i])
+      deallocate(frame.outputUnrankedMemrefs[i].descriptor->allocatedPtr);
+  }
+  for (int i = 0, e = inputs.size(); i < e; i++) {
+    if (inputs[i].isRef() && frame.inputIsCopy[i] && !inputHandedOver[i])
+      deallocate(frame.inputUnrankedMemrefs[i].descriptor->allocatedPtr);
+  }
+
+  // Free the output descriptors.
+  for (int i = 0, e = outputs.size(); i < e; i++) {
+    if (!isMemrefOutput(descriptor, i))
+      continue;
+    // The LLVM lowering guarantees that each returned unranked memref
+    // descriptor is separately allocated (through the compiler runtime's
+    // allocation functions), so no need to do anything special like we had to
+    // do for the allocatedPtr's.
+    deallocate(frame.outputUnrankedMemrefs[i].descriptor);
+  }
+  return result;
+}
+
+// Shared implementation of `invoke` and `invokeInto`, with `writeIntoOutputs`
+// as in unpackOutputs.
+//
+// The input descriptors are allocated from `arena`, which is reset before
+// returning.
+//
+// On failure, `*errorMessage` (if non-null) is set to the reason.
+static LogicalResult invokeImpl(FunctionHandle function,
+                                ArrayRef<RtValue> inputs,
+                                MutableArrayRef<RtValue> outputs,
+                                bool writeIntoOutputs, DescriptorArena &arena,
+                                const char **errorMessage) {
+  assert(function && "unknown function name");
+  detail::CallRecorder recorder(function);
+  auto &descriptor = *function.getDescriptor();
+  CallFrame frame(inputs.size(), outputs.size());
+
+  // Convert the refbackrt::Tensor's into UnrankedMemref's.
+  // Inputs that the compiler marked as read-only are passed zero-copy. All
+  // other inputs are deep-copied, since the compiled code might write to them
+  // or hand them back to us as (aliases of) outputs that we need to free.
   //
   // Create a type-erased list of "packed inputs" to pass to the
   // LLVM/C ABI wrapper function. Each packedInput pointer corresponds to
@@ -227,113 +1618,198 @@ void refbackrt::invoke(ModuleDescriptor *moduleDescriptor,
   // "explode" the unranked memref descriptors on the underlying function
   // into separate arguments for the rank and pointer-to-descriptor.
   for (int i = 0, e = inputs.size(); i < e; i++) {
-    auto idx = 2 * i;
     if (inputs[i].isTensor()) {
-      inputUnrankedMemrefs[i] =
-          convertRefbackrtTensorToUnrankedMemref(inputs[i].toTensor().get());
-      packedInputs[idx] = ToVoidPtr(&inputUnrankedMemrefs[i].rank);
-      packedInputs[idx + 1] = ToVoidPtr(&inputUnrankedMemrefs[i].descriptor);
+      packTensorInput(frame, i,
+                      convertRefbackrtTensorToUnrankedMemref(
+                          inputs[i].getTensor(),
+                          descriptor.inputDescriptors[i].isReadOnly, arena,
+                          frame.inputIsCopy[i]));
+      if (frame.inputIsCopy[i])
+        recorder.recordCopyIn(inputs[i].getTensor()->getDataByteSize());
     } else if (inputs[i].isScalar()) {
-      packedInputs[idx] = ToVoidPtr(&inputs[i]);
+      packScalarInput(descriptor, frame, i, inputs[i]);
     } else {
       assert(false && "unsupported input RtValue type");
     }
   }
+  packOutputs(descriptor, frame);
 
-  // Create a type-erased list of "packed output" to pass to the
-  // LLVM/C ABI wrapper function.
-  //
-  // Due to how StandardToLLVM lowering works, each packedOutput pointer
-  // corresponds to a single UnrankedMemref (not "exploded").
-  for (int i = 0, e = outputs.size(); i < e; i++) {
-    if (outputs[i].isTensor()) {
-      packedOutputs[i] = ToVoidPtr(&outputUnrankedMemrefs[i]);
-    } else if (outputs[i].isScalar()) {
-      packedOutputs[i] = ToVoidPtr(&outputs[i]);
-    }
+  if (const char *checkFailure = callCompiledCode(descriptor, frame)) {
+    freeInputCopies(inputs, frame);
+    arena.reset();
+    if (errorMessage)
+      *errorMessage = checkFailure;
+    return failure();
   }
 
-  // Actually invoke the function!
-  descriptor->functionPtr(packedInputs.data(), packedOutputs.data());
+  LogicalResult result = unpackOutputs(descriptor, inputs, outputs,
+                                       writeIntoOutputs, frame, recorder,
+                                       errorMessage);
+  // Free the input descriptors.
+  arena.reset();
+  return result;
+}
 
-  // Copy out the result data into refbackrt::Tensor's.
-  // TODO: Avoid needing to make a deep copy.
-  for (int i = 0, e = outputs.size(); i < e; i++) {
-    // TODO: Have compiler emit the element type in the metadata.
-    if (outputs[i].isTensor()) {
-      auto elementType = ElementType::F32;
-      Tensor *tensor = convertUnrankedMemrefToRefbackrtTensor(
-          outputUnrankedMemrefs[i].rank, outputUnrankedMemrefs[i].descriptor,
-          elementType);
-      outputs[i] = RtValue(Ref<Tensor>(tensor));
-    } else if (outputs[i].isFloat()) {
-      outputs[i] = RtValue(*(reinterpret_cast<float *>(packedOutputs[i])));
-    }
-  }
+LogicalResult refbackrt::invoke(FunctionHandle function,
+                                ArrayRef<RtValue> inputs,
+                                MutableArrayRef<RtValue> outputs,
+                                const char **errorMessage) {
+  DescriptorArena arena;
+  return invokeImpl(function, inputs, outputs, /*writeIntoOutputs=*/false,
+                    arena, errorMessage);
+}
 
-  // Now, we just need to free all the UnrankedMemref's that we created.
-  // This is complicated by the fact that multiple input/output UnrankedMemref's
-  // can end up with the same backing buffer (`allocatedPtr`), and we need
-  // to avoid double-freeing.
-  // Output buffers might alias any other input or output buffer.
-  // Input buffers are guaranteed to not alias each other.
+LogicalResult refbackrt::invoke(ModuleDescriptor *moduleDescriptor,
+                                StringRef functionName,
+                                ArrayRef<RtValue> inputs,
+                                MutableArrayRef<RtValue> outputs,
+                                const char **errorMessage) {
+  return invoke(selectFunction(moduleDescriptor, functionName, inputs), inputs,
+                outputs, errorMessage);
+}
 
-  // Free the output buffers.
-  for (int i = 0, e = outputs.size(); i < e; i++) {
-    if (outputs[i].isRef()) {
-      void *allocatedPtr = outputUnrankedMemrefs[i].descriptor->allocatedPtr;
-      // Multiple returned memrefs can point into the same underlying
-      // malloc allocation. Do a linear scan to see if any of the previously
-      // deallocated buffers already freed this pointer.
-      bool bufferNeedsFreeing = true;
-      for (int j = 0; j < i; j++) {
-        if (allocatedPtr == outputUnrankedMemrefs[j].descriptor->allocatedPtr)
-          bufferNeedsFreeing = false;
-      }
-      if (!bufferNeedsFreeing)
-        std::free(allocatedPtr);
-    }
+LogicalResult refbackrt::invokeInto(FunctionHandle function,
+                                    ArrayRef<RtValue> inputs,
+                                    MutableArrayRef<RtValue> outputs,
+                                    const char **errorMessage) {
+  DescriptorArena arena;
+  return invokeImpl(function, inputs, outputs, /*writeIntoOutputs=*/true,
+                    arena, errorMessage);
+}
+
+LogicalResult refbackrt::invokeBatch(FunctionHandle function,
+                                     std::int32_t batchSize,
+                                     ArrayRef<RtValue> inputs,
+                                     MutableArrayRef<RtValue> outputs,
+                                     const char **errorMessage) {
+  assert(function && "unknown function name");
+  auto *descriptor = function.getDescriptor();
+  std::size_t numInputs = descriptor->numInputs;
+  std::size_t numOutputs = descriptor->numOutputs;
+  assert(inputs.size() == batchSize * numInputs &&
+         "inputs must hold batchSize groups of inputs");
+  assert(outputs.size() == batchSize * numOutputs &&
+         "outputs must hold batchSize groups of outputs");
+  // One arena shared by the whole batch.
+  DescriptorArena arena;
+  for (std::int32_t b = 0; b < batchSize; b++) {
+    ArrayRef<RtValue> callInputs(inputs.data() + b * numInputs, numInputs);
+    MutableArrayRef<RtValue> callOutputs(outputs.data() + b * numOutputs,
+                                         numOutputs);
+    if (failed(invokeImpl(function, callInputs, callOutputs,
+                          /*writeIntoOutputs=*/false, arena, errorMessage)))
+      return failure();
   }
+  return success();
+}
+
+LogicalResult refbackrt::invokeInto(ModuleDescriptor *moduleDescriptor,
+                                    StringRef functionName,
+                                    ArrayRef<RtValue> inputs,
+                                    MutableArrayRef<RtValue> outputs,
+                                    const char **errorMessage) {
+  return invokeInto(selectFunction(moduleDescriptor, functionName, inputs),
+                    inputs, outputs, errorMessage);
+}
+
+struct CapturedCall::State {
+  State(FunctionHandle function, ArrayRef<RtValue> inputs,
+        ArrayRef<RtValue> outputs)
+      : function(function), inputs(inputs), outputs(outputs),
+        isBoundOutput(outputs.size()), frame(inputs.size(), outputs.size()) {}
+
+  FunctionHandle function;
+  // Holding the input Tensor's keeps them alive.
+  SmallVector<RtValue, kInlineArity> inputs;
+  SmallVector<RtValue, kInlineArity> outputs;
+  // Whether each output is a Tensor that the results are written into.
+  SmallVector<bool, kInlineArity> isBoundOutput;
+  // The inputs whose buffers are copied by each replay.
+  SmallVector<int, kInlineArity> copiedInputs;
+  CallFrame frame;
+  // Holds the input descriptors, which are packed once by `capture`.
+  DescriptorArena arena;
+};
+
+CapturedCall::CapturedCall() = default;
+CapturedCall::CapturedCall(CapturedCall &&other) = default;
+CapturedCall &CapturedCall::operator=(CapturedCall &&other) = default;
+CapturedCall::~CapturedCall() = default;
+
+CapturedCall CapturedCall::capture(FunctionHandle function,
+                                   ArrayRef<RtValue> inputs,
+                                   ArrayRef<RtValue> outputs) {
+  assert(function && "unknown function name");
+  auto &descriptor = *function.getDescriptor();
+  assert(inputs.size() == std::size_t(descriptor.numInputs) &&
+         "wrong number of inputs");
+  assert(outputs.size() == std::size_t(descriptor.numOutputs) &&
+         "wrong number of outputs");
+  CapturedCall captured;
+  captured.state.reset(new State(function, inputs, outputs));
+  State &state = *captured.state;
 
-  // Free the input buffers.
+  // Inputs passed zero-copy are packed once and for all. The descriptors of
+  // the others get the buffer of a fresh copy on each replay.
   for (int i = 0, e = inputs.size(); i < e; i++) {
-    if (!inputs[i].isRef())
-      continue;
-    void *allocatedPtr = inputUnrankedMemrefs[i].descriptor->allocatedPtr;
-    bool bufferNeedsFreeing = true;
-    for (int j = 0, je = outputs.size(); j < je; j++) {
-      if (!outputs[j].isRef())
-        continue;
-      if (allocatedPtr == outputUnrankedMemrefs[j].descriptor->allocatedPtr)
-        bufferNeedsFreeing = false;
+    if (inputs[i].isTensor()) {
+      Tensor *tensor = inputs[i].getTensor();
+      bool isCopy =
+          needsInputCopy(tensor, descriptor.inputDescriptors[i].isReadOnly);
+      auto *memref = MemrefDescriptor::create(
+          tensor->getExtents(), isCopy ? nullptr : tensor->getData(),
+          state.arena.allocate(
+              MemrefDescriptor::getAllocSize(tensor->getRank())));
+      packTensorInput(state.frame, i,
+                      UnrankedMemref{tensor->getRank(), memref});
+      state.frame.inputIsCopy[i] = isCopy;
+      if (isCopy)
+        state.copiedInputs.push_back(i);
+    } else if (inputs[i].isScalar()) {
+      packScalarInput(descriptor, state.frame, i, inputs[i]);
+    } else {
+      assert(false && "unsupported input RtValue type");
     }
-    // HACK: The returned memref can point into statically allocated memory that
-    // we can't pass to `free`, such as the result of lowering a tensor-valued
-    // `std.constant` to `std.global_memref`. The LLVM lowering of
-    // std.global_memref sets the allocated pointer to the magic value
-    // 0xDEADBEEF, which we sniff for here. This is yet another strong signal
-    // that memref is really not the right abstraction for ABI's.
-    if (reinterpret_cast<std::intptr_t>(allocatedPtr) == 0xDEADBEEF)
-      bufferNeedsFreeing = false;
-    if (!bufferNeedsFreeing)
-      std::free(allocatedPtr);
   }
+  packOutputs(descriptor, state.frame);
+  for (int i = 0, e = outputs.size(); i < e; i++)
+    state.isBoundOutput[i] = outputs[i].isTensor();
+  return captured;
+}
 
-  // Free the output descriptors.
-  for (int i = 0, e = outputs.size(); i < e; i++) {
-    if (!outputs[i].isRef())
-      continue;
-    // The LLVM lowering guarantees that each returned unranked memref
-    // descriptor is separately malloc'ed, so no need to do anything special
-    // like we had to do for the allocatedPtr's.
-    std::free(outputUnrankedMemrefs[i].descriptor);
+LogicalResult CapturedCall::replay(const char **errorMessage) {
+  assert(state && "replaying an empty CapturedCall");
+  detail::CallRecorder recorder(state->function);
+  auto &descriptor = *state->function.getDescriptor();
+  CallFrame &frame = state->frame;
+  for (int i : state->copiedInputs) {
+    Tensor *tensor = state->inputs[i].getTensor();
+    MemrefDescriptor *memref = frame.inputUnrankedMemrefs[i].descriptor;
+    memref->allocatedPtr = memref->dataPtr = copyTensorData(tensor);
+    recorder.recordCopyIn(tensor->getDataByteSize());
   }
-  // Free the input descriptors.
-  for (int i = 0, e = inputs.size(); i < e; i++) {
-    if (!inputs[i].isRef())
-      continue;
-    std::free(inputUnrankedMemrefs[i].descriptor);
+
+  if (const char *checkFailure = callCompiledCode(descriptor, frame)) {
+    freeInputCopies(state->inputs, frame);
+    if (errorMessage)
+      *errorMessage = checkFailure;
+    return failure();
   }
+
+  // The outputs that aren't bound get the new results, rather than being
+  // written into the results of the previous replay.
+  for (int i = 0, e = state->outputs.size(); i < e; i++) {
+    if (!state->isBoundOutput[i])
+      state->outputs[i] = RtValue();
+  }
+  return unpackOutputs(descriptor, state->inputs, state->outputs,
+                       /*writeIntoOutputs=*/true, frame, recorder,
+                       errorMessage);
+}
+
+ArrayRef<RtValue> CapturedCall::getOutputs() const {
+  assert(state && "empty CapturedCall");
+  return state->outputs;
 }
 
 static InputArgInfo
@@ -348,7 +1824,7 @@ getExternalInputArgInfo(const refbackrt::InputDescriptor &inputDescriptor) {
     break;
   case ABIArgType::kMemref:
     ret.argType = ArgType::kTensor;
-    ret.elementType = ElementType::F32;
+    ret.elementType = getElementTypeFromABI(inputDescriptor.elementType);
     break;
   case ABIArgType::kF32:
     ret.argType = ArgType::kF32;
@@ -358,13 +1834,25 @@ getExternalInputArgInfo(const refbackrt::InputDescriptor &inputDescriptor) {
     ret.argType = ArgType::kF64;
     ret.elementType = ElementType::NONE;
     break;
+  case ABIArgType::kI32:
+    ret.argType = ArgType::kI32;
+    ret.elementType = ElementType::NONE;
+    break;
+  case ABIArgType::kI64:
+    ret.argType = ArgType::kI64;
+    ret.elementType = ElementType::NONE;
+    break;
+  case ABIArgType::kI1:
+    ret.argType = ArgType::kI1;
+    ret.elementType = ElementType::NONE;
+    break;
   }
 
   // Extract shape information
   ret.rank = inputDescriptor.rank;
-  for (int i = 0; i < inputDescriptor.rank; i++) {
-    ret.extents[i] = inputDescriptor.extents[i];
-  }
+  if (inputDescriptor.rank > 0)
+    ret.extents = ArrayRef<std::int64_t>(inputDescriptor.extents,
+                                         inputDescriptor.rank);
 
   return ret;
 }
@@ -381,7 +1869,7 @@ getExternalOutputArgInfo(const refbackrt::OutputDescriptor &outputDescriptor) {
     break;
   case ABIArgType::kMemref:
     ret.argType = ArgType::kTensor;
-    ret.elementType = ElementType::F32;
+    ret.elementType = getElementTypeFromABI(outputDescriptor.elementType);
     break;
   case ABIArgType::kF32:
     ret.argType = ArgType::kF32;
@@ -391,51 +1879,83 @@ getExternalOutputArgInfo(const refbackrt::OutputDescriptor &outputDescriptor) {
     ret.argType = ArgType::kF64;
     ret.elementType = ElementType::NONE;
     break;
+  case ABIArgType::kI32:
+    ret.argType = ArgType::kI32;
+    ret.elementType = ElementType::NONE;
+    break;
+  case ABIArgType::kI64:
+    ret.argType = ArgType::kI64;
+    ret.elementType = ElementType::NONE;
+    break;
+  case ABIArgType::kI1:
+    ret.argType = ArgType::kI1;
+    ret.elementType = ElementType::NONE;
+    break;
   }
 
   // Extract shape information
   ret.rank = outputDescriptor.rank;
-  for (int i = 0; i < outputDescriptor.rank; i++) {
-    ret.extents[i] = outputDescriptor.extents[i];
-  }
+  if (outputDescriptor.rank > 0)
+    ret.extents = ArrayRef<std::int64_t>(outputDescriptor.extents,
+                                         outputDescriptor.rank);
+  ret.isReadOnly =
+      outputDescriptor.abiType == ABIArgType::kMemref &&
+      outputDescriptor.ownership == ABIOutputOwnership::kConstantGlobal;
   return ret;
 }
 
 LogicalResult refbackrt::getMetadata(ModuleDescriptor *moduleDescriptor,
                                      StringRef functionName,
                                      FunctionMetadata &outMetadata) {
-  auto *descriptor = getFuncDescriptor(moduleDescriptor, functionName);
-  if (!descriptor)
+  auto function = lookupFunction(moduleDescriptor, functionName);
+  if (!function)
     return failure();
+  getMetadata(function, outMetadata);
+  return success();
+}
+
+void refbackrt::getMetadata(FunctionHandle function,
+                            FunctionMetadata &outMetadata) {
+  assert(function && "null function handle");
+  auto *descriptor = function.getDescriptor();
   outMetadata.numInputs = descriptor->numInputs;
   outMetadata.numOutputs = descriptor->numOutputs;
+  outMetadata.peakScratchBytes = descriptor->peakScratchBytes;
+  outMetadata.constantBytes = descriptor->constantBytes;
+  outMetadata.inputBytes = descriptor->inputBytes;
+  outMetadata.outputBytes = descriptor->outputBytes;
 
+  outMetadata.inputArgInfos.resize(descriptor->numInputs);
   for (int i = 0; i < descriptor->numInputs; i++) {
     outMetadata.inputArgInfos[i] =
         getExternalInputArgInfo(descriptor->inputDescriptors[i]);
   }
 
+  outMetadata.outputArgInfos.resize(descriptor->numOutputs);
   for (int i = 0; i < descriptor->numOutputs; i++) {
     outMetadata.outputArgInfos[i] =
         getExternalOutputArgInfo(descriptor->outputDescriptors[i]);
   }
+}
 
-  return success();
+void *refbackrt::getDirectEntryPoint(FunctionHandle function) {
+  assert(function && "null function handle");
+  return function.getDescriptor()->directFunctionPtr;
 }
 
 LogicalResult refbackrt::checkRtValueShapes(const RtValue &value,
                                             const InputArgInfo &info) {
   if (value.isTensor()) {
-    auto refTensor = value.toTensor();
+    const Tensor *tensor = value.getTensor();
 
     // Don't bother checking shapes for unranked tensors
     if (info.rank < 0)
       return success();
 
-    if (refTensor->getRank() != info.rank)
+    if (tensor->getRank() != info.rank)
       return failure();
 
-    auto tensorExtents = refTensor->getExtents();
+    auto tensorExtents = tensor->getExtents();
     for (int i = 0; i < info.rank; i++) {
       // If a dimension is dynamic, it is encoded as extent = -1
       // and we should skip checking over that dimension
@@ -447,19 +1967,41 @@ LogicalResult refbackrt::checkRtValueShapes(const RtValue &value,
   return success();
 }
 
+LogicalResult refbackrt::checkRtValueShapes(const RtValue &value,
+                                            const OutputArgInfo &info) {
+  InputArgInfo inputInfo;
+  inputInfo.argType = info.argType;
+  inputInfo.elementType = info.elementType;
+  inputInfo.rank = info.rank;
+  inputInfo.extents = info.extents;
+  return checkRtValueShapes(value, inputInfo);
+}
+
+LogicalResult refbackrt::checkRtValueArgTypes(const RtValue &value,
+                                              const OutputArgInfo &info) {
+  InputArgInfo inputInfo;
+  inputInfo.argType = info.argType;
+  inputInfo.elementType = info.elementType;
+  inputInfo.rank = info.rank;
+  inputInfo.extents = info.extents;
+  return checkRtValueArgTypes(value, inputInfo);
+}
+
 LogicalResult refbackrt::checkRtValueArgTypes(const RtValue &value,
                                               const InputArgInfo &info) {
   // Generic checks based on argType(s)
   if ((value.isTensor() && info.argType != ArgType::kTensor) ||
-      (value.isFloat() && info.argType != ArgType::kF32))
+      (value.isFloat() && info.argType != ArgType::kF32) ||
+      (value.isDouble() && info.argType != ArgType::kF64) ||
+      (value.isInt() && info.argType != ArgType::kI32 &&
+       info.argType != ArgType::kI64) ||
+      (value.isBool() && info.argType != ArgType::kI1))
     return failure();
 
   if (value.isRef()) {
     // Will need special error checking for ref-counted types
-    // Currently only f32 tensors are supported
     if (value.isTensor()) {
-      auto refTensor = value.toTensor();
-      if (refTensor->getElementType() != ElementType::F32)
+      if (value.getTensor()->getElementType() != info.elementType)
         return failure();
     } else {
       assert(false && "Unsupported input type checking for Ref type");
@@ -468,48 +2010,111 @@ LogicalResult refbackrt::checkRtValueArgTypes(const RtValue &value,
   return success();
 }
 
-RtValue refbackrt::createRtValueFromOutputArgInfo(const OutputArgInfo &info) {
-  constexpr int32_t kDynamicConstantShape = 100;
-  switch (info.argType) {
-  case ArgType::kTensor: {
-    // HACK: for dynamic dims the shape will be negative, so for now we are
-    // just going to create a tensor of size kDynamicConstantShape
-    std::array<int32_t, kMaxRank> tensorShape;
-    for (int i = 0; i < info.rank; i++) {
-      tensorShape[i] =
-          info.extents[i] > 0 ? info.extents[i] : kDynamicConstantShape;
+//===----------------------------------------------------------------------===//
+// Function specializations.
+//===----------------------------------------------------------------------===//
+
+// Returns the number of static extents of the inputs of `descriptor` if
+// `inputs` are valid inputs of it, and -1 otherwise.
+static std::int64_t getSpecializationScore(const FuncDescriptor &descriptor,
+                                           ArrayRef<RtValue> inputs) {
+  if (descriptor.numInputs != static_cast<std::int32_t>(inputs.size()))
+    return -1;
+  std::int64_t score = 0;
+  for (int i = 0; i < descriptor.numInputs; i++) {
+    InputArgInfo info = getExternalInputArgInfo(descriptor.inputDescriptors[i]);
+    if (failed(checkRtValueArgTypes(inputs[i], info)) ||
+        failed(checkRtValueShapes(inputs[i], info)))
+      return -1;
+    for (int j = 0; j < info.rank; j++) {
+      if (info.extents[j] >= 0)
+        score++;
     }
-    refbackrt::ArrayRef<int32_t> shape(tensorShape.data(), info.rank);
-    int numel = 1;
-    for (int i = 0; i < info.rank; i++)
-      numel *= shape[i];
-
-    void *data;
-    switch (info.elementType) {
-    case ElementType::F32: {
-      auto byteSize = numel * sizeof(float);
-      data = static_cast<void *>(aligned_alloc(32, byteSize));
-      memset(data, 0, byteSize);
-      return RtValue(Tensor::create(shape, ElementType::F32, data));
+  }
+  return score;
+}
+
+FunctionHandle refbackrt::selectFunction(ModuleDescriptor *moduleDescriptor,
+                                         StringRef functionName,
+                                         ArrayRef<RtValue> inputs) {
+  FuncDescriptor *fallback = getFuncDescriptor(moduleDescriptor, functionName);
+  FuncDescriptor *best = nullptr;
+  std::int64_t bestScore = -1;
+  if (fallback)
+    bestScore = getSpecializationScore(*fallback, inputs);
+  // The specializations are named `functionName$<suffix>`. Since '$' sorts
+  // before all the other characters of function names, they directly follow
+  // the function in the sorted descriptors.
+  for (std::int32_t i =
+           getFuncDescriptorLowerBound(moduleDescriptor, functionName);
+       i < moduleDescriptor->numFuncDescriptors; i++) {
+    auto &descriptor = moduleDescriptor->functionDescriptors[i];
+    StringRef name = getName(descriptor);
+    if (name.size() <= functionName.size() ||
+        std::memcmp(name.data(), functionName.data(), functionName.size()))
       break;
+    char separator = name.data()[functionName.size()];
+    if (separator > '$')
+      break;
+    if (separator != '$')
+      continue;
+    std::int64_t score = getSpecializationScore(descriptor, inputs);
+    if (score > bestScore) {
+      best = &descriptor;
+      bestScore = score;
     }
-    default: { assert(false && "unknown output tensor type"); }
-    }
-
-    // The Tensor::create function will malloc and memcpy the data
-    // into the Tensor object, so after we need to free our
-    // temporary data buffer
-    assert(data && "data ptr must exist");
-    auto refTensor = Tensor::create(shape, ElementType::F32, data);
-    free(data);
-    return RtValue(refTensor);
   }
-  case ArgType::kF32: {
-    return RtValue(-20.0f);
+  // If nothing matches, return the function itself, so that calling it
+  // reports the mismatch as usual.
+  return FunctionHandle(best ? best : fallback);
+}
+
+// Creates a zero-filled value of `argType`, or None for tensors that aren't
+// of a static shape.
+static RtValue createZeroRtValue(ArgType argType, ElementType elementType,
+                                 std::int32_t rank,
+                                 const std::int64_t *extents) {
+  switch (argType) {
+  case ArgType::kTensor: {
+    if (rank < 0)
+      return RtValue();
+    for (int i = 0; i < rank; i++)
+      if (extents[i] < 0)
+        return RtValue();
+    refbackrt::ArrayRef<int64_t> shape(extents, rank);
+    assert(elementType != ElementType::NONE && "unknown tensor type");
+    // Zero-initialize the tensor. All supported element types represent zero
+    // as all-zero bytes.
+    auto byteSize = getElementTypeByteSize(elementType) * totalElements(shape);
+    void *buffer = allocate(byteSize);
+    std::memset(buffer, 0, byteSize);
+    return RtValue(Ref<Tensor>(Tensor::createRawAdoptingBuffer(
+        shape, elementType, buffer, buffer, /*byteOffset=*/0)));
   }
+  case ArgType::kF32:
+    return RtValue(0.0f);
+  case ArgType::kF64:
+    return RtValue(0.0);
+  case ArgType::kI32:
+  case ArgType::kI64:
+    return RtValue(std::int64_t(0));
+  case ArgType::kI1:
+    return RtValue(false);
   default: {
     assert(false && "Don't know how to handle this artType");
     return RtValue();
   }
   }
 }
+
+RtValue refbackrt::createRtValueFromOutputArgInfo(const OutputArgInfo &info) {
+  // The compiled code allocates the tensors whose shapes it computes, which
+  // `invokeInto` then adopts.
+  return createZeroRtValue(info.argType, info.elementType, info.rank,
+                           info.extents.data());
+}
+
+RtValue refbackrt::createRtValueFromInputArgInfo(const InputArgInfo &info) {
+  return createZeroRtValue(info.argType, info.elementType, info.rank,
+                           info.extents.data());
+}
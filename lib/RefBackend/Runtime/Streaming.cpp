@@ -0,0 +1,478 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Streaming execution of functions over tensors stored in files.
+//
+// Each chunk is a range of rows (indices of the leading dimension) of the
+// streamed inputs, which is read with `pread` into one of two buffers per
+// input, and passed to the function as Tensor's borrowing these buffers. The
+// next chunk is read on another thread while the function runs, and the
+// results of a chunk are written with `pwrite` on another thread while the
+// function runs on the next chunk.
+//
+//===----------------------------------------------------------------------===//
+
+#include "npcomp/RefBackend/Runtime/UserAPI.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace refbackrt;
+
+static thread_local std::string lastStreamError;
+
+static LogicalResult setStreamError(const char **errorMessage,
+                                    std::string message) {
+  lastStreamError = std::move(message);
+  if (errorMessage)
+    *errorMessage = lastStreamError.c_str();
+  return failure();
+}
+
+#ifndef _WIN32
+namespace {
+// A file descriptor, closed when destroyed.
+class File {
+public:
+  File() = default;
+  File(const File &) = delete;
+  File(File &&other) : fd(other.fd) { other.fd = -1; }
+  ~File() {
+    if (fd >= 0)
+      ::close(fd);
+  }
+  int fd = -1;
+};
+
+// A buffer allocated with refbackrt::allocate, deallocated when destroyed.
+class Buffer {
+public:
+  Buffer() = default;
+  Buffer(const Buffer &) = delete;
+  Buffer(Buffer &&other) : data(other.data) { other.data = nullptr; }
+  ~Buffer() { deallocate(data); }
+  void *data = nullptr;
+};
+
+// A FileTensor opened for streaming.
+struct StreamedFile {
+  FileTensor tensor;
+  File file;
+  // The size of the elements of one index of the leading dimension.
+  std::int64_t rowBytes;
+};
+} // namespace
+
+static std::string describeErrno() { return std::strerror(errno); }
+
+static bool openFile(const FileTensor &tensor, bool forWriting,
+                     StreamedFile &streamed, std::string &error) {
+  streamed.tensor = tensor;
+  streamed.file.fd = forWriting ? ::open(tensor.path, O_WRONLY | O_CREAT, 0644)
+                                : ::open(tensor.path, O_RDONLY);
+  if (streamed.file.fd < 0) {
+    error = std::string("could not open ") + tensor.path + ": " +
+            describeErrno();
+    return false;
+  }
+  streamed.rowBytes = getElementTypeByteSize(tensor.elementType);
+  for (std::size_t i = 1; i < tensor.extents.size(); i++)
+    streamed.rowBytes *= tensor.extents[i];
+  return true;
+}
+
+// Reads or writes `size` bytes at `offset` of `file`, retrying partial
+// transfers.
+static bool transfer(const StreamedFile &file, bool write, char *data,
+                     std::int64_t size, std::int64_t offset,
+                     std::string &error) {
+  while (size > 0) {
+    ssize_t done = write ? ::pwrite(file.file.fd, data, size, offset)
+                         : ::pread(file.file.fd, data, size, offset);
+    if (done < 0 && errno == EINTR)
+      continue;
+    if (done <= 0) {
+      error = std::string("could not ") + (write ? "write " : "read ") +
+              file.tensor.path + ": " +
+              (done == 0 ? std::string("unexpected end of file")
+                         : describeErrno());
+      return false;
+    }
+    data += done;
+    size -= done;
+    offset += done;
+  }
+  return true;
+}
+
+namespace {
+// The state shared by streamMap and streamReduce.
+class Stream {
+public:
+  Stream(FunctionHandle function, ArrayRef<FileTensor> streamedInputs,
+         ArrayRef<RtValue> extraInputs, const StreamOptions &options)
+      : function(function), extraInputs(extraInputs),
+        streamedInputs(streamedInputs), options(options) {}
+
+  // Opens the inputs and allocates the chunk buffers. `numLeadingInputs` is
+  // the number of inputs of the function before the streamed ones.
+  bool initialize(int numLeadingInputs, std::string &error);
+
+  // Reads chunk `chunk` into its buffers.
+  bool readChunk(std::int64_t chunk, std::string &error);
+
+  // Returns the inputs of chunk `chunk`: `leadingInputs`, the chunk of the
+  // streamed inputs and the extra inputs.
+  std::vector<RtValue> getInputs(std::int64_t chunk,
+                                 ArrayRef<RtValue> leadingInputs);
+
+  // Invokes the function on `inputs` after checking them.
+  bool invokeChecked(const std::vector<RtValue> &inputs,
+                     std::vector<RtValue> &outputs, std::string &error);
+
+  // Returns true if `data` is in one of the buffers of chunk `chunk`.
+  bool isInChunkBuffers(std::int64_t chunk, const void *data);
+
+  std::int64_t getChunkRows(std::int64_t chunk) const {
+    std::int64_t begin = chunk * chunkRows;
+    return std::min(chunkRows, numRows - begin);
+  }
+
+  FunctionHandle function;
+  ArrayRef<RtValue> extraInputs;
+  ArrayRef<FileTensor> streamedInputs;
+  const StreamOptions &options;
+  FunctionMetadata metadata;
+  std::vector<StreamedFile> files;
+  // The buffers of even and odd chunks, one per streamed input.
+  std::vector<Buffer> buffers[2];
+  std::int64_t numRows = 0;
+  std::int64_t chunkRows = 0;
+  std::int64_t numChunks = 0;
+};
+} // namespace
+
+bool Stream::initialize(int numLeadingInputs, std::string &error) {
+  getMetadata(function, metadata);
+  int numInputs = numLeadingInputs + streamedInputs.size() + extraInputs.size();
+  if (metadata.numInputs != numInputs) {
+    error = "expected " + std::to_string(metadata.numInputs) +
+            " inputs but got " + std::to_string(numInputs);
+    return false;
+  }
+  if (streamedInputs.size() == 0) {
+    error = "no streamed inputs";
+    return false;
+  }
+  std::int64_t totalRowBytes = 0;
+  for (std::size_t i = 0; i < streamedInputs.size(); i++) {
+    const FileTensor &input = streamedInputs[i];
+    if (input.extents.empty()) {
+      error = std::string("streamed input has rank 0: ") + input.path;
+      return false;
+    }
+    if (i == 0)
+      numRows = input.extents[0];
+    if (input.extents[0] != numRows) {
+      error = std::string("leading extent of streamed input ") + input.path +
+              " differs from the other streamed inputs";
+      return false;
+    }
+    files.emplace_back();
+    if (!openFile(input, /*forWriting=*/false, files.back(), error))
+      return false;
+    totalRowBytes += files.back().rowBytes;
+  }
+
+  chunkRows = options.chunkRows;
+  if (chunkRows <= 0) {
+    chunkRows = totalRowBytes == 0 ? numRows
+                                   : kDefaultStreamChunkBytes / totalRowBytes;
+  }
+  chunkRows = std::max<std::int64_t>(1, std::min(chunkRows, numRows));
+  numChunks = numRows == 0 ? 0 : (numRows + chunkRows - 1) / chunkRows;
+  for (auto &slotBuffers : buffers) {
+    for (StreamedFile &file : files) {
+      slotBuffers.emplace_back();
+      // Don't allocate 0 bytes, which may return null.
+      slotBuffers.back().data =
+          allocate(std::max<std::int64_t>(1, chunkRows * file.rowBytes));
+    }
+  }
+  return true;
+}
+
+bool Stream::readChunk(std::int64_t chunk, std::string &error) {
+  std::int64_t rows = getChunkRows(chunk);
+  for (std::size_t i = 0; i < files.size(); i++) {
+    StreamedFile &file = files[i];
+    if (!transfer(file, /*write=*/false,
+                  static_cast<char *>(buffers[chunk % 2][i].data),
+                  rows * file.rowBytes,
+                  file.tensor.byteOffset + chunk * chunkRows * file.rowBytes,
+                  error))
+      return false;
+  }
+  return true;
+}
+
+std::vector<RtValue> Stream::getInputs(std::int64_t chunk,
+                                       ArrayRef<RtValue> leadingInputs) {
+  std::vector<RtValue> inputs;
+  inputs.reserve(metadata.numInputs);
+  for (std::size_t i = 0; i < leadingInputs.size(); i++)
+    inputs.push_back(leadingInputs[i]);
+  for (std::size_t i = 0; i < files.size(); i++) {
+    const FileTensor &tensor = files[i].tensor;
+    SmallVector<std::int64_t, kInlineRank> extents = tensor.extents;
+    extents[0] = getChunkRows(chunk);
+    inputs.push_back(Tensor::createBorrowingBuffer(
+        extents, tensor.elementType, buffers[chunk % 2][i].data));
+  }
+  for (std::size_t i = 0; i < extraInputs.size(); i++)
+    inputs.push_back(extraInputs[i]);
+  return inputs;
+}
+
+bool Stream::invokeChecked(const std::vector<RtValue> &inputs,
+                           std::vector<RtValue> &outputs, std::string &error) {
+  for (std::size_t i = 0; i < inputs.size(); i++) {
+    if (failed(checkRtValueArgTypes(inputs[i], metadata.inputArgInfos[i])) ||
+        failed(checkRtValueShapes(inputs[i], metadata.inputArgInfos[i]))) {
+      error = "input " + std::to_string(i) +
+              " doesn't match the type of the function's argument";
+      return false;
+    }
+  }
+  outputs.assign(metadata.numOutputs, RtValue());
+  const char *checkFailure = nullptr;
+  if (failed(invoke(function, ArrayRef<RtValue>(inputs.data(), inputs.size()),
+                    MutableArrayRef<RtValue>(outputs.data(), outputs.size()),
+                    &checkFailure))) {
+    error = checkFailure;
+    return false;
+  }
+  return true;
+}
+
+bool Stream::isInChunkBuffers(std::int64_t chunk, const void *data) {
+  auto *pointer = static_cast<const char *>(data);
+  for (std::size_t i = 0; i < files.size(); i++) {
+    auto *begin = static_cast<const char *>(buffers[chunk % 2][i].data);
+    if (pointer >= begin && pointer < begin + chunkRows * files[i].rowBytes)
+      return true;
+  }
+  return false;
+}
+
+// Checks that `output` is a contiguous chunk of `rows` rows of `file`.
+static bool checkOutput(const RtValue &output, const StreamedFile &file,
+                        std::int64_t rows, std::string &error) {
+  const FileTensor &tensor = file.tensor;
+  bool matches = output.isTensor();
+  if (matches) {
+    const Tensor *result = output.getTensor();
+    int rank = tensor.extents.size();
+    matches = result->getElementType() == tensor.elementType &&
+              result->getRank() == rank && result->isContiguous() &&
+              result->getExtent(0) == rows;
+    for (int i = 1; matches && i < rank; i++)
+      matches = result->getExtent(i) == tensor.extents[i];
+  }
+  if (!matches)
+    error = std::string("result doesn't match the output ") + tensor.path;
+  return matches;
+}
+
+static bool writeOutputs(const std::vector<RtValue> &outputs,
+                         const std::vector<StreamedFile> &files,
+                         std::int64_t firstRow, std::string &error) {
+  for (std::size_t i = 0; i < outputs.size(); i++) {
+    const Tensor *result = outputs[i].getTensor();
+    const StreamedFile &file = files[i];
+    if (!transfer(file, /*write=*/true, result->getData<char>(),
+                  result->getDataByteSize(),
+                  file.tensor.byteOffset + firstRow * file.rowBytes, error))
+      return false;
+  }
+  return true;
+}
+
+// Runs `readChunk` of the chunk after `chunk` on another thread, if any.
+static std::future<std::string> readNextChunk(Stream &stream,
+                                              std::int64_t chunk) {
+  if (chunk + 1 >= stream.numChunks)
+    return std::future<std::string>();
+  return std::async(std::launch::async, [&stream, chunk] {
+    std::string error;
+    stream.readChunk(chunk + 1, error);
+    return error;
+  });
+}
+
+// Returns the error of a pending transfer, if any.
+static std::string wait(std::future<std::string> &pending) {
+  return pending.valid() ? pending.get() : std::string();
+}
+#endif // _WIN32
+
+LogicalResult refbackrt::streamMap(FunctionHandle function,
+                                   ArrayRef<FileTensor> streamedInputs,
+                                   ArrayRef<RtValue> extraInputs,
+                                   ArrayRef<FileTensor> outputs,
+                                   const StreamOptions &options,
+                                   const char **errorMessage) {
+#ifdef _WIN32
+  return setStreamError(errorMessage,
+                        "streaming execution is not supported on Windows");
+#else
+  std::string error;
+  Stream stream(function, streamedInputs, extraInputs, options);
+  if (!stream.initialize(/*numLeadingInputs=*/0, error))
+    return setStreamError(errorMessage, error);
+  if (stream.metadata.numOutputs != static_cast<int>(outputs.size()))
+    return setStreamError(errorMessage,
+                          "expected " +
+                              std::to_string(stream.metadata.numOutputs) +
+                              " outputs but got " +
+                              std::to_string(outputs.size()));
+  std::vector<StreamedFile> outputFiles(outputs.size());
+  for (std::size_t i = 0; i < outputs.size(); i++) {
+    if (outputs[i].extents.empty() || outputs[i].extents[0] != stream.numRows)
+      return setStreamError(
+          errorMessage, std::string("leading extent of output ") +
+                            outputs[i].path +
+                            " differs from the streamed inputs");
+    if (!openFile(outputs[i], /*forWriting=*/true, outputFiles[i], error))
+      return setStreamError(errorMessage, error);
+  }
+
+  if (stream.numChunks > 0 && !stream.readChunk(0, error))
+    return setStreamError(errorMessage, error);
+  std::future<std::string> pendingWrite;
+  for (std::int64_t chunk = 0; chunk < stream.numChunks; chunk++) {
+    // The buffers of the next chunk were those of the previous chunk, whose
+    // results are either written already or don't use them.
+    std::future<std::string> pendingRead = readNextChunk(stream, chunk);
+    std::vector<RtValue> results;
+    bool invoked = stream.invokeChecked(
+        stream.getInputs(chunk, ArrayRef<RtValue>(nullptr, 0)), results,
+        error);
+    for (std::size_t i = 0; invoked && i < results.size(); i++) {
+      invoked = checkOutput(results[i], outputFiles[i],
+                            stream.getChunkRows(chunk), error);
+    }
+    std::string writeError = wait(pendingWrite);
+    if (!invoked || !writeError.empty()) {
+      wait(pendingRead);
+      return setStreamError(errorMessage, invoked ? writeError : error);
+    }
+    std::int64_t firstRow = chunk * stream.chunkRows;
+    bool aliasesInputs = false;
+    for (const RtValue &result : results) {
+      aliasesInputs |=
+          stream.isInChunkBuffers(chunk, result.getTensor()->getData());
+    }
+    if (aliasesInputs) {
+      // Results viewing the input buffers (e.g. returned inputs) must be
+      // written before the buffers are reused.
+      if (!writeOutputs(results, outputFiles, firstRow, error)) {
+        wait(pendingRead);
+        return setStreamError(errorMessage, error);
+      }
+    } else {
+      pendingWrite = std::async(
+          std::launch::async,
+          [&outputFiles, firstRow, results = std::move(results)] {
+            std::string error;
+            writeOutputs(results, outputFiles, firstRow, error);
+            return error;
+          });
+    }
+    std::string readError = wait(pendingRead);
+    if (!readError.empty()) {
+      wait(pendingWrite);
+      return setStreamError(errorMessage, readError);
+    }
+  }
+  std::string writeError = wait(pendingWrite);
+  if (!writeError.empty())
+    return setStreamError(errorMessage, writeError);
+  // Drop whatever followed the output in a preexisting file. The file can't
+  // be truncated when opened, since it may also be a streamed input.
+  for (StreamedFile &file : outputFiles) {
+    if (::ftruncate(file.file.fd, file.tensor.byteOffset +
+                                      stream.numRows * file.rowBytes) != 0)
+      return setStreamError(errorMessage, std::string("could not truncate ") +
+                                              file.tensor.path + ": " +
+                                              describeErrno());
+  }
+  return success();
+#endif
+}
+
+LogicalResult refbackrt::streamReduce(FunctionHandle function,
+                                      ArrayRef<FileTensor> streamedInputs,
+                                      ArrayRef<RtValue> extraInputs,
+                                      MutableArrayRef<RtValue> accumulators,
+                                      const StreamOptions &options,
+                                      const char **errorMessage) {
+#ifdef _WIN32
+  return setStreamError(errorMessage,
+                        "streaming execution is not supported on Windows");
+#else
+  std::string error;
+  Stream stream(function, streamedInputs, extraInputs, options);
+  if (!stream.initialize(accumulators.size(), error))
+    return setStreamError(errorMessage, error);
+  if (stream.metadata.numOutputs != static_cast<int>(accumulators.size()))
+    return setStreamError(errorMessage,
+                          "expected the function to return " +
+                              std::to_string(accumulators.size()) +
+                              " accumulators but it returns " +
+                              std::to_string(stream.metadata.numOutputs));
+
+  if (stream.numChunks > 0 && !stream.readChunk(0, error))
+    return setStreamError(errorMessage, error);
+  for (std::int64_t chunk = 0; chunk < stream.numChunks; chunk++) {
+    std::future<std::string> pendingRead = readNextChunk(stream, chunk);
+    std::vector<RtValue> results;
+    bool invoked = stream.invokeChecked(
+        stream.getInputs(chunk, ArrayRef<RtValue>(accumulators.data(),
+                                                  accumulators.size())),
+        results, error);
+    std::string readError = wait(pendingRead);
+    if (!invoked || !readError.empty())
+      return setStreamError(errorMessage, invoked ? readError : error);
+    for (std::size_t i = 0; i < results.size(); i++) {
+      // An accumulator viewing the input buffers would be overwritten by
+      // the next chunk.
+      if (results[i].isTensor() &&
+          stream.isInChunkBuffers(chunk, results[i].getTensor()->getData())) {
+        Ref<Tensor> result = results[i].takeTensor();
+        results[i] = Tensor::create(result->getExtents(),
+                                    result->getElementType(),
+                                    result->getData());
+      }
+      accumulators[i] = std::move(results[i]);
+    }
+  }
+  return success();
+#endif
+}
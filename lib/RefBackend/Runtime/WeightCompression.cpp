@@ -0,0 +1,212 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// The compressed weights are a sequence of blocks, each
+//   uint8_t  elementBytes
+//   uint32_t size          (decompressed, a multiple of elementBytes)
+//   uint32_t payloadSize
+//   the elementBytes byte planes of the block, each
+//     uint8_t  encoding    (kRawPlane or kRunLengthPlane)
+//     uint32_t encodedSize
+//     the encoded plane
+// with integers stored little-endian. Run-length encoded planes are sequences
+// of a control byte `c` followed by `c + 1` literal bytes if `c` is below 128,
+// and otherwise by one byte repeated `c - 125` times.
+//
+//===----------------------------------------------------------------------===//
+
+#include "npcomp/RefBackend/Runtime/WeightCompression.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace refbackrt;
+
+namespace {
+enum PlaneEncoding : std::uint8_t {
+  kRawPlane = 0,
+  kRunLengthPlane = 1,
+};
+} // namespace
+
+constexpr std::size_t kBlockHeaderSize = 9;
+constexpr std::size_t kPlaneHeaderSize = 5;
+constexpr std::size_t kMinRun = 3;
+constexpr std::size_t kMaxRun = 130;
+constexpr std::size_t kMaxLiterals = 128;
+
+static void appendUint32(std::vector<char> &out, std::uint32_t value) {
+  for (int i = 0; i < 4; ++i)
+    out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+}
+
+static void storeUint32(char *out, std::uint32_t value) {
+  for (int i = 0; i < 4; ++i)
+    out[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+}
+
+static std::uint32_t loadUint32(const char *in) {
+  std::uint32_t value = 0;
+  for (int i = 0; i < 4; ++i)
+    value |= static_cast<std::uint32_t>(static_cast<std::uint8_t>(in[i]))
+             << (8 * i);
+  return value;
+}
+
+// Appends the run-length encoding of the `size` bytes at `plane` to `out`.
+static void encodeRunLength(const char *plane, std::size_t size,
+                            std::vector<char> &out) {
+  std::size_t literalsBegin = 0;
+  auto flushLiterals = [&](std::size_t end) {
+    while (literalsBegin < end) {
+      std::size_t count = std::min(end - literalsBegin, kMaxLiterals);
+      out.push_back(static_cast<char>(count - 1));
+      out.insert(out.end(), plane + literalsBegin,
+                 plane + literalsBegin + count);
+      literalsBegin += count;
+    }
+  };
+  std::size_t i = 0;
+  while (i < size) {
+    std::size_t run = 1;
+    while (i + run < size && run < kMaxRun && plane[i + run] == plane[i])
+      ++run;
+    if (run < kMinRun) {
+      i += run;
+      continue;
+    }
+    flushLiterals(i);
+    out.push_back(static_cast<char>(128 + run - kMinRun));
+    out.push_back(plane[i]);
+    i += run;
+    literalsBegin = i;
+  }
+  flushLiterals(size);
+}
+
+// Decodes the run-length encoded `encodedSize` bytes at `encoded` into the
+// `size` bytes at `plane`. Returns false if they don't decode to exactly
+// `size` bytes.
+static bool decodeRunLength(const char *encoded, std::size_t encodedSize,
+                            char *plane, std::size_t size) {
+  const char *end = encoded + encodedSize;
+  std::size_t decoded = 0;
+  while (encoded < end) {
+    auto control = static_cast<std::uint8_t>(*encoded++);
+    if (control < 128) {
+      std::size_t count = control + 1;
+      if (static_cast<std::size_t>(end - encoded) < count ||
+          size - decoded < count)
+        return false;
+      std::memcpy(plane + decoded, encoded, count);
+      encoded += count;
+      decoded += count;
+    } else {
+      std::size_t count = control - 128 + kMinRun;
+      if (encoded == end || size - decoded < count)
+        return false;
+      std::memset(plane + decoded, *encoded++, count);
+      decoded += count;
+    }
+  }
+  return decoded == size;
+}
+
+void refbackrt::compressWeights(const void *data, std::size_t size,
+                                std::size_t elementBytes,
+                                std::vector<char> &compressed) {
+  elementBytes = std::max<std::size_t>(1, std::min<std::size_t>(
+                                              elementBytes, 255));
+  if (size % elementBytes != 0)
+    elementBytes = 1;
+  std::size_t blockSize = kWeightBlockSize / elementBytes * elementBytes;
+  const char *bytes = static_cast<const char *>(data);
+  std::vector<char> plane, encoded;
+  for (std::size_t blockBegin = 0; blockBegin < size;
+       blockBegin += blockSize) {
+    std::size_t currentSize = std::min(blockSize, size - blockBegin);
+    std::size_t numElements = currentSize / elementBytes;
+    std::size_t header = compressed.size();
+    compressed.push_back(static_cast<char>(elementBytes));
+    appendUint32(compressed, currentSize);
+    appendUint32(compressed, 0);
+    plane.resize(numElements);
+    for (std::size_t byte = 0; byte < elementBytes; ++byte) {
+      for (std::size_t i = 0; i < numElements; ++i)
+        plane[i] = bytes[blockBegin + i * elementBytes + byte];
+      encoded.clear();
+      encodeRunLength(plane.data(), numElements, encoded);
+      bool raw = encoded.size() >= numElements;
+      const std::vector<char> &stored = raw ? plane : encoded;
+      compressed.push_back(static_cast<char>(raw ? kRawPlane
+                                                 : kRunLengthPlane));
+      appendUint32(compressed, stored.size());
+      compressed.insert(compressed.end(), stored.begin(), stored.end());
+    }
+    storeUint32(&compressed[header + 5],
+                compressed.size() - header - kBlockHeaderSize);
+  }
+}
+
+bool refbackrt::getCompressedWeightsBlocks(
+    const void *compressed, std::size_t compressedSize, void *output,
+    std::size_t size, std::vector<CompressedWeightsBlock> &blocks) {
+  const char *in = static_cast<const char *>(compressed);
+  const char *end = in + compressedSize;
+  char *out = static_cast<char *>(output);
+  std::size_t decompressedSize = 0;
+  while (in != end) {
+    if (static_cast<std::size_t>(end - in) < kBlockHeaderSize)
+      return false;
+    std::size_t blockSize = loadUint32(in + 1);
+    std::size_t payloadSize = loadUint32(in + 5);
+    if (static_cast<std::size_t>(end - in) - kBlockHeaderSize < payloadSize ||
+        size - decompressedSize < blockSize)
+      return false;
+    blocks.push_back({in, kBlockHeaderSize + payloadSize,
+                      out + decompressedSize, blockSize});
+    in += kBlockHeaderSize + payloadSize;
+    decompressedSize += blockSize;
+  }
+  return decompressedSize == size;
+}
+
+bool refbackrt::decompressWeightsBlock(const CompressedWeightsBlock &block) {
+  std::size_t elementBytes = static_cast<std::uint8_t>(block.data[0]);
+  if (elementBytes == 0 || block.size % elementBytes != 0)
+    return false;
+  std::size_t numElements = block.size / elementBytes;
+  const char *in = block.data + kBlockHeaderSize;
+  const char *end = block.data + block.compressedSize;
+  // Planes are decoded into a scratch buffer and then interleaved, unless
+  // there is only one.
+  std::vector<char> plane(elementBytes == 1 ? 0 : numElements);
+  for (std::size_t byte = 0; byte < elementBytes; ++byte) {
+    if (static_cast<std::size_t>(end - in) < kPlaneHeaderSize)
+      return false;
+    auto encoding = static_cast<std::uint8_t>(in[0]);
+    std::size_t encodedSize = loadUint32(in + 1);
+    in += kPlaneHeaderSize;
+    if (static_cast<std::size_t>(end - in) < encodedSize)
+      return false;
+    char *decoded = elementBytes == 1 ? block.output : plane.data();
+    if (encoding == kRawPlane) {
+      if (encodedSize != numElements)
+        return false;
+      std::memcpy(decoded, in, numElements);
+    } else if (encoding != kRunLengthPlane ||
+               !decodeRunLength(in, encodedSize, decoded, numElements)) {
+      return false;
+    }
+    in += encodedSize;
+    if (elementBytes != 1)
+      for (std::size_t i = 0; i < numElements; ++i)
+        block.output[i * elementBytes + byte] = plane[i];
+  }
+  return in == end;
+}
@@ -0,0 +1,309 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "npcomp/RefBackend/ShapeEquivalence.h"
+
+#include "mlir/Dialect/Linalg/IR/LinalgOps.h"
+#include "mlir/Dialect/MemRef/IR/MemRef.h"
+#include "mlir/Dialect/Shape/IR/Shape.h"
+#include "mlir/Dialect/StandardOps/IR/Ops.h"
+#include "mlir/Dialect/Tensor/IR/Tensor.h"
+#include "mlir/IR/Matchers.h"
+#include "npcomp/Dialect/TCP/IR/TCPOps.h"
+
+#include <limits>
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+// The sizes are keyed by a value and a position:
+// - dimension `i` of a shaped value is (value, i),
+// - element `i` of an extent tensor is (value, -1 - i),
+// - an index value is (value, kScalar),
+// - and the static size `n` is (null, n), so that all the sizes proven equal
+//   to the same constant end up with the same symbol.
+static constexpr int64_t kScalar = std::numeric_limits<int64_t>::min();
+
+static std::pair<Value, int64_t> getDimKey(Value value, int64_t dim) {
+  auto type = value.getType().cast<ShapedType>();
+  if (!type.isDynamicDim(dim))
+    return {Value(), type.getDimSize(dim)};
+  return {value, dim};
+}
+
+static std::pair<Value, int64_t> getElementKey(Value shape, int64_t index) {
+  DenseIntElementsAttr elements;
+  if (auto constShape = shape.getDefiningOp<shape::ConstShapeOp>())
+    elements = constShape.shape();
+  else
+    matchPattern(shape, m_Constant(&elements));
+  if (elements && index < elements.getNumElements())
+    return {Value(), *std::next(elements.getValues<int64_t>().begin(), index)};
+  return {shape, -1 - index};
+}
+
+static std::pair<Value, int64_t> getScalarKey(Value value) {
+  APInt constant;
+  if (matchPattern(value, m_ConstantInt(&constant)))
+    return {Value(), constant.getSExtValue()};
+  return {value, kScalar};
+}
+
+static bool isRanked(Value value) {
+  auto type = value.getType().dyn_cast<ShapedType>();
+  return type && type.hasRank();
+}
+
+ShapeEquivalence::ShapeEquivalence(Operation *root) {
+  SmallVector<Operation *, 8> broadcasts;
+  root->walk([&](Operation *op) {
+    if (isa<shape::BroadcastOp>(op))
+      broadcasts.push_back(op);
+    else
+      visit(op);
+  });
+  // The sizes of broadcasts depend on whether their operands are equal,
+  // which later broadcasts can prove.
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (Operation *op : broadcasts)
+      changed |= visitBroadcast(op);
+  }
+}
+
+bool ShapeEquivalence::areDimsEqual(Value lhs, int64_t lhsDim, Value rhs,
+                                    int64_t rhsDim) {
+  return isEqual(getDimKey(lhs, lhsDim), getDimKey(rhs, rhsDim));
+}
+
+bool ShapeEquivalence::haveSameShape(Value lhs, Value rhs) {
+  auto lhsType = lhs.getType().cast<ShapedType>();
+  auto rhsType = rhs.getType().cast<ShapedType>();
+  if (!lhsType.hasRank() || !rhsType.hasRank() ||
+      lhsType.getRank() != rhsType.getRank())
+    return false;
+  for (int64_t i = 0, e = lhsType.getRank(); i < e; i++)
+    if (!areDimsEqual(lhs, i, rhs, i))
+      return false;
+  return true;
+}
+
+bool ShapeEquivalence::unify(Key lhs, Key rhs) {
+  unsigned lhsId = ids.try_emplace(lhs, ids.size()).first->second;
+  unsigned rhsId = ids.try_emplace(rhs, ids.size()).first->second;
+  if (classes.findLeader(lhsId) != classes.member_end() &&
+      classes.findLeader(lhsId) == classes.findLeader(rhsId))
+    return false;
+  classes.unionSets(lhsId, rhsId);
+  return true;
+}
+
+bool ShapeEquivalence::isEqual(Key lhs, Key rhs) {
+  if (lhs == rhs)
+    return true;
+  auto lhsIt = ids.find(lhs);
+  auto rhsIt = ids.find(rhs);
+  if (lhsIt == ids.end() || rhsIt == ids.end())
+    return false;
+  return classes.findLeader(lhsIt->second) ==
+         classes.findLeader(rhsIt->second);
+}
+
+Optional<int64_t> ShapeEquivalence::getExtentTensorLength(Value shape) {
+  auto type = shape.getType().dyn_cast<RankedTensorType>();
+  if (type && type.hasStaticShape())
+    return type.getDimSize(0);
+  if (auto shapeOf = shape.getDefiningOp<shape::ShapeOfOp>())
+    if (isRanked(shapeOf.arg()))
+      return shapeOf.arg().getType().cast<ShapedType>().getRank();
+  if (auto broadcast = shape.getDefiningOp<shape::BroadcastOp>()) {
+    int64_t length = 0;
+    for (Value operand : broadcast.shapes()) {
+      auto operandLength = getExtentTensorLength(operand);
+      if (!operandLength)
+        return None;
+      length = std::max(length, *operandLength);
+    }
+    return length;
+  }
+  return None;
+}
+
+// Unifies the dynamic dimensions of `shaped`, in order, with `sizes`.
+static void unifyDynamicSizes(Value shaped, ValueRange sizes,
+                              llvm::function_ref<void(Value, int64_t, Value)>
+                                  unifyDimWithScalar) {
+  auto type = shaped.getType().cast<ShapedType>();
+  auto size = sizes.begin();
+  for (int64_t i = 0, e = type.getRank(); i < e && size != sizes.end(); i++)
+    if (type.isDynamicDim(i))
+      unifyDimWithScalar(shaped, i, *size++);
+}
+
+void ShapeEquivalence::visit(Operation *op) {
+  auto unifyDims = [&](Value lhs, Value rhs) {
+    if (!isRanked(lhs) || !isRanked(rhs))
+      return;
+    auto rank = lhs.getType().cast<ShapedType>().getRank();
+    if (rank != rhs.getType().cast<ShapedType>().getRank())
+      return;
+    for (int64_t i = 0; i < rank; i++)
+      unify(getDimKey(lhs, i), getDimKey(rhs, i));
+  };
+  auto unifyDimWithScalar = [&](Value shaped, int64_t dim, Value scalar) {
+    unify(getDimKey(shaped, dim), getScalarKey(scalar));
+  };
+  auto unifyDimsWithElements = [&](Value shaped, Value shape) {
+    if (!isRanked(shaped))
+      return;
+    for (int64_t i = 0, e = shaped.getType().cast<ShapedType>().getRank();
+         i < e; i++)
+      unify(getDimKey(shaped, i), getElementKey(shape, i));
+  };
+  auto getConstantIndex = [](Value value) -> Optional<int64_t> {
+    APInt constant;
+    if (!matchPattern(value, m_ConstantInt(&constant)))
+      return None;
+    return constant.getSExtValue();
+  };
+
+  // Sizes computed from other sizes.
+  if (auto dim = dyn_cast<memref::DimOp>(op)) {
+    auto index = dim.getConstantIndex();
+    if (index && isRanked(dim.memrefOrTensor()))
+      unifyDimWithScalar(dim.memrefOrTensor(), *index, dim.result());
+    return;
+  }
+  if (auto shapeOf = dyn_cast<shape::ShapeOfOp>(op)) {
+    unifyDimsWithElements(shapeOf.arg(), shapeOf.result());
+    return;
+  }
+  if (auto extract = dyn_cast<tensor::ExtractOp>(op)) {
+    if (extract.indices().size() != 1 ||
+        !extract.getType().isa<IndexType>())
+      return;
+    if (auto index = getConstantIndex(extract.indices().front()))
+      unify(getScalarKey(extract.result()),
+            getElementKey(extract.tensor(), *index));
+    return;
+  }
+  if (auto fromElements = dyn_cast<tensor::FromElementsOp>(op)) {
+    if (!fromElements.getType().cast<ShapedType>().getElementType().isIndex())
+      return;
+    for (auto element : llvm::enumerate(fromElements.elements()))
+      unify(getElementKey(fromElements.result(), element.index()),
+            getScalarKey(element.value()));
+    return;
+  }
+
+  // Ops created with the given sizes.
+  if (auto alloc = dyn_cast<memref::AllocOp>(op)) {
+    unifyDynamicSizes(alloc.getResult(), alloc.dynamicSizes(),
+                      unifyDimWithScalar);
+    return;
+  }
+  if (auto alloca = dyn_cast<memref::AllocaOp>(op)) {
+    unifyDynamicSizes(alloca.getResult(), alloca.dynamicSizes(),
+                      unifyDimWithScalar);
+    return;
+  }
+  if (auto init = dyn_cast<linalg::InitTensorOp>(op)) {
+    unifyDynamicSizes(init.getResult(), init.sizes(), unifyDimWithScalar);
+    return;
+  }
+  if (auto broadcastTo = dyn_cast<tcp::BroadcastToOp>(op)) {
+    unifyDimsWithElements(broadcastTo.getResult(), broadcastTo.shape());
+    return;
+  }
+  if (auto splatted = dyn_cast<tcp::SplattedOp>(op)) {
+    unifyDimsWithElements(splatted.getResult(), splatted.shape());
+    return;
+  }
+
+  // Ops preserving the shape of their operand.
+  if (isa<tensor::CastOp, memref::CastOp, memref::TensorLoadOp,
+          memref::BufferCastOp>(op)) {
+    unifyDims(op->getOperand(0), op->getResult(0));
+    return;
+  }
+  if (auto assuming = dyn_cast<shape::AssumingOp>(op)) {
+    Operation *yield = assuming.doRegion().front().getTerminator();
+    for (auto results :
+         llvm::zip(assuming.getResults(), yield->getOperands()))
+      unifyDims(std::get<0>(results), std::get<1>(results));
+    return;
+  }
+
+  // Ops requiring their operands to have the same shape.
+  if (op->hasTrait<OpTrait::SameOperandsAndResultShape>()) {
+    SmallVector<Value, 4> values;
+    llvm::copy_if(op->getOperands(), std::back_inserter(values), isRanked);
+    llvm::copy_if(op->getResults(), std::back_inserter(values), isRanked);
+    for (Value value : llvm::drop_begin(values, 1))
+      unifyDims(values.front(), value);
+    return;
+  }
+  if (auto linalgOp = dyn_cast<linalg::LinalgOp>(op)) {
+    // The dimensions of the operands indexed by the same loop are equal.
+    DenseMap<unsigned, Key> loopSizes;
+    auto operands = linalgOp.getShapedOperands();
+    auto maps = linalgOp.getIndexingMaps();
+    for (auto operandAndMap : llvm::zip(operands, maps)) {
+      Value operand = std::get<0>(operandAndMap);
+      AffineMap map = std::get<1>(operandAndMap);
+      if (!isRanked(operand))
+        continue;
+      for (auto expr : llvm::enumerate(map.getResults())) {
+        auto dimExpr = expr.value().dyn_cast<AffineDimExpr>();
+        if (!dimExpr)
+          continue;
+        Key key = getDimKey(operand, expr.index());
+        auto inserted = loopSizes.try_emplace(dimExpr.getPosition(), key);
+        if (!inserted.second)
+          unify(inserted.first->second, key);
+      }
+    }
+    // The results on tensors have the shapes of the outputs.
+    for (auto result : llvm::enumerate(op->getResults()))
+      unifyDims(result.value(),
+                operands[linalgOp.getNumInputs() + result.index()]);
+    return;
+  }
+}
+
+bool ShapeEquivalence::visitBroadcast(Operation *op) {
+  auto broadcast = cast<shape::BroadcastOp>(op);
+  auto length = getExtentTensorLength(broadcast.result());
+  if (!length)
+    return false;
+  bool changed = false;
+  // The extents are aligned on the right. Extents of 1 broadcast to the
+  // others, so the result is known where all the other extents are equal.
+  for (int64_t i = 0; i < *length; i++) {
+    Optional<Key> extent;
+    bool isKnown = true;
+    for (Value operand : broadcast.shapes()) {
+      int64_t operandIndex = *getExtentTensorLength(operand) - *length + i;
+      if (operandIndex < 0)
+        continue;
+      Key key = getElementKey(operand, operandIndex);
+      if (key == Key(Value(), 1))
+        continue;
+      if (!extent)
+        extent = key;
+      else if (!isEqual(*extent, key))
+        isKnown = false;
+    }
+    if (!isKnown)
+      continue;
+    changed |= unify(getElementKey(broadcast.result(), i),
+                     extent ? *extent : Key(Value(), 1));
+  }
+  return changed;
+}
@@ -0,0 +1,121 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Adds statically shaped variants of the public functions of a module, one per
+// batch size, so that the shapes of typical calls are known at compile time
+// (which enables static tiling and removes most of the shape computations).
+//
+// The variant of `@f` for batch size N is named `@f$batchN`, following the
+// `<name>$<suffix>` convention that `refbackrt::selectFunction` uses to
+// dispatch the calls of `@f` to the variant with the most static extents that
+// matches the inputs. `@f` itself is kept unchanged as the fallback for the
+// other sizes.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+
+#include "mlir/Dialect/StandardOps/IR/Ops.h"
+#include "mlir/Dialect/Tensor/IR/Tensor.h"
+#include "mlir/IR/BuiltinOps.h"
+#include "npcomp/Dialect/TCF/IR/TCFDialect.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+// Returns true if `type` is a tensor with a dynamic leading dimension.
+static bool hasDynamicBatchSize(Type type) {
+  auto tensorType = type.dyn_cast<RankedTensorType>();
+  return tensorType && tensorType.getRank() >= 1 &&
+         tensorType.isDynamicDim(0);
+}
+
+// Adds the variant of `func` for `batchSize` after `func`.
+static void addBatchVariant(FuncOp func, int64_t batchSize) {
+  FuncOp variant = func.clone();
+  variant.setName((func.getName() + "$batch" + Twine(batchSize)).str());
+  OpBuilder moduleBuilder(func);
+  moduleBuilder.setInsertionPointAfter(func);
+  moduleBuilder.insert(variant);
+
+  SmallVector<Type, 4> argTypes;
+  Block &entry = variant.getBody().front();
+  OpBuilder builder = OpBuilder::atBlockBegin(&entry);
+  for (BlockArgument arg : entry.getArguments()) {
+    Type originalType = arg.getType();
+    if (!hasDynamicBatchSize(originalType)) {
+      argTypes.push_back(originalType);
+      continue;
+    }
+    auto tensorType = originalType.cast<RankedTensorType>();
+    SmallVector<int64_t, 4> shape(tensorType.getShape().begin(),
+                                  tensorType.getShape().end());
+    shape[0] = batchSize;
+    auto refinedType =
+        RankedTensorType::get(shape, tensorType.getElementType());
+    arg.setType(refinedType);
+    argTypes.push_back(refinedType);
+
+    // TCF ops accept any refinement of their operand types, and propagate it
+    // during shape refinement. The other users keep the original type.
+    SmallVector<OpOperand *, 4> otherUses;
+    for (OpOperand &use : arg.getUses())
+      if (!isa_and_nonnull<tcf::TCFDialect>(use.getOwner()->getDialect()))
+        otherUses.push_back(&use);
+    if (otherUses.empty())
+      continue;
+    Value cast =
+        builder.create<tensor::CastOp>(variant.getLoc(), originalType, arg);
+    for (OpOperand *use : otherUses)
+      use->set(cast);
+  }
+  variant.setType(FunctionType::get(func.getContext(), argTypes,
+                                    func.getType().getResults()));
+}
+
+namespace {
+class SpecializeFunctions
+    : public SpecializeFunctionsBase<SpecializeFunctions> {
+public:
+  SpecializeFunctions() = default;
+  SpecializeFunctions(ArrayRef<int64_t> sizes) { batchSizes = sizes; }
+
+  void runOnOperation() override {
+    ModuleOp module = getOperation();
+    for (int64_t batchSize : batchSizes) {
+      if (batchSize <= 0) {
+        module.emitError() << "batch sizes must be positive";
+        return signalPassFailure();
+      }
+    }
+
+    SmallVector<FuncOp, 4> funcs;
+    for (FuncOp func : module.getOps<FuncOp>()) {
+      if (func.isPublic() && !func.isExternal() &&
+          llvm::any_of(func.getType().getInputs(), hasDynamicBatchSize))
+        funcs.push_back(func);
+    }
+    for (FuncOp func : funcs) {
+      // Insert the variants in order after the original function.
+      for (int64_t batchSize : llvm::reverse(*batchSizes))
+        addBatchVariant(func, batchSize);
+    }
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<ModuleOp>>
+mlir::NPCOMP::createSpecializeFunctionsPass() {
+  return std::make_unique<SpecializeFunctions>();
+}
+
+std::unique_ptr<OperationPass<ModuleOp>>
+mlir::NPCOMP::createSpecializeFunctionsPass(ArrayRef<int64_t> batchSizes) {
+  return std::make_unique<SpecializeFunctions>(batchSizes);
+}
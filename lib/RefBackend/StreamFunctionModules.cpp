@@ -0,0 +1,134 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Splits a module lowered to the LLVM dialect into one module per function, so
+// that LLVM translates, optimizes and generates code for one function at a
+// time (see mlir::NPCOMP::streamFunctionModules).
+//
+//===----------------------------------------------------------------------===//
+
+#include "npcomp/RefBackend/RefBackend.h"
+
+#include "mlir/Dialect/LLVMIR/LLVMDialect.h"
+#include "mlir/IR/Builders.h"
+#include "mlir/IR/BuiltinOps.h"
+#include "mlir/IR/SymbolTable.h"
+#include "llvm/ADT/DenseSet.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+// Gives `op`, a function or global, external linkage, so that it can be
+// referenced from the other modules.
+static void setExternalLinkage(Operation *op) {
+  op->setAttr("linkage", Builder(op->getContext())
+                             .getI64IntegerAttr(static_cast<int64_t>(
+                                 LLVM::Linkage::External)));
+}
+
+// Returns true if `op` is a global with an initial value.
+static bool isGlobalDefinition(Operation *op) {
+  auto global = dyn_cast<LLVM::GlobalOp>(op);
+  return global && (global.getValueOrNull() ||
+                    !global.getInitializerRegion().empty());
+}
+
+namespace {
+// Builds one module of streamFunctionModules.
+class FunctionModuleBuilder {
+public:
+  FunctionModuleBuilder(ModuleOp module, SymbolTable &symbolTable,
+                        DenseSet<Operation *> &definedGlobals)
+      : symbolTable(symbolTable), definedGlobals(definedGlobals),
+        part(ModuleOp::create(module.getLoc())) {
+    part->setAttrs(module->getAttrDictionary());
+  }
+
+  // Copies `op` into the module, along with the globals it uses which aren't
+  // defined by a previous module yet, and declares the other symbols it uses.
+  void define(Operation *op) {
+    part->push_back(op->clone());
+    added.insert(op);
+    if (isGlobalDefinition(op))
+      definedGlobals.insert(op);
+    declareUses(op);
+  }
+
+  OwningModuleRef take() { return std::move(part); }
+
+private:
+  void declareUses(Operation *op) {
+    Optional<SymbolTable::UseRange> uses = SymbolTable::getSymbolUses(op);
+    if (!uses)
+      return;
+    for (const SymbolTable::SymbolUse &use : *uses) {
+      Operation *symbol =
+          symbolTable.lookup(use.getSymbolRef().getRootReference());
+      if (!symbol || !added.insert(symbol).second)
+        continue;
+      if (isGlobalDefinition(symbol) && !definedGlobals.count(symbol)) {
+        added.erase(symbol);
+        define(symbol);
+        continue;
+      }
+      Operation *declaration = symbol->cloneWithoutRegions();
+      declaration->removeAttr("value");
+      part->push_back(declaration);
+    }
+  }
+
+  SymbolTable &symbolTable;
+  DenseSet<Operation *> &definedGlobals;
+  OwningModuleRef part;
+  // The ops of `module` copied or declared into `part`.
+  DenseSet<Operation *> added;
+};
+} // namespace
+
+LogicalResult mlir::NPCOMP::streamFunctionModules(
+    ModuleOp module, function_ref<LogicalResult(ModuleOp)> callback) {
+  SymbolTable symbolTable(module);
+  SmallVector<LLVM::LLVMFuncOp, 16> functions;
+  SmallVector<Operation *, 16> others;
+  for (Operation &op : *module.getBody()) {
+    if (op.hasTrait<OpTrait::IsTerminator>())
+      continue;
+    if (isa<LLVM::LLVMFuncOp, LLVM::GlobalOp>(op))
+      setExternalLinkage(&op);
+    auto function = dyn_cast<LLVM::LLVMFuncOp>(op);
+    if (function && !function.isExternal())
+      functions.push_back(function);
+    else if (!function && !isa<LLVM::GlobalOp>(op))
+      others.push_back(&op);
+  }
+
+  DenseSet<Operation *> definedGlobals;
+  for (LLVM::LLVMFuncOp function : functions) {
+    {
+      FunctionModuleBuilder builder(module, symbolTable, definedGlobals);
+      builder.define(function);
+      OwningModuleRef part = builder.take();
+      if (failed(callback(*part)))
+        return failure();
+    }
+    // The function is only held as object code (or whatever `callback` made
+    // of it) from now on.
+    function.eraseBody();
+  }
+
+  // The last module defines the globals that no function uses (such as the
+  // module descriptor), and the other ops of `module`.
+  FunctionModuleBuilder builder(module, symbolTable, definedGlobals);
+  for (Operation &op : *module.getBody())
+    if (isGlobalDefinition(&op) && !definedGlobals.count(&op))
+      builder.define(&op);
+  for (Operation *op : others)
+    builder.define(op);
+  OwningModuleRef part = builder.take();
+  return callback(*part);
+}
@@ -0,0 +1,99 @@
+//===----------------------------------------------------------------------===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "npcomp/RefBackend/TargetInfo.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/Host.h"
+
+#include <algorithm>
+#include <fstream>
+#include <thread>
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+bool TargetInfo::hasFeature(StringRef feature) const {
+  return std::binary_search(features.begin(), features.end(), feature.str());
+}
+
+bool TargetInfo::hasFMA() const {
+  return hasFeature("neon") || hasFeature("fma") || hasFeature("avx512f");
+}
+
+TargetInfo mlir::NPCOMP::getTargetInfo(const llvm::StringMap<bool> &features) {
+  TargetInfo target;
+  for (const auto &feature : features)
+    if (feature.second)
+      target.features.push_back(feature.first().str());
+  llvm::sort(target.features);
+
+  if (target.hasFeature("neon")) {
+    // AArch64: 32 NEON registers. The pipeline only emits fixed-width
+    // vectors, and the width of SVE registers is only known at runtime, so
+    // SVE CPUs (such as Graviton3) are targeted through NEON: LLVM can still
+    // select SVE instructions for fixed-width vectors of 128 bits.
+    target.numVectorRegisters = 32;
+  } else if (target.hasFeature("avx512f")) {
+    target.vectorWidth = 512;
+    target.numVectorRegisters = 32;
+  } else if (target.hasFeature("avx")) {
+    target.vectorWidth = 256;
+  }
+  return target;
+}
+
+// Reads the first line of the file at `path`, which is empty if it can't be
+// read.
+static std::string readLine(const std::string &path) {
+  std::ifstream file(path);
+  std::string line;
+  std::getline(file, line);
+  return line;
+}
+
+// Sets the cache sizes of `target` to those of the first core of the host, as
+// described by Linux in sysfs.
+static void detectHostCacheSizes(TargetInfo &target) {
+  const std::string cacheDir = "/sys/devices/system/cpu/cpu0/cache/index";
+  for (unsigned index = 0;; index++) {
+    std::string dir = cacheDir + std::to_string(index) + "/";
+    std::string level = readLine(dir + "level");
+    if (level.empty())
+      return;
+    if (readLine(dir + "type") == "Instruction")
+      continue;
+    // The size is in KiB ("32K"), or rarely MiB ("1M").
+    StringRef size = StringRef(readLine(dir + "size")).trim();
+    int64_t scale = 1;
+    if (size.consume_back("K"))
+      scale = 1024;
+    else if (size.consume_back("M"))
+      scale = 1024 * 1024;
+    int64_t bytes;
+    if (size.getAsInteger(10, bytes) || bytes <= 0)
+      continue;
+    if (level == "1")
+      target.l1CacheSize = bytes * scale;
+    else if (level == "2")
+      target.l2CacheSize = bytes * scale;
+  }
+}
+
+TargetInfo mlir::NPCOMP::getHostTargetInfo() {
+  llvm::StringMap<bool> features;
+  llvm::sys::getHostCPUFeatures(features);
+  TargetInfo target = getTargetInfo(features);
+  detectHostCacheSizes(target);
+  int physicalCores = llvm::sys::getHostNumPhysicalCores();
+  target.numCores = physicalCores > 0
+                        ? physicalCores
+                        : std::max(std::thread::hardware_concurrency(), 1u);
+  return target;
+}
@@ -0,0 +1,223 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Multi-level tiling of the compute-heavy linalg ops, so that the loops they
+// are lowered to work on cache-sized blocks of their operands instead of
+// streaming entire rows/columns through the cache for every output element.
+//
+// Each level is applied with the upstream tiling patterns, using transform
+// markers to make sure that each level only applies to the ops produced by the
+// previous one. Ops with tuned tile sizes (see Tuning.h) are tiled with those
+// instead of the sizes of the pass.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+#include "npcomp/RefBackend/Tuning.h"
+
+#include "mlir/Dialect/Linalg/IR/LinalgOps.h"
+#include "mlir/Dialect/Linalg/Transforms/Transforms.h"
+#include "mlir/Transforms/GreedyPatternRewriteDriver.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+// Returns the tile sizes of an op for a tiling level (0 for L2, 1 for L1).
+using TileSizesFn =
+    std::function<SmallVector<int64_t, 4>(Operation *op, unsigned level)>;
+
+static bool isUntiled(ArrayRef<int64_t> tileSizes) {
+  return llvm::all_of(tileSizes, [](int64_t size) { return size == 0; });
+}
+
+// Tiles all ops of type `OpTy` in `func` with each of `numLevels` levels in
+// turn, with the tile sizes `getTileSizes` returns for each op. If
+// `parallelize` is true, the parallel loops of the first level that applies to
+// an op are scf.parallel loops.
+template <typename OpTy>
+static LogicalResult tileOps(FuncOp func, StringRef opClass,
+                             unsigned numLevels,
+                             const TileSizesFn &getTileSizes,
+                             bool parallelize) {
+  MLIRContext *context = func.getContext();
+  bool hasNegativeSizes = false;
+  func.walk([&](OpTy op) {
+    for (unsigned level = 0; level < numLevels; level++) {
+      if (llvm::any_of(getTileSizes(op, level),
+                       [](int64_t size) { return size < 0; })) {
+        op.emitError() << "negative " << opClass << " tile size";
+        hasNegativeSizes = true;
+        return;
+      }
+    }
+  });
+  if (hasNegativeSizes)
+    return failure();
+
+  // The ops that haven't been tiled yet are marked "untiled" (or not marked
+  // before the first level), the others "tiled".
+  auto getMarker = [&](StringRef state, unsigned level) {
+    return Identifier::get(
+        ("refback_" + opClass + "_" + state + "_" + Twine(level)).str(),
+        context);
+  };
+  for (unsigned level = 0; level < numLevels; level++) {
+    SmallVector<Identifier, 1> untiled, tiled;
+    if (level > 0) {
+      untiled.push_back(getMarker("untiled", level - 1));
+      tiled.push_back(getMarker("tiled", level - 1));
+    }
+
+    // Ops that aren't tiled at this level just move on to the next one.
+    func.walk([&](OpTy op) {
+      if (!isUntiled(getTileSizes(op, level)))
+        return;
+      auto marker = op->template getAttrOfType<StringAttr>(
+          linalg::LinalgTransforms::kLinalgTransformMarker);
+      bool wasTiled = !tiled.empty() && marker &&
+                      marker.getValue() == tiled.front().strref();
+      op->setAttr(linalg::LinalgTransforms::kLinalgTransformMarker,
+                  StringAttr::get(context,
+                                  getMarker(wasTiled ? "tiled" : "untiled",
+                                            level)
+                                      .strref()));
+    });
+
+    auto computeTileSizes = [&, level](OpBuilder &b, Operation *op) {
+      OpBuilder::InsertionGuard guard(b);
+      b.setInsertionPointToStart(
+          &op->getParentOfType<FuncOp>().getBody().front());
+      return llvm::to_vector<4>(
+          llvm::map_range(getTileSizes(op, level), [&](int64_t size) -> Value {
+            return b.create<ConstantIndexOp>(op->getLoc(), size);
+          }));
+    };
+    RewritePatternSet patterns(context);
+    auto addPattern = [&](ArrayRef<Identifier> matchDisjunction,
+                          linalg::LinalgTilingLoopType loopType) {
+      linalg::LinalgTransformationFilter filter(matchDisjunction,
+                                                getMarker("tiled", level));
+      auto options = linalg::LinalgTilingOptions()
+                         .setTileSizeComputationFunction(computeTileSizes)
+                         .setLoopType(loopType);
+      patterns.add<linalg::LinalgTilingPattern<OpTy>>(context, options,
+                                                      filter);
+    };
+    addPattern(untiled, parallelize
+                            ? linalg::LinalgTilingLoopType::ParallelLoops
+                            : linalg::LinalgTilingLoopType::Loops);
+    if (level > 0)
+      addPattern(tiled, linalg::LinalgTilingLoopType::Loops);
+    if (failed(applyPatternsAndFoldGreedily(func, std::move(patterns))))
+      return func.emitError() << "failed to tile " << opClass << " ops";
+  }
+  return success();
+}
+
+// Returns the tile sizes of batch matmuls (as created for Winograd
+// convolutions), which are tiled like matmuls, one matrix at a time.
+static SmallVector<int64_t, 4>
+getBatchMatmulTileSizes(ArrayRef<int64_t> matmulTileSizes) {
+  SmallVector<int64_t, 4> tileSizes;
+  if (matmulTileSizes.empty())
+    return tileSizes;
+  tileSizes.push_back(isUntiled(matmulTileSizes) ? 0 : 1);
+  tileSizes.append(matmulTileSizes.begin(), matmulTileSizes.end());
+  return tileSizes;
+}
+
+// Returns the tile sizes of matrix-vector products (as created for
+// `numpy.dot`), which are tiled like the matmuls with the same loops: `i, k`
+// for matvecs and `j, k` for vecmats.
+static SmallVector<int64_t, 4>
+getMatrixVectorTileSizes(ArrayRef<int64_t> matmulTileSizes, unsigned dim) {
+  SmallVector<int64_t, 4> tileSizes;
+  if (matmulTileSizes.size() != 3)
+    return tileSizes;
+  tileSizes.push_back(matmulTileSizes[dim]);
+  tileSizes.push_back(matmulTileSizes[2]);
+  return tileSizes;
+}
+
+// Returns the tile sizes of `op` for `level`: its tuned ones (see Tuning.h)
+// if it has some, or else `defaultSizes`.
+static SmallVector<int64_t, 4>
+getTunedTileSizes(Operation *op, unsigned level,
+                  ArrayRef<int64_t> defaultSizes) {
+  TuningConfig tuning = getTuningConfig(op);
+  ArrayRef<int64_t> tunedSizes =
+      level == 0 ? tuning.l2TileSizes : tuning.l1TileSizes;
+  return llvm::to_vector<4>(tunedSizes.empty() ? defaultSizes : tunedSizes);
+}
+
+namespace {
+class TileLinalgOps : public TileLinalgOpsBase<TileLinalgOps> {
+public:
+  TileLinalgOps() = default;
+  TileLinalgOps(const LinalgTilingStrategy &strategy) {
+    parallelize = strategy.parallelize;
+    matmulL2TileSizes = ArrayRef<int64_t>(strategy.matmulL2TileSizes);
+    matmulL1TileSizes = ArrayRef<int64_t>(strategy.matmulL1TileSizes);
+    convL2TileSizes = ArrayRef<int64_t>(strategy.convL2TileSizes);
+    convL1TileSizes = ArrayRef<int64_t>(strategy.convL1TileSizes);
+  }
+
+  void runOnOperation() override {
+    FuncOp func = getOperation();
+    ArrayRef<int64_t> matmulLevels[] = {*matmulL2TileSizes,
+                                        *matmulL1TileSizes};
+    ArrayRef<int64_t> convLevels[] = {*convL2TileSizes, *convL1TileSizes};
+    auto getMatmulTileSizes = [&](Operation *op, unsigned level) {
+      return getTunedTileSizes(op, level, matmulLevels[level]);
+    };
+    auto getBatchMatmulTileSizesOf = [&](Operation *op, unsigned level) {
+      return getBatchMatmulTileSizes(getMatmulTileSizes(op, level));
+    };
+    auto getMatvecTileSizes = [&](Operation *op, unsigned level) {
+      return getTunedTileSizes(
+          op, level,
+          getMatrixVectorTileSizes(matmulLevels[level], /*dim=*/0));
+    };
+    auto getVecmatTileSizes = [&](Operation *op, unsigned level) {
+      return getTunedTileSizes(
+          op, level,
+          getMatrixVectorTileSizes(matmulLevels[level], /*dim=*/1));
+    };
+    auto getConvTileSizes = [&](Operation *op, unsigned level) {
+      return getTunedTileSizes(op, level, convLevels[level]);
+    };
+    if (failed(tileOps<linalg::MatmulOp>(func, "matmul", 2, getMatmulTileSizes,
+                                         parallelize)) ||
+        failed(tileOps<linalg::BatchMatmulOp>(func, "batch_matmul", 2,
+                                              getBatchMatmulTileSizesOf,
+                                              parallelize)) ||
+        failed(tileOps<linalg::MatvecOp>(func, "matvec", 2, getMatvecTileSizes,
+                                         parallelize)) ||
+        failed(tileOps<linalg::VecmatOp>(func, "vecmat", 2, getVecmatTileSizes,
+                                         parallelize)) ||
+        failed(tileOps<linalg::ConvNCHWOp>(func, "conv", 2, getConvTileSizes,
+                                           parallelize)))
+      return signalPassFailure();
+
+    // The markers are only meaningful while tiling.
+    func.walk([](linalg::LinalgOp op) {
+      op->removeAttr(linalg::LinalgTransforms::kLinalgTransformMarker);
+    });
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<FuncOp>> mlir::NPCOMP::createTileLinalgOpsPass() {
+  return std::make_unique<TileLinalgOps>();
+}
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createTileLinalgOpsPass(const LinalgTilingStrategy &strategy) {
+  return std::make_unique<TileLinalgOps>(strategy);
+}
@@ -0,0 +1,244 @@
+//===----------------------------------------------------------------------===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "npcomp/RefBackend/Tuning.h"
+
+#include "mlir/Dialect/Linalg/IR/LinalgOps.h"
+#include "mlir/IR/Builders.h"
+#include "mlir/IR/BuiltinTypes.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+using llvm::Error;
+using llvm::Twine;
+
+static Error make_string_error(const Twine &message) {
+  return llvm::make_error<llvm::StringError>(message.str(),
+                                             llvm::inconvertibleErrorCode());
+}
+
+static ValueRange getInputs(Operation *op) {
+  return op->getOperands().take_front(
+      cast<linalg::LinalgOp>(op).getNumInputs());
+}
+
+bool mlir::NPCOMP::isTunableOp(Operation *op) {
+  if (!isa<linalg::MatmulOp, linalg::BatchMatmulOp, linalg::ConvNCHWOp>(op) ||
+      !cast<linalg::LinalgOp>(op).hasTensorSemantics())
+    return false;
+  return llvm::all_of(op->getOperandTypes(), [](Type type) {
+    auto tensorType = type.dyn_cast<RankedTensorType>();
+    return tensorType && tensorType.getElementType().isF32();
+  });
+}
+
+std::string mlir::NPCOMP::getTuningSignature(Operation *op) {
+  std::string signature;
+  llvm::raw_string_ostream os(signature);
+  os << op->getName() << "(";
+  llvm::interleaveComma(getInputs(op), os,
+                        [&](Value input) { os << input.getType(); });
+  os << ")";
+  return os.str();
+}
+
+bool mlir::NPCOMP::hasStaticTuningSignature(Operation *op) {
+  return llvm::all_of(op->getOperandTypes(), [](Type type) {
+    return type.cast<ShapedType>().hasStaticShape();
+  });
+}
+
+SmallVector<TuningConfig, 16> mlir::NPCOMP::getTuningCandidates(Operation *op) {
+  // Matmul tile sizes around the default ones (L2 128x128x128 and L1
+  // 32x32x32), for smaller caches, for larger ones, and with more reuse of
+  // the rows of the left-hand side.
+  static const int64_t kMatmulTileSizes[][2][3] = {
+      {{64, 64, 64}, {16, 16, 16}},
+      {{128, 128, 128}, {16, 64, 32}},
+      {{256, 256, 128}, {32, 32, 32}},
+      {{256, 128, 256}, {64, 64, 32}},
+  };
+  auto addMatmulCandidates = [](StringRef convStrategy,
+                                SmallVectorImpl<TuningConfig> &candidates) {
+    for (const auto &tileSizes : kMatmulTileSizes) {
+      TuningConfig config;
+      config.convStrategy = convStrategy.str();
+      config.l2TileSizes.assign(std::begin(tileSizes[0]),
+                                std::end(tileSizes[0]));
+      config.l1TileSizes.assign(std::begin(tileSizes[1]),
+                                std::end(tileSizes[1]));
+      candidates.push_back(std::move(config));
+    }
+  };
+
+  SmallVector<TuningConfig, 16> candidates = {TuningConfig()};
+  if (!isa<linalg::ConvNCHWOp>(op)) {
+    addMatmulCandidates("", candidates);
+    return candidates;
+  }
+  TuningConfig direct;
+  direct.convStrategy = "direct";
+  candidates.push_back(direct);
+  TuningConfig im2col;
+  im2col.convStrategy = "im2col";
+  candidates.push_back(im2col);
+  addMatmulCandidates("im2col", candidates);
+  // Winograd F(2x2, 3x3) needs 3x3 filters and an even output size.
+  auto filterType = op->getOperand(1).getType().cast<ShapedType>();
+  auto resultType = op->getResult(0).getType().cast<ShapedType>();
+  if (filterType.getDimSize(2) == 3 && filterType.getDimSize(3) == 3 &&
+      resultType.getDimSize(2) % 2 == 0 && resultType.getDimSize(3) % 2 == 0) {
+    TuningConfig winograd;
+    winograd.convStrategy = "winograd";
+    candidates.push_back(winograd);
+    addMatmulCandidates("winograd", candidates);
+  }
+  return candidates;
+}
+
+void mlir::NPCOMP::setTuningConfig(Operation *op, const TuningConfig &config) {
+  Builder builder(op->getContext());
+  SmallVector<NamedAttribute, 3> attrs;
+  if (!config.convStrategy.empty())
+    attrs.push_back(builder.getNamedAttr(
+        "conv_strategy", builder.getStringAttr(config.convStrategy)));
+  if (!config.l2TileSizes.empty())
+    attrs.push_back(builder.getNamedAttr(
+        "l2_tile_sizes", builder.getI64ArrayAttr(config.l2TileSizes)));
+  if (!config.l1TileSizes.empty())
+    attrs.push_back(builder.getNamedAttr(
+        "l1_tile_sizes", builder.getI64ArrayAttr(config.l1TileSizes)));
+  if (attrs.empty())
+    op->removeAttr(kTuningAttrName);
+  else
+    op->setAttr(kTuningAttrName, builder.getDictionaryAttr(attrs));
+}
+
+TuningConfig mlir::NPCOMP::getTuningConfig(Operation *op) {
+  TuningConfig config;
+  auto dict = op->getAttrOfType<DictionaryAttr>(kTuningAttrName);
+  if (!dict)
+    return config;
+  if (auto strategy = dict.getAs<StringAttr>("conv_strategy"))
+    config.convStrategy = strategy.getValue().str();
+  auto getSizes = [&](StringRef name, SmallVectorImpl<int64_t> &sizes) {
+    if (auto array = dict.getAs<ArrayAttr>(name))
+      for (auto size : array.getAsRange<IntegerAttr>())
+        sizes.push_back(size.getInt());
+  };
+  getSizes("l2_tile_sizes", config.l2TileSizes);
+  getSizes("l1_tile_sizes", config.l1TileSizes);
+  return config;
+}
+
+//===----------------------------------------------------------------------===//
+// TuningDatabase
+//===----------------------------------------------------------------------===//
+
+static bool parseTileSizes(const llvm::json::Object &object, StringRef name,
+                           SmallVectorImpl<int64_t> &sizes) {
+  const llvm::json::Value *value = object.get(name);
+  if (!value)
+    return true;
+  const llvm::json::Array *array = value->getAsArray();
+  if (!array)
+    return false;
+  for (const llvm::json::Value &size : *array) {
+    Optional<int64_t> integer = size.getAsInteger();
+    if (!integer || *integer < 0)
+      return false;
+    sizes.push_back(*integer);
+  }
+  return true;
+}
+
+llvm::Expected<TuningDatabase> TuningDatabase::load(StringRef path) {
+  TuningDatabase database;
+  if (!llvm::sys::fs::exists(path))
+    return database;
+  auto buffer = llvm::MemoryBuffer::getFile(path);
+  if (!buffer)
+    return make_string_error("could not read tuning database " + path + ": " +
+                             buffer.getError().message());
+  llvm::Expected<llvm::json::Value> json =
+      llvm::json::parse((*buffer)->getBuffer());
+  if (!json)
+    return make_string_error("invalid tuning database " + path + ": " +
+                             llvm::toString(json.takeError()));
+  const llvm::json::Object *entries = json->getAsObject();
+  if (!entries)
+    return make_string_error("invalid tuning database " + path +
+                             ": expected an object");
+  for (const auto &signatureAndEntry : *entries) {
+    StringRef signature = signatureAndEntry.first;
+    const llvm::json::Object *object = signatureAndEntry.second.getAsObject();
+    Entry entry;
+    if (object) {
+      if (Optional<StringRef> strategy = object->getString("conv_strategy"))
+        entry.config.convStrategy = strategy->str();
+      entry.latencyMs = object->getNumber("latency_ms").getValueOr(0);
+    }
+    if (!object ||
+        !parseTileSizes(*object, "l2_tile_sizes", entry.config.l2TileSizes) ||
+        !parseTileSizes(*object, "l1_tile_sizes", entry.config.l1TileSizes))
+      return make_string_error("invalid tuning database " + path +
+                               ": invalid entry for " + signature);
+    database.insert(signature, std::move(entry));
+  }
+  return database;
+}
+
+Error TuningDatabase::save(StringRef path) const {
+  // Sort the entries so that the file is stable across runs.
+  SmallVector<StringRef, 16> signatures;
+  for (const auto &entry : entries)
+    signatures.push_back(entry.getKey());
+  llvm::sort(signatures);
+
+  std::string contents;
+  llvm::raw_string_ostream os(contents);
+  {
+    llvm::json::OStream json(os, /*IndentSize=*/2);
+    json.object([&] {
+      for (StringRef signature : signatures) {
+        const Entry &entry = entries.find(signature)->second;
+        json.attributeObject(signature, [&] {
+          if (!entry.config.convStrategy.empty())
+            json.attribute("conv_strategy", entry.config.convStrategy);
+          if (!entry.config.l2TileSizes.empty())
+            json.attribute("l2_tile_sizes",
+                           llvm::json::Array(entry.config.l2TileSizes));
+          if (!entry.config.l1TileSizes.empty())
+            json.attribute("l1_tile_sizes",
+                           llvm::json::Array(entry.config.l1TileSizes));
+          json.attribute("latency_ms", entry.latencyMs);
+        });
+      }
+    });
+  }
+  os << "\n";
+  if (auto error = llvm::writeFileAtomically((path + ".tmp%%%%%%%%").str(),
+                                             path, os.str()))
+    return make_string_error("could not write tuning database " + path +
+                             ": " + llvm::toString(std::move(error)));
+  return Error::success();
+}
+
+const TuningDatabase::Entry *
+TuningDatabase::lookup(StringRef signature) const {
+  auto it = entries.find(signature);
+  return it == entries.end() ? nullptr : &it->second;
+}
+
+void TuningDatabase::insert(StringRef signature, Entry entry) {
+  entries[signature] = std::move(entry);
+}
@@ -0,0 +1,288 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Removes the copies into and out of mutable globals, so that updates of
+// globals (such as the parameter updates of a training step, see
+// torch-lower-global-slots) are computed in place.
+//
+// An SGD step `w = w - lr * g` on the global @w bufferizes to
+//   %0 = memref.get_global @w
+//   %old = memref.alloc()
+//   linalg.copy(%0, %old)
+//   %new = memref.alloc()
+//   linalg.generic ins(%old, %g) outs(%new) { w - lr * g }
+//   %1 = memref.get_global @w
+//   linalg.copy(%new, %1)
+// which reads and writes the parameters three times. This pass
+// - computes the value copied into the global directly into the global, when
+//   the global isn't accessed between the op computing it and the copy,
+// - and then reads the global directly instead of a copy of it, when it isn't
+//   written while the copy is used, or only by an elementwise op that reads
+//   the copy last (at the element it writes),
+// which leaves
+//   linalg.generic ins(%w, %g) outs(%w) { w - lr * g }
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+
+#include "mlir/Dialect/Linalg/IR/LinalgOps.h"
+#include "mlir/Dialect/MemRef/IR/MemRef.h"
+#include "mlir/Interfaces/CallInterfaces.h"
+#include "mlir/Interfaces/SideEffectInterfaces.h"
+#include "mlir/Interfaces/ViewLikeInterface.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+// Returns the name of the global that `memref` is (a view of), if any.
+static Optional<StringRef> getGlobalName(Value memref) {
+  while (Operation *op = memref.getDefiningOp()) {
+    if (auto getGlobal = dyn_cast<memref::GetGlobalOp>(op))
+      return getGlobal.name();
+    if (auto view = dyn_cast<ViewLikeOpInterface>(op))
+      memref = view.getViewSource();
+    else if (auto cast = dyn_cast<memref::CastOp>(op))
+      memref = cast.source();
+    else
+      return None;
+  }
+  return None;
+}
+
+static bool isGlobal(Value memref, StringRef name) {
+  Optional<StringRef> globalName = getGlobalName(memref);
+  return globalName && *globalName == name;
+}
+
+// Returns true if `op` (or an op nested in it) may write the global `name`.
+static bool mayWriteGlobal(Operation *op, StringRef name) {
+  auto result = op->walk([&](Operation *nested) {
+    if (isa<CallOpInterface>(nested))
+      return WalkResult::interrupt();
+    if (auto linalgOp = dyn_cast<linalg::LinalgOp>(nested)) {
+      for (Value output : linalgOp.getOutputBuffers())
+        if (isGlobal(output, name))
+          return WalkResult::interrupt();
+      return WalkResult::advance();
+    }
+    if (isa<memref::DimOp, ViewLikeOpInterface, memref::CastOp>(nested))
+      return WalkResult::advance();
+    for (Value operand : nested->getOperands()) {
+      if (!isGlobal(operand, name))
+        continue;
+      auto effects = dyn_cast<MemoryEffectOpInterface>(nested);
+      if (!effects || effects.getEffectOnValue<MemoryEffects::Write>(operand))
+        return WalkResult::interrupt();
+    }
+    return WalkResult::advance();
+  });
+  return result.wasInterrupted();
+}
+
+// Returns true if `op` (or an op nested in it) may read or write the global
+// `name`.
+static bool mayAccessGlobal(Operation *op, StringRef name) {
+  auto result = op->walk([&](Operation *nested) {
+    if (isa<CallOpInterface>(nested))
+      return WalkResult::interrupt();
+    if (isa<memref::DimOp, ViewLikeOpInterface, memref::CastOp>(nested))
+      return WalkResult::advance();
+    for (Value operand : nested->getOperands())
+      if (isGlobal(operand, name))
+        return WalkResult::interrupt();
+    return WalkResult::advance();
+  });
+  return result.wasInterrupted();
+}
+
+// Returns true if any op strictly between `begin` and `end` (in the same
+// block) satisfies `pred`.
+static bool anyOpBetween(Operation *begin, Operation *end,
+                         function_ref<bool(Operation *)> pred) {
+  for (Operation *op = begin->getNextNode(); op != end; op = op->getNextNode())
+    if (pred(op))
+      return true;
+  return false;
+}
+
+// Returns true if `op` writes `buffer` as its only output and doesn't read it.
+static bool writesOnly(linalg::LinalgOp op, Value buffer) {
+  return op.getNumOutputs() == 1 && op.getOutputBuffer(0) == buffer &&
+         !llvm::is_contained(op.getInputs(), buffer) &&
+         !op.payloadUsesValueFromOutputOperandIndex(0);
+}
+
+// Returns true if `op` only reads `buffer`, as an input.
+static bool readsOnly(Operation *op, Value buffer) {
+  if (auto linalgOp = dyn_cast<linalg::LinalgOp>(op))
+    return !llvm::is_contained(linalgOp.getOutputBuffers(), buffer);
+  if (isa<memref::DimOp>(op))
+    return true;
+  // Terminators and views let the buffer escape.
+  auto effects = dyn_cast<MemoryEffectOpInterface>(op);
+  return effects && op->getNumRegions() == 0 &&
+         !op->hasTrait<OpTrait::IsTerminator>() &&
+         !isa<ViewLikeOpInterface>(op) &&
+         !effects.getEffectOnValue<MemoryEffects::Write>(buffer) &&
+         !effects.getEffectOnValue<MemoryEffects::Free>(buffer);
+}
+
+// Returns true if `op` updates each element of the global `name` from the
+// same element of `copy` (and of the global itself), so that reading the
+// global instead of `copy` gives the same result.
+static bool isElementwiseUpdate(Operation *op, Value copy, StringRef name) {
+  auto linalgOp = dyn_cast<linalg::LinalgOp>(op);
+  if (!linalgOp || linalgOp.getNumParallelLoops() != linalgOp.getNumLoops())
+    return false;
+  Optional<AffineMap> map;
+  for (auto it : llvm::zip(linalgOp.getShapedOperands(),
+                           linalgOp.getIndexingMaps())) {
+    Value operand = std::get<0>(it);
+    if (operand != copy && !isGlobal(operand, name))
+      continue;
+    // Views of the global are accessed at other elements.
+    if (operand != copy && !operand.getDefiningOp<memref::GetGlobalOp>())
+      return false;
+    if (map && *map != std::get<1>(it))
+      return false;
+    map = std::get<1>(it);
+  }
+  return map && map->isPermutation();
+}
+
+// Computes the source of `copy`, a fresh allocation only written by one op,
+// directly into the global that it is copied to.
+static LogicalResult forwardWrite(linalg::CopyOp copy) {
+  Value global = copy.output();
+  auto getGlobal = global.getDefiningOp<memref::GetGlobalOp>();
+  auto alloc = copy.input().getDefiningOp<memref::AllocOp>();
+  if (!getGlobal || !alloc || alloc.getType() != global.getType() ||
+      alloc->getBlock() != copy->getBlock())
+    return failure();
+  linalg::LinalgOp writer;
+  SmallVector<Operation *, 2> deallocs;
+  for (Operation *user : alloc->getUsers()) {
+    if (isa<memref::DeallocOp>(user)) {
+      deallocs.push_back(user);
+      continue;
+    }
+    auto linalgOp = dyn_cast<linalg::LinalgOp>(user);
+    if (!linalgOp || !llvm::is_contained(linalgOp.getOutputBuffers(), alloc))
+      continue;
+    if (writer || linalgOp->getBlock() != copy->getBlock() ||
+        !writesOnly(linalgOp, alloc))
+      return failure();
+    writer = linalgOp;
+  }
+  if (!writer || !writer->isBeforeInBlock(copy))
+    return failure();
+  // The other uses of the buffer read the value computed by the writer, which
+  // the global must hold from the writer to the last of them.
+  Block *block = copy->getBlock();
+  Operation *lastUse = copy;
+  for (Operation *user : alloc->getUsers()) {
+    if (user == copy || user == writer || isa<memref::DeallocOp>(user))
+      continue;
+    Operation *ancestor = block->findAncestorOpInBlock(*user);
+    if (!ancestor || !writer->isBeforeInBlock(ancestor) ||
+        !readsOnly(user, alloc))
+      return failure();
+    if (lastUse->isBeforeInBlock(ancestor))
+      lastUse = ancestor;
+  }
+  StringRef name = getGlobal.name();
+  if (mayAccessGlobal(writer, name) ||
+      anyOpBetween(writer, copy,
+                   [&](Operation *op) { return mayAccessGlobal(op, name); }) ||
+      anyOpBetween(copy, lastUse,
+                   [&](Operation *op) { return mayWriteGlobal(op, name); }) ||
+      (lastUse != copy && mayWriteGlobal(lastUse, name)))
+    return failure();
+
+  OpBuilder builder(alloc);
+  Value replacement = builder.create<memref::GetGlobalOp>(
+      alloc.getLoc(), getGlobal.getType(), name);
+  for (Operation *dealloc : deallocs)
+    dealloc->erase();
+  copy.erase();
+  alloc.replaceAllUsesWith(replacement);
+  alloc.erase();
+  return success();
+}
+
+// Reads the global that `copy` copies into a fresh allocation, which is only
+// read, directly instead of the allocation.
+static LogicalResult forwardRead(linalg::CopyOp copy) {
+  Value global = copy.input();
+  auto getGlobal = global.getDefiningOp<memref::GetGlobalOp>();
+  auto alloc = copy.output().getDefiningOp<memref::AllocOp>();
+  if (!getGlobal || !alloc || alloc.getType() != global.getType() ||
+      alloc->getBlock() != copy->getBlock() ||
+      !alloc->isBeforeInBlock(copy))
+    return failure();
+  StringRef name = getGlobal.name();
+  Block *block = copy->getBlock();
+  Operation *lastUse = copy;
+  SmallVector<Operation *, 2> deallocs;
+  for (Operation *user : alloc->getUsers()) {
+    if (user == copy)
+      continue;
+    if (isa<memref::DeallocOp>(user)) {
+      deallocs.push_back(user);
+      continue;
+    }
+    Operation *ancestor = block->findAncestorOpInBlock(*user);
+    if (!ancestor || !copy->isBeforeInBlock(ancestor) ||
+        !readsOnly(user, alloc))
+      return failure();
+    if (lastUse->isBeforeInBlock(ancestor))
+      lastUse = ancestor;
+  }
+  if (lastUse == copy)
+    return failure();
+  // The global must hold the copied value until the last read, which may
+  // however update the global elementwise.
+  if (anyOpBetween(copy, lastUse,
+                   [&](Operation *op) { return mayWriteGlobal(op, name); }) ||
+      (mayWriteGlobal(lastUse, name) &&
+       !isElementwiseUpdate(lastUse, alloc, name)))
+    return failure();
+
+  for (Operation *dealloc : deallocs)
+    dealloc->erase();
+  copy.erase();
+  alloc.replaceAllUsesWith(global);
+  alloc.erase();
+  return success();
+}
+
+namespace {
+class UpdateGlobalsInPlace
+    : public UpdateGlobalsInPlaceBase<UpdateGlobalsInPlace> {
+  void runOnOperation() override {
+    FuncOp func = getOperation();
+    SmallVector<linalg::CopyOp, 8> copies;
+    func.walk([&](linalg::CopyOp copy) { copies.push_back(copy); });
+    // Forward all the writes first, so that the reads see the ops that now
+    // write the globals.
+    SmallVector<linalg::CopyOp, 8> remaining;
+    for (linalg::CopyOp copy : copies)
+      if (failed(forwardWrite(copy)))
+        remaining.push_back(copy);
+    for (linalg::CopyOp copy : remaining)
+      (void)forwardRead(copy);
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createUpdateGlobalsInPlacePass() {
+  return std::make_unique<UpdateGlobalsInPlace>();
+}
@@ -0,0 +1,122 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Vectorization of small, statically shaped linalg ops (typically the
+// innermost tiles produced by TileLinalgOps, and small elementwise ops).
+//
+// Each selected op is turned into vector.transfer_read/transfer_write ops
+// around vector arithmetic (or a vector.contract for matmuls), and
+// contractions are then lowered to vector.outerproduct chains, which become
+// FMAs on whole vector registers. The transfer ops are lowered later, by
+// VectorToSCF and finally VectorToLLVM (as plain or masked vector loads and
+// stores).
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetail.h"
+#include "npcomp/RefBackend/RefBackend.h"
+#include "npcomp/RefBackend/TargetInfo.h"
+
+#include "mlir/Dialect/Linalg/IR/LinalgOps.h"
+#include "mlir/Dialect/Linalg/Transforms/Transforms.h"
+#include "mlir/Dialect/Vector/VectorTransforms.h"
+#include "mlir/Transforms/GreedyPatternRewriteDriver.h"
+
+using namespace mlir;
+using namespace mlir::NPCOMP;
+
+// The largest iteration space that we turn into a single set of vector ops.
+// Vectorizing larger ops creates huge amounts of code; they should be tiled
+// first.
+constexpr int64_t kMaxVectorizedIterations = 1 << 15;
+
+// Marks the ops selected for vectorization.
+constexpr StringLiteral kVectorizeMarker = "refback_vectorize";
+
+// Returns true if `op` should be vectorized for vectors of `vectorWidth` bits.
+static bool shouldVectorize(linalg::LinalgOp op, unsigned vectorWidth) {
+  if (op.getNumOutputs() != 1 ||
+      failed(linalg::vectorizeLinalgOpPrecondition(op)))
+    return false;
+  auto loopRanges = op.getStaticLoopRanges();
+  if (!loopRanges)
+    return false;
+  int64_t numIterations = 1;
+  for (int64_t range : *loopRanges)
+    numIterations *= range;
+  if (numIterations > kMaxVectorizedIterations)
+    return false;
+
+  // Only vectorize if the innermost output dimension fills whole vector
+  // registers. Otherwise, the wasted lanes make this a pessimization.
+  ShapedType outputType = op.getOutputShapedType(0);
+  Type elementType = outputType.getElementType();
+  if (outputType.getRank() == 0 || !elementType.isIntOrFloat())
+    return false;
+  unsigned bitWidth = elementType.getIntOrFloatBitWidth();
+  if (bitWidth == 0 || vectorWidth % bitWidth != 0)
+    return false;
+  return outputType.getShape().back() % (vectorWidth / bitWidth) == 0;
+}
+
+namespace {
+class VectorizeLinalgOps
+    : public VectorizeLinalgOpsBase<VectorizeLinalgOps> {
+public:
+  VectorizeLinalgOps() = default;
+  VectorizeLinalgOps(unsigned width) { vectorWidth = width; }
+
+  void runOnOperation() override {
+    FuncOp func = getOperation();
+    MLIRContext *context = &getContext();
+    unsigned width =
+        vectorWidth ? vectorWidth : getHostTargetInfo().vectorWidth;
+
+    // Fold the bounds computations of tiles that are known to be full, so
+    // that the ops in them get static shapes.
+    {
+      RewritePatternSet patterns(context);
+      linalg::populateLinalgTilingCanonicalizationPatterns(patterns);
+      (void)applyPatternsAndFoldGreedily(func, std::move(patterns));
+    }
+
+    auto marker = Identifier::get(kVectorizeMarker, context);
+    func.walk([&](linalg::LinalgOp op) {
+      if (shouldVectorize(op, width))
+        op->setAttr(linalg::LinalgTransforms::kLinalgTransformMarker,
+                    StringAttr::get(context, kVectorizeMarker));
+    });
+    {
+      RewritePatternSet patterns(context);
+      patterns.add<linalg::LinalgVectorizationPattern>(
+          context, linalg::LinalgTransformationFilter(marker));
+      (void)applyPatternsAndFoldGreedily(func, std::move(patterns));
+    }
+
+    // Lower contractions to outer products, which map directly to FMAs.
+    {
+      RewritePatternSet patterns(context);
+      auto options =
+          vector::VectorTransformsOptions().setVectorTransformsOptions(
+              vector::VectorContractLowering::OuterProduct);
+      vector::populateVectorContractLoweringPatterns(patterns, options);
+      (void)applyPatternsAndFoldGreedily(func, std::move(patterns));
+    }
+  }
+};
+} // namespace
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createVectorizeLinalgOpsPass() {
+  return std::make_unique<VectorizeLinalgOps>();
+}
+
+std::unique_ptr<OperationPass<FuncOp>>
+mlir::NPCOMP::createVectorizeLinalgOpsPass(unsigned vectorWidth) {
+  return std::make_unique<VectorizeLinalgOps>(vectorWidth);
+}
@@ -23,11 +23,19 @@ using namespace mlir::NPCOMP::Typing::CPA;
 PropagationWorklist::PropagationWorklist(Environment &env) : env(env) {
   auto &contents = env.getConstraints();
   currentConstraints.reserve(contents.size() * 2);
+  constraintList.reserve(contents.size() * 2);
   for (auto *c : contents) {
-    currentConstraints.insert(c);
+    addConstraint(c);
   }
 }
 
+bool PropagationWorklist::addConstraint(Constraint *c) {
+  if (!currentConstraints.insert(c).second)
+    return false;
+  constraintList.push_back(c);
+  return true;
+}
+
 bool PropagationWorklist::commit() {
   bool hadNew = newConstraintCount > 0;
   newConstraintCount = 0;
@@ -35,44 +43,49 @@ bool PropagationWorklist::commit() {
 }
 
 void PropagationWorklist::propagateTransitivity() {
-  // Prepare for join.
-  constexpr size_t N = 8;
-  llvm::DenseMap<TypeVar *, llvm::SmallVector<ValueType *, N>> varToValueType;
-  llvm::DenseMap<TypeVar *, llvm::SmallVector<TypeNode *, N>> varToAny;
-  for (auto *c : currentConstraints) {
+  // Join each constraint that was not joined yet against the indexes, then
+  // add it to them, so that every pair is joined exactly once (whichever of
+  // the two constraints comes second does the join). Constraints added by
+  // this round are joined by the next one.
+  auto addTransConstraint = [&](ValueType *vt, TypeNode *to) {
+    Constraint *newC = env.getContext().getConstraint(vt, to);
+    if (addConstraint(newC)) {
+      LLVM_DEBUG(llvm::dbgs() << "-->ADD TRANS CONSTRAINT: ";
+                 newC->print(env.getContext(), llvm::dbgs());
+                 llvm::dbgs() << "\n";);
+      newConstraintCount += 1;
+    }
+  };
+
+  size_t end = constraintList.size();
+  for (size_t i = firstUnjoined; i < end; ++i) {
+    Constraint *c = constraintList[i];
     auto *lhsVar = llvm::dyn_cast<TypeVar>(c->getFrom());
     auto *rhsVar = llvm::dyn_cast<TypeVar>(c->getTo());
 
     if (lhsVar) {
-      varToAny[lhsVar].push_back(c->getTo());
+      // t <: τ joins with every τv <: t.
+      TypeNode *to = c->getTo();
+      varToAny[lhsVar].push_back(to);
+      auto it = varToValueTypes.find(lhsVar);
+      if (it != varToValueTypes.end()) {
+        for (ValueType *vt : it->second)
+          addTransConstraint(vt, to);
+      }
     }
     if (rhsVar) {
       if (auto *vt = llvm::dyn_cast<ValueType>(c->getFrom())) {
-        varToValueType[rhsVar].push_back(vt);
-      }
-    }
-  }
-
-  // Expand join.
-  for (auto vtIt : varToValueType) {
-    auto &lhsSet = vtIt.second;
-    auto anyIt = varToAny.find(vtIt.first);
-    if (anyIt == varToAny.end())
-      continue;
-    auto &rhsSet = anyIt->second;
-
-    for (ValueType *lhsItem : lhsSet) {
-      for (TypeNode *rhsItem : rhsSet) {
-        Constraint *newC = env.getContext().getConstraint(lhsItem, rhsItem);
-        if (currentConstraints.insert(newC).second) {
-          LLVM_DEBUG(llvm::dbgs() << "-->ADD TRANS CONSTRAINT: ";
-                     newC->print(env.getContext(), llvm::dbgs());
-                     llvm::dbgs() << "\n";);
-          newConstraintCount += 1;
+        // τv <: t joins with every t <: τ.
+        varToValueTypes[rhsVar].push_back(vt);
+        auto it = varToAny.find(rhsVar);
+        if (it != varToAny.end()) {
+          for (TypeNode *to : it->second)
+            addTransConstraint(vt, to);
         }
       }
     }
   }
+  firstUnjoined = end;
 }
 
 //------------------------------------------------------------------------------
@@ -109,7 +122,7 @@ LogicalResult GreedyTypeNodeVarResolver::analyzeTypeNode(TypeNode *tn) {
       continue;
 
     // Known mappings to this TypeVar.
-    auto &existingMembers = context.getMembers(newTv);
+    auto existingMembers = context.getMembers(newTv);
     ValueTypeSet members(existingMembers.begin(), existingMembers.end());
 
     ValueType *concreteVt = unionCandidateTypes(members);
@@ -153,46 +153,171 @@ TypeNode *Context::mapIrType(::mlir::Type irType) {
   return getIRValueType(irType);
 }
 
+llvm::SmallVector<ValueType *, 4> Context::getMembers(TypeNode *node) {
+  llvm::SmallVector<ValueType *, 4> members;
+  for (unsigned id : nodes[getRep(node->getId())].members)
+    members.push_back(llvm::cast<ValueType>(nodes[id].node));
+  return members;
+}
+
+unsigned Context::getRep(unsigned id) {
+  unsigned rep = id;
+  while (nodes[rep].rep != rep)
+    rep = nodes[rep].rep;
+  // Path compression.
+  while (nodes[id].rep != rep) {
+    unsigned next = nodes[id].rep;
+    nodes[id].rep = rep;
+    id = next;
+  }
+  return rep;
+}
+
+void Context::enqueueNode(unsigned id) {
+  if (pendingNodeIds.size() <= id)
+    pendingNodeIds.resize(std::max(2 * pendingNodeIds.size(), id + 1));
+  if (pendingNodeIds.test(id))
+    return;
+  pendingNodeIds.set(id);
+  pendingNodes.push_back(id);
+}
+
 void Context::addConstraintToGraph(Constraint *c) {
-  fwdNodeToConstraintMap[c->getFrom()].insert(c);
-  fwdConstraintToNodeMap[c].insert(c->getTo());
-  bakNodeToConstraintMap[c->getTo()].insert(c);
-  pendingConstraints.insert(c);
+  unsigned fromId = getRep(c->getFrom()->getId());
+  unsigned toId = getRep(c->getTo()->getId());
+  nodes[fromId].fwdConstraints.push_back(c);
+
+  // A new constraint gets all of the members of 'from', and not only those
+  // propagated from now on.
+  NodeState &to = nodes[toId];
+  bool modified = fromId != toId && (to.members |= nodes[fromId].members);
+  // If the 'from' is a ValueType, consider it part of its own set.
+  if (llvm::isa<ValueType>(c->getFrom())) {
+    modified = to.members.test_and_set(c->getFrom()->getId()) || modified;
+  }
+  if (modified)
+    enqueueNode(toId);
   propagateConstraints();
 }
 
 void Context::propagateConstraints() {
-  // Process pending constraints until converges.
-  while (!pendingConstraints.empty()) {
-    // Swap for stable iteration.
-    assert(pendingConstraintWorklist.empty());
-    pendingConstraintWorklist.swap(pendingConstraints);
-
-    for (auto *constraint : pendingConstraintWorklist) {
-      ValueTypeSet &fromContents = typeNodeMembers[constraint->getFrom()];
-      ValueTypeSet &toContents = typeNodeMembers[constraint->getTo()];
-
-      bool modified = false;
-      for (ValueType *fromItem : fromContents) {
-        modified = toContents.insert(fromItem).second || modified;
-      }
-      // If the 'from' is a ValueType, consider it part of its own set.
-      if (auto *fromIdentity =
-              llvm::dyn_cast<ValueType>(constraint->getFrom())) {
-        modified = toContents.insert(fromIdentity).second;
+  // Process pending nodes until converges.
+  while (!pendingNodes.empty()) {
+    unsigned id = pendingNodes.pop_back_val();
+    pendingNodeIds.reset(id);
+    // Collapsed nodes are propagated by their representative.
+    if (getRep(id) != id)
+      continue;
+
+    // Only propagate the members added since the last time.
+    NodeState &node = nodes[id];
+    llvm::SparseBitVector<> delta = node.members;
+    delta.intersectWithComplement(node.propagated);
+    if (delta.empty())
+      continue;
+    node.propagated |= delta;
+
+    // Constraints after which both sides have the same members are likely
+    // part of a cycle (the "lazy cycle detection" of Hardekopf and Lin).
+    llvm::SmallVector<unsigned, 4> cycleCandidates;
+    for (Constraint *constraint : node.fwdConstraints) {
+      unsigned toId = getRep(constraint->getTo()->getId());
+      if (toId == id)
+        continue;
+      NodeState &to = nodes[toId];
+      if (to.members |= delta)
+        enqueueNode(toId);
+      unsigned constraintId = constraint->getId();
+      if (cycleCheckedConstraintIds.size() <= constraintId)
+        cycleCheckedConstraintIds.resize(std::max(
+            2 * cycleCheckedConstraintIds.size(), constraintId + 1));
+      if (!cycleCheckedConstraintIds.test(constraintId) &&
+          to.members == node.members) {
+        cycleCheckedConstraintIds.set(constraintId);
+        cycleCandidates.push_back(toId);
       }
+    }
+    for (unsigned candidate : cycleCandidates)
+      collapseCyclesFrom(getRep(candidate));
+  }
+}
 
-      // If the 'to' item was modified, propagate any of its constraints.
-      if (modified) {
-        ConstraintSet &toPropagate =
-            fwdNodeToConstraintMap[constraint->getTo()];
-        for (Constraint *newConstraint : toPropagate) {
-          pendingConstraints.insert(newConstraint);
-        }
-      }
+void Context::collapseCyclesFrom(unsigned rootId) {
+  // Iterative Tarjan's algorithm over the representative nodes reachable
+  // from the root.
+  struct Frame {
+    unsigned id;
+    unsigned nextConstraint;
+  };
+  llvm::DenseMap<unsigned, unsigned> dfsIndex;
+  llvm::DenseMap<unsigned, unsigned> lowLink;
+  llvm::SmallVector<unsigned, 16> sccStack;
+  llvm::DenseSet<unsigned> onSccStack;
+  llvm::SmallVector<Frame, 16> dfsStack;
+  unsigned nextIndex = 0;
+  auto visit = [&](unsigned id) {
+    dfsIndex[id] = lowLink[id] = nextIndex++;
+    sccStack.push_back(id);
+    onSccStack.insert(id);
+    dfsStack.push_back({id, 0});
+  };
+
+  visit(rootId);
+  while (!dfsStack.empty()) {
+    Frame &frame = dfsStack.back();
+    unsigned id = frame.id;
+    auto &fwdConstraints = nodes[id].fwdConstraints;
+    if (frame.nextConstraint < fwdConstraints.size()) {
+      unsigned succ =
+          getRep(fwdConstraints[frame.nextConstraint++]->getTo()->getId());
+      if (!dfsIndex.count(succ))
+        visit(succ);
+      else if (onSccStack.count(succ))
+        lowLink[id] = std::min(lowLink[id], dfsIndex[succ]);
+      continue;
     }
-    pendingConstraintWorklist.clear();
+
+    dfsStack.pop_back();
+    if (!dfsStack.empty()) {
+      unsigned parent = dfsStack.back().id;
+      lowLink[parent] = std::min(lowLink[parent], lowLink[id]);
+    }
+    if (lowLink[id] != dfsIndex[id])
+      continue;
+    llvm::SmallVector<unsigned, 4> scc;
+    unsigned member;
+    do {
+      member = sccStack.pop_back_val();
+      onSccStack.erase(member);
+      scc.push_back(member);
+    } while (member != id);
+    // All nodes of the SCC are finished, so collapsing it does not disturb
+    // the traversal.
+    if (scc.size() > 1)
+      collapseNodes(scc);
+  }
+}
+
+void Context::collapseNodes(ArrayRef<unsigned> ids) {
+  unsigned repId = ids.front();
+  NodeState &rep = nodes[repId];
+  for (unsigned id : ids.drop_front()) {
+    NodeState &node = nodes[id];
+    node.rep = repId;
+    rep.members |= node.members;
+    rep.fwdConstraints.append(node.fwdConstraints.begin(),
+                              node.fwdConstraints.end());
+    node.fwdConstraints.clear();
+    node.members.clear();
+    node.propagated.clear();
   }
+  // Constraints within the cycle have nothing left to propagate.
+  llvm::erase_if(rep.fwdConstraints, [&](Constraint *c) {
+    return getRep(c->getTo()->getId()) == repId;
+  });
+  // The merged constraints have not seen the members of the other nodes.
+  rep.propagated.clear();
+  enqueueNode(repId);
 }
 
 //===----------------------------------------------------------------------===//
@@ -210,7 +335,7 @@ void TypeNode::print(Context &context, raw_ostream &os, bool brief) {
 void TypeVar::print(Context &context, raw_ostream &os, bool brief) {
   os << "TypeVar(" << ordinal;
   if (!brief) {
-    auto &members = context.getMembers(this);
+    auto members = context.getMembers(this);
     if (members.empty()) {
       os << " => EMPTY";
     } else {
@@ -0,0 +1,109 @@
+//===- FunctionSummaries.cpp - Bottom-up function type inference ----------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "npcomp/Typing/Support/FunctionSummaries.h"
+
+#include "mlir/Dialect/StandardOps/IR/Ops.h"
+#include "mlir/IR/Diagnostics.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/Support/Parallel.h"
+
+#include <atomic>
+
+using namespace mlir;
+using namespace mlir::NPCOMP::Typing;
+
+namespace {
+struct PendingFunction {
+  FuncOp func;
+  // The functions of the module called by `func` (other than itself) that
+  // aren't summarized yet.
+  llvm::SetVector<StringRef> callees;
+};
+} // namespace
+
+// Infers the functions of `wave`, which don't call each other, in parallel if
+// possible.
+static LogicalResult inferWave(
+    MLIRContext *context, ArrayRef<FuncOp> wave,
+    const FunctionSummaries &summaries,
+    llvm::function_ref<LogicalResult(FuncOp, const FunctionSummaries &)>
+        inferFunction) {
+  if (wave.size() == 1 || !context->isMultithreadingEnabled()) {
+    bool failed = false;
+    for (FuncOp func : wave)
+      failed |= mlir::failed(inferFunction(func, summaries));
+    return failure(failed);
+  }
+
+  // Order the diagnostics of the functions as if they were inferred in turn.
+  ParallelDiagnosticHandler diagHandler(context);
+  std::atomic<bool> failed(false);
+  llvm::parallelForEachN(0, wave.size(), [&](size_t i) {
+    diagHandler.setOrderIDForThread(i);
+    if (mlir::failed(inferFunction(wave[i], summaries)))
+      failed = true;
+    diagHandler.eraseOrderIDForThread();
+  });
+  return failure(failed);
+}
+
+LogicalResult mlir::NPCOMP::Typing::inferFunctionsBottomUp(
+    ModuleOp module,
+    llvm::function_ref<LogicalResult(FuncOp, const FunctionSummaries &)>
+        inferFunction) {
+  FunctionSummaries summaries;
+  std::vector<PendingFunction> pending;
+  llvm::StringMap<size_t> pendingIndices;
+  for (FuncOp func : module.getOps<FuncOp>()) {
+    if (func.isExternal()) {
+      summaries[func.getName()] = func.getType();
+      continue;
+    }
+    pendingIndices[func.getName()] = pending.size();
+    pending.push_back({func, {}});
+  }
+  for (PendingFunction &function : pending) {
+    function.func.walk([&](CallOp call) {
+      StringRef callee = call.getCallee();
+      if (callee != function.func.getName() && pendingIndices.count(callee))
+        function.callees.insert(callee);
+    });
+  }
+
+  bool failed = false;
+  while (!pending.empty()) {
+    // The next wave is the functions whose callees are all summarized.
+    SmallVector<FuncOp, 8> wave;
+    for (PendingFunction &function : pending) {
+      if (function.callees.empty())
+        wave.push_back(function.func);
+    }
+    // Otherwise the remaining functions call each other: break the cycle at
+    // the first of them.
+    if (wave.empty())
+      wave.push_back(pending.front().func);
+
+    failed |= mlir::failed(
+        inferWave(module.getContext(), wave, summaries, inferFunction));
+
+    llvm::SmallDenseSet<Operation *, 8> inferred;
+    for (FuncOp func : wave) {
+      summaries[func.getName()] = func.getType();
+      inferred.insert(func);
+    }
+    llvm::erase_if(pending, [&](PendingFunction &function) {
+      return inferred.count(function.func);
+    });
+    for (PendingFunction &function : pending) {
+      for (FuncOp func : wave)
+        function.callees.remove(func.getName());
+    }
+  }
+  return failure(failed);
+}
@@ -18,6 +18,7 @@
 #include "npcomp/Typing/Analysis/CPA/Interfaces.h"
 #include "npcomp/Typing/Analysis/CPA/Types.h"
 #include "npcomp/Typing/Support/CPAIrHelpers.h"
+#include "npcomp/Typing/Support/FunctionSummaries.h"
 #include "npcomp/Typing/Transforms/Passes.h"
 #include "llvm/Support/Debug.h"
 
@@ -84,7 +85,9 @@ namespace {
 
 class InitialConstraintGenerator {
 public:
-  InitialConstraintGenerator(CPA::Environment &env) : env(env) {}
+  InitialConstraintGenerator(CPA::Environment &env,
+                             const FunctionSummaries &summaries)
+      : env(env), summaries(summaries) {}
 
   /// If a return op was visited, this will be one of them.
   Operation *getLastReturnOp() { return funcReturnOp; }
@@ -154,8 +157,30 @@ public:
         }
         return WalkResult::advance();
       }
+      if (auto op = dyn_cast<scf::WhileOp>(childOp)) {
+        for (auto it : llvm::zip(op.inits(), op.getBefore().getArguments()))
+          addSubtypeConstraint(std::get<0>(it), std::get<1>(it), op);
+        return WalkResult::advance();
+      }
+      if (auto conditionOp = dyn_cast<scf::ConditionOp>(childOp)) {
+        auto whileOp = cast<scf::WhileOp>(conditionOp->getParentOp());
+        for (auto it : llvm::zip(conditionOp.args(), whileOp.getResults(),
+                                 whileOp.getAfter().getArguments())) {
+          addSubtypeConstraint(std::get<0>(it), std::get<1>(it), conditionOp);
+          addSubtypeConstraint(std::get<0>(it), std::get<2>(it), conditionOp);
+        }
+        return WalkResult::advance();
+      }
       if (auto yieldOp = dyn_cast<scf::YieldOp>(childOp)) {
         auto scfParentOp = yieldOp->getParentOp();
+        // The `after` region of a loop yields the next values of the
+        // arguments of its `before` region.
+        if (auto whileOp = dyn_cast<scf::WhileOp>(scfParentOp)) {
+          for (auto it : llvm::zip(yieldOp.getOperands(),
+                                   whileOp.getBefore().getArguments()))
+            addSubtypeConstraint(std::get<0>(it), std::get<1>(it), yieldOp);
+          return WalkResult::advance();
+        }
         if (scfParentOp->getNumResults() != yieldOp.getNumOperands()) {
           yieldOp.emitWarning()
               << "cannot run type inference on yield due to arity mismatch";
@@ -171,6 +196,27 @@ public:
         addSubtypeConstraint(op.operand(), op.result(), op);
         return WalkResult::advance();
       }
+      if (auto op = dyn_cast<CallOp>(childOp)) {
+        // The operands of calls of the functions already inferred flow to
+        // the arguments of their summaries, and their results flow from the
+        // results.
+        FunctionType summary = summaries.lookup(op.getCallee());
+        if (summary && summary.getNumInputs() == op.getNumOperands() &&
+            summary.getNumResults() == op.getNumResults()) {
+          auto &cpaContext = env.getContext();
+          for (auto it : llvm::zip(op.getOperands(), summary.getInputs())) {
+            if (!std::get<1>(it).isa<UnknownType>())
+              cpaContext.getConstraint(resolveValueType(std::get<0>(it)),
+                                       cpaContext.mapIrType(std::get<1>(it)));
+          }
+          for (auto it : llvm::zip(op.getResults(), summary.getResults())) {
+            if (!std::get<1>(it).isa<UnknownType>())
+              cpaContext.getConstraint(cpaContext.mapIrType(std::get<1>(it)),
+                                       resolveValueType(std::get<0>(it)));
+          }
+          return WalkResult::advance();
+        }
+      }
       if (auto op = dyn_cast<BinaryExprOp>(childOp)) {
         // TODO: This should really be applying arithmetic promotion, not
         // strict equality.
@@ -228,76 +274,95 @@ private:
   Operation *funcReturnOp = nullptr;
   llvm::SmallVector<Operation *, 4> innerReturnLikeOps;
   CPA::Environment &env;
+  const FunctionSummaries &summaries;
 };
 
-class CPAFunctionTypeInferencePass
-    : public CPAFunctionTypeInferenceBase<CPAFunctionTypeInferencePass> {
-public:
-  void runOnOperation() override {
-    FuncOp func = getOperation();
-    if (func.getBody().empty())
-      return;
-
-    CPA::Context cpaContext(CPA::createDefaultTypeMapHook());
-    auto &env = cpaContext.getCurrentEnvironment();
-
-    InitialConstraintGenerator p(env);
-    (void)p.runOnFunction(func);
-
-    CPA::PropagationWorklist prop(env);
-    do {
-      prop.propagateTransitivity();
-    } while (prop.commit());
-
-    LLVM_DEBUG(printReport(env, getContext(), llvm::dbgs()));
-
-    // Apply updates.
-    // TODO: This is far too naive and is basically only valid for single-block
-    // functions that are not called. Generalize it.
-    for (auto &it : env.getValueTypeMap()) {
-      auto irValue = it.first;
-      auto typeNode = it.second;
-      auto loc = irValue.getLoc();
-      CPA::GreedyTypeNodeVarResolver resolver(cpaContext, getContext(),
-                                              irValue.getLoc());
-      if (failed(resolver.analyzeTypeNode(typeNode))) {
-        mlir::emitRemark(loc)
-            << "type inference did not converge to an "
-            << "unambiguous type (this is a terribly unacceptable level of "
-            << "detail in an error message)";
-        return signalPassFailure();
-      }
+/// Infers the types of `func`, given the summaries of its callees.
+LogicalResult inferFunctionTypes(FuncOp func,
+                                 const FunctionSummaries &summaries) {
+  if (func.getBody().empty())
+    return success();
+  MLIRContext &mlirContext = *func.getContext();
 
-      if (resolver.getMappings().empty()) {
-        // The type is not generic/unknown, so it does not need to be updated.
-        continue;
-      }
+  CPA::Context cpaContext(CPA::createDefaultTypeMapHook());
+  auto &env = cpaContext.getCurrentEnvironment();
 
-      auto newType = typeNode->constructIrType(
-          cpaContext, resolver.getMappings(), &getContext(), loc);
-      if (!newType) {
-        auto diag = mlir::emitRemark(loc);
-        diag << "type inference converged but a concrete IR "
-             << "type could not be constructed";
-        return signalPassFailure();
-      }
-      irValue.setType(newType);
+  InitialConstraintGenerator p(env, summaries);
+  (void)p.runOnFunction(func);
+
+  CPA::PropagationWorklist prop(env);
+  do {
+    prop.propagateTransitivity();
+  } while (prop.commit());
+
+  LLVM_DEBUG(printReport(env, mlirContext, llvm::dbgs()));
+
+  // Apply updates.
+  // TODO: This is far too naive and is basically only valid for single-block
+  // functions. Generalize it.
+  for (auto &it : env.getValueTypeMap()) {
+    auto irValue = it.first;
+    auto typeNode = it.second;
+    auto loc = irValue.getLoc();
+    CPA::GreedyTypeNodeVarResolver resolver(cpaContext, mlirContext,
+                                            irValue.getLoc());
+    if (failed(resolver.analyzeTypeNode(typeNode))) {
+      mlir::emitRemark(loc)
+          << "type inference did not converge to an "
+          << "unambiguous type (this is a terribly unacceptable level of "
+          << "detail in an error message)";
+      return failure();
+    }
+
+    if (resolver.getMappings().empty()) {
+      // The type is not generic/unknown, so it does not need to be updated.
+      continue;
     }
 
-    // Now rewrite the function type based on actual types of entry block
-    // args and the final return op operands.
-    // Again, this is just a toy that will work for very simple, global
-    // functions.
-    auto entryBlockTypes = func.getBody().front().getArgumentTypes();
-    SmallVector<Type, 4> inputTypes(entryBlockTypes.begin(),
-                                    entryBlockTypes.end());
-    SmallVector<Type, 4> resultTypes;
-    if (p.getLastReturnOp()) {
-      auto resultRange = p.getLastReturnOp()->getOperandTypes();
-      resultTypes.append(resultRange.begin(), resultRange.end());
+    auto newType = typeNode->constructIrType(
+        cpaContext, resolver.getMappings(), &mlirContext, loc);
+    if (!newType) {
+      auto diag = mlir::emitRemark(loc);
+      diag << "type inference converged but a concrete IR "
+           << "type could not be constructed";
+      return failure();
     }
-    auto funcType = FunctionType::get(&getContext(), inputTypes, resultTypes);
-    func.setType(funcType);
+    irValue.setType(newType);
+  }
+
+  // Now rewrite the function type based on actual types of entry block
+  // args and the final return op operands.
+  // Again, this is just a toy that will work for very simple, global
+  // functions.
+  auto entryBlockTypes = func.getBody().front().getArgumentTypes();
+  SmallVector<Type, 4> inputTypes(entryBlockTypes.begin(),
+                                  entryBlockTypes.end());
+  SmallVector<Type, 4> resultTypes;
+  if (p.getLastReturnOp()) {
+    auto resultRange = p.getLastReturnOp()->getOperandTypes();
+    resultTypes.append(resultRange.begin(), resultRange.end());
+  }
+  func.setType(FunctionType::get(&mlirContext, inputTypes, resultTypes));
+  return success();
+}
+
+class CPAFunctionTypeInferencePass
+    : public CPAFunctionTypeInferenceBase<CPAFunctionTypeInferencePass> {
+public:
+  void runOnOperation() override {
+    // A function pass can't see its callees, so the types of calls are only
+    // inferred by npcomp-cpa-module-type-inference.
+    if (failed(inferFunctionTypes(getOperation(), /*summaries=*/{})))
+      return signalPassFailure();
+  }
+};
+
+class CPAModuleTypeInferencePass
+    : public CPAModuleTypeInferenceBase<CPAModuleTypeInferencePass> {
+public:
+  void runOnOperation() override {
+    if (failed(inferFunctionsBottomUp(getOperation(), inferFunctionTypes)))
+      return signalPassFailure();
   }
 };
 
@@ -307,3 +372,8 @@ std::unique_ptr<OperationPass<FuncOp>>
 mlir::NPCOMP::Typing::createCPAFunctionTypeInferencePass() {
   return std::make_unique<CPAFunctionTypeInferencePass>();
 }
+
+std::unique_ptr<OperationPass<ModuleOp>>
+mlir::NPCOMP::Typing::createCPAModuleTypeInferencePass() {
+  return std::make_unique<CPAModuleTypeInferencePass>();
+}
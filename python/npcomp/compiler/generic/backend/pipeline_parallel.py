@@ -0,0 +1,386 @@
+#  Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+#  See https://llvm.org/LICENSE.txt for license information.
+#  SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+"""Pipeline-parallel execution of a model too large for one process.
+
+`split_pipeline_stages` splits a function of a module satisfying the backend
+contract into stages, balanced by compute and weight memory (see
+`npcomp-split-pipeline-stages`), each of which is a module of its own. A
+`PipelineParallelModule` then compiles and runs each stage in a process of
+its own, so that each process only holds the weights of its stage, and
+streams micro-batches through the stages: while stage `k` runs micro-batch
+`i`, stage `k - 1` runs micro-batch `i + 1`.
+
+Tensors move between stages through shared memory rather than being
+pickled: each stage writes its results once into a shared memory slot, and
+the next stage reads them in place, as numpy arrays viewing the slot. The
+slots of each pair of stages are recycled, and their number bounds the
+micro-batches in flight between the stages.
+"""
+
+import multiprocessing
+import threading
+import traceback
+from multiprocessing import resource_tracker, shared_memory
+from typing import Iterable, Iterator, List, Optional, Sequence, Tuple
+
+import numpy as np
+
+__all__ = [
+    "split_pipeline_stages",
+    "PipelineParallelModule",
+]
+
+# The alignment of the tensors within a slot.
+_ALIGNMENT = 64
+
+
+def split_pipeline_stages(asm: str,
+                          num_stages: int,
+                          function: str = "forward") -> List[str]:
+  """Splits `function` of the module `asm` into pipeline stages.
+
+  Args:
+    asm: A module satisfying the backend contract, as text.
+    num_stages: The number of stages. There are fewer if the function has
+      fewer ops.
+    function: The function to split.
+  Returns:
+    The modules of the stages, as text. Stage `k` only has the function
+    `{function}_stage{k}`, taking the results of stage `k - 1` (the
+    arguments of `function` for the first stage) and returning the results
+    of `function` for the last stage.
+  """
+  from mlir.ir import Context, Module
+  from mlir.passmanager import PassManager
+  from npcomp import _cext
+  stages = []
+  for stage in range(num_stages):
+    with Context() as context:
+      _cext.register_all_dialects(context)
+      module = Module.parse(asm)
+      pm = PassManager.parse(
+          f"npcomp-split-pipeline-stages{{function={function} "
+          f"num-stages={num_stages} stage={stage}}}")
+      pm.run(module)
+      if not any(True for _ in module.body.operations):
+        break
+      stages.append(str(module))
+  return stages
+
+
+class _StageError(RuntimeError):
+  pass
+
+
+class _Sender:
+  """Writes micro-batches to the slots of a channel."""
+
+  def __init__(self, conn, returned_conn, num_slots: int):
+    self._conn = conn
+    self._returned_conn = returned_conn
+    self._num_slots = num_slots
+    self._slots = dict()
+    self._free = []
+    # The slots replaced by larger ones since the last micro-batch.
+    self._retired = []
+
+  def _get_slot(self, size: int) -> shared_memory.SharedMemory:
+    if not self._free and len(self._slots) == self._num_slots:
+      # Wait for the receiver to be done with a micro-batch.
+      self._free.append(self._returned_conn.recv())
+    if self._free:
+      slot = self._slots[self._free.pop()]
+      if slot.size >= size:
+        return slot
+      del self._slots[slot.name]
+      self._retired.append(slot.name)
+      slot.close()
+      slot.unlink()
+    slot = shared_memory.SharedMemory(create=True, size=max(size, 1))
+    self._slots[slot.name] = slot
+    return slot
+
+  def send(self, arrays: Sequence[np.ndarray]):
+    arrays = [np.asarray(array) for array in arrays]
+    offsets = []
+    size = 0
+    for array in arrays:
+      offsets.append(size)
+      size += -(-array.nbytes // _ALIGNMENT) * _ALIGNMENT
+    slot = self._get_slot(size)
+    metadata = []
+    for array, offset in zip(arrays, offsets):
+      view = np.ndarray(array.shape, array.dtype, slot.buf, offset)
+      view[...] = array
+      metadata.append((array.dtype.str, array.shape, offset))
+    self._conn.send(("batch", slot.name, metadata, self._retired))
+    self._retired = []
+
+  def send_error(self, message: str):
+    self._conn.send(("error", message))
+
+  def close(self):
+    """Ends the stream, and unlinks the slots once the receiver is done."""
+    self._conn.send(None)
+    try:
+      while len(self._free) < len(self._slots):
+        self._free.append(self._returned_conn.recv())
+    except EOFError:
+      pass
+    for slot in self._slots.values():
+      slot.close()
+      slot.unlink()
+    self._slots.clear()
+
+
+class _Receiver:
+  """Reads the micro-batches written by a _Sender, in place."""
+
+  def __init__(self, conn, returned_conn):
+    self._conn = conn
+    self._returned_conn = returned_conn
+    self._slots = dict()
+
+  def _attach(self, name: str) -> shared_memory.SharedMemory:
+    slot = self._slots.get(name)
+    if slot is None:
+      slot = shared_memory.SharedMemory(name=name)
+      # The sender owns the slot: keep the resource tracker of this process
+      # from unlinking it when this process exits.
+      resource_tracker.unregister(slot._name, "shared_memory")
+      self._slots[name] = slot
+    return slot
+
+  def poll(self, timeout: float) -> bool:
+    return self._conn.poll(timeout)
+
+  def recv(self):
+    """Returns (slot name, arrays viewing the slot), or None at the end.
+
+    Raises _StageError if a previous stage failed on the micro-batch.
+    """
+    message = self._conn.recv()
+    if message is None:
+      return None
+    if message[0] == "error":
+      raise _StageError(message[1])
+    _, name, metadata, retired = message
+    for retired_name in retired:
+      slot = self._slots.pop(retired_name, None)
+      if slot is not None:
+        slot.close()
+    slot = self._attach(name)
+    arrays = [
+        np.ndarray(shape, np.dtype(dtype), slot.buf, offset)
+        for dtype, shape, offset in metadata
+    ]
+    return name, arrays
+
+  def release(self, name: str):
+    """Returns the slot `name` to the sender, once done with its arrays."""
+    self._returned_conn.send(name)
+
+  def close(self):
+    for slot in self._slots.values():
+      slot.close()
+    self._slots.clear()
+
+
+def _create_channel(context, num_slots: int) -> Tuple[_Sender, _Receiver]:
+  recv_conn, send_conn = context.Pipe(duplex=False)
+  returned_recv_conn, returned_send_conn = context.Pipe(duplex=False)
+  return (_Sender(send_conn, returned_recv_conn, num_slots),
+          _Receiver(recv_conn, returned_send_conn))
+
+
+def _run_stage(asm: str, function: str, receiver: _Receiver,
+               sender: _Sender, compile_options: dict):
+  """The main function of the process of a stage.
+
+  Sends exactly one message, results or error, per micro-batch received.
+  """
+  from npcomp.compiler.generic.backend import refjit as refjit_backend
+  jit_module = None
+  compile_error = None
+  try:
+    service = refjit_backend.create_compilation_service(num_threads=1)
+    jit_module = service.compile(asm, **compile_options)
+  except Exception:
+    compile_error = traceback.format_exc()
+  try:
+    while True:
+      try:
+        received = receiver.recv()
+      except _StageError as e:
+        sender.send_error(str(e))
+        continue
+      if received is None:
+        break
+      name, args = received
+      try:
+        if jit_module is None:
+          sender.send_error(compile_error)
+        else:
+          # The results are written to the next slot before this one is
+          # released, as they may view the arguments.
+          sender.send(jit_module.invoke(function, args))
+      except Exception:
+        sender.send_error(traceback.format_exc())
+      # Drop the views of the slot, so that it can be closed if retired.
+      del received, args
+      receiver.release(name)
+  finally:
+    receiver.close()
+    sender.close()
+
+
+class PipelineParallelModule:
+  """Runs the stages of a model in a pipeline of processes.
+
+  The stages are compiled by their processes, concurrently, with the refjit
+  backend. Use as a context manager, or call `close` to stop the processes.
+  """
+
+  def __init__(self,
+               stages: Sequence[str],
+               function: str = "forward",
+               max_in_flight: int = 2,
+               compile_options: Optional[dict] = None):
+    """Starts a process for each stage.
+
+    Args:
+      stages: The modules of the stages, as returned by
+        `split_pipeline_stages`.
+      function: The function that was split.
+      max_in_flight: The number of micro-batches buffered between each pair
+        of stages.
+      compile_options: Keyword arguments of the `compile` method of the
+        refjit `CompilationService` compiling the stages.
+    """
+    super().__init__()
+    context = multiprocessing.get_context("spawn")
+    channels = [
+        _create_channel(context, max_in_flight)
+        for _ in range(len(stages) + 1)
+    ]
+    self._sender = channels[0][0]
+    self._receiver = channels[-1][1]
+    self._processes = []
+    for k, asm in enumerate(stages):
+      process = context.Process(target=_run_stage,
+                                args=(asm, f"{function}_stage{k}",
+                                      channels[k][1], channels[k + 1][0],
+                                      compile_options or {}),
+                                daemon=True)
+      process.start()
+      self._processes.append(process)
+    self._lock = threading.Lock()
+    self._closed = False
+
+  def _receive(self):
+    """Returns the results of the next micro-batch, or None on a timeout.
+
+    Raises _StageError if a stage failed on the micro-batch.
+    """
+    if not self._receiver.poll(0.1):
+      for k, process in enumerate(self._processes):
+        if not process.is_alive():
+          raise RuntimeError(
+              f"pipeline stage {k} exited with code {process.exitcode}")
+      return None
+    received = self._receiver.recv()
+    if received is None:
+      raise RuntimeError("the pipeline stopped")
+    name, arrays = received
+    results = tuple(np.array(array) for array in arrays)
+    self._receiver.release(name)
+    return results
+
+  def map(self, batches: Iterable[Sequence[np.ndarray]]
+         ) -> Iterator[Tuple[np.ndarray, ...]]:
+    """Runs the model on each micro-batch of `batches`, in a pipeline.
+
+    `batches` is consumed by another thread, as the stages make room for
+    more micro-batches. Yields the results of each micro-batch in turn,
+    copied out of shared memory. Raises RuntimeError if a stage fails, with
+    its traceback, once the micro-batches in flight are done.
+    """
+    with self._lock:
+      # The number of micro-batches fed, once all of them are.
+      fed = []
+      feed_error = []
+
+      def feed():
+        count = 0
+        try:
+          for batch in batches:
+            self._sender.send(batch)
+            count += 1
+        except BaseException as e:
+          feed_error.append(e)
+        finally:
+          fed.append(count)
+
+      feeder = threading.Thread(target=feed, daemon=True)
+      feeder.start()
+      received = 0
+      stage_error = None
+      try:
+        while not fed or received < fed[0]:
+          try:
+            results = self._receive()
+          except _StageError as e:
+            received += 1
+            stage_error = stage_error or e
+            continue
+          if results is None:
+            continue
+          received += 1
+          if stage_error is None:
+            yield results
+      finally:
+        # If the caller stopped early, drain the micro-batches in flight.
+        while not fed or received < fed[0]:
+          try:
+            if self._receive() is not None:
+              received += 1
+          except _StageError:
+            received += 1
+      feeder.join()
+      if stage_error is not None:
+        raise RuntimeError(f"pipeline stage failed:\n{stage_error}")
+      if feed_error:
+        raise feed_error[0]
+
+  def __call__(self, *args: np.ndarray) -> Tuple[np.ndarray, ...]:
+    """Runs the model on one micro-batch."""
+    return list(self.map([args]))[0]
+
+  def close(self):
+    """Stops the processes of the stages, once done with their work."""
+    if self._closed:
+      return
+    self._closed = True
+    with self._lock:
+      self._sender.close()
+      # Drain the pipeline, so that the last stage can unlink its slots.
+      while True:
+        try:
+          received = self._receiver.recv()
+        except _StageError:
+          continue
+        except EOFError:
+          break
+        if received is None:
+          break
+        self._receiver.release(received[0])
+      self._receiver.close()
+    for process in self._processes:
+      process.join()
+
+  def __enter__(self):
+    return self
+
+  def __exit__(self, *exc):
+    self.close()
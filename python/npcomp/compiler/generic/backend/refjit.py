@@ -2,7 +2,11 @@
 #  See https://llvm.org/LICENSE.txt for license information.
 #  SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
 
+import hashlib
 import os
+import tempfile
+import urllib.request
+from typing import Any, Callable, Optional
 
 _refjit = None
 
@@ -30,16 +34,295 @@ def get_refjit():
 def is_enabled() -> bool:
   """Returns whether the backend is enabled for the current build."""
   try:
-    _get_refjit()
+    get_refjit()
     return True
   except ImportError:
     return False
 
 
-def get_runtime_libs():
+def configure_pass_manager(context, pm):
+  """Applies the compile-time options from the environment to `pm`.
+
+  - NPCOMP_COMPILE_THREADS: the number of threads to run pass pipelines on in
+    `context` (0 for one per hardware thread, 1 to disable multithreading).
+  - NPCOMP_COMPILE_TIME_REPORT: if set, `pm` prints a per-pass timing and
+    memory report to stderr once it is destroyed.
+  """
+  refjit = get_refjit()
+  num_threads = os.environ.get("NPCOMP_COMPILE_THREADS")
+  if num_threads is not None:
+    refjit.set_compile_threads(context, int(num_threads))
+  if "NPCOMP_COMPILE_TIME_REPORT" in os.environ:
+    refjit.enable_compile_time_report(pm)
+
+
+def set_num_threads(num_threads: int = 0):
+  """Sets the number of threads that the parallel loops of JITModules run on.
+
+  0 restores the default: REFBACKRT_NUM_THREADS if it is set, and one thread
+  per core otherwise. Must not be called while a JITModule is running.
+  """
+  get_refjit().set_num_threads(num_threads)
+
+
+def get_num_threads() -> int:
+  """Returns the number of threads that the parallel loops run on."""
+  return get_refjit().get_num_threads()
+
+
+def defer_threads_to_torch(share: float = 1.0) -> int:
+  """Sizes the runtime's thread pool after the intra-op pool of PyTorch.
+
+  In a process that also runs PyTorch, each pool otherwise starts a thread
+  per core. The runtime gets `share` of the threads of
+  `torch.get_num_threads()`: all of them for workloads alternating between
+  PyTorch and JITModules, and a part of them for workloads running both
+  concurrently, which should give PyTorch the rest with
+  `torch.set_num_threads`. Returns the number of threads of the runtime.
+  """
+  import torch
+  num_threads = max(1, int(round(torch.get_num_threads() * share)))
+  set_num_threads(num_threads)
+  return num_threads
+
+
+def get_runtime_shlib() -> str:
+  """Returns the path of the compiler runtime shared library.
+
+  JITModules don't need it, as they bind the compiler runtime functions to
+  those of the runtime linked into the refjit module. It is for other hosts
+  of the compiled code, such as the MLIR ExecutionEngine.
+  """
   # The _refjit_resources directory is at the npcomp.compiler level.
   resources_dir = os.path.join(os.path.dirname(__file__))
-  return [os.path.join(resources_dir, "libNPCOMPCompilerRuntimeShlib.so")]
+  return os.path.join(resources_dir, "libNPCOMPCompilerRuntimeShlib.so")
+
+
+def get_runtime_libs():
+  """Returns the shared libraries that JITModules load, which are none."""
+  return []
+
+
+class _HttpObjectStore:
+  """Fetches and stores object code as `{url}/{key}.o`, with GET and PUT."""
+
+  def __init__(self, url: str, timeout: float):
+    super().__init__()
+    self._url = url.rstrip("/")
+    self._timeout = timeout
+
+  def fetch(self, key: str) -> Optional[bytes]:
+    try:
+      with urllib.request.urlopen(f"{self._url}/{key}.o",
+                                  timeout=self._timeout) as response:
+        return response.read()
+    except OSError:
+      # Including 404s, and caches that can't be reached.
+      return None
+
+  def store(self, key: str, data: bytes):
+    request = urllib.request.Request(f"{self._url}/{key}.o",
+                                     data=data,
+                                     method="PUT")
+    try:
+      urllib.request.urlopen(request, timeout=self._timeout).close()
+    except OSError:
+      pass
+
+
+def open_shared_object_store(location: str, timeout: float = 10.0):
+  """Returns the store of object code shared by a fleet at `location`.
+
+  Compilations given the store (see `create_compilation_service` and the
+  `shared_object_store` of `JITModule.from_compiled_module`) load the object
+  code that another process compiled for the same module, target, CPU and
+  options instead of compiling it, and store the object code that they
+  compile.
+
+  Args:
+    location: An `http://` or `https://` URL, under which the object code is
+      fetched with GET and stored with PUT, or a directory, typically on
+      network storage. Empty for no store.
+    timeout: The timeout in seconds of the HTTP requests.
+  Returns:
+    An `ObjectStore` of the refjit module, or None.
+  """
+  if not location:
+    return None
+  if location.startswith(("http://", "https://")):
+    store = _HttpObjectStore(location, timeout)
+    return get_refjit().ObjectStore.from_functions(store.fetch, store.store)
+  return get_refjit().ObjectStore.directory(location)
+
+
+_default_shared_object_store = (None, None)
+
+
+def get_default_shared_object_store():
+  """Returns the shared object store of the backends that aren't given one.
+
+  The default store is at the location given by the
+  NPCOMP_SHARED_OBJECT_STORE environment variable (see
+  `open_shared_object_store`). Otherwise, there is none.
+  """
+  global _default_shared_object_store
+  location = os.environ.get("NPCOMP_SHARED_OBJECT_STORE", "")
+  if _default_shared_object_store[0] != location:
+    _default_shared_object_store = (location,
+                                    open_shared_object_store(location))
+  return _default_shared_object_store[1]
+
+
+def get_shared_object_store(store):
+  """Resolves a location or ObjectStore, defaulting to the default store."""
+  if store is None:
+    return get_default_shared_object_store()
+  if isinstance(store, str):
+    return open_shared_object_store(store)
+  return store
+
+
+def create_compilation_service(num_threads: int = 0,
+                               object_cache_dir: str = "",
+                               shared_object_store=None):
+  """Creates a service compiling many modules, given as text, to JITModules.
+
+  The service keeps its contexts, pass managers and LLVM targets across
+  compilations, which run concurrently on `num_threads` threads (0 for one
+  per hardware thread). See `CompilationService` of the refjit module.
+  `shared_object_store` is an `ObjectStore` or the location of one (see
+  `open_shared_object_store`), and defaults to the default store.
+  """
+  return get_refjit().CompilationService(
+      get_runtime_libs(),
+      object_cache_dir=object_cache_dir,
+      num_threads=num_threads,
+      shared_object_store=get_shared_object_store(shared_object_store))
+
+
+def get_compiler_identity() -> str:
+  """Returns a string that changes whenever the compiler is rebuilt."""
+  import _npcomp
+  stat = os.stat(_npcomp.__file__)
+  return f"{_npcomp.__file__}:{stat.st_size}:{stat.st_mtime_ns}"
+
+
+class CompiledModuleCache:
+  """A content-addressed cache of compiled JITModules.
+
+  Modules are keyed by the hash of their IR as passed to the compiler, the
+  options of the pipeline lowering them and the build of the compiler, so
+  that any change to one of them recompiles. The modules compiled by the
+  current process are kept in memory. If `cache_dir` is given, the lowered
+  IR of the modules is also stored there, and their object code in the
+  `object_cache_dir` subdirectory (see the `object_cache_dir` of
+  `JITModule.from_compiled_module`), so that other processes compiling the
+  same modules skip both the MLIR pipeline and LLVM code generation. A
+  disabled cache never hits.
+
+  Note that the compilations hitting the same in-memory entry share the
+  JITModule, including the state of its mutable globals.
+  """
+
+  def __init__(self, cache_dir: Optional[str] = None, enabled: bool = True):
+    super().__init__()
+    self.cache_dir = cache_dir if enabled else None
+    self.enabled = enabled
+    self._modules = dict()
+    # Compilations served from memory, from disk, and compiled from scratch.
+    self.memory_hits = 0
+    self.disk_hits = 0
+    self.misses = 0
+    if self.cache_dir is not None:
+      os.makedirs(self.cache_dir, exist_ok=True)
+
+  @property
+  def object_cache_dir(self) -> str:
+    """The directory for the object cache of the compiler, or ''."""
+    if self.cache_dir is None:
+      return ""
+    return os.path.join(self.cache_dir, "objects")
+
+  def get_key(self, asm: str, options: Any) -> str:
+    h = hashlib.sha256()
+    for part in (get_compiler_identity(), repr(options), asm):
+      h.update(part.encode())
+      h.update(b"\0")
+    return h.hexdigest()
+
+  def get_module(self, key: str):
+    return self._modules.get(key)
+
+  def put_module(self, key: str, jit_module):
+    if self.enabled:
+      self._modules[key] = jit_module
+
+  def get_lowered_asm(self, key: str) -> Optional[str]:
+    if self.cache_dir is None:
+      return None
+    try:
+      with open(os.path.join(self.cache_dir, key + ".mlir")) as f:
+        return f.read()
+    except OSError:
+      return None
+
+  def put_lowered_asm(self, key: str, asm: str):
+    if self.cache_dir is None:
+      return
+    # Write to a temporary file first, so that concurrent readers never see a
+    # partial file.
+    fd, temp_path = tempfile.mkstemp(dir=self.cache_dir, suffix=".tmp")
+    with os.fdopen(fd, "w") as f:
+      f.write(asm)
+    os.replace(temp_path, os.path.join(self.cache_dir, key + ".mlir"))
+
+  def get_or_compile(self, module, options: Any,
+                     lower: Callable[[Any], None],
+                     compile_lowered: Callable[[Any], Any]):
+    """Returns the JITModule compiled from `module`, compiling it on a miss.
+
+    Args:
+      module: The MLIR module to compile.
+      options: The options of the compilation (anything with a stable repr).
+      lower: Lowers a module in place, on a miss.
+      compile_lowered: Compiles a lowered module to a JITModule.
+    """
+    key = self.get_key(str(module), options)
+    jit_module = self.get_module(key)
+    if jit_module is not None:
+      self.memory_hits += 1
+      return jit_module
+    lowered_asm = self.get_lowered_asm(key)
+    if lowered_asm is not None:
+      from mlir.ir import Module
+      self.disk_hits += 1
+      lowered = Module.parse(lowered_asm, context=module.context)
+      jit_module = compile_lowered(lowered)
+    else:
+      self.misses += 1
+      lower(module)
+      self.put_lowered_asm(key, str(module))
+      jit_module = compile_lowered(module)
+    self.put_module(key, jit_module)
+    return jit_module
+
+
+_default_cache = None
+
+
+def get_default_cache() -> Optional[CompiledModuleCache]:
+  """Returns the cache of the backends that aren't given one.
+
+  The default cache is enabled by the NPCOMP_COMPILE_CACHE_DIR environment
+  variable, which gives its directory. Otherwise, there is none.
+  """
+  global _default_cache
+  cache_dir = os.environ.get("NPCOMP_COMPILE_CACHE_DIR")
+  if not cache_dir:
+    return None
+  if _default_cache is None or _default_cache.cache_dir != cache_dir:
+    _default_cache = CompiledModuleCache(cache_dir)
+  return _default_cache
 
 
 class JitModuleInvoker:
@@ -16,7 +16,7 @@ __all__ = [
 ]
 
 FRONTEND_PASSES = (
-    "func(basicpy-type-inference)",
+    "basicpy-module-type-inference",
     "func(convert-basicpy-to-std)",
     "func(canonicalize)",
     "func(convert-scf-to-std)",
@@ -3,6 +3,7 @@
 #  SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
 
 import os
+from typing import Optional
 
 from mlir.ir import *
 from mlir.passmanager import *
@@ -15,8 +16,9 @@ __all__ = [
 ]
 
 FRONTEND_PASSES = (
-    "func(npcomp-cpa-type-inference)",
+    "npcomp-cpa-module-type-inference",
     "numpy-public-functions-to-tensor",
+    "func(numpy-elide-array-copies)",
     "func(convert-numpy-to-tcf)",
     "func(convert-scf-to-std)",
     "func(canonicalize)",
@@ -30,10 +32,37 @@ is_enabled = refjit_backend.is_enabled
 class CompilerBackend:
   """Main entry-point for the backend."""
 
-  def __init__(self):
+  def __init__(self,
+               profile_ops: bool = False,
+               optimize: bool = False,
+               cache: Optional[refjit_backend.CompiledModuleCache] = None,
+               shared_object_store=None):
+    """Creates the backend.
+
+    Args:
+      profile_ops: Whether to record the time spent in each op.
+      optimize: Whether to run the optimizing backend pipeline, which among
+        others fuses chains of ufunc calls into a single loop nest.
+      cache: The cache of the modules compiled by `compile`. Defaults to the
+        default cache of the refjit backend, if any.
+      shared_object_store: The store of object code shared with other
+        processes, or its location (see `open_shared_object_store` of the
+        refjit backend). Defaults to the default store, if any.
+    """
     super().__init__()
     self._refjit = refjit_backend.get_refjit()
     self._debug = logging.debug_enabled()
+    self._profile_ops = profile_ops
+    self._optimize = optimize
+    self._cache = cache if cache is not None else (
+        refjit_backend.get_default_cache())
+    self._shared_object_store = refjit_backend.get_shared_object_store(
+        shared_object_store)
+
+  @property
+  def cache_key(self):
+    """Options affecting the compiled code, for the compile cache."""
+    return (self._profile_ops, self._optimize)
 
   def compile(self, imported_module: Module):
     """Compiles an imported module.
@@ -46,7 +75,19 @@ class CompilerBackend:
       The object may actually be something more specific to the backend (i.e.
       for IREE, it is a serialized VM flatbuffer) but the contract is that
       it is operated on by methods on this class.
+
+    With a cache, `imported_module` is only lowered (in place) when it isn't
+    found in the cache.
     """
+    if self._cache is not None:
+      return self._cache.get_or_compile(imported_module,
+                                        (FRONTEND_PASSES, self.cache_key),
+                                        self.lower, self.compile_lowered)
+    self.lower(imported_module)
+    return self.compile_lowered(imported_module)
+
+  def lower(self, imported_module: Module):
+    """Runs the frontend and backend pipelines on `imported_module` in place."""
     with imported_module.context as context:
       # Frontend.
       if self._debug:
@@ -54,6 +95,7 @@ class CompilerBackend:
       assert (
           imported_module.operation.verify()), "Imported module does not verify"
       pm = PassManager.parse(",".join(FRONTEND_PASSES))
+      refjit_backend.configure_pass_manager(context, pm)
       pm.run(imported_module)
       if self._debug:
         logging.debug("Frontend IR:\n{}", imported_module)
@@ -61,14 +103,23 @@ class CompilerBackend:
       # Backend.
       # Note that this is a separate pass manager purely to aid in debugging.
       pm = PassManager()
-      self._refjit.build_backend_compilation_pipeline(pm)
+      self._refjit.build_backend_compilation_pipeline(
+          pm, profile_ops=self._profile_ops, optimize=self._optimize)
+      refjit_backend.configure_pass_manager(context, pm)
       pm.run(imported_module)
       if self._debug:
         logging.debug("Backend IR:\n{}", imported_module)
 
-    jit_module = self._refjit.JITModule.from_compiled_module(
-        imported_module, refjit_backend.get_runtime_libs())
-    return jit_module
+  def compile_lowered(self, lowered_module: Module):
+    """Compiles a module lowered by `lower` to a JITModule."""
+    object_cache_dir = ""
+    if self._cache is not None:
+      object_cache_dir = self._cache.object_cache_dir
+    return self._refjit.JITModule.from_compiled_module(
+        lowered_module,
+        refjit_backend.get_runtime_libs(),
+        object_cache_dir=object_cache_dir,
+        shared_object_store=self._shared_object_store)
 
   def load(self, jit_module):
     """Loads a compiled artifact into the runtime.
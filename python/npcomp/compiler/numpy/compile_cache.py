@@ -0,0 +1,161 @@
+#  Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+#  See https://llvm.org/LICENSE.txt for license information.
+#  SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+"""Caches the compiled form of functions imported with the ImportFrontend.
+
+Importing a function parses its source, partially evaluates it and runs the
+whole backend pipeline, which is far more expensive than invoking the
+compiled code. The `compile_function` decorator keeps the loaded module of
+each compiled function in a `CompileCache`, so that compiling the same
+function again (for example when a module defining it is reloaded, or when
+it is decorated in a loop) only loads the cached module.
+"""
+
+import functools
+import hashlib
+import inspect
+import types
+
+import numpy as np
+
+from ..utils import logging
+from .frontend import *
+from .target import *
+from . import test_config
+
+__all__ = [
+    "CompileCache",
+    "compile_function",
+    "default_compile_cache",
+]
+
+
+def _fingerprint_value(value):
+  """Returns a hashable fingerprint of a value used by a compiled function.
+
+  Arrays are imported as constants, so their dtype, shape and contents are
+  all part of the compiled code.
+  """
+  if isinstance(value, np.ndarray):
+    return ("ndarray", value.dtype.str, value.shape,
+            hashlib.sha256(np.ascontiguousarray(value).tobytes()).hexdigest())
+  if value is None or isinstance(value, (bool, int, float, complex, str)):
+    return (type(value).__name__, value)
+  if isinstance(value, tuple):
+    return ("tuple",) + tuple(_fingerprint_value(v) for v in value)
+  if isinstance(value, types.ModuleType):
+    return ("module", value.__name__)
+  if callable(value) and hasattr(value, "__qualname__"):
+    return ("callable", getattr(value, "__module__", None), value.__qualname__)
+  # Anything else is only known to be the same by identity.
+  return ("object", id(value))
+
+
+def _get_global_names(code):
+  """Returns the names of the globals `code` and its nested code may load."""
+  names = set(code.co_names)
+  for const in code.co_consts:
+    if isinstance(const, types.CodeType):
+      names |= _get_global_names(const)
+  return names
+
+
+def _get_signature_key(f):
+  """Returns the part of the cache key for the arguments of `f`.
+
+  The ImportFrontend derives the type of the arguments and result from their
+  annotations, and captures the globals that `f` references (typically
+  arrays) as constants.
+  """
+  signature = inspect.signature(f)
+  annotations = tuple(
+      (name, repr(p.annotation)) for name, p in signature.parameters.items())
+  return_annotation = repr(signature.return_annotation)
+  captured = tuple(
+      (name, _fingerprint_value(f.__globals__[name]))
+      for name in sorted(_get_global_names(f.__code__))
+      if name in f.__globals__)
+  return annotations, return_annotation, captured
+
+
+def _get_backend_key(backend):
+  return (type(backend).__module__, type(backend).__qualname__,
+          getattr(backend, "cache_key", ()))
+
+
+class CompileCache:
+  """Maps the compile keys of functions to their loaded modules.
+
+  A key is made of the identity of the function (module and qualified name),
+  a hash of its source, the types of its arguments and the dtypes, shapes and
+  contents of the globals it captures, the target and the backend.
+  """
+
+  def __init__(self):
+    super().__init__()
+    self._loaded_modules = dict()
+    self.hits = 0
+    self.misses = 0
+
+  def get_key(self, f, backend, target_factory=GenericTarget32):
+    source = inspect.getsource(f)
+    return (f.__module__, f.__qualname__,
+            hashlib.sha256(source.encode("utf-8")).hexdigest(),
+            _get_signature_key(f), repr(target_factory),
+            _get_backend_key(backend))
+
+  def get_or_compile(self, f, backend, target_factory=GenericTarget32):
+    """Returns the loaded module of `f`, compiling it on a miss."""
+    key = self.get_key(f, backend, target_factory)
+    loaded_module = self._loaded_modules.get(key)
+    if loaded_module is not None:
+      self.hits += 1
+      logging.debug("Compile cache hit for {}", f.__qualname__)
+      return loaded_module
+    self.misses += 1
+    logging.debug("Compile cache miss for {}", f.__qualname__)
+    fe = ImportFrontend(config=test_config.create_test_config(
+        target_factory=target_factory))
+    fe.import_global_function(f)
+    loaded_module = backend.load(backend.compile(fe.ir_module))
+    self._loaded_modules[key] = loaded_module
+    return loaded_module
+
+  def clear(self):
+    self._loaded_modules.clear()
+    self.hits = 0
+    self.misses = 0
+
+  def __len__(self):
+    return len(self._loaded_modules)
+
+
+default_compile_cache = CompileCache()
+
+
+def compile_function(f=None,
+                     *,
+                     backend=None,
+                     target_factory: TargetFactory = GenericTarget32,
+                     cache: CompileCache = None):
+  """Decorator compiling a global function with the ImportFrontend.
+
+  Returns the compiled function, taken from `cache` (the default cache if
+  not given) when the same function was already compiled for the same
+  backend. `backend` defaults to the RefJIT backend.
+
+  Can be used both as `@compile_function` and as
+  `@compile_function(backend=...)`.
+  """
+  if f is None:
+    return functools.partial(compile_function,
+                             backend=backend,
+                             target_factory=target_factory,
+                             cache=cache)
+  if backend is None:
+    from .backend import refjit
+    backend = refjit.CompilerBackend()
+  if cache is None:
+    cache = default_compile_cache
+  loaded_module = cache.get_or_compile(f, backend, target_factory)
+  return loaded_module[f.__name__]
@@ -182,6 +182,137 @@ class FunctionDefImporter(BaseNodeVisitor):
     basicpy_ops.ExecDiscardOp([expr.value], loc=ic.loc, ip=ic.ip)
     ic.pop_ip()
 
+  def visit_For(self, ast_node):
+    """Imports a `for <name> in range(...)` loop to an scf.while loop.
+
+    The loop carries the counter and the locals assigned in the body that
+    were assigned before the loop. The locals first assigned in the body (and
+    the loop variable) are unassigned after the loop.
+    """
+    fctx = self.fctx
+    ic = fctx.ic
+    env = fctx.environment
+    if ast_node.orelse:
+      fctx.abort("unsupported for loop with an else clause")
+    if not isinstance(ast_node.target, ast.Name):
+      fctx.abort("unsupported for loop target (expected a name)")
+    if any(isinstance(n, ast.Return) for n in ast.walk(ast_node)):
+      fctx.abort("unsupported return in a for loop")
+    start, stop, step = self._import_range(ast_node.iter)
+
+    # Split the locals assigned in the body into the loop-carried ones and
+    # the ones local to the loop.
+    stored_names = []
+    for n in ast.walk(ast_node):
+      if (isinstance(n, ast.Name) and isinstance(n.ctx, ast.Store) and
+          n.id != ast_node.target.id and n.id not in stored_names):
+        stored_names.append(n.id)
+    carried_refs = []
+    carried_values = []
+    local_refs = []
+    for name in stored_names:
+      name_ref = fctx.lookup_name(name)
+      pe_result = name_ref.load(env)
+      if pe_result.type == PartialEvalType.YIELDS_IR_VALUE:
+        carried_refs.append(name_ref)
+        carried_values.append(pe_result.yields)
+      else:
+        local_refs.append(name_ref)
+    target_ref = fctx.lookup_name(ast_node.target.id)
+
+    def cast_all(values):
+      return [
+          basicpy_ops.UnknownCastOp(ic.unknown_type, v, ip=ic.ip,
+                                    loc=ic.loc).result for v in values
+      ]
+
+    def store(name_ref, value):
+      try:
+        name_ref.store(env, value)
+      except NotImplementedError:
+        fctx.abort("Cannot assign to '{}': Store not supported".format(name_ref))
+
+    inits = cast_all([start] + carried_values)
+    while_op, before_block, after_block = ic.scf_WhileOp(
+        [ic.unknown_type] * len(inits), inits)
+
+    # Continue while the counter hasn't reached `stop`.
+    ic.push_ip(_ir.InsertionPoint(before_block))
+    counter = before_block.arguments[0]
+    compare_result = basicpy_ops.BinaryCompareOp(
+        ic.bool_type,
+        counter,
+        stop,
+        _ir.StringAttr.get("Lt" if step > 0 else "Gt", context=ic.context),
+        ip=ic.ip,
+        loc=ic.loc).result
+    condition_value = basicpy_ops.AsI1Op(ic.i1_type,
+                                         compare_result,
+                                         ip=ic.ip,
+                                         loc=ic.loc).result
+    ic.scf_ConditionOp(condition_value, list(before_block.arguments))
+    ic.pop_ip()
+
+    # Import the body and step the counter.
+    ic.push_ip(_ir.InsertionPoint(after_block))
+    store(target_ref, after_block.arguments[0])
+    for name_ref, arg in zip(carried_refs, list(after_block.arguments)[1:]):
+      store(name_ref, arg)
+    for ast_stmt in ast_node.body:
+      self.visit(ast_stmt)
+    fctx.update_loc(ast_node)
+    step_value = fctx.emit_const_value(step)
+    next_counter = basicpy_ops.BinaryExprOp(ic.unknown_type,
+                                            after_block.arguments[0],
+                                            step_value,
+                                            _ir.StringAttr.get(
+                                                "Add", context=ic.context),
+                                            ip=ic.ip,
+                                            loc=ic.loc).result
+    next_values = [
+        fctx.emit_partial_eval_result(name_ref.load(env))
+        for name_ref in carried_refs
+    ]
+    ic.scf_YieldOp(cast_all([next_counter] + next_values))
+    ic.pop_ip()
+
+    for name_ref, result in zip(carried_refs, list(while_op.results)[1:]):
+      store(name_ref, result)
+    for name_ref in [target_ref] + local_refs:
+      store(name_ref, None)
+
+  def _import_range(self, ast_node):
+    """Imports the bounds of a `range(...)` call with a constant step.
+
+    Returns:
+      (start value, stop value, step int)
+    """
+    fctx = self.fctx
+    if not isinstance(ast_node, ast.Call) or ast_node.keywords:
+      fctx.abort("unsupported for loop iterable (expected range(...))")
+    callee_importer = PartialEvalImporter(fctx)
+    callee_importer.visit(ast_node.func)
+    callee_result = callee_importer.partial_eval_result
+    if (not callee_result or
+        callee_result.type != PartialEvalType.YIELDS_LIVE_VALUE or
+        callee_result.yields.live_value is not range):
+      fctx.abort("unsupported for loop iterable (expected range(...))")
+    args = ast_node.args
+    if not 1 <= len(args) <= 3:
+      fctx.abort("range expects 1 to 3 arguments")
+    step = 1
+    if len(args) == 3:
+      step = _get_constant_int(args[2])
+      if not step:
+        fctx.abort("range step must be a nonzero integer literal")
+    expr = ExpressionImporter(fctx)
+    if len(args) == 1:
+      start = fctx.emit_const_value(0)
+    else:
+      start = expr.sub_evaluate(args[0])
+    stop = expr.sub_evaluate(args[-2 if len(args) == 3 else -1])
+    return start, stop, step
+
   def visit_Pass(self, ast_node):
     pass
 
@@ -195,6 +326,19 @@ class FunctionDefImporter(BaseNodeVisitor):
       self._last_was_return = True
 
 
+def _get_constant_int(ast_node):
+  """Returns the value of an integer literal (possibly negated), or None."""
+  if isinstance(ast_node, ast.UnaryOp) and isinstance(ast_node.op, ast.USub):
+    value = _get_constant_int(ast_node.operand)
+    return -value if value is not None else None
+  if not isinstance(ast_node, ast.Constant):
+    return None
+  value = ast_node.value
+  if isinstance(value, bool) or not isinstance(value, int):
+    return None
+  return value
+
+
 class ExpressionImporter(BaseNodeVisitor):
   """Imports expression nodes.
 
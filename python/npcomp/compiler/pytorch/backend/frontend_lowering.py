@@ -8,6 +8,7 @@ import torch
 
 from mlir.ir import *
 from mlir.passmanager import *
+from npcomp.compiler.generic.backend import refjit as refjit_backend
 from npcomp.compiler.utils import logging
 
 __all__ = [
@@ -32,17 +33,22 @@ def lower_module(imported_module: Module):
         if logging.debug_enabled():
             logging.debug("Running Torch->TCP pipeline '{}'", pipeline_str)
         pm = PassManager.parse(pipeline_str)
+        if refjit_backend.is_enabled():
+            refjit_backend.configure_pass_manager(context, pm)
         pm.run(imported_module)
         if logging.debug_enabled():
             logging.debug("TCP IR:\n{}", imported_module)
     return imported_module
 
-def lower_object_graph(imported_module: Module):
+def lower_object_graph(imported_module: Module, entry_points=None):
     """Lowers an imported module that has TorchScript object graph semantics.
 
     Args:
         imported_module: The MLIR module consisting of IR as imported by the
         torch_mlir.import_module. It is lowered in place.
+        entry_points: If not empty, the names of the methods that are called
+        (such as `["forward"]`). The other methods and exported attributes,
+        and the weights only they use, are deleted.
     Returns:
         The imported_module, for convenience chaining methods.
     """
@@ -52,9 +58,13 @@ def lower_object_graph(imported_module: Module):
 
         # Object graph lowering.
         pipeline_str = "torchscript-to-npcomp-backend-pipeline"
+        if entry_points:
+            pipeline_str += "{{entry-points={}}}".format(",".join(entry_points))
         if logging.debug_enabled():
             logging.debug(
                 "Running Torch object graph lowering pipeline '{}'", pipeline_str)
         pm = PassManager.parse(pipeline_str)
+        if refjit_backend.is_enabled():
+            refjit_backend.configure_pass_manager(context, pm)
         pm.run(imported_module)
     return imported_module
@@ -17,6 +17,8 @@ __all__ = [
 ]
 
 PREPARE_FOR_IREE_PASSES = (
+  # IREE can't map the weights stored outside of the module.
+  "npcomp-internalize-elements",
   "npcomp-iree-backend-lower-linkage",
 )
 
@@ -59,26 +61,34 @@ class TorchIreeModuleInvoker(IreeModuleInvoker):
 
 
 class CompilerBackend:
-  """Main entry-point for the backend."""
+  """Main entry-point for the backend.
 
-  def __init__(self):
+  `driver` is the IREE HAL driver that runs the compiled modules:
+    "dylib": the dispatches are executed asynchronously on IREE's
+      multi-threaded task system.
+    "dylib-sync": the dispatches are executed inline on the calling thread,
+      which is easier to debug.
+  Both run the same "dylib-llvm-aot" executables.
+  """
+
+  def __init__(self, driver: str = "dylib"):
     super().__init__()
     self._debug = logging.debug_enabled()
+    self._driver = driver
 
   def compile(self, imported_module: Module):
     """Compiles an imported module, with a flat list of functions.
-    The module is expected to be in "TCP + scalar code" form.
-    TODO: More clearly define the backend contract. Generally this will
-    extend to support globals, lists, and other stuff.
+    The module is expected to satisfy the npcomp backend contract (see
+    `VerifyBackendContract`), which IREE's compiler consumes directly.
 
     Args:
       imported_module: The MLIR module consisting of funcs in the torch
         dialect.
     Returns:
       An opaque, backend specific module object that can be passed to load.
-      The object may actually be something more specific to the backend (i.e.
-      for IREE, it is a serialized VM flatbuffer) but the contract is that
-      it is operated on by methods on this class.
+      For IREE, it is a serialized VM flatbuffer, which can be shared with
+      other processes, but the contract is that it is operated on by methods
+      on this class.
     """
     with imported_module.context as context:
       if self._debug:
@@ -97,12 +107,11 @@ class CompilerBackend:
       # Backend.
       binary = ireec.compile_str(str(imported_module),
                                  target_backends=["dylib-llvm-aot"])
-      iree_config = ireert.Config(driver_name="dylib")
-
-      iree_module = ireert.load_module(ireert.VmModule.from_flatbuffer(binary),
-                                       config=iree_config)
-    return iree_module
+    return binary
 
-  def load(self, iree_module) -> TorchIreeModuleInvoker:
+  def load(self, binary) -> TorchIreeModuleInvoker:
     """Loads a compiled artifact into the runtime."""
+    iree_config = ireert.Config(driver_name=self._driver)
+    iree_module = ireert.load_module(ireert.VmModule.from_flatbuffer(binary),
+                                     config=iree_config)
     return TorchIreeModuleInvoker(iree_module)
@@ -3,33 +3,69 @@
 #  SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
 
 import os
+from typing import Optional
 
+import numpy as np
 import torch
+import torch.utils.dlpack
 
 from mlir.ir import *
 from mlir.passmanager import *
 from npcomp.compiler.generic.backend import refjit as refjit_backend
+from npcomp.compiler.pytorch.backend.frontend_lowering import (
+    lower_object_graph)
 from npcomp.compiler.utils import logging
 
 __all__ = [
     "is_enabled",
     "CompilerBackend",
+    "RefreshableModule",
 ]
 
 # Re-export.
 is_enabled = refjit_backend.is_enabled
 
 
+def _to_input(arg):
+  if not isinstance(arg, torch.Tensor):
+    return arg
+  # Older versions of PyTorch can't export bool tensors with DLPack, but numpy
+  # views them without copies too.
+  if arg.dtype == torch.bool:
+    return arg.numpy()
+  return torch.utils.dlpack.to_dlpack(arg)
+
+
+def _to_torch(array: np.ndarray) -> torch.Tensor:
+  if array.dtype == np.bool_:
+    return torch.from_numpy(array)
+  return torch.utils.dlpack.from_dlpack(
+      refjit_backend.get_refjit().to_dlpack(array))
+
+
 class TorchJitModuleInvoker(refjit_backend.JitModuleInvoker):
-  """Allows torch.Tensor inputs to be passed to module invocations."""
+  """Allows torch.Tensor's to be passed to (and returned by) invocations.
+
+  torch.Tensor inputs are passed with DLPack, without copying them. With
+  `torch_outputs`, the results are torch.Tensor's viewing the outputs of the
+  module (except for its constants, which are copied), and numpy arrays
+  otherwise.
+  """
+
+  def __init__(self, jit_module, torch_outputs: bool = False):
+    super().__init__(jit_module)
+    self._torch_outputs = torch_outputs
 
   def __getitem__(self, function_name: str):
     numpy_invoke = super().__getitem__(function_name)
 
     def invoke(*args):
-      args = tuple(
-          arg.numpy() if isinstance(arg, torch.Tensor) else arg for arg in args)
-      return numpy_invoke(*args)
+      results = numpy_invoke(*(_to_input(arg) for arg in args))
+      if not self._torch_outputs:
+        return results
+      if isinstance(results, tuple):
+        return tuple(_to_torch(result) for result in results)
+      return _to_torch(results)
 
     return invoke
 
@@ -37,10 +73,41 @@ class TorchJitModuleInvoker(refjit_backend.JitModuleInvoker):
 class CompilerBackend:
   """Main entry-point for the backend."""
 
-  def __init__(self):
+  def __init__(self,
+               object_cache_dir: str = "",
+               profile_ops: bool = False,
+               cache: Optional[refjit_backend.CompiledModuleCache] = None,
+               shared_object_store=None):
+    """Creates a backend.
+
+    Args:
+      object_cache_dir: If not empty, the directory caching the object code
+        of the compiled modules across processes. Defaults to the object
+        cache directory of `cache`.
+      profile_ops: Whether the compiled code records the runtime's per-op
+        profile (see `get_op_profile` of the refjit module).
+      cache: The cache of the modules compiled by `compile`. Defaults to the
+        default cache of the refjit backend, if any.
+      shared_object_store: The store of object code shared with other
+        processes, or its location (see `open_shared_object_store` of the
+        refjit backend). Defaults to the default store, if any.
+    """
     super().__init__()
     self._refjit = refjit_backend.get_refjit()
     self._debug = logging.debug_enabled()
+    self._cache = cache if cache is not None else (
+        refjit_backend.get_default_cache())
+    if not object_cache_dir and self._cache is not None:
+      object_cache_dir = self._cache.object_cache_dir
+    self._object_cache_dir = object_cache_dir
+    self._shared_object_store = refjit_backend.get_shared_object_store(
+        shared_object_store)
+    self._profile_ops = profile_ops
+
+  @property
+  def cache_key(self):
+    """Options affecting the compiled code, for the compile cache."""
+    return (self._profile_ops,)
 
   def compile(self, imported_module: Module):
     """Compiles an imported module, with a flat list of functions.
@@ -56,6 +123,21 @@ class CompilerBackend:
       The object may actually be something more specific to the backend (i.e.
       for IREE, it is a serialized VM flatbuffer) but the contract is that
       it is operated on by methods on this class.
+
+    With a cache, `imported_module` is only lowered (in place) when it isn't
+    found in the cache.
+    """
+    if self._cache is not None:
+      return self._cache.get_or_compile(imported_module, self.cache_key,
+                                        self.lower, self.compile_lowered)
+    self.lower(imported_module)
+    return self.compile_lowered(imported_module)
+
+  def lower(self, imported_module: Module):
+    """Runs the RefBackend compiler on `imported_module` in place.
+
+    The resulting module can be saved as text and passed to `compile_lowered`
+    in lieu of calling `compile` on an identical imported module.
     """
     with imported_module.context as context:
       if self._debug:
@@ -64,17 +146,89 @@ class CompilerBackend:
       # Backend.
       # Note that this is a separate pass manager purely to aid in debugging.
       pm = PassManager()
-      self._refjit.build_backend_compilation_pipeline(pm)
+      self._refjit.build_backend_compilation_pipeline(
+          pm, profile_ops=self._profile_ops)
+      refjit_backend.configure_pass_manager(context, pm)
       pm.run(imported_module)
       if self._debug:
         logging.debug(
           "RefBackend input IR (this is what the RefBackend compiler sees):\n{}",
           imported_module)
 
+  def compile_lowered(self, lowered_module: Module):
+    """Compiles a module lowered by `lower` to a loadable artifact."""
     jit_module = self._refjit.JITModule.from_compiled_module(
-        imported_module, refjit_backend.get_runtime_libs())
+        lowered_module, refjit_backend.get_runtime_libs(),
+        object_cache_dir=self._object_cache_dir,
+        shared_object_store=self._shared_object_store)
     return jit_module
 
-  def load(self, jit_module) -> TorchJitModuleInvoker:
-    """Loads a compiled artifact into the runtime."""
-    return TorchJitModuleInvoker(jit_module)
+  def load(self,
+           jit_module,
+           torch_outputs: bool = False) -> TorchJitModuleInvoker:
+    """Loads a compiled artifact into the runtime.
+
+    With `torch_outputs`, the functions return torch.Tensor's instead of numpy
+    arrays.
+    """
+    return TorchJitModuleInvoker(jit_module, torch_outputs)
+
+
+class RefreshableModule:
+  """A TorchScript module compiled once, whose weights can be refreshed.
+
+  The weights of the module must be stored in an external file when it is
+  imported, by passing `external_weights_path` and
+  `external_weights_min_bytes=0` to `ModuleBuilder.import_module`, so that
+  the compiled code maps them from the file instead of embedding them.
+  `refresh` then takes a structurally identical module (the same code, and
+  tensors of the same types and shapes), such as the same model retrained,
+  imported with its weights stored in another file, and returns a JITModule
+  reading them. It skips the lowering of the module, and LLVM code generation
+  too if the backend has an object cache.
+
+  Tensors of types that can't be stored externally are part of the structure
+  of the module, so refreshing fails if they change.
+  """
+
+  def __init__(self, backend: CompilerBackend, imported_module: Module,
+               weights_path: str):
+    """Compiles a module as imported with its weights in `weights_path`.
+
+    `imported_module` is lowered in place.
+    """
+    super().__init__()
+    self._backend = backend
+    self._weights_path = os.path.realpath(weights_path)
+    self._structure = self._get_structure(imported_module, self._weights_path)
+    lower_object_graph(imported_module)
+    backend.lower(imported_module)
+    self._lowered_asm = str(imported_module)
+    self.jit_module = backend.compile_lowered(imported_module)
+
+  @staticmethod
+  def _get_structure(imported_module: Module, weights_path: str) -> str:
+    # External elements attributes are printed as the hex of their offset and
+    # path (see refback::getExternalElementsAttr), so leaving out the path
+    # leaves the layout of the weights in the file.
+    return str(imported_module).replace(
+        weights_path.encode().hex().upper(), "")
+
+  def refresh(self, imported_module: Module, weights_path: str):
+    """Returns a JITModule running with the weights of `imported_module`.
+
+    `imported_module` must be imported like the original module, with its
+    weights stored in `weights_path`. The previous JITModules keep using their
+    weights. Raises ValueError if the module isn't structurally identical to
+    the original one.
+    """
+    weights_path = os.path.realpath(weights_path)
+    if self._get_structure(imported_module, weights_path) != self._structure:
+      raise ValueError(
+          "the module isn't structurally identical to the compiled module")
+    refjit = refjit_backend.get_refjit()
+    lowered = Module.parse(self._lowered_asm, context=imported_module.context)
+    refjit.replace_external_weights_path(lowered, self._weights_path,
+                                         weights_path)
+    self.jit_module = self._backend.compile_lowered(lowered)
+    return self.jit_module
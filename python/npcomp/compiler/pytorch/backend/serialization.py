@@ -0,0 +1,73 @@
+#  Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+#  See https://llvm.org/LICENSE.txt for license information.
+#  SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+"""Saving and loading modules that satisfy the npcomp backend contract.
+
+A model can be imported and lowered to the backend contract once, saved, and
+then loaded by each process that compiles it, skipping the import,
+globalization and type refinement. The module is saved as MLIR text, with the
+elements of its large constants (its weights) stored in a separate binary
+file that is mapped rather than parsed when the module is compiled.
+"""
+
+from typing import Optional
+
+from mlir.ir import *
+from mlir.passmanager import *
+from npcomp import _cext
+
+__all__ = [
+    "save_backend_module",
+    "load_backend_module",
+]
+
+
+def save_backend_module(module: Module,
+                        path: str,
+                        weights_path: Optional[str] = None,
+                        weights_min_bytes: int = 1 << 20):
+  """Saves a module lowered to the backend contract.
+
+  The module is verified and its constants of at least `weights_min_bytes`
+  bytes are moved to `weights_path` in place (see
+  `npcomp-externalize-elements`); the module can still be compiled afterwards.
+
+  Args:
+    module: The module, as lowered by the
+      "torchscript-to-npcomp-backend-pipeline".
+    path: The file to save the module to.
+    weights_path: The file to store the weights in (`path` + ".weights" by
+      default). The module references it by this path, so the processes
+      loading the module must find it there (relative to their working
+      directory if the path is relative).
+    weights_min_bytes: The size in bytes of the smallest constants stored in
+      `weights_path`.
+  """
+  if weights_path is None:
+    weights_path = path + ".weights"
+  with module.context:
+    pm = PassManager.parse(
+        "npcomp-verify-backend-contract,"
+        f"npcomp-externalize-elements{{path={weights_path} "
+        f"min-bytes={weights_min_bytes}}}")
+    pm.run(module)
+  with open(path, "w") as f:
+    f.write(str(module))
+
+
+def load_backend_module(path: str, context: Optional[Context] = None) -> Module:
+  """Loads a module saved by `save_backend_module`.
+
+  The result can be passed to the `compile` method of the RefBackend and IREE
+  compiler backends.
+
+  Args:
+    path: The file the module was saved to.
+    context: The context to load the module in. A new context with the npcomp
+      dialects registered by default.
+  """
+  if context is None:
+    context = Context()
+    _cext.register_all_dialects(context)
+  with open(path) as f:
+    return Module.parse(f.read(), context=context)
@@ -160,6 +160,29 @@ class ImportContext:
     else:
       return op, _ir.InsertionPoint(then_block)
 
+  def scf_WhileOp(self, results, inits):
+    """Creates an SCF while op, whose regions take arguments of the types of
+    the results.
+
+    Returns:
+      (while_op, before_block, after_block)
+    """
+    op = _ir.Operation.create("scf.while",
+                              results=results,
+                              operands=inits,
+                              regions=2,
+                              loc=self.loc,
+                              ip=self.ip)
+    before_block = op.regions[0].blocks.append(*results)
+    after_block = op.regions[1].blocks.append(*results)
+    return op, before_block, after_block
+
+  def scf_ConditionOp(self, condition: _ir.Value, args):
+    return _ir.Operation.create("scf.condition",
+                                operands=[condition] + list(args),
+                                loc=self.loc,
+                                ip=self.ip)
+
   def scf_YieldOp(self, operands):
     return _ir.Operation.create("scf.yield",
                                 operands=operands,
@@ -0,0 +1,311 @@
+#  Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+#  See https://llvm.org/LICENSE.txt for license information.
+#  SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+"""Lazy evaluation of traced numpy expressions.
+
+Within a LazyTraceContext, the ufuncs applied to LazyArrays are not evaluated
+but accumulate into a graph. When a value is materialized (with `numpy()` or
+`np.asarray`), the graph computing it is compiled with RefJIT into a single
+function, in which the elementwise ops are fused, and invoked. The compiled
+function is cached by the structure of the graph and the dtypes and ranks of
+its inputs, so evaluating the same expression on new arrays only invokes it.
+"""
+
+from typing import Optional
+
+import numpy as np
+
+from .context import *
+
+__all__ = [
+    "LazyArray",
+    "LazyTraceContext",
+]
+
+# The ufuncs lowered by the numpy frontend of RefJIT, by qualified name.
+_LAZY_UFUNCS = {
+    np.add: "numpy.add",
+    np.multiply: "numpy.multiply",
+    np.maximum: "numpy.maximum",
+    np.exp: "numpy.exp",
+    np.tanh: "numpy.tanh",
+}
+
+# The dtypes the lazy ufuncs are compiled for.
+_LAZY_DTYPES = (np.dtype(np.float32),)
+
+# Maps the keys of graphs (see _Graph.key) to compiled functions.
+_compiled_graphs = {}
+
+
+class _Node:
+  """The application of a ufunc to LazyArrays."""
+  __slots__ = ["ufunc_name", "inputs"]
+
+  def __init__(self, ufunc_name, inputs):
+    self.ufunc_name = ufunc_name
+    self.inputs = inputs
+
+
+class _Graph:
+  """The graph of nodes computing a LazyArray from materialized ones.
+
+    >>> tc = LazyTraceContext()
+    >>> with tc:
+    ...   a = tc.array(np.ones((2, 3), np.float32))
+    ...   b = tc.array(np.ones(3, np.float32))
+    ...   c = np.tanh(a * b + a)
+    >>> g = _Graph(c)
+    >>> g.key
+    ((('<f4', 2), ('<f4', 1)), (('numpy.multiply', (0, 1)), ('numpy.add', (2, 0)), ('numpy.tanh', (3,))))
+    >>> print(g.get_mlir_asm())
+    func @lazy_graph(%arg0: tensor<?x?xf32>, %arg1: tensor<?xf32>) -> tensor<*xf32> {
+      %0 = numpy.builtin_ufunc_call<"numpy.multiply"> (%arg0, %arg1) : (tensor<?x?xf32>, tensor<?xf32>) -> tensor<*xf32>
+      %1 = numpy.builtin_ufunc_call<"numpy.add"> (%0, %arg0) : (tensor<*xf32>, tensor<?x?xf32>) -> tensor<*xf32>
+      %2 = numpy.builtin_ufunc_call<"numpy.tanh"> (%1) : (tensor<*xf32>) -> tensor<*xf32>
+      return %2 : tensor<*xf32>
+    }
+  """
+  __slots__ = ["leaves", "nodes", "dtype", "key"]
+
+  def __init__(self, root: "LazyArray"):
+    # Materialized arrays used by the graph.
+    self.leaves = []
+    # Nodes in topological order.
+    self.nodes = []
+    self.dtype = root.dtype
+    # Indices of the values of the graph: leaves first, then nodes.
+    indices = {}
+    leaf_keys = []
+    node_keys = []
+
+    def visit(array):
+      index = indices.get(id(array))
+      if index is not None:
+        return index
+      if array._node is None:
+        self.leaves.append(array._value)
+        leaf_keys.append((array._value.dtype.str, array._value.ndim))
+        # Leaves are numbered apart, so they are only known after the walk.
+        index = ("leaf", len(self.leaves) - 1)
+      else:
+        input_indices = tuple(visit(i) for i in array._node.inputs)
+        self.nodes.append(array._node)
+        node_keys.append((array._node.ufunc_name, input_indices))
+        index = ("node", len(self.nodes) - 1)
+      indices[id(array)] = index
+      return index
+
+    visit(root)
+    num_leaves = len(self.leaves)
+
+    def flatten(index):
+      kind, i = index
+      return i if kind == "leaf" else num_leaves + i
+
+    self.key = (tuple(leaf_keys),
+                tuple((name, tuple(flatten(i)
+                                   for i in inputs))
+                      for name, inputs in node_keys))
+
+  def get_mlir_asm(self) -> str:
+    """Returns a function computing the graph from its leaves."""
+    leaf_keys, node_keys = self.key
+    element_type = _get_mlir_element_type(self.dtype)
+    unranked_type = "tensor<*x%s>" % element_type
+    value_names = []
+    value_types = []
+    for i, (_, rank) in enumerate(leaf_keys):
+      value_names.append("%%arg%d" % i)
+      value_types.append("tensor<%s%s>" % ("?x" * rank, element_type))
+    lines = [
+        "func @lazy_graph(%s) -> %s {" % (", ".join(
+            "%s: %s" % arg for arg in zip(value_names, value_types)),
+                                          unranked_type)
+    ]
+    for i, (ufunc_name, inputs) in enumerate(node_keys):
+      lines.append(
+          "  %%%d = numpy.builtin_ufunc_call<\"%s\"> (%s) : (%s) -> %s" %
+          (i, ufunc_name, ", ".join(value_names[j] for j in inputs), ", ".join(
+              value_types[j] for j in inputs), unranked_type))
+      value_names.append("%%%d" % i)
+      value_types.append(unranked_type)
+    lines.append("  return %s : %s" % (value_names[-1], unranked_type))
+    lines.append("}")
+    return "\n".join(lines)
+
+
+def _get_mlir_element_type(dtype: np.dtype) -> str:
+  if dtype == np.float32:
+    return "f32"
+  raise TracingError("Unsupported dtype for lazy evaluation: %r" % dtype)
+
+
+def _broadcast_shapes(*shapes):
+  rank = max(len(s) for s in shapes)
+  result = []
+  for i in range(rank):
+    extents = set(s[i - rank + len(s)] for s in shapes if rank - i <= len(s))
+    extents.discard(1)
+    if len(extents) > 1:
+      raise ValueError("Shapes are not broadcastable: %r" % (shapes,))
+    result.append(extents.pop() if extents else 1)
+  return tuple(result)
+
+
+class LazyArray(TracedArray):
+  """An array computed by a graph of ufuncs that is evaluated on demand.
+
+  A LazyArray is either materialized (it holds an ndarray) or the result of a
+  ufunc on other LazyArrays.
+  """
+
+  def __init__(self,
+               tc: "LazyTraceContext",
+               value: Optional[np.ndarray] = None,
+               node: Optional[_Node] = None,
+               shape=None,
+               dtype=None):
+    super().__init__(tc)
+    self._value = value
+    self._node = node
+    self._shape = value.shape if value is not None else shape
+    self._dtype = value.dtype if value is not None else dtype
+
+  def __repr__(self):
+    return "<LazyArray %d%s>" % (self.uid,
+                                 "" if self.is_materialized else " (pending)")
+
+  @property
+  def is_materialized(self) -> bool:
+    return self._node is None
+
+  @property
+  def shape(self):
+    return self._shape
+
+  @property
+  def dtype(self):
+    return self._dtype
+
+  @property
+  def ndim(self):
+    return len(self._shape)
+
+  def numpy(self) -> np.ndarray:
+    """Evaluates the array if needed and returns its value."""
+    if self._node is not None:
+      self._value = self._tc._evaluate(self)
+      # Release the graph, which may reference large arrays.
+      self._node = None
+    return self._value
+
+  def __array__(self, dtype=None):
+    value = self.numpy()
+    return value if dtype is None else value.astype(dtype)
+
+
+class LazyTraceContext(TraceContext):
+  """Trace context deferring the evaluation of ufuncs on LazyArrays.
+
+  Ufuncs that RefJIT compiles (add, multiply, maximum, exp and tanh on float32
+  arrays) build graphs, which are compiled once per distinct structure and
+  input dtypes and ranks. Other ops materialize their inputs and run eagerly
+  with numpy.
+  """
+  __slots__ = [
+      "_backend",
+      "_compiled_graphs",
+      "compile_count",
+  ]
+
+  def __init__(self, backend=None, compiled_graphs=None, desc=None):
+    """Creates the context.
+
+    Args:
+      backend: The numpy RefJIT CompilerBackend compiling the graphs. Defaults
+        to an optimizing one.
+      compiled_graphs: The dict caching the compiled graphs. Defaults to one
+        shared by all contexts.
+    """
+    super().__init__(desc=desc)
+    self._backend = backend
+    self._compiled_graphs = (compiled_graphs
+                             if compiled_graphs is not None else
+                             _compiled_graphs)
+    self.compile_count = 0
+
+  def array(self, value) -> LazyArray:
+    """Wraps an array-like value into a materialized LazyArray."""
+    if isinstance(value, LazyArray):
+      return value
+    return LazyArray(self, value=np.asarray(value))
+
+  def _as_lazy_input(self, value, dtype):
+    if isinstance(value, LazyArray):
+      return value
+    if isinstance(value, (int, float)):
+      return self.array(np.asarray(value, dtype=dtype))
+    if isinstance(value, np.ndarray):
+      return self.array(value)
+    return None
+
+  def _handle_ufunc(self, ufunc, method, inputs, kwargs):
+    ufunc_name = _LAZY_UFUNCS.get(ufunc)
+    dtype = next(i.dtype for i in inputs if isinstance(i, LazyArray))
+    lazy_inputs = [self._as_lazy_input(i, dtype) for i in inputs]
+    if (ufunc_name is None or method != "__call__" or kwargs or
+        any(i is None or i.dtype != dtype for i in lazy_inputs) or
+        dtype not in _LAZY_DTYPES):
+      return self._evaluate_eagerly(ufunc, inputs, kwargs, method)
+    shape = _broadcast_shapes(*(i.shape for i in lazy_inputs))
+    return LazyArray(self,
+                     node=_Node(ufunc_name, lazy_inputs),
+                     shape=shape,
+                     dtype=dtype)
+
+  def _handle_array_func(self, func, types, inputs, kwargs):
+    return self._evaluate_eagerly(func, inputs, kwargs)
+
+  def _handle_array_getitem(self, array, key):
+    return self.array(array.numpy()[key])
+
+  def _evaluate_eagerly(self, func, inputs, kwargs, method="__call__"):
+    materialize = lambda v: v.numpy() if isinstance(v, LazyArray) else v
+    inputs = [materialize(i) for i in inputs]
+    if method != "__call__":
+      func = getattr(func, method)
+    result = func(*inputs, **kwargs)
+    if isinstance(result, tuple):
+      return tuple(self.array(r) for r in result)
+    return self.array(result) if isinstance(result, np.ndarray) else result
+
+  def _evaluate(self, array: LazyArray) -> np.ndarray:
+    graph = _Graph(array)
+    key = (graph.key, self._get_backend().cache_key)
+    compiled = self._compiled_graphs.get(key)
+    if compiled is None:
+      compiled = self._compile(graph)
+      self._compiled_graphs[key] = compiled
+    return compiled(*(np.ascontiguousarray(leaf) for leaf in graph.leaves))
+
+  def _get_backend(self):
+    if self._backend is None:
+      from ..compiler.numpy.backend import refjit
+      self._backend = refjit.CompilerBackend(optimize=True)
+    return self._backend
+
+  def _compile(self, graph: _Graph):
+    from mlir import ir as _ir
+    from npcomp import _cext
+    context = _ir.Context()
+    _cext.register_all_dialects(context)
+    module = _ir.Module.parse(graph.get_mlir_asm(), context=context)
+    backend = self._get_backend()
+    self.compile_count += 1
+    return backend.load(backend.compile(module))["lazy_graph"]
+
+
+if __name__ == "__main__":
+  import doctest
+  doctest.testmod()
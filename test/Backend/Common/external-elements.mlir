@@ -0,0 +1,26 @@
+// RUN: npcomp-opt -npcomp-externalize-elements="path=%t.bin min-bytes=16" %s | FileCheck %s
+// RUN: %PYTHON -c "import numpy as np; print(np.fromfile('%t.bin', dtype=np.float32)[:4].tolist())" | FileCheck %s --check-prefix=FILE
+// RUN: npcomp-opt -npcomp-externalize-elements="path=%t.bin min-bytes=16" -npcomp-internalize-elements %s | FileCheck %s --check-prefix=ROUNDTRIP
+
+// CHECK-LABEL: func @constants
+// Identical constants are stored once.
+// CHECK: %[[WEIGHT:.*]] = constant opaque<"refback", "0x[[DATA:[0-9A-F]+]]"> : tensor<4xf32>
+// CHECK: %[[TIED:.*]] = constant opaque<"refback", "0x[[DATA]]"> : tensor<4xf32>
+// CHECK: %[[MASK:.*]] = constant opaque<"refback", "0x{{[0-9A-F]+}}"> : tensor<16xi1>
+// CHECK: %[[SMALL:.*]] = constant dense<[1.000000e+00, 2.000000e+00]> : tensor<2xf32>
+// CHECK: %[[SPLAT:.*]] = constant dense<1.000000e+00> : tensor<8xf32>
+
+// FILE: [1.0, 2.0, 3.0, 4.0]
+
+// ROUNDTRIP-LABEL: func @constants
+// ROUNDTRIP: constant dense<[1.000000e+00, 2.000000e+00, 3.000000e+00, 4.000000e+00]> : tensor<4xf32>
+// ROUNDTRIP: constant dense<[1.000000e+00, 2.000000e+00, 3.000000e+00, 4.000000e+00]> : tensor<4xf32>
+// ROUNDTRIP: constant dense<[true, false, true, false, true, false, true, false, true, false, true, false, true, false, true, false]> : tensor<16xi1>
+func @constants() -> (tensor<4xf32>, tensor<4xf32>, tensor<16xi1>, tensor<2xf32>, tensor<8xf32>) {
+  %0 = constant dense<[1.0, 2.0, 3.0, 4.0]> : tensor<4xf32>
+  %1 = constant dense<[1.0, 2.0, 3.0, 4.0]> : tensor<4xf32>
+  %2 = constant dense<[true, false, true, false, true, false, true, false, true, false, true, false, true, false, true, false]> : tensor<16xi1>
+  %3 = constant dense<[1.0, 2.0]> : tensor<2xf32>
+  %4 = constant dense<1.0> : tensor<8xf32>
+  return %0, %1, %2, %3, %4 : tensor<4xf32>, tensor<4xf32>, tensor<16xi1>, tensor<2xf32>, tensor<8xf32>
+}
@@ -0,0 +1,58 @@
+// RUN: npcomp-opt -npcomp-split-pipeline-stages="function=forward num-stages=2" %s | FileCheck %s
+// RUN: npcomp-opt -npcomp-split-pipeline-stages="function=forward num-stages=2 stage=1" %s | FileCheck %s --check-prefix=STAGE1
+
+#map = affine_map<(d0, d1) -> (d0, d1)>
+
+// The first op uses all the weights, so it makes a stage of its own. The
+// second stage gets the argument used by its last op passed through.
+
+// CHECK-LABEL:   func @forward_stage0(
+// CHECK-SAME:                         %[[ARG:.*]]: tensor<2x4xf32>) -> (tensor<2x4xf32>, tensor<2x4xf32>)
+// CHECK-SAME:                         attributes {npcomp.pipeline_stage = 0 : i64} {
+// CHECK:           %[[WEIGHT:.*]] = constant dense<1.000000e+00> : tensor<2x4xf32>
+// CHECK:           %[[INIT:.*]] = linalg.init_tensor [2, 4] : tensor<2x4xf32>
+// CHECK:           %[[ADD:.*]] = linalg.generic {{.*}} ins(%[[ARG]], %[[WEIGHT]] : tensor<2x4xf32>, tensor<2x4xf32>) outs(%[[INIT]] : tensor<2x4xf32>)
+// CHECK:           return %[[ARG]], %[[ADD]] : tensor<2x4xf32>, tensor<2x4xf32>
+
+// CHECK-LABEL:   func @forward_stage1(
+// CHECK-SAME:                         %[[ARG:.*]]: tensor<2x4xf32>, %[[ADD:.*]]: tensor<2x4xf32>) -> tensor<2x4xf32>
+// CHECK-SAME:                         attributes {npcomp.pipeline_stage = 1 : i64} {
+// CHECK:           %[[INIT:.*]] = linalg.init_tensor [2, 4] : tensor<2x4xf32>
+// CHECK:           %[[MUL:.*]] = linalg.generic {{.*}} ins(%[[ADD]], %[[ADD]] : tensor<2x4xf32>, tensor<2x4xf32>) outs(%[[INIT]] : tensor<2x4xf32>)
+// CHECK:           %[[RESULT:.*]] = linalg.generic {{.*}} ins(%[[MUL]], %[[ARG]] : tensor<2x4xf32>, tensor<2x4xf32>) outs(%[[INIT]] : tensor<2x4xf32>)
+// CHECK:           return %[[RESULT]] : tensor<2x4xf32>
+
+// CHECK-LABEL:   func @forward(
+// CHECK-SAME:                  %[[ARG:.*]]: tensor<2x4xf32>) -> tensor<2x4xf32> {
+// CHECK:           %[[STAGE0:.*]]:2 = call @forward_stage0(%[[ARG]])
+// CHECK:           %[[STAGE1:.*]] = call @forward_stage1(%[[STAGE0]]#0, %[[STAGE0]]#1)
+// CHECK:           return %[[STAGE1]] : tensor<2x4xf32>
+
+// STAGE1-NOT:    func @forward(
+// STAGE1-NOT:    func @forward_stage0(
+// STAGE1:        func @forward_stage1(
+// STAGE1-NOT:    func @forward
+
+func @forward(%arg0: tensor<2x4xf32>) -> tensor<2x4xf32> {
+  %weight = constant dense<1.0> : tensor<2x4xf32>
+  %init = linalg.init_tensor [2, 4] : tensor<2x4xf32>
+  %0 = linalg.generic {indexing_maps = [#map, #map, #map], iterator_types = ["parallel", "parallel"]}
+      ins(%arg0, %weight : tensor<2x4xf32>, tensor<2x4xf32>) outs(%init : tensor<2x4xf32>) {
+  ^bb0(%a: f32, %b: f32, %c: f32):
+    %r = addf %a, %b : f32
+    linalg.yield %r : f32
+  } -> tensor<2x4xf32>
+  %1 = linalg.generic {indexing_maps = [#map, #map, #map], iterator_types = ["parallel", "parallel"]}
+      ins(%0, %0 : tensor<2x4xf32>, tensor<2x4xf32>) outs(%init : tensor<2x4xf32>) {
+  ^bb0(%a: f32, %b: f32, %c: f32):
+    %r = mulf %a, %b : f32
+    linalg.yield %r : f32
+  } -> tensor<2x4xf32>
+  %2 = linalg.generic {indexing_maps = [#map, #map, #map], iterator_types = ["parallel", "parallel"]}
+      ins(%1, %arg0 : tensor<2x4xf32>, tensor<2x4xf32>) outs(%init : tensor<2x4xf32>) {
+  ^bb0(%a: f32, %b: f32, %c: f32):
+    %r = addf %a, %b : f32
+    linalg.yield %r : f32
+  } -> tensor<2x4xf32>
+  return %2 : tensor<2x4xf32>
+}
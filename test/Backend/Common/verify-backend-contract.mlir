@@ -51,3 +51,47 @@ module {
     return %arg0 : tensor<?x!numpy.any_dtype>
   }
 }
+
+// -----
+
+// Mutable globals are read and written by copying through memrefs.
+
+// CHECK: memref.global "private" @param
+// CHECK: func @update
+module {
+  memref.global "private" @param : memref<3xf32> = dense<1.0>
+  func @update(%arg0: tensor<3xf32>) -> tensor<3xf32> {
+    %0 = memref.get_global @param : memref<3xf32>
+    %1 = memref.alloc() : memref<3xf32>
+    linalg.copy(%0, %1) : memref<3xf32>, memref<3xf32>
+    %2 = memref.tensor_load %1 : memref<3xf32>
+    %3 = memref.buffer_cast %arg0 : memref<3xf32>
+    linalg.copy(%3, %0) : memref<3xf32>, memref<3xf32>
+    return %2 : tensor<3xf32>
+  }
+}
+
+// -----
+
+// Casts that torch-finalizing-builtin-tensorize folds are rejected.
+
+// expected-error@+1 {{Module does not conform to npcomp's backend contract.}}
+module {
+  func @cast_chain(%arg0: tensor<2xf32>) -> tensor<?xf32> {
+    %0 = tensor.cast %arg0 : tensor<2xf32> to tensor<?xf32>
+    // expected-error@+1 {{failed to legalize operation 'tensor.cast'}}
+    %1 = tensor.cast %0 : tensor<?xf32> to tensor<?xf32>
+    return %1 : tensor<?xf32>
+  }
+}
+
+// -----
+
+// Casts refining or erasing static extents are allowed.
+
+// CHECK: func @refining_casts
+func @refining_casts(%arg0: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = tensor.cast %arg0 : tensor<?xf32> to tensor<2xf32>
+  %1 = tensor.cast %0 : tensor<2xf32> to tensor<?xf32>
+  return %1 : tensor<?xf32>
+}
@@ -0,0 +1,160 @@
+/*===- runtime.c - Test of the runtime C APIs -----------------------------===*\
+|*                                                                            *|
+|* Part of the LLVM Project, under the Apache License v2.0 with LLVM          *|
+|* Exceptions.                                                                *|
+|* See https://llvm.org/LICENSE.txt for license information.                  *|
+|* SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception                    *|
+|*                                                                            *|
+\*===----------------------------------------------------------------------===*/
+
+/* RUN: npcomp-capi-runtime-test %npcomp_runtime_shlib 2>&1 | FileCheck %s
+ */
+
+#include "mlir-c/IR.h"
+#include "mlir-c/Pass.h"
+#include "mlir-c/Registration.h"
+#include "npcomp-c/InitLLVM.h"
+#include "npcomp-c/Registration.h"
+#include "npcomp-c/Runtime.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char *kModuleSource =
+    "func @add(%arg0: tensor<?xf32>, %arg1: tensor<?xf32>) -> tensor<?xf32> {\n"
+    "  %0 = tcf.add %arg0, %arg1 : (tensor<?xf32>, tensor<?xf32>) -> "
+    "tensor<?xf32>\n"
+    "  return %0 : tensor<?xf32>\n"
+    "}\n";
+
+static void printTensor(NpcompRtTensor tensor) {
+  float *data = (float *)npcompRtTensorGetData(tensor);
+  fprintf(stderr, "[");
+  for (int64_t i = 0, e = npcompRtTensorGetExtent(tensor, 0); i < e; i++)
+    fprintf(stderr, "%s%.1f", i ? ", " : "", data[i]);
+  fprintf(stderr, "]\n");
+}
+
+// Compiles kModuleSource with the JIT.
+static NpcompRtModule compileModule(MlirContext ctx, const char *runtimeLib) {
+  MlirModule module =
+      mlirModuleCreateParse(ctx, mlirStringRefCreateFromCString(kModuleSource));
+  MlirPassManager pm = mlirPassManagerCreate(ctx);
+  npcompRtBuildBackendCompilationPipeline(pm, /*optimize=*/false);
+  NpcompRtModule rtModule = {NULL};
+  if (mlirLogicalResultIsSuccess(mlirPassManagerRun(pm, module))) {
+    MlirStringRef sharedLib = mlirStringRefCreateFromCString(runtimeLib);
+    rtModule = npcompRtModuleCreateFromCompiledModule(module, 1, &sharedLib);
+  }
+  mlirPassManagerDestroy(pm);
+  mlirModuleDestroy(module);
+  return rtModule;
+}
+
+static int testInvoke(NpcompRtModule module) {
+  fprintf(stderr, "@invoke\n");
+  NpcompRtFunction add =
+      npcompRtModuleLookupFunction(module, mlirStringRefCreateFromCString("add"));
+  if (npcompRtFunctionIsNull(add))
+    return 1;
+
+  MlirStringRef name = npcompRtFunctionGetName(add);
+  fprintf(stderr, "%.*s: %d inputs, %d outputs\n", (int)name.length, name.data,
+          (int)npcompRtFunctionGetNumInputs(add),
+          (int)npcompRtFunctionGetNumOutputs(add));
+  NpcompRtArgInfo info = npcompRtFunctionGetInputInfo(add, 0);
+  if (info.argType != NpcompRtArgTypeTensor ||
+      info.elementType != NpcompRtElementTypeF32)
+    return 2;
+  int64_t expectedExtent;
+  npcompRtFunctionGetInputExtents(add, 0, &expectedExtent);
+  fprintf(stderr, "input #0: rank %d, extent %d\n", (int)info.rank,
+          (int)expectedExtent);
+
+  int64_t extent = 4;
+  float lhsData[] = {1.0f, 2.0f, 3.0f, 4.0f};
+  float rhsData[] = {10.0f, 20.0f, 30.0f, 40.0f};
+  NpcompRtTensor inputs[2] = {
+      npcompRtTensorCreateBorrowing(NpcompRtElementTypeF32, 1, &extent, NULL,
+                                    lhsData),
+      npcompRtTensorCreateCopy(NpcompRtElementTypeF32, 1, &extent, rhsData)};
+
+  NpcompRtTensor output;
+  if (mlirLogicalResultIsFailure(
+          npcompRtFunctionInvoke(module, add, 2, inputs, 1, &output, NULL)))
+    return 3;
+  printTensor(output);
+  npcompRtTensorDestroy(output);
+
+  NpcompRtSchedule schedule = {NpcompRtPriorityHigh, 0};
+  NpcompRtInvocation invocation =
+      npcompRtFunctionInvokeAsync(module, add, 2, inputs, &schedule);
+  npcompRtTensorDestroy(inputs[0]);
+  npcompRtTensorDestroy(inputs[1]);
+  if (mlirLogicalResultIsFailure(
+          npcompRtInvocationWait(invocation, 1, &output)))
+    return 4;
+  npcompRtInvocationDestroy(invocation);
+  printTensor(output);
+  npcompRtTensorDestroy(output);
+  return 0;
+}
+
+static int testErrors(NpcompRtModule module) {
+  fprintf(stderr, "@errors\n");
+  NpcompRtFunction missing = npcompRtModuleLookupFunction(
+      module, mlirStringRefCreateFromCString("missing"));
+  if (!npcompRtFunctionIsNull(missing))
+    return 1;
+  fprintf(stderr, "%s\n", npcompRtGetLastErrorMessage());
+
+  NpcompRtFunction add =
+      npcompRtModuleLookupFunction(module, mlirStringRefCreateFromCString("add"));
+  NpcompRtTensor output;
+  if (mlirLogicalResultIsSuccess(
+          npcompRtFunctionInvoke(module, add, 0, NULL, 1, &output, NULL)))
+    return 2;
+  fprintf(stderr, "%s\n", npcompRtGetLastErrorMessage());
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <runtime shared library>\n", argv[0]);
+    return 1;
+  }
+  npcompInitializeLLVMCodegen();
+  MlirContext ctx = mlirContextCreate();
+  mlirRegisterAllDialects(ctx);
+  npcompRegisterAllDialects(ctx);
+
+  NpcompRtModule module = compileModule(ctx, argv[1]);
+  if (npcompRtModuleIsNull(module)) {
+    fprintf(stderr, "error: %s\n", npcompRtGetLastErrorMessage());
+    return 1;
+  }
+
+  // clang-format off
+  // CHECK-LABEL: @invoke
+  // CHECK: add: 2 inputs, 1 outputs
+  // CHECK: input #0: rank 1, extent -1
+  // CHECK: [11.0, 22.0, 33.0, 44.0]
+  // CHECK: [11.0, 22.0, 33.0, 44.0]
+  // CHECK: 0
+  // clang-format on
+  int errcode = testInvoke(module);
+  fprintf(stderr, "%d\n", errcode);
+
+  // clang-format off
+  // CHECK-LABEL: @errors
+  // CHECK: unknown function: missing
+  // CHECK: invoking 'add': expected 2 inputs
+  // CHECK: 0
+  // clang-format on
+  errcode = testErrors(module);
+  fprintf(stderr, "%d\n", errcode);
+
+  npcompRtModuleDestroy(module);
+  mlirContextDestroy(ctx);
+  return 0;
+}
@@ -23,3 +23,46 @@ func @numpyAdd(%arg0: tensor<?xf32>, %arg1: tensor<?x?xf32>) -> tensor<*xf32> {
   %0 = numpy.builtin_ufunc_call<"numpy.add"> (%arg0, %arg1) : (tensor<?xf32>, tensor<?x?xf32>) -> tensor<*xf32>
   return %0 : tensor<*xf32>
 }
+
+// CHECK-LABEL: func @numpyMultiplyMaximum
+func @numpyMultiplyMaximum(%arg0: tensor<?xf32>, %arg1: tensor<?x?xf32>) -> tensor<*xf32> {
+  // CHECK: %[[MUL:.*]] = tcf.mul %arg0, %arg1 : (tensor<?xf32>, tensor<?x?xf32>) -> tensor<*xf32>
+  // CHECK: tcf.max %[[MUL]], %arg0 : (tensor<*xf32>, tensor<?xf32>) -> tensor<*xf32>
+  %0 = numpy.builtin_ufunc_call<"numpy.multiply"> (%arg0, %arg1) : (tensor<?xf32>, tensor<?x?xf32>) -> tensor<*xf32>
+  %1 = numpy.builtin_ufunc_call<"numpy.maximum"> (%0, %arg0) : (tensor<*xf32>, tensor<?xf32>) -> tensor<*xf32>
+  return %1 : tensor<*xf32>
+}
+
+// CHECK-LABEL: func @numpyUnary
+func @numpyUnary(%arg0: tensor<?xf32>) -> tensor<*xf32> {
+  // CHECK: %[[EXP:.*]] = tcf.exp %arg0 : tensor<?xf32>
+  // CHECK: %[[TANH:.*]] = tcf.tanh %[[EXP]] : tensor<?xf32>
+  // CHECK: tensor.cast %[[TANH]] : tensor<?xf32> to tensor<*xf32>
+  %0 = numpy.builtin_ufunc_call<"numpy.exp"> (%arg0) : (tensor<?xf32>) -> tensor<?xf32>
+  %1 = numpy.builtin_ufunc_call<"numpy.tanh"> (%0) : (tensor<?xf32>) -> tensor<*xf32>
+  return %1 : tensor<*xf32>
+}
+
+// CHECK-LABEL: func @numpyTranspose
+func @numpyTranspose(%arg0: tensor<2x?x8xf32>, %arg1: tensor<*xf32>) -> (tensor<*xf32>, tensor<*xf32>) {
+  // CHECK: %[[TRANSPOSE:.*]] = tcf.transpose %arg0 {permutation = [2, 1, 0]} : (tensor<2x?x8xf32>) -> tensor<8x?x2xf32>
+  // CHECK: tensor.cast %[[TRANSPOSE]] : tensor<8x?x2xf32> to tensor<*xf32>
+  // CHECK: numpy.transpose %arg1
+  %0 = numpy.transpose %arg0 : (tensor<2x?x8xf32>) -> tensor<*xf32>
+  %1 = numpy.transpose %arg1 : (tensor<*xf32>) -> tensor<*xf32>
+  return %0, %1 : tensor<*xf32>, tensor<*xf32>
+}
+
+// CHECK-LABEL: func @numpyDot
+func @numpyDot(%arg0: tensor<?x?xf32>, %arg1: tensor<?xf32>) -> (tensor<*xf32>, tensor<*xf32>, tensor<*xf32>, tensor<*xf32>) {
+  // CHECK: tcf.matmul %arg0, %arg0 : (tensor<?x?xf32>, tensor<?x?xf32>) -> tensor<?x?xf32>
+  // CHECK: tcf.dot %arg0, %arg1 : (tensor<?x?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  // CHECK: tcf.dot %arg1, %arg0 : (tensor<?xf32>, tensor<?x?xf32>) -> tensor<?xf32>
+  // CHECK: %[[DOT:.*]] = tcf.dot %arg1, %arg1 : (tensor<?xf32>, tensor<?xf32>) -> tensor<f32>
+  // CHECK: tensor.cast %[[DOT]] : tensor<f32> to tensor<*xf32>
+  %0 = numpy.dot %arg0, %arg0 : (tensor<?x?xf32>, tensor<?x?xf32>) -> tensor<*xf32>
+  %1 = numpy.dot %arg0, %arg1 : (tensor<?x?xf32>, tensor<?xf32>) -> tensor<*xf32>
+  %2 = numpy.dot %arg1, %arg0 : (tensor<?xf32>, tensor<?x?xf32>) -> tensor<*xf32>
+  %3 = numpy.dot %arg1, %arg1 : (tensor<?xf32>, tensor<?xf32>) -> tensor<*xf32>
+  return %0, %1, %2, %3 : tensor<*xf32>, tensor<*xf32>, tensor<*xf32>, tensor<*xf32>
+}
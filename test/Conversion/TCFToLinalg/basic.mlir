@@ -1,5 +1,15 @@
 // RUN: npcomp-opt <%s -convert-tcf-to-linalg | FileCheck %s --dump-input=fail
 
+// The indexing maps of the reductions below.
+// CHECK-DAG:     #[[ID:.*]] = affine_map<(d0, d1) -> (d0, d1)>
+// CHECK-DAG:     #[[REDUCED:.*]] = affine_map<(d0, d1) -> (d0, 0)>
+// CHECK-DAG:     #[[CHUNKED:.*]] = affine_map<(d0, d1, d2, d3) -> (d0, d1 * 512 + d2 * 16 + d3)>
+// CHECK-DAG:     #[[ROW:.*]] = affine_map<(d0, d1, d2, d3) -> (d2)>
+// CHECK-DAG:     #[[PARTIAL:.*]] = affine_map<(d0, d1, d2, d3) -> (d0, d1, d3)>
+// CHECK-DAG:     #[[PARTIAL_ID:.*]] = affine_map<(d0, d1, d2) -> (d0, d1, d2)>
+// CHECK-DAG:     #[[PARTIAL_REDUCED:.*]] = affine_map<(d0, d1, d2) -> (d0, 0)>
+// CHECK-DAG:     #[[PERMUTED:.*]] = affine_map<(d0, d1, d2) -> (d1, d2, d0)>
+
 // CHECK-LABEL:   func @tcf_matmul(
 // CHECK-SAME:                     %[[LHS:.*]]: tensor<?x?xf32>,
 // CHECK-SAME:                     %[[RHS:.*]]: tensor<?x?xf32>) -> tensor<?x?xf32> {
@@ -70,3 +80,143 @@ func @tcf_conv_2d_nchw(%arg0: tensor<?x?x?x?xf32>, %arg1: tensor<?x?x?x?xf32>) -
   %0 = tcf.conv_2d_nchw %arg0, %arg1 : (tensor<?x?x?x?xf32>, tensor<?x?x?x?xf32>) -> tensor<?x?x?x?xf32>
   return %0 : tensor<?x?x?x?xf32>
 }
+
+// CHECK-LABEL:   func @tcf_reduce_sum(
+// CHECK-SAME:                         %[[OPERAND:.*]]: tensor<?x?xf32>) -> tensor<?x1xf32> {
+// CHECK:           %[[ZERO:.*]] = constant 0.000000e+00 : f32
+// CHECK:           %[[INIT:.*]] = linalg.init_tensor [%{{.*}}, 1] : tensor<?x1xf32>
+// CHECK:           %[[FILL:.*]] = linalg.fill(%[[INIT]], %[[ZERO]])
+// CHECK:           %[[SUM:.*]] = linalg.generic {indexing_maps = [#[[ID]], #[[REDUCED]]], iterator_types = ["parallel", "reduction"]} ins(%[[OPERAND]] : tensor<?x?xf32>) outs(%[[FILL]] : tensor<?x1xf32>)
+// CHECK:           ^bb0(%[[ELEMENT:.*]]: f32, %[[ACC:.*]]: f32):
+// CHECK:             %[[ADD:.*]] = addf %[[ACC]], %[[ELEMENT]] : f32
+// CHECK:             linalg.yield %[[ADD]] : f32
+// CHECK:           return %[[SUM]] : tensor<?x1xf32>
+func @tcf_reduce_sum(%arg0: tensor<?x?xf32>) -> tensor<?x1xf32> {
+  %0 = tcf.reduce_sum %arg0 {dim = 1 : i64} : (tensor<?x?xf32>) -> tensor<?x1xf32>
+  return %0 : tensor<?x1xf32>
+}
+
+// Large reductions are split into 16 chunks of 16 lanes, which are reduced in
+// parallel, and then reduced together.
+
+// CHECK-LABEL:   func @tcf_reduce_max_split(
+// CHECK-SAME:                               %[[OPERAND:.*]]: tensor<?x8192xf32>) -> tensor<?x1xf32> {
+// CHECK:           %[[LOWEST:.*]] = constant 0xFF800000 : f32
+// CHECK:           %[[FILL:.*]] = linalg.fill(%{{.*}}, %[[LOWEST]]) : tensor<?x1xf32>, f32
+// CHECK:           %[[PARTIAL_FILL:.*]] = linalg.fill(%{{.*}}, %[[LOWEST]]) : tensor<?x16x16xf32>, f32
+// CHECK:           %[[ROWS:.*]] = linalg.init_tensor [32] : tensor<32xf32>
+// CHECK:           %[[PARTIALS:.*]] = linalg.generic {indexing_maps = [#[[CHUNKED]], #[[ROW]], #[[PARTIAL]]], iterator_types = ["parallel", "parallel", "reduction", "parallel"]} ins(%[[OPERAND]], %[[ROWS]] : tensor<?x8192xf32>, tensor<32xf32>) outs(%[[PARTIAL_FILL]] : tensor<?x16x16xf32>)
+// CHECK:             cmpf ogt
+// CHECK:             select
+// CHECK:           %[[MAX:.*]] = linalg.generic {indexing_maps = [#[[PARTIAL_ID]], #[[PARTIAL_REDUCED]]], iterator_types = ["parallel", "reduction", "reduction"]} ins(%[[PARTIALS]] : tensor<?x16x16xf32>) outs(%[[FILL]] : tensor<?x1xf32>)
+// CHECK:           return %[[MAX]] : tensor<?x1xf32>
+func @tcf_reduce_max_split(%arg0: tensor<?x8192xf32>) -> tensor<?x1xf32> {
+  %0 = tcf.reduce_max %arg0 {dim = 1 : i64} : (tensor<?x8192xf32>) -> tensor<?x1xf32>
+  return %0 : tensor<?x1xf32>
+}
+
+// CHECK-LABEL:   func @tcf_softmax(
+// CHECK:           %[[MAX:.*]] = linalg.generic {{.*}}["parallel", "reduction"]
+// CHECK:           %[[EXP:.*]] = linalg.generic {{.*}}["parallel", "parallel"]} ins(%{{.*}}, %[[MAX]] : tensor<?x?xf32>, tensor<?x1xf32>)
+// CHECK:             subf
+// CHECK:             math.exp
+// CHECK:           %[[SUM:.*]] = linalg.generic {{.*}}["parallel", "reduction"]} ins(%[[EXP]] : tensor<?x?xf32>)
+// CHECK:           %[[SOFTMAX:.*]] = linalg.generic {{.*}}["parallel", "parallel"]} ins(%[[EXP]], %[[SUM]] : tensor<?x?xf32>, tensor<?x1xf32>)
+// CHECK:             divf
+// CHECK:           return %[[SOFTMAX]]
+func @tcf_softmax(%arg0: tensor<?x?xf32>) -> tensor<?x?xf32> {
+  %0 = tcf.softmax %arg0 {dim = 1 : i64} : tensor<?x?xf32>
+  return %0 : tensor<?x?xf32>
+}
+
+// CHECK-LABEL:   func @tcf_batch_matmul(
+// CHECK-SAME:                           %[[LHS:.*]]: tensor<?x?x?xf32>,
+// CHECK-SAME:                           %[[RHS:.*]]: tensor<?x?x?xf32>) -> tensor<?x?x?xf32> {
+// CHECK:           shape.cstr_require %{{.*}}, "mismatching batch dimension for batch_matmul"
+// CHECK:           shape.cstr_require %{{.*}}, "mismatching contracting dimension for batch_matmul"
+// CHECK:           %[[WITNESS:.*]] = shape.assuming_all
+// CHECK:           %[[RET:.*]] = shape.assuming %[[WITNESS]] -> (tensor<?x?x?xf32>) {
+// CHECK:             %[[INIT_TENSOR:.*]] = tcp.splatted
+// CHECK:             %[[MATMUL:.*]] = linalg.batch_matmul ins(%[[LHS]], %[[RHS]] : tensor<?x?x?xf32>, tensor<?x?x?xf32>) outs(%[[INIT_TENSOR]] : tensor<?x?x?xf32>)  -> tensor<?x?x?xf32>
+// CHECK:             shape.assuming_yield %[[MATMUL]] : tensor<?x?x?xf32>
+// CHECK:           return %[[RET]] : tensor<?x?x?xf32>
+func @tcf_batch_matmul(%arg0: tensor<?x?x?xf32>, %arg1: tensor<?x?x?xf32>) -> tensor<?x?x?xf32> {
+  %0 = tcf.batch_matmul %arg0, %arg1 : (tensor<?x?x?xf32>, tensor<?x?x?xf32>) -> tensor<?x?x?xf32>
+  return %0 : tensor<?x?x?xf32>
+}
+
+// CHECK-LABEL:   func @tcf_transpose(
+// CHECK-SAME:                        %[[OPERAND:.*]]: tensor<2x?x8xf32>) -> tensor<8x2x?xf32> {
+// CHECK:           %[[C1:.*]] = constant 1 : index
+// CHECK:           %[[DIM:.*]] = memref.dim %[[OPERAND]], %[[C1]] : tensor<2x?x8xf32>
+// CHECK:           %[[INIT:.*]] = linalg.init_tensor [8, 2, %[[DIM]]] : tensor<8x2x?xf32>
+// CHECK:           %[[TRANSPOSE:.*]] = linalg.generic {indexing_maps = [#[[PERMUTED]], #[[PARTIAL_ID]]], iterator_types = ["parallel", "parallel", "parallel"]} ins(%[[OPERAND]] : tensor<2x?x8xf32>) outs(%[[INIT]] : tensor<8x2x?xf32>)
+// CHECK:           return %[[TRANSPOSE]] : tensor<8x2x?xf32>
+func @tcf_transpose(%arg0: tensor<2x?x8xf32>) -> tensor<8x2x?xf32> {
+  %0 = tcf.transpose %arg0 {permutation = [2, 0, 1]} : (tensor<2x?x8xf32>) -> tensor<8x2x?xf32>
+  return %0 : tensor<8x2x?xf32>
+}
+
+// CHECK-LABEL:   func @tcf_dot_matvec(
+// CHECK-SAME:                         %[[LHS:.*]]: tensor<?x?xf32>,
+// CHECK-SAME:                         %[[RHS:.*]]: tensor<?xf32>) -> tensor<?xf32> {
+// CHECK:           shape.cstr_require %{{.*}}, "mismatching contracting dimension for dot"
+// CHECK:             %[[FILL:.*]] = linalg.fill(%{{.*}}, %{{.*}}) : tensor<?xf32>, f32
+// CHECK:             %[[MATVEC:.*]] = linalg.matvec ins(%[[LHS]], %[[RHS]] : tensor<?x?xf32>, tensor<?xf32>) outs(%[[FILL]] : tensor<?xf32>)
+// CHECK:             shape.assuming_yield %[[MATVEC]] : tensor<?xf32>
+func @tcf_dot_matvec(%arg0: tensor<?x?xf32>, %arg1: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = tcf.dot %arg0, %arg1 : (tensor<?x?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  return %0 : tensor<?xf32>
+}
+
+// CHECK-LABEL:   func @tcf_dot_vecmat(
+// CHECK:             linalg.vecmat ins(%{{.*}}, %{{.*}} : tensor<?xf32>, tensor<?x?xf32>) outs(%{{.*}} : tensor<?xf32>)
+func @tcf_dot_vecmat(%arg0: tensor<?xf32>, %arg1: tensor<?x?xf32>) -> tensor<?xf32> {
+  %0 = tcf.dot %arg0, %arg1 : (tensor<?xf32>, tensor<?x?xf32>) -> tensor<?xf32>
+  return %0 : tensor<?xf32>
+}
+
+// Large dot products of vectors are split into vectorizable partial sums of
+// products, like reductions.
+
+// CHECK-LABEL:   func @tcf_dot_split(
+// CHECK-SAME:                        %[[LHS:.*]]: tensor<8192xf32>,
+// CHECK-SAME:                        %[[RHS:.*]]: tensor<8192xf32>) -> tensor<f32> {
+// CHECK:             %[[PARTIALS:.*]] = linalg.generic {{.*}} ins(%[[LHS]], %[[RHS]], %{{.*}} : tensor<8192xf32>, tensor<8192xf32>, tensor<32xf32>) outs(%{{.*}} : tensor<16x16xf32>)
+// CHECK:               mulf
+// CHECK:               addf
+// CHECK:             %[[SUM:.*]] = linalg.generic {{.*}} ins(%[[PARTIALS]] : tensor<16x16xf32>) outs(%{{.*}} : tensor<1xf32>)
+// CHECK:             %[[DOT:.*]] = linalg.generic {{.*}} ins(%[[SUM]] : tensor<1xf32>) outs(%{{.*}} : tensor<f32>)
+// CHECK:             shape.assuming_yield %[[DOT]] : tensor<f32>
+func @tcf_dot_split(%arg0: tensor<8192xf32>, %arg1: tensor<8192xf32>) -> tensor<f32> {
+  %0 = tcf.dot %arg0, %arg1 : (tensor<8192xf32>, tensor<8192xf32>) -> tensor<f32>
+  return %0 : tensor<f32>
+}
+
+// The keys are processed in blocks of 64, so that only the [B, S, 64] scores
+// of a block are materialized.
+
+// CHECK-LABEL:   func @tcf_attention(
+// CHECK-SAME:                        %[[QUERY:[a-zA-Z0-9]+]]: tensor<?x?x?xf32>,
+// CHECK-SAME:                        %[[KEY:[a-zA-Z0-9]+]]: tensor<?x?x?xf32>,
+// CHECK-SAME:                        %[[VALUE:[a-zA-Z0-9]+]]: tensor<?x?x?xf32>) -> tensor<?x?x?xf32> {
+// CHECK-COUNT-4:   shape.cstr_require
+// CHECK:           shape.assuming
+// CHECK:             %[[LOOP:.*]]:3 = scf.for %{{.*}} = %{{.*}} to %{{.*}} step %{{.*}} iter_args({{.*}}) -> (tensor<?x?x1xf32>, tensor<?x?x1xf32>, tensor<?x?x?xf32>) {
+// CHECK:               %[[SCORES:.*]] = linalg.generic {{.*}}["parallel", "parallel", "parallel", "reduction"]} ins(%[[QUERY]] : tensor<?x?x?xf32>) outs(%{{.*}} : tensor<?x?x64xf32>)
+// CHECK:                 linalg.index 2
+// CHECK:                 tensor.extract %[[KEY]]
+// CHECK:               linalg.generic {{.*}} ins(%[[SCORES]] : tensor<?x?x64xf32>)
+// CHECK:                 select
+// CHECK:               math.exp
+// CHECK:               math.exp
+// CHECK:               %[[ACC:.*]] = linalg.generic {{.*}}["parallel", "parallel", "parallel", "reduction"]} ins(%{{.*}} : tensor<?x?x64xf32>) outs(%{{.*}} : tensor<?x?x?xf32>)
+// CHECK:                 linalg.index 3
+// CHECK:                 tensor.extract %[[VALUE]]
+// CHECK:               scf.yield %{{.*}}, %{{.*}}, %[[ACC]] : tensor<?x?x1xf32>, tensor<?x?x1xf32>, tensor<?x?x?xf32>
+// CHECK:             linalg.generic {{.*}} ins(%[[LOOP]]#2, %[[LOOP]]#1 : tensor<?x?x?xf32>, tensor<?x?x1xf32>)
+// CHECK:               divf
+func @tcf_attention(%arg0: tensor<?x?x?xf32>, %arg1: tensor<?x?x?xf32>, %arg2: tensor<?x?x?xf32>) -> tensor<?x?x?xf32> {
+  %0 = tcf.attention %arg0, %arg1, %arg2 {scale = 0.125 : f32} : (tensor<?x?x?xf32>, tensor<?x?x?xf32>, tensor<?x?x?xf32>) -> tensor<?x?x?xf32>
+  return %0 : tensor<?x?x?xf32>
+}
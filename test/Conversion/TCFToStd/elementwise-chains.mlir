@@ -0,0 +1,60 @@
+// RUN: npcomp-opt <%s -convert-tcf-to-std | FileCheck %s
+
+// The chain is lowered into a single shape.assuming region, which broadcasts
+// each of its operands once.
+
+// CHECK-LABEL:   func @tanh_of_mul_add(
+// CHECK-SAME:            %[[A:.*]]: tensor<?x?xf32>, %[[B:.*]]: tensor<?xf32>,
+// CHECK-SAME:            %[[C:.*]]: tensor<?x?xf32>) -> tensor<?x?xf32> {
+// CHECK:           %[[ASHAPE:.*]] = shape.shape_of %[[A]]
+// CHECK:           %[[BSHAPE:.*]] = shape.shape_of %[[B]]
+// CHECK:           %[[CSHAPE:.*]] = shape.shape_of %[[C]]
+// CHECK:           %[[WITNESS:.*]] = shape.cstr_broadcastable %[[ASHAPE]], %[[BSHAPE]], %[[CSHAPE]]
+// CHECK:           %[[RET:.*]] = shape.assuming %[[WITNESS]] -> (tensor<?x?xf32>) {
+// CHECK:             %[[SHAPE:.*]] = shape.broadcast %[[ASHAPE]], %[[BSHAPE]], %[[CSHAPE]]
+// CHECK:             %[[ABCAST:.*]] = tcp.broadcast_to %[[A]], %[[SHAPE]]
+// CHECK:             %[[BBCAST:.*]] = tcp.broadcast_to %[[B]], %[[SHAPE]]
+// CHECK:             %[[CBCAST:.*]] = tcp.broadcast_to %[[C]], %[[SHAPE]]
+// CHECK:             %[[MUL:.*]] = mulf %[[ABCAST]], %[[BBCAST]] : tensor<?x?xf32>
+// CHECK:             %[[ADD:.*]] = addf %[[MUL]], %[[CBCAST]] : tensor<?x?xf32>
+// CHECK:             %[[TANH:.*]] = math.tanh %[[ADD]] : tensor<?x?xf32>
+// CHECK:             shape.assuming_yield %[[TANH]] : tensor<?x?xf32>
+// CHECK:           }
+// CHECK-NOT:       shape.assuming
+// CHECK:           return %[[RET]] : tensor<?x?xf32>
+func @tanh_of_mul_add(%arg0: tensor<?x?xf32>, %arg1: tensor<?xf32>, %arg2: tensor<?x?xf32>) -> tensor<?x?xf32> {
+  %0 = tcf.mul %arg0, %arg1 : (tensor<?x?xf32>, tensor<?xf32>) -> tensor<?x?xf32>
+  %1 = tcf.add %0, %arg2 : (tensor<?x?xf32>, tensor<?x?xf32>) -> tensor<?x?xf32>
+  %2 = tcf.tanh %1 : tensor<?x?xf32>
+  return %2 : tensor<?x?xf32>
+}
+
+// An op whose result has other uses ends a chain.
+
+// CHECK-LABEL:   func @shared_intermediate(
+// CHECK:           %[[MUL:.*]] = shape.assuming
+// CHECK:             mulf
+// CHECK:           shape.assuming
+// CHECK:             addf
+// CHECK:             math.exp
+// CHECK:           return
+func @shared_intermediate(%arg0: tensor<?xf32>, %arg1: tensor<?xf32>) -> (tensor<?xf32>, tensor<?xf32>) {
+  %0 = tcf.mul %arg0, %arg1 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  %1 = tcf.add %0, %arg0 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  %2 = tcf.exp %1 : tensor<?xf32>
+  return %0, %2 : tensor<?xf32>, tensor<?xf32>
+}
+
+// A chain on a single operand needs no broadcasting.
+
+// CHECK-LABEL:   func @single_operand(
+// CHECK-SAME:            %[[ARG:.*]]: tensor<?xf32>) -> tensor<?xf32> {
+// CHECK-NOT:       shape.assuming
+// CHECK:           %[[MUL:.*]] = mulf %[[ARG]], %[[ARG]] : tensor<?xf32>
+// CHECK:           %[[MAX:.*]] = select %{{.*}}, %[[MUL]], %[[ARG]] : tensor<?xi1>, tensor<?xf32>
+// CHECK:           return %[[MAX]] : tensor<?xf32>
+func @single_operand(%arg0: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = tcf.mul %arg0, %arg0 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  %1 = tcf.max %0, %arg0 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  return %1 : tensor<?xf32>
+}
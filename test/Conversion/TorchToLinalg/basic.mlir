@@ -27,6 +27,47 @@ func @torch.aten.mm$basic(%arg0: !torch.vtensor<[?,?],f32>, %arg1: !torch.vtenso
   return %0 : !torch.vtensor<[?,2],f32>
 }
 
+// Static sizes of the operands are kept in the types of the linalg ops.
+// CHECK-LABEL:   func @torch.aten.mm$static(
+// CHECK:           %[[INIT_TENSOR:.*]] = linalg.init_tensor [2, 4] : tensor<2x4xf32>
+// CHECK:           %[[ZEROFILL:.*]] = linalg.fill(%[[INIT_TENSOR]], %{{.*}}) : tensor<2x4xf32>, f32 -> tensor<2x4xf32>
+// CHECK:           linalg.matmul ins(%{{.*}}, %{{.*}} : tensor<2x3xf32>, tensor<3x4xf32>) outs(%[[ZEROFILL]] : tensor<2x4xf32>) -> tensor<2x4xf32>
+func @torch.aten.mm$static(%arg0: !torch.vtensor<[2,3],f32>, %arg1: !torch.vtensor<[3,4],f32>) -> !torch.vtensor<[2,4],f32> {
+  %0 = torch.aten.mm %arg0, %arg1 : !torch.vtensor<[2,3],f32>, !torch.vtensor<[3,4],f32> -> !torch.vtensor<[2,4],f32>
+  return %0 : !torch.vtensor<[2,4],f32>
+}
+
+// CHECK-LABEL:   func @torch.aten.bmm(
+// CHECK:           assert %{{.*}}, "mismatching contracting dimension for torch.aten.bmm"
+// CHECK:           assert %{{.*}}, "mismatching batch dimension for torch.aten.bmm"
+// CHECK:           %[[INIT_TENSOR:.*]] = linalg.init_tensor [8, %{{.*}}, 4] : tensor<8x?x4xf32>
+// CHECK:           %[[ZEROFILL:.*]] = linalg.fill(%[[INIT_TENSOR]], %{{.*}}) : tensor<8x?x4xf32>, f32 -> tensor<8x?x4xf32>
+// CHECK:           linalg.batch_matmul ins(%{{.*}}, %{{.*}} : tensor<8x?x3xf32>, tensor<8x3x4xf32>) outs(%[[ZEROFILL]] : tensor<8x?x4xf32>) -> tensor<8x?x4xf32>
+func @torch.aten.bmm(%arg0: !torch.vtensor<[8,?,3],f32>, %arg1: !torch.vtensor<[8,3,4],f32>) -> !torch.vtensor<[8,?,4],f32> {
+  %0 = torch.aten.bmm %arg0, %arg1 : !torch.vtensor<[8,?,3],f32>, !torch.vtensor<[8,3,4],f32> -> !torch.vtensor<[8,?,4],f32>
+  return %0 : !torch.vtensor<[8,?,4],f32>
+}
+
+// A matrix multiplying a batch of matrices is read by all of them, instead of
+// being broadcast to a batch.
+// CHECK-LABEL:   func @torch.aten.matmul$broadcast(
+// CHECK:           assert %{{.*}}, "mismatching contracting dimension for torch.aten.matmul"
+// CHECK-NOT:       assert
+// CHECK:           linalg.generic {indexing_maps = [#{{.*}}, #{{.*}}, #{{.*}}], iterator_types = ["parallel", "parallel", "parallel", "reduction"]} ins(%{{.*}}, %{{.*}} : tensor<8x?x3xf32>, tensor<3x4xf32>) outs(%{{.*}} : tensor<8x?x4xf32>)
+// CHECK:             mulf
+// CHECK:             addf
+func @torch.aten.matmul$broadcast(%arg0: !torch.vtensor<[8,?,3],f32>, %arg1: !torch.vtensor<[3,4],f32>) -> !torch.vtensor<[8,?,4],f32> {
+  %0 = torch.aten.matmul %arg0, %arg1 : !torch.vtensor<[8,?,3],f32>, !torch.vtensor<[3,4],f32> -> !torch.vtensor<[8,?,4],f32>
+  return %0 : !torch.vtensor<[8,?,4],f32>
+}
+
+// CHECK-LABEL:   func @torch.aten.matmul$2d(
+// CHECK:           linalg.matmul
+func @torch.aten.matmul$2d(%arg0: !torch.vtensor<[2,3],f32>, %arg1: !torch.vtensor<[3,4],f32>) -> !torch.vtensor<[2,4],f32> {
+  %0 = torch.aten.matmul %arg0, %arg1 : !torch.vtensor<[2,3],f32>, !torch.vtensor<[3,4],f32> -> !torch.vtensor<[2,4],f32>
+  return %0 : !torch.vtensor<[2,4],f32>
+}
+
 // Unary op example.
 // CHECK-LABEL:   func @torch.aten.tanh(
 // CHECK-SAME:                          %[[ARG_VTENSOR:.*]]: !torch.vtensor<[?,?],f32>) -> !torch.vtensor<[?,?],f32> {
@@ -45,6 +86,58 @@ func @torch.aten.tanh(%arg0: !torch.vtensor<[?,?],f32>) -> !torch.vtensor<[?,?],
 
 // -----
 
+// Broadcasting is expressed in the indexing maps, without materializing the
+// broadcast operands. Dimensions of static size 1 are indexed with 0, and
+// missing leading dimensions are not indexed.
+// CHECK-DAG:     #[[MAP_LHS:.*]] = affine_map<(d0, d1, d2) -> (d0, d1, d2)>
+// CHECK-DAG:     #[[MAP_RHS:.*]] = affine_map<(d0, d1, d2) -> (0, d2)>
+// CHECK-LABEL:   func @torch.aten.add.Tensor$broadcast(
+// CHECK:           %[[LHS:.*]] = torch.to_builtin_tensor %{{.*}} : !torch.vtensor<[?,?,?],f32> -> tensor<?x?x?xf32>
+// CHECK:           %[[RHS:.*]] = torch.to_builtin_tensor %{{.*}} : !torch.vtensor<[1,?],f32> -> tensor<1x?xf32>
+// CHECK:           %[[ALPHA:.*]] = sitofp %{{.*}} : i64 to f32
+// CHECK:           %[[RHS_DIM:.*]] = memref.dim %[[RHS]], %{{.*}} : tensor<1x?xf32>
+// CHECK:           %[[LHS_DIM:.*]] = memref.dim %[[LHS]], %{{.*}} : tensor<?x?x?xf32>
+// CHECK:           %[[EQ:.*]] = cmpi eq, %[[RHS_DIM]], %[[LHS_DIM]] : index
+// CHECK:           assert %[[EQ]], "mismatching sizes in elementwise op (only static sizes of 1 are broadcast)"
+// CHECK:           %[[ADD:.*]] = linalg.generic {indexing_maps = [#[[MAP_LHS]], #[[MAP_RHS]], #[[MAP_LHS]]], iterator_types = ["parallel", "parallel", "parallel"]} ins(%[[LHS]], %[[RHS]] : tensor<?x?x?xf32>, tensor<1x?xf32>) outs(%[[LHS]] : tensor<?x?x?xf32>) {
+// CHECK:           ^bb0(%[[L:.*]]: f32, %[[R:.*]]: f32, %{{.*}}: f32):
+// CHECK:             %[[SCALED:.*]] = mulf %[[R]], %[[ALPHA]] : f32
+// CHECK:             %[[SUM:.*]] = addf %[[L]], %[[SCALED]] : f32
+// CHECK:             linalg.yield %[[SUM]] : f32
+// CHECK:           } -> tensor<?x?x?xf32>
+func @torch.aten.add.Tensor$broadcast(%arg0: !torch.vtensor<[?,?,?],f32>, %arg1: !torch.vtensor<[1,?],f32>) -> !torch.vtensor<[?,?,?],f32> {
+  %c2_i64 = constant 2 : i64
+  %0 = torch.aten.add.Tensor %arg0, %arg1, %c2_i64 : !torch.vtensor<[?,?,?],f32>, !torch.vtensor<[1,?],f32>, i64 -> !torch.vtensor<[?,?,?],f32>
+  return %0 : !torch.vtensor<[?,?,?],f32>
+}
+
+// -----
+
+// An init tensor is created when no operand has the type of the result.
+// CHECK-LABEL:   func @torch.aten.gt.Tensor(
+// CHECK:           %[[INIT:.*]] = linalg.init_tensor [4, 3] : tensor<4x3xi1>
+// CHECK:           linalg.generic {{.*}} ins(%{{.*}}, %{{.*}} : tensor<4x1xf32>, tensor<3xf32>) outs(%[[INIT]] : tensor<4x3xi1>)
+// CHECK:             cmpf ogt, %{{.*}}, %{{.*}} : f32
+func @torch.aten.gt.Tensor(%arg0: !torch.vtensor<[4,1],f32>, %arg1: !torch.vtensor<[3],f32>) -> !torch.vtensor<[4,3],i1> {
+  %0 = torch.aten.gt.Tensor %arg0, %arg1 : !torch.vtensor<[4,1],f32>, !torch.vtensor<[3],f32> -> !torch.vtensor<[4,3],i1>
+  return %0 : !torch.vtensor<[4,3],i1>
+}
+
+// -----
+
+// CHECK-LABEL:   func @torch.aten.maximum(
+// CHECK:           linalg.generic
+// CHECK:             %[[SELECT_SELF:.*]] = cmpf ugt, %[[SELF:.*]], %[[OTHER:.*]] : f32
+// CHECK:             %[[MAX:.*]] = select %[[SELECT_SELF]], %[[SELF]], %[[OTHER]] : f32
+// CHECK:             %[[OTHER_IS_NAN:.*]] = cmpf uno, %[[OTHER]], %[[OTHER]] : f32
+// CHECK:             select %[[OTHER_IS_NAN]], %[[OTHER]], %[[MAX]] : f32
+func @torch.aten.maximum(%arg0: !torch.vtensor<[?],f32>, %arg1: !torch.vtensor<[?],f32>) -> !torch.vtensor<[?],f32> {
+  %0 = torch.aten.maximum %arg0, %arg1 : !torch.vtensor<[?],f32>, !torch.vtensor<[?],f32> -> !torch.vtensor<[?],f32>
+  return %0 : !torch.vtensor<[?],f32>
+}
+
+// -----
+
 // If the operands are missing dtype, we cannot lower it.
 func @torch.aten.mm$no_convert$missing_dtype(%arg0: !torch.vtensor, %arg1: !torch.vtensor) -> !torch.vtensor {
   // expected-error@+1 {{failed to legalize}}
@@ -70,3 +163,382 @@ func @torch.aten.mm$no_convert$result_missing_dtype(%arg0: !torch.vtensor<[?,?],
   %0 = torch.aten.mm %arg0, %arg1 : !torch.vtensor<[?,?],f32>, !torch.vtensor<[?,?],f32> -> !torch.vtensor
   return %0 : !torch.vtensor
 }
+
+// -----
+
+// CHECK-LABEL:   func @torch.aten.conv2d(
+// CHECK:           assert %{{.*}}, "mismatching input channels for aten.conv2d"
+// CHECK:           assert %{{.*}}, "mismatching bias size for aten.conv2d"
+// CHECK:           %[[PADDED:.*]] = linalg.pad_tensor %{{.*}} low[0, 0, 1, 1] high[0, 0, 1, 1]
+// CHECK:           } : tensor<2x3x8x8xf32> to tensor<2x3x10x10xf32>
+// CHECK:           %[[INIT:.*]] = linalg.init_tensor [2, 16, 4, 4] : tensor<2x16x4x4xf32>
+// CHECK:           %[[BIAS:.*]] = linalg.generic {{.*}} ins(%{{.*}} : tensor<16xf32>) outs(%[[INIT]] : tensor<2x16x4x4xf32>)
+// CHECK:           %[[CONV:.*]] = linalg.generic {{.*}}iterator_types = ["parallel", "parallel", "parallel", "parallel", "reduction", "reduction", "reduction"]} ins(%[[PADDED]], %{{.*}} : tensor<2x3x10x10xf32>, tensor<16x3x3x3xf32>) outs(%[[BIAS]] : tensor<2x16x4x4xf32>)
+// CHECK:             mulf
+// CHECK:             addf
+// CHECK:           tensor.cast %[[CONV]] : tensor<2x16x4x4xf32> to tensor<2x16x4x4xf32>
+func @torch.aten.conv2d(%arg0: !torch.vtensor<[2,3,8,8],f32>, %arg1: !torch.vtensor<[16,3,3,3],f32>, %arg2: !torch.vtensor<[16],f32>) -> !torch.vtensor<[2,16,4,4],f32> {
+  %c1_i64 = constant 1 : i64
+  %c2_i64 = constant 2 : i64
+  %0 = torch.prim.ListConstruct %c2_i64, %c2_i64 : (i64, i64) -> !torch.list<i64>
+  %1 = torch.prim.ListConstruct %c1_i64, %c1_i64 : (i64, i64) -> !torch.list<i64>
+  %2 = torch.prim.ListConstruct %c1_i64, %c1_i64 : (i64, i64) -> !torch.list<i64>
+  %3 = torch.aten.conv2d %arg0, %arg1, %arg2, %0, %1, %2, %c1_i64 : !torch.vtensor<[2,3,8,8],f32>, !torch.vtensor<[16,3,3,3],f32>, !torch.vtensor<[16],f32>, !torch.list<i64>, !torch.list<i64>, !torch.list<i64>, i64 -> !torch.vtensor<[2,16,4,4],f32>
+  return %3 : !torch.vtensor<[2,16,4,4],f32>
+}
+
+// -----
+
+// Each filter of a depthwise convolution only reads the window of its own
+// channel, so there is no reduction over the channels.
+// CHECK-DAG:     #[[INPUT_MAP:.*]] = affine_map<(d0, d1, d2, d3, d4, d5) -> (d0, d1, d2 + d4, d3 + d5)>
+// CHECK-DAG:     #[[WEIGHT_MAP:.*]] = affine_map<(d0, d1, d2, d3, d4, d5) -> (d1, 0, d4, d5)>
+// CHECK-LABEL:   func @torch.aten.conv2d$depthwise(
+// CHECK:           %[[CHANNELS:.*]] = constant 8 : index
+// CHECK:           cmpi eq, %{{.*}}, %[[CHANNELS]] : index
+// CHECK:           assert %{{.*}}, "mismatching input channels for aten.conv2d"
+// CHECK:           linalg.generic {indexing_maps = [#[[INPUT_MAP]], #[[WEIGHT_MAP]], #{{.*}}], iterator_types = ["parallel", "parallel", "parallel", "parallel", "reduction", "reduction"]} ins(%{{.*}}, %{{.*}} : tensor<?x8x10x10xf32>, tensor<8x1x3x3xf32>) outs(%{{.*}} : tensor<?x8x8x8xf32>)
+func @torch.aten.conv2d$depthwise(%arg0: !torch.vtensor<[?,8,10,10],f32>, %arg1: !torch.vtensor<[8,1,3,3],f32>) -> !torch.vtensor<[?,8,8,8],f32> {
+  %c0_i64 = constant 0 : i64
+  %c1_i64 = constant 1 : i64
+  %c8_i64 = constant 8 : i64
+  %none = basicpy.singleton : !basicpy.NoneType
+  %0 = torch.prim.ListConstruct %c1_i64, %c1_i64 : (i64, i64) -> !torch.list<i64>
+  %1 = torch.prim.ListConstruct %c0_i64, %c0_i64 : (i64, i64) -> !torch.list<i64>
+  %2 = torch.aten.conv2d %arg0, %arg1, %none, %0, %1, %0, %c8_i64 : !torch.vtensor<[?,8,10,10],f32>, !torch.vtensor<[8,1,3,3],f32>, !basicpy.NoneType, !torch.list<i64>, !torch.list<i64>, !torch.list<i64>, i64 -> !torch.vtensor<[?,8,8,8],f32>
+  return %2 : !torch.vtensor<[?,8,8,8],f32>
+}
+
+// -----
+
+// The 3 filters of each of the 2 groups read the 2 input channels of their
+// group.
+// CHECK:         #[[INPUT_MAP:.*]] = affine_map<(d0, d1, d2, d3, d4, d5, d6) -> (d0, (d1 floordiv 3) * 2 + d4, d2 + d5, d3 + d6)>
+// CHECK-LABEL:   func @torch.aten.conv2d$grouped(
+// CHECK:           linalg.generic {indexing_maps = [#[[INPUT_MAP]], {{.*}}iterator_types = ["parallel", "parallel", "parallel", "parallel", "reduction", "reduction", "reduction"]} ins(%{{.*}}, %{{.*}} : tensor<1x4x5x5xf32>, tensor<6x2x3x3xf32>) outs(%{{.*}} : tensor<1x6x3x3xf32>)
+func @torch.aten.conv2d$grouped(%arg0: !torch.vtensor<[1,4,5,5],f32>, %arg1: !torch.vtensor<[6,2,3,3],f32>) -> !torch.vtensor<[1,6,3,3],f32> {
+  %c0_i64 = constant 0 : i64
+  %c1_i64 = constant 1 : i64
+  %c2_i64 = constant 2 : i64
+  %none = basicpy.singleton : !basicpy.NoneType
+  %0 = torch.prim.ListConstruct %c1_i64, %c1_i64 : (i64, i64) -> !torch.list<i64>
+  %1 = torch.prim.ListConstruct %c0_i64, %c0_i64 : (i64, i64) -> !torch.list<i64>
+  %2 = torch.aten.conv2d %arg0, %arg1, %none, %0, %1, %0, %c2_i64 : !torch.vtensor<[1,4,5,5],f32>, !torch.vtensor<[6,2,3,3],f32>, !basicpy.NoneType, !torch.list<i64>, !torch.list<i64>, !torch.list<i64>, i64 -> !torch.vtensor<[1,6,3,3],f32>
+  return %2 : !torch.vtensor<[1,6,3,3],f32>
+}
+
+// -----
+
+// CHECK-LABEL:   func @torch.aten.max_pool2d(
+// CHECK:           %[[NEG_INF:.*]] = constant 0xFF800000 : f32
+// CHECK:           %[[PADDED:.*]] = linalg.pad_tensor %{{.*}} low[0, 0, 1, 1] high[0, 0, 1, 1]
+// CHECK:             linalg.yield %[[NEG_INF]] : f32
+// CHECK:           %[[INIT:.*]] = linalg.init_tensor [%{{.*}}, 3, 4, 4] : tensor<?x3x4x4xf32>
+// CHECK:           %[[FILL:.*]] = linalg.fill(%[[INIT]], %[[NEG_INF]])
+// CHECK:           %[[WINDOW:.*]] = linalg.init_tensor [3, 3] : tensor<3x3xf32>
+// CHECK:           linalg.generic {{.*}} ins(%[[PADDED]], %[[WINDOW]] : tensor<?x3x10x10xf32>, tensor<3x3xf32>) outs(%[[FILL]] : tensor<?x3x4x4xf32>)
+// CHECK:             cmpf ugt
+// CHECK:             cmpf uno
+func @torch.aten.max_pool2d(%arg0: !torch.vtensor<[?,3,8,8],f32>) -> !torch.vtensor<[?,3,4,4],f32> {
+  %c1_i64 = constant 1 : i64
+  %c2_i64 = constant 2 : i64
+  %c3_i64 = constant 3 : i64
+  %false = basicpy.bool_constant false
+  %0 = torch.prim.ListConstruct %c3_i64, %c3_i64 : (i64, i64) -> !torch.list<i64>
+  %1 = torch.prim.ListConstruct %c2_i64, %c2_i64 : (i64, i64) -> !torch.list<i64>
+  %2 = torch.prim.ListConstruct %c1_i64, %c1_i64 : (i64, i64) -> !torch.list<i64>
+  %3 = torch.prim.ListConstruct %c1_i64, %c1_i64 : (i64, i64) -> !torch.list<i64>
+  %4 = torch.aten.max_pool2d %arg0, %0, %1, %2, %3, %false : !torch.vtensor<[?,3,8,8],f32>, !torch.list<i64>, !torch.list<i64>, !torch.list<i64>, !torch.list<i64>, !basicpy.BoolType -> !torch.vtensor<[?,3,4,4],f32>
+  return %4 : !torch.vtensor<[?,3,4,4],f32>
+}
+
+// -----
+
+// Global average pooling, with a dynamic window size.
+// CHECK-LABEL:   func @torch.aten.adaptive_avg_pool2d(
+// CHECK:           %[[WINDOW_SIZE:.*]] = muli
+// CHECK:           %[[COUNT:.*]] = sitofp %{{.*}} : i64 to f32
+// CHECK:           %[[SCALE:.*]] = divf %{{.*}}, %[[COUNT]] : f32
+// CHECK:           %[[INIT:.*]] = linalg.init_tensor [%{{.*}}, %{{.*}}, 1, 1] : tensor<?x?x1x1xf32>
+// CHECK:           %[[FILL:.*]] = linalg.fill(%[[INIT]]
+// CHECK:           %[[WINDOW:.*]] = linalg.init_tensor [%{{.*}}, %{{.*}}] : tensor<?x?xf32>
+// CHECK:           linalg.generic {{.*}} ins(%{{.*}}, %[[WINDOW]] : tensor<?x?x?x?xf32>, tensor<?x?xf32>) outs(%[[FILL]] : tensor<?x?x1x1xf32>)
+// CHECK:             %[[SCALED:.*]] = mulf %{{.*}}, %[[SCALE]] : f32
+func @torch.aten.adaptive_avg_pool2d(%arg0: !torch.vtensor<[?,?,?,?],f32>) -> !torch.vtensor<[?,?,1,1],f32> {
+  %c1_i64 = constant 1 : i64
+  %0 = torch.prim.ListConstruct %c1_i64, %c1_i64 : (i64, i64) -> !torch.list<i64>
+  %1 = torch.aten.adaptive_avg_pool2d %arg0, %0 : !torch.vtensor<[?,?,?,?],f32>, !torch.list<i64> -> !torch.vtensor<[?,?,1,1],f32>
+  return %1 : !torch.vtensor<[?,?,1,1],f32>
+}
+
+// -----
+
+// CHECK-LABEL:   func @torch.aten.batch_norm(
+// CHECK:           assert %{{.*}}, "mismatching number of channels for aten.batch_norm"
+// CHECK:           %[[EPS:.*]] = fptrunc %{{.*}} : f64 to f32
+// CHECK:           linalg.generic {{.*}} ins(%{{.*}}, %{{.*}}, %{{.*}}, %{{.*}}, %{{.*}} : tensor<?x4x?x?xf32>, tensor<4xf32>, tensor<4xf32>, tensor<4xf32>, tensor<4xf32>)
+// CHECK:             addf %{{.*}}, %[[EPS]] : f32
+// CHECK:             math.sqrt
+func @torch.aten.batch_norm(%arg0: !torch.vtensor<[?,4,?,?],f32>, %arg1: !torch.vtensor<[4],f32>, %arg2: !torch.vtensor<[4],f32>, %arg3: !torch.vtensor<[4],f32>, %arg4: !torch.vtensor<[4],f32>) -> !torch.vtensor<[?,4,?,?],f32> {
+  %false = basicpy.bool_constant false
+  %momentum = constant 1.000000e-01 : f64
+  %eps = constant 1.000000e-05 : f64
+  %0 = torch.aten.batch_norm %arg0, %arg1, %arg2, %arg3, %arg4, %false, %momentum, %eps, %false : !torch.vtensor<[?,4,?,?],f32>, !torch.vtensor<[4],f32>, !torch.vtensor<[4],f32>, !torch.vtensor<[4],f32>, !torch.vtensor<[4],f32>, !basicpy.BoolType, f64, f64, !basicpy.BoolType -> !torch.vtensor<[?,4,?,?],f32>
+  return %0 : !torch.vtensor<[?,4,?,?],f32>
+}
+
+// -----
+
+// The mean and variance are computed in a single pass, and the normalization
+// and the affine transform in a second one.
+// CHECK-LABEL:   func @torch.aten.layer_norm(
+// CHECK:           assert %{{.*}}, "mismatching normalized_shape for aten.layer_norm"
+// CHECK:           %[[STATS:.*]]:3 = linalg.generic {{.*}}iterator_types = ["parallel", "reduction"]} ins(%{{.*}} : tensor<?x8xf32>) outs(%{{.*}}, %{{.*}}, %{{.*}} : tensor<?xf32>, tensor<?xf32>, tensor<?xf32>)
+// CHECK:           %[[INV_STD:.*]] = linalg.generic {{.*}} ins(%[[STATS]]#0, %[[STATS]]#2 : tensor<?xf32>, tensor<?xf32>)
+// CHECK:             math.sqrt
+// CHECK:           linalg.generic {{.*}} ins(%{{.*}}, %[[STATS]]#1, %[[INV_STD]], %{{.*}}, %{{.*}} : tensor<?x8xf32>, tensor<?xf32>, tensor<?xf32>, tensor<8xf32>, tensor<8xf32>)
+// CHECK:             mulf
+// CHECK:             mulf
+// CHECK:             addf
+func @torch.aten.layer_norm(%arg0: !torch.vtensor<[?,8],f32>, %arg1: !torch.vtensor<[8],f32>, %arg2: !torch.vtensor<[8],f32>) -> !torch.vtensor<[?,8],f32> {
+  %true = basicpy.bool_constant true
+  %c8_i64 = constant 8 : i64
+  %eps = constant 1.000000e-05 : f64
+  %0 = torch.prim.ListConstruct %c8_i64 : (i64) -> !torch.list<i64>
+  %1 = torch.aten.layer_norm %arg0, %0, %arg1, %arg2, %eps, %true : !torch.vtensor<[?,8],f32>, !torch.list<i64>, !torch.vtensor<[8],f32>, !torch.vtensor<[8],f32>, f64, !basicpy.BoolType -> !torch.vtensor<[?,8],f32>
+  return %1 : !torch.vtensor<[?,8],f32>
+}
+
+// -----
+
+// Each group of 2 channels shares its statistics.
+// CHECK:         #[[STATS_MAP:.*]] = affine_map<(d0, d1, d2) -> (d0, d1 floordiv 2)>
+// CHECK-LABEL:   func @torch.aten.group_norm(
+// CHECK:           %[[STATS:.*]]:3 = linalg.generic {indexing_maps = [#{{.*}}, #[[STATS_MAP]], #[[STATS_MAP]], #[[STATS_MAP]]], iterator_types = ["parallel", "reduction", "reduction"]} ins(%{{.*}} : tensor<?x4x?xf32>) outs(%{{.*}}, %{{.*}}, %{{.*}} : tensor<?x2xf32>, tensor<?x2xf32>, tensor<?x2xf32>)
+// CHECK:           linalg.generic {{.*}} ins(%[[STATS]]#0, %[[STATS]]#2 : tensor<?x2xf32>, tensor<?x2xf32>)
+// CHECK:           linalg.generic {{.*}} ins(%{{.*}}, %[[STATS]]#1, %{{.*}} : tensor<?x4x?xf32>, tensor<?x2xf32>, tensor<?x2xf32>)
+// CHECK-NOT:         addf
+// CHECK:             linalg.yield
+func @torch.aten.group_norm(%arg0: !torch.vtensor<[?,4,?],f32>) -> !torch.vtensor<[?,4,?],f32> {
+  %true = basicpy.bool_constant true
+  %c2_i64 = constant 2 : i64
+  %eps = constant 1.000000e-05 : f64
+  %none = basicpy.singleton : !basicpy.NoneType
+  %0 = torch.aten.group_norm %arg0, %c2_i64, %none, %none, %eps, %true : !torch.vtensor<[?,4,?],f32>, i64, !basicpy.NoneType, !basicpy.NoneType, f64, !basicpy.BoolType -> !torch.vtensor<[?,4,?],f32>
+  return %0 : !torch.vtensor<[?,4,?],f32>
+}
+
+// -----
+
+// CHECK:         #[[PERMUTED:.*]] = affine_map<(d0, d1, d2) -> (d2, d0, d1)>
+// CHECK-LABEL:   func @torch.aten.permute(
+// CHECK-SAME:                             %[[ARG:.*]]: !torch.vtensor<[?,4,8],f32>) -> !torch.vtensor<[4,8,?],f32> {
+// CHECK:           %[[SELF:.*]] = torch.to_builtin_tensor %[[ARG]] : !torch.vtensor<[?,4,8],f32> -> tensor<?x4x8xf32>
+// CHECK:           %[[INIT:.*]] = linalg.init_tensor [4, 8, %{{.*}}] : tensor<4x8x?xf32>
+// CHECK:           linalg.generic {indexing_maps = [#[[PERMUTED]], #{{.*}}], iterator_types = ["parallel", "parallel", "parallel"]} ins(%[[SELF]] : tensor<?x4x8xf32>) outs(%[[INIT]] : tensor<4x8x?xf32>)
+func @torch.aten.permute(%arg0: !torch.vtensor<[?,4,8],f32>) -> !torch.vtensor<[4,8,?],f32> {
+  %c0_i64 = constant 0 : i64
+  %c1_i64 = constant 1 : i64
+  %c2_i64 = constant 2 : i64
+  %0 = torch.prim.ListConstruct %c1_i64, %c2_i64, %c0_i64 : (i64, i64, i64) -> !torch.list<i64>
+  %1 = torch.aten.permute %arg0, %0 : !torch.vtensor<[?,4,8],f32>, !torch.list<i64> -> !torch.vtensor<[4,8,?],f32>
+  return %1 : !torch.vtensor<[4,8,?],f32>
+}
+
+// -----
+
+// Transposes of non-value tensors are views, which are left alone.
+// CHECK-LABEL:   func @torch.aten.transpose.int(
+// CHECK:           linalg.generic {{.*}} ins(%{{.*}} : tensor<2x3xf32>) outs(%{{.*}} : tensor<3x2xf32>)
+// CHECK:           torch.aten.transpose.int %arg1, %{{.*}}, %{{.*}} : !torch.tensor<[2,3],f32>
+func @torch.aten.transpose.int(%arg0: !torch.vtensor<[2,3],f32>, %arg1: !torch.tensor<[2,3],f32>) -> (!torch.vtensor<[3,2],f32>, !torch.tensor<[3,2],f32>) {
+  %c0_i64 = constant 0 : i64
+  %c-1_i64 = constant -1 : i64
+  %0 = torch.aten.transpose.int %arg0, %c0_i64, %c-1_i64 : !torch.vtensor<[2,3],f32>, i64, i64 -> !torch.vtensor<[3,2],f32>
+  %1 = torch.aten.transpose.int %arg1, %c0_i64, %c-1_i64 : !torch.tensor<[2,3],f32>, i64, i64 -> !torch.tensor<[3,2],f32>
+  return %0, %1 : !torch.vtensor<[3,2],f32>, !torch.tensor<[3,2],f32>
+}
+
+// -----
+
+// Constant bounds of static dimensions give a static slice.
+// CHECK-LABEL:   func @torch.aten.slice.Tensor(
+// CHECK:           %[[SELF:.*]] = torch.to_builtin_tensor %{{.*}} : !torch.vtensor<[4,8],f32> -> tensor<4x8xf32>
+// CHECK:           %[[SLICE:.*]] = subtensor %[[SELF]][0, 5] [4, 2] [1, 2] : tensor<4x8xf32> to tensor<4x2xf32>
+// CHECK:           tensor.cast %[[SLICE]] : tensor<4x2xf32> to tensor<4x?xf32>
+func @torch.aten.slice.Tensor(%arg0: !torch.vtensor<[4,8],f32>) -> !torch.vtensor<[4,?],f32> {
+  %c1_i64 = constant 1 : i64
+  %c2_i64 = constant 2 : i64
+  %c-3_i64 = constant -3 : i64
+  %none = basicpy.singleton : !basicpy.NoneType
+  %0 = torch.aten.slice.Tensor %arg0, %c1_i64, %c-3_i64, %none, %c2_i64 : !torch.vtensor<[4,8],f32>, i64, i64, !basicpy.NoneType, i64 -> !torch.vtensor<[4,?],f32>
+  return %0 : !torch.vtensor<[4,?],f32>
+}
+
+// -----
+
+// CHECK-LABEL:   func @torch.aten.slice.Tensor$dynamic(
+// CHECK-SAME:                                          %[[ARG:.*]]: !torch.vtensor<[?],f32>, %[[START:.*]]: i64) -> !torch.vtensor<[?],f32> {
+// CHECK:           %[[SELF:.*]] = torch.to_builtin_tensor %[[ARG]] : !torch.vtensor<[?],f32> -> tensor<?xf32>
+// CHECK:           %[[DIM:.*]] = memref.dim %[[SELF]], %{{.*}} : tensor<?xf32>
+// CHECK:           %[[OFFSET:.*]] = select %{{.*}}, %[[DIM]], %{{.*}} : index
+// CHECK:           %[[SIZE:.*]] = divi_signed %{{.*}}, %{{.*}} : index
+// CHECK:           subtensor %[[SELF]][%[[OFFSET]]] [%[[SIZE]]] [1] : tensor<?xf32> to tensor<?xf32>
+func @torch.aten.slice.Tensor$dynamic(%arg0: !torch.vtensor<[?],f32>, %arg1: i64) -> !torch.vtensor<[?],f32> {
+  %c0_i64 = constant 0 : i64
+  %c1_i64 = constant 1 : i64
+  %none = basicpy.singleton : !basicpy.NoneType
+  %0 = torch.aten.slice.Tensor %arg0, %c0_i64, %arg1, %none, %c1_i64 : !torch.vtensor<[?],f32>, i64, i64, !basicpy.NoneType, i64 -> !torch.vtensor<[?],f32>
+  return %0 : !torch.vtensor<[?],f32>
+}
+
+// -----
+
+// CHECK-LABEL:   func @torch.aten.select.int(
+// CHECK-SAME:                                %[[ARG:.*]]: !torch.vtensor<[?,8],f32>, %[[INDEX:.*]]: i64) -> !torch.vtensor<[8],f32> {
+// CHECK:           %[[SELF:.*]] = torch.to_builtin_tensor %[[ARG]] : !torch.vtensor<[?,8],f32> -> tensor<?x8xf32>
+// CHECK:           %[[DIM:.*]] = memref.dim %[[SELF]], %{{.*}} : tensor<?x8xf32>
+// CHECK:           %[[CAST:.*]] = index_cast %[[INDEX]] : i64 to index
+// CHECK:           %[[NORMALIZED:.*]] = select %{{.*}}, %{{.*}}, %[[CAST]] : index
+// CHECK:           %[[IN_BOUNDS:.*]] = cmpi ult, %[[NORMALIZED]], %[[DIM]] : index
+// CHECK:           assert %[[IN_BOUNDS]], "index out of range in torch.aten.select.int"
+// CHECK:           subtensor %[[SELF]][%[[NORMALIZED]], 0] [1, 8] [1, 1] : tensor<?x8xf32> to tensor<8xf32>
+func @torch.aten.select.int(%arg0: !torch.vtensor<[?,8],f32>, %arg1: i64) -> !torch.vtensor<[8],f32> {
+  %c0_i64 = constant 0 : i64
+  %0 = torch.aten.select.int %arg0, %c0_i64, %arg1 : !torch.vtensor<[?,8],f32>, i64, i64 -> !torch.vtensor<[8],f32>
+  return %0 : !torch.vtensor<[8],f32>
+}
+
+// -----
+
+// CHECK-LABEL:   func @torch.aten.cat(
+// CHECK-SAME:                         %[[ARG0:.*]]: !torch.vtensor<[?,3],f32>, %[[ARG1:.*]]: !torch.vtensor<[?,4],f32>) -> !torch.vtensor<[?,7],f32> {
+// CHECK:           %[[LHS:.*]] = torch.to_builtin_tensor %[[ARG0]] : !torch.vtensor<[?,3],f32> -> tensor<?x3xf32>
+// CHECK:           %[[RHS:.*]] = torch.to_builtin_tensor %[[ARG1]] : !torch.vtensor<[?,4],f32> -> tensor<?x4xf32>
+// CHECK:           assert %{{.*}}, "mismatching sizes in torch.aten.cat"
+// CHECK:           %[[INIT:.*]] = linalg.init_tensor
+// CHECK:           %[[INSERT_LHS:.*]] = subtensor_insert %[[LHS]] into %[[INIT]][0, %{{.*}}] [%{{.*}}, 3] [1, 1] : tensor<?x3xf32> into tensor<?x?xf32>
+// CHECK:           %[[INSERT_RHS:.*]] = subtensor_insert %[[RHS]] into %[[INSERT_LHS]][0, %{{.*}}] [%{{.*}}, 4] [1, 1] : tensor<?x4xf32> into tensor<?x?xf32>
+// CHECK:           tensor.cast %[[INSERT_RHS]] : tensor<?x?xf32> to tensor<?x7xf32>
+func @torch.aten.cat(%arg0: !torch.vtensor<[?,3],f32>, %arg1: !torch.vtensor<[?,4],f32>) -> !torch.vtensor<[?,7],f32> {
+  %c1_i64 = constant 1 : i64
+  %0 = torch.prim.ListConstruct %arg0, %arg1 : (!torch.vtensor<[?,3],f32>, !torch.vtensor<[?,4],f32>) -> !torch.list<!torch.vtensor>
+  %1 = torch.aten.cat %0, %c1_i64 : !torch.list<!torch.vtensor>, i64 -> !torch.vtensor<[?,7],f32>
+  return %1 : !torch.vtensor<[?,7],f32>
+}
+
+// -----
+
+// CHECK-LABEL:   func @torch.aten.split.Tensor(
+// CHECK-SAME:                                  %[[ARG:.*]]: !torch.vtensor<[?,8],f32>) -> (!torch.vtensor<[?,?],f32>, !torch.vtensor<[?,?],f32>) {
+// CHECK:           %[[SELF:.*]] = torch.to_builtin_tensor %[[ARG]] : !torch.vtensor<[?,8],f32> -> tensor<?x8xf32>
+// CHECK:           assert %{{.*}}, "mismatching number of results for torch.prim.ListUnpack"
+// CHECK:           %[[PIECE0:.*]] = subtensor %[[SELF]][0, %{{.*}}] [%{{.*}}, %{{.*}}] [1, 1] : tensor<?x8xf32> to tensor<?x?xf32>
+// CHECK:           %[[PIECE1:.*]] = subtensor %[[SELF]][0, %{{.*}}] [%{{.*}}, %{{.*}}] [1, 1] : tensor<?x8xf32> to tensor<?x?xf32>
+// CHECK-NOT:       torch.aten.split.Tensor
+func @torch.aten.split.Tensor(%arg0: !torch.vtensor<[?,8],f32>) -> (!torch.vtensor<[?,?],f32>, !torch.vtensor<[?,?],f32>) {
+  %c1_i64 = constant 1 : i64
+  %c4_i64 = constant 4 : i64
+  %0 = torch.aten.split.Tensor %arg0, %c4_i64, %c1_i64 : !torch.vtensor<[?,8],f32>, i64, i64 -> !torch.list<!torch.vtensor>
+  %1:2 = torch.prim.ListUnpack %0 : !torch.list<!torch.vtensor> -> !torch.vtensor<[?,?],f32>, !torch.vtensor<[?,?],f32>
+  return %1#0, %1#1 : !torch.vtensor<[?,?],f32>, !torch.vtensor<[?,?],f32>
+}
+
+// -----
+
+// The maximum and the sum of the exponentials are computed in the same pass.
+// CHECK-LABEL:   func @torch.aten.softmax.int(
+// CHECK:           %[[STATS:.*]]:2 = linalg.generic {{.*}}iterator_types = ["parallel", "reduction"]} ins(%{{.*}} : tensor<?x?xf32>) outs(%{{.*}}, %{{.*}} : tensor<?xf32>, tensor<?xf32>)
+// CHECK:           linalg.generic {{.*}} ins(%{{.*}}, %[[STATS]]#0, %[[STATS]]#1 : tensor<?x?xf32>, tensor<?xf32>, tensor<?xf32>)
+// CHECK:             math.exp
+// CHECK:             divf
+func @torch.aten.softmax.int(%arg0: !torch.vtensor<[?,?],f32>) -> !torch.vtensor<[?,?],f32> {
+  %c-1_i64 = constant -1 : i64
+  %none = basicpy.singleton : !basicpy.NoneType
+  %0 = torch.aten.softmax.int %arg0, %c-1_i64, %none : !torch.vtensor<[?,?],f32>, i64, !basicpy.NoneType -> !torch.vtensor<[?,?],f32>
+  return %0 : !torch.vtensor<[?,?],f32>
+}
+
+// CHECK-LABEL:   func @torch.aten.log_softmax.int(
+// CHECK:           %[[STATS:.*]]:2 = linalg.generic {{.*}}iterator_types = ["reduction", "parallel"]}
+// CHECK:           linalg.generic
+// CHECK:             math.log
+func @torch.aten.log_softmax.int(%arg0: !torch.vtensor<[?,?],f32>) -> !torch.vtensor<[?,?],f32> {
+  %c0_i64 = constant 0 : i64
+  %none = basicpy.singleton : !basicpy.NoneType
+  %0 = torch.aten.log_softmax.int %arg0, %c0_i64, %none : !torch.vtensor<[?,?],f32>, i64, !basicpy.NoneType -> !torch.vtensor<[?,?],f32>
+  return %0 : !torch.vtensor<[?,?],f32>
+}
+
+// -----
+
+// The indices are checked to be in bounds in a single reduction, and each row
+// of the weight is gathered with `tensor.extract`.
+// CHECK-LABEL:   func @torch.aten.embedding(
+// CHECK-SAME:                               %[[WEIGHT:.*]]: tensor<10x3xf32>, %[[INDICES:.*]]: tensor<?xsi64>) -> tensor<?x3xf32> {
+// CHECK:           %[[MINMAX:.*]]:2 = linalg.generic {{.*}}iterator_types = ["reduction"]} ins(%[[INDICES]] : tensor<?xsi64>) outs(%{{.*}}, %{{.*}} : tensor<i64>, tensor<i64>)
+// CHECK:             builtin.unrealized_conversion_cast %{{.*}} : si64 to i64
+// CHECK:           %[[MIN:.*]] = tensor.extract %[[MINMAX]]#0[] : tensor<i64>
+// CHECK:           %[[MAX:.*]] = tensor.extract %[[MINMAX]]#1[] : tensor<i64>
+// CHECK:           assert %{{.*}}, "index out of range in torch.aten.embedding"
+// CHECK:           linalg.generic {{.*}}iterator_types = ["parallel", "parallel"]} ins(%[[INDICES]] : tensor<?xsi64>) outs(%{{.*}} : tensor<?x3xf32>)
+// CHECK:             %[[ROW:.*]] = index_cast %{{.*}} : i64 to index
+// CHECK:             %[[COLUMN:.*]] = linalg.index 1 : index
+// CHECK:             tensor.extract %[[WEIGHT]][%[[ROW]], %[[COLUMN]]] : tensor<10x3xf32>
+func @torch.aten.embedding(%arg0: !torch.vtensor<[10,3],f32>, %arg1: !torch.vtensor<[?],si64>) -> !torch.vtensor<[?,3],f32> {
+  %c-1_i64 = constant -1 : i64
+  %false = basicpy.bool_constant false
+  %0 = torch.aten.embedding %arg0, %arg1, %c-1_i64, %false, %false : !torch.vtensor<[10,3],f32>, !torch.vtensor<[?],si64>, i64, !basicpy.BoolType, !basicpy.BoolType -> !torch.vtensor<[?,3],f32>
+  return %0 : !torch.vtensor<[?,3],f32>
+}
+
+// CHECK-LABEL:   func @torch.aten.index_select(
+// CHECK-SAME:                                  %[[SELF:.*]]: tensor<4x?xf32>, %[[INDEX:.*]]: tensor<2xsi64>) -> tensor<4x2xf32> {
+// CHECK:           assert %{{.*}}, "index out of range in torch.aten.index_select"
+// CHECK:           linalg.generic {{.*}} ins(%[[INDEX]] : tensor<2xsi64>) outs(%{{.*}} : tensor<4x2xf32>)
+// CHECK:             %[[ROW:.*]] = linalg.index 0 : index
+// CHECK:             tensor.extract %[[SELF]][%[[ROW]], %{{.*}}] : tensor<4x?xf32>
+func @torch.aten.index_select(%arg0: !torch.vtensor<[4,?],f32>, %arg1: !torch.vtensor<[2],si64>) -> !torch.vtensor<[4,2],f32> {
+  %c1_i64 = constant 1 : i64
+  %0 = torch.aten.index_select %arg0, %c1_i64, %arg1 : !torch.vtensor<[4,?],f32>, i64, !torch.vtensor<[2],si64> -> !torch.vtensor<[4,2],f32>
+  return %0 : !torch.vtensor<[4,2],f32>
+}
+
+// -----
+
+// The input is quantized to i8, multiplied with the i8 weights accumulating in
+// i32, and a single epilogue corrects for the input zero point (with the sums
+// of the weights: 6 and -5), scales, adds the bias, and requantizes and
+// dequantizes the result.
+// CHECK-LABEL:   func @torch.quantized.linear(
+// CHECK:           %[[QUANTIZED:.*]] = linalg.generic {{.*}} ins(%{{.*}} : tensor<?x3xf32>) outs(%{{.*}} : tensor<?x3xi8>)
+// CHECK:             fptosi %{{.*}} : f32 to i32
+// CHECK:             trunci %{{.*}} : i32 to i8
+// CHECK:           %[[WEIGHTS:.*]] = constant dense<{{\[\[}}1, 2, 3], [-4, 5, -6]]> : tensor<2x3xi8>
+// CHECK:           %[[ACC:.*]] = linalg.generic {{.*}}iterator_types = ["parallel", "parallel", "reduction"]} ins(%[[QUANTIZED]], %[[WEIGHTS]] : tensor<?x3xi8>, tensor<2x3xi8>) outs(%{{.*}} : tensor<?x2xi32>)
+// CHECK:             sexti %{{.*}} : i8 to i32
+// CHECK:             sexti %{{.*}} : i8 to i32
+// CHECK:             muli %{{.*}}, %{{.*}} : i32
+// CHECK:             addi %{{.*}}, %{{.*}} : i32
+// CHECK:           %[[SUMS:.*]] = constant dense<[6, -5]> : tensor<2xi32>
+// CHECK:           %[[BIAS:.*]] = constant dense<[1.000000e+00, 2.000000e+00]> : tensor<2xf32>
+// CHECK:           linalg.generic {{.*}} ins(%[[ACC]], %[[SUMS]], %[[BIAS]] : tensor<?x2xi32>, tensor<2xi32>, tensor<2xf32>) outs(%{{.*}} : tensor<?x2xf32>)
+// CHECK-NOT:       torch.quantized.linear
+// CHECK-NOT:       torch.linear_params.create
+func @torch.quantized.linear(%arg0: !torch.vtensor<[?,3],f32>) -> !torch.vtensor<[?,2],f32> {
+  %int_repr = torch.tensor(dense<[[1, 2, 3], [-4, 5, -6]]> : tensor<2x3xsi8>) : !torch.tensor<[2,3],si8>
+  %w_scale = constant 5.000000e-01 : f64
+  %w_zero_point = constant 0 : i64
+  %weight = torch.per_tensor_affine.create %int_repr, %w_scale, %w_zero_point : !torch.tensor<[2,3],si8>, f64, i64 -> !torch.tensor<[2,3],!torch.qint8>
+  %bias = torch.tensor(dense<[1.0, 2.0]> : tensor<2xf32>) : !torch.tensor<[2],f32>
+  %params = torch.linear_params.create %weight, %bias : !torch.tensor<[2,3],!torch.qint8>, !torch.tensor<[2],f32>
+  %x_scale = constant 1.000000e-01 : f64
+  %x_zero_point = constant 3 : i64
+  %qint8 = constant 12 : i64
+  %0 = torch.aten.quantize_per_tensor %arg0, %x_scale, %x_zero_point, %qint8 : !torch.vtensor<[?,3],f32>, f64, i64, i64 -> !torch.vtensor<[?,3],!torch.qint8>
+  %y_scale = constant 2.000000e-01 : f64
+  %y_zero_point = constant -1 : i64
+  %1 = torch.quantized.linear %0, %params, %y_scale, %y_zero_point : !torch.vtensor<[?,3],!torch.qint8>, !torch.LinearParams, f64, i64 -> !torch.vtensor<[?,2],!torch.qint8>
+  %2 = torch.aten.dequantize.self %1 : !torch.vtensor<[?,2],!torch.qint8> -> !torch.vtensor<[?,2],f32>
+  return %2 : !torch.vtensor<[?,2],f32>
+}
@@ -0,0 +1,28 @@
+// RUN: npcomp-opt -basicpy-module-type-inference %s | FileCheck %s --dump-input=fail
+
+// The callees are inferred first, and the calls take their types.
+
+// CHECK-LABEL: func @caller(
+// CHECK-SAME:      %arg0: i64) -> i64 {
+// CHECK:         %[[RESULT:.*]] = call @callee(%arg0) : (i64) -> i64
+// CHECK:         return %[[RESULT]] : i64
+func @caller(%arg0: !basicpy.UnknownType) -> !basicpy.UnknownType {
+  %0 = call @callee(%arg0) : (!basicpy.UnknownType) -> !basicpy.UnknownType
+  return %0 : !basicpy.UnknownType
+}
+
+// CHECK-LABEL: func @other_caller(
+// CHECK-SAME:      %arg0: i64) -> i64 {
+// CHECK:         call @callee(%arg0) : (i64) -> i64
+func @other_caller(%arg0: !basicpy.UnknownType) -> !basicpy.UnknownType {
+  %0 = call @callee(%arg0) : (!basicpy.UnknownType) -> !basicpy.UnknownType
+  return %0 : !basicpy.UnknownType
+}
+
+// CHECK-LABEL: func @callee(
+// CHECK-SAME:      %arg0: i64) -> i64 {
+func @callee(%arg0: !basicpy.UnknownType) -> !basicpy.UnknownType {
+  %c1 = constant 1 : i64
+  %0 = basicpy.binary_expr %arg0 "Add" %c1 : (!basicpy.UnknownType, i64) -> !basicpy.UnknownType
+  return %0 : !basicpy.UnknownType
+}
@@ -0,0 +1,54 @@
+// RUN: npcomp-opt -split-input-file %s -allow-unregistered-dialect -numpy-elide-array-copies | FileCheck --dump-input=fail %s
+
+// CHECK-LABEL: func @multipleCopies(
+// CHECK-SAME:                       %[[ARG:.*]]: tensor<2xf64>)
+// CHECK-NOT: numpy.create_array_from_tensor
+// CHECK-NOT: numpy.copy_to_tensor
+// CHECK: return %[[ARG]], %[[ARG]]
+func @multipleCopies(%arg0: tensor<2xf64>) -> (tensor<2xf64>, tensor<2xf64>) {
+  %0 = numpy.create_array_from_tensor %arg0 : (tensor<2xf64>) -> !numpy.ndarray<[2]:f64>
+  %1 = numpy.copy_to_tensor %0 : (!numpy.ndarray<[2]:f64>) -> tensor<2xf64>
+  %2 = numpy.copy_to_tensor %0 : (!numpy.ndarray<[2]:f64>) -> tensor<2xf64>
+  return %1, %2 : tensor<2xf64>, tensor<2xf64>
+}
+
+// -----
+// Copies through casts keep the type of the copy.
+// CHECK-LABEL: func @copyThroughCast(
+// CHECK-SAME:                        %[[ARG:.*]]: tensor<2xf64>)
+// CHECK: %[[CAST:.*]] = numpy.tensor_static_info_cast %[[ARG]] : tensor<2xf64> to tensor<*xf64>
+// CHECK-NOT: numpy.static_info_cast
+// CHECK: return %[[CAST]]
+func @copyThroughCast(%arg0: tensor<2xf64>) -> tensor<*xf64> {
+  %0 = numpy.create_array_from_tensor %arg0 : (tensor<2xf64>) -> !numpy.ndarray<[2]:f64>
+  %1 = numpy.static_info_cast %0 : !numpy.ndarray<[2]:f64> to !numpy.ndarray<*:f64>
+  %2 = numpy.copy_to_tensor %1 : (!numpy.ndarray<*:f64>) -> tensor<*xf64>
+  return %2 : tensor<*xf64>
+}
+
+// -----
+// A mutated array is copied.
+// CHECK-LABEL: func @overwritten
+// CHECK: numpy.create_array_from_tensor
+// CHECK: numpy.copy_to_tensor
+// CHECK: numpy.overwrite_array
+// CHECK: numpy.copy_to_tensor
+func @overwritten(%arg0: tensor<2xf64>, %arg1: tensor<2xf64>) -> (tensor<2xf64>, tensor<2xf64>) {
+  %0 = numpy.create_array_from_tensor %arg0 : (tensor<2xf64>) -> !numpy.ndarray<[2]:f64>
+  %1 = numpy.copy_to_tensor %0 : (!numpy.ndarray<[2]:f64>) -> tensor<2xf64>
+  numpy.overwrite_array %arg1 overwrites %0 : tensor<2xf64>, !numpy.ndarray<[2]:f64>
+  %2 = numpy.copy_to_tensor %0 : (!numpy.ndarray<[2]:f64>) -> tensor<2xf64>
+  return %1, %2 : tensor<2xf64>, tensor<2xf64>
+}
+
+// -----
+// An array escaping to an unknown op is copied.
+// CHECK-LABEL: func @escaping
+// CHECK: numpy.create_array_from_tensor
+// CHECK: numpy.copy_to_tensor
+func @escaping(%arg0: tensor<2xf64>) -> tensor<2xf64> {
+  %0 = numpy.create_array_from_tensor %arg0 : (tensor<2xf64>) -> !numpy.ndarray<[2]:f64>
+  "unknown_op"(%0) : (!numpy.ndarray<[2]:f64>) -> ()
+  %1 = numpy.copy_to_tensor %0 : (!numpy.ndarray<[2]:f64>) -> tensor<2xf64>
+  return %1 : tensor<2xf64>
+}
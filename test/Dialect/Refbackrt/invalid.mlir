@@ -21,3 +21,20 @@ refbackrt.module_metadata {
   refbackrt.func_metadata {funcName = @f, numInputs = 0 : i32, numOutputs = 1 : i32}
 }
 func @f() { return }
+
+// -----
+
+func @parallel_for(%arg0: index) {
+  // expected-error @+1 {{must reference a valid func}}
+  refbackrt.parallel_for @missing(%arg0, %arg0) grain %arg0
+  return
+}
+
+// -----
+
+func @parallel_for(%arg0: index) {
+  // expected-error @+1 {{body must have type (index, index, !llvm.ptr<i8>) -> ()}}
+  refbackrt.parallel_for @body(%arg0, %arg0) grain %arg0
+  return
+}
+func private @body(%arg0: index) { return }
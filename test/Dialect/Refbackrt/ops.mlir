@@ -11,9 +11,25 @@ refbackrt.module_metadata {
     inputArgTypes = dense<1> : tensor<1xi32>,
     inputElementTypes = dense<1> : tensor<1xi32>,
     inputRanks = dense<-1> : tensor<1xi32>,
-    inputShapes = dense<1> : tensor<4xi32>}
+    inputShapes = dense<1> : tensor<4xi64>}
 }
 
 func @f(%arg0: tensor<*xf32>) {
   return
 }
+
+// CHECK-LABEL: func @parallel_for
+func @parallel_for(%arg0: memref<?xf32>, %arg1: index) {
+  // CHECK: refbackrt.parallel_for @parallel_body(%{{.*}}, %{{.*}}) grain %{{.*}} captures(%{{.*}} : memref<?xf32>)
+  %c0 = constant 0 : index
+  %c16 = constant 16 : index
+  refbackrt.parallel_for @parallel_body(%c0, %arg1) grain %c16 captures(%arg0 : memref<?xf32>)
+  return
+}
+
+// CHECK-LABEL: func private @parallel_body
+func private @parallel_body(%arg0: index, %arg1: index, %arg2: !llvm.ptr<i8>) {
+  // CHECK: refbackrt.unpack_parallel_context %{{.*}} : !llvm.ptr<i8> -> memref<?xf32>
+  %0 = refbackrt.unpack_parallel_context %arg2 : !llvm.ptr<i8> -> memref<?xf32>
+  return
+}
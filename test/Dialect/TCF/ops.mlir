@@ -18,9 +18,52 @@ func @matmul(%arg0: tensor<?x?xf32>, %arg1: tensor<?x?xf32>) -> tensor<?x?xf32>
   return %0 : tensor<?x?xf32>
 }
 
+// CHECK-LABEL: func @batch_matmul
+func @batch_matmul(%arg0: tensor<?x?x?xf32>, %arg1: tensor<?x?x?xf32>) -> tensor<?x?x?xf32> {
+  // CHECK: tcf.batch_matmul %arg0, %arg1 : (tensor<?x?x?xf32>, tensor<?x?x?xf32>) -> tensor<?x?x?xf32>
+  %0 = tcf.batch_matmul %arg0, %arg1 : (tensor<?x?x?xf32>, tensor<?x?x?xf32>) -> tensor<?x?x?xf32>
+  return %0 : tensor<?x?x?xf32>
+}
+
+// CHECK-LABEL: func @attention
+func @attention(%arg0: tensor<?x?x?xf32>, %arg1: tensor<?x?x?xf32>, %arg2: tensor<?x?x?xf32>) -> tensor<?x?x?xf32> {
+  // CHECK: tcf.attention %arg0, %arg1, %arg2 {scale = 1.250000e-01 : f32} : (tensor<?x?x?xf32>, tensor<?x?x?xf32>, tensor<?x?x?xf32>) -> tensor<?x?x?xf32>
+  %0 = tcf.attention %arg0, %arg1, %arg2 {scale = 0.125 : f32} : (tensor<?x?x?xf32>, tensor<?x?x?xf32>, tensor<?x?x?xf32>) -> tensor<?x?x?xf32>
+  return %0 : tensor<?x?x?xf32>
+}
+
 // CHECK-LABEL: func @conv_2d_nchw
 func @conv_2d_nchw(%arg0: tensor<?x?x?x?xf32>, %arg1: tensor<?x?x?x?xf32>) -> tensor<?x?x?x?xf32> {
   // CHECK: tcf.conv_2d_nchw %arg0, %arg1 : (tensor<?x?x?x?xf32>, tensor<?x?x?x?xf32>) -> tensor<?x?x?x?xf32>
   %0 = tcf.conv_2d_nchw %arg0, %arg1 : (tensor<?x?x?x?xf32>, tensor<?x?x?x?xf32>) -> tensor<?x?x?x?xf32>
   return %0 : tensor<?x?x?x?xf32>
 }
+
+// CHECK-LABEL: func @reductions
+func @reductions(%arg0: tensor<?x?xf32>) {
+  // CHECK: tcf.reduce_sum %arg0 {dim = 1 : i64} : (tensor<?x?xf32>) -> tensor<?x1xf32>
+  // CHECK: tcf.reduce_mean %arg0 {dim = 0 : i64} : (tensor<?x?xf32>) -> tensor<1x?xf32>
+  // CHECK: tcf.reduce_max %arg0 {dim = 1 : i64} : (tensor<?x?xf32>) -> tensor<?x1xf32>
+  // CHECK: tcf.softmax %arg0 {dim = 1 : i64} : tensor<?x?xf32>
+  %0 = tcf.reduce_sum %arg0 {dim = 1 : i64} : (tensor<?x?xf32>) -> tensor<?x1xf32>
+  %1 = tcf.reduce_mean %arg0 {dim = 0 : i64} : (tensor<?x?xf32>) -> tensor<1x?xf32>
+  %2 = tcf.reduce_max %arg0 {dim = 1 : i64} : (tensor<?x?xf32>) -> tensor<?x1xf32>
+  %3 = tcf.softmax %arg0 {dim = 1 : i64} : tensor<?x?xf32>
+  return
+}
+
+// CHECK-LABEL: func @transpose
+func @transpose(%arg0: tensor<2x?x8xf32>) -> tensor<8x2x?xf32> {
+  // CHECK: tcf.transpose %arg0 {permutation = [2, 0, 1]} : (tensor<2x?x8xf32>) -> tensor<8x2x?xf32>
+  %0 = tcf.transpose %arg0 {permutation = [2, 0, 1]} : (tensor<2x?x8xf32>) -> tensor<8x2x?xf32>
+  return %0 : tensor<8x2x?xf32>
+}
+
+// CHECK-LABEL: func @dot
+func @dot(%arg0: tensor<4x?xf32>, %arg1: tensor<?xf32>) -> (tensor<4xf32>, tensor<f32>) {
+  // CHECK: tcf.dot %arg0, %arg1 : (tensor<4x?xf32>, tensor<?xf32>) -> tensor<4xf32>
+  // CHECK: tcf.dot %arg1, %arg1 : (tensor<?xf32>, tensor<?xf32>) -> tensor<f32>
+  %0 = tcf.dot %arg0, %arg1 : (tensor<4x?xf32>, tensor<?xf32>) -> tensor<4xf32>
+  %1 = tcf.dot %arg1, %arg1 : (tensor<?xf32>, tensor<?xf32>) -> tensor<f32>
+  return %0, %1 : tensor<4xf32>, tensor<f32>
+}
@@ -0,0 +1,96 @@
+// RUN: npcomp-opt -tcf-shape-refinement -split-input-file <%s | FileCheck %s --dump-input=fail
+
+// Elementwise ops get the broadcast of their operand shapes, and the
+// function results are refined along with them.
+
+// CHECK-LABEL: func @broadcast(
+// CHECK-SAME:      -> tensor<2x3xf32>
+// CHECK:         %[[ADD:.*]] = tcf.add %arg0, %arg1 : (tensor<2x1xf32>, tensor<3xf32>) -> tensor<2x3xf32>
+// CHECK:         %[[EXP:.*]] = tcf.exp %[[ADD]] : tensor<2x3xf32>
+// CHECK:         return %[[EXP]] : tensor<2x3xf32>
+func @broadcast(%arg0: tensor<2x1xf32>, %arg1: tensor<3xf32>) -> tensor<?x?xf32> {
+  %0 = tcf.add %arg0, %arg1 : (tensor<2x1xf32>, tensor<3xf32>) -> tensor<?x?xf32>
+  %1 = tcf.exp %0 : tensor<?x?xf32>
+  return %1 : tensor<?x?xf32>
+}
+
+// -----
+
+// Dynamic dimensions broadcast against static ones (other than 1) are
+// assumed to match them.
+
+// CHECK-LABEL: func @dynamic_broadcast
+// CHECK:         tcf.max %arg0, %arg1 : (tensor<?x4xf32>, tensor<?x1xf32>) -> tensor<?x4xf32>
+func @dynamic_broadcast(%arg0: tensor<?x4xf32>, %arg1: tensor<?x1xf32>) -> tensor<*xf32> {
+  %0 = tcf.max %arg0, %arg1 : (tensor<?x4xf32>, tensor<?x1xf32>) -> tensor<*xf32>
+  return %0 : tensor<*xf32>
+}
+
+// -----
+
+// CHECK-LABEL: func @matmul_conv
+// CHECK:         tcf.matmul %arg0, %arg1 : (tensor<4x?xf32>, tensor<?x8xf32>) -> tensor<4x8xf32>
+// CHECK:         tcf.conv_2d_nchw %arg2, %arg3 : (tensor<1x3x32x?xf32>, tensor<16x3x3x3xf32>) -> tensor<1x16x30x?xf32>
+func @matmul_conv(%arg0: tensor<4x?xf32>, %arg1: tensor<?x8xf32>, %arg2: tensor<1x3x32x?xf32>, %arg3: tensor<16x3x3x3xf32>) -> (tensor<?x?xf32>, tensor<?x?x?x?xf32>) {
+  %0 = tcf.matmul %arg0, %arg1 : (tensor<4x?xf32>, tensor<?x8xf32>) -> tensor<?x?xf32>
+  %1 = tcf.conv_2d_nchw %arg2, %arg3 : (tensor<1x3x32x?xf32>, tensor<16x3x3x3xf32>) -> tensor<?x?x?x?xf32>
+  return %0, %1 : tensor<?x?xf32>, tensor<?x?x?x?xf32>
+}
+
+// -----
+
+// CHECK-LABEL: func @batch_matmul_attention
+// CHECK:         tcf.batch_matmul %arg0, %arg1 : (tensor<2x4x?xf32>, tensor<?x?x8xf32>) -> tensor<2x4x8xf32>
+// CHECK:         tcf.attention %arg2, %arg3, %arg4 {scale = 1.000000e+00 : f32} : (tensor<2x16x64xf32>, tensor<2x?x64xf32>, tensor<2x?x32xf32>) -> tensor<2x16x32xf32>
+func @batch_matmul_attention(%arg0: tensor<2x4x?xf32>, %arg1: tensor<?x?x8xf32>, %arg2: tensor<2x16x64xf32>, %arg3: tensor<2x?x64xf32>, %arg4: tensor<2x?x32xf32>) -> (tensor<?x?x?xf32>, tensor<?x?x?xf32>) {
+  %0 = tcf.batch_matmul %arg0, %arg1 : (tensor<2x4x?xf32>, tensor<?x?x8xf32>) -> tensor<?x?x?xf32>
+  %1 = tcf.attention %arg2, %arg3, %arg4 {scale = 1.0 : f32} : (tensor<2x16x64xf32>, tensor<2x?x64xf32>, tensor<2x?x32xf32>) -> tensor<?x?x?xf32>
+  return %0, %1 : tensor<?x?x?xf32>, tensor<?x?x?xf32>
+}
+
+// -----
+
+// CHECK-LABEL: func @transpose
+// CHECK:         tcf.transpose %arg0 {permutation = [2, 0, 1]} : (tensor<2x?x8xf32>) -> tensor<8x2x?xf32>
+func @transpose(%arg0: tensor<2x?x8xf32>) -> tensor<?x?x?xf32> {
+  %0 = tcf.transpose %arg0 {permutation = [2, 0, 1]} : (tensor<2x?x8xf32>) -> tensor<?x?x?xf32>
+  return %0 : tensor<?x?x?xf32>
+}
+
+// -----
+
+// CHECK-LABEL: func @dot
+// CHECK:         tcf.dot %arg0, %arg1 : (tensor<4x?xf32>, tensor<?xf32>) -> tensor<4xf32>
+// CHECK:         tcf.dot %arg1, %arg2 : (tensor<?xf32>, tensor<?x8xf32>) -> tensor<8xf32>
+func @dot(%arg0: tensor<4x?xf32>, %arg1: tensor<?xf32>, %arg2: tensor<?x8xf32>) -> (tensor<?xf32>, tensor<?xf32>) {
+  %0 = tcf.dot %arg0, %arg1 : (tensor<4x?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  %1 = tcf.dot %arg1, %arg2 : (tensor<?xf32>, tensor<?x8xf32>) -> tensor<?xf32>
+  return %0, %1 : tensor<?xf32>, tensor<?xf32>
+}
+
+// -----
+
+// Shapes that are statically not broadcastable (which will abort at runtime)
+// aren't refined.
+
+// CHECK-LABEL: func @mismatch
+// CHECK:         tcf.add %arg0, %arg1 : (tensor<2xf32>, tensor<3xf32>) -> tensor<?xf32>
+func @mismatch(%arg0: tensor<2xf32>, %arg1: tensor<3xf32>) -> tensor<?xf32> {
+  %0 = tcf.add %arg0, %arg1 : (tensor<2xf32>, tensor<3xf32>) -> tensor<?xf32>
+  return %0 : tensor<?xf32>
+}
+
+// -----
+
+// Users outside TCF keep seeing the original type.
+
+// CHECK-LABEL: func @other_users
+// CHECK:         %[[ADD:.*]] = tcf.add %arg0, %arg0 : (tensor<2xf32>, tensor<2xf32>) -> tensor<2xf32>
+// CHECK:         %[[CAST:.*]] = tensor.cast %[[ADD]] : tensor<2xf32> to tensor<?xf32>
+// CHECK:         call @use(%[[CAST]])
+func private @use(tensor<?xf32>)
+func @other_users(%arg0: tensor<2xf32>) {
+  %0 = tcf.add %arg0, %arg0 : (tensor<2xf32>, tensor<2xf32>) -> tensor<?xf32>
+  call @use(%0) : (tensor<?xf32>) -> ()
+  return
+}
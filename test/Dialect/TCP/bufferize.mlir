@@ -43,12 +43,18 @@ func @tcp_splatted(%arg0: f32, %arg1: tensor<?xindex>) -> tensor<?x?xf32> {
 // CHECK:           %[[D1_OUT:.*]] = addi %[[D1_EXPANSION]], %[[D1]] : index
 // CHECK:           %[[D1_OUT_TENSOR:.*]] = tensor.from_elements %[[D1_OUT]] : tensor<1xindex>
 // CHECK:           %[[D1_OUT_MREF:.*]] = refback.alloc_memref %[[D1_OUT_TENSOR]] : memref<?xf32>
-// CHECK:           %[[C1:.*]] = constant 1 : index
 // CHECK:           %[[C0_1:.*]] = constant 0 : index
-// CHECK:           %[[LOWER_EXTENT_D1_1:.*]] = tensor.extract %[[LOWER_EXPANSION]][%[[C0_1]]] : tensor<?xindex>
+// CHECK:           %[[C1:.*]] = constant 1 : index
 // CHECK:           %[[C0_2:.*]] = constant 0 : index
-// CHECK:           %[[D1_1:.*]] = memref.dim %[[TENSOR]], %[[C0_2]] : tensor<?xf32>
-// CHECK:           linalg.fill(%[[D1_OUT_MREF]], %[[FILL_VAL]]) : memref<?xf32>, f32
+// CHECK:           %[[LOWER_EXTENT_D1_1:.*]] = tensor.extract %[[LOWER_EXPANSION]][%[[C0_2]]] : tensor<?xindex>
+// CHECK:           %[[UPPER_EXTENT_D1_1:.*]] = tensor.extract %[[UPPER_EXPANSION]][%[[C0_2]]] : tensor<?xindex>
+// CHECK:           %[[C0_3:.*]] = constant 0 : index
+// CHECK:           %[[D1_1:.*]] = memref.dim %[[TENSOR]], %[[C0_3]] : tensor<?xf32>
+// CHECK:           %[[LOWER_SUBVIEW:.*]] = memref.subview %[[D1_OUT_MREF]][%[[C0_1]]] [%[[LOWER_EXTENT_D1_1]]] [%[[C1]]] : memref<?xf32> to memref<?xf32, #map>
+// CHECK:           linalg.fill(%[[LOWER_SUBVIEW]], %[[FILL_VAL]]) : memref<?xf32, #map>, f32
+// CHECK:           %[[UPPER_OFFSET:.*]] = addi %[[LOWER_EXTENT_D1_1]], %[[D1_1]] : index
+// CHECK:           %[[UPPER_SUBVIEW:.*]] = memref.subview %[[D1_OUT_MREF]][%[[UPPER_OFFSET]]] [%[[UPPER_EXTENT_D1_1]]] [%[[C1]]] : memref<?xf32> to memref<?xf32, #map>
+// CHECK:           linalg.fill(%[[UPPER_SUBVIEW]], %[[FILL_VAL]]) : memref<?xf32, #map>, f32
 // CHECK:           %[[SUBVIEW:.*]] = memref.subview %[[D1_OUT_MREF]][%[[LOWER_EXTENT_D1_1]]] [%[[D1_1]]] [%[[C1]]] : memref<?xf32> to memref<?xf32, #map>
 // CHECK:           linalg.copy(%0, %[[SUBVIEW]]) : memref<?xf32>, memref<?xf32, #map>
 // CHECK:           %[[RESULT_TENSOR:.*]] = memref.tensor_load %[[D1_OUT_MREF]] : memref<?xf32>
@@ -0,0 +1,36 @@
+// RUN: npcomp-opt -torch-globalize-object-graph -mlir-print-debuginfo -mlir-print-local-scope %s | FileCheck %s
+
+// Check that the ops of methods are named after the method, whose linkage name
+// is the path of its module from the root.
+
+torch.class_type @child {
+  torch.attr "float" : f64
+  torch.method "forward", @child_forward
+}
+torch.class_type @parent {
+  torch.attr "m" : !torch.nn.Module<"child">
+  torch.method "forward", @parent_forward
+}
+
+// CHECK-LABEL:   func @m.forward() -> f64 {
+// CHECK:           torch.global_slot.get @m.float : f64 loc("m.forward"("model.py":3:4))
+func private @child_forward(%arg0: !torch.nn.Module<"child">) -> f64 {
+  %0 = torch.prim.GetAttr %arg0["float"] : !torch.nn.Module<"child"> -> f64 loc("model.py":3:4)
+  return %0 : f64
+}
+
+// CHECK-LABEL:   func @forward() -> f64 {
+// CHECK:           call @m.forward() : () -> f64 loc("forward"("model.py":10:4))
+func private @parent_forward(%arg0: !torch.nn.Module<"parent">) -> f64 {
+  %0 = torch.prim.GetAttr %arg0["m"] : !torch.nn.Module<"parent"> -> !torch.nn.Module<"child">
+  %1 = call @child_forward(%0) : (!torch.nn.Module<"child">) -> f64 loc("model.py":10:4)
+  return %1 : f64
+}
+
+%c42 = std.constant 42.0 : f64
+%child = torch.nn_module {
+  torch.slot "float", %c42 : f64
+} : !torch.nn.Module<"child">
+%parent = torch.nn_module {
+  torch.slot "m", %child : !torch.nn.Module<"child">
+} : !torch.nn.Module<"parent">
@@ -1,4 +1,9 @@
 // RUN: npcomp-opt -torch-globalize-object-graph -split-input-file %s | FileCheck %s
+// RUN: npcomp-opt -torch-globalize-object-graph -pass-statistics %s 2>&1 >/dev/null | FileCheck %s --check-prefix=STATS
+
+// STATS-DAG: (S) 2 global-slots
+// STATS-DAG: (S) 3 monomorphizations
+// STATS-DAG: (S) 1 extra-monomorphizations
 
 torch.class_type @__torch__.TestModule  {
   torch.attr private "s1" : !torch.nn.Module<"__torch__.Submodule">
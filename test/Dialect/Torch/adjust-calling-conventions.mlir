@@ -47,3 +47,25 @@ func @none_call_return() {
   "test.use"(%0) : (!basicpy.NoneType) -> ()
   return
 }
+
+// CHECK-LABEL:   func @tuple_return(
+// CHECK-SAME:                       %[[ARG0:.*]]: !torch.tensor,
+// CHECK-SAME:                       %[[ARG1:.*]]: i64) -> (!torch.tensor, i64) {
+// CHECK:           return %[[ARG0]], %[[ARG1]] : !torch.tensor, i64
+func @tuple_return(%arg0: !torch.tensor, %arg1: i64) -> !basicpy.TupleType {
+  %0 = basicpy.build_tuple %arg0, %arg1 : (!torch.tensor, i64) -> !basicpy.TupleType
+  return %0 : !basicpy.TupleType
+}
+
+// CHECK-LABEL:   func @tuple_call_return(
+// CHECK-SAME:                            %[[ARG0:.*]]: !torch.tensor,
+// CHECK-SAME:                            %[[ARG1:.*]]: i64) {
+// CHECK:           %[[RESULTS:.*]]:2 = call @tuple_return(%[[ARG0]], %[[ARG1]]) : (!torch.tensor, i64) -> (!torch.tensor, i64)
+// CHECK:           %[[TUPLE:.*]] = basicpy.build_tuple %[[RESULTS]]#0, %[[RESULTS]]#1 : (!torch.tensor, i64) -> !basicpy.TupleType
+// CHECK:           "test.use"(%[[TUPLE]]) : (!basicpy.TupleType) -> ()
+// CHECK:           return
+func @tuple_call_return(%arg0: !torch.tensor, %arg1: i64) {
+  %0 = call @tuple_return(%arg0, %arg1) : (!torch.tensor, i64) -> !basicpy.TupleType
+  "test.use"(%0) : (!basicpy.TupleType) -> ()
+  return
+}
@@ -113,3 +113,55 @@ func @torch.aten.__getitem__.t$no_change_test1(%arg0: !torch.list<i64>) -> i64 {
   %0 = torch.aten.__getitem__.t %arg0, %c5_i64 : !torch.list<i64>, i64 -> i64
   return %0 : i64
 }
+
+// CHECK-LABEL:   func @torch.aten.__getitem__.t$negative_index(
+// CHECK-SAME:                                                   %[[ARG0:.*]]: i64, %[[ARG1:.*]]: i64) -> (i64, i64) {
+// CHECK:           return %[[ARG1]], %[[ARG0]] : i64, i64
+func @torch.aten.__getitem__.t$negative_index(%arg0: i64, %arg1: i64) -> (i64, i64) {
+  %c-1_i64 = constant -1 : i64
+  %c0_i64 = constant 0 : i64
+  %0 = torch.prim.ListConstruct %arg0, %arg1 : (i64, i64) -> !torch.list<i64>
+  %1 = torch.aten.__getitem__.t %0, %c-1_i64 : !torch.list<i64>, i64 -> i64
+  %2 = torch.aten.__getitem__.t %0, %c0_i64 : !torch.list<i64>, i64 -> i64
+  return %1, %2 : i64, i64
+}
+
+// Not canonicalized because the list may be mutated.
+// CHECK-LABEL:   func @torch.aten.__getitem__.t$mutated_list(
+// CHECK:           torch.aten.__getitem__.t
+func @torch.aten.__getitem__.t$mutated_list(%arg0: i64, %arg1: i64) -> i64 {
+  %c0_i64 = constant 0 : i64
+  %0 = torch.prim.ListConstruct %arg0, %arg1 : (i64, i64) -> !torch.list<i64>
+  %1 = torch.aten._set_item.t %0, %c0_i64, %arg1 : !torch.list<i64>, i64, i64 -> !torch.list<i64>
+  %2 = torch.aten.__getitem__.t %0, %c0_i64 : !torch.list<i64>, i64 -> i64
+  return %2 : i64
+}
+
+// CHECK-LABEL:   func @torch.prim.ListUnpack(
+// CHECK-SAME:                                %[[ARG0:.*]]: !torch.vtensor<[2],f32>, %[[ARG1:.*]]: !torch.vtensor) -> (!torch.vtensor, !torch.vtensor) {
+// CHECK:           %[[CAST:.*]] = torch.tensor_static_info_cast %[[ARG0]] : !torch.vtensor<[2],f32> to !torch.vtensor
+// CHECK:           return %[[CAST]], %[[ARG1]] : !torch.vtensor, !torch.vtensor
+func @torch.prim.ListUnpack(%arg0: !torch.vtensor<[2],f32>, %arg1: !torch.vtensor) -> (!torch.vtensor, !torch.vtensor) {
+  %0 = torch.prim.ListConstruct %arg0, %arg1 : (!torch.vtensor<[2],f32>, !torch.vtensor) -> !torch.list<!torch.vtensor>
+  %1:2 = torch.prim.ListUnpack %0 : !torch.list<!torch.vtensor> -> !torch.vtensor, !torch.vtensor
+  return %1#0, %1#1 : !torch.vtensor, !torch.vtensor
+}
+
+// CHECK-LABEL:   func @torch.prim.TupleIndex(
+// CHECK-SAME:                                %[[ARG0:.*]]: !torch.tensor, %[[ARG1:.*]]: i64) -> i64 {
+// CHECK:           return %[[ARG1]] : i64
+func @torch.prim.TupleIndex(%arg0: !torch.tensor, %arg1: i64) -> i64 {
+  %c1_i64 = constant 1 : i64
+  %0 = basicpy.build_tuple %arg0, %arg1 : (!torch.tensor, i64) -> !basicpy.TupleType
+  %1 = torch.prim.TupleIndex %0, %c1_i64 : !basicpy.TupleType, i64 -> i64
+  return %1 : i64
+}
+
+// CHECK-LABEL:   func @torch.prim.TupleUnpack(
+// CHECK-SAME:                                 %[[ARG0:.*]]: !torch.tensor, %[[ARG1:.*]]: i64) -> (!torch.tensor, i64) {
+// CHECK:           return %[[ARG0]], %[[ARG1]] : !torch.tensor, i64
+func @torch.prim.TupleUnpack(%arg0: !torch.tensor, %arg1: i64) -> (!torch.tensor, i64) {
+  %0 = basicpy.build_tuple %arg0, %arg1 : (!torch.tensor, i64) -> !basicpy.TupleType
+  %1:2 = torch.prim.TupleUnpack %0 : !basicpy.TupleType -> !torch.tensor, i64
+  return %1#0, %1#1 : !torch.tensor, i64
+}
@@ -29,3 +29,52 @@ func @unable_to_convert_lone_tensor_load(%arg0: tensor<f32>) {
   "test.sink"(%0) : (!torch.vtensor<[],f32>) -> ()
   return
 }
+
+// -----
+
+// The casts on either side of the eliminated materializations fold.
+
+// CHECK-LABEL:   func @fold_cast_chains(
+// CHECK-SAME:                           %[[ARG:.*]]: tensor<2xf32>) -> tensor<?xf32> {
+// CHECK:           %[[CAST:.*]] = tensor.cast %[[ARG]] : tensor<2xf32> to tensor<?xf32>
+// CHECK:           return %[[CAST]] : tensor<?xf32>
+func @fold_cast_chains(%arg0: tensor<2xf32>) -> tensor<?xf32> {
+  %0 = tensor.cast %arg0 : tensor<2xf32> to tensor<?xf32>
+  %1 = torch.from_builtin_tensor %0 : tensor<?xf32> -> !torch.vtensor<[?],f32>
+  %2 = torch.to_builtin_tensor %1 : !torch.vtensor<[?],f32> -> tensor<?xf32>
+  %3 = tensor.cast %2 : tensor<?xf32> to tensor<?xf32>
+  return %3 : tensor<?xf32>
+}
+
+// -----
+
+// A chain refining an extent that neither end knows checks it: it stays.
+
+// CHECK-LABEL:   func @keep_refining_cast_chains(
+// CHECK:           tensor.cast %{{.*}} : tensor<?xf32> to tensor<2xf32>
+// CHECK:           tensor.cast %{{.*}} : tensor<2xf32> to tensor<?xf32>
+func @keep_refining_cast_chains(%arg0: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = tensor.cast %arg0 : tensor<?xf32> to tensor<2xf32>
+  %1 = tensor.cast %0 : tensor<2xf32> to tensor<?xf32>
+  return %1 : tensor<?xf32>
+}
+
+// -----
+
+// Linalg ops read their inputs with their static shapes.
+
+// CHECK-LABEL:   func @fold_casts_into_linalg_inputs(
+// CHECK-SAME:                                        %[[ARG:.*]]: tensor<2xf32>,
+// CHECK-SAME:                                        %[[INIT:.*]]: tensor<?xf32>) -> tensor<?xf32> {
+// CHECK:           %[[RESULT:.*]] = linalg.generic {{.*}} ins(%[[ARG]] : tensor<2xf32>) outs(%[[INIT]] : tensor<?xf32>)
+// CHECK:           return %[[RESULT]] : tensor<?xf32>
+#map = affine_map<(d0) -> (d0)>
+func @fold_casts_into_linalg_inputs(%arg0: tensor<2xf32>, %arg1: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = tensor.cast %arg0 : tensor<2xf32> to tensor<?xf32>
+  %1 = linalg.generic {indexing_maps = [#map, #map], iterator_types = ["parallel"]} ins(%0 : tensor<?xf32>) outs(%arg1 : tensor<?xf32>) {
+  ^bb0(%in: f32, %out: f32):
+    %2 = addf %in, %in : f32
+    linalg.yield %2 : f32
+  } -> tensor<?xf32>
+  return %1 : tensor<?xf32>
+}
@@ -0,0 +1,87 @@
+// RUN: npcomp-opt -torch-fold-batch-norm -split-input-file %s | FileCheck %s
+
+// CHECK-LABEL:   func @conv2d(
+// CHECK-SAME:                 %[[INPUT:.*]]: !torch.vtensor<[1,1,4,4],f32>) -> !torch.vtensor<[1,2,4,4],f32> {
+// CHECK-NOT:       torch.aten.batch_norm
+// CHECK:           %[[WEIGHT:.*]] = torch.tensor(dense<{{\[\[\[\[}}1.000000e+00]]], {{\[\[\[}}2.000000e+00]]]]> : tensor<2x1x1x1xf32>) : !torch.vtensor<[2,1,1,1],f32>
+// CHECK:           %[[BIAS:.*]] = torch.tensor(dense<5.000000e-01> : tensor<2xf32>) : !torch.vtensor<[2],f32>
+// CHECK:           %[[CONV:.*]] = torch.aten.conv2d %[[INPUT]], %[[WEIGHT]], %[[BIAS]]
+// CHECK-NOT:       torch.aten.batch_norm
+// CHECK:           return %[[CONV]] : !torch.vtensor<[1,2,4,4],f32>
+func @conv2d(%arg0: !torch.vtensor<[1,1,4,4],f32>) -> !torch.vtensor<[1,2,4,4],f32> {
+  %weight = torch.tensor(dense<2.0> : tensor<2x1x1x1xf32>) : !torch.tensor<[2,1,1,1],f32>
+  %weight_copy = torch.copy.tensor %weight : !torch.tensor<[2,1,1,1],f32> -> !torch.vtensor<[2,1,1,1],f32>
+  %bias = torch.tensor(dense<1.0> : tensor<2xf32>) : !torch.vtensor<[2],f32>
+  %gamma = torch.tensor(dense<[1.0, 2.0]> : tensor<2xf32>) : !torch.vtensor<[2],f32>
+  %beta = torch.tensor(dense<0.5> : tensor<2xf32>) : !torch.vtensor<[2],f32>
+  %mean = torch.tensor(dense<1.0> : tensor<2xf32>) : !torch.vtensor<[2],f32>
+  %var = torch.tensor(dense<3.0> : tensor<2xf32>) : !torch.vtensor<[2],f32>
+  %c1_i64 = constant 1 : i64
+  %c0_i64 = constant 0 : i64
+  %ones = torch.prim.ListConstruct %c1_i64, %c1_i64 : (i64, i64) -> !torch.list<i64>
+  %zeros = torch.prim.ListConstruct %c0_i64, %c0_i64 : (i64, i64) -> !torch.list<i64>
+  %0 = torch.aten.conv2d %arg0, %weight_copy, %bias, %ones, %zeros, %ones, %c1_i64 : !torch.vtensor<[1,1,4,4],f32>, !torch.vtensor<[2,1,1,1],f32>, !torch.vtensor<[2],f32>, !torch.list<i64>, !torch.list<i64>, !torch.list<i64>, i64 -> !torch.vtensor<[1,2,4,4],f32>
+  %false = basicpy.bool_constant false
+  %momentum = constant 1.000000e-01 : f64
+  %eps = constant 1.000000e+00 : f64
+  %1 = torch.aten.batch_norm %0, %gamma, %beta, %mean, %var, %false, %momentum, %eps, %false : !torch.vtensor<[1,2,4,4],f32>, !torch.vtensor<[2],f32>, !torch.vtensor<[2],f32>, !torch.vtensor<[2],f32>, !torch.vtensor<[2],f32>, !basicpy.BoolType, f64, f64, !basicpy.BoolType -> !torch.vtensor<[1,2,4,4],f32>
+  return %1 : !torch.vtensor<[1,2,4,4],f32>
+}
+
+// -----
+
+// The bias of aten.linear is created when it is None.
+// CHECK-LABEL:   func @linear_without_bias(
+// CHECK:           %[[BIAS:.*]] = torch.tensor(dense<[-1.000000e+00, 5.000000e-01]> : tensor<2xf32>) : !torch.vtensor<[2],f32>
+// CHECK:           %[[LINEAR:.*]] = torch.aten.linear %{{.*}}, %{{.*}}, %[[BIAS]]
+// CHECK:           return %[[LINEAR]]
+func @linear_without_bias(%arg0: !torch.vtensor<[?,3],f32>) -> !torch.vtensor<[?,2],f32> {
+  %weight = torch.tensor(dense<1.0> : tensor<2x3xf32>) : !torch.vtensor<[2,3],f32>
+  %none = basicpy.singleton : !basicpy.NoneType
+  %gamma = torch.tensor(dense<1.0> : tensor<2xf32>) : !torch.vtensor<[2],f32>
+  %beta = torch.tensor(dense<[0.0, 1.5]> : tensor<2xf32>) : !torch.vtensor<[2],f32>
+  %mean = torch.tensor(dense<1.0> : tensor<2xf32>) : !torch.vtensor<[2],f32>
+  %var = torch.tensor(dense<0.0> : tensor<2xf32>) : !torch.vtensor<[2],f32>
+  %0 = torch.aten.linear %arg0, %weight, %none : !torch.vtensor<[?,3],f32>, !torch.vtensor<[2,3],f32>, !basicpy.NoneType -> !torch.vtensor<[?,2],f32>
+  %false = basicpy.bool_constant false
+  %momentum = constant 1.000000e-01 : f64
+  %eps = constant 1.000000e+00 : f64
+  %1 = torch.aten.batch_norm %0, %gamma, %beta, %mean, %var, %false, %momentum, %eps, %false : !torch.vtensor<[?,2],f32>, !torch.vtensor<[2],f32>, !torch.vtensor<[2],f32>, !torch.vtensor<[2],f32>, !torch.vtensor<[2],f32>, !basicpy.BoolType, f64, f64, !basicpy.BoolType -> !torch.vtensor<[?,2],f32>
+  return %1 : !torch.vtensor<[?,2],f32>
+}
+
+// -----
+
+// Batch statistics are only known at runtime in training mode.
+// CHECK-LABEL:   func @training(
+// CHECK:           torch.aten.batch_norm
+func @training(%arg0: !torch.vtensor<[?,3],f32>) -> !torch.vtensor<[?,2],f32> {
+  %weight = torch.tensor(dense<1.0> : tensor<2x3xf32>) : !torch.vtensor<[2,3],f32>
+  %none = basicpy.singleton : !basicpy.NoneType
+  %param = torch.tensor(dense<1.0> : tensor<2xf32>) : !torch.vtensor<[2],f32>
+  %0 = torch.aten.linear %arg0, %weight, %none : !torch.vtensor<[?,3],f32>, !torch.vtensor<[2,3],f32>, !basicpy.NoneType -> !torch.vtensor<[?,2],f32>
+  %true = basicpy.bool_constant true
+  %momentum = constant 1.000000e-01 : f64
+  %eps = constant 1.000000e+00 : f64
+  %1 = torch.aten.batch_norm %0, %param, %param, %param, %param, %true, %momentum, %eps, %true : !torch.vtensor<[?,2],f32>, !torch.vtensor<[2],f32>, !torch.vtensor<[2],f32>, !torch.vtensor<[2],f32>, !torch.vtensor<[2],f32>, !basicpy.BoolType, f64, f64, !basicpy.BoolType -> !torch.vtensor<[?,2],f32>
+  return %1 : !torch.vtensor<[?,2],f32>
+}
+
+// -----
+
+// The weight can be modified, so it is not a constant.
+// CHECK-LABEL:   func @modified_weight(
+// CHECK:           torch.aten.batch_norm
+func @modified_weight(%arg0: !torch.vtensor<[?,3],f32>, %arg1: !torch.vtensor<[2,3],f32>) -> !torch.vtensor<[?,2],f32> {
+  %weight = torch.tensor(dense<1.0> : tensor<2x3xf32>) : !torch.tensor<[2,3],f32>
+  torch.overwrite.tensor %arg1 overwrites %weight : !torch.vtensor<[2,3],f32>, !torch.tensor<[2,3],f32>
+  %weight_copy = torch.copy.tensor %weight : !torch.tensor<[2,3],f32> -> !torch.vtensor<[2,3],f32>
+  %none = basicpy.singleton : !basicpy.NoneType
+  %param = torch.tensor(dense<1.0> : tensor<2xf32>) : !torch.vtensor<[2],f32>
+  %0 = torch.aten.linear %arg0, %weight_copy, %none : !torch.vtensor<[?,3],f32>, !torch.vtensor<[2,3],f32>, !basicpy.NoneType -> !torch.vtensor<[?,2],f32>
+  %false = basicpy.bool_constant false
+  %momentum = constant 1.000000e-01 : f64
+  %eps = constant 1.000000e+00 : f64
+  %1 = torch.aten.batch_norm %0, %param, %param, %param, %param, %false, %momentum, %eps, %false : !torch.vtensor<[?,2],f32>, !torch.vtensor<[2],f32>, !torch.vtensor<[2],f32>, !torch.vtensor<[2],f32>, !torch.vtensor<[2],f32>, !basicpy.BoolType, f64, f64, !basicpy.BoolType -> !torch.vtensor<[?,2],f32>
+  return %1 : !torch.vtensor<[?,2],f32>
+}
@@ -35,3 +35,45 @@ func @forward() -> (!torch.tensor, !torch.tensor, !torch.tensor) {
   // CHECK:           return %[[READONLY]], %[[PUBLIC]], %[[MUTATED]] : !torch.tensor, !torch.tensor, !torch.tensor
   return %0, %1, %2 : !torch.tensor, !torch.tensor, !torch.tensor
 }
+
+// -----
+
+// Each slot is materialized once per function, at the start of the function,
+// however many times and wherever it is read.
+
+torch.global_slot "private" @a : !torch.tensor  {
+  %0 = torch.tensor(dense<1.0> : tensor<1xf32>) : !torch.tensor
+  torch.global_slot.init %0 : !torch.tensor
+}
+torch.global_slot "private" @b : !torch.tensor  {
+  %0 = torch.tensor(dense<2.0> : tensor<1xf32>) : !torch.tensor
+  torch.global_slot.init %0 : !torch.tensor
+}
+
+// CHECK-LABEL:   func @multiple_reads(
+// CHECK-SAME:                         %[[COND:.*]]: i1) -> (!torch.tensor, !torch.tensor, !torch.tensor) {
+// CHECK:           %[[A:.*]] = torch.tensor(dense<1.000000e+00> : tensor<1xf32>) : !torch.tensor
+// CHECK:           %[[B:.*]] = torch.tensor(dense<2.000000e+00> : tensor<1xf32>) : !torch.tensor
+// CHECK-NOT:       torch.tensor(
+// CHECK:           %[[IF:.*]] = scf.if %[[COND]] -> (!torch.tensor) {
+// CHECK:             scf.yield %[[A]] : !torch.tensor
+// CHECK:           return %[[A]], %[[B]], %[[IF]]
+func @multiple_reads(%arg0: i1) -> (!torch.tensor, !torch.tensor, !torch.tensor) {
+  %0 = torch.global_slot.get @a : !torch.tensor
+  %1 = torch.global_slot.get @b : !torch.tensor
+  %2 = scf.if %arg0 -> (!torch.tensor) {
+    %3 = torch.global_slot.get @a : !torch.tensor
+    scf.yield %3 : !torch.tensor
+  } else {
+    scf.yield %1 : !torch.tensor
+  }
+  return %0, %1, %2 : !torch.tensor, !torch.tensor, !torch.tensor
+}
+
+// CHECK-LABEL:   func @other_function() -> !torch.tensor {
+// CHECK:           %[[A:.*]] = torch.tensor(dense<1.000000e+00> : tensor<1xf32>) : !torch.tensor
+// CHECK:           return %[[A]]
+func @other_function() -> !torch.tensor {
+  %0 = torch.global_slot.get @a : !torch.tensor
+  return %0 : !torch.tensor
+}
@@ -0,0 +1,64 @@
+// RUN: npcomp-opt -torch-lower-global-slots -split-input-file %s | FileCheck %s
+
+// CHECK: memref.global "private" @param : memref<3xf32> = dense<1.000000e+00>
+// CHECK-NOT: torch.global_slot
+torch.global_slot "private" @param : !torch.tensor {
+  %0 = torch.tensor(dense<1.0> : tensor<3xf32>) : !torch.tensor
+  torch.global_slot.init %0 : !torch.tensor
+}
+
+// CHECK-LABEL:   func @step(
+// CHECK-SAME:               %[[GRAD:.*]]: !torch.tensor) -> !torch.tensor {
+// CHECK:           %[[GLOBAL:.*]] = memref.get_global @param : memref<3xf32>
+// CHECK:           %[[COPY:.*]] = memref.alloc() : memref<3xf32>
+// CHECK:           linalg.copy(%[[GLOBAL]], %[[COPY]]) : memref<3xf32>, memref<3xf32>
+// CHECK:           %[[TENSOR:.*]] = memref.tensor_load %[[COPY]] : memref<3xf32>
+// CHECK:           %[[VTENSOR:.*]] = torch.from_builtin_tensor %[[TENSOR]] : tensor<3xf32> -> !torch.vtensor<[3],f32>
+// CHECK:           %[[NTENSOR:.*]] = torch.copy.tensor %[[VTENSOR]] : !torch.vtensor<[3],f32> -> !torch.tensor<[3],f32>
+// CHECK:           %[[PARAM:.*]] = torch.tensor_static_info_cast %[[NTENSOR]] : !torch.tensor<[3],f32> to !torch.tensor
+// CHECK:           %[[CAST:.*]] = torch.tensor_static_info_cast %[[GRAD]] : !torch.tensor to !torch.tensor<[3],f32>
+// CHECK:           %[[VALUE:.*]] = torch.copy.tensor %[[CAST]] : !torch.tensor<[3],f32> -> !torch.vtensor<[3],f32>
+// CHECK:           %[[BUILTIN:.*]] = torch.to_builtin_tensor %[[VALUE]] : !torch.vtensor<[3],f32> -> tensor<3xf32>
+// CHECK:           %[[SOURCE:.*]] = memref.buffer_cast %[[BUILTIN]] : memref<3xf32>
+// CHECK:           %[[DEST:.*]] = memref.get_global @param : memref<3xf32>
+// CHECK:           linalg.copy(%[[SOURCE]], %[[DEST]]) : memref<3xf32>, memref<3xf32>
+// CHECK:           return %[[PARAM]] : !torch.tensor
+func @step(%arg0: !torch.tensor) -> !torch.tensor {
+  %0 = torch.global_slot.get @param : !torch.tensor
+  torch.global_slot.set @param = %arg0 : !torch.tensor
+  return %0 : !torch.tensor
+}
+
+// -----
+
+// A private slot that is never set is read in place.
+
+// CHECK: memref.global "private" @readonly : memref<2xf32>
+torch.global_slot "private" @readonly : !torch.tensor {
+  %0 = torch.tensor(dense<0.0> : tensor<2xf32>) : !torch.tensor
+  torch.global_slot.init %0 : !torch.tensor
+}
+
+// CHECK-LABEL:   func @read() -> !torch.tensor {
+// CHECK:           %[[GLOBAL:.*]] = memref.get_global @readonly : memref<2xf32>
+// CHECK-NOT:       linalg.copy
+// CHECK:           memref.tensor_load %[[GLOBAL]] : memref<2xf32>
+func @read() -> !torch.tensor {
+  %0 = torch.global_slot.get @readonly : !torch.tensor
+  return %0 : !torch.tensor
+}
+
+// -----
+
+// Slots that are not tensor literals are left alone.
+
+// CHECK: torch.global_slot "private" @float : f64
+torch.global_slot "private" @float : f64 {
+  %0 = basicpy.numeric_constant 4.250000e+01 : f64
+  torch.global_slot.init %0 : f64
+}
+
+func @read_float() -> f64 {
+  %0 = torch.global_slot.get @float : f64
+  return %0 : f64
+}
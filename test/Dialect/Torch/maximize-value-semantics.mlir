@@ -20,3 +20,122 @@ func @local(%arg0: !torch.vtensor<[2,3,?],f32>) -> !torch.vtensor<[2,3,?],f32> {
   %4 = torch.copy.tensor %2 : !torch.tensor<[2,3,?],f32> -> !torch.vtensor<[2,3,?],f32>
   return %4 : !torch.vtensor<[2,3,?],f32>
 }
+
+// -----
+
+// An in-place update, as produced by ReduceOpVariants for `aten.add_`, of a
+// tensor that doesn't escape is rewritten to value semantics.
+
+// CHECK-LABEL:   func @inplace_update(
+// CHECK-SAME:                         %[[ARG:.*]]: !torch.vtensor<[2],f32>,
+// CHECK-SAME:                         %[[ALPHA:.*]]: i64) -> !torch.vtensor {
+// CHECK:           %[[ADD:.*]] = torch.aten.add.Tensor %[[ARG]], %[[ARG]], %[[ALPHA]] : !torch.vtensor<[2],f32>, !torch.vtensor<[2],f32>, i64 -> !torch.vtensor<[2],f32>
+// CHECK:           %[[TANH:.*]] = torch.aten.tanh %[[ADD]] : !torch.vtensor<[2],f32> -> !torch.vtensor<[2],f32>
+// CHECK:           %[[RET:.*]] = torch.tensor_static_info_cast %[[TANH]] : !torch.vtensor<[2],f32> to !torch.vtensor
+// CHECK:           return %[[RET]] : !torch.vtensor
+func @inplace_update(%arg0: !torch.vtensor<[2],f32>, %alpha: i64) -> !torch.vtensor {
+  %0 = torch.copy.tensor %arg0 : !torch.vtensor<[2],f32> -> !torch.tensor<[2],f32>
+  %1 = torch.copy.tensor %0 : !torch.tensor<[2],f32> -> !torch.vtensor<[2],f32>
+  %2 = torch.aten.add.Tensor %1, %1, %alpha : !torch.vtensor<[2],f32>, !torch.vtensor<[2],f32>, i64 -> !torch.vtensor<[2],f32>
+  torch.overwrite.tensor %2 overwrites %0 : !torch.vtensor<[2],f32>, !torch.tensor<[2],f32>
+  %3 = torch.tensor_static_info_cast %0 : !torch.tensor<[2],f32> to !torch.tensor
+  %4 = torch.copy.tensor %3 : !torch.tensor -> !torch.vtensor
+  %5 = torch.copy.tensor %0 : !torch.tensor<[2],f32> -> !torch.vtensor<[2],f32>
+  %6 = torch.aten.tanh %5 : !torch.vtensor<[2],f32> -> !torch.vtensor<[2],f32>
+  torch.overwrite.tensor %6 overwrites %3 : !torch.vtensor<[2],f32>, !torch.tensor
+  %7 = torch.copy.tensor %3 : !torch.tensor -> !torch.vtensor
+  return %7 : !torch.vtensor
+}
+
+// -----
+
+// A tensor that escapes (here, through the return) is kept as is.
+
+// CHECK-LABEL:   func @escapes(
+// CHECK:           torch.copy.tensor
+// CHECK:           torch.overwrite.tensor
+func @escapes(%arg0: !torch.vtensor<[2],f32>, %arg1: !torch.vtensor<[2],f32>) -> !torch.tensor<[2],f32> {
+  %0 = torch.copy.tensor %arg0 : !torch.vtensor<[2],f32> -> !torch.tensor<[2],f32>
+  torch.overwrite.tensor %arg1 overwrites %0 : !torch.vtensor<[2],f32>, !torch.tensor<[2],f32>
+  return %0 : !torch.tensor<[2],f32>
+}
+
+// -----
+
+// Loop-carried tensors and the tensors read in the loop body are converted
+// to value tensors.
+
+// CHECK-LABEL:   func @loop_carried(
+// CHECK-SAME:                       %[[ARG0:.*]]: !torch.vtensor<[2],f32>, %[[ARG1:.*]]: !torch.vtensor<[2],f32>,
+// CHECK-SAME:                       %[[N:.*]]: i64) -> !torch.vtensor<[2],f32> {
+// CHECK:           %[[TRUE:.*]] = basicpy.bool_constant true
+// CHECK:           %[[LOOP:.*]] = torch.prim.Loop %[[N]], %[[TRUE]], init(%[[ARG0]])  {
+// CHECK:           ^bb0(%[[IV:.*]]: i64, %[[H:.*]]: !torch.vtensor<[2],f32>):
+// CHECK:             %[[ADD:.*]] = torch.aten.add.Tensor %[[H]], %[[ARG1]], %[[N]] : !torch.vtensor<[2],f32>, !torch.vtensor<[2],f32>, i64 -> !torch.vtensor<[2],f32>
+// CHECK:             %[[TANH:.*]] = torch.aten.tanh %[[ADD]] : !torch.vtensor<[2],f32> -> !torch.vtensor<[2],f32>
+// CHECK:             torch.prim.Loop.condition %[[TRUE]], iter(%[[TANH]] : !torch.vtensor<[2],f32>)
+// CHECK:           } : (i64, !basicpy.BoolType, !torch.vtensor<[2],f32>) -> !torch.vtensor<[2],f32>
+// CHECK:           return %[[LOOP]] : !torch.vtensor<[2],f32>
+func @loop_carried(%arg0: !torch.vtensor<[2],f32>, %arg1: !torch.vtensor<[2],f32>, %n: i64) -> !torch.vtensor<[2],f32> {
+  %true = basicpy.bool_constant true
+  %0 = torch.copy.tensor %arg0 : !torch.vtensor<[2],f32> -> !torch.tensor<[2],f32>
+  %1 = torch.copy.tensor %arg1 : !torch.vtensor<[2],f32> -> !torch.tensor<[2],f32>
+  %2 = torch.prim.Loop %n, %true, init(%0) {
+  ^bb0(%iv: i64, %h: !torch.tensor<[2],f32>):
+    %3 = torch.copy.tensor %h : !torch.tensor<[2],f32> -> !torch.vtensor<[2],f32>
+    %4 = torch.copy.tensor %1 : !torch.tensor<[2],f32> -> !torch.vtensor<[2],f32>
+    %5 = torch.aten.add.Tensor %3, %4, %n : !torch.vtensor<[2],f32>, !torch.vtensor<[2],f32>, i64 -> !torch.vtensor<[2],f32>
+    %6 = torch.aten.tanh %5 : !torch.vtensor<[2],f32> -> !torch.vtensor<[2],f32>
+    %7 = torch.copy.tensor %6 : !torch.vtensor<[2],f32> -> !torch.tensor<[2],f32>
+    torch.prim.Loop.condition %true, iter(%7 : !torch.tensor<[2],f32>)
+  } : (i64, !basicpy.BoolType, !torch.tensor<[2],f32>) -> !torch.tensor<[2],f32>
+  %8 = torch.copy.tensor %2 : !torch.tensor<[2],f32> -> !torch.vtensor<[2],f32>
+  return %8 : !torch.vtensor<[2],f32>
+}
+
+// -----
+
+// A loop-carried tensor that is overwritten in the loop body is kept as is.
+
+// CHECK-LABEL:   func @loop_carried_overwritten(
+// CHECK:           torch.prim.Loop
+// CHECK:             torch.overwrite.tensor
+// CHECK:           } : (i64, !basicpy.BoolType, !torch.tensor<[2],f32>) -> !torch.tensor<[2],f32>
+func @loop_carried_overwritten(%arg0: !torch.vtensor<[2],f32>, %n: i64) -> !torch.vtensor<[2],f32> {
+  %true = basicpy.bool_constant true
+  %0 = torch.copy.tensor %arg0 : !torch.vtensor<[2],f32> -> !torch.tensor<[2],f32>
+  %1 = torch.prim.Loop %n, %true, init(%0) {
+  ^bb0(%iv: i64, %h: !torch.tensor<[2],f32>):
+    %2 = torch.copy.tensor %h : !torch.tensor<[2],f32> -> !torch.vtensor<[2],f32>
+    %3 = torch.aten.tanh %2 : !torch.vtensor<[2],f32> -> !torch.vtensor<[2],f32>
+    torch.overwrite.tensor %3 overwrites %h : !torch.vtensor<[2],f32>, !torch.tensor<[2],f32>
+    torch.prim.Loop.condition %true, iter(%h : !torch.tensor<[2],f32>)
+  } : (i64, !basicpy.BoolType, !torch.tensor<[2],f32>) -> !torch.tensor<[2],f32>
+  %4 = torch.copy.tensor %1 : !torch.tensor<[2],f32> -> !torch.vtensor<[2],f32>
+  return %4 : !torch.vtensor<[2],f32>
+}
+
+// -----
+
+// CHECK-LABEL:   func @if_result(
+// CHECK-SAME:                    %[[COND:.*]]: i1,
+// CHECK-SAME:                    %[[ARG:.*]]: !torch.vtensor<[2],f32>) -> !torch.vtensor<[2],f32> {
+// CHECK:           %[[IF:.*]] = scf.if %[[COND]] -> (!torch.vtensor<[2],f32>) {
+// CHECK:             %[[TANH:.*]] = torch.aten.tanh %[[ARG]] : !torch.vtensor<[2],f32> -> !torch.vtensor<[2],f32>
+// CHECK:             scf.yield %[[TANH]] : !torch.vtensor<[2],f32>
+// CHECK:           } else {
+// CHECK:             scf.yield %[[ARG]] : !torch.vtensor<[2],f32>
+// CHECK:           }
+// CHECK:           return %[[IF]] : !torch.vtensor<[2],f32>
+func @if_result(%cond: i1, %arg0: !torch.vtensor<[2],f32>) -> !torch.vtensor<[2],f32> {
+  %0 = scf.if %cond -> (!torch.tensor<[2],f32>) {
+    %1 = torch.aten.tanh %arg0 : !torch.vtensor<[2],f32> -> !torch.vtensor<[2],f32>
+    %2 = torch.copy.tensor %1 : !torch.vtensor<[2],f32> -> !torch.tensor<[2],f32>
+    scf.yield %2 : !torch.tensor<[2],f32>
+  } else {
+    %1 = torch.copy.tensor %arg0 : !torch.vtensor<[2],f32> -> !torch.tensor<[2],f32>
+    scf.yield %1 : !torch.tensor<[2],f32>
+  }
+  %3 = torch.copy.tensor %0 : !torch.tensor<[2],f32> -> !torch.vtensor<[2],f32>
+  return %3 : !torch.vtensor<[2],f32>
+}
@@ -0,0 +1,55 @@
+// RUN: npcomp-opt -torch-propagate-global-constants -split-input-file %s | FileCheck %s
+
+// The training branch is folded away, after which the running mean is no
+// longer written and is inlined, and the weight only used for training is
+// removed.
+
+// CHECK-NOT:     torch.global_slot
+// CHECK-LABEL:   func @forward() -> !torch.tensor {
+// CHECK-NEXT:      %[[MEAN:.*]] = torch.tensor(dense<0.000000e+00> : tensor<3xf32>) : !torch.tensor
+// CHECK-NEXT:      return %[[MEAN]] : !torch.tensor
+torch.global_slot "private" @training : !basicpy.BoolType  {
+  %0 = basicpy.bool_constant false
+  torch.global_slot.init %0 : !basicpy.BoolType
+}
+torch.global_slot "private" @running_mean : !torch.tensor  {
+  %0 = torch.tensor(dense<0.0> : tensor<3xf32>) : !torch.tensor
+  torch.global_slot.init %0 : !torch.tensor
+}
+torch.global_slot "private" @training_only : !torch.tensor  {
+  %0 = torch.tensor(dense<1.0> : tensor<3xf32>) : !torch.tensor
+  torch.global_slot.init %0 : !torch.tensor
+}
+func @forward() -> !torch.tensor {
+  %0 = torch.global_slot.get @training : !basicpy.BoolType
+  %1 = basicpy.bool_cast %0 : !basicpy.BoolType -> i1
+  scf.if %1 {
+    %2 = torch.global_slot.get @training_only : !torch.tensor
+    torch.global_slot.set @running_mean = %2 : !torch.tensor
+  }
+  %3 = torch.global_slot.get @running_mean : !torch.tensor
+  %4 = torch.global_slot.get @training_only : !torch.tensor
+  return %3 : !torch.tensor
+}
+
+// -----
+
+// Branches on values only known at runtime are kept, along with the slots they
+// write.
+
+// CHECK-LABEL:   torch.global_slot "private" @counter
+torch.global_slot "private" @counter : !torch.tensor  {
+  %0 = torch.tensor(dense<0.0> : tensor<1xf32>) : !torch.tensor
+  torch.global_slot.init %0 : !torch.tensor
+}
+// CHECK-LABEL:   func @step(
+// CHECK:           scf.if
+// CHECK:             torch.global_slot.set @counter
+// CHECK:           torch.global_slot.get @counter
+func @step(%arg0: i1, %arg1: !torch.tensor) -> !torch.tensor {
+  scf.if %arg0 {
+    torch.global_slot.set @counter = %arg1 : !torch.tensor
+  }
+  %0 = torch.global_slot.get @counter : !torch.tensor
+  return %0 : !torch.tensor
+}
@@ -0,0 +1,46 @@
+// RUN: npcomp-opt -torch-prune-to-entry-points='entry-points=forward' -symbol-dce -split-input-file -verify-diagnostics %s | FileCheck %s
+
+// Only the entry point and the slots it reads (directly or through calls) are
+// kept.
+
+// CHECK-NOT:     @unused_weight
+// CHECK-NOT:     @exported_attr
+// CHECK-LABEL:   torch.global_slot "private" @weight
+// CHECK-NOT:     @unused_weight
+// CHECK-NOT:     @exported_attr
+// CHECK-LABEL:   func @forward
+// CHECK-LABEL:   func private @helper
+// CHECK-NOT:     @train
+torch.global_slot "private" @unused_weight : !torch.tensor  {
+  %0 = torch.tensor(dense<0.0> : tensor<3xf32>) : !torch.tensor
+  torch.global_slot.init %0 : !torch.tensor
+}
+torch.global_slot @weight : !torch.tensor  {
+  %0 = torch.tensor(dense<1.0> : tensor<3xf32>) : !torch.tensor
+  torch.global_slot.init %0 : !torch.tensor
+}
+torch.global_slot @exported_attr : !torch.tensor  {
+  %0 = torch.tensor(dense<2.0> : tensor<3xf32>) : !torch.tensor
+  torch.global_slot.init %0 : !torch.tensor
+}
+func @forward() -> !torch.tensor {
+  %0 = call @helper() : () -> !torch.tensor
+  return %0 : !torch.tensor
+}
+func private @helper() -> !torch.tensor {
+  %0 = torch.global_slot.get @weight : !torch.tensor
+  return %0 : !torch.tensor
+}
+func @train() -> !torch.tensor {
+  %0 = torch.global_slot.get @unused_weight : !torch.tensor
+  return %0 : !torch.tensor
+}
+
+// -----
+
+// expected-error @+1 {{entry point 'forward' is not a public function of the module}}
+module {
+  func private @forward() {
+    return
+  }
+}
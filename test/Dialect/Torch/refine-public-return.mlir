@@ -12,6 +12,18 @@ func @basic(%arg0: !torch.vtensor<[2,3,?],f32>) -> !torch.tensor {
   return %2 : !torch.tensor
 }
 
+// CHECK-LABEL:   func @cast_chain(
+// CHECK-SAME:                     %[[ARG:.*]]: !torch.vtensor<[2,3],f32>) -> !torch.vtensor<[2,3],f32> {
+// CHECK:           %[[COPIED:.*]] = torch.copy.tensor %[[ARG]] : !torch.vtensor<[2,3],f32> -> !torch.tensor<[2,3],f32>
+// CHECK:           %[[COPIED_VALUE:.*]] = torch.copy.tensor %[[COPIED]] : !torch.tensor<[2,3],f32> -> !torch.vtensor<[2,3],f32>
+// CHECK:           return %[[COPIED_VALUE]] : !torch.vtensor<[2,3],f32>
+func @cast_chain(%arg0: !torch.vtensor<[2,3],f32>) -> !torch.tensor {
+  %0 = torch.copy.tensor %arg0 : !torch.vtensor<[2,3],f32> -> !torch.tensor<[2,3],f32>
+  %1 = torch.tensor_static_info_cast %0 : !torch.tensor<[2,3],f32> to !torch.tensor<[?,?],f32>
+  %2 = torch.tensor_static_info_cast %1 : !torch.tensor<[?,?],f32> to !torch.tensor
+  return %2 : !torch.tensor
+}
+
 // No conversion on private function.
 // CHECK-LABEL:   func private @basic_private(
 // CHECK-SAME:                                %[[ARG:.*]]: !torch.vtensor<[2,3,?],f32>) -> !torch.tensor {
@@ -41,8 +41,8 @@ func @f(%arg0: !torch.vtensor<[2,3,?],f32>) -> !torch.vtensor {
 // CHECK-LABEL:   func @f(
 // CHECK-SAME:            %[[LHS:.*]]: !torch.vtensor<[2,?],f32>,
 // CHECK-SAME:            %[[RHS:.*]]: !torch.vtensor<[?,?],f32>) -> !torch.vtensor {
-// CHECK:           %[[MM:.*]] = torch.aten.mm %[[LHS]], %[[RHS]] : !torch.vtensor<[2,?],f32>, !torch.vtensor<[?,?],f32> -> !torch.vtensor<[?,?],f32>
-// CHECK:           %[[SHAPE_ERASED:.*]] = torch.tensor_static_info_cast %[[MM]] : !torch.vtensor<[?,?],f32> to !torch.vtensor
+// CHECK:           %[[MM:.*]] = torch.aten.mm %[[LHS]], %[[RHS]] : !torch.vtensor<[2,?],f32>, !torch.vtensor<[?,?],f32> -> !torch.vtensor<[2,?],f32>
+// CHECK:           %[[SHAPE_ERASED:.*]] = torch.tensor_static_info_cast %[[MM]] : !torch.vtensor<[2,?],f32> to !torch.vtensor
 // CHECK:           return %[[SHAPE_ERASED]] : !torch.vtensor
 func @f(%arg0: !torch.vtensor<[2,?],f32>, %arg1: !torch.vtensor<[?,?],f32>) -> !torch.vtensor {
   %1 = torch.aten.mm %arg0, %arg1 : !torch.vtensor<[2,?],f32>, !torch.vtensor<[?,?],f32> -> !torch.vtensor
@@ -51,12 +51,56 @@ func @f(%arg0: !torch.vtensor<[2,?],f32>, %arg1: !torch.vtensor<[?,?],f32>) -> !
 
 // -----
 
+// CHECK-LABEL:   func @mm_static(
+// CHECK:           torch.aten.mm {{.*}} -> !torch.vtensor<[2,4],f32>
+func @mm_static(%arg0: !torch.vtensor<[2,3],f32>, %arg1: !torch.vtensor<[3,4],f32>) -> !torch.vtensor {
+  %1 = torch.aten.mm %arg0, %arg1 : !torch.vtensor<[2,3],f32>, !torch.vtensor<[3,4],f32> -> !torch.vtensor
+  return %1 : !torch.vtensor
+}
+
+// CHECK-LABEL:   func @mm_invalid_rank(
+// CHECK:           torch.aten.mm {{.*}} -> !torch.vtensor<[?,?],f32>
+func @mm_invalid_rank(%arg0: !torch.vtensor<[],f32>, %arg1: !torch.vtensor<[],f32>) -> !torch.vtensor {
+  %1 = torch.aten.mm %arg0, %arg1 : !torch.vtensor<[],f32>, !torch.vtensor<[],f32> -> !torch.vtensor
+  return %1 : !torch.vtensor
+}
+
+// -----
+
+// CHECK-LABEL:   func @bmm(
+// CHECK:           torch.aten.bmm {{.*}} -> !torch.vtensor<[8,2,4],f32>
+func @bmm(%arg0: !torch.vtensor<[8,2,3],f32>, %arg1: !torch.vtensor<[8,3,4],f32>) -> !torch.vtensor {
+  %1 = torch.aten.bmm %arg0, %arg1 : !torch.vtensor<[8,2,3],f32>, !torch.vtensor<[8,3,4],f32> -> !torch.vtensor
+  return %1 : !torch.vtensor
+}
+
+// CHECK-LABEL:   func @matmul(
+// CHECK:           torch.aten.matmul {{.*}} -> !torch.vtensor<[2,4],f32>
+// CHECK:           torch.aten.matmul {{.*}} -> !torch.vtensor<[8,2,4],f32>
+// CHECK:           torch.aten.matmul {{.*}} -> !torch.vtensor<[8,?,4],f32>
+func @matmul(%arg0: !torch.vtensor<[2,3],f32>, %arg1: !torch.vtensor<[3,4],f32>, %arg2: !torch.vtensor<[8,2,3],f32>, %arg3: !torch.vtensor<[8,3,4],f32>, %arg4: !torch.vtensor<[8,?,3],f32>) -> (!torch.vtensor, !torch.vtensor, !torch.vtensor) {
+  %0 = torch.aten.matmul %arg0, %arg1 : !torch.vtensor<[2,3],f32>, !torch.vtensor<[3,4],f32> -> !torch.vtensor
+  %1 = torch.aten.matmul %arg2, %arg3 : !torch.vtensor<[8,2,3],f32>, !torch.vtensor<[8,3,4],f32> -> !torch.vtensor
+  %2 = torch.aten.matmul %arg4, %arg1 : !torch.vtensor<[8,?,3],f32>, !torch.vtensor<[3,4],f32> -> !torch.vtensor
+  return %0, %1, %2 : !torch.vtensor, !torch.vtensor, !torch.vtensor
+}
+
+// The result rank of other operand ranks isn't refined.
+// CHECK-LABEL:   func @matmul_vector(
+// CHECK:           torch.aten.matmul {{.*}} -> !torch.vtensor<*,f32>
+func @matmul_vector(%arg0: !torch.vtensor<[2,3],f32>, %arg1: !torch.vtensor<[3],f32>) -> !torch.vtensor {
+  %0 = torch.aten.matmul %arg0, %arg1 : !torch.vtensor<[2,3],f32>, !torch.vtensor<[3],f32> -> !torch.vtensor
+  return %0 : !torch.vtensor
+}
+
+// -----
+
 // CHECK-LABEL:   func @f(
 // CHECK-SAME:            %[[INPUT:.*]]: !torch.vtensor<[?,3],f32>,
 // CHECK-SAME:            %[[WEIGHT:.*]]: !torch.vtensor<[5,3],f32>,
 // CHECK-SAME:            %[[BIAS:.*]]: !torch.vtensor<[5],f32>) -> !torch.vtensor {
-// CHECK:           %[[LINEAR:.*]] = torch.aten.linear %[[INPUT]], %[[WEIGHT]], %[[BIAS]] : !torch.vtensor<[?,3],f32>, !torch.vtensor<[5,3],f32>, !torch.vtensor<[5],f32> -> !torch.vtensor<[?,?],f32>
-// CHECK:           %[[SHAPE_ERASED:.*]] = torch.tensor_static_info_cast %[[LINEAR]] : !torch.vtensor<[?,?],f32> to !torch.vtensor
+// CHECK:           %[[LINEAR:.*]] = torch.aten.linear %[[INPUT]], %[[WEIGHT]], %[[BIAS]] : !torch.vtensor<[?,3],f32>, !torch.vtensor<[5,3],f32>, !torch.vtensor<[5],f32> -> !torch.vtensor<[?,5],f32>
+// CHECK:           %[[SHAPE_ERASED:.*]] = torch.tensor_static_info_cast %[[LINEAR]] : !torch.vtensor<[?,5],f32> to !torch.vtensor
 // CHECK:           return %[[SHAPE_ERASED]] : !torch.vtensor
 func @f(%arg0: !torch.vtensor<[?,3],f32>, %arg1: !torch.vtensor<[5,3],f32>, %arg2: !torch.vtensor<[5],f32>) -> !torch.vtensor {
   %1 = torch.aten.linear %arg0, %arg1, %arg2 : !torch.vtensor<[?,3],f32>, !torch.vtensor<[5,3],f32>, !torch.vtensor<[5],f32> -> !torch.vtensor
@@ -93,6 +137,31 @@ func @g(%arg0:!torch.vtensor<*,f32>, %arg1:!torch.vtensor<*,f32>, %arg2:!torch.v
   return %3 :!torch.vtensor
 }
 
+// CHECK-LABEL: func @embedding
+// CHECK:           torch.aten.embedding{{.*}} -> !torch.vtensor<[2,?,8],f32>
+// CHECK:           torch.aten.index_select{{.*}} -> !torch.vtensor<[10,3],f32>
+func @embedding(%arg0: !torch.vtensor<[10,8],f32>, %arg1: !torch.vtensor<[2,?],si64>, %arg2: !torch.vtensor<[3],si64>) -> (!torch.vtensor, !torch.vtensor) {
+  %c-1_i64 = constant -1 : i64
+  %false = basicpy.bool_constant false
+  %0 = torch.aten.embedding %arg0, %arg1, %c-1_i64, %false, %false : !torch.vtensor<[10,8],f32>, !torch.vtensor<[2,?],si64>, i64, !basicpy.BoolType, !basicpy.BoolType -> !torch.vtensor
+  %1 = torch.aten.index_select %arg0, %c-1_i64, %arg2 : !torch.vtensor<[10,8],f32>, i64, !torch.vtensor<[3],si64> -> !torch.vtensor
+  return %0, %1 : !torch.vtensor, !torch.vtensor
+}
+
+// -----
+
+// CHECK-LABEL: func @conv2d_static
+// CHECK:           torch.aten.conv2d{{.*}} -> !torch.vtensor<[2,16,8,?],f32>
+func @conv2d_static(%arg0:!torch.vtensor<[2,3,16,?],f32>, %arg1:!torch.vtensor<[16,3,3,3],f32>, %arg2:!torch.vtensor<[16],f32>) ->!torch.vtensor {
+  %c1_i64 = constant 1 : i64
+  %c2_i64 = constant 2 : i64
+  %0 = torch.prim.ListConstruct %c2_i64, %c2_i64 : (i64, i64) -> !torch.list<i64>
+  %1 = torch.prim.ListConstruct %c1_i64, %c1_i64 : (i64, i64) -> !torch.list<i64>
+  %2 = torch.prim.ListConstruct %c1_i64, %c1_i64 : (i64, i64) -> !torch.list<i64>
+  %3 = torch.aten.conv2d %arg0, %arg1, %arg2, %0, %1, %2, %c1_i64 : !torch.vtensor<[2,3,16,?],f32>, !torch.vtensor<[16,3,3,3],f32>, !torch.vtensor<[16],f32>, !torch.list<i64>, !torch.list<i64>, !torch.list<i64>, i64 ->!torch.vtensor
+  return %3 :!torch.vtensor
+}
+
 // -----
 
 // CHECK-LABEL: func @f
@@ -116,7 +185,7 @@ func @f(%arg0: !torch.vtensor<[?,?,?,?],f32>) -> !torch.vtensor {
 func @f(%arg0: !torch.vtensor<[?,?,?,?],f32>) -> !torch.vtensor {
   %c1_i64 = constant 1 : i64
   %0 = torch.prim.ListConstruct %c1_i64, %c1_i64 : (i64, i64) -> !torch.list<i64>
-  // CHECK: torch.aten.adaptive_avg_pool2d{{.*}} -> !torch.vtensor<[?,?,?,?],f32>
+  // CHECK: torch.aten.adaptive_avg_pool2d{{.*}} -> !torch.vtensor<[?,?,1,1],f32>
   %1 = torch.aten.adaptive_avg_pool2d %arg0, %0 : !torch.vtensor<[?,?,?,?],f32>, !torch.list<i64> -> !torch.vtensor
   return %1 : !torch.vtensor
 }
@@ -155,18 +224,78 @@ func @flatten_rank0(%arg0: !torch.tensor<[],f32>) -> !torch.tensor {
 
 // -----
 
+// CHECK-LABEL:   func @transpose(
+// CHECK:           torch.aten.transpose.int{{.*}}-> !torch.tensor<[3,5,?,2],f32>
+func @transpose(%arg0: !torch.tensor<[3,2,?,5],f32>) -> !torch.tensor {
+  %c1_i64 = constant 1 : i64
+  %c-1_i64 = constant -1 : i64
+  %0 = torch.aten.transpose.int %arg0, %c1_i64, %c-1_i64 : !torch.tensor<[3,2,?,5],f32>, i64, i64 -> !torch.tensor
+  return %0 : !torch.tensor
+}
+
+// CHECK-LABEL:   func @permute(
+// CHECK:           torch.aten.permute{{.*}}-> !torch.vtensor<[5,3,2,?],f32>
+func @permute(%arg0: !torch.vtensor<[3,2,?,5],f32>) -> !torch.vtensor {
+  %c0_i64 = constant 0 : i64
+  %c1_i64 = constant 1 : i64
+  %c2_i64 = constant 2 : i64
+  %c3_i64 = constant 3 : i64
+  %0 = torch.prim.ListConstruct %c3_i64, %c0_i64, %c1_i64, %c2_i64 : (i64, i64, i64, i64) -> !torch.list<i64>
+  %1 = torch.aten.permute %arg0, %0 : !torch.vtensor<[3,2,?,5],f32>, !torch.list<i64> -> !torch.vtensor
+  return %1 : !torch.vtensor
+}
+
+// -----
+
+// CHECK-LABEL:   func @slice_and_select(
+// CHECK:           torch.aten.slice.Tensor{{.*}} -> !torch.vtensor<[3,?,5],f32>
+// CHECK:           torch.aten.select.int{{.*}} -> !torch.vtensor<[3,5],f32>
+func @slice_and_select(%arg0: !torch.vtensor<[3,4,5],f32>, %arg1: i64) -> (!torch.vtensor, !torch.vtensor) {
+  %c1_i64 = constant 1 : i64
+  %none = basicpy.singleton : !basicpy.NoneType
+  %0 = torch.aten.slice.Tensor %arg0, %c1_i64, %arg1, %none, %c1_i64 : !torch.vtensor<[3,4,5],f32>, i64, i64, !basicpy.NoneType, i64 -> !torch.vtensor
+  %1 = torch.aten.select.int %arg0, %c1_i64, %arg1 : !torch.vtensor<[3,4,5],f32>, i64, i64 -> !torch.vtensor
+  return %0, %1 : !torch.vtensor, !torch.vtensor
+}
+
+// -----
+
 // CHECK-LABEL: func @f
 func @f(%arg0: !torch.vtensor<[4,6,3],f32>, %arg1: !torch.vtensor<[1,1,3],f32>, %arg2: !torch.vtensor<[?,3],f32>) {
   %c1_i64 = constant 1 : i64
-  // CHECK: torch.aten.add{{.*}} -> !torch.vtensor<[?,?,?],f32>
+  // CHECK: torch.aten.add{{.*}} -> !torch.vtensor<[4,6,3],f32>
   %0 = torch.aten.add.Tensor %arg0, %arg1, %c1_i64 : !torch.vtensor<[4,6,3],f32>, !torch.vtensor<[1,1,3],f32>, i64 -> !torch.vtensor
-  // CHECK: torch.aten.add{{.*}} -> !torch.vtensor<[?,?,?],f32>
+  // CHECK: torch.aten.add{{.*}} -> !torch.vtensor<[4,6,3],f32>
   %1 = torch.aten.add.Tensor %arg0, %arg2, %c1_i64 : !torch.vtensor<[4,6,3],f32>, !torch.vtensor<[?,3],f32>, i64 -> !torch.vtensor
+  // CHECK: torch.aten.add{{.*}} -> !torch.vtensor<[1,?,3],f32>
+  %2 = torch.aten.add.Tensor %arg1, %arg2, %c1_i64 : !torch.vtensor<[1,1,3],f32>, !torch.vtensor<[?,3],f32>, i64 -> !torch.vtensor
+  return
+}
+
+// -----
+
+// Comparisons broadcast like the arithmetic ops, and produce bools.
+// CHECK-LABEL: func @comparison
+func @comparison(%arg0: !torch.vtensor<[4,6,3],f32>, %arg1: !torch.vtensor<[?,3],f32>) {
+  // CHECK: torch.aten.mul.Tensor{{.*}} -> !torch.vtensor<[4,6,3],f32>
+  %0 = torch.aten.mul.Tensor %arg0, %arg1 : !torch.vtensor<[4,6,3],f32>, !torch.vtensor<[?,3],f32> -> !torch.vtensor
+  // CHECK: torch.aten.gt.Tensor{{.*}} -> !torch.vtensor<[4,6,3],i1>
+  %1 = torch.aten.gt.Tensor %arg0, %arg1 : !torch.vtensor<[4,6,3],f32>, !torch.vtensor<[?,3],f32> -> !torch.vtensor
   return
 }
 
 // -----
 
+// The in-place variants return `self`.
+// CHECK-LABEL: func @in_place_variant
+func @in_place_variant(%arg0: !torch.tensor<[2,3],f32>) -> !torch.tensor {
+  // CHECK: torch.aten.tanh_ %{{.*}} : !torch.tensor<[2,3],f32> -> !torch.tensor<[2,3],f32>
+  %0 = torch.aten.tanh_ %arg0 : !torch.tensor<[2,3],f32> -> !torch.tensor
+  return %0 : !torch.tensor
+}
+
+// -----
+
 // CHECK-LABEL:   func @f
 func @f(%arg0: !torch.vtensor<[2,3,?],f32>) -> !torch.vtensor {
   // Check propagation through multiple ops.
@@ -227,3 +356,29 @@ func @f() {
   }
   return
 }
+
+// -----
+
+// CHECK-LABEL: func @softmax
+// CHECK:           torch.aten.softmax.int {{.*}} -> !torch.vtensor<[2,?],f32>
+// CHECK:           torch.aten.log_softmax.int {{.*}} -> !torch.vtensor<[2,?],unk>
+func @softmax(%arg0: !torch.vtensor<[2,?],f32>, %dtype: i64) -> (!torch.vtensor, !torch.vtensor) {
+  %c1_i64 = constant 1 : i64
+  %none = basicpy.singleton : !basicpy.NoneType
+  %0 = torch.aten.softmax.int %arg0, %c1_i64, %none : !torch.vtensor<[2,?],f32>, i64, !basicpy.NoneType -> !torch.vtensor
+  %1 = torch.aten.log_softmax.int %arg0, %c1_i64, %dtype : !torch.vtensor<[2,?],f32>, i64, i64 -> !torch.vtensor
+  return %0, %1 : !torch.vtensor, !torch.vtensor
+}
+
+// CHECK-LABEL:   func @cat(
+// CHECK:           torch.aten.cat{{.*}} -> !torch.vtensor<[2,7],f32>
+// CHECK:           torch.aten.cat{{.*}} -> !torch.vtensor<[?,3],f32>
+func @cat(%arg0: !torch.vtensor<[2,3],f32>, %arg1: !torch.vtensor<[2,4],f32>, %arg2: !torch.vtensor<[?,3],f32>) -> (!torch.vtensor, !torch.vtensor) {
+  %c1_i64 = constant 1 : i64
+  %c0_i64 = constant 0 : i64
+  %0 = torch.prim.ListConstruct %arg0, %arg1 : (!torch.vtensor<[2,3],f32>, !torch.vtensor<[2,4],f32>) -> !torch.list<!torch.vtensor>
+  %1 = torch.aten.cat %0, %c1_i64 : !torch.list<!torch.vtensor>, i64 -> !torch.vtensor
+  %2 = torch.prim.ListConstruct %arg0, %arg2 : (!torch.vtensor<[2,3],f32>, !torch.vtensor<[?,3],f32>) -> !torch.list<!torch.vtensor>
+  %3 = torch.aten.cat %2, %c0_i64 : !torch.list<!torch.vtensor>, i64 -> !torch.vtensor
+  return %1, %3 : !torch.vtensor, !torch.vtensor
+}
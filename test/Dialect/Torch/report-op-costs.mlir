@@ -0,0 +1,20 @@
+// RUN: npcomp-opt -torch-report-op-costs -split-input-file -verify-diagnostics %s
+
+// expected-remark @+1 {{total flops: 1088, total bytes: 1408}}
+func @costs(%arg0: !torch.vtensor<[4,8],f32>, %arg1: !torch.vtensor<[8,16],f32>) -> !torch.vtensor<[4,16],f32> {
+  // expected-remark @+1 {{flops: 1024, bytes: 896}}
+  %0 = torch.aten.mm %arg0, %arg1 : !torch.vtensor<[4,8],f32>, !torch.vtensor<[8,16],f32> -> !torch.vtensor<[4,16],f32>
+  // expected-remark @+1 {{flops: 64, bytes: 512}}
+  %1 = torch.aten.tanh %0 : !torch.vtensor<[4,16],f32> -> !torch.vtensor<[4,16],f32>
+  return %1 : !torch.vtensor<[4,16],f32>
+}
+
+// -----
+
+// Costs depending on unknown sizes are unknown.
+// expected-remark @+1 {{total flops: ?, total bytes: ?}}
+func @unknown_sizes(%arg0: !torch.vtensor<[?,8],f32>) -> !torch.vtensor<[?,8],f32> {
+  // expected-remark @+1 {{flops: ?, bytes: ?}}
+  %0 = torch.aten.relu %arg0 : !torch.vtensor<[?,8],f32> -> !torch.vtensor<[?,8],f32>
+  return %0 : !torch.vtensor<[?,8],f32>
+}
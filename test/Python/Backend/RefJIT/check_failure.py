@@ -0,0 +1,27 @@
+# RUN: %PYTHON %s | FileCheck %s --dump-input=fail
+
+import numpy as np
+
+from npcomp.compiler.generic.backend.refjit import create_compilation_service
+
+SOURCE = """
+func @add(%arg0: tensor<?xf32>, %arg1: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = tcf.add %arg0, %arg1 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  return %0 : tensor<?xf32>
+}
+"""
+
+jit_module = create_compilation_service().compile(SOURCE)
+x = np.asarray([1.0, 2.0], dtype=np.float32)
+y = np.asarray([3.0, 4.0, 5.0], dtype=np.float32)
+
+# A failed shape check of the compiled code fails the call instead of exiting
+# the process, which can keep invoking the module.
+# CHECK: ERROR: error invoking JIT function: invoking 'add': required broadcastable shapes
+try:
+  jit_module.invoke("add", [x, y])
+except RuntimeError as e:
+  print("ERROR:", e)
+
+# CHECK: RESULT: [2. 4.]
+print("RESULT:", jit_module.invoke("add", [x, x])[0])
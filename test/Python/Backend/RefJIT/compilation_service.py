@@ -0,0 +1,35 @@
+# RUN: %PYTHON %s | FileCheck %s --dump-input=fail
+
+import numpy as np
+
+from npcomp.compiler.generic.backend.refjit import create_compilation_service
+
+ADD_TEMPLATE = """
+func @add(%arg0: tensor<?xf32>) -> tensor<?xf32> {{
+  %0 = constant dense<{}> : tensor<1xf32>
+  %1 = tcf.add %arg0, %0 : (tensor<?xf32>, tensor<1xf32>) -> tensor<?xf32>
+  return %1 : tensor<?xf32>
+}}
+"""
+
+service = create_compilation_service(num_threads=2)
+x = np.asarray([1.0, 2.0], dtype=np.float32)
+
+# CHECK: COMPILE: [2. 3.]
+jit_module = service.compile(ADD_TEMPLATE.format(1.0))
+print("COMPILE:", jit_module.invoke("add", [x])[0])
+
+# Compilations run concurrently, reusing the pass managers of each thread.
+# CHECK: ASYNC: [2.0, 3.0, 4.0, 5.0]
+pending = [
+    service.compile_async(ADD_TEMPLATE.format(float(i)), optimize=i % 2 == 0)
+    for i in range(4)
+]
+results = [p.result().invoke("add", [x])[0] for p in pending]
+print("ASYNC:", [float(r[1]) for r in results])
+
+# CHECK: ERROR: error compiling module: could not parse the module
+try:
+  service.compile("func @bad(")
+except RuntimeError as e:
+  print("ERROR:", e)
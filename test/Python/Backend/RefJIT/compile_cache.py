@@ -0,0 +1,43 @@
+# RUN: %PYTHON %s | FileCheck %s --dump-input=fail
+
+import numpy as np
+
+from npcomp.compiler.numpy.backend import refjit
+from npcomp.compiler.numpy.compile_cache import *
+
+cache = CompileCache()
+backend = refjit.CompilerBackend()
+
+a = np.asarray([1.0, 2.0], dtype=np.float32)
+
+
+def global_add():
+  return np.add(a, a)
+
+
+first = compile_function(global_add, backend=backend, cache=cache)
+second = compile_function(global_add, backend=backend, cache=cache)
+assert first.__isnpcomp__
+
+# CHECK: FIRST: [2. 4.]
+print("FIRST:", first())
+# CHECK: SECOND: [2. 4.]
+print("SECOND:", second())
+# CHECK: HITS: 1 MISSES: 1
+print("HITS:", cache.hits, "MISSES:", cache.misses)
+
+# The captured array is a constant of the compiled code, so changing it
+# compiles the function again.
+a = np.asarray([1.0, 2.0, 3.0], dtype=np.float32)
+third = compile_function(global_add, backend=backend, cache=cache)
+# CHECK: THIRD: [2. 4. 6.]
+print("THIRD:", third())
+# CHECK: HITS: 1 MISSES: 2
+print("HITS:", cache.hits, "MISSES:", cache.misses)
+
+# So does a backend with different options.
+compile_function(global_add,
+                 backend=refjit.CompilerBackend(profile_ops=True),
+                 cache=cache)
+# CHECK: HITS: 1 MISSES: 3
+print("HITS:", cache.hits, "MISSES:", cache.misses)
@@ -0,0 +1,61 @@
+# RUN: %PYTHON %s | FileCheck %s --dump-input=fail
+
+import os
+import tempfile
+
+import numpy as np
+
+from npcomp.compiler.generic.backend.refjit import CompiledModuleCache
+from npcomp.compiler.numpy.backend import refjit
+from npcomp.compiler.numpy.frontend import *
+from npcomp.compiler.numpy import test_config
+from npcomp.compiler.numpy.target import *
+
+a = np.asarray([1.0, 2.0], dtype=np.float32)
+
+
+def global_add():
+  return np.add(a, a)
+
+
+def import_global_add():
+  fe = ImportFrontend(config=test_config.create_test_config(
+      target_factory=GenericTarget32))
+  fe.import_global_function(global_add)
+  return fe.ir_module
+
+
+def stats(cache):
+  return "MEMORY: {} DISK: {} MISSES: {}".format(cache.memory_hits,
+                                                 cache.disk_hits, cache.misses)
+
+
+with tempfile.TemporaryDirectory() as cache_dir:
+  cache = CompiledModuleCache(cache_dir)
+  backend = refjit.CompilerBackend(cache=cache)
+  first = backend.load(backend.compile(import_global_add()))
+  # Importing the same function again gives the same IR, which is found in
+  # memory.
+  second = backend.load(backend.compile(import_global_add()))
+  # CHECK: FIRST: [2. 4.] SECOND: [2. 4.]
+  print("FIRST:", first.global_add(), "SECOND:", second.global_add())
+  # CHECK: MEMORY: 1 DISK: 0 MISSES: 1
+  print(stats(cache))
+
+  # A new cache on the same directory (such as the one of another process)
+  # compiles the lowered IR stored on disk, from the cached object code.
+  cache = CompiledModuleCache(cache_dir)
+  backend = refjit.CompilerBackend(cache=cache)
+  third = backend.load(backend.compile(import_global_add()))
+  # CHECK: THIRD: [2. 4.]
+  print("THIRD:", third.global_add())
+  # CHECK: MEMORY: 0 DISK: 1 MISSES: 0
+  print(stats(cache))
+  # CHECK: OBJECTS: True
+  print("OBJECTS:", bool(os.listdir(cache.object_cache_dir)))
+
+  # Different pipeline options compile again.
+  backend = refjit.CompilerBackend(optimize=True, cache=cache)
+  backend.compile(import_global_add())
+  # CHECK: MEMORY: 0 DISK: 1 MISSES: 1
+  print(stats(cache))
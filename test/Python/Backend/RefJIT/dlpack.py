@@ -0,0 +1,41 @@
+# RUN: %PYTHON %s | FileCheck %s --dump-input=fail
+
+import numpy as np
+
+from npcomp.compiler.generic.backend.refjit import (
+    create_compilation_service, get_refjit)
+
+SOURCE = """
+func @double(%arg0: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = tcf.add %arg0, %arg0 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  return %0 : tensor<?xf32>
+}
+"""
+
+refjit = get_refjit()
+jit_module = create_compilation_service().compile(SOURCE)
+x = np.asarray([1.0, 2.0], dtype=np.float32)
+
+# Outputs are exported as DLPack capsules that keep them alive, and capsules
+# are accepted as inputs.
+# CHECK: ROUND_TRIP: [4. 8.]
+capsule = refjit.to_dlpack(jit_module.invoke("double", [x])[0])
+print("ROUND_TRIP:", jit_module.invoke("double", [capsule])[0])
+
+# CHECK: CONSUMED: expected a DLPack capsule that wasn't consumed
+try:
+  jit_module.invoke("double", [capsule])
+except ValueError as e:
+  print("CONSUMED:", e)
+
+# CHECK: NOT_AN_OUTPUT: only arrays returned by a JITModule can be exported with DLPack
+try:
+  refjit.to_dlpack(x)
+except ValueError as e:
+  print("NOT_AN_OUTPUT:", e)
+
+# CHECK: TYPE_ERROR: inputs must be buffers or DLPack tensors, not str
+try:
+  jit_module.invoke("double", ["x"])
+except TypeError as e:
+  print("TYPE_ERROR:", e)
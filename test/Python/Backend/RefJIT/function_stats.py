@@ -0,0 +1,57 @@
+# RUN: %PYTHON %s | FileCheck %s --dump-input=fail
+
+import numpy as np
+
+from npcomp.compiler.generic.backend.refjit import get_refjit
+from npcomp.compiler.numpy.backend import refjit
+from npcomp.compiler.numpy.frontend import *
+from npcomp.compiler.numpy import test_config
+from npcomp.compiler.numpy.target import *
+
+
+def compile_function(f):
+  fe = ImportFrontend(config=test_config.create_test_config(
+      target_factory=GenericTarget32))
+  fe.import_global_function(f)
+  compiler = refjit.CompilerBackend()
+  jit_module = compiler.compile(fe.ir_module)
+  return jit_module, compiler.load(jit_module)[f.__name__]
+
+
+a = np.asarray([1.0, 2.0], dtype=np.float32)
+
+
+@compile_function
+def global_add():
+  return np.add(a, a)
+
+
+jit_module, invoke = global_add
+
+# Calls made while instrumentation is disabled aren't counted.
+# CHECK: DISABLED: 0
+invoke()
+print("DISABLED:", jit_module.get_function_stats("global_add")["num_calls"])
+
+# CHECK: CALLS: 3
+# CHECK: HISTOGRAM: 3
+# CHECK: TIMED: True
+get_refjit().set_instrumentation_enabled(True)
+for _ in range(3):
+  invoke()
+stats = jit_module.get_function_stats("global_add")
+print("CALLS:", stats["num_calls"])
+print("HISTOGRAM:", sum(stats["latency_histogram_us"]))
+print("TIMED:", stats["total_ns"] > 0)
+
+# CHECK: RESET: 0
+get_refjit().reset_function_stats()
+print("RESET:", jit_module.get_function_stats("global_add")["num_calls"])
+
+# The memory footprint is recorded by the compiler: `a` is the only constant,
+# and there are no inputs.
+# CHECK: CONSTANT: 8
+# CHECK: INPUT: 0
+footprint = jit_module.get_memory_footprint("global_add")
+print("CONSTANT:", footprint["constant_bytes"])
+print("INPUT:", footprint["input_bytes"])
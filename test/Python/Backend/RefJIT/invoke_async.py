@@ -0,0 +1,42 @@
+# RUN: %PYTHON %s | FileCheck %s --dump-input=fail
+
+import numpy as np
+
+from npcomp.compiler.generic.backend.refjit import create_compilation_service
+
+SOURCE = """
+func @add(%arg0: tensor<?xf32>, %arg1: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = tcf.add %arg0, %arg1 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  return %0 : tensor<?xf32>
+}
+"""
+
+jit_module = create_compilation_service().compile(SOURCE)
+x = np.asarray([1.0, 2.0], dtype=np.float32)
+
+# CHECK: RESULT: [2. 4.] True
+invocation = jit_module.invoke_async("add", [x, x])
+result = invocation.result()
+print("RESULT:", result[0], invocation.done())
+
+# CHECK: ERROR: error invoking JIT function: invoking 'add': required broadcastable shapes
+invocation = jit_module.invoke_async("add", [x, np.zeros(3, dtype=np.float32)])
+try:
+  invocation.result()
+except RuntimeError as e:
+  print("ERROR:", e)
+
+# CHECK: ERROR: result of invocation was already retrieved
+try:
+  invocation.result()
+except RuntimeError as e:
+  print("ERROR:", e)
+
+# The results of abandoned invocations, including failed ones, are dropped
+# once they complete.
+# CHECK: ABANDONED
+for _ in range(8):
+  jit_module.invoke_async("add", [x, x])
+  jit_module.invoke_async("add", [x, np.zeros(3, dtype=np.float32)])
+del jit_module
+print("ABANDONED")
@@ -0,0 +1,39 @@
+# RUN: %PYTHON %s | FileCheck %s --dump-input=fail
+
+import os
+os.environ["NUMPY_EXPERIMENTAL_ARRAY_FUNCTION"] = "1"
+
+import numpy as np
+
+from npcomp.tracing.lazy import *
+
+tc = LazyTraceContext(compiled_graphs={})
+
+
+def expression(a, b, c):
+  return np.tanh(a * b + c)
+
+
+with tc:
+  a = tc.array(np.asarray([[1.0, -1.0], [0.5, 0.0]], dtype=np.float32))
+  b = tc.array(np.asarray([2.0, 1.0], dtype=np.float32))
+  c = tc.array(np.asarray([[0.0, 1.0], [-1.0, 0.0]], dtype=np.float32))
+  result = expression(a, b, c)
+  # CHECK: PENDING: True
+  print("PENDING:", not result.is_materialized)
+  # CHECK: RESULT: True
+  print("RESULT:",
+        np.allclose(result.numpy(), np.tanh(a.numpy() * b.numpy() + c.numpy())))
+
+  # The same expression on other arrays of the same ranks reuses the compiled
+  # graph.
+  d = tc.array(np.ones((3, 4), dtype=np.float32))
+  e = tc.array(np.ones(4, dtype=np.float32))
+  # CHECK: SHAPE: (3, 4)
+  print("SHAPE:", np.asarray(expression(d, e, d)).shape)
+  # CHECK: COMPILE_COUNT: 1
+  print("COMPILE_COUNT:", tc.compile_count)
+
+  # Other ops run eagerly on the materialized values.
+  # CHECK: SUM: 8.0
+  print("SUM:", np.sum(d * e))
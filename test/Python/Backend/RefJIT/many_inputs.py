@@ -0,0 +1,35 @@
+# RUN: %PYTHON %s | FileCheck %s --dump-input=fail
+
+import numpy as np
+
+from npcomp.compiler.generic.backend.refjit import create_compilation_service
+
+# A function with more inputs and outputs, and of a higher rank, than the
+# runtime packs inline.
+NUM_INPUTS = 24
+TYPE = "tensor<1x1x1x1x1x1x1x2xf32>"
+ARGS = ", ".join(f"%arg{i}: {TYPE}" for i in range(NUM_INPUTS))
+ADDS = "\n".join(
+    f"  %{i} = tcf.add %arg{i}, %arg{i} : ({TYPE}, {TYPE}) -> {TYPE}"
+    for i in range(NUM_INPUTS))
+RESULTS = ", ".join(f"%{i}" for i in range(NUM_INPUTS))
+SOURCE = f"""
+func @double({ARGS}) -> ({", ".join([TYPE] * NUM_INPUTS)}) {{
+{ADDS}
+  return {RESULTS} : {", ".join([TYPE] * NUM_INPUTS)}
+}}
+"""
+
+jit_module = create_compilation_service().compile(SOURCE)
+inputs = [
+    np.full((1, 1, 1, 1, 1, 1, 1, 2), i, dtype=np.float32)
+    for i in range(NUM_INPUTS)
+]
+outputs = jit_module.invoke("double", inputs)
+
+# CHECK: NUM_OUTPUTS: 24
+# CHECK: SHAPE: (1, 1, 1, 1, 1, 1, 1, 2)
+# CHECK: LAST: [46. 46.]
+print("NUM_OUTPUTS:", len(outputs))
+print("SHAPE:", outputs[-1].shape)
+print("LAST:", outputs[-1].flatten())
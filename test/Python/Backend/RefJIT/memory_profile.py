@@ -0,0 +1,59 @@
+# RUN: %PYTHON %s %t.json | FileCheck %s --dump-input=fail
+
+import json
+import sys
+
+import numpy as np
+
+from npcomp.compiler.generic.backend.refjit import get_refjit
+from npcomp.compiler.numpy.backend import refjit
+from npcomp.compiler.numpy.frontend import *
+from npcomp.compiler.numpy import test_config
+from npcomp.compiler.numpy.target import *
+
+
+def compile_function(f):
+  fe = ImportFrontend(config=test_config.create_test_config(
+      target_factory=GenericTarget32))
+  fe.import_global_function(f)
+  compiler = refjit.CompilerBackend(profile_ops=True)
+  jit_module = compiler.compile(fe.ir_module)
+  return jit_module, compiler.load(jit_module)[f.__name__]
+
+
+a = np.asarray([1.0, 2.0], dtype=np.float32)
+
+
+@compile_function
+def global_add():
+  return np.add(a, a)
+
+
+jit_module, invoke = global_add
+get_refjit().set_memory_profiling_enabled(True)
+result = invoke()
+get_refjit().set_memory_profiling_enabled(False)
+
+# The call is recorded, and the buffer of its result is allocated within it,
+# by an op of the compiled code.
+# CHECK: CALLS: ['global_add', 'global_add']
+# CHECK: ALLOCATED: True
+# CHECK: SITES NAMED: True
+profile = get_refjit().get_memory_profile()
+print("CALLS:",
+      [e["function"] for e in profile if e["kind"].startswith("call")])
+allocations = [e for e in profile if e["kind"] == "allocate"]
+print("ALLOCATED:",
+      any(e["function"] == "global_add" and e["bytes"] >= 8
+          for e in allocations))
+print("SITES NAMED:", all(e["site"] for e in allocations))
+
+# CHECK: LIVE BYTES: True
+get_refjit().write_memory_profile_as_chrome_trace(sys.argv[1])
+with open(sys.argv[1]) as f:
+  events = json.load(f)["traceEvents"]
+print("LIVE BYTES:", any(e["name"] == "live bytes" for e in events))
+
+# CHECK: RESET: []
+get_refjit().reset_memory_profile()
+print("RESET:", get_refjit().get_memory_profile())
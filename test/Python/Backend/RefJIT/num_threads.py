@@ -0,0 +1,42 @@
+# RUN: %PYTHON %s | FileCheck %s --dump-input=fail
+
+import numpy as np
+
+from npcomp.compiler.generic.backend import refjit as refjit_backend
+from npcomp.compiler.numpy.backend import refjit
+from npcomp.compiler.numpy.frontend import *
+from npcomp.compiler.numpy import test_config
+from npcomp.compiler.numpy.target import *
+
+
+def compile_function(f):
+  fe = ImportFrontend(config=test_config.create_test_config(
+      target_factory=GenericTarget32))
+  fe.import_global_function(f)
+  compiler = refjit.CompilerBackend()
+  jit_module = compiler.compile(fe.ir_module)
+  return compiler.load(jit_module)[f.__name__]
+
+
+a = np.asarray([1.0, 2.0], dtype=np.float32)
+
+
+@compile_function
+def global_add():
+  return np.add(a, a)
+
+
+# CHECK: THREADS: 3
+refjit_backend.set_num_threads(3)
+print("THREADS:", refjit_backend.get_num_threads())
+
+# Resizing the pool between calls doesn't change the results.
+# CHECK: RESULT: [2. 4.]
+# CHECK: RESULT: [2. 4.]
+print("RESULT:", global_add())
+refjit_backend.set_num_threads(1)
+print("RESULT:", global_add())
+
+# CHECK: DEFAULT: True
+refjit_backend.set_num_threads(0)
+print("DEFAULT:", refjit_backend.get_num_threads() >= 1)
@@ -0,0 +1,48 @@
+# RUN: %PYTHON %s %t.json | FileCheck %s --dump-input=fail
+
+import json
+import sys
+
+import numpy as np
+
+from npcomp.compiler.generic.backend.refjit import get_refjit
+from npcomp.compiler.numpy.backend import refjit
+from npcomp.compiler.numpy.frontend import *
+from npcomp.compiler.numpy import test_config
+from npcomp.compiler.numpy.target import *
+
+
+def compile_function(f):
+  fe = ImportFrontend(config=test_config.create_test_config(
+      target_factory=GenericTarget32))
+  fe.import_global_function(f)
+  compiler = refjit.CompilerBackend(profile_ops=True)
+  jit_module = compiler.compile(fe.ir_module)
+  return jit_module, compiler.load(jit_module)[f.__name__]
+
+
+a = np.asarray([1.0, 2.0], dtype=np.float32)
+
+
+@compile_function
+def global_add():
+  return np.add(a, a)
+
+
+jit_module, invoke = global_add
+for _ in range(3):
+  invoke()
+
+# CHECK: linalg.generic 3
+profile = get_refjit().get_op_profile()
+for entry in profile:
+  print(entry["name"].split(" at ")[0], entry["num_calls"])
+
+# CHECK: EVENTS: 3
+get_refjit().write_op_profile_as_chrome_trace(sys.argv[1])
+with open(sys.argv[1]) as f:
+  print("EVENTS:", len(json.load(f)["traceEvents"]))
+
+# CHECK: RESET: []
+get_refjit().reset_op_profile()
+print("RESET:", get_refjit().get_op_profile())
@@ -0,0 +1,44 @@
+# RUN: %PYTHON %s | FileCheck %s --dump-input=fail
+
+import numpy as np
+
+from npcomp.compiler.generic.backend.pipeline_parallel import (
+    PipelineParallelModule, split_pipeline_stages)
+
+MODEL = """
+#map = affine_map<(d0) -> (d0)>
+func @forward(%arg0: tensor<4xf32>) -> tensor<4xf32> {
+  %weight = constant dense<[1.0, 2.0, 3.0, 4.0]> : tensor<4xf32>
+  %init = linalg.init_tensor [4] : tensor<4xf32>
+  %0 = linalg.generic {indexing_maps = [#map, #map, #map], iterator_types = ["parallel"]}
+      ins(%arg0, %weight : tensor<4xf32>, tensor<4xf32>) outs(%init : tensor<4xf32>) {
+  ^bb0(%a: f32, %b: f32, %c: f32):
+    %r = addf %a, %b : f32
+    linalg.yield %r : f32
+  } -> tensor<4xf32>
+  %1 = linalg.generic {indexing_maps = [#map, #map, #map], iterator_types = ["parallel"]}
+      ins(%0, %arg0 : tensor<4xf32>, tensor<4xf32>) outs(%init : tensor<4xf32>) {
+  ^bb0(%a: f32, %b: f32, %c: f32):
+    %r = mulf %a, %b : f32
+    linalg.yield %r : f32
+  } -> tensor<4xf32>
+  return %1 : tensor<4xf32>
+}
+"""
+
+if __name__ == "__main__":
+  # The stages run in processes of their own, which import this file.
+  stages = split_pipeline_stages(MODEL, num_stages=2)
+  # CHECK: STAGES: 2
+  print("STAGES:", len(stages))
+
+  with PipelineParallelModule(stages) as model:
+    # CHECK: CALL: [ 2.  6. 12. 20.]
+    x = np.asarray([1.0, 2.0, 3.0, 4.0], dtype=np.float32)
+    print("CALL:", model(x)[0])
+
+    # Micro-batches stream through both stages, more of them than the
+    # pipeline buffers.
+    # CHECK: MAP: [0.0, 2.0, 6.0, 12.0, 20.0, 30.0]
+    batches = [(np.full(4, float(i), dtype=np.float32),) for i in range(6)]
+    print("MAP:", [float(r[0][0]) for r in model.map(batches)])
@@ -0,0 +1,39 @@
+# RUN: %PYTHON %s | FileCheck %s --dump-input=fail
+
+import numpy as np
+
+from npcomp.compiler.generic.backend.refjit import create_compilation_service
+
+SOURCE = """
+func @add(%arg0: tensor<2xf32>, %arg1: tensor<?xf32>) -> (tensor<2xf32>, tensor<?xf32>) {
+  %0 = tcf.add %arg0, %arg0 : (tensor<2xf32>, tensor<2xf32>) -> tensor<2xf32>
+  %1 = tcf.add %arg1, %arg1 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  return %0, %1 : tensor<2xf32>, tensor<?xf32>
+}
+"""
+
+jit_module = create_compilation_service().compile(SOURCE)
+x = np.asarray([1.0, 2.0], dtype=np.float32)
+y = np.asarray([3.0, 4.0, 5.0], dtype=np.float32)
+add = jit_module.prepare("add", [x, y])
+
+# CHECK: NAME: add
+print("NAME:", add.function_name)
+
+# CHECK: FIRST: [2. 4.] [ 6.  8. 10.]
+first = add(x, y)
+print("FIRST:", first[0], first[1])
+
+# The output with a static shape is written into the same array by each call,
+# the one with a dynamic shape gets a new array.
+# CHECK: SECOND: [4. 8.] [ 6.  8. 10.]
+# CHECK: REUSED: True False
+second = add(x * 2, y)
+print("SECOND:", second[0], first[1])
+print("REUSED:", second[0] is first[0], second[1] is first[1])
+
+# CHECK: ERROR: error invoking JIT function: invoking 'add': input does not match the signature the call was prepared with (%arg1)
+try:
+  add(x, x)
+except RuntimeError as e:
+  print("ERROR:", e)
@@ -0,0 +1,59 @@
+# RUN: %PYTHON %s | FileCheck %s --dump-input=fail
+
+import os
+import tempfile
+
+import numpy as np
+
+from mlir.ir import *
+from mlir.passmanager import *
+from npcomp import _cext
+from npcomp.compiler.generic.backend.refjit import get_refjit, get_runtime_libs
+
+SOURCE = """
+func @add_weights(%arg0: tensor<4xf32>) -> tensor<4xf32> {
+  %0 = constant opaque<"refback", "0x@WEIGHTS@"> : tensor<4xf32>
+  %1 = tcf.add %arg0, %0 : (tensor<4xf32>, tensor<4xf32>) -> tensor<4xf32>
+  return %1 : tensor<4xf32>
+}
+"""
+
+refjit = get_refjit()
+ones = np.ones(4, dtype=np.float32)
+
+with tempfile.TemporaryDirectory() as temp_dir:
+  old_path = os.path.join(temp_dir, "old.bin")
+  new_path = os.path.join(temp_dir, "new.bin")
+  object_cache_dir = os.path.join(temp_dir, "objects")
+  np.arange(4, dtype=np.float32).tofile(old_path)
+  (np.arange(4, dtype=np.float32) * 10).tofile(new_path)
+
+  context = Context()
+  _cext.register_all_dialects(context)
+  with context:
+    module = Module.parse(
+        SOURCE.replace("@WEIGHTS@", ("external:0:" + old_path).encode().hex()))
+    pm = PassManager()
+    refjit.build_backend_compilation_pipeline(pm)
+    pm.run(module)
+  lowered_asm = str(module)
+
+  old = refjit.JITModule.from_compiled_module(
+      module, get_runtime_libs(), object_cache_dir=object_cache_dir)
+  # CHECK: OLD: [1. 2. 3. 4.]
+  print("OLD:", old.invoke("add_weights", [ones])[0])
+
+  # The same compiled module reads the weights from another file, without
+  # generating its object code again.
+  module = Module.parse(lowered_asm, context=context)
+  # CHECK: REPLACED: 1
+  print("REPLACED:",
+        refjit.replace_external_weights_path(module, old_path, new_path))
+  new = refjit.JITModule.from_compiled_module(
+      module, get_runtime_libs(), object_cache_dir=object_cache_dir)
+  # CHECK: NEW: [ 1. 11. 21. 31.]
+  print("NEW:", new.invoke("add_weights", [ones])[0])
+  # CHECK: OBJECTS: 1
+  print("OBJECTS:", len(os.listdir(object_cache_dir)))
+  # CHECK: STILL_OLD: [1. 2. 3. 4.]
+  print("STILL_OLD:", old.invoke("add_weights", [ones])[0])
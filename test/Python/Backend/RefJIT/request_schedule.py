@@ -0,0 +1,54 @@
+# RUN: %PYTHON %s | FileCheck %s --dump-input=fail
+
+import numpy as np
+
+from npcomp.compiler.generic.backend.refjit import create_compilation_service
+
+SOURCE = """
+func @add(%arg0: tensor<?xf32>, %arg1: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = tcf.add %arg0, %arg1 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  return %0 : tensor<?xf32>
+}
+"""
+
+jit_module = create_compilation_service().compile(SOURCE)
+x = np.asarray([1.0, 2.0], dtype=np.float32)
+
+# CHECK: high: [2. 4.]
+# CHECK: low: [2. 4.]
+# CHECK: timeout: [2. 4.]
+print("high:", jit_module.invoke("add", [x, x], priority="high")[0])
+print("low:", jit_module.invoke("add", [x, x], priority="low")[0])
+print("timeout:", jit_module.invoke("add", [x, x], timeout=60.0)[0])
+
+# CHECK: ERROR: unknown priority: urgent
+try:
+  jit_module.invoke("add", [x, x], priority="urgent")
+except ValueError as e:
+  print("ERROR:", e)
+
+# Requests whose deadline passed fail without running.
+# CHECK: ERROR: error invoking JIT function: invoking 'add': deadline exceeded
+try:
+  jit_module.invoke("add", [x, x], timeout=-1.0)
+except RuntimeError as e:
+  print("ERROR:", e)
+
+# CHECK: ASYNC: [2. 4.]
+invocation = jit_module.invoke_async("add", [x, x], priority="high",
+                                     timeout=60.0)
+print("ASYNC:", invocation.result()[0])
+
+# CHECK: ASYNC ERROR: error invoking JIT function: invoking 'add': deadline exceeded
+invocation = jit_module.invoke_async("add", [x, x], priority="low",
+                                     timeout=-1.0)
+try:
+  invocation.result()
+except RuntimeError as e:
+  print("ASYNC ERROR:", e)
+
+# CHECK: ASYNC ERROR: unknown priority: urgent
+try:
+  jit_module.invoke_async("add", [x, x], priority="urgent")
+except ValueError as e:
+  print("ASYNC ERROR:", e)
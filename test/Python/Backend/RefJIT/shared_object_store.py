@@ -0,0 +1,69 @@
+# RUN: %PYTHON %s | FileCheck %s --dump-input=fail
+
+import os
+import tempfile
+
+import numpy as np
+
+from npcomp.compiler.generic.backend.refjit import (create_compilation_service,
+                                                    get_refjit,
+                                                    open_shared_object_store)
+
+SOURCE = """
+func @add(%arg0: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = tcf.add %arg0, %arg0 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  return %0 : tensor<?xf32>
+}
+"""
+
+x = np.asarray([1.0, 2.0], dtype=np.float32)
+
+# A store kept in a dict, standing in for a remote cache.
+objects = dict()
+fetches = []
+
+
+def fetch(key):
+  fetches.append(key)
+  return objects.get(key)
+
+
+def store(key, data):
+  objects[key] = data
+
+
+shared_store = get_refjit().ObjectStore.from_functions(fetch, store)
+
+# The first replica misses and compiles, and the second one loads the object
+# code that the first one stored.
+# CHECK: FIRST: [2. 4.] STORED: 1
+first = create_compilation_service(shared_object_store=shared_store)
+print("FIRST:",
+      first.compile(SOURCE).invoke("add", [x])[0], "STORED:", len(objects))
+# CHECK: SECOND: [2. 4.] STORED: 1 HIT: True
+second = create_compilation_service(shared_object_store=shared_store)
+print("SECOND:",
+      second.compile(SOURCE).invoke("add", [x])[0], "STORED:", len(objects),
+      "HIT:", fetches[-1] in objects)
+
+# Other compile options are stored under another key.
+# CHECK: OPT0: STORED: 2
+second.compile(SOURCE, opt_level=0)
+print("OPT0: STORED:", len(objects))
+
+# The local object cache is filled from the shared store.
+# CHECK: LOCAL: 1
+with tempfile.TemporaryDirectory() as local_dir:
+  create_compilation_service(object_cache_dir=local_dir,
+                             shared_object_store=shared_store).compile(SOURCE)
+  print("LOCAL:", len(os.listdir(local_dir)))
+
+# Directories (typically on network storage) are stores too.
+# CHECK: DIRECTORY: [2. 4.] FILES: 1
+with tempfile.TemporaryDirectory() as shared_dir:
+  service = create_compilation_service(shared_object_store=shared_dir)
+  result = service.compile(SOURCE).invoke("add", [x])[0]
+  print("DIRECTORY:", result, "FILES:", len(os.listdir(shared_dir)))
+
+# CHECK: NONE: True
+print("NONE:", open_shared_object_store("") is None)
@@ -0,0 +1,52 @@
+# RUN: %PYTHON %s | FileCheck %s --dump-input=fail
+
+import numpy as np
+
+from npcomp.compiler.generic.backend.refjit import create_compilation_service
+
+SOURCE = """
+func @add(%arg0: tensor<?xf32>, %arg1: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = tcf.add %arg0, %arg1 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  return %0 : tensor<?xf32>
+}
+func @mul(%arg0: tensor<?xf32>, %arg1: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = tcf.mul %arg0, %arg1 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  return %0 : tensor<?xf32>
+}
+"""
+
+service = create_compilation_service(num_threads=1)
+jit_module = service.compile_tiered(SOURCE, promote_after_calls=2)
+x = np.asarray([1.0, 2.0], dtype=np.float32)
+
+# The first calls run the code of the fast tier.
+# CHECK: FAST: [2. 4.] False
+print("FAST:", jit_module.invoke("add", [x, x])[0],
+      jit_module.is_optimized("add"))
+
+# The second call of `add` starts its optimized compilation, and its calls
+# switch to the optimized code once it is ready. The calls of `mul` still run
+# the fast code.
+# CHECK: OPTIMIZED: [2. 4.] True
+# CHECK: COLD: [1. 4.] False
+jit_module.invoke("add", [x, x])
+jit_module.wait_for_optimized("add")
+print("OPTIMIZED:", jit_module.invoke("add", [x, x])[0],
+      jit_module.is_optimized("add"))
+print("COLD:", jit_module.invoke("mul", [x, x])[0],
+      jit_module.is_optimized("mul"))
+
+# Shape checks fail the same way on both tiers.
+# CHECK: ERROR: error invoking JIT function: invoking 'add': required broadcastable shapes
+try:
+  jit_module.invoke("add", [x, np.zeros(3, dtype=np.float32)])
+except RuntimeError as e:
+  print("ERROR:", e)
+
+# Destroying the module waits for the optimized compilations that no call
+# switched to, and drops their results.
+# CHECK: ABANDONED
+jit_module.invoke("mul", [x, x])
+jit_module.invoke("mul", [x, x])
+del jit_module
+print("ABANDONED")
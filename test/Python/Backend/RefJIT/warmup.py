@@ -0,0 +1,36 @@
+# RUN: %PYTHON %s | FileCheck %s --dump-input=fail
+
+import numpy as np
+
+from npcomp.compiler.generic.backend.refjit import (create_compilation_service,
+                                                    get_refjit)
+
+SOURCE = """
+func @add(%arg0: tensor<2xf32>, %arg1: tensor<?xf32>) -> (tensor<2xf32>, tensor<?xf32>) {
+  %0 = tcf.add %arg0, %arg0 : (tensor<2xf32>, tensor<2xf32>) -> tensor<2xf32>
+  %1 = tcf.add %arg1, %arg1 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  return %0, %1 : tensor<2xf32>, tensor<?xf32>
+}
+"""
+
+jit_module = create_compilation_service().compile(SOURCE)
+
+# The signature of the function doesn't say what shape of %arg1 to warm up.
+# CHECK: ERROR: error warming up JIT function: warming up 'add': %arg1 needs a static shape
+try:
+  jit_module.warmup("add")
+except RuntimeError as e:
+  print("ERROR:", e)
+
+# Warming up calls the function once, on inputs of the given shapes.
+# CHECK: CALLS: 1
+get_refjit().set_instrumentation_enabled(True)
+jit_module.warmup("add", [None, [3]])
+print("CALLS:", jit_module.get_function_stats("add")["num_calls"])
+get_refjit().set_instrumentation_enabled(False)
+
+# CHECK: RESULT: [2. 4.] [ 6.  8. 10.]
+x = np.asarray([1.0, 2.0], dtype=np.float32)
+y = np.asarray([3.0, 4.0, 5.0], dtype=np.float32)
+result = jit_module.invoke("add", [x, y])
+print("RESULT:", result[0], result[1])
@@ -112,6 +112,70 @@ def float_floordiv(a: float, b: float):
   return a / b
 
 
+################################################################################
+# Numeric promotion
+################################################################################
+
+
+# CHECK-LABEL: func @int_float_add
+@import_global
+def int_float_add(a: int, b: float):
+  # CHECK: %[[A:.*]] = sitofp %arg0 : i64 to f64
+  # CHECK: addf %[[A]], %arg1 : f64
+  return a + b
+
+
+# CHECK-LABEL: func @int_truediv
+@import_global
+def int_truediv(a: int, b: int):
+  # CHECK: %[[A:.*]] = sitofp %arg0 : i64 to f64
+  # CHECK: %[[B:.*]] = sitofp %arg1 : i64 to f64
+  # CHECK: divf %[[A]], %[[B]] : f64
+  return a / b
+
+
+# CHECK-LABEL: func @int_float_lt
+@import_global
+def int_float_lt(a: int, b: float):
+  # CHECK: %[[A:.*]] = sitofp %arg0 : i64 to f64
+  # CHECK: cmpf olt, %[[A]], %arg1 : f64
+  return a < b
+
+
+################################################################################
+# Loops
+################################################################################
+
+
+# CHECK-LABEL: func @int_range_sum
+@import_global
+def int_range_sum(n: int):
+  s = 0
+  # CHECK: scf.while {{.*}} : (i64, i64) -> (i64, i64)
+  # CHECK:   %[[CMP:.*]] = cmpi slt, %{{.*}}, %arg0 : i64
+  # CHECK:   scf.condition(%[[CMP]])
+  # CHECK: ^bb0(%[[I:.*]]: i64, %[[S:.*]]: i64):
+  # CHECK:   addi %[[S]], %[[I]] : i64
+  # CHECK:   addi %[[I]], %{{.*}} : i64
+  # CHECK:   scf.yield
+  for i in range(n):
+    s = s + i
+  return s
+
+
+# CHECK-LABEL: func @float_range_sum
+@import_global
+def float_range_sum(n: int):
+  s = 0.0
+  # CHECK: scf.while {{.*}} : (i64, f64) -> (i64, f64)
+  # CHECK:   cmpi sgt
+  # CHECK:   %[[I:.*]] = sitofp %{{.*}} : i64 to f64
+  # CHECK:   addf %{{.*}}, %[[I]] : f64
+  for i in range(n, 0, -2):
+    s = s + i
+  return s
+
+
 ################################################################################
 # Bool conversions
 ################################################################################
@@ -26,6 +26,7 @@ TEST_MODULES = (
     "npcomp.compiler.numpy.py_value_utils",
     "npcomp.tracing.context",
     "npcomp.tracing.emitters",
+    "npcomp.tracing.lazy",
     "npcomp.tracing.mlir_trace",
     "npcomp.types",
     "npcomp.exporter",
@@ -0,0 +1,35 @@
+// RUN: echo '{"linalg.matmul(tensor<4x8xf32>, tensor<8x2xf32>)": {"l2_tile_sizes": [64, 64, 64], "l1_tile_sizes": [16, 16, 16], "latency_ms": 0.5}, "linalg.conv_2d_nchw(tensor<1x3x6x6xf32>, tensor<8x3x3x3xf32>)": {"conv_strategy": "direct", "latency_ms": 2.0}}' > %t.json
+// RUN: npcomp-opt -refback-apply-tuning-database=database=%t.json <%s | FileCheck %s --dump-input=fail
+// RUN: npcomp-opt -refback-apply-tuning-database=database=%t.missing.json <%s | FileCheck %s --check-prefix=MISSING --dump-input=fail
+// RUN: echo '{"linalg.matmul(tensor<4x8xf32>, tensor<8x2xf32>)": {"l2_tile_sizes": 64}}' > %t.invalid.json
+// RUN: not npcomp-opt -refback-apply-tuning-database=database=%t.invalid.json <%s 2>&1 | FileCheck %s --check-prefix=INVALID
+
+// INVALID: error: invalid tuning database {{.*}}: invalid entry for linalg.matmul(tensor<4x8xf32>, tensor<8x2xf32>)
+
+// A database file that doesn't exist is empty.
+// MISSING-NOT: refback.tuning
+
+// CHECK-LABEL: func @matmul(
+// CHECK:         linalg.matmul {refback.tuning = {l1_tile_sizes = [16, 16, 16], l2_tile_sizes = [64, 64, 64]}}
+func @matmul(%arg0: tensor<4x8xf32>, %arg1: tensor<8x2xf32>, %arg2: tensor<4x2xf32>) -> tensor<4x2xf32> {
+  %0 = linalg.matmul ins(%arg0, %arg1 : tensor<4x8xf32>, tensor<8x2xf32>) outs(%arg2 : tensor<4x2xf32>) -> tensor<4x2xf32>
+  return %0 : tensor<4x2xf32>
+}
+
+// Signatures that weren't tuned keep the heuristics.
+
+// CHECK-LABEL: func @untuned_matmul(
+// CHECK:         linalg.matmul ins
+func @untuned_matmul(%arg0: tensor<4x4xf32>, %arg1: tensor<4x2xf32>, %arg2: tensor<4x2xf32>) -> tensor<4x2xf32> {
+  %0 = linalg.matmul ins(%arg0, %arg1 : tensor<4x4xf32>, tensor<4x2xf32>) outs(%arg2 : tensor<4x2xf32>) -> tensor<4x2xf32>
+  return %0 : tensor<4x2xf32>
+}
+
+// Configurations set on the op are kept.
+
+// CHECK-LABEL: func @conv(
+// CHECK:         linalg.conv_2d_nchw {refback.tuning = {conv_strategy = "im2col"}}
+func @conv(%input: tensor<1x3x6x6xf32>, %filter: tensor<8x3x3x3xf32>, %init: tensor<1x8x4x4xf32>) -> tensor<1x8x4x4xf32> {
+  %0 = linalg.conv_2d_nchw {refback.tuning = {conv_strategy = "im2col"}} ins(%input, %filter : tensor<1x3x6x6xf32>, tensor<8x3x3x3xf32>) outs(%init : tensor<1x8x4x4xf32>) -> tensor<1x8x4x4xf32>
+  return %0 : tensor<1x8x4x4xf32>
+}
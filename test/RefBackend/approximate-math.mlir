@@ -0,0 +1,88 @@
+// RUN: npcomp-opt -refback-approximate-math=max-ulp=1024 -split-input-file <%s | FileCheck %s --check-prefix=FAST --dump-input=fail
+// RUN: npcomp-opt -refback-approximate-math=max-ulp=2 -split-input-file <%s | FileCheck %s --check-prefix=PRECISE --dump-input=fail
+// RUN: npcomp-opt -refback-approximate-math -split-input-file <%s | FileCheck %s --check-prefix=EXACT --dump-input=fail
+// RUN: npcomp-opt -refback-approximate-math='max-ulp=2 use-fma=true' -split-input-file <%s | FileCheck %s --check-prefix=FMA --dump-input=fail
+
+// The fast exp has a polynomial of degree 4, the precise one of degree 7.
+// Both scale by 2^n through the exponent field, in two steps.
+
+// FAST-LABEL:    func @exp
+// FAST-NOT:        math.exp
+// FAST:            floorf
+// FAST-COUNT-3:    mulf {{.*}} : vector<8xf32>
+// FAST:            fptosi {{.*}} : vector<8xf32> to vector<8xi32>
+// FAST:            shift_right_signed
+// FAST-COUNT-2:    shift_left
+// FAST:            cmpf uno
+// FAST-NOT:        math.exp
+// PRECISE-LABEL: func @exp
+// PRECISE-NOT:     math.exp
+// PRECISE-COUNT-6: mulf {{.*}} : vector<8xf32>
+// PRECISE:         shift_left
+// EXACT-LABEL:   func @exp
+// EXACT:           math.exp
+// With FMAs, each step of the polynomial is a single op.
+// FMA-LABEL:     func @exp
+// FMA-COUNT-5:     fmaf {{.*}} : vector<8xf32>
+// FMA:             shift_left
+func @exp(%arg0: vector<8xf32>) -> vector<8xf32> {
+  %0 = math.exp %arg0 : vector<8xf32>
+  return %0 : vector<8xf32>
+}
+
+// -----
+
+// The fast tanh is a rational function of the clamped input, the precise one
+// uses a polynomial close to 0 and exp elsewhere.
+
+// FAST-LABEL:    func @tanh
+// FAST-NOT:        math.tanh
+// FAST-NOT:        floorf
+// FAST:            divf
+// FAST-NOT:        floorf
+// FAST:            return
+// PRECISE-LABEL: func @tanh
+// PRECISE-NOT:     math.tanh
+// PRECISE:         floorf
+// PRECISE:         divf
+// PRECISE:         copysign
+// PRECISE:         return
+// EXACT-LABEL:   func @tanh
+// EXACT:           math.tanh
+func @tanh(%arg0: f32) -> f32 {
+  %0 = math.tanh %arg0 : f32
+  return %0 : f32
+}
+
+// -----
+
+// FAST-LABEL:    func @log
+// FAST-NOT:        math.log
+// FAST:            bitcast {{.*}} : f32 to i32
+// FAST:            shift_right_signed
+// FAST:            and {{.*}} : i32
+// FAST:            or {{.*}} : i32
+// FAST:            bitcast {{.*}} : i32 to f32
+// FAST:            return
+// PRECISE-LABEL: func @log
+// PRECISE-NOT:     math.log
+// PRECISE:         return
+// EXACT-LABEL:   func @log
+// EXACT:           math.log
+func @log(%arg0: f32) -> f32 {
+  %0 = math.log %arg0 : f32
+  return %0 : f32
+}
+
+// -----
+
+// Only f32 is approximated.
+
+// FAST-LABEL:    func @f64
+// FAST:            math.exp
+// PRECISE-LABEL: func @f64
+// PRECISE:         math.exp
+func @f64(%arg0: f64) -> f64 {
+  %0 = math.exp %arg0 : f64
+  return %0 : f64
+}
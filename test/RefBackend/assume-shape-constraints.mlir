@@ -0,0 +1,36 @@
+// RUN: npcomp-opt -refback-assume-shape-constraints <%s | FileCheck %s --dump-input=fail
+
+// CHECK-LABEL: func @broadcast(
+// CHECK-NOT:     shape.cstr_broadcastable
+// CHECK:         %[[TRUE:.*]] = shape.const_witness true
+// CHECK:         shape.assuming %[[TRUE]]
+func @broadcast(%arg0: tensor<?xf32>, %arg1: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = shape.shape_of %arg0 : tensor<?xf32> -> tensor<?xindex>
+  %1 = shape.shape_of %arg1 : tensor<?xf32> -> tensor<?xindex>
+  %2 = shape.cstr_broadcastable %0, %1 : tensor<?xindex>, tensor<?xindex>
+  %3 = shape.assuming %2 -> (tensor<?xf32>) {
+    %10 = shape.broadcast %0, %1 : tensor<?xindex>, tensor<?xindex> -> tensor<?xindex>
+    %11 = tcp.broadcast_to %arg0, %10 : (tensor<?xf32>, tensor<?xindex>) -> tensor<?xf32>
+    %12 = tcp.broadcast_to %arg1, %10 : (tensor<?xf32>, tensor<?xindex>) -> tensor<?xf32>
+    %13 = addf %11, %12 : tensor<?xf32>
+    shape.assuming_yield %13 : tensor<?xf32>
+  }
+  return %3 : tensor<?xf32>
+}
+
+// The checks emitted as asserts (such as by the Torch frontend) are removed
+// too.
+
+// CHECK-LABEL: func @matmul_dims(
+// CHECK-NOT:     shape.cstr_require
+// CHECK-NOT:     assert
+// CHECK:         return
+func @matmul_dims(%arg0: index, %arg1: index) {
+  %0 = cmpi eq, %arg0, %arg1 : index
+  %1 = shape.cstr_require %0, "mismatching contracting dimension"
+  shape.assuming %1 {
+    shape.assuming_yield
+  }
+  assert %0, "mismatching contracting dimension"
+  return
+}
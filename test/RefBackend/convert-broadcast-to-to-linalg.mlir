@@ -0,0 +1,70 @@
+// RUN: npcomp-opt -refback-convert-broadcast-to-to-linalg -split-input-file <%s | FileCheck %s --dump-input=fail
+
+// A bias vector is read along the last dimension of the result, without
+// materializing the broadcast.
+
+// CHECK-DAG:   #[[BIAS:.*]] = affine_map<(d0, d1) -> (d1)>
+// CHECK-DAG:   #[[ID:.*]] = affine_map<(d0, d1) -> (d0, d1)>
+// CHECK-LABEL: func @bias(
+// CHECK-SAME:      %[[BIAS_ARG:.*]]: tensor<8xf32>, %[[SHAPE:.*]]: tensor<?xindex>)
+// CHECK:         %[[C0:.*]] = constant 0 : index
+// CHECK:         %[[D0:.*]] = tensor.extract %[[SHAPE]][%[[C0]]]
+// CHECK:         %[[INIT:.*]] = linalg.init_tensor [%[[D0]], 8] : tensor<?x8xf32>
+// CHECK:         %[[RESULT:.*]] = linalg.generic {indexing_maps = [#[[BIAS]], #[[ID]]], iterator_types = ["parallel", "parallel"]} ins(%[[BIAS_ARG]] : tensor<8xf32>) outs(%[[INIT]] : tensor<?x8xf32>)
+// CHECK:         ^bb0(%[[IN:.*]]: f32, %{{.*}}: f32):
+// CHECK:           linalg.yield %[[IN]] : f32
+// CHECK:         return %[[RESULT]]
+func @bias(%arg0: tensor<8xf32>, %arg1: tensor<?xindex>) -> tensor<?x8xf32> {
+  %0 = tcp.broadcast_to %arg0, %arg1 : (tensor<8xf32>, tensor<?xindex>) -> tensor<?x8xf32>
+  return %0 : tensor<?x8xf32>
+}
+
+// -----
+
+// Dimensions of size 1 are read at index 0.
+
+// CHECK-DAG:   #[[COLUMN:.*]] = affine_map<(d0, d1) -> (d0, 0)>
+// CHECK-LABEL: func @size_one(
+// CHECK:         linalg.generic {indexing_maps = [#[[COLUMN]], {{.*}}]{{.*}} ins(%{{.*}} : tensor<4x1xf32>) outs(%{{.*}} : tensor<?x?xf32>)
+func @size_one(%arg0: tensor<4x1xf32>, %arg1: tensor<?xindex>) -> tensor<?x?xf32> {
+  %0 = tcp.broadcast_to %arg0, %arg1 : (tensor<4x1xf32>, tensor<?xindex>) -> tensor<?x?xf32>
+  return %0 : tensor<?x?xf32>
+}
+
+// -----
+
+// Dynamic dimensions of the operand are only known to be broadcast at
+// runtime.
+
+// CHECK-LABEL: func @dynamic(
+// CHECK:         tcp.broadcast_to
+// CHECK-NOT:     linalg.generic
+func @dynamic(%arg0: tensor<?xf32>, %arg1: tensor<?xindex>) -> tensor<?x?xf32> {
+  %0 = tcp.broadcast_to %arg0, %arg1 : (tensor<?xf32>, tensor<?xindex>) -> tensor<?x?xf32>
+  return %0 : tensor<?x?xf32>
+}
+
+// -----
+
+// Dynamic dimensions that are proven equal to the result dimensions aren't
+// broadcast: the result of an elementwise op on an argument has the same
+// shape as the argument, so broadcasting both to their common shape does
+// nothing.
+
+// CHECK-LABEL: func @same_shape(
+// CHECK-SAME:      %[[ARG:.*]]: tensor<?xf32>)
+// CHECK:         %[[NEG:.*]] = negf %[[ARG]]
+// CHECK-NOT:     tcp.broadcast_to
+// CHECK-NOT:     linalg.generic
+// CHECK:         %[[SUM:.*]] = addf %[[ARG]], %[[NEG]]
+// CHECK:         return %[[SUM]]
+func @same_shape(%arg0: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = negf %arg0 : tensor<?xf32>
+  %1 = shape.shape_of %arg0 : tensor<?xf32> -> tensor<?xindex>
+  %2 = shape.shape_of %0 : tensor<?xf32> -> tensor<?xindex>
+  %3 = shape.broadcast %1, %2 : tensor<?xindex>, tensor<?xindex> -> tensor<?xindex>
+  %4 = tcp.broadcast_to %arg0, %3 : (tensor<?xf32>, tensor<?xindex>) -> tensor<?xf32>
+  %5 = tcp.broadcast_to %0, %3 : (tensor<?xf32>, tensor<?xindex>) -> tensor<?xf32>
+  %6 = addf %4, %5 : tensor<?xf32>
+  return %6 : tensor<?xf32>
+}
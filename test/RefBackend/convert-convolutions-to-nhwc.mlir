@@ -0,0 +1,26 @@
+// RUN: npcomp-opt -refback-convert-convolutions-to-nhwc <%s | FileCheck %s --dump-input=fail
+
+// The operands are transposed to NHWC/HWCF, and the result is transposed
+// back and accumulated into the original output.
+
+// CHECK-DAG:   #[[TO_NHWC:.*]] = affine_map<(d0, d1, d2, d3) -> (d0, d3, d1, d2)>
+// CHECK-DAG:   #[[TO_HWCF:.*]] = affine_map<(d0, d1, d2, d3) -> (d3, d2, d0, d1)>
+// CHECK-DAG:   #[[CONV_INPUT:.*]] = affine_map<(d0, d1, d2, d3, d4, d5, d6) -> (d0, d1 + d3, d2 + d4, d5)>
+// CHECK-DAG:   #[[CONV_FILTER:.*]] = affine_map<(d0, d1, d2, d3, d4, d5, d6) -> (d3, d4, d5, d6)>
+// CHECK-DAG:   #[[CONV_OUTPUT:.*]] = affine_map<(d0, d1, d2, d3, d4, d5, d6) -> (d0, d1, d2, d6)>
+// CHECK-DAG:   #[[TO_NCHW:.*]] = affine_map<(d0, d1, d2, d3) -> (d0, d2, d3, d1)>
+// CHECK-LABEL: func @conv(
+// CHECK-SAME:      %[[INPUT:.*]]: tensor<?x?x?x?xf32>, %[[FILTER:.*]]: tensor<?x?x3x3xf32>, %[[INIT:.*]]: tensor<?x?x?x?xf32>)
+// CHECK:         %[[NHWC_INPUT:.*]] = linalg.generic {indexing_maps = [#[[TO_NHWC]], {{.*}}]{{.*}} ins(%[[INPUT]] : tensor<?x?x?x?xf32>) outs(%{{.*}} : tensor<?x?x?x?xf32>)
+// CHECK:         %[[HWCF_FILTER:.*]] = linalg.generic {indexing_maps = [#[[TO_HWCF]], {{.*}}]{{.*}} ins(%[[FILTER]] : tensor<?x?x3x3xf32>) outs(%{{.*}} : tensor<3x3x?x?xf32>)
+// CHECK:         %[[ZERO:.*]] = linalg.fill
+// CHECK:         %[[CONV:.*]] = linalg.generic {indexing_maps = [#[[CONV_INPUT]], #[[CONV_FILTER]], #[[CONV_OUTPUT]]], iterator_types = ["parallel", "parallel", "parallel", "reduction", "reduction", "reduction", "parallel"]} ins(%[[NHWC_INPUT]], %[[HWCF_FILTER]] : {{.*}}) outs(%[[ZERO]] : tensor<?x?x?x?xf32>)
+// CHECK:           mulf
+// CHECK:           addf
+// CHECK:         %[[RESULT:.*]] = linalg.generic {indexing_maps = [#[[TO_NCHW]], {{.*}}]{{.*}} ins(%[[CONV]] : tensor<?x?x?x?xf32>) outs(%[[INIT]] : tensor<?x?x?x?xf32>)
+// CHECK:           addf
+// CHECK:         return %[[RESULT]]
+func @conv(%input: tensor<?x?x?x?xf32>, %filter: tensor<?x?x3x3xf32>, %init: tensor<?x?x?x?xf32>) -> tensor<?x?x?x?xf32> {
+  %0 = linalg.conv_2d_nchw ins(%input, %filter : tensor<?x?x?x?xf32>, tensor<?x?x3x3xf32>) outs(%init : tensor<?x?x?x?xf32>) -> tensor<?x?x?x?xf32>
+  return %0 : tensor<?x?x?x?xf32>
+}
@@ -0,0 +1,41 @@
+// RUN: npcomp-opt -refback-demote-to-bf16 -split-input-file <%s | FileCheck %s --dump-input=fail
+
+// Constant operands are rounded at compile time, the others by an
+// elementwise op. The result stays f32.
+
+// CHECK-LABEL: func @matmul(
+// CHECK-SAME:      %[[LHS:.*]]: tensor<?x2xf32>, %[[INIT:.*]]: tensor<?x2xf32>) -> tensor<?x2xf32> {
+// CHECK:         %[[C0:.*]] = constant 0 : index
+// CHECK:         %[[ROWS:.*]] = memref.dim %[[LHS]], %[[C0]]
+// CHECK:         %[[EMPTY:.*]] = linalg.init_tensor [%[[ROWS]], 2] : tensor<?x2xbf16>
+// CHECK:         %[[DEMOTED_LHS:.*]] = linalg.generic
+// CHECK-SAME:        ins(%[[LHS]] : tensor<?x2xf32>) outs(%[[EMPTY]] : tensor<?x2xbf16>)
+// CHECK:           fptrunc %{{.*}} : f32 to bf16
+// CHECK:         %[[DEMOTED_RHS:.*]] = constant dense<{{\[}}[1.000000e+00, 3.0078{{[0-9]*}}e-01], [2.000000e+00, 1.000000e+03]]> : tensor<2x2xbf16>
+// CHECK:         %[[RESULT:.*]] = linalg.matmul ins(%[[DEMOTED_LHS]], %[[DEMOTED_RHS]] : tensor<?x2xbf16>, tensor<2x2xbf16>) outs(%[[INIT]] : tensor<?x2xf32>) -> tensor<?x2xf32>
+// CHECK:         return %[[RESULT]]
+func @matmul(%arg0: tensor<?x2xf32>, %arg1: tensor<?x2xf32>) -> tensor<?x2xf32> {
+  %0 = constant dense<[[1.0, 0.3], [2.0, 1000.0]]> : tensor<2x2xf32>
+  %1 = linalg.matmul ins(%arg0, %0 : tensor<?x2xf32>, tensor<2x2xf32>) outs(%arg1 : tensor<?x2xf32>) -> tensor<?x2xf32>
+  return %1 : tensor<?x2xf32>
+}
+
+// -----
+
+// CHECK-LABEL: func @batch_matmul
+// CHECK:         linalg.batch_matmul ins(%{{.*}}, %{{.*}} : tensor<2x3x4xbf16>, tensor<2x4x5xbf16>) outs(%{{.*}} : tensor<2x3x5xf32>)
+func @batch_matmul(%arg0: tensor<2x3x4xf32>, %arg1: tensor<2x4x5xf32>, %arg2: tensor<2x3x5xf32>) -> tensor<2x3x5xf32> {
+  %0 = linalg.batch_matmul ins(%arg0, %arg1 : tensor<2x3x4xf32>, tensor<2x4x5xf32>) outs(%arg2 : tensor<2x3x5xf32>) -> tensor<2x3x5xf32>
+  return %0 : tensor<2x3x5xf32>
+}
+
+// -----
+
+// Other element types are left alone.
+
+// CHECK-LABEL: func @f64
+// CHECK:         linalg.matmul ins(%{{.*}}, %{{.*}} : tensor<2x2xf64>, tensor<2x2xf64>)
+func @f64(%arg0: tensor<2x2xf64>, %arg1: tensor<2x2xf64>) -> tensor<2x2xf64> {
+  %0 = linalg.matmul ins(%arg0, %arg0 : tensor<2x2xf64>, tensor<2x2xf64>) outs(%arg1 : tensor<2x2xf64>) -> tensor<2x2xf64>
+  return %0 : tensor<2x2xf64>
+}
@@ -0,0 +1,12 @@
+// RUN: npcomp-opt <%s -pass-pipeline='tcf-refback-lowering-pipeline{optimize target-cores=8}' | FileCheck %s --check-prefix=MULTICORE --dump-input=fail
+// RUN: npcomp-opt <%s -pass-pipeline='tcf-refback-lowering-pipeline{optimize target-cores=1}' | FileCheck %s --check-prefix=SINGLECORE --dump-input=fail
+
+// The tiles of the matmul only run on the runtime's thread pool when the
+// target has several cores.
+
+// MULTICORE: @matmul.parallel_body
+// SINGLECORE-NOT: parallel_body
+func @matmul(%arg0: tensor<256x256xf32>, %arg1: tensor<256x256xf32>) -> tensor<256x256xf32> {
+  %0 = tcf.matmul %arg0, %arg1 : (tensor<256x256xf32>, tensor<256x256xf32>) -> tensor<256x256xf32>
+  return %0 : tensor<256x256xf32>
+}
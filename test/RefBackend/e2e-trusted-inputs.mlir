@@ -0,0 +1,11 @@
+// RUN: npcomp-opt <%s -pass-pipeline=tcf-refback-lowering-pipeline | FileCheck %s --check-prefix=CHECKED --dump-input=fail
+// RUN: npcomp-opt <%s -pass-pipeline='tcf-refback-lowering-pipeline{optimize trusted-inputs}' | FileCheck %s --check-prefix=TRUSTED --dump-input=fail
+
+// The broadcast is only checked at runtime for untrusted callers.
+
+// CHECKED: required broadcastable shapes
+// TRUSTED-NOT: required broadcastable shapes
+func @add(%arg0: tensor<?xf32>, %arg1: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = tcf.add %arg0, %arg1 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  return %0 : tensor<?xf32>
+}
@@ -0,0 +1,76 @@
+// RUN: npcomp-opt -refback-elide-concat-copies -split-input-file %s | FileCheck %s
+
+#map = affine_map<(d0, d1) -> (d0, d1)>
+#strided0 = affine_map<(d0, d1) -> (d0 * 7 + d1)>
+#strided3 = affine_map<(d0, d1) -> (d0 * 7 + d1 + 3)>
+
+// The inputs are computed into views of the concatenated buffer.
+
+// CHECK-LABEL:   func @concat(
+// CHECK-SAME:                 %[[ARG0:.*]]: memref<4x3xf32>, %[[ARG1:.*]]: memref<4x4xf32>) -> memref<4x7xf32> {
+// CHECK:           %[[RESULT:.*]] = memref.alloc() : memref<4x7xf32>
+// CHECK:           %[[VIEW0:.*]] = memref.subview %[[RESULT]][0, 0] [4, 3] [1, 1]
+// CHECK:           linalg.generic {{.*}} ins(%[[ARG0]] : memref<4x3xf32>) outs(%[[VIEW0]] : memref<4x3xf32, #{{.*}}>)
+// CHECK:           %[[VIEW1:.*]] = memref.subview %[[RESULT]][0, 3] [4, 4] [1, 1]
+// CHECK:           linalg.generic {{.*}} ins(%[[ARG1]] : memref<4x4xf32>) outs(%[[VIEW1]] : memref<4x4xf32, #{{.*}}>)
+// CHECK-NOT:       linalg.copy
+// CHECK-NOT:       memref.dealloc
+// CHECK:           return %[[RESULT]] : memref<4x7xf32>
+func @concat(%arg0: memref<4x3xf32>, %arg1: memref<4x4xf32>) -> memref<4x7xf32> {
+  %x = memref.alloc() : memref<4x3xf32>
+  linalg.generic {indexing_maps = [#map, #map], iterator_types = ["parallel", "parallel"]}
+      ins(%arg0 : memref<4x3xf32>) outs(%x : memref<4x3xf32>) {
+  ^bb0(%a: f32, %b: f32):
+    %0 = addf %a, %a : f32
+    linalg.yield %0 : f32
+  }
+  %y = memref.alloc() : memref<4x4xf32>
+  linalg.generic {indexing_maps = [#map, #map], iterator_types = ["parallel", "parallel"]}
+      ins(%arg1 : memref<4x4xf32>) outs(%y : memref<4x4xf32>) {
+  ^bb0(%a: f32, %b: f32):
+    %0 = mulf %a, %a : f32
+    linalg.yield %0 : f32
+  }
+  %init = memref.alloc() : memref<4x7xf32>
+  %1 = memref.alloc() : memref<4x7xf32>
+  linalg.copy(%init, %1) : memref<4x7xf32>, memref<4x7xf32>
+  memref.dealloc %init : memref<4x7xf32>
+  %2 = memref.subview %1[0, 0] [4, 3] [1, 1] : memref<4x7xf32> to memref<4x3xf32, #strided0>
+  linalg.copy(%x, %2) : memref<4x3xf32>, memref<4x3xf32, #strided0>
+  memref.dealloc %x : memref<4x3xf32>
+  %3 = memref.alloc() : memref<4x7xf32>
+  linalg.copy(%1, %3) : memref<4x7xf32>, memref<4x7xf32>
+  memref.dealloc %1 : memref<4x7xf32>
+  %4 = memref.subview %3[0, 3] [4, 4] [1, 1] : memref<4x7xf32> to memref<4x4xf32, #strided3>
+  linalg.copy(%y, %4) : memref<4x4xf32>, memref<4x4xf32, #strided3>
+  memref.dealloc %y : memref<4x4xf32>
+  return %3 : memref<4x7xf32>
+}
+
+// -----
+
+#map = affine_map<(d0, d1) -> (d0, d1)>
+#strided0 = affine_map<(d0, d1) -> (d0 * 7 + d1)>
+
+// The input is still copied when it is read after the concatenated buffer is
+// written.
+
+// CHECK-LABEL:   func @input_read_after_write(
+// CHECK:           linalg.copy(%{{.*}}, %{{.*}}) : memref<4x3xf32>, memref<4x3xf32, #{{.*}}>
+func @input_read_after_write(%arg0: memref<4x3xf32>, %out: memref<4x3xf32>) -> memref<4x7xf32> {
+  %cst = constant 0.0 : f32
+  %x = memref.alloc() : memref<4x3xf32>
+  linalg.generic {indexing_maps = [#map, #map], iterator_types = ["parallel", "parallel"]}
+      ins(%arg0 : memref<4x3xf32>) outs(%x : memref<4x3xf32>) {
+  ^bb0(%a: f32, %b: f32):
+    %0 = addf %a, %a : f32
+    linalg.yield %0 : f32
+  }
+  %result = memref.alloc() : memref<4x7xf32>
+  %1 = memref.subview %result[0, 0] [4, 3] [1, 1] : memref<4x7xf32> to memref<4x3xf32, #strided0>
+  linalg.copy(%x, %1) : memref<4x3xf32>, memref<4x3xf32, #strided0>
+  linalg.fill(%result, %cst) : memref<4x7xf32>, f32
+  linalg.copy(%x, %out) : memref<4x3xf32>, memref<4x3xf32>
+  memref.dealloc %x : memref<4x3xf32>
+  return %result : memref<4x7xf32>
+}
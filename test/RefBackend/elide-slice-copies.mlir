@@ -0,0 +1,69 @@
+// RUN: npcomp-opt -refback-elide-slice-copies -split-input-file %s | FileCheck %s
+
+#map = affine_map<(d0, d1) -> (d0, d1)>
+#strided = affine_map<(d0, d1)[s0] -> (d0 * 8 + s0 + d1)>
+
+// A slice only read by a linalg op is read through the view.
+
+// CHECK-LABEL:   func @read_slice(
+// CHECK-SAME:                     %[[ARG:.*]]: memref<4x8xf32>,
+// CHECK-SAME:                     %[[OUT:.*]]: memref<4x3xf32>) {
+// CHECK:           %[[VIEW:.*]] = memref.subview %[[ARG]][0, 2] [4, 3] [1, 1]
+// CHECK-NOT:       memref.alloc
+// CHECK-NOT:       linalg.copy
+// CHECK:           linalg.generic
+// CHECK-SAME:        ins(%[[VIEW]] : memref<4x3xf32, #{{.*}}>)
+// CHECK-SAME:        outs(%[[OUT]] : memref<4x3xf32>)
+// CHECK-NOT:       memref.dealloc
+// CHECK:           return
+func @read_slice(%arg0: memref<4x8xf32>, %out: memref<4x3xf32>) {
+  %0 = memref.subview %arg0[0, 2] [4, 3] [1, 1] : memref<4x8xf32> to memref<4x3xf32, #strided>
+  %1 = memref.alloc() : memref<4x3xf32>
+  linalg.copy(%0, %1) : memref<4x3xf32, #strided>, memref<4x3xf32>
+  linalg.generic {indexing_maps = [#map, #map], iterator_types = ["parallel", "parallel"]}
+      ins(%1 : memref<4x3xf32>) outs(%out : memref<4x3xf32>) {
+  ^bb0(%a: f32, %b: f32):
+    %2 = addf %a, %a : f32
+    linalg.yield %2 : f32
+  }
+  memref.dealloc %1 : memref<4x3xf32>
+  return
+}
+
+// -----
+
+#strided = affine_map<(d0, d1)[s0] -> (d0 * 8 + s0 + d1)>
+
+// The copy is kept when the sliced buffer is written while the copy is used.
+
+// CHECK-LABEL:   func @sliced_buffer_written(
+// CHECK:           linalg.copy
+// CHECK:           linalg.fill
+// CHECK:           linalg.copy
+func @sliced_buffer_written(%arg0: memref<4x8xf32>, %out: memref<4x3xf32>) {
+  %cst = constant 0.0 : f32
+  %0 = memref.subview %arg0[0, 2] [4, 3] [1, 1] : memref<4x8xf32> to memref<4x3xf32, #strided>
+  %1 = memref.alloc() : memref<4x3xf32>
+  linalg.copy(%0, %1) : memref<4x3xf32, #strided>, memref<4x3xf32>
+  linalg.fill(%arg0, %cst) : memref<4x8xf32>, f32
+  linalg.copy(%1, %out) : memref<4x3xf32>, memref<4x3xf32>
+  memref.dealloc %1 : memref<4x3xf32>
+  return
+}
+
+// -----
+
+#strided = affine_map<(d0, d1)[s0] -> (d0 * 8 + s0 + d1)>
+
+// Returned slices need the contiguous layout of the runtime ABI.
+
+// CHECK-LABEL:   func @returned_slice(
+// CHECK:           %[[COPY:.*]] = memref.alloc
+// CHECK:           linalg.copy
+// CHECK:           return %[[COPY]]
+func @returned_slice(%arg0: memref<4x8xf32>) -> memref<4x3xf32> {
+  %0 = memref.subview %arg0[0, 2] [4, 3] [1, 1] : memref<4x8xf32> to memref<4x3xf32, #strided>
+  %1 = memref.alloc() : memref<4x3xf32>
+  linalg.copy(%0, %1) : memref<4x3xf32, #strided>, memref<4x3xf32>
+  return %1 : memref<4x3xf32>
+}
@@ -0,0 +1,28 @@
+// RUN: npcomp-opt -refback-expand-splat-constants=min-elements=16 -split-input-file %s | FileCheck %s
+
+// CHECK-LABEL:   func @zero_bias(
+// CHECK-SAME:                    %[[ARG:.*]]: tensor<4x8xf32>) -> tensor<4x8xf32> {
+// CHECK:           %[[INIT:.*]] = linalg.init_tensor [4, 8] : tensor<4x8xf32>
+// CHECK:           %[[ZERO:.*]] = constant 0.000000e+00 : f32
+// CHECK:           %[[BIAS:.*]] = linalg.fill(%[[INIT]], %[[ZERO]]) : tensor<4x8xf32>, f32 -> tensor<4x8xf32>
+// CHECK:           %[[SUM:.*]] = addf %[[ARG]], %[[BIAS]] : tensor<4x8xf32>
+// CHECK:           return %[[SUM]] : tensor<4x8xf32>
+func @zero_bias(%arg0: tensor<4x8xf32>) -> tensor<4x8xf32> {
+  %0 = constant dense<0.0> : tensor<4x8xf32>
+  %1 = addf %arg0, %0 : tensor<4x8xf32>
+  return %1 : tensor<4x8xf32>
+}
+
+// -----
+
+// Small splats and constants that aren't splats stay constants.
+
+// CHECK-LABEL:   func @not_expanded(
+// CHECK-NOT:       linalg.fill
+// CHECK:           constant dense<1> : tensor<8xi32>
+// CHECK:           constant dense<[
+func @not_expanded() -> (tensor<8xi32>, tensor<16xi32>) {
+  %0 = constant dense<1> : tensor<8xi32>
+  %1 = constant dense<[0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15]> : tensor<16xi32>
+  return %0, %1 : tensor<8xi32>, tensor<16xi32>
+}
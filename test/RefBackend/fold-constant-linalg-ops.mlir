@@ -0,0 +1,95 @@
+// RUN: npcomp-opt -refback-fold-constant-linalg-ops -split-input-file <%s | FileCheck %s --dump-input=fail
+// RUN: npcomp-opt -refback-fold-constant-linalg-ops=max-elements=4 -split-input-file <%s | FileCheck %s --check-prefix=BUDGET --dump-input=fail
+
+#map0 = affine_map<(d0, d1) -> (d1, d0)>
+#map1 = affine_map<(d0, d1) -> (d0, d1)>
+// CHECK-LABEL: func @transpose
+// CHECK-NEXT:    %[[RESULT:.*]] = constant dense<{{\[}}[1, 3, 5], [2, 4, 6]]> : tensor<2x3xi32>
+// CHECK-NEXT:    return %[[RESULT]]
+// Results larger than the budget aren't folded.
+// BUDGET-LABEL:  func @transpose
+// BUDGET:          linalg.generic
+func @transpose() -> tensor<2x3xi32> {
+  %0 = constant dense<[[1, 2], [3, 4], [5, 6]]> : tensor<3x2xi32>
+  %1 = linalg.init_tensor [2, 3] : tensor<2x3xi32>
+  %2 = linalg.generic {indexing_maps = [#map0, #map1], iterator_types = ["parallel", "parallel"]} ins(%0 : tensor<3x2xi32>) outs(%1 : tensor<2x3xi32>) {
+  ^bb0(%arg0: i32, %arg1: i32):
+    linalg.yield %arg0 : i32
+  } -> tensor<2x3xi32>
+  return %2 : tensor<2x3xi32>
+}
+
+// -----
+
+#map0 = affine_map<(d0, d1) -> (d1)>
+#map1 = affine_map<(d0, d1) -> (d0, d1)>
+// CHECK-LABEL: func @broadcast
+// CHECK-NEXT:    %[[RESULT:.*]] = constant dense<{{\[}}[1.000000e+00, 2.000000e+00], [1.000000e+00, 2.000000e+00]]> : tensor<2x2xf32>
+// CHECK-NEXT:    return %[[RESULT]]
+func @broadcast() -> tensor<2x2xf32> {
+  %0 = constant dense<[1.0, 2.0]> : tensor<2xf32>
+  %1 = linalg.init_tensor [2, 2] : tensor<2x2xf32>
+  %2 = linalg.generic {indexing_maps = [#map0, #map1], iterator_types = ["parallel", "parallel"]} ins(%0 : tensor<2xf32>) outs(%1 : tensor<2x2xf32>) {
+  ^bb0(%arg0: f32, %arg1: f32):
+    linalg.yield %arg0 : f32
+  } -> tensor<2x2xf32>
+  return %2 : tensor<2x2xf32>
+}
+
+// -----
+
+// Payloads that compute something are folded op by op.
+
+#map = affine_map<(d0) -> (d0)>
+// CHECK-LABEL: func @computation
+// CHECK:         %[[RESULT:.*]] = constant dense<[4.000000e+00, 6.000000e+00]> : tensor<2xf32>
+// CHECK-NEXT:    return %[[RESULT]]
+func @computation() -> tensor<2xf32> {
+  %0 = constant dense<[1.0, 2.0]> : tensor<2xf32>
+  %1 = constant dense<[3.0, 4.0]> : tensor<2xf32>
+  %cst = constant 0.0 : f32
+  %2 = linalg.init_tensor [2] : tensor<2xf32>
+  %3 = linalg.generic {indexing_maps = [#map, #map, #map], iterator_types = ["parallel"]} ins(%0, %1 : tensor<2xf32>, tensor<2xf32>) outs(%2 : tensor<2xf32>) {
+  ^bb0(%arg0: f32, %arg1: f32, %arg2: f32):
+    %4 = addf %arg0, %arg1 : f32
+    %5 = addf %4, %cst : f32
+    linalg.yield %5 : f32
+  } -> tensor<2xf32>
+  return %3 : tensor<2xf32>
+}
+
+// -----
+
+// Ops with non-constant inputs are left alone.
+
+#map = affine_map<(d0) -> (d0)>
+// CHECK-LABEL: func @non_constant
+// CHECK:         linalg.generic
+func @non_constant(%arg0: tensor<2xf32>) -> tensor<2xf32> {
+  %0 = linalg.init_tensor [2] : tensor<2xf32>
+  %1 = linalg.generic {indexing_maps = [#map, #map], iterator_types = ["parallel"]} ins(%arg0 : tensor<2xf32>) outs(%0 : tensor<2xf32>) {
+  ^bb0(%arg1: f32, %arg2: f32):
+    linalg.yield %arg1 : f32
+  } -> tensor<2xf32>
+  return %1 : tensor<2xf32>
+}
+
+
+// -----
+
+// Inputs can be indexed with any affine map, such as a reshape.
+
+#map0 = affine_map<(d0) -> (d0 floordiv 2, d0 mod 2)>
+#map1 = affine_map<(d0) -> (d0)>
+// CHECK-LABEL: func @reshape
+// CHECK-NEXT:    %[[RESULT:.*]] = constant dense<[1, 2, 3, 4]> : tensor<4xi32>
+// CHECK-NEXT:    return %[[RESULT]]
+func @reshape() -> tensor<4xi32> {
+  %0 = constant dense<[[1, 2], [3, 4]]> : tensor<2x2xi32>
+  %1 = linalg.init_tensor [4] : tensor<4xi32>
+  %2 = linalg.generic {indexing_maps = [#map0, #map1], iterator_types = ["parallel"]} ins(%0 : tensor<2x2xi32>) outs(%1 : tensor<4xi32>) {
+  ^bb0(%arg0: i32, %arg1: i32):
+    linalg.yield %arg0 : i32
+  } -> tensor<4xi32>
+  return %2 : tensor<4xi32>
+}
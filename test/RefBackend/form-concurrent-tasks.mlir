@@ -0,0 +1,73 @@
+// RUN: npcomp-opt -refback-form-concurrent-tasks -split-input-file <%s | FileCheck %s --dump-input=fail
+
+// Two towers reading the same input and writing separate buffers run
+// concurrently, then the op joining them runs on its own.
+
+#map = affine_map<(d0) -> (d0)>
+// CHECK-LABEL: func @towers(
+// CHECK-SAME:      %[[ARG:.*]]: memref<?xf32>, %[[OUT:.*]]: memref<?xf32>) {
+// CHECK:         %[[A:.*]] = memref.alloc
+// CHECK:         %[[B:.*]] = memref.alloc
+// CHECK:         %[[NUM_TASKS:.*]] = constant 2 : index
+// CHECK:         scf.parallel (%[[TASK:.*]]) = (%{{.*}}) to (%[[NUM_TASKS]])
+// CHECK:           %[[IS0:.*]] = cmpi eq, %[[TASK]], %{{.*}} : index
+// CHECK:           scf.if %[[IS0]] {
+// CHECK:             linalg.generic {{.*}} ins(%[[ARG]] : memref<?xf32>) outs(%[[A]] : memref<?xf32>)
+// CHECK:           %[[IS1:.*]] = cmpi eq, %[[TASK]], %{{.*}} : index
+// CHECK:           scf.if %[[IS1]] {
+// CHECK:             linalg.generic {{.*}} ins(%[[ARG]] : memref<?xf32>) outs(%[[B]] : memref<?xf32>)
+// CHECK:         } {refbackrt.concurrent_tasks}
+// CHECK:         linalg.generic {{.*}} ins(%[[A]], %[[B]] : memref<?xf32>, memref<?xf32>) outs(%[[OUT]] : memref<?xf32>)
+// CHECK:         memref.dealloc %[[A]]
+// CHECK:         memref.dealloc %[[B]]
+// CHECK:         return
+func @towers(%arg0: memref<?xf32>, %out: memref<?xf32>) {
+  %c0 = constant 0 : index
+  %size = memref.dim %arg0, %c0 : memref<?xf32>
+  %a = memref.alloc(%size) : memref<?xf32>
+  linalg.generic {indexing_maps = [#map, #map], iterator_types = ["parallel"]}
+      ins(%arg0 : memref<?xf32>) outs(%a : memref<?xf32>) {
+  ^bb0(%x: f32, %y: f32):
+    %0 = math.exp %x : f32
+    linalg.yield %0 : f32
+  }
+  %b = memref.alloc(%size) : memref<?xf32>
+  linalg.generic {indexing_maps = [#map, #map], iterator_types = ["parallel"]}
+      ins(%arg0 : memref<?xf32>) outs(%b : memref<?xf32>) {
+  ^bb0(%x: f32, %y: f32):
+    %0 = math.tanh %x : f32
+    linalg.yield %0 : f32
+  }
+  linalg.generic {indexing_maps = [#map, #map, #map], iterator_types = ["parallel"]}
+      ins(%a, %b : memref<?xf32>, memref<?xf32>) outs(%out : memref<?xf32>) {
+  ^bb0(%x: f32, %y: f32, %z: f32):
+    %0 = addf %x, %y : f32
+    linalg.yield %0 : f32
+  }
+  memref.dealloc %a : memref<?xf32>
+  memref.dealloc %b : memref<?xf32>
+  return
+}
+
+// -----
+
+// Ops writing buffers that may alias (here, function arguments) stay in
+// order.
+
+#map = affine_map<(d0) -> (d0)>
+// CHECK-LABEL: func @may_alias
+// CHECK-NOT:     scf.parallel
+// CHECK:         return
+func @may_alias(%arg0: memref<?xf32>, %arg1: memref<?xf32>, %arg2: memref<?xf32>) {
+  linalg.generic {indexing_maps = [#map, #map], iterator_types = ["parallel"]}
+      ins(%arg0 : memref<?xf32>) outs(%arg1 : memref<?xf32>) {
+  ^bb0(%x: f32, %y: f32):
+    linalg.yield %x : f32
+  }
+  linalg.generic {indexing_maps = [#map, #map], iterator_types = ["parallel"]}
+      ins(%arg0 : memref<?xf32>) outs(%arg2 : memref<?xf32>) {
+  ^bb0(%x: f32, %y: f32):
+    linalg.yield %x : f32
+  }
+  return
+}
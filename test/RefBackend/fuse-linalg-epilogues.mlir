@@ -0,0 +1,53 @@
+// RUN: npcomp-opt -refback-fuse-linalg-epilogues="matmul-tile-sizes=32,32,32" -split-input-file <%s | FileCheck %s --dump-input=fail
+
+// The bias broadcast, the matmul and the activation are all computed tile by
+// tile, in a single loop nest over the output.
+
+#map0 = affine_map<(d0, d1) -> (d1)>
+#map1 = affine_map<(d0, d1) -> (d0, d1)>
+// CHECK-LABEL: func @linear_tanh
+// CHECK:         scf.for
+// CHECK:           scf.for
+// CHECK:             linalg.generic
+// CHECK-SAME:          ins(%{{.*}} : memref<64xf32>)
+// CHECK:             linalg.matmul
+// CHECK:             linalg.generic
+// CHECK:               math.tanh
+// CHECK-NOT:     linalg.
+// CHECK:         return
+func @linear_tanh(%arg0: memref<128x16xf32>, %arg1: memref<16x64xf32>, %arg2: memref<64xf32>, %arg3: memref<128x64xf32>) {
+  %0 = memref.alloc() : memref<128x64xf32>
+  linalg.generic {indexing_maps = [#map0, #map1], iterator_types = ["parallel", "parallel"]} ins(%arg2 : memref<64xf32>) outs(%0 : memref<128x64xf32>) {
+  ^bb0(%arg4: f32, %arg5: f32):
+    linalg.yield %arg4 : f32
+  }
+  linalg.matmul ins(%arg0, %arg1 : memref<128x16xf32>, memref<16x64xf32>) outs(%0 : memref<128x64xf32>)
+  linalg.generic {indexing_maps = [#map1, #map1], iterator_types = ["parallel", "parallel"]} ins(%0 : memref<128x64xf32>) outs(%arg3 : memref<128x64xf32>) {
+  ^bb0(%arg4: f32, %arg5: f32):
+    %1 = math.tanh %arg4 : f32
+    linalg.yield %1 : f32
+  }
+  memref.dealloc %0 : memref<128x64xf32>
+  return
+}
+
+// -----
+
+// Ops in between that access memory prevent fusion.
+
+#map = affine_map<(d0, d1) -> (d0, d1)>
+// CHECK-LABEL: func @intervening_store
+// CHECK-NOT:     scf.for
+// CHECK:         linalg.matmul
+// CHECK:         memref.store
+// CHECK:         linalg.generic
+func @intervening_store(%arg0: memref<128x16xf32>, %arg1: memref<16x64xf32>, %arg2: memref<128x64xf32>, %arg3: memref<128x64xf32>, %arg4: f32, %arg5: index) {
+  linalg.matmul ins(%arg0, %arg1 : memref<128x16xf32>, memref<16x64xf32>) outs(%arg2 : memref<128x64xf32>)
+  memref.store %arg4, %arg2[%arg5, %arg5] : memref<128x64xf32>
+  linalg.generic {indexing_maps = [#map, #map], iterator_types = ["parallel", "parallel"]} ins(%arg2 : memref<128x64xf32>) outs(%arg3 : memref<128x64xf32>) {
+  ^bb0(%arg6: f32, %arg7: f32):
+    %0 = math.tanh %arg6 : f32
+    linalg.yield %0 : f32
+  }
+  return
+}
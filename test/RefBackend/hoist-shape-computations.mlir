@@ -0,0 +1,53 @@
+// RUN: npcomp-opt -refback-hoist-shape-computations -split-input-file <%s | FileCheck %s --dump-input=fail
+
+// A chain of ops on tensors of the same shape queries the extent once, at the
+// entry, and allocates each result with it.
+
+// CHECK-LABEL: func @chain(
+// CHECK-SAME:      %[[ARG:.*]]: tensor<?xf32>)
+// CHECK-NEXT:    %[[C0:.*]] = constant 0 : index
+// CHECK-NEXT:    %[[EXTENT:.*]] = memref.dim %[[ARG]], %[[C0]]
+// CHECK-NEXT:    %[[FIRST:.*]] = memref.alloc(%[[EXTENT]])
+// CHECK:         %[[SECOND:.*]] = memref.alloc(%[[EXTENT]])
+// CHECK-NOT:     memref.dim
+// CHECK-NOT:     tensor.from_elements
+// CHECK-NOT:     tensor.extract
+func @chain(%arg0: tensor<?xf32>) -> tensor<?xf32> {
+  %c0 = constant 0 : index
+  %0 = memref.dim %arg0, %c0 : tensor<?xf32>
+  %1 = tensor.from_elements %0 : tensor<1xindex>
+  %c0_0 = constant 0 : index
+  %2 = tensor.extract %1[%c0_0] : tensor<1xindex>
+  %3 = memref.alloc(%2) : memref<?xf32>
+  %4 = memref.tensor_load %3 : memref<?xf32>
+  %c0_1 = constant 0 : index
+  %5 = memref.dim %4, %c0_1 : tensor<?xf32>
+  %6 = tensor.from_elements %5 : tensor<1xindex>
+  %c0_2 = constant 0 : index
+  %7 = tensor.extract %6[%c0_2] : tensor<1xindex>
+  %8 = memref.alloc(%7) : memref<?xf32>
+  %9 = memref.tensor_load %8 : memref<?xf32>
+  return %9 : tensor<?xf32>
+}
+
+// -----
+
+// Shape computations on values computed in the function, and divisions,
+// which may trap, stay in place.
+
+// CHECK-LABEL: func @not_hoisted(
+// CHECK-SAME:      %[[ARG:.*]]: tensor<?xf32>, %[[VALUE:.*]]: f32, %[[SHAPE:.*]]: tensor<?xindex>, %[[DIVISOR:.*]]: index)
+// CHECK-NEXT:    %[[C0:.*]] = constant 0 : index
+// CHECK-NEXT:    %[[EXTENT:.*]] = memref.dim %[[ARG]], %[[C0]]
+// CHECK-NEXT:    %[[TENSOR:.*]] = tcp.splatted
+// CHECK-NEXT:    memref.dim %[[TENSOR]], %[[C0]]
+// CHECK-NEXT:    divi_signed %[[EXTENT]], %[[DIVISOR]]
+func @not_hoisted(%arg0: tensor<?xf32>, %arg1: f32, %arg2: tensor<?xindex>, %arg3: index) -> (index, index) {
+  %c0 = constant 0 : index
+  %0 = tcp.splatted %arg1, %arg2 : (f32, tensor<?xindex>) -> tensor<?xf32>
+  %1 = memref.dim %0, %c0 : tensor<?xf32>
+  %c0_0 = constant 0 : index
+  %2 = memref.dim %arg0, %c0_0 : tensor<?xf32>
+  %3 = divi_signed %2, %arg3 : index
+  return %1, %3 : index, index
+}
@@ -0,0 +1,79 @@
+// RUN: npcomp-opt -refback-hoist-shape-constraints -split-input-file <%s | FileCheck %s --dump-input=fail
+
+// A chain of broadcasting ops on the same shapes checks them only once: the
+// second op broadcasts the result of the first (whose shape is the broadcast
+// of the same shapes) with one of them again.
+
+// CHECK-LABEL: func @chain(
+// CHECK-SAME:      %[[LHS:.*]]: tensor<?xf32>, %[[RHS:.*]]: tensor<?xf32>)
+// CHECK:         %[[LHS_SHAPE:.*]] = shape.shape_of %[[LHS]]
+// CHECK:         %[[RHS_SHAPE:.*]] = shape.shape_of %[[RHS]]
+// CHECK:         %[[WITNESS:.*]] = shape.cstr_broadcastable %[[LHS_SHAPE]], %[[RHS_SHAPE]]
+// CHECK:         %[[SHAPE:.*]] = shape.broadcast %[[LHS_SHAPE]], %[[RHS_SHAPE]]
+// CHECK:         %[[FIRST:.*]] = shape.assuming %[[WITNESS]]
+// CHECK:         %[[TRUE:.*]] = shape.const_witness true
+// CHECK:         shape.assuming %[[TRUE]]
+// CHECK-NOT:       shape.broadcast
+// CHECK:           tcp.broadcast_to %[[FIRST]], %[[SHAPE]]
+// CHECK:           tcp.broadcast_to %[[RHS]], %[[SHAPE]]
+// CHECK-NOT:     shape.cstr_broadcastable
+func @chain(%arg0: tensor<?xf32>, %arg1: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = shape.shape_of %arg0 : tensor<?xf32> -> tensor<?xindex>
+  %1 = shape.shape_of %arg1 : tensor<?xf32> -> tensor<?xindex>
+  %2 = shape.cstr_broadcastable %0, %1 : tensor<?xindex>, tensor<?xindex>
+  %3 = shape.assuming %2 -> (tensor<?xf32>) {
+    %10 = shape.broadcast %0, %1 : tensor<?xindex>, tensor<?xindex> -> tensor<?xindex>
+    %11 = tcp.broadcast_to %arg0, %10 : (tensor<?xf32>, tensor<?xindex>) -> tensor<?xf32>
+    %12 = tcp.broadcast_to %arg1, %10 : (tensor<?xf32>, tensor<?xindex>) -> tensor<?xf32>
+    %13 = addf %11, %12 : tensor<?xf32>
+    shape.assuming_yield %13 : tensor<?xf32>
+  }
+  %4 = shape.shape_of %3 : tensor<?xf32> -> tensor<?xindex>
+  %5 = shape.shape_of %arg1 : tensor<?xf32> -> tensor<?xindex>
+  %6 = shape.cstr_broadcastable %4, %5 : tensor<?xindex>, tensor<?xindex>
+  %7 = shape.assuming %6 -> (tensor<?xf32>) {
+    %10 = shape.broadcast %4, %5 : tensor<?xindex>, tensor<?xindex> -> tensor<?xindex>
+    %11 = tcp.broadcast_to %3, %10 : (tensor<?xf32>, tensor<?xindex>) -> tensor<?xf32>
+    %12 = tcp.broadcast_to %arg1, %10 : (tensor<?xf32>, tensor<?xindex>) -> tensor<?xf32>
+    %13 = mulf %11, %12 : tensor<?xf32>
+    shape.assuming_yield %13 : tensor<?xf32>
+  }
+  return %7 : tensor<?xf32>
+}
+
+// -----
+
+// Constraints on new shapes are kept, but hoisted.
+
+// CHECK-LABEL: func @new_shape(
+// CHECK-SAME:      %[[ARG0:.*]]: tensor<?xf32>, %[[ARG1:.*]]: tensor<?xf32>, %[[ARG2:.*]]: tensor<?xf32>)
+// CHECK:         shape.cstr_broadcastable
+// CHECK:         %[[SHAPE:.*]] = shape.broadcast
+// CHECK:         %[[ARG2_SHAPE:.*]] = shape.shape_of %[[ARG2]]
+// CHECK:         shape.cstr_broadcastable %[[SHAPE]], %[[ARG2_SHAPE]]
+// CHECK:         shape.broadcast %[[SHAPE]], %[[ARG2_SHAPE]]
+// CHECK:         shape.assuming
+// CHECK-NOT:     shape.const_witness
+func @new_shape(%arg0: tensor<?xf32>, %arg1: tensor<?xf32>, %arg2: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = shape.shape_of %arg0 : tensor<?xf32> -> tensor<?xindex>
+  %1 = shape.shape_of %arg1 : tensor<?xf32> -> tensor<?xindex>
+  %2 = shape.cstr_broadcastable %0, %1 : tensor<?xindex>, tensor<?xindex>
+  %3 = shape.assuming %2 -> (tensor<?xf32>) {
+    %10 = shape.broadcast %0, %1 : tensor<?xindex>, tensor<?xindex> -> tensor<?xindex>
+    %11 = tcp.broadcast_to %arg0, %10 : (tensor<?xf32>, tensor<?xindex>) -> tensor<?xf32>
+    %12 = tcp.broadcast_to %arg1, %10 : (tensor<?xf32>, tensor<?xindex>) -> tensor<?xf32>
+    %13 = addf %11, %12 : tensor<?xf32>
+    shape.assuming_yield %13 : tensor<?xf32>
+  }
+  %4 = shape.shape_of %3 : tensor<?xf32> -> tensor<?xindex>
+  %5 = shape.shape_of %arg2 : tensor<?xf32> -> tensor<?xindex>
+  %6 = shape.cstr_broadcastable %4, %5 : tensor<?xindex>, tensor<?xindex>
+  %7 = shape.assuming %6 -> (tensor<?xf32>) {
+    %10 = shape.broadcast %4, %5 : tensor<?xindex>, tensor<?xindex> -> tensor<?xindex>
+    %11 = tcp.broadcast_to %3, %10 : (tensor<?xf32>, tensor<?xindex>) -> tensor<?xf32>
+    %12 = tcp.broadcast_to %arg2, %10 : (tensor<?xf32>, tensor<?xindex>) -> tensor<?xf32>
+    %13 = addf %11, %12 : tensor<?xf32>
+    shape.assuming_yield %13 : tensor<?xf32>
+  }
+  return %7 : tensor<?xf32>
+}
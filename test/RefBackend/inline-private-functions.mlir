@@ -0,0 +1,74 @@
+// RUN: npcomp-opt -refback-inline-private-functions=inline-threshold=4 -split-input-file <%s | FileCheck %s --dump-input=fail
+
+// Small callees are inlined, and deleted once no call is left to them. TCF
+// ops see the static operands, other users the declared types.
+
+// CHECK-NOT:   func private @add
+// CHECK-LABEL: func @f(
+// CHECK-SAME:      %[[ARG0:.*]]: tensor<2xf32>, %[[ARG1:.*]]: tensor<?xf32>) -> tensor<?xf32> {
+// CHECK:         %[[CAST:.*]] = tensor.cast %[[ARG0]] : tensor<2xf32> to tensor<?xf32>
+// CHECK:         %[[SUM:.*]] = tcf.add %[[ARG0]], %[[ARG1]] : (tensor<2xf32>, tensor<?xf32>) -> tensor<?xf32>
+// CHECK:         %[[DIM:.*]] = memref.dim %[[CAST]]
+// CHECK:         %[[SUM2:.*]] = tcf.add %[[SUM]], %[[SUM]] : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+// CHECK-NOT:     call
+// CHECK:         return %[[SUM2]]
+func private @add(%arg0: tensor<?xf32>, %arg1: tensor<?xf32>) -> tensor<?xf32> {
+  %c0 = constant 0 : index
+  %0 = tcf.add %arg0, %arg1 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  %1 = memref.dim %arg0, %c0 : tensor<?xf32>
+  return %0 : tensor<?xf32>
+}
+
+func @f(%arg0: tensor<2xf32>, %arg1: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = tensor.cast %arg0 : tensor<2xf32> to tensor<?xf32>
+  %1 = call @add(%0, %arg1) : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  %2 = call @add(%1, %1) : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  return %2 : tensor<?xf32>
+}
+
+// -----
+
+// Larger callees called several times are specialized for the static shapes
+// of the operands, once per distinct signature.
+
+// CHECK-LABEL: func private @big(
+// CHECK-SAME:      tensor<?xf32>) -> tensor<?xf32>
+// CHECK-LABEL: func private @big.static0(
+// CHECK-SAME:      %[[ARG:.*]]: tensor<2xf32>) -> tensor<?xf32> {
+// CHECK:         tcf.exp %[[ARG]] : (tensor<2xf32>) -> tensor<?xf32>
+// CHECK-LABEL: func @g(
+// CHECK-SAME:      %[[ARG0:.*]]: tensor<2xf32>, %[[ARG1:.*]]: tensor<?xf32>)
+// CHECK:         call @big.static0(%[[ARG0]]) : (tensor<2xf32>) -> tensor<?xf32>
+// CHECK:         call @big.static0(%[[ARG0]]) : (tensor<2xf32>) -> tensor<?xf32>
+// CHECK:         call @big(%[[ARG1]]) : (tensor<?xf32>) -> tensor<?xf32>
+func private @big(%arg0: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = tcf.exp %arg0 : (tensor<?xf32>) -> tensor<?xf32>
+  %1 = tcf.exp %0 : (tensor<?xf32>) -> tensor<?xf32>
+  %2 = tcf.exp %1 : (tensor<?xf32>) -> tensor<?xf32>
+  %3 = tcf.exp %2 : (tensor<?xf32>) -> tensor<?xf32>
+  return %3 : tensor<?xf32>
+}
+
+func @g(%arg0: tensor<2xf32>, %arg1: tensor<?xf32>) -> (tensor<?xf32>, tensor<?xf32>, tensor<?xf32>) {
+  %0 = tensor.cast %arg0 : tensor<2xf32> to tensor<?xf32>
+  %1 = call @big(%0) : (tensor<?xf32>) -> tensor<?xf32>
+  %2 = call @big(%0) : (tensor<?xf32>) -> tensor<?xf32>
+  %3 = call @big(%arg1) : (tensor<?xf32>) -> tensor<?xf32>
+  return %1, %2, %3 : tensor<?xf32>, tensor<?xf32>, tensor<?xf32>
+}
+
+// -----
+
+// Public functions are left alone.
+
+// CHECK-LABEL: func @public_callee
+// CHECK-LABEL: func @h
+// CHECK:         call @public_callee
+func @public_callee(%arg0: tensor<?xf32>) -> tensor<?xf32> {
+  return %arg0 : tensor<?xf32>
+}
+
+func @h(%arg0: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = call @public_callee(%arg0) : (tensor<?xf32>) -> tensor<?xf32>
+  return %0 : tensor<?xf32>
+}
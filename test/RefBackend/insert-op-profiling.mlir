@@ -0,0 +1,70 @@
+// RUN: npcomp-opt -refback-insert-op-profiling -split-input-file <%s | FileCheck %s --dump-input=fail
+
+// Each top-level linalg op is profiled, and named after its location.
+
+// CHECK-LABEL: func @ops
+// CHECK:         %[[START0:.*]] = refbackrt.profile_begin
+// CHECK-NEXT:    linalg.fill
+// CHECK-NEXT:    refbackrt.profile_end "linalg.fill at model.py:3:4", %[[START0]]
+// CHECK-NEXT:    %[[START1:.*]] = refbackrt.profile_begin
+// CHECK-NEXT:    linalg.matmul
+// CHECK-NEXT:    refbackrt.profile_end "linalg.matmul at model.py:4:8", %[[START1]]
+// CHECK-NEXT:    return
+func @ops(%arg0: memref<?x?xf32>, %arg1: memref<?x?xf32>, %arg2: memref<?x?xf32>, %arg3: f32) {
+  linalg.fill(%arg2, %arg3) : memref<?x?xf32>, f32 loc("/path/to/model.py":3:4)
+  linalg.matmul ins(%arg0, %arg1 : memref<?x?xf32>, memref<?x?xf32>) outs(%arg2 : memref<?x?xf32>) loc(callsite("model.py":4:8 at "main.py":1:1))
+  return
+}
+
+// -----
+
+// Ops with a named location, such as the TorchScript ops of a submodule, are
+// attributed to the innermost name.
+
+// CHECK-LABEL: func @scopes
+// CHECK:         refbackrt.profile_end "linalg.fill at model.py:3:4 in layer1.forward"
+// CHECK:         refbackrt.profile_end "linalg.copy in forward"
+func @scopes(%arg0: memref<?xf32>, %arg1: memref<?xf32>, %arg2: f32) {
+  linalg.fill(%arg0, %arg2) : memref<?xf32>, f32 loc(callsite("layer1.forward"("model.py":3:4) at "forward"("model.py":10:4)))
+  linalg.copy(%arg0, %arg1) : memref<?xf32>, memref<?xf32> loc("forward"(unknown))
+  return
+}
+
+// -----
+
+// A loop nest is profiled as a whole, named after the linalg ops in it. Ops
+// in other regions are profiled individually.
+
+// CHECK-LABEL: func @nested
+// CHECK:         refbackrt.profile_begin
+// CHECK-NEXT:    scf.for
+// CHECK-NOT:     refbackrt.profile
+// CHECK:         refbackrt.profile_end "linalg.matmul+linalg.generic at tiles.mlir:1:1"
+// CHECK:         scf.if
+// CHECK-NEXT:      refbackrt.profile_begin
+// CHECK-NEXT:      linalg.copy
+// CHECK-NEXT:      refbackrt.profile_end "linalg.copy"
+// CHECK:         refbackrt.profile_begin
+// CHECK-NEXT:    scf.for
+// CHECK:         refbackrt.profile_end "scf.for"
+#map = affine_map<(d0, d1) -> (d0, d1)>
+func @nested(%arg0: memref<?x?xf32>, %arg1: memref<?x?xf32>, %arg2: memref<?x?xf32>, %arg3: index, %arg4: i1) {
+  %c0 = constant 0 : index
+  %c1 = constant 1 : index
+  scf.for %i = %c0 to %arg3 step %c1 {
+    linalg.matmul ins(%arg0, %arg1 : memref<?x?xf32>, memref<?x?xf32>) outs(%arg2 : memref<?x?xf32>)
+    linalg.generic {indexing_maps = [#map], iterator_types = ["parallel", "parallel"]} outs(%arg2 : memref<?x?xf32>) {
+    ^bb0(%arg5: f32):
+      %0 = addf %arg5, %arg5 : f32
+      linalg.yield %0 : f32
+    }
+  } loc("tiles.mlir":1:1)
+  scf.if %arg4 {
+    linalg.copy(%arg0, %arg1) : memref<?x?xf32>, memref<?x?xf32> loc(unknown)
+  }
+  scf.for %i = %c0 to %arg3 step %c1 {
+    %0 = memref.load %arg0[%i, %i] : memref<?x?xf32>
+    memref.store %0, %arg1[%i, %i] : memref<?x?xf32>
+  } loc(unknown)
+  return
+}
@@ -0,0 +1,75 @@
+// RUN: npcomp-opt -refback-insert-prefetches=distance=4 <%s | FileCheck %s --dump-input=fail
+
+// Loads across rows prefetch the element of a later iteration, clamped to the
+// iteration space. Sequential loads don't.
+
+// CHECK-LABEL: func @across_rows(
+// CHECK-SAME:                    %[[A:.*]]: memref<?x?xf32>, %[[B:.*]]: memref<?x?xf32>, %[[I:.*]]: index, %[[J:.*]]: index, %[[K:.*]]: index
+// CHECK:         %[[C4:.*]] = constant 4 : index
+// CHECK:         %[[OFFSET:.*]] = muli %{{.*}}, %[[C4]]
+// CHECK:         scf.for %[[IV:.*]] =
+// CHECK:           %[[AHEAD:.*]] = addi %[[IV]], %[[OFFSET]]
+// CHECK:           %[[IN_RANGE:.*]] = cmpi slt, %[[AHEAD]], %[[K]]
+// CHECK:           %[[NEXT:.*]] = select %[[IN_RANGE]], %[[AHEAD]], %[[IV]]
+// CHECK-NOT:       memref.prefetch %[[A]]
+// CHECK:           memref.load %[[A]][%[[I]], %[[IV]]]
+// CHECK:           memref.prefetch %[[B]][%[[NEXT]], %[[J]]], read, locality<3>, data
+// CHECK:           memref.load %[[B]][%[[IV]], %[[J]]]
+func @across_rows(%A: memref<?x?xf32>, %B: memref<?x?xf32>, %i: index, %j: index, %K: index) -> f32 {
+  %c0 = constant 0 : index
+  %c1 = constant 1 : index
+  %zero = constant 0.0 : f32
+  %0 = scf.for %k = %c0 to %K step %c1 iter_args(%acc = %zero) -> (f32) {
+    %a = memref.load %A[%i, %k] : memref<?x?xf32>
+    %b = memref.load %B[%k, %j] : memref<?x?xf32>
+    %p = mulf %a, %b : f32
+    %s = addf %acc, %p : f32
+    scf.yield %s : f32
+  }
+  return %0 : f32
+}
+
+// Gathers repeat the loads of their indices for the later iteration.
+
+// CHECK-LABEL: func @gather(
+// CHECK-SAME:               %[[TABLE:.*]]: memref<?x?xf32>, %[[IDS:.*]]: memref<?xi32>, %[[OUT:.*]]: memref<?xf32>
+// CHECK:         scf.for %[[IV:.*]] =
+// CHECK:           %[[NEXT:.*]] = select
+// CHECK:           %[[ID:.*]] = memref.load %[[IDS]][%[[IV]]]
+// CHECK:           %[[ROW:.*]] = index_cast %[[ID]]
+// CHECK:           %[[NEXT_ID:.*]] = memref.load %[[IDS]][%[[NEXT]]]
+// CHECK:           %[[NEXT_ROW:.*]] = index_cast %[[NEXT_ID]]
+// CHECK:           memref.prefetch %[[TABLE]][%[[NEXT_ROW]], %{{.*}}], read, locality<3>, data
+// CHECK:           memref.load %[[TABLE]][%[[ROW]], %{{.*}}]
+func @gather(%table: memref<?x?xf32>, %ids: memref<?xi32>, %out: memref<?xf32>, %n: index) {
+  %c0 = constant 0 : index
+  %c1 = constant 1 : index
+  scf.for %i = %c0 to %n step %c1 {
+    %id = memref.load %ids[%i] : memref<?xi32>
+    %row = index_cast %id : i32 to index
+    %x = memref.load %table[%row, %c0] : memref<?x?xf32>
+    memref.store %x, %out[%i] : memref<?xf32>
+  }
+  return
+}
+
+// Only innermost loops are prefetched.
+
+// CHECK-LABEL: func @outer_loop(
+// CHECK:         scf.for
+// CHECK-NOT:       memref.prefetch
+// CHECK:           scf.for
+// CHECK:             memref.prefetch
+// CHECK:             memref.load
+func @outer_loop(%A: memref<?x?xf32>, %out: memref<?xf32>, %n: index) {
+  %c0 = constant 0 : index
+  %c1 = constant 1 : index
+  scf.for %i = %c0 to %n step %c1 {
+    %a = memref.load %A[%i, %c0] : memref<?x?xf32>
+    scf.for %j = %c0 to %n step %c1 {
+      %b = memref.load %A[%j, %i] : memref<?x?xf32>
+      memref.store %b, %out[%j] : memref<?xf32>
+    }
+  }
+  return
+}
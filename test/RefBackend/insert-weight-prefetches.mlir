@@ -0,0 +1,38 @@
+// RUN: npcomp-opt -refback-insert-weight-prefetches <%s | FileCheck %s --dump-input=fail
+
+// Each public function prefetches the external globals that it or its callees
+// read, once each and in the order of their first use. Globals stored in the
+// module aren't prefetched.
+
+memref.global "private" constant @__constant_a : memref<4xf32> = opaque<"refback", "0x65787465726E616C3A36343A2F646174612F776569676874732E62696E">
+memref.global "private" constant @__constant_b : memref<4xf32> = opaque<"refback", "0x65787465726E616C3A3132383A2F646174612F776569676874732E62696E">
+memref.global "private" constant @__constant_c : memref<2xi32> = dense<[1, 2]>
+
+// CHECK-LABEL: func @both(
+// CHECK-NEXT:    refbackrt.prefetch_global @__constant_b
+// CHECK-NEXT:    refbackrt.prefetch_global @__constant_a
+// CHECK-NOT:     refbackrt.prefetch_global
+// CHECK:         return
+func @both() -> (memref<4xf32>, memref<4xf32>, memref<2xi32>) {
+  %0 = memref.get_global @__constant_b : memref<4xf32>
+  %1 = call @helper() : () -> memref<4xf32>
+  %2 = memref.get_global @__constant_b : memref<4xf32>
+  %3 = memref.get_global @__constant_c : memref<2xi32>
+  return %0, %1, %3 : memref<4xf32>, memref<4xf32>, memref<2xi32>
+}
+
+// CHECK-LABEL: func @none(
+// CHECK-NOT:     refbackrt.prefetch_global
+// CHECK:         return
+func @none() -> memref<2xi32> {
+  %0 = memref.get_global @__constant_c : memref<2xi32>
+  return %0 : memref<2xi32>
+}
+
+// CHECK-LABEL: func private @helper(
+// CHECK-NOT:     refbackrt.prefetch_global
+// CHECK:         memref.get_global @__constant_a
+func private @helper() -> memref<4xf32> {
+  %0 = memref.get_global @__constant_a : memref<4xf32>
+  return %0 : memref<4xf32>
+}
@@ -0,0 +1,48 @@
+// RUN: npcomp-opt -refback-interchange-affine-loops -split-input-file <%s | FileCheck %s --dump-input=fail
+
+// The loop over the columns of a matmul moves innermost, where it walks the
+// right-hand side and the output with unit stride.
+
+// CHECK-LABEL: func @matmul(
+// CHECK-SAME:      %[[LHS:.*]]: memref<64x32xf32>, %[[RHS:.*]]: memref<32x16xf32>, %[[OUT:.*]]: memref<64x16xf32>)
+// CHECK:         affine.for %[[I:.*]] = 0 to 64 {
+// CHECK:           affine.for %[[K:.*]] = 0 to 32 {
+// CHECK:             affine.for %[[J:.*]] = 0 to 16 {
+// CHECK:               affine.load %[[LHS]][%[[I]], %[[K]]]
+// CHECK:               affine.load %[[RHS]][%[[K]], %[[J]]]
+// CHECK:               affine.load %[[OUT]][%[[I]], %[[J]]]
+// CHECK:               affine.store %{{.*}}, %[[OUT]][%[[I]], %[[J]]]
+func @matmul(%lhs: memref<64x32xf32>, %rhs: memref<32x16xf32>, %out: memref<64x16xf32>) {
+  affine.for %i = 0 to 64 {
+    affine.for %j = 0 to 16 {
+      affine.for %k = 0 to 32 {
+        %0 = affine.load %lhs[%i, %k] : memref<64x32xf32>
+        %1 = affine.load %rhs[%k, %j] : memref<32x16xf32>
+        %2 = affine.load %out[%i, %j] : memref<64x16xf32>
+        %3 = mulf %0, %1 : f32
+        %4 = addf %2, %3 : f32
+        affine.store %4, %out[%i, %j] : memref<64x16xf32>
+      }
+    }
+  }
+  return
+}
+
+// -----
+
+// A transposed copy is left as is: either order strides one of the accesses.
+
+// CHECK-LABEL: func @transpose(
+// CHECK:         affine.for %[[I:.*]] = 0 to 8 {
+// CHECK:           affine.for %[[J:.*]] = 0 to 4 {
+// CHECK:             affine.load %{{.*}}[%[[J]], %[[I]]]
+// CHECK:             affine.store %{{.*}}, %{{.*}}[%[[I]], %[[J]]]
+func @transpose(%in: memref<4x8xf32>, %out: memref<8x4xf32>) {
+  affine.for %i = 0 to 8 {
+    affine.for %j = 0 to 4 {
+      %0 = affine.load %in[%j, %i] : memref<4x8xf32>
+      affine.store %0, %out[%i, %j] : memref<8x4xf32>
+    }
+  }
+  return
+}
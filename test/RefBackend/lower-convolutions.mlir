@@ -0,0 +1,87 @@
+// RUN: npcomp-opt -refback-lower-convolutions -split-input-file <%s | FileCheck %s --dump-input=fail
+// RUN: npcomp-opt -refback-lower-convolutions=strategy=direct -split-input-file <%s | FileCheck %s --check-prefix=DIRECT --dump-input=fail
+
+// Small convolutions are multiplied as im2col matrices, with the filter as
+// the right-hand side.
+
+// CHECK-DAG:   #[[COL:.*]] = affine_map<(d0, d1) -> (d0 floordiv 16, d1 floordiv 9, (d0 mod 16) floordiv 4 + (d1 mod 9) floordiv 3, d0 mod 4 + d1 mod 3)>
+// CHECK-DAG:   #[[FILTER:.*]] = affine_map<(d0, d1) -> (d1, d0 floordiv 9, (d0 mod 9) floordiv 3, d0 mod 3)>
+// CHECK-DAG:   #[[PRODUCT:.*]] = affine_map<(d0, d1, d2, d3) -> (d0 * 16 + d2 * 4 + d3, d1)>
+// CHECK-LABEL: func @im2col(
+// CHECK-SAME:      %[[INPUT:.*]]: tensor<2x3x6x6xf32>, %[[FILTER_ARG:.*]]: tensor<8x3x3x3xf32>, %[[INIT:.*]]: tensor<2x8x4x4xf32>)
+// CHECK:         %[[COL_INIT:.*]] = linalg.init_tensor [32, 27] : tensor<32x27xf32>
+// CHECK:         %[[COL_MATRIX:.*]] = linalg.generic {indexing_maps = [#[[COL]], {{.*}}]{{.*}} ins(%[[INPUT]] : tensor<2x3x6x6xf32>) outs(%[[COL_INIT]] : tensor<32x27xf32>)
+// CHECK:         %[[FILTER_MATRIX:.*]] = linalg.generic {indexing_maps = [#[[FILTER]], {{.*}}]{{.*}} ins(%[[FILTER_ARG]] : tensor<8x3x3x3xf32>) outs(%{{.*}} : tensor<27x8xf32>)
+// CHECK:         %[[ZERO:.*]] = linalg.fill
+// CHECK:         %[[PRODUCT_MATRIX:.*]] = linalg.matmul ins(%[[COL_MATRIX]], %[[FILTER_MATRIX]] : tensor<32x27xf32>, tensor<27x8xf32>) outs(%[[ZERO]] : tensor<32x8xf32>)
+// CHECK:         %[[RESULT:.*]] = linalg.generic {indexing_maps = [#[[PRODUCT]], {{.*}}]{{.*}} ins(%[[PRODUCT_MATRIX]] : tensor<32x8xf32>) outs(%[[INIT]] : tensor<2x8x4x4xf32>)
+// CHECK:           addf
+// CHECK:         return %[[RESULT]]
+// DIRECT-LABEL: func @im2col
+// DIRECT:         linalg.conv_2d_nchw
+func @im2col(%input: tensor<2x3x6x6xf32>, %filter: tensor<8x3x3x3xf32>, %init: tensor<2x8x4x4xf32>) -> tensor<2x8x4x4xf32> {
+  %0 = linalg.conv_2d_nchw ins(%input, %filter : tensor<2x3x6x6xf32>, tensor<8x3x3x3xf32>) outs(%init : tensor<2x8x4x4xf32>) -> tensor<2x8x4x4xf32>
+  return %0 : tensor<2x8x4x4xf32>
+}
+
+// -----
+
+// The batch size can be dynamic, in which case the im2col budget is checked
+// for a single image.
+
+// CHECK-LABEL: func @dynamic_batch(
+// CHECK-SAME:      %[[INPUT:.*]]: tensor<?x3x6x6xf32>, %{{.*}}: tensor<8x3x3x3xf32>, %[[INIT:.*]]: tensor<?x8x4x4xf32>)
+// CHECK:         %[[BATCH:.*]] = memref.dim %[[INIT]], %c0
+// CHECK:         %[[ROWS:.*]] = muli %[[BATCH]], %c16
+// CHECK:         linalg.init_tensor [%[[ROWS]], 27] : tensor<?x27xf32>
+// CHECK:         linalg.matmul
+func @dynamic_batch(%input: tensor<?x3x6x6xf32>, %filter: tensor<8x3x3x3xf32>, %init: tensor<?x8x4x4xf32>) -> tensor<?x8x4x4xf32> {
+  %0 = linalg.conv_2d_nchw ins(%input, %filter : tensor<?x3x6x6xf32>, tensor<8x3x3x3xf32>) outs(%init : tensor<?x8x4x4xf32>) -> tensor<?x8x4x4xf32>
+  return %0 : tensor<?x8x4x4xf32>
+}
+
+// -----
+
+// 3x3 convolutions with many channels use Winograd: the transformed filter
+// and input are multiplied by a batch matmul over the 16 points of a tile.
+
+// CHECK-LABEL: func @winograd(
+// CHECK-SAME:      %[[INPUT:.*]]: tensor<1x16x10x10xf32>, %[[FILTER:.*]]: tensor<32x16x3x3xf32>, %[[INIT:.*]]: tensor<1x32x8x8xf32>)
+// CHECK:         %[[U:.*]] = linalg.generic {{.*}} ins(%{{.*}}, %{{.*}}, %[[FILTER]] : tensor<4x3xf32>, tensor<4x3xf32>, tensor<32x16x3x3xf32>) outs(%{{.*}} : tensor<16x16x32xf32>)
+// CHECK:         %[[V:.*]] = linalg.generic {{.*}} ins(%{{.*}}, %{{.*}}, %[[INPUT]] : tensor<4x4xf32>, tensor<4x4xf32>, tensor<1x16x10x10xf32>) outs(%{{.*}} : tensor<16x16x16xf32>)
+// CHECK:         %[[M:.*]] = linalg.batch_matmul ins(%[[V]], %[[U]] : tensor<16x16x16xf32>, tensor<16x16x32xf32>) outs(%{{.*}} : tensor<16x16x32xf32>)
+// CHECK:         %[[RESULT:.*]] = linalg.generic {{.*}} ins(%{{.*}}, %{{.*}}, %[[M]] : tensor<2x4xf32>, tensor<2x4xf32>, tensor<16x16x32xf32>) outs(%[[INIT]] : tensor<1x32x8x8xf32>)
+// CHECK:         return %[[RESULT]]
+func @winograd(%input: tensor<1x16x10x10xf32>, %filter: tensor<32x16x3x3xf32>, %init: tensor<1x32x8x8xf32>) -> tensor<1x32x8x8xf32> {
+  %0 = linalg.conv_2d_nchw ins(%input, %filter : tensor<1x16x10x10xf32>, tensor<32x16x3x3xf32>) outs(%init : tensor<1x32x8x8xf32>) -> tensor<1x32x8x8xf32>
+  return %0 : tensor<1x32x8x8xf32>
+}
+
+// -----
+
+// Convolutions with dynamic spatial sizes are computed directly.
+
+// CHECK-LABEL: func @dynamic_spatial
+// CHECK:         linalg.conv_2d_nchw
+// CHECK-NOT:     linalg.matmul
+func @dynamic_spatial(%input: tensor<?x?x?x?xf32>, %filter: tensor<?x?x?x?xf32>, %init: tensor<?x?x?x?xf32>) -> tensor<?x?x?x?xf32> {
+  %0 = linalg.conv_2d_nchw ins(%input, %filter : tensor<?x?x?x?xf32>, tensor<?x?x?x?xf32>) outs(%init : tensor<?x?x?x?xf32>) -> tensor<?x?x?x?xf32>
+  return %0 : tensor<?x?x?x?xf32>
+}
+
+// -----
+
+// The tuned strategy of a convolution takes precedence over the heuristics
+// and the `strategy` option, and its tile sizes move to the matmul it is
+// rewritten to.
+
+// CHECK-LABEL: func @tuned(
+// CHECK:         linalg.batch_matmul {refback.tuning = {l1_tile_sizes = [16, 16, 16], l2_tile_sizes = [64, 64, 64]}}
+// CHECK-NOT:     conv_strategy
+// DIRECT-LABEL: func @tuned(
+// DIRECT:         linalg.batch_matmul
+// DIRECT-NOT:     linalg.conv_2d_nchw
+func @tuned(%input: tensor<2x3x6x6xf32>, %filter: tensor<8x3x3x3xf32>, %init: tensor<2x8x4x4xf32>) -> tensor<2x8x4x4xf32> {
+  %0 = linalg.conv_2d_nchw {refback.tuning = {conv_strategy = "winograd", l2_tile_sizes = [64, 64, 64], l1_tile_sizes = [16, 16, 16]}} ins(%input, %filter : tensor<2x3x6x6xf32>, tensor<8x3x3x3xf32>) outs(%init : tensor<2x8x4x4xf32>) -> tensor<2x8x4x4xf32>
+  return %0 : tensor<2x8x4x4xf32>
+}
@@ -0,0 +1,78 @@
+// RUN: npcomp-opt -refback-lower-packed-matmuls=rows=2 -split-input-file <%s | FileCheck %s --dump-input=fail
+// RUN: npcomp-opt -refback-lower-packed-matmuls='rows=2 use-fma=false' -split-input-file <%s | FileCheck %s --check-prefix=NOFMA --dump-input=fail
+
+#map0 = affine_map<(d0, d1, d2) -> (d0, d2)>
+#map1 = affine_map<(d0, d1, d2) -> (d1 floordiv 4, d2, d1 mod 4)>
+#map2 = affine_map<(d0, d1, d2) -> (d0, d1)>
+
+// CHECK-LABEL: func @packed_matmul(
+// CHECK-SAME:      %[[LHS:.*]]: memref<?x?xf32>, %[[PACKED:.*]]: memref<3x16x4xf32>, %[[OUT:.*]]: memref<?x10xf32>) {
+// CHECK:         %[[C3:.*]] = constant 3 : index
+// CHECK:         scf.parallel (%[[PANEL:.*]]) = (%{{.*}}) to (%[[C3]])
+// CHECK:           %[[COL:.*]] = muli %[[PANEL]]
+// Blocks of two rows.
+// CHECK:           scf.for %[[ROW:.*]] =
+// CHECK:             %[[ACC0:.*]] = vector.transfer_read %[[OUT]][%{{.*}}, %[[COL]]]
+// CHECK:             %[[ACC1:.*]] = vector.transfer_read %[[OUT]][%{{.*}}, %[[COL]]]
+// CHECK:             %[[RESULTS:.*]]:2 = scf.for %[[K:.*]] = {{.*}} iter_args(%{{.*}} = %[[ACC0]], %{{.*}} = %[[ACC1]]) -> (vector<4xf32>, vector<4xf32>) {
+// CHECK:               %[[PANEL_ROW:.*]] = vector.transfer_read %[[PACKED]][%[[PANEL]], %[[K]], %{{.*}}], %{{.*}} {in_bounds = [true]} : memref<3x16x4xf32>, vector<4xf32>
+// CHECK:               memref.load %[[LHS]]
+// CHECK:               vector.broadcast
+// CHECK:               vector.fma
+// CHECK:               memref.load %[[LHS]]
+// CHECK:               vector.broadcast
+// CHECK:               vector.fma
+// CHECK:               scf.yield
+// CHECK:             vector.transfer_write %[[RESULTS]]#0, %[[OUT]]
+// CHECK:             vector.transfer_write %[[RESULTS]]#1, %[[OUT]]
+// The remaining rows, one at a time.
+// CHECK:           scf.for
+// CHECK:             vector.transfer_read %[[OUT]]
+// CHECK:             scf.for
+// CHECK:               vector.fma
+// CHECK-NOT:           vector.fma
+// CHECK:             vector.transfer_write
+// CHECK-NOT:     linalg.generic
+// Targets without FMA units multiply and add separately.
+// NOFMA-LABEL: func @packed_matmul(
+// NOFMA-NOT:     vector.fma
+// NOFMA:         %[[PRODUCT:.*]] = mulf %{{.*}}, %{{.*}} : vector<4xf32>
+// NOFMA:         addf %[[PRODUCT]], %{{.*}} : vector<4xf32>
+// NOFMA-NOT:     vector.fma
+func @packed_matmul(%arg0: memref<?x?xf32>, %arg1: memref<3x16x4xf32>, %arg2: memref<?x10xf32>) {
+  linalg.generic {indexing_maps = [#map0, #map1, #map2], iterator_types = ["parallel", "parallel", "reduction"]} ins(%arg0, %arg1 : memref<?x?xf32>, memref<3x16x4xf32>) outs(%arg2 : memref<?x10xf32>) attrs = {refback.packed_matmul} {
+  ^bb0(%arg3: f32, %arg4: f32, %arg5: f32):
+    %0 = mulf %arg3, %arg4 : f32
+    %1 = addf %arg5, %0 : f32
+    linalg.yield %1 : f32
+  }
+  return
+}
+
+// -----
+
+#map0 = affine_map<(d0, d1, d2) -> (d0, d2)>
+#map1 = affine_map<(d0, d1, d2) -> (d1 floordiv 4, d2, d1 mod 4)>
+#map2 = affine_map<(d0, d1, d2) -> (d0, d1)>
+
+// bf16 operands are extended to the f32 accumulators.
+
+// CHECK-LABEL: func @bf16_operands(
+// CHECK:         scf.for
+// CHECK:           %[[PANEL_ROW:.*]] = vector.transfer_read %{{.*}} : memref<3x16x4xbf16>, vector<4xbf16>
+// CHECK:           %[[EXTENDED_ROW:.*]] = fpext %[[PANEL_ROW]] : vector<4xbf16> to vector<4xf32>
+// CHECK:           %[[ELEMENT:.*]] = memref.load
+// CHECK:           %[[EXTENDED:.*]] = fpext %[[ELEMENT]] : bf16 to f32
+// CHECK:           %[[BROADCAST:.*]] = vector.broadcast %[[EXTENDED]] : f32 to vector<4xf32>
+// CHECK:           vector.fma %[[BROADCAST]], %[[EXTENDED_ROW]], %{{.*}} : vector<4xf32>
+func @bf16_operands(%arg0: memref<?x?xbf16>, %arg1: memref<3x16x4xbf16>, %arg2: memref<?x10xf32>) {
+  linalg.generic {indexing_maps = [#map0, #map1, #map2], iterator_types = ["parallel", "parallel", "reduction"]} ins(%arg0, %arg1 : memref<?x?xbf16>, memref<3x16x4xbf16>) outs(%arg2 : memref<?x10xf32>) attrs = {refback.packed_matmul} {
+  ^bb0(%arg3: bf16, %arg4: bf16, %arg5: f32):
+    %0 = fpext %arg3 : bf16 to f32
+    %1 = fpext %arg4 : bf16 to f32
+    %2 = mulf %0, %1 : f32
+    %3 = addf %arg5, %2 : f32
+    linalg.yield %3 : f32
+  }
+  return
+}
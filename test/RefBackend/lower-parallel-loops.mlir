@@ -0,0 +1,56 @@
+// RUN: npcomp-opt -refback-lower-parallel-loops -split-input-file <%s | FileCheck %s --dump-input=fail
+
+// The first dimension of an outermost parallel loop is distributed, and the
+// rest of the loop nest is outlined along with it.
+
+// The body is outlined before its parent function.
+// CHECK-LABEL: func private @parallel_2d.parallel_body.0(
+// CHECK-SAME:      %[[BEGIN:.*]]: index, %[[END:.*]]: index, %[[CONTEXT:.*]]: !llvm.ptr<i8>)
+// CHECK-SAME:      attributes {refbackrt.parallel_body}
+// CHECK:         %[[BUFFER:.*]] = refbackrt.unpack_parallel_context %[[CONTEXT]] : !llvm.ptr<i8> -> memref<?x64xf32>
+// CHECK:         scf.for %[[K:.*]] = %[[BEGIN]] to %[[END]]
+// CHECK:           %[[SCALED:.*]] = muli %[[K]]
+// CHECK:           %[[I:.*]] = addi %{{.*}}, %[[SCALED]]
+// CHECK:           scf.parallel (%[[J:.*]]) =
+// CHECK:             memref.store %{{.*}}, %[[BUFFER]][%[[I]], %[[J]]]
+
+// CHECK-LABEL: func @parallel_2d(
+// CHECK-SAME:      %[[ARG0:.*]]: memref<?x64xf32>, %[[ARG1:.*]]: index) {
+// CHECK:         %[[TRIP_COUNT:.*]] = divi_signed
+// CHECK:         %[[GRAIN:.*]] = constant 256 : index
+// CHECK:         refbackrt.parallel_for @parallel_2d.parallel_body.0(%{{.*}}, %[[TRIP_COUNT]]) grain %[[GRAIN]] captures(%[[ARG0]] : memref<?x64xf32>)
+// CHECK-NOT:     scf.parallel
+// CHECK:         return
+func @parallel_2d(%arg0: memref<?x64xf32>, %arg1: index) {
+  %c0 = constant 0 : index
+  %c1 = constant 1 : index
+  %c64 = constant 64 : index
+  %cst = constant 0.0 : f32
+  scf.parallel (%i, %j) = (%c0, %c0) to (%arg1, %c64) step (%c1, %c1) {
+    memref.store %cst, %arg0[%i, %j] : memref<?x64xf32>
+  }
+  return
+}
+
+// -----
+
+// Loops with reductions stay as they are.
+
+// CHECK-LABEL: func @reduction
+// CHECK-NOT:     refbackrt.parallel_for
+// CHECK:         scf.parallel
+// CHECK-NOT:     func private
+func @reduction(%arg0: memref<?xf32>, %arg1: index) -> f32 {
+  %c0 = constant 0 : index
+  %c1 = constant 1 : index
+  %cst = constant 0.0 : f32
+  %0 = scf.parallel (%i) = (%c0) to (%arg1) step (%c1) init (%cst) -> f32 {
+    %1 = memref.load %arg0[%i] : memref<?xf32>
+    scf.reduce(%1) : f32 {
+    ^bb0(%lhs: f32, %rhs: f32):
+      %2 = addf %lhs, %rhs : f32
+      scf.reduce.return %2 : f32
+    }
+  }
+  return %0 : f32
+}
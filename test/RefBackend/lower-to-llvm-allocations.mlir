@@ -0,0 +1,24 @@
+// RUN: npcomp-opt -refback-lower-to-llvm <%s | FileCheck %s --dump-input=fail
+
+// Allocations are made through the compiler runtime rather than libc.
+
+// CHECK-NOT: llvm.func @malloc
+// CHECK-NOT: llvm.func @free
+// CHECK-LABEL: llvm.func @alloc_dealloc
+// CHECK:         llvm.call @__npcomp_compiler_rt_alloc
+// CHECK:         llvm.call @__npcomp_compiler_rt_free
+func @alloc_dealloc(%arg0: index) {
+  %0 = memref.alloc(%arg0) : memref<?xf32>
+  memref.dealloc %0 : memref<?xf32>
+  return
+}
+
+// Scratch allocations are carved out of the runtime's per-invocation arena.
+
+// CHECK-LABEL: llvm.func @scratch_alloc
+// CHECK:         llvm.call @__npcomp_compiler_rt_scratch_alloc
+// CHECK-NOT:     llvm.call @__npcomp_compiler_rt_alloc
+func @scratch_alloc(%arg0: index) {
+  %0 = memref.alloc(%arg0) {refbackrt.scratch} : memref<?xf32>
+  return
+}
@@ -0,0 +1,87 @@
+// RUN: npcomp-opt -refback-lower-to-llvm <%s | FileCheck %s --dump-input=fail
+
+// The failed checks of exported functions, and of the functions they call, are
+// returned to the runtime through the status argument of the wrapper.
+
+refbackrt.module_metadata {
+  refbackrt.func_metadata {funcName = @checked, numInputs = 1 : i32, numOutputs = 1 : i32, inputArgTypes = dense<5> : tensor<1xi32>, inputElementTypes = dense<0> : tensor<1xi32>, inputRanks = dense<0> : tensor<1xi32>, outputArgTypes = dense<5> : tensor<1xi32>, outputElementTypes = dense<0> : tensor<1xi32>, outputRanks = dense<0> : tensor<1xi32>}
+  refbackrt.func_metadata {funcName = @unchecked, numInputs = 0 : i32, numOutputs = 0 : i32}
+}
+
+// The wrappers are created at the start of the module, in reverse order.
+
+// CHECK-LABEL: llvm.func @__refbackrt_wrapper_unchecked(
+// CHECK-SAME:      %{{.*}}: !llvm.ptr<ptr<i8>>, %{{.*}}: !llvm.ptr<ptr<i8>>, %[[STATUS:.*]]: !llvm.ptr<ptr<i8>>) {
+// CHECK:         llvm.call @unchecked(%[[STATUS]]) : (!llvm.ptr<ptr<i8>>) -> ()
+
+// CHECK-LABEL: llvm.func @__refbackrt_wrapper_checked(
+// CHECK-SAME:      %{{.*}}: !llvm.ptr<ptr<i8>>, %{{.*}}: !llvm.ptr<ptr<i8>>, %[[STATUS:.*]]: !llvm.ptr<ptr<i8>>) {
+// CHECK:         llvm.call @checked(%{{.*}}, %[[STATUS]])
+
+// CHECK-LABEL: llvm.func @checked(
+// CHECK-SAME:                     %[[ARG:.*]]: i64, %[[STATUS:.*]]: !llvm.ptr<ptr<i8>>) -> i64 {
+// CHECK:         %[[MSG:.*]] = llvm.getelementptr
+// CHECK-NOT:     llvm.call @__npcomp_compiler_rt_abort_if
+// CHECK:         llvm.cond_br %{{.*}} weights([1, 2000]), ^[[FAILURE:bb[0-9]+]], ^[[CONTINUE:bb[0-9]+]]
+// CHECK:       ^[[CONTINUE]]:
+// CHECK:         llvm.return %[[ARG]] : i64
+// CHECK:       ^[[FAILURE]]:
+// CHECK:         llvm.store %[[MSG]], %[[STATUS]] : !llvm.ptr<ptr<i8>>
+// CHECK:         %[[UNDEF:.*]] = llvm.mlir.undef : i64
+// CHECK:         llvm.return %[[UNDEF]] : i64
+func @checked(%arg0: i64) -> i64 {
+  %c0 = constant 0 : i64
+  %0 = cmpi slt, %arg0, %c0 : i64
+  refbackrt.abort_if %0, "negative input"
+  return %arg0 : i64
+}
+
+// Functions calling functions that can fail take a status too, and return as
+// soon as a callee sets it, even if they are exported themselves.
+
+// CHECK-LABEL: llvm.func @unchecked(
+// CHECK-SAME:                       %[[STATUS:.*]]: !llvm.ptr<ptr<i8>>) {
+// CHECK:         llvm.call @checked(%{{.*}}, %[[STATUS]]) : (i64, !llvm.ptr<ptr<i8>>) -> i64
+// CHECK:         %[[MSG:.*]] = llvm.load %[[STATUS]] : !llvm.ptr<ptr<i8>>
+// CHECK:         %[[NULL:.*]] = llvm.mlir.null : !llvm.ptr<i8>
+// CHECK:         %[[FAILED:.*]] = llvm.icmp "ne" %[[MSG]], %[[NULL]] : !llvm.ptr<i8>
+// CHECK:         llvm.cond_br %[[FAILED]] weights([1, 2000]), ^[[FAILURE:bb[0-9]+]], ^[[CONTINUE:bb[0-9]+]]
+// CHECK:       ^[[CONTINUE]]:
+// CHECK:         llvm.call @helper(%[[STATUS]]) : (!llvm.ptr<ptr<i8>>) -> ()
+// CHECK:         llvm.cond_br %{{.*}} weights([1, 2000])
+// CHECK:       ^[[FAILURE]]:
+// CHECK-NEXT:    llvm.return
+func @unchecked() {
+  %c1 = constant 1 : i64
+  %0 = call @checked(%c1) : (i64) -> i64
+  call @helper() : () -> ()
+  return
+}
+
+// CHECK-LABEL: llvm.func @helper(
+// CHECK-SAME:                    %[[STATUS:.*]]: !llvm.ptr<ptr<i8>>) {
+// CHECK-NOT:     llvm.call @__npcomp_compiler_rt_abort_if
+// CHECK:         llvm.store %{{.*}}, %[[STATUS]] : !llvm.ptr<ptr<i8>>
+func private @helper() {
+  %true = constant true
+  refbackrt.abort_if %true, "always"
+  return
+}
+
+// Functions with a fixed signature, such as the direct entries, keep their
+// checks fatal: they pass a status of their own, and abort if it is set.
+
+// CHECK-LABEL: llvm.func @direct_entry()
+// CHECK:         %[[STATUS:.*]] = llvm.alloca %{{.*}} x !llvm.ptr<i8>
+// CHECK:         llvm.store %{{.*}}, %[[STATUS]] : !llvm.ptr<ptr<i8>>
+// CHECK:         llvm.call @helper(%[[STATUS]]) : (!llvm.ptr<ptr<i8>>) -> ()
+// CHECK:         %[[MSG:.*]] = llvm.load %[[STATUS]] : !llvm.ptr<ptr<i8>>
+// CHECK:         %[[FAILED:.*]] = llvm.icmp "ne" %[[MSG]], %{{.*}} : !llvm.ptr<i8>
+// CHECK:         llvm.call @__npcomp_compiler_rt_abort_if(%[[FAILED]], %[[MSG]])
+// CHECK:         llvm.call @__npcomp_compiler_rt_abort_if
+func private @direct_entry() attributes {refbackrt.direct_entry = "unchecked"} {
+  call @helper() : () -> ()
+  %true = constant true
+  refbackrt.abort_if %true, "direct"
+  return
+}
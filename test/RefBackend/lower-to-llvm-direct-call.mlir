@@ -0,0 +1,32 @@
+// RUN: npcomp-opt -refback-lower-to-llvm <%s | FileCheck %s --dump-input=fail
+
+// The function descriptor of @f points at the function with the direct-call
+// ABI for its direct entry, which passes the statically shaped memrefs as bare
+// pointers. @g has no direct entry.
+
+// CHECK-LABEL: llvm.mlir.global internal constant @__npcomp_func_descriptors
+// CHECK:         llvm.mlir.addressof @__refbackrt_wrapper_f
+// CHECK:         llvm.mlir.addressof @__refbackrt_direct_f
+// CHECK:         llvm.mlir.addressof @__refbackrt_wrapper_g
+// CHECK:         llvm.mlir.null : !llvm.ptr<i8>
+refbackrt.module_metadata {
+  refbackrt.func_metadata {directFuncName = @__refbackrt_direct_entry_f, funcName = @f, numInputs = 2 : i32, numOutputs = 1 : i32, inputArgTypes = dense<[1, 2]> : tensor<2xi32>, inputElementTypes = dense<[1, 0]> : tensor<2xi32>, inputRanks = dense<[2, 0]> : tensor<2xi32>, inputShapes = dense<[2, 3]> : tensor<2xi64>, inputReadOnly = dense<[1, 0]> : tensor<2xi32>, outputArgTypes = dense<1> : tensor<1xi32>, outputElementTypes = dense<1> : tensor<1xi32>, outputRanks = dense<1> : tensor<1xi32>, outputShapes = dense<3> : tensor<1xi64>}
+  refbackrt.func_metadata {funcName = @g, numInputs = 0 : i32, numOutputs = 0 : i32}
+}
+
+func @f(%arg0: memref<*xf32>, %arg1: f32) -> memref<*xf32> {
+  return %arg0 : memref<*xf32>
+}
+
+func private @__refbackrt_direct_entry_f(%arg0: memref<2x3xf32>, %arg1: f32, %arg2: memref<3xf32>) attributes {refbackrt.direct_entry = "f"} {
+  return
+}
+
+func @g() {
+  return
+}
+
+// CHECK-LABEL: llvm.func @__refbackrt_direct_f(
+// CHECK-SAME:      %arg0: !llvm.ptr<f32>, %arg1: f32, %arg2: !llvm.ptr<f32>) {
+// CHECK:         llvm.call @__refbackrt_direct_entry_f(%arg0, %arg0, %{{.*}}, %arg1, %arg2, %arg2, %{{.*}})
+// CHECK-NEXT:    llvm.return
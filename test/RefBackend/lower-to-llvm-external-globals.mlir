@@ -0,0 +1,34 @@
+// RUN: npcomp-opt -refback-lower-to-llvm <%s | FileCheck %s --dump-input=fail
+
+// Globals initialized with external elements attributes become external
+// declarations, whose storage is recorded on the module. Other globals keep
+// their initial values.
+
+// CHECK-LABEL: module attributes
+// CHECK-SAME:    refback.external_globals = [{offset = 64 : i64, path = "/data/weights.bin", size = 16 : i64, symbol = "__constant_4xf32"}]
+// CHECK:         llvm.mlir.global external constant @__constant_4xf32() : !llvm.array<4 x f32>
+// CHECK:         llvm.mlir.global private constant @__constant_2xi32(dense<[1, 2]> : tensor<2xi32>)
+memref.global "private" constant @__constant_4xf32 : memref<4xf32> = opaque<"refback", "0x65787465726E616C3A36343A2F646174612F776569676874732E62696E">
+memref.global "private" constant @__constant_2xi32 : memref<2xi32> = dense<[1, 2]>
+
+// CHECK-LABEL: llvm.func @get_globals
+// CHECK:         llvm.mlir.addressof @__constant_4xf32
+// CHECK:         llvm.mlir.addressof @__constant_2xi32
+func @get_globals() -> (memref<4xf32>, memref<2xi32>) {
+  %0 = memref.get_global @__constant_4xf32 : memref<4xf32>
+  %1 = memref.get_global @__constant_2xi32 : memref<2xi32>
+  return %0, %1 : memref<4xf32>, memref<2xi32>
+}
+
+// Prefetches call the runtime with a flag per global and its size.
+
+// CHECK-LABEL: llvm.func @prefetch_globals
+// CHECK:         %[[FLAG:.*]] = llvm.mlir.addressof @__npcomp_prefetched___constant_4xf32 : !llvm.ptr<i8>
+// CHECK:         %[[GLOBAL:.*]] = llvm.mlir.addressof @__constant_4xf32
+// CHECK:         %[[PTR:.*]] = llvm.bitcast %[[GLOBAL]]
+// CHECK:         %[[SIZE:.*]] = llvm.mlir.constant(16 : i64) : i64
+// CHECK:         llvm.call @__npcomp_compiler_rt_prefetch(%[[FLAG]], %[[PTR]], %[[SIZE]])
+func @prefetch_globals() {
+  refbackrt.prefetch_global @__constant_4xf32
+  return
+}
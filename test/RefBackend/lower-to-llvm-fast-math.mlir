@@ -0,0 +1,31 @@
+// RUN: npcomp-opt -refback-lower-to-llvm <%s | FileCheck %s --check-prefix=STRICT --dump-input=fail
+// RUN: npcomp-opt -refback-lower-to-llvm='fast-math-reassoc fast-math-contract' <%s | FileCheck %s --check-prefix=FAST --dump-input=fail
+// RUN: npcomp-opt -refback-lower-to-llvm='fast-math-no-nans' <%s | FileCheck %s --check-prefix=NONANS --dump-input=fail
+
+// Without fast-math options, the floating-point ops keep their strict
+// semantics.
+
+// STRICT-LABEL: llvm.func @muladd(
+// STRICT-NOT:     fastmathFlags
+// FAST-LABEL:   llvm.func @muladd(
+// FAST:           llvm.fmul %{{.*}}, %{{.*}} {fastmathFlags = #llvm.fastmath<contract, reassoc>} : f32
+// FAST:           llvm.fadd %{{.*}}, %{{.*}} {fastmathFlags = #llvm.fastmath<contract, reassoc>} : f32
+// NONANS-LABEL: llvm.func @muladd(
+// NONANS:         llvm.fmul %{{.*}}, %{{.*}} {fastmathFlags = #llvm.fastmath<nnan>} : f32
+// NONANS:         llvm.fadd %{{.*}}, %{{.*}} {fastmathFlags = #llvm.fastmath<nnan>} : f32
+func private @muladd(%arg0: f32, %arg1: f32, %arg2: f32) -> f32 {
+  %0 = mulf %arg0, %arg1 : f32
+  %1 = addf %0, %arg2 : f32
+  return %1 : f32
+}
+
+// Reassociation also lets the vector reductions be computed in any order.
+
+// STRICT-LABEL: llvm.func @reduce(
+// STRICT:         "llvm.intr.vector.reduce.fadd"(%{{.*}}, %{{.*}}) {reassoc = false}
+// FAST-LABEL:   llvm.func @reduce(
+// FAST:           "llvm.intr.vector.reduce.fadd"(%{{.*}}, %{{.*}}) {reassoc = true}
+func private @reduce(%arg0: vector<8xf32>) -> f32 {
+  %0 = vector.reduction "add", %arg0 : vector<8xf32> into f32
+  return %0 : f32
+}
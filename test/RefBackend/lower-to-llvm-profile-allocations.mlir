@@ -0,0 +1,20 @@
+// RUN: npcomp-opt -refback-lower-to-llvm=profile-allocations <%s | FileCheck %s --dump-input=fail
+
+// Allocations and frees name their site for the runtime's memory profile.
+
+// CHECK-DAG:   llvm.mlir.global internal constant @[[SITE:.*]]("model.py:3:8 in forward\00")
+// CHECK-DAG:   llvm.mlir.global internal constant @[[UNKNOWN:.*]]("compiled code\00")
+// CHECK-DAG:   llvm.func @__npcomp_compiler_rt_alloc_at(i64, !llvm.ptr<i8>) -> !llvm.ptr<i8>
+// CHECK-DAG:   llvm.func @__npcomp_compiler_rt_free_at(!llvm.ptr<i8>, !llvm.ptr<i8>)
+// CHECK-NOT:   llvm.func @malloc
+// CHECK-NOT:   llvm.func @free
+// CHECK-LABEL: llvm.func @alloc_dealloc
+// CHECK:         llvm.mlir.addressof @[[SITE]]
+// CHECK:         llvm.call @__npcomp_compiler_rt_alloc_at
+// CHECK:         llvm.mlir.addressof @[[UNKNOWN]]
+// CHECK:         llvm.call @__npcomp_compiler_rt_free_at
+func @alloc_dealloc(%arg0: index) {
+  %0 = memref.alloc(%arg0) : memref<?xf32> loc("forward"("model.py":3:8))
+  memref.dealloc %0 : memref<?xf32> loc(unknown)
+  return
+}
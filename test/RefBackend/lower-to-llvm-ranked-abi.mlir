@@ -0,0 +1,18 @@
+// RUN: npcomp-opt -refback-lower-to-llvm <%s | FileCheck %s --dump-input=fail
+
+// The wrapper of a function taking a ranked memref loads the descriptor that
+// the runtime passes with the static rank, and explodes it into the arguments
+// of the call.
+
+refbackrt.module_metadata {
+  refbackrt.func_metadata {funcName = @ranked, numInputs = 1 : i32, numOutputs = 0 : i32, inputArgTypes = dense<1> : tensor<1xi32>, inputElementTypes = dense<1> : tensor<1xi32>, inputRanks = dense<2> : tensor<1xi32>, inputShapes = dense<[2, -1]> : tensor<2xi64>, inputReadOnly = dense<1> : tensor<1xi32>}
+}
+
+func @ranked(%arg0: memref<2x?xf32>) {
+  return
+}
+
+// CHECK-LABEL: llvm.func @__refbackrt_wrapper_ranked(
+// CHECK:         %[[DESCRIPTOR:.*]] = llvm.load %{{.*}} : !llvm.ptr<struct<(ptr<f32>, ptr<f32>, i64, array<2 x i64>, array<2 x i64>)>>
+// CHECK-COUNT-7: llvm.extractvalue %[[DESCRIPTOR]]
+// CHECK:         llvm.call @ranked(
@@ -0,0 +1,28 @@
+// RUN: npcomp-opt -refback-lower-to-llvm <%s | FileCheck %s --dump-input=fail
+
+// The wrapper loads each input from the first of its two slots, whatever the
+// kinds of the preceding inputs, and passes booleans as one byte.
+
+refbackrt.module_metadata {
+  refbackrt.func_metadata {funcName = @scalars, numInputs = 3 : i32, numOutputs = 2 : i32, inputArgTypes = dense<[1, 6, 4]> : tensor<3xi32>, inputElementTypes = dense<[1, 0, 0]> : tensor<3xi32>, inputRanks = dense<[-1, 0, 0]> : tensor<3xi32>, inputReadOnly = dense<[1, 0, 0]> : tensor<3xi32>, outputArgTypes = dense<[6, 5]> : tensor<2xi32>, outputElementTypes = dense<0> : tensor<2xi32>, outputRanks = dense<0> : tensor<2xi32>}
+}
+
+func @scalars(%arg0: memref<*xf32>, %arg1: i1, %arg2: i32) -> (i1, i64) {
+  %0 = sexti %arg2 : i32 to i64
+  return %arg1, %0 : i1, i64
+}
+
+// CHECK-LABEL: llvm.func @__refbackrt_wrapper_scalars(
+// CHECK:         %[[C2:.*]] = llvm.mlir.constant(2 : i32) : i32
+// CHECK:         llvm.getelementptr %arg0[%[[C2]]]
+// CHECK:         %[[BYTE:.*]] = llvm.load %{{.*}} : !llvm.ptr<i8>
+// CHECK:         %[[BOOL:.*]] = llvm.trunc %[[BYTE]] : i8 to i1
+// CHECK:         %[[C4:.*]] = llvm.mlir.constant(4 : i32) : i32
+// CHECK:         llvm.getelementptr %arg0[%[[C4]]]
+// CHECK:         %[[INT:.*]] = llvm.load %{{.*}} : !llvm.ptr<i32>
+// CHECK:         %[[RESULTS:.*]] = llvm.call @scalars(%{{.*}}, %{{.*}}, %[[BOOL]], %[[INT]])
+// CHECK:         %[[FLAG:.*]] = llvm.extractvalue %[[RESULTS]][0 : i32]
+// CHECK:         %[[FLAG_BYTE:.*]] = llvm.zext %[[FLAG]] : i1 to i8
+// CHECK:         llvm.store %[[FLAG_BYTE]], %{{.*}} : !llvm.ptr<i8>
+// CHECK:         %[[COUNT:.*]] = llvm.extractvalue %[[RESULTS]][1 : i32]
+// CHECK:         llvm.store %[[COUNT]], %{{.*}} : !llvm.ptr<i64>
@@ -0,0 +1,12 @@
+// RUN: npcomp-opt -lower-to-refbackrt-abi=ranked-abi=true <%s | FileCheck %s --dump-input=fail
+
+// Memref arguments keep their ranked types, while results are still returned
+// as unranked memrefs.
+
+// CHECK-LABEL: func @ranked(%arg0: memref<2x?xf32>, %arg1: f32) -> memref<*xf32>
+// CHECK-NEXT:    memref.assume_alignment %arg0, 64 : memref<2x?xf32>
+// CHECK-NEXT:    %[[RESULT:.*]] = memref.cast %arg0 : memref<2x?xf32> to memref<*xf32>
+// CHECK-NEXT:    return %[[RESULT]] : memref<*xf32>
+func @ranked(%arg0: memref<2x?xf32>, %arg1: f32) -> memref<2x?xf32> {
+  return %arg0 : memref<2x?xf32>
+}
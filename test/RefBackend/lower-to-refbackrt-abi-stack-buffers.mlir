@@ -0,0 +1,35 @@
+// RUN: npcomp-opt -lower-to-refbackrt-abi="stack-buffer-max-bytes=16" <%s | FileCheck %s --dump-input=fail
+
+// CHECK-LABEL: func private @stack_buffers
+func private @stack_buffers(%arg0: index) -> memref<2xf32> {
+  // The small scratch buffers are hoisted to the entry block as allocas,
+  // without their deallocations.
+  // CHECK-NEXT: memref.alloca() {alignment = 64 : i64} : memref<2xindex>
+  // CHECK-NEXT: memref.alloca() {alignment = 64 : i64} : memref<4xf32>
+  // CHECK-NOT: memref.dealloc
+  %c0 = constant 0 : index
+  %c1 = constant 1 : index
+  %cst = constant 1.0 : f32
+  %small = memref.alloc() : memref<2xindex>
+  memref.store %arg0, %small[%c0] : memref<2xindex>
+  %0 = memref.load %small[%c0] : memref<2xindex>
+  memref.dealloc %small : memref<2xindex>
+  scf.for %i = %c0 to %0 step %c1 {
+    %in_loop = memref.alloc() : memref<4xf32>
+    memref.store %cst, %in_loop[%i] : memref<4xf32>
+    memref.dealloc %in_loop : memref<4xf32>
+  }
+  // Too large, so it comes from the scratch arena.
+  // CHECK: memref.alloc() {refbackrt.scratch} : memref<8xf32>
+  %large = memref.alloc() : memref<8xf32>
+  memref.store %cst, %large[%c0] : memref<8xf32>
+  // Dynamically shaped.
+  // CHECK: memref.alloc(%arg0) {refbackrt.scratch} : memref<?xf32>
+  %dynamic = memref.alloc(%arg0) : memref<?xf32>
+  memref.store %cst, %dynamic[%c0] : memref<?xf32>
+  // Returned.
+  // CHECK: memref.alloc() : memref<2xf32>
+  %returned = memref.alloc() : memref<2xf32>
+  memref.store %cst, %returned[%c0] : memref<2xf32>
+  return %returned : memref<2xf32>
+}
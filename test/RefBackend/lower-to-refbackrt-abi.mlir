@@ -5,12 +5,16 @@
 // CHECK:      refbackrt.module_metadata
 // CHECK-NEXT: refbackrt.func_metadata
 // CHECK-SAME:   funcName = @f_2inputs_0outputs
+// CHECK-SAME:   inputReadOnly = dense<1> : tensor<2xi32>
 // CHECK-SAME:   numInputs = 2
 // CHECK-SAME:   numOutputs = 0
 // CHECK-NEXT: refbackrt.func_metadata 
 // CHECK-SAME:   funcName = @f_1input_2outputs
+// CHECK-SAME:   inputReadOnly = dense<0> : tensor<1xi32>
 // CHECK-SAME:   numInputs = 1
 // CHECK-SAME:   numOutputs = 2
+// CHECK-SAME:   outputAliasIndices = dense<0> : tensor<2xi32>
+// CHECK-SAME:   outputOwnership = dense<[2, 3]> : tensor<2xi32>
 
 // This function only exists to test its metadata above.
 func @f_2inputs_0outputs(%arg0: memref<?xf32>, %arg1: memref<?xf32>) {
@@ -24,6 +28,170 @@ func @f_1input_2outputs(%arg0: memref<?xf32>) -> (memref<?xf32>, memref<?xf32>)
 
 // -----
 
+// Test output ownership: allocated for the output alone (1), an input (2), an
+// earlier output (3), a mutable global (4), a constant global (5), or
+// unknown (0).
+
+// CHECK:      refbackrt.func_metadata
+// CHECK-SAME:   funcName = @output_ownership
+// CHECK-SAME:   outputAliasIndices = dense<[-1, 1, 0, -1, -1, -1, -1]> : tensor<7xi32>
+// CHECK-SAME:   outputOwnership = dense<[1, 2, 3, 5, 4, 0, 0]> : tensor<7xi32>
+
+memref.global "private" constant @__constant_2xf32 : memref<2xf32> = dense<1.0>
+memref.global "private" @mutable : memref<2xf32> = dense<0.0>
+
+// This function only exists to test its metadata above.
+func @output_ownership(%arg0: index, %arg1: memref<?xf32>, %arg2: i1) -> (memref<?xf32>, memref<?xf32>, memref<*xf32>, memref<2xf32>, memref<2xf32>, memref<?xf32>, f32) {
+  %c0 = constant 0 : index
+  %0 = memref.alloc(%arg0) : memref<?xf32>
+  %1 = memref.cast %0 : memref<?xf32> to memref<*xf32>
+  %2 = memref.get_global @__constant_2xf32 : memref<2xf32>
+  %5 = memref.get_global @mutable : memref<2xf32>
+  %3 = select %arg2, %0, %arg1 : memref<?xf32>
+  %4 = memref.load %arg1[%c0] : memref<?xf32>
+  return %0, %arg1, %1, %2, %5, %3, %4 : memref<?xf32>, memref<?xf32>, memref<*xf32>, memref<2xf32>, memref<2xf32>, memref<?xf32>, f32
+}
+
+// -----
+
+// Test read-only input detection.
+
+// CHECK:      refbackrt.func_metadata
+// CHECK-SAME:   funcName = @read_only_inputs
+// CHECK-SAME:   inputReadOnly = dense<[1, 0, 0]> : tensor<3xi32>
+
+// %arg0 is only read, %arg1 is written to, and a view of %arg2 is returned.
+func @read_only_inputs(%arg0: memref<?xf32>, %arg1: memref<?xf32>, %arg2: memref<?xf32>) -> memref<*xf32> {
+  %c0 = constant 0 : index
+  %0 = memref.load %arg0[%c0] : memref<?xf32>
+  memref.store %0, %arg1[%c0] : memref<?xf32>
+  %1 = memref.cast %arg2 : memref<?xf32> to memref<*xf32>
+  return %1 : memref<*xf32>
+}
+
+// -----
+
+// Test element type metadata.
+
+// CHECK:      refbackrt.func_metadata
+// CHECK-SAME:   funcName = @element_types
+// CHECK-SAME:   inputElementTypes = dense<[1, 2, 3, 4, 5, 6, 7]> : tensor<7xi32>
+// CHECK-SAME:   outputElementTypes = dense<2> : tensor<1xi32>
+
+// This function only exists to test its metadata above.
+func @element_types(%arg0: memref<?xf32>, %arg1: memref<?xf16>, %arg2: memref<?xbf16>, %arg3: memref<?xi8>, %arg4: memref<?xi32>, %arg5: memref<?xi64>, %arg6: memref<?xi1>) -> memref<?xf16> {
+  return %arg1 : memref<?xf16>
+}
+
+// -----
+
+// Test scratch allocation detection.
+
+// CHECK-LABEL: func private @scratch_allocations
+func private @scratch_allocations(%arg0: index) -> memref<?xf32> {
+  %c0 = constant 0 : index
+  %cst = constant 1.0 : f32
+  // CHECK: memref.alloc(%arg0) {refbackrt.scratch} : memref<?xf32>
+  %scratch = memref.alloc(%arg0) : memref<?xf32>
+  memref.store %cst, %scratch[%c0] : memref<?xf32>
+  %0 = memref.load %scratch[%c0] : memref<?xf32>
+  // Returned, possibly through a view.
+  // CHECK: memref.alloc(%arg0) : memref<?xf32>
+  %returned = memref.alloc(%arg0) : memref<?xf32>
+  memref.store %0, %returned[%c0] : memref<?xf32>
+  // Freed after use. The scratch arena frees it instead.
+  // CHECK: memref.alloc(%arg0) {refbackrt.scratch} : memref<?xf32>
+  // CHECK-NOT: memref.dealloc
+  %freed = memref.alloc(%arg0) : memref<?xf32>
+  memref.store %0, %freed[%c0] : memref<?xf32>
+  memref.dealloc %freed : memref<?xf32>
+  %1 = memref.cast %returned : memref<?xf32> to memref<?xf32>
+  return %1 : memref<?xf32>
+}
+
+// CHECK-LABEL: func private @scratch_allocation_through_branch
+func private @scratch_allocation_through_branch(%arg0: index) {
+  // Aliased to a block argument, so it stays a regular allocation that is
+  // freed explicitly.
+  // CHECK: memref.alloc(%arg0) : memref<?xf32>
+  %0 = memref.alloc(%arg0) : memref<?xf32>
+  br ^bb1(%0 : memref<?xf32>)
+^bb1(%1: memref<?xf32>):
+  // CHECK: memref.dealloc
+  memref.dealloc %1 : memref<?xf32>
+  return
+}
+
+// Buffers allocated in each iteration of a loop stay regular allocations that
+// are freed explicitly, so that the scratch arena doesn't grow with the trip
+// count. Those of branches that run once are still scratch buffers.
+// CHECK-LABEL: func private @scratch_allocations_in_loops
+func private @scratch_allocations_in_loops(%arg0: index, %arg1: i1) {
+  %c0 = constant 0 : index
+  %c1 = constant 1 : index
+  %cst = constant 1.0 : f32
+  // CHECK: scf.for
+  scf.for %i = %c0 to %arg0 step %c1 {
+    // CHECK: memref.alloc(%arg0) : memref<?xf32>
+    // CHECK: memref.dealloc
+    %0 = memref.alloc(%arg0) : memref<?xf32>
+    memref.store %cst, %0[%c0] : memref<?xf32>
+    memref.dealloc %0 : memref<?xf32>
+    // Statically shaped ones too, since only the buffers of the blocks of
+    // the function body get a slot of its scratch workspace.
+    // CHECK: memref.alloc() : memref<4xf32>
+    // CHECK: memref.dealloc
+    %1 = memref.alloc() : memref<4xf32>
+    memref.store %cst, %1[%c0] : memref<4xf32>
+    memref.dealloc %1 : memref<4xf32>
+  }
+  // CHECK: scf.if
+  scf.if %arg1 {
+    // CHECK: memref.alloc(%arg0) {refbackrt.scratch} : memref<?xf32>
+    %2 = memref.alloc(%arg0) : memref<?xf32>
+    memref.store %cst, %2[%c0] : memref<?xf32>
+  }
+  // CHECK: br ^bb1
+  br ^bb1
+^bb1:
+  // CHECK: memref.alloc(%arg0) : memref<?xf32>
+  // CHECK: memref.dealloc
+  %3 = memref.alloc(%arg0) : memref<?xf32>
+  memref.store %cst, %3[%c0] : memref<?xf32>
+  memref.dealloc %3 : memref<?xf32>
+  cond_br %arg1, ^bb1, ^bb2
+^bb2:
+  return
+}
+
+// Statically shaped buffers of the blocks of a CFG loop are scratch buffers
+// if they are only used in their block, where they get a slot of the
+// function's scratch workspace. Otherwise, they are freed explicitly.
+// CHECK-LABEL: func private @scratch_allocations_in_cfg_loops
+func private @scratch_allocations_in_cfg_loops(%arg0: i1) {
+  %c0 = constant 0 : index
+  %cst = constant 1.0 : f32
+  br ^bb1
+^bb1:
+  // CHECK: memref.alloc() {refbackrt.scratch} : memref<1024xf32>
+  // CHECK-NOT: memref.dealloc
+  %0 = memref.alloc() : memref<1024xf32>
+  memref.store %cst, %0[%c0] : memref<1024xf32>
+  memref.dealloc %0 : memref<1024xf32>
+  // CHECK: memref.alloc() : memref<1024xf32>
+  %1 = memref.alloc() : memref<1024xf32>
+  memref.store %cst, %1[%c0] : memref<1024xf32>
+  br ^bb2
+^bb2:
+  // CHECK: memref.dealloc
+  memref.dealloc %1 : memref<1024xf32>
+  cond_br %arg0, ^bb1, ^bb3
+^bb3:
+  return
+}
+
+// -----
+
 // Test ABI conversions.
 
 // CHECK-LABEL:   func @identity(%arg0: memref<*xf32>) -> memref<*xf32>
@@ -38,6 +206,7 @@ func @identity(%arg0: memref<?xf32>) -> memref<?xf32> {
 // CHECK-LABEL: func @use_of_arg(%arg0: memref<*xf32>)
 func @use_of_arg(%arg0: memref<?xf32>) {
   // CHECK-NEXT: %[[MEMREF:.*]] = memref.cast %arg0 : memref<*xf32> to memref<?xf32>
+  // CHECK-NEXT: memref.assume_alignment %[[MEMREF]], 64 : memref<?xf32>
   %c0 = constant 0 : index
   %0 = memref.dim %arg0, %c0 : memref<?xf32>
   // CHECK-NEXT: %[[C0:.*]] = constant 0 : index
@@ -50,6 +219,7 @@ func @use_of_arg(%arg0: memref<?xf32>) {
 // CHECK-LABEL: func @multiple_blocks(%arg0: memref<*xf32>) -> memref<*xf32>
 func @multiple_blocks(%arg0: memref<?xf32>) -> memref<?xf32> {
   // CHECK-NEXT:   %[[INMEMREF:.*]] = memref.cast %arg0 : memref<*xf32> to memref<?xf32>
+  // CHECK-NEXT:   memref.assume_alignment %[[INMEMREF]], 64 : memref<?xf32>
   // CHECK-NEXT:   br ^bb1(%[[INMEMREF]] : memref<?xf32>)
   br ^bb1(%arg0: memref<?xf32>)
   // CHECK-NEXT: ^bb1(%[[BBARG:.*]]: memref<?xf32>):
@@ -61,9 +231,108 @@ func @multiple_blocks(%arg0: memref<?xf32>) -> memref<?xf32> {
 
 // -----
 
+// Test alignment assumptions on allocations.
+
+// CHECK-LABEL: func private @alloc
+func private @alloc(%arg0: index) -> memref<?xf32> {
+  // CHECK-NEXT: %[[ALLOC:.*]] = memref.alloc(%arg0) : memref<?xf32>
+  // CHECK-NEXT: memref.assume_alignment %[[ALLOC]], 64 : memref<?xf32>
+  %0 = memref.alloc(%arg0) : memref<?xf32>
+  return %0 : memref<?xf32>
+}
+
+// -----
+
+// Test direct entries.
+
+// CHECK:      refbackrt.func_metadata
+// CHECK-SAME:   directFuncName = @__refbackrt_direct_entry_direct
+// CHECK-SAME:   funcName = @direct
+// CHECK-NEXT: refbackrt.func_metadata
+// CHECK-NOT:    directFuncName
+// CHECK-SAME:   funcName = @written_input
+
+// The output buffer replaces the returned allocation, and scalar outputs are
+// stored to rank-0 memrefs.
+// CHECK-LABEL: func @direct(%arg0: memref<*xf32>, %arg1: f32) -> (memref<*xf32>, f32)
+// CHECK-LABEL: func private @__refbackrt_direct_entry_direct(
+// CHECK-SAME:      %arg0: memref<2xf32>, %arg1: f32, %arg2: memref<2xf32>, %arg3: memref<f32>)
+// CHECK-SAME:      attributes {refbackrt.direct_entry = "direct"}
+// CHECK-NOT:     memref.alloc
+// CHECK-NOT:     memref.assume_alignment
+// CHECK:         memref.store %{{.*}}, %arg2[%{{.*}}] : memref<2xf32>
+// CHECK-NEXT:    memref.store %arg1, %arg3[] : memref<f32>
+// CHECK-NEXT:    return{{$}}
+func @direct(%arg0: memref<2xf32>, %arg1: f32) -> (memref<2xf32>, f32) {
+  %c0 = constant 0 : index
+  %0 = memref.load %arg0[%c0] : memref<2xf32>
+  %1 = memref.alloc() : memref<2xf32>
+  memref.store %0, %1[%c0] : memref<2xf32>
+  return %1, %arg1 : memref<2xf32>, f32
+}
+
+// The compiled code writes to the caller's buffer, so it can't be passed as
+// is.
+// CHECK-LABEL: func @written_input
+// CHECK-NOT:   __refbackrt_direct_entry
+func @written_input(%arg0: memref<2xf32>) {
+  %c0 = constant 0 : index
+  %cst = constant 0.0 : f32
+  memref.store %cst, %arg0[%c0] : memref<2xf32>
+  return
+}
+
+// -----
+
+// Test the memory footprint: the bytes of the globals used (each counted
+// once), and of the inputs and outputs when they all have a static size.
+
+// CHECK:      refbackrt.func_metadata
+// CHECK-SAME:   constantBytes = 48 : i64
+// CHECK-SAME:   funcName = @static_footprint
+// CHECK-SAME:   inputBytes = 28 : i64
+// CHECK-SAME:   outputBytes = 4 : i64
+// CHECK-NEXT: refbackrt.func_metadata
+// CHECK-SAME:   constantBytes = 0 : i64
+// CHECK-SAME:   funcName = @dynamic_footprint
+// CHECK-NOT:    inputBytes
+// CHECK-SAME:   outputBytes = 0 : i64
+memref.global "private" constant @__constant_8xf32 : memref<8xf32> = dense<1.0>
+memref.global "private" constant @__constant_2x2xi64 : memref<2x2xi64> = dense<1>
+func @static_footprint(%arg0: memref<2x3xf32>, %arg1: f32) -> memref<4xi1> {
+  %0 = memref.get_global @__constant_8xf32 : memref<8xf32>
+  %1 = memref.get_global @__constant_8xf32 : memref<8xf32>
+  %2 = memref.get_global @__constant_2x2xi64 : memref<2x2xi64>
+  %3 = memref.alloc() : memref<4xi1>
+  return %3 : memref<4xi1>
+}
+
+func @dynamic_footprint(%arg0: memref<?xf32>) {
+  return
+}
+
+// -----
+
 // Test diagnostics.
 
 // expected-error @+1 {{func not expressible with refbackrt ABI}}
 func @unhandled_abi_type_on_public_func(%arg0: i32) {
   return
 }
+
+// -----
+
+// The extents of the inputs (and outputs) are packed one after the other,
+// whatever their rank. Scalars have none.
+
+// CHECK:      refbackrt.func_metadata
+// CHECK-SAME:   funcName = @packed_shapes
+// CHECK-SAME:   inputRanks = dense<[7, 0, 1]> : tensor<3xi32>
+// CHECK-SAME:   inputShapes = dense<[2, -1, 3, 4, 5, 6, 7, 8]> : tensor<8xi64>
+// CHECK-SAME:   outputRanks = dense<1> : tensor<1xi32>
+// CHECK-SAME:   outputShapes = dense<8> : tensor<1xi64>
+
+// This function only exists to test its metadata above.
+func @packed_shapes(%arg0: memref<2x?x3x4x5x6x7xf32>, %arg1: f32, %arg2: memref<8xf32>) -> memref<8xf32> {
+  return %arg2 : memref<8xf32>
+}
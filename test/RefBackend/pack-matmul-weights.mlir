@@ -0,0 +1,78 @@
+// RUN: npcomp-opt -refback-pack-matmul-weights=panel-width=2 -split-input-file <%s | FileCheck %s --dump-input=fail
+
+// The last panel is padded with zeros.
+
+// CHECK-DAG:   #[[LHS_MAP:.*]] = affine_map<(d0, d1, d2) -> (d0, d2)>
+// CHECK-DAG:   #[[PACKED_MAP:.*]] = affine_map<(d0, d1, d2) -> (d1 floordiv 2, d2, d1 mod 2)>
+// CHECK-DAG:   #[[OUT_MAP:.*]] = affine_map<(d0, d1, d2) -> (d0, d1)>
+// CHECK-LABEL: func @constant_rhs(
+// CHECK-SAME:      %[[LHS:.*]]: tensor<?x2xf32>, %[[INIT:.*]]: tensor<?x3xf32>) -> tensor<?x3xf32> {
+// CHECK:         %[[PACKED:.*]] = constant dense<{{\[}}{{\[}}[1.000000e+00, 2.000000e+00], [4.000000e+00, 5.000000e+00]], {{\[}}[3.000000e+00, 0.000000e+00], [6.000000e+00, 0.000000e+00]]]> : tensor<2x2x2xf32>
+// CHECK:         %[[RESULT:.*]] = linalg.generic
+// CHECK-SAME:        indexing_maps = [#[[LHS_MAP]], #[[PACKED_MAP]], #[[OUT_MAP]]]
+// CHECK-SAME:        iterator_types = ["parallel", "parallel", "reduction"]
+// CHECK-SAME:        ins(%[[LHS]], %[[PACKED]] : tensor<?x2xf32>, tensor<2x2x2xf32>)
+// CHECK-SAME:        outs(%[[INIT]] : tensor<?x3xf32>)
+// CHECK-SAME:        refback.packed_matmul
+// CHECK:           mulf
+// CHECK:           addf
+// CHECK-NOT:     linalg.matmul
+// CHECK:         return %[[RESULT]]
+func @constant_rhs(%arg0: tensor<?x2xf32>, %arg1: tensor<?x3xf32>) -> tensor<?x3xf32> {
+  %0 = constant dense<[[1.0, 2.0, 3.0], [4.0, 5.0, 6.0]]> : tensor<2x3xf32>
+  %1 = linalg.matmul ins(%arg0, %0 : tensor<?x2xf32>, tensor<2x3xf32>) outs(%arg1 : tensor<?x3xf32>) -> tensor<?x3xf32>
+  return %1 : tensor<?x3xf32>
+}
+
+// -----
+
+// Transposed constants (as in the lowering of aten.linear) are packed from
+// their original layout, and the transpose goes away.
+
+#map0 = affine_map<(d0, d1) -> (d1, d0)>
+#map1 = affine_map<(d0, d1) -> (d0, d1)>
+// CHECK-LABEL: func @transposed_rhs
+// CHECK:         constant dense<{{\[}}{{\[}}[1.000000e+00, 2.000000e+00], [4.000000e+00, 5.000000e+00]], {{\[}}[3.000000e+00, 0.000000e+00], [6.000000e+00, 0.000000e+00]]]> : tensor<2x2x2xf32>
+// CHECK-NOT:     tensor<3x2xf32>
+// CHECK:         linalg.generic
+// CHECK-SAME:        refback.packed_matmul
+func @transposed_rhs(%arg0: tensor<?x2xf32>, %arg1: tensor<?x3xf32>) -> tensor<?x3xf32> {
+  %0 = constant dense<[[1.0, 4.0], [2.0, 5.0], [3.0, 6.0]]> : tensor<3x2xf32>
+  %1 = linalg.init_tensor [2, 3] : tensor<2x3xf32>
+  %2 = linalg.generic {indexing_maps = [#map0, #map1], iterator_types = ["parallel", "parallel"]} ins(%0 : tensor<3x2xf32>) outs(%1 : tensor<2x3xf32>) {
+  ^bb0(%arg2: f32, %arg3: f32):
+    linalg.yield %arg2 : f32
+  } -> tensor<2x3xf32>
+  %3 = linalg.matmul ins(%arg0, %2 : tensor<?x2xf32>, tensor<2x3xf32>) outs(%arg1 : tensor<?x3xf32>) -> tensor<?x3xf32>
+  return %3 : tensor<?x3xf32>
+}
+
+// -----
+
+// Matmuls with non-constant operands are left alone.
+
+// CHECK-LABEL: func @non_constant_rhs
+// CHECK:         linalg.matmul
+func @non_constant_rhs(%arg0: tensor<?x?xf32>, %arg1: tensor<?x?xf32>, %arg2: tensor<?x?xf32>) -> tensor<?x?xf32> {
+  %0 = linalg.matmul ins(%arg0, %arg1 : tensor<?x?xf32>, tensor<?x?xf32>) outs(%arg2 : tensor<?x?xf32>) -> tensor<?x?xf32>
+  return %0 : tensor<?x?xf32>
+}
+
+// -----
+
+// bf16 operands (see DemoteToBF16) are packed as bf16, and extended to the
+// f32 accumulator in the payload.
+
+// CHECK-LABEL: func @bf16_operands(
+// CHECK:         %[[PACKED:.*]] = constant dense<{{.*}}> : tensor<1x2x2xbf16>
+// CHECK:         linalg.generic
+// CHECK-SAME:        ins(%{{.*}}, %[[PACKED]] : tensor<?x2xbf16>, tensor<1x2x2xbf16>)
+// CHECK-SAME:        refback.packed_matmul
+// CHECK:           fpext %{{.*}} : bf16 to f32
+// CHECK:           fpext %{{.*}} : bf16 to f32
+// CHECK:           mulf %{{.*}}, %{{.*}} : f32
+func @bf16_operands(%arg0: tensor<?x2xbf16>, %arg1: tensor<?x2xf32>) -> tensor<?x2xf32> {
+  %0 = constant dense<[[1.0, 2.0], [3.0, 4.0]]> : tensor<2x2xbf16>
+  %1 = linalg.matmul ins(%arg0, %0 : tensor<?x2xbf16>, tensor<2x2xbf16>) outs(%arg1 : tensor<?x2xf32>) -> tensor<?x2xf32>
+  return %1 : tensor<?x2xf32>
+}
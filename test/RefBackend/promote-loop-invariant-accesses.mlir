@@ -0,0 +1,60 @@
+// RUN: npcomp-opt -refback-promote-loop-invariant-accesses -split-input-file <%s | FileCheck %s --dump-input=fail
+
+// The accumulator of a reduction loop is kept in a register, and the bias
+// element, which is the same in all iterations, is loaded once.
+
+// CHECK-LABEL: func @matvec_bias(
+// CHECK-SAME:      %[[A:.*]]: memref<?x?xf32>, %[[X:.*]]: memref<?xf32>, %[[BIAS:.*]]: memref<?xf32>,
+// CHECK:         scf.for %[[I:.*]] =
+// CHECK:           %[[B:.*]] = memref.load %[[BIAS]][%[[I]]]
+// CHECK:           %[[INIT:.*]] = memref.load %[[Y:.*]][%[[I]]]
+// CHECK:           %[[SUM:.*]] = scf.for %[[K:.*]] = {{.*}} iter_args(%[[ACC:.*]] = %[[INIT]]) -> (f32) {
+// CHECK:             memref.load %[[A]][%[[I]], %[[K]]]
+// CHECK:             memref.load %[[X]][%[[K]]]
+// CHECK-NOT:         memref.load
+// CHECK:             %[[MUL:.*]] = mulf
+// CHECK:             %[[ADD:.*]] = addf %[[ACC]], %[[MUL]]
+// CHECK:             %[[NEXT:.*]] = addf %[[ADD]], %[[B]]
+// CHECK-NOT:         memref.store
+// CHECK:             scf.yield %[[NEXT]] : f32
+// CHECK:           memref.store %[[SUM]], %[[Y]][%[[I]]]
+func @matvec_bias(%a: memref<?x?xf32>, %x: memref<?xf32>, %bias: memref<?xf32>, %m: index, %n: index) -> memref<?xf32> {
+  %c0 = constant 0 : index
+  %c1 = constant 1 : index
+  %y = memref.alloc(%m) : memref<?xf32>
+  scf.for %i = %c0 to %m step %c1 {
+    scf.for %k = %c0 to %n step %c1 {
+      %0 = memref.load %a[%i, %k] : memref<?x?xf32>
+      %1 = memref.load %x[%k] : memref<?xf32>
+      %2 = memref.load %y[%i] : memref<?xf32>
+      %3 = memref.load %bias[%i] : memref<?xf32>
+      %4 = mulf %0, %1 : f32
+      %5 = addf %2, %4 : f32
+      %6 = addf %5, %3 : f32
+      memref.store %6, %y[%i] : memref<?xf32>
+    }
+  }
+  return %y : memref<?xf32>
+}
+
+// -----
+
+// The output may alias the inputs, so nothing is moved.
+
+// CHECK-LABEL: func @may_alias(
+// CHECK:         scf.for
+// CHECK-NEXT:      memref.load
+// CHECK-NEXT:      memref.load
+// CHECK-NEXT:      addf
+// CHECK-NEXT:      memref.store
+func @may_alias(%a: memref<?xf32>, %b: memref<?xf32>, %out: memref<?xf32>, %n: index) {
+  %c0 = constant 0 : index
+  %c1 = constant 1 : index
+  scf.for %k = %c0 to %n step %c1 {
+    %0 = memref.load %a[%c0] : memref<?xf32>
+    %1 = memref.load %out[%c0] : memref<?xf32>
+    %2 = addf %0, %1 : f32
+    memref.store %2, %out[%c0] : memref<?xf32>
+  }
+  return
+}
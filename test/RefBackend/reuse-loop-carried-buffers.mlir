@@ -0,0 +1,122 @@
+// RUN: npcomp-opt -refback-reuse-loop-carried-buffers -split-input-file %s | FileCheck %s
+
+#map = affine_map<(d0) -> (d0)>
+
+// Each step of a recurrence computes the new state into the buffer of the
+// state before the previous one.
+
+// CHECK-LABEL:   func @recurrence(
+// CHECK-SAME:                     %[[INIT:.*]]: memref<?xf32>,
+// CHECK-SAME:                     %[[N:.*]]: index, %[[STEPS:.*]]: index) -> memref<?xf32> {
+// CHECK:           %[[SPARE:.*]] = memref.alloc(%[[N]]) : memref<?xf32>
+// CHECK:           %[[LOOP:.*]]:2 = scf.for %{{.*}} = %{{.*}} to %[[STEPS]] step %{{.*}} iter_args(%[[STATE:[a-zA-Z0-9_]+]] = %[[INIT]], %[[NEXT:[a-zA-Z0-9_]+]] = %[[SPARE]]) -> (memref<?xf32>, memref<?xf32>) {
+// CHECK-NOT:         memref.alloc
+// CHECK:             linalg.generic
+// CHECK-SAME:          ins(%[[STATE]] : memref<?xf32>) outs(%[[NEXT]] : memref<?xf32>)
+// CHECK-NOT:         memref.dealloc
+// CHECK:             scf.yield %[[NEXT]], %[[STATE]] : memref<?xf32>, memref<?xf32>
+// CHECK:           }
+// CHECK:           memref.dealloc %[[LOOP]]#1 : memref<?xf32>
+// CHECK:           return %[[LOOP]]#0 : memref<?xf32>
+func @recurrence(%init: memref<?xf32>, %n: index, %steps: index) -> memref<?xf32> {
+  %c0 = constant 0 : index
+  %c1 = constant 1 : index
+  %0 = scf.for %i = %c0 to %steps step %c1 iter_args(%state = %init) -> (memref<?xf32>) {
+    %next = memref.alloc(%n) : memref<?xf32>
+    linalg.generic {indexing_maps = [#map, #map], iterator_types = ["parallel"]}
+        ins(%state : memref<?xf32>) outs(%next : memref<?xf32>) {
+    ^bb0(%s: f32, %out: f32):
+      %1 = math.tanh %s : f32
+      linalg.yield %1 : f32
+    }
+    memref.dealloc %state : memref<?xf32>
+    scf.yield %next : memref<?xf32>
+  }
+  return %0 : memref<?xf32>
+}
+
+// -----
+
+#map = affine_map<(d0) -> (d0)>
+
+// The states of an LSTM-style loop are double buffered independently, but
+// not the buffers that aren't loop-carried.
+
+// CHECK-LABEL:   func @two_states(
+// CHECK:           %[[H_SPARE:.*]] = memref.alloc() : memref<4xf32>
+// CHECK:           %[[C_SPARE:.*]] = memref.alloc() : memref<4xf32>
+// CHECK:           %[[LOOP:.*]]:4 = scf.for {{.*}} iter_args(%[[H:[a-zA-Z0-9_]+]] = %{{.*}}, %[[C:[a-zA-Z0-9_]+]] = %{{.*}}, %[[H_NEXT:[a-zA-Z0-9_]+]] = %[[H_SPARE]], %[[C_NEXT:[a-zA-Z0-9_]+]] = %[[C_SPARE]])
+// CHECK:             %[[TMP:.*]] = memref.alloc() : memref<4xf32>
+// CHECK:             linalg.generic {{.*}} ins(%[[H]], %[[C]] : memref<4xf32>, memref<4xf32>) outs(%[[TMP]] : memref<4xf32>)
+// CHECK:             linalg.generic {{.*}} ins(%[[TMP]] : memref<4xf32>) outs(%[[C_NEXT]] : memref<4xf32>)
+// CHECK:             linalg.generic {{.*}} ins(%[[C_NEXT]] : memref<4xf32>) outs(%[[H_NEXT]] : memref<4xf32>)
+// CHECK:             memref.dealloc %[[TMP]] : memref<4xf32>
+// CHECK-NOT:         memref.dealloc
+// CHECK:             scf.yield %[[H_NEXT]], %[[C_NEXT]], %[[H]], %[[C]]
+// CHECK:           memref.dealloc %[[LOOP]]#2 : memref<4xf32>
+// CHECK:           memref.dealloc %[[LOOP]]#3 : memref<4xf32>
+func @two_states(%h0: memref<4xf32>, %c0: memref<4xf32>, %steps: index) -> (memref<4xf32>, memref<4xf32>) {
+  %i0 = constant 0 : index
+  %i1 = constant 1 : index
+  %0:2 = scf.for %i = %i0 to %steps step %i1 iter_args(%h = %h0, %c = %c0) -> (memref<4xf32>, memref<4xf32>) {
+    %tmp = memref.alloc() : memref<4xf32>
+    linalg.generic {indexing_maps = [#map, #map, #map], iterator_types = ["parallel"]}
+        ins(%h, %c : memref<4xf32>, memref<4xf32>) outs(%tmp : memref<4xf32>) {
+    ^bb0(%a: f32, %b: f32, %out: f32):
+      %1 = addf %a, %b : f32
+      linalg.yield %1 : f32
+    }
+    memref.dealloc %h : memref<4xf32>
+    memref.dealloc %c : memref<4xf32>
+    %c_next = memref.alloc() : memref<4xf32>
+    linalg.generic {indexing_maps = [#map, #map], iterator_types = ["parallel"]}
+        ins(%tmp : memref<4xf32>) outs(%c_next : memref<4xf32>) {
+    ^bb0(%a: f32, %out: f32):
+      %1 = math.exp %a : f32
+      linalg.yield %1 : f32
+    }
+    %h_next = memref.alloc() : memref<4xf32>
+    linalg.generic {indexing_maps = [#map, #map], iterator_types = ["parallel"]}
+        ins(%c_next : memref<4xf32>) outs(%h_next : memref<4xf32>) {
+    ^bb0(%a: f32, %out: f32):
+      %1 = math.tanh %a : f32
+      linalg.yield %1 : f32
+    }
+    memref.dealloc %tmp : memref<4xf32>
+    scf.yield %h_next, %c_next : memref<4xf32>, memref<4xf32>
+  }
+  return %0#0, %0#1 : memref<4xf32>, memref<4xf32>
+}
+
+// -----
+
+// The buffers aren't reused when the new value has an iteration-dependent
+// size, or when a buffer is aliased by a view.
+
+// CHECK-LABEL:   func @not_reused(
+// CHECK-NOT:       memref.alloc
+// CHECK:           scf.for
+// CHECK:             memref.alloc(%{{.*}}) : memref<?xf32>
+// CHECK:           scf.for
+// CHECK:             memref.alloc() : memref<4xf32>
+// CHECK:             memref.subview
+func private @use(memref<2xf32, offset: 1, strides: [1]>)
+func @not_reused(%init: memref<?xf32>, %init4: memref<4xf32>, %steps: index) -> (memref<?xf32>, memref<4xf32>) {
+  %c0 = constant 0 : index
+  %c1 = constant 1 : index
+  %0 = scf.for %i = %c0 to %steps step %c1 iter_args(%state = %init) -> (memref<?xf32>) {
+    %next = memref.alloc(%i) : memref<?xf32>
+    linalg.copy(%state, %next) : memref<?xf32>, memref<?xf32>
+    memref.dealloc %state : memref<?xf32>
+    scf.yield %next : memref<?xf32>
+  }
+  %1 = scf.for %i = %c0 to %steps step %c1 iter_args(%state = %init4) -> (memref<4xf32>) {
+    %next = memref.alloc() : memref<4xf32>
+    linalg.copy(%state, %next) : memref<4xf32>, memref<4xf32>
+    %view = memref.subview %next[1] [2] [1] : memref<4xf32> to memref<2xf32, offset: 1, strides: [1]>
+    call @use(%view) : (memref<2xf32, offset: 1, strides: [1]>) -> ()
+    memref.dealloc %state : memref<4xf32>
+    scf.yield %next : memref<4xf32>
+  }
+  return %0, %1 : memref<?xf32>, memref<4xf32>
+}
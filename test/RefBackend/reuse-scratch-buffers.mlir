@@ -0,0 +1,144 @@
+// RUN: npcomp-opt -refback-reuse-scratch-buffers -split-input-file <%s | FileCheck %s --dump-input=fail
+
+// Buffers with disjoint live ranges share storage.
+
+// CHECK:      refbackrt.func_metadata
+// CHECK-SAME:   funcName = @disjoint
+// CHECK-SAME:   peakScratchBytes = 128 : i64
+refbackrt.module_metadata {
+  refbackrt.func_metadata {funcName = @disjoint, numInputs = 0 : i32, numOutputs = 0 : i32}
+}
+
+// CHECK-LABEL: func @disjoint
+func @disjoint() {
+  // CHECK-NEXT: %[[WORKSPACE:.*]] = memref.alloc() {refbackrt.scratch} : memref<128xi8>
+  // CHECK-NEXT: %[[OFFSET0:.*]] = constant 0 : index
+  // CHECK-NEXT: memref.view %[[WORKSPACE]][%[[OFFSET0]]][] : memref<128xi8> to memref<16xf32>
+  // CHECK-NEXT: %[[OFFSET1:.*]] = constant 64 : index
+  // CHECK-NEXT: memref.view %[[WORKSPACE]][%[[OFFSET1]]][] : memref<128xi8> to memref<4xi32>
+  // CHECK:      memref.view %[[WORKSPACE]][%{{.*}}][] : memref<128xi8> to memref<2xf32>
+  // CHECK-NOT:  memref.alloc
+  %0 = memref.alloc() {refbackrt.scratch} : memref<16xf32>
+  %1 = memref.alloc() {refbackrt.scratch} : memref<4xi32>
+  %c0 = constant 0 : index
+  %2 = memref.load %0[%c0] : memref<16xf32>
+  %3 = memref.load %1[%c0] : memref<4xi32>
+  // %0 is dead by now, so %4 can reuse its storage.
+  %4 = memref.alloc() {refbackrt.scratch} : memref<2xf32>
+  memref.store %2, %4[%c0] : memref<2xf32>
+  return
+}
+
+// -----
+
+// Buffers local to different blocks all share one workspace allocated on
+// entry, which only needs to be as large as the largest block's layout. This
+// holds even for blocks executed repeatedly.
+
+// CHECK:      refbackrt.func_metadata
+// CHECK-SAME:   funcName = @blocks
+// CHECK-SAME:   peakScratchBytes = 256 : i64
+refbackrt.module_metadata {
+  refbackrt.func_metadata {funcName = @blocks, numInputs = 1 : i32, inputArgTypes = dense<0> : tensor<1xi32>, numOutputs = 0 : i32}
+}
+
+// CHECK-LABEL: func @blocks
+func private @blocks(%arg0: i1) {
+  // CHECK-NEXT: %[[WORKSPACE:.*]] = memref.alloc() {refbackrt.scratch} : memref<256xi8>
+  // CHECK:      memref.view %[[WORKSPACE]][%{{.*}}][] : memref<256xi8> to memref<32xf32>
+  // CHECK:      ^bb1:
+  // CHECK:      memref.view %[[WORKSPACE]][%{{.*}}][] : memref<256xi8> to memref<64xf32>
+  // CHECK-NOT:  memref.alloc
+  %0 = memref.alloc() {refbackrt.scratch} : memref<32xf32>
+  %c0 = constant 0 : index
+  %1 = memref.load %0[%c0] : memref<32xf32>
+  br ^bb1
+^bb1:
+  %2 = memref.alloc() {refbackrt.scratch} : memref<64xf32>
+  memref.store %1, %2[%c0] : memref<64xf32>
+  cond_br %arg0, ^bb1, ^bb2
+^bb2:
+  return
+}
+
+// -----
+
+// Even a lone buffer is placed in the workspace when it is allocated in a
+// loop, so that the iterations don't each take a new one from the scratch
+// arena.
+
+// CHECK:      refbackrt.func_metadata
+// CHECK-SAME:   funcName = @lone_buffer_in_loop
+// CHECK-SAME:   peakScratchBytes = 4096 : i64
+refbackrt.module_metadata {
+  refbackrt.func_metadata {funcName = @lone_buffer_in_loop, numInputs = 1 : i32, inputArgTypes = dense<0> : tensor<1xi32>, numOutputs = 0 : i32}
+}
+
+// CHECK-LABEL: func @lone_buffer_in_loop
+func private @lone_buffer_in_loop(%arg0: i1) {
+  // CHECK-NEXT: %[[WORKSPACE:.*]] = memref.alloc() {refbackrt.scratch} : memref<4096xi8>
+  // CHECK:      ^bb1:
+  // CHECK:      memref.view %[[WORKSPACE]][%{{.*}}][] : memref<4096xi8> to memref<1024xf32>
+  // CHECK-NOT:  memref.alloc
+  %c0 = constant 0 : index
+  %cst = constant 1.0 : f32
+  br ^bb1
+^bb1:
+  %0 = memref.alloc() {refbackrt.scratch} : memref<1024xf32>
+  memref.store %cst, %0[%c0] : memref<1024xf32>
+  cond_br %arg0, ^bb1, ^bb2
+^bb2:
+  return
+}
+
+// -----
+
+// Dynamically shaped buffers aren't shared, and make the peak unknown.
+
+// CHECK:      refbackrt.func_metadata
+// CHECK-NOT:    peakScratchBytes
+refbackrt.module_metadata {
+  refbackrt.func_metadata {funcName = @dynamic, numInputs = 1 : i32, inputArgTypes = dense<0> : tensor<1xi32>, numOutputs = 0 : i32}
+}
+
+// CHECK-LABEL: func @dynamic
+func @dynamic(%arg0: index) {
+  // CHECK-NEXT: memref.alloc(%arg0) {refbackrt.scratch} : memref<?xf32>
+  // CHECK-NEXT: memref.alloc() {refbackrt.scratch} : memref<4xf32>
+  // CHECK-NEXT: return
+  %0 = memref.alloc(%arg0) {refbackrt.scratch} : memref<?xf32>
+  %1 = memref.alloc() {refbackrt.scratch} : memref<4xf32>
+  return
+}
+
+// -----
+
+// Dynamically shaped buffers reuse dead ones of the same shape.
+
+// CHECK-LABEL: func @dynamic_reuse
+func @dynamic_reuse(%arg0: memref<?xf32>) {
+  // CHECK:      %[[BUFFER:.*]] = memref.alloc(%{{.*}}) {refbackrt.scratch} : memref<?xf32>
+  // CHECK-NOT:  memref.alloc
+  // CHECK:      memref.store %{{.*}}, %[[BUFFER]]
+  %c0 = constant 0 : index
+  %0 = memref.dim %arg0, %c0 : memref<?xf32>
+  %1 = memref.alloc(%0) {refbackrt.scratch} : memref<?xf32>
+  %2 = memref.load %1[%c0] : memref<?xf32>
+  %c0_0 = constant 0 : index
+  %3 = memref.dim %arg0, %c0_0 : memref<?xf32>
+  %4 = memref.alloc(%3) {refbackrt.scratch} : memref<?xf32>
+  memref.store %2, %4[%c0] : memref<?xf32>
+  return
+}
+
+// -----
+
+// Regular (non-scratch) allocations are left alone.
+
+// CHECK-LABEL: func @not_scratch
+func @not_scratch() -> memref<4xf32> {
+  // CHECK-NEXT: memref.alloc() : memref<4xf32>
+  // CHECK-NEXT: return
+  %0 = memref.alloc() : memref<4xf32>
+  return %0 : memref<4xf32>
+}
@@ -0,0 +1,42 @@
+// RUN: npcomp-opt -refback-specialize-functions=batch-sizes=1,8 -split-input-file <%s | FileCheck %s --dump-input=fail
+
+// The variants follow the original function, in the order of the batch
+// sizes. TCF ops see the static arguments, other users the original types.
+
+// CHECK-LABEL: func @f(
+// CHECK-SAME:      %{{.*}}: tensor<?x4xf32>, %{{.*}}: tensor<4xf32>) -> tensor<?x4xf32>
+// CHECK-LABEL: func @f$batch1(
+// CHECK-SAME:      %[[ARG0:.*]]: tensor<1x4xf32>, %[[ARG1:.*]]: tensor<4xf32>) -> tensor<?x4xf32> {
+// CHECK:         %[[CAST:.*]] = tensor.cast %[[ARG0]] : tensor<1x4xf32> to tensor<?x4xf32>
+// CHECK:         %[[SUM:.*]] = tcf.add %[[ARG0]], %[[ARG1]] : (tensor<1x4xf32>, tensor<4xf32>) -> tensor<?x4xf32>
+// CHECK:         %[[DIM:.*]] = memref.dim %[[CAST]]
+// CHECK:         return %[[SUM]]
+// CHECK-LABEL: func @f$batch8(
+// CHECK-SAME:      %{{.*}}: tensor<8x4xf32>, %{{.*}}: tensor<4xf32>) -> tensor<?x4xf32>
+func @f(%arg0: tensor<?x4xf32>, %arg1: tensor<4xf32>) -> tensor<?x4xf32> {
+  %c0 = constant 0 : index
+  %0 = tcf.add %arg0, %arg1 : (tensor<?x4xf32>, tensor<4xf32>) -> tensor<?x4xf32>
+  %1 = memref.dim %arg0, %c0 : tensor<?x4xf32>
+  return %0 : tensor<?x4xf32>
+}
+
+// -----
+
+// Private functions, and functions without a dynamic leading dimension, are
+// left alone.
+
+// CHECK-LABEL: func private @private
+// CHECK-LABEL: func @static
+// CHECK-LABEL: func @scalar
+// CHECK-NOT:   $batch
+func private @private(%arg0: tensor<?xf32>) -> tensor<?xf32> {
+  return %arg0 : tensor<?xf32>
+}
+
+func @static(%arg0: tensor<2x?xf32>) -> tensor<2x?xf32> {
+  return %arg0 : tensor<2x?xf32>
+}
+
+func @scalar(%arg0: tensor<f32>) -> tensor<f32> {
+  return %arg0 : tensor<f32>
+}
@@ -0,0 +1,84 @@
+// RUN: npcomp-opt -refback-tile-linalg-ops="matmul-l2-tile-sizes=128,128,128 matmul-l1-tile-sizes=32,32,32" -split-input-file <%s | FileCheck %s --dump-input=fail
+
+// Two levels of tiling give six loops around the innermost matmul.
+
+// CHECK-LABEL: func @matmul
+// CHECK:         scf.for
+// CHECK:           scf.for
+// CHECK:             scf.for
+// CHECK:               scf.for
+// CHECK:                 scf.for
+// CHECK:                   scf.for
+// CHECK:                     linalg.matmul
+// CHECK-NOT:                   __internal_linalg_transform__
+func @matmul(%arg0: memref<256x256xf32>, %arg1: memref<256x256xf32>, %arg2: memref<256x256xf32>) {
+  linalg.matmul ins(%arg0, %arg1 : memref<256x256xf32>, memref<256x256xf32>) outs(%arg2 : memref<256x256xf32>)
+  return
+}
+
+// -----
+
+// Other ops aren't tiled.
+
+// CHECK-LABEL: func @fill
+// CHECK-NOT:     scf.for
+// CHECK:         linalg.fill
+func @fill(%arg0: memref<256x256xf32>, %arg1: f32) {
+  linalg.fill(%arg0, %arg1) : memref<256x256xf32>, f32
+  return
+}
+
+// -----
+
+// Batch matmuls are tiled with the matmul tile sizes, one matrix at a time.
+
+// CHECK-LABEL: func @batch_matmul
+// CHECK:         scf.for {{.*}} step %c1
+// CHECK:           scf.for {{.*}} step %c128
+// CHECK:             scf.for {{.*}} step %c128
+// CHECK:               scf.for {{.*}} step %c128
+// CHECK:                 linalg.batch_matmul
+func @batch_matmul(%arg0: memref<16x256x256xf32>, %arg1: memref<16x256x256xf32>, %arg2: memref<16x256x256xf32>) {
+  linalg.batch_matmul ins(%arg0, %arg1 : memref<16x256x256xf32>, memref<16x256x256xf32>) outs(%arg2 : memref<16x256x256xf32>)
+  return
+}
+
+// -----
+
+// Matrix-vector products are tiled with the matmul tile sizes of their loops.
+
+// CHECK-LABEL: func @matvec
+// CHECK:         scf.for {{.*}} step %c128
+// CHECK:           scf.for {{.*}} step %c128
+// CHECK:             scf.for {{.*}} step %c32
+// CHECK:               scf.for {{.*}} step %c32
+// CHECK:                 linalg.matvec
+func @matvec(%arg0: memref<256x256xf32>, %arg1: memref<256xf32>, %arg2: memref<256xf32>) {
+  linalg.matvec ins(%arg0, %arg1 : memref<256x256xf32>, memref<256xf32>) outs(%arg2 : memref<256xf32>)
+  return
+}
+
+// -----
+
+// Tuned tile sizes replace those of the pass, and an op whose tuned L2 sizes
+// are all zero is only tiled for L1.
+
+// CHECK-LABEL: func @tuned_matmul
+// CHECK:         scf.for {{.*}} step %c64
+// CHECK:           scf.for {{.*}} step %c64
+// CHECK:             scf.for {{.*}} step %c64
+// CHECK:               scf.for {{.*}} step %c16
+// CHECK:                 scf.for {{.*}} step %c16
+// CHECK:                   scf.for {{.*}} step %c16
+// CHECK:                     linalg.matmul
+// CHECK:         scf.for {{.*}} step %c8
+// CHECK:           scf.for {{.*}} step %c8
+// CHECK:             scf.for {{.*}} step %c8
+// CHECK-NOT:           scf.for
+// CHECK:               linalg.matmul
+// CHECK-NOT:           __internal_linalg_transform__
+func @tuned_matmul(%arg0: memref<256x256xf32>, %arg1: memref<256x256xf32>, %arg2: memref<256x256xf32>) {
+  linalg.matmul {refback.tuning = {l2_tile_sizes = [64, 64, 64], l1_tile_sizes = [16, 16, 16]}} ins(%arg0, %arg1 : memref<256x256xf32>, memref<256x256xf32>) outs(%arg2 : memref<256x256xf32>)
+  linalg.matmul {refback.tuning = {l2_tile_sizes = [0, 0, 0], l1_tile_sizes = [8, 8, 8]}} ins(%arg0, %arg1 : memref<256x256xf32>, memref<256x256xf32>) outs(%arg2 : memref<256x256xf32>)
+  return
+}
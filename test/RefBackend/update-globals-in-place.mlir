@@ -0,0 +1,95 @@
+// RUN: npcomp-opt -refback-update-globals-in-place -split-input-file %s | FileCheck %s
+
+#map = affine_map<(d0) -> (d0)>
+
+memref.global "private" @w : memref<4xf32> = dense<1.0>
+
+// An SGD step updates the weights in place.
+
+// CHECK-LABEL:   func @sgd(
+// CHECK-SAME:              %[[GRAD:.*]]: memref<4xf32>,
+// CHECK-SAME:              %[[LR:.*]]: f32) {
+// CHECK-NOT:       memref.alloc
+// CHECK-NOT:       linalg.copy
+// CHECK:           %[[OLD:.*]] = memref.get_global @w : memref<4xf32>
+// CHECK:           %[[NEW:.*]] = memref.get_global @w : memref<4xf32>
+// CHECK-NOT:       memref.alloc
+// CHECK:           linalg.generic
+// CHECK-SAME:        ins(%[[OLD]], %[[GRAD]] : memref<4xf32>, memref<4xf32>)
+// CHECK-SAME:        outs(%[[NEW]] : memref<4xf32>)
+// CHECK-NOT:       linalg.copy
+// CHECK-NOT:       memref.dealloc
+// CHECK:           return
+func @sgd(%grad: memref<4xf32>, %lr: f32) {
+  %0 = memref.get_global @w : memref<4xf32>
+  %old = memref.alloc() : memref<4xf32>
+  linalg.copy(%0, %old) : memref<4xf32>, memref<4xf32>
+  %new = memref.alloc() : memref<4xf32>
+  linalg.generic {indexing_maps = [#map, #map, #map], iterator_types = ["parallel"]}
+      ins(%old, %grad : memref<4xf32>, memref<4xf32>) outs(%new : memref<4xf32>) {
+  ^bb0(%w: f32, %g: f32, %out: f32):
+    %1 = mulf %lr, %g : f32
+    %2 = subf %w, %1 : f32
+    linalg.yield %2 : f32
+  }
+  memref.dealloc %old : memref<4xf32>
+  %3 = memref.get_global @w : memref<4xf32>
+  linalg.copy(%new, %3) : memref<4xf32>, memref<4xf32>
+  memref.dealloc %new : memref<4xf32>
+  return
+}
+
+// -----
+
+#map = affine_map<(d0) -> (d0)>
+#reversed = affine_map<(d0) -> (3 - d0)>
+
+memref.global "private" @w : memref<4xf32> = dense<1.0>
+
+// The copy of the weights is still needed when they are overwritten at other
+// elements than the ones read.
+
+// CHECK-LABEL:   func @reverse() {
+// CHECK:           %[[W:.*]] = memref.get_global @w : memref<4xf32>
+// CHECK:           %[[OLD:.*]] = memref.alloc() : memref<4xf32>
+// CHECK:           linalg.copy(%[[W]], %[[OLD]])
+// CHECK:           %[[NEW:.*]] = memref.get_global @w : memref<4xf32>
+// CHECK:           linalg.generic
+// CHECK-SAME:        ins(%[[OLD]] : memref<4xf32>) outs(%[[NEW]] : memref<4xf32>)
+// CHECK-NOT:       linalg.copy
+func @reverse() {
+  %0 = memref.get_global @w : memref<4xf32>
+  %old = memref.alloc() : memref<4xf32>
+  linalg.copy(%0, %old) : memref<4xf32>, memref<4xf32>
+  %new = memref.alloc() : memref<4xf32>
+  linalg.generic {indexing_maps = [#reversed, #map], iterator_types = ["parallel"]}
+      ins(%old : memref<4xf32>) outs(%new : memref<4xf32>) {
+  ^bb0(%w: f32, %out: f32):
+    linalg.yield %w : f32
+  }
+  memref.dealloc %old : memref<4xf32>
+  %1 = memref.get_global @w : memref<4xf32>
+  linalg.copy(%new, %1) : memref<4xf32>, memref<4xf32>
+  memref.dealloc %new : memref<4xf32>
+  return
+}
+
+// -----
+
+memref.global "private" @w : memref<4xf32> = dense<1.0>
+
+// A read of the weights before they are overwritten keeps its copy.
+
+// CHECK-LABEL:   func @read_then_write(
+// CHECK:           %[[OLD:.*]] = memref.alloc() : memref<4xf32>
+// CHECK:           linalg.copy(%{{.*}}, %[[OLD]])
+// CHECK:           linalg.copy(%{{.*}}, %{{.*}})
+// CHECK:           return %[[OLD]] : memref<4xf32>
+func @read_then_write(%arg0: memref<4xf32>) -> memref<4xf32> {
+  %0 = memref.get_global @w : memref<4xf32>
+  %old = memref.alloc() : memref<4xf32>
+  linalg.copy(%0, %old) : memref<4xf32>, memref<4xf32>
+  %1 = memref.get_global @w : memref<4xf32>
+  linalg.copy(%arg0, %1) : memref<4xf32>, memref<4xf32>
+  return %old : memref<4xf32>
+}
@@ -0,0 +1,57 @@
+// RUN: npcomp-opt -refback-vectorize-linalg-ops=vector-width=256 -split-input-file <%s | FileCheck %s --dump-input=fail
+
+#map = affine_map<(d0, d1) -> (d0, d1)>
+
+// CHECK-LABEL: func @elementwise
+// CHECK:         vector.transfer_read {{.*}} : memref<4x16xf32>, vector<4x16xf32>
+// CHECK:         vector.transfer_read {{.*}} : memref<4x16xf32>, vector<4x16xf32>
+// CHECK:         addf {{.*}} : vector<4x16xf32>
+// CHECK:         vector.transfer_write {{.*}} : vector<4x16xf32>, memref<4x16xf32>
+// CHECK-NOT:     linalg.generic
+func @elementwise(%arg0: memref<4x16xf32>, %arg1: memref<4x16xf32>, %arg2: memref<4x16xf32>) {
+  linalg.generic {indexing_maps = [#map, #map, #map], iterator_types = ["parallel", "parallel"]}
+      ins(%arg0, %arg1 : memref<4x16xf32>, memref<4x16xf32>)
+      outs(%arg2 : memref<4x16xf32>) {
+  ^bb0(%lhs: f32, %rhs: f32, %out: f32):
+    %0 = addf %lhs, %rhs : f32
+    linalg.yield %0 : f32
+  }
+  return
+}
+
+// -----
+
+// Matmuls are vectorized as contractions, which are lowered to outer
+// products.
+
+// CHECK-LABEL: func @matmul
+// CHECK:         vector.outerproduct {{.*}} : vector<8xf32>, vector<8xf32>
+// CHECK-NOT:     vector.contract
+// CHECK-NOT:     linalg.matmul
+func @matmul(%arg0: memref<8x8xf32>, %arg1: memref<8x8xf32>, %arg2: memref<8x8xf32>) {
+  linalg.matmul ins(%arg0, %arg1 : memref<8x8xf32>, memref<8x8xf32>) outs(%arg2 : memref<8x8xf32>)
+  return
+}
+
+// -----
+
+#map = affine_map<(d0, d1) -> (d0, d1)>
+
+// An innermost dimension that doesn't fill whole vectors, and dynamic shapes,
+// are left to the scalar loop lowering.
+
+// CHECK-LABEL: func @not_vectorized
+// CHECK:         linalg.generic
+// CHECK:         linalg.matmul
+// CHECK-NOT:     vector.
+func @not_vectorized(%arg0: memref<4x3xf32>, %arg1: memref<?x?xf32>) {
+  linalg.generic {indexing_maps = [#map, #map], iterator_types = ["parallel", "parallel"]}
+      ins(%arg0 : memref<4x3xf32>)
+      outs(%arg0 : memref<4x3xf32>) {
+  ^bb0(%in: f32, %out: f32):
+    %0 = addf %in, %in : f32
+    linalg.yield %0 : f32
+  }
+  linalg.matmul ins(%arg1, %arg1 : memref<?x?xf32>, memref<?x?xf32>) outs(%arg1 : memref<?x?xf32>)
+  return
+}
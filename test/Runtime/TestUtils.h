@@ -0,0 +1,103 @@
+//===- TestUtils.h - Helpers of the runtime tests ---------------*- C++ -*-===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Each test of this directory is a binary of its own, which prints what it
+// observes for FileCheck. These are the helpers that they share.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef NPCOMP_TEST_RUNTIME_TESTUTILS_H
+#define NPCOMP_TEST_RUNTIME_TESTUTILS_H
+
+#include "mlir/InitAllDialects.h"
+#include "mlir/Parser.h"
+#include "mlir/Pass/PassManager.h"
+#include "npcomp-c/InitLLVM.h"
+#include "npcomp/InitAll.h"
+#include "npcomp/RefBackend/JITHelpers/JITModule.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdlib>
+#include <vector>
+
+namespace runtime_test {
+
+/// Prints `error` and exits, for the errors that the tests don't expect.
+inline void exitOnError(llvm::Error error) {
+  if (!error)
+    return;
+  llvm::errs() << "unexpected error: " << llvm::toString(std::move(error))
+               << "\n";
+  std::exit(EXIT_FAILURE);
+}
+
+template <typename T> T exitOnError(llvm::Expected<T> expected) {
+  exitOnError(expected.takeError());
+  return std::move(*expected);
+}
+
+/// Compiles `source` through the backend compilation pipeline into a
+/// JITModule, exiting on failure.
+inline std::unique_ptr<refback::JITModule>
+compileModule(llvm::StringRef source, bool optimize = false,
+              llvm::StringRef objectCacheDir = "",
+              const refback::JITCompileOptions &compileOptions = {}) {
+  static mlir::MLIRContext *context = [] {
+    npcompInitializeLLVMCodegen();
+    mlir::DialectRegistry registry;
+    mlir::registerAllDialects(registry);
+    mlir::NPCOMP::registerAllDialects(registry);
+    auto *context = new mlir::MLIRContext;
+    context->appendDialectRegistry(registry);
+    context->loadAllAvailableDialects();
+    return context;
+  }();
+  mlir::OwningModuleRef module = mlir::parseSourceString(source, context);
+  if (!module) {
+    llvm::errs() << "could not parse the module\n";
+    std::exit(EXIT_FAILURE);
+  }
+  mlir::PassManager pm(context, mlir::OpPassManager::Nesting::Implicit);
+  mlir::NPCOMP::RefBackendLoweringPipelineOptions pipelineOptions;
+  pipelineOptions.optimize = optimize;
+  refback::JITModule::buildBackendCompilationPipeline(pm, pipelineOptions);
+  if (mlir::failed(pm.run(*module))) {
+    llvm::errs() << "could not compile the module\n";
+    std::exit(EXIT_FAILURE);
+  }
+  return exitOnError(refback::JITModule::fromCompiledModule(
+      *module, /*sharedLibs=*/{}, objectCacheDir, compileOptions));
+}
+
+/// Returns a tensor of f32 `elements` with `extents`.
+inline refbackrt::RtValue createTensor(std::vector<std::int64_t> extents,
+                                       std::vector<float> elements) {
+  return refbackrt::Tensor::create(
+      refbackrt::ArrayRef<std::int64_t>(extents.data(), extents.size()),
+      refbackrt::ElementType::F32, elements.data());
+}
+
+/// Prints the elements of the f32 tensor `value` as `label: [e0, e1, ...]`.
+inline void printTensor(llvm::StringRef label,
+                        const refbackrt::RtValue &value) {
+  llvm::outs() << label << ": [";
+  refbackrt::Tensor *tensor = value.getTensor();
+  std::int64_t numElements = 1;
+  for (int i = 0, e = tensor->getRank(); i < e; i++)
+    numElements *= tensor->getExtent(i);
+  for (std::int64_t i = 0; i < numElements; i++) {
+    llvm::outs() << (i ? ", " : "");
+    llvm::outs() << llvm::format("%.1f", tensor->getData<float>()[i]);
+  }
+  llvm::outs() << "]\n";
+}
+
+} // namespace runtime_test
+
+#endif // NPCOMP_TEST_RUNTIME_TESTUTILS_H
@@ -0,0 +1,72 @@
+//===- check-failure.cpp - Test of the calls failing a runtime check ------===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+// RUN: npcomp-runtime-check-failure-test 2>&1 | FileCheck %s
+
+#include "TestUtils.h"
+
+using namespace runtime_test;
+
+// The first result is allocated before the shape check of the second one.
+static const char *kModuleSource = R"mlir(
+func @f(%arg0: tensor<?xf32>, %arg1: tensor<?xf32>) -> (tensor<?xf32>, tensor<?xf32>) {
+  %0 = tcf.add %arg0, %arg0 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  %1 = tcf.add %0, %arg1 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  return %0, %1 : tensor<?xf32>, tensor<?xf32>
+}
+)mlir";
+
+constexpr int kNumCalls = 1000;
+
+int main() {
+  auto jitModule = compileModule(kModuleSource);
+  refbackrt::RtValue goodInputs[] = {createTensor({3}, {1.0, 2.0, 3.0}),
+                                     createTensor({3}, {1.0, 1.0, 1.0})};
+  refbackrt::RtValue badInputs[] = {createTensor({3}, {1.0, 2.0, 3.0}),
+                                    createTensor({2}, {1.0, 1.0})};
+  // Warm the caches of the allocator up, which then hold on to the buffers
+  // of the call.
+  exitOnError(jitModule->invoke("f", goodInputs));
+
+  // Failed calls free the buffers that the compiled code allocated before
+  // the check, however many times they are repeated.
+  // CHECK:      error: invoking 'f': required broadcastable shapes
+  // CHECK-NEXT: leaked bytes: 0
+  std::int64_t bytesLive = refbackrt::getAllocatorStats().bytesLive;
+  std::string message;
+  for (int i = 0; i < kNumCalls; i++) {
+    auto outputs = jitModule->invoke("f", badInputs);
+    if (outputs) {
+      llvm::outs() << "unexpected success\n";
+      return 1;
+    }
+    message = llvm::toString(outputs.takeError());
+  }
+  llvm::outs() << "error: " << message << "\n";
+  llvm::outs() << "leaked bytes: "
+               << refbackrt::getAllocatorStats().bytesLive - bytesLive
+               << "\n";
+
+  // The same goes for invokeInto.
+  // CHECK-NEXT: leaked bytes: 0
+  refbackrt::RtValue outputs[2];
+  bytesLive = refbackrt::getAllocatorStats().bytesLive;
+  for (int i = 0; i < kNumCalls; i++)
+    llvm::consumeError(jitModule->invokeInto("f", badInputs, outputs));
+  llvm::outs() << "leaked bytes: "
+               << refbackrt::getAllocatorStats().bytesLive - bytesLive
+               << "\n";
+
+  // The module can still be invoked.
+  // CHECK-NEXT: #0: [2.0, 4.0, 6.0]
+  // CHECK-NEXT: #1: [3.0, 5.0, 7.0]
+  auto results = exitOnError(jitModule->invoke("f", goodInputs));
+  printTensor("#0", results[0]);
+  printTensor("#1", results[1]);
+  return 0;
+}
@@ -0,0 +1,103 @@
+//===- huge-pages.cpp - Test of the huge page allocations -----------------===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+// RUN: env -u REFBACKRT_HUGE_PAGES npcomp-runtime-huge-pages-test 2>&1 \
+// RUN:   | FileCheck %s
+
+#include "TestUtils.h"
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+using namespace runtime_test;
+
+// Returns true if all the pages of [ptr, ptr + size) are mapped. `ptr` must
+// be page-aligned.
+static bool isMapped(void *ptr, std::size_t size) {
+#ifdef __linux__
+  std::vector<unsigned char> residency(size / 4096 + 1);
+  return mincore(ptr, size, residency.data()) == 0;
+#else
+  return true;
+#endif
+}
+
+static const char *getName(refbackrt::HugePages hugePages) {
+  switch (hugePages) {
+  case refbackrt::HugePages::None:
+    return "none";
+  case refbackrt::HugePages::Transparent:
+    return "transparent";
+  case refbackrt::HugePages::Explicit:
+    return "explicit";
+  }
+  return "unknown";
+}
+
+// Allocates buffers with the current huge pages setting, checks that they can
+// be used, and frees them.
+static void testAllocations() {
+  refbackrt::HugePages hugePages = refbackrt::getHugePages();
+  llvm::outs() << getName(hugePages) << ":";
+
+  // Not a multiple of the huge page size, which must still be mapped in
+  // full. With explicit huge pages, this falls back to other pages when the
+  // system has none reserved (or not enough).
+  std::size_t size = 3 * refbackrt::kHugePageSize + 1;
+  void *ptr = refbackrt::allocateHugePages(size);
+  if (!ptr) {
+    llvm::outs() << " allocation failed\n";
+    return;
+  }
+  bool aligned =
+      reinterpret_cast<std::uintptr_t>(ptr) % refbackrt::kHugePageSize == 0;
+  std::memset(ptr, 1, size);
+  bool mapped = isMapped(ptr, size);
+  refbackrt::deallocateHugePages(ptr, size);
+  llvm::outs() << " aligned " << aligned << ", mapped " << mapped
+               << ", unmapped after free " << !isMapped(ptr, size);
+
+  // Large buffers of the default allocator come from the same pages.
+  std::int64_t bytesLive = refbackrt::getAllocatorStats().bytesLive;
+  void *buffer = refbackrt::allocate(2 * refbackrt::kHugePageSize);
+  std::memset(buffer, 1, 2 * refbackrt::kHugePageSize);
+  bool bufferAligned =
+      reinterpret_cast<std::uintptr_t>(buffer) % refbackrt::kBufferAlignment ==
+      0;
+  refbackrt::deallocate(buffer);
+  llvm::outs() << ", buffer aligned " << bufferAligned << ", buffer freed "
+               << (refbackrt::getAllocatorStats().bytesLive == bytesLive)
+               << "\n";
+}
+
+int main() {
+  // CHECK: none: aligned 1, mapped 1, unmapped after free 1, buffer aligned 1, buffer freed 1
+  testAllocations();
+
+  // CHECK: transparent: aligned 1, mapped 1, unmapped after free 1, buffer aligned 1, buffer freed 1
+  refbackrt::setHugePages(refbackrt::HugePages::Transparent);
+  testAllocations();
+
+  // CHECK: explicit: aligned 1, mapped 1, unmapped after free 1, buffer aligned 1, buffer freed 1
+  refbackrt::setHugePages(refbackrt::HugePages::Explicit);
+  testAllocations();
+
+  // Empty buffers still take a page, and freeing null does nothing.
+  // CHECK: empty: 1
+  void *empty = refbackrt::allocateHugePages(0);
+  llvm::outs() << "empty: " << (empty != nullptr) << "\n";
+  refbackrt::deallocateHugePages(empty, 0);
+  refbackrt::deallocateHugePages(nullptr, 0);
+
+  refbackrt::setHugePages(refbackrt::HugePages::None);
+  return 0;
+}
@@ -0,0 +1,61 @@
+//===- invoke-batch.cpp - Test of batched invocation ----------------------===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+// RUN: npcomp-runtime-invoke-batch-test 2>&1 | FileCheck %s
+
+#include "TestUtils.h"
+
+using namespace runtime_test;
+
+static const char *kModuleSource = R"mlir(
+func @mul(%arg0: tensor<?xf32>, %arg1: tensor<?xf32>) -> (tensor<?xf32>, tensor<?xf32>) {
+  %0 = tcf.mul %arg0, %arg1 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  %1 = tcf.add %arg0, %arg1 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  return %0, %1 : tensor<?xf32>, tensor<?xf32>
+}
+)mlir";
+
+int main() {
+  auto jitModule = compileModule(kModuleSource);
+  refbackrt::RtValue a = createTensor({2}, {1.0, 2.0});
+  refbackrt::RtValue b = createTensor({2}, {3.0, 4.0});
+  refbackrt::RtValue c = createTensor({2}, {5.0, 6.0});
+  refbackrt::RtValue call0[] = {a, b};
+  refbackrt::RtValue call1[] = {b, c};
+  refbackrt::RtValue call2[] = {c, c};
+  auto mul = exitOnError(jitModule->prepare("mul", call0));
+
+  // Each call of the batch gets its own outputs, in order.
+  // CHECK:      #0 mul: [3.0, 8.0]
+  // CHECK-NEXT: #0 add: [4.0, 6.0]
+  // CHECK-NEXT: #1 mul: [15.0, 24.0]
+  // CHECK-NEXT: #1 add: [8.0, 10.0]
+  // CHECK-NEXT: #2 mul: [25.0, 36.0]
+  // CHECK-NEXT: #2 add: [10.0, 12.0]
+  llvm::ArrayRef<refbackrt::RtValue> batch[] = {call0, call1, call2};
+  auto results = exitOnError(mul.invokeBatch(batch));
+  for (size_t i = 0; i < results.size(); i++) {
+    printTensor("#" + std::to_string(i) + " mul", results[i][0]);
+    printTensor("#" + std::to_string(i) + " add", results[i][1]);
+  }
+
+  // An empty batch makes no call.
+  // CHECK: empty: 0
+  llvm::outs() << "empty: " << exitOnError(mul.invokeBatch({})).size()
+               << "\n";
+
+  // A call of the batch that doesn't match the prepared signature fails the
+  // whole batch, before any call is made.
+  // CHECK: error: invoking 'mul': input does not match the signature the call was prepared with (%arg1)
+  refbackrt::RtValue badCall[] = {a, createTensor({3}, {1.0, 2.0, 3.0})};
+  llvm::ArrayRef<refbackrt::RtValue> badBatch[] = {call0, badCall};
+  llvm::outs() << "error: "
+               << llvm::toString(mul.invokeBatch(badBatch).takeError())
+               << "\n";
+  return 0;
+}
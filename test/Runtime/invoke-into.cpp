@@ -0,0 +1,86 @@
+//===- invoke-into.cpp - Test of invokeInto with dynamic outputs ----------===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+// RUN: npcomp-runtime-invoke-into-test 2>&1 | FileCheck %s
+
+#include "TestUtils.h"
+
+using namespace runtime_test;
+
+static const char *kModuleSource = R"mlir(
+func @double(%arg0: tensor<?xf32>, %arg1: tensor<2xf32>) -> (tensor<?xf32>, tensor<2xf32>) {
+  %0 = tcf.add %arg0, %arg0 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  %1 = tcf.add %arg1, %arg1 : (tensor<2xf32>, tensor<2xf32>) -> tensor<2xf32>
+  return %0, %1 : tensor<?xf32>, tensor<2xf32>
+}
+)mlir";
+
+// Prints the kind of each of `outputs`.
+static void printOutputKinds(llvm::StringRef label,
+                             llvm::ArrayRef<refbackrt::RtValue> outputs) {
+  llvm::outs() << label << ":";
+  for (const refbackrt::RtValue &output : outputs)
+    llvm::outs() << (output.isNone() ? " none" : " tensor");
+  llvm::outs() << "\n";
+}
+
+int main() {
+  auto jitModule = compileModule(kModuleSource);
+  refbackrt::FunctionMetadata metadata =
+      exitOnError(jitModule->getMetadata("double"));
+
+  // The output with a dynamic extent is left as None, for invokeInto to fill
+  // in with the buffer allocated by the compiled code.
+  // CHECK: created: none tensor
+  llvm::SmallVector<refbackrt::RtValue, 2> outputs;
+  for (int i = 0; i < metadata.numOutputs; i++) {
+    outputs.push_back(
+        refbackrt::createRtValueFromOutputArgInfo(metadata.outputArgInfos[i]));
+  }
+  printOutputKinds("created", outputs);
+  refbackrt::Tensor *staticOutput = outputs[1].getTensor();
+
+  // CHECK-NEXT: #0: [2.0, 4.0, 6.0]
+  // CHECK-NEXT: #1: [8.0, 10.0]
+  // CHECK-NEXT: #1 written in place: 1
+  refbackrt::RtValue inputs[] = {createTensor({3}, {1.0, 2.0, 3.0}),
+                                 createTensor({2}, {4.0, 5.0})};
+  exitOnError(jitModule->invokeInto("double", inputs, outputs));
+  printTensor("#0", outputs[0]);
+  printTensor("#1", outputs[1]);
+  llvm::outs() << "#1 written in place: "
+               << (outputs[1].getTensor() == staticOutput) << "\n";
+
+  // Once filled in, the output has the extent of the first call, and is
+  // written into by later calls, which then need results of that extent.
+  // CHECK-NEXT: error: invoking 'double': result shape does not match the shape of the provided output buffer
+  refbackrt::RtValue longer[] = {createTensor({4}, {1.0, 1.0, 1.0, 1.0}),
+                                 createTensor({2}, {1.0, 1.0})};
+  llvm::Error error = jitModule->invokeInto("double", longer, outputs);
+  llvm::outs() << "error: " << llvm::toString(std::move(error)) << "\n";
+
+  // CHECK-NEXT: #0: [2.0, 2.0, 2.0, 2.0]
+  // CHECK-NEXT: #1: [2.0, 2.0]
+  outputs[0] = refbackrt::RtValue();
+  exitOnError(jitModule->invokeInto("double", longer, outputs));
+  printTensor("#0", outputs[0]);
+  printTensor("#1", outputs[1]);
+
+  // Prepared calls pin the dynamic extent, but their outputs are still only
+  // allocated by the compiled code.
+  // CHECK-NEXT: prepared: none tensor
+  // CHECK-NEXT: prepared #0: [2.0, 4.0, 6.0]
+  // CHECK-NEXT: prepared #1: [8.0, 10.0]
+  auto call = exitOnError(jitModule->prepare("double", inputs));
+  auto preparedOutputs = call.createOutputs();
+  printOutputKinds("prepared", preparedOutputs);
+  exitOnError(call.invokeInto(inputs, preparedOutputs));
+  printTensor("prepared #0", preparedOutputs[0]);
+  printTensor("prepared #1", preparedOutputs[1]);
+  return 0;
+}
@@ -0,0 +1,108 @@
+//===- numa.cpp - Test of the NUMA placement ------------------------------===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+// RUN: env -u REFBACKRT_PIN_THREADS npcomp-runtime-numa-test 2>&1 \
+// RUN:   | FileCheck %s
+
+#include "TestUtils.h"
+
+#include <cstring>
+
+using namespace runtime_test;
+
+static const char *kModuleSource = R"mlir(
+func @double(%arg0: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = tcf.add %arg0, %arg0 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  return %0 : tensor<?xf32>
+}
+)mlir";
+
+static const char *getName(refbackrt::ThreadPinning pinning) {
+  switch (pinning) {
+  case refbackrt::ThreadPinning::None:
+    return "none";
+  case refbackrt::ThreadPinning::Compact:
+    return "compact";
+  case refbackrt::ThreadPinning::Scatter:
+    return "scatter";
+  }
+  return "unknown";
+}
+
+// Runs a function large enough to be split over the thread pool, and prints
+// whether its result is right.
+static void testParallelCall(refback::JITModule &jitModule) {
+  constexpr int kSize = 1 << 20;
+  std::vector<float> elements(kSize);
+  for (int i = 0; i < kSize; i++)
+    elements[i] = i % 7;
+  refbackrt::RtValue inputs[] = {createTensor({kSize}, elements)};
+  auto outputs = exitOnError(jitModule.invoke("double", inputs));
+  const float *data = outputs[0].getTensor()->getData<float>();
+  int wrong = 0;
+  for (int i = 0; i < kSize; i++)
+    wrong += data[i] != 2 * (i % 7);
+  llvm::outs() << getName(refbackrt::getThreadPinning()) << ": " << wrong
+               << " wrong\n";
+}
+
+int main() {
+  // CHECK: nodes: ok
+  int numNodes = refbackrt::getNumNumaNodes();
+  llvm::outs() << "nodes: " << (numNodes >= 1 ? "ok" : "none") << "\n";
+
+  // Pinning restarts the thread pool, whose workers then run compiled code
+  // as before, on machines with and without a NUMA topology.
+  // CHECK-NEXT: none: 0 wrong
+  // CHECK-NEXT: compact: 0 wrong
+  // CHECK-NEXT: scatter: 0 wrong
+  // CHECK-NEXT: none: 0 wrong
+  auto jitModule = compileModule(kModuleSource);
+  refbackrt::setNumThreads(4);
+  testParallelCall(*jitModule);
+  refbackrt::setThreadPinning(refbackrt::ThreadPinning::Compact);
+  testParallelCall(*jitModule);
+  refbackrt::setThreadPinning(refbackrt::ThreadPinning::Scatter);
+  testParallelCall(*jitModule);
+  refbackrt::setThreadPinning(refbackrt::ThreadPinning::None);
+  testParallelCall(*jitModule);
+
+  // Binding pages fails without NUMA support (or a single node), and the
+  // contents of the buffer are kept either way.
+  // CHECK-NEXT: local: consistent, contents kept
+  // CHECK-NEXT: interleave: consistent, contents kept
+  std::size_t size = 1 << 20;
+  void *buffer = refbackrt::allocate(size);
+  std::memset(buffer, 3, size);
+  for (auto policy : {refbackrt::NumaMemoryPolicy::Local,
+                      refbackrt::NumaMemoryPolicy::Interleave}) {
+    bool bound = refbackrt::succeeded(
+        refbackrt::setNumaMemoryPolicy(buffer, size, policy));
+    bool kept = true;
+    for (std::size_t i = 0; i < size; i++)
+      kept &= static_cast<unsigned char *>(buffer)[i] == 3;
+    llvm::outs() << (policy == refbackrt::NumaMemoryPolicy::Local
+                         ? "local"
+                         : "interleave")
+                 << ": "
+                 << (numNodes >= 2 || !bound ? "consistent" : "inconsistent")
+                 << ", contents " << (kept ? "kept" : "lost") << "\n";
+  }
+  refbackrt::deallocate(buffer);
+
+  // Buffers smaller than a page have no page entirely within them, which
+  // succeeds trivially on NUMA machines.
+  // CHECK-NEXT: small: consistent
+  char small[16];
+  bool bound = refbackrt::succeeded(refbackrt::setNumaMemoryPolicy(
+      small, sizeof(small), refbackrt::NumaMemoryPolicy::Interleave));
+  llvm::outs() << "small: "
+               << (bound == (numNodes >= 2) ? "consistent" : "inconsistent")
+               << "\n";
+  return 0;
+}
@@ -0,0 +1,70 @@
+//===- prepared-call.cpp - Test of PreparedCall ---------------------------===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+// RUN: npcomp-runtime-prepared-call-test 2>&1 | FileCheck %s
+
+#include "TestUtils.h"
+
+using namespace runtime_test;
+
+static const char *kModuleSource = R"mlir(
+func @add(%arg0: tensor<2xf32>, %arg1: tensor<?xf32>) -> (tensor<2xf32>, tensor<?xf32>) {
+  %0 = tcf.add %arg0, %arg0 : (tensor<2xf32>, tensor<2xf32>) -> tensor<2xf32>
+  %1 = tcf.add %arg1, %arg1 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  return %0, %1 : tensor<2xf32>, tensor<?xf32>
+}
+)mlir";
+
+int main() {
+  auto jitModule = compileModule(kModuleSource);
+  refbackrt::RtValue x = createTensor({2}, {1.0, 2.0});
+  refbackrt::RtValue y = createTensor({3}, {3.0, 4.0, 5.0});
+  refbackrt::RtValue inputs[] = {x, y};
+  auto call = exitOnError(jitModule->prepare("add", inputs));
+
+  // CHECK: name: add
+  llvm::outs() << "name: " << call.getFunctionName() << "\n";
+
+  // Calls with the inputs of the prepared signature run, as often as needed.
+  // CHECK:      first #0: [2.0, 4.0]
+  // CHECK-NEXT: first #1: [6.0, 8.0, 10.0]
+  // CHECK-NEXT: second #0: [4.0, 8.0]
+  auto first = exitOnError(call.invoke(inputs));
+  printTensor("first #0", first[0]);
+  printTensor("first #1", first[1]);
+  refbackrt::RtValue doubled[] = {first[0], y};
+  auto second = exitOnError(call.invoke(doubled));
+  printTensor("second #0", second[0]);
+
+  // The dynamic extent of %arg1 is pinned to that of the example input.
+  // CHECK: error: invoking 'add': input does not match the signature the call was prepared with (%arg1)
+  refbackrt::RtValue otherShape[] = {x, createTensor({2}, {3.0, 4.0})};
+  llvm::outs() << "error: "
+               << llvm::toString(call.invoke(otherShape).takeError()) << "\n";
+
+  // CHECK: error: invoking 'add': expected 2 inputs
+  llvm::outs() << "error: "
+               << llvm::toString(
+                      call.invoke(llvm::makeArrayRef(inputs, 1)).takeError())
+               << "\n";
+
+  // Preparing fails on inputs that the function doesn't accept.
+  // CHECK: error: invoking 'add': input shape mismatch (%arg0)
+  refbackrt::RtValue badInputs[] = {y, y};
+  llvm::outs() << "error: "
+               << llvm::toString(
+                      jitModule->prepare("add", badInputs).takeError())
+               << "\n";
+
+  // CHECK: error: unknown function: missing
+  llvm::outs() << "error: "
+               << llvm::toString(
+                      jitModule->prepare("missing", inputs).takeError())
+               << "\n";
+  return 0;
+}
@@ -0,0 +1,188 @@
+//===- request-scheduler.cpp - Test of the order of async calls -----------===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+// RUN: npcomp-runtime-request-scheduler-test 2>&1 | FileCheck %s
+
+#include "TestUtils.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+using namespace runtime_test;
+
+static const char *kModuleSource = R"mlir(
+func @double(%arg0: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = tcf.add %arg0, %arg0 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  return %0 : tensor<?xf32>
+}
+)mlir";
+
+// The number of elements of the inputs of the calls that occupy the threads
+// of the scheduler. The other calls have sizes further apart than any padding
+// of the allocations, which tell their output buffers apart.
+constexpr std::int64_t kBlockerSize = 1000;
+constexpr std::int64_t kSizeSpacing = 100;
+
+// An allocator that holds the threads of the scheduler in the allocations of
+// the output buffers of the calls, and lets them go one at a time, so that
+// the calls start in a deterministic order.
+class GatingAllocator : public refbackrt::Allocator {
+public:
+  void *allocate(std::size_t size) override {
+    if (std::this_thread::get_id() != mainThread &&
+        size >= kBlockerSize * sizeof(float)) {
+      std::unique_lock<std::mutex> lock(mutex);
+      started.push_back(size);
+      numHeld++;
+      changed.notify_all();
+      changed.wait(lock, [&] { return released || numPermits > 0; });
+      if (!released)
+        numPermits--;
+      numHeld--;
+    }
+    return refbackrt::getDefaultAllocator()->allocate(size);
+  }
+  void deallocate(void *ptr) override {
+    refbackrt::getDefaultAllocator()->deallocate(ptr);
+  }
+
+  // Waits until `n` threads are held.
+  void waitForHeld(unsigned n) {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [&] { return numHeld == n && numPermits == 0; });
+  }
+
+  // Lets one held thread go.
+  void releaseOne() {
+    std::lock_guard<std::mutex> lock(mutex);
+    numPermits++;
+    changed.notify_all();
+  }
+
+  // Stops holding threads.
+  void releaseAll() {
+    std::lock_guard<std::mutex> lock(mutex);
+    released = true;
+    changed.notify_all();
+  }
+
+  std::size_t getLastStarted() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return started.back();
+  }
+
+private:
+  std::thread::id mainThread = std::this_thread::get_id();
+  std::mutex mutex;
+  std::condition_variable changed;
+  // The sizes of the output buffers of the calls that started.
+  std::vector<std::size_t> started;
+  unsigned numHeld = 0;
+  unsigned numPermits = 0;
+  bool released = false;
+};
+
+static refbackrt::RequestSchedule
+getSchedule(refbackrt::Priority priority,
+            std::chrono::steady_clock::duration timeout =
+                std::chrono::steady_clock::duration::zero()) {
+  refbackrt::RequestSchedule schedule;
+  schedule.priority = priority;
+  if (timeout != std::chrono::steady_clock::duration::zero())
+    schedule.deadlineNanos =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            (std::chrono::steady_clock::now() + timeout).time_since_epoch())
+            .count();
+  return schedule;
+}
+
+int main() {
+  auto jitModule = compileModule(kModuleSource);
+  GatingAllocator allocator;
+  refbackrt::setAllocator(&allocator);
+  auto createInput = [](std::int64_t size) {
+    return createTensor({size}, std::vector<float>(size, 1.0));
+  };
+
+  // Occupy all the threads of the scheduler.
+  using Future = std::future<refback::AsyncCallResult>;
+  std::vector<Future> blockers;
+  unsigned numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+  for (unsigned i = 0; i < numThreads; i++) {
+    refbackrt::RtValue inputs[] = {createInput(kBlockerSize)};
+    blockers.push_back(jitModule->invokeAsync("double", inputs));
+  }
+  allocator.waitForHeld(numThreads);
+
+  // Queue calls in the reverse of the order in which they should start.
+  using refbackrt::Priority;
+  struct Call {
+    const char *name;
+    std::int64_t size;
+    refbackrt::RequestSchedule schedule;
+    Future future;
+  };
+  std::vector<Call> calls;
+  auto submit = [&](const char *name, std::int64_t size,
+                    refbackrt::RequestSchedule schedule) {
+    refbackrt::RtValue inputs[] = {createInput(size)};
+    calls.push_back({name, size, schedule,
+                     jitModule->invokeAsync("double", inputs, schedule)});
+  };
+  submit("low", kBlockerSize + kSizeSpacing, getSchedule(Priority::Low));
+  submit("normal", kBlockerSize + 2 * kSizeSpacing,
+         getSchedule(Priority::Normal));
+  submit("normal later", kBlockerSize + 3 * kSizeSpacing,
+         getSchedule(Priority::Normal));
+  submit("normal with deadline", kBlockerSize + 4 * kSizeSpacing,
+         getSchedule(Priority::Normal, std::chrono::hours(1)));
+  submit("high", kBlockerSize + 5 * kSizeSpacing,
+         getSchedule(Priority::High));
+  submit("high expiring", kBlockerSize + 6 * kSizeSpacing,
+         getSchedule(Priority::High, std::chrono::milliseconds(1)));
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  // Each released thread starts the next pending call, which is then held in
+  // turn. The expired call fails without running, so the thread moves on to
+  // the following one.
+  // CHECK:      started: high
+  // CHECK-NEXT: started: normal with deadline
+  // CHECK-NEXT: started: normal
+  // CHECK-NEXT: started: normal later
+  // CHECK-NEXT: started: low
+  for (int i = 0; i < 5; i++) {
+    allocator.releaseOne();
+    allocator.waitForHeld(numThreads);
+    std::size_t bytes = allocator.getLastStarted();
+    for (Call &call : calls) {
+      if (bytes >= call.size * sizeof(float) &&
+          bytes < (call.size + kSizeSpacing) * sizeof(float))
+        llvm::outs() << "started: " << call.name << "\n";
+    }
+  }
+  allocator.releaseAll();
+
+  // CHECK-NEXT: low: ok
+  // CHECK-NEXT: normal: ok
+  // CHECK-NEXT: normal later: ok
+  // CHECK-NEXT: normal with deadline: ok
+  // CHECK-NEXT: high: ok
+  // CHECK-NEXT: high expiring: invoking 'double': deadline exceeded
+  for (Call &call : calls) {
+    refback::AsyncCallResult result = call.future.get();
+    llvm::outs() << call.name << ": "
+                 << (result ? "ok" : llvm::toString(result.takeError()))
+                 << "\n";
+  }
+  for (Future &blocker : blockers)
+    exitOnError(blocker.get().takeError());
+  refbackrt::setAllocator(nullptr);
+  return 0;
+}
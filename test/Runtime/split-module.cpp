@@ -0,0 +1,104 @@
+//===- split-module.cpp - Test of the concurrent compilation of modules ---===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+// RUN: rm -rf %t
+// RUN: npcomp-runtime-split-module-test %t 2>&1 | FileCheck %s
+
+#include "TestUtils.h"
+
+#include "llvm/Support/FileSystem.h"
+
+#include <string>
+
+using namespace runtime_test;
+
+// The number of functions of the module, which is large enough to be split
+// into several parts (one per compile thread, up to one per 20000 LLVM
+// instructions).
+constexpr int kNumFunctions = 256;
+constexpr unsigned kCompileThreads = 4;
+
+// Returns the number of additions of function `i`, which returns its input
+// times that number plus one.
+static int getNumAdds(int i) { return 4 + i % 5; }
+
+static std::string getModuleSource() {
+  std::string source;
+  llvm::raw_string_ostream os(source);
+  for (int i = 0; i < kNumFunctions; i++) {
+    os << "func @f" << i << "(%arg0: tensor<?xf32>) -> tensor<?xf32> {\n";
+    std::string previous = "%arg0";
+    for (int j = 0; j < getNumAdds(i); j++) {
+      os << "  %" << j << " = tcf.add " << previous << ", %arg0 : "
+         << "(tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>\n";
+      previous = "%" + std::to_string(j);
+    }
+    os << "  return " << previous << " : tensor<?xf32>\n}\n";
+  }
+  return os.str();
+}
+
+// Calls every function of `jitModule`, and prints the number of wrong
+// results.
+static void testFunctions(refback::JITModule &jitModule,
+                          llvm::StringRef label) {
+  int wrong = 0;
+  refbackrt::RtValue inputs[] = {createTensor({3}, {1.0, 2.0, 3.0})};
+  for (int i = 0; i < kNumFunctions; i++) {
+    auto outputs =
+        exitOnError(jitModule.invoke("f" + std::to_string(i), inputs));
+    const float *data = outputs[0].getTensor()->getData<float>();
+    for (int j = 0; j < 3; j++)
+      wrong += data[j] != (j + 1) * (getNumAdds(i) + 1);
+  }
+  llvm::outs() << label << ": " << wrong << " wrong\n";
+}
+
+// Prints the number of parts of the module whose object code is in the
+// object cache `directory`.
+static void printCachedParts(llvm::StringRef directory) {
+  int numParts = 0;
+  std::error_code error;
+  for (llvm::sys::fs::directory_iterator it(directory, error), end;
+       it != end && !error; it.increment(error)) {
+    if (llvm::StringRef(it->path()).contains("-of-"))
+      numParts++;
+  }
+  llvm::outs() << "cached parts: " << numParts << "\n";
+}
+
+int main(int argc, char **argv) {
+  std::string source = getModuleSource();
+  refback::JITCompileOptions compileOptions;
+  compileOptions.compileThreads = kCompileThreads;
+
+  // The parts of the module are compiled concurrently, and linked back
+  // together: functions of all parts can be called.
+  // CHECK:      compiled: 0 wrong
+  // CHECK-NEXT: cached parts: [[PARTS:[2-4]]]
+  testFunctions(*compileModule(source, /*optimize=*/false, argv[1],
+                               compileOptions),
+                "compiled");
+  printCachedParts(argv[1]);
+
+  // The object code of each part is then loaded from the cache.
+  // CHECK-NEXT: cached: 0 wrong
+  // CHECK-NEXT: cached parts: [[PARTS]]
+  testFunctions(*compileModule(source, /*optimize=*/false, argv[1],
+                               compileOptions),
+                "cached");
+  printCachedParts(argv[1]);
+
+  // With a single compile thread, the module is compiled whole.
+  // CHECK-NEXT: single thread: 0 wrong
+  compileOptions.compileThreads = 1;
+  testFunctions(*compileModule(source, /*optimize=*/false,
+                               /*objectCacheDir=*/"", compileOptions),
+                "single thread");
+  return 0;
+}
@@ -0,0 +1,175 @@
+//===- streaming.cpp - Test of streamMap and streamReduce -----------------===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+// RUN: rm -rf %t && mkdir -p %t
+// RUN: npcomp-runtime-streaming-test %t 2>&1 | FileCheck %s
+
+#include "TestUtils.h"
+
+#include <cstdio>
+#include <string>
+
+using namespace runtime_test;
+
+static const char *kModuleSource = R"mlir(
+func @double(%arg0: tensor<?x2xf32>) -> tensor<?x2xf32> {
+  %0 = tcf.add %arg0, %arg0 : (tensor<?x2xf32>, tensor<?x2xf32>) -> tensor<?x2xf32>
+  return %0 : tensor<?x2xf32>
+}
+func @identity(%arg0: tensor<?x2xf32>) -> tensor<?x2xf32> {
+  return %arg0 : tensor<?x2xf32>
+}
+func @sum(%arg0: tensor<1x2xf32>, %arg1: tensor<?x2xf32>) -> tensor<1x2xf32> {
+  %0 = tcf.reduce_sum %arg1 {dim = 0 : i64} : (tensor<?x2xf32>) -> tensor<1x2xf32>
+  %1 = tcf.add %arg0, %0 : (tensor<1x2xf32>, tensor<1x2xf32>) -> tensor<1x2xf32>
+  return %1 : tensor<1x2xf32>
+}
+func @last(%arg0: tensor<?x2xf32>, %arg1: tensor<?x2xf32>) -> tensor<?x2xf32> {
+  return %arg1 : tensor<?x2xf32>
+}
+)mlir";
+
+static void writeFile(const std::string &path, std::vector<float> elements) {
+  FILE *file = std::fopen(path.c_str(), "wb");
+  std::fwrite(elements.data(), sizeof(float), elements.size(), file);
+  std::fclose(file);
+}
+
+// Prints the f32 elements of the file at `path`.
+static void printFile(llvm::StringRef label, const std::string &path) {
+  llvm::outs() << label << ": [";
+  FILE *file = std::fopen(path.c_str(), "rb");
+  float element;
+  for (int i = 0; std::fread(&element, sizeof(float), 1, file) == 1; i++)
+    llvm::outs() << (i ? ", " : "") << llvm::format("%.1f", element);
+  std::fclose(file);
+  llvm::outs() << "]\n";
+}
+
+// Returns a file tensor of `rows` rows of 2 f32 elements. `path` must outlive
+// it.
+static refbackrt::FileTensor fileTensor(const std::string &path,
+                                        std::int64_t rows) {
+  refbackrt::FileTensor tensor;
+  tensor.path = path.c_str();
+  std::int64_t extents[] = {rows, 2};
+  tensor.extents = refbackrt::ArrayRef<std::int64_t>(extents, 2);
+  return tensor;
+}
+
+static refbackrt::ArrayRef<refbackrt::FileTensor>
+one(const refbackrt::FileTensor &tensor) {
+  return refbackrt::ArrayRef<refbackrt::FileTensor>(&tensor, 1);
+}
+
+static void printResult(llvm::StringRef label, refbackrt::LogicalResult result,
+                        const char *errorMessage) {
+  llvm::outs() << label << ": "
+               << (succeeded(result) ? "ok" : std::string("error: ") +
+                                                  errorMessage)
+               << "\n";
+}
+
+int main(int argc, char **argv) {
+  std::string dir = argv[1];
+  auto jitModule = compileModule(kModuleSource);
+  auto lookup = [&](llvm::StringRef name) {
+    return exitOnError(jitModule->lookup(name));
+  };
+  const refbackrt::ArrayRef<refbackrt::RtValue> kNone(nullptr, 0);
+  refbackrt::RtValue accumulators[1];
+  refbackrt::MutableArrayRef<refbackrt::RtValue> accumulatorsRef(accumulators,
+                                                                 1);
+  const char *errorMessage = nullptr;
+  refbackrt::LogicalResult result = refbackrt::success();
+
+  // 5 rows in chunks of 2, so the last chunk is partial.
+  std::string inputPath = dir + "/input";
+  writeFile(inputPath, {1, 2, 3, 4, 5, 6, 7, 8, 9, 10});
+  refbackrt::FileTensor input = fileTensor(inputPath, 5);
+  refbackrt::StreamOptions options;
+  options.chunkRows = 2;
+
+  // A preexisting output file is truncated after the output.
+  // CHECK:      double: ok
+  // CHECK-NEXT: doubled: [2.0, 4.0, 6.0, 8.0, 10.0, 12.0, 14.0, 16.0, 18.0, 20.0]
+  std::string outputPath = dir + "/doubled";
+  writeFile(outputPath, std::vector<float>(16, -1));
+  refbackrt::FileTensor output = fileTensor(outputPath, 5);
+  result = refbackrt::streamMap(lookup("double"), one(input), kNone,
+                                one(output), options, &errorMessage);
+  printResult("double", result, errorMessage);
+  printFile("doubled", outputPath);
+
+  // Results viewing the input buffers are written before they are reused.
+  // CHECK:      identity: ok
+  // CHECK-NEXT: copied: [1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 8.0, 9.0, 10.0]
+  std::string copyPath = dir + "/copied";
+  refbackrt::FileTensor copy = fileTensor(copyPath, 5);
+  result = refbackrt::streamMap(lookup("identity"), one(input), kNone,
+                                one(copy), options, &errorMessage);
+  printResult("identity", result, errorMessage);
+  printFile("copied", copyPath);
+
+  // An input can be updated in place.
+  // CHECK:      in place: ok
+  // CHECK-NEXT: updated: [2.0, 4.0, 6.0, 8.0, 10.0, 12.0, 14.0, 16.0, 18.0, 20.0]
+  std::string inPlacePath = dir + "/in-place";
+  writeFile(inPlacePath, {1, 2, 3, 4, 5, 6, 7, 8, 9, 10});
+  refbackrt::FileTensor inPlace = fileTensor(inPlacePath, 5);
+  result = refbackrt::streamMap(lookup("double"), one(inPlace), kNone,
+                                one(inPlace), options, &errorMessage);
+  printResult("in place", result, errorMessage);
+  printFile("updated", inPlacePath);
+
+  // CHECK:      sum: ok
+  // CHECK-NEXT: sum: [25.0, 30.0]
+  accumulators[0] = createTensor({1, 2}, {0, 0});
+  result = refbackrt::streamReduce(lookup("sum"), one(input), kNone,
+                                   accumulatorsRef, options, &errorMessage);
+  printResult("sum", result, errorMessage);
+  printTensor("sum", accumulators[0]);
+
+  // An accumulator viewing the input buffers is copied out of them.
+  // CHECK:      last: ok
+  // CHECK-NEXT: last: [9.0, 10.0]
+  accumulators[0] = createTensor({1, 2}, {0, 0});
+  result = refbackrt::streamReduce(lookup("last"), one(input), kNone,
+                                   accumulatorsRef, options, &errorMessage);
+  printResult("last", result, errorMessage);
+  printTensor("last", accumulators[0]);
+
+  // CHECK: missing input: error: could not open {{.*}}/missing: No such file or directory
+  std::string missingPath = dir + "/missing";
+  refbackrt::FileTensor missing = fileTensor(missingPath, 5);
+  result = refbackrt::streamMap(lookup("double"), one(missing), kNone,
+                                one(output), options, &errorMessage);
+  printResult("missing input", result, errorMessage);
+
+  // The file has 5 rows, so the last chunk can't be read in full.
+  // CHECK: short input: error: could not read {{.*}}/input: unexpected end of file
+  refbackrt::FileTensor shortInput = fileTensor(inputPath, 6);
+  refbackrt::FileTensor longOutput = fileTensor(outputPath, 6);
+  result = refbackrt::streamMap(lookup("double"), one(shortInput), kNone,
+                                one(longOutput), options, &errorMessage);
+  printResult("short input", result, errorMessage);
+
+  // CHECK: bad output: error: could not open {{.*}}/no-such-dir/output: No such file or directory
+  std::string badOutputPath = dir + "/no-such-dir/output";
+  refbackrt::FileTensor badOutput = fileTensor(badOutputPath, 5);
+  result = refbackrt::streamMap(lookup("double"), one(input), kNone,
+                                one(badOutput), options, &errorMessage);
+  printResult("bad output", result, errorMessage);
+
+  // CHECK: short reduce: error: could not read {{.*}}/input: unexpected end of file
+  accumulators[0] = createTensor({1, 2}, {0, 0});
+  result = refbackrt::streamReduce(lookup("sum"), one(shortInput), kNone,
+                                   accumulatorsRef, options, &errorMessage);
+  printResult("short reduce", result, errorMessage);
+  return 0;
+}
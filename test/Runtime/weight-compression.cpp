@@ -0,0 +1,130 @@
+//===- weight-compression.cpp - Test of the codec of compressed weights ---===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+// RUN: npcomp-runtime-weight-compression-test 2>&1 | FileCheck %s
+
+#include "npcomp/RefBackend/Runtime/WeightCompression.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstring>
+#include <random>
+#include <string>
+
+// Compresses `data`, and prints the number of blocks and whether it
+// decompresses back to `data`.
+static void testRoundTrip(llvm::StringRef label, const std::vector<char> &data,
+                          std::size_t elementBytes) {
+  std::vector<char> compressed;
+  refbackrt::compressWeights(data.data(), data.size(), elementBytes,
+                             compressed);
+  std::vector<char> decompressed(data.size());
+  std::vector<refbackrt::CompressedWeightsBlock> blocks;
+  bool ok = refbackrt::getCompressedWeightsBlocks(
+      compressed.data(), compressed.size(), decompressed.data(),
+      decompressed.size(), blocks);
+  for (const refbackrt::CompressedWeightsBlock &block : blocks)
+    ok &= refbackrt::decompressWeightsBlock(block);
+  ok &= decompressed == data;
+  llvm::outs() << label << ": " << blocks.size() << " blocks, "
+               << (ok ? "ok" : "wrong") << ", "
+               << (compressed.size() < data.size() ? "smaller" : "not smaller")
+               << "\n";
+}
+
+// Returns `numElements` floats, each repeated `runLength` times in a row,
+// as bytes.
+static std::vector<char> getFloats(std::size_t numElements,
+                                   std::size_t runLength) {
+  std::vector<float> elements(numElements);
+  for (std::size_t i = 0; i < numElements; i++)
+    elements[i] = static_cast<float>(i / runLength) * 0.25f;
+  std::vector<char> bytes(numElements * sizeof(float));
+  std::memcpy(bytes.data(), elements.data(), bytes.size());
+  return bytes;
+}
+
+static std::vector<char> getRandomBytes(std::size_t size) {
+  std::mt19937 generator(42);
+  std::vector<char> bytes(size);
+  for (char &byte : bytes)
+    byte = static_cast<char>(generator());
+  return bytes;
+}
+
+int main() {
+  constexpr std::size_t kBlock = refbackrt::kWeightBlockSize;
+
+  // Runs of any length (including those longer than one run-length code),
+  // and literals between them, round-trip in each byte plane.
+  // CHECK:      empty: 0 blocks, ok, not smaller
+  // CHECK-NEXT: runs: 1 blocks, ok, smaller
+  // CHECK-NEXT: short runs: 1 blocks, ok, smaller
+  // CHECK-NEXT: literals: 1 blocks, ok, smaller
+  // CHECK-NEXT: random: 1 blocks, ok, not smaller
+  // CHECK-NEXT: zeros: 1 blocks, ok, smaller
+  testRoundTrip("empty", {}, 4);
+  testRoundTrip("runs", getFloats(10000, 1000), 4);
+  testRoundTrip("short runs", getFloats(10000, 2), 4);
+  std::vector<char> literals;
+  for (int i = 0; i < 10; i++) {
+    std::vector<char> random = getRandomBytes(300);
+    literals.insert(literals.end(), random.begin(), random.end());
+    literals.resize(literals.size() + 1000);
+  }
+  testRoundTrip("literals", literals, 1);
+  testRoundTrip("random", getRandomBytes(10000), 4);
+  testRoundTrip("zeros", std::vector<char>(10000), 4);
+
+  // Weights larger than a block are split into blocks, the last of which
+  // is partial.
+  // CHECK-NEXT: one block: 1 blocks, ok, smaller
+  // CHECK-NEXT: multiple blocks: 4 blocks, ok, smaller
+  // CHECK-NEXT: random multiple blocks: 3 blocks, ok, not smaller
+  testRoundTrip("one block", getFloats(kBlock / 4, 300), 4);
+  testRoundTrip("multiple blocks", getFloats(kBlock * 7 / 8, 300), 4);
+  testRoundTrip("random multiple blocks", getRandomBytes(kBlock * 5 / 2), 4);
+
+  // Sizes that aren't a multiple of the element size are compressed as
+  // bytes. Elements of other sizes are split into as many planes, and floats
+  // compressed as bytes have no runs but the zeros.
+  // CHECK-NEXT: odd size: 1 blocks, ok, smaller
+  // CHECK-NEXT: bytes: 2 blocks, ok, not smaller
+  // CHECK-NEXT: doubles: 2 blocks, ok, smaller
+  std::vector<char> oddSize = getFloats(10000, 1000);
+  oddSize.pop_back();
+  testRoundTrip("odd size", oddSize, 4);
+  testRoundTrip("bytes", getFloats(kBlock / 2, 1000), 1);
+  testRoundTrip("doubles", getFloats(kBlock / 2, 1000), 8);
+
+  // Malformed data fails to decompress.
+  // CHECK-NEXT: truncated: rejected
+  // CHECK-NEXT: wrong size: rejected
+  // CHECK-NEXT: bad encoding: rejected
+  std::vector<char> data = getFloats(10000, 1000);
+  std::vector<char> compressed;
+  refbackrt::compressWeights(data.data(), data.size(), 4, compressed);
+  std::vector<char> output(data.size());
+  auto decompress = [&](llvm::StringRef label, const std::vector<char> &input,
+                        std::size_t size) {
+    std::vector<refbackrt::CompressedWeightsBlock> blocks;
+    bool ok = refbackrt::getCompressedWeightsBlocks(
+        input.data(), input.size(), output.data(), size, blocks);
+    for (const refbackrt::CompressedWeightsBlock &block : blocks)
+      ok = ok && refbackrt::decompressWeightsBlock(block);
+    llvm::outs() << label << ": " << (ok ? "accepted" : "rejected") << "\n";
+  };
+  decompress("truncated",
+             std::vector<char>(compressed.begin(), compressed.end() - 1),
+             data.size());
+  decompress("wrong size", compressed, data.size() - 4);
+  // The encoding of the first plane follows the 9-byte block header.
+  std::vector<char> badEncoding = compressed;
+  badEncoding[9] = 7;
+  decompress("bad encoding", badEncoding, data.size());
+  return 0;
+}
@@ -67,9 +67,24 @@ tool_dirs = [
     config.llvm_tools_dir,
 ]
 tools = [
+    'npcomp-compile',
+    'npcomp-compile-bench',
     'npcomp-opt',
     'npcomp-run-mlir',
+    'npcomp-serve-bench',
     'npcomp-capi-ir-test',
+    'npcomp-capi-runtime-test',
+    'npcomp-runtime-check-failure-test',
+    'npcomp-runtime-concurrent-invoke-test',
+    'npcomp-runtime-huge-pages-test',
+    'npcomp-runtime-invoke-batch-test',
+    'npcomp-runtime-invoke-into-test',
+    'npcomp-runtime-numa-test',
+    'npcomp-runtime-prepared-call-test',
+    'npcomp-runtime-request-scheduler-test',
+    'npcomp-runtime-split-module-test',
+    'npcomp-runtime-streaming-test',
+    'npcomp-runtime-weight-compression-test',
     ToolSubst('%npcomp_runtime_shlib', config.npcomp_runtime_shlib),
 ]
 
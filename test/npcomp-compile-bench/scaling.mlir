@@ -0,0 +1,24 @@
+// The modules are generated, so this file only holds the RUN lines.
+
+// RUN: npcomp-compile-bench -workload=mlp -sizes=1,2 | FileCheck %s
+// RUN: npcomp-compile-bench -workload=object-graph -sizes=1,2 \
+// RUN:   | FileCheck %s --check-prefix=OBJECT-GRAPH
+// RUN: npcomp-compile-bench -workload=cpa -sizes=2,4 -format=json \
+// RUN:   | FileCheck %s --check-prefix=JSON
+
+// CHECK:       mlp, size 1
+// CHECK:       Total pass time:
+// CHECK:       Time (ms)  Heap growth (KiB)   Runs  Name
+// CHECK:       convert-tcf-to-tcp
+// CHECK:       mlp, size 2
+// CHECK:       mlp, scaling from size 1 to 2
+// CHECK:       Exponent  First (ms)   Last (ms)  Name
+
+// OBJECT-GRAPH: object-graph, size 2
+// OBJECT-GRAPH: torch-globalize-object-graph
+
+// JSON:        "workload": "cpa",
+// JSON:        "size": 2,
+// JSON:        "name": "npcomp-cpa-type-inference",
+// JSON:        "size": 4,
+// JSON:        "scaling": [
@@ -0,0 +1,27 @@
+// RUN: npcomp-compile %s -o %t.so
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke add \
+// RUN:   -arg-value="dense<[1.0, 2.0]> : tensor<2xf32>" \
+// RUN:   -arg-value="dense<[3.0, 4.0]> : tensor<2xf32>" \
+// RUN:   -compiled-module=%t.so 2>&1 \
+// RUN:   | FileCheck %s
+
+// Failed checks of the compiled code are reported through the runtime that
+// loaded it.
+// RUN: not npcomp-run-mlir %s \
+// RUN:   -invoke add \
+// RUN:   -arg-value="dense<[1.0, 2.0]> : tensor<2xf32>" \
+// RUN:   -arg-value="dense<[3.0, 4.0, 5.0]> : tensor<3xf32>" \
+// RUN:   -compiled-module=%t.so 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=ABORT
+
+// An object file is emitted for other extensions.
+// RUN: npcomp-compile %s -o %t.o
+// RUN: ls %t.o
+
+// CHECK: output #0: dense<[4.000000e+00, 6.000000e+00]> : tensor<2xf32>
+// ABORT: Error: invoking 'add': required broadcastable shapes
+func @add(%arg0: tensor<?xf32>, %arg1: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = tcf.add %arg0, %arg1 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  return %0 : tensor<?xf32>
+}
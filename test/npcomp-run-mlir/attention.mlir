@@ -0,0 +1,25 @@
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke attention \
+// RUN:   -arg-value="dense<1.0> : tensor<1x2x1xf32>" \
+// RUN:   -arg-value="dense<0.0> : tensor<1x3x1xf32>" \
+// RUN:   -arg-value="dense<[[[1.0], [2.0], [6.0]]]> : tensor<1x3x1xf32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s
+
+// The 100 keys span two blocks of 64, the second of which is partial. The
+// positions past the last key must not contribute to the result.
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke attention \
+// RUN:   -arg-value="dense<1.0> : tensor<2x3x1xf32>" \
+// RUN:   -arg-value="dense<0.0> : tensor<2x100x1xf32>" \
+// RUN:   -arg-value="dense<2.0> : tensor<2x100x1xf32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=BLOCKS
+
+// All the scores are equal, so the result is the mean of the values.
+// CHECK: output #0: dense<3.000000e+00> : tensor<1x2x1xf32>
+// BLOCKS: output #0: dense<2.000000e+00> : tensor<2x3x1xf32>
+func @attention(%arg0: tensor<?x?x?xf32>, %arg1: tensor<?x?x?xf32>, %arg2: tensor<?x?x?xf32>) -> tensor<?x?x?xf32> {
+  %0 = tcf.attention %arg0, %arg1, %arg2 {scale = 1.0 : f32} : (tensor<?x?x?xf32>, tensor<?x?x?xf32>, tensor<?x?x?xf32>) -> tensor<?x?x?xf32>
+  return %0 : tensor<?x?x?xf32>
+}
@@ -0,0 +1,40 @@
+// RUN: rm -f %t.json
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke matmul \
+// RUN:   -arg-value="dense<1.0> : tensor<8x16xf32>" \
+// RUN:   -arg-value="dense<2.0> : tensor<16x4xf32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib -optimize \
+// RUN:   -autotune -autotune-iterations=1 -tuning-database=%t.json 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=TUNE
+// RUN: FileCheck %s --check-prefix=DATABASE <%t.json
+
+// Shapes that are already in the database aren't tuned again, and the tuned
+// configuration gives the same results.
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke matmul \
+// RUN:   -arg-value="dense<1.0> : tensor<8x16xf32>" \
+// RUN:   -arg-value="dense<2.0> : tensor<16x4xf32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib -optimize \
+// RUN:   -autotune -tuning-database=%t.json 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=REUSE
+
+// RUN: not npcomp-run-mlir %s -invoke matmul -autotune \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=NO_DATABASE
+
+// TUNE: tuning linalg.matmul(tensor<8x16xf32>, tensor<16x4xf32>)
+// TUNE-NEXT:   heuristics: {{[0-9.]+}} ms
+// TUNE-NEXT:   l2=64x64x64 l1=16x16x16: {{[0-9.]+}} ms
+// TUNE: output #0: dense<3.200000e+01> : tensor<8x4xf32>
+
+// DATABASE:      "linalg.matmul(tensor<8x16xf32>, tensor<16x4xf32>)": {
+// DATABASE:        "latency_ms":
+
+// REUSE-NOT: tuning
+// REUSE: output #0: dense<3.200000e+01> : tensor<8x4xf32>
+
+// NO_DATABASE: Error: -autotune requires -tuning-database
+func @matmul(%arg0: tensor<8x16xf32>, %arg1: tensor<16x4xf32>) -> tensor<8x4xf32> {
+  %0 = tcf.matmul %arg0, %arg1 : (tensor<8x16xf32>, tensor<16x4xf32>) -> tensor<8x4xf32>
+  return %0 : tensor<8x4xf32>
+}
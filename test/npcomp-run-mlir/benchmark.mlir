@@ -0,0 +1,110 @@
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke mul_2d \
+// RUN:   -arg-value="random : tensor<256x256xf32>" \
+// RUN:   -arg-value="random : tensor<256x256xf32>" \
+// RUN:   -benchmark-iterations=10 -warmup=2 \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=TABLE
+
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke mul_2d \
+// RUN:   -arg-value="random : tensor<256x256xf32>" \
+// RUN:   -arg-value="random : tensor<256x256xf32>" \
+// RUN:   -benchmark-iterations=10 -threads=2 -benchmark-format=json \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=JSON
+
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke mul_2d \
+// RUN:   -arg-value="random : tensor<256x256xf32>" \
+// RUN:   -arg-value="random : tensor<256x256xf32>" \
+// RUN:   -benchmark-iterations=10 -threads=2 -benchmark-replay \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=REPLAY
+
+// The roofline is the memory roof if the peak GFLOP/s is unknown.
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke mul_2d \
+// RUN:   -arg-value="random : tensor<256x256xf32>" \
+// RUN:   -arg-value="random : tensor<256x256xf32>" \
+// RUN:   -benchmark-iterations=10 -roofline -flops-per-call=65536 \
+// RUN:   -peak-gbps=10 \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=ROOFLINE
+
+// RUN: not npcomp-run-mlir %s \
+// RUN:   -invoke mul_2d \
+// RUN:   -arg-value="random : tensor<256x256xf32>" \
+// RUN:   -arg-value="random : tensor<256x256xf32>" \
+// RUN:   -benchmark-iterations=10 -roofline -flops-per-call=65536 \
+// RUN:   -peak-gflops=1000000 -peak-gbps=1000000 -min-roofline-fraction=0.5 \
+// RUN:   -benchmark-format=json \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=ROOFLINE-GATE
+
+// Elements are read from files as raw little-endian data.
+// RUN: %PYTHON -c "import struct, sys; sys.stdout.buffer.write(struct.pack('<2f', 1.5, -2.0))" > %t.bin
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke mul \
+// RUN:   -arg-value="file(%t.bin) : tensor<2xf32>" \
+// RUN:   -arg-value="dense<[2.0, 3.0]> : tensor<2xf32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=FILE
+
+// RUN: not npcomp-run-mlir %s \
+// RUN:   -invoke mul \
+// RUN:   -arg-value="file(%t.bin) : tensor<3xf32>" \
+// RUN:   -arg-value="dense<[2.0, 3.0, 4.0]> : tensor<3xf32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=FILE-SIZE
+
+// TABLE: compile time:
+// TABLE: first-call latency:
+// TABLE: p50 latency:
+// TABLE: p90 latency:
+// TABLE: p99 latency:
+// TABLE: throughput: {{.*}} calls/s (10 calls on 1 threads)
+// TABLE: peak RSS:
+// TABLE-NOT: output #0
+
+// REPLAY: p50 latency:
+// REPLAY: throughput: {{.*}} calls/s (20 calls on 2 threads)
+
+// JSON:      "function": "mul_2d",
+// JSON-NEXT: "iterations": 10,
+// JSON-NEXT: "warmup": 1,
+// JSON-NEXT: "threads": 2,
+// JSON-NEXT: "compile_time_ms":
+// JSON-NEXT: "first_call_latency_ms":
+// JSON-NEXT: "latency_ms": {
+// JSON-NEXT:   "p50":
+// JSON-NEXT:   "p90":
+// JSON-NEXT:   "p99":
+// JSON-NEXT: },
+// JSON-NEXT: "throughput_calls_per_s":
+// JSON-NEXT: "peak_rss_mib":
+
+// ROOFLINE: GFLOP/s:
+// ROOFLINE: GB/s:
+// ROOFLINE: intensity:                  0.083 FLOP/byte
+// ROOFLINE: roofline:                   0.83 GFLOP/s (memory bound)
+// ROOFLINE: roofline fraction:
+
+// ROOFLINE-GATE: "roofline": {
+// ROOFLINE-GATE:   "intensity_flops_per_byte":
+// ROOFLINE-GATE:   "bound": "memory",
+// ROOFLINE-GATE: Error: reached {{.*}}% of the roofline, below the minimum of 50.00%
+
+// FILE: output #0: dense<[3.000000e+00, -6.000000e+00]> : tensor<2xf32>
+
+// FILE-SIZE: has 8 bytes, but tensor<3xf32> has 12
+
+func @mul(%arg0: tensor<?xf32>, %arg1: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = tcf.mul %arg0, %arg1 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  return %0 : tensor<?xf32>
+}
+
+func @mul_2d(%arg0: tensor<?x?xf32>, %arg1: tensor<?x?xf32>) -> tensor<?x?xf32> {
+  %0 = tcf.mul %arg0, %arg1 : (tensor<?x?xf32>, tensor<?x?xf32>) -> tensor<?x?xf32>
+  return %0 : tensor<?x?xf32>
+}
@@ -0,0 +1,17 @@
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke add \
+// RUN:   -arg-value="dense<[1.0, 2.0]> : tensor<2xf32>" \
+// RUN:   -compile-threads=1 -compile-time-report \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s
+
+// CHECK-DAG: {{time|timing}} report
+// CHECK-DAG: Pass memory report
+// CHECK-DAG: Peak heap usage after a pass:
+// CHECK-DAG: Heap growth (KiB) Runs Name
+// CHECK-DAG: refback-lower-to-llvm
+// CHECK-DAG: output #0: dense<[2.000000e+00, 4.000000e+00]> : tensor<2xf32>
+func @add(%arg0: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = tcf.add %arg0, %arg0 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  return %0 : tensor<?xf32>
+}
@@ -0,0 +1,18 @@
+// Externalize the weights next to the module, under a relative path.
+// RUN: rm -rf %t && mkdir -p %t
+// RUN: cd %t && npcomp-opt -npcomp-externalize-elements="path=weights.bin min-bytes=16" %s -o model.mlir
+
+// The path is resolved against the directory of the module, not the working
+// directory.
+// RUN: npcomp-run-mlir %t/model.mlir \
+// RUN:   -invoke add_weights \
+// RUN:   -arg-value="dense<[1.0, 1.0, 1.0, 1.0]> : tensor<4xf32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s
+
+// CHECK: output #0: dense<[3.000000e+00, 4.000000e+00, 5.000000e+00, 6.000000e+00]> : tensor<4xf32>
+func @add_weights(%arg0: tensor<4xf32>) -> tensor<4xf32> {
+  %0 = constant dense<[2.0, 3.0, 4.0, 5.0]> : tensor<4xf32>
+  %1 = tcf.add %arg0, %0 : (tensor<4xf32>, tensor<4xf32>) -> tensor<4xf32>
+  return %1 : tensor<4xf32>
+}
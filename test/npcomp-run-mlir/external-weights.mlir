@@ -0,0 +1,90 @@
+// RUN: %PYTHON -c "import numpy as np; np.arange(8, dtype=np.float32).tofile('%t.bin')"
+// RUN: %PYTHON -c "import numpy as np; np.repeat(np.arange(1, 13, dtype=np.float32), 32768).tofile('%t.large.bin')"
+// RUN: %PYTHON -c "import sys; sys.stdout.write(open('%s').read().replace('@WEIGHTS@', ('external:16:' + '%t.bin').encode().hex()).replace('@LARGE_WEIGHTS@', ('external:0:' + '%t.large.bin').encode().hex()))" > %t.mlir
+
+// The JIT maps the weights from the file.
+// RUN: npcomp-run-mlir %t.mlir \
+// RUN:   -invoke add_weights \
+// RUN:   -arg-value="dense<[1.0, 1.0, 1.0, 1.0]> : tensor<4xf32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s
+// RUN: npcomp-run-mlir %t.mlir \
+// RUN:   -invoke sum_large_weights \
+// RUN:   -arg-value="dense<1.0> : tensor<65536x1xf32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=LARGE
+
+// With -external-weights, ahead-of-time compiled code maps them when loaded.
+// RUN: npcomp-compile %t.mlir -external-weights -prefetch-weights -o %t.mapped.so
+// RUN: npcomp-run-mlir %t.mlir \
+// RUN:   -invoke add_weights \
+// RUN:   -arg-value="dense<[1.0, 1.0, 1.0, 1.0]> : tensor<4xf32>" \
+// RUN:   -compiled-module=%t.mapped.so 2>&1 \
+// RUN:   | FileCheck %s
+// RUN: npcomp-run-mlir %t.mlir \
+// RUN:   -invoke sum_large_weights \
+// RUN:   -arg-value="dense<1.0> : tensor<65536x1xf32>" \
+// RUN:   -compiled-module=%t.mapped.so 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=LARGE
+
+// Otherwise it embeds them, compressed with -compress-weights. The large
+// weights span several compression blocks, whose byte planes are run-length
+// encoded.
+// RUN: npcomp-compile %t.mlir -o %t.so
+// RUN: npcomp-compile %t.mlir -compress-weights -o %t.compressed.so
+// RUN: %PYTHON -c "import os; print('compressed by', (os.path.getsize('%t.so') - os.path.getsize('%t.compressed.so')) >> 20, 'MiB')" \
+// RUN:   | FileCheck %s --check-prefix=SIZE
+// RUN: rm %t.bin %t.large.bin
+// RUN: npcomp-run-mlir %t.mlir \
+// RUN:   -invoke add_weights \
+// RUN:   -arg-value="dense<[1.0, 1.0, 1.0, 1.0]> : tensor<4xf32>" \
+// RUN:   -compiled-module=%t.so 2>&1 \
+// RUN:   | FileCheck %s
+// RUN: npcomp-run-mlir %t.mlir \
+// RUN:   -invoke add_weights \
+// RUN:   -arg-value="dense<[1.0, 1.0, 1.0, 1.0]> : tensor<4xf32>" \
+// RUN:   -compiled-module=%t.compressed.so 2>&1 \
+// RUN:   | FileCheck %s
+// RUN: npcomp-run-mlir %t.mlir \
+// RUN:   -invoke sum_large_weights \
+// RUN:   -arg-value="dense<1.0> : tensor<65536x1xf32>" \
+// RUN:   -compiled-module=%t.so 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=LARGE
+// RUN: npcomp-run-mlir %t.mlir \
+// RUN:   -invoke sum_large_weights \
+// RUN:   -arg-value="dense<1.0> : tensor<65536x1xf32>" \
+// RUN:   -compiled-module=%t.compressed.so 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=LARGE
+
+// RUN: not npcomp-run-mlir %t.mlir \
+// RUN:   -invoke add_weights \
+// RUN:   -arg-value="dense<[1.0, 1.0, 1.0, 1.0]> : tensor<4xf32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=MISSING
+
+// RUN: not npcomp-run-mlir %t.mlir \
+// RUN:   -invoke add_weights \
+// RUN:   -arg-value="dense<[1.0, 1.0, 1.0, 1.0]> : tensor<4xf32>" \
+// RUN:   -compiled-module=%t.mapped.so 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=MISSING-MAPPED
+
+// CHECK: output #0: dense<[5.000000e+00, 6.000000e+00, 7.000000e+00, 8.000000e+00]> : tensor<4xf32>
+// Each row of the large weights is 32768 times 2r+1 followed by 32768 times
+// 2r+2, which sum to 32768*(4r+3).
+// LARGE: output #0: dense<[
+// LARGE-SAME: [9.830400e+04], [2.293760e+05], [3.604480e+05], [4.915200e+05], [6.225920e+05], [7.536640e+05]
+// LARGE-SAME: ]> : tensor<6x1xf32>
+// SIZE: compressed by 1 MiB
+// MISSING: could not open {{.*}}.bin
+// MISSING-MAPPED: could not open external weights {{.*}}.bin
+func @add_weights(%arg0: tensor<4xf32>) -> tensor<4xf32> {
+  %0 = constant opaque<"refback", "0x@WEIGHTS@"> : tensor<4xf32>
+  %1 = tcf.add %arg0, %0 : (tensor<4xf32>, tensor<4xf32>) -> tensor<4xf32>
+  return %1 : tensor<4xf32>
+}
+
+func @sum_large_weights(%arg0: tensor<65536x1xf32>) -> tensor<6x1xf32> {
+  %0 = constant opaque<"refback", "0x@LARGE_WEIGHTS@"> : tensor<6x65536xf32>
+  %1 = tcf.matmul %0, %arg0 : (tensor<6x65536xf32>, tensor<65536x1xf32>) -> tensor<6x1xf32>
+  return %1 : tensor<6x1xf32>
+}
@@ -0,0 +1,19 @@
+// RUN: not npcomp-run-mlir %s \
+// RUN:   -invoke caller \
+// RUN:   -arg-value="dense<[1.0, 2.0]> : tensor<2xf32>" \
+// RUN:   -interpret \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s
+
+// The private callee is not translated on its own, but the call is rejected.
+
+// CHECK: Error: cannot interpret caller: unsupported op: std.call
+func private @callee(%arg0: tensor<2xf32>) -> tensor<2xf32> {
+  %0 = tcf.add %arg0, %arg0 : (tensor<2xf32>, tensor<2xf32>) -> tensor<2xf32>
+  return %0 : tensor<2xf32>
+}
+
+func @caller(%arg0: tensor<2xf32>) -> tensor<2xf32> {
+  %0 = call @callee(%arg0) : (tensor<2xf32>) -> tensor<2xf32>
+  return %0 : tensor<2xf32>
+}
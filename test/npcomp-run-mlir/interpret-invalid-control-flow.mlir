@@ -0,0 +1,19 @@
+// RUN: not npcomp-run-mlir %s \
+// RUN:   -invoke control_flow \
+// RUN:   -arg-value="dense<1.0> : tensor<f32>" \
+// RUN:   -interpret \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s
+
+// CHECK: Error: cannot interpret control_flow: functions must have a single block
+func @control_flow(%arg0: tensor<f32>) -> tensor<f32> {
+  %zero = constant 0.0 : f32
+  %0 = tensor.extract %arg0[] : tensor<f32>
+  %positive = cmpf ogt, %0, %zero : f32
+  cond_br %positive, ^bb1, ^bb2
+^bb1:
+  %1 = tcf.add %arg0, %arg0 : (tensor<f32>, tensor<f32>) -> tensor<f32>
+  return %1 : tensor<f32>
+^bb2:
+  return %arg0 : tensor<f32>
+}
@@ -0,0 +1,18 @@
+// RUN: not npcomp-run-mlir %s \
+// RUN:   -invoke loop \
+// RUN:   -arg-value="dense<1.0> : tensor<f32>" \
+// RUN:   -interpret \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s
+
+// CHECK: Error: cannot interpret loop: unsupported op: scf.for
+func @loop(%arg0: tensor<f32>) -> tensor<f32> {
+  %c0 = constant 0 : index
+  %c4 = constant 4 : index
+  %c1 = constant 1 : index
+  %0 = scf.for %iv = %c0 to %c4 step %c1 iter_args(%iter = %arg0) -> tensor<f32> {
+    %doubled = tcf.add %iter, %iter : (tensor<f32>, tensor<f32>) -> tensor<f32>
+    scf.yield %doubled : tensor<f32>
+  }
+  return %0 : tensor<f32>
+}
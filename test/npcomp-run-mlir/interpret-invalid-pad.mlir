@@ -0,0 +1,15 @@
+// RUN: not npcomp-run-mlir %s \
+// RUN:   -invoke pad \
+// RUN:   -arg-value="dense<[1.2, 3.4]> : tensor<2xf32>" \
+// RUN:   -interpret \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s
+
+// CHECK: Error: cannot interpret pad: unsupported op: tcp.pad
+func @pad(%arg0: tensor<?xf32>) -> tensor<?xf32> {
+  %lowerExpansion = shape.const_shape [1] : tensor<?xindex>
+  %upperExpansion = shape.const_shape [2] : tensor<?xindex>
+  %fillVal = constant 0.0 : f32
+  %0 = tcp.pad %arg0, %lowerExpansion, %upperExpansion, %fillVal : (tensor<?xf32>, tensor<?xindex>, tensor<?xindex>, f32) -> tensor<?xf32>
+  return %0 : tensor<?xf32>
+}
@@ -0,0 +1,145 @@
+// Each function is run both by the interpreter and as compiled code, which
+// must agree.
+
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke matmul_add \
+// RUN:   -arg-value="dense<[[1.0, 0.0, 1.0], [1.0, 1.0, 1.0]]> : tensor<2x3xf32>" \
+// RUN:   -arg-value="dense<[[1.0, 2.0], [3.0, 4.0], [5.0, 6.0]]> : tensor<3x2xf32>" \
+// RUN:   -arg-value="dense<[1.0, 2.0]> : tensor<2xf32>" \
+// RUN:   -interpret \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke matmul_add \
+// RUN:   -arg-value="dense<[[1.0, 0.0, 1.0], [1.0, 1.0, 1.0]]> : tensor<2x3xf32>" \
+// RUN:   -arg-value="dense<[[1.0, 2.0], [3.0, 4.0], [5.0, 6.0]]> : tensor<3x2xf32>" \
+// RUN:   -arg-value="dense<[1.0, 2.0]> : tensor<2xf32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s
+
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke payloads \
+// RUN:   -arg-value="dense<[1.0, -2.0, 0.5, 0.0]> : tensor<4xf32>" \
+// RUN:   -arg-value="dense<[2.0, 1.0, -1.0, 0.0]> : tensor<4xf32>" \
+// RUN:   -interpret \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=PAYLOADS
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke payloads \
+// RUN:   -arg-value="dense<[1.0, -2.0, 0.5, 0.0]> : tensor<4xf32>" \
+// RUN:   -arg-value="dense<[2.0, 1.0, -1.0, 0.0]> : tensor<4xf32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=PAYLOADS
+
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke batch_matmul \
+// RUN:   -arg-value="dense<[[[1.0, 2.0, 3.0], [4.0, 5.0, 6.0]], [[1.0, 0.0, 0.0], [0.0, 1.0, 0.0]]]> : tensor<2x2x3xf32>" \
+// RUN:   -arg-value="dense<[[[1.0, 0.0], [0.0, 1.0], [1.0, 1.0]], [[1.0, 2.0], [3.0, 4.0], [5.0, 6.0]]]> : tensor<2x3x2xf32>" \
+// RUN:   -interpret \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=BATCH_MATMUL
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke batch_matmul \
+// RUN:   -arg-value="dense<[[[1.0, 2.0, 3.0], [4.0, 5.0, 6.0]], [[1.0, 0.0, 0.0], [0.0, 1.0, 0.0]]]> : tensor<2x2x3xf32>" \
+// RUN:   -arg-value="dense<[[[1.0, 0.0], [0.0, 1.0], [1.0, 1.0]], [[1.0, 2.0], [3.0, 4.0], [5.0, 6.0]]]> : tensor<2x3x2xf32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=BATCH_MATMUL
+
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke integers \
+// RUN:   -arg-value="dense<[1, -2, 7, 0]> : tensor<4xi32>" \
+// RUN:   -arg-value="dense<[3, 4, -5, 0]> : tensor<4xi32>" \
+// RUN:   -interpret \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=INTEGERS
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke integers \
+// RUN:   -arg-value="dense<[1, -2, 7, 0]> : tensor<4xi32>" \
+// RUN:   -arg-value="dense<[3, 4, -5, 0]> : tensor<4xi32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=INTEGERS
+
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke large_add \
+// RUN:   -arg-value="dense<1.0> : tensor<65536x8xf32>" \
+// RUN:   -arg-value="dense<[0.0, 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0]> : tensor<8xf32>" \
+// RUN:   -interpret \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=LARGE_ADD
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke large_add \
+// RUN:   -arg-value="dense<1.0> : tensor<65536x8xf32>" \
+// RUN:   -arg-value="dense<[0.0, 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0]> : tensor<8xf32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=LARGE_ADD
+
+// The broadcast add is computed in the buffer of the matmul result.
+
+// CHECK: output #0: dense<[
+// CHECK-SAME:   [7.000000e+00, 1.000000e+01], [1.000000e+01, 1.400000e+01]
+// CHECK-SAME: ]> : tensor<2x2xf32>
+func @matmul_add(%arg0: tensor<2x3xf32>, %arg1: tensor<3x2xf32>, %arg2: tensor<2xf32>) -> tensor<2x2xf32> {
+  %0 = tcf.matmul %arg0, %arg1 : (tensor<2x3xf32>, tensor<3x2xf32>) -> tensor<2x2xf32>
+  %1 = tcf.add %0, %arg2 : (tensor<2x2xf32>, tensor<2xf32>) -> tensor<2x2xf32>
+  return %1 : tensor<2x2xf32>
+}
+
+// The payloads of the elementwise ops other than add, including the
+// comparison of max.
+
+// PAYLOADS: output #0: dense<[2.000000e+00, -2.000000e+00, -5.000000e-01, 0.000000e+00]> : tensor<4xf32>
+// PAYLOADS: output #1: dense<[2.000000e+00, 1.000000e+00, 5.000000e-01, 0.000000e+00]> : tensor<4xf32>
+// PAYLOADS: output #2: dense<[2.718281{{[0-9]+}}, 0.135335{{[0-9]+}}, 1.648721{{[0-9]+}}, 1.000000e+00]> : tensor<4xf32>
+// PAYLOADS: output #3: dense<[0.964027{{[0-9]+}}, 0.761594{{[0-9]+}}, -0.761594{{[0-9]+}}, 0.000000e+00]> : tensor<4xf32>
+func @payloads(%arg0: tensor<4xf32>, %arg1: tensor<4xf32>) -> (tensor<4xf32>, tensor<4xf32>, tensor<4xf32>, tensor<4xf32>) {
+  %0 = tcf.mul %arg0, %arg1 : (tensor<4xf32>, tensor<4xf32>) -> tensor<4xf32>
+  %1 = tcf.max %arg0, %arg1 : (tensor<4xf32>, tensor<4xf32>) -> tensor<4xf32>
+  %2 = tcf.exp %arg0 : tensor<4xf32>
+  %3 = tcf.tanh %arg1 : tensor<4xf32>
+  return %0, %1, %2, %3 : tensor<4xf32>, tensor<4xf32>, tensor<4xf32>, tensor<4xf32>
+}
+
+// BATCH_MATMUL: output #0: dense<[
+// BATCH_MATMUL-SAME:   [
+// BATCH_MATMUL-SAME:     [4.000000e+00, 5.000000e+00], [1.000000e+01, 1.100000e+01]
+// BATCH_MATMUL-SAME:   ], [
+// BATCH_MATMUL-SAME:     [1.000000e+00, 2.000000e+00], [3.000000e+00, 4.000000e+00]
+// BATCH_MATMUL-SAME:   ]
+// BATCH_MATMUL-SAME: ]> : tensor<2x2x2xf32>
+func @batch_matmul(%arg0: tensor<2x2x3xf32>, %arg1: tensor<2x3x2xf32>) -> tensor<2x2x2xf32> {
+  %0 = tcf.batch_matmul %arg0, %arg1 : (tensor<2x2x3xf32>, tensor<2x3x2xf32>) -> tensor<2x2x2xf32>
+  return %0 : tensor<2x2x2xf32>
+}
+
+// TCF has no integer ops, so the integer and comparison payloads are
+// written as a linalg.generic: select(a < b, (a + b) * b, a - b).
+
+// INTEGERS: output #0: dense<[12, 8, 12, 0]> : tensor<4xi32>
+#map = affine_map<(d0) -> (d0)>
+func @integers(%arg0: tensor<4xi32>, %arg1: tensor<4xi32>) -> tensor<4xi32> {
+  %init = linalg.init_tensor [4] : tensor<4xi32>
+  %0 = linalg.generic {indexing_maps = [#map, #map, #map], iterator_types = ["parallel"]}
+      ins(%arg0, %arg1 : tensor<4xi32>, tensor<4xi32>)
+      outs(%init : tensor<4xi32>) {
+  ^bb0(%a: i32, %b: i32, %out: i32):
+    %sum = addi %a, %b : i32
+    %product = muli %sum, %b : i32
+    %difference = subi %a, %b : i32
+    %less = cmpi slt, %a, %b : i32
+    %result = select %less, %product, %difference : i32
+    linalg.yield %result : i32
+  } -> tensor<4xi32>
+  return %0 : tensor<4xi32>
+}
+
+// The add is large enough for its outer loop to be split among the threads
+// of the interpreter. The sums are exact, whatever their order.
+
+// LARGE_ADD: output #0: dense<[
+// LARGE_ADD-SAME:   [6.553600e+04, 1.310720e+05, 1.966080e+05, 2.621440e+05, 3.276800e+05, 3.932160e+05, 4.587520e+05, 5.242880e+05]
+// LARGE_ADD-SAME: ]> : tensor<1x8xf32>
+func @large_add(%arg0: tensor<65536x8xf32>, %arg1: tensor<8xf32>) -> tensor<1x8xf32> {
+  %0 = tcf.add %arg0, %arg1 : (tensor<65536x8xf32>, tensor<8xf32>) -> tensor<65536x8xf32>
+  %1 = tcf.reduce_sum %0 {dim = 0 : i64} : (tensor<65536x8xf32>) -> tensor<1x8xf32>
+  return %1 : tensor<1x8xf32>
+}
@@ -5,7 +5,7 @@
 // RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
 // RUN:   | FileCheck %s
 
-// CHECK: NPCOMP: aborting: required broadcastable shapes
+// CHECK: Error: invoking 'invalid_broadcast': required broadcastable shapes
 func @invalid_broadcast(%arg0: tensor<?xf32>, %arg1: tensor<?xf32>) -> tensor<?xf32> {
   %0 = tcf.add %arg0, %arg1 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
   return %0 : tensor<?xf32>
@@ -0,0 +1,38 @@
+// RUN: not npcomp-run-mlir %s \
+// RUN:   -invoke caller \
+// RUN:   -arg-value="dense<[1.0, 2.0]> : tensor<2xf32>" \
+// RUN:   -arg-value="dense<[3.0, 4.0, 5.0]> : tensor<3xf32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=CALLER
+
+// RUN: not npcomp-run-mlir %s \
+// RUN:   -invoke exported_callee \
+// RUN:   -arg-value="dense<[1.0, 2.0]> : tensor<2xf32>" \
+// RUN:   -arg-value="dense<[3.0, 4.0, 5.0]> : tensor<3xf32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=EXPORTED_CALLEE
+
+// The checks of called functions fail the invocation, like those of the
+// invoked function, instead of exiting. This holds for exported functions
+// that other functions call too.
+
+// CALLER-NOT: NPCOMP: aborting
+// CALLER: Error: invoking 'caller': required broadcastable shapes
+// EXPORTED_CALLEE-NOT: NPCOMP: aborting
+// EXPORTED_CALLEE: Error: invoking 'exported_callee': required broadcastable shapes
+
+func private @callee(%arg0: tensor<?xf32>, %arg1: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = tcf.add %arg0, %arg1 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  return %0 : tensor<?xf32>
+}
+
+func @exported_callee(%arg0: tensor<?xf32>, %arg1: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = tcf.add %arg0, %arg1 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  return %0 : tensor<?xf32>
+}
+
+func @caller(%arg0: tensor<?xf32>, %arg1: tensor<?xf32>) -> (tensor<?xf32>, tensor<?xf32>) {
+  %0 = call @exported_callee(%arg0, %arg0) : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  %1 = call @callee(%0, %arg1) : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  return %0, %1 : tensor<?xf32>, tensor<?xf32>
+}
@@ -19,9 +19,9 @@
 // RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
 // RUN:   | FileCheck %s --check-prefix=WIDTH
 
-// CHANNELS: NPCOMP: aborting: input and filter in-channels must be equal
-// HEIGHT: NPCOMP: aborting: input height must be greater than or equal to filter KH-dimension
-// WIDTH: NPCOMP: aborting: input width must be greater than or equal to filter KW-dimension
+// CHANNELS: Error: invoking 'conv_2d_nchw': input and filter in-channels must be equal
+// HEIGHT: Error: invoking 'conv_2d_nchw': input height must be greater than or equal to filter KH-dimension
+// WIDTH: Error: invoking 'conv_2d_nchw': input width must be greater than or equal to filter KW-dimension
 func @conv_2d_nchw(%arg0: tensor<?x?x?x?xf32>, %arg1: tensor<?x?x?x?xf32>) -> tensor<?x?x?x?xf32> {
   %0 = tcf.conv_2d_nchw %arg0, %arg1 : (tensor<?x?x?x?xf32>, tensor<?x?x?x?xf32>) -> tensor<?x?x?x?xf32>
   return %0 : tensor<?x?x?x?xf32>
@@ -9,7 +9,7 @@
 // [1 0 1] * [1 2] = [6  8]
 // [1 1 1]   [3 4]   [9 12]
 
-// CHECK: NPCOMP: aborting: mismatching contracting dimension for matmul
+// CHECK: Error: invoking 'matmul': mismatching contracting dimension for matmul
 func @matmul(%arg0: tensor<?x?xf32>, %arg1: tensor<?x?xf32>) -> tensor<?x?xf32> {
   %0 = tcf.matmul %arg0, %arg1 : (tensor<?x?xf32>, tensor<?x?xf32>) -> tensor<?x?xf32>
   return %0 : tensor<?x?xf32>
@@ -0,0 +1,29 @@
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke add_twice \
+// RUN:   -arg-value="dense<1.0> : tensor<f32>" \
+// RUN:   -lazy \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s
+
+// RUN: not npcomp-run-mlir %s \
+// RUN:   -invoke add_twice \
+// RUN:   -arg-value="dense<1.0> : tensor<f32>" \
+// RUN:   -lazy -object-cache-dir=%t \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=CACHE
+
+// Only @add_twice (and what it calls) is compiled.
+
+// CHECK: output #0: dense<4.000000e+00> : tensor<f32>
+// CACHE: Error: lazy compilation doesn't support an object cache
+
+func @add_twice(%arg0: tensor<f32>) -> tensor<f32> {
+  %0 = tcf.add %arg0, %arg0 : (tensor<f32>, tensor<f32>) -> tensor<f32>
+  %1 = tcf.add %0, %0 : (tensor<f32>, tensor<f32>) -> tensor<f32>
+  return %1 : tensor<f32>
+}
+
+func @unused(%arg0: tensor<?x?xf32>, %arg1: tensor<?x?xf32>) -> tensor<?x?xf32> {
+  %0 = tcf.matmul %arg0, %arg1 : (tensor<?x?xf32>, tensor<?x?xf32>) -> tensor<?x?xf32>
+  return %0 : tensor<?x?xf32>
+}
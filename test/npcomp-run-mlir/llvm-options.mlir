@@ -0,0 +1,35 @@
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke add \
+// RUN:   -arg-value="dense<[1.0, 2.0]> : tensor<2xf32>" \
+// RUN:   -O0 \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s
+
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke add \
+// RUN:   -arg-value="dense<[1.0, 2.0]> : tensor<2xf32>" \
+// RUN:   -O3 -mcpu=native \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s
+
+// The options of the fast compile tier.
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke add \
+// RUN:   -arg-value="dense<[1.0, 2.0]> : tensor<2xf32>" \
+// RUN:   -O0 -fast-isel \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s
+
+// RUN: not npcomp-run-mlir %s \
+// RUN:   -invoke add \
+// RUN:   -arg-value="dense<[1.0, 2.0]> : tensor<2xf32>" \
+// RUN:   -O4 \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=INVALID
+
+// CHECK: output #0: dense<[2.000000e+00, 4.000000e+00]> : tensor<2xf32>
+// INVALID: Error: invalid LLVM optimization level 4
+func @add(%arg0: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = tcf.add %arg0, %arg0 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  return %0 : tensor<?xf32>
+}
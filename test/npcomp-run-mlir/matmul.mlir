@@ -12,6 +12,14 @@
 // RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
 // RUN:   | FileCheck %s --check-prefix=ZEROS
 
+// Tiling (done when optimizing) must handle partial tiles.
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke matmul \
+// RUN:   -arg-value="dense<[[1.0, 0.0, 1.0], [1.0, 1.0, 1.0]]> : tensor<2x3xf32>" \
+// RUN:   -arg-value="dense<[[1.0, 2.0], [3.0, 4.0], [5.0, 6.0]]> : tensor<3x2xf32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib -optimize 2>&1 \
+// RUN:   | FileCheck %s
+
 // Basic correctness check:
 // [1 0 1] * [1 2] = [6  8]
 // [1 1 1]   [3 4]   [9 12]
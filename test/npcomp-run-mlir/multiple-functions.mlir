@@ -0,0 +1,46 @@
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke add \
+// RUN:   -arg-value="dense<1.0> : tensor<f32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=ADD
+
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke add_twice \
+// RUN:   -arg-value="dense<1.0> : tensor<f32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=ADD_TWICE
+
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke identity \
+// RUN:   -arg-value="dense<1.0> : tensor<f32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=IDENTITY
+
+// RUN: not npcomp-run-mlir %s \
+// RUN:   -invoke ad \
+// RUN:   -arg-value="dense<1.0> : tensor<f32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=UNKNOWN
+
+// Functions are deliberately not in sorted order, and some names are prefixes
+// of others, to exercise the sorted function descriptor table.
+
+// ADD: output #0: dense<2.000000e+00> : tensor<f32>
+// ADD_TWICE: output #0: dense<4.000000e+00> : tensor<f32>
+// IDENTITY: output #0: dense<1.000000e+00> : tensor<f32>
+// UNKNOWN: unknown function: ad
+
+func @identity(%arg0: tensor<f32>) -> tensor<f32> {
+  return %arg0 : tensor<f32>
+}
+
+func @add_twice(%arg0: tensor<f32>) -> tensor<f32> {
+  %0 = tcf.add %arg0, %arg0 : (tensor<f32>, tensor<f32>) -> tensor<f32>
+  %1 = tcf.add %0, %0 : (tensor<f32>, tensor<f32>) -> tensor<f32>
+  return %1 : tensor<f32>
+}
+
+func @add(%arg0: tensor<f32>) -> tensor<f32> {
+  %0 = tcf.add %arg0, %arg0 : (tensor<f32>, tensor<f32>) -> tensor<f32>
+  return %0 : tensor<f32>
+}
@@ -0,0 +1,55 @@
+// RUN: %PYTHON -c "import numpy as np; np.save('%t.lhs.npy', np.array([[1.0, 2.0], [3.0, 4.0]], dtype=np.float32))"
+// RUN: %PYTHON -c "import numpy as np; np.save('%t.rhs.npy', np.asfortranarray(np.array([[5.0, 6.0], [7.0, 8.0]], dtype=np.float32)))"
+
+// Arguments from files and arg values are passed in command-line order, and
+// column-major files are read as their logical elements.
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke scale \
+// RUN:   -arg-file=%t.rhs.npy \
+// RUN:   -arg-value="dense<[1.0, 2.0]> : tensor<2xf32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=ORDER
+
+// ORDER: output #0: dense<{{\[}}[5.000000e+00, 1.200000e+01], [7.000000e+00, 1.600000e+01]]> : tensor<2x2xf32>
+
+// Outputs are written to .npy files, or as their raw elements otherwise.
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke mul \
+// RUN:   -arg-file=%t.lhs.npy \
+// RUN:   -arg-file=%t.rhs.npy \
+// RUN:   -output-file=%t.out.npy \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=WRITTEN
+// RUN: %PYTHON -c "import numpy as np; a = np.load('%t.out.npy'); print(a.dtype, a.tolist())" \
+// RUN:   | FileCheck %s --check-prefix=NPY
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke mul \
+// RUN:   -arg-file=%t.lhs.npy \
+// RUN:   -arg-file=%t.rhs.npy \
+// RUN:   -output-file=%t.out.bin \
+// RUN:   -shared-libs=%npcomp_runtime_shlib
+// RUN: %PYTHON -c "import struct; print(struct.unpack('<4f', open('%t.out.bin', 'rb').read()))" \
+// RUN:   | FileCheck %s --check-prefix=RAW
+
+// WRITTEN: output #0: written to {{.*}}.out.npy
+// NPY: float32 {{\[}}[5.0, 12.0], [21.0, 32.0]]
+// RAW: (5.0, 12.0, 21.0, 32.0)
+
+// RUN: not npcomp-run-mlir %s \
+// RUN:   -invoke mul \
+// RUN:   -arg-file=%t.lhs.npy \
+// RUN:   -arg-file=%s \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=NOT-NPY
+
+// NOT-NPY: Error: -arg-file expects a .npy file
+
+func @mul(%arg0: tensor<?x?xf32>, %arg1: tensor<?x?xf32>) -> tensor<?x?xf32> {
+  %0 = tcf.mul %arg0, %arg1 : (tensor<?x?xf32>, tensor<?x?xf32>) -> tensor<?x?xf32>
+  return %0 : tensor<?x?xf32>
+}
+
+func @scale(%arg0: tensor<?x?xf32>, %arg1: tensor<?xf32>) -> tensor<?x?xf32> {
+  %0 = tcf.mul %arg0, %arg1 : (tensor<?x?xf32>, tensor<?xf32>) -> tensor<?x?xf32>
+  return %0 : tensor<?x?xf32>
+}
@@ -0,0 +1,26 @@
+// RUN: rm -rf %t
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke add \
+// RUN:   -arg-value="dense<[1.0, 2.0]> : tensor<2xf32>" \
+// RUN:   -object-cache-dir=%t \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s
+// RUN: ls %t | FileCheck %s --check-prefix=CACHE
+
+// The second run loads the object code stored by the first one.
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke add \
+// RUN:   -arg-value="dense<[1.0, 2.0]> : tensor<2xf32>" \
+// RUN:   -object-cache-dir=%t \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s
+// RUN: ls %t | FileCheck %s --check-prefix=CACHE
+
+// CACHE: {{^[0-9a-f]+}}.o
+// CACHE-NOT: .o
+
+// CHECK: output #0: dense<[2.000000e+00, 4.000000e+00]> : tensor<2xf32>
+func @add(%arg0: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = tcf.add %arg0, %arg0 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  return %0 : tensor<?xf32>
+}
@@ -0,0 +1,25 @@
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke matmul_add \
+// RUN:   -arg-value="dense<[[1.0, 2.0], [3.0, 4.0]]> : tensor<2x2xf32>" \
+// RUN:   -arg-value="dense<[[1.0, 0.0], [0.0, 1.0]]> : tensor<2x2xf32>" \
+// RUN:   -op-profile=%t.json \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s
+// RUN: FileCheck %s --check-prefix=TRACE < %t.json
+
+// CHECK: output #0: dense<{{\[\[}}2.000000e+00, 4.000000e+00], [6.000000e+00, 8.000000e+00]]> : tensor<2x2xf32>
+// CHECK: op profile: written to {{.*}}.json
+// CHECK: Total ms % Calls Op
+// CHECK-DAG: 1 linalg.matmul at op-profile.mlir:{{[0-9]+}}:{{[0-9]+}}
+// CHECK-DAG: 1 linalg.generic at op-profile.mlir:{{[0-9]+}}:{{[0-9]+}}
+// CHECK: SUCCESS
+
+// TRACE: {"traceEvents": [
+// TRACE-DAG: {"name": "linalg.matmul at op-profile.mlir:{{[0-9]+}}:{{[0-9]+}}", "ph": "X", "ts": {{[0-9.]+}}, "dur": {{[0-9.]+}}, "pid": 0, "tid": 0}
+// TRACE-DAG: {"name": "linalg.generic at op-profile.mlir:{{[0-9]+}}:{{[0-9]+}}", "ph": "X"
+// TRACE: ], "displayTimeUnit": "ns"}
+func @matmul_add(%arg0: tensor<?x?xf32>, %arg1: tensor<?x?xf32>) -> tensor<?x?xf32> {
+  %0 = tcf.matmul %arg0, %arg1 : (tensor<?x?xf32>, tensor<?x?xf32>) -> tensor<?x?xf32>
+  %1 = tcf.add %0, %0 : (tensor<?x?xf32>, tensor<?x?xf32>) -> tensor<?x?xf32>
+  return %1 : tensor<?x?xf32>
+}
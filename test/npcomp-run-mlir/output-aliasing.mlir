@@ -0,0 +1,19 @@
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke output_aliasing \
+// RUN:   -arg-value="dense<1.0> : tensor<1xf32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s
+
+// Outputs that share a buffer with an input, with each other, or with a
+// constant must each end up with their own valid storage.
+
+// CHECK: output #0: dense<1.000000e+00> : tensor<1xf32>
+// CHECK: output #1: dense<2.000000e+00> : tensor<1xf32>
+// CHECK: output #2: dense<2.000000e+00> : tensor<1xf32>
+// CHECK: output #3: dense<3.000000e+00> : tensor<1xf32>
+// CHECK: output #4: dense<1.000000e+00> : tensor<1xf32>
+func @output_aliasing(%arg0: tensor<?xf32>) -> (tensor<?xf32>, tensor<?xf32>, tensor<?xf32>, tensor<1xf32>, tensor<?xf32>) {
+  %0 = tcf.add %arg0, %arg0 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  %1 = constant dense<3.0> : tensor<1xf32>
+  return %arg0, %0, %0, %1, %arg0 : tensor<?xf32>, tensor<?xf32>, tensor<?xf32>, tensor<1xf32>, tensor<?xf32>
+}
@@ -0,0 +1,60 @@
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke sum \
+// RUN:   -arg-value="dense<[[1.0, 2.0, 3.0], [4.0, 5.0, 6.0]]> : tensor<2x3xf32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=SUM
+
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke mean \
+// RUN:   -arg-value="dense<[[1.0, 2.0, 3.0], [4.0, 5.0, 6.0]]> : tensor<2x3xf32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=MEAN
+
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke max \
+// RUN:   -arg-value="dense<[[1.0, 5.0, 3.0], [-4.0, -2.0, -6.0]]> : tensor<2x3xf32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=MAX
+
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke softmax \
+// RUN:   -arg-value="dense<[[0.0, 0.0], [1000.0, 1000.0]]> : tensor<2x2xf32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=SOFTMAX
+
+// The large reduction is split into parallel partial reductions.
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke large_sum \
+// RUN:   -arg-value="dense<1.0> : tensor<8192xf32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib -optimize 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=LARGE_SUM
+
+// SUM: output #0: dense<{{\[}}[6.000000e+00], [1.500000e+01]]> : tensor<2x1xf32>
+func @sum(%arg0: tensor<?x?xf32>) -> tensor<?x1xf32> {
+  %0 = tcf.reduce_sum %arg0 {dim = 1 : i64} : (tensor<?x?xf32>) -> tensor<?x1xf32>
+  return %0 : tensor<?x1xf32>
+}
+
+// MEAN: output #0: dense<{{\[}}[2.500000e+00, 3.500000e+00, 4.500000e+00]]> : tensor<1x3xf32>
+func @mean(%arg0: tensor<?x?xf32>) -> tensor<1x?xf32> {
+  %0 = tcf.reduce_mean %arg0 {dim = 0 : i64} : (tensor<?x?xf32>) -> tensor<1x?xf32>
+  return %0 : tensor<1x?xf32>
+}
+
+// MAX: output #0: dense<{{\[}}[5.000000e+00], [-2.000000e+00]]> : tensor<2x1xf32>
+func @max(%arg0: tensor<?x?xf32>) -> tensor<?x1xf32> {
+  %0 = tcf.reduce_max %arg0 {dim = 1 : i64} : (tensor<?x?xf32>) -> tensor<?x1xf32>
+  return %0 : tensor<?x1xf32>
+}
+
+// SOFTMAX: output #0: dense<5.000000e-01> : tensor<2x2xf32>
+func @softmax(%arg0: tensor<?x?xf32>) -> tensor<?x?xf32> {
+  %0 = tcf.softmax %arg0 {dim = 1 : i64} : tensor<?x?xf32>
+  return %0 : tensor<?x?xf32>
+}
+
+// LARGE_SUM: output #0: dense<8.192000e+03> : tensor<1xf32>
+func @large_sum(%arg0: tensor<8192xf32>) -> tensor<1xf32> {
+  %0 = tcf.reduce_sum %arg0 {dim = 0 : i64} : (tensor<8192xf32>) -> tensor<1xf32>
+  return %0 : tensor<1xf32>
+}
@@ -10,6 +10,15 @@
 // RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
 // RUN:   | FileCheck %s --check-prefix=SCALAR_ARG
 
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke int_scalars \
+// RUN:   -arg-value="3 : i64" \
+// RUN:   -arg-value="-4 : i32" \
+// RUN:   -arg-value="true" \
+// RUN:   -arg-value="1.5 : f64" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=INT_SCALARS
+
 // SCALAR: output #0: dense<2.000000e+00> : tensor<f32>
 func @scalar(%arg0: tensor<f32>) -> tensor<f32> {
   %0 = tcf.add %arg0, %arg0 : (tensor<f32>, tensor<f32>) -> tensor<f32>
@@ -19,4 +28,16 @@ func @scalar(%arg0: tensor<f32>) -> tensor<f32> {
 // SCALAR_ARG: output #0: 2.500000e+00 : f32
 func @scalar_arg(%arg0: f32) -> f32 {
   return %arg0 : f32
-}
\ No newline at end of file
+}
+
+// Integer outputs are printed as i64, whatever their width.
+// INT_SCALARS: output #0: true
+// INT_SCALARS: output #1: -8 : i64
+// INT_SCALARS: output #2: 6 : i64
+// INT_SCALARS: output #3: 3.000000e+00 : f64
+func @int_scalars(%arg0: i64, %arg1: i32, %arg2: i1, %arg3: f64) -> (i1, i32, i64, f64) {
+  %0 = addi %arg1, %arg1 : i32
+  %1 = addi %arg0, %arg0 : i64
+  %2 = addf %arg3, %arg3 : f64
+  return %arg2, %0, %1, %2 : i1, i32, i64, f64
+}
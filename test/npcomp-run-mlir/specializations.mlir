@@ -0,0 +1,44 @@
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke f \
+// RUN:   -arg-value="dense<1.0> : tensor<2xf32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=SPECIALIZED
+
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke f \
+// RUN:   -arg-value="dense<1.0> : tensor<3xf32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=FALLBACK
+
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke g \
+// RUN:   -arg-value="dense<1.0> : tensor<4xf32>" \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=NO_FALLBACK
+
+// Calls of `f` are dispatched to the specialization with the most static
+// extents that the inputs match, and to `f` itself otherwise. The
+// specializations compute different results so that we can tell which one ran.
+
+// SPECIALIZED: output #0: dense<3.000000e+00> : tensor<2xf32>
+// FALLBACK: output #0: dense<2.000000e+00> : tensor<3xf32>
+// NO_FALLBACK: output #0: dense<1.000000e+00> : tensor<4xf32>
+
+func @f(%arg0: tensor<?xf32>) -> tensor<?xf32> {
+  %0 = tcf.add %arg0, %arg0 : (tensor<?xf32>, tensor<?xf32>) -> tensor<?xf32>
+  return %0 : tensor<?xf32>
+}
+
+func @f$0(%arg0: tensor<2xf32>) -> tensor<2xf32> {
+  %0 = tcf.add %arg0, %arg0 : (tensor<2xf32>, tensor<2xf32>) -> tensor<2xf32>
+  %1 = tcf.add %0, %arg0 : (tensor<2xf32>, tensor<2xf32>) -> tensor<2xf32>
+  return %1 : tensor<2xf32>
+}
+
+func @f$1(%arg0: tensor<5xf32>) -> tensor<5xf32> {
+  return %arg0 : tensor<5xf32>
+}
+
+func @g$0(%arg0: tensor<4xf32>) -> tensor<4xf32> {
+  return %arg0 : tensor<4xf32>
+}
@@ -0,0 +1,24 @@
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke f \
+// RUN:   -arg-value="dense<[[1.0, 2.0], [3.0, 4.0]]> : tensor<2x2xf32>" \
+// RUN:   -arg-value="dense<[10.0, 20.0]> : tensor<2xf32>" \
+// RUN:   -specialize-batch-sizes=1,2 \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s
+
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke f \
+// RUN:   -arg-value="dense<[[1.0, 2.0], [3.0, 4.0], [5.0, 6.0]]> : tensor<3x2xf32>" \
+// RUN:   -arg-value="dense<[10.0, 20.0]> : tensor<2xf32>" \
+// RUN:   -specialize-batch-sizes=1,2 \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=FALLBACK
+
+// Batch sizes that were not specialized for run the dynamic function.
+
+// CHECK: output #0: dense<{{\[}}[1.100000e+01, 2.200000e+01], [1.300000e+01, 2.400000e+01]]> : tensor<2x2xf32>
+// FALLBACK: output #0: dense<{{\[}}[1.100000e+01, 2.200000e+01], [1.300000e+01, 2.400000e+01], [1.500000e+01, 2.600000e+01]]> : tensor<3x2xf32>
+func @f(%arg0: tensor<?x2xf32>, %arg1: tensor<2xf32>) -> tensor<?x2xf32> {
+  %0 = tcf.add %arg0, %arg1 : (tensor<?x2xf32>, tensor<2xf32>) -> tensor<?x2xf32>
+  return %0 : tensor<?x2xf32>
+}
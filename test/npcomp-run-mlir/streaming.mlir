@@ -0,0 +1,32 @@
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke add_constant_twice \
+// RUN:   -arg-value="dense<[3.0, 5.0]> : tensor<2xf32>" \
+// RUN:   -streaming \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s
+
+// RUN: not npcomp-run-mlir %s \
+// RUN:   -invoke add_constant_twice \
+// RUN:   -arg-value="dense<[3.0, 5.0]> : tensor<2xf32>" \
+// RUN:   -streaming -object-cache-dir=%t \
+// RUN:   -shared-libs=%npcomp_runtime_shlib 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=CACHE
+
+// Each function is compiled separately, and the constant shared by both is
+// defined once, along with the first of them.
+
+// CHECK: output #0: dense<[5.000000e+00, 9.000000e+00]> : tensor<2xf32>
+// CACHE: Error: streaming compilation supports neither lazy compilation nor an object cache
+
+func @add_constant(%arg0: tensor<2xf32>) -> tensor<2xf32> {
+  %0 = constant dense<[1.0, 2.0]> : tensor<2xf32>
+  %1 = tcf.add %arg0, %0 : (tensor<2xf32>, tensor<2xf32>) -> tensor<2xf32>
+  return %1 : tensor<2xf32>
+}
+
+func @add_constant_twice(%arg0: tensor<2xf32>) -> tensor<2xf32> {
+  %0 = constant dense<[1.0, 2.0]> : tensor<2xf32>
+  %1 = tcf.add %arg0, %0 : (tensor<2xf32>, tensor<2xf32>) -> tensor<2xf32>
+  %2 = tcf.add %1, %0 : (tensor<2xf32>, tensor<2xf32>) -> tensor<2xf32>
+  return %2 : tensor<2xf32>
+}
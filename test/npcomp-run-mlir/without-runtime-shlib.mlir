@@ -0,0 +1,13 @@
+// The compiler runtime functions are bound to the runtime linked into the
+// process, without loading the compiler runtime shared library.
+// RUN: npcomp-run-mlir %s \
+// RUN:   -invoke matmul \
+// RUN:   -arg-value="dense<[[1.0, -2.0]]> : tensor<1x2xf32>" \
+// RUN:   -arg-value="dense<[[1.0], [3.0]]> : tensor<2x1xf32>" \
+// RUN:   | FileCheck %s
+
+// CHECK: output #0: dense<-5.000000e+00> : tensor<1x1xf32>
+func @matmul(%arg0: tensor<?x?xf32>, %arg1: tensor<?x?xf32>) -> tensor<?x?xf32> {
+  %0 = tcf.matmul %arg0, %arg1 : (tensor<?x?xf32>, tensor<?x?xf32>) -> tensor<?x?xf32>
+  return %0 : tensor<?x?xf32>
+}
@@ -0,0 +1,53 @@
+// RUN: npcomp-serve-bench %s -invoke add -clients=2 -request-sizes=1,4 \
+// RUN:   -duration=0.2 | FileCheck %s --check-prefix=TABLE
+
+// RUN: npcomp-serve-bench %s -invoke add -clients=2 -request-sizes=1,4 \
+// RUN:   -duration=0.2 -rate=200 -api=into -format=json \
+// RUN:   | FileCheck %s --check-prefix=JSON
+
+// RUN: npcomp-serve-bench %s -invoke add -clients=2 -duration=0.2 \
+// RUN:   -api=async | FileCheck %s --check-prefix=ASYNC
+
+// Only the leading extent of the inputs is the size of the requests.
+// RUN: not npcomp-serve-bench %s -invoke add_2d -duration=0.2 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=DYNAMIC
+
+// TABLE:      serving 'add' through invoke from 2 clients, closed loop
+// TABLE:      throughput:
+// TABLE:      p99.9 latency:
+// TABLE:      CPU utilization:
+// TABLE:      peak RSS:
+// TABLE:      Size   Requests   p50 (ms)   p99 (ms)
+// TABLE-NEXT:    1
+// TABLE-NEXT:    4
+
+// JSON:      "function": "add",
+// JSON-NEXT: "api": "into",
+// JSON-NEXT: "clients": 2,
+// JSON-NEXT: "offered_rate_qps": 200,
+// JSON:      "errors": 0,
+// JSON-NEXT: "qps":
+// JSON:      "by_request_size": [
+// JSON:        "request_size": 1,
+// JSON:        "request_size": 4,
+// JSON:      "cpu": {
+// JSON:        "utilization":
+// JSON:      "memory_mib": {
+// JSON-NEXT:   "rss_before":
+// JSON-NEXT:   "rss_after":
+// JSON-NEXT:   "peak_rss":
+
+// ASYNC:     serving 'add' through async from 2 clients, closed loop
+// ASYNC-NOT: Size
+
+// DYNAMIC: Error: 'add_2d': %arg0 has a dynamic extent other than the leading one
+
+func @add(%arg0: tensor<?x4xf32>, %arg1: tensor<4xf32>) -> tensor<?x4xf32> {
+  %0 = tcf.add %arg0, %arg1 : (tensor<?x4xf32>, tensor<4xf32>) -> tensor<?x4xf32>
+  return %0 : tensor<?x4xf32>
+}
+
+func @add_2d(%arg0: tensor<?x?xf32>) -> tensor<?x?xf32> {
+  %0 = tcf.add %arg0, %arg0 : (tensor<?x?xf32>, tensor<?x?xf32>) -> tensor<?x?xf32>
+  return %0 : tensor<?x?xf32>
+}
@@ -0,0 +1,549 @@
+//===------------------------------------------------------------*- C++ -*-===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Benchmark of the compile time of the npcomp pass pipelines.
+//
+// Generates synthetic modules of increasing size, runs them through a
+// pipeline, and reports the time and heap growth of each pass at each size.
+// From the smallest to the largest size, it estimates how the time of each
+// pass scales with the size of the module, flagging the passes that scale
+// super-linearly. The workloads are:
+//
+//   mlp           N-layer MLPs in the TCF dialect, through
+//                 createTCFRefBackendLoweringPipeline.
+//   object-graph  Chains of N nested torch.nn_module's, through
+//                 createLowerObjectGraphPipeline.
+//   cpa           Basicpy functions of N expressions, through
+//                 npcomp-cpa-type-inference.
+//
+// Compilation is single-threaded, so that the time of each pass doesn't
+// depend on the number of functions it runs on in parallel.
+//
+//===----------------------------------------------------------------------===//
+
+#include "mlir/IR/AsmState.h"
+#include "mlir/InitAllDialects.h"
+#include "mlir/InitAllPasses.h"
+#include "mlir/Parser.h"
+#include "mlir/Pass/PassInstrumentation.h"
+#include "mlir/Pass/PassManager.h"
+#include "npcomp/Dialect/Torch/Transforms/Passes.h"
+#include "npcomp/InitAll.h"
+#include "npcomp/RefBackend/RefBackend.h"
+#include "npcomp/Typing/Transforms/Passes.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/Process.h"
+
+#include <chrono>
+#include <cmath>
+
+using namespace mlir;
+using llvm::Error;
+using llvm::Expected;
+using llvm::StringError;
+using llvm::Twine;
+
+/// Wrap a string into an llvm::StringError.
+static Error make_string_error(const Twine &message) {
+  return llvm::make_error<StringError>(message.str(),
+                                       llvm::inconvertibleErrorCode());
+}
+
+//===----------------------------------------------------------------------===//
+// Workloads.
+//===----------------------------------------------------------------------===//
+
+namespace {
+enum class Workload { Mlp, ObjectGraph, Cpa };
+} // namespace
+
+static StringRef getWorkloadName(Workload workload) {
+  switch (workload) {
+  case Workload::Mlp:
+    return "mlp";
+  case Workload::ObjectGraph:
+    return "object-graph";
+  case Workload::Cpa:
+    return "cpa";
+  }
+  llvm_unreachable("unknown workload");
+}
+
+// A function computing an MLP of `numLayers` layers, each a matmul with its
+// weights, a bias add and a tanh.
+static std::string generateMlp(unsigned numLayers) {
+  std::string text;
+  llvm::raw_string_ostream os(text);
+  const char *type = "tensor<?x?xf32>";
+  os << "func @mlp(%x: " << type;
+  for (unsigned i = 0; i < numLayers; i++)
+    os << ", %w" << i << ": " << type << ", %b" << i << ": " << type;
+  os << ") -> " << type << " {\n";
+  std::string input = "%x";
+  for (unsigned i = 0; i < numLayers; i++) {
+    os << "  %mm" << i << " = tcf.matmul " << input << ", %w" << i << " : ("
+       << type << ", " << type << ") -> " << type << "\n";
+    os << "  %add" << i << " = tcf.add %mm" << i << ", %b" << i << " : ("
+       << type << ", " << type << ") -> " << type << "\n";
+    os << "  %h" << i << " = tcf.tanh %add" << i << " : " << type << "\n";
+    input = "%h" + std::to_string(i);
+  }
+  os << "  return " << input << " : " << type << "\n}\n";
+  return os.str();
+}
+
+// An object graph of `depth` modules, each holding its weights and the next
+// module, whose `forward` methods apply their layer and call the next one, as
+// imported from TorchScript.
+static std::string generateObjectGraph(unsigned depth) {
+  std::string text;
+  llvm::raw_string_ostream os(text);
+  auto moduleType = [](unsigned i) {
+    return "!torch.nn.Module<\"c" + std::to_string(i) + "\">";
+  };
+  for (unsigned i = 0; i < depth; i++) {
+    os << "torch.class_type @c" << i << " {\n"
+       << "  torch.attr \"weight\" : !torch.tensor\n";
+    if (i + 1 < depth)
+      os << "  torch.attr \"child\" : " << moduleType(i + 1) << "\n";
+    os << "  torch.method \"forward\", @c" << i << ".forward\n}\n";
+  }
+  for (unsigned i = 0; i < depth; i++) {
+    os << "func private @c" << i << ".forward(%self: " << moduleType(i)
+       << ", %x: !torch.tensor";
+    // The calling convention of the root is annotated, as the importer does
+    // for the inputs of the program.
+    if (i == 0)
+      os << " {torch.type_bound = !torch.vtensor<[?,16],f32>}";
+    os << ") -> !torch.tensor {\n"
+       << "  %w = torch.prim.GetAttr %self[\"weight\"] : " << moduleType(i)
+       << " -> !torch.tensor\n"
+       << "  %mm = torch.aten.mm %x, %w : !torch.tensor, !torch.tensor -> "
+          "!torch.tensor\n"
+       << "  %h = torch.aten.tanh %mm : !torch.tensor -> !torch.tensor\n";
+    if (i + 1 < depth) {
+      os << "  %child = torch.prim.GetAttr %self[\"child\"] : "
+         << moduleType(i) << " -> " << moduleType(i + 1) << "\n"
+         << "  %y = call @c" << i + 1 << ".forward(%child, %h) : ("
+         << moduleType(i + 1) << ", !torch.tensor) -> !torch.tensor\n"
+         << "  return %y : !torch.tensor\n}\n";
+    } else {
+      os << "  return %h : !torch.tensor\n}\n";
+    }
+  }
+  // The modules are created from the innermost one.
+  for (unsigned i = depth; i-- > 0;) {
+    os << "%w" << i
+       << " = torch.tensor(dense<0.5> : tensor<16x16xf32>) : !torch.tensor\n"
+       << "%m" << i << " = torch.nn_module {\n"
+       << "  torch.slot \"weight\", %w" << i << " : !torch.tensor\n";
+    if (i + 1 < depth)
+      os << "  torch.slot \"child\", %m" << i + 1 << " : "
+         << moduleType(i + 1) << "\n";
+    os << "} : " << moduleType(i) << "\n";
+  }
+  return os.str();
+}
+
+// A function of `numExprs` arithmetic expressions on its untyped arguments
+// and constants, as imported from Python.
+static std::string generateCpaProgram(unsigned numExprs) {
+  std::string text;
+  llvm::raw_string_ostream os(text);
+  const char *unknown = "!basicpy.UnknownType";
+  const char *ops[] = {"Add", "Mult", "Sub"};
+  os << "func @program(%a: " << unknown << ", %b: " << unknown << ") -> "
+     << unknown << " {\n"
+     << "  %c2 = constant 2 : i64\n";
+  std::string previous = "%a";
+  for (unsigned i = 0; i < numExprs; i++) {
+    // Alternate between combining with the other argument and a constant.
+    bool withConstant = i % 2;
+    os << "  %v" << i << " = basicpy.binary_expr " << previous << " \""
+       << ops[i % 3] << "\" " << (withConstant ? "%c2" : "%b") << " : ("
+       << unknown << ", " << (withConstant ? "i64" : unknown) << ") -> "
+       << unknown << "\n";
+    previous = "%v" + std::to_string(i);
+  }
+  os << "  return " << previous << " : " << unknown << "\n}\n";
+  return os.str();
+}
+
+static std::string generateModule(Workload workload, unsigned size) {
+  switch (workload) {
+  case Workload::Mlp:
+    return generateMlp(size);
+  case Workload::ObjectGraph:
+    return generateObjectGraph(size);
+  case Workload::Cpa:
+    return generateCpaProgram(size);
+  }
+  llvm_unreachable("unknown workload");
+}
+
+static void buildPipeline(Workload workload, OpPassManager &pm,
+                          bool optimize) {
+  switch (workload) {
+  case Workload::Mlp: {
+    NPCOMP::RefBackendLoweringPipelineOptions options;
+    options.optimize = optimize;
+    NPCOMP::createTCFRefBackendLoweringPipeline(pm, options);
+    return;
+  }
+  case Workload::ObjectGraph: {
+    NPCOMP::Torch::TorchLoweringPipelineOptions options;
+    options.optimize = optimize;
+    NPCOMP::Torch::createLowerObjectGraphPipeline(pm, options);
+    return;
+  }
+  case Workload::Cpa:
+    pm.addNestedPass<FuncOp>(
+        NPCOMP::Typing::createCPAFunctionTypeInferencePass());
+    return;
+  }
+  llvm_unreachable("unknown workload");
+}
+
+//===----------------------------------------------------------------------===//
+// Measurement.
+//===----------------------------------------------------------------------===//
+
+using Clock = std::chrono::steady_clock;
+
+static double getMilliseconds(Clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+namespace {
+// The cost of the runs of a pass on one module.
+struct PassCost {
+  double time = 0;
+  int64_t heapGrowth = 0;
+  unsigned numRuns = 0;
+};
+
+// The cost of compiling the module of one size.
+struct SizeResult {
+  unsigned size;
+  double parseTime;
+  double totalTime;
+  size_t peakHeapUsage;
+  // In the order the passes first finished running.
+  llvm::MapVector<std::string, PassCost> passes;
+};
+
+// Records the time and heap growth of each pass. Since compilation is
+// single-threaded, the runs of the passes are properly nested.
+class PassCostInstrumentation : public PassInstrumentation {
+public:
+  explicit PassCostInstrumentation(SizeResult &result) : result(result) {}
+
+  void runBeforePass(Pass *pass, Operation *op) override {
+    starts.push_back({Clock::now(), llvm::sys::Process::GetMallocUsage()});
+  }
+  void runAfterPass(Pass *pass, Operation *op) override { recordRun(pass); }
+  void runAfterPassFailed(Pass *pass, Operation *op) override {
+    recordRun(pass);
+  }
+
+private:
+  struct Start {
+    Clock::time_point time;
+    size_t heapUsage;
+  };
+
+  void recordRun(Pass *pass) {
+    Clock::time_point end = Clock::now();
+    size_t heapUsage = llvm::sys::Process::GetMallocUsage();
+    Start start = starts.pop_back_val();
+    result.peakHeapUsage = std::max(result.peakHeapUsage, heapUsage);
+    // Pass adaptors, which run nested pipelines, have no argument. Their
+    // cost is that of the passes they run, so they aren't reported.
+    if (pass->getArgument().empty())
+      return;
+    PassCost &cost = result.passes[pass->getArgument().str()];
+    cost.time += getMilliseconds(end - start.time);
+    cost.heapGrowth += static_cast<int64_t>(heapUsage) -
+                       static_cast<int64_t>(start.heapUsage);
+    cost.numRuns++;
+  }
+
+  SizeResult &result;
+  SmallVector<Start, 4> starts;
+};
+} // namespace
+
+static Expected<SizeResult> compileModule(Workload workload, unsigned size,
+                                          bool optimize,
+                                          MLIRContext &context) {
+  SizeResult result;
+  result.size = size;
+  result.peakHeapUsage = 0;
+  std::string text = generateModule(workload, size);
+
+  Clock::time_point start = Clock::now();
+  OwningModuleRef module = parseSourceString(text, &context);
+  if (!module)
+    return make_string_error("could not parse the " +
+                             Twine(getWorkloadName(workload)) +
+                             " module of size " + Twine(size));
+  result.parseTime = getMilliseconds(Clock::now() - start);
+
+  PassManager pm(&context, OpPassManager::Nesting::Implicit);
+  applyPassManagerCLOptions(pm);
+  pm.addInstrumentation(std::make_unique<PassCostInstrumentation>(result));
+  buildPipeline(workload, pm, optimize);
+  start = Clock::now();
+  if (failed(pm.run(*module)))
+    return make_string_error("compiling the " +
+                             Twine(getWorkloadName(workload)) +
+                             " module of size " + Twine(size) + " failed");
+  result.totalTime = getMilliseconds(Clock::now() - start);
+  return result;
+}
+
+namespace {
+// How the time of a pass grows from the smallest to the largest size.
+struct PassScaling {
+  std::string pass;
+  double firstTime;
+  double lastTime;
+  // The exponent `k` of the fit `time ~ size^k`, or NaN if the pass is too
+  // fast at the smallest size to measure it.
+  double exponent;
+  bool superLinear;
+};
+} // namespace
+
+static std::vector<PassScaling>
+computeScaling(ArrayRef<SizeResult> results, double maxExponent,
+               double minTime) {
+  std::vector<PassScaling> scaling;
+  if (results.size() < 2)
+    return scaling;
+  const SizeResult &first = results.front();
+  const SizeResult &last = results.back();
+  double sizeRatio = static_cast<double>(last.size) / first.size;
+  for (auto &entry : last.passes) {
+    PassScaling passScaling;
+    passScaling.pass = entry.first;
+    passScaling.lastTime = entry.second.time;
+    auto firstCost = first.passes.find(entry.first);
+    passScaling.firstTime =
+        firstCost == first.passes.end() ? 0 : firstCost->second.time;
+    passScaling.exponent =
+        passScaling.firstTime < minTime || sizeRatio <= 1
+            ? NAN
+            : std::log(passScaling.lastTime / passScaling.firstTime) /
+                  std::log(sizeRatio);
+    // Passes too fast to measure at the smallest size are only flagged if
+    // they become slow at the largest one.
+    passScaling.superLinear =
+        std::isnan(passScaling.exponent)
+            ? passScaling.lastTime >= minTime * std::pow(sizeRatio, maxExponent)
+            : passScaling.exponent > maxExponent;
+    scaling.push_back(std::move(passScaling));
+  }
+  return scaling;
+}
+
+//===----------------------------------------------------------------------===//
+// Reporting.
+//===----------------------------------------------------------------------===//
+
+namespace {
+enum class ReportFormat { Table, Json };
+} // namespace
+
+static void printTable(Workload workload, ArrayRef<SizeResult> results,
+                       ArrayRef<PassScaling> scaling, llvm::raw_ostream &os) {
+  for (const SizeResult &result : results) {
+    os << "===" << std::string(73, '-') << "===\n"
+       << "  " << getWorkloadName(workload) << ", size " << result.size
+       << "\n"
+       << "===" << std::string(73, '-') << "===\n"
+       << llvm::format("  Parse time: %.3f ms\n", result.parseTime)
+       << llvm::format("  Total pass time: %.3f ms\n", result.totalTime)
+       << llvm::format("  Peak heap usage after a pass: %.1f MiB\n\n",
+                       result.peakHeapUsage / (1024.0 * 1024.0))
+       << "    Time (ms)  Heap growth (KiB)   Runs  Name\n";
+    for (auto &entry : result.passes)
+      os << llvm::format("  %11.3f  %17.1f %6u  ", entry.second.time,
+                         entry.second.heapGrowth / 1024.0,
+                         entry.second.numRuns)
+         << entry.first << "\n";
+  }
+  if (scaling.empty())
+    return;
+  os << "===" << std::string(73, '-') << "===\n"
+     << "  " << getWorkloadName(workload) << ", scaling from size "
+     << results.front().size << " to " << results.back().size << "\n"
+     << "===" << std::string(73, '-') << "===\n"
+     << "   Exponent  First (ms)   Last (ms)  Name\n";
+  for (const PassScaling &passScaling : scaling) {
+    if (std::isnan(passScaling.exponent))
+      os << "          -";
+    else
+      os << llvm::format("  %9.2f", passScaling.exponent);
+    os << llvm::format("  %10.3f  %10.3f  ", passScaling.firstTime,
+                       passScaling.lastTime)
+       << passScaling.pass
+       << (passScaling.superLinear ? "  (super-linear)" : "") << "\n";
+  }
+}
+
+static void printJson(Workload workload, ArrayRef<SizeResult> results,
+                      ArrayRef<PassScaling> scaling, llvm::raw_ostream &os) {
+  llvm::json::OStream json(os, /*IndentSize=*/2);
+  json.object([&] {
+    json.attribute("workload", getWorkloadName(workload));
+    json.attributeArray("sizes", [&] {
+      for (const SizeResult &result : results) {
+        json.object([&] {
+          json.attribute("size", result.size);
+          json.attribute("parse_time_ms", result.parseTime);
+          json.attribute("total_time_ms", result.totalTime);
+          json.attribute("peak_heap_mib",
+                         result.peakHeapUsage / (1024.0 * 1024.0));
+          json.attributeArray("passes", [&] {
+            for (auto &entry : result.passes) {
+              json.object([&] {
+                json.attribute("name", entry.first);
+                json.attribute("time_ms", entry.second.time);
+                json.attribute("heap_growth_kib",
+                               entry.second.heapGrowth / 1024.0);
+                json.attribute("runs", entry.second.numRuns);
+              });
+            }
+          });
+        });
+      }
+    });
+    json.attributeArray("scaling", [&] {
+      for (const PassScaling &passScaling : scaling) {
+        json.object([&] {
+          json.attribute("name", passScaling.pass);
+          if (std::isnan(passScaling.exponent))
+            json.attribute("exponent", nullptr);
+          else
+            json.attribute("exponent", passScaling.exponent);
+          json.attribute("super_linear", passScaling.superLinear);
+        });
+      }
+    });
+  });
+  os << "\n";
+}
+
+//===----------------------------------------------------------------------===//
+// Main-related init and option parsing.
+//===----------------------------------------------------------------------===//
+
+namespace {
+namespace cl = llvm::cl;
+struct Options {
+  cl::opt<Workload> workload{
+      "workload", cl::Required, cl::desc("the synthetic modules to compile"),
+      cl::values(clEnumValN(Workload::Mlp, "mlp",
+                            "N-layer MLPs in the TCF dialect"),
+                 clEnumValN(Workload::ObjectGraph, "object-graph",
+                            "chains of N nested torch.nn_module's"),
+                 clEnumValN(Workload::Cpa, "cpa",
+                            "Basicpy functions of N expressions"))};
+  cl::list<unsigned> sizes{
+      "sizes", cl::ZeroOrMore, cl::MiscFlags::CommaSeparated,
+      cl::desc("the sizes N of the modules to compile (default: 8,16,32,64)")};
+  cl::opt<bool> optimize{
+      "optimize", cl::Optional,
+      cl::desc("whether the pipelines should run optimizations"),
+      cl::init(true)};
+  cl::opt<double> maxExponent{
+      "max-exponent", cl::Optional,
+      cl::desc("the scaling exponent above which a pass is super-linear"),
+      cl::init(1.5)};
+  cl::opt<double> minTime{
+      "min-time", cl::Optional,
+      cl::desc("the time in ms below which the time of a pass is too short "
+               "to estimate its scaling"),
+      cl::init(0.5)};
+  cl::opt<bool> failOnSuperLinear{
+      "fail-on-super-linear", cl::Optional,
+      cl::desc("exit with a failure if a pass scales super-linearly"),
+      cl::init(false)};
+  cl::opt<ReportFormat> format{
+      "format", cl::Optional, cl::desc("the format of the report"),
+      cl::values(clEnumValN(ReportFormat::Table, "table", "a text table"),
+                 clEnumValN(ReportFormat::Json, "json", "a JSON object")),
+      cl::init(ReportFormat::Table)};
+};
+} // namespace
+
+static Error runBenchmark(const Options &options, MLIRContext &context,
+                          bool &anySuperLinear) {
+  SmallVector<unsigned, 4> sizes(options.sizes.begin(), options.sizes.end());
+  if (sizes.empty())
+    sizes = {8, 16, 32, 64};
+  llvm::sort(sizes);
+  if (sizes.front() == 0)
+    return make_string_error("sizes must be positive");
+
+  std::vector<SizeResult> results;
+  for (unsigned size : sizes) {
+    auto result = compileModule(options.workload, size, options.optimize,
+                                context);
+    if (!result)
+      return result.takeError();
+    results.push_back(std::move(*result));
+  }
+  std::vector<PassScaling> scaling =
+      computeScaling(results, options.maxExponent, options.minTime);
+  anySuperLinear = llvm::any_of(
+      scaling, [](const PassScaling &s) { return s.superLinear; });
+  if (options.format == ReportFormat::Json)
+    printJson(options.workload, results, scaling, llvm::outs());
+  else
+    printTable(options.workload, results, scaling, llvm::outs());
+  return Error::success();
+}
+
+int main(int argc, char **argv) {
+  mlir::DialectRegistry registry;
+  mlir::registerAllDialects(registry);
+  mlir::registerAllPasses();
+  mlir::NPCOMP::registerAllDialects(registry);
+  mlir::NPCOMP::registerAllPasses();
+  MLIRContext context;
+  context.appendDialectRegistry(registry);
+  context.loadAllAvailableDialects();
+  context.disableMultithreading();
+
+  llvm::InitLLVM y(argc, argv);
+  mlir::registerAsmPrinterCLOptions();
+  mlir::registerPassManagerCLOptions();
+  Options options;
+  llvm::cl::ParseCommandLineOptions(argc, argv,
+                                    "npcomp compile-time benchmark\n");
+
+  bool anySuperLinear = false;
+  Error error = runBenchmark(options, context, anySuperLinear);
+
+  int exitCode = EXIT_SUCCESS;
+  llvm::handleAllErrors(std::move(error),
+                        [&exitCode](const llvm::ErrorInfoBase &info) {
+                          llvm::errs() << "Error: ";
+                          info.log(llvm::errs());
+                          llvm::errs() << '\n';
+                          exitCode = EXIT_FAILURE;
+                        });
+  if (anySuperLinear && options.failOnSuperLinear)
+    exitCode = EXIT_FAILURE;
+  return exitCode;
+}
@@ -0,0 +1,570 @@
+//===------------------------------------------------------------*- C++ -*-===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Utility binary for compiling code through the npcomp compiler stack ahead of
+// time, into an object file or a shared object that refbackrt::loadModule
+// loads without needing LLVM.
+//
+// The compiled code calls the compiler runtime (`__npcomp_compiler_rt_*`)
+// through function pointers named `<function>_ptr`, which the loader points
+// at the runtime it is part of. That way, the shared object has no undefined
+// symbols from the runtime, and the compiled code shares the allocator and
+// thread pool of the process that loads it.
+//
+// The storage of external weights (see refback::getExternalElementsAttr) is
+// embedded into the output, which therefore doesn't depend on their files.
+// With -external-weights, the output instead lists the files and the loader
+// maps them read-only, so that the weights are only read from disk as the
+// compiled code touches them (and are shared between the processes using
+// them). Files in the directory of the output are listed relative to it.
+// With -compress-weights, the output embeds them compressed instead (see
+// WeightCompression.h), which the loader decompresses when loading it.
+//
+//===----------------------------------------------------------------------===//
+
+#include "mlir/ExecutionEngine/OptUtils.h"
+#include "mlir/IR/AsmState.h"
+#include "mlir/InitAllDialects.h"
+#include "mlir/InitAllPasses.h"
+#include "mlir/Pass/PassManager.h"
+#include "mlir/Target/LLVMIR/Dialect/LLVMIR/LLVMToLLVMIRTranslation.h"
+#include "mlir/Target/LLVMIR/Export.h"
+#include "npcomp-c/InitLLVM.h"
+#include "npcomp/InitAll.h"
+#include "npcomp/RefBackend/JITHelpers/JITModule.h"
+#include "npcomp/RefBackend/RefBackend.h"
+#include "npcomp/RefBackend/Runtime/WeightCompression.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/MC/SubtargetFeature.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include <map>
+#include <tuple>
+
+using namespace mlir;
+using llvm::Error;
+using llvm::Expected;
+using llvm::StringError;
+using llvm::Twine;
+
+/// Wrap a string into an llvm::StringError.
+static Error make_string_error(const Twine &message) {
+  return llvm::make_error<StringError>(message.str(),
+                                       llvm::inconvertibleErrorCode());
+}
+
+// Defines each compiler runtime function that `module` calls as a thunk
+// calling through a function pointer `<function>_ptr` exported by the module.
+static void bindCompilerRuntimeThroughPointers(llvm::Module &module) {
+  for (llvm::Function &function : module.functions()) {
+    if (!function.isDeclaration() ||
+        !function.getName().startswith("__npcomp_compiler_rt_"))
+      continue;
+    auto *pointer = new llvm::GlobalVariable(
+        module, function.getType(), /*isConstant=*/false,
+        llvm::GlobalValue::ExternalLinkage,
+        llvm::Constant::getNullValue(function.getType()),
+        function.getName() + "_ptr");
+    function.setLinkage(llvm::GlobalValue::InternalLinkage);
+    llvm::IRBuilder<> builder(
+        llvm::BasicBlock::Create(module.getContext(), "entry", &function));
+    llvm::Value *callee =
+        builder.CreateLoad(function.getType(), pointer, "callee");
+    llvm::SmallVector<llvm::Value *, 6> args;
+    for (llvm::Argument &arg : function.args())
+      args.push_back(&arg);
+    llvm::CallInst *call =
+        builder.CreateCall(function.getFunctionType(), callee, args);
+    call->setTailCall();
+    if (function.getReturnType()->isVoidTy())
+      builder.CreateRetVoid();
+    else
+      builder.CreateRet(call);
+  }
+}
+
+// Embeds the storage of the external globals of `module` (see
+// mlir::NPCOMP::getExternalGlobals) into `llvmModule`, its translation to LLVM
+// IR, so that the compiled code doesn't depend on the files storing them.
+static void embedExternalGlobals(ModuleOp module, llvm::Module &llvmModule) {
+  for (const NPCOMP::ExternalGlobal &global :
+       NPCOMP::getExternalGlobals(module)) {
+    std::string path;
+    for (char c : global.path) {
+      if (c == '"' || c == '\\')
+        path += '\\';
+      path += c;
+    }
+    // The definition is local to the shared object.
+    if (llvm::GlobalVariable *declaration =
+            llvmModule.getNamedGlobal(global.symbol))
+      declaration->setVisibility(llvm::GlobalValue::HiddenVisibility);
+    llvmModule.appendModuleInlineAsm(
+        (".pushsection .rodata.npcomp_external,\"a\",@progbits\n"
+         ".globl " + global.symbol + "\n"
+         ".hidden " + global.symbol + "\n"
+         ".p2align 6\n" +
+         global.symbol + ":\n"
+         ".incbin \"" + path + "\", " + Twine(global.offset) + ", " +
+         Twine(global.size) + "\n"
+         ".popsection")
+            .str());
+  }
+}
+
+// Materializes the constant expression `expr` as an instruction at each of its
+// uses by instructions, starting with the constant expressions using it.
+static void materializeConstantExpr(llvm::ConstantExpr *expr) {
+  llvm::SmallVector<llvm::User *, 8> users(expr->users());
+  for (llvm::User *user : users)
+    if (auto *userExpr = llvm::dyn_cast<llvm::ConstantExpr>(user))
+      materializeConstantExpr(userExpr);
+  for (llvm::Use &use : llvm::make_early_inc_range(expr->uses())) {
+    auto *user = llvm::dyn_cast<llvm::Instruction>(use.getUser());
+    if (!user)
+      continue;
+    llvm::Instruction *insertionPoint = user;
+    if (auto *phi = llvm::dyn_cast<llvm::PHINode>(user))
+      insertionPoint = phi->getIncomingBlock(use)->getTerminator();
+    llvm::Instruction *instruction = expr->getAsInstruction();
+    instruction->insertBefore(insertionPoint);
+    use.set(instruction);
+  }
+  if (expr->use_empty())
+    expr->destroyConstant();
+}
+
+// Makes the compiled code read the global `declaration` through a pointer
+// `<symbol>_ptr` that whoever loads it sets, loaded once at the entry of each
+// function using the global, and erases the declaration. Returns the pointer.
+static Expected<llvm::GlobalVariable *>
+readThroughPointer(llvm::GlobalVariable *declaration,
+                   const std::string &symbol) {
+  auto *pointer = new llvm::GlobalVariable(
+      *declaration->getParent(), declaration->getType(), /*isConstant=*/false,
+      llvm::GlobalValue::InternalLinkage,
+      llvm::Constant::getNullValue(declaration->getType()), symbol + "_ptr");
+
+  llvm::SmallVector<llvm::User *, 8> users(declaration->users());
+  for (llvm::User *user : users)
+    if (auto *expr = llvm::dyn_cast<llvm::ConstantExpr>(user))
+      materializeConstantExpr(expr);
+  llvm::DenseMap<llvm::Function *, llvm::Value *> loads;
+  for (llvm::Use &use : llvm::make_early_inc_range(declaration->uses())) {
+    auto *user = llvm::dyn_cast<llvm::Instruction>(use.getUser());
+    if (!user)
+      return make_string_error("external global " + symbol +
+                               " is used outside of functions");
+    llvm::Function *function = user->getFunction();
+    llvm::Value *&load = loads[function];
+    if (!load) {
+      llvm::IRBuilder<> builder(
+          &*function->getEntryBlock().getFirstInsertionPt());
+      load = builder.CreateLoad(declaration->getType(), pointer, symbol);
+    }
+    use.set(load);
+  }
+  declaration->eraseFromParent();
+  return pointer;
+}
+
+// Makes the compiled code read the external globals of `module` (see
+// mlir::NPCOMP::getExternalGlobals) through pointers that the loader sets to
+// their storage, mapped from their files, and lists the files in the table
+// `__npcomp_external_weights`, terminated by an entry with a null path. The
+// files in the directory of `outputFile` are listed by name, and others by
+// absolute path.
+static Error loadExternalGlobalsThroughPointers(ModuleOp module,
+                                               llvm::Module &llvmModule,
+                                               StringRef outputFile) {
+  llvm::SmallVector<NPCOMP::ExternalGlobal, 4> externalGlobals =
+      NPCOMP::getExternalGlobals(module);
+  if (externalGlobals.empty())
+    return Error::success();
+
+  llvm::LLVMContext &context = llvmModule.getContext();
+  auto *i8PtrTy = llvm::Type::getInt8PtrTy(context);
+  auto *i64Ty = llvm::Type::getInt64Ty(context);
+  auto *entryTy = llvm::StructType::get(
+      context, {i8PtrTy, i64Ty, i64Ty, i8PtrTy->getPointerTo()});
+  llvm::SmallString<128> outputDirectory(outputFile);
+  llvm::sys::fs::make_absolute(outputDirectory);
+  llvm::sys::path::remove_dots(outputDirectory, /*remove_dot_dot=*/true);
+  llvm::sys::path::remove_filename(outputDirectory);
+
+  llvm::SmallVector<llvm::Constant *, 4> entries;
+  for (const NPCOMP::ExternalGlobal &global : externalGlobals) {
+    llvm::GlobalVariable *declaration =
+        llvmModule.getNamedGlobal(global.symbol);
+    if (!declaration)
+      continue;
+    Expected<llvm::GlobalVariable *> pointer =
+        readThroughPointer(declaration, global.symbol);
+    if (!pointer)
+      return pointer.takeError();
+
+    llvm::SmallString<128> path(global.path);
+    llvm::sys::fs::make_absolute(path);
+    llvm::sys::path::remove_dots(path, /*remove_dot_dot=*/true);
+    StringRef listedPath = path;
+    if (llvm::sys::path::parent_path(path) == outputDirectory)
+      listedPath = llvm::sys::path::filename(path);
+    auto *pathGlobal = new llvm::GlobalVariable(
+        llvmModule, llvm::ArrayType::get(llvm::Type::getInt8Ty(context),
+                                         listedPath.size() + 1),
+        /*isConstant=*/true, llvm::GlobalValue::PrivateLinkage,
+        llvm::ConstantDataArray::getString(context, listedPath),
+        global.symbol + "_path");
+    entries.push_back(llvm::ConstantStruct::get(
+        entryTy,
+        {llvm::ConstantExpr::getPointerCast(pathGlobal, i8PtrTy),
+         llvm::ConstantInt::get(i64Ty, global.offset),
+         llvm::ConstantInt::get(i64Ty, global.size),
+         llvm::ConstantExpr::getPointerCast(*pointer,
+                                            i8PtrTy->getPointerTo())}));
+  }
+  entries.push_back(llvm::Constant::getNullValue(entryTy));
+  auto *tableTy = llvm::ArrayType::get(entryTy, entries.size());
+  new llvm::GlobalVariable(llvmModule, tableTy, /*isConstant=*/true,
+                           llvm::GlobalValue::ExternalLinkage,
+                           llvm::ConstantArray::get(tableTy, entries),
+                           "__npcomp_external_weights");
+  return Error::success();
+}
+
+// Embeds the storage of the external globals of `module` (see
+// mlir::NPCOMP::getExternalGlobals) into `llvmModule` compressed with
+// refbackrt::compressWeights, and makes the compiled code read them through
+// pointers that the loader sets to decompressed copies. The globals are
+// listed in the table `__npcomp_compressed_weights`, terminated by an entry
+// with null data.
+static Error compressExternalGlobals(ModuleOp module,
+                                     llvm::Module &llvmModule) {
+  llvm::SmallVector<NPCOMP::ExternalGlobal, 4> externalGlobals =
+      NPCOMP::getExternalGlobals(module);
+  if (externalGlobals.empty())
+    return Error::success();
+
+  llvm::LLVMContext &context = llvmModule.getContext();
+  auto *i8PtrTy = llvm::Type::getInt8PtrTy(context);
+  auto *i64Ty = llvm::Type::getInt64Ty(context);
+  auto *entryTy = llvm::StructType::get(
+      context, {i8PtrTy, i64Ty, i64Ty, i8PtrTy->getPointerTo()});
+
+  llvm::StringMap<std::unique_ptr<llvm::MemoryBuffer>> files;
+  // Globals with the same storage (such as tied weights) share their
+  // compressed data.
+  std::map<std::tuple<std::string, uint64_t, uint64_t>,
+           std::pair<llvm::GlobalVariable *, uint64_t>>
+      compressedData;
+  llvm::SmallVector<llvm::Constant *, 4> entries;
+  for (const NPCOMP::ExternalGlobal &global : externalGlobals) {
+    llvm::GlobalVariable *declaration =
+        llvmModule.getNamedGlobal(global.symbol);
+    if (!declaration)
+      continue;
+    // Byte planes are formed from the elements of the (nested) array.
+    llvm::Type *elementType = declaration->getValueType();
+    while (auto *arrayType = llvm::dyn_cast<llvm::ArrayType>(elementType))
+      elementType = arrayType->getElementType();
+    uint64_t elementBytes =
+        llvm::divideCeil(elementType->getScalarSizeInBits(), 8);
+
+    auto &data = compressedData[std::make_tuple(global.path, global.offset,
+                                                global.size)];
+    if (!data.first) {
+      std::unique_ptr<llvm::MemoryBuffer> &file = files[global.path];
+      if (!file) {
+        auto buffer = llvm::MemoryBuffer::getFile(
+            global.path, /*FileSize=*/-1, /*RequiresNullTerminator=*/false);
+        if (!buffer)
+          return make_string_error("could not open " + global.path + ": " +
+                                   buffer.getError().message());
+        file = std::move(*buffer);
+      }
+      if (global.offset + global.size > file->getBufferSize())
+        return make_string_error(global.path + " is too small");
+      std::vector<char> compressed;
+      refbackrt::compressWeights(file->getBufferStart() + global.offset,
+                                 global.size, elementBytes, compressed);
+      auto *dataGlobal = new llvm::GlobalVariable(
+          llvmModule,
+          llvm::ArrayType::get(llvm::Type::getInt8Ty(context),
+                               compressed.size()),
+          /*isConstant=*/true, llvm::GlobalValue::PrivateLinkage,
+          llvm::ConstantDataArray::get(
+              context,
+              llvm::makeArrayRef(
+                  reinterpret_cast<const uint8_t *>(compressed.data()),
+                  compressed.size())),
+          global.symbol + "_compressed");
+      data = {dataGlobal, compressed.size()};
+    }
+
+    Expected<llvm::GlobalVariable *> pointer =
+        readThroughPointer(declaration, global.symbol);
+    if (!pointer)
+      return pointer.takeError();
+    entries.push_back(llvm::ConstantStruct::get(
+        entryTy,
+        {llvm::ConstantExpr::getPointerCast(data.first, i8PtrTy),
+         llvm::ConstantInt::get(i64Ty, data.second),
+         llvm::ConstantInt::get(i64Ty, global.size),
+         llvm::ConstantExpr::getPointerCast(*pointer,
+                                            i8PtrTy->getPointerTo())}));
+  }
+  entries.push_back(llvm::Constant::getNullValue(entryTy));
+  auto *tableTy = llvm::ArrayType::get(entryTy, entries.size());
+  new llvm::GlobalVariable(llvmModule, tableTy, /*isConstant=*/true,
+                           llvm::GlobalValue::ExternalLinkage,
+                           llvm::ConstantArray::get(tableTy, entries),
+                           "__npcomp_compressed_weights");
+  return Error::success();
+}
+
+// Returns a target machine generating position-independent code at
+// `optLevel` for `cpu` (the host CPU if empty or "native") with `features`
+// enabled or disabled on top of those of the CPU.
+static Expected<std::unique_ptr<llvm::TargetMachine>>
+createTargetMachine(StringRef cpu, StringRef features, unsigned optLevel) {
+  std::string triple = llvm::sys::getProcessTriple();
+  std::string errorMessage;
+  const llvm::Target *target =
+      llvm::TargetRegistry::lookupTarget(triple, errorMessage);
+  if (!target)
+    return make_string_error(errorMessage);
+  if (optLevel > 3)
+    return make_string_error("invalid LLVM optimization level " +
+                             Twine(optLevel));
+  llvm::SubtargetFeatures allFeatures;
+  if (cpu.empty() || cpu == "native") {
+    cpu = llvm::sys::getHostCPUName();
+    llvm::StringMap<bool> hostFeatures;
+    if (llvm::sys::getHostCPUFeatures(hostFeatures))
+      for (auto &feature : hostFeatures)
+        allFeatures.AddFeature(feature.first(), feature.second);
+  }
+  SmallVector<StringRef, 8> extraFeatures;
+  features.split(extraFeatures, ',', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+  for (StringRef feature : extraFeatures)
+    allFeatures.AddFeature(feature.trim());
+  return std::unique_ptr<llvm::TargetMachine>(target->createTargetMachine(
+      triple, cpu, allFeatures.getString(), llvm::TargetOptions(),
+      llvm::Reloc::PIC_, /*CM=*/llvm::None,
+      static_cast<llvm::CodeGenOpt::Level>(optLevel)));
+}
+
+static Error writeObjectFile(llvm::Module &module,
+                             llvm::TargetMachine &targetMachine,
+                             StringRef path) {
+  std::error_code error;
+  llvm::ToolOutputFile output(path, error, llvm::sys::fs::OF_None);
+  if (error)
+    return make_string_error("could not open " + Twine(path) + ": " +
+                             error.message());
+  llvm::legacy::PassManager pm;
+  if (targetMachine.addPassesToEmitFile(pm, output.os(), nullptr,
+                                        llvm::CGFT_ObjectFile))
+    return make_string_error("the target can't emit object files");
+  pm.run(module);
+  output.keep();
+  return Error::success();
+}
+
+// Links the object file at `objectPath` into the shared object `path` with
+// the system C compiler.
+static Error linkSharedObject(StringRef objectPath, StringRef path) {
+  auto compiler = llvm::sys::findProgramByName("cc");
+  if (!compiler)
+    return make_string_error("could not find the system C compiler (cc) to "
+                             "link " + Twine(path));
+  StringRef args[] = {*compiler, "-shared", objectPath, "-o", path};
+  std::string errorMessage;
+  if (llvm::sys::ExecuteAndWait(*compiler, args, /*Env=*/llvm::None,
+                                /*Redirects=*/{}, /*SecondsToWait=*/0,
+                                /*MemoryLimit=*/0, &errorMessage))
+    return make_string_error("linking " + Twine(path) + " failed: " +
+                             errorMessage);
+  return Error::success();
+}
+
+Error compile(std::string mlirFile, mlir::MLIRContext &context,
+              StringRef outputFile, bool optimize, bool profileOps,
+              bool externalWeights, bool compressWeights,
+              bool prefetchWeights, unsigned optLevel, StringRef cpu,
+              StringRef features) {
+  if (externalWeights && compressWeights)
+    return make_string_error(
+        "-external-weights and -compress-weights are exclusive");
+
+  OwningModuleRef moduleRef =
+      refback::JITModule::parseModuleFile(mlirFile, context);
+  if (!moduleRef)
+    return make_string_error(Twine("could not open ") + mlirFile);
+  ModuleOp module = *moduleRef;
+
+  auto expectedTargetMachine = createTargetMachine(cpu, features, optLevel);
+  if (!expectedTargetMachine)
+    return expectedTargetMachine.takeError();
+  llvm::TargetMachine &targetMachine = **expectedTargetMachine;
+
+  // Optimize for the CPU that the shared object is compiled for, rather than
+  // for the host.
+  NPCOMP::TargetInfo target = refback::JITModule::getTargetInfo(
+      targetMachine, /*isHost=*/cpu.empty() || cpu == "native");
+  PassManager pm(module.getContext(), OpPassManager::Nesting::Implicit);
+  applyPassManagerCLOptions(pm);
+  NPCOMP::RefBackendLoweringPipelineOptions pipelineOptions;
+  pipelineOptions.optimize = optimize;
+  pipelineOptions.profileOps = profileOps;
+  pipelineOptions.prefetchWeights = prefetchWeights;
+  NPCOMP::setTargetInfo(pipelineOptions, target);
+  refback::JITModule::buildBackendCompilationPipeline(pm, pipelineOptions);
+  if (failed(pm.run(module)))
+    return make_string_error(Twine("error compiling to the backend"));
+
+  mlir::registerLLVMDialectTranslation(context);
+  llvm::LLVMContext llvmContext;
+  std::unique_ptr<llvm::Module> llvmModule =
+      mlir::translateModuleToLLVMIR(module, llvmContext);
+  if (!llvmModule)
+    return make_string_error("could not translate the module to LLVM IR");
+  bindCompilerRuntimeThroughPointers(*llvmModule);
+  if (externalWeights) {
+    if (Error error =
+            loadExternalGlobalsThroughPointers(module, *llvmModule, outputFile))
+      return error;
+  } else if (compressWeights) {
+    if (Error error = compressExternalGlobals(module, *llvmModule))
+      return error;
+  } else {
+    embedExternalGlobals(module, *llvmModule);
+  }
+
+  llvmModule->setTargetTriple(targetMachine.getTargetTriple().str());
+  llvmModule->setDataLayout(targetMachine.createDataLayout());
+  auto transformer = mlir::makeOptimizingTransformer(
+      optLevel, /*sizeLevel=*/0, &targetMachine);
+  if (Error error = transformer(llvmModule.get()))
+    return error;
+
+  if (!outputFile.endswith(".so"))
+    return writeObjectFile(*llvmModule, targetMachine, outputFile);
+
+  llvm::SmallString<128> objectPath;
+  if (std::error_code error =
+          llvm::sys::fs::createTemporaryFile("npcomp-compile", "o",
+                                             objectPath))
+    return make_string_error("could not create a temporary file: " +
+                             error.message());
+  llvm::FileRemover objectRemover(objectPath);
+  if (Error error = writeObjectFile(*llvmModule, targetMachine, objectPath))
+    return error;
+  return linkSharedObject(objectPath, outputFile);
+}
+
+//===----------------------------------------------------------------------===//
+// Main-related init and option parsing.
+//===----------------------------------------------------------------------===//
+
+namespace {
+namespace cl = llvm::cl;
+struct Options {
+  cl::opt<std::string> inputFile{
+      cl::Positional, cl::desc("the input .mlir file"), cl::init("-")};
+  cl::opt<std::string> outputFile{
+      "o", cl::Required,
+      cl::desc("the output object file, or shared object if it ends in .so")};
+  cl::opt<bool> optimize{
+      "optimize", cl::Optional,
+      cl::desc("whether the refback pass pipeline should run optimizations"),
+      cl::init(false)};
+  cl::opt<bool> profileOps{
+      "profile-ops", cl::Optional,
+      cl::desc("time each op of the compiled code for the runtime's per-op "
+               "profile"),
+      cl::init(false)};
+  cl::opt<bool> externalWeights{
+      "external-weights", cl::Optional,
+      cl::desc("map the external weights from their files when loading the "
+               "output, instead of embedding them"),
+      cl::init(false)};
+  cl::opt<bool> compressWeights{
+      "compress-weights", cl::Optional,
+      cl::desc("embed the external weights compressed, and decompress them "
+               "in parallel when loading the output"),
+      cl::init(false)};
+  cl::opt<bool> prefetchWeights{
+      "prefetch-weights", cl::Optional,
+      cl::desc("read ahead the external weights used by each function on its "
+               "first call"),
+      cl::init(false)};
+  cl::opt<unsigned> llvmOptLevel{
+      "O", cl::Prefix, cl::Optional,
+      cl::desc("LLVM optimization level of the compiled code (-O0 to -O3)"),
+      cl::init(2)};
+  cl::opt<std::string> cpu{
+      "mcpu", cl::Optional,
+      cl::desc("the CPU to compile for (the host CPU by default, or with "
+               "-mcpu=native)"),
+      cl::init("")};
+  cl::opt<std::string> features{
+      "mattr", cl::Optional,
+      cl::desc("comma-separated target features to enable (+feature) or "
+               "disable (-feature) on top of those of the CPU"),
+      cl::init("")};
+};
+} // namespace
+
+int main(int argc, char **argv) {
+  mlir::DialectRegistry registry;
+  mlir::registerAllDialects(registry);
+  mlir::registerAllPasses();
+  mlir::NPCOMP::registerAllDialects(registry);
+  mlir::NPCOMP::registerAllPasses();
+  MLIRContext context;
+  context.appendDialectRegistry(registry);
+  context.loadAllAvailableDialects();
+
+  llvm::InitLLVM y(argc, argv);
+  npcompInitializeLLVMCodegen();
+
+  mlir::registerAsmPrinterCLOptions();
+  mlir::registerPassManagerCLOptions();
+  Options options;
+  llvm::cl::ParseCommandLineOptions(argc, argv,
+                                    "npcomp ahead-of-time compiler\n");
+
+  Error error = compile(options.inputFile, context, options.outputFile,
+                        options.optimize, options.profileOps,
+                        options.externalWeights, options.compressWeights,
+                        options.prefetchWeights, options.llvmOptLevel,
+                        options.cpu, options.features);
+
+  int exitCode = EXIT_SUCCESS;
+  llvm::handleAllErrors(std::move(error),
+                        [&exitCode](const llvm::ErrorInfoBase &info) {
+                          llvm::errs() << "Error: ";
+                          info.log(llvm::errs());
+                          llvm::errs() << '\n';
+                          exitCode = EXIT_FAILURE;
+                        });
+  return exitCode;
+}
@@ -19,8 +19,24 @@
 #include "mlir/Pass/PassManager.h"
 #include "npcomp-c/InitLLVM.h"
 #include "npcomp/InitAll.h"
+#include "npcomp/RefBackend/JITHelpers/Autotuner.h"
 #include "npcomp/RefBackend/JITHelpers/JITModule.h"
+#include "npcomp/RefBackend/RefBackend.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
 
 using namespace mlir;
 using llvm::Error;
@@ -34,27 +50,84 @@ static Error make_string_error(const Twine &message) {
                                        llvm::inconvertibleErrorCode());
 }
 
+static Expected<refbackrt::ElementType> convertToElementType(Type type) {
+  if (type.isF32())
+    return refbackrt::ElementType::F32;
+  if (type.isF16())
+    return refbackrt::ElementType::F16;
+  if (type.isBF16())
+    return refbackrt::ElementType::BF16;
+  if (type.isSignlessInteger(8))
+    return refbackrt::ElementType::I8;
+  if (type.isSignlessInteger(32))
+    return refbackrt::ElementType::I32;
+  if (type.isSignlessInteger(64))
+    return refbackrt::ElementType::I64;
+  if (type.isSignlessInteger(1))
+    return refbackrt::ElementType::I1;
+  return make_string_error("unhandled tensor element type");
+}
+
+// Creates a Tensor whose elements are `elements` mapped through `convert`,
+// stored as `T`.
+template <typename T, typename Range, typename Fn>
+static refbackrt::Ref<refbackrt::Tensor>
+createTensor(ArrayRef<int64_t> extents, refbackrt::ElementType elementType,
+             Range &&elements, Fn convert) {
+  SmallVector<T, 100> values;
+  for (auto element : elements)
+    values.push_back(convert(element));
+  return refbackrt::Tensor::create(
+      refbackrt::ArrayRef<std::int64_t>(extents.data(), extents.size()),
+      elementType, static_cast<void *>(values.data()));
+}
+
 static Expected<refbackrt::Ref<refbackrt::Tensor>>
 convertAttrToTensor(Attribute attr) {
   auto type = attr.getType().dyn_cast<RankedTensorType>();
   if (!type)
     return make_string_error("unhandled argument type; must be a tensor type");
-  auto extents = llvm::to_vector<6>(llvm::map_range(
-      type.getShape(), [](int64_t x) { return static_cast<std::int32_t>(x); }));
-  auto elementType = type.getElementType();
-  auto denseFp = attr.dyn_cast<DenseFPElementsAttr>();
-  if (denseFp) {
-    if (elementType.isF32()) {
-      auto values = llvm::to_vector<100>(llvm::map_range(
-          denseFp, [](APFloat f) { return f.convertToFloat(); }));
-      return refbackrt::Tensor::create(
-          refbackrt::ArrayRef<std::int32_t>(extents.data(), extents.size()),
-          refbackrt::ElementType::F32, static_cast<void *>(values.data()));
+  auto extents = type.getShape();
+  auto elementType = convertToElementType(type.getElementType());
+  if (!elementType)
+    return elementType.takeError();
+  if (auto denseFp = attr.dyn_cast<DenseFPElementsAttr>()) {
+    if (*elementType == refbackrt::ElementType::F32)
+      return createTensor<float>(extents, *elementType, denseFp,
+                                 [](APFloat f) { return f.convertToFloat(); });
+    // f16 and bf16 are passed as their raw bit patterns.
+    return createTensor<std::uint16_t>(
+        extents, *elementType, denseFp, [](APFloat f) {
+          return static_cast<std::uint16_t>(
+              f.bitcastToAPInt().getZExtValue());
+        });
+  }
+  if (auto denseInt = attr.dyn_cast<DenseIntElementsAttr>()) {
+    switch (*elementType) {
+    case refbackrt::ElementType::I8:
+      return createTensor<std::int8_t>(
+          extents, *elementType, denseInt, [](APInt i) {
+            return static_cast<std::int8_t>(i.getSExtValue());
+          });
+    case refbackrt::ElementType::I32:
+      return createTensor<std::int32_t>(
+          extents, *elementType, denseInt, [](APInt i) {
+            return static_cast<std::int32_t>(i.getSExtValue());
+          });
+    case refbackrt::ElementType::I64:
+      return createTensor<std::int64_t>(
+          extents, *elementType, denseInt,
+          [](APInt i) { return std::int64_t(i.getSExtValue()); });
+    case refbackrt::ElementType::I1:
+      return createTensor<std::uint8_t>(
+          extents, *elementType, denseInt, [](APInt i) {
+            return static_cast<std::uint8_t>(i.getBoolValue());
+          });
+    default:
+      break;
     }
-  } else {
-    return make_string_error("unhandled argument; must be dense floating-point");
   }
-  return make_string_error("unhandled argument");
+  return make_string_error("unhandled argument; must be dense elements");
 }
 
 static Expected<float> convertAttrToFloat(Attribute attr) {
@@ -65,11 +138,405 @@ static Expected<float> convertAttrToFloat(Attribute attr) {
   return floatAttr.getValue().convertToFloat();
 }
 
+//===----------------------------------------------------------------------===//
+// Tensor files.
+//===----------------------------------------------------------------------===//
+
+namespace {
+// A read-only memory mapping of a whole file, which tensors can view without
+// copying it.
+class MappedFile {
+public:
+  static Expected<std::unique_ptr<MappedFile>> open(StringRef path) {
+    auto file = std::make_unique<MappedFile>();
+    std::uint64_t size;
+    if (std::error_code error = llvm::sys::fs::file_size(path, size))
+      return make_string_error("could not open " + Twine(path) + ": " +
+                               error.message());
+    // Empty files can't be mapped.
+    if (size == 0)
+      return std::move(file);
+    auto fd = llvm::sys::fs::openNativeFileForRead(path);
+    if (!fd)
+      return fd.takeError();
+    std::error_code error;
+    file->region = llvm::sys::fs::mapped_file_region(
+        *fd, llvm::sys::fs::mapped_file_region::readonly, size, /*offset=*/0,
+        error);
+    llvm::sys::fs::closeFile(*fd);
+    if (error)
+      return make_string_error("could not map " + Twine(path) + ": " +
+                               error.message());
+    file->size = size;
+    return std::move(file);
+  }
+
+  StringRef getContents() const {
+    return size ? StringRef(region.const_data(), size) : StringRef();
+  }
+
+private:
+  llvm::sys::fs::mapped_file_region region;
+  size_t size = 0;
+};
+} // namespace
+
+// The files mapped by the inputs of a call, which must outlive the tensors
+// viewing them.
+using MappedFiles = std::vector<std::unique_ptr<MappedFile>>;
+
+static const char npyMagic[] = "\x93NUMPY";
+static constexpr size_t npyMagicSize = sizeof(npyMagic) - 1;
+
+// Returns the `.npy` dtype of `type`, or None if `.npy` files can't hold it.
+// Multi-byte elements are little-endian, as refbackrt stores them on the
+// little-endian hosts it supports.
+static Optional<StringRef> getNpyDescr(refbackrt::ElementType type) {
+  switch (type) {
+  case refbackrt::ElementType::F32:
+    return StringRef("<f4");
+  case refbackrt::ElementType::F16:
+    return StringRef("<f2");
+  case refbackrt::ElementType::I8:
+    return StringRef("|i1");
+  case refbackrt::ElementType::I32:
+    return StringRef("<i4");
+  case refbackrt::ElementType::I64:
+    return StringRef("<i8");
+  case refbackrt::ElementType::I1:
+    return StringRef("|b1");
+  default:
+    return None;
+  }
+}
+
+// Returns the text following the key `key` in the `.npy` header `header`,
+// which is a Python dict literal.
+static Optional<StringRef> getNpyHeaderField(StringRef header, StringRef key) {
+  for (char quote : {'\'', '"'}) {
+    std::string quotedKey = (Twine(quote) + key + Twine(quote)).str();
+    size_t keyPos = header.find(quotedKey);
+    if (keyPos == StringRef::npos)
+      continue;
+    StringRef rest = header.drop_front(keyPos + quotedKey.size()).ltrim();
+    if (!rest.consume_front(":"))
+      return None;
+    return rest.ltrim();
+  }
+  return None;
+}
+
+// Creates a tensor viewing the elements of the `.npy` file `contents`.
+static Expected<refbackrt::Ref<refbackrt::Tensor>>
+createTensorFromNpy(StringRef contents, StringRef path) {
+  auto fail = [&](const Twine &message) {
+    return make_string_error(Twine(path) + ": " + message);
+  };
+  if (!contents.startswith(StringRef(npyMagic, npyMagicSize)) ||
+      contents.size() < npyMagicSize + 2)
+    return fail("not a .npy file");
+  unsigned majorVersion = static_cast<unsigned char>(contents[npyMagicSize]);
+  if (majorVersion < 1 || majorVersion > 3)
+    return fail("unsupported .npy version " + Twine(majorVersion));
+  // Version 1 has a 2 byte header length, later versions a 4 byte one.
+  size_t lengthSize = majorVersion == 1 ? 2 : 4;
+  size_t headerStart = npyMagicSize + 2 + lengthSize;
+  if (contents.size() < headerStart)
+    return fail("truncated .npy header");
+  size_t headerSize = 0;
+  for (size_t i = 0; i < lengthSize; i++)
+    headerSize |= static_cast<size_t>(static_cast<unsigned char>(
+                      contents[npyMagicSize + 2 + i]))
+                  << (8 * i);
+  if (contents.size() < headerStart + headerSize)
+    return fail("truncated .npy header");
+  StringRef header = contents.substr(headerStart, headerSize);
+
+  Optional<StringRef> descrText = getNpyHeaderField(header, "descr");
+  Optional<StringRef> fortranOrderText =
+      getNpyHeaderField(header, "fortran_order");
+  Optional<StringRef> shapeText = getNpyHeaderField(header, "shape");
+  if (!descrText || !fortranOrderText || !shapeText || descrText->empty() ||
+      !shapeText->startswith("("))
+    return fail("malformed .npy header: " + header);
+
+  char quote = descrText->front();
+  StringRef descr =
+      descrText->drop_front().take_until([&](char c) { return c == quote; });
+  // Native byte order is little-endian on the hosts refbackrt supports.
+  if (descr.startswith(">") && !descr.endswith("1"))
+    return fail("big-endian .npy files are not supported");
+  Optional<refbackrt::ElementType> elementType;
+  for (auto type : {refbackrt::ElementType::F32, refbackrt::ElementType::F16,
+                    refbackrt::ElementType::I8, refbackrt::ElementType::I32,
+                    refbackrt::ElementType::I64, refbackrt::ElementType::I1})
+    if (descr.drop_front() == getNpyDescr(type)->drop_front())
+      elementType = type;
+  if (!elementType)
+    return fail("unsupported .npy dtype '" + descr + "'");
+
+  SmallVector<std::int64_t, 6> extents;
+  SmallVector<StringRef, 6> dimTexts;
+  shapeText->drop_front()
+      .take_until([](char c) { return c == ')'; })
+      .split(dimTexts, ',', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+  for (StringRef dimText : dimTexts) {
+    dimText = dimText.trim();
+    if (dimText.empty())
+      continue;
+    std::int64_t extent;
+    if (dimText.getAsInteger(10, extent) || extent < 0)
+      return fail("malformed .npy shape: " + *shapeText);
+    extents.push_back(extent);
+  }
+
+  std::int64_t numElements = 1;
+  for (std::int64_t extent : extents)
+    numElements *= extent;
+  std::int64_t byteSize =
+      numElements * refbackrt::getElementTypeByteSize(*elementType);
+  size_t dataOffset = headerStart + headerSize;
+  if (static_cast<std::int64_t>(contents.size() - dataOffset) < byteSize)
+    return fail("expected " + Twine(byteSize) + " bytes of elements, but " +
+                 "the file only has " + Twine(contents.size() - dataOffset));
+
+  // Column-major elements are viewed through reversed strides; the runtime
+  // makes a contiguous copy when calling the function.
+  SmallVector<std::int64_t, 6> strides(extents.size());
+  std::int64_t stride = 1;
+  bool fortranOrder = fortranOrderText->startswith("True");
+  for (size_t i = 0, e = extents.size(); i < e; i++) {
+    size_t dim = fortranOrder ? i : e - 1 - i;
+    strides[dim] = stride;
+    stride *= extents[dim];
+  }
+  return refbackrt::Tensor::createBorrowingBuffer(
+      refbackrt::ArrayRef<std::int64_t>(extents.data(), extents.size()),
+      refbackrt::ArrayRef<std::int64_t>(strides.data(), strides.size()),
+      *elementType, const_cast<char *>(contents.data() + dataOffset));
+}
+
+// Writes the elements of `tensor` to `os` in row-major order.
+static void writeElements(const refbackrt::Tensor &tensor,
+                          llvm::raw_ostream &os) {
+  const char *data = static_cast<const char *>(tensor.getData());
+  if (tensor.isContiguous()) {
+    os.write(data, tensor.getDataByteSize());
+    return;
+  }
+  std::int64_t elementSize =
+      refbackrt::getElementTypeByteSize(tensor.getElementType());
+  auto extents = tensor.getExtents();
+  auto strides = tensor.getStrides();
+  std::int64_t numElements = tensor.getDataByteSize() / elementSize;
+  for (std::int64_t i = 0; i < numElements; i++) {
+    std::int64_t offset = 0;
+    std::int64_t rest = i;
+    for (int dim = tensor.getRank() - 1; dim >= 0; dim--) {
+      offset += (rest % extents[dim]) * strides[dim];
+      rest /= extents[dim];
+    }
+    os.write(data + offset * elementSize, elementSize);
+  }
+}
+
+// Writes a version 1.0 `.npy` header for row-major elements of dtype `descr`
+// and shape `shape`.
+static void writeNpyHeader(llvm::raw_ostream &os, StringRef descr,
+                           ArrayRef<std::int64_t> shape) {
+  std::string header;
+  llvm::raw_string_ostream headerOs(header);
+  headerOs << "{'descr': '" << descr << "', 'fortran_order': False, 'shape': (";
+  // Python spells 1-tuples with a trailing comma.
+  for (size_t i = 0, e = shape.size(); i < e; i++)
+    headerOs << (i ? ", " : "") << shape[i];
+  headerOs << (shape.size() == 1 ? ",), }" : "), }");
+  headerOs.flush();
+  // Pad with spaces and a newline so that the elements start at a multiple
+  // of 64 bytes, as numpy does.
+  size_t prefixSize = npyMagicSize + 2 + 2;
+  header.append(63 - (prefixSize + header.size()) % 64, ' ');
+  header.push_back('\n');
+  os << StringRef(npyMagic, npyMagicSize) << '\x01' << '\x00'
+     << static_cast<char>(header.size() & 0xff)
+     << static_cast<char>(header.size() >> 8) << header;
+}
+
+// Writes `value` to the file `path`, as a `.npy` file if `path` ends in .npy
+// and otherwise as its raw little-endian elements.
+static Error writeOutputFile(const refbackrt::RtValue &value, StringRef path) {
+  std::error_code ec;
+  llvm::raw_fd_ostream os(path, ec, llvm::sys::fs::OF_None);
+  if (ec)
+    return make_string_error("could not open " + Twine(path) + ": " +
+                             ec.message());
+  bool isNpy = path.endswith(".npy");
+
+  if (value.isFloat()) {
+    float f = value.toFloat();
+    if (isNpy)
+      writeNpyHeader(os, *getNpyDescr(refbackrt::ElementType::F32), {});
+    os.write(reinterpret_cast<const char *>(&f), sizeof(f));
+    return Error::success();
+  }
+  if (!value.isTensor())
+    return make_string_error("can only write tensor and float outputs to "
+                             "files");
+
+  const refbackrt::Tensor &tensor = *value.getTensor();
+  if (isNpy) {
+    Optional<StringRef> descr = getNpyDescr(tensor.getElementType());
+    if (!descr)
+      return make_string_error("can't write an output of this element type to "
+                               "a .npy file: " + Twine(path));
+    auto extents = tensor.getExtents();
+    writeNpyHeader(os, *descr,
+                   ArrayRef<std::int64_t>(extents.data(), extents.size()));
+  }
+  writeElements(tensor, os);
+  return Error::success();
+}
+
+// Fills `buffer` with `numElements` pseudo-random elements of type `type`:
+// floats uniformly distributed in [-1, 1), integers in [-8, 8) and booleans.
+static void fillRandom(void *buffer, std::int64_t numElements,
+                       refbackrt::ElementType type, std::mt19937 &generator) {
+  std::uniform_real_distribution<float> real(-1.0f, 1.0f);
+  std::uniform_int_distribution<int> integer(-8, 7);
+  auto fill = [&](auto *elements, auto generate) {
+    for (std::int64_t i = 0; i < numElements; i++)
+      elements[i] = generate();
+  };
+  switch (type) {
+  case refbackrt::ElementType::F32:
+    return fill(static_cast<float *>(buffer), [&] { return real(generator); });
+  case refbackrt::ElementType::F16:
+  case refbackrt::ElementType::BF16: {
+    const llvm::fltSemantics &semantics =
+        type == refbackrt::ElementType::F16 ? APFloat::IEEEhalf()
+                                             : APFloat::BFloat();
+    return fill(static_cast<std::uint16_t *>(buffer), [&] {
+      APFloat value(real(generator));
+      bool losesInfo;
+      value.convert(semantics, APFloat::rmNearestTiesToEven, &losesInfo);
+      return static_cast<std::uint16_t>(value.bitcastToAPInt().getZExtValue());
+    });
+  }
+  case refbackrt::ElementType::I8:
+    return fill(static_cast<std::int8_t *>(buffer), [&] {
+      return static_cast<std::int8_t>(integer(generator));
+    });
+  case refbackrt::ElementType::I32:
+    return fill(static_cast<std::int32_t *>(buffer),
+                [&] { return std::int32_t(integer(generator)); });
+  case refbackrt::ElementType::I64:
+    return fill(static_cast<std::int64_t *>(buffer),
+                [&] { return std::int64_t(integer(generator)); });
+  case refbackrt::ElementType::I1:
+    return fill(static_cast<std::uint8_t *>(buffer), [&] {
+      return static_cast<std::uint8_t>(integer(generator) & 1);
+    });
+  default:
+    llvm_unreachable("unsupported element type");
+  }
+}
+
+// Creates a tensor of type `typeText` whose elements are either generated by
+// `fillRandom` (for `random`) or the raw little-endian contents of a file (for
+// `file(<path>)`), which is mapped into `mappedFiles`.
+static Expected<refbackrt::Ref<refbackrt::Tensor>>
+createGeneratedTensor(StringRef generatorText, StringRef typeText,
+                      MLIRContext &context, std::mt19937 &generator,
+                      MappedFiles &mappedFiles) {
+  auto type =
+      parseType(typeText, &context).dyn_cast_or_null<RankedTensorType>();
+  if (!type || !type.hasStaticShape())
+    return make_string_error(
+        Twine("generated arg values must have a static tensor type: ") +
+        typeText);
+  auto elementType = convertToElementType(type.getElementType());
+  if (!elementType)
+    return elementType.takeError();
+  auto shape = type.getShape();
+  refbackrt::ArrayRef<std::int64_t> extents(shape.data(), shape.size());
+  std::int64_t byteSize =
+      type.getNumElements() * refbackrt::getElementTypeByteSize(*elementType);
+
+  if (generatorText == "random") {
+    // Generate the elements in place, as generated tensors can be large.
+    void *buffer = refbackrt::allocate(byteSize);
+    fillRandom(buffer, type.getNumElements(), *elementType, generator);
+    return refbackrt::Ref<refbackrt::Tensor>(
+        refbackrt::Tensor::createRawAdoptingBuffer(extents, *elementType,
+                                                   buffer, buffer,
+                                                   /*byteOffset=*/0));
+  }
+
+  StringRef path = generatorText.drop_front(strlen("file(")).drop_back();
+  auto file = MappedFile::open(path);
+  if (!file)
+    return file.takeError();
+  StringRef contents = (*file)->getContents();
+  if (static_cast<std::int64_t>(contents.size()) != byteSize)
+    return make_string_error(Twine(path) + " has " + Twine(contents.size()) +
+                             " bytes, but " + typeText + " has " +
+                             Twine(byteSize));
+  mappedFiles.push_back(std::move(*file));
+  return refbackrt::Tensor::createBorrowingBuffer(
+      extents, *elementType, const_cast<char *>(contents.data()));
+}
+
+namespace {
+// An argument to the called function: either the text of an -arg-value or
+// the path of an -arg-file.
+struct InputArg {
+  StringRef text;
+  bool isFile;
+};
+} // namespace
+
+// Creates the inputs of the call from `args`. Input files are mapped into
+// `mappedFiles`, which must outlive the inputs.
 static Expected<SmallVector<refbackrt::RtValue, 6>>
-createInputs(ArrayRef<StringRef> argValues) {
+createInputs(ArrayRef<InputArg> args, MappedFiles &mappedFiles) {
   MLIRContext context;
+  // A fixed seed makes random inputs reproducible across runs.
+  std::mt19937 generator;
   SmallVector<refbackrt::RtValue, 6> ret;
-  for (auto argValue : argValues) {
+  for (const InputArg &arg : args) {
+    if (arg.isFile) {
+      if (!arg.text.endswith(".npy"))
+        return make_string_error(
+            "-arg-file expects a .npy file (use -arg-value='file(<path>) : "
+            "<type>' for raw elements): " + arg.text);
+      auto file = MappedFile::open(arg.text);
+      if (!file)
+        return file.takeError();
+      auto expectedTensor =
+          createTensorFromNpy((*file)->getContents(), arg.text);
+      if (!expectedTensor)
+        return expectedTensor.takeError();
+      mappedFiles.push_back(std::move(*file));
+      ret.push_back(std::move(*expectedTensor));
+      continue;
+    }
+
+    StringRef argValue = arg.text;
+    // `random : <type>` and `file(<path>) : <type>` generate large tensors
+    // that would be impractical to spell out as dense attributes.
+    StringRef generatorText, typeText;
+    std::tie(generatorText, typeText) = argValue.rsplit(':');
+    generatorText = generatorText.trim();
+    if (generatorText == "random" ||
+        (generatorText.startswith("file(") && generatorText.endswith(")"))) {
+      auto expectedTensor = createGeneratedTensor(
+          generatorText, typeText.trim(), context, generator, mappedFiles);
+      if (!expectedTensor)
+        return expectedTensor.takeError();
+      ret.push_back(std::move(*expectedTensor));
+      continue;
+    }
+
     auto attr = parseAttribute(argValue, &context);
     if (!attr)
       return make_string_error(Twine("could not parse arg value: ") + argValue);
@@ -81,11 +548,23 @@ createInputs(ArrayRef<StringRef> argValues) {
       if (!expectedTensor)
         return expectedTensor.takeError();
       ret.push_back(std::move(*expectedTensor));
+    } else if (attrType.isF64()) {
+      ret.push_back(refbackrt::RtValue(
+          attr.cast<FloatAttr>().getValue().convertToDouble()));
     } else if (attrType.isa<FloatType>()) {
       auto expectedFloat = convertAttrToFloat(attr);
       if (!expectedFloat)
         return expectedFloat.takeError();
       ret.push_back(refbackrt::RtValue(*expectedFloat));
+    } else if (attrType.isSignlessInteger(1)) {
+      ret.push_back(
+          refbackrt::RtValue(attr.cast<IntegerAttr>().getValue().getBoolValue()));
+    } else if (attrType.isSignlessInteger(32) ||
+               attrType.isSignlessInteger(64)) {
+      ret.push_back(refbackrt::RtValue(
+          static_cast<std::int64_t>(attr.cast<IntegerAttr>().getInt())));
+    } else {
+      return make_string_error(Twine("unsupported arg value: ") + argValue);
     }
   }
 
@@ -96,6 +575,18 @@ static Type convertToMLIRType(refbackrt::ElementType type, Builder &builder) {
   switch (type) {
   case refbackrt::ElementType::F32:
     return builder.getF32Type();
+  case refbackrt::ElementType::F16:
+    return builder.getF16Type();
+  case refbackrt::ElementType::BF16:
+    return builder.getBF16Type();
+  case refbackrt::ElementType::I8:
+    return builder.getIntegerType(8);
+  case refbackrt::ElementType::I32:
+    return builder.getIntegerType(32);
+  case refbackrt::ElementType::I64:
+    return builder.getIntegerType(64);
+  case refbackrt::ElementType::I1:
+    return builder.getIntegerType(1);
   default:
     llvm_unreachable("unsupported dtype");
   }
@@ -110,24 +601,82 @@ static RankedTensorType getCorrespondingMLIRTensorType(refbackrt::Tensor &tensor
   return RankedTensorType::get(extents, elementType);
 }
 
+// Returns the elements of `tensor` in row-major order, mapped through
+// `convert`.
+template <typename T, typename Fn>
+static auto gatherElements(refbackrt::Tensor &tensor, Fn convert)
+    -> SmallVector<decltype(convert(std::declval<T>())), 100> {
+  SmallVector<decltype(convert(std::declval<T>())), 100> values;
+  auto *basePtr = tensor.getData<T>();
+  auto extents = tensor.getExtents();
+  auto strides = tensor.getStrides();
+  std::int64_t numElements = 1;
+  for (int dim = 0, e = tensor.getRank(); dim < e; dim++)
+    numElements *= extents[dim];
+  for (std::int64_t i = 0; i < numElements; i++) {
+    // Map the row-major element index to its offset in the (possibly
+    // strided) buffer.
+    std::int64_t offset = 0;
+    std::int64_t rest = i;
+    for (int dim = tensor.getRank() - 1; dim >= 0; dim--) {
+      offset += (rest % extents[dim]) * strides[dim];
+      rest /= extents[dim];
+    }
+    values.push_back(convert(basePtr[offset]));
+  }
+  return values;
+}
+
 static Attribute convertToMLIRAttribute(const refbackrt::RtValue &value,
                                         Builder &builder) {
   if (value.isTensor()) {
-    auto& tensor = *(value.toTensor());
+    auto& tensor = *value.getTensor();
     RankedTensorType type = getCorrespondingMLIRTensorType(tensor, builder);
+    auto toAPInt = [&](auto x) {
+      return APInt(type.getElementTypeBitWidth(), static_cast<uint64_t>(x),
+                   /*isSigned=*/true);
+    };
     switch (tensor.getElementType()) {
       case refbackrt::ElementType::F32: {
-        SmallVector<float, 100> values;
-        auto *basePtr = tensor.getData<float>();
-        for (int i = 0, e = type.getNumElements(); i < e; i++)
-          values.push_back(basePtr[i]);
+        auto values = gatherElements<float>(tensor, [](float f) { return f; });
         return DenseFPElementsAttr::get(type, values);
       }
+      case refbackrt::ElementType::F16:
+      case refbackrt::ElementType::BF16: {
+        const auto &semantics =
+            type.getElementType().cast<FloatType>().getFloatSemantics();
+        auto values = gatherElements<std::uint16_t>(
+            tensor, [&](std::uint16_t bits) {
+              return APFloat(semantics, APInt(16, bits));
+            });
+        return DenseElementsAttr::get(type, values);
+      }
+      case refbackrt::ElementType::I8:
+        return DenseElementsAttr::get(
+            type, gatherElements<std::int8_t>(tensor, toAPInt));
+      case refbackrt::ElementType::I32:
+        return DenseElementsAttr::get(
+            type, gatherElements<std::int32_t>(tensor, toAPInt));
+      case refbackrt::ElementType::I64:
+        return DenseElementsAttr::get(
+            type, gatherElements<std::int64_t>(tensor, toAPInt));
+      case refbackrt::ElementType::I1: {
+        auto values = gatherElements<std::uint8_t>(
+            tensor, [](std::uint8_t b) { return APInt(1, b != 0); });
+        return DenseElementsAttr::get(type, values);
+      }
       default:
         llvm_unreachable("unsupported element type");
     }
   } else if (value.isFloat()) {
     return builder.getF32FloatAttr(value.toFloat());
+  } else if (value.isDouble()) {
+    return builder.getF64FloatAttr(value.toDouble());
+  } else if (value.isInt()) {
+    // Integer outputs don't record their width, so print them as i64.
+    return builder.getI64IntegerAttr(value.toInt());
+  } else if (value.isBool()) {
+    return builder.getBoolAttr(value.toBool());
   }
   llvm_unreachable("unsupported type");
 }
@@ -139,48 +688,467 @@ static void printOutput(const refbackrt::RtValue &value, llvm::raw_ostream &os)
   attr.print(os);
 }
 
-static void printOutputs(ArrayRef<refbackrt::RtValue> outputs,
-                         llvm::raw_ostream &os) {
+// Prints `outputs`, except for the leading ones written to `outputFiles`.
+static Error printOutputs(ArrayRef<refbackrt::RtValue> outputs,
+                          ArrayRef<StringRef> outputFiles,
+                          llvm::raw_ostream &os) {
+  if (outputFiles.size() > outputs.size())
+    return make_string_error("got " + Twine(outputFiles.size()) +
+                             " output files for " + Twine(outputs.size()) +
+                             " outputs");
   for (auto output : llvm::enumerate(outputs)) {
     os << "output #" << output.index() << ": ";
+    if (output.index() < outputFiles.size()) {
+      StringRef path = outputFiles[output.index()];
+      if (Error error = writeOutputFile(output.value(), path))
+        return error;
+      os << "written to " << path << "\n";
+      continue;
+    }
     printOutput(output.value(), os);
     os << "\n";
   }
+  return Error::success();
 }
 
-Error compileAndRun(std::string mlirFile, mlir::MLIRContext &context,
-                    std::string invokeFunction, ArrayRef<StringRef> argValues,
-                    ArrayRef<StringRef> sharedLibs, bool optimize) {
-  OwningModuleRef moduleRef = parseSourceFile(mlirFile, &context);
+static Expected<std::unique_ptr<refback::JITModule>>
+compile(std::string mlirFile, mlir::MLIRContext &context,
+        ArrayRef<StringRef> sharedLibs, bool optimize, bool profileOps,
+        ArrayRef<int64_t> specializedBatchSizes, unsigned prefetchDistance,
+        bool compileTimeReport, StringRef objectCacheDir,
+        const refback::JITCompileOptions &compileOptions,
+        StringRef tuningDatabase,
+        const refback::AutotuneOptions *autotuneOptions) {
+  OwningModuleRef moduleRef =
+      refback::JITModule::parseModuleFile(mlirFile, context);
   if (!moduleRef)
     return make_string_error(Twine("could not open ") + mlirFile);
 
   ModuleOp module = *moduleRef;
 
-  // Compile.
+  // Tune the shapes of the module missing from the database before compiling
+  // it with the database.
+  if (autotuneOptions) {
+    auto database = NPCOMP::TuningDatabase::load(tuningDatabase);
+    if (!database)
+      return database.takeError();
+    auto numTuned = refback::autotuneModule(module, *database,
+                                            *autotuneOptions, &llvm::errs());
+    if (!numTuned)
+      return numTuned.takeError();
+    if (*numTuned != 0)
+      if (Error error = database->save(tuningDatabase))
+        return error;
+  }
+
+  // Compile, optimizing for the CPU that LLVM generates code for.
+  auto target = refback::JITModule::getTargetInfo(compileOptions);
+  if (!target)
+    return target.takeError();
   PassManager pm(module.getContext(), OpPassManager::Nesting::Implicit);
   applyPassManagerCLOptions(pm);
-  refback::JITModule::buildBackendCompilationPipeline(pm, optimize);
+  if (compileTimeReport)
+    NPCOMP::enableCompileTimeReport(pm);
+  NPCOMP::RefBackendLoweringPipelineOptions pipelineOptions;
+  pipelineOptions.optimize = optimize;
+  pipelineOptions.profileOps = profileOps;
+  pipelineOptions.specializeBatchSizes = specializedBatchSizes;
+  pipelineOptions.prefetchDistance = prefetchDistance;
+  pipelineOptions.tuningDatabase = tuningDatabase.str();
+  NPCOMP::setTargetInfo(pipelineOptions, *target);
+  refback::JITModule::buildBackendCompilationPipeline(pm, pipelineOptions);
   if (failed(pm.run(module))) {
     return make_string_error(Twine("error compiling to jit backend"));
   }
 
+  return refback::JITModule::fromCompiledModule(
+      module, sharedLibs, objectCacheDir, compileOptions);
+}
+
+// Lowers the module in `mlirFile` for the runtime's interpreter, which runs it
+// without generating any code.
+static Expected<std::unique_ptr<refback::JITModule>>
+lowerForInterpreter(std::string mlirFile, mlir::MLIRContext &context,
+                    bool compileTimeReport) {
+  OwningModuleRef moduleRef =
+      refback::JITModule::parseModuleFile(mlirFile, context);
+  if (!moduleRef)
+    return make_string_error(Twine("could not open ") + mlirFile);
+  PassManager pm(context, OpPassManager::Nesting::Implicit);
+  applyPassManagerCLOptions(pm);
+  if (compileTimeReport)
+    NPCOMP::enableCompileTimeReport(pm);
+  refback::JITModule::buildInterpreterPipeline(pm);
+  if (failed(pm.run(*moduleRef)))
+    return make_string_error(Twine("error lowering for the interpreter"));
+  return refback::JITModule::fromInterpretedModule(*moduleRef);
+}
+
+//===----------------------------------------------------------------------===//
+// Per-op profiling.
+//===----------------------------------------------------------------------===//
+
+// Writes the per-op profile recorded by the compiled code to `path` as a
+// Chrome trace, and prints a summary of it to `os`, slowest op first.
+static Error writeOpProfile(StringRef path, llvm::raw_ostream &os) {
+  if (!refbackrt::writeOpProfileAsChromeTrace(path.str().c_str()))
+    return make_string_error("could not write " + Twine(path));
+  std::vector<refbackrt::OpProfileEntry> entries(refbackrt::kMaxProfiledOps);
+  entries.resize(refbackrt::getOpProfile(entries.data(), entries.size()));
+  llvm::sort(entries, [](const auto &lhs, const auto &rhs) {
+    return lhs.totalNanoseconds > rhs.totalNanoseconds;
+  });
+  std::int64_t totalNanoseconds = 0;
+  for (const refbackrt::OpProfileEntry &entry : entries)
+    totalNanoseconds += entry.totalNanoseconds;
+  os << "op profile: written to " << path << "\n";
+  os << "  Total ms      %    Calls  Op\n";
+  for (const refbackrt::OpProfileEntry &entry : entries)
+    os << llvm::format("  %8.3f %6.1f %8lld  ", entry.totalNanoseconds / 1e6,
+                       totalNanoseconds == 0
+                           ? 0.0
+                           : 100.0 * entry.totalNanoseconds / totalNanoseconds,
+                       static_cast<long long>(entry.numCalls))
+       << entry.name << "\n";
+  return Error::success();
+}
+
+//===----------------------------------------------------------------------===//
+// Benchmarking.
+//===----------------------------------------------------------------------===//
+
+namespace {
+enum class BenchmarkFormat { Table, Json };
+
+struct BenchmarkOptions {
+  // The number of timed calls on each thread. 0 disables benchmarking.
+  unsigned iterations = 0;
+  // The number of untimed calls before the timed ones.
+  unsigned warmup = 0;
+  // The number of threads calling the function concurrently.
+  unsigned threads = 1;
+  // Whether the timed calls are replays of a captured call (see
+  // refbackrt::CapturedCall) rather than prepared calls.
+  bool replay = false;
+  BenchmarkFormat format = BenchmarkFormat::Table;
+  // Whether to report the performance of the function against the roofline
+  // of the machine.
+  bool roofline = false;
+  // The floating-point operations of one call.
+  double flopsPerCall = 0;
+  // The bytes one call reads and writes, or 0 for the sizes of its inputs and
+  // outputs.
+  double bytesPerCall = 0;
+  // The peak compute throughput of the machine, or 0 if unknown, in which
+  // case only the memory roof is known.
+  double peakGflops = 0;
+  // The peak memory bandwidth of the machine, or 0 to measure it.
+  double peakGbps = 0;
+  // Fail if the function reaches less than this fraction of the roofline.
+  double minRooflineFraction = 0;
+};
+} // namespace
+
+using Clock = std::chrono::steady_clock;
+
+static double getMilliseconds(Clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+// Returns the peak resident set size of the process in bytes, or 0 if it is
+// unknown.
+static std::uint64_t getPeakRSS() {
+#ifdef _WIN32
+  return 0;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage))
+    return 0;
+#ifdef __APPLE__
+  return usage.ru_maxrss;
+#else
+  return static_cast<std::uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+// Returns the nearest-rank `percentile` of the sorted `values`.
+static double getPercentile(ArrayRef<double> values, double percentile) {
+  size_t rank =
+      static_cast<size_t>(std::ceil(percentile / 100 * values.size()));
+  return values[std::max<size_t>(rank, 1) - 1];
+}
+
+// Returns the memory bandwidth of copying buffers much larger than the caches,
+// in GB/s, counting the bytes read and written.
+static double measureMemoryBandwidth() {
+  constexpr size_t kBufferSize = 64 << 20;
+  std::vector<char> source(kBufferSize, 1), destination(kBufferSize, 0);
+  double bestSeconds = INFINITY;
+  for (int i = 0; i < 5; i++) {
+    Clock::time_point start = Clock::now();
+    std::memcpy(destination.data(), source.data(), kBufferSize);
+    bestSeconds = std::min(
+        bestSeconds,
+        std::chrono::duration<double>(Clock::now() - start).count());
+    source[i] = destination[kBufferSize - 1 - i];
+  }
+  return 2.0 * kBufferSize / bestSeconds / 1e9;
+}
+
+namespace {
+// The performance of a function against the roofline of the machine.
+struct RooflineReport {
+  double gflops;
+  double gbps;
+  // FLOPs per byte moved.
+  double intensity;
+  double peakGflops;
+  double peakGbps;
+  // The throughput the roofline allows at `intensity`.
+  double attainableGflops;
+  bool memoryBound;
+  // The achieved fraction of the attainable throughput, in terms of FLOPs for
+  // compute-bound functions and of bytes for memory-bound ones.
+  double fraction;
+};
+} // namespace
+
+static RooflineReport computeRoofline(const BenchmarkOptions &options,
+                                      double bytesPerCall,
+                                      double callsPerSecond) {
+  RooflineReport report;
+  report.gflops = options.flopsPerCall * callsPerSecond / 1e9;
+  report.gbps = bytesPerCall * callsPerSecond / 1e9;
+  report.intensity = bytesPerCall > 0 ? options.flopsPerCall / bytesPerCall : 0;
+  report.peakGflops = options.peakGflops;
+  report.peakGbps =
+      options.peakGbps > 0 ? options.peakGbps : measureMemoryBandwidth();
+  double memoryRoof = report.intensity * report.peakGbps;
+  report.memoryBound = report.peakGflops <= 0 || memoryRoof < report.peakGflops;
+  report.attainableGflops =
+      report.memoryBound ? memoryRoof : report.peakGflops;
+  report.fraction = report.memoryBound ? report.gbps / report.peakGbps
+                                       : report.gflops / report.peakGflops;
+  return report;
+}
+
+static Error checkRooflineFraction(const Optional<RooflineReport> &roofline,
+                                   const BenchmarkOptions &options) {
+  if (!roofline || roofline->fraction >= options.minRooflineFraction)
+    return Error::success();
+  return make_string_error(
+      llvm::formatv("reached {0:P} of the roofline, below the minimum of {1:P}",
+                    roofline->fraction, options.minRooflineFraction));
+}
+
+static Error runBenchmark(refback::JITModule &jitModule,
+                          StringRef invokeFunction,
+                          ArrayRef<refbackrt::RtValue> inputs,
+                          double compileTime,
+                          const BenchmarkOptions &options) {
+  Clock::time_point firstCallStart = Clock::now();
+  auto expectedCall = jitModule.prepare(invokeFunction, inputs);
+  if (!expectedCall)
+    return expectedCall.takeError();
+  const refback::PreparedCall &call = *expectedCall;
+  auto expectedOutputs = call.invoke(inputs);
+  if (!expectedOutputs)
+    return expectedOutputs.takeError();
+  double firstCallLatency = getMilliseconds(Clock::now() - firstCallStart);
+
+  for (unsigned i = 0; i < options.warmup; i++) {
+    auto outputs = call.invoke(inputs);
+    if (!outputs)
+      return outputs.takeError();
+  }
+
+  // Each thread records the latencies of its calls, or the first error.
+  unsigned numThreads = std::max(options.threads, 1u);
+  std::vector<std::vector<double>> threadLatencies(numThreads);
+  std::vector<std::string> threadErrors(numThreads);
+  auto runCalls = [&](unsigned thread) {
+    threadLatencies[thread].reserve(options.iterations);
+    // Each thread replays its own captured call, which writes into its own
+    // outputs.
+    refbackrt::CapturedCall captured;
+    if (options.replay) {
+      auto outputs = call.createOutputs();
+      auto expectedCaptured = call.capture(inputs, outputs);
+      if (!expectedCaptured) {
+        threadErrors[thread] = llvm::toString(expectedCaptured.takeError());
+        return;
+      }
+      captured = std::move(*expectedCaptured);
+    }
+    auto callOnce = [&]() -> Error {
+      if (!options.replay)
+        return call.invoke(inputs).takeError();
+      const char *errorMessage = nullptr;
+      if (refbackrt::failed(captured.replay(&errorMessage)))
+        return make_string_error("invoking '" + Twine(call.getFunctionName()) +
+                                 "': " + errorMessage);
+      return Error::success();
+    };
+    for (unsigned i = 0; i < options.iterations; i++) {
+      Clock::time_point start = Clock::now();
+      if (Error error = callOnce()) {
+        threadErrors[thread] = llvm::toString(std::move(error));
+        return;
+      }
+      threadLatencies[thread].push_back(getMilliseconds(Clock::now() - start));
+    }
+  };
+  Clock::time_point start = Clock::now();
+  std::vector<std::thread> workers;
+  for (unsigned thread = 1; thread < numThreads; thread++)
+    workers.emplace_back(runCalls, thread);
+  runCalls(0);
+  for (std::thread &worker : workers)
+    worker.join();
+  double wallTime = getMilliseconds(Clock::now() - start);
+
+  std::vector<double> latencies;
+  for (unsigned thread = 0; thread < numThreads; thread++) {
+    if (!threadErrors[thread].empty())
+      return make_string_error(threadErrors[thread]);
+    latencies.insert(latencies.end(), threadLatencies[thread].begin(),
+                     threadLatencies[thread].end());
+  }
+  llvm::sort(latencies);
+  double p50 = getPercentile(latencies, 50);
+  double p90 = getPercentile(latencies, 90);
+  double p99 = getPercentile(latencies, 99);
+  double throughput = latencies.size() / (wallTime / 1000);
+  double peakRSS = getPeakRSS() / (1024.0 * 1024.0);
+
+  Optional<RooflineReport> roofline;
+  if (options.roofline) {
+    double bytesPerCall = options.bytesPerCall;
+    if (bytesPerCall <= 0) {
+      for (const refbackrt::RtValue &value : inputs)
+        if (value.isTensor())
+          bytesPerCall += value.getTensor()->getDataByteSize();
+      for (const refbackrt::RtValue &value : *expectedOutputs)
+        if (value.isTensor())
+          bytesPerCall += value.getTensor()->getDataByteSize();
+    }
+    roofline = computeRoofline(options, bytesPerCall, throughput);
+  }
+
+  llvm::raw_ostream &os = llvm::outs();
+  if (options.format == BenchmarkFormat::Json) {
+    llvm::json::OStream json(os, /*IndentSize=*/2);
+    json.object([&] {
+      json.attribute("function", invokeFunction);
+      json.attribute("iterations", options.iterations);
+      json.attribute("warmup", options.warmup);
+      json.attribute("threads", numThreads);
+      json.attribute("compile_time_ms", compileTime);
+      json.attribute("first_call_latency_ms", firstCallLatency);
+      json.attributeObject("latency_ms", [&] {
+        json.attribute("p50", p50);
+        json.attribute("p90", p90);
+        json.attribute("p99", p99);
+      });
+      json.attribute("throughput_calls_per_s", throughput);
+      json.attribute("peak_rss_mib", peakRSS);
+      if (roofline) {
+        json.attributeObject("roofline", [&] {
+          json.attribute("gflops", roofline->gflops);
+          json.attribute("gbps", roofline->gbps);
+          json.attribute("intensity_flops_per_byte", roofline->intensity);
+          json.attribute("peak_gflops", roofline->peakGflops);
+          json.attribute("peak_gbps", roofline->peakGbps);
+          json.attribute("attainable_gflops", roofline->attainableGflops);
+          json.attribute("bound", roofline->memoryBound ? "memory" : "compute");
+          json.attribute("fraction", roofline->fraction);
+        });
+      }
+    });
+    os << "\n";
+    return checkRooflineFraction(roofline, options);
+  }
+  os << llvm::format("compile time:        %12.3f ms\n", compileTime)
+     << llvm::format("first-call latency:  %12.3f ms\n", firstCallLatency)
+     << llvm::format("p50 latency:         %12.3f ms\n", p50)
+     << llvm::format("p90 latency:         %12.3f ms\n", p90)
+     << llvm::format("p99 latency:         %12.3f ms\n", p99)
+     << llvm::format("throughput:          %12.1f calls/s", throughput)
+     << " (" << latencies.size() << " calls on " << numThreads
+     << " threads)\n"
+     << llvm::format("peak RSS:            %12.1f MiB\n", peakRSS);
+  if (roofline) {
+    os << llvm::format("GFLOP/s:             %12.2f\n", roofline->gflops)
+       << llvm::format("GB/s:                %12.2f\n", roofline->gbps)
+       << llvm::format("intensity:           %12.3f FLOP/byte\n",
+                       roofline->intensity)
+       << llvm::format("roofline:            %12.2f GFLOP/s (%s bound)\n",
+                       roofline->attainableGflops,
+                       roofline->memoryBound ? "memory" : "compute")
+       << llvm::format("roofline fraction:   %11.1f%%\n",
+                       roofline->fraction * 100);
+  }
+  return checkRooflineFraction(roofline, options);
+}
+
+Error compileAndRun(std::string mlirFile, mlir::MLIRContext &context,
+                    std::string invokeFunction, ArrayRef<InputArg> args,
+                    ArrayRef<StringRef> outputFiles,
+                    ArrayRef<StringRef> sharedLibs, bool optimize,
+                    ArrayRef<int64_t> specializedBatchSizes,
+                    unsigned prefetchDistance, bool compileTimeReport,
+                    StringRef objectCacheDir,
+                    const refback::JITCompileOptions &compileOptions,
+                    StringRef tuningDatabase,
+                    const refback::AutotuneOptions *autotuneOptions,
+                    StringRef compiledModule, bool interpret,
+                    StringRef opProfileFile,
+                    const BenchmarkOptions &benchmarkOptions) {
+  // A module compiled ahead of time is loaded instead of compiling the input.
+  // Its per-op profile is only recorded if it was compiled with profiling.
+  Clock::time_point compileStart = Clock::now();
   auto expectedJitModule =
-      refback::JITModule::fromCompiledModule(module, sharedLibs);
+      !compiledModule.empty()
+          ? refback::JITModule::fromSharedObject(compiledModule)
+          : interpret
+                ? lowerForInterpreter(mlirFile, context, compileTimeReport)
+                : compile(mlirFile, context, sharedLibs, optimize,
+                          /*profileOps=*/!opProfileFile.empty(),
+                          specializedBatchSizes, prefetchDistance,
+                          compileTimeReport, objectCacheDir, compileOptions,
+                          tuningDatabase, autotuneOptions);
   if (!expectedJitModule)
     return expectedJitModule.takeError();
   auto jitModule = std::move(*expectedJitModule);
+  double compileTime = getMilliseconds(Clock::now() - compileStart);
 
-  auto expectedInputs = createInputs(argValues);
+  // Declared before the inputs and outputs, which may view the files.
+  MappedFiles mappedFiles;
+  auto expectedInputs = createInputs(args, mappedFiles);
   if (!expectedInputs)
     return expectedInputs.takeError();
 
+  if (benchmarkOptions.iterations != 0) {
+    if (Error error = runBenchmark(*jitModule, invokeFunction,
+                                   *expectedInputs, compileTime,
+                                   benchmarkOptions))
+      return error;
+    if (!opProfileFile.empty())
+      return writeOpProfile(opProfileFile, llvm::outs());
+    return Error::success();
+  }
+
   auto expectedOutputs = jitModule->invoke(invokeFunction, *expectedInputs);
   if (!expectedOutputs)
     return expectedOutputs.takeError();
 
   auto outputs = std::move(*expectedOutputs);
-  printOutputs(outputs, llvm::outs());
+  if (Error error = printOutputs(outputs, outputFiles, llvm::outs()))
+    return error;
+  if (!opProfileFile.empty())
+    if (Error error = writeOpProfile(opProfileFile, llvm::outs()))
+      return error;
   llvm::outs() << "SUCCESS\n";
   return Error::success();
 }
@@ -198,6 +1166,14 @@ struct Options {
                                       cl::desc("function to invoke")};
   cl::list<std::string> argValues{"arg-value", cl::ZeroOrMore,
                                   cl::desc("Arguments to the called function")};
+  cl::list<std::string> argFiles{
+      "arg-file", cl::ZeroOrMore,
+      cl::desc(".npy files holding arguments to the called function, which "
+               "are interleaved with -arg-value in command-line order")};
+  cl::list<std::string> outputFiles{
+      "output-file", cl::ZeroOrMore,
+      cl::desc("Files to write the outputs of the called function to, in "
+               "order: .npy files, or else the raw elements")};
 
   cl::list<std::string> sharedLibs{"shared-libs", cl::ZeroOrMore,
                                    cl::MiscFlags::CommaSeparated,
@@ -206,6 +1182,147 @@ struct Options {
       "optimize", cl::Optional,
       cl::desc("whether the refback pass pipeline should run optimizations"),
       cl::init(false)};
+  cl::list<int64_t> specializeBatchSizes{
+      "specialize-batch-sizes", cl::ZeroOrMore, cl::MiscFlags::CommaSeparated,
+      cl::desc("batch sizes to compile static variants of the functions for, "
+               "which calls with matching inputs dispatch to")};
+  cl::opt<unsigned> prefetchDistance{
+      "prefetch-distance", cl::Optional,
+      cl::desc("prefetch the strided and indirect loads of innermost loops "
+               "this many iterations ahead (0 to not prefetch)"),
+      cl::init(0)};
+  cl::opt<std::string> tuningDatabase{
+      "tuning-database", cl::Optional,
+      cl::desc("database of the tuned lowerings of matmuls and convolutions "
+               "to compile with, when optimizing"),
+      cl::init("")};
+  cl::opt<bool> autotune{
+      "autotune", cl::Optional,
+      cl::desc("before compiling, tune the matmuls and convolutions of the "
+               "input whose shapes aren't in -tuning-database, and add them "
+               "to it"),
+      cl::init(false)};
+  cl::opt<unsigned> autotuneIterations{
+      "autotune-iterations", cl::Optional,
+      cl::desc("the number of timed calls of each candidate while "
+               "autotuning"),
+      cl::init(10)};
+  cl::opt<std::string> objectCacheDir{
+      "object-cache-dir", cl::Optional,
+      cl::desc("directory caching the object code of compiled modules"),
+      cl::init("")};
+  cl::opt<unsigned> compileThreads{
+      "compile-threads", cl::Optional,
+      cl::desc("number of threads to run the pass pipeline and LLVM codegen "
+               "on (0 for one per hardware thread)"),
+      cl::init(0)};
+  cl::opt<bool> compileTimeReport{
+      "compile-time-report", cl::Optional,
+      cl::desc("print a per-pass timing and memory report of the pass "
+               "pipeline"),
+      cl::init(false)};
+  cl::opt<unsigned> llvmOptLevel{
+      "O", cl::Prefix, cl::Optional,
+      cl::desc("LLVM optimization level of the compiled code (-O0 to -O3)"),
+      cl::init(2)};
+  cl::opt<bool> fastISel{
+      "fast-isel", cl::Optional,
+      cl::desc("select instructions with FastISel, which compiles faster "
+               "but generates slower code (best with -O0)"),
+      cl::init(false)};
+  cl::opt<std::string> cpu{
+      "mcpu", cl::Optional,
+      cl::desc("the CPU to compile for (the host CPU by default, or with "
+               "-mcpu=native)"),
+      cl::init("")};
+  cl::opt<std::string> features{
+      "mattr", cl::Optional,
+      cl::desc("comma-separated target features to enable (+feature) or "
+               "disable (-feature) on top of those of the CPU"),
+      cl::init("")};
+  cl::opt<bool> lazy{
+      "lazy", cl::Optional,
+      cl::desc("compile each function on its first call instead of upfront"),
+      cl::init(false)};
+  cl::opt<bool> streaming{
+      "streaming", cl::Optional,
+      cl::desc("translate and generate code for one function at a time, to "
+               "bound the memory of compiling large modules"),
+      cl::init(false)};
+  cl::opt<bool> hugePageWeights{
+      "huge-page-weights", cl::Optional,
+      cl::desc("copy external globals into huge pages (see "
+               "REFBACKRT_HUGE_PAGES) instead of mapping their files"),
+      cl::init(false)};
+  cl::opt<unsigned> benchmarkIterations{
+      "benchmark-iterations", cl::Optional,
+      cl::desc("benchmark the function with this many timed calls per "
+               "thread, instead of printing its outputs"),
+      cl::init(0)};
+  cl::opt<unsigned> warmup{
+      "warmup", cl::Optional,
+      cl::desc("the number of untimed calls before the benchmark"),
+      cl::init(1)};
+  cl::opt<unsigned> threads{
+      "threads", cl::Optional,
+      cl::desc("the number of threads calling the function concurrently "
+               "while benchmarking"),
+      cl::init(1)};
+  cl::opt<bool> benchmarkReplay{
+      "benchmark-replay", cl::Optional,
+      cl::desc("benchmark replays of a call captured with the inputs, which "
+               "skip the per-call checks and setup"),
+      cl::init(false)};
+  cl::opt<BenchmarkFormat> benchmarkFormat{
+      "benchmark-format", cl::Optional,
+      cl::desc("the format of the benchmark report"),
+      cl::values(clEnumValN(BenchmarkFormat::Table, "table", "a table"),
+                 clEnumValN(BenchmarkFormat::Json, "json", "a JSON object")),
+      cl::init(BenchmarkFormat::Table)};
+  cl::opt<bool> roofline{
+      "roofline", cl::Optional,
+      cl::desc("report the GFLOP/s and GB/s of the function while "
+               "benchmarking, against the roofline of the machine"),
+      cl::init(false)};
+  cl::opt<double> flopsPerCall{
+      "flops-per-call", cl::Optional,
+      cl::desc("the floating-point operations of one call, for -roofline"),
+      cl::init(0)};
+  cl::opt<double> bytesPerCall{
+      "bytes-per-call", cl::Optional,
+      cl::desc("the bytes one call reads and writes, for -roofline (the size "
+               "of its inputs and outputs by default)"),
+      cl::init(0)};
+  cl::opt<double> peakGflops{
+      "peak-gflops", cl::Optional,
+      cl::desc("the peak GFLOP/s of the machine, for -roofline (only the "
+               "memory roof is used by default)"),
+      cl::init(0)};
+  cl::opt<double> peakGbps{
+      "peak-gbps", cl::Optional,
+      cl::desc("the peak memory bandwidth of the machine in GB/s, for "
+               "-roofline (measured by default)"),
+      cl::init(0)};
+  cl::opt<double> minRooflineFraction{
+      "min-roofline-fraction", cl::Optional,
+      cl::desc("fail if the function reaches less than this fraction of the "
+               "roofline, for -roofline"),
+      cl::init(0)};
+  cl::opt<std::string> compiledModule{
+      "compiled-module", cl::Optional,
+      cl::desc("shared object produced by npcomp-compile to run instead of "
+               "compiling the input"),
+      cl::init("")};
+  cl::opt<bool> interpret{
+      "interpret", cl::Optional,
+      cl::desc("run the input with the runtime's interpreter instead of "
+               "compiling it with LLVM"),
+      cl::init(false)};
+  cl::opt<std::string> opProfile{
+      "op-profile", cl::Optional,
+      cl::desc("time each op of the compiled code, and write the profile to "
+               "this file as a Chrome trace"),
+      cl::init("")};
 };
 } // namespace
 
@@ -229,11 +1346,62 @@ int main(int argc, char **argv) {
 
   SmallVector<StringRef, 6> sharedLibs(options.sharedLibs.begin(),
                                        options.sharedLibs.end());
-  SmallVector<StringRef, 6> argValues(options.argValues.begin(),
-                                      options.argValues.end());
+  // -arg-value and -arg-file are interleaved in command-line order.
+  SmallVector<std::pair<unsigned, InputArg>, 6> positionedArgs;
+  for (unsigned i = 0, e = options.argValues.size(); i < e; i++)
+    positionedArgs.push_back({options.argValues.getPosition(i),
+                              InputArg{options.argValues[i], false}});
+  for (unsigned i = 0, e = options.argFiles.size(); i < e; i++)
+    positionedArgs.push_back({options.argFiles.getPosition(i),
+                              InputArg{options.argFiles[i], true}});
+  llvm::sort(positionedArgs, llvm::less_first());
+  SmallVector<InputArg, 6> args;
+  for (auto &positionedArg : positionedArgs)
+    args.push_back(positionedArg.second);
+  SmallVector<StringRef, 6> outputFiles(options.outputFiles.begin(),
+                                        options.outputFiles.end());
+  SmallVector<int64_t, 4> specializedBatchSizes(
+      options.specializeBatchSizes.begin(), options.specializeBatchSizes.end());
+  NPCOMP::setNumCompileThreads(context, options.compileThreads);
+  refback::JITCompileOptions compileOptions;
+  compileOptions.optLevel = options.llvmOptLevel;
+  compileOptions.fastISel = options.fastISel;
+  compileOptions.cpu = options.cpu;
+  compileOptions.features = options.features;
+  compileOptions.lazy = options.lazy;
+  compileOptions.compileThreads = options.compileThreads;
+  compileOptions.streaming = options.streaming;
+  compileOptions.hugePageWeights = options.hugePageWeights;
+  BenchmarkOptions benchmarkOptions;
+  benchmarkOptions.iterations = options.benchmarkIterations;
+  benchmarkOptions.warmup = options.warmup;
+  benchmarkOptions.threads = options.threads;
+  benchmarkOptions.replay = options.benchmarkReplay;
+  benchmarkOptions.format = options.benchmarkFormat;
+  benchmarkOptions.roofline = options.roofline;
+  benchmarkOptions.flopsPerCall = options.flopsPerCall;
+  benchmarkOptions.bytesPerCall = options.bytesPerCall;
+  benchmarkOptions.peakGflops = options.peakGflops;
+  benchmarkOptions.peakGbps = options.peakGbps;
+  benchmarkOptions.minRooflineFraction = options.minRooflineFraction;
+  if (options.autotune && options.tuningDatabase.empty()) {
+    llvm::errs() << "Error: -autotune requires -tuning-database\n";
+    return EXIT_FAILURE;
+  }
+  refback::AutotuneOptions autotuneOptions;
+  autotuneOptions.iterations = options.autotuneIterations;
+  autotuneOptions.compileOptions = compileOptions;
+  autotuneOptions.sharedLibs.assign(sharedLibs.begin(), sharedLibs.end());
   Error error =
       compileAndRun(options.inputFile, context, options.invokeFunction,
-                    argValues, sharedLibs, options.optimize);
+                    args, outputFiles, sharedLibs, options.optimize,
+                    specializedBatchSizes, options.prefetchDistance,
+                    options.compileTimeReport,
+                    options.objectCacheDir,
+                    compileOptions, options.tuningDatabase,
+                    options.autotune ? &autotuneOptions : nullptr,
+                    options.compiledModule, options.interpret,
+                    options.opProfile, benchmarkOptions);
 
   int exitCode = EXIT_SUCCESS;
   llvm::handleAllErrors(std::move(error),
@@ -0,0 +1,688 @@
+//===------------------------------------------------------------*- C++ -*-===//
+//
+// This file is licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Serving benchmark of a compiled model.
+//
+// Loads a model once, then drives one of its functions from N concurrent
+// client threads for a fixed duration, as a server would be driven by its
+// connections. Each request has a size (the leading extent of the dynamic
+// inputs of the function) drawn from -request-sizes. The clients either send
+// their requests back to back (closed loop), or at the arrival times of a
+// Poisson process of -rate requests per second in total (open loop), in which
+// case the latency of a request counts from its arrival, including the time
+// it waited for its client to be done with the previous ones.
+//
+// Requests are served through one of the runtime's entry points:
+//
+//   invoke  JITModule::invoke on the client thread, which allocates the
+//           outputs of each request.
+//   into    PreparedCall::invokeInto on the client thread, with outputs
+//           preallocated per client and request size.
+//   async   JITModule::invokeAsync, which queues the request for the thread
+//           pool of the JITModule, the client waiting for its completion.
+//
+// It reports the achieved throughput, the latency percentiles overall and
+// per request size, the CPU time spent per request and the utilization of
+// the machine, and the resident memory before and after the load.
+//
+//===----------------------------------------------------------------------===//
+
+#include "mlir/IR/AsmState.h"
+#include "mlir/InitAllDialects.h"
+#include "mlir/InitAllPasses.h"
+#include "mlir/Pass/PassManager.h"
+#include "npcomp-c/InitLLVM.h"
+#include "npcomp/InitAll.h"
+#include "npcomp/RefBackend/JITHelpers/JITModule.h"
+#include "npcomp/RefBackend/RefBackend.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+using namespace mlir;
+using llvm::Error;
+using llvm::Expected;
+using llvm::StringError;
+using llvm::Twine;
+
+/// Wrap a string into an llvm::StringError.
+static Error make_string_error(const Twine &message) {
+  return llvm::make_error<StringError>(message.str(),
+                                       llvm::inconvertibleErrorCode());
+}
+
+//===----------------------------------------------------------------------===//
+// Loading the model.
+//===----------------------------------------------------------------------===//
+
+static Expected<std::unique_ptr<refback::JITModule>>
+loadModel(StringRef mlirFile, StringRef compiledModule, MLIRContext &context,
+          bool optimize, ArrayRef<int64_t> specializedBatchSizes) {
+  if (!compiledModule.empty())
+    return refback::JITModule::fromSharedObject(compiledModule);
+  OwningModuleRef moduleRef =
+      refback::JITModule::parseModuleFile(mlirFile, context);
+  if (!moduleRef)
+    return make_string_error(Twine("could not open ") + mlirFile);
+  PassManager pm(&context, OpPassManager::Nesting::Implicit);
+  applyPassManagerCLOptions(pm);
+  NPCOMP::RefBackendLoweringPipelineOptions pipelineOptions;
+  pipelineOptions.optimize = optimize;
+  pipelineOptions.specializeBatchSizes = specializedBatchSizes;
+  refback::JITModule::buildBackendCompilationPipeline(pm, pipelineOptions);
+  if (failed(pm.run(*moduleRef)))
+    return make_string_error("error compiling to jit backend");
+  return refback::JITModule::fromCompiledModule(*moduleRef,
+                                                /*sharedLibs=*/{});
+}
+
+// Returns the inputs of a request of `requestSize`: zero-filled tensors of
+// the shapes of the inputs of `metadata`, whose dynamic leading extents are
+// `requestSize`.
+static Expected<SmallVector<refbackrt::RtValue, 6>>
+createRequestInputs(const refbackrt::FunctionMetadata &metadata,
+                    StringRef functionName, int64_t requestSize) {
+  SmallVector<refbackrt::RtValue, 6> inputs;
+  for (int32_t i = 0; i < metadata.numInputs; i++) {
+    refbackrt::InputArgInfo info = metadata.inputArgInfos[i];
+    if (info.argType == refbackrt::ArgType::kTensor) {
+      if (info.rank < 0)
+        return make_string_error("'" + functionName + "': %arg" + Twine(i) +
+                                 " is unranked");
+      for (int32_t d = 0; d < info.rank; d++) {
+        if (info.extents[d] != -1)
+          continue;
+        if (d != 0)
+          return make_string_error(
+              "'" + functionName + "': %arg" + Twine(i) +
+              " has a dynamic extent other than the leading one");
+        info.extents[d] = requestSize;
+      }
+    }
+    inputs.push_back(refbackrt::createRtValueFromInputArgInfo(info));
+  }
+  return inputs;
+}
+
+//===----------------------------------------------------------------------===//
+// Load generation.
+//===----------------------------------------------------------------------===//
+
+namespace {
+enum class ServingApi { Invoke, Into, Async };
+enum class ReportFormat { Table, Json };
+
+struct LoadOptions {
+  unsigned clients = 1;
+  SmallVector<int64_t, 4> requestSizes;
+  // The total arrival rate in requests per second, or 0 for clients sending
+  // their requests back to back.
+  double rate = 0;
+  double durationSeconds = 10;
+  // The untimed requests of each size that each client sends first.
+  unsigned warmup = 2;
+  ServingApi api = ServingApi::Invoke;
+  unsigned seed = 0;
+};
+
+// The inputs and outputs of the requests of one size, owned by a client.
+struct RequestBuffers {
+  SmallVector<refbackrt::RtValue, 6> inputs;
+  // For ServingApi::Into.
+  Optional<refback::PreparedCall> call;
+  SmallVector<refbackrt::RtValue, 6> outputs;
+};
+
+struct Completion {
+  double latencyMs;
+  unsigned sizeIndex;
+};
+
+struct ClientResult {
+  std::vector<Completion> completions;
+  unsigned numErrors = 0;
+  std::string firstError;
+};
+} // namespace
+
+using Clock = std::chrono::steady_clock;
+
+static double getMilliseconds(Clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+// Returns the CPU time (user and system) of the process so far, in seconds.
+static double getProcessCpuSeconds() {
+#ifdef _WIN32
+  return 0;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage))
+    return 0;
+  auto seconds = [](const struct timeval &time) {
+    return time.tv_sec + time.tv_usec / 1e6;
+  };
+  return seconds(usage.ru_utime) + seconds(usage.ru_stime);
+#endif
+}
+
+// Returns the peak resident set size of the process in bytes, or 0 if it is
+// unknown.
+static std::uint64_t getPeakRSS() {
+#ifdef _WIN32
+  return 0;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage))
+    return 0;
+#ifdef __APPLE__
+  return usage.ru_maxrss;
+#else
+  return static_cast<std::uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+// Returns the current resident set size of the process in bytes, or 0 if it
+// is unknown.
+static std::uint64_t getCurrentRSS() {
+#ifdef __linux__
+  FILE *file = std::fopen("/proc/self/statm", "r");
+  if (!file)
+    return 0;
+  unsigned long long size = 0, resident = 0;
+  int numRead = std::fscanf(file, "%llu %llu", &size, &resident);
+  std::fclose(file);
+  if (numRead != 2)
+    return 0;
+  return resident * static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE));
+#else
+  return 0;
+#endif
+}
+
+// Sends the requests of one client until `deadline`.
+static void runClient(refback::JITModule &jitModule, StringRef functionName,
+                      const LoadOptions &options, unsigned client,
+                      MutableArrayRef<RequestBuffers> buffers,
+                      Clock::time_point start, Clock::time_point deadline,
+                      ClientResult &result) {
+  auto serve = [&](RequestBuffers &request) -> Error {
+    switch (options.api) {
+    case ServingApi::Invoke:
+      return jitModule.invoke(functionName, request.inputs).takeError();
+    case ServingApi::Into:
+      return request.call->invokeInto(request.inputs, request.outputs);
+    case ServingApi::Async:
+      return jitModule.invokeAsync(functionName, request.inputs)
+          .get()
+          .takeError();
+    }
+    llvm_unreachable("unknown serving API");
+  };
+
+  std::mt19937 generator(options.seed + client);
+  std::uniform_int_distribution<unsigned> sizeDistribution(
+      0, buffers.size() - 1);
+  // The arrivals of each client are a Poisson process of its share of the
+  // rate, so that the arrivals of all of them are one of the total rate.
+  std::exponential_distribution<double> interArrival(
+      options.rate > 0 ? options.rate / options.clients : 1);
+  Clock::time_point arrival = start;
+  result.completions.reserve(1024);
+  while (true) {
+    if (options.rate > 0) {
+      arrival += std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double>(interArrival(generator)));
+      if (arrival >= deadline)
+        break;
+      std::this_thread::sleep_until(arrival);
+    } else {
+      arrival = Clock::now();
+      if (arrival >= deadline)
+        break;
+    }
+    unsigned sizeIndex = sizeDistribution(generator);
+    if (Error error = serve(buffers[sizeIndex])) {
+      std::string message = llvm::toString(std::move(error));
+      if (result.numErrors++ == 0)
+        result.firstError = message;
+      continue;
+    }
+    result.completions.push_back(
+        {getMilliseconds(Clock::now() - arrival), sizeIndex});
+  }
+}
+
+namespace {
+struct LatencySummary {
+  size_t count = 0;
+  double p50 = 0, p90 = 0, p99 = 0, p999 = 0, max = 0, mean = 0;
+};
+
+struct ServingReport {
+  double durationSeconds;
+  size_t numRequests;
+  unsigned numErrors;
+  double qps;
+  LatencySummary latency;
+  // Per request size, in the order of LoadOptions::requestSizes.
+  std::vector<LatencySummary> latencyBySize;
+  double cpuSeconds;
+  double cpuMsPerRequest;
+  unsigned numCores;
+  // The cores kept busy on average, and the fraction of the machine.
+  double coresUsed;
+  double cpuUtilization;
+  std::uint64_t rssBeforeBytes;
+  std::uint64_t rssAfterBytes;
+  std::uint64_t peakRssBytes;
+};
+} // namespace
+
+// Returns the nearest-rank `percentile` of the sorted `values`.
+static double getPercentile(ArrayRef<double> values, double percentile) {
+  size_t rank =
+      static_cast<size_t>(std::ceil(percentile / 100 * values.size()));
+  return values[std::max<size_t>(rank, 1) - 1];
+}
+
+static LatencySummary summarize(std::vector<double> latencies) {
+  LatencySummary summary;
+  summary.count = latencies.size();
+  if (latencies.empty())
+    return summary;
+  llvm::sort(latencies);
+  summary.p50 = getPercentile(latencies, 50);
+  summary.p90 = getPercentile(latencies, 90);
+  summary.p99 = getPercentile(latencies, 99);
+  summary.p999 = getPercentile(latencies, 99.9);
+  summary.max = latencies.back();
+  double total = 0;
+  for (double latency : latencies)
+    total += latency;
+  summary.mean = total / latencies.size();
+  return summary;
+}
+
+static Expected<ServingReport> runLoad(refback::JITModule &jitModule,
+                                       StringRef functionName,
+                                       const LoadOptions &options) {
+  auto metadata = jitModule.getMetadata(functionName);
+  if (!metadata)
+    return metadata.takeError();
+
+  // Each client owns the buffers of its requests, as the connections of a
+  // server would, and warms up on its own thread: the allocator pools and
+  // scratch arenas of the runtime are per-thread.
+  unsigned numClients = std::max(options.clients, 1u);
+  std::vector<std::vector<RequestBuffers>> clientBuffers(numClients);
+  for (auto &buffers : clientBuffers) {
+    for (int64_t requestSize : options.requestSizes) {
+      RequestBuffers request;
+      auto inputs = createRequestInputs(*metadata, functionName, requestSize);
+      if (!inputs)
+        return inputs.takeError();
+      request.inputs = std::move(*inputs);
+      if (options.api == ServingApi::Into) {
+        auto call = jitModule.prepare(functionName, request.inputs);
+        if (!call)
+          return call.takeError();
+        request.outputs = call->createOutputs();
+        request.call = std::move(*call);
+      }
+      buffers.push_back(std::move(request));
+    }
+  }
+  std::vector<std::string> warmupErrors(numClients);
+  {
+    std::vector<std::thread> threads;
+    for (unsigned client = 0; client < numClients; client++) {
+      threads.emplace_back([&, client] {
+        for (RequestBuffers &request : clientBuffers[client]) {
+          for (unsigned i = 0; i < options.warmup; i++) {
+            auto outputs = jitModule.invoke(functionName, request.inputs);
+            if (!outputs) {
+              warmupErrors[client] = llvm::toString(outputs.takeError());
+              return;
+            }
+          }
+        }
+      });
+    }
+    for (std::thread &thread : threads)
+      thread.join();
+  }
+  for (const std::string &error : warmupErrors)
+    if (!error.empty())
+      return make_string_error("warming up: " + error);
+
+  ServingReport report;
+  report.rssBeforeBytes = getCurrentRSS();
+  double cpuStart = getProcessCpuSeconds();
+  std::vector<ClientResult> results(numClients);
+  Clock::time_point start = Clock::now();
+  Clock::time_point deadline =
+      start + std::chrono::duration_cast<Clock::duration>(
+                  std::chrono::duration<double>(options.durationSeconds));
+  {
+    std::vector<std::thread> threads;
+    for (unsigned client = 0; client < numClients; client++)
+      threads.emplace_back(runClient, std::ref(jitModule), functionName,
+                           std::cref(options), client,
+                           MutableArrayRef<RequestBuffers>(
+                               clientBuffers[client]),
+                           start, deadline, std::ref(results[client]));
+    for (std::thread &thread : threads)
+      thread.join();
+  }
+  // The requests in flight at the deadline complete after it.
+  report.durationSeconds = getMilliseconds(Clock::now() - start) / 1000;
+  report.cpuSeconds = getProcessCpuSeconds() - cpuStart;
+  report.rssAfterBytes = getCurrentRSS();
+  report.peakRssBytes = getPeakRSS();
+
+  std::vector<double> latencies;
+  std::vector<std::vector<double>> latenciesBySize(
+      options.requestSizes.size());
+  report.numErrors = 0;
+  std::string firstError;
+  for (const ClientResult &result : results) {
+    for (const Completion &completion : result.completions) {
+      latencies.push_back(completion.latencyMs);
+      latenciesBySize[completion.sizeIndex].push_back(completion.latencyMs);
+    }
+    if (result.numErrors != 0 && firstError.empty())
+      firstError = result.firstError;
+    report.numErrors += result.numErrors;
+  }
+  if (latencies.empty()) {
+    if (!firstError.empty())
+      return make_string_error("all requests failed: " + firstError);
+    return make_string_error("no request completed: increase -duration or "
+                             "-rate");
+  }
+  if (!firstError.empty())
+    llvm::errs() << "warning: " << report.numErrors
+                 << " requests failed, the first with: " << firstError << "\n";
+  report.numRequests = latencies.size();
+  report.qps = report.numRequests / report.durationSeconds;
+  report.latency = summarize(std::move(latencies));
+  for (auto &sizeLatencies : latenciesBySize)
+    report.latencyBySize.push_back(summarize(std::move(sizeLatencies)));
+  report.cpuMsPerRequest = report.cpuSeconds * 1000 / report.numRequests;
+  report.numCores = std::max(std::thread::hardware_concurrency(), 1u);
+  report.coresUsed = report.cpuSeconds / report.durationSeconds;
+  report.cpuUtilization = report.coresUsed / report.numCores;
+  return report;
+}
+
+//===----------------------------------------------------------------------===//
+// Reporting.
+//===----------------------------------------------------------------------===//
+
+static StringRef getApiName(ServingApi api) {
+  switch (api) {
+  case ServingApi::Invoke:
+    return "invoke";
+  case ServingApi::Into:
+    return "into";
+  case ServingApi::Async:
+    return "async";
+  }
+  llvm_unreachable("unknown serving API");
+}
+
+static double getMiB(std::uint64_t bytes) { return bytes / (1024.0 * 1024.0); }
+
+static void printJson(StringRef functionName, const LoadOptions &options,
+                      double loadTime, const ServingReport &report,
+                      llvm::raw_ostream &os) {
+  llvm::json::OStream json(os, /*IndentSize=*/2);
+  auto writeLatency = [&](const LatencySummary &summary) {
+    json.attribute("count", static_cast<int64_t>(summary.count));
+    json.attributeObject("latency_ms", [&] {
+      json.attribute("mean", summary.mean);
+      json.attribute("p50", summary.p50);
+      json.attribute("p90", summary.p90);
+      json.attribute("p99", summary.p99);
+      json.attribute("p999", summary.p999);
+      json.attribute("max", summary.max);
+    });
+  };
+  json.object([&] {
+    json.attribute("function", functionName);
+    json.attribute("api", getApiName(options.api));
+    json.attribute("clients", options.clients);
+    json.attribute("offered_rate_qps", options.rate);
+    json.attribute("load_time_ms", loadTime);
+    json.attribute("duration_s", report.durationSeconds);
+    json.attribute("requests", static_cast<int64_t>(report.numRequests));
+    json.attribute("errors", report.numErrors);
+    json.attribute("qps", report.qps);
+    writeLatency(report.latency);
+    json.attributeArray("by_request_size", [&] {
+      for (size_t i = 0, e = options.requestSizes.size(); i < e; i++) {
+        json.object([&] {
+          json.attribute("request_size", options.requestSizes[i]);
+          writeLatency(report.latencyBySize[i]);
+        });
+      }
+    });
+    json.attributeObject("cpu", [&] {
+      json.attribute("seconds", report.cpuSeconds);
+      json.attribute("ms_per_request", report.cpuMsPerRequest);
+      json.attribute("cores", report.numCores);
+      json.attribute("cores_used", report.coresUsed);
+      json.attribute("utilization", report.cpuUtilization);
+    });
+    json.attributeObject("memory_mib", [&] {
+      json.attribute("rss_before", getMiB(report.rssBeforeBytes));
+      json.attribute("rss_after", getMiB(report.rssAfterBytes));
+      json.attribute("peak_rss", getMiB(report.peakRssBytes));
+    });
+  });
+  os << "\n";
+}
+
+static void printTable(StringRef functionName, const LoadOptions &options,
+                       double loadTime, const ServingReport &report,
+                       llvm::raw_ostream &os) {
+  os << "serving '" << functionName << "' through " << getApiName(options.api)
+     << " from " << options.clients << " clients, ";
+  if (options.rate > 0)
+    os << llvm::format("%.1f requests/s offered\n", options.rate);
+  else
+    os << "closed loop\n";
+  os << llvm::format("load time:           %12.3f ms\n", loadTime)
+     << llvm::format("duration:            %12.3f s\n", report.durationSeconds)
+     << llvm::format("requests:            %12zu", report.numRequests)
+     << " (" << report.numErrors << " errors)\n"
+     << llvm::format("throughput:          %12.1f requests/s\n", report.qps)
+     << llvm::format("mean latency:        %12.3f ms\n", report.latency.mean)
+     << llvm::format("p50 latency:         %12.3f ms\n", report.latency.p50)
+     << llvm::format("p90 latency:         %12.3f ms\n", report.latency.p90)
+     << llvm::format("p99 latency:         %12.3f ms\n", report.latency.p99)
+     << llvm::format("p99.9 latency:       %12.3f ms\n", report.latency.p999)
+     << llvm::format("max latency:         %12.3f ms\n", report.latency.max)
+     << llvm::format("CPU per request:     %12.3f ms\n",
+                     report.cpuMsPerRequest)
+     << llvm::format("CPU utilization:     %11.1f%%",
+                     report.cpuUtilization * 100)
+     << llvm::format(" (%.2f of %u cores)\n", report.coresUsed,
+                     report.numCores)
+     << llvm::format("RSS:                 %12.1f MiB",
+                     getMiB(report.rssAfterBytes))
+     << llvm::format(" (%.1f MiB before the load)\n",
+                     getMiB(report.rssBeforeBytes))
+     << llvm::format("peak RSS:            %12.1f MiB\n",
+                     getMiB(report.peakRssBytes));
+  if (options.requestSizes.size() < 2)
+    return;
+  os << "  Size   Requests   p50 (ms)   p99 (ms)\n";
+  for (size_t i = 0, e = options.requestSizes.size(); i < e; i++) {
+    const LatencySummary &summary = report.latencyBySize[i];
+    os << llvm::format("  %4lld %10zu %10.3f %10.3f\n",
+                       static_cast<long long>(options.requestSizes[i]),
+                       summary.count, summary.p50, summary.p99);
+  }
+}
+
+//===----------------------------------------------------------------------===//
+// Main-related init and option parsing.
+//===----------------------------------------------------------------------===//
+
+namespace {
+namespace cl = llvm::cl;
+struct Options {
+  cl::opt<std::string> inputFile{
+      cl::Positional, cl::desc("the input .mlir file"), cl::init("-")};
+  cl::opt<std::string> compiledModule{
+      "compiled-module", cl::Optional,
+      cl::desc("shared object produced by npcomp-compile to serve instead of "
+               "compiling the input"),
+      cl::init("")};
+  cl::opt<std::string> invokeFunction{"invoke", cl::Required,
+                                      cl::desc("function to serve")};
+  cl::opt<bool> optimize{
+      "optimize", cl::Optional,
+      cl::desc("whether the refback pass pipeline should run optimizations"),
+      cl::init(true)};
+  cl::list<int64_t> specializeBatchSizes{
+      "specialize-batch-sizes", cl::ZeroOrMore, cl::MiscFlags::CommaSeparated,
+      cl::desc("batch sizes to compile static variants of the functions for, "
+               "which requests of matching sizes dispatch to")};
+  cl::opt<unsigned> clients{
+      "clients", cl::Optional,
+      cl::desc("the number of client threads sending requests concurrently"),
+      cl::init(1)};
+  cl::list<int64_t> requestSizes{
+      "request-sizes", cl::ZeroOrMore, cl::MiscFlags::CommaSeparated,
+      cl::desc("the sizes of the requests (the leading extent of the dynamic "
+               "inputs), each drawn uniformly (default: 1)")};
+  cl::opt<double> rate{
+      "rate", cl::Optional,
+      cl::desc("the total arrival rate of the requests per second, as a "
+               "Poisson process (0 for clients sending back to back)"),
+      cl::init(0)};
+  cl::opt<double> duration{
+      "duration", cl::Optional,
+      cl::desc("the seconds during which the clients send requests"),
+      cl::init(10)};
+  cl::opt<unsigned> warmup{
+      "warmup", cl::Optional,
+      cl::desc("the untimed requests of each size that each client sends "
+               "first"),
+      cl::init(2)};
+  cl::opt<ServingApi> api{
+      "api", cl::Optional, cl::desc("the runtime entry point serving requests"),
+      cl::values(clEnumValN(ServingApi::Invoke, "invoke",
+                            "JITModule::invoke on the client thread"),
+                 clEnumValN(ServingApi::Into, "into",
+                            "PreparedCall::invokeInto with preallocated "
+                            "outputs"),
+                 clEnumValN(ServingApi::Async, "async",
+                            "JITModule::invokeAsync on its thread pool")),
+      cl::init(ServingApi::Invoke)};
+  cl::opt<unsigned> seed{
+      "seed", cl::Optional,
+      cl::desc("the seed of the request sizes and arrival times"),
+      cl::init(0)};
+  cl::opt<ReportFormat> format{
+      "format", cl::Optional, cl::desc("the format of the report"),
+      cl::values(clEnumValN(ReportFormat::Table, "table", "a text table"),
+                 clEnumValN(ReportFormat::Json, "json", "a JSON object")),
+      cl::init(ReportFormat::Table)};
+};
+} // namespace
+
+static Error runServingBenchmark(const Options &options,
+                                 MLIRContext &context) {
+  LoadOptions loadOptions;
+  loadOptions.clients = options.clients;
+  loadOptions.requestSizes.assign(options.requestSizes.begin(),
+                                  options.requestSizes.end());
+  if (loadOptions.requestSizes.empty())
+    loadOptions.requestSizes.push_back(1);
+  if (llvm::any_of(loadOptions.requestSizes,
+                   [](int64_t size) { return size <= 0; }))
+    return make_string_error("request sizes must be positive");
+  if (options.clients == 0)
+    return make_string_error("there must be at least one client");
+  if (options.rate < 0 || options.duration <= 0)
+    return make_string_error("-rate must be non-negative, and -duration "
+                             "positive");
+  loadOptions.rate = options.rate;
+  loadOptions.durationSeconds = options.duration;
+  loadOptions.warmup = options.warmup;
+  loadOptions.api = options.api;
+  loadOptions.seed = options.seed;
+
+  Clock::time_point loadStart = Clock::now();
+  SmallVector<int64_t, 4> specializedBatchSizes(
+      options.specializeBatchSizes.begin(), options.specializeBatchSizes.end());
+  auto jitModule = loadModel(options.inputFile, options.compiledModule,
+                             context, options.optimize, specializedBatchSizes);
+  if (!jitModule)
+    return jitModule.takeError();
+  double loadTime = getMilliseconds(Clock::now() - loadStart);
+
+  auto report = runLoad(**jitModule, options.invokeFunction, loadOptions);
+  if (!report)
+    return report.takeError();
+  if (options.format == ReportFormat::Json)
+    printJson(options.invokeFunction, loadOptions, loadTime, *report,
+              llvm::outs());
+  else
+    printTable(options.invokeFunction, loadOptions, loadTime, *report,
+               llvm::outs());
+  return Error::success();
+}
+
+int main(int argc, char **argv) {
+  mlir::DialectRegistry registry;
+  mlir::registerAllDialects(registry);
+  mlir::registerAllPasses();
+  mlir::NPCOMP::registerAllDialects(registry);
+  mlir::NPCOMP::registerAllPasses();
+  MLIRContext context;
+  context.appendDialectRegistry(registry);
+  context.loadAllAvailableDialects();
+
+  llvm::InitLLVM y(argc, argv);
+  npcompInitializeLLVMCodegen();
+
+  mlir::registerAsmPrinterCLOptions();
+  mlir::registerPassManagerCLOptions();
+  Options options;
+  llvm::cl::ParseCommandLineOptions(argc, argv,
+                                    "npcomp serving benchmark\n");
+
+  Error error = runServingBenchmark(options, context);
+
+  int exitCode = EXIT_SUCCESS;
+  llvm::handleAllErrors(std::move(error),
+                        [&exitCode](const llvm::ErrorInfoBase &info) {
+                          llvm::errs() << "Error: ";
+                          info.log(llvm::errs());
+                          llvm::errs() << '\n';
+                          exitCode = EXIT_FAILURE;
+                        });
+  return exitCode;
+}